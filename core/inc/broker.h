@@ -53,6 +53,42 @@ typedef struct BROKER_LINK_DATA_TAG {
 */
 DEFINE_ENUM(BROKER_RESULT, BROKER_RESULT_VALUES);
 
+#define BROKER_ALERT_VALUES \
+    BROKER_ALERT_INBOX_HIGH_WATERMARK, \
+    BROKER_ALERT_MESSAGE_DROPPED, \
+    BROKER_ALERT_RECEIVE_SLOW, \
+    BROKER_ALERT_MODULE_DETACHED
+
+/** @brief    Enumeration describing the conditions reported to the
+*            #BROKER_ALERT_CALLBACK.
+*/
+DEFINE_ENUM(BROKER_ALERT, BROKER_ALERT_VALUES);
+
+/** @brief    Thresholds of the alerts the broker measures, 0 disables an
+*            alert.
+*/
+typedef struct BROKER_ALERT_THRESHOLDS_TAG {
+    /** @brief    Number of messages waiting for a module above which
+    *            #BROKER_ALERT_INBOX_HIGH_WATERMARK is reported.
+    */
+    size_t inbox_high_watermark;
+    /** @brief    Milliseconds a call to the Receive function of a module may
+    *            take before #BROKER_ALERT_RECEIVE_SLOW is reported.
+    */
+    size_t receive_budget_ms;
+} BROKER_ALERT_THRESHOLDS;
+
+/** @brief    Function called on the thread that detected an alert.
+*
+*    @details    @c value is the number of messages waiting for
+*                #BROKER_ALERT_INBOX_HIGH_WATERMARK, the number of messages
+*                lost for #BROKER_ALERT_MESSAGE_DROPPED and the milliseconds
+*                the call took for #BROKER_ALERT_RECEIVE_SLOW. @c threshold is
+*                the threshold that was crossed, or 0. The function is called
+*                with broker locks held and shall not call the broker.
+*/
+typedef void(*BROKER_ALERT_CALLBACK)(void* context, BROKER_ALERT alert, MODULE_HANDLE module, size_t value, size_t threshold);
+
 /** @brief        Creates a new message broker.
 *   
 *    @return        A valid #BROKER_HANDLE upon success, or @c NULL upon failure.
@@ -144,6 +180,139 @@ GATEWAY_EXPORT BROKER_RESULT Broker_AddLink(BROKER_HANDLE broker, const BROKER_L
 */
 GATEWAY_EXPORT BROKER_RESULT Broker_RemoveLink(BROKER_HANDLE broker, const BROKER_LINK_DATA* link);
 
+/** @brief        Removes and adds routes of the message broker at one point of
+*                the message stream.
+*
+*    @details    The route changes are sent to the sinks in-band, behind the
+*                messages already published. A message published before this
+*                call is delivered with the former routes, a message
+*                published after it with the new routes. The sinks must be
+*                attached to the broker, and the sources of the added routes
+*                too. If any route cannot be changed, none are.
+*
+*    @param        broker              The #BROKER_HANDLE whose routes change.
+*    @param        links_to_remove     The routes to remove.
+*    @param        remove_count        The number of routes in links_to_remove.
+*    @param        links_to_add        The routes to add.
+*    @param        add_count           The number of routes in links_to_add.
+*
+*    @return        A #BROKER_RESULT describing the result of the function.
+*/
+GATEWAY_EXPORT BROKER_RESULT Broker_UpdateLinks(BROKER_HANDLE broker, const BROKER_LINK_DATA* links_to_remove, size_t remove_count, const BROKER_LINK_DATA* links_to_add, size_t add_count);
+
+/** @brief        Removes a module from the message broker once it received the
+*                messages already published to it.
+*
+*    @details    Unlike ::Broker_RemoveModule, the messages queued for the
+*                module are delivered before its thread stops. The module may
+*                publish while it drains.
+*
+*    @param        broker    The #BROKER_HANDLE from which the module will be removed.
+*    @param        module    The #MODULE of the module to be removed.
+*
+*    @return        A #BROKER_RESULT describing the result of the function.
+*/
+GATEWAY_EXPORT BROKER_RESULT Broker_DrainModule(BROKER_HANDLE broker, const MODULE* module);
+
+/** @brief        Routes the messages published with another handle as if a
+*                module attached to the broker published them.
+*
+*    @details    A module standing in for another one, such as a module
+*                created on its first message, is attached to the broker and
+*                linked in its place. The module it stands for publishes with
+*                its own handle, the alias; its messages reach the sinks
+*                linked to @c module.
+*
+*    @param        broker    The #BROKER_HANDLE onto which the module is attached.
+*    @param        module    The #MODULE of the attached module.
+*    @param        alias     The #MODULE_HANDLE the messages are published with.
+*
+*    @return        A #BROKER_RESULT describing the result of the function.
+*/
+GATEWAY_EXPORT BROKER_RESULT Broker_AddModuleAlias(BROKER_HANDLE broker, const MODULE* module, MODULE_HANDLE alias);
+
+/** @brief        Stops routing the messages published with an alias.
+*
+*    @param        broker    The #BROKER_HANDLE holding the alias.
+*    @param        alias     The #MODULE_HANDLE given to ::Broker_AddModuleAlias.
+*
+*    @return        A #BROKER_RESULT describing the result of the function.
+*/
+GATEWAY_EXPORT BROKER_RESULT Broker_RemoveModuleAlias(BROKER_HANDLE broker, MODULE_HANDLE alias);
+
+/** @brief        Delivers the messages of a route on the thread of the
+*                publisher instead of the sink's thread.
+*
+*    @details    Once fused, ::Broker_Publish passes the messages of the
+*                source to the sink's @c Receive directly, without copying
+*                them nor queueing them; the sink receives one message at a
+*                time. The sink must be the only sink of the source, the
+*                broker does not send the messages of a fused source to its
+*                other sinks. A source has at most one fused route and a sink
+*                at most one fused route to it, and the fused routes cannot
+*                make a cycle. The messages of the source queued for the sink
+*                when the route is fused are dropped, so a route is fused
+*                before its source publishes.
+*
+*    @param        broker    The #BROKER_HANDLE holding the route.
+*    @param        link      The #BROKER_LINK_DATA of the route to fuse.
+*
+*    @return        A #BROKER_RESULT describing the result of the function.
+*/
+GATEWAY_EXPORT BROKER_RESULT Broker_FuseLink(BROKER_HANDLE broker, const BROKER_LINK_DATA* link);
+
+/** @brief        Queues the messages of a fused route for the sink again.
+*
+*    @details    Returns once the sink received the message being delivered
+*                on the thread of a publisher, if any.
+*
+*    @param        broker    The #BROKER_HANDLE holding the route.
+*    @param        link      The #BROKER_LINK_DATA given to ::Broker_FuseLink.
+*
+*    @return        A #BROKER_RESULT describing the result of the function.
+*/
+GATEWAY_EXPORT BROKER_RESULT Broker_UnfuseLink(BROKER_HANDLE broker, const BROKER_LINK_DATA* link);
+
+/** @brief        Sets the function the broker reports its alerts to.
+*
+*    @details    The first call shall happen before a module is attached, as
+*                the broker only counts the messages waiting for the modules
+*                attached after it. Later calls replace or, with a @c NULL
+*                @c callback, stop the reporting and return once the alert
+*                being reported, if any, is handled.
+*
+*    @param        broker      The #BROKER_HANDLE reporting the alerts.
+*    @param        callback    The #BROKER_ALERT_CALLBACK, or @c NULL.
+*    @param        context     Passed to @c callback.
+*
+*    @return        A #BROKER_RESULT describing the result of the function.
+*/
+GATEWAY_EXPORT BROKER_RESULT Broker_SetAlertCallback(BROKER_HANDLE broker, BROKER_ALERT_CALLBACK callback, void* context);
+
+/** @brief        Sets the thresholds of the alerts the broker measures.
+*
+*    @details    The thresholds are read without a lock by the threads
+*                delivering the messages, a change applies to the messages
+*                delivered after it.
+*
+*    @param        broker        The #BROKER_HANDLE reporting the alerts.
+*    @param        thresholds    The #BROKER_ALERT_THRESHOLDS to copy.
+*
+*    @return        A #BROKER_RESULT describing the result of the function.
+*/
+GATEWAY_EXPORT BROKER_RESULT Broker_SetAlertThresholds(BROKER_HANDLE broker, const BROKER_ALERT_THRESHOLDS* thresholds);
+
+/** @brief        Reports an alert detected outside of the broker, such as a
+*                proxy module losing its remote module.
+*
+*    @param        broker       The #BROKER_HANDLE the module is attached to.
+*    @param        alert        The #BROKER_ALERT to report.
+*    @param        module       The #MODULE_HANDLE of the module.
+*    @param        value        See #BROKER_ALERT_CALLBACK.
+*    @param        threshold    See #BROKER_ALERT_CALLBACK.
+*/
+GATEWAY_EXPORT void Broker_ReportAlert(BROKER_HANDLE broker, BROKER_ALERT alert, MODULE_HANDLE module, size_t value, size_t threshold);
+
 /** @brief      Disposes of resources allocated by a message broker.
 *
 *    @param      broker  The #BROKER_HANDLE to be destroyed.
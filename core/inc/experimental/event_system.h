@@ -30,6 +30,9 @@ typedef struct GATEWAY_MODULE_INFO_TAG
      *  If the handle == NULL this module receives data from all other modules. 
      */
     VECTOR_HANDLE module_sources;
+
+    /** @brief  The handle of the module, which the alert events refer to */
+    MODULE_HANDLE module_handle;
 } GATEWAY_MODULE_INFO;
 
 /** @brief      Enum representing different gateway events that have support
@@ -52,6 +55,37 @@ typedef enum GATEWAY_EVENT_TAG
     /** @brief  Called when the gateway is destroyed. */
     GATEWAY_DESTROYED,
 
+    /** @brief  Called when more messages than the inbox high watermark wait
+     *          for a module, once until its inbox empties.
+     *
+     *  A #GATEWAY_ALERT_CONTEXT is provided as the context; @c value is the
+     *  number of messages waiting and @c threshold the watermark.
+     */
+    GATEWAY_MODULE_INBOX_HIGH_WATERMARK,
+
+    /** @brief  Called when a message published by or sent to a module is
+     *          lost.
+     *
+     *  A #GATEWAY_ALERT_CONTEXT is provided as the context; @c value is the
+     *  number of messages lost.
+     */
+    GATEWAY_MESSAGE_DROPPED,
+
+    /** @brief  Called when the Receive function of a module took longer than
+     *          the receive budget.
+     *
+     *  A #GATEWAY_ALERT_CONTEXT is provided as the context; @c value is the
+     *  milliseconds the call took and @c threshold the budget.
+     */
+    GATEWAY_MODULE_RECEIVE_SLOW,
+
+    /** @brief  Called when an out of process module lost its remote module
+     *          and starts attaching again.
+     *
+     *  A #GATEWAY_ALERT_CONTEXT is provided as the context.
+     */
+    GATEWAY_OUTPROCESS_DETACHED,
+
     /* @brief   Not an actual event, used to keep track of count of different
      *          events
      */
@@ -66,6 +100,32 @@ typedef enum GATEWAY_EVENT_TAG
  */
 typedef void* GATEWAY_EVENT_CTX;
 
+/** @brief      Context of the alert events, copied for the callbacks. */
+typedef struct GATEWAY_ALERT_CONTEXT_TAG
+{
+    /** @brief  The module the alert is about, see
+     *          #GATEWAY_MODULE_INFO::module_handle */
+    MODULE_HANDLE module_handle;
+
+    /** @brief  The measured value, see #GATEWAY_EVENT */
+    size_t value;
+
+    /** @brief  The threshold that was crossed, or 0 */
+    size_t threshold;
+} GATEWAY_ALERT_CONTEXT;
+
+/** @brief      Thresholds of the alert events, 0 disables an event. */
+typedef struct GATEWAY_ALERT_THRESHOLDS_TAG
+{
+    /** @brief  Number of messages waiting for a module above which
+     *          #GATEWAY_MODULE_INBOX_HIGH_WATERMARK is reported */
+    size_t inbox_high_watermark;
+
+    /** @brief  Milliseconds a call to the Receive function of a module may
+     *          take before #GATEWAY_MODULE_RECEIVE_SLOW is reported */
+    size_t receive_budget_ms;
+} GATEWAY_ALERT_THRESHOLDS;
+
 /** @brief      Function pointer that can be registered and will be called for
  *              gateway events 
  *
@@ -76,6 +136,7 @@ typedef void(*GATEWAY_CALLBACK)(GATEWAY_HANDLE gateway, GATEWAY_EVENT event_type
 EVENTSYSTEM_HANDLE EventSystem_Init(void);
 void EventSystem_AddEventCallback(EVENTSYSTEM_HANDLE event_system, GATEWAY_EVENT event_type, GATEWAY_CALLBACK callback, void* user_param);
 void EventSystem_ReportEvent(EVENTSYSTEM_HANDLE event_system, GATEWAY_HANDLE gw, GATEWAY_EVENT event_type);
+void EventSystem_ReportAlert(EVENTSYSTEM_HANDLE event_system, GATEWAY_HANDLE gw, GATEWAY_EVENT event_type, const GATEWAY_ALERT_CONTEXT* alert);
 void EventSystem_Destroy(EVENTSYSTEM_HANDLE event_system);
 
 /** @brief      Registers a function to be called on a callback thread when_all
@@ -92,6 +153,21 @@ void EventSystem_Destroy(EVENTSYSTEM_HANDLE event_system);
  */
 void Gateway_AddEventCallback(GATEWAY_HANDLE gw, GATEWAY_EVENT event_type, GATEWAY_CALLBACK callback, void* user_param);
 
+/** @brief      Sets the thresholds of #GATEWAY_MODULE_INBOX_HIGH_WATERMARK
+ *              and #GATEWAY_MODULE_RECEIVE_SLOW, which are disabled until
+ *              then.
+ *
+ *  @details    The alert events are reported from the threads delivering the
+ *              messages, and the callbacks are called on the event thread
+ *              like for the other events.
+ *
+ *  @param      gw          The #GATEWAY_HANDLE measuring the alerts
+ *  @param      thresholds  The #GATEWAY_ALERT_THRESHOLDS to copy
+ *
+ *  @return     0 on success, non-zero otherwise.
+ */
+int Gateway_SetAlertThresholds(GATEWAY_HANDLE gw, const GATEWAY_ALERT_THRESHOLDS* thresholds);
+
 /** @brief      Returns a snapshot copy of information about running modules.
  *
  *              Since this function allocates new memory for the snapshot, the
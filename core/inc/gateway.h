@@ -52,7 +52,8 @@ DEFINE_ENUM(GATEWAY_START_RESULT, GATEWAY_START_RESULT_VALUES);
     GATEWAY_UPDATE_FROM_JSON_INVALID_ARG, \
     GATEWAY_UPDATE_FROM_JSON_MEMORY
 
-/** @brief      Enumeration describing the result of ::Gateway_UpdateFromJson.
+/** @brief      Enumeration describing the result of ::Gateway_UpdateFromJson
+ *              and ::Gateway_ReconfigureFromJson.
 */
 DEFINE_ENUM(GATEWAY_UPDATE_FROM_JSON_RESULT, GATEWAY_UPDATE_FROM_JSON_RESULT_VALUES);
 
@@ -177,6 +178,28 @@ GATEWAY_EXPORT GATEWAY_HANDLE Gateway_CreateFromJson(const char* file_path);
  */
 GATEWAY_EXPORT GATEWAY_UPDATE_FROM_JSON_RESULT Gateway_UpdateFromJson(GATEWAY_HANDLE gw, const char* json_content);
 
+/** @brief      Reconfigures a running gateway to the complete graph described
+ *              by a JSON configuration string.
+ *
+ *  @details    Unlike ::Gateway_UpdateFromJson, the JSON describes every
+ *              module and link the gateway shall have afterwards. Modules
+ *              whose JSON entry is unchanged keep running, other modules
+ *              are created, replaced or removed, and only the links that
+ *              differ are changed. A message published before the links
+ *              change is delivered with the former links, a message
+ *              published after it with the new ones. Modules that are
+ *              replaced or removed receive the messages already published
+ *              to them before they are destroyed. Upon failure the gateway
+ *              is left unchanged.
+ *
+ *  @param      gw          Pointer to a #GATEWAY_HANDLE to reconfigure.
+ *  @param      json_content A JSON string with a list of Loaders, and the
+ *                          complete lists of Modules and Links.
+ *
+ *  @return     A GATEWAY_UPDATE_FROM_JSON_RESULT with the operation result.
+ */
+GATEWAY_EXPORT GATEWAY_UPDATE_FROM_JSON_RESULT Gateway_ReconfigureFromJson(GATEWAY_HANDLE gw, const char* json_content);
+
 /** @brief      Creates a new gateway using the provided #GATEWAY_PROPERTIES.
  *
  *  @param      properties      #GATEWAY_PROPERTIES structure containing
@@ -195,6 +218,23 @@ GATEWAY_EXPORT GATEWAY_HANDLE Gateway_Create(const GATEWAY_PROPERTIES* propertie
  */
 GATEWAY_EXPORT GATEWAY_START_RESULT Gateway_Start(GATEWAY_HANDLE gw);
 
+/** @brief      Makes the gateway fuse the links of linear chains of native
+ *              modules when it starts.
+ *
+ *  @details    A link is fused when its source publishes only to its sink
+ *              and its sink receives only from its source, both modules
+ *              being native and the gateway having no link from "*". The
+ *              broker passes the messages of a fused link to the sink on
+ *              the thread of the source, without copying them. Adding or
+ *              removing links, or reconfiguring the gateway, turns the
+ *              affected links back into queued links.
+ *
+ *  @param      gw      #GATEWAY_HANDLE of a gateway not started yet.
+ *
+ *  @return     Zero on success, non-zero if @c gw is @c NULL or started.
+ */
+GATEWAY_EXPORT int Gateway_EnableLinkFusion(GATEWAY_HANDLE gw);
+
 /** @brief      Destroys the gateway and disposes of all associated data.
  *
  *  @param      gw      #GATEWAY_HANDLE to be destroyed.
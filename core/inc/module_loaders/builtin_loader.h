@@ -0,0 +1,77 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file       builtin_loader.h
+ *  @brief      Library for loading modules linked into the gateway program.
+ *
+ *  @details    A module built with BUILD_MODULE_TYPE_STATIC exports its API
+ *              through its MODULE_STATIC_GETAPI entry point. The program
+ *              registers that entry point under a name, and the JSON
+ *              configuration refers to the module by that name:
+ *
+ *              "loader": {
+ *                  "name": "builtin",
+ *                  "entrypoint": { "module.name": "logger" }
+ *              }
+ *
+ *              Loading such a module neither opens a library nor looks up a
+ *              symbol.
+ */
+
+#ifndef BUILTIN_LOADER_H
+#define BUILTIN_LOADER_H
+
+#include "azure_c_shared_utility/strings.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#include "module.h"
+#include "module_loader.h"
+#include "gateway_export.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define BUILTIN_LOADER_NAME "builtin"
+
+/** @brief Structure to load a module linked into the program */
+typedef struct BUILTIN_LOADER_ENTRYPOINT_TAG
+{
+    /** @brief the name the module was registered with */
+    STRING_HANDLE moduleName;
+} BUILTIN_LOADER_ENTRYPOINT;
+
+/** @brief      The API for the builtin module loader. */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT const MODULE_LOADER*, BuiltinLoader_Get);
+
+/** @brief      Registers a module linked into the program.
+ *
+ *  @details    Modules are registered before the gateways loading them are
+ *              created; registering is not synchronized with loading.
+ *
+ *  @param      name            The name the JSON configuration refers to the
+ *                              module by. It is not copied and must remain
+ *                              valid while the module is registered.
+ *  @param      module_get_api  The MODULE_STATIC_GETAPI entry point of the
+ *                              module.
+ *
+ *  @return     #MODULE_LOADER_SUCCESS, or #MODULE_LOADER_ERROR if the
+ *              arguments are invalid, the name is already registered or the
+ *              table cannot grow.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT MODULE_LOADER_RESULT, BuiltinLoader_RegisterModule, const char*, name, pfModule_GetApi, module_get_api);
+
+/** @brief      Removes a module from the registered modules.
+ *
+ *  @details    The table is freed once its last module is unregistered.
+ *
+ *  @param      name    The name the module was registered with.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT void, BuiltinLoader_UnregisterModule, const char*, name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BUILTIN_LOADER_H
@@ -0,0 +1,68 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file       lazy_loader.h
+ *  @brief      Library for creating gateway modules on their first message.
+ *
+ *  @details    The gateway uses this module loader for the modules configured
+ *              with "activation": "lazy". It attaches a stand-in module to the
+ *              broker, which loads, creates and starts the module through the
+ *              module's own loader when the first message reaches it. With an
+ *              idle timeout, the stand-in destroys the module and unloads its
+ *              library once no message reached it for that long, and creates
+ *              it again on the next message.
+ */
+
+#ifndef LAZY_LOADER_H
+#define LAZY_LOADER_H
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "parson.h"
+
+#include "module.h"
+#include "module_loader.h"
+#include "gateway_export.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define LAZY_LOADER_NAME "lazy"
+
+/** @brief Structure to create a module on its first message */
+typedef struct LAZY_LOADER_ENTRYPOINT_TAG
+{
+    /** @brief loader of the module */
+    const MODULE_LOADER* loader;
+
+    /** @brief entrypoint JSON of the module for that loader, it is parsed
+     *         again each time the module is created */
+    JSON_Value* entrypoint;
+
+    /** @brief milliseconds without message after which the module is
+     *         destroyed and its library unloaded, 0 keeps it once created */
+    unsigned int idle_timeout;
+} LAZY_LOADER_ENTRYPOINT;
+
+/** @brief      The API for the lazy module loader. */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT const MODULE_LOADER*, LazyLoader_Get);
+
+/** @brief      Creates the entrypoint of a module created on its first message.
+ *
+ *  @param      loader          The loader of the module.
+ *  @param      entrypoint      The entrypoint JSON of the module for that
+ *                              loader, it is copied.
+ *  @param      idle_timeout    Milliseconds without message after which the
+ *                              module is destroyed, 0 keeps it once created.
+ *
+ *  @return     An entrypoint to free with the lazy loader's FreeEntrypoint,
+ *              or @c NULL upon failure.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT LAZY_LOADER_ENTRYPOINT*, LazyLoader_CreateEntrypoint, const MODULE_LOADER*, loader, const JSON_Value*, entrypoint, unsigned int, idle_timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LAZY_LOADER_H
@@ -0,0 +1,89 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file       static_gateway.h
+ *  @brief      Library for creating a gateway from a graph compiled into the
+ *              program.
+ *
+ *  @details    The gateway_aot tool turns a gateway JSON configuration into
+ *              a C file holding a #STATIC_GATEWAY_GRAPH. The modules of the
+ *              graph are linked statically and reached through their
+ *              MODULE_STATIC_GETAPI entry points, so creating the gateway
+ *              neither reads a file nor loads a library. The module
+ *              arguments are kept as JSON, checked when the graph was
+ *              generated, and parsed by each module when it is created.
+ *
+ *              This is a shortcut through a static module loader, not a
+ *              gateway compiled ahead of time: the graph goes through the
+ *              same creation path as ::Gateway_CreateFromJson, the modules
+ *              are created and their links added to the broker at startup,
+ *              and messages are routed by the broker unless links are fused.
+ */
+
+#ifndef STATIC_GATEWAY_H
+#define STATIC_GATEWAY_H
+
+#include <stdbool.h>
+
+#include "module.h"
+#include "gateway.h"
+#include "gateway_export.h"
+
+#ifdef __cplusplus
+#include <cstddef>
+extern "C"
+{
+#else
+#include <stddef.h>
+#endif
+
+/** @brief      A module of a #STATIC_GATEWAY_GRAPH. */
+typedef struct STATIC_GATEWAY_MODULE_TAG
+{
+    /** @brief  The name of the module, unique in the graph. */
+    const char* module_name;
+
+    /** @brief  The MODULE_STATIC_GETAPI entry point of the module. */
+    pfModule_GetApi module_get_api;
+
+    /** @brief  The serialized JSON "args" of the module, @c NULL if it has
+     *          none. */
+    const char* module_configuration;
+} STATIC_GATEWAY_MODULE;
+
+/** @brief      A gateway graph compiled into the program. */
+typedef struct STATIC_GATEWAY_GRAPH_TAG
+{
+    /** @brief  The modules, in the order they are created. */
+    const STATIC_GATEWAY_MODULE* modules;
+
+    /** @brief  The number of modules. */
+    size_t module_count;
+
+    /** @brief  The links between the modules, a source of "*" links every
+     *          module to the sink. */
+    const GATEWAY_LINK_ENTRY* links;
+
+    /** @brief  The number of links. */
+    size_t link_count;
+
+    /** @brief  True to fuse the links of chains of modules, see
+     *          ::Gateway_EnableLinkFusion. */
+    bool fuse_links;
+} STATIC_GATEWAY_GRAPH;
+
+/** @brief      Creates and starts a gateway from a compiled graph.
+ *
+ *  @param      graph   The #STATIC_GATEWAY_GRAPH, it is only read while
+ *                      the gateway is created.
+ *
+ *  @return     A started #GATEWAY_HANDLE to destroy with ::Gateway_Destroy,
+ *              or @c NULL upon failure.
+ */
+GATEWAY_EXPORT GATEWAY_HANDLE StaticGateway_Create(const STATIC_GATEWAY_GRAPH* graph);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*STATIC_GATEWAY_H*/
@@ -3,6 +3,7 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <errno.h>
 
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/vector.h"
@@ -13,6 +14,7 @@
 #include "azure_c_shared_utility/refcount.h"
 #include "azure_c_shared_utility/singlylinkedlist.h"
 #include "azure_c_shared_utility/uniqueid.h"
+#include "azure_c_shared_utility/tickcounter.h"
 
 #include "nanomsg/nn.h"
 #include "nanomsg/pubsub.h"
@@ -28,6 +30,11 @@
 #define INPROC_URL_HEAD_SIZE 9
 #define URL_SIZE (INPROC_URL_HEAD_SIZE + BROKER_GUID_SIZE +1)
 
+/* route change sent to a module worker: [quit guid][operation][source module handle] */
+#define BROKER_LINK_ADD 1
+#define BROKER_LINK_REMOVE 2
+#define BROKER_LINK_CONTROL_SIZE (BROKER_GUID_SIZE + 1 + sizeof(MODULE_HANDLE))
+
 /*The structure backing the message broker handle*/
 typedef struct BROKER_HANDLE_DATA_TAG
 {
@@ -35,8 +42,29 @@ typedef struct BROKER_HANDLE_DATA_TAG
     LOCK_HANDLE             modules_lock;
     int                     publish_socket;
     STRING_HANDLE           url;
+    /** Handles modules publish with in place of the attached module they stand for */
+    struct BROKER_ALIAS_TAG* aliases;
+    size_t                  alias_count;
+    /** Links whose sink receives on the thread of the publisher instead of its worker */
+    struct BROKER_FUSION_TAG** fusions;
+    size_t                  fusion_count;
+    /** Guards the alert callback, created by the first Broker_SetAlertCallback */
+    LOCK_HANDLE             alert_lock;
+    BROKER_ALERT_CALLBACK   alert_callback;
+    void*                   alert_context;
+    /** Guarded by alert_lock once it exists, by modules_lock before */
+    BROKER_ALERT_THRESHOLDS alert_thresholds;
 }BROKER_HANDLE_DATA;
 
+/** An alert found with modules_lock held, reported once it is released */
+typedef struct BROKER_PENDING_ALERT_TAG
+{
+    BROKER_ALERT alert;
+    MODULE_HANDLE module;
+    size_t value;
+    size_t threshold;
+}BROKER_PENDING_ALERT;
+
 DEFINE_REFCOUNT_TYPE(BROKER_HANDLE_DATA);
 
 typedef struct BROKER_MODULEINFO_TAG
@@ -53,9 +81,55 @@ typedef struct BROKER_MODULEINFO_TAG
     LOCK_HANDLE     socket_lock;
     /** Guid sent to module worker thread to close task */
     STRING_HANDLE   quit_message_guid;
+    /** The broker reporting the alerts of the module */
+    BROKER_HANDLE_DATA* broker_data;
+    /** Modules linked to this one whose inbox is counted, NULL if the broker
+     *  did not report alerts when the module was attached. Guarded by
+     *  modules_lock.
+     */
+    VECTOR_HANDLE   sinks;
+    /** Messages sent to the module and not received yet, guarded by inbox_lock */
+    size_t          inbox_depth;
+    /** Set once the depth was reported above the watermark, until the inbox empties */
+    bool            is_inbox_alerted;
+    LOCK_HANDLE     inbox_lock;
+    /** Times the calls to the module's Receive */
+    TICK_COUNTER_HANDLE tick_counter;
 
 }BROKER_MODULEINFO;
 
+typedef struct BROKER_SINK_TAG
+{
+    /** Module receiving the messages of the source */
+    BROKER_MODULEINFO* module_info;
+    /** Links added from the source to the module and not removed yet */
+    size_t          link_count;
+}BROKER_SINK;
+
+typedef struct BROKER_ALIAS_TAG
+{
+    /** Handle the messages are published with */
+    MODULE_HANDLE   alias;
+    /** Handle of the attached module the messages are routed as */
+    MODULE_HANDLE   module_handle;
+}BROKER_ALIAS;
+
+typedef struct BROKER_FUSION_TAG
+{
+    /** Handle of the module whose messages skip the sink's queue */
+    MODULE_HANDLE   source;
+    /** Module receiving them on the thread of the publisher */
+    MODULE          sink;
+    /** Serializes the calls to the sink's Receive */
+    LOCK_HANDLE     receive_lock;
+    /** Publishers delivering through the fusion, guarded by modules_lock */
+    size_t          in_flight;
+    /** Set once the fusion left BROKER_HANDLE_DATA::fusions, under both locks */
+    bool            detached;
+    /** Next fusion taken out of the broker along with this one */
+    struct BROKER_FUSION_TAG* next;
+}BROKER_FUSION;
+
 static STRING_HANDLE construct_url()
 {
     STRING_HANDLE result;
@@ -164,6 +238,18 @@ BROKER_HANDLE Broker_Create(void)
                             free(result);
                             result = NULL;
                         }
+                        else
+                        {
+                            result->aliases = NULL;
+                            result->alias_count = 0;
+                            result->fusions = NULL;
+                            result->fusion_count = 0;
+                            result->alert_lock = NULL;
+                            result->alert_callback = NULL;
+                            result->alert_context = NULL;
+                            result->alert_thresholds.inbox_high_watermark = 0;
+                            result->alert_thresholds.receive_budget_ms = 0;
+                        }
                     }
                 }
             }
@@ -188,6 +274,132 @@ void Broker_IncRef(BROKER_HANDLE broker)
     }
 }
 
+static void apply_link_control(BROKER_MODULEINFO* module_info, const unsigned char* control)
+{
+    MODULE_HANDLE source;
+    int option = (control[BROKER_GUID_SIZE] == BROKER_LINK_ADD) ? NN_SUB_SUBSCRIBE : NN_SUB_UNSUBSCRIBE;
+    memcpy(&source, control + BROKER_GUID_SIZE + 1, sizeof(MODULE_HANDLE));
+
+    if (nn_setsockopt(module_info->receive_socket, NN_SUB, option, &source, sizeof(MODULE_HANDLE)) < 0)
+    {
+        LogError("unable to change the route from [%p] to module [%p]", source, module_info);
+    }
+}
+
+static void report_alert(BROKER_HANDLE_DATA* broker_data, BROKER_ALERT alert, MODULE_HANDLE module, size_t value, size_t threshold)
+{
+    /* the lock exists once the first Broker_SetAlertCallback returned, before any module was attached */
+    if (broker_data->alert_lock != NULL)
+    {
+        if (Lock(broker_data->alert_lock) != LOCK_OK)
+        {
+            LogError("unable to lock the alert callback, alert %d for module [%p] is not reported", (int)alert, module);
+        }
+        else
+        {
+            if (broker_data->alert_callback != NULL)
+            {
+                broker_data->alert_callback(broker_data->alert_context, alert, module, value, threshold);
+            }
+            Unlock(broker_data->alert_lock);
+        }
+    }
+}
+
+static void defer_alert(BROKER_HANDLE_DATA* broker_data, VECTOR_HANDLE* pending_alerts, BROKER_ALERT alert, MODULE_HANDLE module, size_t value, size_t threshold)
+{
+    if (broker_data->alert_lock != NULL)
+    {
+        BROKER_PENDING_ALERT pending_alert = { alert, module, value, threshold };
+        if (*pending_alerts == NULL && (*pending_alerts = VECTOR_create(sizeof(BROKER_PENDING_ALERT))) == NULL)
+        {
+            LogError("unable to keep alert %d for module [%p], it is not reported", (int)alert, module);
+        }
+        else if (VECTOR_push_back(*pending_alerts, &pending_alert, 1) != 0)
+        {
+            LogError("unable to keep alert %d for module [%p], it is not reported", (int)alert, module);
+        }
+    }
+}
+
+/* must be called without modules_lock held */
+static void report_pending_alerts(BROKER_HANDLE_DATA* broker_data, VECTOR_HANDLE pending_alerts)
+{
+    if (pending_alerts != NULL)
+    {
+        size_t count = VECTOR_size(pending_alerts);
+        size_t index;
+        for (index = 0; index < count; index++)
+        {
+            const BROKER_PENDING_ALERT* pending_alert = (const BROKER_PENDING_ALERT*)VECTOR_element(pending_alerts, index);
+            report_alert(broker_data, pending_alert->alert, pending_alert->module, pending_alert->value, pending_alert->threshold);
+        }
+        VECTOR_destroy(pending_alerts);
+    }
+}
+
+/* the thresholds are all 0 when the broker reports no alert */
+static BROKER_ALERT_THRESHOLDS get_alert_thresholds(BROKER_HANDLE_DATA* broker_data)
+{
+    BROKER_ALERT_THRESHOLDS result = { 0, 0 };
+    if (broker_data->alert_lock == NULL)
+    {
+        /* the alerts are not reported */
+    }
+    else if (Lock(broker_data->alert_lock) != LOCK_OK)
+    {
+        LogError("unable to lock the alert thresholds, the alerts are not checked");
+    }
+    else
+    {
+        result = broker_data->alert_thresholds;
+        Unlock(broker_data->alert_lock);
+    }
+    return result;
+}
+
+static void update_inbox(BROKER_MODULEINFO* module_info, bool is_empty)
+{
+    if (Lock(module_info->inbox_lock) != LOCK_OK)
+    {
+        LogError("unable to lock the inbox of module [%p]", module_info);
+    }
+    else
+    {
+        if (is_empty)
+        {
+            /* also forgets the messages counted for routes removed since */
+            module_info->inbox_depth = 0;
+            module_info->is_inbox_alerted = false;
+        }
+        else if (module_info->inbox_depth > 0)
+        {
+            module_info->inbox_depth--;
+        }
+        Unlock(module_info->inbox_lock);
+    }
+}
+
+static void receive_message(BROKER_MODULEINFO* module_info, MESSAGE_HANDLE msg, size_t budget)
+{
+    tickcounter_ms_t start;
+
+    if (budget > 0 && module_info->tick_counter != NULL && tickcounter_get_current_ms(module_info->tick_counter, &start) == 0)
+    {
+        tickcounter_ms_t end;
+        MODULE_RECEIVE(module_info->module->module_apis)(module_info->module->module_handle, msg);
+        /*Codes_SRS_BROKER_31_042: [ If the receive budget is not 0, the function shall report `BROKER_ALERT_RECEIVE_SLOW` with the milliseconds the call took when the module's `Receive` takes longer than the budget. ]*/
+        if (tickcounter_get_current_ms(module_info->tick_counter, &end) == 0 && end - start > budget)
+        {
+            report_alert(module_info->broker_data, BROKER_ALERT_RECEIVE_SLOW, module_info->module->module_handle, (size_t)(end - start), budget);
+        }
+    }
+    else
+    {
+        MODULE_RECEIVE(module_info->module->module_apis)(module_info->module->module_handle, msg);
+    }
+}
+
 /**
 * This function runs for each module. It receives a pointer to a MODULE_INFO
 * object that describes the module. Its job is to call the Receive function on
@@ -201,6 +413,9 @@ static int module_worker(void * user_data)
     int should_continue = 1;
     while (should_continue)
     {
+        /* read before socket_lock is taken, the thresholds may change while the module runs */
+        BROKER_ALERT_THRESHOLDS thresholds = get_alert_thresholds(module_info->broker_data);
+
         /*Codes_SRS_BROKER_13_089: [ This function shall acquire the lock on module_info->socket_lock. ]*/
         if (Lock(module_info->socket_lock))
         {
@@ -212,9 +427,16 @@ static int module_worker(void * user_data)
         int nn_fd = module_info->receive_socket;
         int nbytes;
         unsigned char *buf = NULL;
+        bool tracks_inbox = module_info->inbox_lock != NULL && thresholds.inbox_high_watermark > 0;
 
         /*Codes_SRS_BROKER_17_005: [ For every iteration of the loop, the function shall wait on the receive_socket for messages. ]*/
-        nbytes = nn_recv(nn_fd, (void *)&buf, NN_MSG, 0);
+        nbytes = nn_recv(nn_fd, (void *)&buf, NN_MSG, tracks_inbox ? NN_DONTWAIT : 0);
+        if (tracks_inbox && nbytes < 0 && nn_errno() == EAGAIN)
+        {
+            /*Codes_SRS_BROKER_31_041: [ If the inbox high watermark is not 0, the function shall reset the count of messages waiting for the module whenever `receive_socket` has no message, then wait for the next one. ]*/
+            update_inbox(module_info, true);
+            nbytes = nn_recv(nn_fd, (void *)&buf, NN_MSG, 0);
+        }
         /*Codes_SRS_BROKER_13_091: [ The function shall unlock module_info->socket_lock. ]*/
         if (Unlock(module_info->socket_lock) != LOCK_OK)
         {
@@ -242,6 +464,12 @@ static int module_worker(void * user_data)
                 /* received special quit message for this module */
                 should_continue = 0;
             }
+            else if (nbytes == BROKER_LINK_CONTROL_SIZE &&
+                (strncmp(STRING_c_str(module_info->quit_message_guid), (const char *)buf, BROKER_GUID_SIZE - 1) == 0))
+            {
+                /*Codes_SRS_BROKER_31_009: [ When the worker receives a route change for its module, it shall subscribe or unsubscribe `receive_socket` to the source module handle before receiving the next message. ]*/
+                apply_link_control(module_info, buf);
+            }
             else
             {
                 /*Codes_SRS_BROKER_17_024: [ The function shall strip off the topic from the message. ]*/
@@ -249,11 +477,20 @@ static int module_worker(void * user_data)
                 buf_bytes += sizeof(MODULE_HANDLE);
                 /*Codes_SRS_BROKER_17_017: [ The function shall deserialize the message received. ]*/
                 MESSAGE_HANDLE msg = Message_CreateFromByteArray(buf_bytes, nbytes - sizeof(MODULE_HANDLE));
+                if (tracks_inbox)
+                {
+                    update_inbox(module_info, false);
+                }
                 /*Codes_SRS_BROKER_17_018: [ If the deserialization is not successful, the message loop shall continue. ]*/
-                if (msg != NULL)
+                if (msg == NULL)
+                {
+                    /*Codes_SRS_BROKER_31_043: [ If the deserialization is not successful, the function shall report `BROKER_ALERT_MESSAGE_DROPPED` for the module. ]*/
+                    report_alert(module_info->broker_data, BROKER_ALERT_MESSAGE_DROPPED, module_info->module->module_handle, 1, 0);
+                }
+                else
                 {
                     /*Codes_SRS_BROKER_13_092: [The function shall deliver the message to the module's callback function via module_info->module_apis. ]*/
-                    MODULE_RECEIVE(module_info->module->module_apis)(module_info->module->module_handle, msg);
+                    receive_message(module_info, msg, thresholds.receive_budget_ms);
                     /*Codes_SRS_BROKER_13_093: [ The function shall destroy the message that was dequeued by calling Message_Destroy. ]*/
                     Message_Destroy(msg);
                 }
@@ -266,7 +503,43 @@ static int module_worker(void * user_data)
     return 0;
 }
 
-static BROKER_RESULT init_module(BROKER_MODULEINFO* module_info, const MODULE* module)
+static void deinit_module_alerts(BROKER_MODULEINFO* module_info)
+{
+    if (module_info->sinks != NULL)
+    {
+        VECTOR_destroy(module_info->sinks);
+    }
+    if (module_info->inbox_lock != NULL)
+    {
+        Lock_Deinit(module_info->inbox_lock);
+    }
+    if (module_info->tick_counter != NULL)
+    {
+        tickcounter_destroy(module_info->tick_counter);
+    }
+}
+
+/*returns 0 if success, otherwise __LINE__*/
+static int init_module_alerts(BROKER_MODULEINFO* module_info)
+{
+    int result;
+    module_info->sinks = VECTOR_create(sizeof(BROKER_SINK));
+    module_info->inbox_lock = Lock_Init();
+    module_info->tick_counter = tickcounter_create();
+    if (module_info->sinks == NULL || module_info->inbox_lock == NULL || module_info->tick_counter == NULL)
+    {
+        LogError("unable to allocate the alert tracking of the module");
+        deinit_module_alerts(module_info);
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+static BROKER_RESULT init_module(BROKER_HANDLE_DATA* broker_data, BROKER_MODULEINFO* module_info, const MODULE* module)
 {
     BROKER_RESULT result;
 
@@ -314,7 +587,24 @@ static BROKER_RESULT init_module(BROKER_MODULEINFO* module_info, const MODULE* m
                 }
                 else
                 {
-                    result = BROKER_OK;
+                    module_info->broker_data = broker_data;
+                    module_info->sinks = NULL;
+                    module_info->inbox_depth = 0;
+                    module_info->is_inbox_alerted = false;
+                    module_info->inbox_lock = NULL;
+                    module_info->tick_counter = NULL;
+                    /*Codes_SRS_BROKER_31_044: [ If the broker reports alerts, the function shall create the list of modules linked to the module, the lock of the count of messages waiting for it and a tick counter. ]*/
+                    if (broker_data->alert_lock != NULL && init_module_alerts(module_info) != 0)
+                    {
+                        /*Codes_SRS_BROKER_13_047: [ This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise. ]*/
+                        Lock_Deinit(module_info->socket_lock);
+                        STRING_delete(module_info->quit_message_guid);
+                        result = BROKER_ERROR;
+                    }
+                    else
+                    {
+                        result = BROKER_OK;
+                    }
                 }
             }
         }
@@ -325,6 +615,7 @@ static BROKER_RESULT init_module(BROKER_MODULEINFO* module_info, const MODULE* m
 static void deinit_module(BROKER_MODULEINFO* module_info)
 {
     /*Codes_SRS_BROKER_13_057: [The function shall free all members of the MODULE_INFO object.]*/
+    deinit_module_alerts(module_info);
     Lock_Deinit(module_info->socket_lock);
     STRING_delete(module_info->quit_message_guid);
     free(module_info->module);
@@ -467,6 +758,7 @@ BROKER_RESULT Broker_AddModule(BROKER_HANDLE broker, const MODULE* module)
     }
     else
     {
+        BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
         BROKER_MODULEINFO* module_info = (BROKER_MODULEINFO*)malloc(sizeof(BROKER_MODULEINFO));
         if (module_info == NULL)
         {
@@ -475,7 +767,7 @@ BROKER_RESULT Broker_AddModule(BROKER_HANDLE broker, const MODULE* module)
         }
         else
         {
-            if (init_module(module_info, module) != BROKER_OK)
+            if (init_module(broker_data, module_info, module) != BROKER_OK)
             {
                 /*Codes_SRS_BROKER_13_047: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
                 LogError("start_module failed");
@@ -486,7 +778,6 @@ BROKER_RESULT Broker_AddModule(BROKER_HANDLE broker, const MODULE* module)
             else
             {
                 /*Codes_SRS_BROKER_13_039: [This function shall acquire the lock on BROKER_HANDLE_DATA::modules_lock.]*/
-                BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
                 if (Lock(broker_data->modules_lock) != LOCK_OK)
                 {
                     /*Codes_SRS_BROKER_13_047: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
@@ -541,6 +832,151 @@ static bool find_module_predicate(LIST_ITEM_HANDLE list_item, const void* value)
     return element->module->module_handle == ((MODULE*)value)->module_handle;
 }
 
+static size_t find_fusion(BROKER_HANDLE_DATA* broker_data, MODULE_HANDLE source)
+{
+    size_t index;
+    for (index = 0; index < broker_data->fusion_count; index++)
+    {
+        if (broker_data->fusions[index]->source == source)
+        {
+            break;
+        }
+    }
+    return index;
+}
+
+static bool is_fused_sink(BROKER_HANDLE_DATA* broker_data, MODULE_HANDLE sink)
+{
+    size_t index;
+    for (index = 0; index < broker_data->fusion_count; index++)
+    {
+        if (broker_data->fusions[index]->sink.module_handle == sink)
+        {
+            break;
+        }
+    }
+    return index < broker_data->fusion_count;
+}
+
+/* a module receiving on the thread of a publisher that receives on its own thread would deadlock */
+static bool closes_fusion_cycle(BROKER_HANDLE_DATA* broker_data, const BROKER_LINK_DATA* link)
+{
+    MODULE_HANDLE next = link->module_sink_handle;
+    size_t index;
+    while (next != link->module_source_handle &&
+        (index = find_fusion(broker_data, next)) < broker_data->fusion_count)
+    {
+        next = broker_data->fusions[index]->sink.module_handle;
+    }
+    return next == link->module_source_handle;
+}
+
+static void destroy_fusion(BROKER_FUSION* fusion)
+{
+    Lock_Deinit(fusion->receive_lock);
+    free(fusion);
+}
+
+/* must be called with modules_lock held */
+static BROKER_FUSION* take_fusion(BROKER_HANDLE_DATA* broker_data, size_t index)
+{
+    BROKER_FUSION* fusion = broker_data->fusions[index];
+    broker_data->fusion_count--;
+    broker_data->fusions[index] = broker_data->fusions[broker_data->fusion_count];
+    if (broker_data->fusion_count == 0)
+    {
+        free(broker_data->fusions);
+        broker_data->fusions = NULL;
+    }
+    fusion->next = NULL;
+    return fusion;
+}
+
+/* must be called with modules_lock held, returns the fusions chained by their next member */
+static BROKER_FUSION* take_fusions_of_module(BROKER_HANDLE_DATA* broker_data, MODULE_HANDLE module_handle)
+{
+    BROKER_FUSION* result = NULL;
+    size_t index = broker_data->fusion_count;
+    while (index > 0)
+    {
+        index--;
+        if (broker_data->fusions[index]->source == module_handle ||
+            broker_data->fusions[index]->sink.module_handle == module_handle)
+        {
+            BROKER_FUSION* fusion = take_fusion(broker_data, index);
+            fusion->next = result;
+            result = fusion;
+        }
+    }
+    return result;
+}
+
+/* must be called without modules_lock, returns once the sinks are out of Receive */
+static void detach_fusions(BROKER_HANDLE_DATA* broker_data, BROKER_FUSION* fusions)
+{
+    while (fusions != NULL)
+    {
+        BROKER_FUSION* fusion = fusions;
+        fusions = fusion->next;
+
+        /* receive_lock is taken before modules_lock, like a sink publishing from its Receive does */
+        if (Lock(fusion->receive_lock) != LOCK_OK)
+        {
+            LogError("unable to wait for the deliveries from [%p] to [%p]", fusion->source, fusion->sink.module_handle);
+        }
+        else
+        {
+            if (Lock(broker_data->modules_lock) != LOCK_OK)
+            {
+                LogError("Lock on broker_data->modules_lock failed, the fusion [%p] is not released", fusion);
+                Unlock(fusion->receive_lock);
+            }
+            else
+            {
+                bool is_released;
+                fusion->detached = true;
+                is_released = (fusion->in_flight == 0);
+                Unlock(broker_data->modules_lock);
+                Unlock(fusion->receive_lock);
+
+                /* otherwise the last publisher delivering through it destroys it */
+                if (is_released)
+                {
+                    destroy_fusion(fusion);
+                }
+            }
+        }
+    }
+}
+
+static bool is_same_sink(const void* element, const void* value)
+{
+    return ((const BROKER_SINK*)element)->module_info == (const BROKER_MODULEINFO*)value;
+}
+
+/* must be called with modules_lock held, before module_info is freed */
+static void untrack_module(BROKER_HANDLE_DATA* broker_data, BROKER_MODULEINFO* module_info)
+{
+    /*Codes_SRS_BROKER_31_056: [ `Broker_RemoveModule` and `Broker_DrainModule` shall remove the module from the sinks of every module linked to it. ]*/
+    if (module_info->inbox_lock != NULL)
+    {
+        LIST_ITEM_HANDLE item = singlylinkedlist_get_head_item(broker_data->modules);
+        while (item != NULL)
+        {
+            BROKER_MODULEINFO* source_info = (BROKER_MODULEINFO*)singlylinkedlist_item_get_value(item);
+            if (source_info->sinks != NULL)
+            {
+                BROKER_SINK* tracked = (BROKER_SINK*)VECTOR_find_if(source_info->sinks, is_same_sink, module_info);
+                if (tracked != NULL)
+                {
+                    VECTOR_erase(source_info->sinks, tracked, 1);
+                }
+            }
+            item = singlylinkedlist_get_next_item(item);
+        }
+    }
+}
+
 BROKER_RESULT Broker_RemoveModule(BROKER_HANDLE broker, const MODULE* module)
 {
     /*Codes_SRS_BROKER_13_048: [If `broker` or `module` is NULL the function shall return BROKER_INVALIDARG.]*/
@@ -555,6 +991,7 @@ BROKER_RESULT Broker_RemoveModule(BROKER_HANDLE broker, const MODULE* module)
     {
         /*Codes_SRS_BROKER_13_088: [This function shall acquire the lock on BROKER_HANDLE_DATA::modules_lock.]*/
         BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
+        BROKER_FUSION* fusions = NULL;
         if (Lock(broker_data->modules_lock) != LOCK_OK)
         {
             /*Codes_SRS_BROKER_13_053: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
@@ -575,6 +1012,9 @@ BROKER_RESULT Broker_RemoveModule(BROKER_HANDLE broker, const MODULE* module)
             else
             {
                 BROKER_MODULEINFO* module_info = (BROKER_MODULEINFO*)singlylinkedlist_item_get_value(module_info_item);
+                /*Codes_SRS_BROKER_31_035: [ `Broker_RemoveModule` and `Broker_DrainModule` shall take the fused links of the module out of `BROKER_HANDLE_DATA::fusions`, and after releasing `modules_lock`, wait for the deliveries through them in progress. ]*/
+                fusions = take_fusions_of_module(broker_data, module->module_handle);
+                untrack_module(broker_data, module_info);
                 if (stop_module(broker_data->publish_socket, module_info) == 0)
                 {
                     deinit_module(module_info);
@@ -594,6 +1034,7 @@ BROKER_RESULT Broker_RemoveModule(BROKER_HANDLE broker, const MODULE* module)
 
             /*Codes_SRS_BROKER_13_054: [This function shall release the lock on BROKER_HANDLE_DATA::modules_lock.]*/
             Unlock(broker_data->modules_lock);
+            detach_fusions(broker_data, fusions);
         }
     }
 
@@ -619,6 +1060,35 @@ BROKER_MODULEINFO* broker_locate_handle(BROKER_HANDLE_DATA* broker_data, MODULE_
     return result;
 }
 
+/* must be called with modules_lock held, source_info is NULL when the source is not attached */
+static void track_link(BROKER_MODULEINFO* source_info, BROKER_MODULEINFO* sink_info, bool is_added)
+{
+    /*Codes_SRS_BROKER_31_045: [ If both modules track their inbox, adding or removing a link shall add the sink to or remove it from the sinks of the source, counting the links between them. ]*/
+    if (source_info != NULL && source_info->sinks != NULL && sink_info->inbox_lock != NULL)
+    {
+        BROKER_SINK* tracked = (BROKER_SINK*)VECTOR_find_if(source_info->sinks, is_same_sink, sink_info);
+        if (!is_added)
+        {
+            if (tracked != NULL && --tracked->link_count == 0)
+            {
+                VECTOR_erase(source_info->sinks, tracked, 1);
+            }
+        }
+        else if (tracked != NULL)
+        {
+            tracked->link_count++;
+        }
+        else
+        {
+            BROKER_SINK sink = { sink_info, 1 };
+            if (VECTOR_push_back(source_info->sinks, &sink, 1) != 0)
+            {
+                LogError("unable to track the route from [%p], its messages are not counted in the inbox of [%p]", source_info, sink_info);
+            }
+        }
+    }
+}
+
 BROKER_RESULT Broker_AddLink(BROKER_HANDLE broker, const BROKER_LINK_DATA* link)
 {
     BROKER_RESULT result;
@@ -671,6 +1141,7 @@ BROKER_RESULT Broker_AddLink(BROKER_HANDLE broker, const BROKER_LINK_DATA* link)
                     }
                     else
                     {
+                        track_link(source_module, module_info, true);
                         result = BROKER_OK;
                     }
                 }
@@ -733,6 +1204,7 @@ BROKER_RESULT Broker_RemoveLink(BROKER_HANDLE broker, const BROKER_LINK_DATA* li
                     }
                     else
                     {
+                        track_link(source_module_info, module_info, false);
                         result = BROKER_OK;
                     }
                 }
@@ -744,123 +1216,881 @@ BROKER_RESULT Broker_RemoveLink(BROKER_HANDLE broker, const BROKER_LINK_DATA* li
     return result;
 }
 
-static void broker_decrement_ref(BROKER_HANDLE broker)
+/*returns 0 if success, otherwise __LINE__*/
+static int send_link_control(int publish_socket, BROKER_MODULEINFO* sink_info, unsigned char operation, MODULE_HANDLE source)
 {
-    /*Codes_SRS_BROKER_13_058: [If `broker` is NULL the function shall do nothing.]*/
-    if (broker != NULL)
+    int result;
+    unsigned char control[BROKER_LINK_CONTROL_SIZE];
+
+    /* the sink worker is subscribed to its quit guid, the route change is queued behind the messages already sent */
+    memcpy(control, STRING_c_str(sink_info->quit_message_guid), BROKER_GUID_SIZE);
+    control[BROKER_GUID_SIZE] = operation;
+    memcpy(control + BROKER_GUID_SIZE + 1, &source, sizeof(MODULE_HANDLE));
+
+    if (nn_send(publish_socket, control, BROKER_LINK_CONTROL_SIZE, 0) != (int)BROKER_LINK_CONTROL_SIZE)
     {
-        /*Codes_SRS_BROKER_13_111: [Otherwise, Broker_Destroy shall decrement the internal ref count of the message.]*/
-        /*Codes_SRS_BROKER_13_112: [If the ref count is zero then the allocated resources are freed.]*/
-        if (DEC_REF(BROKER_HANDLE_DATA, broker) == DEC_RETURN_ZERO)
-        {
-            BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker; 
-            if (singlylinkedlist_get_head_item(broker_data->modules) != NULL)
-            {
-                LogError("WARNING: There are still active modules attached to the broker and the broker is being destroyed.");
-            }
-            /* May want to do nn_shutdown first for cleanliness. */
-            nn_close(broker_data->publish_socket);
-            STRING_delete(broker_data->url);
-            singlylinkedlist_destroy(broker_data->modules);
-            Lock_Deinit(broker_data->modules_lock);
-            free(broker_data);
-        }
+        LogError("unable to send a route change to module [%p]", sink_info);
+        result = __LINE__;
     }
     else
     {
-        LogError("broker handle is NULL");
+        result = 0;
     }
+    return result;
 }
 
-extern void Broker_Destroy(BROKER_HANDLE broker)
+static bool are_links_attached(BROKER_HANDLE_DATA* broker_data, const BROKER_LINK_DATA* links, size_t count, bool check_source)
 {
-    broker_decrement_ref(broker);
+    bool result = true;
+    size_t i;
+
+    for (i = 0; i < count && result; i++)
+    {
+        if (broker_locate_handle(broker_data, links[i].module_sink_handle) == NULL)
+        {
+            LogError("Link->sink is not attached to the broker");
+            result = false;
+        }
+        else if (check_source && broker_locate_handle(broker_data, links[i].module_source_handle) == NULL)
+        {
+            LogError("Link->source is not attached to the broker");
+            result = false;
+        }
+    }
+    return result;
 }
 
-extern void Broker_DecRef(BROKER_HANDLE broker)
+static bool are_links_valid(const BROKER_LINK_DATA* links, size_t count)
 {
-    /*Codes_SRS_BROKER_13_113: [This function shall implement all the requirements of the Broker_Destroy API.]*/
-    broker_decrement_ref(broker);
+    bool result = (count == 0 || links != NULL);
+    size_t i;
+
+    for (i = 0; i < count && result; i++)
+    {
+        result = (links[i].module_source_handle != NULL && links[i].module_sink_handle != NULL);
+    }
+    return result;
 }
 
-BROKER_RESULT Broker_Publish(BROKER_HANDLE broker, MODULE_HANDLE source, MESSAGE_HANDLE message)
+BROKER_RESULT Broker_UpdateLinks(BROKER_HANDLE broker, const BROKER_LINK_DATA* links_to_remove, size_t remove_count, const BROKER_LINK_DATA* links_to_add, size_t add_count)
 {
     BROKER_RESULT result;
-    /*Codes_SRS_BROKER_13_030: [If broker or message is NULL the function shall return BROKER_INVALIDARG.]*/
-    if (broker == NULL || source == NULL || message == NULL)
+    /*Codes_SRS_BROKER_31_001: [ If `broker` is NULL, or a count is not zero and its links are NULL, or any link has a NULL source or sink, `Broker_UpdateLinks` shall return `BROKER_INVALIDARG`. ]*/
+    if (broker == NULL || !are_links_valid(links_to_remove, remove_count) || !are_links_valid(links_to_add, add_count))
     {
+        LogError("Broker_UpdateLinks, invalid input.");
         result = BROKER_INVALIDARG;
-        LogError("Broker handle, source, and/or message handle is NULL");
     }
     else
     {
         BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
-        /*Codes_SRS_BROKER_17_022: [ Broker_Publish shall Lock the modules lock. ]*/
+        /*Codes_SRS_BROKER_31_002: [ `Broker_UpdateLinks` shall hold the `modules_lock` while it checks and sends the route changes, so no message is published between them. ]*/
         if (Lock(broker_data->modules_lock) != LOCK_OK)
         {
-            /*Codes_SRS_BROKER_13_053: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
+            /*Codes_SRS_BROKER_31_006: [ Upon an error, `Broker_UpdateLinks` shall return `BROKER_ERROR`. ]*/
+            LogError("Broker_UpdateLinks, Lock on broker_data->modules_lock failed");
+            result = BROKER_ERROR;
+        }
+        else
+        {
+            /*Codes_SRS_BROKER_31_003: [ `Broker_UpdateLinks` shall fail if the sink of a link, or the source of a link to add, is not attached to the broker. ]*/
+            if (!are_links_attached(broker_data, links_to_remove, remove_count, false) ||
+                !are_links_attached(broker_data, links_to_add, add_count, true))
+            {
+                /*Codes_SRS_BROKER_31_006: [ Upon an error, `Broker_UpdateLinks` shall return `BROKER_ERROR`. ]*/
+                result = BROKER_ERROR;
+            }
+            else
+            {
+                size_t total = remove_count + add_count;
+                size_t sent;
+
+                /*Codes_SRS_BROKER_31_004: [ For each link, `Broker_UpdateLinks` shall send on the `publish_socket` a route change made of the sink quit signal GUID, the operation and the source module handle, the removals first. ]*/
+                for (sent = 0; sent < total; sent++)
+                {
+                    const BROKER_LINK_DATA* link = (sent < remove_count) ? &links_to_remove[sent] : &links_to_add[sent - remove_count];
+                    if (send_link_control(
+                        broker_data->publish_socket,
+                        broker_locate_handle(broker_data, link->module_sink_handle),
+                        (sent < remove_count) ? BROKER_LINK_REMOVE : BROKER_LINK_ADD,
+                        link->module_source_handle) != 0)
+                    {
+                        break;
+                    }
+                }
+
+                if (sent < total)
+                {
+                    /*Codes_SRS_BROKER_31_005: [ If a route change cannot be sent, `Broker_UpdateLinks` shall send the reverse of the route changes already sent, in reverse order, and return `BROKER_ERROR`. ]*/
+                    while (sent > 0)
+                    {
+                        const BROKER_LINK_DATA* link;
+                        sent--;
+                        link = (sent < remove_count) ? &links_to_remove[sent] : &links_to_add[sent - remove_count];
+                        if (send_link_control(
+                            broker_data->publish_socket,
+                            broker_locate_handle(broker_data, link->module_sink_handle),
+                            (sent < remove_count) ? BROKER_LINK_ADD : BROKER_LINK_REMOVE,
+                            link->module_source_handle) != 0)
+                        {
+                            LogError("unable to revert the route from [%p] to [%p]", link->module_source_handle, link->module_sink_handle);
+                        }
+                    }
+                    result = BROKER_ERROR;
+                }
+                else
+                {
+                    for (sent = 0; sent < total; sent++)
+                    {
+                        const BROKER_LINK_DATA* link = (sent < remove_count) ? &links_to_remove[sent] : &links_to_add[sent - remove_count];
+                        track_link(
+                            broker_locate_handle(broker_data, link->module_source_handle),
+                            broker_locate_handle(broker_data, link->module_sink_handle),
+                            sent >= remove_count);
+                    }
+                    result = BROKER_OK;
+                }
+            }
+            Unlock(broker_data->modules_lock);
+        }
+    }
+    return result;
+}
+
+BROKER_RESULT Broker_DrainModule(BROKER_HANDLE broker, const MODULE* module)
+{
+    BROKER_RESULT result;
+    /*Codes_SRS_BROKER_31_010: [ If `broker` or `module` is NULL the function shall return `BROKER_INVALIDARG`. ]*/
+    if (broker == NULL || module == NULL)
+    {
+        result = BROKER_INVALIDARG;
+        LogError("invalid parameter (NULL).");
+    }
+    else
+    {
+        BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
+        if (Lock(broker_data->modules_lock) != LOCK_OK)
+        {
+            /*Codes_SRS_BROKER_31_015: [ This function shall return `BROKER_ERROR` if an underlying API call to the platform causes an error or `BROKER_OK` otherwise. ]*/
             LogError("Lock on broker_data->modules_lock failed");
             result = BROKER_ERROR;
         }
         else
         {
-            int32_t msg_size;
-            int32_t buf_size;
-            /*Codes_SRS_BROKER_17_007: [ Broker_Publish shall clone the message. ]*/
-            MESSAGE_HANDLE msg = Message_Clone(message);
-            /*Codes_SRS_BROKER_17_008: [ Broker_Publish shall serialize the message. ]*/
-            msg_size = Message_ToByteArray(message, NULL, 0);
-            if (msg_size < 0)
+            BROKER_MODULEINFO* module_info = NULL;
+            BROKER_FUSION* fusions = NULL;
+            LIST_ITEM_HANDLE module_info_item = singlylinkedlist_find(broker_data->modules, find_module_predicate, module);
+
+            if (module_info_item == NULL)
             {
-                /*Codes_SRS_BROKER_13_053: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
-                LogError("unable to serialize a message [%p]", msg);
-                Message_Destroy(msg);
+                /*Codes_SRS_BROKER_31_011: [ `Broker_DrainModule` shall return `BROKER_ERROR` if the module is not attached to the broker. ]*/
+                LogError("Supplied module is not attached to the broker");
+                result = BROKER_ERROR;
+            }
+            else
+            {
+                module_info = (BROKER_MODULEINFO*)singlylinkedlist_item_get_value(module_info_item);
+                /*Codes_SRS_BROKER_31_012: [ `Broker_DrainModule` shall send the quit signal of the module on the `publish_socket` and remove the module from `BROKER_HANDLE_DATA::modules` while holding `modules_lock`. ]*/
+                if (nn_send(broker_data->publish_socket, STRING_c_str(module_info->quit_message_guid), BROKER_GUID_SIZE, 0) < 0)
+                {
+                    LogError("unable to send the quit signal to module [%p]", module_info);
+                    module_info = NULL;
+                    result = BROKER_ERROR;
+                }
+                else
+                {
+                    singlylinkedlist_remove(broker_data->modules, module_info_item);
+                    untrack_module(broker_data, module_info);
+                    /*Codes_SRS_BROKER_31_035: [ `Broker_RemoveModule` and `Broker_DrainModule` shall take the fused links of the module out of `BROKER_HANDLE_DATA::fusions`, and after releasing `modules_lock`, wait for the deliveries through them in progress. ]*/
+                    fusions = take_fusions_of_module(broker_data, module->module_handle);
+                    result = BROKER_OK;
+                }
+            }
+            Unlock(broker_data->modules_lock);
+            detach_fusions(broker_data, fusions);
+
+            if (module_info != NULL)
+            {
+                int thread_result;
+                /*Codes_SRS_BROKER_31_013: [ After releasing `modules_lock`, `Broker_DrainModule` shall join the module thread, which delivers the queued messages before it receives the quit signal. ]*/
+                if (ThreadAPI_Join(module_info->thread, &thread_result) != THREADAPI_OK)
+                {
+                    LogError("ThreadAPI_Join() returned an error.");
+                    result = BROKER_ERROR;
+                }
+                else
+                {
+                    /*Codes_SRS_BROKER_31_014: [ `Broker_DrainModule` shall close `receive_socket` and free all members of the `BROKER_MODULEINFO` object. ]*/
+                    if (nn_close(module_info->receive_socket) < 0)
+                    {
+                        LogError("Receive socket close failed for module at  item [%p] failed", module_info);
+                    }
+                    deinit_module(module_info);
+                    free(module_info);
+                }
+            }
+        }
+    }
+    return result;
+}
+
+static size_t find_alias(BROKER_HANDLE_DATA* broker_data, MODULE_HANDLE alias)
+{
+    size_t index;
+    for (index = 0; index < broker_data->alias_count; index++)
+    {
+        if (broker_data->aliases[index].alias == alias)
+        {
+            break;
+        }
+    }
+    return index;
+}
+
+static MODULE_HANDLE resolve_alias(BROKER_HANDLE_DATA* broker_data, MODULE_HANDLE source)
+{
+    size_t index = find_alias(broker_data, source);
+    return index < broker_data->alias_count ? broker_data->aliases[index].module_handle : source;
+}
+
+BROKER_RESULT Broker_AddModuleAlias(BROKER_HANDLE broker, const MODULE* module, MODULE_HANDLE alias)
+{
+    BROKER_RESULT result;
+    /*Codes_SRS_BROKER_31_016: [ If `broker`, `module` or `alias` is NULL the function shall return `BROKER_INVALIDARG`. ]*/
+    if (broker == NULL || module == NULL || alias == NULL)
+    {
+        result = BROKER_INVALIDARG;
+        LogError("invalid parameter (NULL).");
+    }
+    else
+    {
+        BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
+        /*Codes_SRS_BROKER_31_017: [ `Broker_AddModuleAlias` shall add the alias while holding `modules_lock`. ]*/
+        if (Lock(broker_data->modules_lock) != LOCK_OK)
+        {
+            /*Codes_SRS_BROKER_31_020: [ This function shall return `BROKER_ERROR` if an underlying API call to the platform causes an error or `BROKER_OK` otherwise. ]*/
+            LogError("Lock on broker_data->modules_lock failed");
+            result = BROKER_ERROR;
+        }
+        else
+        {
+            /*Codes_SRS_BROKER_31_018: [ `Broker_AddModuleAlias` shall return `BROKER_ERROR` if the module is not attached to the broker or if `alias` is already an alias. ]*/
+            if (singlylinkedlist_find(broker_data->modules, find_module_predicate, module) == NULL)
+            {
+                LogError("Supplied module is not attached to the broker");
+                result = BROKER_ERROR;
+            }
+            else if (find_alias(broker_data, alias) < broker_data->alias_count)
+            {
+                LogError("Supplied alias [%p] is already in use", alias);
                 result = BROKER_ERROR;
             }
             else
             {
-                /*Codes_SRS_BROKER_17_025: [ Broker_Publish shall allocate a nanomsg buffer the size of the serialized message + sizeof(MODULE_HANDLE). ]*/
-                buf_size = msg_size + sizeof(MODULE_HANDLE);
-                void* nn_msg = nn_allocmsg(buf_size, 0);
-                if (nn_msg == NULL)
+                /*Codes_SRS_BROKER_31_019: [ `Broker_AddModuleAlias` shall grow `BROKER_HANDLE_DATA::aliases` by one element holding `alias` and the handle of `module`. ]*/
+                BROKER_ALIAS* aliases = (BROKER_ALIAS*)realloc(broker_data->aliases, (broker_data->alias_count + 1) * sizeof(BROKER_ALIAS));
+                if (aliases == NULL)
                 {
-                    /*Codes_SRS_BROKER_13_053: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
-                    LogError("unable to serialize a message [%p]", msg);
+                    /*Codes_SRS_BROKER_31_020: [ This function shall return `BROKER_ERROR` if an underlying API call to the platform causes an error or `BROKER_OK` otherwise. ]*/
+                    LogError("unable to grow the broker aliases");
                     result = BROKER_ERROR;
                 }
                 else
                 {
-                    /*Codes_SRS_BROKER_17_026: [ Broker_Publish shall copy source into the beginning of the nanomsg buffer. ]*/
-                    unsigned char *nn_msg_bytes = (unsigned char *)nn_msg;
-                    memcpy(nn_msg_bytes, &source, sizeof(MODULE_HANDLE));
-                    /*Codes_SRS_BROKER_17_027: [ Broker_Publish shall serialize the message into the remainder of the nanomsg buffer. ]*/
-                    nn_msg_bytes += sizeof(MODULE_HANDLE);
-                    Message_ToByteArray(message, nn_msg_bytes, msg_size);
+                    aliases[broker_data->alias_count].alias = alias;
+                    aliases[broker_data->alias_count].module_handle = module->module_handle;
+                    broker_data->aliases = aliases;
+                    broker_data->alias_count++;
+                    result = BROKER_OK;
+                }
+            }
+            Unlock(broker_data->modules_lock);
+        }
+    }
+    return result;
+}
+
+BROKER_RESULT Broker_RemoveModuleAlias(BROKER_HANDLE broker, MODULE_HANDLE alias)
+{
+    BROKER_RESULT result;
+    /*Codes_SRS_BROKER_31_021: [ If `broker` or `alias` is NULL the function shall return `BROKER_INVALIDARG`. ]*/
+    if (broker == NULL || alias == NULL)
+    {
+        result = BROKER_INVALIDARG;
+        LogError("invalid parameter (NULL).");
+    }
+    else
+    {
+        BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
+        if (Lock(broker_data->modules_lock) != LOCK_OK)
+        {
+            /*Codes_SRS_BROKER_31_020: [ This function shall return `BROKER_ERROR` if an underlying API call to the platform causes an error or `BROKER_OK` otherwise. ]*/
+            LogError("Lock on broker_data->modules_lock failed");
+            result = BROKER_ERROR;
+        }
+        else
+        {
+            size_t index = find_alias(broker_data, alias);
+            if (index == broker_data->alias_count)
+            {
+                /*Codes_SRS_BROKER_31_022: [ `Broker_RemoveModuleAlias` shall return `BROKER_ERROR` if `alias` is not an alias. ]*/
+                LogError("Supplied alias [%p] is not in use", alias);
+                result = BROKER_ERROR;
+            }
+            else
+            {
+                /*Codes_SRS_BROKER_31_023: [ `Broker_RemoveModuleAlias` shall remove the alias while holding `modules_lock`, and free `BROKER_HANDLE_DATA::aliases` once it is empty. ]*/
+                broker_data->alias_count--;
+                broker_data->aliases[index] = broker_data->aliases[broker_data->alias_count];
+                if (broker_data->alias_count == 0)
+                {
+                    free(broker_data->aliases);
+                    broker_data->aliases = NULL;
+                }
+                result = BROKER_OK;
+            }
+            Unlock(broker_data->modules_lock);
+        }
+    }
+    return result;
+}
 
-                    /*Codes_SRS_BROKER_17_010: [ Broker_Publish shall send a message on the publish_socket. ]*/
-                    int nbytes = nn_send(broker_data->publish_socket, &nn_msg, NN_MSG, 0);
-                    if (nbytes != buf_size)
+static bool is_link_valid(const BROKER_LINK_DATA* link)
+{
+    return link != NULL && link->module_source_handle != NULL && link->module_sink_handle != NULL;
+}
+
+BROKER_RESULT Broker_FuseLink(BROKER_HANDLE broker, const BROKER_LINK_DATA* link)
+{
+    BROKER_RESULT result;
+    /*Codes_SRS_BROKER_31_025: [ If `broker` or `link` is NULL, or `link` has a NULL source or sink, or its source is its sink, `Broker_FuseLink` shall return `BROKER_INVALIDARG`. ]*/
+    if (broker == NULL || !is_link_valid(link) || link->module_source_handle == link->module_sink_handle)
+    {
+        result = BROKER_INVALIDARG;
+        LogError("invalid parameter.");
+    }
+    else
+    {
+        BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
+        /*Codes_SRS_BROKER_31_026: [ `Broker_FuseLink` shall fuse the link while holding `modules_lock`. ]*/
+        if (Lock(broker_data->modules_lock) != LOCK_OK)
+        {
+            /*Codes_SRS_BROKER_31_030: [ This function shall return `BROKER_ERROR` if an underlying API call to the platform causes an error or `BROKER_OK` otherwise. ]*/
+            LogError("Lock on broker_data->modules_lock failed");
+            result = BROKER_ERROR;
+        }
+        else
+        {
+            BROKER_MODULEINFO* sink_info = broker_locate_handle(broker_data, link->module_sink_handle);
+
+            /*Codes_SRS_BROKER_31_027: [ `Broker_FuseLink` shall return `BROKER_ERROR` if the source or the sink is not attached to the broker, if the source has a fused link, if the sink is the sink of a fused link, or if the fused links would make a cycle. ]*/
+            if (sink_info == NULL || broker_locate_handle(broker_data, link->module_source_handle) == NULL)
+            {
+                LogError("Link->source or link->sink is not attached to the broker");
+                result = BROKER_ERROR;
+            }
+            else if (find_fusion(broker_data, link->module_source_handle) < broker_data->fusion_count ||
+                is_fused_sink(broker_data, link->module_sink_handle) ||
+                closes_fusion_cycle(broker_data, link))
+            {
+                LogError("the link from [%p] to [%p] cannot be fused", link->module_source_handle, link->module_sink_handle);
+                result = BROKER_ERROR;
+            }
+            else
+            {
+                /*Codes_SRS_BROKER_31_028: [ `Broker_FuseLink` shall grow `BROKER_HANDLE_DATA::fusions` by one fusion holding the source handle, the sink `MODULE` and a lock serializing the calls to the sink's `Receive`. ]*/
+                BROKER_FUSION* fusion = (BROKER_FUSION*)malloc(sizeof(BROKER_FUSION));
+                if (fusion == NULL)
+                {
+                    /*Codes_SRS_BROKER_31_030: [ This function shall return `BROKER_ERROR` if an underlying API call to the platform causes an error or `BROKER_OK` otherwise. ]*/
+                    LogError("unable to allocate a fusion");
+                    result = BROKER_ERROR;
+                }
+                else if ((fusion->receive_lock = Lock_Init()) == NULL)
+                {
+                    LogError("unable to create the lock of a fusion");
+                    free(fusion);
+                    result = BROKER_ERROR;
+                }
+                else
+                {
+                    BROKER_FUSION** fusions = (BROKER_FUSION**)realloc(broker_data->fusions, (broker_data->fusion_count + 1) * sizeof(BROKER_FUSION*));
+                    if (fusions == NULL)
                     {
-                        /*Codes_SRS_BROKER_13_053: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
-                        LogError("unable to send a message [%p]", msg);
-                        /*Codes_SRS_BROKER_17_012: [ Broker_Publish shall free the message. ]*/
-                        nn_freemsg(nn_msg);
+                        LogError("unable to grow the broker fusions");
+                        destroy_fusion(fusion);
                         result = BROKER_ERROR;
                     }
                     else
                     {
-                        result = BROKER_OK;
+                        broker_data->fusions = fusions;
+
+                        /*Codes_SRS_BROKER_31_029: [ `Broker_FuseLink` shall unsubscribe the sink `receive_socket` from the source module handle. ]*/
+                        if (nn_setsockopt(
+                            sink_info->receive_socket, NN_SUB, NN_SUB_UNSUBSCRIBE, &(link->module_source_handle), sizeof(MODULE_HANDLE)) < 0)
+                        {
+                            LogError("unable to unsubscribe [%p] from [%p]", link->module_sink_handle, link->module_source_handle);
+                            destroy_fusion(fusion);
+                            result = BROKER_ERROR;
+                        }
+                        else
+                        {
+                            fusion->source = link->module_source_handle;
+                            fusion->sink.module_apis = sink_info->module->module_apis;
+                            fusion->sink.module_handle = sink_info->module->module_handle;
+                            fusion->in_flight = 0;
+                            fusion->detached = false;
+                            fusion->next = NULL;
+                            fusions[broker_data->fusion_count] = fusion;
+                            broker_data->fusion_count++;
+                            result = BROKER_OK;
+                        }
                     }
                 }
-                /*Codes_SRS_BROKER_17_012: [ Broker_Publish shall free the message. ]*/
-                Message_Destroy(msg);
-                /*Codes_SRS_BROKER_17_011: [ Broker_Publish shall free the serialized message data. ]*/
             }
-            /*Codes_SRS_BROKER_17_023: [ Broker_Publish shall Unlock the modules lock. ]*/
             Unlock(broker_data->modules_lock);
         }
+    }
+    return result;
+}
+
+BROKER_RESULT Broker_UnfuseLink(BROKER_HANDLE broker, const BROKER_LINK_DATA* link)
+{
+    BROKER_RESULT result;
+    /*Codes_SRS_BROKER_31_031: [ If `broker` or `link` is NULL, or `link` has a NULL source or sink, `Broker_UnfuseLink` shall return `BROKER_INVALIDARG`. ]*/
+    if (broker == NULL || !is_link_valid(link))
+    {
+        result = BROKER_INVALIDARG;
+        LogError("invalid parameter.");
+    }
+    else
+    {
+        BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
+        BROKER_FUSION* fusion = NULL;
+        if (Lock(broker_data->modules_lock) != LOCK_OK)
+        {
+            /*Codes_SRS_BROKER_31_030: [ This function shall return `BROKER_ERROR` if an underlying API call to the platform causes an error or `BROKER_OK` otherwise. ]*/
+            LogError("Lock on broker_data->modules_lock failed");
+            result = BROKER_ERROR;
+        }
+        else
+        {
+            size_t index = find_fusion(broker_data, link->module_source_handle);
+            if (index == broker_data->fusion_count ||
+                broker_data->fusions[index]->sink.module_handle != link->module_sink_handle)
+            {
+                /*Codes_SRS_BROKER_31_032: [ `Broker_UnfuseLink` shall return `BROKER_ERROR` if the link is not fused. ]*/
+                LogError("the link from [%p] to [%p] is not fused", link->module_source_handle, link->module_sink_handle);
+                result = BROKER_ERROR;
+            }
+            else
+            {
+                /* a fused sink stays attached, Broker_RemoveModule takes its fusions out */
+                BROKER_MODULEINFO* sink_info = broker_locate_handle(broker_data, link->module_sink_handle);
+
+                /*Codes_SRS_BROKER_31_033: [ While holding `modules_lock`, `Broker_UnfuseLink` shall subscribe the sink `receive_socket` to the source module handle again and take the fusion out of `BROKER_HANDLE_DATA::fusions`. ]*/
+                if (nn_setsockopt(
+                    sink_info->receive_socket, NN_SUB, NN_SUB_SUBSCRIBE, &(link->module_source_handle), sizeof(MODULE_HANDLE)) < 0)
+                {
+                    LogError("unable to subscribe [%p] to [%p]", link->module_sink_handle, link->module_source_handle);
+                    result = BROKER_ERROR;
+                }
+                else
+                {
+                    fusion = take_fusion(broker_data, index);
+                    result = BROKER_OK;
+                }
+            }
+            Unlock(broker_data->modules_lock);
+
+            /*Codes_SRS_BROKER_31_034: [ After releasing `modules_lock`, `Broker_UnfuseLink` shall wait for the delivery through the fusion in progress; the messages published meanwhile go through the sink's queue. ]*/
+            detach_fusions(broker_data, fusion);
+        }
+    }
+    return result;
+}
+
+BROKER_RESULT Broker_SetAlertCallback(BROKER_HANDLE broker, BROKER_ALERT_CALLBACK callback, void* context)
+{
+    BROKER_RESULT result;
+    /*Codes_SRS_BROKER_31_047: [ If `broker` is NULL, `Broker_SetAlertCallback` shall return `BROKER_INVALIDARG`. ]*/
+    if (broker == NULL)
+    {
+        LogError("Broker_SetAlertCallback, broker is NULL.");
+        result = BROKER_INVALIDARG;
+    }
+    else
+    {
+        BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
+        if (broker_data->alert_lock == NULL)
+        {
+            if (Lock(broker_data->modules_lock) != LOCK_OK)
+            {
+                LogError("Lock on broker_data->modules_lock failed");
+                result = BROKER_ERROR;
+            }
+            else
+            {
+                /*Codes_SRS_BROKER_31_048: [ The first call shall fail and return `BROKER_ERROR` if a module is attached to the broker. ]*/
+                if (singlylinkedlist_get_head_item(broker_data->modules) != NULL)
+                {
+                    LogError("the alert callback shall be set before the modules are attached");
+                    result = BROKER_ERROR;
+                }
+                /*Codes_SRS_BROKER_31_049: [ The first call shall create the lock guarding the alert callback, and return `BROKER_ERROR` if it cannot. ]*/
+                else if ((broker_data->alert_lock = Lock_Init()) == NULL)
+                {
+                    LogError("Lock_Init failed");
+                    result = BROKER_ERROR;
+                }
+                else
+                {
+                    /*Codes_SRS_BROKER_31_050: [ `Broker_SetAlertCallback` shall store `callback` and `context` under the alert lock and return `BROKER_OK`. ]*/
+                    broker_data->alert_callback = callback;
+                    broker_data->alert_context = context;
+                    result = BROKER_OK;
+                }
+                Unlock(broker_data->modules_lock);
+            }
+        }
+        else if (Lock(broker_data->alert_lock) != LOCK_OK)
+        {
+            LogError("Lock on broker_data->alert_lock failed");
+            result = BROKER_ERROR;
+        }
+        else
+        {
+            /*Codes_SRS_BROKER_31_050: [ `Broker_SetAlertCallback` shall store `callback` and `context` under the alert lock and return `BROKER_OK`. ]*/
+            broker_data->alert_callback = callback;
+            broker_data->alert_context = context;
+            Unlock(broker_data->alert_lock);
+            result = BROKER_OK;
+        }
+    }
+    return result;
+}
+
+BROKER_RESULT Broker_SetAlertThresholds(BROKER_HANDLE broker, const BROKER_ALERT_THRESHOLDS* thresholds)
+{
+    BROKER_RESULT result;
+    /*Codes_SRS_BROKER_31_051: [ If `broker` or `thresholds` is NULL, `Broker_SetAlertThresholds` shall return `BROKER_INVALIDARG`. ]*/
+    if (broker == NULL || thresholds == NULL)
+    {
+        LogError("Broker_SetAlertThresholds, input is NULL.");
+        result = BROKER_INVALIDARG;
+    }
+    else
+    {
+        BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
+        if (Lock(broker_data->modules_lock) != LOCK_OK)
+        {
+            LogError("Lock on broker_data->modules_lock failed");
+            result = BROKER_ERROR;
+        }
+        else
+        {
+            /* the first Broker_SetAlertCallback creates the alert lock under modules_lock */
+            LOCK_HANDLE alert_lock = broker_data->alert_lock;
+            if (alert_lock == NULL)
+            {
+                /*Codes_SRS_BROKER_31_052: [ `Broker_SetAlertThresholds` shall copy `thresholds` under the alert lock, or under `modules_lock` if no alert callback was set yet, and return `BROKER_OK`. ]*/
+                broker_data->alert_thresholds = *thresholds;
+            }
+            Unlock(broker_data->modules_lock);
+
+            if (alert_lock == NULL)
+            {
+                result = BROKER_OK;
+            }
+            else if (Lock(alert_lock) != LOCK_OK)
+            {
+                LogError("Lock on broker_data->alert_lock failed");
+                result = BROKER_ERROR;
+            }
+            else
+            {
+                /*Codes_SRS_BROKER_31_052: [ `Broker_SetAlertThresholds` shall copy `thresholds` under the alert lock, or under `modules_lock` if no alert callback was set yet, and return `BROKER_OK`. ]*/
+                broker_data->alert_thresholds = *thresholds;
+                Unlock(alert_lock);
+                result = BROKER_OK;
+            }
+        }
+    }
+    return result;
+}
+
+void Broker_ReportAlert(BROKER_HANDLE broker, BROKER_ALERT alert, MODULE_HANDLE module, size_t value, size_t threshold)
+{
+    /*Codes_SRS_BROKER_31_053: [ If `broker` is NULL, `Broker_ReportAlert` shall do nothing. ]*/
+    if (broker == NULL)
+    {
+        LogError("Broker_ReportAlert, broker is NULL.");
+    }
+    else
+    {
+        /*Codes_SRS_BROKER_31_054: [ `Broker_ReportAlert` shall call the alert callback, if any, with `alert`, `module`, `value` and `threshold` under the alert lock. ]*/
+        report_alert((BROKER_HANDLE_DATA*)broker, alert, module, value, threshold);
+    }
+}
+
+static void broker_decrement_ref(BROKER_HANDLE broker)
+{
+    /*Codes_SRS_BROKER_13_058: [If `broker` is NULL the function shall do nothing.]*/
+    if (broker != NULL)
+    {
+        /*Codes_SRS_BROKER_13_111: [Otherwise, Broker_Destroy shall decrement the internal ref count of the message.]*/
+        /*Codes_SRS_BROKER_13_112: [If the ref count is zero then the allocated resources are freed.]*/
+        if (DEC_REF(BROKER_HANDLE_DATA, broker) == DEC_RETURN_ZERO)
+        {
+            BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker; 
+            if (singlylinkedlist_get_head_item(broker_data->modules) != NULL)
+            {
+                LogError("WARNING: There are still active modules attached to the broker and the broker is being destroyed.");
+            }
+            /* May want to do nn_shutdown first for cleanliness. */
+            nn_close(broker_data->publish_socket);
+            STRING_delete(broker_data->url);
+            singlylinkedlist_destroy(broker_data->modules);
+            Lock_Deinit(broker_data->modules_lock);
+            if (broker_data->alert_lock != NULL)
+            {
+                Lock_Deinit(broker_data->alert_lock);
+            }
+            if (broker_data->aliases != NULL)
+            {
+                free(broker_data->aliases);
+            }
+            if (broker_data->fusions != NULL)
+            {
+                size_t index;
+                for (index = 0; index < broker_data->fusion_count; index++)
+                {
+                    destroy_fusion(broker_data->fusions[index]);
+                }
+                free(broker_data->fusions);
+            }
+            free(broker_data);
+        }
+    }
+    else
+    {
+        LogError("broker handle is NULL");
+    }
+}
+
+extern void Broker_Destroy(BROKER_HANDLE broker)
+{
+    broker_decrement_ref(broker);
+}
+
+extern void Broker_DecRef(BROKER_HANDLE broker)
+{
+    /*Codes_SRS_BROKER_13_113: [This function shall implement all the requirements of the Broker_Destroy API.]*/
+    broker_decrement_ref(broker);
+}
+
+/* must be called with modules_lock held */
+static void add_to_inboxes(BROKER_HANDLE_DATA* broker_data, MODULE_HANDLE topic, size_t watermark, VECTOR_HANDLE* pending_alerts)
+{
+    if (watermark > 0)
+    {
+        BROKER_MODULEINFO* source_info = broker_locate_handle(broker_data, topic);
+        if (source_info != NULL && source_info->sinks != NULL)
+        {
+            size_t count = VECTOR_size(source_info->sinks);
+            size_t index;
+            for (index = 0; index < count; index++)
+            {
+                BROKER_MODULEINFO* module_info = ((BROKER_SINK*)VECTOR_element(source_info->sinks, index))->module_info;
+                if (Lock(module_info->inbox_lock) != LOCK_OK)
+                {
+                    LogError("unable to lock the inbox of module [%p]", module_info);
+                }
+                else
+                {
+                    size_t depth = ++module_info->inbox_depth;
+                    bool is_crossed = (depth > watermark && !module_info->is_inbox_alerted);
+                    if (is_crossed)
+                    {
+                        module_info->is_inbox_alerted = true;
+                    }
+                    Unlock(module_info->inbox_lock);
+
+                    /*Codes_SRS_BROKER_31_040: [ If the inbox high watermark is not 0, `Broker_Publish` shall count the message in the inbox of each sink of the source, and report `BROKER_ALERT_INBOX_HIGH_WATERMARK` once when the count goes above the watermark, until the inbox of the module empties. ]*/
+                    if (is_crossed)
+                    {
+                        defer_alert(broker_data, pending_alerts, BROKER_ALERT_INBOX_HIGH_WATERMARK, module_info->module->module_handle, depth, watermark);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/* must be called with modules_lock held, the alerts are reported by the caller once it is released */
+static BROKER_RESULT publish_to_queues(BROKER_HANDLE_DATA* broker_data, MODULE_HANDLE topic, MESSAGE_HANDLE message, size_t watermark, VECTOR_HANDLE* pending_alerts)
+{
+    BROKER_RESULT result;
+    int32_t msg_size;
+    int32_t buf_size;
+    /*Codes_SRS_BROKER_17_007: [ Broker_Publish shall clone the message. ]*/
+    MESSAGE_HANDLE msg = Message_Clone(message);
+    /*Codes_SRS_BROKER_17_008: [ Broker_Publish shall serialize the message. ]*/
+    msg_size = Message_ToByteArray(message, NULL, 0);
+    if (msg_size < 0)
+    {
+        /*Codes_SRS_BROKER_13_053: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
+        LogError("unable to serialize a message [%p]", msg);
+        Message_Destroy(msg);
+        result = BROKER_ERROR;
+    }
+    else
+    {
+        /*Codes_SRS_BROKER_17_025: [ Broker_Publish shall allocate a nanomsg buffer the size of the serialized message + sizeof(MODULE_HANDLE). ]*/
+        buf_size = msg_size + sizeof(MODULE_HANDLE);
+        void* nn_msg = nn_allocmsg(buf_size, 0);
+        if (nn_msg == NULL)
+        {
+            /*Codes_SRS_BROKER_13_053: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
+            LogError("unable to serialize a message [%p]", msg);
+            result = BROKER_ERROR;
+        }
+        else
+        {
+            /*Codes_SRS_BROKER_17_026: [ Broker_Publish shall copy source into the beginning of the nanomsg buffer. ]*/
+            unsigned char *nn_msg_bytes = (unsigned char *)nn_msg;
+            memcpy(nn_msg_bytes, &topic, sizeof(MODULE_HANDLE));
+            /*Codes_SRS_BROKER_17_027: [ Broker_Publish shall serialize the message into the remainder of the nanomsg buffer. ]*/
+            nn_msg_bytes += sizeof(MODULE_HANDLE);
+            Message_ToByteArray(message, nn_msg_bytes, msg_size);
+
+            /*Codes_SRS_BROKER_17_010: [ Broker_Publish shall send a message on the publish_socket. ]*/
+            int nbytes = nn_send(broker_data->publish_socket, &nn_msg, NN_MSG, 0);
+            if (nbytes != buf_size)
+            {
+                /*Codes_SRS_BROKER_13_053: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
+                LogError("unable to send a message [%p]", msg);
+                /*Codes_SRS_BROKER_17_012: [ Broker_Publish shall free the message. ]*/
+                nn_freemsg(nn_msg);
+                result = BROKER_ERROR;
+            }
+            else
+            {
+                add_to_inboxes(broker_data, topic, watermark, pending_alerts);
+                result = BROKER_OK;
+            }
+        }
+        /*Codes_SRS_BROKER_17_012: [ Broker_Publish shall free the message. ]*/
+        Message_Destroy(msg);
+        /*Codes_SRS_BROKER_17_011: [ Broker_Publish shall free the serialized message data. ]*/
+    }
+
+    if (result != BROKER_OK)
+    {
+        /*Codes_SRS_BROKER_31_046: [ If the message cannot be sent, `Broker_Publish` shall report `BROKER_ALERT_MESSAGE_DROPPED` for the source. ]*/
+        defer_alert(broker_data, pending_alerts, BROKER_ALERT_MESSAGE_DROPPED, topic, 1, 0);
+    }
+    return result;
+}
+
+/* returns false if the fusion was detached before the sink could receive the message */
+static bool deliver_fused(BROKER_FUSION* fusion, MESSAGE_HANDLE message, BROKER_RESULT* result)
+{
+    bool is_handled;
+    /*Codes_SRS_BROKER_31_037: [ `Broker_Publish` shall hold the lock of the fusion while it calls the sink's `Receive`, so the sink receives one message at a time. ]*/
+    if (Lock(fusion->receive_lock) != LOCK_OK)
+    {
+        LogError("unable to lock the fusion from [%p] to [%p]", fusion->source, fusion->sink.module_handle);
+        *result = BROKER_ERROR;
+        is_handled = true;
+    }
+    else
+    {
+        is_handled = !fusion->detached;
+        if (is_handled)
+        {
+            /*Codes_SRS_BROKER_31_036: [ If the source has a fused link, `Broker_Publish` shall release `modules_lock` and pass `message` to the sink's `Receive` on the calling thread, without cloning, serializing or sending it. ]*/
+            MODULE_RECEIVE(fusion->sink.module_apis)(fusion->sink.module_handle, message);
+            *result = BROKER_OK;
+        }
+        Unlock(fusion->receive_lock);
+    }
+    return is_handled;
+}
+
+BROKER_RESULT Broker_Publish(BROKER_HANDLE broker, MODULE_HANDLE source, MESSAGE_HANDLE message)
+{
+    BROKER_RESULT result;
+    /*Codes_SRS_BROKER_13_030: [If broker or message is NULL the function shall return BROKER_INVALIDARG.]*/
+    if (broker == NULL || source == NULL || message == NULL)
+    {
+        result = BROKER_INVALIDARG;
+        LogError("Broker handle, source, and/or message handle is NULL");
+    }
+    else
+    {
+        BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
+        size_t watermark = get_alert_thresholds(broker_data).inbox_high_watermark;
+        VECTOR_HANDLE pending_alerts = NULL;
+        /*Codes_SRS_BROKER_17_022: [ Broker_Publish shall Lock the modules lock. ]*/
+        if (Lock(broker_data->modules_lock) != LOCK_OK)
+        {
+            /*Codes_SRS_BROKER_13_053: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
+            LogError("Lock on broker_data->modules_lock failed");
+            result = BROKER_ERROR;
+        }
+        else
+        {
+            /*Codes_SRS_BROKER_31_024: [ If `source` is an alias, `Broker_Publish` shall copy the handle of the module the alias stands for instead. ]*/
+            MODULE_HANDLE topic = resolve_alias(broker_data, source);
+            size_t fusion_index = find_fusion(broker_data, topic);
+
+            if (fusion_index == broker_data->fusion_count)
+            {
+                result = publish_to_queues(broker_data, topic, message, watermark, &pending_alerts);
+                /*Codes_SRS_BROKER_17_023: [ Broker_Publish shall Unlock the modules lock. ]*/
+                Unlock(broker_data->modules_lock);
+            }
+            else
+            {
+                BROKER_FUSION* fusion = broker_data->fusions[fusion_index];
+                fusion->in_flight++;
+                Unlock(broker_data->modules_lock);
+
+                /* the sink may publish from Receive, which goes down the chain on this thread */
+                bool is_handled = deliver_fused(fusion, message, &result);
+
+                if (Lock(broker_data->modules_lock) != LOCK_OK)
+                {
+                    /* the fusion stays in flight and is never destroyed */
+                    LogError("Lock on broker_data->modules_lock failed");
+                    result = BROKER_ERROR;
+                }
+                else
+                {
+                    bool is_released;
+                    fusion->in_flight--;
+                    is_released = fusion->detached && fusion->in_flight == 0;
+                    if (!is_handled)
+                    {
+                        /*Codes_SRS_BROKER_31_038: [ If the link was unfused before the sink received the message, `Broker_Publish` shall send the message as if the link had not been fused. ]*/
+                        result = publish_to_queues(broker_data, topic, message, watermark, &pending_alerts);
+                    }
+                    Unlock(broker_data->modules_lock);
+
+                    /*Codes_SRS_BROKER_31_039: [ The last publisher delivering through a detached fusion shall free it. ]*/
+                    if (is_released)
+                    {
+                        destroy_fusion(fusion);
+                    }
+                }
+            }
+        }
+
+        /*Codes_SRS_BROKER_31_055: [ `Broker_Publish` shall report the alerts of the message after it released `modules_lock`. ]*/
+        report_pending_alerts(broker_data, pending_alerts);
 
     }
     /*Codes_SRS_BROKER_13_037: [ This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise. ]*/
     return result;
-}
\ No newline at end of file
+}
@@ -16,7 +16,6 @@
 
 static bool module_info_name_find(const void* element, const void* module_name);
 static void gateway_destroymodulelist_internal(GATEWAY_MODULE_INFO* infos, size_t count);
-static bool module_data_find(const void* element, const void* value);
 
 VECTOR_HANDLE Gateway_GetModuleList(GATEWAY_HANDLE gw)
 {
@@ -72,6 +71,8 @@ VECTOR_HANDLE Gateway_GetModuleList(GATEWAY_HANDLE gw)
                         MODULE_DATA *module_data = *(MODULE_DATA**)VECTOR_element(gw->modules, i);
                         GATEWAY_MODULE_INFO *info = (GATEWAY_MODULE_INFO*)VECTOR_element(result, i);
                         info->module_name = module_data->module_name;
+                        /*Codes_SRS_GATEWAY_31_033: [ For each module returned this function shall provide the handle of the module, which the alert events refer to. ]*/
+                        info->module_handle = module_data->module;
                         info->module_sources = VECTOR_create(sizeof(GATEWAY_MODULE_INFO*));
                         if (info->module_sources == NULL)
                         {
@@ -147,6 +148,34 @@ void Gateway_AddEventCallback(GATEWAY_HANDLE gw, GATEWAY_EVENT event_type, GATEW
     }
 }
 
+int Gateway_SetAlertThresholds(GATEWAY_HANDLE gw, const GATEWAY_ALERT_THRESHOLDS* thresholds)
+{
+    int result;
+    /*Codes_SRS_GATEWAY_31_031: [ Gateway_SetAlertThresholds shall return a non-zero value if gw or thresholds is NULL. ]*/
+    if (gw == NULL || thresholds == NULL)
+    {
+        LogError("Gateway_SetAlertThresholds: the gateway or the thresholds are NULL.");
+        result = __LINE__;
+    }
+    else
+    {
+        BROKER_ALERT_THRESHOLDS broker_thresholds;
+        broker_thresholds.inbox_high_watermark = thresholds->inbox_high_watermark;
+        broker_thresholds.receive_budget_ms = thresholds->receive_budget_ms;
+        /*Codes_SRS_GATEWAY_31_032: [ Gateway_SetAlertThresholds shall set the thresholds of the broker alerts, and return a non-zero value if it fails or 0 otherwise. ]*/
+        if (Broker_SetAlertThresholds(gw->broker, &broker_thresholds) != BROKER_OK)
+        {
+            LogError("Gateway_SetAlertThresholds: Broker_SetAlertThresholds failed.");
+            result = __LINE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+    return result;
+}
+
 GATEWAY_HANDLE Gateway_Create(const GATEWAY_PROPERTIES* properties)
 {
     GATEWAY_HANDLE result;
@@ -177,19 +206,16 @@ GATEWAY_START_RESULT Gateway_Start(GATEWAY_HANDLE gw)
     {
         GATEWAY_HANDLE_DATA* gateway_handle = (GATEWAY_HANDLE_DATA*)gw;
 
-        /*Codes_SRS_GATEWAY_17_010: [ This function shall call Module_Start for every module which defines the start function. ]*/
-        size_t module_count = VECTOR_size(gateway_handle->modules);
-        size_t m;
-        for (m = 0; m < module_count; m++)
+        /*Codes_SRS_GATEWAY_31_023: [ If link fusion is enabled and the gateway is not started, this function shall fuse the links before starting the modules. ]*/
+        if (gateway_handle->fuse_links && !gateway_handle->started)
         {
-            MODULE_DATA** module_data = VECTOR_element(gateway_handle->modules, m);
-            pfModule_Start pfStart = MODULE_START((*module_data)->module_loader->api->GetApi((*module_data)->module_loader, (*module_data)->module_library_handle));
-            if (pfStart != NULL)
-            {
-                /*Codes_SRS_GATEWAY_17_010: [ This function shall call Module_Start for every module which defines the start function. ]*/
-                (pfStart)((*module_data)->module);
-            }
+            gateway_fuselinks_internal(gateway_handle);
         }
+
+        /*Codes_SRS_GATEWAY_17_010: [ This function shall call Module_Start for every module which defines the start function. ]*/
+        gateway_startmodules_internal(gateway_handle);
+        gateway_handle->started = true;
+
         /*Codes_SRS_GATEWAY_17_012: [ This function shall report a GATEWAY_STARTED event. ]*/
         EventSystem_ReportEvent(gw->event_system, gw, GATEWAY_STARTED);
         /*Codes_SRS_GATEWAY_17_013: [ This function shall return GATEWAY_START_SUCCESS upon completion. ]*/
@@ -203,6 +229,24 @@ GATEWAY_START_RESULT Gateway_Start(GATEWAY_HANDLE gw)
     return result;
 }
 
+int Gateway_EnableLinkFusion(GATEWAY_HANDLE gw)
+{
+    int result;
+    /*Codes_SRS_GATEWAY_31_021: [ Gateway_EnableLinkFusion shall return a non-zero value if gw is NULL or the gateway is started. ]*/
+    if (gw == NULL || gw->started)
+    {
+        LogError("Gateway_EnableLinkFusion: the gateway is NULL or started.");
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_GATEWAY_31_022: [ Gateway_EnableLinkFusion shall make Gateway_Start fuse the links and return 0. ]*/
+        gw->fuse_links = true;
+        result = 0;
+    }
+    return result;
+}
+
 void Gateway_Destroy(GATEWAY_HANDLE gw)
 {
     gateway_destroy_internal(gw);
@@ -242,14 +286,14 @@ extern void Gateway_StartModule(GATEWAY_HANDLE gw, MODULE_HANDLE module)
     if (gw != NULL)
     {
         GATEWAY_HANDLE_DATA* gateway_handle = (GATEWAY_HANDLE_DATA*)gw;
-        MODULE_DATA** module_data = (MODULE_DATA**)VECTOR_find_if(gateway_handle->modules, module_data_find, module);
+        MODULE_DATA* module_data = GatewayIndex_FindModuleByHandle(gateway_handle->index, module);
         if (module_data != NULL)
         {
-            pfModule_Start pfStart = MODULE_START((*module_data)->module_loader->api->GetApi((*module_data)->module_loader, (*module_data)->module_library_handle));
+            pfModule_Start pfStart = MODULE_START(module_data->module_loader->api->GetApi(module_data->module_loader, module_data->module_library_handle));
             if (pfStart != NULL)
             {
                 /*Codes_SRS_GATEWAY_17_008: [ When module is found, if the Module_Start function is defined for this module, the Module_Start function shall be called. ]*/
-                (pfStart)((*module_data)->module);
+                (pfStart)(module_data->module);
             }
         }
         else
@@ -274,7 +318,7 @@ void Gateway_RemoveModule(GATEWAY_HANDLE gw, MODULE_HANDLE module)
         GATEWAY_HANDLE_DATA* gateway_handle = (GATEWAY_HANDLE_DATA*)gw;
 
         /*Codes_SRS_GATEWAY_14_023: [The function shall locate the MODULE_DATA object in GATEWAY_HANDLE_DATA's modules containing module and return if it cannot be found. ]*/
-        MODULE_DATA** module_data = (MODULE_DATA**)VECTOR_find_if(gateway_handle->modules, module_data_find, module);
+        MODULE_DATA* module_data = GatewayIndex_FindModuleByHandle(gateway_handle->index, module);
 
         if (module_data != NULL)
         {
@@ -298,7 +342,7 @@ int Gateway_RemoveModuleByName(GATEWAY_HANDLE gw, const char *module_name)
     int result;
     if (gw != NULL && module_name != NULL)
     {
-        MODULE_DATA **module_data = (MODULE_DATA**)VECTOR_find_if(gw->modules, module_name_find, module_name);
+        MODULE_DATA *module_data = GatewayIndex_FindModuleByName(gw->index, module_name);
         if (module_data != NULL)
         {
             /* Codes_SRS_GATEWAY_26_016: [** The function shall return 0 if the module was found. ] */
@@ -364,7 +408,7 @@ void Gateway_RemoveLink(GATEWAY_HANDLE gw, const GATEWAY_LINK_ENTRY* entryLink)
         GATEWAY_HANDLE_DATA* gateway_handle = (GATEWAY_HANDLE_DATA*)gw;
 
         /*Codes_SRS_GATEWAY_04_006: [ The function shall locate the LINK_DATA object in GATEWAY_HANDLE_DATA's links containing link and return if it cannot be found. ]*/
-        LINK_DATA* link_data = (LINK_DATA*)VECTOR_find_if(gateway_handle->links, link_data_find, entryLink);
+        LINK_DATA* link_data = gateway_findlink_internal(gateway_handle, entryLink);
 
         if (link_data != NULL)
         {
@@ -391,11 +435,6 @@ static void gateway_destroymodulelist_internal(GATEWAY_MODULE_INFO* infos, size_
     }
 }
 
-static bool module_data_find(const void* element, const void* value)
-{
-    return (*(MODULE_DATA**)element)->module == value;
-}
-
 static bool module_info_name_find(const void* element, const void* module_name)
 {
     const char* name = (const char*)module_name;
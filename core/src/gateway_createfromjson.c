@@ -2,14 +2,18 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/macro_utils.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
 #include "gateway.h"
 #include "parson.h"
 #include "experimental/event_system.h"
 
 #include "module_loaders/dynamic_loader.h"
+#include "module_loaders/lazy_loader.h"
 #include "gateway_internal.h"
 
 #define MODULES_KEY "modules"
@@ -20,6 +24,11 @@
 #define LOADER_ENTRYPOINT_KEY "entrypoint"
 #define MODULE_PATH_KEY "module.path"
 #define ARG_KEY "args"
+#define ACTIVATION_KEY "activation"
+#define ACTIVATION_EAGER "eager"
+#define ACTIVATION_LAZY "lazy"
+#define IDLE_TIMEOUT_KEY "idle.timeout"
+#define LINK_FUSION_KEY "link.fusion"
 
 #define LINKS_KEY "links"
 #define SOURCE_KEY "source"
@@ -36,7 +45,9 @@ DEFINE_ENUM(PARSE_JSON_RESULT, PARSE_JSON_RESULT_VALUES);
 
 GATEWAY_HANDLE gateway_create_internal(const GATEWAY_PROPERTIES* properties, bool use_json);
 static PARSE_JSON_RESULT parse_json_internal(GATEWAY_PROPERTIES* out_properties, JSON_Value *root);
+static PARSE_JSON_RESULT parse_activation(JSON_Object* module_json, JSON_Object* loader_json, GATEWAY_MODULE_LOADER_INFO* loader_info);
 static void destroy_properties_internal(GATEWAY_PROPERTIES* properties);
+static void record_module_signatures(GATEWAY_HANDLE gw, JSON_Value *root);
 void gateway_destroy_internal(GATEWAY_HANDLE gw);
 
 GATEWAY_HANDLE Gateway_CreateFromJson(const char* file_path)
@@ -81,6 +92,12 @@ GATEWAY_HANDLE Gateway_CreateFromJson(const char* file_path)
                         {
                             /*Codes_SRS_GATEWAY_JSON_17_001: [ Upon successful creation, this function shall start the gateway. ]*/
                             GATEWAY_START_RESULT start_result;
+
+                            /*Codes_SRS_GATEWAY_JSON_31_017: [ If the root object has "link.fusion" set to true, the function shall make the gateway fuse its links when it starts. ]*/
+                            if (json_object_get_boolean(json_value_get_object(root_value), LINK_FUSION_KEY) == 1)
+                            {
+                                gw->fuse_links = true;
+                            }
                             start_result = Gateway_Start(gw);
                             if (start_result != GATEWAY_START_SUCCESS)
                             {
@@ -89,6 +106,11 @@ GATEWAY_HANDLE Gateway_CreateFromJson(const char* file_path)
                                 gateway_destroy_internal(gw);
                                 gw = NULL;
                             }
+                            else
+                            {
+                                /*Codes_SRS_GATEWAY_JSON_31_001: [ Upon successful start, the function shall record the serialized JSON of each module entry as the signature of the module it created. ]*/
+                                record_module_signatures(gw, root_value);
+                            }
                         }
                     }
                     /*Codes_SRS_GATEWAY_JSON_14_006: [The function shall return NULL if the JSON_Value contains incomplete information.]*/
@@ -273,6 +295,9 @@ GATEWAY_UPDATE_FROM_JSON_RESULT Gateway_UpdateFromJson(GATEWAY_HANDLE gw, const
                                     }
                                     else
                                     {
+                                        /* Codes_SRS_GATEWAY_JSON_31_002: [ Upon successfully adding the modules, the function shall record the serialized JSON of each module entry as the signature of the module it created. ] */
+                                        record_module_signatures(gw, root_value);
+
                                         //Notify Event System.
                                         GATEWAY_HANDLE_DATA* gateway = (GATEWAY_HANDLE_DATA*)gw;
                                         EventSystem_ReportEvent(gateway->event_system, gateway, GATEWAY_MODULE_LIST_CHANGED);
@@ -377,6 +402,126 @@ GATEWAY_UPDATE_FROM_JSON_RESULT Gateway_UpdateFromJson(GATEWAY_HANDLE gw, const
 }
 
 
+GATEWAY_UPDATE_FROM_JSON_RESULT Gateway_ReconfigureFromJson(GATEWAY_HANDLE gw, const char* json_content)
+{
+    GATEWAY_UPDATE_FROM_JSON_RESULT result;
+    /* Codes_SRS_GATEWAY_JSON_31_003: [ If gw or json_content is NULL the function shall return GATEWAY_UPDATE_FROM_JSON_INVALID_ARG. ] */
+    if (gw == NULL || json_content == NULL)
+    {
+        LogError("invalid arg: gw = %p, json_content = %p.", gw, json_content);
+        result = GATEWAY_UPDATE_FROM_JSON_INVALID_ARG;
+    }
+    else
+    {
+        /* Codes_SRS_GATEWAY_JSON_31_004: [ The function shall use parson to parse the JSON string to a parson JSON_Value structure. ] */
+        JSON_Value *root_value = json_parse_string(json_content);
+        if (root_value == NULL)
+        {
+            /* Codes_SRS_GATEWAY_JSON_31_005: [ The function shall return GATEWAY_UPDATE_FROM_JSON_ERROR if the JSON content could not be parsed to a JSON_Value. ] */
+            LogError("JSON content could not be parsed.");
+            result = GATEWAY_UPDATE_FROM_JSON_ERROR;
+        }
+        else
+        {
+            GATEWAY_PROPERTIES *properties = (GATEWAY_PROPERTIES*)malloc(sizeof(GATEWAY_PROPERTIES));
+            if (properties == NULL)
+            {
+                /* Codes_SRS_GATEWAY_JSON_31_006: [ The function shall return GATEWAY_UPDATE_FROM_JSON_MEMORY upon any memory allocation failure. ] */
+                LogError("Failed to allocate GATEWAY_PROPERTIES.");
+                result = GATEWAY_UPDATE_FROM_JSON_MEMORY;
+            }
+            else
+            {
+                properties->gateway_modules = NULL;
+                properties->gateway_links = NULL;
+                /* Codes_SRS_GATEWAY_JSON_31_007: [ The function shall traverse the JSON_Value object to initialize a GATEWAY_PROPERTIES instance, which shall describe both `modules` and `links`. ] */
+                if (parse_json_internal(properties, root_value) != PARSE_JSON_SUCCESS ||
+                    properties->gateway_modules == NULL ||
+                    properties->gateway_links == NULL)
+                {
+                    /* Codes_SRS_GATEWAY_JSON_31_008: [ The function shall return GATEWAY_UPDATE_FROM_JSON_ERROR if the JSON_Value contains incomplete information. ] */
+                    LogError("Failed to create properties structure from JSON configuration.");
+                    result = GATEWAY_UPDATE_FROM_JSON_ERROR;
+                }
+                else
+                {
+                    JSON_Array *modules_array = json_object_get_array(json_value_get_object(root_value), MODULES_KEY);
+                    size_t module_count = VECTOR_size(properties->gateway_modules);
+                    char** module_signatures = (char**)malloc(sizeof(char*) * (module_count > 0 ? module_count : 1));
+                    if (module_signatures == NULL)
+                    {
+                        /* Codes_SRS_GATEWAY_JSON_31_006: [ The function shall return GATEWAY_UPDATE_FROM_JSON_MEMORY upon any memory allocation failure. ] */
+                        LogError("Failed to allocate module signatures.");
+                        result = GATEWAY_UPDATE_FROM_JSON_MEMORY;
+                    }
+                    else
+                    {
+                        /* Codes_SRS_GATEWAY_JSON_31_009: [ The function shall serialize the JSON of each module entry as the signature of that module. ] */
+                        for (size_t module_index = 0; module_index < module_count; ++module_index)
+                        {
+                            module_signatures[module_index] = json_serialize_to_string(json_array_get_value(modules_array, module_index));
+                        }
+
+                        /* Codes_SRS_GATEWAY_JSON_31_010: [ The function shall reconfigure the gateway to the modules and links described, keeping the modules whose signature is unchanged. ] */
+                        if (gateway_reconfigure_internal((GATEWAY_HANDLE_DATA*)gw, properties->gateway_modules, (const char* const*)module_signatures, properties->gateway_links, true) != 0)
+                        {
+                            /* Codes_SRS_GATEWAY_JSON_31_011: [ The function shall return GATEWAY_UPDATE_FROM_JSON_ERROR if the gateway could not be reconfigured. ] */
+                            LogError("Failed to reconfigure the gateway.");
+                            result = GATEWAY_UPDATE_FROM_JSON_ERROR;
+                        }
+                        else
+                        {
+                            /* Codes_SRS_GATEWAY_JSON_31_012: [ The function shall return GATEWAY_UPDATE_FROM_JSON_SUCCESS upon success. ] */
+                            result = GATEWAY_UPDATE_FROM_JSON_SUCCESS;
+                        }
+
+                        for (size_t module_index = 0; module_index < module_count; ++module_index)
+                        {
+                            if (module_signatures[module_index] != NULL)
+                            {
+                                json_free_serialized_string(module_signatures[module_index]);
+                            }
+                        }
+                        free(module_signatures);
+                    }
+                }
+                destroy_properties_internal(properties);
+                free(properties);
+            }
+            json_value_free(root_value);
+        }
+    }
+
+    return result;
+}
+
+static void record_module_signatures(GATEWAY_HANDLE gw, JSON_Value *root)
+{
+    JSON_Array *modules_array = json_object_get_array(json_value_get_object(root), MODULES_KEY);
+    size_t module_count = json_array_get_count(modules_array);
+    for (size_t module_index = 0; module_index < module_count; ++module_index)
+    {
+        JSON_Value *module_value = json_array_get_value(modules_array, module_index);
+        const char* module_name = json_object_get_string(json_value_get_object(module_value), MODULE_NAME_KEY);
+        MODULE_DATA* module_data = GatewayIndex_FindModuleByName(((GATEWAY_HANDLE_DATA*)gw)->index, module_name);
+        if (module_data != NULL && module_data->module_signature == NULL)
+        {
+            char* module_signature = json_serialize_to_string(module_value);
+            if (module_signature == NULL ||
+                mallocAndStrcpy_s(&module_data->module_signature, module_signature) != 0)
+            {
+                /* a module without signature is replaced by the next reconfiguration */
+                LogError("Failed to record the signature of module %s.", module_name);
+                module_data->module_signature = NULL;
+            }
+            if (module_signature != NULL)
+            {
+                json_free_serialized_string(module_signature);
+            }
+        }
+    }
+}
+
 static void destroy_properties_internal(GATEWAY_PROPERTIES* properties)
 {
     if (properties->gateway_modules != NULL)
@@ -446,6 +591,50 @@ static PARSE_JSON_RESULT parse_loader(JSON_Object* loader_json, GATEWAY_MODULE_L
     return result;
 }
 
+static PARSE_JSON_RESULT parse_activation(JSON_Object* module_json, JSON_Object* loader_json, GATEWAY_MODULE_LOADER_INFO* loader_info)
+{
+    PARSE_JSON_RESULT result;
+
+    /*Codes_SRS_GATEWAY_JSON_31_013: [ The function shall parse each module object for an optional "activation", which is "eager" when it is missing. ]*/
+    const char* activation = json_object_get_string(module_json, ACTIVATION_KEY);
+    if (activation == NULL || strcmp(activation, ACTIVATION_EAGER) == 0)
+    {
+        result = PARSE_JSON_SUCCESS;
+    }
+    else if (strcmp(activation, ACTIVATION_LAZY) != 0)
+    {
+        /*Codes_SRS_GATEWAY_JSON_31_014: [ If "activation" is neither "eager" nor "lazy", the function shall fail and return NULL. ]*/
+        LogError("Module JSON has an unknown \"activation\" specified - %s.", activation);
+        result = PARSE_JSON_MISSING_OR_MISCONFIGURED_CONFIG;
+    }
+    else
+    {
+        /*Codes_SRS_GATEWAY_JSON_31_015: [ For a "lazy" module, the function shall replace the module loader and entrypoint by a lazy loader entrypoint made of the module loader, its "loader.entrypoint" JSON and the optional "idle.timeout" milliseconds. ]*/
+        double idle_timeout = json_object_get_number(module_json, IDLE_TIMEOUT_KEY);
+        LAZY_LOADER_ENTRYPOINT* entrypoint = (idle_timeout < 0 || idle_timeout > UINT_MAX) ? NULL :
+            LazyLoader_CreateEntrypoint(loader_info->loader, json_object_get_value(loader_json, LOADER_ENTRYPOINT_KEY), (unsigned int)idle_timeout);
+        if (entrypoint == NULL)
+        {
+            /*Codes_SRS_GATEWAY_JSON_31_016: [ If the lazy loader entrypoint cannot be created, the function shall fail and return NULL. ]*/
+            LogError("Failed to create the lazy loader entrypoint, \"idle.timeout\" = %f.", idle_timeout);
+            result = PARSE_JSON_MISSING_OR_MISCONFIGURED_CONFIG;
+        }
+        else
+        {
+            /* the module loader parses its entrypoint again each time the module is created */
+            if (loader_info->entrypoint != NULL)
+            {
+                loader_info->loader->api->FreeEntrypoint(loader_info->loader, loader_info->entrypoint);
+            }
+            loader_info->loader = LazyLoader_Get();
+            loader_info->entrypoint = entrypoint;
+            result = PARSE_JSON_SUCCESS;
+        }
+    }
+
+    return result;
+}
+
 static PARSE_JSON_RESULT parse_json_internal(GATEWAY_PROPERTIES* out_properties, JSON_Value *root)
 {
     PARSE_JSON_RESULT result;
@@ -489,7 +678,7 @@ static PARSE_JSON_RESULT parse_json_internal(GATEWAY_PROPERTIES* out_properties,
                             else
                             {
                                 const char* module_name = json_object_get_string(module, MODULE_NAME_KEY);
-                                if (module_name != NULL)
+                                if (module_name != NULL && parse_activation(module, loader_args, &loader_info) == PARSE_JSON_SUCCESS)
                                 {
                                     /*Codes_SRS_GATEWAY_JSON_14_005: [The function shall set the value of const void* module_properties in the GATEWAY_PROPERTIES instance to a char* representing the serialized args value for the particular module.]*/
                                     JSON_Value *args = json_object_get_value(module, ARG_KEY);
@@ -520,7 +709,7 @@ static PARSE_JSON_RESULT parse_json_internal(GATEWAY_PROPERTIES* out_properties,
                                 {
                                     loader_info.loader->api->FreeEntrypoint(loader_info.loader, loader_info.entrypoint);
                                     result = PARSE_JSON_MISSING_OR_MISCONFIGURED_CONFIG;
-                                    LogError("\"module name\" or \"module path\" in input JSON configuration is missing or misconfigured.");
+                                    LogError("\"module name\", \"module path\" or \"activation\" in input JSON configuration is missing or misconfigured.");
                                     break;
                                 }
                             }
@@ -0,0 +1,395 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <azure_c_shared_utility/gballoc.h>
+#include <azure_c_shared_utility/xlogging.h>
+#include <azure_c_shared_utility/vector.h>
+
+#include "experimental/event_system.h"
+#include "broker.h"
+#include "gateway_internal.h"
+#include "gateway_index.h"
+
+/* A power of two, the tables double when three quarters full */
+#define INDEX_INITIAL_CAPACITY 16
+
+typedef struct INDEX_SLOT_TAG
+{
+    /** @brief  The module name, the module handle or the link source */
+    const void* key;
+
+    /** @brief  The link sink, NULL in the module tables */
+    const void* sink;
+
+    MODULE_DATA* module_data;
+    size_t hash;
+    bool used;
+} INDEX_SLOT;
+
+typedef bool(*INDEX_KEY_EQUAL)(const INDEX_SLOT* slot, const void* key, const void* sink);
+
+/* Open addressing with linear probing, removal shifts the following entries back */
+typedef struct INDEX_TABLE_TAG
+{
+    INDEX_SLOT* slots;
+    size_t capacity;
+    size_t count;
+    INDEX_KEY_EQUAL key_equal;
+} INDEX_TABLE;
+
+typedef struct GATEWAY_INDEX_TAG
+{
+    INDEX_TABLE modules_by_name;
+    INDEX_TABLE modules_by_handle;
+    INDEX_TABLE links;
+} GATEWAY_INDEX;
+
+static size_t hash_name(const char* name)
+{
+    /* FNV-1a */
+    size_t hash = (size_t)2166136261u;
+    while (*name != '\0')
+    {
+        hash ^= (unsigned char)*name++;
+        hash *= (size_t)16777619u;
+    }
+    return hash;
+}
+
+static size_t hash_pointer(const void* pointer)
+{
+    /* handles and MODULE_DATA are aligned allocations, mix the high bits into the low ones */
+    uintptr_t value = (uintptr_t)pointer;
+    value ^= value >> 16;
+    value *= (uintptr_t)0x45d9f3bu;
+    value ^= value >> 16;
+    return (size_t)value;
+}
+
+static size_t hash_link(const void* source, const void* sink)
+{
+    return hash_pointer(source) * 31 + hash_pointer(sink);
+}
+
+static bool name_equal(const INDEX_SLOT* slot, const void* key, const void* sink)
+{
+    (void)sink;
+    return strcmp((const char*)slot->key, (const char*)key) == 0;
+}
+
+static bool pointers_equal(const INDEX_SLOT* slot, const void* key, const void* sink)
+{
+    return slot->key == key && slot->sink == sink;
+}
+
+static int init_table(INDEX_TABLE* table, INDEX_KEY_EQUAL key_equal)
+{
+    int result;
+
+    table->slots = (INDEX_SLOT*)malloc(INDEX_INITIAL_CAPACITY * sizeof(INDEX_SLOT));
+    if (table->slots == NULL)
+    {
+        LogError("Unable to allocate the index table.");
+        result = __LINE__;
+    }
+    else
+    {
+        memset(table->slots, 0, INDEX_INITIAL_CAPACITY * sizeof(INDEX_SLOT));
+        table->capacity = INDEX_INITIAL_CAPACITY;
+        table->count = 0;
+        table->key_equal = key_equal;
+        result = 0;
+    }
+
+    return result;
+}
+
+/* Returns the slot holding the key, or the empty slot ending its probe sequence. */
+static size_t find_slot(const INDEX_TABLE* table, size_t hash, const void* key, const void* sink)
+{
+    size_t mask = table->capacity - 1;
+    size_t i = hash & mask;
+
+    while (table->slots[i].used &&
+        !(table->slots[i].hash == hash && table->key_equal(&table->slots[i], key, sink)))
+    {
+        i = (i + 1) & mask;
+    }
+
+    return i;
+}
+
+static int grow_table(INDEX_TABLE* table)
+{
+    int result;
+    size_t capacity = table->capacity * 2;
+    INDEX_SLOT* slots;
+
+    if (capacity > SIZE_MAX / sizeof(INDEX_SLOT) ||
+        (slots = (INDEX_SLOT*)malloc(capacity * sizeof(INDEX_SLOT))) == NULL)
+    {
+        LogError("Unable to grow the index table to %zu slots.", capacity);
+        result = __LINE__;
+    }
+    else
+    {
+        INDEX_SLOT* previous_slots = table->slots;
+        size_t previous_capacity = table->capacity;
+        size_t i;
+
+        memset(slots, 0, capacity * sizeof(INDEX_SLOT));
+        table->slots = slots;
+        table->capacity = capacity;
+        for (i = 0; i < previous_capacity; i++)
+        {
+            if (previous_slots[i].used)
+            {
+                table->slots[find_slot(table, previous_slots[i].hash, previous_slots[i].key, previous_slots[i].sink)] = previous_slots[i];
+            }
+        }
+        free(previous_slots);
+        result = 0;
+    }
+
+    return result;
+}
+
+static int insert_slot(INDEX_TABLE* table, size_t hash, const void* key, const void* sink, MODULE_DATA* module_data)
+{
+    int result;
+
+    /*Codes_SRS_GATEWAY_INDEX_31_012: [ The index shall double a table when it gets three quarters full, so a lookup takes the same time whatever the number of modules and links. ]*/
+    if ((table->count + 1) * 4 > table->capacity * 3 && grow_table(table) != 0)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        size_t i = find_slot(table, hash, key, sink);
+        if (table->slots[i].used)
+        {
+            LogError("The key is already in the index.");
+            result = __LINE__;
+        }
+        else
+        {
+            table->slots[i].key = key;
+            table->slots[i].sink = sink;
+            table->slots[i].module_data = module_data;
+            table->slots[i].hash = hash;
+            table->slots[i].used = true;
+            table->count++;
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+static void remove_slot(INDEX_TABLE* table, size_t hash, const void* key, const void* sink)
+{
+    size_t mask = table->capacity - 1;
+    size_t hole = find_slot(table, hash, key, sink);
+
+    if (table->slots[hole].used)
+    {
+        size_t i = hole;
+
+        table->slots[hole].used = false;
+        table->count--;
+
+        /* move back the entries probed past the hole, so no probe sequence gets broken */
+        for (i = (i + 1) & mask; table->slots[i].used; i = (i + 1) & mask)
+        {
+            size_t home = table->slots[i].hash & mask;
+            if (((i - home) & mask) >= ((i - hole) & mask))
+            {
+                table->slots[hole] = table->slots[i];
+                table->slots[i].used = false;
+                hole = i;
+            }
+        }
+    }
+}
+
+static MODULE_DATA* lookup_slot(const INDEX_TABLE* table, size_t hash, const void* key, const void* sink)
+{
+    size_t i = find_slot(table, hash, key, sink);
+    return table->slots[i].used ? table->slots[i].module_data : NULL;
+}
+
+GATEWAY_INDEX_HANDLE GatewayIndex_Create(void)
+{
+    GATEWAY_INDEX* result = (GATEWAY_INDEX*)malloc(sizeof(GATEWAY_INDEX));
+
+    if (result == NULL)
+    {
+        /*Codes_SRS_GATEWAY_INDEX_31_002: [ If any allocation fails, `GatewayIndex_Create` shall free what it allocated and return `NULL`. ]*/
+        LogError("Unable to allocate the gateway index.");
+    }
+    else
+    {
+        memset(result, 0, sizeof(GATEWAY_INDEX));
+
+        /*Codes_SRS_GATEWAY_INDEX_31_001: [ `GatewayIndex_Create` shall create an empty index of the modules by name, of the modules by handle and of the links. ]*/
+        if (init_table(&result->modules_by_name, name_equal) != 0 ||
+            init_table(&result->modules_by_handle, pointers_equal) != 0 ||
+            init_table(&result->links, pointers_equal) != 0)
+        {
+            /*Codes_SRS_GATEWAY_INDEX_31_002: [ If any allocation fails, `GatewayIndex_Create` shall free what it allocated and return `NULL`. ]*/
+            GatewayIndex_Destroy(result);
+            result = NULL;
+        }
+    }
+
+    return result;
+}
+
+void GatewayIndex_Destroy(GATEWAY_INDEX_HANDLE index)
+{
+    /*Codes_SRS_GATEWAY_INDEX_31_003: [ If `index` is `NULL`, `GatewayIndex_Destroy` shall do nothing. ]*/
+    if (index != NULL)
+    {
+        /*Codes_SRS_GATEWAY_INDEX_31_004: [ `GatewayIndex_Destroy` shall free the index, but not the modules it refers to. ]*/
+        free(index->modules_by_name.slots);
+        free(index->modules_by_handle.slots);
+        free(index->links.slots);
+        free(index);
+    }
+}
+
+int GatewayIndex_AddModule(GATEWAY_INDEX_HANDLE index, MODULE_DATA* module_data)
+{
+    int result;
+
+    /*Codes_SRS_GATEWAY_INDEX_31_005: [ If `index`, `module_data` or its name is `NULL`, `GatewayIndex_AddModule` shall fail and return a non-zero value. ]*/
+    if (index == NULL || module_data == NULL || module_data->module_name == NULL)
+    {
+        LogError("Invalid arguments: index = %p, module_data = %p.", index, module_data);
+        result = __LINE__;
+    }
+    /*Codes_SRS_GATEWAY_INDEX_31_006: [ `GatewayIndex_AddModule` shall index the module by its name and by its handle, and return 0. ]*/
+    else if (insert_slot(&index->modules_by_name, hash_name(module_data->module_name), module_data->module_name, NULL, module_data) != 0)
+    {
+        /*Codes_SRS_GATEWAY_INDEX_31_007: [ If the name or the handle is already indexed, or if an allocation fails, `GatewayIndex_AddModule` shall leave the index unchanged and return a non-zero value. ]*/
+        result = __LINE__;
+    }
+    else if (insert_slot(&index->modules_by_handle, hash_pointer(module_data->module), module_data->module, NULL, module_data) != 0)
+    {
+        /*Codes_SRS_GATEWAY_INDEX_31_007: [ If the name or the handle is already indexed, or if an allocation fails, `GatewayIndex_AddModule` shall leave the index unchanged and return a non-zero value. ]*/
+        remove_slot(&index->modules_by_name, hash_name(module_data->module_name), module_data->module_name, NULL);
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+
+    return result;
+}
+
+void GatewayIndex_RemoveModule(GATEWAY_INDEX_HANDLE index, const MODULE_DATA* module_data)
+{
+    /*Codes_SRS_GATEWAY_INDEX_31_008: [ `GatewayIndex_RemoveModule` shall remove the module from the index, and do nothing if `index` or `module_data` is `NULL`. ]*/
+    if (index != NULL && module_data != NULL)
+    {
+        if (lookup_slot(&index->modules_by_name, hash_name(module_data->module_name), module_data->module_name, NULL) == module_data)
+        {
+            remove_slot(&index->modules_by_name, hash_name(module_data->module_name), module_data->module_name, NULL);
+        }
+        if (lookup_slot(&index->modules_by_handle, hash_pointer(module_data->module), module_data->module, NULL) == module_data)
+        {
+            remove_slot(&index->modules_by_handle, hash_pointer(module_data->module), module_data->module, NULL);
+        }
+    }
+}
+
+MODULE_DATA* GatewayIndex_FindModuleByName(GATEWAY_INDEX_HANDLE index, const char* module_name)
+{
+    MODULE_DATA* result;
+
+    /*Codes_SRS_GATEWAY_INDEX_31_009: [ `GatewayIndex_FindModuleByName` shall return the module of this name, or `NULL` if there is none or an argument is `NULL`. ]*/
+    if (index == NULL || module_name == NULL)
+    {
+        result = NULL;
+    }
+    else
+    {
+        result = lookup_slot(&index->modules_by_name, hash_name(module_name), module_name, NULL);
+    }
+
+    return result;
+}
+
+MODULE_DATA* GatewayIndex_FindModuleByHandle(GATEWAY_INDEX_HANDLE index, MODULE_HANDLE module)
+{
+    MODULE_DATA* result;
+
+    /*Codes_SRS_GATEWAY_INDEX_31_010: [ `GatewayIndex_FindModuleByHandle` shall return the module of this handle, or `NULL` if there is none or an argument is `NULL`. ]*/
+    if (index == NULL || module == NULL)
+    {
+        result = NULL;
+    }
+    else
+    {
+        result = lookup_slot(&index->modules_by_handle, hash_pointer(module), module, NULL);
+    }
+
+    return result;
+}
+
+int GatewayIndex_AddLink(GATEWAY_INDEX_HANDLE index, const MODULE_DATA* source, const MODULE_DATA* sink)
+{
+    int result;
+
+    /*Codes_SRS_GATEWAY_INDEX_31_011: [ If `index` or `sink` is `NULL`, `GatewayIndex_AddLink` shall fail and return a non-zero value. ]*/
+    if (index == NULL || sink == NULL)
+    {
+        LogError("Invalid arguments: index = %p, sink = %p.", index, sink);
+        result = __LINE__;
+    }
+    /*Codes_SRS_GATEWAY_INDEX_31_013: [ `GatewayIndex_AddLink` shall index the link from `source` to `sink`, a `NULL` source standing for any source, and return 0. ]*/
+    /*Codes_SRS_GATEWAY_INDEX_31_014: [ If the link is already indexed, or if an allocation fails, `GatewayIndex_AddLink` shall return a non-zero value. ]*/
+    else if (insert_slot(&index->links, hash_link(source, sink), source, sink, NULL) != 0)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+
+    return result;
+}
+
+void GatewayIndex_RemoveLink(GATEWAY_INDEX_HANDLE index, const MODULE_DATA* source, const MODULE_DATA* sink)
+{
+    /*Codes_SRS_GATEWAY_INDEX_31_015: [ `GatewayIndex_RemoveLink` shall remove the link from `source` to `sink` from the index, and do nothing if `index` or `sink` is `NULL`. ]*/
+    if (index != NULL && sink != NULL)
+    {
+        remove_slot(&index->links, hash_link(source, sink), source, sink);
+    }
+}
+
+bool GatewayIndex_HasLink(GATEWAY_INDEX_HANDLE index, const MODULE_DATA* source, const MODULE_DATA* sink)
+{
+    bool result;
+
+    /*Codes_SRS_GATEWAY_INDEX_31_016: [ `GatewayIndex_HasLink` shall return true if the link from `source` to `sink` is indexed, and false otherwise or if `index` or `sink` is `NULL`. ]*/
+    if (index == NULL || sink == NULL)
+    {
+        result = false;
+    }
+    else
+    {
+        size_t i = find_slot(&index->links, hash_link(source, sink), source, sink);
+        result = index->links.slots[i].used;
+    }
+
+    return result;
+}
@@ -0,0 +1,93 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file       gateway_index.h
+ *  @brief      Hash indexes of the modules and links of a gateway.
+ *
+ *  @details    The gateway keeps its modules and links in vectors, in the order
+ *              they were added. The index finds a module by name or by handle,
+ *              and tells if a link between two modules exists, without walking
+ *              the vectors. It does not own the MODULE_DATA it refers to.
+ */
+
+#ifndef GATEWAY_INDEX_H
+#define GATEWAY_INDEX_H
+
+#include "module.h"
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdbool>
+extern "C"
+{
+#else
+#include <stddef.h>
+#include <stdbool.h>
+#endif
+
+struct MODULE_DATA_TAG;
+
+typedef struct GATEWAY_INDEX_TAG* GATEWAY_INDEX_HANDLE;
+
+/** @brief      Creates an empty index.
+ *
+ *  @return     A valid #GATEWAY_INDEX_HANDLE upon success, or @c NULL upon failure.
+ */
+GATEWAY_INDEX_HANDLE GatewayIndex_Create(void);
+
+/** @brief      Destroys the index, not the modules it refers to.
+ *
+ *  @param      index   The #GATEWAY_INDEX_HANDLE to destroy.
+ */
+void GatewayIndex_Destroy(GATEWAY_INDEX_HANDLE index);
+
+/** @brief      Indexes a module by its name and by its handle.
+ *
+ *  @param      index       The #GATEWAY_INDEX_HANDLE to add the module to.
+ *  @param      module_data The module, its name and handle must not change
+ *                          while it is indexed.
+ *
+ *  @return     0 upon success, a non-zero value otherwise.
+ */
+int GatewayIndex_AddModule(GATEWAY_INDEX_HANDLE index, struct MODULE_DATA_TAG* module_data);
+
+/** @brief      Removes a module from the index.
+ *
+ *  @param      index       The #GATEWAY_INDEX_HANDLE to remove the module from.
+ *  @param      module_data The module to remove.
+ */
+void GatewayIndex_RemoveModule(GATEWAY_INDEX_HANDLE index, const struct MODULE_DATA_TAG* module_data);
+
+/** @brief      Finds a module by name.
+ *
+ *  @return     The module, or @c NULL if no module has this name.
+ */
+struct MODULE_DATA_TAG* GatewayIndex_FindModuleByName(GATEWAY_INDEX_HANDLE index, const char* module_name);
+
+/** @brief      Finds a module by handle.
+ *
+ *  @return     The module, or @c NULL if no module has this handle.
+ */
+struct MODULE_DATA_TAG* GatewayIndex_FindModuleByHandle(GATEWAY_INDEX_HANDLE index, MODULE_HANDLE module);
+
+/** @brief      Indexes the link from @c source to @c sink.
+ *
+ *  @param      index   The #GATEWAY_INDEX_HANDLE to add the link to.
+ *  @param      source  The source module, @c NULL for a link from any source.
+ *  @param      sink    The sink module.
+ *
+ *  @return     0 upon success, a non-zero value otherwise.
+ */
+int GatewayIndex_AddLink(GATEWAY_INDEX_HANDLE index, const struct MODULE_DATA_TAG* source, const struct MODULE_DATA_TAG* sink);
+
+/** @brief      Removes the link from @c source to @c sink from the index. */
+void GatewayIndex_RemoveLink(GATEWAY_INDEX_HANDLE index, const struct MODULE_DATA_TAG* source, const struct MODULE_DATA_TAG* sink);
+
+/** @brief      Tells if the link from @c source to @c sink is indexed. */
+bool GatewayIndex_HasLink(GATEWAY_INDEX_HANDLE index, const struct MODULE_DATA_TAG* source, const struct MODULE_DATA_TAG* sink);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*GATEWAY_INDEX_H*/
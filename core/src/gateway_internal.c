@@ -4,8 +4,11 @@
 #include <stdlib.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <azure_c_shared_utility/gballoc.h>
 #include <azure_c_shared_utility/xlogging.h>
+#include <azure_c_shared_utility/lock.h>
+#include <azure_c_shared_utility/threadapi.h>
 
 #include <azure_c_shared_utility/vector.h>
 
@@ -20,41 +23,303 @@
 
 #define GATEWAY_ALL "*"
 
+/* Most threads creating or starting modules at the same time */
+#define GATEWAY_STARTUP_THREADS 8
+
 static MODULE_DATA *no_module = NULL;
 
-bool module_name_find(const void* element, const void* module_name)
+/* A module between loading and attaching to the gateway. */
+typedef struct MODULE_INSTANCE_TAG
+{
+    const GATEWAY_MODULES_ENTRY* entry;
+    MODULE_DATA* module_data;
+    MODULE_LIBRARY_HANDLE module_library_handle;
+    const MODULE_API* module_apis;
+    const void* module_configuration;
+    const void* transformed_module_configuration;
+    MODULE_HANDLE module_handle;
+
+    /** @brief  Modules of the same lane are created one after the other */
+    size_t lane;
+} MODULE_INSTANCE;
+
+typedef struct MODULE_INSTANCES_TAG
+{
+    BROKER_HANDLE broker;
+    MODULE_INSTANCE* instances;
+    size_t count;
+    size_t lane_count;
+} MODULE_INSTANCES;
+
+typedef struct MODULE_START_TAG
+{
+    MODULE_DATA* module_data;
+    pfModule_Start start;
+    bool started;
+
+    /** @brief  Links from this module to a sink not started yet */
+    size_t pending;
+
+    /** @brief  Links from any source to this module */
+    size_t any_source_links;
+
+    /** @brief  Where the modules linked to this one as a source begin in `sources` */
+    size_t first_source;
+} MODULE_START;
+
+typedef struct START_DEPENDENCY_TAG
+{
+    bool from_any_source;
+    size_t source;
+    size_t sink;
+} START_DEPENDENCY;
+
+typedef struct MODULE_POSITION_TAG
+{
+    const MODULE_DATA* module_data;
+    size_t index;
+} MODULE_POSITION;
+
+typedef struct MODULE_STARTS_TAG
+{
+    MODULE_START* modules;
+    size_t module_count;
+    START_DEPENDENCY* dependencies;
+    size_t dependency_count;
+
+    /** @brief  The modules, sorted by MODULE_DATA address */
+    MODULE_POSITION* positions;
+
+    /** @brief  The sources of the links to each module, grouped by sink */
+    size_t* sources;
+    size_t source_count;
+
+    /** @brief  The modules in the order they start, and the ones started together */
+    size_t* queue;
+    size_t* wave;
+} MODULE_STARTS;
+
+typedef void(*GATEWAY_TASK)(void* context, size_t index);
+
+typedef struct GATEWAY_TASKS_TAG
+{
+    LOCK_HANDLE lock;
+    GATEWAY_TASK task;
+    void* context;
+    size_t count;
+    size_t next;
+} GATEWAY_TASKS;
+
+static bool take_task(GATEWAY_TASKS* tasks, size_t* index)
+{
+    bool result;
+
+    if (tasks->lock != NULL && Lock(tasks->lock) != LOCK_OK)
+    {
+        LogError("Unable to lock the gateway tasks.");
+        result = false;
+    }
+    else
+    {
+        if (tasks->next < tasks->count)
+        {
+            *index = tasks->next;
+            tasks->next++;
+            result = true;
+        }
+        else
+        {
+            result = false;
+        }
+
+        if (tasks->lock != NULL)
+        {
+            (void)Unlock(tasks->lock);
+        }
+    }
+
+    return result;
+}
+
+static int run_tasks(void* context)
+{
+    GATEWAY_TASKS* tasks = (GATEWAY_TASKS*)context;
+    size_t index;
+
+    while (take_task(tasks, &index))
+    {
+        tasks->task(tasks->context, index);
+    }
+
+    return 0;
+}
+
+/* Runs task(context, 0) to task(context, count - 1) on up to GATEWAY_STARTUP_THREADS threads, the caller included, and returns once all of them completed. */
+static void run_concurrently(GATEWAY_TASK task, void* context, size_t count)
 {
-    const char* module_name_casted = (const char*)module_name;
-    return (strcmp((*(MODULE_DATA**)element)->module_name, module_name_casted) == 0);
+    GATEWAY_TASKS tasks;
+    tasks.lock = NULL;
+    tasks.task = task;
+    tasks.context = context;
+    tasks.count = count;
+    tasks.next = 0;
+
+    if (count > 1)
+    {
+        tasks.lock = Lock_Init();
+        if (tasks.lock == NULL)
+        {
+            LogError("Lock_Init failed, the gateway tasks run one at a time.");
+        }
+    }
+
+    if (tasks.lock == NULL)
+    {
+        (void)run_tasks(&tasks);
+    }
+    else
+    {
+        THREAD_HANDLE threads[GATEWAY_STARTUP_THREADS - 1];
+        size_t thread_count = ((count < GATEWAY_STARTUP_THREADS) ? count : GATEWAY_STARTUP_THREADS) - 1;
+        size_t threads_created;
+        size_t t;
+
+        for (threads_created = 0; threads_created < thread_count; threads_created++)
+        {
+            if (ThreadAPI_Create(&threads[threads_created], run_tasks, &tasks) != THREADAPI_OK)
+            {
+                /* the threads already running take over the remaining tasks */
+                LogError("ThreadAPI_Create failed, running the gateway tasks on %zu threads.", threads_created + 1);
+                break;
+            }
+        }
+
+        (void)run_tasks(&tasks);
+
+        for (t = 0; t < threads_created; t++)
+        {
+            int thread_result;
+            if (ThreadAPI_Join(threads[t], &thread_result) != THREADAPI_OK)
+            {
+                LogError("ThreadAPI_Join failed.");
+            }
+        }
+
+        Lock_Deinit(tasks.lock);
+    }
 }
 
-static bool link_name_both_find(const void* link_void, const void* name_void)
+/* Finds the modules of a link entry in an index, the source of a link from any source is no_module. */
+static bool find_link_modules(GATEWAY_INDEX_HANDLE index, const GATEWAY_LINK_ENTRY* link_entry, MODULE_DATA** module_source, MODULE_DATA** module_sink)
 {
-    const char* name = (const char*)name_void;
-    const LINK_DATA *link = (LINK_DATA*)link_void;
-    return
-        strcmp(link->module_sink->module_name, name) == 0 ||
-        (!link->from_any_source && strcmp(link->module_source->module_name, name) == 0);
+    bool result;
+
+    *module_sink = GatewayIndex_FindModuleByName(index, link_entry->module_sink);
+    if (strcmp(GATEWAY_ALL, link_entry->module_source) == 0)
+    {
+        *module_source = no_module;
+        result = (*module_sink != NULL);
+    }
+    else
+    {
+        *module_source = GatewayIndex_FindModuleByName(index, link_entry->module_source);
+        result = (*module_source != NULL && *module_sink != NULL);
+    }
+
+    return result;
 }
 
 static bool check_if_link_exists(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_LINK_ENTRY* link_entry)
 {
-    LINK_DATA* link_data = (LINK_DATA*)VECTOR_find_if(gateway_handle->links, link_data_find, link_entry);
+    MODULE_DATA* module_source;
+    MODULE_DATA* module_sink;
+
+    return find_link_modules(gateway_handle->index, link_entry, &module_source, &module_sink) &&
+        GatewayIndex_HasLink(gateway_handle->index, module_source, module_sink);
+}
+
+static bool is_link_fused(const LINK_DATA* link_data)
+{
+    return link_data->module_source != NULL && link_data->module_source->fused_sink == link_data->module_sink;
+}
+
+static void unfuse_modules(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_DATA* source, MODULE_DATA* sink)
+{
+    BROKER_LINK_DATA broker_link_entry =
+    {
+        source->module,
+        sink->module
+    };
+
+    if (Broker_UnfuseLink(gateway_handle->broker, &broker_link_entry) != BROKER_OK)
+    {
+        LogError("Could not unfuse link [%p] -> [%p]", broker_link_entry.module_source_handle, broker_link_entry.module_sink_handle);
+    }
+    source->fused_sink = NULL;
+    sink->fused_source = NULL;
+}
+
+/* A fused source has a single sink and a fused sink a single source, a new link from the source or to the sink breaks the chain. */
+static void unfuse_links_at(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_DATA* source, MODULE_DATA* sink)
+{
+    if (source->fused_sink != NULL)
+    {
+        unfuse_modules(gateway_handle, source, source->fused_sink);
+    }
+    if (sink->fused_source != NULL)
+    {
+        unfuse_modules(gateway_handle, sink->fused_source, sink);
+    }
+}
+
+static void unfuse_all_links(GATEWAY_HANDLE_DATA* gateway_handle)
+{
+    size_t link_count = gateway_handle->fuse_links ? VECTOR_size(gateway_handle->links) : 0;
+    size_t link;
+
+    for (link = 0; link < link_count; link++)
+    {
+        LINK_DATA* link_data = (LINK_DATA*)VECTOR_element(gateway_handle->links, link);
+        if (is_link_fused(link_data))
+        {
+            unfuse_modules(gateway_handle, link_data->module_source, link_data->module_sink);
+        }
+    }
+}
+
+/* The links of a module are counted as they are added and removed, so whether a link can be fused does not depend on the number of links. */
+static void count_link(LINK_DATA* link_data)
+{
+    if (link_data->module_source != NULL)
+    {
+        link_data->module_source->source_link_count++;
+    }
+    link_data->module_sink->sink_link_count++;
+}
 
-    return link_data == NULL ? false : true;
+static void uncount_link(LINK_DATA* link_data)
+{
+    if (link_data->module_source != NULL)
+    {
+        link_data->module_source->source_link_count--;
+    }
+    link_data->module_sink->sink_link_count--;
 }
 
-static int add_one_link_to_broker(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_HANDLE source, MODULE_HANDLE sink)
+static int add_one_link_to_broker(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_DATA* source, MODULE_DATA* sink)
 {
     int result;
     BROKER_LINK_DATA broker_link_entry =
     {
-        source,
-        sink
+        source->module,
+        sink->module
     };
+
+    /*Codes_SRS_GATEWAY_31_025: [ Before a link is added, the gateway shall unfuse the fused links from its source or to its sink. ]*/
+    unfuse_links_at(gateway_handle, source, sink);
     if (Broker_AddLink(gateway_handle->broker, &broker_link_entry) != BROKER_OK)
     {
-        LogError("Could not add link to broker [%p] -> [%p]", source, sink);
+        LogError("Could not add link to broker [%p] -> [%p]", source->module, sink->module);
         result = __LINE__;
     }
     else
@@ -87,27 +352,28 @@ static int remove_one_link_from_broker(GATEWAY_HANDLE_DATA* gateway_handle, MODU
 static int add_regular_link(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_LINK_ENTRY* link_entry)
 {
     int result;
-    MODULE_DATA** module_source_handle = (MODULE_DATA**)VECTOR_find_if(gateway_handle->modules, module_name_find, link_entry->module_source);
+    /*Codes_SRS_GATEWAY_31_015: [ The gateway shall find its modules by name or handle, and its links by source and sink, in the gateway index instead of walking its modules and links. ]*/
+    MODULE_DATA* module_source_data = GatewayIndex_FindModuleByName(gateway_handle->index, link_entry->module_source);
 
     //Check of Source Module exists.
     /*Codes_SRS_GATEWAY_04_011: [If the module referenced by the entryLink->module_source or entryLink->module_sink doesn't exists this function shall return GATEWAY_ADD_LINK_ERROR ] */
-    if (module_source_handle == NULL)
+    if (module_source_data == NULL)
     {
         LogError("Failed to add the link. Source module doesn't exists on this gateway. Module Name: %s.", link_entry->module_source);
         result = __LINE__;
     }
     else
     {
-        MODULE_DATA** module_sink_handle = (MODULE_DATA**)VECTOR_find_if(gateway_handle->modules, module_name_find, link_entry->module_sink);
+        MODULE_DATA* module_sink_data = GatewayIndex_FindModuleByName(gateway_handle->index, link_entry->module_sink);
         /*Codes_SRS_GATEWAY_04_011: [If the module referenced by the entryLink->module_source or entryLink->module_sink doesn't exists this function shall return GATEWAY_ADD_LINK_ERROR ] */
-        if (module_sink_handle == NULL)
+        if (module_sink_data == NULL)
         {
             LogError("Failed to add the link. Sink module doesn't exists on this gateway. Module Name: %s.", link_entry->module_sink);
             result = __LINE__;
         }
         else
         {
-            if (add_one_link_to_broker(gateway_handle, (*module_source_handle)->module, (*module_sink_handle)->module) != 0)
+            if (add_one_link_to_broker(gateway_handle, module_source_data, module_sink_data) != 0)
             {
                 LogError("Unable to add link to Broker.");
                 result = __LINE__;
@@ -117,19 +383,28 @@ static int add_regular_link(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_L
                 LINK_DATA link_data =
                 {
                     false,
-                    *module_source_handle,
-                    *module_sink_handle
+                    module_source_data,
+                    module_sink_data
                 };
 
                 /*Codes_SRS_GATEWAY_04_012: [ This function shall add the entryLink to the gw->links ] */
                 if (VECTOR_push_back(gateway_handle->links, &link_data, 1) != 0)
                 {
                     LogError("Unable to add LINK_DATA* to the gateway links vector.");
-                    remove_one_link_from_broker(gateway_handle, (*module_source_handle)->module, (*module_sink_handle)->module);
+                    remove_one_link_from_broker(gateway_handle, module_source_data->module, module_sink_data->module);
+                    result = __LINE__;
+                }
+                /*Codes_SRS_GATEWAY_31_016: [ The gateway shall add each module and link it tracks to the gateway index, and shall fail to add the module or link if the index cannot be updated. ]*/
+                else if (GatewayIndex_AddLink(gateway_handle->index, module_source_data, module_sink_data) != 0)
+                {
+                    LogError("Unable to add the link to the gateway index.");
+                    VECTOR_erase(gateway_handle->links, VECTOR_back(gateway_handle->links), 1);
+                    remove_one_link_from_broker(gateway_handle, module_source_data->module, module_sink_data->module);
                     result = __LINE__;
                 }
                 else
                 {
+                    count_link(&link_data);
                     result = 0;
                 }
             }
@@ -138,6 +413,34 @@ static int add_regular_link(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_L
     return result;
 }
 
+static void report_broker_alert(void* context, BROKER_ALERT alert, MODULE_HANDLE module, size_t value, size_t threshold)
+{
+    /* the event system is created before the broker reports its alerts and destroyed after they are stopped */
+    GATEWAY_HANDLE_DATA* gateway_handle = (GATEWAY_HANDLE_DATA*)context;
+    GATEWAY_EVENT event_type;
+    GATEWAY_ALERT_CONTEXT alert_context;
+    switch (alert)
+    {
+    case BROKER_ALERT_INBOX_HIGH_WATERMARK:
+        event_type = GATEWAY_MODULE_INBOX_HIGH_WATERMARK;
+        break;
+    case BROKER_ALERT_MESSAGE_DROPPED:
+        event_type = GATEWAY_MESSAGE_DROPPED;
+        break;
+    case BROKER_ALERT_RECEIVE_SLOW:
+        event_type = GATEWAY_MODULE_RECEIVE_SLOW;
+        break;
+    default:
+        event_type = GATEWAY_OUTPROCESS_DETACHED;
+        break;
+    }
+    alert_context.module_handle = module;
+    alert_context.value = value;
+    alert_context.threshold = threshold;
+    /*Codes_SRS_GATEWAY_31_029: [ The gateway shall report each alert of the broker as the matching alert event, with the module handle, value and threshold of the alert as its context. ]*/
+    EventSystem_ReportAlert(gateway_handle->event_system, gateway_handle, event_type, &alert_context);
+}
+
 GATEWAY_HANDLE gateway_create_internal(const GATEWAY_PROPERTIES* properties, bool use_json)
 {
     GATEWAY_HANDLE_DATA* gateway;
@@ -158,8 +461,22 @@ GATEWAY_HANDLE gateway_create_internal(const GATEWAY_PROPERTIES* properties, boo
             gateway = NULL;
             LogError("Gateway_Create(): Broker_Create() failed.");
         }
+        /*Codes_SRS_GATEWAY_26_001: [ This function shall initialize attached Gateway Events callback system and report GATEWAY_STARTED event. ] */
+        else if ((gateway->event_system = EventSystem_Init()) == NULL)
+        {
+            /*Codes_SRS_GATEWAY_26_002: [ If Gateway Events module fails to be initialized the gateway module shall be destroyed with no events reported. ] */
+            LogError("Gateway_Create(): Unable to initialize callback system");
+            gateway_destroy_internal(gateway);
+            gateway = NULL;
+        }
         else
         {
+            /*Codes_SRS_GATEWAY_31_028: [ The function shall make the broker report its alerts to the gateway once its event system is initialized and before adding the modules, and shall only log an error if it cannot. ]*/
+            if (Broker_SetAlertCallback(gateway->broker, report_broker_alert, gateway) != BROKER_OK)
+            {
+                LogError("Gateway_Create(): Broker_SetAlertCallback() failed, no alert event is reported.");
+            }
+
             /*Codes_SRS_GATEWAY_14_033: [ The function shall create a vector to store each MODULE_DATA. ]*/
             gateway->modules = VECTOR_create(sizeof(MODULE_DATA*));
             if (gateway->modules == NULL)
@@ -180,31 +497,23 @@ GATEWAY_HANDLE gateway_create_internal(const GATEWAY_PROPERTIES* properties, boo
                     gateway = NULL;
                     LogError("Gateway_Create(): VECTOR_create for links failed.");
                 }
+                /*Codes_SRS_GATEWAY_31_017: [ The function shall create the gateway index of the modules and links, and shall return NULL if it cannot be created. ]*/
+                else if ((gateway->index = GatewayIndex_Create()) == NULL)
+                {
+                    gateway_destroy_internal(gateway);
+                    gateway = NULL;
+                    LogError("Gateway_Create(): GatewayIndex_Create failed.");
+                }
                 else
                 {
                     if (properties != NULL && properties->gateway_modules != NULL)
                     {
                         /*Codes_SRS_GATEWAY_14_009: [The function shall use each of GATEWAY_PROPERTIES's gateway_modules to create and add a module to the gateway's message broker. ]*/
-                        size_t entries_count = VECTOR_size(properties->gateway_modules);
-                        if (entries_count > 0)
+                        /*Codes_SRS_GATEWAY_14_036: [ If any MODULE_HANDLE is unable to be created from a GATEWAY_MODULES_ENTRY the GATEWAY_HANDLE will be destroyed. ]*/
+                        if (gateway_addmodules_internal(gateway, properties->gateway_modules, use_json) != 0)
                         {
-                            //Add the first module, if successful add others
-                            GATEWAY_MODULES_ENTRY* entry = (GATEWAY_MODULES_ENTRY*)VECTOR_element(properties->gateway_modules, 0);
-                            MODULE_HANDLE module = gateway_addmodule_internal(gateway, entry, use_json);
-
-                            //Continue adding modules until all are added or one fails
-                            for (size_t properties_index = 1; properties_index < entries_count && module != NULL; ++properties_index)
-                            {
-                                entry = (GATEWAY_MODULES_ENTRY*)VECTOR_element(properties->gateway_modules, properties_index);
-                                module = gateway_addmodule_internal(gateway, entry, use_json);
-                            }
-
-                            /*Codes_SRS_GATEWAY_14_036: [ If any MODULE_HANDLE is unable to be created from a GATEWAY_MODULES_ENTRY the GATEWAY_HANDLE will be destroyed. ]*/
-                            if (module == NULL)
-                            {
-                                gateway_destroy_internal(gateway);
-                                gateway = NULL;
-                            }
+                            gateway_destroy_internal(gateway);
+                            gateway = NULL;
                         }
 
                         if (gateway != NULL)
@@ -244,21 +553,9 @@ GATEWAY_HANDLE gateway_create_internal(const GATEWAY_PROPERTIES* properties, boo
                         /* TODO: Seperate the gateway init from gateway start-up so that plugins have the chance
                         * register themselves */
                         /*Codes_SRS_GATEWAY_26_001: [ This function shall initialize attached Gateway Events callback system and report GATEWAY_STARTED event. ] */
-                        gateway->event_system = EventSystem_Init();
-                        /*Codes_SRS_GATEWAY_26_002: [ If Gateway Events module fails to be initialized the gateway module shall be destroyed with no events reported. ] */
-                        if (gateway->event_system == NULL)
-                        {
-                            LogError("Gateway_Create(): Unable to initialize callback system");
-                            gateway_destroy_internal(gateway);
-                            gateway = NULL;
-                        }
-                        else
-                        {
-                            /*Codes_SRS_GATEWAY_26_001: [ This function shall initialize attached Gateway Events callback system and report GATEWAY_STARTED event. ] */
-                            EventSystem_ReportEvent(gateway->event_system, gateway, GATEWAY_CREATED);
-                            /*Codes_SRS_GATEWAY_26_010: [ This function shall report `GATEWAY_MODULE_LIST_CHANGED` event. ] */
-                            EventSystem_ReportEvent(gateway->event_system, gateway, GATEWAY_MODULE_LIST_CHANGED);
-                        }
+                        EventSystem_ReportEvent(gateway->event_system, gateway, GATEWAY_CREATED);
+                        /*Codes_SRS_GATEWAY_26_010: [ This function shall report `GATEWAY_MODULE_LIST_CHANGED` event. ] */
+                        EventSystem_ReportEvent(gateway->event_system, gateway, GATEWAY_MODULE_LIST_CHANGED);
                     }
                 }
             }
@@ -279,6 +576,12 @@ void gateway_destroy_internal(GATEWAY_HANDLE gw)
     {
         GATEWAY_HANDLE_DATA* gateway_handle = (GATEWAY_HANDLE_DATA*)gw;
 
+        if (gateway_handle->broker != NULL)
+        {
+            /*Codes_SRS_GATEWAY_31_030: [ Before destroying the event system, the function shall stop the alerts of the broker, whether or not the event system was created. ]*/
+            (void)Broker_SetAlertCallback(gateway_handle->broker, NULL, NULL);
+        }
+
         if (gateway_handle->event_system != NULL)
         {
             /* event_system might be NULL here if destroying during failed creation, event system API should cleanly handle that */
@@ -292,9 +595,10 @@ void gateway_destroy_internal(GATEWAY_HANDLE gw)
         if (gateway_handle->links != NULL)
         {
             /*Codes_SRS_GATEWAY_04_014: [ The function shall remove each link in GATEWAY_HANDLE_DATA's links vector and destroy GATEWAY_HANDLE_DATA's link. ]*/
+            /*Codes_SRS_GATEWAY_31_018: [ The function shall remove the links, then the modules, from the last one added, so destroying the gateway takes a time proportional to its number of modules and links. ]*/
             while (VECTOR_size(gateway_handle->links) > 0)
             {
-                LINK_DATA* link_data = (LINK_DATA*)VECTOR_front(gateway_handle->links);
+                LINK_DATA* link_data = (LINK_DATA*)VECTOR_back(gateway_handle->links);
                 gateway_removelink_internal(gateway_handle, link_data);
             }
             VECTOR_destroy(gateway_handle->links);
@@ -306,10 +610,10 @@ void gateway_destroy_internal(GATEWAY_HANDLE gw)
             /*Codes_SRS_GATEWAY_14_028: [The function shall remove each module in GATEWAY_HANDLE_DATA's modules vector and destroy GATEWAY_HANDLE_DATA's modules.]*/
             while (VECTOR_size(gateway_handle->modules) > 0)
             {
-                MODULE_DATA** module_data = (MODULE_DATA**)VECTOR_front(gateway_handle->modules);
+                MODULE_DATA** module_data = (MODULE_DATA**)VECTOR_back(gateway_handle->modules);
                 //By design, there will be no NULL module_data_pptr pointers in the vector
                 /*Codes_SRS_GATEWAY_14_037: [If GATEWAY_HANDLE_DATA's message broker cannot remove a module, the function shall log the error and continue removing the modules from the GATEWAY_HANDLE. ]*/
-                gateway_removemodule_internal(gateway_handle, module_data);
+                gateway_removemodule_internal(gateway_handle, *module_data);
             }
 
             VECTOR_destroy(gateway_handle->modules);
@@ -319,6 +623,11 @@ void gateway_destroy_internal(GATEWAY_HANDLE gw)
 #endif
         }
 
+        if (gateway_handle->index != NULL)
+        {
+            GatewayIndex_Destroy(gateway_handle->index);
+        }
+
         if (gateway_handle->broker != NULL)
         {
             /*Codes_SRS_GATEWAY_14_006: [The function shall destroy the GATEWAY_HANDLE_DATA's `broker` `BROKER_HANDLE`. ]*/
@@ -335,14 +644,13 @@ void gateway_destroy_internal(GATEWAY_HANDLE gw)
 
 bool checkIfModuleExists(GATEWAY_HANDLE_DATA* gateway_handle, const char* module_name)
 {
-    MODULE_DATA** module_data = (MODULE_DATA**)VECTOR_find_if(gateway_handle->modules, module_name_find, module_name);
-
-    return module_data == NULL ? false : true;
+    /*Codes_SRS_GATEWAY_31_015: [ The gateway shall find its modules by name or handle, and its links by source and sink, in the gateway index instead of walking its modules and links. ]*/
+    return GatewayIndex_FindModuleByName(gateway_handle->index, module_name) != NULL;
 }
 
-MODULE_HANDLE gateway_addmodule_internal(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_MODULES_ENTRY* module_entry, bool use_json)
+static bool is_module_entry_valid(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_MODULES_ENTRY* module_entry)
 {
-    MODULE_HANDLE module_result;
+    bool result;
 
     /*Codes_SRS_GATEWAY_14_011: [ If gw, entry, or GATEWAY_MODULES_ENTRY's loader_configuration or loader_api is NULL the function shall return NULL. ]*/
     if (
@@ -354,7 +662,7 @@ MODULE_HANDLE gateway_addmodule_internal(GATEWAY_HANDLE_DATA* gateway_handle, co
 		module_entry->module_loader_info.loader->api == NULL
        )
     {
-        module_result = NULL;
+        result = false;
         LogError(
             "Failed to add module because a required input parameter is NULL. gw = %p, module_name = '%s', loader = %p, entrypoint = %p.",
             gateway_handle,
@@ -366,226 +674,1525 @@ MODULE_HANDLE gateway_addmodule_internal(GATEWAY_HANDLE_DATA* gateway_handle, co
     else if (strcmp(module_entry->module_name, GATEWAY_ALL) == 0)
     {
         /*Codes_SRS_GATEWAY_17_001: [ This function shall not accept "*" as a module name. ]*/
-        module_result = NULL;
+        result = false;
         LogError("Failed to add module because the module_name is invalid [%s]", module_entry->module_name);
     }
+    //First check if a module with a given name already exists.
+    /*Codes_SRS_GATEWAY_04_004: [ If a module with the same module_name already exists, this function shall fail and the GATEWAY_HANDLE will be destroyed. ]*/
+    else if (checkIfModuleExists(gateway_handle, module_entry->module_name))
+    {
+        result = false;
+        LogError("Error to add module. Duplicated module name: %s", module_entry->module_name);
+    }
+    else
+    {
+        result = true;
+    }
+
+    return result;
+}
+
+static int load_module(MODULE_INSTANCE* instance, bool use_json)
+{
+    int result;
+    const GATEWAY_MODULES_ENTRY* module_entry = instance->entry;
+
+    /*Codes_SRS_GATEWAY_14_012: [The function shall load the module located at GATEWAY_MODULES_ENTRY's module_path into a MODULE_LIBRARY_HANDLE. ]*/
+    /*Codes_SRS_GATEWAY_17_015: [ The function shall use the module's specified loader and the module's entrypoint to get each module's MODULE_LIBRARY_HANDLE. ]*/
+    instance->module_library_handle = module_entry->module_loader_info.loader->api->Load(
+        module_entry->module_loader_info.loader,
+        module_entry->module_loader_info.entrypoint
+    );
+
+    /*Codes_SRS_GATEWAY_14_031: [If unsuccessful, the function shall return NULL.]*/
+    if (instance->module_library_handle == NULL)
+    {
+        result = __LINE__;
+        LogError("Failed to add module because the module could not be loaded.");
+    }
+    else
+    {
+        //Should always be a safe call.
+        /*Codes_SRS_GATEWAY_14_013: [The function shall get the const MODULE_API* from the MODULE_LIBRARY_HANDLE.]*/
+        instance->module_apis = module_entry->module_loader_info.loader->api->GetApi(module_entry->module_loader_info.loader, instance->module_library_handle);
+
+        // parse module args if needed
+        instance->module_configuration = module_entry->module_configuration;
+        if (use_json)
+        {
+            instance->module_configuration = MODULE_PARSE_CONFIGURATION_FROM_JSON(instance->module_apis)(
+                (const char *)(module_entry->module_configuration)
+            );
+        }
+
+        // request the loader to transform the module configuration to what the module expects
+        /*Codes_SRS_GATEWAY_17_018: [ The function shall construct module configuration from module's entrypoint and module's module_configuration. ]*/
+        /*Codes_SRS_GATEWAY_17_021: [ The function shall construct module configuration from module's entrypoint and module's module_configuration. ]*/
+        /*Codes_SRS_GATEWAY_JSON_17_011: [ The function shall the loader's BuildModuleConfiguration to construct module input from module's "args" and "loader.entrypoint". ]*/
+        instance->transformed_module_configuration = module_entry->module_loader_info.loader->api->BuildModuleConfiguration(
+            module_entry->module_loader_info.loader,
+            module_entry->module_loader_info.entrypoint,
+            instance->module_configuration
+        );
+        instance->module_handle = NULL;
+        result = 0;
+    }
+
+    return result;
+}
+
+static void create_module(BROKER_HANDLE broker, MODULE_INSTANCE* instance)
+{
+    /*Codes_SRS_GATEWAY_14_015: [The function shall use the MODULE_API to create a MODULE_HANDLE using the GATEWAY_MODULES_ENTRY's module_configuration. ]*/
+    instance->module_handle = MODULE_CREATE(instance->module_apis)(broker, instance->transformed_module_configuration);
+}
+
+static void free_module_configuration(MODULE_INSTANCE* instance, bool use_json)
+{
+    const MODULE_LOADER* loader = instance->entry->module_loader_info.loader;
+
+    // free the configurations
+    /*Codes_SRS_GATEWAY_17_020: [ The function shall clean up any constructed resources. ]*/
+    /*Codes_SRS_GATEWAY_17_022: [ The function shall clean up any constructed resources. ]*/
+    if (use_json)
+    {
+        MODULE_FREE_CONFIGURATION(instance->module_apis)((void*)instance->module_configuration);
+    }
+    loader->api->FreeModuleConfiguration(loader, instance->transformed_module_configuration);
+}
+
+/* Releases a loaded module that was not attached to the gateway. */
+static void discard_module(MODULE_INSTANCE* instance)
+{
+    const MODULE_LOADER* loader = instance->entry->module_loader_info.loader;
+
+    if (instance->module_handle != NULL)
+    {
+        MODULE_DESTROY(instance->module_apis)(instance->module_handle);
+    }
+    loader->api->Unload(loader, instance->module_library_handle);
+    free(instance->module_data);
+}
+
+static MODULE_HANDLE attach_module(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_INSTANCE* instance)
+{
+    MODULE_HANDLE module_result;
+    const GATEWAY_MODULES_ENTRY* module_entry = instance->entry;
+    MODULE_DATA* new_module_data = instance->module_data;
+    MODULE_HANDLE module_handle = instance->module_handle;
+
+    /*Codes_SRS_GATEWAY_14_016: [If the module creation is unsuccessful, the function shall return NULL.]*/
+    if (module_handle == NULL)
+    {
+        free(new_module_data);
+        module_result = NULL;
+        module_entry->module_loader_info.loader->api->Unload(module_entry->module_loader_info.loader, instance->module_library_handle);
+        LogError("Module_Create failed.");
+    }
     else
     {
-        //First check if a module with a given name already exists.
-        /*Codes_SRS_GATEWAY_04_004: [ If a module with the same module_name already exists, this function shall fail and the GATEWAY_HANDLE will be destroyed. ]*/
-        bool moduleExist = checkIfModuleExists(gateway_handle, module_entry->module_name);
-        if (!moduleExist)
+        /*Codes_SRS_GATEWAY_99_011: [The function shall assign `module_apis` to `MODULE::module_apis`. ]*/
+        MODULE module;
+        module.module_apis = instance->module_apis;
+        module.module_handle = module_handle;
+
+        /*Codes_SRS_GATEWAY_14_017: [The function shall attach the module to the GATEWAY_HANDLE_DATA's broker using a call to Broker_AddModule. ]*/
+        /*Codes_SRS_GATEWAY_14_018: [If the function cannot attach the module to the message broker, the function shall return NULL.]*/
+        if (Broker_AddModule(gateway_handle->broker, &module) != BROKER_OK)
+        {
+            free(new_module_data);
+            module_result = NULL;
+            LogError("Failed to add module to the gateway's broker.");
+        }
+        else
         {
-            MODULE_DATA * new_module_data = (MODULE_DATA*)malloc(sizeof(MODULE_DATA));
-            if (new_module_data == NULL)
+            char* name_copied = NULL;
+            /*Codes_SRS_GATEWAY_26_020: [ The function shall make a copy of the name of the module for internal use. ]*/
+            mallocAndStrcpy_s(&name_copied, module_entry->module_name);
+            if (name_copied == NULL)
             {
-                /*Codes_SRS_GATEWAY_14_031: [If unsuccessful, the function shall return NULL.]*/
+                free(new_module_data);
                 module_result = NULL;
-                LogError("Failed to add module because it could not allocate memory.");
+                if (Broker_RemoveModule(gateway_handle->broker, &module) != BROKER_OK)
+                {
+                    LogError("Failed to remove module [%p] from the gateway message broker. This module will remain attached.", &module);
+                }
+                LogError("Unable to malloc for module name");
             }
             else
             {
-                /*Codes_SRS_GATEWAY_14_012: [The function shall load the module located at GATEWAY_MODULES_ENTRY's module_path into a MODULE_LIBRARY_HANDLE. ]*/
-                /*Codes_SRS_GATEWAY_17_015: [ The function shall use the module's specified loader and the module's entrypoint to get each module's MODULE_LIBRARY_HANDLE. ]*/
-                MODULE_LIBRARY_HANDLE module_library_handle = module_entry->module_loader_info.loader->api->Load(
+                strcpy(name_copied, module_entry->module_name);
+                /*Codes_SRS_GATEWAY_14_039: [ The function shall increment the BROKER_HANDLE reference count if the MODULE_HANDLE was successfully added to the GATEWAY_HANDLE_DATA's broker. ]*/
+                Broker_IncRef(gateway_handle->broker);
+                /*Codes_SRS_GATEWAY_14_029: [ The function shall create a new MODULE_DATA containing the MODULE_HANDLE, MODULE_LOADER_API and MODULE_LIBRARY_HANDLE if the module was successfully linked to the message broker. ]*/
+                MODULE_DATA module_data =
+                {
+                    name_copied,
+                    instance->module_library_handle,
                     module_entry->module_loader_info.loader,
-                    module_entry->module_loader_info.entrypoint
-                );
-
-                /*Codes_SRS_GATEWAY_14_031: [If unsuccessful, the function shall return NULL.]*/
-                if (module_library_handle == NULL)
+                    module_handle
+                };
+                *new_module_data = module_data;
+                /*Codes_SRS_GATEWAY_14_032: [The function shall add the new MODULE_DATA to GATEWAY_HANDLE_DATA's modules if the module was successfully attached to the message broker. ]*/
+                if (VECTOR_push_back(gateway_handle->modules, &new_module_data, 1) != 0)
                 {
+                    /*Codes_SRS_GATEWAY_14_019: [The function shall return the newly created MODULE_HANDLE only if each API call returns successfully.]*/
+                    Broker_DecRef(gateway_handle->broker);
                     free(new_module_data);
+                    free(name_copied);
                     module_result = NULL;
-                    LogError("Failed to add module because the module could not be loaded.");
+                    if (Broker_RemoveModule(gateway_handle->broker, &module) != BROKER_OK)
+                    {
+                        LogError("Failed to remove module [%p] from the gateway message broker. This module will remain attached.", &module);
+                    }
+                    LogError("Unable to add MODULE_DATA* to the gateway module vector.");
                 }
-                else
+                /*Codes_SRS_GATEWAY_31_016: [ The gateway shall add each module and link it tracks to the gateway index, and shall fail to add the module or link if the index cannot be updated. ]*/
+                else if (GatewayIndex_AddModule(gateway_handle->index, new_module_data) != 0)
                 {
-                    //Should always be a safe call.
-                    /*Codes_SRS_GATEWAY_14_013: [The function shall get the const MODULE_API* from the MODULE_LIBRARY_HANDLE.]*/
-                    const MODULE_API* module_apis = module_entry->module_loader_info.loader->api->GetApi(module_entry->module_loader_info.loader, module_library_handle);
-
-                    // parse module args if needed
-                    const void* module_configuration = module_entry->module_configuration;
-                    const void* transformed_module_configuration;
-                    if (use_json)
-                    {
-                        module_configuration = MODULE_PARSE_CONFIGURATION_FROM_JSON(module_apis)(
-                            (const char *)(module_entry->module_configuration)
-                        );
-					}
-
-                    // request the loader to transform the module configuration to what the module expects
-                    /*Codes_SRS_GATEWAY_17_018: [ The function shall construct module configuration from module's entrypoint and module's module_configuration. ]*/
-                    /*Codes_SRS_GATEWAY_17_021: [ The function shall construct module configuration from module's entrypoint and module's module_configuration. ]*/
-                    /*Codes_SRS_GATEWAY_JSON_17_011: [ The function shall the loader's BuildModuleConfiguration to construct module input from module's "args" and "loader.entrypoint". ]*/
-                    transformed_module_configuration = module_entry->module_loader_info.loader->api->BuildModuleConfiguration(
-                        module_entry->module_loader_info.loader,
-                        module_entry->module_loader_info.entrypoint,
-                        module_configuration
-                    );
-
-                    /*Codes_SRS_GATEWAY_14_015: [The function shall use the MODULE_API to create a MODULE_HANDLE using the GATEWAY_MODULES_ENTRY's module_configuration. ]*/
-                    MODULE_HANDLE module_handle = MODULE_CREATE(module_apis)(gateway_handle->broker, transformed_module_configuration);
-
-                    // free the configurations
-                    /*Codes_SRS_GATEWAY_17_020: [ The function shall clean up any constructed resources. ]*/
-                    /*Codes_SRS_GATEWAY_17_022: [ The function shall clean up any constructed resources. ]*/
-                    if (use_json)
+                    Broker_DecRef(gateway_handle->broker);
+                    module_result = NULL;
+                    if (Broker_RemoveModule(gateway_handle->broker, &module) != BROKER_OK)
                     {
-                        MODULE_FREE_CONFIGURATION(module_apis)((void*)module_configuration);
+                        LogError("Failed to remove module [%p] from the gateway message broker. This module will remain attached.", &module);
                     }
-                    module_entry->module_loader_info.loader->api->FreeModuleConfiguration(module_entry->module_loader_info.loader, transformed_module_configuration);
-
-                    /*Codes_SRS_GATEWAY_14_016: [If the module creation is unsuccessful, the function shall return NULL.]*/
-                    if (module_handle == NULL)
+                    VECTOR_erase(gateway_handle->modules, VECTOR_back(gateway_handle->modules), 1);
+                    free(new_module_data);
+                    free(name_copied);
+                    LogError("Unable to add MODULE_DATA* to the gateway index.");
+                }
+                else
+                {
+                    if (add_module_to_any_source(gateway_handle, *(MODULE_DATA**)VECTOR_back(gateway_handle->modules)) != 0)
                     {
-                        free(new_module_data);
+                        /*Codes_SRS_GATEWAY_14_019: [The function shall return the newly created MODULE_HANDLE only if each API call returns successfully.]*/
+                        Broker_DecRef(gateway_handle->broker);
                         module_result = NULL;
-                        module_entry->module_loader_info.loader->api->Unload(module_entry->module_loader_info.loader, module_library_handle);
-                        LogError("Module_Create failed.");
+                        if (Broker_RemoveModule(gateway_handle->broker, &module) != BROKER_OK)
+                        {
+                            LogError("Failed to remove module [%p] from the gateway message broker. This module will remain attached.", &module);
+                        }
+                        GatewayIndex_RemoveModule(gateway_handle->index, new_module_data);
+                        VECTOR_erase(gateway_handle->modules, VECTOR_back(gateway_handle->modules), 1);
+                        free(new_module_data);
+                        free(name_copied);
+                        LogError("Unable to add MODULE_DATA* to existing broker links.");
                     }
                     else
                     {
-                        /*Codes_SRS_GATEWAY_99_011: [The function shall assign `module_apis` to `MODULE::module_apis`. ]*/
-                        MODULE module;
-                        module.module_apis = module_apis;
-                        module.module_handle = module_handle;
-
-                        /*Codes_SRS_GATEWAY_14_017: [The function shall attach the module to the GATEWAY_HANDLE_DATA's broker using a call to Broker_AddModule. ]*/
-                        /*Codes_SRS_GATEWAY_14_018: [If the function cannot attach the module to the message broker, the function shall return NULL.]*/
-                        if (Broker_AddModule(gateway_handle->broker, &module) != BROKER_OK)
-                        {
-                            free(new_module_data);
-                            module_result = NULL;
-                            LogError("Failed to add module to the gateway's broker.");
-                        }
-                        else
-                        {
-                            char* name_copied = NULL;
-                            /*Codes_SRS_GATEWAY_26_020: [ The function shall make a copy of the name of the module for internal use. ]*/
-                            mallocAndStrcpy_s(&name_copied, module_entry->module_name);
-                            if (name_copied == NULL)
-                            {
-                                free(new_module_data);
-                                module_result = NULL;
-                                if (Broker_RemoveModule(gateway_handle->broker, &module) != BROKER_OK)
-                                {
-                                    LogError("Failed to remove module [%p] from the gateway message broker. This module will remain attached.", &module);
-                                }
-                                LogError("Unable to malloc for module name");
-                            }
-                            else
-                            {
-                                strcpy(name_copied, module_entry->module_name);
-                                /*Codes_SRS_GATEWAY_14_039: [ The function shall increment the BROKER_HANDLE reference count if the MODULE_HANDLE was successfully added to the GATEWAY_HANDLE_DATA's broker. ]*/
-                                Broker_IncRef(gateway_handle->broker);
-                                /*Codes_SRS_GATEWAY_14_029: [ The function shall create a new MODULE_DATA containing the MODULE_HANDLE, MODULE_LOADER_API and MODULE_LIBRARY_HANDLE if the module was successfully linked to the message broker. ]*/
-                                MODULE_DATA module_data =
-                                {
-                                    name_copied,
-                                    module_library_handle,
-                                    module_entry->module_loader_info.loader,
-                                    module_handle
-                                };
-                                *new_module_data = module_data;
-                                /*Codes_SRS_GATEWAY_14_032: [The function shall add the new MODULE_DATA to GATEWAY_HANDLE_DATA's modules if the module was successfully attached to the message broker. ]*/
-                                if (VECTOR_push_back(gateway_handle->modules, &new_module_data, 1) != 0)
-                                {
-                                    /*Codes_SRS_GATEWAY_14_019: [The function shall return the newly created MODULE_HANDLE only if each API call returns successfully.]*/
-                                    Broker_DecRef(gateway_handle->broker);
-                                    free(new_module_data);
-                                    free(name_copied);
-                                    module_result = NULL;
-                                    if (Broker_RemoveModule(gateway_handle->broker, &module) != BROKER_OK)
-                                    {
-                                        LogError("Failed to remove module [%p] from the gateway message broker. This module will remain attached.", &module);
-                                    }
-                                    LogError("Unable to add MODULE_DATA* to the gateway module vector.");
-                                }
-                                else
-                                {
-                                    if (add_module_to_any_source(gateway_handle, *(MODULE_DATA**)VECTOR_back(gateway_handle->modules)) != 0)
-                                    {
-                                        /*Codes_SRS_GATEWAY_14_019: [The function shall return the newly created MODULE_HANDLE only if each API call returns successfully.]*/
-                                        Broker_DecRef(gateway_handle->broker);
-                                        module_result = NULL;
-                                        if (Broker_RemoveModule(gateway_handle->broker, &module) != BROKER_OK)
-                                        {
-                                            LogError("Failed to remove module [%p] from the gateway message broker. This module will remain attached.", &module);
-                                        }
-                                        VECTOR_erase(gateway_handle->modules, VECTOR_back(gateway_handle->modules), 1);
-                                        free(new_module_data);
-                                        free(name_copied);
-                                        LogError("Unable to add MODULE_DATA* to existing broker links.");
-                                    }
-                                    else
-                                    {
-                                        /*Codes_SRS_GATEWAY_14_019: [The function shall return the newly created MODULE_HANDLE only if each API call returns successfully.]*/
-                                        module_result = module_handle;
-                                    }
-                                }
-                            }
-                        }
+                        /*Codes_SRS_GATEWAY_14_019: [The function shall return the newly created MODULE_HANDLE only if each API call returns successfully.]*/
+                        module_result = module_handle;
+                    }
+                }
+            }
+        }
+
+        /*Codes_SRS_GATEWAY_14_030: [If any internal API call is unsuccessful after a module is created, the library will be unloaded and the module destroyed.]*/
+        if (module_result == NULL)
+        {
+            MODULE_DESTROY(instance->module_apis)(module_handle);
+            module_entry->module_loader_info.loader->api->Unload(module_entry->module_loader_info.loader, instance->module_library_handle);
+        }
+    }
+
+    return module_result;
+}
+
+MODULE_HANDLE gateway_addmodule_internal(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_MODULES_ENTRY* module_entry, bool use_json)
+{
+    MODULE_HANDLE module_result;
+
+    if (!is_module_entry_valid(gateway_handle, module_entry))
+    {
+        module_result = NULL;
+    }
+    else
+    {
+        MODULE_INSTANCE instance;
+        instance.entry = module_entry;
+        instance.module_data = (MODULE_DATA*)malloc(sizeof(MODULE_DATA));
+        if (instance.module_data == NULL)
+        {
+            /*Codes_SRS_GATEWAY_14_031: [If unsuccessful, the function shall return NULL.]*/
+            module_result = NULL;
+            LogError("Failed to add module because it could not allocate memory.");
+        }
+        else if (load_module(&instance, use_json) != 0)
+        {
+            free(instance.module_data);
+            module_result = NULL;
+        }
+        else
+        {
+            create_module(gateway_handle->broker, &instance);
+            free_module_configuration(&instance, use_json);
+            module_result = attach_module(gateway_handle, &instance);
+        }
+    }
+
+    return module_result;
+}
+
+static const char* get_host_id(const MODULE_INSTANCE* instance)
+{
+    const char* result = NULL;
+#ifdef OUTPROCESS_ENABLED
+    if (instance->entry->module_loader_info.loader->type == OUTPROCESS && instance->entry->module_loader_info.entrypoint != NULL)
+    {
+        result = ((const OUTPROCESS_LOADER_ENTRYPOINT*)instance->entry->module_loader_info.entrypoint)->host_id;
+    }
+#else
+    (void)instance;
+#endif
+    return result;
+}
+
+static bool is_same_lane(const MODULE_INSTANCE* instance, const MODULE_INSTANCE* other)
+{
+    const MODULE_LOADER* loader = instance->entry->module_loader_info.loader;
+    bool result;
+
+    if (loader->type == NATIVE)
+    {
+        result = false;
+    }
+    else if (loader->type == OUTPROCESS)
+    {
+        /* the modules of one host process are created through it, one at a time */
+        const char* host_id = get_host_id(instance);
+        const char* other_host_id = get_host_id(other);
+        result = (host_id != NULL && other_host_id != NULL && strcmp(host_id, other_host_id) == 0);
+    }
+    else
+    {
+        /* the language binding loaders host all their modules in one runtime, their modules are created one at a time */
+        result = (other->entry->module_loader_info.loader == loader);
+    }
+
+    return result;
+}
+
+static void assign_lane(MODULE_INSTANCES* batch, MODULE_INSTANCE* instance)
+{
+    size_t i;
+
+    instance->lane = batch->lane_count;
+    for (i = 0; i < batch->count; i++)
+    {
+        if (is_same_lane(instance, &batch->instances[i]))
+        {
+            instance->lane = batch->instances[i].lane;
+            break;
+        }
+    }
+
+    if (instance->lane == batch->lane_count)
+    {
+        batch->lane_count++;
+    }
+}
+
+static size_t hash_module_name(const char* module_name)
+{
+    /* FNV-1a, as the gateway index */
+    size_t hash = (size_t)2166136261u;
+    while (*module_name != '\0')
+    {
+        hash ^= (unsigned char)*module_name++;
+        hash *= (size_t)16777619u;
+    }
+    return hash;
+}
+
+/* Adds a name to an open addressing set of names, name_capacity is a power of two larger than the names. Returns false if the name is there already. */
+static bool add_batch_name(const char** names, size_t name_capacity, const char* module_name)
+{
+    bool result = true;
+    size_t i = hash_module_name(module_name) & (name_capacity - 1);
+
+    while (names[i] != NULL && result)
+    {
+        result = (strcmp(names[i], module_name) != 0);
+        i = (i + 1) & (name_capacity - 1);
+    }
+    if (result)
+    {
+        names[i] = module_name;
+    }
+
+    return result;
+}
+
+static void create_modules_in_lane(void* context, size_t lane)
+{
+    MODULE_INSTANCES* batch = (MODULE_INSTANCES*)context;
+    size_t i;
+
+    for (i = 0; i < batch->count; i++)
+    {
+        if (batch->instances[i].lane == lane)
+        {
+            create_module(batch->broker, &batch->instances[i]);
+        }
+    }
+}
+
+int gateway_addmodules_internal(GATEWAY_HANDLE_DATA* gateway_handle, VECTOR_HANDLE module_entries, bool use_json)
+{
+    int result;
+    size_t entries_count = VECTOR_size(module_entries);
+
+    if (entries_count == 1)
+    {
+        if (gateway_addmodule_internal(gateway_handle, (GATEWAY_MODULES_ENTRY*)VECTOR_element(module_entries, 0), use_json) == NULL)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+    else if (entries_count > 1)
+    {
+        MODULE_INSTANCES batch;
+        const char** names;
+        size_t name_capacity = 1;
+        while (name_capacity < 2 * entries_count)
+        {
+            name_capacity *= 2;
+        }
+
+        /* one allocation: the modules, then the set of their names */
+        batch.broker = gateway_handle->broker;
+        batch.count = 0;
+        batch.lane_count = 0;
+        batch.instances = (MODULE_INSTANCE*)malloc(entries_count * sizeof(MODULE_INSTANCE) + name_capacity * sizeof(const char*));
+        if (batch.instances == NULL)
+        {
+            LogError("Failed to add modules because it could not allocate memory.");
+            result = __LINE__;
+        }
+        else
+        {
+            size_t i;
+            names = (const char**)(batch.instances + entries_count);
+            memset((void*)names, 0, name_capacity * sizeof(const char*));
+            result = 0;
+
+            /*Codes_SRS_GATEWAY_31_001: [ The function shall load the modules one at a time, in the order of `gateway_modules`. ]*/
+            for (i = 0; i < entries_count && result == 0; i++)
+            {
+                MODULE_INSTANCE* instance = &batch.instances[batch.count];
+                instance->entry = (GATEWAY_MODULES_ENTRY*)VECTOR_element(module_entries, i);
+                if (!is_module_entry_valid(gateway_handle, instance->entry))
+                {
+                    result = __LINE__;
+                }
+                else if (!add_batch_name(names, name_capacity, instance->entry->module_name))
+                {
+                    /*Codes_SRS_GATEWAY_04_004: [ If a module with the same module_name already exists, this function shall fail and the GATEWAY_HANDLE will be destroyed. ]*/
+                    LogError("Error to add module. Duplicated module name: %s", instance->entry->module_name);
+                    result = __LINE__;
+                }
+                else if ((instance->module_data = (MODULE_DATA*)malloc(sizeof(MODULE_DATA))) == NULL)
+                {
+                    LogError("Failed to add module because it could not allocate memory.");
+                    result = __LINE__;
+                }
+                else if (load_module(instance, use_json) != 0)
+                {
+                    free(instance->module_data);
+                    result = __LINE__;
+                }
+                else
+                {
+                    assign_lane(&batch, instance);
+                    batch.count++;
+                }
+            }
+
+            if (result == 0)
+            {
+                /*Codes_SRS_GATEWAY_31_002: [ The function shall create the modules concurrently, except the modules of a language binding loader, which shall be created one at a time. ]*/
+            /*Codes_SRS_GATEWAY_31_034: [ The function shall create the out of process modules that share a `host.id` one at a time. ]*/
+                run_concurrently(create_modules_in_lane, &batch, batch.lane_count);
+            }
+
+            /*Codes_SRS_GATEWAY_31_003: [ The function shall attach the created modules to the gateway in the order of `gateway_modules`. ]*/
+            for (i = 0; i < batch.count; i++)
+            {
+                free_module_configuration(&batch.instances[i], use_json);
+                if (result != 0)
+                {
+                    /*Codes_SRS_GATEWAY_31_004: [ If any module fails to load, to be created or to be attached, the function shall destroy and unload the modules not yet attached. ]*/
+                    discard_module(&batch.instances[i]);
+                }
+                else if (attach_module(gateway_handle, &batch.instances[i]) == NULL)
+                {
+                    result = __LINE__;
+                }
+            }
+
+            free(batch.instances);
+        }
+    }
+    else
+    {
+        result = 0;
+    }
+
+    return result;
+}
+
+static int compare_positions(const void* left, const void* right)
+{
+    uintptr_t left_address = (uintptr_t)((const MODULE_POSITION*)left)->module_data;
+    uintptr_t right_address = (uintptr_t)((const MODULE_POSITION*)right)->module_data;
+    return (left_address < right_address) ? -1 : ((left_address > right_address) ? 1 : 0);
+}
+
+static size_t get_start_index(const MODULE_STARTS* starts, const MODULE_DATA* module_data)
+{
+    MODULE_POSITION key;
+    MODULE_POSITION* position;
+
+    key.module_data = module_data;
+    key.index = 0;
+    position = (MODULE_POSITION*)bsearch(&key, starts->positions, starts->module_count, sizeof(MODULE_POSITION), compare_positions);
+
+    return (position != NULL) ? position->index : starts->module_count;
+}
+
+/* Counts the links from each module to a sink not started yet, and groups the sources of the links by sink. */
+static void count_dependencies(MODULE_STARTS* starts)
+{
+    size_t any_source_pending = 0;
+    size_t source_count = 0;
+    size_t d;
+    size_t m;
+
+    for (d = 0; d < starts->dependency_count; d++)
+    {
+        const START_DEPENDENCY* dependency = &starts->dependencies[d];
+        if (dependency->sink < starts->module_count && !starts->modules[dependency->sink].started)
+        {
+            if (dependency->from_any_source)
+            {
+                starts->modules[dependency->sink].any_source_links++;
+                any_source_pending++;
+            }
+            else if (dependency->source < starts->module_count && dependency->source != dependency->sink)
+            {
+                starts->modules[dependency->source].pending++;
+                starts->modules[dependency->sink].first_source++;
+            }
+        }
+    }
+
+    /* the sources of a sink end where the sources of the next sink begin, they are placed from the end */
+    for (m = 0; m < starts->module_count; m++)
+    {
+        source_count += starts->modules[m].first_source;
+        starts->modules[m].first_source = source_count;
+    }
+    starts->source_count = source_count;
+
+    for (d = 0; d < starts->dependency_count; d++)
+    {
+        const START_DEPENDENCY* dependency = &starts->dependencies[d];
+        if (!dependency->from_any_source &&
+            dependency->sink < starts->module_count &&
+            !starts->modules[dependency->sink].started &&
+            dependency->source < starts->module_count &&
+            dependency->source != dependency->sink)
+        {
+            starts->sources[--starts->modules[dependency->sink].first_source] = dependency->source;
+        }
+    }
+
+    /* every module publishes to the sinks of the links from any source, but to itself */
+    for (m = 0; m < starts->module_count; m++)
+    {
+        if (!starts->modules[m].started)
+        {
+            starts->modules[m].pending += any_source_pending - starts->modules[m].any_source_links;
+        }
+    }
+}
+
+static void queue_if_ready(MODULE_STARTS* starts, size_t module, size_t* queued)
+{
+    if (starts->modules[module].pending == 0 && !starts->modules[module].started)
+    {
+        starts->queue[(*queued)++] = module;
+    }
+}
+
+/* A started module no longer holds back the modules publishing to it. */
+static void release_sources(MODULE_STARTS* starts, size_t sink, size_t* queued)
+{
+    size_t source_end = (sink + 1 < starts->module_count) ? starts->modules[sink + 1].first_source : starts->source_count;
+    size_t i;
+    size_t m;
+
+    for (i = starts->modules[sink].first_source; i < source_end; i++)
+    {
+        size_t source = starts->sources[i];
+        if (starts->modules[source].pending > 0)
+        {
+            starts->modules[source].pending--;
+            queue_if_ready(starts, source, queued);
+        }
+    }
+
+    if (starts->modules[sink].any_source_links > 0)
+    {
+        for (m = 0; m < starts->module_count; m++)
+        {
+            if (m != sink && !starts->modules[m].started && starts->modules[m].pending > 0)
+            {
+                starts->modules[m].pending -= starts->modules[sink].any_source_links;
+                queue_if_ready(starts, m, queued);
+            }
+        }
+    }
+}
+
+static void start_module_in_wave(void* context, size_t index)
+{
+    MODULE_STARTS* starts = (MODULE_STARTS*)context;
+    MODULE_START* module_start = &starts->modules[starts->wave[index]];
+
+    /*Codes_SRS_GATEWAY_17_010: [ This function shall call Module_Start for every module which defines the start function. ]*/
+    module_start->start(module_start->module_data->module);
+}
+
+static void start_modules_in_order(GATEWAY_HANDLE_DATA* gateway_handle, size_t module_count)
+{
+    size_t m;
+
+    for (m = 0; m < module_count; m++)
+    {
+        MODULE_DATA** module_data = VECTOR_element(gateway_handle->modules, m);
+        pfModule_Start pfStart = MODULE_START((*module_data)->module_loader->api->GetApi((*module_data)->module_loader, (*module_data)->module_library_handle));
+        if (pfStart != NULL)
+        {
+            /*Codes_SRS_GATEWAY_17_010: [ This function shall call Module_Start for every module which defines the start function. ]*/
+            (pfStart)((*module_data)->module);
+        }
+    }
+}
+
+void gateway_startmodules_internal(GATEWAY_HANDLE_DATA* gateway_handle)
+{
+    size_t module_count = VECTOR_size(gateway_handle->modules);
+    if (module_count > 0)
+    {
+        size_t link_count = VECTOR_size(gateway_handle->links);
+        MODULE_STARTS starts;
+
+        /* one allocation: the modules, their positions, the start queue, then the links and the sources of the links */
+        starts.modules = (MODULE_START*)malloc(module_count * (sizeof(MODULE_START) + sizeof(MODULE_POSITION) + sizeof(size_t)) + link_count * (sizeof(START_DEPENDENCY) + sizeof(size_t)));
+        if (starts.modules == NULL)
+        {
+            /*Codes_SRS_GATEWAY_31_007: [ If the function cannot allocate memory, it shall start the modules one at a time, in the order they were added. ]*/
+            LogError("Unable to allocate the start order, starting the modules one at a time.");
+            start_modules_in_order(gateway_handle, module_count);
+        }
+        else
+        {
+            size_t remaining = 0;
+            size_t started_count = 0;
+            size_t queued = 0;
+            size_t first_unstarted = 0;
+            size_t m;
+            size_t l;
+
+            starts.module_count = module_count;
+            starts.positions = (MODULE_POSITION*)(starts.modules + module_count);
+            starts.queue = (size_t*)(starts.positions + module_count);
+            starts.dependencies = (START_DEPENDENCY*)(starts.queue + module_count);
+            starts.dependency_count = link_count;
+            starts.sources = (size_t*)(starts.dependencies + link_count);
+
+            for (m = 0; m < module_count; m++)
+            {
+                MODULE_DATA* module_data = *(MODULE_DATA**)VECTOR_element(gateway_handle->modules, m);
+                starts.modules[m].module_data = module_data;
+                starts.modules[m].start = MODULE_START(module_data->module_loader->api->GetApi(module_data->module_loader, module_data->module_library_handle));
+                starts.modules[m].started = (starts.modules[m].start == NULL);
+                starts.modules[m].pending = 0;
+                starts.modules[m].any_source_links = 0;
+                starts.modules[m].first_source = 0;
+                starts.positions[m].module_data = module_data;
+                starts.positions[m].index = m;
+                if (!starts.modules[m].started)
+                {
+                    remaining++;
+                }
+            }
+            qsort(starts.positions, module_count, sizeof(MODULE_POSITION), compare_positions);
+
+            for (l = 0; l < link_count; l++)
+            {
+                LINK_DATA* link_data = (LINK_DATA*)VECTOR_element(gateway_handle->links, l);
+                starts.dependencies[l].from_any_source = link_data->from_any_source;
+                starts.dependencies[l].source = link_data->from_any_source ? module_count : get_start_index(&starts, link_data->module_source);
+                starts.dependencies[l].sink = get_start_index(&starts, link_data->module_sink);
+            }
+
+            /*Codes_SRS_GATEWAY_31_020: [ The function shall order the start in a time proportional to the number of modules and links, but for the links from any source. ]*/
+            count_dependencies(&starts);
+            for (m = 0; m < module_count; m++)
+            {
+                queue_if_ready(&starts, m, &queued);
+            }
+
+            /*Codes_SRS_GATEWAY_31_005: [ The function shall start a module only after the modules it is linked to as a source, and shall start the modules that are ready at the same time concurrently. ]*/
+            while (remaining > 0)
+            {
+                size_t wave_size;
+
+                if (queued == started_count)
+                {
+                    /*Codes_SRS_GATEWAY_31_006: [ If the links form a cycle, the function shall start the first module not yet started, in the order they were added, and continue. ]*/
+                    while (starts.modules[first_unstarted].started)
+                    {
+                        first_unstarted++;
+                    }
+                    starts.queue[queued++] = first_unstarted;
+                }
+
+                starts.wave = starts.queue + started_count;
+                wave_size = queued - started_count;
+                run_concurrently(start_module_in_wave, &starts, wave_size);
+
+                for (m = 0; m < wave_size; m++)
+                {
+                    starts.modules[starts.wave[m]].started = true;
+                }
+                for (m = 0; m < wave_size; m++)
+                {
+                    release_sources(&starts, starts.wave[m], &queued);
+                }
+                started_count += wave_size;
+                remaining -= wave_size;
+            }
+
+            free(starts.modules);
+        }
+    }
+}
+
+/* A route of the broker: a link from one source to one sink. */
+typedef struct GATEWAY_ROUTE_TAG
+{
+    BROKER_LINK_DATA link;
+    bool source_retired;
+    bool sink_retired;
+} GATEWAY_ROUTE;
+
+/* The running graph and the graph replacing it. */
+typedef struct GATEWAY_RECONFIGURATION_TAG
+{
+    /** @brief  The module entries by name and the links between them, each entry standing for a module */
+    GATEWAY_INDEX_HANDLE entry_index;
+    MODULE_DATA* entry_modules;
+
+    /** @brief  The modules created for the new graph */
+    MODULE_INSTANCES batch;
+    size_t attached_count;
+
+    /** @brief  The modules of the new graph, in the order of the module entries */
+    MODULE_DATA** next_modules;
+    size_t next_module_count;
+
+    /** @brief  The modules of the running graph, and whether the new graph drops them */
+    MODULE_DATA** modules;
+    bool* retired;
+    size_t module_count;
+
+    VECTOR_HANDLE next_modules_vector;
+    VECTOR_HANDLE next_links_vector;
+    GATEWAY_INDEX_HANDLE next_index;
+
+    /** @brief  The routes removed and added at the cut, then the routes removed once their retired source is destroyed */
+    GATEWAY_ROUTE* routes;
+    BROKER_LINK_DATA* links_to_remove;
+    size_t remove_count;
+    BROKER_LINK_DATA* links_to_add;
+    size_t add_count;
+    BROKER_LINK_DATA* deferred_links;
+    size_t deferred_count;
+} GATEWAY_RECONFIGURATION;
+
+/* Indexes the module entries and the links of the new graph, so the diff looks up a name instead of scanning the entries. */
+static int index_configuration(GATEWAY_RECONFIGURATION* reconfiguration, VECTOR_HANDLE module_entries, VECTOR_HANDLE link_entries)
+{
+    int result;
+    size_t entry_count = VECTOR_size(module_entries);
+    size_t link_count = VECTOR_size(link_entries);
+
+    reconfiguration->entry_modules = (MODULE_DATA*)malloc(entry_count * sizeof(MODULE_DATA) + 1);
+    reconfiguration->entry_index = GatewayIndex_Create();
+    if (reconfiguration->entry_modules == NULL || reconfiguration->entry_index == NULL)
+    {
+        LogError("Failed to reconfigure the gateway because it could not allocate memory.");
+        result = __LINE__;
+    }
+    else
+    {
+        size_t i;
+
+        result = 0;
+        for (i = 0; i < entry_count && result == 0; i++)
+        {
+            const GATEWAY_MODULES_ENTRY* entry = (GATEWAY_MODULES_ENTRY*)VECTOR_element(module_entries, i);
+            MODULE_DATA* entry_module = &reconfiguration->entry_modules[i];
+            if (entry->module_name == NULL ||
+                entry->module_loader_info.loader == NULL ||
+                entry->module_loader_info.entrypoint == NULL ||
+                entry->module_loader_info.loader->api == NULL ||
+                strcmp(entry->module_name, GATEWAY_ALL) == 0)
+            {
+                LogError("Invalid module entry '%s'.", entry->module_name != NULL ? entry->module_name : "NULL");
+                result = __LINE__;
+            }
+            else if (GatewayIndex_FindModuleByName(reconfiguration->entry_index, entry->module_name) != NULL)
+            {
+                LogError("Duplicated module name: %s", entry->module_name);
+                result = __LINE__;
+            }
+            else
+            {
+                memset(entry_module, 0, sizeof(MODULE_DATA));
+                entry_module->module_name = (char*)entry->module_name;
+                entry_module->module = (MODULE_HANDLE)entry_module;
+                if (GatewayIndex_AddModule(reconfiguration->entry_index, entry_module) != 0)
+                {
+                    LogError("Unable to index the module entry '%s'.", entry->module_name);
+                    result = __LINE__;
+                }
+            }
+        }
+
+        for (i = 0; i < link_count && result == 0; i++)
+        {
+            const GATEWAY_LINK_ENTRY* link_entry = (GATEWAY_LINK_ENTRY*)VECTOR_element(link_entries, i);
+            MODULE_DATA* module_source;
+            MODULE_DATA* module_sink;
+            if (link_entry->module_source == NULL || link_entry->module_sink == NULL ||
+                !find_link_modules(reconfiguration->entry_index, link_entry, &module_source, &module_sink))
+            {
+                LogError("Link from '%s' to '%s' references a module not in the configuration.",
+                    link_entry->module_source != NULL ? link_entry->module_source : "NULL",
+                    link_entry->module_sink != NULL ? link_entry->module_sink : "NULL");
+                result = __LINE__;
+            }
+            else if (GatewayIndex_HasLink(reconfiguration->entry_index, module_source, module_sink))
+            {
+                LogError("Duplicated link. Source_name: %s, Sink_name: %s", link_entry->module_source, link_entry->module_sink);
+                result = __LINE__;
+            }
+            else if (GatewayIndex_AddLink(reconfiguration->entry_index, module_source, module_sink) != 0)
+            {
+                LogError("Unable to index the link from '%s' to '%s'.", link_entry->module_source, link_entry->module_sink);
+                result = __LINE__;
+            }
+        }
+    }
+
+    return result;
+}
+
+static bool is_module_unchanged(const MODULE_DATA* module_data, const char* module_signature)
+{
+    return module_data->module_signature != NULL &&
+        module_signature != NULL &&
+        strcmp(module_data->module_signature, module_signature) == 0;
+}
+
+/* Keeps the running modules whose configuration did not change, loads and creates the others. */
+static int plan_modules(GATEWAY_HANDLE_DATA* gateway_handle, GATEWAY_RECONFIGURATION* reconfiguration, VECTOR_HANDLE module_entries, const char* const* module_signatures, bool use_json)
+{
+    int result;
+    size_t entry_count = VECTOR_size(module_entries);
+    size_t module_count = VECTOR_size(gateway_handle->modules);
+
+    /* one allocation: the created modules, then the new graph, then the retired flags */
+    reconfiguration->batch.broker = gateway_handle->broker;
+    reconfiguration->batch.count = 0;
+    reconfiguration->batch.lane_count = 0;
+    reconfiguration->batch.instances = (MODULE_INSTANCE*)malloc(entry_count * (sizeof(MODULE_INSTANCE) + sizeof(MODULE_DATA*)) + module_count * sizeof(bool) + 1);
+    if (reconfiguration->batch.instances == NULL)
+    {
+        LogError("Failed to reconfigure the gateway because it could not allocate memory.");
+        result = __LINE__;
+    }
+    else
+    {
+        size_t i;
+        size_t m;
+
+        reconfiguration->next_modules = (MODULE_DATA**)(reconfiguration->batch.instances + entry_count);
+        reconfiguration->next_module_count = entry_count;
+        reconfiguration->retired = (bool*)(reconfiguration->next_modules + entry_count);
+        reconfiguration->modules = (module_count > 0) ? (MODULE_DATA**)VECTOR_element(gateway_handle->modules, 0) : NULL;
+        reconfiguration->module_count = module_count;
+        memset(reconfiguration->next_modules, 0, entry_count * sizeof(MODULE_DATA*));
+
+        /*Codes_SRS_GATEWAY_31_009: [ The function shall keep the running module of the same name if its configuration did not change, and shall create a new module otherwise. ]*/
+        for (m = 0; m < module_count; m++)
+        {
+            MODULE_DATA* entry_module = GatewayIndex_FindModuleByName(reconfiguration->entry_index, reconfiguration->modules[m]->module_name);
+            i = (entry_module != NULL) ? (size_t)(entry_module - reconfiguration->entry_modules) : entry_count;
+            reconfiguration->retired[m] = (i == entry_count ||
+                !is_module_unchanged(reconfiguration->modules[m], module_signatures != NULL ? module_signatures[i] : NULL));
+            if (!reconfiguration->retired[m])
+            {
+                reconfiguration->next_modules[i] = reconfiguration->modules[m];
+            }
+        }
+
+        result = 0;
+        for (i = 0; i < entry_count && result == 0; i++)
+        {
+            if (reconfiguration->next_modules[i] == NULL)
+            {
+                const GATEWAY_MODULES_ENTRY* entry = (GATEWAY_MODULES_ENTRY*)VECTOR_element(module_entries, i);
+                MODULE_INSTANCE* instance = &reconfiguration->batch.instances[reconfiguration->batch.count];
+                instance->entry = entry;
+                if ((instance->module_data = (MODULE_DATA*)malloc(sizeof(MODULE_DATA))) == NULL)
+                {
+                    LogError("Failed to add module because it could not allocate memory.");
+                    result = __LINE__;
+                }
+                else if (load_module(instance, use_json) != 0)
+                {
+                    free(instance->module_data);
+                    result = __LINE__;
+                }
+                else
+                {
+                    reconfiguration->next_modules[i] = instance->module_data;
+                    assign_lane(&reconfiguration->batch, instance);
+                    reconfiguration->batch.count++;
+                }
+            }
+        }
+
+        if (result == 0)
+        {
+            run_concurrently(create_modules_in_lane, &reconfiguration->batch, reconfiguration->batch.lane_count);
+        }
+
+        for (i = 0; i < reconfiguration->batch.count; i++)
+        {
+            free_module_configuration(&reconfiguration->batch.instances[i], use_json);
+            if (result == 0 && reconfiguration->batch.instances[i].module_handle == NULL)
+            {
+                LogError("Module_Create failed.");
+                result = __LINE__;
+            }
+        }
+
+        if (result != 0)
+        {
+            /*Codes_SRS_GATEWAY_31_012: [ If any step fails before the routes change, the function shall destroy the modules it created and leave the running graph unchanged. ]*/
+            for (i = 0; i < reconfiguration->batch.count; i++)
+            {
+                discard_module(&reconfiguration->batch.instances[i]);
+            }
+            reconfiguration->batch.count = 0;
+        }
+    }
+
+    return result;
+}
+
+/* Attaches a created module to the broker, without any route. */
+static int attach_planned_module(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_INSTANCE* instance, const char* module_signature)
+{
+    int result;
+    char* name_copied = NULL;
+    char* signature_copied = NULL;
+    MODULE module;
+    module.module_apis = instance->module_apis;
+    module.module_handle = instance->module_handle;
+
+    if (Broker_AddModule(gateway_handle->broker, &module) != BROKER_OK)
+    {
+        LogError("Failed to add module to the gateway's broker.");
+        result = __LINE__;
+    }
+    else if (mallocAndStrcpy_s(&name_copied, instance->entry->module_name) != 0 ||
+        (module_signature != NULL && mallocAndStrcpy_s(&signature_copied, module_signature) != 0))
+    {
+        LogError("Unable to malloc for module name");
+        free(name_copied);
+        if (Broker_RemoveModule(gateway_handle->broker, &module) != BROKER_OK)
+        {
+            LogError("Failed to remove module [%p] from the gateway message broker. This module will remain attached.", &module);
+        }
+        result = __LINE__;
+    }
+    else
+    {
+        MODULE_DATA module_data =
+        {
+            name_copied,
+            instance->module_library_handle,
+            instance->entry->module_loader_info.loader,
+            instance->module_handle,
+            signature_copied
+        };
+        *instance->module_data = module_data;
+        Broker_IncRef(gateway_handle->broker);
+        result = 0;
+    }
+
+    return result;
+}
+
+/* Destroys the modules created for the new graph. */
+static void abandon_planned_modules(GATEWAY_HANDLE_DATA* gateway_handle, GATEWAY_RECONFIGURATION* reconfiguration)
+{
+    size_t i;
+
+    for (i = 0; i < reconfiguration->batch.count; i++)
+    {
+        MODULE_INSTANCE* instance = &reconfiguration->batch.instances[i];
+        if (i < reconfiguration->attached_count)
+        {
+            MODULE module;
+            module.module_apis = instance->module_apis;
+            module.module_handle = instance->module_handle;
+            if (Broker_RemoveModule(gateway_handle->broker, &module) != BROKER_OK)
+            {
+                LogError("Failed to remove module [%p] from the gateway message broker. This module will remain attached.", &module);
+            }
+            Broker_DecRef(gateway_handle->broker);
+            free(instance->module_data->module_name);
+            free(instance->module_data->module_signature);
+        }
+        discard_module(instance);
+    }
+    reconfiguration->batch.count = 0;
+    reconfiguration->attached_count = 0;
+}
+
+static int build_next_graph(GATEWAY_RECONFIGURATION* reconfiguration, VECTOR_HANDLE link_entries)
+{
+    int result;
+    size_t link_count = VECTOR_size(link_entries);
+
+    reconfiguration->next_modules_vector = VECTOR_create(sizeof(MODULE_DATA*));
+    reconfiguration->next_links_vector = VECTOR_create(sizeof(LINK_DATA));
+    reconfiguration->next_index = GatewayIndex_Create();
+    if (reconfiguration->next_modules_vector == NULL || reconfiguration->next_links_vector == NULL || reconfiguration->next_index == NULL)
+    {
+        LogError("Unable to create the vectors of the new configuration.");
+        result = __LINE__;
+    }
+    else if (reconfiguration->next_module_count > 0 &&
+        VECTOR_push_back(reconfiguration->next_modules_vector, reconfiguration->next_modules, reconfiguration->next_module_count) != 0)
+    {
+        LogError("Unable to add MODULE_DATA* to the gateway module vector.");
+        result = __LINE__;
+    }
+    else
+    {
+        size_t i;
+
+        result = 0;
+        for (i = 0; i < reconfiguration->next_module_count && result == 0; i++)
+        {
+            if (GatewayIndex_AddModule(reconfiguration->next_index, reconfiguration->next_modules[i]) != 0)
+            {
+                LogError("Unable to add MODULE_DATA* to the gateway index.");
+                result = __LINE__;
+            }
+        }
+
+        for (i = 0; i < link_count && result == 0; i++)
+        {
+            const GATEWAY_LINK_ENTRY* link_entry = (GATEWAY_LINK_ENTRY*)VECTOR_element(link_entries, i);
+            bool from_any_source = (strcmp(link_entry->module_source, GATEWAY_ALL) == 0);
+            LINK_DATA link_data =
+            {
+                from_any_source,
+                from_any_source ? no_module : GatewayIndex_FindModuleByName(reconfiguration->next_index, link_entry->module_source),
+                GatewayIndex_FindModuleByName(reconfiguration->next_index, link_entry->module_sink)
+            };
+
+            if (VECTOR_push_back(reconfiguration->next_links_vector, &link_data, 1) != 0 ||
+                GatewayIndex_AddLink(reconfiguration->next_index, link_data.module_source, link_data.module_sink) != 0)
+            {
+                LogError("Unable to add LINK_DATA* to the gateway links vector.");
+                result = __LINE__;
+            }
+        }
+    }
 
-                        /*Codes_SRS_GATEWAY_14_030: [If any internal API call is unsuccessful after a module is created, the library will be unloaded and the module destroyed.]*/
-                        if (module_result == NULL)
-                        {
-                            MODULE_DESTROY(module_apis)(module_handle);
-                            module_entry->module_loader_info.loader->api->Unload(module_entry->module_loader_info.loader, module_library_handle);
-                        }
-                    }
+    return result;
+}
+
+static size_t count_routes(VECTOR_HANDLE links, size_t module_count)
+{
+    size_t result = 0;
+    size_t link_count = VECTOR_size(links);
+    size_t i;
+
+    for (i = 0; i < link_count; i++)
+    {
+        result += ((LINK_DATA*)VECTOR_element(links, i))->from_any_source ? module_count - 1 : 1;
+    }
+
+    return result;
+}
+
+/* A running module is retired when the new graph has no module of its name, or another one. */
+static bool is_module_retired(GATEWAY_INDEX_HANDLE next_index, const MODULE_DATA* module_data)
+{
+    return next_index != NULL && GatewayIndex_FindModuleByName(next_index, module_data->module_name) != module_data;
+}
+
+/* Expands the links of a graph to the routes of the broker, "*" to every module but the sink. Only the routes of the running graph get a next_index, to tell the modules retired. */
+static size_t add_routes(GATEWAY_ROUTE* routes, VECTOR_HANDLE links, MODULE_DATA** modules, size_t module_count, GATEWAY_INDEX_HANDLE next_index)
+{
+    size_t route_count = 0;
+    size_t link_count = VECTOR_size(links);
+    size_t i;
+    size_t m;
+
+    for (i = 0; i < link_count; i++)
+    {
+        const LINK_DATA* link_data = (LINK_DATA*)VECTOR_element(links, i);
+        bool sink_retired = is_module_retired(next_index, link_data->module_sink);
+        for (m = 0; m < (link_data->from_any_source ? module_count : 1); m++)
+        {
+            const MODULE_DATA* module_source = link_data->from_any_source ? modules[m] : link_data->module_source;
+            if (!link_data->from_any_source || module_source->module != link_data->module_sink->module)
+            {
+                GATEWAY_ROUTE* route = &routes[route_count++];
+                route->link.module_source_handle = module_source->module;
+                route->link.module_sink_handle = link_data->module_sink->module;
+                route->source_retired = is_module_retired(next_index, module_source);
+                route->sink_retired = sink_retired;
+            }
+        }
+    }
+
+    return route_count;
+}
+
+static int compare_handles(MODULE_HANDLE left, MODULE_HANDLE right)
+{
+    return ((uintptr_t)left < (uintptr_t)right) ? -1 : (((uintptr_t)left > (uintptr_t)right) ? 1 : 0);
+}
+
+static int compare_routes(const void* left, const void* right)
+{
+    const GATEWAY_ROUTE* left_route = (const GATEWAY_ROUTE*)left;
+    const GATEWAY_ROUTE* right_route = (const GATEWAY_ROUTE*)right;
+    int result = compare_handles(left_route->link.module_sink_handle, right_route->link.module_sink_handle);
+    return (result != 0) ? result : compare_handles(left_route->link.module_source_handle, right_route->link.module_source_handle);
+}
+
+/* Diffs the routes of the running graph and of the new graph. A route counts once per link it comes from, like the broker subscriptions. */
+static int plan_routes(GATEWAY_HANDLE_DATA* gateway_handle, GATEWAY_RECONFIGURATION* reconfiguration)
+{
+    int result;
+    size_t route_count = count_routes(gateway_handle->links, reconfiguration->module_count);
+    size_t next_route_count = count_routes(reconfiguration->next_links_vector, reconfiguration->next_module_count);
+
+    /* one allocation: the routes of both graphs, then the routes to remove, to add and to remove later */
+    reconfiguration->routes = (GATEWAY_ROUTE*)malloc(
+        (route_count + next_route_count) * sizeof(GATEWAY_ROUTE) +
+        (2 * route_count + next_route_count) * sizeof(BROKER_LINK_DATA) + 1);
+    if (reconfiguration->routes == NULL)
+    {
+        LogError("Failed to reconfigure the gateway because it could not allocate memory.");
+        result = __LINE__;
+    }
+    else
+    {
+        GATEWAY_ROUTE* routes = reconfiguration->routes;
+        GATEWAY_ROUTE* next_routes = routes + route_count;
+        size_t i = 0;
+        size_t j = 0;
+
+        reconfiguration->links_to_remove = (BROKER_LINK_DATA*)(next_routes + next_route_count);
+        reconfiguration->deferred_links = reconfiguration->links_to_remove + route_count;
+        reconfiguration->links_to_add = reconfiguration->deferred_links + route_count;
+
+        (void)add_routes(routes, gateway_handle->links, reconfiguration->modules, reconfiguration->module_count, reconfiguration->next_index);
+        (void)add_routes(next_routes, reconfiguration->next_links_vector, reconfiguration->next_modules, reconfiguration->next_module_count, NULL);
+        qsort(routes, route_count, sizeof(GATEWAY_ROUTE), compare_routes);
+        qsort(next_routes, next_route_count, sizeof(GATEWAY_ROUTE), compare_routes);
+
+        /*Codes_SRS_GATEWAY_31_010: [ The function shall remove the routes of the running graph missing from the new graph and add the routes of the new graph missing from the running graph, counting a route once per link it comes from. ]*/
+        while (i < route_count || j < next_route_count)
+        {
+            int order = (i == route_count) ? 1 : ((j == next_route_count) ? -1 : compare_routes(&routes[i], &next_routes[j]));
+            if (order == 0)
+            {
+                i++;
+                j++;
+            }
+            else if (order < 0)
+            {
+                /* a retired module may publish until it is destroyed, the routes from it go once it is */
+                if (routes[i].source_retired && !routes[i].sink_retired)
+                {
+                    reconfiguration->deferred_links[reconfiguration->deferred_count++] = routes[i].link;
                 }
+                else
+                {
+                    reconfiguration->links_to_remove[reconfiguration->remove_count++] = routes[i].link;
+                }
+                i++;
+            }
+            else
+            {
+                reconfiguration->links_to_add[reconfiguration->add_count++] = next_routes[j].link;
+                j++;
+            }
+        }
+        result = 0;
+    }
+
+    return result;
+}
+
+/* Retires the modules the new graph dropped and swaps the graph. Nothing fails past the route change. */
+static void commit_reconfiguration(GATEWAY_HANDLE_DATA* gateway_handle, GATEWAY_RECONFIGURATION* reconfiguration)
+{
+    size_t retired_count = 0;
+    size_t m;
+
+    /*Codes_SRS_GATEWAY_31_011: [ The function shall drain the modules it replaces or removes, so they receive the messages published before the routes changed, then destroy them. ]*/
+    for (m = 0; m < reconfiguration->module_count; m++)
+    {
+        if (reconfiguration->retired[m])
+        {
+            MODULE_DATA* module_data = reconfiguration->modules[m];
+            MODULE module;
+            module.module_apis = NULL;
+            module.module_handle = module_data->module;
+            if (Broker_DrainModule(gateway_handle->broker, &module) != BROKER_OK &&
+                Broker_RemoveModule(gateway_handle->broker, &module) != BROKER_OK)
+            {
+                LogError("Failed to remove module [%p] from the message broker.", module_data->module);
+            }
+            MODULE_DESTROY(module_data->module_loader->api->GetApi(module_data->module_loader, module_data->module_library_handle))(module_data->module);
+            retired_count++;
+        }
+    }
+
+    if (reconfiguration->deferred_count > 0 &&
+        Broker_UpdateLinks(gateway_handle->broker, reconfiguration->deferred_links, reconfiguration->deferred_count, NULL, 0) != BROKER_OK)
+    {
+        LogError("Unable to remove the routes from the retired modules.");
+    }
+
+    for (m = 0; m < reconfiguration->module_count; m++)
+    {
+        if (reconfiguration->retired[m])
+        {
+            MODULE_DATA* module_data = reconfiguration->modules[m];
+            Broker_DecRef(gateway_handle->broker);
+            module_data->module_loader->api->Unload(module_data->module_loader, module_data->module_library_handle);
+            free(module_data->module_name);
+            free(module_data->module_signature);
+            free(module_data);
+        }
+    }
+
+    VECTOR_destroy(gateway_handle->modules);
+    VECTOR_destroy(gateway_handle->links);
+    GatewayIndex_Destroy(gateway_handle->index);
+    gateway_handle->modules = reconfiguration->next_modules_vector;
+    gateway_handle->links = reconfiguration->next_links_vector;
+    gateway_handle->index = reconfiguration->next_index;
+    reconfiguration->next_modules_vector = NULL;
+    reconfiguration->next_links_vector = NULL;
+    reconfiguration->next_index = NULL;
+
+    /* the links of the kept modules were counted in the former graph */
+    for (m = 0; m < reconfiguration->next_module_count; m++)
+    {
+        reconfiguration->next_modules[m]->source_link_count = 0;
+        reconfiguration->next_modules[m]->sink_link_count = 0;
+    }
+    for (m = 0; m < VECTOR_size(gateway_handle->links); m++)
+    {
+        count_link((LINK_DATA*)VECTOR_element(gateway_handle->links, m));
+    }
+
+    if (gateway_handle->started)
+    {
+        /*Codes_SRS_GATEWAY_31_013: [ If the gateway was started, the function shall start the modules it created. ]*/
+        for (m = 0; m < reconfiguration->batch.count; m++)
+        {
+            pfModule_Start pfStart = MODULE_START(reconfiguration->batch.instances[m].module_apis);
+            if (pfStart != NULL)
+            {
+                (pfStart)(reconfiguration->batch.instances[m].module_handle);
+            }
+        }
+    }
+
+    if (reconfiguration->batch.count > 0 || retired_count > 0)
+    {
+        EventSystem_ReportEvent(gateway_handle->event_system, gateway_handle, GATEWAY_MODULE_LIST_CHANGED);
+    }
+}
+
+int gateway_reconfigure_internal(GATEWAY_HANDLE_DATA* gateway_handle, VECTOR_HANDLE module_entries, const char* const* module_signatures, VECTOR_HANDLE link_entries, bool use_json)
+{
+    int result;
+    GATEWAY_RECONFIGURATION reconfiguration;
+    memset(&reconfiguration, 0, sizeof(GATEWAY_RECONFIGURATION));
+
+    /*Codes_SRS_GATEWAY_31_008: [ The function shall fail if a module name is repeated or is "*", or if a link references a module not in `module_entries`. ]*/
+    if (gateway_handle == NULL || module_entries == NULL || link_entries == NULL || index_configuration(&reconfiguration, module_entries, link_entries) != 0)
+    {
+        LogError("Invalid configuration, the gateway is not changed.");
+        result = __LINE__;
+    }
+    else if (plan_modules(gateway_handle, &reconfiguration, module_entries, module_signatures, use_json) != 0)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        MODULE_INSTANCE* first_instance = reconfiguration.batch.instances;
+        const GATEWAY_MODULES_ENTRY* first_entry = (reconfiguration.next_module_count > 0) ? (GATEWAY_MODULES_ENTRY*)VECTOR_element(module_entries, 0) : NULL;
+
+        result = 0;
+        for (reconfiguration.attached_count = 0; reconfiguration.attached_count < reconfiguration.batch.count && result == 0; reconfiguration.attached_count++)
+        {
+            MODULE_INSTANCE* instance = &first_instance[reconfiguration.attached_count];
+            const char* module_signature = (module_signatures != NULL) ? module_signatures[instance->entry - first_entry] : NULL;
+            if (attach_planned_module(gateway_handle, instance, module_signature) != 0)
+            {
+                result = __LINE__;
+                break;
             }
         }
+
+        /*Codes_SRS_GATEWAY_31_027: [ Before the routes change, the function shall unfuse all the fused links; they stay unfused afterwards. ]*/
+        if (result == 0)
+        {
+            unfuse_all_links(gateway_handle);
+        }
+
+        /*Codes_SRS_GATEWAY_31_014: [ The function shall change all the routes at once with `Broker_UpdateLinks`, so a message published before is delivered along the former routes and a message published after along the new routes. ]*/
+        if (result != 0 ||
+            build_next_graph(&reconfiguration, link_entries) != 0 ||
+            plan_routes(gateway_handle, &reconfiguration) != 0 ||
+            Broker_UpdateLinks(gateway_handle->broker, reconfiguration.links_to_remove, reconfiguration.remove_count, reconfiguration.links_to_add, reconfiguration.add_count) != BROKER_OK)
+        {
+            /*Codes_SRS_GATEWAY_31_012: [ If any step fails before the routes change, the function shall destroy the modules it created and leave the running graph unchanged. ]*/
+            LogError("Unable to reconfigure the gateway, the gateway is not changed.");
+            abandon_planned_modules(gateway_handle, &reconfiguration);
+            result = __LINE__;
+        }
         else
         {
-            module_result = NULL;
-            LogError("Error to add module. Duplicated module name: %s", module_entry->module_name);
+            commit_reconfiguration(gateway_handle, &reconfiguration);
+            result = 0;
         }
     }
 
-    return module_result;
+    if (reconfiguration.next_modules_vector != NULL)
+    {
+        VECTOR_destroy(reconfiguration.next_modules_vector);
+    }
+    if (reconfiguration.next_links_vector != NULL)
+    {
+        VECTOR_destroy(reconfiguration.next_links_vector);
+    }
+    if (reconfiguration.next_index != NULL)
+    {
+        GatewayIndex_Destroy(reconfiguration.next_index);
+    }
+    if (reconfiguration.entry_index != NULL)
+    {
+        GatewayIndex_Destroy(reconfiguration.entry_index);
+    }
+    free(reconfiguration.entry_modules);
+    free(reconfiguration.routes);
+    free(reconfiguration.batch.instances);
+
+    return result;
+}
+
+static bool is_link_fusable(const LINK_DATA* link_data)
+{
+    /*Codes_SRS_GATEWAY_31_035: [ The gateway shall count the links from and to each module as they are added and removed, and shall tell whether a link can be fused from the counts of its source and sink. ]*/
+    return link_data->module_source != link_data->module_sink &&
+        link_data->module_source->module_loader->type == NATIVE &&
+        link_data->module_sink->module_loader->type == NATIVE &&
+        link_data->module_source->source_link_count == 1 &&
+        link_data->module_sink->sink_link_count == 1;
+}
+
+void gateway_fuselinks_internal(GATEWAY_HANDLE_DATA* gateway_handle)
+{
+    size_t link_count = VECTOR_size(gateway_handle->links);
+    size_t link;
+    bool has_any_source = false;
+
+    for (link = 0; link < link_count && !has_any_source; link++)
+    {
+        has_any_source = ((LINK_DATA*)VECTOR_element(gateway_handle->links, link))->from_any_source;
+    }
+
+    /*Codes_SRS_GATEWAY_31_024: [ The gateway shall fuse each link whose source and sink are native modules, when the source has no other sink, the sink has no other source and no link is from "*". ]*/
+    for (link = 0; link < link_count && !has_any_source; link++)
+    {
+        LINK_DATA* link_data = (LINK_DATA*)VECTOR_element(gateway_handle->links, link);
+        if (is_link_fusable(link_data))
+        {
+            BROKER_LINK_DATA broker_link_entry =
+            {
+                link_data->module_source->module,
+                link_data->module_sink->module
+            };
+
+            /* The broker refuses the fusions that would close a cycle, the link then stays queued. */
+            if (Broker_FuseLink(gateway_handle->broker, &broker_link_entry) == BROKER_OK)
+            {
+                link_data->module_source->fused_sink = link_data->module_sink;
+                link_data->module_sink->fused_source = link_data->module_source;
+            }
+        }
+    }
+}
+
+/* The modules are removed from the last one when the gateway is destroyed, look from the back. */
+static MODULE_DATA** find_module_slot(GATEWAY_HANDLE_DATA* gateway_handle, const MODULE_DATA* module_data)
+{
+    MODULE_DATA** result = NULL;
+    size_t m = VECTOR_size(gateway_handle->modules);
+
+    while (m > 0 && result == NULL)
+    {
+        MODULE_DATA** module_data_pptr = (MODULE_DATA**)VECTOR_element(gateway_handle->modules, --m);
+        if (*module_data_pptr == module_data)
+        {
+            result = module_data_pptr;
+        }
+    }
+
+    return result;
+}
+
+/* Removes a link from the broker and from the gateway index, not from the links vector. */
+static void release_link(GATEWAY_HANDLE_DATA* gateway_handle, LINK_DATA* link_data)
+{
+    /*Codes_SRS_GATEWAY_31_026: [ Before a fused link is removed, the gateway shall unfuse it. ]*/
+    if (is_link_fused(link_data))
+    {
+        unfuse_modules(gateway_handle, link_data->module_source, link_data->module_sink);
+    }
+    uncount_link(link_data);
+
+    if (link_data->from_any_source)
+    {
+        remove_any_source_link(gateway_handle, link_data);
+    }
+    else
+    {
+        BROKER_LINK_DATA broker_data =
+        {
+            link_data->module_source->module,
+            link_data->module_sink->module
+        };
+
+        Broker_RemoveLink(gateway_handle->broker, &broker_data);
+    }
+
+    GatewayIndex_RemoveLink(gateway_handle->index, link_data->module_source, link_data->module_sink);
+}
+
+/* Removes the links from or to a module, moving the links kept over the removed ones in one pass. */
+static void remove_links_of_module(GATEWAY_HANDLE_DATA* gateway_handle, const MODULE_DATA* module_data)
+{
+    size_t link_count = VECTOR_size(gateway_handle->links);
+    size_t kept_count = 0;
+    size_t link;
+
+    for (link = 0; link < link_count; link++)
+    {
+        LINK_DATA* link_data = (LINK_DATA*)VECTOR_element(gateway_handle->links, link);
+        if (link_data->module_sink == module_data ||
+            (!link_data->from_any_source && link_data->module_source == module_data))
+        {
+            release_link(gateway_handle, link_data);
+        }
+        else
+        {
+            if (kept_count < link)
+            {
+                *(LINK_DATA*)VECTOR_element(gateway_handle->links, kept_count) = *link_data;
+            }
+            kept_count++;
+        }
+    }
+
+    if (kept_count < link_count)
+    {
+        VECTOR_erase(gateway_handle->links, VECTOR_element(gateway_handle->links, kept_count), link_count - kept_count);
+    }
 }
 
-void gateway_removemodule_internal(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_DATA** module_data_pptr)
+void gateway_removemodule_internal(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_DATA* module_data)
 {
     MODULE module;
     module.module_apis = NULL;
-    module.module_handle = (*module_data_pptr)->module;
+    module.module_handle = module_data->module;
 
-    remove_module_from_any_source(gateway_handle, *module_data_pptr);
+    remove_module_from_any_source(gateway_handle, module_data);
     /* Codes_SRS_GATEWAY_26_018: [ This function shall remove any links that contain the removed module either as a source or sink. ] */
+    /*Codes_SRS_GATEWAY_31_019: [ The function shall remove the links of the module in a single pass over the links. ]*/
     if (gateway_handle->links)
     {
-        LINK_DATA *link;
-        while ((link = VECTOR_find_if(gateway_handle->links, link_name_both_find, (*module_data_pptr)->module_name)) != NULL)
-        {
-            gateway_removelink_internal(gateway_handle, link);
-        }
+        remove_links_of_module(gateway_handle, module_data);
     }
 
-    free((*module_data_pptr)->module_name);
+    GatewayIndex_RemoveModule(gateway_handle->index, module_data);
+    free(module_data->module_name);
+    if (module_data->module_signature != NULL)
+    {
+        free(module_data->module_signature);
+    }
 
     /*Codes_SRS_GATEWAY_14_021: [ The function shall detach module from the GATEWAY_HANDLE_DATA's broker BROKER_HANDLE. ]*/
     /*Codes_SRS_GATEWAY_14_022: [ If GATEWAY_HANDLE_DATA's broker cannot detach module, the function shall log the error and continue unloading the module from the GATEWAY_HANDLE. ]*/
     if (Broker_RemoveModule(gateway_handle->broker, &module) != BROKER_OK)
     {
-        LogError("Failed to remove module [%p] from the message broker. This module will remain linked to the broker but will be removed from the gateway.", (*module_data_pptr)->module);
+        LogError("Failed to remove module [%p] from the message broker. This module will remain linked to the broker but will be removed from the gateway.", module_data->module);
     }
     /*Codes_SRS_GATEWAY_14_038: [ The function shall decrement the BROKER_HANDLE reference count. ]*/
     Broker_DecRef(gateway_handle->broker);
 
     /*Codes_SRS_GATEWAY_14_024: [ The function shall use the MODULE_DATA's module_library_handle to retrieve the MODULE_API and destroy module. ]*/
-    MODULE_DESTROY((*module_data_pptr)->module_loader->api->GetApi((*module_data_pptr)->module_loader, (*module_data_pptr)->module_library_handle))((*module_data_pptr)->module);
+    MODULE_DESTROY(module_data->module_loader->api->GetApi(module_data->module_loader, module_data->module_library_handle))(module_data->module);
 
     /*Codes_SRS_GATEWAY_14_025: [The function shall unload MODULE_DATA's module_library_handle. ]*/
-    (*module_data_pptr)->module_loader->api->Unload((*module_data_pptr)->module_loader, (*module_data_pptr)->module_library_handle);
+    module_data->module_loader->api->Unload(module_data->module_loader, module_data->module_library_handle);
 
     /*Codes_SRS_GATEWAY_14_026:[The function shall remove that MODULE_DATA from GATEWAY_HANDLE_DATA's modules. ]*/
-    MODULE_DATA * module_data_ptr = *module_data_pptr;
-    VECTOR_erase(gateway_handle->modules, module_data_pptr, 1);
-    free(module_data_ptr);
+    MODULE_DATA** module_data_pptr = find_module_slot(gateway_handle, module_data);
+    if (module_data_pptr != NULL)
+    {
+        VECTOR_erase(gateway_handle->modules, module_data_pptr, 1);
+    }
+    free(module_data);
 }
 
 bool gateway_addlink_internal(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_LINK_ENTRY* link_entry)
@@ -636,24 +2243,33 @@ bool gateway_addlink_internal(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY
 void gateway_removelink_internal(GATEWAY_HANDLE_DATA* gateway_handle, LINK_DATA* link_data)
 {
     /*Codes_SRS_GATEWAY_04_007: [The functional shall remove that LINK_DATA from GATEWAY_HANDLE_DATA's links. ]*/
+    release_link(gateway_handle, link_data);
+    VECTOR_erase(gateway_handle->links, link_data, 1);
+}
 
-    if (link_data->from_any_source)
-    {
-        remove_any_source_link(gateway_handle, link_data);
-    }
-    else
-    {
+LINK_DATA* gateway_findlink_internal(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_LINK_ENTRY* link_entry)
+{
+    LINK_DATA* result = NULL;
+    MODULE_DATA* module_source;
+    MODULE_DATA* module_sink;
 
-        BROKER_LINK_DATA broker_data =
+    /*Codes_SRS_GATEWAY_31_015: [ The gateway shall find its modules by name or handle, and its links by source and sink, in the gateway index instead of walking its modules and links. ]*/
+    if (find_link_modules(gateway_handle->index, link_entry, &module_source, &module_sink) &&
+        GatewayIndex_HasLink(gateway_handle->index, module_source, module_sink))
+    {
+        /* the link exists, only its place in the vector is left to find */
+        size_t link = VECTOR_size(gateway_handle->links);
+        while (link > 0 && result == NULL)
         {
-            link_data->module_source->module,
-            link_data->module_sink->module
-        };
-
-        Broker_RemoveLink(gateway_handle->broker, &broker_data);
+            LINK_DATA* link_data = (LINK_DATA*)VECTOR_element(gateway_handle->links, --link);
+            if (link_data->module_source == module_source && link_data->module_sink == module_sink)
+            {
+                result = link_data;
+            }
+        }
     }
 
-    VECTOR_erase(gateway_handle->links, link_data, 1);
+    return result;
 }
 
 int add_module_to_any_source(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_DATA* module)
@@ -666,7 +2282,7 @@ int add_module_to_any_source(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_DATA* m
         LINK_DATA * link_data = VECTOR_element(gateway_handle->links, link);
         if (link_data->from_any_source)
         {
-            MODULE_DATA** module_sink = (MODULE_DATA**)VECTOR_find_if(gateway_handle->modules, module_name_find, link_data->module_sink->module_name);
+            MODULE_DATA* module_sink = GatewayIndex_FindModuleByName(gateway_handle->index, link_data->module_sink->module_name);
             if (module_sink == NULL)
             {
                 LogError("Link failure between [%s] and [%s]", link_data->module_sink->module_name, module->module_name);
@@ -675,7 +2291,7 @@ int add_module_to_any_source(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_DATA* m
             }
             else
             {
-                if (add_one_link_to_broker(gateway_handle, module->module, (*module_sink)->module) != 0)
+                if (add_one_link_to_broker(gateway_handle, module, module_sink) != 0)
                 {
                     result = __LINE__;
                     break;
@@ -702,14 +2318,14 @@ void remove_module_from_any_source(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_D
             LINK_DATA * link_data = VECTOR_element(gateway_handle->links, link);
             if (link_data->from_any_source)
             {
-                MODULE_DATA** module_sink = (MODULE_DATA**)VECTOR_find_if(gateway_handle->modules, module_name_find, link_data->module_sink->module_name);
+                MODULE_DATA* module_sink = GatewayIndex_FindModuleByName(gateway_handle->index, link_data->module_sink->module_name);
                 if (module_sink == NULL)
                 {
-                    LogError("Could not find sink for link [%s]", link_data->module_sink);
+                    LogError("Could not find sink for link [%s]", link_data->module_sink->module_name);
                 }
                 else
                 {
-                    if (remove_one_link_from_broker(gateway_handle, module->module, (*module_sink)->module) != 0)
+                    if (remove_one_link_from_broker(gateway_handle, module->module, module_sink->module) != 0)
                     {
                         LogError("Unable to remove link to Broker.");
                     }
@@ -722,7 +2338,7 @@ void remove_module_from_any_source(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_D
 int add_any_source_link(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_LINK_ENTRY* link_entry)
 {
     int result;
-    MODULE_DATA** module_sink_data = (MODULE_DATA**)VECTOR_find_if(gateway_handle->modules, module_name_find, link_entry->module_sink);
+    MODULE_DATA* module_sink_data = GatewayIndex_FindModuleByName(gateway_handle->index, link_entry->module_sink);
 
     /*Codes_SRS_GATEWAY_04_011: [If the module referenced by the entryLink->module_source or entryLink->module_sink doesn't exists this function shall return GATEWAY_ADD_LINK_ERROR ] */
     if (module_sink_data == NULL)
@@ -737,7 +2353,7 @@ int add_any_source_link(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_LINK_
         {
             true,
             no_module,
-            *module_sink_data
+            module_sink_data
         };
 
         /*Codes_SRS_GATEWAY_04_012: [ This function shall add the entryLink to the gw->links ] */
@@ -756,18 +2372,28 @@ int add_any_source_link(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_LINK_
             {
                 MODULE_DATA **source_module_data = (MODULE_DATA **)VECTOR_element(gateway_handle->modules, m);
                 /*Codes_SRS_GATEWAY_17_005: [ For this link, the sink shall receive all messages publish by other modules. ]*/
-                if ((*source_module_data)->module != (*module_sink_data)->module &&
-                    add_one_link_to_broker(gateway_handle, (*source_module_data)->module, (*module_sink_data)->module) != 0)
+                if ((*source_module_data)->module != module_sink_data->module &&
+                    add_one_link_to_broker(gateway_handle, *source_module_data, module_sink_data) != 0)
                 {
                     result = __LINE__;
                     break;
                 }
             }
+            /*Codes_SRS_GATEWAY_31_016: [ The gateway shall add each module and link it tracks to the gateway index, and shall fail to add the module or link if the index cannot be updated. ]*/
+            if (result == 0 && GatewayIndex_AddLink(gateway_handle->index, no_module, module_sink_data) != 0)
+            {
+                LogError("Unable to add the link to the gateway index.");
+                result = __LINE__;
+            }
             if (result != 0)
             {
                 remove_any_source_link(gateway_handle, &link_data);
                 VECTOR_erase(gateway_handle->links, VECTOR_back(gateway_handle->links), 1);
             }
+            else
+            {
+                count_link(&link_data);
+            }
         }
     }
     return result;
@@ -775,7 +2401,7 @@ int add_any_source_link(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_LINK_
 
 void remove_any_source_link(GATEWAY_HANDLE_DATA* gateway_handle, LINK_DATA* link_entry)
 {
-    MODULE_DATA** module_sink_data = (MODULE_DATA**)VECTOR_find_if(gateway_handle->modules, module_name_find, link_entry->module_sink->module_name);
+    MODULE_DATA* module_sink_data = GatewayIndex_FindModuleByName(gateway_handle->index, link_entry->module_sink->module_name);
 
     /*Codes_SRS_GATEWAY_04_011: [If the module referenced by the entryLink->module_source or entryLink->module_sink doesn't exists this function shall return GATEWAY_ADD_LINK_ERROR ] */
     if (module_sink_data != NULL)
@@ -785,8 +2411,8 @@ void remove_any_source_link(GATEWAY_HANDLE_DATA* gateway_handle, LINK_DATA* link
         for (m = 0; m < num_modules; m++)
         {
             MODULE_DATA **source_module_data = (MODULE_DATA **)VECTOR_element(gateway_handle->modules, m);
-            if ((*source_module_data)->module != (*module_sink_data)->module &&
-                remove_one_link_from_broker(gateway_handle, (*source_module_data)->module, (*module_sink_data)->module) != 0)
+            if ((*source_module_data)->module != module_sink_data->module &&
+                remove_one_link_from_broker(gateway_handle, (*source_module_data)->module, module_sink_data->module) != 0)
             {
                 LogError("Unable to remove link to Broker.");
             }
@@ -794,41 +2420,7 @@ void remove_any_source_link(GATEWAY_HANDLE_DATA* gateway_handle, LINK_DATA* link
     }
     else
     {
-        LogError("Sink module doesn't exists on this gateway. Module Name: %s.", link_entry->module_sink);
-    }
-
-}
-
-/* Searches both sources and sinks. */
-bool link_data_find(const void* element, const void* linkEntry)
-{
-    bool result;
-    GATEWAY_LINK_ENTRY* link_entry_casted = (GATEWAY_LINK_ENTRY*)linkEntry;
-    LINK_DATA * element_casted = (LINK_DATA*)element;
-
-    if (strcmp(GATEWAY_ALL, link_entry_casted->module_source) == 0)
-    {
-        if (element_casted->from_any_source)
-        {
-            result = (strcmp(element_casted->module_sink->module_name, link_entry_casted->module_sink) == 0);
-        }
-        else
-        {
-            result = false;
-        }
-    }
-    else
-    {
-        if (element_casted->from_any_source)
-        {
-            result = false;
-        }
-        else
-        {
-            result = ((strcmp(element_casted->module_sink->module_name, link_entry_casted->module_sink) == 0) &&
-                (strcmp(element_casted->module_source->module_name, link_entry_casted->module_source) == 0));
-        }
+        LogError("Sink module doesn't exists on this gateway. Module Name: %s.", link_entry->module_sink->module_name);
     }
 
-    return result;
 }
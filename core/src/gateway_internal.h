@@ -5,6 +5,7 @@
 #define GATEWAY_INTERNAL_H
 
 #include "module_loader.h"
+#include "gateway_index.h"
 
 #ifdef __cplusplus
 extern "C"
@@ -26,6 +27,24 @@ typedef struct MODULE_DATA_TAG {
      *          broker.
      */
     MODULE_HANDLE module;
+
+    /** @brief  The JSON configuration the module was created from, NULL if it
+     *          was not created from JSON. Reconfiguring keeps a module whose
+     *          configuration did not change.
+     */
+    char* module_signature;
+
+    /** @brief  The number of links from and to this module, a link from "*"
+     *          counts for its sink only.
+     */
+    size_t source_link_count;
+    size_t sink_link_count;
+
+    /** @brief  The sink of the fused link from this module and the source of
+     *          the fused link to it, NULL when there is none.
+     */
+    struct MODULE_DATA_TAG* fused_sink;
+    struct MODULE_DATA_TAG* fused_source;
 } MODULE_DATA;
 
 typedef struct GATEWAY_HANDLE_DATA_TAG {
@@ -41,6 +60,15 @@ typedef struct GATEWAY_HANDLE_DATA_TAG {
 
     /** @brief  Vector of LINK_DATA links that the Gateway must track */
     VECTOR_HANDLE links;
+
+    /** @brief  True once the gateway started, the modules created later are started too */
+    bool started;
+
+    /** @brief  Finds the modules by name or handle and the links without walking the vectors */
+    GATEWAY_INDEX_HANDLE index;
+
+    /** @brief  True if the links of single native sources and sinks are fused when the gateway starts */
+    bool fuse_links;
 } GATEWAY_HANDLE_DATA;
 
 typedef struct LINK_DATA_TAG {
@@ -52,15 +80,18 @@ typedef struct LINK_DATA_TAG {
 GATEWAY_HANDLE gateway_create_internal(const GATEWAY_PROPERTIES* properties, bool use_json);
 void gateway_destroy_internal(GATEWAY_HANDLE gw);
 MODULE_HANDLE gateway_addmodule_internal(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_MODULES_ENTRY* entry, bool use_json);
-void gateway_removemodule_internal(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_DATA** module);
+int gateway_addmodules_internal(GATEWAY_HANDLE_DATA* gateway_handle, VECTOR_HANDLE module_entries, bool use_json);
+void gateway_startmodules_internal(GATEWAY_HANDLE_DATA* gateway_handle);
+void gateway_fuselinks_internal(GATEWAY_HANDLE_DATA* gateway_handle);
+int gateway_reconfigure_internal(GATEWAY_HANDLE_DATA* gateway_handle, VECTOR_HANDLE module_entries, const char* const* module_signatures, VECTOR_HANDLE link_entries, bool use_json);
+void gateway_removemodule_internal(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_DATA* module_data);
 bool gateway_addlink_internal(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_LINK_ENTRY* link_entry);
+LINK_DATA* gateway_findlink_internal(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_LINK_ENTRY* link_entry);
 void gateway_removelink_internal(GATEWAY_HANDLE_DATA* gateway_handle, LINK_DATA* link_data);
 int add_module_to_any_source(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_DATA* module);
 void remove_module_from_any_source(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_DATA* module);
 int add_any_source_link(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_LINK_ENTRY* link_entry);
 void remove_any_source_link(GATEWAY_HANDLE_DATA* gateway_handle, LINK_DATA* link_entry);
-bool module_name_find(const void* element, const void* module_name);
-bool link_data_find(const void* element, const void* link_data);
 
 #ifdef __cplusplus
 }
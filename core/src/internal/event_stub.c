@@ -48,6 +48,14 @@ void EventSystem_ReportEvent(EVENTSYSTEM_HANDLE event_system, GATEWAY_HANDLE gw,
     (void)event_type;
 }
 
+void EventSystem_ReportAlert(EVENTSYSTEM_HANDLE event_system, GATEWAY_HANDLE gw, GATEWAY_EVENT event_type, const GATEWAY_ALERT_CONTEXT* alert)
+{
+    (void)event_system;
+    (void)gw;
+    (void)event_type;
+    (void)alert;
+}
+
 void EventSystem_Destroy(EVENTSYSTEM_HANDLE handle)
 {
     if (handle != NULL)
@@ -18,15 +18,15 @@
 #include <stdlib.h>
 
 struct EVENTSYSTEM_DATA {
+    /* Guarded by internal_change_lock, alerts are reported from the broker worker threads */
     VECTOR_HANDLE event_callbacks[GATEWAY_EVENTS_COUNT];
-    /* Should some callback or thread creation fail all next event reports will be no-op */
+    /* Should some callback or thread creation fail all next event reports will be no-op, guarded by internal_change_lock */
     int is_errored;
-    /* @brief Decides whether the thread should have delayed shutdown or not */
-    int delay_when_queue_empty;
+    /* @brief Cleared on destroy, the thread then returns as soon as the queue is empty */
+    int keep_dispatching;
 
+    /* Started with the first event, runs until the event system is destroyed */
     THREAD_HANDLE callback_thread;
-    // The last thread that quit already and needs cleaning up of the handle
-    THREAD_HANDLE destroyed_thread;
     LOCK_HANDLE internal_change_lock;
     LOCK_HANDLE thread_queue_lock;
     COND_HANDLE thread_queue_condition;
@@ -45,19 +45,22 @@ typedef struct THREAD_QUEUE_ROW_TAG {
     GATEWAY_EVENT_CTX context;
 } THREAD_QUEUE_ROW;
 
-/** @brief How long should the thread stay alive before shutting down when the processing queue is empty */
-static const int THREAD_EMPTY_QUEUE_TIMEOUT_MS = 200;
-
 static void destroy_event_system(EVENTSYSTEM_HANDLE handle);
 static void callbacks_call(EVENTSYSTEM_HANDLE event_system, GATEWAY_HANDLE gw, GATEWAY_EVENT event_type, VECTOR_HANDLE callbacks, GATEWAY_EVENT_CTX context);
 static int add_to_thread_queue(EVENTSYSTEM_HANDLE event_system, THREAD_QUEUE_ROW* row);
-static THREAD_QUEUE_ROW* get_from_thread_queue(EVENTSYSTEM_HANDLE event_system, int timeout_ms);
+static THREAD_QUEUE_ROW* get_from_thread_queue(EVENTSYSTEM_HANDLE event_system);
 static void destroy_thread_row(THREAD_QUEUE_ROW* row);
 static int callback_thread_main_func(void* event_system_param);
-static GATEWAY_EVENT_CTX handle_module_list_update(EVENTSYSTEM_HANDLE event_system, GATEWAY_HANDLE gateway, VECTOR_HANDLE callbacks);
+static GATEWAY_EVENT_CTX handle_module_list_update(GATEWAY_HANDLE gateway, VECTOR_HANDLE callbacks, int* failed);
+static GATEWAY_EVENT_CTX handle_alert(const GATEWAY_ALERT_CONTEXT* alert, VECTOR_HANDLE callbacks, int* failed);
+static void set_errored(EVENTSYSTEM_HANDLE event_system);
+static int coalesce_alert(EVENTSYSTEM_HANDLE event_system, GATEWAY_EVENT event_type, const GATEWAY_ALERT_CONTEXT* alert);
+static void report_event(EVENTSYSTEM_HANDLE event_system, GATEWAY_HANDLE gw, GATEWAY_EVENT event_type, const GATEWAY_ALERT_CONTEXT* alert);
 
 /** @brief This function assumes that the context is a #VECTOR_HANDLE and destroys it */
 static void callback_destroy_modulelist(GATEWAY_HANDLE gateway, GATEWAY_EVENT event_type, GATEWAY_EVENT_CTX context, void* user_param);
+/** @brief This function assumes that the context is a copied #GATEWAY_ALERT_CONTEXT and frees it */
+static void callback_destroy_alert(GATEWAY_HANDLE gateway, GATEWAY_EVENT event_type, GATEWAY_EVENT_CTX context, void* user_param);
 
 EVENTSYSTEM_HANDLE EventSystem_Init(void)
 {
@@ -105,7 +108,7 @@ EVENTSYSTEM_HANDLE EventSystem_Init(void)
             /* callback creation might have failed */
             if (result != NULL)
             {
-                result->delay_when_queue_empty = 1;
+                result->keep_dispatching = 1;
 
                 result->thread_queue = singlylinkedlist_create();
                 /* Codes_SRS_EVENTSYSTEM_26_002: [ This function shall return NULL upon any internal error during event system creation. ] */
@@ -135,32 +138,62 @@ void EventSystem_AddEventCallback(EVENTSYSTEM_HANDLE event_system, GATEWAY_EVENT
             callback,
             user_param
         };
+        /* Codes_SRS_EVENTSYSTEM_31_005: [ This function shall register the callback under the lock the events are reported with, so it may be called while events are reported on other threads. ] */
+        Lock(event_system->internal_change_lock);
         if (VECTOR_push_back(event_system->event_callbacks[event_type], &closure, 1) != 0)
         {
             /* Codes_SRS_EVENTSYSTEM_26_013: [ Should the worker thread ever fail to be created or any internall callbacks fail, failure will be logged and no further callbacks will be called during gateway's lifecycle. ] */
             LogError("failed to register callback");
             event_system->is_errored = 1;
         }
+        Unlock(event_system->internal_change_lock);
     }
 }
 
 void EventSystem_ReportEvent(EVENTSYSTEM_HANDLE event_system, GATEWAY_HANDLE gw, GATEWAY_EVENT event_type)
+{
+    report_event(event_system, gw, event_type, NULL);
+}
+
+void EventSystem_ReportAlert(EVENTSYSTEM_HANDLE event_system, GATEWAY_HANDLE gw, GATEWAY_EVENT event_type, const GATEWAY_ALERT_CONTEXT* alert)
+{
+    /* Codes_SRS_EVENTSYSTEM_31_003: [ This function shall do nothing when `alert` is NULL. ] */
+    if (alert == NULL)
+    {
+        LogError("null alert context when reporting event");
+    }
+    else
+    {
+        report_event(event_system, gw, event_type, alert);
+    }
+}
+
+void EventSystem_Destroy(EVENTSYSTEM_HANDLE handle)
+{
+    destroy_event_system(handle);
+}
+
+/*********************
+ * Private functions *
+ *********************/
+
+static void report_event(EVENTSYSTEM_HANDLE event_system, GATEWAY_HANDLE gw, GATEWAY_EVENT event_type, const GATEWAY_ALERT_CONTEXT* alert)
 {
     /* Codes_SRS_EVENTSYSTEM_26_014: [ This function shall do nothing when `event_system` parameter is NULL. ] */
     if (event_system == NULL)
     {
         LogError("null gateway handle or gateway event handle when reporting event");
     }
-    /* Codes_SRS_EVENTSYSTEM_26_013: [ Should the worker thread ever fail to be created or any internall callbacks fail, failure will be logged and no further callbacks will be called during gateway's lifecycle. ] */
-    else if (!event_system->is_errored)
+    /* Codes_SRS_EVENTSYSTEM_31_007: [ An alert of a module still waiting to be dispatched with the same event type shall take the value and threshold of the new alert instead of the new alert being queued, so at most one alert of each type is queued for a module. ] */
+    else if (alert == NULL || !coalesce_alert(event_system, event_type, alert))
     {
-        /* Lock-avoiding mechanism, we get a probably-past state with previous if, then check synchronized state to be sure */
-        int real_is_errored = 0;
+        VECTOR_HANDLE call_queue = NULL;
+
+        /* Codes_SRS_EVENTSYSTEM_31_006: [ This function shall copy the callbacks registered for the event under the lock they are registered with. ] */
         Lock(event_system->internal_change_lock);
-        real_is_errored = event_system->is_errored;
-        Unlock(event_system->internal_change_lock);
-        
-        if (!real_is_errored)
+
+        /* Codes_SRS_EVENTSYSTEM_26_013: [ Should the worker thread ever fail to be created or any internall callbacks fail, failure will be logged and no further callbacks will be called during gateway's lifecycle. ] */
+        if (!event_system->is_errored)
         {
             /* We need to copy the callback queue because the callback might register another function */
             /* Codes_SRS_EVENTSYSTEM_26_007: [ This function shan't call any callbacks registered for any other GATEWAY_EVENT other than the one given as parameter. ] */
@@ -169,54 +202,93 @@ void EventSystem_ReportEvent(EVENTSYSTEM_HANDLE event_system, GATEWAY_HANDLE gw,
 
             if (vector_size > 0)
             {
-                VECTOR_HANDLE call_queue = VECTOR_create(sizeof(CALLBACK_CLOSURE));
+                call_queue = VECTOR_create(sizeof(CALLBACK_CLOSURE));
                 if (call_queue == NULL)
                 {
                     /*Codes_SRS_EVENTSYSTEM_26_013: [ Should the worker thread ever fail to be created or any internall callbacks fail, failure will be logged and no further callbacks will be called during gateway's lifecycle. ] */
                     LogError("Failed to create call queue during event report");
                     event_system->is_errored = 1;
                 }
-                else
+                else if (VECTOR_push_back(call_queue, VECTOR_front(callbacks), vector_size) != 0)
                 {
-                    if (VECTOR_push_back(call_queue, VECTOR_front(callbacks), vector_size) != 0)
-                    {
-                        /*Codes_SRS_EVENTSYSTEM_26_013: [ Should the worker thread ever fail to be created or any internall callbacks fail, failure will be logged and no further callbacks will be called during gateway's lifecycle. ] */
-                        LogError("Failed to copy callback queue during event report");
-                        event_system->is_errored = 1;
-                        VECTOR_destroy(call_queue);
-                    }
-                    else
-                    {
-                        GATEWAY_EVENT_CTX context = NULL;
-                        /* handlers might change event_system->is_errored */
-                        switch (event_type)
-                        {
-                        case GATEWAY_MODULE_LIST_CHANGED:
-                            context = handle_module_list_update(event_system, gw, call_queue);
-                            break;
-                        default:
-                            break;
-                        }
-
-                        if (event_system->is_errored)
-                            VECTOR_destroy(call_queue);
-                        else
-                            callbacks_call(event_system, gw, event_type, call_queue, context);
-                    }
+                    /*Codes_SRS_EVENTSYSTEM_26_013: [ Should the worker thread ever fail to be created or any internall callbacks fail, failure will be logged and no further callbacks will be called during gateway's lifecycle. ] */
+                    LogError("Failed to copy callback queue during event report");
+                    event_system->is_errored = 1;
+                    VECTOR_destroy(call_queue);
+                    call_queue = NULL;
                 }
             }
         }
+
+        Unlock(event_system->internal_change_lock);
+
+        if (call_queue != NULL)
+        {
+            GATEWAY_EVENT_CTX context = NULL;
+            int failed = 0;
+            /* the handlers run outside of the lock, the module list is read from the gateway */
+            switch (event_type)
+            {
+            case GATEWAY_MODULE_LIST_CHANGED:
+                context = handle_module_list_update(gw, call_queue, &failed);
+                break;
+            case GATEWAY_MODULE_INBOX_HIGH_WATERMARK:
+            case GATEWAY_MESSAGE_DROPPED:
+            case GATEWAY_MODULE_RECEIVE_SLOW:
+            case GATEWAY_OUTPROCESS_DETACHED:
+                context = handle_alert(alert, call_queue, &failed);
+                break;
+            default:
+                break;
+            }
+
+            if (failed)
+            {
+                set_errored(event_system);
+                VECTOR_destroy(call_queue);
+            }
+            else
+            {
+                callbacks_call(event_system, gw, event_type, call_queue, context);
+            }
+        }
     }
 }
 
-void EventSystem_Destroy(EVENTSYSTEM_HANDLE handle)
+static void set_errored(EVENTSYSTEM_HANDLE event_system)
 {
-    destroy_event_system(handle);
+    Lock(event_system->internal_change_lock);
+    event_system->is_errored = 1;
+    Unlock(event_system->internal_change_lock);
 }
 
-/*********************
- * Private functions *
- *********************/
+static int coalesce_alert(EVENTSYSTEM_HANDLE event_system, GATEWAY_EVENT event_type, const GATEWAY_ALERT_CONTEXT* alert)
+{
+    int coalesced = 0;
+
+    /* the queue holds at most one alert of each type per module, besides the other events */
+    Lock(event_system->thread_queue_lock);
+
+    LIST_ITEM_HANDLE node = singlylinkedlist_get_head_item(event_system->thread_queue);
+    while (node != NULL)
+    {
+        THREAD_QUEUE_ROW* row = (THREAD_QUEUE_ROW*)singlylinkedlist_item_get_value(node);
+        if (row->event_type == event_type &&
+            ((GATEWAY_ALERT_CONTEXT*)row->context)->module_handle == alert->module_handle)
+        {
+            /* the row leaves the queue under this lock before its callbacks read the context */
+            ((GATEWAY_ALERT_CONTEXT*)row->context)->value = alert->value;
+            ((GATEWAY_ALERT_CONTEXT*)row->context)->threshold = alert->threshold;
+            coalesced = 1;
+            break;
+        }
+        node = singlylinkedlist_get_next_item(node);
+    }
+
+    Unlock(event_system->thread_queue_lock);
+
+    return coalesced;
+}
 
 static void destroy_event_system(EVENTSYSTEM_HANDLE handle)
 {
@@ -229,22 +301,20 @@ static void destroy_event_system(EVENTSYSTEM_HANDLE handle)
             Lock(handle->thread_queue_lock);
 
             /* in case the thread is still running callbacks, notify it that it shouldn't wait for new data later on */
-            handle->delay_when_queue_empty = 0;
+            handle->keep_dispatching = 0;
             /* in case the thread is already waiting and we want it to stop waiting */
             Condition_Post(handle->thread_queue_condition);
 
             Unlock(handle->thread_queue_lock);
         }
 
-        THREAD_HANDLE callback_thread = NULL, destroyed_thread = NULL;
+        THREAD_HANDLE callback_thread = NULL;
         if (handle->internal_change_lock != NULL)
         {
-            // The thread might be running, we want to wait for it to finish, but it might be moving the handles
-            // So we need to have a copy of those
+            // An event reported on another thread might be starting the thread
             Lock(handle->internal_change_lock);
 
             callback_thread = handle->callback_thread;
-            destroyed_thread = handle->destroyed_thread;
 
             Unlock(handle->internal_change_lock);
         }
@@ -253,8 +323,6 @@ static void destroy_event_system(EVENTSYSTEM_HANDLE handle)
         /* Codes_SRS_EVENTSYSTEM_26_005: [ This function shall wait for all callbacks to finish before returning. ] */
         if (callback_thread != NULL)
             ThreadAPI_Join(callback_thread, &thread_res);
-        if (destroyed_thread != NULL)
-            ThreadAPI_Join(destroyed_thread, &thread_res);
         /* Codes_SRS_EVENTSYSTEM_26_003: [ This function shall destroy and free resources of the given event system. ] */
         Condition_Deinit(handle->thread_queue_condition);
         Lock_Deinit(handle->thread_queue_lock);
@@ -299,14 +367,6 @@ static void callbacks_call(EVENTSYSTEM_HANDLE event_system, GATEWAY_HANDLE gw, G
 
     Lock(event_system->internal_change_lock);
 
-    // There's a thread to cleanup that was destroyed but has a floating handle
-    if (event_system->destroyed_thread != NULL)
-    {
-        int res;
-        ThreadAPI_Join(event_system->destroyed_thread, &res);
-        event_system->destroyed_thread = NULL;
-    }
-
     /* Codes_SRS_EVENTSYSTEM_26_013: [ Should the worker thread ever fail to be created or any internall callbacks fail, failure will be logged and no further callbacks will be called during gateway's lifecycle. ] */
     if (row == NULL)
     {
@@ -315,6 +375,7 @@ static void callbacks_call(EVENTSYSTEM_HANDLE event_system, GATEWAY_HANDLE gw, G
     else if (event_system->callback_thread == NULL)
     {
         /* Codes_SRS_EVENTSYSTEM_26_008: [ This function shall call all registered callbacks on a seperate thread. ] */
+        /* Codes_SRS_EVENTSYSTEM_31_001: [ The thread shall be created with the first event reported and shall keep waiting for the next events until the event system is destroyed. ] */
         THREADAPI_RESULT result = ThreadAPI_Create(&event_system->callback_thread, callback_thread_main_func, (void*)event_system);
         /* Codes_SRS_EVENTSYSTEM_26_013: [ Should the worker thread ever fail to be created or any internall callbacks fail, failure will be logged and no further callbacks will be called during gateway's lifecycle. ] */
         /* Stuff on the queue will be deleted when destroying EventSystem */
@@ -337,20 +398,28 @@ static int add_to_thread_queue(EVENTSYSTEM_HANDLE event_system, THREAD_QUEUE_ROW
     return errored;
 }
 
-static THREAD_QUEUE_ROW* get_from_thread_queue(EVENTSYSTEM_HANDLE event_system, int timeout_ms)
+static THREAD_QUEUE_ROW* get_from_thread_queue(EVENTSYSTEM_HANDLE event_system)
 {
     THREAD_QUEUE_ROW* row = NULL;
+    int has_failed = 0;
     
     Lock(event_system->thread_queue_lock);
     
     LIST_ITEM_HANDLE node = singlylinkedlist_get_head_item(event_system->thread_queue);
-    if (node == NULL && event_system->delay_when_queue_empty)
+    /* Codes_SRS_EVENTSYSTEM_31_001: [ The thread shall be created with the first event reported and shall keep waiting for the next events until the event system is destroyed. ] */
+    while (node == NULL && event_system->keep_dispatching)
     {
-        Condition_Wait(event_system->thread_queue_condition, event_system->thread_queue_lock, timeout_ms);
+        /* no timeout, the condition is posted for each event and on destroy */
+        COND_RESULT wait_result = Condition_Wait(event_system->thread_queue_condition, event_system->thread_queue_lock, 0);
+        if (wait_result != COND_OK && wait_result != COND_TIMEOUT)
+        {
+            has_failed = 1;
+            break;
+        }
         node = singlylinkedlist_get_head_item(event_system->thread_queue);
     }
 
-    /* Condition might have timed out or we don't have delayed destroy so the node can be NULL */
+    /* The wait might have failed or the event system is destroyed so the node can be NULL */
     if (node != NULL)
     {
         row = (THREAD_QUEUE_ROW*)singlylinkedlist_item_get_value(node);
@@ -358,6 +427,13 @@ static THREAD_QUEUE_ROW* get_from_thread_queue(EVENTSYSTEM_HANDLE event_system,
     }
     
     Unlock(event_system->thread_queue_lock);
+
+    if (has_failed)
+    {
+        /* Codes_SRS_EVENTSYSTEM_31_002: [ Should waiting for the next event fail, the thread shall return and no further callbacks will be called during gateway's lifecycle. ] */
+        LogError("failed to wait for the next gateway event");
+        set_errored(event_system);
+    }
     
     return row;
 }
@@ -373,7 +449,7 @@ static int callback_thread_main_func(void* event_system_param)
 {
     EVENTSYSTEM_HANDLE event_system = (EVENTSYSTEM_HANDLE)event_system_param;
     THREAD_QUEUE_ROW* row;
-    while ((row = get_from_thread_queue(event_system, THREAD_EMPTY_QUEUE_TIMEOUT_MS)) != NULL)
+    while ((row = get_from_thread_queue(event_system)) != NULL)
     {
         size_t vector_size = VECTOR_size(row->callbacks);
         /* Codes_SRS_EVENTSYSTEM_26_006: [ This function shall call all registered callbacks for the given GATEWAY_EVENT. ] */
@@ -387,23 +463,17 @@ static int callback_thread_main_func(void* event_system_param)
         destroy_thread_row(row);
     }
 
-    Lock(event_system->internal_change_lock);
-
-    event_system->destroyed_thread = event_system->callback_thread;
-    event_system->callback_thread = NULL;
-
-    Unlock(event_system->internal_change_lock);
-
+    /* the handle is joined by EventSystem_Destroy */
     return THREADAPI_OK;
 }
 
-static GATEWAY_EVENT_CTX handle_module_list_update(EVENTSYSTEM_HANDLE event_system, GATEWAY_HANDLE gateway, VECTOR_HANDLE callbacks)
+static GATEWAY_EVENT_CTX handle_module_list_update(GATEWAY_HANDLE gateway, VECTOR_HANDLE callbacks, int* failed)
 {
     /* Codes_SRS_EVENTSYSTEM_26_016: [ This event shall provide `VECTOR_HANDLE` as returned from #Gateway_GetModuleList as the event context in callbacks ] */
     VECTOR_HANDLE modules = Gateway_GetModuleList(gateway);
     if (modules == NULL)
     {
-        event_system->is_errored = 1;
+        *failed = 1;
     }
     else
     {
@@ -416,7 +486,7 @@ static GATEWAY_EVENT_CTX handle_module_list_update(EVENTSYSTEM_HANDLE event_syst
         {
             LogError("Failed to push back during handling module list updated event");
             VECTOR_destroy(modules);
-            event_system->is_errored = 1;
+            *failed = 1;
             modules = NULL;
         }
     }
@@ -430,4 +500,44 @@ static void callback_destroy_modulelist(GATEWAY_HANDLE gateway, GATEWAY_EVENT ev
     (void)event_type;
     (void)user_param;
     Gateway_DestroyModuleList((VECTOR_HANDLE)context);
-}
\ No newline at end of file
+}
+
+static GATEWAY_EVENT_CTX handle_alert(const GATEWAY_ALERT_CONTEXT* alert, VECTOR_HANDLE callbacks, int* failed)
+{
+    GATEWAY_ALERT_CONTEXT* copy = NULL;
+    /* reported with EventSystem_ReportEvent, the callbacks get no context */
+    if (alert != NULL)
+    {
+        /* Codes_SRS_EVENTSYSTEM_31_004: [ The alert events shall provide a copy of the `GATEWAY_ALERT_CONTEXT` given to #EventSystem_ReportAlert as the event context in callbacks, and free it after finishing all the callbacks. ] */
+        copy = (GATEWAY_ALERT_CONTEXT*)malloc(sizeof(GATEWAY_ALERT_CONTEXT));
+        if (copy == NULL)
+        {
+            LogError("Failed to copy the alert context");
+            *failed = 1;
+        }
+        else
+        {
+            CALLBACK_CLOSURE closure = {
+                callback_destroy_alert,
+                NULL
+            };
+            *copy = *alert;
+            if (VECTOR_push_back(callbacks, &closure, 1) != 0)
+            {
+                LogError("Failed to push back during handling an alert event");
+                free(copy);
+                *failed = 1;
+                copy = NULL;
+            }
+        }
+    }
+    return copy;
+}
+
+static void callback_destroy_alert(GATEWAY_HANDLE gateway, GATEWAY_EVENT event_type, GATEWAY_EVENT_CTX context, void* user_param)
+{
+    (void)gateway;
+    (void)event_type;
+    (void)user_param;
+    free(context);
+}
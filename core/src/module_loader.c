@@ -16,6 +16,7 @@
 #include "module.h"
 #include "module_loader.h"
 #include "module_loaders/dynamic_loader.h"
+#include "module_loaders/builtin_loader.h"
 
 #ifdef OUTPROCESS_ENABLED
 #include "module_loaders/outprocess_loader.h"
@@ -90,6 +91,7 @@ MODULE_LOADER_RESULT ModuleLoader_Initialize(void)
                 const MODULE_LOADER* supported_loaders[] =
                 {
                     DynamicLoader_Get()
+                    , BuiltinLoader_Get()
 #ifdef NODE_BINDING_ENABLED
                     , NodeLoader_Get()
 #endif
@@ -583,8 +585,10 @@ MODULE_LOADER_TYPE ModuleLoader_ParseType(const char* type)
 
 bool ModuleLoader_IsDefaultLoader(const char* name)
 {
-    /*Codes_SRS_MODULE_LOADER_13_061: [ ModuleLoader_IsDefaultLoader shall return true if name is the name of a default module loader and false otherwise. The default module loader names are 'native', 'node', 'java' , 'dotnet' and 'dotnetcore'. ]*/
+    /*Codes_SRS_MODULE_LOADER_13_061: [ ModuleLoader_IsDefaultLoader shall return true if name is the name of a default module loader and false otherwise. The default module loader names are 'native', 'builtin', 'node', 'java' , 'dotnet' and 'dotnetcore'. ]*/
     return strcmp(name, DYNAMIC_LOADER_NAME) == 0
+           ||
+           strcmp(name, BUILTIN_LOADER_NAME) == 0
            ||
            strcmp(name, "outprocess") == 0
            ||
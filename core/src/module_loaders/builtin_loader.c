@@ -0,0 +1,315 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdlib.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include <string.h>
+
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/vector.h"
+#include "parson.h"
+
+#include "module.h"
+#include "module_access.h"
+#include "module_loader.h"
+#include "module_loaders/builtin_loader.h"
+
+typedef struct BUILTIN_MODULE_TAG
+{
+    const char* name;
+    pfModule_GetApi module_get_api;
+} BUILTIN_MODULE;
+
+// The modules linked into the program, created on the first registration.
+static VECTOR_HANDLE g_builtin_modules = NULL;
+
+static bool builtin_module_name_find(const void* element, const void* name)
+{
+    return strcmp(((const BUILTIN_MODULE*)element)->name, (const char*)name) == 0;
+}
+
+static BUILTIN_MODULE* find_builtin_module(const char* name)
+{
+    return g_builtin_modules == NULL ? NULL :
+        (BUILTIN_MODULE*)VECTOR_find_if(g_builtin_modules, builtin_module_name_find, name);
+}
+
+MODULE_LOADER_RESULT BuiltinLoader_RegisterModule(const char* name, pfModule_GetApi module_get_api)
+{
+    MODULE_LOADER_RESULT result;
+
+    if (name == NULL || module_get_api == NULL)
+    {
+        //Codes_SRS_BUILTIN_MODULE_LOADER_31_001: [ BuiltinLoader_RegisterModule shall return MODULE_LOADER_ERROR if name or module_get_api is NULL. ]
+        LogError("invalid input - name = %p, module_get_api = %p", name, module_get_api);
+        result = MODULE_LOADER_ERROR;
+    }
+    else if (find_builtin_module(name) != NULL)
+    {
+        //Codes_SRS_BUILTIN_MODULE_LOADER_31_002: [ BuiltinLoader_RegisterModule shall return MODULE_LOADER_ERROR if a module is already registered with name. ]
+        LogError("module %s is already registered", name);
+        result = MODULE_LOADER_ERROR;
+    }
+    else
+    {
+        BUILTIN_MODULE module = { name, module_get_api };
+        bool created = false;
+
+        //Codes_SRS_BUILTIN_MODULE_LOADER_31_003: [ BuiltinLoader_RegisterModule shall create the table of registered modules if it does not exist. ]
+        if (g_builtin_modules == NULL)
+        {
+            g_builtin_modules = VECTOR_create(sizeof(BUILTIN_MODULE));
+            created = true;
+        }
+
+        if (g_builtin_modules == NULL)
+        {
+            //Codes_SRS_BUILTIN_MODULE_LOADER_31_004: [ BuiltinLoader_RegisterModule shall return MODULE_LOADER_ERROR if an underlying platform call fails. ]
+            LogError("VECTOR_create failed");
+            result = MODULE_LOADER_ERROR;
+        }
+        else if (VECTOR_push_back(g_builtin_modules, &module, 1) != 0)
+        {
+            //Codes_SRS_BUILTIN_MODULE_LOADER_31_004: [ BuiltinLoader_RegisterModule shall return MODULE_LOADER_ERROR if an underlying platform call fails. ]
+            LogError("VECTOR_push_back failed for module %s", name);
+            if (created)
+            {
+                VECTOR_destroy(g_builtin_modules);
+                g_builtin_modules = NULL;
+            }
+            result = MODULE_LOADER_ERROR;
+        }
+        else
+        {
+            //Codes_SRS_BUILTIN_MODULE_LOADER_31_005: [ BuiltinLoader_RegisterModule shall add name and module_get_api to the table and return MODULE_LOADER_SUCCESS. ]
+            result = MODULE_LOADER_SUCCESS;
+        }
+    }
+
+    return result;
+}
+
+void BuiltinLoader_UnregisterModule(const char* name)
+{
+    BUILTIN_MODULE* module = name == NULL ? NULL : find_builtin_module(name);
+    if (module == NULL)
+    {
+        //Codes_SRS_BUILTIN_MODULE_LOADER_31_006: [ BuiltinLoader_UnregisterModule shall do nothing if no module is registered with name. ]
+        LogError("module %s is not registered", name == NULL ? "NULL" : name);
+    }
+    else
+    {
+        //Codes_SRS_BUILTIN_MODULE_LOADER_31_007: [ BuiltinLoader_UnregisterModule shall remove the module from the table, and destroy the table once it is empty. ]
+        VECTOR_erase(g_builtin_modules, module, 1);
+        if (VECTOR_size(g_builtin_modules) == 0)
+        {
+            VECTOR_destroy(g_builtin_modules);
+            g_builtin_modules = NULL;
+        }
+    }
+}
+
+static MODULE_LIBRARY_HANDLE BuiltinModuleLoader_Load(const MODULE_LOADER* loader, const void* entrypoint)
+{
+    const MODULE_API* result;
+
+    if (loader == NULL || entrypoint == NULL)
+    {
+        //Codes_SRS_BUILTIN_MODULE_LOADER_31_008: [ BuiltinModuleLoader_Load shall return NULL if loader or entrypoint is NULL. ]
+        result = NULL;
+        LogError(
+            "invalid input - loader = %p, entrypoint = %p",
+            loader, entrypoint
+        );
+    }
+    else if (loader->type != NATIVE)
+    {
+        //Codes_SRS_BUILTIN_MODULE_LOADER_31_009: [ BuiltinModuleLoader_Load shall return NULL if loader->type is not NATIVE. ]
+        result = NULL;
+        LogError("loader->type is not NATIVE");
+    }
+    else
+    {
+        const BUILTIN_LOADER_ENTRYPOINT* builtin_loader_entrypoint = (const BUILTIN_LOADER_ENTRYPOINT*)entrypoint;
+        const char* module_name = builtin_loader_entrypoint->moduleName == NULL ? NULL :
+            STRING_c_str(builtin_loader_entrypoint->moduleName);
+        const BUILTIN_MODULE* module = module_name == NULL ? NULL : find_builtin_module(module_name);
+        if (module == NULL)
+        {
+            //Codes_SRS_BUILTIN_MODULE_LOADER_31_010: [ BuiltinModuleLoader_Load shall return NULL if no module is registered with entrypoint->moduleName. ]
+            result = NULL;
+            LogError("no module is registered as %s", module_name == NULL ? "NULL" : module_name);
+        }
+        else
+        {
+            //Codes_SRS_BUILTIN_MODULE_LOADER_31_011: [ BuiltinModuleLoader_Load shall call the registered module_get_api to acquire the module API table, without loading a library. ]
+            result = module->module_get_api(Module_ApiGatewayVersion);
+
+            /* if any of the required functions is NULL then we have a misbehaving module */
+            if (result == NULL ||
+                result->version > Module_ApiGatewayVersion ||
+                MODULE_CREATE(result) == NULL ||
+                MODULE_DESTROY(result) == NULL ||
+                MODULE_RECEIVE(result) == NULL)
+            {
+                //Codes_SRS_BUILTIN_MODULE_LOADER_31_012: [ BuiltinModuleLoader_Load shall return NULL if the MODULE_API is NULL, newer than Module_ApiGatewayVersion, or lacks Module_Create, Module_Destroy or Module_Receive. ]
+                result = NULL;
+                LogError("module %s does not have a valid MODULE_API", module_name);
+            }
+        }
+    }
+
+    //Codes_SRS_BUILTIN_MODULE_LOADER_31_013: [ BuiltinModuleLoader_Load shall return the MODULE_API as the MODULE_LIBRARY_HANDLE when successful. ]
+    return (MODULE_LIBRARY_HANDLE)result;
+}
+
+static const MODULE_API* BuiltinModuleLoader_GetModuleApi(const MODULE_LOADER* loader, MODULE_LIBRARY_HANDLE moduleLibraryHandle)
+{
+    (void)loader;
+
+    //Codes_SRS_BUILTIN_MODULE_LOADER_31_014: [ BuiltinModuleLoader_GetModuleApi shall return moduleLibraryHandle, which is NULL or the MODULE_API of the module. ]
+    return (const MODULE_API*)moduleLibraryHandle;
+}
+
+static void BuiltinModuleLoader_Unload(const MODULE_LOADER* loader, MODULE_LIBRARY_HANDLE moduleLibraryHandle)
+{
+    (void)loader;
+    (void)moduleLibraryHandle;
+
+    /**
+     * The module stays linked into the program.
+     */
+    //Codes_SRS_BUILTIN_MODULE_LOADER_31_015: [ BuiltinModuleLoader_Unload shall do nothing. ]
+}
+
+static void* BuiltinModuleLoader_ParseEntrypointFromJson(const MODULE_LOADER* loader, const JSON_Value* json)
+{
+    (void)loader;
+    // The input is a JSON object that looks like this:
+    //  "entrypoint": {
+    //      "module.name": "registered name"
+    //  }
+    BUILTIN_LOADER_ENTRYPOINT* config;
+    const char* moduleName;
+
+    if (json == NULL || json_value_get_type(json) != JSONObject)
+    {
+        //Codes_SRS_BUILTIN_MODULE_LOADER_31_016: [ BuiltinModuleLoader_ParseEntrypointFromJson shall return NULL if json is NULL or not an object. ]
+        LogError("json is NULL or not an object value");
+        config = NULL;
+    }
+    //Codes_SRS_BUILTIN_MODULE_LOADER_31_017: [ BuiltinModuleLoader_ParseEntrypointFromJson shall return NULL if module.name does not exist. ]
+    else if ((moduleName = json_object_get_string(json_value_get_object(json), "module.name")) == NULL)
+    {
+        LogError("json_object_get_string for 'module.name' returned NULL");
+        config = NULL;
+    }
+    else
+    {
+        config = (BUILTIN_LOADER_ENTRYPOINT*)malloc(sizeof(BUILTIN_LOADER_ENTRYPOINT));
+        if (config == NULL)
+        {
+            //Codes_SRS_BUILTIN_MODULE_LOADER_31_018: [ BuiltinModuleLoader_ParseEntrypointFromJson shall return NULL if an underlying platform call fails. ]
+            LogError("malloc failed");
+        }
+        else
+        {
+            //Codes_SRS_BUILTIN_MODULE_LOADER_31_019: [ BuiltinModuleLoader_ParseEntrypointFromJson shall return an entrypoint holding a copy of module.name. ]
+            config->moduleName = STRING_construct(moduleName);
+            if (config->moduleName == NULL)
+            {
+                //Codes_SRS_BUILTIN_MODULE_LOADER_31_018: [ BuiltinModuleLoader_ParseEntrypointFromJson shall return NULL if an underlying platform call fails. ]
+                LogError("STRING_construct failed");
+                free(config);
+                config = NULL;
+            }
+        }
+    }
+
+    return (void*)config;
+}
+
+static void BuiltinModuleLoader_FreeEntrypoint(const MODULE_LOADER* loader, void* entrypoint)
+{
+    (void)loader;
+
+    if (entrypoint != NULL)
+    {
+        //Codes_SRS_BUILTIN_MODULE_LOADER_31_020: [ BuiltinModuleLoader_FreeEntrypoint shall free resources allocated during BuiltinModuleLoader_ParseEntrypointFromJson. ]
+        BUILTIN_LOADER_ENTRYPOINT* ep = (BUILTIN_LOADER_ENTRYPOINT*)entrypoint;
+        STRING_delete(ep->moduleName);
+        free(ep);
+    }
+    else
+    {
+        //Codes_SRS_BUILTIN_MODULE_LOADER_31_021: [ BuiltinModuleLoader_FreeEntrypoint shall do nothing if entrypoint is NULL. ]
+        LogError("entrypoint is NULL");
+    }
+}
+
+static MODULE_LOADER_BASE_CONFIGURATION* BuiltinModuleLoader_ParseConfigurationFromJson(const MODULE_LOADER* loader, const JSON_Value* json)
+{
+    (void)loader;
+    (void)json;
+
+    //Codes_SRS_BUILTIN_MODULE_LOADER_31_022: [ BuiltinModuleLoader_ParseConfigurationFromJson shall return NULL. ]
+    return NULL;
+}
+
+static void BuiltinModuleLoader_FreeConfiguration(const MODULE_LOADER* loader, MODULE_LOADER_BASE_CONFIGURATION* configuration)
+{
+    (void)loader;
+    (void)configuration;
+
+    //Codes_SRS_BUILTIN_MODULE_LOADER_31_023: [ BuiltinModuleLoader_FreeConfiguration shall do nothing. ]
+}
+
+static void* BuiltinModuleLoader_BuildModuleConfiguration(
+    const MODULE_LOADER* loader,
+    const void* entrypoint,
+    const void* module_configuration
+)
+{
+    (void)loader;
+    (void)entrypoint;
+
+    //Codes_SRS_BUILTIN_MODULE_LOADER_31_024: [ BuiltinModuleLoader_BuildModuleConfiguration shall return module_configuration. ]
+    return (void *)module_configuration;
+}
+
+static void BuiltinModuleLoader_FreeModuleConfiguration(const MODULE_LOADER* loader, const void* module_configuration)
+{
+    (void)loader;
+    (void)module_configuration;
+
+    //Codes_SRS_BUILTIN_MODULE_LOADER_31_025: [ BuiltinModuleLoader_FreeModuleConfiguration shall do nothing. ]
+}
+
+static MODULE_LOADER_API Builtin_Module_Loader_API =
+{
+    .Load = BuiltinModuleLoader_Load,
+    .Unload = BuiltinModuleLoader_Unload,
+    .GetApi = BuiltinModuleLoader_GetModuleApi,
+
+    .ParseEntrypointFromJson = BuiltinModuleLoader_ParseEntrypointFromJson,
+    .FreeEntrypoint = BuiltinModuleLoader_FreeEntrypoint,
+
+    .ParseConfigurationFromJson = BuiltinModuleLoader_ParseConfigurationFromJson,
+    .FreeConfiguration = BuiltinModuleLoader_FreeConfiguration,
+
+    .BuildModuleConfiguration = BuiltinModuleLoader_BuildModuleConfiguration,
+    .FreeModuleConfiguration = BuiltinModuleLoader_FreeModuleConfiguration
+};
+
+static MODULE_LOADER Builtin_Module_Loader =
+{
+    NATIVE,
+    BUILTIN_LOADER_NAME,
+    NULL,
+    &Builtin_Module_Loader_API
+};
+
+const MODULE_LOADER* BuiltinLoader_Get(void)
+{
+    //Codes_SRS_BUILTIN_MODULE_LOADER_31_026: [ BuiltinLoader_Get shall return a non-NULL pointer to a NATIVE MODULE_LOADER named builtin. ]
+    return &Builtin_Module_Loader;
+}
@@ -0,0 +1,619 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdlib.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include <stdbool.h>
+
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/tickcounter.h"
+#include "parson.h"
+
+#include "module.h"
+#include "module_access.h"
+#include "module_loader.h"
+#include "broker.h"
+#include "module_loaders/lazy_loader.h"
+
+/* how often an active module checks for idleness, at most */
+#define LAZY_IDLE_POLL_MS 100
+
+typedef struct LAZY_MODULE_CONFIGURATION_TAG
+{
+    const LAZY_LOADER_ENTRYPOINT* entrypoint;
+    const char* configuration;
+}LAZY_MODULE_CONFIGURATION;
+
+/* a module created by the stand-in, from its library */
+typedef struct LAZY_MODULE_INSTANCE_TAG
+{
+    void* entrypoint;
+    MODULE_LIBRARY_HANDLE library;
+    const MODULE_API* module_apis;
+    MODULE_HANDLE module_handle;
+}LAZY_MODULE_INSTANCE;
+
+typedef struct LAZY_MODULE_HANDLE_DATA_TAG
+{
+    BROKER_HANDLE broker;
+    /* the stand-in as attached to the broker, the module publishes in its name */
+    MODULE module;
+    const MODULE_LOADER* loader;
+    JSON_Value* entrypoint_json;
+    char* configuration;
+    unsigned int idle_timeout;
+    TICK_COUNTER_HANDLE tick_counter;
+    LOCK_HANDLE lock;
+    bool started;
+    bool quit;
+    /* the module, its module_handle is NULL while it is not active */
+    LAZY_MODULE_INSTANCE active;
+    tickcounter_ms_t last_message;
+    /* the idle watcher of the active module */
+    THREAD_HANDLE idle_thread;
+    /* the idle watcher of a former activation, joined by the next watcher */
+    THREAD_HANDLE exited_idle_thread;
+}LAZY_MODULE_HANDLE_DATA;
+
+static const MODULE_API_1 LazyModule_Api;
+
+static void release_instance(LAZY_MODULE_HANDLE_DATA* lazy, LAZY_MODULE_INSTANCE* instance)
+{
+    //Codes_SRS_LAZY_LOADER_31_021: [ To deactivate the module, the stand-in shall remove the module handle alias from the broker, destroy the module, unload its library and free its entrypoint. ]
+    if (Broker_RemoveModuleAlias(lazy->broker, instance->module_handle) != BROKER_OK)
+    {
+        LogError("unable to remove the broker alias of the lazy module");
+    }
+    MODULE_DESTROY(instance->module_apis)(instance->module_handle);
+    lazy->loader->api->Unload(lazy->loader, instance->library);
+    if (instance->entrypoint != NULL)
+    {
+        lazy->loader->api->FreeEntrypoint(lazy->loader, instance->entrypoint);
+    }
+}
+
+static int idle_worker(void* context)
+{
+    LAZY_MODULE_HANDLE_DATA* lazy = (LAZY_MODULE_HANDLE_DATA*)context;
+    unsigned int poll_interval = lazy->idle_timeout < LAZY_IDLE_POLL_MS ? lazy->idle_timeout : LAZY_IDLE_POLL_MS;
+    THREAD_HANDLE exited_idle_thread = NULL;
+    LAZY_MODULE_INSTANCE idle_instance = { NULL, NULL, NULL, NULL };
+    bool should_continue = true;
+    int thread_result;
+
+    if (Lock(lazy->lock) != LOCK_OK)
+    {
+        LogError("unable to lock the lazy module");
+        should_continue = false;
+    }
+    else
+    {
+        exited_idle_thread = lazy->exited_idle_thread;
+        lazy->exited_idle_thread = NULL;
+        (void)Unlock(lazy->lock);
+    }
+
+    if (exited_idle_thread != NULL)
+    {
+        (void)ThreadAPI_Join(exited_idle_thread, &thread_result);
+    }
+
+    while (should_continue)
+    {
+        ThreadAPI_Sleep(poll_interval);
+        if (Lock(lazy->lock) != LOCK_OK)
+        {
+            LogError("unable to lock the lazy module");
+            should_continue = false;
+        }
+        else
+        {
+            tickcounter_ms_t now;
+            if (lazy->quit)
+            {
+                should_continue = false;
+            }
+            //Codes_SRS_LAZY_LOADER_31_020: [ Once no message reached the module for `idle_timeout` milliseconds, the idle watcher shall deactivate the module and exit. ]
+            else if (tickcounter_get_current_ms(lazy->tick_counter, &now) == 0 &&
+                now - lazy->last_message >= lazy->idle_timeout)
+            {
+                /* the next message creates the module again, while this one is released outside the lock */
+                idle_instance = lazy->active;
+                lazy->active.module_handle = NULL;
+                should_continue = false;
+            }
+            (void)Unlock(lazy->lock);
+        }
+    }
+
+    if (idle_instance.module_handle != NULL)
+    {
+        release_instance(lazy, &idle_instance);
+    }
+
+    return 0;
+}
+
+static void start_idle_watcher(LAZY_MODULE_HANDLE_DATA* lazy)
+{
+    /* the watcher of the former activation exits, or exited already */
+    if (lazy->idle_thread != NULL)
+    {
+        lazy->exited_idle_thread = lazy->idle_thread;
+        lazy->idle_thread = NULL;
+    }
+
+    //Codes_SRS_LAZY_LOADER_31_019: [ If `idle_timeout` is not 0, the stand-in shall start an idle watcher thread for as long as the module is active. ]
+    if (ThreadAPI_Create(&lazy->idle_thread, idle_worker, lazy) != THREADAPI_OK)
+    {
+        /* the module stays active, as if it had no idle timeout */
+        LogError("unable to start the idle watcher of the lazy module");
+        lazy->idle_thread = NULL;
+    }
+}
+
+static int activate_module(LAZY_MODULE_HANDLE_DATA* lazy)
+{
+    int result;
+    const MODULE_LOADER* loader = lazy->loader;
+    LAZY_MODULE_INSTANCE instance;
+
+    //Codes_SRS_LAZY_LOADER_31_014: [ To activate the module, the stand-in shall parse the module entrypoint with the module loader, load the module library and get its `MODULE_API`. ]
+    instance.entrypoint = lazy->entrypoint_json == NULL ? NULL :
+        loader->api->ParseEntrypointFromJson(loader, lazy->entrypoint_json);
+    if (lazy->entrypoint_json != NULL && instance.entrypoint == NULL)
+    {
+        //Codes_SRS_LAZY_LOADER_31_018: [ If the module cannot be activated, the stand-in shall release what it acquired and drop the message. ]
+        LogError("unable to parse the entrypoint of the lazy module");
+        result = __LINE__;
+    }
+    else if ((instance.library = loader->api->Load(loader, instance.entrypoint)) == NULL)
+    {
+        //Codes_SRS_LAZY_LOADER_31_018: [ If the module cannot be activated, the stand-in shall release what it acquired and drop the message. ]
+        LogError("unable to load the lazy module");
+        if (instance.entrypoint != NULL)
+        {
+            loader->api->FreeEntrypoint(loader, instance.entrypoint);
+        }
+        result = __LINE__;
+    }
+    else
+    {
+        instance.module_apis = loader->api->GetApi(loader, instance.library);
+
+        //Codes_SRS_LAZY_LOADER_31_015: [ The stand-in shall create the module from its JSON configuration the way the gateway creates modules, then free the configurations. ]
+        void* module_configuration = MODULE_PARSE_CONFIGURATION_FROM_JSON(instance.module_apis)(lazy->configuration);
+        void* transformed_configuration = loader->api->BuildModuleConfiguration(loader, instance.entrypoint, module_configuration);
+        instance.module_handle = MODULE_CREATE(instance.module_apis)(lazy->broker, transformed_configuration);
+        MODULE_FREE_CONFIGURATION(instance.module_apis)(module_configuration);
+        loader->api->FreeModuleConfiguration(loader, transformed_configuration);
+
+        if (instance.module_handle == NULL)
+        {
+            //Codes_SRS_LAZY_LOADER_31_018: [ If the module cannot be activated, the stand-in shall release what it acquired and drop the message. ]
+            LogError("unable to create the lazy module");
+            result = __LINE__;
+        }
+        //Codes_SRS_LAZY_LOADER_31_016: [ The stand-in shall make the module handle an alias of the stand-in on the broker, so the messages the module publishes follow the links of the stand-in. ]
+        else if (Broker_AddModuleAlias(lazy->broker, &lazy->module, instance.module_handle) != BROKER_OK)
+        {
+            //Codes_SRS_LAZY_LOADER_31_018: [ If the module cannot be activated, the stand-in shall release what it acquired and drop the message. ]
+            LogError("unable to route the messages of the lazy module");
+            MODULE_DESTROY(instance.module_apis)(instance.module_handle);
+            result = __LINE__;
+        }
+        else
+        {
+            lazy->active = instance;
+            //Codes_SRS_LAZY_LOADER_31_017: [ If the stand-in was started, the stand-in shall start the module. ]
+            if (lazy->started && MODULE_START(instance.module_apis) != NULL)
+            {
+                MODULE_START(instance.module_apis)(instance.module_handle);
+            }
+            if (lazy->idle_timeout != 0)
+            {
+                start_idle_watcher(lazy);
+            }
+            result = 0;
+        }
+
+        if (result != 0)
+        {
+            loader->api->Unload(loader, instance.library);
+            if (instance.entrypoint != NULL)
+            {
+                loader->api->FreeEntrypoint(loader, instance.entrypoint);
+            }
+        }
+    }
+
+    return result;
+}
+
+static void* LazyModule_ParseConfigurationFromJson(const char* configuration)
+{
+    //Codes_SRS_LAZY_LOADER_31_008: [ `LazyModule_ParseConfigurationFromJson` shall return `configuration`, the module parses it when it is created. ]
+    return (void*)configuration;
+}
+
+static void LazyModule_FreeConfiguration(void* configuration)
+{
+    //Codes_SRS_LAZY_LOADER_31_009: [ `LazyModule_FreeConfiguration` shall do nothing. ]
+    (void)configuration;
+}
+
+static MODULE_HANDLE LazyModule_Create(BROKER_HANDLE broker, const void* configuration)
+{
+    LAZY_MODULE_HANDLE_DATA* result;
+    const LAZY_MODULE_CONFIGURATION* lazy_configuration = (const LAZY_MODULE_CONFIGURATION*)configuration;
+
+    if (broker == NULL || lazy_configuration == NULL || lazy_configuration->entrypoint == NULL)
+    {
+        //Codes_SRS_LAZY_LOADER_31_010: [ `LazyModule_Create` shall return `NULL` if `broker` or `configuration` is `NULL`. ]
+        result = NULL;
+        LogError("invalid input - broker = %p, configuration = %p", broker, configuration);
+    }
+    //Codes_SRS_LAZY_LOADER_31_011: [ `LazyModule_Create` shall copy the module entrypoint JSON and JSON configuration, and create a tick counter and a lock, without loading the module. ]
+    else if ((result = (LAZY_MODULE_HANDLE_DATA*)malloc(sizeof(LAZY_MODULE_HANDLE_DATA))) == NULL)
+    {
+        //Codes_SRS_LAZY_LOADER_31_012: [ `LazyModule_Create` shall return `NULL` if an underlying API call fails. ]
+        LogError("malloc(sizeof(LAZY_MODULE_HANDLE_DATA)) failed");
+    }
+    else
+    {
+        const LAZY_LOADER_ENTRYPOINT* entrypoint = lazy_configuration->entrypoint;
+        result->configuration = NULL;
+        result->entrypoint_json = entrypoint->entrypoint == NULL ? NULL : json_value_deep_copy(entrypoint->entrypoint);
+        if ((entrypoint->entrypoint != NULL && result->entrypoint_json == NULL) ||
+            (lazy_configuration->configuration != NULL && mallocAndStrcpy_s(&result->configuration, lazy_configuration->configuration) != 0))
+        {
+            //Codes_SRS_LAZY_LOADER_31_012: [ `LazyModule_Create` shall return `NULL` if an underlying API call fails. ]
+            LogError("unable to copy the lazy module entrypoint or configuration");
+            if (result->entrypoint_json != NULL)
+            {
+                json_value_free(result->entrypoint_json);
+            }
+            free(result);
+            result = NULL;
+        }
+        else if ((result->tick_counter = tickcounter_create()) == NULL)
+        {
+            //Codes_SRS_LAZY_LOADER_31_012: [ `LazyModule_Create` shall return `NULL` if an underlying API call fails. ]
+            LogError("unable to create the lazy module tick counter");
+            json_value_free(result->entrypoint_json);
+            free(result->configuration);
+            free(result);
+            result = NULL;
+        }
+        else if ((result->lock = Lock_Init()) == NULL)
+        {
+            //Codes_SRS_LAZY_LOADER_31_012: [ `LazyModule_Create` shall return `NULL` if an underlying API call fails. ]
+            LogError("unable to create the lazy module lock");
+            tickcounter_destroy(result->tick_counter);
+            json_value_free(result->entrypoint_json);
+            free(result->configuration);
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            result->broker = broker;
+            result->module.module_apis = (const MODULE_API*)&LazyModule_Api;
+            result->module.module_handle = result;
+            result->loader = entrypoint->loader;
+            result->idle_timeout = entrypoint->idle_timeout;
+            result->started = false;
+            result->quit = false;
+            result->active.entrypoint = NULL;
+            result->active.library = NULL;
+            result->active.module_apis = NULL;
+            result->active.module_handle = NULL;
+            result->last_message = 0;
+            result->idle_thread = NULL;
+            result->exited_idle_thread = NULL;
+        }
+    }
+
+    return result;
+}
+
+static void LazyModule_Destroy(MODULE_HANDLE moduleHandle)
+{
+    if (moduleHandle == NULL)
+    {
+        LogError("moduleHandle is NULL");
+    }
+    else
+    {
+        LAZY_MODULE_HANDLE_DATA* lazy = (LAZY_MODULE_HANDLE_DATA*)moduleHandle;
+        THREAD_HANDLE idle_thread = NULL;
+        THREAD_HANDLE exited_idle_thread = NULL;
+        int thread_result;
+
+        //Codes_SRS_LAZY_LOADER_31_022: [ `LazyModule_Destroy` shall stop the idle watcher, deactivate the module if it is active, and free all resources of the stand-in. ]
+        if (Lock(lazy->lock) != LOCK_OK)
+        {
+            LogError("unable to lock the lazy module");
+        }
+        else
+        {
+            lazy->quit = true;
+            idle_thread = lazy->idle_thread;
+            exited_idle_thread = lazy->exited_idle_thread;
+            lazy->idle_thread = NULL;
+            lazy->exited_idle_thread = NULL;
+            (void)Unlock(lazy->lock);
+        }
+
+        /* a watcher releases the module it deactivated before it exits */
+        if (exited_idle_thread != NULL)
+        {
+            (void)ThreadAPI_Join(exited_idle_thread, &thread_result);
+        }
+        if (idle_thread != NULL)
+        {
+            (void)ThreadAPI_Join(idle_thread, &thread_result);
+        }
+
+        if (lazy->active.module_handle != NULL)
+        {
+            release_instance(lazy, &lazy->active);
+        }
+
+        Lock_Deinit(lazy->lock);
+        tickcounter_destroy(lazy->tick_counter);
+        if (lazy->entrypoint_json != NULL)
+        {
+            json_value_free(lazy->entrypoint_json);
+        }
+        free(lazy->configuration);
+        free(lazy);
+    }
+}
+
+static void LazyModule_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE messageHandle)
+{
+    if (moduleHandle == NULL || messageHandle == NULL)
+    {
+        LogError("invalid input - moduleHandle = %p, messageHandle = %p", moduleHandle, messageHandle);
+    }
+    else
+    {
+        LAZY_MODULE_HANDLE_DATA* lazy = (LAZY_MODULE_HANDLE_DATA*)moduleHandle;
+        if (Lock(lazy->lock) != LOCK_OK)
+        {
+            LogError("unable to lock the lazy module");
+        }
+        else
+        {
+            //Codes_SRS_LAZY_LOADER_31_013: [ If the module is not active, `LazyModule_Receive` shall activate it. The broker keeps the messages that follow queued meanwhile. ]
+            if (lazy->active.module_handle == NULL && activate_module(lazy) != 0)
+            {
+                LogError("dropping a message, the lazy module could not be activated");
+            }
+            else
+            {
+                //Codes_SRS_LAZY_LOADER_31_023: [ `LazyModule_Receive` shall record the time of the message and pass it to the module. ]
+                if (tickcounter_get_current_ms(lazy->tick_counter, &lazy->last_message) != 0)
+                {
+                    LogError("unable to get the time of the message");
+                }
+                MODULE_RECEIVE(lazy->active.module_apis)(lazy->active.module_handle, messageHandle);
+            }
+            (void)Unlock(lazy->lock);
+        }
+    }
+}
+
+static void LazyModule_Start(MODULE_HANDLE moduleHandle)
+{
+    if (moduleHandle == NULL)
+    {
+        LogError("moduleHandle is NULL");
+    }
+    else
+    {
+        LAZY_MODULE_HANDLE_DATA* lazy = (LAZY_MODULE_HANDLE_DATA*)moduleHandle;
+        if (Lock(lazy->lock) != LOCK_OK)
+        {
+            LogError("unable to lock the lazy module");
+        }
+        else
+        {
+            //Codes_SRS_LAZY_LOADER_31_024: [ `LazyModule_Start` shall start the module if it is active, and the module created afterwards otherwise. ]
+            lazy->started = true;
+            if (lazy->active.module_handle != NULL && MODULE_START(lazy->active.module_apis) != NULL)
+            {
+                MODULE_START(lazy->active.module_apis)(lazy->active.module_handle);
+            }
+            (void)Unlock(lazy->lock);
+        }
+    }
+}
+
+static const MODULE_API_1 LazyModule_Api =
+{
+    { MODULE_API_VERSION_1 },
+
+    LazyModule_ParseConfigurationFromJson,
+    LazyModule_FreeConfiguration,
+    LazyModule_Create,
+    LazyModule_Destroy,
+    LazyModule_Receive,
+    LazyModule_Start
+};
+
+static MODULE_LIBRARY_HANDLE LazyModuleLoader_Load(const MODULE_LOADER* loader, const void* entrypoint)
+{
+    MODULE_LIBRARY_HANDLE result;
+
+    if (loader == NULL || entrypoint == NULL)
+    {
+        //Codes_SRS_LAZY_LOADER_31_001: [ `LazyModuleLoader_Load` shall return `NULL` if `loader` or `entrypoint` is `NULL`. ]
+        result = NULL;
+        LogError("invalid input - loader = %p, entrypoint = %p", loader, entrypoint);
+    }
+    else
+    {
+        //Codes_SRS_LAZY_LOADER_31_002: [ `LazyModuleLoader_Load` shall not load the module library, it shall return the stand-in module API as the library handle. ]
+        result = (MODULE_LIBRARY_HANDLE)&LazyModule_Api;
+    }
+
+    return result;
+}
+
+static const MODULE_API* LazyModuleLoader_GetModuleApi(const MODULE_LOADER* loader, MODULE_LIBRARY_HANDLE moduleLibraryHandle)
+{
+    (void)loader;
+
+    //Codes_SRS_LAZY_LOADER_31_003: [ `LazyModuleLoader_GetModuleApi` shall return the stand-in module API, or `NULL` if `moduleLibraryHandle` is `NULL`. ]
+    return moduleLibraryHandle == NULL ? NULL : (const MODULE_API*)&LazyModule_Api;
+}
+
+static void LazyModuleLoader_Unload(const MODULE_LOADER* loader, MODULE_LIBRARY_HANDLE moduleLibraryHandle)
+{
+    //Codes_SRS_LAZY_LOADER_31_004: [ `LazyModuleLoader_Unload` shall do nothing, the stand-in unloads the module library when it deactivates the module. ]
+    (void)loader;
+    (void)moduleLibraryHandle;
+}
+
+static void* LazyModuleLoader_ParseEntrypointFromJson(const MODULE_LOADER* loader, const JSON_Value* json)
+{
+    (void)loader;
+    (void)json;
+
+    //Codes_SRS_LAZY_LOADER_31_025: [ `LazyModuleLoader_ParseEntrypointFromJson` shall return `NULL`, lazy entrypoints are created with `LazyLoader_CreateEntrypoint`. ]
+    LogError("the lazy loader entrypoint is created from the module loader entrypoint");
+    return NULL;
+}
+
+static void LazyModuleLoader_FreeEntrypoint(const MODULE_LOADER* loader, void* entrypoint)
+{
+    (void)loader;
+
+    //Codes_SRS_LAZY_LOADER_31_005: [ `LazyModuleLoader_FreeEntrypoint` shall do nothing if `entrypoint` is `NULL`. ]
+    if (entrypoint != NULL)
+    {
+        //Codes_SRS_LAZY_LOADER_31_006: [ `LazyModuleLoader_FreeEntrypoint` shall free the entrypoint JSON and the entrypoint. ]
+        LAZY_LOADER_ENTRYPOINT* lazy_entrypoint = (LAZY_LOADER_ENTRYPOINT*)entrypoint;
+        if (lazy_entrypoint->entrypoint != NULL)
+        {
+            json_value_free(lazy_entrypoint->entrypoint);
+        }
+        free(lazy_entrypoint);
+    }
+}
+
+static MODULE_LOADER_BASE_CONFIGURATION* LazyModuleLoader_ParseConfigurationFromJson(const MODULE_LOADER* loader, const JSON_Value* json)
+{
+    (void)loader;
+    (void)json;
+
+    //Codes_SRS_LAZY_LOADER_31_026: [ `LazyModuleLoader_ParseConfigurationFromJson` shall return `NULL`, the lazy loader has no configuration. ]
+    return NULL;
+}
+
+static void LazyModuleLoader_FreeConfiguration(const MODULE_LOADER* loader, MODULE_LOADER_BASE_CONFIGURATION* configuration)
+{
+    (void)loader;
+    (void)configuration;
+}
+
+static void* LazyModuleLoader_BuildModuleConfiguration(const MODULE_LOADER* loader, const void* entrypoint, const void* module_configuration)
+{
+    LAZY_MODULE_CONFIGURATION* result;
+    (void)loader;
+
+    if (entrypoint == NULL)
+    {
+        //Codes_SRS_LAZY_LOADER_31_027: [ `LazyModuleLoader_BuildModuleConfiguration` shall return `NULL` if `entrypoint` is `NULL`. ]
+        result = NULL;
+        LogError("entrypoint is NULL");
+    }
+    else if ((result = (LAZY_MODULE_CONFIGURATION*)malloc(sizeof(LAZY_MODULE_CONFIGURATION))) == NULL)
+    {
+        //Codes_SRS_LAZY_LOADER_31_028: [ `LazyModuleLoader_BuildModuleConfiguration` shall return `NULL` if an underlying API call fails. ]
+        LogError("malloc(sizeof(LAZY_MODULE_CONFIGURATION)) failed");
+    }
+    else
+    {
+        //Codes_SRS_LAZY_LOADER_31_029: [ `LazyModuleLoader_BuildModuleConfiguration` shall pair the entrypoint with the module JSON configuration. ]
+        result->entrypoint = (const LAZY_LOADER_ENTRYPOINT*)entrypoint;
+        result->configuration = (const char*)module_configuration;
+    }
+
+    return result;
+}
+
+static void LazyModuleLoader_FreeModuleConfiguration(const MODULE_LOADER* loader, const void* module_configuration)
+{
+    (void)loader;
+
+    //Codes_SRS_LAZY_LOADER_31_030: [ `LazyModuleLoader_FreeModuleConfiguration` shall free the pair, not the configuration it refers to. ]
+    free((void*)module_configuration);
+}
+
+LAZY_LOADER_ENTRYPOINT* LazyLoader_CreateEntrypoint(const MODULE_LOADER* loader, const JSON_Value* entrypoint, unsigned int idle_timeout)
+{
+    LAZY_LOADER_ENTRYPOINT* result;
+
+    if (loader == NULL)
+    {
+        //Codes_SRS_LAZY_LOADER_31_031: [ `LazyLoader_CreateEntrypoint` shall return `NULL` if `loader` is `NULL`. ]
+        result = NULL;
+        LogError("loader is NULL");
+    }
+    else if ((result = (LAZY_LOADER_ENTRYPOINT*)malloc(sizeof(LAZY_LOADER_ENTRYPOINT))) == NULL)
+    {
+        //Codes_SRS_LAZY_LOADER_31_032: [ `LazyLoader_CreateEntrypoint` shall return `NULL` if an underlying API call fails. ]
+        LogError("malloc(sizeof(LAZY_LOADER_ENTRYPOINT)) failed");
+    }
+    else
+    {
+        //Codes_SRS_LAZY_LOADER_31_033: [ `LazyLoader_CreateEntrypoint` shall keep `loader` and `idle_timeout`, and a copy of `entrypoint` if it is not `NULL`. ]
+        result->loader = loader;
+        result->idle_timeout = idle_timeout;
+        result->entrypoint = entrypoint == NULL ? NULL : json_value_deep_copy(entrypoint);
+        if (entrypoint != NULL && result->entrypoint == NULL)
+        {
+            //Codes_SRS_LAZY_LOADER_31_032: [ `LazyLoader_CreateEntrypoint` shall return `NULL` if an underlying API call fails. ]
+            LogError("unable to copy the entrypoint JSON");
+            free(result);
+            result = NULL;
+        }
+    }
+
+    return result;
+}
+
+static MODULE_LOADER_API Lazy_Module_Loader_API =
+{
+    .Load = LazyModuleLoader_Load,
+    .Unload = LazyModuleLoader_Unload,
+    .GetApi = LazyModuleLoader_GetModuleApi,
+
+    .ParseEntrypointFromJson = LazyModuleLoader_ParseEntrypointFromJson,
+    .FreeEntrypoint = LazyModuleLoader_FreeEntrypoint,
+
+    .ParseConfigurationFromJson = LazyModuleLoader_ParseConfigurationFromJson,
+    .FreeConfiguration = LazyModuleLoader_FreeConfiguration,
+
+    .BuildModuleConfiguration = LazyModuleLoader_BuildModuleConfiguration,
+    .FreeModuleConfiguration = LazyModuleLoader_FreeModuleConfiguration
+};
+
+static MODULE_LOADER Lazy_Module_Loader =
+{
+    UNKNOWN,
+    LAZY_LOADER_NAME,
+    NULL,
+    &Lazy_Module_Loader_API
+};
+
+const MODULE_LOADER* LazyLoader_Get(void)
+{
+    //Codes_SRS_LAZY_LOADER_31_007: [ `LazyLoader_Get` shall return a non-`NULL` pointer to a `MODULE_LOADER` named `lazy`, which is not registered with the module loaders. ]
+    return &Lazy_Module_Loader;
+}
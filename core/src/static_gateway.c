@@ -0,0 +1,252 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/vector.h"
+
+#include "module.h"
+#include "module_access.h"
+#include "module_loader.h"
+#include "gateway.h"
+#include "static_gateway.h"
+#include "experimental/event_system.h"
+#include "gateway_internal.h"
+
+#define STATIC_LOADER_NAME "static"
+
+/* The entrypoint of a module is its STATIC_GATEWAY_MODULE, the library handle its MODULE_API. */
+static MODULE_LIBRARY_HANDLE StaticModuleLoader_Load(const MODULE_LOADER* loader, const void* entrypoint)
+{
+    const MODULE_API* result;
+
+    if (loader == NULL || entrypoint == NULL)
+    {
+        LogError("invalid input - loader = %p, entrypoint = %p", loader, entrypoint);
+        result = NULL;
+    }
+    else
+    {
+        const STATIC_GATEWAY_MODULE* module = (const STATIC_GATEWAY_MODULE*)entrypoint;
+
+        /*Codes_SRS_STATIC_GATEWAY_31_005: [ The gateway shall get the MODULE_API of each module from its MODULE_STATIC_GETAPI entry point, without loading a library. ]*/
+        result = module->module_get_api(Module_ApiGatewayVersion);
+
+        /*Codes_SRS_STATIC_GATEWAY_31_006: [ The gateway shall fail to load a module whose MODULE_API is NULL, newer than the gateway, or lacks Module_Create, Module_Destroy or Module_Receive. ]*/
+        if (result == NULL ||
+            result->version > Module_ApiGatewayVersion ||
+            MODULE_CREATE(result) == NULL ||
+            MODULE_DESTROY(result) == NULL ||
+            MODULE_RECEIVE(result) == NULL)
+        {
+            LogError("module %s does not have a valid MODULE_API", module->module_name);
+            result = NULL;
+        }
+    }
+
+    return (MODULE_LIBRARY_HANDLE)result;
+}
+
+static void StaticModuleLoader_Unload(const MODULE_LOADER* loader, MODULE_LIBRARY_HANDLE moduleLibraryHandle)
+{
+    (void)loader;
+    (void)moduleLibraryHandle;
+}
+
+static const MODULE_API* StaticModuleLoader_GetModuleApi(const MODULE_LOADER* loader, MODULE_LIBRARY_HANDLE moduleLibraryHandle)
+{
+    (void)loader;
+    return (const MODULE_API*)moduleLibraryHandle;
+}
+
+static void* StaticModuleLoader_ParseEntrypointFromJson(const MODULE_LOADER* loader, const JSON_Value* json)
+{
+    (void)loader;
+    (void)json;
+    return NULL;
+}
+
+static void StaticModuleLoader_FreeEntrypoint(const MODULE_LOADER* loader, void* entrypoint)
+{
+    (void)loader;
+    (void)entrypoint;
+}
+
+static MODULE_LOADER_BASE_CONFIGURATION* StaticModuleLoader_ParseConfigurationFromJson(const MODULE_LOADER* loader, const JSON_Value* json)
+{
+    (void)loader;
+    (void)json;
+    return NULL;
+}
+
+static void StaticModuleLoader_FreeConfiguration(const MODULE_LOADER* loader, MODULE_LOADER_BASE_CONFIGURATION* configuration)
+{
+    (void)loader;
+    (void)configuration;
+}
+
+static void* StaticModuleLoader_BuildModuleConfiguration(const MODULE_LOADER* loader, const void* entrypoint, const void* module_configuration)
+{
+    (void)loader;
+    (void)entrypoint;
+    return (void*)module_configuration;
+}
+
+static void StaticModuleLoader_FreeModuleConfiguration(const MODULE_LOADER* loader, const void* module_configuration)
+{
+    (void)loader;
+    (void)module_configuration;
+}
+
+static MODULE_LOADER_API Static_Module_Loader_API =
+{
+    .Load = StaticModuleLoader_Load,
+    .Unload = StaticModuleLoader_Unload,
+    .GetApi = StaticModuleLoader_GetModuleApi,
+
+    .ParseEntrypointFromJson = StaticModuleLoader_ParseEntrypointFromJson,
+    .FreeEntrypoint = StaticModuleLoader_FreeEntrypoint,
+
+    .ParseConfigurationFromJson = StaticModuleLoader_ParseConfigurationFromJson,
+    .FreeConfiguration = StaticModuleLoader_FreeConfiguration,
+
+    .BuildModuleConfiguration = StaticModuleLoader_BuildModuleConfiguration,
+    .FreeModuleConfiguration = StaticModuleLoader_FreeModuleConfiguration
+};
+
+/* Native, so the links between static modules can be fused. */
+static MODULE_LOADER Static_Module_Loader =
+{
+    NATIVE,
+    STATIC_LOADER_NAME,
+    NULL,
+    &Static_Module_Loader_API
+};
+
+static bool is_graph_valid(const STATIC_GATEWAY_GRAPH* graph)
+{
+    bool result;
+
+    if (graph == NULL ||
+        (graph->modules == NULL && graph->module_count > 0) ||
+        (graph->links == NULL && graph->link_count > 0))
+    {
+        result = false;
+    }
+    else
+    {
+        size_t i;
+
+        result = true;
+        for (i = 0; i < graph->module_count && result; i++)
+        {
+            result = (graph->modules[i].module_name != NULL && graph->modules[i].module_get_api != NULL);
+        }
+    }
+
+    return result;
+}
+
+static int add_graph_entries(const STATIC_GATEWAY_GRAPH* graph, VECTOR_HANDLE module_entries, VECTOR_HANDLE link_entries)
+{
+    int result = 0;
+    size_t i;
+
+    for (i = 0; i < graph->module_count && result == 0; i++)
+    {
+        GATEWAY_MODULES_ENTRY module_entry =
+        {
+            graph->modules[i].module_name,
+            {
+                &Static_Module_Loader,
+                (void*)&graph->modules[i]
+            },
+            graph->modules[i].module_configuration
+        };
+
+        if (VECTOR_push_back(module_entries, &module_entry, 1) != 0)
+        {
+            LogError("Unable to add the module entry of %s.", module_entry.module_name);
+            result = __LINE__;
+        }
+    }
+
+    if (result == 0 && graph->link_count > 0 &&
+        VECTOR_push_back(link_entries, graph->links, graph->link_count) != 0)
+    {
+        LogError("Unable to add the link entries.");
+        result = __LINE__;
+    }
+
+    return result;
+}
+
+GATEWAY_HANDLE StaticGateway_Create(const STATIC_GATEWAY_GRAPH* graph)
+{
+    GATEWAY_HANDLE result;
+
+    /*Codes_SRS_STATIC_GATEWAY_31_001: [ StaticGateway_Create shall return NULL if graph is NULL, if the modules or links it counts are NULL, or if a module has no name or entry point. ]*/
+    if (!is_graph_valid(graph))
+    {
+        LogError("invalid graph %p", graph);
+        result = NULL;
+    }
+    else
+    {
+        GATEWAY_PROPERTIES properties;
+
+        /*Codes_SRS_STATIC_GATEWAY_31_002: [ StaticGateway_Create shall create the gateway properties from the modules and links of the graph, and return NULL if they cannot be created. ]*/
+        properties.gateway_modules = VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY));
+        properties.gateway_links = VECTOR_create(sizeof(GATEWAY_LINK_ENTRY));
+        if (properties.gateway_modules == NULL ||
+            properties.gateway_links == NULL ||
+            add_graph_entries(graph, properties.gateway_modules, properties.gateway_links) != 0)
+        {
+            LogError("Unable to create the gateway properties of the graph.");
+            result = NULL;
+        }
+        else
+        {
+            /*Codes_SRS_STATIC_GATEWAY_31_003: [ StaticGateway_Create shall create the gateway the way Gateway_CreateFromJson does, each module parsing its JSON arguments, and return NULL if it cannot be created. ]*/
+            /* the static loader shortcut: the JSON gateway path creates the modules and adds the links to the broker here, at startup; the graph holds neither parsed configurations nor a table of sinks */
+            result = gateway_create_internal(&properties, true);
+            if (result == NULL)
+            {
+                LogError("Unable to create the gateway of the graph.");
+            }
+            else
+            {
+                /*Codes_SRS_STATIC_GATEWAY_31_004: [ StaticGateway_Create shall enable link fusion if the graph asks for it, then start the gateway and return it. ]*/
+                if (graph->fuse_links && Gateway_EnableLinkFusion(result) != 0)
+                {
+                    /*Codes_SRS_STATIC_GATEWAY_31_007: [ If link fusion cannot be enabled or the gateway cannot be started, StaticGateway_Create shall destroy the gateway and return NULL. ]*/
+                    LogError("Unable to enable link fusion for the gateway of the graph.");
+                    Gateway_Destroy(result);
+                    result = NULL;
+                }
+                else if (Gateway_Start(result) != GATEWAY_START_SUCCESS)
+                {
+                    LogError("Unable to start the gateway of the graph.");
+                    Gateway_Destroy(result);
+                    result = NULL;
+                }
+                else
+                {
+                    /*all is fine*/
+                }
+            }
+        }
+
+        if (properties.gateway_modules != NULL)
+        {
+            VECTOR_destroy(properties.gateway_modules);
+        }
+        if (properties.gateway_links != NULL)
+        {
+            VECTOR_destroy(properties.gateway_links);
+        }
+    }
+
+    return result;
+}
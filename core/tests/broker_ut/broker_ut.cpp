@@ -3,6 +3,7 @@
 
 #include <cstdlib>
 #include <cstddef>
+#include <cstring>
 #include <cstdbool>
 #include "testrunnerswitcher.h"
 #include "micromock.h"
@@ -14,6 +15,7 @@
 #include "message.h"
 #include "azure_c_shared_utility/threadapi.h"
 #include "azure_c_shared_utility/uniqueid.h"
+#include "azure_c_shared_utility/tickcounter.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "nanomsg/nn.h"
 #include "nanomsg/pubsub.h"
@@ -50,6 +52,33 @@ namespace BASEIMPLEMENTATION
 
 DEFINE_MICROMOCK_ENUM_TO_STRING(BROKER_RESULT, BROKER_RESULT_VALUES);
 
+typedef struct ALERT_CALL_STATUS_TAG
+{
+    size_t call_count;
+    void* context;
+    BROKER_ALERT alert;
+    MODULE_HANDLE module;
+    size_t value;
+    size_t threshold;
+    /* the locks held while the callback runs */
+    size_t held_locks;
+} ALERT_CALL_STATUS;
+static ALERT_CALL_STATUS alert_call_status;
+
+static size_t currentLock_call;
+static size_t currentUnlock_call;
+
+static void FakeAlert_Callback(void* context, BROKER_ALERT alert, MODULE_HANDLE module, size_t value, size_t threshold)
+{
+    alert_call_status.call_count++;
+    alert_call_status.context = context;
+    alert_call_status.alert = alert;
+    alert_call_status.module = module;
+    alert_call_status.value = value;
+    alert_call_status.threshold = threshold;
+    alert_call_status.held_locks = currentLock_call - currentUnlock_call;
+}
+
 static size_t currentmalloc_call;
 static size_t whenShallmalloc_fail;
 
@@ -75,11 +104,8 @@ static size_t whenShallsinglylinkedlist_add_fail;
 static size_t currentLock_Init_call;
 static size_t whenShallLock_Init_fail;
 
-static size_t currentLock_call;
 static size_t whenShallLock_fail;
 
-static size_t currentUnlock_call;
-
 static size_t currentCond_Init_call;
 static size_t whenShallCond_Init_fail;
 
@@ -90,6 +116,7 @@ static size_t currentThreadAPI_Create_call;
 static size_t whenShallThreadAPI_Create_fail;
 
 static size_t nn_current_msg_size;
+static MODULE_HANDLE nn_last_topic;
 
 typedef struct LIST_ITEM_INSTANCE_TAG
 {
@@ -159,6 +186,14 @@ MODULE fake_module =
     fake_module_handle
 };
 
+static MODULE_HANDLE fake_sink_module_handle = (MODULE_HANDLE)0x44;
+
+MODULE fake_sink_module =
+{
+    (const MODULE_API *)&fake_module_apis,
+    fake_sink_module_handle
+};
+
 class RefCountObject
 {
 private:
@@ -526,6 +561,20 @@ public:
         free(msg);
     MOCK_METHOD_END(int, 0)
 
+    MOCK_STATIC_METHOD_0(, int, nn_errno)
+    MOCK_METHOD_END(int, 0)
+
+    MOCK_STATIC_METHOD_0(, TICK_COUNTER_HANDLE, tickcounter_create)
+    MOCK_METHOD_END(TICK_COUNTER_HANDLE, (TICK_COUNTER_HANDLE)malloc(1))
+
+    MOCK_STATIC_METHOD_1(, void, tickcounter_destroy, TICK_COUNTER_HANDLE, tick_counter)
+        free(tick_counter);
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_2(, int, tickcounter_get_current_ms, TICK_COUNTER_HANDLE, tick_counter, tickcounter_ms_t*, current_ms)
+        *current_ms = 0;
+    MOCK_METHOD_END(int, 0)
+
     MOCK_STATIC_METHOD_2(, int, nn_socket, int, domain, int, protocol)
         current_nn_socket_index++;
         nn_socket_memory[current_nn_socket_index] = malloc(1);
@@ -550,6 +599,7 @@ public:
         if (len == NN_MSG)
         {
             send_length = (int)nn_current_msg_size;
+            memcpy(&nn_last_topic, *(void**)buf, sizeof(MODULE_HANDLE));
             free(*(void**)buf); // send is supposed to free auto created buffer on success
         }
         else
@@ -563,7 +613,8 @@ public:
         if (len == NN_MSG)
         {
             char * text = (char*)"nn_recv";
-            (*(void**)buf) = malloc(8);
+            /* large enough for the sizes the tests force with SetReturn */
+            (*(void**)buf) = calloc(1, 64);
             memcpy((*(void**)buf), text, 8);
             rcv_length = 8;
         }
@@ -623,6 +674,12 @@ DECLARE_GLOBAL_MOCK_METHOD_2(CBrokerMocks, , UNIQUEID_RESULT, UniqueId_Generate,
 DECLARE_GLOBAL_MOCK_METHOD_2(CBrokerMocks, , void *, nn_allocmsg, size_t, size, int, type)
 // nn.h
 DECLARE_GLOBAL_MOCK_METHOD_1(CBrokerMocks, , int, nn_freemsg, void*, msg)
+DECLARE_GLOBAL_MOCK_METHOD_0(CBrokerMocks, , int, nn_errno)
+
+// tickcounter.h
+DECLARE_GLOBAL_MOCK_METHOD_0(CBrokerMocks, , TICK_COUNTER_HANDLE, tickcounter_create)
+DECLARE_GLOBAL_MOCK_METHOD_1(CBrokerMocks, , void, tickcounter_destroy, TICK_COUNTER_HANDLE, tick_counter)
+DECLARE_GLOBAL_MOCK_METHOD_2(CBrokerMocks, , int, tickcounter_get_current_ms, TICK_COUNTER_HANDLE, tick_counter, tickcounter_ms_t*, current_ms)
 DECLARE_GLOBAL_MOCK_METHOD_2(CBrokerMocks, , int, nn_socket, int, domain, int, protocol)
 DECLARE_GLOBAL_MOCK_METHOD_1(CBrokerMocks, , int, nn_close, int, s)
 DECLARE_GLOBAL_MOCK_METHOD_2(CBrokerMocks, , int, nn_bind, int, s, const char *, addr)
@@ -668,6 +725,8 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
     currentLock_Init_call = 0;
     whenShallLock_Init_fail = 0;
 
+    memset(&alert_call_status, 0, sizeof(alert_call_status));
+
     currentsinglylinkedlist_find_call = 0;
     whenShallsinglylinkedlist_find_fail = 0;
 
@@ -843,7 +902,7 @@ TEST_FUNCTION(Broker_Create_fails_when_socket_fails)
     STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, nn_socket(AF_SP, NN_PUB))
-        .SetFailReturn(-1);
+        .SetFailReturn((int)-1);
 
     ///act
     auto r = Broker_Create();
@@ -998,7 +1057,7 @@ TEST_FUNCTION(Broker_Create_fails_when_bind_fails)
     STRICT_EXPECTED_CALL(mocks, nn_bind(IGNORED_NUM_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2)
-        .SetFailReturn(-1);
+        .SetFailReturn((int)-1);
     STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     ///act
@@ -1369,7 +1428,7 @@ TEST_FUNCTION(Broker_AddModule_fails_when_nn_socket_fails)
     STRICT_EXPECTED_CALL(mocks, singlylinkedlist_remove(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, nn_socket(AF_SP, NN_SUB))
-        .SetFailReturn(-1);
+        .SetFailReturn((int)-1);
 
     ///act
     auto result = Broker_AddModule(broker, &fake_module);
@@ -1421,7 +1480,7 @@ TEST_FUNCTION(Broker_AddModule_fails_when_nn_connect_fails)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, nn_connect(IGNORED_NUM_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments()
-        .SetFailReturn(-1);
+        .SetFailReturn((int)-1);
     STRICT_EXPECTED_CALL(mocks, nn_close(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
 
@@ -1482,7 +1541,7 @@ TEST_FUNCTION(Broker_AddModule_fails_when_nn_setSocketOpts_fails)
     STRICT_EXPECTED_CALL(mocks, nn_setsockopt(IGNORED_NUM_ARG, NN_SUB, NN_SUB_SUBSCRIBE, IGNORED_PTR_ARG, 36))
         .IgnoreArgument(1)
         .IgnoreArgument(4)
-        .SetFailReturn(-1);
+        .SetFailReturn((int)-1);
     STRICT_EXPECTED_CALL(mocks, nn_close(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
 
@@ -1795,7 +1854,7 @@ TEST_FUNCTION(module_publish_worker_exits_on_nn_recv_error)
     STRICT_EXPECTED_CALL(mocks, nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, 0))
         .IgnoreArgument(1)
         .IgnoreArgument(2)
-        .SetFailReturn(-1);
+        .SetFailReturn((int)-1);
 
 
     auto result = thread_func_to_call(thread_func_args);
@@ -1876,6 +1935,61 @@ TEST_FUNCTION(module_publish_worker_message_size_matches_but_not_quit_for_me)
     Broker_Destroy(broker);
 }
 
+//Tests_SRS_BROKER_31_009: [ When the worker receives a route change for its module, it shall subscribe or unsubscribe `receive_socket` to the source module handle before receiving the next message. ]
+TEST_FUNCTION(module_publish_worker_applies_route_change_for_me)
+{
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+
+    (void)Broker_AddModule(broker, &fake_module);
+
+    mocks.ResetAllCalls();
+
+    //loop 1
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetReturn((int)(37 + 1 + sizeof(MODULE_HANDLE)));
+    STRICT_EXPECTED_CALL(mocks, nn_freemsg(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    // buf from nn_recv will always be "nn_recv" followed by zeroes, so the
+    // route change is for this module and is not an addition
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetFailReturn("nn_recv");
+    STRICT_EXPECTED_CALL(mocks, nn_setsockopt(IGNORED_NUM_ARG, NN_SUB, NN_SUB_UNSUBSCRIBE, IGNORED_PTR_ARG, sizeof(MODULE_HANDLE)))
+        .IgnoreArgument(1)
+        .IgnoreArgument(4);
+
+    //loop 2
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetReturn(37);
+    STRICT_EXPECTED_CALL(mocks, nn_freemsg(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetFailReturn("nn_recv");
+
+    auto result = thread_func_to_call(thread_func_args);
+
+    ASSERT_ARE_EQUAL(int, result, 0);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
 //Tests_SRS_BROKER_17_018: [ If the deserialization is not successful, the message loop shall continue. ]
 TEST_FUNCTION(module_publish_worker_continue_on_CreateFromByteArray_fails)
 {
@@ -2123,7 +2237,7 @@ TEST_FUNCTION(Broker_RemoveModule_succeeds_when_nn_send_fails)
     STRICT_EXPECTED_CALL(mocks, nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, 37, 0))
         .IgnoreArgument(1)
         .IgnoreArgument(2)
-        .SetFailReturn(-1);
+        .SetFailReturn((int)-1);
     STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, nn_close(IGNORED_NUM_ARG))
@@ -2506,7 +2620,7 @@ TEST_FUNCTION(Broker_AddLink_fails_setsocketoption_fails)
     STRICT_EXPECTED_CALL(mocks, nn_setsockopt(IGNORED_NUM_ARG, NN_SUB, NN_SUB_SUBSCRIBE, IGNORED_PTR_ARG, sizeof(MODULE_HANDLE)))
         .IgnoreArgument(1)
         .IgnoreArgument(4)
-        .SetFailReturn(-1);
+        .SetFailReturn((int)-1);
 
     BROKER_LINK_DATA bld =
     {
@@ -2822,7 +2936,7 @@ TEST_FUNCTION(Broker_RemoveLink_fails_sockopt_fails)
     STRICT_EXPECTED_CALL(mocks, nn_setsockopt(IGNORED_NUM_ARG, NN_SUB, NN_SUB_UNSUBSCRIBE, IGNORED_PTR_ARG, sizeof(MODULE_HANDLE)))
         .IgnoreArgument(1)
         .IgnoreArgument(4)
-        .SetFailReturn(-1);
+        .SetFailReturn((int)-1);
 
     ///act
     result = Broker_RemoveLink(broker, &bld);
@@ -2952,23 +3066,28 @@ TEST_FUNCTION(Broker_RemoveLink_fails_lock_fails)
     Broker_Destroy(broker);
 }
 
-//Tests_SRS_BROKER_13_108: [If broker is NULL then Broker_IncRef shall do nothing.]
-TEST_FUNCTION(Broker_IncRef_does_nothing_with_null_input)
+//Tests_SRS_BROKER_31_001: [ If `broker` is NULL, or a count is not zero and its links are NULL, or any link has a NULL source or sink, `Broker_UpdateLinks` shall return `BROKER_INVALIDARG`. ]
+TEST_FUNCTION(Broker_UpdateLinks_null_broker_fails)
 {
     ///arrange
     CBrokerMocks mocks;
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    mocks.ResetAllCalls();
 
     ///act
-    Broker_IncRef(NULL);
+    auto result = Broker_UpdateLinks(NULL, NULL, 0, &bld, 1);
 
     ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_INVALIDARG);
     mocks.AssertActualAndExpectedCalls();
-
-    ///cleanup
 }
 
-//Tests_SRS_BROKER_13_109: [Otherwise, `Broker_IncRef` shall increment the internal ref count.]
-TEST_FUNCTION(Broker_IncRef_increments_ref_count_1)
+//Tests_SRS_BROKER_31_001: [ If `broker` is NULL, or a count is not zero and its links are NULL, or any link has a NULL source or sink, `Broker_UpdateLinks` shall return `BROKER_INVALIDARG`. ]
+TEST_FUNCTION(Broker_UpdateLinks_null_links_fails)
 {
     ///arrange
     CBrokerMocks mocks;
@@ -2976,333 +3095,1809 @@ TEST_FUNCTION(Broker_IncRef_increments_ref_count_1)
     mocks.ResetAllCalls();
 
     ///act
-    Broker_IncRef(broker);
-    Broker_DecRef(broker);
+    auto result = Broker_UpdateLinks(broker, NULL, 1, NULL, 0);
 
     ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_INVALIDARG);
     mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
     Broker_Destroy(broker);
 }
 
-//Tests_SRS_BROKER_13_111: [ Otherwise, Broker_Destroy shall decrement the internal ref count of the message. ]
-TEST_FUNCTION(Broker_IncRef_increments_ref_count_1_destroy)
+//Tests_SRS_BROKER_31_001: [ If `broker` is NULL, or a count is not zero and its links are NULL, or any link has a NULL source or sink, `Broker_UpdateLinks` shall return `BROKER_INVALIDARG`. ]
+TEST_FUNCTION(Broker_UpdateLinks_null_source_fails)
 {
     ///arrange
     CBrokerMocks mocks;
     auto broker = Broker_Create();
+    BROKER_LINK_DATA bld =
+    {
+        NULL,
+        fake_module_handle
+    };
     mocks.ResetAllCalls();
 
     ///act
-    Broker_IncRef(broker);
-    Broker_Destroy(broker);
+    auto result = Broker_UpdateLinks(broker, NULL, 0, &bld, 1);
 
     ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_INVALIDARG);
     mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
     Broker_Destroy(broker);
 }
 
-//Tests_SRS_BROKER_13_058: [If broker is NULL the function shall do nothing.]
-TEST_FUNCTION(Broker_Destroy_does_nothing_with_null_input)
+//Tests_SRS_BROKER_31_002: [ `Broker_UpdateLinks` shall hold the `modules_lock` while it checks and sends the route changes, so no message is published between them. ]
+//Tests_SRS_BROKER_31_004: [ For each link, `Broker_UpdateLinks` shall send on the `publish_socket` a route change made of the sink quit signal GUID, the operation and the source module handle, the removals first. ]
+TEST_FUNCTION(Broker_UpdateLinks_succeeds)
 {
     ///arrange
     CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    // sink of the removal, sink and source of the addition
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, 37 + 1 + sizeof(MODULE_HANDLE), 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, 37 + 1 + sizeof(MODULE_HANDLE), 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
 
     ///act
-    Broker_Destroy(NULL);
+    result = Broker_UpdateLinks(broker, &bld, 1, &bld, 1);
 
     ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
     mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
 }
 
-//Tests_SRS_BROKER_13_058: [If broker is NULL the function shall do nothing.]
-TEST_FUNCTION(Broker_DecRef_does_nothing_with_null_input)
+//Tests_SRS_BROKER_31_002: [ `Broker_UpdateLinks` shall hold the `modules_lock` while it checks and sends the route changes, so no message is published between them. ]
+//Tests_SRS_BROKER_31_006: [ Upon an error, `Broker_UpdateLinks` shall return `BROKER_ERROR`. ]
+TEST_FUNCTION(Broker_UpdateLinks_fails_lock_fails)
 {
     ///arrange
     CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetFailReturn(LOCK_ERROR);
 
     ///act
-    Broker_DecRef(NULL);
+    result = Broker_UpdateLinks(broker, NULL, 0, &bld, 1);
 
     ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
     mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
 }
 
-//Tests_SRS_BROKER_13_112: [If the ref count is zero then the allocated resources are freed.]
-TEST_FUNCTION(Broker_Destroy_works)
+//Tests_SRS_BROKER_31_003: [ `Broker_UpdateLinks` shall fail if the sink of a link, or the source of a link to add, is not attached to the broker. ]
+TEST_FUNCTION(Broker_UpdateLinks_fails_sink_not_attached)
 {
     ///arrange
     CBrokerMocks mocks;
     auto broker = Broker_Create();
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        (MODULE_HANDLE)0x4243
+    };
     mocks.ResetAllCalls();
 
-    // these are for Broker_Destroy
-    STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, nn_close(IGNORED_NUM_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_destroy(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
     ///act
-    Broker_Destroy(broker);
+    result = Broker_UpdateLinks(broker, NULL, 0, &bld, 1);
 
     ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
     mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
 }
 
-//Tests_SRS_BROKER_13_112: [If the ref count is zero then the allocated resources are freed.]
-//Tests_SRS_BROKER_13_113: [ This function shall implement all the requirements of the Broker_Destroy API. ]
-TEST_FUNCTION(Broker_DecRef_works)
+//Tests_SRS_BROKER_31_005: [ If a route change cannot be sent, `Broker_UpdateLinks` shall send the reverse of the route changes already sent, in reverse order, and return `BROKER_ERROR`. ]
+TEST_FUNCTION(Broker_UpdateLinks_reverts_when_send_fails)
 {
     ///arrange
     CBrokerMocks mocks;
     auto broker = Broker_Create();
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
     mocks.ResetAllCalls();
 
-    // these are for Broker_Destroy
-    STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, nn_close(IGNORED_NUM_ARG))
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_destroy(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, 37 + 1 + sizeof(MODULE_HANDLE), 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, 37 + 1 + sizeof(MODULE_HANDLE), 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetFailReturn((int)-1);
+    // reverts the removal
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, 37 + 1 + sizeof(MODULE_HANDLE), 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+
+    ///act
+    result = Broker_UpdateLinks(broker, &bld, 1, &bld, 1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_31_010: [ If `broker` or `module` is NULL the function shall return `BROKER_INVALIDARG`. ]
+TEST_FUNCTION(Broker_DrainModule_fails_with_null_module)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    mocks.ResetAllCalls();
+
+    ///act
+    auto result = Broker_DrainModule(broker, NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_INVALIDARG);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_31_011: [ `Broker_DrainModule` shall return `BROKER_ERROR` if the module is not attached to the broker. ]
+TEST_FUNCTION(Broker_DrainModule_fails_when_module_not_found)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &fake_module))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+
+    ///act
+    auto result = Broker_DrainModule(broker, &fake_module);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_31_012: [ `Broker_DrainModule` shall send the quit signal of the module on the `publish_socket` and remove the module from `BROKER_HANDLE_DATA::modules` while holding `modules_lock`. ]
+//Tests_SRS_BROKER_31_013: [ After releasing `modules_lock`, `Broker_DrainModule` shall join the module thread, which delivers the queued messages before it receives the quit signal. ]
+//Tests_SRS_BROKER_31_014: [ `Broker_DrainModule` shall close `receive_socket` and free all members of the `BROKER_MODULEINFO` object. ]
+TEST_FUNCTION(Broker_DrainModule_succeeds)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    auto result = Broker_AddModule(broker, &fake_module);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &fake_module))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, 37, 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_remove(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, nn_close(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    result = Broker_DrainModule(broker, &fake_module);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_31_015: [ This function shall return `BROKER_ERROR` if an underlying API call to the platform causes an error or `BROKER_OK` otherwise. ]
+TEST_FUNCTION(Broker_DrainModule_keeps_module_when_nn_send_fails)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    auto result = Broker_AddModule(broker, &fake_module);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &fake_module))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, 37, 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetFailReturn((int)-1);
+
+    ///act
+    result = Broker_DrainModule(broker, &fake_module);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_13_108: [If broker is NULL then Broker_IncRef shall do nothing.]
+TEST_FUNCTION(Broker_IncRef_does_nothing_with_null_input)
+{
+    ///arrange
+    CBrokerMocks mocks;
+
+    ///act
+    Broker_IncRef(NULL);
+
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+}
+
+//Tests_SRS_BROKER_13_109: [Otherwise, `Broker_IncRef` shall increment the internal ref count.]
+TEST_FUNCTION(Broker_IncRef_increments_ref_count_1)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    mocks.ResetAllCalls();
+
+    ///act
+    Broker_IncRef(broker);
+    Broker_DecRef(broker);
+
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_13_111: [ Otherwise, Broker_Destroy shall decrement the internal ref count of the message. ]
+TEST_FUNCTION(Broker_IncRef_increments_ref_count_1_destroy)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    mocks.ResetAllCalls();
+
+    ///act
+    Broker_IncRef(broker);
+    Broker_Destroy(broker);
+
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_31_016: [ If `broker`, `module` or `alias` is NULL the function shall return `BROKER_INVALIDARG`. ]
+TEST_FUNCTION(Broker_AddModuleAlias_fails_with_null_alias)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    mocks.ResetAllCalls();
+
+    ///act
+    auto result = Broker_AddModuleAlias(broker, &fake_module, NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_INVALIDARG);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_31_018: [ `Broker_AddModuleAlias` shall return `BROKER_ERROR` if the module is not attached to the broker or if `alias` is already an alias. ]
+TEST_FUNCTION(Broker_AddModuleAlias_fails_when_module_not_found)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &fake_module))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+
+    ///act
+    auto result = Broker_AddModuleAlias(broker, &fake_module, (MODULE_HANDLE)0x43);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_31_017: [ `Broker_AddModuleAlias` shall add the alias while holding `modules_lock`. ]
+//Tests_SRS_BROKER_31_019: [ `Broker_AddModuleAlias` shall grow `BROKER_HANDLE_DATA::aliases` by one element holding `alias` and the handle of `module`. ]
+//Tests_SRS_BROKER_31_020: [ This function shall return `BROKER_ERROR` if an underlying API call to the platform causes an error or `BROKER_OK` otherwise. ]
+TEST_FUNCTION(Broker_AddModuleAlias_succeeds)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    auto result = Broker_AddModule(broker, &fake_module);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &fake_module))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    result = Broker_AddModuleAlias(broker, &fake_module, (MODULE_HANDLE)0x43);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_RemoveModuleAlias(broker, (MODULE_HANDLE)0x43);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_31_018: [ `Broker_AddModuleAlias` shall return `BROKER_ERROR` if the module is not attached to the broker or if `alias` is already an alias. ]
+TEST_FUNCTION(Broker_AddModuleAlias_fails_when_alias_in_use)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    auto result = Broker_AddModule(broker, &fake_module);
+    result = Broker_AddModuleAlias(broker, &fake_module, (MODULE_HANDLE)0x43);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &fake_module))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    result = Broker_AddModuleAlias(broker, &fake_module, (MODULE_HANDLE)0x43);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_RemoveModuleAlias(broker, (MODULE_HANDLE)0x43);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_31_021: [ If `broker` or `alias` is NULL the function shall return `BROKER_INVALIDARG`. ]
+TEST_FUNCTION(Broker_RemoveModuleAlias_fails_with_null_alias)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    mocks.ResetAllCalls();
+
+    ///act
+    auto result = Broker_RemoveModuleAlias(broker, NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_INVALIDARG);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_31_022: [ `Broker_RemoveModuleAlias` shall return `BROKER_ERROR` if `alias` is not an alias. ]
+TEST_FUNCTION(Broker_RemoveModuleAlias_fails_when_alias_not_found)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    auto result = Broker_RemoveModuleAlias(broker, (MODULE_HANDLE)0x43);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_31_023: [ `Broker_RemoveModuleAlias` shall remove the alias while holding `modules_lock`, and free `BROKER_HANDLE_DATA::aliases` once it is empty. ]
+TEST_FUNCTION(Broker_RemoveModuleAlias_succeeds)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    auto result = Broker_AddModule(broker, &fake_module);
+    result = Broker_AddModuleAlias(broker, &fake_module, (MODULE_HANDLE)0x43);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    result = Broker_RemoveModuleAlias(broker, (MODULE_HANDLE)0x43);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_31_025: [ If `broker` or `link` is NULL, or `link` has a NULL source or sink, or its source is its sink, `Broker_FuseLink` shall return `BROKER_INVALIDARG`. ]
+TEST_FUNCTION(Broker_FuseLink_fails_with_null_link)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    mocks.ResetAllCalls();
+
+    ///act
+    auto result = Broker_FuseLink(broker, NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_INVALIDARG);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_31_025: [ If `broker` or `link` is NULL, or `link` has a NULL source or sink, or its source is its sink, `Broker_FuseLink` shall return `BROKER_INVALIDARG`. ]
+TEST_FUNCTION(Broker_FuseLink_fails_when_source_is_sink)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    mocks.ResetAllCalls();
+
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+
+    ///act
+    auto result = Broker_FuseLink(broker, &bld);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_INVALIDARG);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_31_027: [ `Broker_FuseLink` shall return `BROKER_ERROR` if the source or the sink is not attached to the broker, if the source has a fused link, if the sink is the sink of a fused link, or if the fused links would make a cycle. ]
+TEST_FUNCTION(Broker_FuseLink_fails_when_sink_not_attached)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    auto result = Broker_AddModule(broker, &fake_module);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_sink_module_handle
+    };
+
+    ///act
+    result = Broker_FuseLink(broker, &bld);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_31_026: [ `Broker_FuseLink` shall fuse the link while holding `modules_lock`. ]
+//Tests_SRS_BROKER_31_028: [ `Broker_FuseLink` shall grow `BROKER_HANDLE_DATA::fusions` by one fusion holding the source handle, the sink `MODULE` and a lock serializing the calls to the sink's `Receive`. ]
+//Tests_SRS_BROKER_31_029: [ `Broker_FuseLink` shall unsubscribe the sink `receive_socket` from the source module handle. ]
+//Tests_SRS_BROKER_31_030: [ This function shall return `BROKER_ERROR` if an underlying API call to the platform causes an error or `BROKER_OK` otherwise. ]
+TEST_FUNCTION(Broker_FuseLink_succeeds)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    auto result = Broker_AddModule(broker, &fake_module);
+    result = Broker_AddModule(broker, &fake_sink_module);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    // sink, second in the list
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .ExpectedTimesExactly(3);
+    // source, first in the list
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .ExpectedTimesExactly(2);
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Lock_Init());
+    STRICT_EXPECTED_CALL(mocks, nn_setsockopt(IGNORED_NUM_ARG, NN_SUB, NN_SUB_UNSUBSCRIBE, IGNORED_PTR_ARG, sizeof(MODULE_HANDLE)))
+        .IgnoreArgument(1)
+        .IgnoreArgument(4);
+
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_sink_module_handle
+    };
+
+    ///act
+    result = Broker_FuseLink(broker, &bld);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_UnfuseLink(broker, &bld);
+    Broker_RemoveModule(broker, &fake_sink_module);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_31_027: [ `Broker_FuseLink` shall return `BROKER_ERROR` if the source or the sink is not attached to the broker, if the source has a fused link, if the sink is the sink of a fused link, or if the fused links would make a cycle. ]
+TEST_FUNCTION(Broker_FuseLink_fails_when_already_fused)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    auto result = Broker_AddModule(broker, &fake_module);
+    result = Broker_AddModule(broker, &fake_sink_module);
+
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_sink_module_handle
+    };
+    result = Broker_FuseLink(broker, &bld);
+    mocks.ResetAllCalls();
+
+    ///act
+    result = Broker_FuseLink(broker, &bld);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+
+    ///cleanup
+    Broker_UnfuseLink(broker, &bld);
+    Broker_RemoveModule(broker, &fake_sink_module);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_31_027: [ `Broker_FuseLink` shall return `BROKER_ERROR` if the source or the sink is not attached to the broker, if the source has a fused link, if the sink is the sink of a fused link, or if the fused links would make a cycle. ]
+TEST_FUNCTION(Broker_FuseLink_fails_when_fusions_make_a_cycle)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    auto result = Broker_AddModule(broker, &fake_module);
+    result = Broker_AddModule(broker, &fake_sink_module);
+
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_sink_module_handle
+    };
+    BROKER_LINK_DATA back =
+    {
+        fake_sink_module_handle,
+        fake_module_handle
+    };
+    result = Broker_FuseLink(broker, &bld);
+    mocks.ResetAllCalls();
+
+    ///act
+    result = Broker_FuseLink(broker, &back);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+
+    ///cleanup
+    Broker_UnfuseLink(broker, &bld);
+    Broker_RemoveModule(broker, &fake_sink_module);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_31_031: [ If `broker` or `link` is NULL, or `link` has a NULL source or sink, `Broker_UnfuseLink` shall return `BROKER_INVALIDARG`. ]
+TEST_FUNCTION(Broker_UnfuseLink_fails_with_null_broker)
+{
+    ///arrange
+    CBrokerMocks mocks;
+
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_sink_module_handle
+    };
+
+    ///act
+    auto result = Broker_UnfuseLink(NULL, &bld);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_INVALIDARG);
+    mocks.AssertActualAndExpectedCalls();
+}
+
+//Tests_SRS_BROKER_31_032: [ `Broker_UnfuseLink` shall return `BROKER_ERROR` if the link is not fused. ]
+TEST_FUNCTION(Broker_UnfuseLink_fails_when_link_not_fused)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_sink_module_handle
+    };
+
+    ///act
+    auto result = Broker_UnfuseLink(broker, &bld);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_31_033: [ While holding `modules_lock`, `Broker_UnfuseLink` shall subscribe the sink `receive_socket` to the source module handle again and take the fusion out of `BROKER_HANDLE_DATA::fusions`. ]
+//Tests_SRS_BROKER_31_034: [ After releasing `modules_lock`, `Broker_UnfuseLink` shall wait for the delivery through the fusion in progress; the messages published meanwhile go through the sink's queue. ]
+TEST_FUNCTION(Broker_UnfuseLink_succeeds)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    auto result = Broker_AddModule(broker, &fake_module);
+    result = Broker_AddModule(broker, &fake_sink_module);
+
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_sink_module_handle
+    };
+    result = Broker_FuseLink(broker, &bld);
+    mocks.ResetAllCalls();
+
+    // modules_lock, then the fusion lock and modules_lock to detach it
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .ExpectedTimesExactly(3);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .ExpectedTimesExactly(3);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .ExpectedTimesExactly(3);
+    STRICT_EXPECTED_CALL(mocks, nn_setsockopt(IGNORED_NUM_ARG, NN_SUB, NN_SUB_SUBSCRIBE, IGNORED_PTR_ARG, sizeof(MODULE_HANDLE)))
+        .IgnoreArgument(1)
+        .IgnoreArgument(4);
+    // the fusions array, then the fusion
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .ExpectedTimesExactly(2);
+    STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    result = Broker_UnfuseLink(broker, &bld);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_sink_module);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_31_035: [ `Broker_RemoveModule` and `Broker_DrainModule` shall take the fused links of the module out of `BROKER_HANDLE_DATA::fusions`, and after releasing `modules_lock`, wait for the deliveries through them in progress. ]
+TEST_FUNCTION(Broker_RemoveModule_takes_out_the_fused_links_of_the_module)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+
+    auto result = Broker_AddModule(broker, &fake_module);
+    result = Broker_AddModule(broker, &fake_sink_module);
+
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_sink_module_handle
+    };
+    result = Broker_FuseLink(broker, &bld);
+    nn_last_topic = NULL;
+
+    ///act
+    result = Broker_RemoveModule(broker, &fake_sink_module);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, Broker_UnfuseLink(broker, &bld), BROKER_ERROR);
+    result = Broker_Publish(broker, fake_module_handle, message);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    ASSERT_IS_FALSE(call_status_for_FakeModule_Receive.was_called);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)fake_module_handle, (void*)nn_last_topic);
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_13_058: [If broker is NULL the function shall do nothing.]
+TEST_FUNCTION(Broker_Destroy_does_nothing_with_null_input)
+{
+    ///arrange
+    CBrokerMocks mocks;
+
+    ///act
+    Broker_Destroy(NULL);
+
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+}
+
+//Tests_SRS_BROKER_13_058: [If broker is NULL the function shall do nothing.]
+TEST_FUNCTION(Broker_DecRef_does_nothing_with_null_input)
+{
+    ///arrange
+    CBrokerMocks mocks;
+
+    ///act
+    Broker_DecRef(NULL);
+
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+}
+
+//Tests_SRS_BROKER_13_112: [If the ref count is zero then the allocated resources are freed.]
+TEST_FUNCTION(Broker_Destroy_works)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    mocks.ResetAllCalls();
+
+    // these are for Broker_Destroy
+    STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_close(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    Broker_Destroy(broker);
+
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+}
+
+//Tests_SRS_BROKER_13_112: [If the ref count is zero then the allocated resources are freed.]
+//Tests_SRS_BROKER_13_113: [ This function shall implement all the requirements of the Broker_Destroy API. ]
+TEST_FUNCTION(Broker_DecRef_works)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    mocks.ResetAllCalls();
+
+    // these are for Broker_Destroy
+    STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_close(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    Broker_DecRef(broker);
+
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+}
+
+//Tests_SRS_BROKER_13_030: [If broker or message is NULL the function shall return BROKER_INVALIDARG.]
+TEST_FUNCTION(Broker_Publish_fails_with_null_broker)
+{
+    ///arrange
+    CBrokerMocks mocks;
+
+    ///act
+    auto r1 = Broker_Publish(NULL, fake_module_handle, (MESSAGE_HANDLE)0x1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, r1, BROKER_INVALIDARG);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+}
+
+//Tests_SRS_BROKER_13_030: [If broker or message is NULL the function shall return BROKER_INVALIDARG.]
+TEST_FUNCTION(Broker_Publish_fails_with_null_message)
+{
+    ///arrange
+    CBrokerMocks mocks;
+
+    ///act
+    auto r1 = Broker_Publish((BROKER_HANDLE)0x1, fake_module_handle, NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, r1, BROKER_INVALIDARG);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+}
+
+//Tests_SRS_BROKER_13_030: [If broker or message is NULL the function shall return BROKER_INVALIDARG.]
+TEST_FUNCTION(Broker_Publish_fails_with_null_source)
+{
+    ///arrange
+    CBrokerMocks mocks;
+
+    ///act
+    auto r1 = Broker_Publish((BROKER_HANDLE)0x1, NULL, (MESSAGE_HANDLE)0x1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, r1, BROKER_INVALIDARG);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+}
+//Tests_SRS_BROKER_13_037: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]
+TEST_FUNCTION(Broker_Publish_fails_when_Lock_fails)
+{
+    ///arrange
+    CBrokerMocks mocks;
+
+    auto broker = Broker_Create();
+
+    // create a message to send
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+
+    auto result = Broker_AddModule(broker, &fake_module);
+
+    mocks.ResetAllCalls();
+
+    // this is for Broker_Publish
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetFailReturn(LOCK_ERROR);
+
+    ///act
+    result = Broker_Publish(broker, fake_module_handle, message);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_13_037: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]
+TEST_FUNCTION(Broker_Publish_fails_when_Message_ToByteArray_fails)
+{
+    ///arrange
+    CBrokerMocks mocks;
+
+    auto broker = Broker_Create();
+
+    // create a message to send
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+
+    auto result = Broker_AddModule(broker, &fake_module);
+
+    mocks.ResetAllCalls();
+
+    // this is for Broker_Publish
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Message_Clone(message));
+    STRICT_EXPECTED_CALL(mocks, Message_Destroy(message));
+    STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(message, NULL, 0))
+        .SetFailReturn((int)-1);
+
+    ///act
+    result = Broker_Publish(broker, fake_module_handle, message);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_13_037: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]
+TEST_FUNCTION(Broker_Publish_fails_when_allocmsg_fails)
+{
+    ///arrange
+    CBrokerMocks mocks;
+
+    auto broker = Broker_Create();
+
+    // create a message to send
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+
+    auto result = Broker_AddModule(broker, &fake_module);
+
+    mocks.ResetAllCalls();
+
+    // this is for Broker_Publish
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Message_Clone(message));
+    STRICT_EXPECTED_CALL(mocks, Message_Destroy(message));
+    STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(message, NULL, 0));
+    STRICT_EXPECTED_CALL(mocks, nn_allocmsg(1 + sizeof(MODULE_HANDLE), 0))
+        .SetFailReturn(nullptr);
+
+    ///act
+    result = Broker_Publish(broker, fake_module_handle, message);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, result, BROKER_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_13_037: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]
+TEST_FUNCTION(Broker_Publish_fails_when_send_fails)
+{
+    ///arrange
+    CBrokerMocks mocks;
+
+    auto broker = Broker_Create();
+
+    // create a message to send
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+
+    auto result = Broker_AddModule(broker, &fake_module);
+
+    mocks.ResetAllCalls();
+
+    // this is for Broker_Publish
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Message_Clone(message));
+    STRICT_EXPECTED_CALL(mocks, Message_Destroy(message));
+    STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(message, NULL, 0));
+    STRICT_EXPECTED_CALL(mocks, nn_allocmsg(1 + sizeof(MODULE_HANDLE), 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_freemsg(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(message, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetFailReturn((int)-1);
+
+    ///act
+    result = Broker_Publish(broker, fake_module_handle, message);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_17_022: [ Broker_Publish shall Lock the modules lock. ]
+//Tests_SRS_BROKER_17_007: [Broker_Publish shall clone the message.]
+//Tests_SRS_BROKER_17_008: [ Broker_Publish shall serialize the message. ]
+//Tests_SRS_BROKER_17_025: [ Broker_Publish shall allocate a nanomsg buffer the size of the serialized message + sizeof(MODULE_HANDLE). ]
+//Tests_SRS_BROKER_17_026: [ Broker_Publish shall copy source into the beginning of the nanomsg buffer. ]
+//Tests_SRS_BROKER_17_027: [ Broker_Publish shall serialize the message into the remainder of the nanomsg buffer. ]
+//Tests_SRS_BROKER_17_010: [ Broker_Publish shall send a message on the publish_socket. ]
+//Tests_SRS_BROKER_17_011: [ Broker_Publish shall free the serialized message data. ]
+//Tests_SRS_BROKER_17_012: [ Broker_Publish shall free the message. ]
+//Tests_SRS_BROKER_17_023: [ Broker_Publish shall Unlock the modules lock. ]
+//Tests_SRS_BROKER_13_037 : [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]
+TEST_FUNCTION(Broker_Publish_succeeds)
+{
+    ///arrange
+    CBrokerMocks mocks;
+
+    auto broker = Broker_Create();
+
+    // create a message to send
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+
+    auto result = Broker_AddModule(broker, &fake_module);
+
+    mocks.ResetAllCalls();
+
+    // this is for Broker_Publish
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Message_Clone(message));
+    STRICT_EXPECTED_CALL(mocks, Message_Destroy(message));
+    STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(message, NULL, 0));
+    STRICT_EXPECTED_CALL(mocks, nn_allocmsg(1 + sizeof(MODULE_HANDLE), 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(message, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+
+
+    ///act
+    result = Broker_Publish(broker, fake_module_handle, message);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+
+//Tests_SRS_BROKER_31_024: [ If `source` is an alias, `Broker_Publish` shall copy the handle of the module the alias stands for instead. ]
+TEST_FUNCTION(Broker_Publish_routes_alias_as_its_module)
+{
+    ///arrange
+    CBrokerMocks mocks;
+
+    auto broker = Broker_Create();
+
+    // create a message to send
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+
+    auto result = Broker_AddModule(broker, &fake_module);
+    result = Broker_AddModuleAlias(broker, &fake_module, (MODULE_HANDLE)0x43);
+    nn_last_topic = NULL;
+
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Message_Clone(message));
+    STRICT_EXPECTED_CALL(mocks, Message_Destroy(message));
+    STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(message, NULL, 0));
+    STRICT_EXPECTED_CALL(mocks, nn_allocmsg(1 + sizeof(MODULE_HANDLE), 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(message, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+
+    ///act
+    result = Broker_Publish(broker, (MODULE_HANDLE)0x43, message);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)fake_module_handle, (void*)nn_last_topic);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModuleAlias(broker, (MODULE_HANDLE)0x43);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_31_036: [ If the source has a fused link, `Broker_Publish` shall release `modules_lock` and pass `message` to the sink's `Receive` on the calling thread, without cloning, serializing or sending it. ]
+//Tests_SRS_BROKER_31_037: [ `Broker_Publish` shall hold the lock of the fusion while it calls the sink's `Receive`, so the sink receives one message at a time. ]
+TEST_FUNCTION(Broker_Publish_delivers_fused_link_on_calling_thread)
+{
+    ///arrange
+    CBrokerMocks mocks;
+
+    auto broker = Broker_Create();
+
+    // create a message to send
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+
+    auto result = Broker_AddModule(broker, &fake_module);
+    result = Broker_AddModule(broker, &fake_sink_module);
+
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_sink_module_handle
+    };
+    result = Broker_FuseLink(broker, &bld);
+    call_status_for_FakeModule_Receive.module = fake_sink_module_handle;
+
+    mocks.ResetAllCalls();
+
+    // modules_lock, the fusion lock, then modules_lock to leave the fusion
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .ExpectedTimesExactly(3);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .ExpectedTimesExactly(3);
+
+    ///act
+    result = Broker_Publish(broker, fake_module_handle, message);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    ASSERT_IS_TRUE(call_status_for_FakeModule_Receive.was_called);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_UnfuseLink(broker, &bld);
+    Broker_RemoveModule(broker, &fake_sink_module);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_31_047: [ If `broker` is NULL, `Broker_SetAlertCallback` shall return `BROKER_INVALIDARG`. ]
+TEST_FUNCTION(Broker_SetAlertCallback_fails_with_null_broker)
+{
+    ///arrange
+    CBrokerMocks mocks;
+
     ///act
-    Broker_DecRef(broker);
+    auto result = Broker_SetAlertCallback(NULL, FakeAlert_Callback, NULL);
 
     ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_INVALIDARG);
     mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
 }
 
-//Tests_SRS_BROKER_13_030: [If broker or message is NULL the function shall return BROKER_INVALIDARG.]
-TEST_FUNCTION(Broker_Publish_fails_with_null_broker)
+//Tests_SRS_BROKER_31_048: [ The first call shall fail and return `BROKER_ERROR` if a module is attached to the broker. ]
+TEST_FUNCTION(Broker_SetAlertCallback_fails_when_a_module_is_attached)
 {
     ///arrange
     CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    (void)Broker_AddModule(broker, &fake_module);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
 
     ///act
-    auto r1 = Broker_Publish(NULL, fake_module_handle, (MESSAGE_HANDLE)0x1);
+    auto result = Broker_SetAlertCallback(broker, FakeAlert_Callback, NULL);
 
     ///assert
-    ASSERT_ARE_EQUAL(BROKER_RESULT, r1, BROKER_INVALIDARG);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
     mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
 }
 
-//Tests_SRS_BROKER_13_030: [If broker or message is NULL the function shall return BROKER_INVALIDARG.]
-TEST_FUNCTION(Broker_Publish_fails_with_null_message)
+//Tests_SRS_BROKER_31_049: [ The first call shall create the lock guarding the alert callback, and return `BROKER_ERROR` if it cannot. ]
+TEST_FUNCTION(Broker_SetAlertCallback_fails_when_lock_init_fails)
 {
     ///arrange
     CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    mocks.ResetAllCalls();
+    whenShallLock_Init_fail = currentLock_Init_call + 1;
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Lock_Init());
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
 
     ///act
-    auto r1 = Broker_Publish((BROKER_HANDLE)0x1, fake_module_handle, NULL);
+    auto result = Broker_SetAlertCallback(broker, FakeAlert_Callback, NULL);
 
     ///assert
-    ASSERT_ARE_EQUAL(BROKER_RESULT, r1, BROKER_INVALIDARG);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
     mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
+    Broker_Destroy(broker);
 }
 
-//Tests_SRS_BROKER_13_030: [If broker or message is NULL the function shall return BROKER_INVALIDARG.]
-TEST_FUNCTION(Broker_Publish_fails_with_null_source)
+//Tests_SRS_BROKER_31_049: [ The first call shall create the lock guarding the alert callback, and return `BROKER_ERROR` if it cannot. ]
+//Tests_SRS_BROKER_31_050: [ `Broker_SetAlertCallback` shall store `callback` and `context` under the alert lock and return `BROKER_OK`. ]
+TEST_FUNCTION(Broker_SetAlertCallback_succeeds)
 {
     ///arrange
     CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Lock_Init());
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
 
     ///act
-    auto r1 = Broker_Publish((BROKER_HANDLE)0x1, NULL, (MESSAGE_HANDLE)0x1);
+    auto result = Broker_SetAlertCallback(broker, FakeAlert_Callback, NULL);
 
     ///assert
-    ASSERT_ARE_EQUAL(BROKER_RESULT, r1, BROKER_INVALIDARG);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
     mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
+    Broker_Destroy(broker);
 }
-//Tests_SRS_BROKER_13_037: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]
-TEST_FUNCTION(Broker_Publish_fails_when_Lock_fails)
+
+//Tests_SRS_BROKER_31_050: [ `Broker_SetAlertCallback` shall store `callback` and `context` under the alert lock and return `BROKER_OK`. ]
+TEST_FUNCTION(Broker_SetAlertCallback_replaces_the_callback_with_modules_attached)
 {
     ///arrange
     CBrokerMocks mocks;
-
     auto broker = Broker_Create();
-
-    // create a message to send
-    unsigned char fake;
-    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
-    auto message = Message_Create(&c);
-
-    auto result = Broker_AddModule(broker, &fake_module);
-
+    (void)Broker_SetAlertCallback(broker, FakeAlert_Callback, NULL);
+    (void)Broker_AddModule(broker, &fake_module);
     mocks.ResetAllCalls();
 
-    // this is for Broker_Publish
     STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .SetFailReturn(LOCK_ERROR);
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
 
     ///act
-    result = Broker_Publish(broker, fake_module_handle, message);
+    auto result = Broker_SetAlertCallback(broker, NULL, NULL);
+    Broker_ReportAlert(broker, BROKER_ALERT_MODULE_DETACHED, fake_module_handle, 0, 0);
 
     ///assert
-    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
-    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    ASSERT_ARE_EQUAL(size_t, 0, alert_call_status.call_count);
 
     ///cleanup
-    Message_Destroy(message);
     Broker_RemoveModule(broker, &fake_module);
     Broker_Destroy(broker);
 }
 
-//Tests_SRS_BROKER_13_037: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]
-TEST_FUNCTION(Broker_Publish_fails_when_Message_ToByteArray_fails)
+//Tests_SRS_BROKER_31_051: [ If `broker` or `thresholds` is NULL, `Broker_SetAlertThresholds` shall return `BROKER_INVALIDARG`. ]
+TEST_FUNCTION(Broker_SetAlertThresholds_fails_with_null_thresholds)
 {
     ///arrange
     CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    mocks.ResetAllCalls();
+
+    ///act
+    auto result = Broker_SetAlertThresholds(broker, NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_INVALIDARG);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
 
+//Tests_SRS_BROKER_31_052: [ `Broker_SetAlertThresholds` shall copy `thresholds` under the alert lock, or under `modules_lock` if no alert callback was set yet, and return `BROKER_OK`. ]
+TEST_FUNCTION(Broker_SetAlertThresholds_succeeds)
+{
+    ///arrange
+    CBrokerMocks mocks;
     auto broker = Broker_Create();
+    BROKER_ALERT_THRESHOLDS thresholds = { 10, 100 };
+    mocks.ResetAllCalls();
 
-    // create a message to send
-    unsigned char fake;
-    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
-    auto message = Message_Create(&c);
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
 
-    auto result = Broker_AddModule(broker, &fake_module);
+    ///act
+    auto result = Broker_SetAlertThresholds(broker, &thresholds);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
 
+//Tests_SRS_BROKER_31_052: [ `Broker_SetAlertThresholds` shall copy `thresholds` under the alert lock, or under `modules_lock` if no alert callback was set yet, and return `BROKER_OK`. ]
+TEST_FUNCTION(Broker_SetAlertThresholds_copies_under_the_alert_lock)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    (void)Broker_SetAlertCallback(broker, FakeAlert_Callback, NULL);
+    BROKER_ALERT_THRESHOLDS thresholds = { 10, 100 };
     mocks.ResetAllCalls();
 
-    // this is for Broker_Publish
     STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, Message_Clone(message));
-    STRICT_EXPECTED_CALL(mocks, Message_Destroy(message));
-    STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(message, NULL, 0))
-        .SetFailReturn(-1);
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
 
     ///act
-    result = Broker_Publish(broker, fake_module_handle, message);
+    auto result = Broker_SetAlertThresholds(broker, &thresholds);
 
     ///assert
-    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
     mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
-    Message_Destroy(message);
-    Broker_RemoveModule(broker, &fake_module);
     Broker_Destroy(broker);
 }
 
-//Tests_SRS_BROKER_13_037: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]
-TEST_FUNCTION(Broker_Publish_fails_when_allocmsg_fails)
+//Tests_SRS_BROKER_31_053: [ If `broker` is NULL, `Broker_ReportAlert` shall do nothing. ]
+TEST_FUNCTION(Broker_ReportAlert_does_nothing_with_null_broker)
 {
     ///arrange
     CBrokerMocks mocks;
 
-    auto broker = Broker_Create();
+    ///act
+    Broker_ReportAlert(NULL, BROKER_ALERT_MODULE_DETACHED, fake_module_handle, 0, 0);
 
-    // create a message to send
-    unsigned char fake;
-    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
-    auto message = Message_Create(&c);
+    ///assert
+    ASSERT_ARE_EQUAL(size_t, 0, alert_call_status.call_count);
+    mocks.AssertActualAndExpectedCalls();
 
-    auto result = Broker_AddModule(broker, &fake_module);
+    ///cleanup
+}
 
+//Tests_SRS_BROKER_31_054: [ `Broker_ReportAlert` shall call the alert callback, if any, with `alert`, `module`, `value` and `threshold` under the alert lock. ]
+TEST_FUNCTION(Broker_ReportAlert_calls_the_alert_callback)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    (void)Broker_SetAlertCallback(broker, FakeAlert_Callback, (void*)0x51);
     mocks.ResetAllCalls();
 
-    // this is for Broker_Publish
     STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, Message_Clone(message));
-    STRICT_EXPECTED_CALL(mocks, Message_Destroy(message));
-    STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(message, NULL, 0));
-    STRICT_EXPECTED_CALL(mocks, nn_allocmsg(1 + sizeof(MODULE_HANDLE), 0))
-        .SetFailReturn(nullptr);
 
     ///act
-    result = Broker_Publish(broker, fake_module_handle, message);
+    Broker_ReportAlert(broker, BROKER_ALERT_MODULE_DETACHED, fake_module_handle, 0, 0);
 
     ///assert
-    ASSERT_ARE_EQUAL(int, result, BROKER_ERROR);
+    ASSERT_ARE_EQUAL(size_t, 1, alert_call_status.call_count);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)0x51, alert_call_status.context);
+    ASSERT_IS_TRUE(alert_call_status.alert == BROKER_ALERT_MODULE_DETACHED);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)fake_module_handle, (void*)alert_call_status.module);
     mocks.AssertActualAndExpectedCalls();
 
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_31_044: [ If the broker reports alerts, the function shall create the list of modules linked to the module, the lock of the count of messages waiting for it and a tick counter. ]
+//Tests_SRS_BROKER_31_045: [ If both modules track their inbox, adding or removing a link shall add the sink to or remove it from the sinks of the source, counting the links between them. ]
+//Tests_SRS_BROKER_31_040: [ If the inbox high watermark is not 0, `Broker_Publish` shall count the message in the inbox of each sink of the source, and report `BROKER_ALERT_INBOX_HIGH_WATERMARK` once when the count goes above the watermark, until the inbox of the module empties. ]
+//Tests_SRS_BROKER_31_055: [ `Broker_Publish` shall report the alerts of the message after it released `modules_lock`. ]
+TEST_FUNCTION(Broker_Publish_reports_inbox_high_watermark_once)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    (void)Broker_SetAlertCallback(broker, FakeAlert_Callback, NULL);
+    BROKER_ALERT_THRESHOLDS thresholds = { 1, 0 };
+    (void)Broker_SetAlertThresholds(broker, &thresholds);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+
+    (void)Broker_AddModule(broker, &fake_module);
+    (void)Broker_AddModule(broker, &fake_sink_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_sink_module_handle
+    };
+    (void)Broker_AddLink(broker, &bld);
+    mocks.ResetAllCalls();
+
+    ///act
+    auto result1 = Broker_Publish(broker, fake_module_handle, message);
+    auto result2 = Broker_Publish(broker, fake_module_handle, message);
+    auto result3 = Broker_Publish(broker, fake_module_handle, message);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result1, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result2, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result3, BROKER_OK);
+    ASSERT_ARE_EQUAL(size_t, 1, alert_call_status.call_count);
+    ASSERT_IS_TRUE(alert_call_status.alert == BROKER_ALERT_INBOX_HIGH_WATERMARK);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)fake_sink_module_handle, (void*)alert_call_status.module);
+    ASSERT_ARE_EQUAL(size_t, 2, alert_call_status.value);
+    ASSERT_ARE_EQUAL(size_t, 1, alert_call_status.threshold);
+    ASSERT_ARE_EQUAL(size_t, 1, alert_call_status.held_locks);
+
     ///cleanup
     Message_Destroy(message);
+    Broker_RemoveLink(broker, &bld);
+    Broker_RemoveModule(broker, &fake_sink_module);
     Broker_RemoveModule(broker, &fake_module);
     Broker_Destroy(broker);
 }
 
-//Tests_SRS_BROKER_13_037: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]
-TEST_FUNCTION(Broker_Publish_fails_when_send_fails)
+//Tests_SRS_BROKER_31_056: [ `Broker_RemoveModule` and `Broker_DrainModule` shall remove the module from the sinks of every module linked to it. ]
+TEST_FUNCTION(Broker_Publish_does_not_count_for_a_removed_sink)
 {
     ///arrange
     CBrokerMocks mocks;
-
     auto broker = Broker_Create();
+    (void)Broker_SetAlertCallback(broker, FakeAlert_Callback, NULL);
+    BROKER_ALERT_THRESHOLDS thresholds = { 1, 0 };
+    (void)Broker_SetAlertThresholds(broker, &thresholds);
 
-    // create a message to send
     unsigned char fake;
     MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
     auto message = Message_Create(&c);
 
-    auto result = Broker_AddModule(broker, &fake_module);
-
+    (void)Broker_AddModule(broker, &fake_module);
+    (void)Broker_AddModule(broker, &fake_sink_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_sink_module_handle
+    };
+    (void)Broker_AddLink(broker, &bld);
+    (void)Broker_RemoveModule(broker, &fake_sink_module);
     mocks.ResetAllCalls();
 
-    // this is for Broker_Publish
-    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, Message_Clone(message));
-    STRICT_EXPECTED_CALL(mocks, Message_Destroy(message));
-    STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(message, NULL, 0));
-    STRICT_EXPECTED_CALL(mocks, nn_allocmsg(1 + sizeof(MODULE_HANDLE), 0))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, nn_freemsg(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(message, IGNORED_PTR_ARG, 1))
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, 0))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .SetFailReturn((int)-1);
-
     ///act
-    result = Broker_Publish(broker, fake_module_handle, message);
+    auto result1 = Broker_Publish(broker, fake_module_handle, message);
+    auto result2 = Broker_Publish(broker, fake_module_handle, message);
 
     ///assert
-    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
-    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result1, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result2, BROKER_OK);
+    ASSERT_ARE_EQUAL(size_t, 0, alert_call_status.call_count);
 
     ///cleanup
     Message_Destroy(message);
@@ -3310,56 +4905,37 @@ TEST_FUNCTION(Broker_Publish_fails_when_send_fails)
     Broker_Destroy(broker);
 }
 
-//Tests_SRS_BROKER_17_022: [ Broker_Publish shall Lock the modules lock. ]
-//Tests_SRS_BROKER_17_007: [Broker_Publish shall clone the message.]
-//Tests_SRS_BROKER_17_008: [ Broker_Publish shall serialize the message. ]
-//Tests_SRS_BROKER_17_025: [ Broker_Publish shall allocate a nanomsg buffer the size of the serialized message + sizeof(MODULE_HANDLE). ]
-//Tests_SRS_BROKER_17_026: [ Broker_Publish shall copy source into the beginning of the nanomsg buffer. ]
-//Tests_SRS_BROKER_17_027: [ Broker_Publish shall serialize the message into the remainder of the nanomsg buffer. ]
-//Tests_SRS_BROKER_17_010: [ Broker_Publish shall send a message on the publish_socket. ]
-//Tests_SRS_BROKER_17_011: [ Broker_Publish shall free the serialized message data. ]
-//Tests_SRS_BROKER_17_012: [ Broker_Publish shall free the message. ]
-//Tests_SRS_BROKER_17_023: [ Broker_Publish shall Unlock the modules lock. ]
-//Tests_SRS_BROKER_13_037 : [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]
-TEST_FUNCTION(Broker_Publish_succeeds)
+//Tests_SRS_BROKER_31_046: [ If the message cannot be sent, `Broker_Publish` shall report `BROKER_ALERT_MESSAGE_DROPPED` for the source. ]
+//Tests_SRS_BROKER_31_055: [ `Broker_Publish` shall report the alerts of the message after it released `modules_lock`. ]
+TEST_FUNCTION(Broker_Publish_reports_dropped_message_when_send_fails)
 {
     ///arrange
     CBrokerMocks mocks;
-
     auto broker = Broker_Create();
+    (void)Broker_SetAlertCallback(broker, FakeAlert_Callback, NULL);
 
-    // create a message to send
     unsigned char fake;
     MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
     auto message = Message_Create(&c);
 
-    auto result = Broker_AddModule(broker, &fake_module);
-
+    (void)Broker_AddModule(broker, &fake_module);
     mocks.ResetAllCalls();
 
-    // this is for Broker_Publish
-    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, Message_Clone(message));
-    STRICT_EXPECTED_CALL(mocks, Message_Destroy(message));
-    STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(message, NULL, 0));
-    STRICT_EXPECTED_CALL(mocks, nn_allocmsg(1 + sizeof(MODULE_HANDLE), 0))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(message, IGNORED_PTR_ARG, 1))
-        .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, 0))
         .IgnoreArgument(1)
-        .IgnoreArgument(2);
-
+        .IgnoreArgument(2)
+        .SetFailReturn((int)-1);
 
     ///act
-    result = Broker_Publish(broker, fake_module_handle, message);
+    auto result = Broker_Publish(broker, fake_module_handle, message);
 
     ///assert
-    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
-    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+    ASSERT_ARE_EQUAL(size_t, 1, alert_call_status.call_count);
+    ASSERT_IS_TRUE(alert_call_status.alert == BROKER_ALERT_MESSAGE_DROPPED);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)fake_module_handle, (void*)alert_call_status.module);
+    /* only the alert lock */
+    ASSERT_ARE_EQUAL(size_t, 1, alert_call_status.held_locks);
 
     ///cleanup
     Message_Destroy(message);
@@ -3367,5 +4943,4 @@ TEST_FUNCTION(Broker_Publish_succeeds)
     Broker_Destroy(broker);
 }
 
-
 END_TEST_SUITE(broker_ut)
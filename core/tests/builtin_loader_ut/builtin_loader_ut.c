@@ -0,0 +1,587 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+static bool malloc_will_fail = false;
+static size_t malloc_fail_count = 0;
+static size_t malloc_count = 0;
+
+void* my_gballoc_malloc(size_t size)
+{
+    ++malloc_count;
+
+    void* result;
+    if (malloc_will_fail == true && malloc_count == malloc_fail_count)
+    {
+        result = NULL;
+    }
+    else
+    {
+        result = malloc(size);
+    }
+
+    return result;
+}
+
+void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umock_c_negative_tests.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_bool.h"
+#include "umocktypes_stdint.h"
+
+#include "real_strings.h"
+
+#define ENABLE_MOCKS
+
+#define GATEWAY_EXPORT_H
+#define GATEWAY_EXPORT
+
+#include "azure_c_shared_utility/strings.h"
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/vector.h"
+
+#include "parson.h"
+#include "module_loader.h"
+
+#undef ENABLE_MOCKS
+
+#include "module_loaders/builtin_loader.h"
+
+#define ENABLE_MOCKS
+
+static pfModuleLoader_Load BuiltinModuleLoader_Load = NULL;
+static pfModuleLoader_Unload BuiltinModuleLoader_Unload = NULL;
+static pfModuleLoader_GetApi BuiltinModuleLoader_GetModuleApi = NULL;
+static pfModuleLoader_ParseEntrypointFromJson BuiltinModuleLoader_ParseEntrypointFromJson = NULL;
+static pfModuleLoader_FreeEntrypoint BuiltinModuleLoader_FreeEntrypoint = NULL;
+static pfModuleLoader_ParseConfigurationFromJson BuiltinModuleLoader_ParseConfigurationFromJson = NULL;
+static pfModuleLoader_FreeConfiguration BuiltinModuleLoader_FreeConfiguration = NULL;
+static pfModuleLoader_BuildModuleConfiguration BuiltinModuleLoader_BuildModuleConfiguration = NULL;
+static pfModuleLoader_FreeModuleConfiguration BuiltinModuleLoader_FreeModuleConfiguration = NULL;
+
+MOCKABLE_FUNCTION(, JSON_Object*, json_value_get_object, const JSON_Value*, value);
+MOCKABLE_FUNCTION(, const char*, json_object_get_string, const JSON_Object*, object, const char*, name);
+MOCKABLE_FUNCTION(, JSON_Value_Type, json_value_get_type, const JSON_Value*, value);
+
+//=============================================================================
+//Globals
+//=============================================================================
+
+#ifdef WIN32
+static TEST_MUTEX_HANDLE g_dllByDll;
+#endif
+static TEST_MUTEX_HANDLE g_testByTest;
+
+void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    (void)error_code;
+    ASSERT_FAIL("umock_c reported error");
+}
+
+//parson mocks
+MOCK_FUNCTION_WITH_CODE(, JSON_Object*, json_value_get_object, const JSON_Value*, value)
+    JSON_Object* obj = NULL;
+    if (value != NULL)
+    {
+        obj = (JSON_Object*)0x42;
+    }
+MOCK_FUNCTION_END(obj)
+
+MOCK_FUNCTION_WITH_CODE(, const char*, json_object_get_string, const JSON_Object*, object, const char*, name)
+    const char* str = NULL;
+    if (object != NULL && name != NULL)
+    {
+        str = "hello_world";
+    }
+MOCK_FUNCTION_END(str)
+
+MOCK_FUNCTION_WITH_CODE(, JSON_Value_Type, json_value_get_type, const JSON_Value*, value)
+    JSON_Value_Type val = JSONError;
+    if (value != NULL)
+    {
+        val = JSONObject;
+    }
+MOCK_FUNCTION_END(val)
+
+// the module linked into the program
+MOCK_FUNCTION_WITH_CODE(, MODULE_HANDLE, Fake_Create, BROKER_HANDLE, broker, const void*, configuration)
+MOCK_FUNCTION_END((MODULE_HANDLE)0x42)
+
+MOCK_FUNCTION_WITH_CODE(, void, Fake_Destroy, MODULE_HANDLE, moduleHandle)
+MOCK_FUNCTION_END()
+
+MOCK_FUNCTION_WITH_CODE(, void, Fake_Receive, MODULE_HANDLE, moduleHandle, MESSAGE_HANDLE, messageHandle)
+MOCK_FUNCTION_END()
+
+#undef ENABLE_MOCKS
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+VECTOR_HANDLE real_VECTOR_create(size_t elementSize);
+void real_VECTOR_destroy(VECTOR_HANDLE handle);
+int real_VECTOR_push_back(VECTOR_HANDLE handle, const void* elements, size_t numElements);
+void real_VECTOR_erase(VECTOR_HANDLE handle, void* elements, size_t numElements);
+void* real_VECTOR_find_if(const VECTOR_HANDLE handle, PREDICATE_FUNCTION pred, const void* value);
+size_t real_VECTOR_size(const VECTOR_HANDLE handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+static const MODULE_API_1 fake_module_api =
+{
+    { MODULE_API_VERSION_1 },
+
+    NULL,
+    NULL,
+    Fake_Create,
+    Fake_Destroy,
+    Fake_Receive,
+    NULL
+};
+
+static const MODULE_API_1 fake_module_api_without_create =
+{
+    { MODULE_API_VERSION_1 },
+
+    NULL,
+    NULL,
+    NULL,
+    Fake_Destroy,
+    Fake_Receive,
+    NULL
+};
+
+static const MODULE_API* fake_get_api(MODULE_API_VERSION gateway_api_version)
+{
+    (void)gateway_api_version;
+    return (const MODULE_API*)&fake_module_api;
+}
+
+static const MODULE_API* fake_get_api_without_create(MODULE_API_VERSION gateway_api_version)
+{
+    (void)gateway_api_version;
+    return (const MODULE_API*)&fake_module_api_without_create;
+}
+
+static const MODULE_API* fake_get_no_api(MODULE_API_VERSION gateway_api_version)
+{
+    (void)gateway_api_version;
+    return NULL;
+}
+
+TEST_DEFINE_ENUM_TYPE(MODULE_LOADER_TYPE, MODULE_LOADER_TYPE_VALUES);
+TEST_DEFINE_ENUM_TYPE(MODULE_LOADER_RESULT, MODULE_LOADER_RESULT_VALUES);
+
+BEGIN_TEST_SUITE(BuiltinLoader_UnitTests)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+    umocktypes_charptr_register_types();
+    umocktypes_stdint_register_types();
+
+    REGISTER_UMOCK_ALIAS_TYPE(MODULE_LOADER_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(MODULE_LOADER_TYPE, int);
+    REGISTER_UMOCK_ALIAS_TYPE(STRING_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(VECTOR_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(PREDICATE_FUNCTION, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(MODULE_LIBRARY_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(MODULE_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(MESSAGE_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(BROKER_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(JSON_Value_Type, int);
+
+    // malloc/free hooks
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+
+    // Strings hooks
+    REGISTER_GLOBAL_MOCK_HOOK(STRING_construct, real_STRING_construct);
+    REGISTER_GLOBAL_MOCK_HOOK(STRING_delete, real_STRING_delete);
+    REGISTER_GLOBAL_MOCK_HOOK(STRING_c_str, real_STRING_c_str);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(STRING_construct, NULL);
+
+    // Vector hooks
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_create, real_VECTOR_create);
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_destroy, real_VECTOR_destroy);
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_push_back, real_VECTOR_push_back);
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_erase, real_VECTOR_erase);
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_find_if, real_VECTOR_find_if);
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_size, real_VECTOR_size);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(VECTOR_create, NULL);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(VECTOR_push_back, -1);
+
+    const MODULE_LOADER* loader = BuiltinLoader_Get();
+    BuiltinModuleLoader_Load = loader->api->Load;
+    BuiltinModuleLoader_Unload = loader->api->Unload;
+    BuiltinModuleLoader_GetModuleApi = loader->api->GetApi;
+    BuiltinModuleLoader_ParseEntrypointFromJson = loader->api->ParseEntrypointFromJson;
+    BuiltinModuleLoader_FreeEntrypoint = loader->api->FreeEntrypoint;
+    BuiltinModuleLoader_ParseConfigurationFromJson = loader->api->ParseConfigurationFromJson;
+    BuiltinModuleLoader_FreeConfiguration = loader->api->FreeConfiguration;
+    BuiltinModuleLoader_BuildModuleConfiguration = loader->api->BuildModuleConfiguration;
+    BuiltinModuleLoader_FreeModuleConfiguration = loader->api->FreeModuleConfiguration;
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    umock_c_deinit();
+
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest) != 0)
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    umock_c_reset_all_calls();
+    malloc_will_fail = false;
+    malloc_fail_count = 0;
+    malloc_count = 0;
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+//Tests_SRS_BUILTIN_MODULE_LOADER_31_001: [ BuiltinLoader_RegisterModule shall return MODULE_LOADER_ERROR if name or module_get_api is NULL. ]
+TEST_FUNCTION(BuiltinLoader_RegisterModule_returns_MODULE_LOADER_ERROR_when_args_are_NULL)
+{
+    // act
+    MODULE_LOADER_RESULT null_name_result = BuiltinLoader_RegisterModule(NULL, fake_get_api);
+    MODULE_LOADER_RESULT null_get_api_result = BuiltinLoader_RegisterModule("hello_world", NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(MODULE_LOADER_RESULT, MODULE_LOADER_ERROR, null_name_result);
+    ASSERT_ARE_EQUAL(MODULE_LOADER_RESULT, MODULE_LOADER_ERROR, null_get_api_result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+//Tests_SRS_BUILTIN_MODULE_LOADER_31_003: [ BuiltinLoader_RegisterModule shall create the table of registered modules if it does not exist. ]
+//Tests_SRS_BUILTIN_MODULE_LOADER_31_005: [ BuiltinLoader_RegisterModule shall add name and module_get_api to the table and return MODULE_LOADER_SUCCESS. ]
+//Tests_SRS_BUILTIN_MODULE_LOADER_31_007: [ BuiltinLoader_UnregisterModule shall remove the module from the table, and destroy the table once it is empty. ]
+TEST_FUNCTION(BuiltinLoader_RegisterModule_creates_the_table_and_UnregisterModule_destroys_it)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(VECTOR_create(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    // act
+    MODULE_LOADER_RESULT result = BuiltinLoader_RegisterModule("hello_world", fake_get_api);
+    BuiltinLoader_UnregisterModule("hello_world");
+
+    // assert
+    ASSERT_ARE_EQUAL(MODULE_LOADER_RESULT, MODULE_LOADER_SUCCESS, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+//Tests_SRS_BUILTIN_MODULE_LOADER_31_002: [ BuiltinLoader_RegisterModule shall return MODULE_LOADER_ERROR if a module is already registered with name. ]
+TEST_FUNCTION(BuiltinLoader_RegisterModule_returns_MODULE_LOADER_ERROR_when_the_name_is_registered)
+{
+    // arrange
+    (void)BuiltinLoader_RegisterModule("hello_world", fake_get_api);
+    umock_c_reset_all_calls();
+
+    // act
+    MODULE_LOADER_RESULT result = BuiltinLoader_RegisterModule("hello_world", fake_get_api_without_create);
+
+    // assert
+    ASSERT_ARE_EQUAL(MODULE_LOADER_RESULT, MODULE_LOADER_ERROR, result);
+
+    // cleanup
+    BuiltinLoader_UnregisterModule("hello_world");
+}
+
+//Tests_SRS_BUILTIN_MODULE_LOADER_31_004: [ BuiltinLoader_RegisterModule shall return MODULE_LOADER_ERROR if an underlying platform call fails. ]
+TEST_FUNCTION(BuiltinLoader_RegisterModule_returns_MODULE_LOADER_ERROR_when_things_fail)
+{
+    // arrange
+    int result = 0;
+    result = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    STRICT_EXPECTED_CALL(VECTOR_create(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+
+    umock_c_negative_tests_snapshot();
+
+    for (size_t i = 0; i < umock_c_negative_tests_call_count(); i++)
+    {
+        // arrange
+        umock_c_negative_tests_reset();
+        umock_c_negative_tests_fail_call(i);
+
+        // act
+        MODULE_LOADER_RESULT result = BuiltinLoader_RegisterModule("hello_world", fake_get_api);
+
+        // assert
+        ASSERT_ARE_EQUAL(MODULE_LOADER_RESULT, MODULE_LOADER_ERROR, result);
+    }
+
+    umock_c_negative_tests_deinit();
+}
+
+//Tests_SRS_BUILTIN_MODULE_LOADER_31_006: [ BuiltinLoader_UnregisterModule shall do nothing if no module is registered with name. ]
+TEST_FUNCTION(BuiltinLoader_UnregisterModule_does_nothing_when_the_name_is_not_registered)
+{
+    // act
+    BuiltinLoader_UnregisterModule("hello_world");
+    BuiltinLoader_UnregisterModule(NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+//Tests_SRS_BUILTIN_MODULE_LOADER_31_008: [ BuiltinModuleLoader_Load shall return NULL if loader or entrypoint is NULL. ]
+//Tests_SRS_BUILTIN_MODULE_LOADER_31_009: [ BuiltinModuleLoader_Load shall return NULL if loader->type is not NATIVE. ]
+TEST_FUNCTION(BuiltinModuleLoader_Load_returns_NULL_when_args_are_invalid)
+{
+    // arrange
+    BUILTIN_LOADER_ENTRYPOINT entrypoint = { NULL };
+    MODULE_LOADER loader =
+    {
+        NODEJS,
+        NULL, NULL, NULL
+    };
+
+    // act
+    MODULE_LIBRARY_HANDLE null_loader_result = BuiltinModuleLoader_Load(NULL, &entrypoint);
+    MODULE_LIBRARY_HANDLE null_entrypoint_result = BuiltinModuleLoader_Load(BuiltinLoader_Get(), NULL);
+    MODULE_LIBRARY_HANDLE not_native_result = BuiltinModuleLoader_Load(&loader, &entrypoint);
+
+    // assert
+    ASSERT_IS_NULL(null_loader_result);
+    ASSERT_IS_NULL(null_entrypoint_result);
+    ASSERT_IS_NULL(not_native_result);
+}
+
+//Tests_SRS_BUILTIN_MODULE_LOADER_31_010: [ BuiltinModuleLoader_Load shall return NULL if no module is registered with entrypoint->moduleName. ]
+TEST_FUNCTION(BuiltinModuleLoader_Load_returns_NULL_when_the_module_is_not_registered)
+{
+    // arrange
+    BUILTIN_LOADER_ENTRYPOINT entrypoint = { real_STRING_construct("hello_world") };
+
+    // act
+    MODULE_LIBRARY_HANDLE result = BuiltinModuleLoader_Load(BuiltinLoader_Get(), &entrypoint);
+
+    // assert
+    ASSERT_IS_NULL(result);
+
+    // cleanup
+    real_STRING_delete(entrypoint.moduleName);
+}
+
+//Tests_SRS_BUILTIN_MODULE_LOADER_31_011: [ BuiltinModuleLoader_Load shall call the registered module_get_api to acquire the module API table, without loading a library. ]
+//Tests_SRS_BUILTIN_MODULE_LOADER_31_013: [ BuiltinModuleLoader_Load shall return the MODULE_API as the MODULE_LIBRARY_HANDLE when successful. ]
+//Tests_SRS_BUILTIN_MODULE_LOADER_31_014: [ BuiltinModuleLoader_GetModuleApi shall return moduleLibraryHandle, which is NULL or the MODULE_API of the module. ]
+//Tests_SRS_BUILTIN_MODULE_LOADER_31_015: [ BuiltinModuleLoader_Unload shall do nothing. ]
+TEST_FUNCTION(BuiltinModuleLoader_Load_returns_the_api_of_the_registered_module)
+{
+    // arrange
+    BUILTIN_LOADER_ENTRYPOINT entrypoint = { real_STRING_construct("hello_world") };
+    (void)BuiltinLoader_RegisterModule("hello_world", fake_get_api);
+    umock_c_reset_all_calls();
+
+    // act
+    MODULE_LIBRARY_HANDLE library = BuiltinModuleLoader_Load(BuiltinLoader_Get(), &entrypoint);
+    const MODULE_API* api = BuiltinModuleLoader_GetModuleApi(BuiltinLoader_Get(), library);
+    BuiltinModuleLoader_Unload(BuiltinLoader_Get(), library);
+
+    // assert
+    ASSERT_IS_NOT_NULL(library);
+    ASSERT_ARE_EQUAL(void_ptr, &fake_module_api, api);
+    ASSERT_IS_NULL(BuiltinModuleLoader_GetModuleApi(BuiltinLoader_Get(), NULL));
+
+    // cleanup
+    BuiltinLoader_UnregisterModule("hello_world");
+    real_STRING_delete(entrypoint.moduleName);
+}
+
+//Tests_SRS_BUILTIN_MODULE_LOADER_31_012: [ BuiltinModuleLoader_Load shall return NULL if the MODULE_API is NULL, newer than Module_ApiGatewayVersion, or lacks Module_Create, Module_Destroy or Module_Receive. ]
+TEST_FUNCTION(BuiltinModuleLoader_Load_returns_NULL_when_the_module_api_is_invalid)
+{
+    // arrange
+    BUILTIN_LOADER_ENTRYPOINT no_api = { real_STRING_construct("no_api") };
+    BUILTIN_LOADER_ENTRYPOINT no_create = { real_STRING_construct("no_create") };
+    (void)BuiltinLoader_RegisterModule("no_api", fake_get_no_api);
+    (void)BuiltinLoader_RegisterModule("no_create", fake_get_api_without_create);
+    umock_c_reset_all_calls();
+
+    // act
+    MODULE_LIBRARY_HANDLE no_api_result = BuiltinModuleLoader_Load(BuiltinLoader_Get(), &no_api);
+    MODULE_LIBRARY_HANDLE no_create_result = BuiltinModuleLoader_Load(BuiltinLoader_Get(), &no_create);
+
+    // assert
+    ASSERT_IS_NULL(no_api_result);
+    ASSERT_IS_NULL(no_create_result);
+
+    // cleanup
+    BuiltinLoader_UnregisterModule("no_api");
+    BuiltinLoader_UnregisterModule("no_create");
+    real_STRING_delete(no_api.moduleName);
+    real_STRING_delete(no_create.moduleName);
+}
+
+//Tests_SRS_BUILTIN_MODULE_LOADER_31_016: [ BuiltinModuleLoader_ParseEntrypointFromJson shall return NULL if json is NULL or not an object. ]
+TEST_FUNCTION(BuiltinModuleLoader_ParseEntrypointFromJson_returns_NULL_when_json_is_not_an_object)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(json_value_get_type((const JSON_Value*)0x42))
+        .SetReturn(JSONArray);
+
+    // act
+    void* null_json_result = BuiltinModuleLoader_ParseEntrypointFromJson(BuiltinLoader_Get(), NULL);
+    void* array_result = BuiltinModuleLoader_ParseEntrypointFromJson(BuiltinLoader_Get(), (const JSON_Value*)0x42);
+
+    // assert
+    ASSERT_IS_NULL(null_json_result);
+    ASSERT_IS_NULL(array_result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+//Tests_SRS_BUILTIN_MODULE_LOADER_31_017: [ BuiltinModuleLoader_ParseEntrypointFromJson shall return NULL if module.name does not exist. ]
+TEST_FUNCTION(BuiltinModuleLoader_ParseEntrypointFromJson_returns_NULL_when_module_name_is_missing)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(json_value_get_type((const JSON_Value*)0x42));
+    STRICT_EXPECTED_CALL(json_value_get_object((const JSON_Value*)0x42));
+    STRICT_EXPECTED_CALL(json_object_get_string((const JSON_Object*)0x42, "module.name"))
+        .SetReturn(NULL);
+
+    // act
+    void* result = BuiltinModuleLoader_ParseEntrypointFromJson(BuiltinLoader_Get(), (const JSON_Value*)0x42);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+//Tests_SRS_BUILTIN_MODULE_LOADER_31_018: [ BuiltinModuleLoader_ParseEntrypointFromJson shall return NULL if an underlying platform call fails. ]
+TEST_FUNCTION(BuiltinModuleLoader_ParseEntrypointFromJson_returns_NULL_when_things_fail)
+{
+    // arrange
+    int result = 0;
+    result = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    STRICT_EXPECTED_CALL(json_value_get_type((const JSON_Value*)0x42));
+    STRICT_EXPECTED_CALL(json_value_get_object((const JSON_Value*)0x42));
+    STRICT_EXPECTED_CALL(json_object_get_string((const JSON_Object*)0x42, "module.name"));
+    STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(BUILTIN_LOADER_ENTRYPOINT)))
+        .SetFailReturn(NULL);
+    STRICT_EXPECTED_CALL(STRING_construct("hello_world"));
+
+    umock_c_negative_tests_snapshot();
+
+    // the JSON calls have no failure mode of their own, only malloc and STRING_construct do
+    for (size_t i = 3; i < umock_c_negative_tests_call_count(); i++)
+    {
+        // arrange
+        umock_c_negative_tests_reset();
+        umock_c_negative_tests_fail_call(i);
+
+        // act
+        void* result = BuiltinModuleLoader_ParseEntrypointFromJson(BuiltinLoader_Get(), (const JSON_Value*)0x42);
+
+        // assert
+        ASSERT_IS_NULL(result);
+    }
+
+    umock_c_negative_tests_deinit();
+}
+
+//Tests_SRS_BUILTIN_MODULE_LOADER_31_019: [ BuiltinModuleLoader_ParseEntrypointFromJson shall return an entrypoint holding a copy of module.name. ]
+//Tests_SRS_BUILTIN_MODULE_LOADER_31_020: [ BuiltinModuleLoader_FreeEntrypoint shall free resources allocated during BuiltinModuleLoader_ParseEntrypointFromJson. ]
+TEST_FUNCTION(BuiltinModuleLoader_ParseEntrypointFromJson_succeeds)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(json_value_get_type((const JSON_Value*)0x42));
+    STRICT_EXPECTED_CALL(json_value_get_object((const JSON_Value*)0x42));
+    STRICT_EXPECTED_CALL(json_object_get_string((const JSON_Object*)0x42, "module.name"));
+    STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(BUILTIN_LOADER_ENTRYPOINT)));
+    STRICT_EXPECTED_CALL(STRING_construct("hello_world"));
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    // act
+    BUILTIN_LOADER_ENTRYPOINT* result = (BUILTIN_LOADER_ENTRYPOINT*)BuiltinModuleLoader_ParseEntrypointFromJson(BuiltinLoader_Get(), (const JSON_Value*)0x42);
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, "hello_world", real_STRING_c_str(result->moduleName));
+    BuiltinModuleLoader_FreeEntrypoint(BuiltinLoader_Get(), result);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+//Tests_SRS_BUILTIN_MODULE_LOADER_31_021: [ BuiltinModuleLoader_FreeEntrypoint shall do nothing if entrypoint is NULL. ]
+//Tests_SRS_BUILTIN_MODULE_LOADER_31_022: [ BuiltinModuleLoader_ParseConfigurationFromJson shall return NULL. ]
+//Tests_SRS_BUILTIN_MODULE_LOADER_31_023: [ BuiltinModuleLoader_FreeConfiguration shall do nothing. ]
+//Tests_SRS_BUILTIN_MODULE_LOADER_31_024: [ BuiltinModuleLoader_BuildModuleConfiguration shall return module_configuration. ]
+//Tests_SRS_BUILTIN_MODULE_LOADER_31_025: [ BuiltinModuleLoader_FreeModuleConfiguration shall do nothing. ]
+TEST_FUNCTION(BuiltinModuleLoader_configuration_functions_pass_the_configuration_through)
+{
+    // act
+    BuiltinModuleLoader_FreeEntrypoint(BuiltinLoader_Get(), NULL);
+    MODULE_LOADER_BASE_CONFIGURATION* loader_configuration = BuiltinModuleLoader_ParseConfigurationFromJson(BuiltinLoader_Get(), (const JSON_Value*)0x42);
+    BuiltinModuleLoader_FreeConfiguration(BuiltinLoader_Get(), NULL);
+    void* module_configuration = BuiltinModuleLoader_BuildModuleConfiguration(BuiltinLoader_Get(), (void*)0x42, (void*)0x43);
+    BuiltinModuleLoader_FreeModuleConfiguration(BuiltinLoader_Get(), module_configuration);
+
+    // assert
+    ASSERT_IS_NULL(loader_configuration);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)0x43, module_configuration);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+//Tests_SRS_BUILTIN_MODULE_LOADER_31_026: [ BuiltinLoader_Get shall return a non-NULL pointer to a NATIVE MODULE_LOADER named builtin. ]
+TEST_FUNCTION(BuiltinLoader_Get_succeeds)
+{
+    // act
+    const MODULE_LOADER* loader = BuiltinLoader_Get();
+
+    // assert
+    ASSERT_IS_NOT_NULL(loader);
+    ASSERT_ARE_EQUAL(MODULE_LOADER_TYPE, NATIVE, loader->type);
+    ASSERT_ARE_EQUAL(char_ptr, BUILTIN_LOADER_NAME, loader->name);
+}
+
+END_TEST_SUITE(BuiltinLoader_UnitTests)
@@ -3,6 +3,7 @@
 
 #include <cstdlib>
 #include <cstddef>
+#include <cstring>
 #include <cstdbool>
 #include <vector>
 #include <list>
@@ -57,6 +58,7 @@ static int last_thread_result;
 
 static void* last_context;
 static void* last_user_param;
+static GATEWAY_ALERT_CONTEXT last_alert;
 
 static VECTOR_HANDLE module_list;
 
@@ -188,8 +190,9 @@ public:
     MOCK_STATIC_METHOD_1(, COND_RESULT, Condition_Post, COND_HANDLE, handle);
     MOCK_METHOD_END(COND_RESULT, COND_OK);
 
+    /* the simulated thread waits for the next event once its queue is empty, failing lets it return */
     MOCK_STATIC_METHOD_3(, COND_RESULT, Condition_Wait, COND_HANDLE, handle, LOCK_HANDLE, lock, int, timeout_milliseconds);
-    MOCK_METHOD_END(COND_RESULT, COND_OK);
+    MOCK_METHOD_END(COND_RESULT, COND_ERROR);
 
     MOCK_STATIC_METHOD_1(, void, Condition_Deinit, COND_HANDLE, handle);
         BASEIMPLEMENTATION::gballoc_free(handle);
@@ -287,6 +290,15 @@ static void catch_context_callback(GATEWAY_HANDLE gw, GATEWAY_EVENT event_type,
     last_user_param = user_param;
 }
 
+static void catch_alert_callback(GATEWAY_HANDLE gw, GATEWAY_EVENT event_type, GATEWAY_EVENT_CTX ctx, void* user_param)
+{
+    (void)gw;
+    (void)event_type;
+    (void)user_param;
+    last_context = ctx;
+    last_alert = *(GATEWAY_ALERT_CONTEXT*)ctx;
+}
+
 BEGIN_TEST_SUITE(event_system_ut)
 
 TEST_SUITE_INITIALIZE(TestClassInitialize)
@@ -323,6 +335,7 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
     last_thread_func = NULL;
     module_list = NULL;
     last_context = NULL;
+    memset(&last_alert, 0, sizeof(last_alert));
 }
 
 TEST_FUNCTION_CLEANUP(TestMethodCleanup)
@@ -618,9 +631,9 @@ TEST_FUNCTION(EventSystem_Thread_Creation_Fails)
 
     // Expect
     EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(5);
+        .ExpectedTimesExactly(6);
     EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(5);
+        .ExpectedTimesExactly(6);
     EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG));
     EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG));
@@ -660,8 +673,8 @@ TEST_FUNCTION(EventSystem_Thread_Creation_Fails)
     mocks.AssertActualAndExpectedCalls();
 }
 
-/* Checks that even if the thread quits after finishing the job, that another thread is created properly */
-TEST_FUNCTION(EventSystem_Recreates_Thread_When_Quit)
+/* Tests_SRS_EVENTSYSTEM_31_001: [ The thread shall be created with the first event reported and shall keep waiting for the next events until the event system is destroyed. ] */
+TEST_FUNCTION(EventSystem_Creates_One_Thread_For_All_Events)
 {
     // Arrange
     CEventSystemMocks mocks;
@@ -671,49 +684,60 @@ TEST_FUNCTION(EventSystem_Recreates_Thread_When_Quit)
 
     // Act
     ASSERT_IS_NULL((void*)last_thread_func);
-    
+
     EventSystem_ReportEvent(handle, NULL, GATEWAY_STARTED);
-    
+
     ASSERT_IS_NOT_NULL((void*)last_thread_func);
-    ASSERT_ARE_EQUAL(int, callback_gw_history->size(), 0);
-    last_thread_func(last_thread_arg);
-    ASSERT_ARE_EQUAL(int, callback_gw_history->size(), 2);
+    THREAD_START_FUNC thread_func = last_thread_func;
     last_thread_func = NULL;
-    
+
     EventSystem_ReportEvent(handle, NULL, GATEWAY_STARTED);
-    
-    ASSERT_IS_NOT_NULL((void*)last_thread_func);
-    last_thread_func(last_thread_arg);
+
+    // the second event is queued for the thread already running
+    ASSERT_IS_NULL((void*)last_thread_func);
+    ASSERT_ARE_EQUAL(int, callback_gw_history->size(), 0);
+    thread_func(last_thread_arg);
     ASSERT_ARE_EQUAL(int, callback_gw_history->size(), 4);
 
     mocks.ResetAllCalls();
 
     // All callbacks should already be consumed
-    EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG)).ExpectedAtLeastTimes(2);
-    EXPECTED_CALL(mocks, Condition_Post(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG)).ExpectedAtLeastTimes(2);
-    EXPECTED_CALL(mocks, ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, Condition_Deinit(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(2);
+    expectEventSystemDestroy(mocks, true, 0);
 
-    EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
-    EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(0);
-    EXPECTED_CALL(mocks, singlylinkedlist_remove(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(0);
+    EventSystem_Destroy(handle);
 
-    EXPECTED_CALL(mocks, singlylinkedlist_destroy(IGNORED_PTR_ARG));
+    mocks.AssertActualAndExpectedCalls();
+}
 
-    EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(GATEWAY_EVENTS_COUNT);
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+/* Tests_SRS_EVENTSYSTEM_31_002: [ Should waiting for the next event fail, the thread shall return and no further callbacks will be called during gateway's lifecycle. ] */
+TEST_FUNCTION(EventSystem_Wait_Fails_No_More_Callbacks)
+{
+    // Arrange
+    CEventSystemMocks mocks;
+    EVENTSYSTEM_HANDLE handle = EventSystem_Init();
+    EventSystem_AddEventCallback(handle, GATEWAY_STARTED, countingCallback, NULL);
+    EventSystem_ReportEvent(handle, NULL, GATEWAY_STARTED);
+    // the mocked Condition_Wait fails once the queue is empty
+    last_thread_func(last_thread_arg);
+    ASSERT_ARE_EQUAL(int, callback_gw_history->size(), 1);
+    mocks.ResetAllCalls();
+
+    // Expect
+    // Only the check of the error flag, the event system is errored
+    EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(1);
+    EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
         .ExpectedTimesExactly(1);
 
-    EventSystem_Destroy(handle);
+    // Act
+    EventSystem_ReportEvent(handle, NULL, GATEWAY_STARTED);
 
+    // Assert
     mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(int, callback_gw_history->size(), 1);
+
+    // Cleanup
+    EventSystem_Destroy(handle);
 }
 
 /* Tests_SRS_EVENTSYSTEM_26_009: [ This function shall call all registered callbacks in First-In-First-Out order in terms registration. ] */
@@ -844,6 +868,10 @@ TEST_FUNCTION(EventSystem_AddEventCallback_Vector_fail)
     mocks.ResetAllCalls();
 
     // Expect
+    EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(2);
+    EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(2);
     EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
         .SetFailReturn(1);
 
@@ -869,9 +897,9 @@ TEST_FUNCTION(EventSystem_ReportEvent_Vector_Create_Fail)
 
     // Expect
     EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
+        .ExpectedTimesExactly(2);
     EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
+        .ExpectedTimesExactly(2);
     EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .ExpectedTimesExactly(1);
     EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
@@ -899,9 +927,9 @@ TEST_FUNCTION(EventSystem_ReportEvent_Vector_Pushback_Fail)
 
     // Expect
     EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
+        .ExpectedTimesExactly(2);
     EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
+        .ExpectedTimesExactly(2);
     EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .ExpectedTimesExactly(1);
     EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
@@ -934,9 +962,9 @@ TEST_FUNCTION(EventSystem_ReportEvent_malloc_fail)
 
     // Expect
     EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(2);
+        .ExpectedTimesExactly(3);
     EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(2);
+        .ExpectedTimesExactly(3);
     EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .ExpectedTimesExactly(1);
     EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
@@ -972,9 +1000,9 @@ TEST_FUNCTION(EventSystem_ReportEvent_singlylinkedlist_add_fail)
 
     // Expect
     EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(3);
+        .ExpectedTimesExactly(4);
     EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(3);
+        .ExpectedTimesExactly(4);
     EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .ExpectedTimesExactly(1);
     EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
@@ -1032,7 +1060,7 @@ TEST_FUNCTION(EventSystem_ReportEvent_Modules_Proper_List_Given)
     EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     // simulated thread
     EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(3);
+        .ExpectedTimesExactly(2);
     EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, singlylinkedlist_remove(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
@@ -1067,9 +1095,9 @@ TEST_FUNCTION(EventSystem_ReportEvent_Modules_GetModuleList_Fails)
 
     // Expect
     EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
+        .ExpectedTimesExactly(2);
     EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
+        .ExpectedTimesExactly(2);
     EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG));
     EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
@@ -1099,9 +1127,9 @@ TEST_FUNCTION(EventSystem_ReportEvent_Modules_Pushback_Fails)
 
     // Expect
     EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
+        .ExpectedTimesExactly(2);
     EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
+        .ExpectedTimesExactly(2);
     EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG));
     EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
@@ -1144,4 +1172,116 @@ TEST_FUNCTION(EventSystem_ReportEvent_user_param_is_passed)
     EventSystem_Destroy(handle);
 }
 
+/* Tests_SRS_EVENTSYSTEM_31_004: [ The alert events shall provide a copy of the `GATEWAY_ALERT_CONTEXT` given to #EventSystem_ReportAlert as the event context in callbacks, and free it after finishing all the callbacks. ] */
+TEST_FUNCTION(EventSystem_ReportAlert_Context_Copied)
+{
+    // Arrange
+    CNiceCallComparer<CEventSystemMocks> mocks;
+    EVENTSYSTEM_HANDLE handle = EventSystem_Init();
+    EventSystem_AddEventCallback(handle, GATEWAY_MODULE_INBOX_HIGH_WATERMARK, catch_alert_callback, NULL);
+    GATEWAY_ALERT_CONTEXT alert = { (MODULE_HANDLE)0x42, 120, 100 };
+
+    // Act
+    EventSystem_ReportAlert(handle, NULL, GATEWAY_MODULE_INBOX_HIGH_WATERMARK, &alert);
+    // the alert of the caller may be gone before the callbacks run
+    alert.value = 0;
+    // simulate the thread running
+    last_thread_func(last_thread_arg);
+
+    // Assert
+    ASSERT_IS_NOT_NULL(last_context);
+    ASSERT_IS_TRUE(last_context != (void*)&alert);
+    ASSERT_IS_TRUE(last_alert.module_handle == (MODULE_HANDLE)0x42);
+    ASSERT_ARE_EQUAL(size_t, 120, last_alert.value);
+    ASSERT_ARE_EQUAL(size_t, 100, last_alert.threshold);
+
+    // Cleanup
+    EventSystem_Destroy(handle);
+}
+
+/* Tests_SRS_EVENTSYSTEM_31_003: [ This function shall do nothing when `alert` is NULL. ] */
+/* Tests_SRS_EVENTSYSTEM_31_007: [ An alert of a module still waiting to be dispatched with the same event type shall take the value and threshold of the new alert instead of the new alert being queued, so at most one alert of each type is queued for a module. ] */
+TEST_FUNCTION(EventSystem_ReportAlert_Coalesces_Queued_Alert)
+{
+    // Arrange
+    CNiceCallComparer<CEventSystemMocks> mocks;
+    EVENTSYSTEM_HANDLE handle = EventSystem_Init();
+    EventSystem_AddEventCallback(handle, GATEWAY_MODULE_INBOX_HIGH_WATERMARK, countingCallback, NULL);
+    EventSystem_AddEventCallback(handle, GATEWAY_MODULE_INBOX_HIGH_WATERMARK, catch_alert_callback, NULL);
+    GATEWAY_ALERT_CONTEXT other = { (MODULE_HANDLE)0x43, 150, 100 };
+    GATEWAY_ALERT_CONTEXT first = { (MODULE_HANDLE)0x42, 120, 100 };
+    GATEWAY_ALERT_CONTEXT second = { (MODULE_HANDLE)0x42, 180, 100 };
+
+    // Act
+    EventSystem_ReportAlert(handle, NULL, GATEWAY_MODULE_INBOX_HIGH_WATERMARK, &other);
+    EventSystem_ReportAlert(handle, NULL, GATEWAY_MODULE_INBOX_HIGH_WATERMARK, &first);
+    EventSystem_ReportAlert(handle, NULL, GATEWAY_MODULE_INBOX_HIGH_WATERMARK, &second);
+    // simulate the thread running
+    last_thread_func(last_thread_arg);
+
+    // Assert
+    ASSERT_ARE_EQUAL(int, 2, callback_gw_history->size());
+    ASSERT_IS_TRUE(last_alert.module_handle == (MODULE_HANDLE)0x42);
+    ASSERT_ARE_EQUAL(size_t, 180, last_alert.value);
+
+    // Cleanup
+    EventSystem_Destroy(handle);
+}
+
+TEST_FUNCTION(EventSystem_ReportAlert_NULL_Alert)
+{
+    // Arrange
+    CEventSystemMocks mocks;
+    EVENTSYSTEM_HANDLE handle = EventSystem_Init();
+    EventSystem_AddEventCallback(handle, GATEWAY_MESSAGE_DROPPED, countingCallback, NULL);
+    mocks.ResetAllCalls();
+
+    // Expect
+    // None! The function should be no-op
+
+    // Act
+    EventSystem_ReportAlert(handle, NULL, GATEWAY_MESSAGE_DROPPED, NULL);
+
+    // Assert
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_IS_NULL((void*)last_thread_func);
+
+    // Cleanup
+    EventSystem_Destroy(handle);
+}
+
+/* Tests_SRS_EVENTSYSTEM_26_013: [ Should the worker thread ever fail to be created or any internall callbacks fail, failure will be logged and no further callbacks will be called during gateway's lifecycle. ] */
+TEST_FUNCTION(EventSystem_ReportAlert_malloc_fail)
+{
+    // Arrange
+    CEventSystemMocks mocks;
+    EVENTSYSTEM_HANDLE handle = EventSystem_Init();
+    EventSystem_AddEventCallback(handle, GATEWAY_MODULE_RECEIVE_SLOW, countingCallback, NULL);
+    GATEWAY_ALERT_CONTEXT alert = { (MODULE_HANDLE)0x42, 250, 100 };
+    mocks.ResetAllCalls();
+
+    // Expect
+    EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(3);
+    EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(3);
+    EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG));
+    EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        .SetFailReturn((void*)NULL);
+    EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG));
+
+    // Act
+    EventSystem_ReportAlert(handle, NULL, GATEWAY_MODULE_RECEIVE_SLOW, &alert);
+
+    // Assert
+    mocks.AssertActualAndExpectedCalls();
+
+    // Cleanup
+    EventSystem_Destroy(handle);
+}
+
 END_TEST_SUITE(event_system_ut)
@@ -7,6 +7,7 @@
 #include "micromock.h"
 #include "micromockcharstararenullterminatedstrings.h"
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/threadapi.h"
 
 #include "module_loader.h"
 #include "experimental/event_system.h"
@@ -16,6 +17,7 @@
 #include <parson.h>
 
 #include "azure_c_shared_utility/vector_types_internal.h"
+#include "module_loaders/lazy_loader.h"
 #ifdef OUTPROCESS_ENABLED
   #include "module_loaders/outprocess_loader.h"
 #endif
@@ -61,6 +63,50 @@ static MODULE_LOADER_API default_module_loader;
 static MODULE_LOADER dummyModuleLoader;
 static GATEWAY_MODULE_LOADER_INFO dummyLoaderInfo;
 
+/* The gateway index of the tests: the modules and links it holds, looked up one by one. */
+typedef struct TEST_INDEX_LINK_TAG
+{
+    const MODULE_DATA* source;
+    const MODULE_DATA* sink;
+} TEST_INDEX_LINK;
+
+typedef struct TEST_INDEX_TAG
+{
+    VECTOR_HANDLE modules;
+    VECTOR_HANDLE links;
+} TEST_INDEX;
+
+static TEST_INDEX_LINK* test_index_find_link(GATEWAY_INDEX_HANDLE index, const MODULE_DATA* source, const MODULE_DATA* sink)
+{
+    TEST_INDEX_LINK* result = NULL;
+    VECTOR_HANDLE links = ((TEST_INDEX*)index)->links;
+    for (size_t i = 0; i < BASEIMPLEMENTATION::VECTOR_size(links) && result == NULL; i++)
+    {
+        TEST_INDEX_LINK* link = (TEST_INDEX_LINK*)BASEIMPLEMENTATION::VECTOR_element(links, i);
+        if (link->source == source && link->sink == sink)
+        {
+            result = link;
+        }
+    }
+    return result;
+}
+
+static MODULE_DATA** test_index_find_module(GATEWAY_INDEX_HANDLE index, const char* module_name, MODULE_HANDLE module)
+{
+    MODULE_DATA** result = NULL;
+    VECTOR_HANDLE modules = ((TEST_INDEX*)index)->modules;
+    for (size_t i = 0; i < BASEIMPLEMENTATION::VECTOR_size(modules) && result == NULL; i++)
+    {
+        MODULE_DATA** module_data = (MODULE_DATA**)BASEIMPLEMENTATION::VECTOR_element(modules, i);
+        if ((module_name != NULL && strcmp((*module_data)->module_name, module_name) == 0) ||
+            (module != NULL && (*module_data)->module == module))
+        {
+            result = module_data;
+        }
+    }
+    return result;
+}
+
 TYPED_MOCK_CLASS(CGatewayMocks, CGlobalMock)
 {
 public:
@@ -110,6 +156,14 @@ public:
         }
     MOCK_METHOD_END(JSON_Object*, object);
 
+    MOCK_STATIC_METHOD_2(, JSON_Value*, json_array_get_value, const JSON_Array*, arr, size_t, index)
+        JSON_Value* value = NULL;
+        if (arr != NULL)
+        {
+            value = (JSON_Value*)0x42;
+        }
+    MOCK_METHOD_END(JSON_Value*, value);
+
     MOCK_STATIC_METHOD_2(, const char*, json_object_get_string, const JSON_Object*, object, const char*, name)
         const char* string = NULL;
         if (object != NULL && name != NULL)
@@ -134,6 +188,12 @@ public:
         }
     MOCK_METHOD_END(JSON_Value*, value);
 
+    MOCK_STATIC_METHOD_2(, double, json_object_get_number, const JSON_Object*, object, const char*, name)
+    MOCK_METHOD_END(double, 0);
+
+    MOCK_STATIC_METHOD_2(, int, json_object_get_boolean, const JSON_Object*, object, const char*, name)
+    MOCK_METHOD_END(int, -1);
+
     MOCK_STATIC_METHOD_1(, char*, json_serialize_to_string, const JSON_Value*, value)
         char* serialized_string = NULL;
         const char* text = "[serialized string]";
@@ -166,6 +226,7 @@ public:
         gateway->broker = (BROKER_HANDLE)Broker_Create();
         gateway->modules = VECTOR_create(sizeof(MODULE_DATA*));
         gateway->links = VECTOR_create(sizeof(LINK_DATA));
+        gateway->index = GatewayIndex_Create();
         gateway->event_system = EventSystem_Init();
         EventSystem_ReportEvent(gateway->event_system, gateway, GATEWAY_CREATED);
         EventSystem_ReportEvent(gateway->event_system, gateway, GATEWAY_MODULE_LIST_CHANGED);
@@ -222,6 +283,21 @@ public:
     MOCK_STATIC_METHOD_2(, BROKER_RESULT, Broker_RemoveLink, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, link)
     MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
 
+    MOCK_STATIC_METHOD_5(, BROKER_RESULT, Broker_UpdateLinks, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, links_to_remove, size_t, remove_count, const BROKER_LINK_DATA*, links_to_add, size_t, add_count)
+    MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
+
+    MOCK_STATIC_METHOD_2(, BROKER_RESULT, Broker_DrainModule, BROKER_HANDLE, handle, const MODULE*, module)
+    MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
+
+    MOCK_STATIC_METHOD_2(, BROKER_RESULT, Broker_FuseLink, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, link)
+    MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
+
+    MOCK_STATIC_METHOD_2(, BROKER_RESULT, Broker_UnfuseLink, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, link)
+    MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
+
+    MOCK_STATIC_METHOD_3(, BROKER_RESULT, Broker_SetAlertCallback, BROKER_HANDLE, broker, BROKER_ALERT_CALLBACK, callback, void*, context)
+    MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
+
     /*ModuleLoader Mocks*/
     MOCK_STATIC_METHOD_0(, const MODULE_LOADER_API*, DynamicLoader_GetApi)
     MOCK_METHOD_END(const MODULE_LOADER_API*, &default_module_loader);
@@ -273,6 +349,13 @@ public:
     MOCK_STATIC_METHOD_1(, MODULE_LOADER*, ModuleLoader_FindByName, const char*, name)
     MOCK_METHOD_END(MODULE_LOADER*, &dummyModuleLoader);
 
+    MOCK_STATIC_METHOD_0(, const MODULE_LOADER*, LazyLoader_Get)
+    MOCK_METHOD_END(const MODULE_LOADER*, &dummyModuleLoader);
+
+    MOCK_STATIC_METHOD_3(, LAZY_LOADER_ENTRYPOINT*, LazyLoader_CreateEntrypoint, const MODULE_LOADER*, loader, const JSON_Value*, entrypoint, unsigned int, idle_timeout)
+        LAZY_LOADER_ENTRYPOINT* r = (LAZY_LOADER_ENTRYPOINT*)BASEIMPLEMENTATION::gballoc_malloc(1);
+    MOCK_METHOD_END(LAZY_LOADER_ENTRYPOINT*, r);
+
     MOCK_STATIC_METHOD_0(, void, OutprocessLoader_JoinChildProcesses);
     MOCK_VOID_METHOD_END();
 
@@ -289,6 +372,9 @@ public:
     MOCK_STATIC_METHOD_3(, void, EventSystem_ReportEvent, EVENTSYSTEM_HANDLE, event_system, GATEWAY_HANDLE, gw, GATEWAY_EVENT, event_type)
     MOCK_VOID_METHOD_END();
 
+    MOCK_STATIC_METHOD_4(, void, EventSystem_ReportAlert, EVENTSYSTEM_HANDLE, event_system, GATEWAY_HANDLE, gw, GATEWAY_EVENT, event_type, const GATEWAY_ALERT_CONTEXT*, alert)
+    MOCK_VOID_METHOD_END();
+
     MOCK_STATIC_METHOD_1(, void, EventSystem_Destroy, EVENTSYSTEM_HANDLE, handle)
         BASEIMPLEMENTATION::gballoc_free(handle);
     MOCK_VOID_METHOD_END();
@@ -330,6 +416,63 @@ public:
         void* element = BASEIMPLEMENTATION::VECTOR_find_if(handle, pred, value);
     MOCK_METHOD_END(void*, element);
 
+    /*Gateway index Mocks*/
+    MOCK_STATIC_METHOD_0(, GATEWAY_INDEX_HANDLE, GatewayIndex_Create)
+        TEST_INDEX* index = (TEST_INDEX*)BASEIMPLEMENTATION::gballoc_malloc(sizeof(TEST_INDEX));
+        index->modules = BASEIMPLEMENTATION::VECTOR_create(sizeof(MODULE_DATA*));
+        index->links = BASEIMPLEMENTATION::VECTOR_create(sizeof(TEST_INDEX_LINK));
+    MOCK_METHOD_END(GATEWAY_INDEX_HANDLE, (GATEWAY_INDEX_HANDLE)index);
+
+    MOCK_STATIC_METHOD_1(, void, GatewayIndex_Destroy, GATEWAY_INDEX_HANDLE, index)
+        BASEIMPLEMENTATION::VECTOR_destroy(((TEST_INDEX*)index)->modules);
+        BASEIMPLEMENTATION::VECTOR_destroy(((TEST_INDEX*)index)->links);
+        BASEIMPLEMENTATION::gballoc_free(index);
+    MOCK_VOID_METHOD_END();
+
+    MOCK_STATIC_METHOD_2(, int, GatewayIndex_AddModule, GATEWAY_INDEX_HANDLE, index, MODULE_DATA*, module_data)
+        int result1 = __LINE__;
+        if (test_index_find_module(index, module_data->module_name, module_data->module) == NULL)
+        {
+            result1 = BASEIMPLEMENTATION::VECTOR_push_back(((TEST_INDEX*)index)->modules, &module_data, 1);
+        }
+    MOCK_METHOD_END(int, result1);
+
+    MOCK_STATIC_METHOD_2(, void, GatewayIndex_RemoveModule, GATEWAY_INDEX_HANDLE, index, const MODULE_DATA*, module_data)
+        MODULE_DATA** found = test_index_find_module(index, NULL, module_data->module);
+        if (found != NULL && *found == module_data)
+        {
+            BASEIMPLEMENTATION::VECTOR_erase(((TEST_INDEX*)index)->modules, found, 1);
+        }
+    MOCK_VOID_METHOD_END();
+
+    MOCK_STATIC_METHOD_2(, MODULE_DATA*, GatewayIndex_FindModuleByName, GATEWAY_INDEX_HANDLE, index, const char*, module_name)
+        MODULE_DATA** found = test_index_find_module(index, module_name, NULL);
+    MOCK_METHOD_END(MODULE_DATA*, (found == NULL) ? NULL : *found);
+
+    MOCK_STATIC_METHOD_2(, MODULE_DATA*, GatewayIndex_FindModuleByHandle, GATEWAY_INDEX_HANDLE, index, MODULE_HANDLE, module)
+        MODULE_DATA** found = test_index_find_module(index, NULL, module);
+    MOCK_METHOD_END(MODULE_DATA*, (found == NULL) ? NULL : *found);
+
+    MOCK_STATIC_METHOD_3(, int, GatewayIndex_AddLink, GATEWAY_INDEX_HANDLE, index, const MODULE_DATA*, source, const MODULE_DATA*, sink)
+        int result1 = __LINE__;
+        if (test_index_find_link(index, source, sink) == NULL)
+        {
+            TEST_INDEX_LINK link = { source, sink };
+            result1 = BASEIMPLEMENTATION::VECTOR_push_back(((TEST_INDEX*)index)->links, &link, 1);
+        }
+    MOCK_METHOD_END(int, result1);
+
+    MOCK_STATIC_METHOD_3(, void, GatewayIndex_RemoveLink, GATEWAY_INDEX_HANDLE, index, const MODULE_DATA*, source, const MODULE_DATA*, sink)
+        TEST_INDEX_LINK* found = test_index_find_link(index, source, sink);
+        if (found != NULL)
+        {
+            BASEIMPLEMENTATION::VECTOR_erase(((TEST_INDEX*)index)->links, found, 1);
+        }
+    MOCK_VOID_METHOD_END();
+
+    MOCK_STATIC_METHOD_3(, bool, GatewayIndex_HasLink, GATEWAY_INDEX_HANDLE, index, const MODULE_DATA*, source, const MODULE_DATA*, sink)
+    MOCK_METHOD_END(bool, test_index_find_link(index, source, sink) != NULL);
+
     /*crt_abstractions Mocks*/
     MOCK_STATIC_METHOD_2(, int, mallocAndStrcpy_s, char**, destination, const char*, source)
         (*destination) = (char*)malloc(strlen(source) + 1);
@@ -364,6 +507,28 @@ public:
 
     MOCK_STATIC_METHOD_2(, void, mock_Module_Receive, MODULE_HANDLE, moduleHandle, MESSAGE_HANDLE, messageHandle)
     MOCK_VOID_METHOD_END();
+
+    MOCK_STATIC_METHOD_0(, LOCK_HANDLE, Lock_Init)
+    MOCK_METHOD_END(LOCK_HANDLE, (LOCK_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1));
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Lock, LOCK_HANDLE, lock)
+    MOCK_METHOD_END(LOCK_RESULT, LOCK_OK);
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Unlock, LOCK_HANDLE, lock)
+    MOCK_METHOD_END(LOCK_RESULT, LOCK_OK);
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Lock_Deinit, LOCK_HANDLE, lock)
+        BASEIMPLEMENTATION::gballoc_free(lock);
+    MOCK_METHOD_END(LOCK_RESULT, LOCK_OK);
+
+    /* runs the thread to completion before returning, so the tests stay deterministic */
+    MOCK_STATIC_METHOD_3(, THREADAPI_RESULT, ThreadAPI_Create, THREAD_HANDLE*, threadHandle, THREAD_START_FUNC, func, void*, arg)
+        *threadHandle = (THREAD_HANDLE)0x4242;
+        (void)func(arg);
+    MOCK_METHOD_END(THREADAPI_RESULT, THREADAPI_OK);
+
+    MOCK_STATIC_METHOD_2(, THREADAPI_RESULT, ThreadAPI_Join, THREAD_HANDLE, threadHandle, int*, res)
+    MOCK_METHOD_END(THREADAPI_RESULT, THREADAPI_OK);
 };
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , JSON_Value *, json_parse_string, const char *, string);
@@ -372,10 +537,13 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , JSON_Object*, json_value_get_objec
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , JSON_Array*, json_object_get_array, const JSON_Object*, object, const char*, name);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , size_t, json_array_get_count, const JSON_Array*, arr);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , JSON_Object*, json_array_get_object, const JSON_Array*, arr, size_t, index);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , JSON_Value*, json_array_get_value, const JSON_Array*, arr, size_t, index);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , const char*, json_object_get_string, const JSON_Object*, object, const char*, name);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , JSON_Object*, json_object_get_object, const JSON_Object*, object, const char*, name);
 
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , JSON_Value*, json_object_get_value, const JSON_Object*, object, const char*, name);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , double, json_object_get_number, const JSON_Object*, object, const char*, name);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , int, json_object_get_boolean, const JSON_Object*, object, const char*, name);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , char*, json_serialize_to_string, const JSON_Value*, value);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , void, json_value_free, JSON_Value*, value);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , void, json_free_serialized_string, char*, string);
@@ -394,6 +562,11 @@ DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , BROKER_RESULT, Broker_AddModule, B
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , BROKER_RESULT, Broker_RemoveModule, BROKER_HANDLE, handle, const MODULE*, module);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , BROKER_RESULT, Broker_AddLink, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, link);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , BROKER_RESULT, Broker_RemoveLink, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, link);
+DECLARE_GLOBAL_MOCK_METHOD_5(CGatewayMocks, , BROKER_RESULT, Broker_UpdateLinks, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, links_to_remove, size_t, remove_count, const BROKER_LINK_DATA*, links_to_add, size_t, add_count);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , BROKER_RESULT, Broker_DrainModule, BROKER_HANDLE, handle, const MODULE*, module);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , BROKER_RESULT, Broker_FuseLink, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, link);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , BROKER_RESULT, Broker_UnfuseLink, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, link);
+DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayMocks, , BROKER_RESULT, Broker_SetAlertCallback, BROKER_HANDLE, broker, BROKER_ALERT_CALLBACK, callback, void*, context);
 
 DECLARE_GLOBAL_MOCK_METHOD_0(CGatewayMocks, , const MODULE_LOADER_API*, DynamicLoader_GetApi);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , MODULE_LIBRARY_HANDLE, DynamicModuleLoader_Load, const struct MODULE_LOADER_TAG*, loader, const void*, entrypoint);
@@ -409,12 +582,15 @@ DECLARE_GLOBAL_MOCK_METHOD_0(CGatewayMocks, , MODULE_LOADER_RESULT, ModuleLoader
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , MODULE_LOADER_RESULT, ModuleLoader_InitializeFromJson, const JSON_Value*, loaders);
 DECLARE_GLOBAL_MOCK_METHOD_0(CGatewayMocks, , void, ModuleLoader_Destroy);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , MODULE_LOADER*, ModuleLoader_FindByName, const char*, name);
+DECLARE_GLOBAL_MOCK_METHOD_0(CGatewayMocks, , const MODULE_LOADER*, LazyLoader_Get);
+DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayMocks, , LAZY_LOADER_ENTRYPOINT*, LazyLoader_CreateEntrypoint, const MODULE_LOADER*, loader, const JSON_Value*, entrypoint, unsigned int, idle_timeout);
 DECLARE_GLOBAL_MOCK_METHOD_0(CGatewayMocks, , void, OutprocessLoader_JoinChildProcesses);
 DECLARE_GLOBAL_MOCK_METHOD_0(CGatewayMocks, , int, OutprocessLoader_SpawnChildProcesses);
 
 DECLARE_GLOBAL_MOCK_METHOD_0(CGatewayMocks, , EVENTSYSTEM_HANDLE, EventSystem_Init);
 DECLARE_GLOBAL_MOCK_METHOD_4(CGatewayMocks, , void, EventSystem_AddEventCallback, EVENTSYSTEM_HANDLE, event_system, GATEWAY_EVENT, event_type, GATEWAY_CALLBACK, callback, void*, user_param);
 DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayMocks, , void, EventSystem_ReportEvent, EVENTSYSTEM_HANDLE, event_system, GATEWAY_HANDLE, gw, GATEWAY_EVENT, event_type);
+DECLARE_GLOBAL_MOCK_METHOD_4(CGatewayMocks, , void, EventSystem_ReportAlert, EVENTSYSTEM_HANDLE, event_system, GATEWAY_HANDLE, gw, GATEWAY_EVENT, event_type, const GATEWAY_ALERT_CONTEXT*, alert);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , void, EventSystem_Destroy, EVENTSYSTEM_HANDLE, handle);
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , VECTOR_HANDLE, VECTOR_create, size_t, elementSize);
@@ -427,6 +603,16 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , void*, VECTOR_back, const VECTOR_H
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , size_t, VECTOR_size, const VECTOR_HANDLE, handle);
 DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayMocks, , void*, VECTOR_find_if, const VECTOR_HANDLE, handle, PREDICATE_FUNCTION, pred, const void*, value);
 
+DECLARE_GLOBAL_MOCK_METHOD_0(CGatewayMocks, , GATEWAY_INDEX_HANDLE, GatewayIndex_Create);
+DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , void, GatewayIndex_Destroy, GATEWAY_INDEX_HANDLE, index);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , int, GatewayIndex_AddModule, GATEWAY_INDEX_HANDLE, index, MODULE_DATA*, module_data);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , void, GatewayIndex_RemoveModule, GATEWAY_INDEX_HANDLE, index, const MODULE_DATA*, module_data);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , MODULE_DATA*, GatewayIndex_FindModuleByName, GATEWAY_INDEX_HANDLE, index, const char*, module_name);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , MODULE_DATA*, GatewayIndex_FindModuleByHandle, GATEWAY_INDEX_HANDLE, index, MODULE_HANDLE, module);
+DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayMocks, , int, GatewayIndex_AddLink, GATEWAY_INDEX_HANDLE, index, const MODULE_DATA*, source, const MODULE_DATA*, sink);
+DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayMocks, , void, GatewayIndex_RemoveLink, GATEWAY_INDEX_HANDLE, index, const MODULE_DATA*, source, const MODULE_DATA*, sink);
+DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayMocks, , bool, GatewayIndex_HasLink, GATEWAY_INDEX_HANDLE, index, const MODULE_DATA*, source, const MODULE_DATA*, sink);
+
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , int, mallocAndStrcpy_s, char**, destination, const char*, source);
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , void*, gballoc_malloc, size_t, size);
@@ -439,6 +625,13 @@ DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , MODULE_HANDLE, mock_Module_Create,
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , void, mock_Module_Destroy, MODULE_HANDLE, moduleHandle);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , void, mock_Module_Receive, MODULE_HANDLE, moduleHandle, MESSAGE_HANDLE, messageHandle);
 
+DECLARE_GLOBAL_MOCK_METHOD_0(CGatewayMocks, , LOCK_HANDLE, Lock_Init);
+DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , LOCK_RESULT, Lock, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , LOCK_RESULT, Unlock, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , LOCK_RESULT, Lock_Deinit, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayMocks, , THREADAPI_RESULT, ThreadAPI_Create, THREAD_HANDLE*, threadHandle, THREAD_START_FUNC, func, void*, arg);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , THREADAPI_RESULT, ThreadAPI_Join, THREAD_HANDLE, threadHandle, int*, res);
+
 static MICROMOCK_GLOBAL_SEMAPHORE_HANDLE g_dllByDll;
 static MICROMOCK_MUTEX_HANDLE g_testByTest;
 
@@ -656,6 +849,9 @@ static void setup_parse_modules_entry(CGatewayMocks& mocks, size_t index, const
     STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "name"))
         .IgnoreArgument(1)
         .SetReturn(modulename);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "activation"))
+        .IgnoreArgument(1)
+        .SetReturn((const char*)NULL);
     STRICT_EXPECTED_CALL(mocks, json_object_get_value(IGNORED_PTR_ARG, "args"))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, json_serialize_to_string(IGNORED_PTR_ARG))
@@ -684,7 +880,7 @@ static void add_a_module(CGatewayMocks& mocks, size_t index)
 {
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, index))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(MODULE_DATA)));
     STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_Load(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
@@ -711,34 +907,91 @@ static void add_a_module(CGatewayMocks& mocks, size_t index)
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_AddModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 }
 
-static void add_a_link(CGatewayMocks& mocks, size_t index)
+/* The calls of creating two modules on the gateway worker threads. */
+static void create_2modules(CGatewayMocks& mocks)
 {
-    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, index))
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, Lock_Init());
+    STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
         .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(3);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(4);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
         .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(3);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(4);
+    STRICT_EXPECTED_CALL(mocks, ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+}
+
+/* The calls of recording the JSON of two modules as their signatures. */
+static void record_signatures(CGatewayMocks& mocks, const char* module1, const char* module2)
+{
+    const char* names[] = { module1, module2 };
+
+    STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_array(IGNORED_PTR_ARG, "modules"))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
         .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(3);
+        .SetReturn(2);
+    for (size_t index = 0; index < 2; index++)
+    {
+        STRICT_EXPECTED_CALL(mocks, json_array_get_value(IGNORED_PTR_ARG, index))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "name"))
+            .IgnoreArgument(1)
+            .SetReturn(names[index]);
+        STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, names[index]))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_serialize_to_string(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "[serialized string]"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char*)"[serialized string]"));
+    }
+}
+
+static void add_a_link(CGatewayMocks& mocks, size_t index)
+{
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, index))
+        .IgnoreArgument(1);
+    // check if the link exists
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_HasLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    // add it
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
 }
 
 /*Tests_SRS_GATEWAY_JSON_14_008: [ This function shall return NULL upon any memory allocation failure. */
@@ -814,6 +1067,7 @@ TEST_FUNCTION(Gateway_CreateFromJson_Returns_NULL_on_gateway_create_internal_fai
 /*Tests_SRS_GATEWAY_JSON_17_011: [ The function shall the loader's BuildModuleConfiguration to construct module input from module's "args" and "loader.entrypoint". ]*/
 /*Tests_SRS_GATEWAY_JSON_17_013: [ The function shall parse each modules object for "loader.name" and "loader.entrypoint". ]*/
 /*Tests_SRS_GATEWAY_JSON_17_014: [ The function shall find the correct loader by "loader.name". ]*/
+/*Tests_SRS_GATEWAY_JSON_31_001: [ Upon successful start, the function shall record the serialized JSON of each module entry as the signature of the module it created. ]*/
 TEST_FUNCTION(Gateway_CreateFromJson_Parses_Valid_JSON_Configuration_File)
 {
     //Arrange
@@ -837,8 +1091,105 @@ TEST_FUNCTION(Gateway_CreateFromJson_Parses_Valid_JSON_Configuration_File)
 
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(GATEWAY_HANDLE_DATA)));
     STRICT_EXPECTED_CALL(mocks, Broker_Create());
+    STRICT_EXPECTED_CALL(mocks, Broker_SetAlertCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(MODULE_DATA*)));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(LINK_DATA)));
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_Create());
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //Adding module 1 (Success)
+    add_a_module(mocks, 0);
+    //Adding module 2 (Success)
+    add_a_module(mocks, 1);
+    create_2modules(mocks);
+
+    //process the links
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    add_a_link(mocks, 0);
+    add_a_link(mocks, 1);
+
+
+    //Gateway start
+       STRICT_EXPECTED_CALL(mocks, EventSystem_Init());
+       STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_CREATED))
+           .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_MODULE_LIST_CHANGED))
+           .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, json_object_get_boolean(IGNORED_PTR_ARG, "link.fusion"))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, Gateway_Start(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       record_signatures(mocks, "module1", "module2");
+       STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+           .IgnoreArgument(1);
+	   STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		   .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char*)"[serialized string]"));
+       STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+           .IgnoreArgument(1);
+	   STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		   .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char*)"[serialized string]"));
+       STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+          .IgnoreArgument(1);
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_CreateFromJson(VALID_JSON_PATH);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
+/*Tests_SRS_GATEWAY_JSON_31_017: [ If the root object has "link.fusion" set to true, the function shall make the gateway fuse its links when it starts. ]*/
+TEST_FUNCTION(Gateway_CreateFromJson_enables_link_fusion)
+{
+    //Arrange
+    CGatewayMocks mocks;
+
+    setup_2module_gw(mocks, (char *)VALID_JSON_PATH);
+
+    // modules array
+    setup_parse_modules_entry(mocks, 0, "module1");
+    setup_parse_modules_entry(mocks, 1, "module2");
+
+    // links entry
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_LINK_ENTRY)));
+    STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(2);
+
+    setup_links_entry(mocks, 0, "module1", "module2");
+    setup_links_entry(mocks, 1, "module2", "module1");
+
+
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(GATEWAY_HANDLE_DATA)));
+    STRICT_EXPECTED_CALL(mocks, Broker_Create());
+    STRICT_EXPECTED_CALL(mocks, Broker_SetAlertCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(MODULE_DATA*)));
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(LINK_DATA)));
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_Create());
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
@@ -846,6 +1197,7 @@ TEST_FUNCTION(Gateway_CreateFromJson_Parses_Valid_JSON_Configuration_File)
     add_a_module(mocks, 0);
     //Adding module 2 (Success)
     add_a_module(mocks, 1);
+    create_2modules(mocks);
 
     //process the links
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
@@ -862,8 +1214,14 @@ TEST_FUNCTION(Gateway_CreateFromJson_Parses_Valid_JSON_Configuration_File)
        STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_MODULE_LIST_CHANGED))
            .IgnoreArgument(1)
            .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, json_object_get_boolean(IGNORED_PTR_ARG, "link.fusion"))
+           .IgnoreArgument(1)
+           .SetReturn(1);
        STRICT_EXPECTED_CALL(mocks, Gateway_Start(IGNORED_PTR_ARG))
            .IgnoreArgument(1);
+       record_signatures(mocks, "module1", "module2");
        STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
            .IgnoreArgument(1);
        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
@@ -892,6 +1250,7 @@ TEST_FUNCTION(Gateway_CreateFromJson_Parses_Valid_JSON_Configuration_File)
 
     //Assert
     ASSERT_IS_NOT_NULL(gateway);
+    ASSERT_IS_TRUE(gateway->fuse_links);
     mocks.AssertActualAndExpectedCalls();
 
     //Cleanup
@@ -922,8 +1281,11 @@ TEST_FUNCTION(Gateway_Create_Start_fails_returns_null)
 
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(GATEWAY_HANDLE_DATA)));
     STRICT_EXPECTED_CALL(mocks, Broker_Create());
+    STRICT_EXPECTED_CALL(mocks, Broker_SetAlertCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(MODULE_DATA*)));
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(LINK_DATA)));
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_Create());
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
@@ -931,6 +1293,7 @@ TEST_FUNCTION(Gateway_Create_Start_fails_returns_null)
     add_a_module(mocks, 0);
     //Adding module 2 (Success)
     add_a_module(mocks, 1);
+    create_2modules(mocks);
 
     //process the links
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
@@ -945,6 +1308,10 @@ TEST_FUNCTION(Gateway_Create_Start_fails_returns_null)
     STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_MODULE_LIST_CHANGED))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_boolean(IGNORED_PTR_ARG, "link.fusion"))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Gateway_Start(IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .SetFailReturn((GATEWAY_START_RESULT)GATEWAY_START_INVALID_ARGS);
@@ -970,19 +1337,39 @@ TEST_FUNCTION(Gateway_Create_Start_fails_returns_null)
         .IgnoreArgument(1);
 
     //Cleaning up calls
+    STRICT_EXPECTED_CALL(mocks, Broker_SetAlertCallback(IGNORED_PTR_ARG, NULL, NULL))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_DESTROYED))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
 
     STRICT_EXPECTED_CALL(mocks, EventSystem_Destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_Destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
@@ -1104,6 +1491,9 @@ TEST_FUNCTION(Gateway_CreateFromJson_Traverses_JSON_Push_Back_Fail)
     STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "name"))
         .IgnoreArgument(1)
         .SetReturn("Module2");
+    STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "activation"))
+        .IgnoreArgument(1)
+        .SetReturn((const char*)NULL);
     STRICT_EXPECTED_CALL(mocks, json_object_get_value(IGNORED_PTR_ARG, "args"))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, json_serialize_to_string(IGNORED_PTR_ARG))
@@ -1224,8 +1614,11 @@ TEST_FUNCTION(Gateway_CreateFromJson_Traverses_JSON_Value_NULL_Loaders_Array_suc
 
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(GATEWAY_HANDLE_DATA)));
     STRICT_EXPECTED_CALL(mocks, Broker_Create());
+    STRICT_EXPECTED_CALL(mocks, Broker_SetAlertCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(MODULE_DATA*)));
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(LINK_DATA)));
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_Create());
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
@@ -1233,6 +1626,7 @@ TEST_FUNCTION(Gateway_CreateFromJson_Traverses_JSON_Value_NULL_Loaders_Array_suc
     add_a_module(mocks, 0);
     //Adding module 2 (Success)
     add_a_module(mocks, 1);
+    create_2modules(mocks);
 
     //process the links
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
@@ -1249,8 +1643,13 @@ TEST_FUNCTION(Gateway_CreateFromJson_Traverses_JSON_Value_NULL_Loaders_Array_suc
     STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_MODULE_LIST_CHANGED))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_boolean(IGNORED_PTR_ARG, "link.fusion"))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Gateway_Start(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    record_signatures(mocks, "module1", "module2");
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
@@ -1484,6 +1883,155 @@ TEST_FUNCTION(Gateway_CreateFromJson_Fails_For_Missing_Info_In_JSON_Configuratio
     mocks.AssertActualAndExpectedCalls();
 }
 
+static void setup_parse_module_activation(CGatewayMocks& mocks, size_t index, const char* modulename, const char* activation)
+{
+    STRICT_EXPECTED_CALL(mocks, json_array_get_object(IGNORED_PTR_ARG, index))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_object(IGNORED_PTR_ARG, "loader"))
+        .IgnoreArgument(1)
+        .SetReturn((JSON_Object*)0x42);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "name"))
+        .IgnoreArgument(1)
+        .SetReturn("loader1");
+    STRICT_EXPECTED_CALL(mocks, ModuleLoader_FindByName("loader1"));
+    STRICT_EXPECTED_CALL(mocks, json_object_get_value(IGNORED_PTR_ARG, "entrypoint"))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_ParseEntrypointFromJson(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "name"))
+        .IgnoreArgument(1)
+        .SetReturn(modulename);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "activation"))
+        .IgnoreArgument(1)
+        .SetReturn(activation);
+}
+
+/*Tests_SRS_GATEWAY_JSON_31_014: [ If "activation" is neither "eager" nor "lazy", the function shall fail and return NULL. ]*/
+TEST_FUNCTION(Gateway_CreateFromJson_fails_for_unknown_activation)
+{
+    //Arrange
+    CGatewayMocks mocks;
+
+    setup_2module_gw(mocks, (char*)MISSING_INFO_JSON_PATH);
+    setup_parse_module_activation(mocks, 0, "module1", "sometimes");
+
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, ModuleLoader_Destroy());
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_CreateFromJson(MISSING_INFO_JSON_PATH);
+
+    //Assert
+    ASSERT_IS_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+}
+
+/*Tests_SRS_GATEWAY_JSON_31_016: [ If the lazy loader entrypoint cannot be created, the function shall fail and return NULL. ]*/
+TEST_FUNCTION(Gateway_CreateFromJson_fails_when_lazy_entrypoint_fails)
+{
+    //Arrange
+    CGatewayMocks mocks;
+
+    setup_2module_gw(mocks, (char*)MISSING_INFO_JSON_PATH);
+    setup_parse_module_activation(mocks, 0, "module1", "lazy");
+
+    STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "idle.timeout"))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_value(IGNORED_PTR_ARG, "entrypoint"))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, LazyLoader_CreateEntrypoint(&dummyModuleLoader, IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(2)
+        .SetFailReturn((LAZY_LOADER_ENTRYPOINT*)NULL);
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, ModuleLoader_Destroy());
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_CreateFromJson(MISSING_INFO_JSON_PATH);
+
+    //Assert
+    ASSERT_IS_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+}
+
+/*Tests_SRS_GATEWAY_JSON_31_013: [ The function shall parse each module object for an optional "activation", which is "eager" when it is missing. ]*/
+/*Tests_SRS_GATEWAY_JSON_31_015: [ For a "lazy" module, the function shall replace the module loader and entrypoint by a lazy loader entrypoint made of the module loader, its "loader.entrypoint" JSON and the optional "idle.timeout" milliseconds. ]*/
+TEST_FUNCTION(Gateway_CreateFromJson_replaces_loader_of_lazy_module)
+{
+    //Arrange
+    CGatewayMocks mocks;
+
+    setup_2module_gw(mocks, (char*)MISSING_INFO_JSON_PATH);
+    setup_parse_module_activation(mocks, 0, "module1", "lazy");
+
+    STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "idle.timeout"))
+        .IgnoreArgument(1)
+        .SetReturn(30000);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_value(IGNORED_PTR_ARG, "entrypoint"))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, LazyLoader_CreateEntrypoint(&dummyModuleLoader, (JSON_Value*)0x42, 30000));
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, LazyLoader_Get());
+    STRICT_EXPECTED_CALL(mocks, json_object_get_value(IGNORED_PTR_ARG, "args"))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_serialize_to_string(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+
+    // the second module fails, the lazy entrypoint is freed with the properties
+    setup_parse_module_activation(mocks, 1, "module2", "sometimes");
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(&dummyModuleLoader, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, ModuleLoader_Destroy());
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_CreateFromJson(MISSING_INFO_JSON_PATH);
+
+    //Assert
+    ASSERT_IS_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+}
+
 //Tests_SRS_GATEWAY_JSON_13_001: [ If loader.name is not found in the JSON then the gateway assumes that the loader name is native. ]
 TEST_FUNCTION(Gateway_CreateFromJson_uses_native_loader_when_loader_name_is_missing)
 {
@@ -1507,8 +2055,11 @@ TEST_FUNCTION(Gateway_CreateFromJson_uses_native_loader_when_loader_name_is_miss
 
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(GATEWAY_HANDLE_DATA)));
     STRICT_EXPECTED_CALL(mocks, Broker_Create());
+    STRICT_EXPECTED_CALL(mocks, Broker_SetAlertCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(MODULE_DATA*)));
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(LINK_DATA)));
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_Create());
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
@@ -1516,6 +2067,7 @@ TEST_FUNCTION(Gateway_CreateFromJson_uses_native_loader_when_loader_name_is_miss
     add_a_module(mocks, 0);
     //Adding module 2 (Success)
     add_a_module(mocks, 1);
+    create_2modules(mocks);
 
     //process the links
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
@@ -1531,8 +2083,13 @@ TEST_FUNCTION(Gateway_CreateFromJson_uses_native_loader_when_loader_name_is_miss
     STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_MODULE_LIST_CHANGED))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_boolean(IGNORED_PTR_ARG, "link.fusion"))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Gateway_Start(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    record_signatures(mocks, "module1", "module2");
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
@@ -1630,6 +2187,9 @@ TEST_FUNCTION(Gateway_CreateFromJson_fails_with_no_entry_point)
     STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "name"))
         .IgnoreArgument(1)
         .SetReturn("module1");
+    STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "activation"))
+        .IgnoreArgument(1)
+        .SetReturn((const char*)NULL);
     STRICT_EXPECTED_CALL(mocks, json_object_get_value(IGNORED_PTR_ARG, "args"))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, json_serialize_to_string(IGNORED_PTR_ARG))
@@ -1652,10 +2212,19 @@ TEST_FUNCTION(Gateway_CreateFromJson_fails_with_no_entry_point)
     // Create gateway until 1st module fails immediately
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(GATEWAY_HANDLE_DATA)));
     STRICT_EXPECTED_CALL(mocks, Broker_Create());
+    STRICT_EXPECTED_CALL(mocks, Broker_SetAlertCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(MODULE_DATA*)));
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(LINK_DATA)));
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_Create());
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
 
     //tear down.
 
@@ -1667,6 +2236,8 @@ TEST_FUNCTION(Gateway_CreateFromJson_fails_with_no_entry_point)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Broker_Destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
@@ -2014,6 +2585,7 @@ static void setup_2module_update_gw(CGatewayMocks& mocks, char * json_content)
 
 
 /* Tests_SRS_GATEWAY_JSON_04_007: [ The function shall traverse the JSON_Value object to initialize a GATEWAY_PROPERTIES instance. ] */
+/* Tests_SRS_GATEWAY_JSON_31_002: [ Upon successfully adding the modules, the function shall record the serialized JSON of each module entry as the signature of the module it created. ] */
 TEST_FUNCTION(Gateway_UpdateFromJson_Parses_Valid_JSON_Configuration_File_Succeed)
 {
     //Arrange
@@ -2098,6 +2670,8 @@ TEST_FUNCTION(Gateway_UpdateFromJson_Parses_Valid_JSON_Configuration_File_Succee
     STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
+    record_signatures(mocks, "module1", "module2");
+
     STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_MODULE_LIST_CHANGED))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -2201,6 +2775,8 @@ TEST_FUNCTION(Gateway_UpdateFromJson_Parses_JSON_WithJustModule_Configuration_Fi
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1); //Modules
 
+    record_signatures(mocks, "module1", "module2");
+
     STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_MODULE_LIST_CHANGED))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -2374,4 +2950,132 @@ TEST_FUNCTION(Gateway_UpdateFromJson_Parses_JSON_WithJustLinks_Configuration_Fil
 }
 
 
+/* Tests_SRS_GATEWAY_JSON_31_003: [ If gw or json_content is NULL the function shall return GATEWAY_UPDATE_FROM_JSON_INVALID_ARG. ] */
+TEST_FUNCTION(Gateway_ReconfigureFromJson_Returns_InvalidArg_For_NULL_gw_Input)
+{
+    //Arrange
+    CGatewayMocks mocks;
+
+    //Act
+    GATEWAY_UPDATE_FROM_JSON_RESULT result = Gateway_ReconfigureFromJson(NULL, (const char*)"AnyThing");
+
+    //Assert
+    ASSERT_ARE_EQUAL(int, GATEWAY_UPDATE_FROM_JSON_INVALID_ARG, result);
+    mocks.AssertActualAndExpectedCalls();
+}
+
+/* Tests_SRS_GATEWAY_JSON_31_003: [ If gw or json_content is NULL the function shall return GATEWAY_UPDATE_FROM_JSON_INVALID_ARG. ] */
+TEST_FUNCTION(Gateway_ReconfigureFromJson_Returns_InvalidArg_For_NULL_JSON_Input)
+{
+    //Arrange
+    CGatewayMocks mocks;
+    GATEWAY_HANDLE gateway = Gateway_Create(NULL);
+    mocks.ResetAllCalls();
+
+    //Act
+    GATEWAY_UPDATE_FROM_JSON_RESULT result = Gateway_ReconfigureFromJson(gateway, NULL);
+
+    //Assert
+    ASSERT_ARE_EQUAL(int, GATEWAY_UPDATE_FROM_JSON_INVALID_ARG, result);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
+/* Tests_SRS_GATEWAY_JSON_31_004: [ The function shall use parson to parse the JSON string to a parson JSON_Value structure. ] */
+/* Tests_SRS_GATEWAY_JSON_31_005: [ The function shall return GATEWAY_UPDATE_FROM_JSON_ERROR if the JSON content could not be parsed to a JSON_Value. ] */
+TEST_FUNCTION(Gateway_ReconfigureFromJson_parse_string_fail_fails)
+{
+    //Arrange
+    CGatewayMocks mocks;
+    GATEWAY_HANDLE gateway = Gateway_Create(NULL);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, json_parse_string(IGNORED_PTR_ARG))
+        .IgnoreAllArguments()
+        .SetFailReturn((JSON_Value*)NULL);
+
+    //Act
+    GATEWAY_UPDATE_FROM_JSON_RESULT result = Gateway_ReconfigureFromJson(gateway, (const char*)"AnyThing");
+
+    //Assert
+    ASSERT_ARE_EQUAL(int, GATEWAY_UPDATE_FROM_JSON_ERROR, result);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
+/* Tests_SRS_GATEWAY_JSON_31_006: [ The function shall return GATEWAY_UPDATE_FROM_JSON_MEMORY upon any memory allocation failure. ] */
+TEST_FUNCTION(Gateway_ReconfigureFromJson_property_malloc_fail_fails)
+{
+    //Arrange
+    CGatewayMocks mocks;
+    GATEWAY_HANDLE gateway = Gateway_Create(NULL);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, json_parse_string(IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(GATEWAY_PROPERTIES)))
+        .SetFailReturn((void*)NULL);
+
+    //Act
+    GATEWAY_UPDATE_FROM_JSON_RESULT result = Gateway_ReconfigureFromJson(gateway, (const char*)"AnyThing");
+
+    //Assert
+    ASSERT_ARE_EQUAL(int, GATEWAY_UPDATE_FROM_JSON_MEMORY, result);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
+/* Tests_SRS_GATEWAY_JSON_31_007: [ The function shall traverse the JSON_Value object to initialize a GATEWAY_PROPERTIES instance, which shall describe both `modules` and `links`. ] */
+/* Tests_SRS_GATEWAY_JSON_31_008: [ The function shall return GATEWAY_UPDATE_FROM_JSON_ERROR if the JSON_Value contains incomplete information. ] */
+TEST_FUNCTION(Gateway_ReconfigureFromJson_fails_without_links)
+{
+    //Arrange
+    CGatewayMocks mocks;
+    GATEWAY_HANDLE gateway = Gateway_Create(NULL);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, json_parse_string(VALID_JSON_CONTENT));
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(GATEWAY_PROPERTIES)));
+    STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_value(IGNORED_PTR_ARG, "loaders"))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, ModuleLoader_InitializeFromJson(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_array(IGNORED_PTR_ARG, "modules"))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_array(IGNORED_PTR_ARG, "links"))
+        .IgnoreArgument(1)
+        .SetReturn((JSON_Array*)NULL);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY)));
+    STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //Act
+    GATEWAY_UPDATE_FROM_JSON_RESULT result = Gateway_ReconfigureFromJson(gateway, (const char*)"validJsonContent");
+
+    //Assert
+    ASSERT_ARE_EQUAL(int, GATEWAY_UPDATE_FROM_JSON_ERROR, result);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
 END_TEST_SUITE(gateway_createfromjson_ut)
@@ -154,6 +154,17 @@ BEGIN_TEST_SUITE(gateway_e2e)
         iotHubConfig.IoTHubName = IoTHubAccount_GetIoTHubName(g_iothubAcctInfo);
         iotHubConfig.IoTHubSuffix = IoTHubAccount_GetIoTHubSuffix(g_iothubAcctInfo);
         iotHubConfig.transportProvider = HTTP_Protocol;
+        iotHubConfig.maxPersonalities = 0;
+        iotHubConfig.batchMaxMessages = 0;
+        iotHubConfig.batchMaxBytes = 0;
+        iotHubConfig.batchMaxMilliseconds = 0;
+        iotHubConfig.transportPoolSize = 0;
+        iotHubConfig.storeDirectory = NULL;
+        iotHubConfig.storeMaxBytes = 0;
+        iotHubConfig.storeRetentionSeconds = 0;
+        iotHubConfig.storeReplayRate = 0;
+        iotHubConfig.maxInFlight = 0;
+        iotHubConfig.provisioningQueueSize = 0;
 
 
         E2EMODULE_CONFIG e2eModuleConfiguration;
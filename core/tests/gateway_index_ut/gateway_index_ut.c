@@ -0,0 +1,509 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define GATEWAY_EXPORT_H
+#define GATEWAY_EXPORT
+
+static bool malloc_will_fail = false;
+static size_t malloc_fail_count = 0;
+static size_t malloc_count = 0;
+
+void* my_gballoc_malloc(size_t size)
+{
+    ++malloc_count;
+
+    void* result;
+    if (malloc_will_fail == true && malloc_count == malloc_fail_count)
+    {
+        result = NULL;
+    }
+    else
+    {
+        result = malloc(size);
+    }
+
+    return result;
+}
+
+void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_bool.h"
+#include "umocktypes_stdint.h"
+
+#define ENABLE_MOCKS
+
+#include "azure_c_shared_utility/gballoc.h"
+
+#undef ENABLE_MOCKS
+
+#include "../src/gateway_internal.h"
+#include "../src/gateway_index.h"
+
+#define TEST_MODULE_COUNT 100
+
+static MODULE_DATA test_modules[TEST_MODULE_COUNT];
+static char test_names[TEST_MODULE_COUNT][16];
+
+static void init_test_modules(void)
+{
+    size_t i;
+    for (i = 0; i < TEST_MODULE_COUNT; i++)
+    {
+        (void)sprintf(test_names[i], "module%u", (unsigned int)i);
+        memset(&test_modules[i], 0, sizeof(MODULE_DATA));
+        test_modules[i].module_name = test_names[i];
+        test_modules[i].module = (MODULE_HANDLE)(uintptr_t)(0x1000 + i * 0x10);
+    }
+}
+
+//=============================================================================
+//Globals
+//=============================================================================
+
+#ifdef WIN32
+static TEST_MUTEX_HANDLE g_dllByDll;
+#endif
+static TEST_MUTEX_HANDLE g_testByTest;
+
+void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    (void)error_code;
+    ASSERT_FAIL("umock_c reported error");
+}
+
+BEGIN_TEST_SUITE(gateway_index_ut)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+    umocktypes_charptr_register_types();
+    umocktypes_stdint_register_types();
+
+    // malloc/free hooks
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    umock_c_deinit();
+
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest) != 0)
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    umock_c_reset_all_calls();
+    malloc_will_fail = false;
+    malloc_fail_count = 0;
+    malloc_count = 0;
+    init_test_modules();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+/*Tests_SRS_GATEWAY_INDEX_31_001: [ `GatewayIndex_Create` shall create an empty index of the modules by name, of the modules by handle and of the links. ]*/
+TEST_FUNCTION(GatewayIndex_Create_success)
+{
+    ///arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    GATEWAY_INDEX_HANDLE index = GatewayIndex_Create();
+
+    ///assert
+    ASSERT_IS_NOT_NULL(index);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(GatewayIndex_FindModuleByName(index, "module0"));
+    ASSERT_IS_FALSE(GatewayIndex_HasLink(index, NULL, &test_modules[0]));
+
+    ///ablutions
+    GatewayIndex_Destroy(index);
+}
+
+/*Tests_SRS_GATEWAY_INDEX_31_002: [ If any allocation fails, `GatewayIndex_Create` shall free what it allocated and return `NULL`. ]*/
+TEST_FUNCTION(GatewayIndex_Create_fails_when_any_allocation_fails)
+{
+    size_t i;
+    for (i = 1; i <= 4; i++)
+    {
+        ///arrange
+        umock_c_reset_all_calls();
+        malloc_will_fail = true;
+        malloc_fail_count = i;
+        malloc_count = 0;
+
+        ///act
+        GATEWAY_INDEX_HANDLE index = GatewayIndex_Create();
+
+        ///assert
+        ASSERT_IS_NULL(index);
+    }
+
+    ///ablutions
+}
+
+/*Tests_SRS_GATEWAY_INDEX_31_003: [ If `index` is `NULL`, `GatewayIndex_Destroy` shall do nothing. ]*/
+TEST_FUNCTION(GatewayIndex_Destroy_does_nothing_with_nothing)
+{
+    ///arrange
+
+    ///act
+    GatewayIndex_Destroy(NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///ablutions
+}
+
+/*Tests_SRS_GATEWAY_INDEX_31_004: [ `GatewayIndex_Destroy` shall free the index, but not the modules it refers to. ]*/
+TEST_FUNCTION(GatewayIndex_Destroy_frees_the_index)
+{
+    ///arrange
+    GATEWAY_INDEX_HANDLE index = GatewayIndex_Create();
+    (void)GatewayIndex_AddModule(index, &test_modules[0]);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    GatewayIndex_Destroy(index);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(char_ptr, "module0", test_modules[0].module_name);
+
+    ///ablutions
+}
+
+/*Tests_SRS_GATEWAY_INDEX_31_005: [ If `index`, `module_data` or its name is `NULL`, `GatewayIndex_AddModule` shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(GatewayIndex_AddModule_fails_with_invalid_args)
+{
+    ///arrange
+    GATEWAY_INDEX_HANDLE index = GatewayIndex_Create();
+    MODULE_DATA unnamed = { 0 };
+
+    ///act
+    int result1 = GatewayIndex_AddModule(NULL, &test_modules[0]);
+    int result2 = GatewayIndex_AddModule(index, NULL);
+    int result3 = GatewayIndex_AddModule(index, &unnamed);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result1);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result2);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result3);
+
+    ///ablutions
+    GatewayIndex_Destroy(index);
+}
+
+/*Tests_SRS_GATEWAY_INDEX_31_006: [ `GatewayIndex_AddModule` shall index the module by its name and by its handle, and return 0. ]*/
+/*Tests_SRS_GATEWAY_INDEX_31_009: [ `GatewayIndex_FindModuleByName` shall return the module of this name, or `NULL` if there is none or an argument is `NULL`. ]*/
+/*Tests_SRS_GATEWAY_INDEX_31_010: [ `GatewayIndex_FindModuleByHandle` shall return the module of this handle, or `NULL` if there is none or an argument is `NULL`. ]*/
+TEST_FUNCTION(GatewayIndex_AddModule_finds_the_module_by_name_and_handle)
+{
+    ///arrange
+    GATEWAY_INDEX_HANDLE index = GatewayIndex_Create();
+    umock_c_reset_all_calls();
+
+    ///act
+    int result = GatewayIndex_AddModule(index, &test_modules[0]);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(void_ptr, &test_modules[0], GatewayIndex_FindModuleByName(index, "module0"));
+    ASSERT_ARE_EQUAL(void_ptr, &test_modules[0], GatewayIndex_FindModuleByHandle(index, test_modules[0].module));
+    ASSERT_IS_NULL(GatewayIndex_FindModuleByName(index, "module1"));
+    ASSERT_IS_NULL(GatewayIndex_FindModuleByHandle(index, test_modules[1].module));
+    ASSERT_IS_NULL(GatewayIndex_FindModuleByName(index, NULL));
+    ASSERT_IS_NULL(GatewayIndex_FindModuleByName(NULL, "module0"));
+    ASSERT_IS_NULL(GatewayIndex_FindModuleByHandle(NULL, test_modules[0].module));
+
+    ///ablutions
+    GatewayIndex_Destroy(index);
+}
+
+/*Tests_SRS_GATEWAY_INDEX_31_007: [ If the name or the handle is already indexed, or if an allocation fails, `GatewayIndex_AddModule` shall leave the index unchanged and return a non-zero value. ]*/
+TEST_FUNCTION(GatewayIndex_AddModule_fails_with_a_duplicate_name)
+{
+    ///arrange
+    GATEWAY_INDEX_HANDLE index = GatewayIndex_Create();
+    (void)GatewayIndex_AddModule(index, &test_modules[0]);
+    test_modules[1].module_name = test_names[0];
+
+    ///act
+    int result = GatewayIndex_AddModule(index, &test_modules[1]);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(void_ptr, &test_modules[0], GatewayIndex_FindModuleByName(index, "module0"));
+    ASSERT_IS_NULL(GatewayIndex_FindModuleByHandle(index, test_modules[1].module));
+
+    ///ablutions
+    GatewayIndex_Destroy(index);
+}
+
+/*Tests_SRS_GATEWAY_INDEX_31_007: [ If the name or the handle is already indexed, or if an allocation fails, `GatewayIndex_AddModule` shall leave the index unchanged and return a non-zero value. ]*/
+TEST_FUNCTION(GatewayIndex_AddModule_fails_with_a_duplicate_handle)
+{
+    ///arrange
+    GATEWAY_INDEX_HANDLE index = GatewayIndex_Create();
+    (void)GatewayIndex_AddModule(index, &test_modules[0]);
+    test_modules[1].module = test_modules[0].module;
+
+    ///act
+    int result = GatewayIndex_AddModule(index, &test_modules[1]);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_IS_NULL(GatewayIndex_FindModuleByName(index, "module1"));
+    ASSERT_ARE_EQUAL(void_ptr, &test_modules[0], GatewayIndex_FindModuleByHandle(index, test_modules[0].module));
+
+    ///ablutions
+    GatewayIndex_Destroy(index);
+}
+
+/*Tests_SRS_GATEWAY_INDEX_31_012: [ The index shall double a table when it gets three quarters full, so a lookup takes the same time whatever the number of modules and links. ]*/
+TEST_FUNCTION(GatewayIndex_AddModule_grows_the_tables)
+{
+    ///arrange
+    GATEWAY_INDEX_HANDLE index = GatewayIndex_Create();
+    size_t i;
+
+    ///act
+    for (i = 0; i < TEST_MODULE_COUNT; i++)
+    {
+        ASSERT_ARE_EQUAL(int, 0, GatewayIndex_AddModule(index, &test_modules[i]));
+    }
+
+    ///assert
+    for (i = 0; i < TEST_MODULE_COUNT; i++)
+    {
+        ASSERT_ARE_EQUAL(void_ptr, &test_modules[i], GatewayIndex_FindModuleByName(index, test_names[i]));
+        ASSERT_ARE_EQUAL(void_ptr, &test_modules[i], GatewayIndex_FindModuleByHandle(index, test_modules[i].module));
+    }
+
+    ///ablutions
+    GatewayIndex_Destroy(index);
+}
+
+/*Tests_SRS_GATEWAY_INDEX_31_007: [ If the name or the handle is already indexed, or if an allocation fails, `GatewayIndex_AddModule` shall leave the index unchanged and return a non-zero value. ]*/
+TEST_FUNCTION(GatewayIndex_AddModule_fails_when_growing_the_handles_fails)
+{
+    ///arrange
+    GATEWAY_INDEX_HANDLE index = GatewayIndex_Create();
+    size_t i;
+
+    /* the tables start with 16 slots and grow on the 13th module */
+    for (i = 0; i < 12; i++)
+    {
+        (void)GatewayIndex_AddModule(index, &test_modules[i]);
+    }
+    malloc_will_fail = true;
+    malloc_fail_count = malloc_count + 2;
+
+    ///act
+    int result = GatewayIndex_AddModule(index, &test_modules[12]);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_IS_NULL(GatewayIndex_FindModuleByName(index, test_names[12]));
+    ASSERT_IS_NULL(GatewayIndex_FindModuleByHandle(index, test_modules[12].module));
+    for (i = 0; i < 12; i++)
+    {
+        ASSERT_ARE_EQUAL(void_ptr, &test_modules[i], GatewayIndex_FindModuleByName(index, test_names[i]));
+    }
+
+    ///ablutions
+    GatewayIndex_Destroy(index);
+}
+
+/*Tests_SRS_GATEWAY_INDEX_31_008: [ `GatewayIndex_RemoveModule` shall remove the module from the index, and do nothing if `index` or `module_data` is `NULL`. ]*/
+TEST_FUNCTION(GatewayIndex_RemoveModule_keeps_the_other_modules)
+{
+    ///arrange
+    GATEWAY_INDEX_HANDLE index = GatewayIndex_Create();
+    size_t i;
+    for (i = 0; i < TEST_MODULE_COUNT; i++)
+    {
+        (void)GatewayIndex_AddModule(index, &test_modules[i]);
+    }
+
+    ///act
+    for (i = 0; i < TEST_MODULE_COUNT; i += 2)
+    {
+        GatewayIndex_RemoveModule(index, &test_modules[i]);
+    }
+    GatewayIndex_RemoveModule(index, NULL);
+    GatewayIndex_RemoveModule(NULL, &test_modules[1]);
+
+    ///assert
+    for (i = 0; i < TEST_MODULE_COUNT; i++)
+    {
+        if (i % 2 == 0)
+        {
+            ASSERT_IS_NULL(GatewayIndex_FindModuleByName(index, test_names[i]));
+            ASSERT_IS_NULL(GatewayIndex_FindModuleByHandle(index, test_modules[i].module));
+        }
+        else
+        {
+            ASSERT_ARE_EQUAL(void_ptr, &test_modules[i], GatewayIndex_FindModuleByName(index, test_names[i]));
+            ASSERT_ARE_EQUAL(void_ptr, &test_modules[i], GatewayIndex_FindModuleByHandle(index, test_modules[i].module));
+        }
+    }
+
+    ///ablutions
+    GatewayIndex_Destroy(index);
+}
+
+/*Tests_SRS_GATEWAY_INDEX_31_008: [ `GatewayIndex_RemoveModule` shall remove the module from the index, and do nothing if `index` or `module_data` is `NULL`. ]*/
+TEST_FUNCTION(GatewayIndex_RemoveModule_keeps_a_module_of_the_same_name)
+{
+    ///arrange
+    GATEWAY_INDEX_HANDLE index = GatewayIndex_Create();
+    (void)GatewayIndex_AddModule(index, &test_modules[0]);
+    test_modules[1].module_name = test_names[0];
+
+    ///act
+    GatewayIndex_RemoveModule(index, &test_modules[1]);
+
+    ///assert
+    ASSERT_ARE_EQUAL(void_ptr, &test_modules[0], GatewayIndex_FindModuleByName(index, "module0"));
+
+    ///ablutions
+    GatewayIndex_Destroy(index);
+}
+
+/*Tests_SRS_GATEWAY_INDEX_31_011: [ If `index` or `sink` is `NULL`, `GatewayIndex_AddLink` shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(GatewayIndex_AddLink_fails_with_invalid_args)
+{
+    ///arrange
+    GATEWAY_INDEX_HANDLE index = GatewayIndex_Create();
+
+    ///act
+    int result1 = GatewayIndex_AddLink(NULL, &test_modules[0], &test_modules[1]);
+    int result2 = GatewayIndex_AddLink(index, &test_modules[0], NULL);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result1);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result2);
+
+    ///ablutions
+    GatewayIndex_Destroy(index);
+}
+
+/*Tests_SRS_GATEWAY_INDEX_31_013: [ `GatewayIndex_AddLink` shall index the link from `source` to `sink`, a `NULL` source standing for any source, and return 0. ]*/
+/*Tests_SRS_GATEWAY_INDEX_31_016: [ `GatewayIndex_HasLink` shall return true if the link from `source` to `sink` is indexed, and false otherwise or if `index` or `sink` is `NULL`. ]*/
+TEST_FUNCTION(GatewayIndex_AddLink_indexes_the_link)
+{
+    ///arrange
+    GATEWAY_INDEX_HANDLE index = GatewayIndex_Create();
+
+    ///act
+    int result1 = GatewayIndex_AddLink(index, &test_modules[0], &test_modules[1]);
+    int result2 = GatewayIndex_AddLink(index, NULL, &test_modules[2]);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result1);
+    ASSERT_ARE_EQUAL(int, 0, result2);
+    ASSERT_IS_TRUE(GatewayIndex_HasLink(index, &test_modules[0], &test_modules[1]));
+    ASSERT_IS_FALSE(GatewayIndex_HasLink(index, &test_modules[1], &test_modules[0]));
+    ASSERT_IS_TRUE(GatewayIndex_HasLink(index, NULL, &test_modules[2]));
+    ASSERT_IS_FALSE(GatewayIndex_HasLink(index, &test_modules[0], &test_modules[2]));
+    ASSERT_IS_FALSE(GatewayIndex_HasLink(index, &test_modules[0], NULL));
+    ASSERT_IS_FALSE(GatewayIndex_HasLink(NULL, &test_modules[0], &test_modules[1]));
+
+    ///ablutions
+    GatewayIndex_Destroy(index);
+}
+
+/*Tests_SRS_GATEWAY_INDEX_31_014: [ If the link is already indexed, or if an allocation fails, `GatewayIndex_AddLink` shall return a non-zero value. ]*/
+TEST_FUNCTION(GatewayIndex_AddLink_fails_with_a_duplicate_link)
+{
+    ///arrange
+    GATEWAY_INDEX_HANDLE index = GatewayIndex_Create();
+    (void)GatewayIndex_AddLink(index, &test_modules[0], &test_modules[1]);
+
+    ///act
+    int result = GatewayIndex_AddLink(index, &test_modules[0], &test_modules[1]);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_IS_TRUE(GatewayIndex_HasLink(index, &test_modules[0], &test_modules[1]));
+
+    ///ablutions
+    GatewayIndex_Destroy(index);
+}
+
+/*Tests_SRS_GATEWAY_INDEX_31_015: [ `GatewayIndex_RemoveLink` shall remove the link from `source` to `sink` from the index, and do nothing if `index` or `sink` is `NULL`. ]*/
+TEST_FUNCTION(GatewayIndex_RemoveLink_keeps_the_other_links)
+{
+    ///arrange
+    GATEWAY_INDEX_HANDLE index = GatewayIndex_Create();
+    size_t i;
+    for (i = 0; i + 1 < TEST_MODULE_COUNT; i++)
+    {
+        (void)GatewayIndex_AddLink(index, &test_modules[i], &test_modules[i + 1]);
+    }
+
+    ///act
+    for (i = 0; i + 1 < TEST_MODULE_COUNT; i += 3)
+    {
+        GatewayIndex_RemoveLink(index, &test_modules[i], &test_modules[i + 1]);
+    }
+    GatewayIndex_RemoveLink(index, &test_modules[1], NULL);
+    GatewayIndex_RemoveLink(NULL, &test_modules[1], &test_modules[2]);
+
+    ///assert
+    for (i = 0; i + 1 < TEST_MODULE_COUNT; i++)
+    {
+        ASSERT_ARE_EQUAL(bool, i % 3 != 0, GatewayIndex_HasLink(index, &test_modules[i], &test_modules[i + 1]));
+    }
+
+    ///ablutions
+    GatewayIndex_Destroy(index);
+}
+
+END_TEST_SUITE(gateway_index_ut)
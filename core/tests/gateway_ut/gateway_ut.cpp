@@ -4,15 +4,18 @@
 #include <cstdlib>
 #include <cstddef>
 #include <cstdbool>
+#include <cstring>
 #include "testrunnerswitcher.h"
 #include "micromock.h"
 #include "micromockcharstararenullterminatedstrings.h"
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/threadapi.h"
 
 #include "gateway.h"
 #include "broker.h"
 #include "experimental/event_system.h"
 #include "module_loader.h"
+#include "../src/gateway_internal.h"
 
 #include "azure_c_shared_utility/vector_types_internal.h"
 #ifdef OUTPROCESS_ENABLED
@@ -62,10 +65,23 @@ static size_t currentBroker_Create_call;
 static size_t whenShallBroker_Create_fail;
 static size_t currentBroker_module_count;
 static size_t currentBroker_ref_count;
+static BROKER_ALERT_CALLBACK currentBroker_alert_callback;
+static void* currentBroker_alert_context;
+static GATEWAY_ALERT_CONTEXT lastEventSystem_alert;
 
 static size_t currentModuleLoader_Load_call;
 static size_t whenShallModuleLoader_Load_fail;
 
+static size_t currentmock_Module_Create_call;
+static size_t whenShallmock_Module_Create_fail;
+static size_t currentLock_Init_call;
+static size_t whenShallLock_Init_fail;
+static size_t currentThreadAPI_Create_call;
+static size_t whenShallThreadAPI_Create_fail;
+
+static MODULE_HANDLE startedModules[8];
+static size_t startedModuleCount;
+
 
 static size_t currentVECTOR_create_call;
 static size_t whenShallVECTOR_create_fail;
@@ -74,6 +90,59 @@ static size_t whenShallVECTOR_push_back_fail;
 static size_t currentVECTOR_find_if_call;
 static size_t whenShallVECTOR_find_if_fail;
 
+static size_t currentGatewayIndex_Create_call;
+static size_t whenShallGatewayIndex_Create_fail;
+static size_t currentGatewayIndex_AddModule_call;
+static size_t whenShallGatewayIndex_AddModule_fail;
+static size_t currentGatewayIndex_AddLink_call;
+static size_t whenShallGatewayIndex_AddLink_fail;
+static size_t currentGatewayIndex_FindModuleByName_call;
+static size_t whenShallGatewayIndex_FindModuleByName_fail;
+
+/* The gateway index of the tests: the modules and links it holds, looked up one by one. */
+typedef struct TEST_INDEX_LINK_TAG
+{
+    const MODULE_DATA* source;
+    const MODULE_DATA* sink;
+} TEST_INDEX_LINK;
+
+typedef struct TEST_INDEX_TAG
+{
+    VECTOR_HANDLE modules;
+    VECTOR_HANDLE links;
+} TEST_INDEX;
+
+static TEST_INDEX_LINK* test_index_find_link(GATEWAY_INDEX_HANDLE index, const MODULE_DATA* source, const MODULE_DATA* sink)
+{
+    TEST_INDEX_LINK* result = NULL;
+    VECTOR_HANDLE links = ((TEST_INDEX*)index)->links;
+    for (size_t i = 0; i < BASEIMPLEMENTATION::VECTOR_size(links) && result == NULL; i++)
+    {
+        TEST_INDEX_LINK* link = (TEST_INDEX_LINK*)BASEIMPLEMENTATION::VECTOR_element(links, i);
+        if (link->source == source && link->sink == sink)
+        {
+            result = link;
+        }
+    }
+    return result;
+}
+
+static MODULE_DATA** test_index_find_module(GATEWAY_INDEX_HANDLE index, const char* module_name, MODULE_HANDLE module)
+{
+    MODULE_DATA** result = NULL;
+    VECTOR_HANDLE modules = ((TEST_INDEX*)index)->modules;
+    for (size_t i = 0; i < BASEIMPLEMENTATION::VECTOR_size(modules) && result == NULL; i++)
+    {
+        MODULE_DATA** module_data = (MODULE_DATA**)BASEIMPLEMENTATION::VECTOR_element(modules, i);
+        if ((module_name != NULL && strcmp((*module_data)->module_name, module_name) == 0) ||
+            (module != NULL && (*module_data)->module == module))
+        {
+            result = module_data;
+        }
+    }
+    return result;
+}
+
 static MODULE_API_1 dummyAPIs;
 
 TYPED_MOCK_CLASS(CGatewayLLMocks, CGlobalMock)
@@ -89,8 +158,12 @@ public:
 	MOCK_VOID_METHOD_END();
 
     MOCK_STATIC_METHOD_2(, MODULE_HANDLE, mock_Module_Create, BROKER_HANDLE, broker, const void*, configuration)
-        MODULE_HANDLE result1;
-        result1 = (MODULE_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1);
+        MODULE_HANDLE result1 = NULL;
+        currentmock_Module_Create_call++;
+        if (whenShallmock_Module_Create_fail != currentmock_Module_Create_call)
+        {
+            result1 = (MODULE_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1);
+        }
     MOCK_METHOD_END(MODULE_HANDLE, result1);
 
     MOCK_STATIC_METHOD_1(, void, mock_Module_Destroy, MODULE_HANDLE, moduleHandle)
@@ -101,6 +174,10 @@ public:
     MOCK_VOID_METHOD_END();
 
     MOCK_STATIC_METHOD_1(, void, mock_Module_Start, MODULE_HANDLE, moduleHandle)
+        if (startedModuleCount < sizeof(startedModules) / sizeof(startedModules[0]))
+        {
+            startedModules[startedModuleCount++] = moduleHandle;
+        }
     MOCK_VOID_METHOD_END();
 
     MOCK_STATIC_METHOD_1(, void, Broker_DecRef, BROKER_HANDLE, broker)
@@ -172,6 +249,32 @@ public:
     MOCK_STATIC_METHOD_2(, BROKER_RESULT, Broker_RemoveLink, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, link)
     MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
 
+    MOCK_STATIC_METHOD_5(, BROKER_RESULT, Broker_UpdateLinks, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, links_to_remove, size_t, remove_count, const BROKER_LINK_DATA*, links_to_add, size_t, add_count)
+    MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
+
+    MOCK_STATIC_METHOD_2(, BROKER_RESULT, Broker_FuseLink, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, link)
+    MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
+
+    MOCK_STATIC_METHOD_2(, BROKER_RESULT, Broker_UnfuseLink, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, link)
+    MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
+
+    MOCK_STATIC_METHOD_3(, BROKER_RESULT, Broker_SetAlertCallback, BROKER_HANDLE, broker, BROKER_ALERT_CALLBACK, callback, void*, context)
+        currentBroker_alert_callback = callback;
+        currentBroker_alert_context = context;
+    MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
+
+    MOCK_STATIC_METHOD_2(, BROKER_RESULT, Broker_SetAlertThresholds, BROKER_HANDLE, broker, const BROKER_ALERT_THRESHOLDS*, thresholds)
+    MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
+
+    MOCK_STATIC_METHOD_2(, BROKER_RESULT, Broker_DrainModule, BROKER_HANDLE, handle, const MODULE*, module)
+        BROKER_RESULT result1 = BROKER_ERROR;
+        if (handle != NULL && module != NULL && currentBroker_module_count > 0)
+        {
+            --currentBroker_module_count;
+            result1 = BROKER_OK;
+        }
+    MOCK_METHOD_END(BROKER_RESULT, result1)
+
     MOCK_STATIC_METHOD_2(, MODULE_LIBRARY_HANDLE, DynamicModuleLoader_Load, const struct MODULE_LOADER_TAG*, loader, const void*, entrypoint)
         currentModuleLoader_Load_call++;
         MODULE_LIBRARY_HANDLE handle = NULL;
@@ -241,6 +344,10 @@ public:
         // no-op
     MOCK_VOID_METHOD_END();
 
+    MOCK_STATIC_METHOD_4(, void, EventSystem_ReportAlert, EVENTSYSTEM_HANDLE, event_system, GATEWAY_HANDLE, gw, GATEWAY_EVENT, event_type, const GATEWAY_ALERT_CONTEXT*, alert)
+        lastEventSystem_alert = *alert;
+    MOCK_VOID_METHOD_END();
+
     MOCK_STATIC_METHOD_1(, void, EventSystem_Destroy, EVENTSYSTEM_HANDLE, handle)
         BASEIMPLEMENTATION::gballoc_free(handle);
     MOCK_VOID_METHOD_END();
@@ -296,6 +403,76 @@ public:
         }
     MOCK_METHOD_END(void*, element);
 
+    MOCK_STATIC_METHOD_0(, GATEWAY_INDEX_HANDLE, GatewayIndex_Create)
+        TEST_INDEX* index = NULL;
+        currentGatewayIndex_Create_call++;
+        if (whenShallGatewayIndex_Create_fail != currentGatewayIndex_Create_call)
+        {
+            index = (TEST_INDEX*)BASEIMPLEMENTATION::gballoc_malloc(sizeof(TEST_INDEX));
+            index->modules = BASEIMPLEMENTATION::VECTOR_create(sizeof(MODULE_DATA*));
+            index->links = BASEIMPLEMENTATION::VECTOR_create(sizeof(TEST_INDEX_LINK));
+        }
+    MOCK_METHOD_END(GATEWAY_INDEX_HANDLE, (GATEWAY_INDEX_HANDLE)index);
+
+    MOCK_STATIC_METHOD_1(, void, GatewayIndex_Destroy, GATEWAY_INDEX_HANDLE, index)
+        BASEIMPLEMENTATION::VECTOR_destroy(((TEST_INDEX*)index)->modules);
+        BASEIMPLEMENTATION::VECTOR_destroy(((TEST_INDEX*)index)->links);
+        BASEIMPLEMENTATION::gballoc_free(index);
+    MOCK_VOID_METHOD_END();
+
+    MOCK_STATIC_METHOD_2(, int, GatewayIndex_AddModule, GATEWAY_INDEX_HANDLE, index, MODULE_DATA*, module_data)
+        int result1 = __LINE__;
+        currentGatewayIndex_AddModule_call++;
+        if (whenShallGatewayIndex_AddModule_fail != currentGatewayIndex_AddModule_call &&
+            test_index_find_module(index, module_data->module_name, module_data->module) == NULL)
+        {
+            result1 = BASEIMPLEMENTATION::VECTOR_push_back(((TEST_INDEX*)index)->modules, &module_data, 1);
+        }
+    MOCK_METHOD_END(int, result1);
+
+    MOCK_STATIC_METHOD_2(, void, GatewayIndex_RemoveModule, GATEWAY_INDEX_HANDLE, index, const MODULE_DATA*, module_data)
+        MODULE_DATA** found = test_index_find_module(index, NULL, module_data->module);
+        if (found != NULL && *found == module_data)
+        {
+            BASEIMPLEMENTATION::VECTOR_erase(((TEST_INDEX*)index)->modules, found, 1);
+        }
+    MOCK_VOID_METHOD_END();
+
+    MOCK_STATIC_METHOD_2(, MODULE_DATA*, GatewayIndex_FindModuleByName, GATEWAY_INDEX_HANDLE, index, const char*, module_name)
+        MODULE_DATA** found = NULL;
+        currentGatewayIndex_FindModuleByName_call++;
+        if (whenShallGatewayIndex_FindModuleByName_fail != currentGatewayIndex_FindModuleByName_call)
+        {
+            found = test_index_find_module(index, module_name, NULL);
+        }
+    MOCK_METHOD_END(MODULE_DATA*, (found == NULL) ? NULL : *found);
+
+    MOCK_STATIC_METHOD_2(, MODULE_DATA*, GatewayIndex_FindModuleByHandle, GATEWAY_INDEX_HANDLE, index, MODULE_HANDLE, module)
+        MODULE_DATA** found = test_index_find_module(index, NULL, module);
+    MOCK_METHOD_END(MODULE_DATA*, (found == NULL) ? NULL : *found);
+
+    MOCK_STATIC_METHOD_3(, int, GatewayIndex_AddLink, GATEWAY_INDEX_HANDLE, index, const MODULE_DATA*, source, const MODULE_DATA*, sink)
+        int result1 = __LINE__;
+        currentGatewayIndex_AddLink_call++;
+        if (whenShallGatewayIndex_AddLink_fail != currentGatewayIndex_AddLink_call &&
+            test_index_find_link(index, source, sink) == NULL)
+        {
+            TEST_INDEX_LINK link = { source, sink };
+            result1 = BASEIMPLEMENTATION::VECTOR_push_back(((TEST_INDEX*)index)->links, &link, 1);
+        }
+    MOCK_METHOD_END(int, result1);
+
+    MOCK_STATIC_METHOD_3(, void, GatewayIndex_RemoveLink, GATEWAY_INDEX_HANDLE, index, const MODULE_DATA*, source, const MODULE_DATA*, sink)
+        TEST_INDEX_LINK* found = test_index_find_link(index, source, sink);
+        if (found != NULL)
+        {
+            BASEIMPLEMENTATION::VECTOR_erase(((TEST_INDEX*)index)->links, found, 1);
+        }
+    MOCK_VOID_METHOD_END();
+
+    MOCK_STATIC_METHOD_3(, bool, GatewayIndex_HasLink, GATEWAY_INDEX_HANDLE, index, const MODULE_DATA*, source, const MODULE_DATA*, sink)
+    MOCK_METHOD_END(bool, test_index_find_link(index, source, sink) != NULL);
+
     MOCK_STATIC_METHOD_1(, void*, gballoc_malloc, size_t, size)
         void* result2;
         currentmalloc_call++;
@@ -330,6 +507,40 @@ public:
         (*destination) = (char*)malloc(strlen(source) + 1);
         strcpy(*destination, source);
     MOCK_METHOD_END(int, 0);
+
+    MOCK_STATIC_METHOD_0(, LOCK_HANDLE, Lock_Init)
+        LOCK_HANDLE result1 = NULL;
+        currentLock_Init_call++;
+        if (whenShallLock_Init_fail != currentLock_Init_call)
+        {
+            result1 = (LOCK_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1);
+        }
+    MOCK_METHOD_END(LOCK_HANDLE, result1);
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Lock, LOCK_HANDLE, lock)
+    MOCK_METHOD_END(LOCK_RESULT, LOCK_OK);
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Unlock, LOCK_HANDLE, lock)
+    MOCK_METHOD_END(LOCK_RESULT, LOCK_OK);
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Lock_Deinit, LOCK_HANDLE, lock)
+        BASEIMPLEMENTATION::gballoc_free(lock);
+    MOCK_METHOD_END(LOCK_RESULT, LOCK_OK);
+
+    /* runs the thread to completion before returning, so the tests stay deterministic */
+    MOCK_STATIC_METHOD_3(, THREADAPI_RESULT, ThreadAPI_Create, THREAD_HANDLE*, threadHandle, THREAD_START_FUNC, func, void*, arg)
+        THREADAPI_RESULT result1 = THREADAPI_ERROR;
+        currentThreadAPI_Create_call++;
+        if (whenShallThreadAPI_Create_fail != currentThreadAPI_Create_call)
+        {
+            *threadHandle = (THREAD_HANDLE)0x4242;
+            (void)func(arg);
+            result1 = THREADAPI_OK;
+        }
+    MOCK_METHOD_END(THREADAPI_RESULT, result1);
+
+    MOCK_STATIC_METHOD_2(, THREADAPI_RESULT, ThreadAPI_Join, THREAD_HANDLE, threadHandle, int*, res)
+    MOCK_METHOD_END(THREADAPI_RESULT, THREADAPI_OK);
 };
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayLLMocks, , void*, mock_Module_ParseConfigurationFromJson, const char*, configuration);
@@ -345,6 +556,12 @@ DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , BROKER_RESULT, Broker_AddModule,
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , BROKER_RESULT, Broker_RemoveModule, BROKER_HANDLE, handle, const MODULE*, module);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , BROKER_RESULT, Broker_AddLink, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, link);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , BROKER_RESULT, Broker_RemoveLink, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, link);
+DECLARE_GLOBAL_MOCK_METHOD_5(CGatewayLLMocks, , BROKER_RESULT, Broker_UpdateLinks, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, links_to_remove, size_t, remove_count, const BROKER_LINK_DATA*, links_to_add, size_t, add_count);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , BROKER_RESULT, Broker_FuseLink, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, link);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , BROKER_RESULT, Broker_UnfuseLink, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, link);
+DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayLLMocks, , BROKER_RESULT, Broker_SetAlertCallback, BROKER_HANDLE, broker, BROKER_ALERT_CALLBACK, callback, void*, context);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , BROKER_RESULT, Broker_SetAlertThresholds, BROKER_HANDLE, broker, const BROKER_ALERT_THRESHOLDS*, thresholds);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , BROKER_RESULT, Broker_DrainModule, BROKER_HANDLE, handle, const MODULE*, module);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayLLMocks, , void, Broker_IncRef, BROKER_HANDLE, broker);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayLLMocks, , void, Broker_DecRef, BROKER_HANDLE, broker);
 
@@ -365,6 +582,7 @@ DECLARE_GLOBAL_MOCK_METHOD_0(CGatewayLLMocks, , int, OutprocessLoader_SpawnChild
 DECLARE_GLOBAL_MOCK_METHOD_0(CGatewayLLMocks, , EVENTSYSTEM_HANDLE, EventSystem_Init);
 DECLARE_GLOBAL_MOCK_METHOD_4(CGatewayLLMocks, , void, EventSystem_AddEventCallback, EVENTSYSTEM_HANDLE, event_system, GATEWAY_EVENT, event_type, GATEWAY_CALLBACK, callback, void*, user_param);
 DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayLLMocks, , void, EventSystem_ReportEvent, EVENTSYSTEM_HANDLE, event_system, GATEWAY_HANDLE, gw, GATEWAY_EVENT, event_type);
+DECLARE_GLOBAL_MOCK_METHOD_4(CGatewayLLMocks, , void, EventSystem_ReportAlert, EVENTSYSTEM_HANDLE, event_system, GATEWAY_HANDLE, gw, GATEWAY_EVENT, event_type, const GATEWAY_ALERT_CONTEXT*, alert);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayLLMocks, , void, EventSystem_Destroy, EVENTSYSTEM_HANDLE, handle);
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayLLMocks, , VECTOR_HANDLE, VECTOR_create, size_t, elementSize);
@@ -377,6 +595,16 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayLLMocks, , void*, VECTOR_back, const VECTOR
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayLLMocks, , size_t, VECTOR_size, const VECTOR_HANDLE, handle);
 DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayLLMocks, , void*, VECTOR_find_if, const VECTOR_HANDLE, handle, PREDICATE_FUNCTION, pred, const void*, value);
 
+DECLARE_GLOBAL_MOCK_METHOD_0(CGatewayLLMocks, , GATEWAY_INDEX_HANDLE, GatewayIndex_Create);
+DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayLLMocks, , void, GatewayIndex_Destroy, GATEWAY_INDEX_HANDLE, index);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , int, GatewayIndex_AddModule, GATEWAY_INDEX_HANDLE, index, MODULE_DATA*, module_data);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , void, GatewayIndex_RemoveModule, GATEWAY_INDEX_HANDLE, index, const MODULE_DATA*, module_data);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , MODULE_DATA*, GatewayIndex_FindModuleByName, GATEWAY_INDEX_HANDLE, index, const char*, module_name);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , MODULE_DATA*, GatewayIndex_FindModuleByHandle, GATEWAY_INDEX_HANDLE, index, MODULE_HANDLE, module);
+DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayLLMocks, , int, GatewayIndex_AddLink, GATEWAY_INDEX_HANDLE, index, const MODULE_DATA*, source, const MODULE_DATA*, sink);
+DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayLLMocks, , void, GatewayIndex_RemoveLink, GATEWAY_INDEX_HANDLE, index, const MODULE_DATA*, source, const MODULE_DATA*, sink);
+DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayLLMocks, , bool, GatewayIndex_HasLink, GATEWAY_INDEX_HANDLE, index, const MODULE_DATA*, source, const MODULE_DATA*, sink);
+
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayLLMocks, , void*, gballoc_malloc, size_t, size);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , void*, gballoc_realloc, void*, ptr, size_t, size);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayLLMocks, , void, gballoc_free, void*, ptr)
@@ -384,6 +612,13 @@ DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , void*, gballoc_calloc, size_t, n
 
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , int, mallocAndStrcpy_s, char**, destination, const char*, source);
 
+DECLARE_GLOBAL_MOCK_METHOD_0(CGatewayLLMocks, , LOCK_HANDLE, Lock_Init);
+DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayLLMocks, , LOCK_RESULT, Lock, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayLLMocks, , LOCK_RESULT, Unlock, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayLLMocks, , LOCK_RESULT, Lock_Deinit, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayLLMocks, , THREADAPI_RESULT, ThreadAPI_Create, THREAD_HANDLE*, threadHandle, THREAD_START_FUNC, func, void*, arg);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , THREADAPI_RESULT, ThreadAPI_Join, THREAD_HANDLE, threadHandle, int*, res);
+
 static MICROMOCK_GLOBAL_SEMAPHORE_HANDLE g_dllByDll;
 static MICROMOCK_MUTEX_HANDLE g_testByTest;
 
@@ -430,6 +665,8 @@ static void expectEventSystemInit(CGatewayLLMocks &mocks)
 
 static void expectEventSystemDestroy(CGatewayLLMocks &mocks)
 {
+    STRICT_EXPECTED_CALL(mocks, Broker_SetAlertCallback(IGNORED_PTR_ARG, NULL, NULL))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_DESTROYED))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -437,6 +674,28 @@ static void expectEventSystemDestroy(CGatewayLLMocks &mocks)
         .IgnoreArgument(1);
 }
 
+/* The calls of running task_count tasks on the gateway worker threads. */
+static void expectConcurrentTasks(CGatewayLLMocks &mocks, size_t task_count)
+{
+    size_t thread_count = (task_count < 8) ? task_count : 8;
+
+    STRICT_EXPECTED_CALL(mocks, Lock_Init());
+    STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments()
+        .ExpectedTimesExactly(thread_count - 1);
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .ExpectedTimesExactly(task_count + thread_count);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .ExpectedTimesExactly(task_count + thread_count);
+    STRICT_EXPECTED_CALL(mocks, ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments()
+        .ExpectedTimesExactly(thread_count - 1);
+    STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+}
+
 static void sampleCallbackFunc(GATEWAY_HANDLE gw, GATEWAY_EVENT event_type, GATEWAY_EVENT_CTX ctx, void* user_param)
 {
     (void)gw;
@@ -478,10 +737,20 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
     whenShallBroker_Create_fail = 0;
     currentBroker_module_count = 0;
     currentBroker_ref_count = 0;
+    currentBroker_alert_callback = NULL;
+    currentBroker_alert_context = NULL;
+    memset(&lastEventSystem_alert, 0, sizeof(lastEventSystem_alert));
 
     currentModuleLoader_Load_call = 0;
     whenShallModuleLoader_Load_fail = 0;
 
+    currentmock_Module_Create_call = 0;
+    whenShallmock_Module_Create_fail = 0;
+    currentLock_Init_call = 0;
+    whenShallLock_Init_fail = 0;
+    currentThreadAPI_Create_call = 0;
+    whenShallThreadAPI_Create_fail = 0;
+    startedModuleCount = 0;
 
     currentVECTOR_create_call = 0;
     whenShallVECTOR_create_fail = 0;
@@ -490,6 +759,15 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
     currentVECTOR_find_if_call = 0;
     whenShallVECTOR_find_if_fail = 0;
 
+    currentGatewayIndex_Create_call = 0;
+    whenShallGatewayIndex_Create_fail = 0;
+    currentGatewayIndex_AddModule_call = 0;
+    whenShallGatewayIndex_AddModule_fail = 0;
+    currentGatewayIndex_AddLink_call = 0;
+    whenShallGatewayIndex_AddLink_fail = 0;
+    currentGatewayIndex_FindModuleByName_call = 0;
+    whenShallGatewayIndex_FindModuleByName_fail = 0;
+
     dummyAPIs =
     {
         {MODULE_API_VERSION_1},
@@ -553,10 +831,13 @@ TEST_FUNCTION(Gateway_Create_Creates_Handle_Success)
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Broker_Create());
+    STRICT_EXPECTED_CALL(mocks, Broker_SetAlertCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_Create());
     expectEventSystemInit(mocks);
 
     //Act
@@ -610,10 +891,14 @@ TEST_FUNCTION(Gateway_Create_returns_null_on_bad_module_api_entry)
 	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Broker_Create());
+    STRICT_EXPECTED_CALL(mocks, EventSystem_Init());
+    STRICT_EXPECTED_CALL(mocks, Broker_SetAlertCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
         .IgnoreArgument(1); //modules
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
         .IgnoreArgument(1); //links
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_Create());
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(newdummyProps.gateway_modules));
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(newdummyProps.gateway_modules, 0));
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
@@ -627,6 +912,9 @@ TEST_FUNCTION(Gateway_Create_returns_null_on_bad_module_api_entry)
 #ifdef OUTPROCESS_ENABLED
     EXPECTED_CALL(mocks, OutprocessLoader_JoinChildProcesses());
 #endif
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    expectEventSystemDestroy(mocks);
     STRICT_EXPECTED_CALL(mocks, Broker_Destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
@@ -730,11 +1018,15 @@ TEST_FUNCTION(Gateway_Create_VECTOR_Create_Fails)
         .IgnoreArgument(1);
 
     STRICT_EXPECTED_CALL(mocks, Broker_Create());
+    STRICT_EXPECTED_CALL(mocks, EventSystem_Init());
+    STRICT_EXPECTED_CALL(mocks, Broker_SetAlertCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
 
     whenShallVECTOR_create_fail = 1; 
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
 
+    expectEventSystemDestroy(mocks);
     STRICT_EXPECTED_CALL(mocks, Broker_Destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
@@ -765,6 +1057,9 @@ TEST_FUNCTION(Gateway_Create_VECTOR_Create2_Fails)
         .IgnoreArgument(1);
 
     STRICT_EXPECTED_CALL(mocks, Broker_Create());
+    STRICT_EXPECTED_CALL(mocks, EventSystem_Init());
+    STRICT_EXPECTED_CALL(mocks, Broker_SetAlertCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
 
     whenShallVECTOR_create_fail = 2;
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
@@ -780,6 +1075,7 @@ TEST_FUNCTION(Gateway_Create_VECTOR_Create2_Fails)
 #ifdef OUTPROCESS_ENABLED
     EXPECTED_CALL(mocks, OutprocessLoader_JoinChildProcesses());
 #endif
+    expectEventSystemDestroy(mocks);
     STRICT_EXPECTED_CALL(mocks, Broker_Destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
@@ -796,6 +1092,58 @@ TEST_FUNCTION(Gateway_Create_VECTOR_Create2_Fails)
     //Nothing to cleanup
 }
 
+/*Tests_SRS_GATEWAY_31_017: [ The function shall create the gateway index of the modules and links, and shall return NULL if it cannot be created. ]*/
+TEST_FUNCTION(Gateway_Create_GatewayIndex_Create_Fails)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    //Expectations
+    STRICT_EXPECTED_CALL(mocks, ModuleLoader_Initialize());
+    STRICT_EXPECTED_CALL(mocks, ModuleLoader_Destroy());
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(mocks, Broker_Create());
+    STRICT_EXPECTED_CALL(mocks, EventSystem_Init());
+    STRICT_EXPECTED_CALL(mocks, Broker_SetAlertCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    whenShallGatewayIndex_Create_fail = 1;
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_Create());
+
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+#ifdef OUTPROCESS_ENABLED
+    EXPECTED_CALL(mocks, OutprocessLoader_JoinChildProcesses());
+#endif
+    expectEventSystemDestroy(mocks);
+    STRICT_EXPECTED_CALL(mocks, Broker_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_Create(NULL);
+
+    //Assert
+    ASSERT_IS_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    //Nothing to cleanup
+}
+
 /*Codes_SRS_GATEWAY_14_002: [ This function shall return NULL upon any failure. ] */
 /*Tests_SRS_GATEWAY_27_027: [ Launch - This function shall join any spawned threads upon any failure. ]*/
 TEST_FUNCTION(Gateway_Create_VECTOR_push_back_Fails_To_Add_All_Modules_In_Props)
@@ -818,15 +1166,25 @@ TEST_FUNCTION(Gateway_Create_VECTOR_push_back_Fails_To_Add_All_Modules_In_Props)
 	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Broker_Create());
+    STRICT_EXPECTED_CALL(mocks, EventSystem_Init());
+    STRICT_EXPECTED_CALL(mocks, Broker_SetAlertCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
         .IgnoreArgument(1); //modules
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
         .IgnoreArgument(1); //links
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_Create());
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(dummyProps->gateway_modules));
 
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1); //Modules being created
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    expectConcurrentTasks(mocks, 2);
+
     //Adding module 1 (Success)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_modules, 0));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
@@ -852,6 +1210,8 @@ TEST_FUNCTION(Gateway_Create_VECTOR_push_back_Fails_To_Add_All_Modules_In_Props)
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_AddModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
@@ -859,7 +1219,7 @@ TEST_FUNCTION(Gateway_Create_VECTOR_push_back_Fails_To_Add_All_Modules_In_Props)
 
     //Adding module 2 (Failure)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_modules, 1));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
@@ -905,8 +1265,14 @@ TEST_FUNCTION(Gateway_Create_VECTOR_push_back_Fails_To_Add_All_Modules_In_Props)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreAllArguments();
     EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
@@ -931,9 +1297,12 @@ TEST_FUNCTION(Gateway_Create_VECTOR_push_back_Fails_To_Add_All_Modules_In_Props)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
 #ifdef OUTPROCESS_ENABLED
     EXPECTED_CALL(mocks, OutprocessLoader_JoinChildProcesses());
 #endif
+    expectEventSystemDestroy(mocks);
     STRICT_EXPECTED_CALL(mocks, Broker_Destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
@@ -972,15 +1341,25 @@ TEST_FUNCTION(Gateway_Create_Broker_AddModule_Fails_To_Add_All_Modules_In_Props)
 	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Broker_Create());
+    STRICT_EXPECTED_CALL(mocks, EventSystem_Init());
+    STRICT_EXPECTED_CALL(mocks, Broker_SetAlertCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
         .IgnoreArgument(1); //modules
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
         .IgnoreArgument(1); //links
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_Create());
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(dummyProps->gateway_modules));
 
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1); //Modules being created
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    expectConcurrentTasks(mocks, 2);
+
     //Adding module 1 (Success)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_modules, 0));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
@@ -1006,6 +1385,8 @@ TEST_FUNCTION(Gateway_Create_Broker_AddModule_Fails_To_Add_All_Modules_In_Props)
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_AddModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
@@ -1013,7 +1394,7 @@ TEST_FUNCTION(Gateway_Create_Broker_AddModule_Fails_To_Add_All_Modules_In_Props)
 
     //Adding module 2 (Failure)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_modules, 1));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
@@ -1048,8 +1429,14 @@ TEST_FUNCTION(Gateway_Create_Broker_AddModule_Fails_To_Add_All_Modules_In_Props)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -1073,9 +1460,12 @@ TEST_FUNCTION(Gateway_Create_Broker_AddModule_Fails_To_Add_All_Modules_In_Props)
         .IgnoreArgument(1); //Modules
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1); //Links
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
 #ifdef OUTPROCESS_ENABLED
     EXPECTED_CALL(mocks, OutprocessLoader_JoinChildProcesses());
 #endif
+    expectEventSystemDestroy(mocks);
     STRICT_EXPECTED_CALL(mocks, Broker_Destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
@@ -1116,21 +1506,25 @@ TEST_FUNCTION(Gateway_Create_AddModule_WithDuplicatedModuleName_Fails)
 	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Broker_Create());
+    STRICT_EXPECTED_CALL(mocks, EventSystem_Init());
+    STRICT_EXPECTED_CALL(mocks, Broker_SetAlertCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
         .IgnoreArgument(1); //modules
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
         .IgnoreArgument(1); //links
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_Create());
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(dummyProps->gateway_modules));
 
-    //Adding module 1 (Success)
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1); //Modules being created
+
+    //Loading module 1 (Success)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_modules, 0));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
-    EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_Load(IGNORED_PTR_ARG, duplicatedEntry.module_loader_info.entrypoint))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_GetModuleApi(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
@@ -1138,63 +1532,39 @@ TEST_FUNCTION(Gateway_Create_AddModule_WithDuplicatedModuleName_Fails)
         .IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_BuildModuleConfiguration(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreAllArguments();
+
+    //Loading module 2 (Failure, the name is already taken by module 1)
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_modules, 1));
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+
+    //Discarding module 1, it was never created
 	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeModuleConfiguration(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
         .IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, mock_Module_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, Broker_AddModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, Broker_IncRef(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_Unload(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
-    //Adding module 2 (Failure)
-    STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_modules, 1));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
-
-    //Removing previous module
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
+    //Gateway_Destroy()
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(mocks, Broker_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, Broker_DecRef(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_GetModuleApi(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, mock_Module_Destroy(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_Unload(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
 #ifdef OUTPROCESS_ENABLED
     EXPECTED_CALL(mocks, OutprocessLoader_JoinChildProcesses());
 #endif
+    expectEventSystemDestroy(mocks);
     STRICT_EXPECTED_CALL(mocks, Broker_Destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
@@ -1237,15 +1607,24 @@ TEST_FUNCTION(Gateway_Create_Adds_All_Modules_In_Props_Success)
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Broker_Create());
+    STRICT_EXPECTED_CALL(mocks, Broker_SetAlertCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
         .IgnoreArgument(1); //modules vector.
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
         .IgnoreArgument(1); //links vector.
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_Create());
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(dummyProps->gateway_modules)); //Modules
 
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1); //Modules being created
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    expectConcurrentTasks(mocks, 2);
+
     //Adding module 1 (Success)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_modules, 0));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
@@ -1271,6 +1650,8 @@ TEST_FUNCTION(Gateway_Create_Adds_All_Modules_In_Props_Success)
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_AddModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
@@ -1278,7 +1659,7 @@ TEST_FUNCTION(Gateway_Create_Adds_All_Modules_In_Props_Success)
 
     //Adding module 2 (Success)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_modules, 1));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
@@ -1304,6 +1685,8 @@ TEST_FUNCTION(Gateway_Create_Adds_All_Modules_In_Props_Success)
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_AddModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
@@ -1366,17 +1749,26 @@ TEST_FUNCTION(Gateway_Create_Adds_All_Modules_And_All_Links_In_Props_Success)
 
     EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, Broker_Create());
+    STRICT_EXPECTED_CALL(mocks, Broker_SetAlertCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
         .IgnoreArgument(1); //modules vector.
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
         .IgnoreArgument(1); //links vector.
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_Create());
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(dummyProps->gateway_modules));
+
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1); //Modules being created
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    expectConcurrentTasks(mocks, 2);
     
     //Modules
 
     //Adding module 1 (Success)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_modules, 0));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
@@ -1403,6 +1795,8 @@ TEST_FUNCTION(Gateway_Create_Adds_All_Modules_And_All_Links_In_Props_Success)
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_AddModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
@@ -1410,7 +1804,7 @@ TEST_FUNCTION(Gateway_Create_Adds_All_Modules_And_All_Links_In_Props_Success)
 
     //Adding module 2 (Success)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_modules, 1));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
@@ -1437,6 +1831,8 @@ TEST_FUNCTION(Gateway_Create_Adds_All_Modules_And_All_Links_In_Props_Success)
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_AddModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
@@ -1447,17 +1843,23 @@ TEST_FUNCTION(Gateway_Create_Adds_All_Modules_And_All_Links_In_Props_Success)
 
     //Adding link1 (Success)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_links, 0));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments(); //Check if Link exists.
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_HasLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments(); //Check if Source Module exists.
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments(); //Check if Sink Module exists.
     STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     expectEventSystemInit(mocks);
 
     //Act
@@ -1472,34 +1874,261 @@ TEST_FUNCTION(Gateway_Create_Adds_All_Modules_And_All_Links_In_Props_Success)
     Gateway_Destroy(gateway);
 }
 
-/*Tests_SRS_GATEWAY_04_003: [If any GATEWAY_LINK_ENTRY is unable to be added to the broker the GATEWAY_HANDLE will be destroyed.]*/
-/*Tests_SRS_GATEWAY_27_027: [ Launch - This function shall join any spawned threads upon any failure. ]*/
-TEST_FUNCTION(Gateway_Create_Adds_All_Modules_And_Links_fromNonExistingModule_Fail)
+/*Tests_SRS_GATEWAY_31_001: [ The function shall load the modules one at a time, in the order of `gateway_modules`. ]*/
+/*Tests_SRS_GATEWAY_31_002: [ The function shall create the modules concurrently, except the modules of a language binding loader, which shall be created one at a time. ]*/
+TEST_FUNCTION(Gateway_Create_creates_modules_of_a_language_binding_loader_one_at_a_time)
 {
     //Arrange
     CGatewayLLMocks mocks;
+    mocks.SetIgnoreUnexpectedCalls(true);
 
-    //Add another entry to the properties
-    GATEWAY_LINK_ENTRY dummyLink = {
-        "Non Existing Module",
-        "dummy module 2"
+    MODULE_LOADER bindingModuleLoader =
+    {
+        JAVA,
+        "binding loader",
+        NULL,
+        &module_loader_api
     };
-    BASEIMPLEMENTATION::VECTOR_push_back(dummyProps->gateway_links, &dummyLink, 1);
+    GATEWAY_MODULE_LOADER_INFO bindingLoaderInfo =
+    {
+        &bindingModuleLoader,
+        (void*)0x42
+    };
+    GATEWAY_MODULES_ENTRY module_entries[] = {
+        {
+            "binding module 1",
+            bindingLoaderInfo,
+            NULL
+        },
+        {
+            "binding module 2",
+            bindingLoaderInfo,
+            NULL
+        }
+    };
+
+    GATEWAY_PROPERTIES properties;
+    properties.gateway_modules = BASEIMPLEMENTATION::VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY));
+    properties.gateway_links = NULL;
+    BASEIMPLEMENTATION::VECTOR_push_back(properties.gateway_modules, module_entries, 2);
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_Create(&properties);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(gateway);
+    ASSERT_ARE_EQUAL(size_t, 2, currentmock_Module_Create_call);
+    ASSERT_ARE_EQUAL(size_t, 2, currentBroker_module_count);
+    ASSERT_ARE_EQUAL(size_t, 0, currentLock_Init_call);
+    ASSERT_ARE_EQUAL(size_t, 0, currentThreadAPI_Create_call);
+
+    //Cleanup
+    Gateway_Destroy(gateway);
+    BASEIMPLEMENTATION::VECTOR_destroy(properties.gateway_modules);
+}
+
+#ifdef OUTPROCESS_ENABLED
+/*Tests_SRS_GATEWAY_31_034: [ The function shall create the out of process modules that share a `host.id` one at a time. ]*/
+TEST_FUNCTION(Gateway_Create_creates_outprocess_modules_of_one_host_one_at_a_time)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+    mocks.SetIgnoreUnexpectedCalls(true);
+
+    MODULE_LOADER outprocessModuleLoader =
+    {
+        OUTPROCESS,
+        "outprocess loader",
+        NULL,
+        &module_loader_api
+    };
+    OUTPROCESS_LOADER_ENTRYPOINT entrypoint;
+    memset(&entrypoint, 0, sizeof(entrypoint));
+    entrypoint.host_id = (char*)"shared host";
+    GATEWAY_MODULE_LOADER_INFO outprocessLoaderInfo =
+    {
+        &outprocessModuleLoader,
+        &entrypoint
+    };
+    GATEWAY_MODULES_ENTRY module_entries[] = {
+        {
+            "hosted module 1",
+            outprocessLoaderInfo,
+            NULL
+        },
+        {
+            "hosted module 2",
+            outprocessLoaderInfo,
+            NULL
+        }
+    };
+
+    GATEWAY_PROPERTIES properties;
+    properties.gateway_modules = BASEIMPLEMENTATION::VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY));
+    properties.gateway_links = NULL;
+    BASEIMPLEMENTATION::VECTOR_push_back(properties.gateway_modules, module_entries, 2);
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_Create(&properties);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(gateway);
+    ASSERT_ARE_EQUAL(size_t, 2, currentmock_Module_Create_call);
+    ASSERT_ARE_EQUAL(size_t, 2, currentBroker_module_count);
+    ASSERT_ARE_EQUAL(size_t, 0, currentLock_Init_call);
+    ASSERT_ARE_EQUAL(size_t, 0, currentThreadAPI_Create_call);
+
+    //Cleanup
+    Gateway_Destroy(gateway);
+    BASEIMPLEMENTATION::VECTOR_destroy(properties.gateway_modules);
+}
+#endif
+
+/*Tests_SRS_GATEWAY_31_002: [ The function shall create the modules concurrently, except the modules of a language binding loader, which shall be created one at a time. ]*/
+TEST_FUNCTION(Gateway_Create_creates_the_modules_on_the_calling_thread_when_ThreadAPI_Create_fails)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+    mocks.SetIgnoreUnexpectedCalls(true);
+
+    GATEWAY_MODULES_ENTRY module_entries[] = {
+        {
+            "dummy module 2",
+            dummyLoaderInfo,
+            NULL
+        },
+        {
+            "dummy module 3",
+            dummyLoaderInfo,
+            NULL
+        }
+    };
+    BASEIMPLEMENTATION::VECTOR_push_back(dummyProps->gateway_modules, module_entries, 2);
+    whenShallThreadAPI_Create_fail = 1;
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_Create(dummyProps);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(gateway);
+    ASSERT_ARE_EQUAL(size_t, 1, currentThreadAPI_Create_call);
+    ASSERT_ARE_EQUAL(size_t, 3, currentmock_Module_Create_call);
+    ASSERT_ARE_EQUAL(size_t, 3, currentBroker_module_count);
+
+    //Cleanup
+    Gateway_Destroy(gateway);
+}
+
+/*Tests_SRS_GATEWAY_31_002: [ The function shall create the modules concurrently, except the modules of a language binding loader, which shall be created one at a time. ]*/
+TEST_FUNCTION(Gateway_Create_creates_the_modules_one_at_a_time_when_Lock_Init_fails)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+    mocks.SetIgnoreUnexpectedCalls(true);
+
+    GATEWAY_MODULES_ENTRY dummyEntry2 = {
+        "dummy module 2",
+        dummyLoaderInfo,
+        NULL
+    };
+    BASEIMPLEMENTATION::VECTOR_push_back(dummyProps->gateway_modules, &dummyEntry2, 1);
+    whenShallLock_Init_fail = 1;
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_Create(dummyProps);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(gateway);
+    ASSERT_ARE_EQUAL(size_t, 0, currentThreadAPI_Create_call);
+    ASSERT_ARE_EQUAL(size_t, 2, currentmock_Module_Create_call);
+    ASSERT_ARE_EQUAL(size_t, 2, currentBroker_module_count);
+
+    //Cleanup
+    Gateway_Destroy(gateway);
+}
+
+/*Tests_SRS_GATEWAY_31_003: [ The function shall attach the created modules to the gateway in the order of `gateway_modules`. ]*/
+/*Tests_SRS_GATEWAY_31_004: [ If any module fails to load, to be created or to be attached, the function shall destroy and unload the modules not yet attached. ]*/
+TEST_FUNCTION(Gateway_Create_Module_Create_fails_destroys_every_module)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    GATEWAY_MODULES_ENTRY module_entries[] = {
+        {
+            "dummy module 2",
+            dummyLoaderInfo,
+            NULL
+        },
+        {
+            "dummy module 3",
+            dummyLoaderInfo,
+            NULL
+        }
+    };
+    BASEIMPLEMENTATION::VECTOR_push_back(dummyProps->gateway_modules, module_entries, 2);
+    whenShallmock_Module_Create_fail = 2;
+
+    //Expectations
+    mocks.SetIgnoreUnexpectedCalls(true);
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_Load(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments()
+        .ExpectedTimesExactly(3);
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_Unload(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments()
+        .ExpectedTimesExactly(3);
+    STRICT_EXPECTED_CALL(mocks, mock_Module_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments()
+        .ExpectedTimesExactly(3);
+    STRICT_EXPECTED_CALL(mocks, mock_Module_Destroy(IGNORED_PTR_ARG))
+        .IgnoreAllArguments()
+        .ExpectedTimesExactly(2);
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_Create(dummyProps);
+
+    //Assert
+    ASSERT_IS_NULL(gateway);
+    ASSERT_ARE_EQUAL(size_t, 0, currentBroker_AddModule_call);
+    ASSERT_ARE_EQUAL(size_t, 0, currentBroker_module_count);
+    ASSERT_ARE_EQUAL(size_t, 0, currentBroker_ref_count);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+}
+
+/*Tests_SRS_GATEWAY_04_003: [If any GATEWAY_LINK_ENTRY is unable to be added to the broker the GATEWAY_HANDLE will be destroyed.]*/
+/*Tests_SRS_GATEWAY_27_027: [ Launch - This function shall join any spawned threads upon any failure. ]*/
+TEST_FUNCTION(Gateway_Create_Adds_All_Modules_And_Links_fromNonExistingModule_Fail)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    //Add another entry to the properties
+    GATEWAY_LINK_ENTRY dummyLink = {
+        "Non Existing Module",
+        "dummy module 2"
+    };
+    BASEIMPLEMENTATION::VECTOR_push_back(dummyProps->gateway_links, &dummyLink, 1);
 
     //Expectations
 	STRICT_EXPECTED_CALL(mocks, ModuleLoader_Initialize());
 	STRICT_EXPECTED_CALL(mocks, ModuleLoader_Destroy());
 	EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, Broker_Create());
+    STRICT_EXPECTED_CALL(mocks, EventSystem_Init());
+    STRICT_EXPECTED_CALL(mocks, Broker_SetAlertCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
         .IgnoreArgument(1); //modules vector.
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
         .IgnoreArgument(1); //links vector.
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_Create());
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(dummyProps->gateway_modules)); //Modules
 
     //Adding module 1 (Success)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_modules, 0));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
@@ -1527,6 +2156,8 @@ TEST_FUNCTION(Gateway_Create_Adds_All_Modules_And_Links_fromNonExistingModule_Fa
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_AddModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
@@ -1536,9 +2167,11 @@ TEST_FUNCTION(Gateway_Create_Adds_All_Modules_And_Links_fromNonExistingModule_Fa
 
     //Adding link1 (Failure)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_links, 0));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments(); //Check if Link exists.
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments(); //Check if Source Module exists.
 
 
@@ -1547,8 +2180,14 @@ TEST_FUNCTION(Gateway_Create_Adds_All_Modules_And_Links_fromNonExistingModule_Fa
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -1572,9 +2211,12 @@ TEST_FUNCTION(Gateway_Create_Adds_All_Modules_And_Links_fromNonExistingModule_Fa
         .IgnoreArgument(1); //Modules
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1); //Links
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
 #ifdef OUTPROCESS_ENABLED
     EXPECTED_CALL(mocks, OutprocessLoader_JoinChildProcesses());
 #endif
+    expectEventSystemDestroy(mocks);
     STRICT_EXPECTED_CALL(mocks, Broker_Destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
@@ -1632,8 +2274,14 @@ TEST_FUNCTION(Gateway_Destroy_Continues_Unloading_If_Broker_RemoveModule_Fails)
         .IgnoreArgument(1); //Modules
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1); //Links
-    STRICT_EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreAllArguments();
     EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
@@ -1658,8 +2306,14 @@ TEST_FUNCTION(Gateway_Destroy_Continues_Unloading_If_Broker_RemoveModule_Fails)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreAllArguments();
     EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
@@ -1684,6 +2338,8 @@ TEST_FUNCTION(Gateway_Destroy_Continues_Unloading_If_Broker_RemoveModule_Fails)
         .IgnoreArgument(1); //Modules
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1); //links
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
 #ifdef OUTPROCESS_ENABLED
     EXPECTED_CALL(mocks, OutprocessLoader_JoinChildProcesses());
 #endif
@@ -1735,8 +2391,14 @@ TEST_FUNCTION(Gateway_Destroy_Removes_All_Modules_And_Destroys_Vector_Success)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreAllArguments();
     EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
@@ -1761,8 +2423,14 @@ TEST_FUNCTION(Gateway_Destroy_Removes_All_Modules_And_Destroys_Vector_Success)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -1786,10 +2454,12 @@ TEST_FUNCTION(Gateway_Destroy_Removes_All_Modules_And_Destroys_Vector_Success)
 
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -1798,6 +2468,8 @@ TEST_FUNCTION(Gateway_Destroy_Removes_All_Modules_And_Destroys_Vector_Success)
         .IgnoreArgument(1); //Modules.
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1); //Links
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
 #ifdef OUTPROCESS_ENABLED
     EXPECTED_CALL(mocks, OutprocessLoader_JoinChildProcesses());
 #endif
@@ -1920,7 +2592,7 @@ TEST_FUNCTION(Gateway_AddModule_Loads_Module_From_Library_Path)
     mocks.ResetAllCalls();
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
@@ -1946,6 +2618,8 @@ TEST_FUNCTION(Gateway_AddModule_Loads_Module_From_Library_Path)
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_AddModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
@@ -1975,7 +2649,7 @@ TEST_FUNCTION(Gateway_AddModule_Malloc_data_Fails)
 
     //Expectations
     whenShallModuleLoader_Load_fail = 1;
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1)
@@ -2002,7 +2676,7 @@ TEST_FUNCTION(Gateway_AddModule_Fails)
 
     //Expectations
     whenShallModuleLoader_Load_fail = 1;
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
@@ -2039,7 +2713,7 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_Using_Module_Properties)
     };
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
@@ -2065,6 +2739,8 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_Using_Module_Properties)
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_AddModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
@@ -2131,7 +2807,7 @@ TEST_FUNCTION(Gateway_AddModule_Module_Create_Fails)
     };
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
@@ -2176,7 +2852,7 @@ TEST_FUNCTION(Gateway_AddModule_Broker_AddModule_Fails)
     mocks.ResetAllCalls();
     
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
@@ -2227,7 +2903,7 @@ TEST_FUNCTION(Gateway_AddModule_Internal_API_Fail_Rollback_Module)
     mocks.ResetAllCalls();
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
@@ -2280,6 +2956,76 @@ TEST_FUNCTION(Gateway_AddModule_Internal_API_Fail_Rollback_Module)
     Gateway_Destroy(gw);
 }
 
+/*Tests_SRS_GATEWAY_31_016: [ The gateway shall add each module and link it tracks to the gateway index, and shall fail to add the module or link if the index cannot be updated. ]*/
+TEST_FUNCTION(Gateway_AddModule_GatewayIndex_AddModule_Fail_Rollback_Module)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    GATEWAY_HANDLE gw = Gateway_Create(NULL);
+    mocks.ResetAllCalls();
+
+    //Expectations
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_Load(IGNORED_PTR_ARG, dummyLoaderInfo.entrypoint))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_GetModuleApi(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_BuildModuleConfiguration(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeModuleConfiguration(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, mock_Module_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, Broker_AddModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, Broker_IncRef(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    whenShallGatewayIndex_AddModule_fail = 1;
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_AddModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, Broker_DecRef(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Broker_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mocks, mock_Module_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_Unload(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+
+    //Act
+    MODULE_HANDLE handle = Gateway_AddModule(gw, (GATEWAY_MODULES_ENTRY*)BASEIMPLEMENTATION::VECTOR_front(dummyProps->gateway_modules));
+
+    //Assert
+    ASSERT_IS_NULL(handle);
+    ASSERT_ARE_EQUAL(size_t, 0, currentBroker_module_count);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gw);
+}
+
 /*Tests_SRS_GATEWAY_14_020: [ If gw or module is NULL the function shall return. ]*/
 TEST_FUNCTION(Gateway_RemoveModule_Does_Nothing_If_Gateway_NULL)
 {
@@ -2309,7 +3055,7 @@ TEST_FUNCTION(Gateway_RemoveModule_Does_Nothing_If_Module_NULL)
     mocks.ResetAllCalls();
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByHandle(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
 
     //Act
@@ -2337,11 +3083,17 @@ TEST_FUNCTION(Gateway_RemoveModule_Finds_Module_Data_Success)
     mocks.ResetAllCalls();
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByHandle(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
         .IgnoreAllArguments();
     EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
@@ -2385,8 +3137,8 @@ TEST_FUNCTION(Gateway_RemoveModule_Finds_Module_Data_Failure)
     mocks.ResetAllCalls();
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, gw))
-        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByHandle(IGNORED_PTR_ARG, (MODULE_HANDLE)gw))
+        .IgnoreArgument(1);
 
     //Act
     Gateway_RemoveModule(gw, (MODULE_HANDLE)gw);
@@ -2410,11 +3162,17 @@ TEST_FUNCTION(Gateway_RemoveModule_Broker_RemoveModule_Failure)
     mocks.ResetAllCalls();
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByHandle(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
         .IgnoreAllArguments();
     whenShallBroker_RemoveModule_fail = 1;
     EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
@@ -2536,8 +3294,10 @@ TEST_FUNCTION(Gateway_RemoveLink_NonExistingSourceModule_Find_Link_Data_Failure)
 
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, gw))
-        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, "dummy module"))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, "NonExistingLink"))
+        .IgnoreArgument(1);
 
     //Act
     Gateway_RemoveLink(gw, &dummyLink2);
@@ -2581,8 +3341,10 @@ TEST_FUNCTION(Gateway_RemoveLink_NonExistingSinkModule_Find_Link_Data_Failure)
 
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, "NonExistingLink"))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, "dummy module"))
+        .IgnoreArgument(1);
 
     //Act
     Gateway_RemoveLink(gw, &dummyLink2);
@@ -2622,13 +3384,20 @@ TEST_FUNCTION(Gateway_RemoveLink_NonExistingSinkModule_Find_star_Link_Data_Failu
 
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &dummyLink))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, dm2))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_HasLink(IGNORED_PTR_ARG, NULL, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    whenShallVECTOR_find_if_fail = currentVECTOR_find_if_call + 2;
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    whenShallGatewayIndex_FindModuleByName_fail = currentGatewayIndex_FindModuleByName_call + 2;
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, dm2))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_RemoveLink(IGNORED_PTR_ARG, NULL, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
-        .IgnoreArgument(2)
         .IgnoreArgument(3);
     STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
@@ -2679,11 +3448,20 @@ TEST_FUNCTION(Gateway_RemoveLink_Finds_Link_Data_Success)
     mocks.ResetAllCalls();
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &dummyLink2))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_HasLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -2786,6 +3564,8 @@ TEST_FUNCTION(Gateway_Event_System_Create_And_Report)
 	STRICT_EXPECTED_CALL(mocks, ModuleLoader_Initialize());
 	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
     EXPECTED_CALL(mocks, Broker_Create());
+    EXPECTED_CALL(mocks, Broker_SetAlertCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG)); //Modules.
     EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG)); //Links
     
@@ -2812,20 +3592,13 @@ TEST_FUNCTION(Gateway_Event_System_Create_Fail)
 	STRICT_EXPECTED_CALL(mocks, ModuleLoader_Destroy());
 	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
     EXPECTED_CALL(mocks, Broker_Create());
-    EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG)); //Modules.
-    EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG)); //Links
-    // Fail to create
+    // Fail to create, before the broker reports alerts and before the modules and links
     EXPECTED_CALL(mocks, EventSystem_Init())
         .SetFailReturn((EVENTSYSTEM_HANDLE)NULL);
     // Note - no EventSystem_Report()!
     // Gateway_destroy called from inside create
-    EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)); //For Modules.
-    EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)); //For Links.
-    EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG)); //Modules
-    EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG)); //Links
-#ifdef OUTPROCESS_ENABLED
-    EXPECTED_CALL(mocks, OutprocessLoader_JoinChildProcesses());
-#endif
+    STRICT_EXPECTED_CALL(mocks, Broker_SetAlertCallback(IGNORED_PTR_ARG, NULL, NULL))
+        .IgnoreArgument(1);
     EXPECTED_CALL(mocks, Broker_Destroy(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
 
@@ -2857,6 +3630,7 @@ TEST_FUNCTION(Gateway_Event_System_Report_Destroy)
 #ifdef OUTPROCESS_ENABLED
     EXPECTED_CALL(mocks, OutprocessLoader_JoinChildProcesses());
 #endif
+    EXPECTED_CALL(mocks, GatewayIndex_Destroy(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, Broker_Destroy(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
 	EXPECTED_CALL(mocks, ModuleLoader_Destroy());
@@ -3076,9 +3850,12 @@ TEST_FUNCTION(Gateway_AddLink_DuplicatedLink_Fail)
     mocks.ResetAllCalls();
 
     //Act
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &duplicatedLink))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, duplicatedLink.module_sink))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, duplicatedLink.module_source))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_HasLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
 
     GATEWAY_ADD_LINK_RESULT result = Gateway_AddLink(gateway, &duplicatedLink);
 
@@ -3122,12 +3899,12 @@ TEST_FUNCTION(Gateway_AddLink_NonExistingSourceModule_Fail)
     mocks.ResetAllCalls();
 
     //Act
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &nonExistingModuleLink))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, nem))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, nonExistingModuleLink.module_sink))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, nem))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, nem))
+        .IgnoreArgument(1);//Check Source Module.
 
     GATEWAY_ADD_LINK_RESULT result = Gateway_AddLink(gateway, &nonExistingModuleLink);
 
@@ -3172,15 +3949,14 @@ TEST_FUNCTION(Gateway_AddLink_NonExistingSinkModule_Fail)
     mocks.ResetAllCalls();
 
     //Act
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &nonExistingModuleLink))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, dm2))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);//Check Source Module.
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, nem))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);//Check Sink Module.
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, nem))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, dm2))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, dm2))
+        .IgnoreArgument(1);//Check Source Module.
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, nem))
+        .IgnoreArgument(1);//Check Sink Module.
 
     GATEWAY_ADD_LINK_RESULT result = Gateway_AddLink(gateway, &nonExistingModuleLink);
 
@@ -3218,17 +3994,23 @@ TEST_FUNCTION(Gateway_AddLink_Succeeds)
     mocks.ResetAllCalls();
 
     //Act
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();//Check link
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_HasLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();//Check Source Module.
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();//Check Sink Module.
     STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_MODULE_LIST_CHANGED))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -3267,11 +4049,15 @@ TEST_FUNCTION(Gateway_AddLink_pushback_fails)
     mocks.ResetAllCalls();
 
     //Act
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();//Check link
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_HasLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();//Check Source Module.
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();//Check Sink Module.
     STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
@@ -3292,6 +4078,67 @@ TEST_FUNCTION(Gateway_AddLink_pushback_fails)
     Gateway_Destroy(gateway);
 }
 
+/*Tests_SRS_GATEWAY_31_016: [ The gateway shall add each module and link it tracks to the gateway index, and shall fail to add the module or link if the index cannot be updated. ]*/
+TEST_FUNCTION(Gateway_AddLink_GatewayIndex_AddLink_fails)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    //Add another entry to the properties
+    GATEWAY_MODULES_ENTRY dummyEntry2 = {
+        "dummy module 2",
+		dummyLoaderInfo,
+        NULL
+    };
+
+    GATEWAY_LINK_ENTRY dummyLink = {
+        "dummy module",
+        "dummy module 2"
+    };
+
+    BASEIMPLEMENTATION::VECTOR_push_back(dummyProps->gateway_modules, &dummyEntry2, 1);
+
+    GATEWAY_HANDLE gateway = Gateway_Create(dummyProps);
+    mocks.ResetAllCalls();
+
+    //Act
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();//Check link
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_HasLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();//Check Source Module.
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();//Check Sink Module.
+    STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    whenShallGatewayIndex_AddLink_fail = currentGatewayIndex_AddLink_call + 1;
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+
+    GATEWAY_ADD_LINK_RESULT result = Gateway_AddLink(gateway, &dummyLink);
+
+    //Assert
+    ASSERT_ARE_EQUAL(GATEWAY_ADD_LINK_RESULT, GATEWAY_ADD_LINK_ERROR, result);
+
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gateway);
+}
+
 TEST_FUNCTION(Gateway_AddLink_broker_add_fails)
 {
     //Arrange
@@ -3315,11 +4162,15 @@ TEST_FUNCTION(Gateway_AddLink_broker_add_fails)
     mocks.ResetAllCalls();
 
     //Act
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();//Check link
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_HasLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();//Check Source Module.
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();//Check Sink Module.
     STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments()
@@ -3372,9 +4223,12 @@ TEST_FUNCTION(Gateway_AddLink_star_2nd_addbroker_fails)
     mocks.ResetAllCalls();
 
     //Act
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();//Check link
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_HasLink(IGNORED_PTR_ARG, NULL, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();//Check Sink Module.
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
@@ -3392,7 +4246,7 @@ TEST_FUNCTION(Gateway_AddLink_star_2nd_addbroker_fails)
         .SetFailReturn(BROKER_ADD_LINK_ERROR);
 
     //Remove link
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1); // for each module.
@@ -3459,9 +4313,12 @@ TEST_FUNCTION(Gateway_AddLink_star_2nd_add_push_fails)
     mocks.ResetAllCalls();
 
     //Act
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();//Check link
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_HasLink(IGNORED_PTR_ARG, NULL, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();//Check Sink Module.
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
@@ -3516,7 +4373,7 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_with_star_links)
     mocks.ResetAllCalls();
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
@@ -3542,6 +4399,8 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_with_star_links)
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_AddModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
@@ -3549,14 +4408,14 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_with_star_links)
     // 1st broadcast link
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     // 2nd broadcast link
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
@@ -3610,7 +4469,7 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_star_2nd_addLink_fails)
     mocks.ResetAllCalls();
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
@@ -3638,6 +4497,8 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_star_2nd_addLink_fails)
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_AddModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
@@ -3645,14 +4506,14 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_star_2nd_addLink_fails)
     // 1st broadcast link
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     // 2nd broadcast link
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments()
@@ -3663,17 +4524,19 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_star_2nd_addLink_fails)
         .IgnoreArgument(1); // for each module.
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     // and remove the rest.
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2)
@@ -3738,7 +4601,7 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_star_2nd_find_fails)
     mocks.ResetAllCalls();
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
@@ -3766,6 +4629,8 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_star_2nd_find_fails)
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_AddModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
@@ -3773,16 +4638,16 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_star_2nd_find_fails)
     // 1st broadcast link
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     // 2nd broadcast link
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments()
-        .SetFailReturn(nullptr);
+        .SetFailReturn((MODULE_DATA*)NULL);
 
 
     // tear down broadcast link.
@@ -3790,18 +4655,20 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_star_2nd_find_fails)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments()
         .SetFailReturn(BROKER_REMOVE_LINK_ERROR);
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     // and remove the rest.
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -3866,13 +4733,13 @@ TEST_FUNCTION(Gateway_AddLink_star_success)
     GATEWAY_HANDLE gateway = Gateway_Create(dummyProps);
     mocks.ResetAllCalls();
 
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &dummyLink2))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, "dummy module"))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, dummyLink2.module_sink))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_HasLink(IGNORED_PTR_ARG, NULL, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
-        .IgnoreArgument(2)
         .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, dummyLink2.module_sink))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -3888,6 +4755,9 @@ TEST_FUNCTION(Gateway_AddLink_star_success)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_AddLink(IGNORED_PTR_ARG, NULL, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(3);
     STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_MODULE_LIST_CHANGED))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -3940,12 +4810,10 @@ TEST_FUNCTION(Gateway_AddLink_star_no_sink)
     GATEWAY_HANDLE gateway = Gateway_Create(dummyProps);
     mocks.ResetAllCalls();
 
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &dummyLink2))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, dm4))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, dm4))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, dm4))
+        .IgnoreArgument(1);
 
     ///Act
     GATEWAY_ADD_LINK_RESULT result = Gateway_AddLink(gateway, &dummyLink2);
@@ -3992,13 +4860,13 @@ TEST_FUNCTION(Gateway_AddLink_star_failure_to_add)
     GATEWAY_HANDLE gateway = Gateway_Create(dummyProps);
     mocks.ResetAllCalls();
 
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &dummyLink2))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, dummyLink2.module_sink))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_HasLink(IGNORED_PTR_ARG, NULL, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
-        .IgnoreArgument(2)
         .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -4013,7 +4881,7 @@ TEST_FUNCTION(Gateway_AddLink_star_failure_to_add)
         .SetFailReturn(BROKER_ADD_LINK_ERROR);
 
     //Remove link
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1); // for each module.
@@ -4083,27 +4951,34 @@ TEST_FUNCTION(Gateway_RemoveModule_with_star_links)
     mocks.ResetAllCalls();
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, module_handle))
-        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByHandle(IGNORED_PTR_ARG, module_handle))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     // 1st broadcast link
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     // 2nd broadcast link
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
-    // and the rest of the remove...
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    // links of the module
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
+    // and the rest of the remove...
     EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
@@ -4117,6 +4992,10 @@ TEST_FUNCTION(Gateway_RemoveModule_with_star_links)
     STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_Unload(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 2))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -4172,28 +5051,35 @@ TEST_FUNCTION(Gateway_RemoveModule_with_star_links_has_errors)
     mocks.ResetAllCalls();
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, module_handle))
-        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByHandle(IGNORED_PTR_ARG, module_handle))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     // 1st broadcast link
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments()
-        .SetFailReturn(nullptr);
+        .SetFailReturn((MODULE_DATA*)NULL);
     // 2nd broadcast link
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments()
         .SetFailReturn(BROKER_REMOVE_LINK_ERROR);
-    // and the rest of the remove...
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    // links of the module
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
+    // and the rest of the remove...
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_DecRef(IGNORED_PTR_ARG))
@@ -4206,6 +5092,10 @@ TEST_FUNCTION(Gateway_RemoveModule_with_star_links_has_errors)
     STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_Unload(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 2))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -4264,10 +5154,19 @@ TEST_FUNCTION(Gateway_RemoveLink_star_link_success)
     mocks.ResetAllCalls();
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &dummyLink2))
-        .IgnoreAllArguments();
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, "dummy module"))
-        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, "dummy module"))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_HasLink(IGNORED_PTR_ARG, NULL, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 2))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, "dummy module"))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     // 1st broadcast link
@@ -4282,6 +5181,8 @@ TEST_FUNCTION(Gateway_RemoveLink_star_link_success)
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments()
         .SetFailReturn(BROKER_REMOVE_LINK_ERROR);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -4339,11 +5240,21 @@ TEST_FUNCTION(Gateway_RemoveLink_nostar_link_success)
     mocks.ResetAllCalls();
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &dummyLink3))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, "dummy module"))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, "dummy module 2"))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_HasLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 2))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments()
         .SetFailReturn(BROKER_REMOVE_LINK_ERROR);
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -4979,7 +5890,7 @@ TEST_FUNCTION(Gateway_RemoveModuleByName_no_modules)
     mocks.ResetAllCalls();
 
     //Expect
-    EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
 
     //Act
     int result = Gateway_RemoveModuleByName(gw, "foo");
@@ -5001,7 +5912,7 @@ TEST_FUNCTION(Gateway_RemoveModuleByName_not_existing)
     mocks.ResetAllCalls();
 
     //Expect
-    EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
 
     //Act
     int result = Gateway_RemoveModuleByName(gw, "foo");
@@ -5023,9 +5934,11 @@ TEST_FUNCTION(Gateway_RemoveModuleByName_success)
     mocks.ResetAllCalls();
 
     //Expect
-    EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(2);
-    EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(3);
+    EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    EXPECTED_CALL(mocks, GatewayIndex_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, Broker_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, Broker_DecRef(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, DynamicModuleLoader_GetModuleApi(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
@@ -5097,9 +6010,12 @@ TEST_FUNCTION(Gateway_RemoveModule_removes_links)
     // Expect
     EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .ExpectedTimesExactly(2);
-    // remove from gw->links + remove module
-    EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
-        .ExpectedTimesExactly(3);
+    // remove from gw->links at once
+    STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 2))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    // remove module
+    EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1));
 
     // Act
     int result = Gateway_RemoveModuleByName(gw, "module1");
@@ -5247,7 +6163,7 @@ TEST_FUNCTION(Gateway_AddModule_malloc_name_fail)
     };
 
     // Expect
-    EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, GatewayIndex_FindModuleByName(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
     EXPECTED_CALL(mocks, DynamicModuleLoader_Load(IGNORED_PTR_ARG, dummyLoaderInfo.entrypoint));
     EXPECTED_CALL(mocks, DynamicModuleLoader_GetModuleApi(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
@@ -5315,6 +6231,10 @@ TEST_FUNCTION(Gateway_Start_starts_stuff)
     mocks.ResetAllCalls();
 
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); //modules
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); //links
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
         .IgnoreArgument(1);
@@ -5329,6 +6249,8 @@ TEST_FUNCTION(Gateway_Start_starts_stuff)
         .IgnoreArgument(1)
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, mock_Module_Start(handle2));
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
 
     STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, gw, GATEWAY_STARTED))
         .IgnoreArgument(1);
@@ -5345,23 +6267,479 @@ TEST_FUNCTION(Gateway_Start_starts_stuff)
     free(properties);
 }
 
-//Tests_SRS_GATEWAY_17_009: [ This function shall return GATEWAY_START_INVALID_ARGS if a NULL gateway is received. ]
-TEST_FUNCTION(Gateway_Start_null_gw_returns_error)
+/*Tests_SRS_GATEWAY_31_005: [ The function shall start a module only after the modules it is linked to as a source, and shall start the modules that are ready at the same time concurrently. ]*/
+TEST_FUNCTION(Gateway_Start_starts_independent_modules_together)
 {
     //Arrange
     CGatewayLLMocks mocks;
 
+    GATEWAY_HANDLE gw = Gateway_Create(NULL);
+    GATEWAY_MODULES_ENTRY entry1 = {
+        "Test module1",
+        dummyLoaderInfo,
+        NULL
+    };
+    GATEWAY_MODULES_ENTRY entry2 = {
+        "Test module2",
+        dummyLoaderInfo,
+        NULL
+    };
+    GATEWAY_MODULES_ENTRY entry3 = {
+        "Test module3",
+        dummyLoaderInfo,
+        NULL
+    };
+    MODULE_HANDLE handle1 = Gateway_AddModule(gw, &entry1);
+    MODULE_HANDLE handle2 = Gateway_AddModule(gw, &entry2);
+    MODULE_HANDLE handle3 = Gateway_AddModule(gw, &entry3);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); //modules
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); //links
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreAllArguments()
+        .ExpectedTimesExactly(3);
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_GetModuleApi(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments()
+        .ExpectedTimesExactly(3);
+    expectConcurrentTasks(mocks, 3);
+    STRICT_EXPECTED_CALL(mocks, mock_Module_Start(handle1));
+    STRICT_EXPECTED_CALL(mocks, mock_Module_Start(handle2));
+    STRICT_EXPECTED_CALL(mocks, mock_Module_Start(handle3));
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, gw, GATEWAY_STARTED))
+        .IgnoreArgument(1);
+
     //Act
-    auto result = Gateway_Start(NULL);
+    auto result = Gateway_Start(gw);
 
     //Assert
-    ASSERT_ARE_EQUAL(GATEWAY_START_RESULT, result, GATEWAY_START_INVALID_ARGS);
+    ASSERT_ARE_EQUAL(GATEWAY_START_RESULT, result, GATEWAY_START_SUCCESS);
     mocks.AssertActualAndExpectedCalls();
 
     //Cleanup
+    Gateway_Destroy(gw);
 }
 
-//Tests_SRS_GATEWAY_17_008: [ When module is found, if the Module_Start function is defined for this module, the Module_Start function shall be called. ]
+/*Tests_SRS_GATEWAY_31_005: [ The function shall start a module only after the modules it is linked to as a source, and shall start the modules that are ready at the same time concurrently. ]*/
+TEST_FUNCTION(Gateway_Start_starts_sinks_before_their_sources)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    GATEWAY_HANDLE gw = Gateway_Create(NULL);
+    GATEWAY_MODULES_ENTRY entry1 = {
+        "Test module1",
+        dummyLoaderInfo,
+        NULL
+    };
+    GATEWAY_MODULES_ENTRY entry2 = {
+        "Test module2",
+        dummyLoaderInfo,
+        NULL
+    };
+    GATEWAY_MODULES_ENTRY entry3 = {
+        "Test module3",
+        dummyLoaderInfo,
+        NULL
+    };
+    GATEWAY_LINK_ENTRY link1 = {
+        "Test module1",
+        "Test module2"
+    };
+    GATEWAY_LINK_ENTRY link2 = {
+        "Test module2",
+        "Test module3"
+    };
+    MODULE_HANDLE handle1 = Gateway_AddModule(gw, &entry1);
+    MODULE_HANDLE handle2 = Gateway_AddModule(gw, &entry2);
+    MODULE_HANDLE handle3 = Gateway_AddModule(gw, &entry3);
+    (void)Gateway_AddLink(gw, &link1);
+    (void)Gateway_AddLink(gw, &link2);
+    mocks.ResetAllCalls();
+    mocks.SetIgnoreUnexpectedCalls(true);
+
+    //Act
+    auto result = Gateway_Start(gw);
+
+    //Assert
+    ASSERT_ARE_EQUAL(GATEWAY_START_RESULT, result, GATEWAY_START_SUCCESS);
+    ASSERT_ARE_EQUAL(size_t, 3, startedModuleCount);
+    ASSERT_ARE_EQUAL(void_ptr, handle3, startedModules[0]);
+    ASSERT_ARE_EQUAL(void_ptr, handle2, startedModules[1]);
+    ASSERT_ARE_EQUAL(void_ptr, handle1, startedModules[2]);
+    ASSERT_ARE_EQUAL(size_t, 0, currentLock_Init_call);
+
+    //Cleanup
+    Gateway_Destroy(gw);
+}
+
+/*Tests_SRS_GATEWAY_31_005: [ The function shall start a module only after the modules it is linked to as a source, and shall start the modules that are ready at the same time concurrently. ]*/
+TEST_FUNCTION(Gateway_Start_starts_the_sink_of_a_star_link_first)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    GATEWAY_HANDLE gw = Gateway_Create(NULL);
+    GATEWAY_MODULES_ENTRY entry1 = {
+        "Test module1",
+        dummyLoaderInfo,
+        NULL
+    };
+    GATEWAY_MODULES_ENTRY entry2 = {
+        "Test module2",
+        dummyLoaderInfo,
+        NULL
+    };
+    GATEWAY_MODULES_ENTRY entry3 = {
+        "Test module3",
+        dummyLoaderInfo,
+        NULL
+    };
+    GATEWAY_LINK_ENTRY link = {
+        "*",
+        "Test module3"
+    };
+    MODULE_HANDLE handle1 = Gateway_AddModule(gw, &entry1);
+    MODULE_HANDLE handle2 = Gateway_AddModule(gw, &entry2);
+    MODULE_HANDLE handle3 = Gateway_AddModule(gw, &entry3);
+    (void)Gateway_AddLink(gw, &link);
+    mocks.ResetAllCalls();
+    mocks.SetIgnoreUnexpectedCalls(true);
+
+    //Act
+    auto result = Gateway_Start(gw);
+
+    //Assert
+    ASSERT_ARE_EQUAL(GATEWAY_START_RESULT, result, GATEWAY_START_SUCCESS);
+    ASSERT_ARE_EQUAL(size_t, 3, startedModuleCount);
+    ASSERT_ARE_EQUAL(void_ptr, handle3, startedModules[0]);
+    ASSERT_ARE_EQUAL(void_ptr, handle1, startedModules[1]);
+    ASSERT_ARE_EQUAL(void_ptr, handle2, startedModules[2]);
+    ASSERT_ARE_EQUAL(size_t, 1, currentLock_Init_call);
+
+    //Cleanup
+    Gateway_Destroy(gw);
+}
+
+/*Tests_SRS_GATEWAY_31_006: [ If the links form a cycle, the function shall start the first module not yet started, in the order they were added, and continue. ]*/
+TEST_FUNCTION(Gateway_Start_starts_every_module_of_a_link_cycle)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    GATEWAY_HANDLE gw = Gateway_Create(NULL);
+    GATEWAY_MODULES_ENTRY entry1 = {
+        "Test module1",
+        dummyLoaderInfo,
+        NULL
+    };
+    GATEWAY_MODULES_ENTRY entry2 = {
+        "Test module2",
+        dummyLoaderInfo,
+        NULL
+    };
+    GATEWAY_LINK_ENTRY link1 = {
+        "Test module1",
+        "Test module2"
+    };
+    GATEWAY_LINK_ENTRY link2 = {
+        "Test module2",
+        "Test module1"
+    };
+    MODULE_HANDLE handle1 = Gateway_AddModule(gw, &entry1);
+    MODULE_HANDLE handle2 = Gateway_AddModule(gw, &entry2);
+    (void)Gateway_AddLink(gw, &link1);
+    (void)Gateway_AddLink(gw, &link2);
+    mocks.ResetAllCalls();
+    mocks.SetIgnoreUnexpectedCalls(true);
+
+    //Act
+    auto result = Gateway_Start(gw);
+
+    //Assert
+    ASSERT_ARE_EQUAL(GATEWAY_START_RESULT, result, GATEWAY_START_SUCCESS);
+    ASSERT_ARE_EQUAL(size_t, 2, startedModuleCount);
+    ASSERT_ARE_EQUAL(void_ptr, handle1, startedModules[0]);
+    ASSERT_ARE_EQUAL(void_ptr, handle2, startedModules[1]);
+
+    //Cleanup
+    Gateway_Destroy(gw);
+}
+
+/*Tests_SRS_GATEWAY_31_007: [ If the function cannot allocate memory, it shall start the modules one at a time, in the order they were added. ]*/
+TEST_FUNCTION(Gateway_Start_malloc_fails_starts_the_modules_in_order)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    GATEWAY_HANDLE gw = Gateway_Create(NULL);
+    GATEWAY_MODULES_ENTRY entry1 = {
+        "Test module1",
+        dummyLoaderInfo,
+        NULL
+    };
+    GATEWAY_MODULES_ENTRY entry2 = {
+        "Test module2",
+        dummyLoaderInfo,
+        NULL
+    };
+    GATEWAY_LINK_ENTRY link = {
+        "Test module1",
+        "Test module2"
+    };
+    MODULE_HANDLE handle1 = Gateway_AddModule(gw, &entry1);
+    MODULE_HANDLE handle2 = Gateway_AddModule(gw, &entry2);
+    (void)Gateway_AddLink(gw, &link);
+    mocks.ResetAllCalls();
+    mocks.SetIgnoreUnexpectedCalls(true);
+    whenShallmalloc_fail = currentmalloc_call + 1;
+
+    //Act
+    auto result = Gateway_Start(gw);
+
+    //Assert
+    ASSERT_ARE_EQUAL(GATEWAY_START_RESULT, result, GATEWAY_START_SUCCESS);
+    ASSERT_ARE_EQUAL(size_t, 2, startedModuleCount);
+    ASSERT_ARE_EQUAL(void_ptr, handle1, startedModules[0]);
+    ASSERT_ARE_EQUAL(void_ptr, handle2, startedModules[1]);
+
+    //Cleanup
+    whenShallmalloc_fail = 0;
+    Gateway_Destroy(gw);
+}
+
+//Tests_SRS_GATEWAY_17_009: [ This function shall return GATEWAY_START_INVALID_ARGS if a NULL gateway is received. ]
+TEST_FUNCTION(Gateway_Start_null_gw_returns_error)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    //Act
+    auto result = Gateway_Start(NULL);
+
+    //Assert
+    ASSERT_ARE_EQUAL(GATEWAY_START_RESULT, result, GATEWAY_START_INVALID_ARGS);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+}
+
+/*Tests_SRS_GATEWAY_31_021: [ Gateway_EnableLinkFusion shall return a non-zero value if gw is NULL or the gateway is started. ]*/
+TEST_FUNCTION(Gateway_EnableLinkFusion_fails_with_null_gw)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    //Act
+    int result = Gateway_EnableLinkFusion(NULL);
+
+    //Assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+}
+
+/*Tests_SRS_GATEWAY_31_021: [ Gateway_EnableLinkFusion shall return a non-zero value if gw is NULL or the gateway is started. ]*/
+TEST_FUNCTION(Gateway_EnableLinkFusion_fails_when_gateway_is_started)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    GATEWAY_HANDLE gw = Gateway_Create(NULL);
+    (void)Gateway_Start(gw);
+    mocks.ResetAllCalls();
+
+    //Act
+    int result = Gateway_EnableLinkFusion(gw);
+
+    //Assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gw);
+}
+
+/*Tests_SRS_GATEWAY_31_022: [ Gateway_EnableLinkFusion shall make Gateway_Start fuse the links and return 0. ]*/
+/*Tests_SRS_GATEWAY_31_023: [ If link fusion is enabled and the gateway is not started, this function shall fuse the links before starting the modules. ]*/
+/*Tests_SRS_GATEWAY_31_024: [ The gateway shall fuse each link whose source and sink are native modules, when the source has no other sink, the sink has no other source and no link is from "*". ]*/
+TEST_FUNCTION(Gateway_Start_fuses_the_links_of_a_chain)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    GATEWAY_HANDLE gw = Gateway_Create(NULL);
+    GATEWAY_MODULES_ENTRY entry1 = {
+        "Test module1",
+        dummyLoaderInfo,
+        NULL
+    };
+    GATEWAY_MODULES_ENTRY entry2 = {
+        "Test module2",
+        dummyLoaderInfo,
+        NULL
+    };
+    GATEWAY_MODULES_ENTRY entry3 = {
+        "Test module3",
+        dummyLoaderInfo,
+        NULL
+    };
+    GATEWAY_LINK_ENTRY link1 = {
+        "Test module1",
+        "Test module2"
+    };
+    GATEWAY_LINK_ENTRY link2 = {
+        "Test module2",
+        "Test module3"
+    };
+    (void)Gateway_AddModule(gw, &entry1);
+    (void)Gateway_AddModule(gw, &entry2);
+    (void)Gateway_AddModule(gw, &entry3);
+    (void)Gateway_AddLink(gw, &link1);
+    (void)Gateway_AddLink(gw, &link2);
+    int enable_result = Gateway_EnableLinkFusion(gw);
+    mocks.ResetAllCalls();
+    mocks.SetIgnoreUnexpectedCalls(true);
+
+    STRICT_EXPECTED_CALL(mocks, Broker_FuseLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .ExpectedTimesExactly(2);
+
+    //Act
+    auto result = Gateway_Start(gw);
+
+    //Assert
+    ASSERT_ARE_EQUAL(int, 0, enable_result);
+    ASSERT_ARE_EQUAL(GATEWAY_START_RESULT, result, GATEWAY_START_SUCCESS);
+    ASSERT_ARE_EQUAL(size_t, 3, startedModuleCount);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gw);
+}
+
+/*Tests_SRS_GATEWAY_31_035: [ The gateway shall count the links from and to each module as they are added and removed, and shall tell whether a link can be fused from the counts of its source and sink. ]*/
+TEST_FUNCTION(Gateway_Start_fuses_the_link_left_after_a_link_is_removed)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    GATEWAY_HANDLE gw = Gateway_Create(NULL);
+    GATEWAY_MODULES_ENTRY entry1 = {
+        "Test module1",
+        dummyLoaderInfo,
+        NULL
+    };
+    GATEWAY_MODULES_ENTRY entry2 = {
+        "Test module2",
+        dummyLoaderInfo,
+        NULL
+    };
+    GATEWAY_MODULES_ENTRY entry3 = {
+        "Test module3",
+        dummyLoaderInfo,
+        NULL
+    };
+    GATEWAY_LINK_ENTRY link1 = {
+        "Test module1",
+        "Test module2"
+    };
+    GATEWAY_LINK_ENTRY link2 = {
+        "Test module1",
+        "Test module3"
+    };
+    (void)Gateway_AddModule(gw, &entry1);
+    (void)Gateway_AddModule(gw, &entry2);
+    (void)Gateway_AddModule(gw, &entry3);
+    (void)Gateway_AddLink(gw, &link1);
+    (void)Gateway_AddLink(gw, &link2);
+    Gateway_RemoveLink(gw, &link2);
+    (void)Gateway_EnableLinkFusion(gw);
+    mocks.ResetAllCalls();
+    mocks.SetIgnoreUnexpectedCalls(true);
+
+    STRICT_EXPECTED_CALL(mocks, Broker_FuseLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .ExpectedTimesExactly(1);
+
+    //Act
+    auto result = Gateway_Start(gw);
+
+    //Assert
+    ASSERT_ARE_EQUAL(GATEWAY_START_RESULT, result, GATEWAY_START_SUCCESS);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gw);
+}
+
+/*Tests_SRS_GATEWAY_31_025: [ Before a link is added, the gateway shall unfuse the fused links from its source or to its sink. ]*/
+TEST_FUNCTION(Gateway_AddLink_unfuses_the_link_of_its_source)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    GATEWAY_HANDLE gw = Gateway_Create(NULL);
+    GATEWAY_MODULES_ENTRY entry1 = {
+        "Test module1",
+        dummyLoaderInfo,
+        NULL
+    };
+    GATEWAY_MODULES_ENTRY entry2 = {
+        "Test module2",
+        dummyLoaderInfo,
+        NULL
+    };
+    GATEWAY_MODULES_ENTRY entry3 = {
+        "Test module3",
+        dummyLoaderInfo,
+        NULL
+    };
+    GATEWAY_LINK_ENTRY link1 = {
+        "Test module1",
+        "Test module2"
+    };
+    GATEWAY_LINK_ENTRY link2 = {
+        "Test module1",
+        "Test module3"
+    };
+    (void)Gateway_AddModule(gw, &entry1);
+    (void)Gateway_AddModule(gw, &entry2);
+    (void)Gateway_AddModule(gw, &entry3);
+    (void)Gateway_AddLink(gw, &link1);
+    (void)Gateway_EnableLinkFusion(gw);
+    (void)Gateway_Start(gw);
+    mocks.ResetAllCalls();
+    mocks.SetIgnoreUnexpectedCalls(true);
+
+    STRICT_EXPECTED_CALL(mocks, Broker_UnfuseLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+
+    //Act
+    auto result = Gateway_AddLink(gw, &link2);
+
+    //Assert
+    ASSERT_ARE_EQUAL(GATEWAY_ADD_LINK_RESULT, GATEWAY_ADD_LINK_SUCCESS, result);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gw);
+}
+
+//Tests_SRS_GATEWAY_17_008: [ When module is found, if the Module_Start function is defined for this module, the Module_Start function shall be called. ]
 TEST_FUNCTION(Gateway_StartModule_starts_module)
 {
     //Arrange
@@ -5378,7 +6756,7 @@ TEST_FUNCTION(Gateway_StartModule_starts_module)
     MODULE_HANDLE handle = Gateway_AddModule(gw, &entry);
     mocks.ResetAllCalls();
 
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, handle))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByHandle(IGNORED_PTR_ARG, handle))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_GetModuleApi(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
@@ -5429,7 +6807,7 @@ TEST_FUNCTION(Gateway_StartModule_no_start_for_null_start_func)
     mocks.ResetAllCalls();
 
 
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, handle))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByHandle(IGNORED_PTR_ARG, handle))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_GetModuleApi(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
@@ -5464,7 +6842,7 @@ TEST_FUNCTION(Gateway_StartModule_no_module)
     MODULE_HANDLE handle = Gateway_AddModule(gw, &entry);
     mocks.ResetAllCalls();
 
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, handle))
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_FindModuleByHandle(IGNORED_PTR_ARG, handle))
         .IgnoreAllArguments();
 
     //Act
@@ -5496,4 +6874,336 @@ TEST_FUNCTION(Gateway_StartModule_no_gateway)
 }
 
 
+static VECTOR_HANDLE module_entries_of(const GATEWAY_MODULES_ENTRY* entries, size_t count)
+{
+    VECTOR_HANDLE module_entries = VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY));
+    (void)VECTOR_push_back(module_entries, entries, count);
+    return module_entries;
+}
+
+static MODULE_DATA* module_data_at(GATEWAY_HANDLE gw, size_t index)
+{
+    return *(MODULE_DATA**)VECTOR_element(((GATEWAY_HANDLE_DATA*)gw)->modules, index);
+}
+
+/*Tests_SRS_GATEWAY_31_008: [ The function shall fail if a module name is repeated or is "*", or if a link references a module not in `module_entries`. ]*/
+TEST_FUNCTION(gateway_reconfigure_internal_fails_for_repeated_module_name)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    GATEWAY_HANDLE gw = Gateway_Create(NULL);
+    GATEWAY_MODULES_ENTRY entries[] = {
+        { "Test module", dummyLoaderInfo, NULL },
+        { "Test module", dummyLoaderInfo, NULL }
+    };
+    const char* signatures[] = { "a", "a" };
+    VECTOR_HANDLE module_entries = module_entries_of(entries, 2);
+    VECTOR_HANDLE link_entries = VECTOR_create(sizeof(GATEWAY_LINK_ENTRY));
+    mocks.ResetAllCalls();
+
+    //Act
+    int result = gateway_reconfigure_internal((GATEWAY_HANDLE_DATA*)gw, module_entries, signatures, link_entries, false);
+
+    //Assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 0, VECTOR_size(((GATEWAY_HANDLE_DATA*)gw)->modules));
+
+    //Cleanup
+    VECTOR_destroy(module_entries);
+    VECTOR_destroy(link_entries);
+    Gateway_Destroy(gw);
+}
+
+/*Tests_SRS_GATEWAY_31_008: [ The function shall fail if a module name is repeated or is "*", or if a link references a module not in `module_entries`. ]*/
+TEST_FUNCTION(gateway_reconfigure_internal_fails_for_link_to_missing_module)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    GATEWAY_HANDLE gw = Gateway_Create(NULL);
+    GATEWAY_MODULES_ENTRY entries[] = {
+        { "Test module", dummyLoaderInfo, NULL }
+    };
+    const char* signatures[] = { "a" };
+    GATEWAY_LINK_ENTRY link = { "Test module", "Missing module" };
+    VECTOR_HANDLE module_entries = module_entries_of(entries, 1);
+    VECTOR_HANDLE link_entries = VECTOR_create(sizeof(GATEWAY_LINK_ENTRY));
+    (void)VECTOR_push_back(link_entries, &link, 1);
+    mocks.ResetAllCalls();
+
+    //Act
+    int result = gateway_reconfigure_internal((GATEWAY_HANDLE_DATA*)gw, module_entries, signatures, link_entries, false);
+
+    //Assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 0, VECTOR_size(((GATEWAY_HANDLE_DATA*)gw)->modules));
+
+    //Cleanup
+    VECTOR_destroy(module_entries);
+    VECTOR_destroy(link_entries);
+    Gateway_Destroy(gw);
+}
+
+/*Tests_SRS_GATEWAY_31_009: [ The function shall keep the running module of the same name if its configuration did not change, and shall create a new module otherwise. ]*/
+TEST_FUNCTION(gateway_reconfigure_internal_keeps_unchanged_module)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    GATEWAY_HANDLE gw = Gateway_Create(NULL);
+    GATEWAY_MODULES_ENTRY entries[] = {
+        { "Test module", dummyLoaderInfo, NULL }
+    };
+    const char* signatures[] = { "a" };
+    VECTOR_HANDLE module_entries = module_entries_of(entries, 1);
+    VECTOR_HANDLE link_entries = VECTOR_create(sizeof(GATEWAY_LINK_ENTRY));
+    (void)gateway_reconfigure_internal((GATEWAY_HANDLE_DATA*)gw, module_entries, signatures, link_entries, false);
+    MODULE_DATA* running = module_data_at(gw, 0);
+    mocks.ResetAllCalls();
+
+    //Act
+    int result = gateway_reconfigure_internal((GATEWAY_HANDLE_DATA*)gw, module_entries, signatures, link_entries, false);
+
+    //Assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 1, VECTOR_size(((GATEWAY_HANDLE_DATA*)gw)->modules));
+    ASSERT_ARE_EQUAL(void_ptr, running, module_data_at(gw, 0));
+
+    //Cleanup
+    VECTOR_destroy(module_entries);
+    VECTOR_destroy(link_entries);
+    Gateway_Destroy(gw);
+}
+
+/*Tests_SRS_GATEWAY_31_009: [ The function shall keep the running module of the same name if its configuration did not change, and shall create a new module otherwise. ]*/
+/*Tests_SRS_GATEWAY_31_011: [ The function shall drain the modules it replaces or removes, so they receive the messages published before the routes changed, then destroy them. ]*/
+TEST_FUNCTION(gateway_reconfigure_internal_replaces_changed_module)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    GATEWAY_HANDLE gw = Gateway_Create(NULL);
+    GATEWAY_MODULES_ENTRY entries[] = {
+        { "Test module", dummyLoaderInfo, NULL }
+    };
+    const char* before[] = { "a" };
+    const char* after[] = { "b" };
+    VECTOR_HANDLE module_entries = module_entries_of(entries, 1);
+    VECTOR_HANDLE link_entries = VECTOR_create(sizeof(GATEWAY_LINK_ENTRY));
+    (void)gateway_reconfigure_internal((GATEWAY_HANDLE_DATA*)gw, module_entries, before, link_entries, false);
+    MODULE_HANDLE running = module_data_at(gw, 0)->module;
+    mocks.ResetAllCalls();
+
+    //Act
+    int result = gateway_reconfigure_internal((GATEWAY_HANDLE_DATA*)gw, module_entries, after, link_entries, false);
+
+    //Assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 1, VECTOR_size(((GATEWAY_HANDLE_DATA*)gw)->modules));
+    ASSERT_ARE_NOT_EQUAL(void_ptr, running, module_data_at(gw, 0)->module);
+    ASSERT_ARE_EQUAL(char_ptr, "b", module_data_at(gw, 0)->module_signature);
+
+    //Cleanup
+    VECTOR_destroy(module_entries);
+    VECTOR_destroy(link_entries);
+    Gateway_Destroy(gw);
+}
+
+/*Tests_SRS_GATEWAY_31_031: [ Gateway_SetAlertThresholds shall return a non-zero value if gw or thresholds is NULL. ]*/
+TEST_FUNCTION(Gateway_SetAlertThresholds_fails_with_null_gw)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+    GATEWAY_ALERT_THRESHOLDS thresholds = { 100, 50 };
+
+    //Act
+    int result = Gateway_SetAlertThresholds(NULL, &thresholds);
+
+    //Assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+}
+
+/*Tests_SRS_GATEWAY_31_031: [ Gateway_SetAlertThresholds shall return a non-zero value if gw or thresholds is NULL. ]*/
+TEST_FUNCTION(Gateway_SetAlertThresholds_fails_with_null_thresholds)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    GATEWAY_HANDLE gw = Gateway_Create(NULL);
+    mocks.ResetAllCalls();
+
+    //Act
+    int result = Gateway_SetAlertThresholds(gw, NULL);
+
+    //Assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gw);
+}
+
+/*Tests_SRS_GATEWAY_31_032: [ Gateway_SetAlertThresholds shall set the thresholds of the broker alerts, and return a non-zero value if it fails or 0 otherwise. ]*/
+TEST_FUNCTION(Gateway_SetAlertThresholds_sets_the_broker_thresholds)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    GATEWAY_HANDLE gw = Gateway_Create(NULL);
+    GATEWAY_ALERT_THRESHOLDS thresholds = { 100, 50 };
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Broker_SetAlertThresholds(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+
+    //Act
+    int result = Gateway_SetAlertThresholds(gw, &thresholds);
+
+    //Assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gw);
+}
+
+/*Tests_SRS_GATEWAY_31_032: [ Gateway_SetAlertThresholds shall set the thresholds of the broker alerts, and return a non-zero value if it fails or 0 otherwise. ]*/
+TEST_FUNCTION(Gateway_SetAlertThresholds_fails_when_the_broker_fails)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    GATEWAY_HANDLE gw = Gateway_Create(NULL);
+    GATEWAY_ALERT_THRESHOLDS thresholds = { 100, 50 };
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Broker_SetAlertThresholds(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments()
+        .SetFailReturn(BROKER_ERROR);
+
+    //Act
+    int result = Gateway_SetAlertThresholds(gw, &thresholds);
+
+    //Assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gw);
+}
+
+/*Tests_SRS_GATEWAY_31_028: [ The function shall make the broker report its alerts to the gateway once its event system is initialized and before adding the modules, and shall only log an error if it cannot. ]*/
+/*Tests_SRS_GATEWAY_31_029: [ The gateway shall report each alert of the broker as the matching alert event, with the module handle, value and threshold of the alert as its context. ]*/
+TEST_FUNCTION(Gateway_reports_broker_alerts_as_events)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    GATEWAY_HANDLE gw = Gateway_Create(NULL);
+    ASSERT_IS_NOT_NULL((void*)currentBroker_alert_callback);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, EventSystem_ReportAlert(IGNORED_PTR_ARG, gw, GATEWAY_MODULE_RECEIVE_SLOW, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(4);
+
+    //Act
+    currentBroker_alert_callback(currentBroker_alert_context, BROKER_ALERT_RECEIVE_SLOW, (MODULE_HANDLE)0x42, 250, 100);
+
+    //Assert
+    ASSERT_IS_TRUE(lastEventSystem_alert.module_handle == (MODULE_HANDLE)0x42);
+    ASSERT_ARE_EQUAL(size_t, 250, lastEventSystem_alert.value);
+    ASSERT_ARE_EQUAL(size_t, 100, lastEventSystem_alert.threshold);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gw);
+}
+
+/*Tests_SRS_GATEWAY_31_028: [ The function shall make the broker report its alerts to the gateway once its event system is initialized and before adding the modules, and shall only log an error if it cannot. ]*/
+TEST_FUNCTION(Gateway_Create_succeeds_when_broker_alerts_fail)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+    mocks.SetIgnoreUnexpectedCalls(true);
+
+    STRICT_EXPECTED_CALL(mocks, Broker_SetAlertCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments()
+        .SetFailReturn(BROKER_ERROR);
+
+    //Act
+    GATEWAY_HANDLE gw = Gateway_Create(NULL);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(gw);
+
+    //Cleanup
+    Gateway_Destroy(gw);
+}
+
+/*Tests_SRS_GATEWAY_31_033: [ For each module returned this function shall provide the handle of the module, which the alert events refer to. ]*/
+TEST_FUNCTION(Gateway_GetModuleList_gives_the_module_handle)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    GATEWAY_HANDLE gw = Gateway_Create(NULL);
+    MODULE_HANDLE handle = Gateway_AddModule(gw, (GATEWAY_MODULES_ENTRY*)BASEIMPLEMENTATION::VECTOR_front(dummyProps->gateway_modules));
+    ASSERT_IS_NOT_NULL(handle);
+    mocks.ResetAllCalls();
+
+    //Act
+    VECTOR_HANDLE modules = Gateway_GetModuleList(gw);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(modules);
+    ASSERT_IS_TRUE(((GATEWAY_MODULE_INFO*)BASEIMPLEMENTATION::VECTOR_element(modules, 0))->module_handle == handle);
+
+    //Cleanup
+    Gateway_DestroyModuleList(modules);
+    Gateway_Destroy(gw);
+    mocks.ResetAllCalls();
+}
+
+/*Tests_SRS_GATEWAY_31_030: [ Before destroying the event system, the function shall stop the alerts of the broker, whether or not the event system was created. ]*/
+TEST_FUNCTION(Gateway_Destroy_stops_broker_alerts)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+    mocks.SetIgnoreUnexpectedCalls(true);
+
+    GATEWAY_HANDLE gw = Gateway_Create(NULL);
+    ASSERT_IS_NOT_NULL((void*)currentBroker_alert_callback);
+
+    //Act
+    Gateway_Destroy(gw);
+
+    //Assert
+    ASSERT_IS_NULL((void*)currentBroker_alert_callback);
+    ASSERT_IS_NULL(currentBroker_alert_context);
+}
+
+/*Tests_SRS_GATEWAY_31_030: [ Before destroying the event system, the function shall stop the alerts of the broker, whether or not the event system was created. ]*/
+TEST_FUNCTION(Gateway_Create_failure_stops_broker_alerts)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+    mocks.SetIgnoreUnexpectedCalls(true);
+
+    whenShallGatewayIndex_Create_fail = 1;
+    STRICT_EXPECTED_CALL(mocks, GatewayIndex_Create());
+
+    //Act
+    GATEWAY_HANDLE gw = Gateway_Create(NULL);
+
+    //Assert
+    ASSERT_IS_NULL(gw);
+    ASSERT_IS_NULL((void*)currentBroker_alert_callback);
+    ASSERT_IS_NULL(currentBroker_alert_context);
+}
+
 END_TEST_SUITE(gateway_ut)
@@ -0,0 +1,764 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+static bool malloc_will_fail = false;
+static size_t malloc_fail_count = 0;
+static size_t malloc_count = 0;
+
+void* my_gballoc_malloc(size_t size)
+{
+    ++malloc_count;
+
+    void* result;
+    if (malloc_will_fail == true && malloc_count == malloc_fail_count)
+    {
+        result = NULL;
+    }
+    else
+    {
+        result = malloc(size);
+    }
+
+    return result;
+}
+
+void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umock_c_negative_tests.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_bool.h"
+#include "umocktypes_stdint.h"
+
+#define ENABLE_MOCKS
+
+#define GATEWAY_EXPORT_H
+#define GATEWAY_EXPORT
+
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/tickcounter.h"
+
+#include "parson.h"
+#include "module_loader.h"
+
+#undef ENABLE_MOCKS
+
+#include "broker.h"
+#include "module_loaders/lazy_loader.h"
+
+#define ENABLE_MOCKS
+
+MOCKABLE_FUNCTION(, JSON_Value*, json_value_deep_copy, const JSON_Value*, value);
+MOCKABLE_FUNCTION(, void, json_value_free, JSON_Value*, value);
+
+static pfModuleLoader_Load LazyModuleLoader_Load = NULL;
+static pfModuleLoader_Unload LazyModuleLoader_Unload = NULL;
+static pfModuleLoader_GetApi LazyModuleLoader_GetModuleApi = NULL;
+static pfModuleLoader_ParseEntrypointFromJson LazyModuleLoader_ParseEntrypointFromJson = NULL;
+static pfModuleLoader_FreeEntrypoint LazyModuleLoader_FreeEntrypoint = NULL;
+static pfModuleLoader_ParseConfigurationFromJson LazyModuleLoader_ParseConfigurationFromJson = NULL;
+static pfModuleLoader_FreeConfiguration LazyModuleLoader_FreeConfiguration = NULL;
+static pfModuleLoader_BuildModuleConfiguration LazyModuleLoader_BuildModuleConfiguration = NULL;
+static pfModuleLoader_FreeModuleConfiguration LazyModuleLoader_FreeModuleConfiguration = NULL;
+
+#define FAKE_BROKER ((BROKER_HANDLE)0x4201)
+#define FAKE_ENTRYPOINT_JSON ((JSON_Value*)0x4202)
+#define FAKE_LIBRARY ((MODULE_LIBRARY_HANDLE)0x4203)
+#define FAKE_MODULE_HANDLE ((MODULE_HANDLE)0x4204)
+#define FAKE_MESSAGE ((MESSAGE_HANDLE)0x4205)
+#define FAKE_THREAD ((THREAD_HANDLE)0x4206)
+#define FAKE_LOCK ((LOCK_HANDLE)0x4207)
+#define FAKE_TICK_COUNTER ((TICK_COUNTER_HANDLE)0x4208)
+
+//=============================================================================
+//Globals
+//=============================================================================
+
+#ifdef WIN32
+static TEST_MUTEX_HANDLE g_dllByDll;
+#endif
+static TEST_MUTEX_HANDLE g_testByTest;
+
+void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    (void)error_code;
+    ASSERT_FAIL("umock_c reported error");
+}
+
+int my_mallocAndStrcpy_s(char** destination, const char* source)
+{
+    *destination = (char*)my_gballoc_malloc(strlen(source) + 1);
+    strcpy(*destination, source);
+    return 0;
+}
+
+// broker mocks
+MOCK_FUNCTION_WITH_CODE(, BROKER_RESULT, Broker_AddModuleAlias, BROKER_HANDLE, broker, const MODULE*, module, MODULE_HANDLE, alias)
+MOCK_FUNCTION_END(BROKER_OK)
+
+MOCK_FUNCTION_WITH_CODE(, BROKER_RESULT, Broker_RemoveModuleAlias, BROKER_HANDLE, broker, MODULE_HANDLE, alias)
+MOCK_FUNCTION_END(BROKER_OK)
+
+static const MODULE_API_1 fake_module_api;
+
+// the loader of the module created on its first message
+MOCK_FUNCTION_WITH_CODE(, MODULE_LIBRARY_HANDLE, Inner_Load, const MODULE_LOADER*, loader, const void*, entrypoint)
+MOCK_FUNCTION_END(FAKE_LIBRARY)
+
+MOCK_FUNCTION_WITH_CODE(, void, Inner_Unload, const MODULE_LOADER*, loader, MODULE_LIBRARY_HANDLE, moduleLibraryHandle)
+MOCK_FUNCTION_END()
+
+MOCK_FUNCTION_WITH_CODE(, const MODULE_API*, Inner_GetApi, const MODULE_LOADER*, loader, MODULE_LIBRARY_HANDLE, moduleLibraryHandle)
+MOCK_FUNCTION_END((const MODULE_API*)&fake_module_api)
+
+MOCK_FUNCTION_WITH_CODE(, void*, Inner_ParseEntrypointFromJson, const MODULE_LOADER*, loader, const JSON_Value*, json)
+    void* entrypoint = my_gballoc_malloc(1);
+MOCK_FUNCTION_END(entrypoint)
+
+MOCK_FUNCTION_WITH_CODE(, void, Inner_FreeEntrypoint, const MODULE_LOADER*, loader, void*, entrypoint)
+    my_gballoc_free(entrypoint);
+MOCK_FUNCTION_END()
+
+MOCK_FUNCTION_WITH_CODE(, void*, Inner_BuildModuleConfiguration, const MODULE_LOADER*, loader, const void*, entrypoint, const void*, module_configuration)
+MOCK_FUNCTION_END((void*)module_configuration)
+
+MOCK_FUNCTION_WITH_CODE(, void, Inner_FreeModuleConfiguration, const MODULE_LOADER*, loader, const void*, module_configuration)
+MOCK_FUNCTION_END()
+
+// the module created on its first message
+MOCK_FUNCTION_WITH_CODE(, void*, Fake_ParseConfigurationFromJson, const char*, configuration)
+MOCK_FUNCTION_END((void*)configuration)
+
+MOCK_FUNCTION_WITH_CODE(, void, Fake_FreeConfiguration, void*, configuration)
+MOCK_FUNCTION_END()
+
+MOCK_FUNCTION_WITH_CODE(, MODULE_HANDLE, Fake_Create, BROKER_HANDLE, broker, const void*, configuration)
+MOCK_FUNCTION_END(FAKE_MODULE_HANDLE)
+
+MOCK_FUNCTION_WITH_CODE(, void, Fake_Destroy, MODULE_HANDLE, moduleHandle)
+MOCK_FUNCTION_END()
+
+MOCK_FUNCTION_WITH_CODE(, void, Fake_Receive, MODULE_HANDLE, moduleHandle, MESSAGE_HANDLE, messageHandle)
+MOCK_FUNCTION_END()
+
+MOCK_FUNCTION_WITH_CODE(, void, Fake_Start, MODULE_HANDLE, moduleHandle)
+MOCK_FUNCTION_END()
+
+#undef ENABLE_MOCKS
+
+static const MODULE_API_1 fake_module_api =
+{
+    { MODULE_API_VERSION_1 },
+
+    Fake_ParseConfigurationFromJson,
+    Fake_FreeConfiguration,
+    Fake_Create,
+    Fake_Destroy,
+    Fake_Receive,
+    Fake_Start
+};
+
+static MODULE_LOADER_API inner_loader_api =
+{
+    Inner_Load,
+    Inner_Unload,
+    Inner_GetApi,
+    Inner_ParseEntrypointFromJson,
+    Inner_FreeEntrypoint,
+    NULL,
+    NULL,
+    Inner_BuildModuleConfiguration,
+    Inner_FreeModuleConfiguration
+};
+
+static MODULE_LOADER inner_loader =
+{
+    NATIVE,
+    "inner",
+    NULL,
+    &inner_loader_api
+};
+
+/* Creates the stand-in of a module of the inner loader, as the gateway does. */
+static MODULE_HANDLE create_stand_in(unsigned int idle_timeout, const MODULE_API_1** stand_in_api)
+{
+    LAZY_LOADER_ENTRYPOINT entrypoint = { &inner_loader, FAKE_ENTRYPOINT_JSON, idle_timeout };
+    const MODULE_LOADER* loader = LazyLoader_Get();
+    MODULE_LIBRARY_HANDLE library = LazyModuleLoader_Load(loader, &entrypoint);
+    *stand_in_api = (const MODULE_API_1*)LazyModuleLoader_GetModuleApi(loader, library);
+
+    void* configuration = LazyModuleLoader_BuildModuleConfiguration(loader, &entrypoint, "{\"hello\":\"world\"}");
+    MODULE_HANDLE result = (*stand_in_api)->Module_Create(FAKE_BROKER, configuration);
+    LazyModuleLoader_FreeModuleConfiguration(loader, configuration);
+    umock_c_reset_all_calls();
+    return result;
+}
+
+static void expect_activation(void)
+{
+    STRICT_EXPECTED_CALL(Inner_ParseEntrypointFromJson(&inner_loader, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(Inner_Load(&inner_loader, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(Inner_GetApi(&inner_loader, FAKE_LIBRARY));
+    STRICT_EXPECTED_CALL(Fake_ParseConfigurationFromJson("{\"hello\":\"world\"}"));
+    STRICT_EXPECTED_CALL(Inner_BuildModuleConfiguration(&inner_loader, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(Fake_Create(FAKE_BROKER, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(Fake_FreeConfiguration(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Inner_FreeModuleConfiguration(&inner_loader, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(Broker_AddModuleAlias(FAKE_BROKER, IGNORED_PTR_ARG, FAKE_MODULE_HANDLE))
+        .IgnoreArgument(2);
+}
+
+BEGIN_TEST_SUITE(LazyLoader_UnitTests)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+    umocktypes_charptr_register_types();
+    umocktypes_stdint_register_types();
+    umocktypes_bool_register_types();
+
+    REGISTER_UMOCK_ALIAS_TYPE(MODULE_LOADER_TYPE, int);
+    REGISTER_UMOCK_ALIAS_TYPE(MODULE_LIBRARY_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(MODULE_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(MESSAGE_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(BROKER_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(BROKER_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(THREAD_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(THREAD_START_FUNC, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(THREADAPI_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(TICK_COUNTER_HANDLE, void*);
+
+    // malloc/free hooks
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+    REGISTER_GLOBAL_MOCK_HOOK(mallocAndStrcpy_s, my_mallocAndStrcpy_s);
+
+    REGISTER_GLOBAL_MOCK_RETURN(json_value_deep_copy, FAKE_ENTRYPOINT_JSON);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(json_value_deep_copy, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(Lock_Init, FAKE_LOCK);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Lock_Init, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(Lock, LOCK_OK);
+    REGISTER_GLOBAL_MOCK_RETURN(Unlock, LOCK_OK);
+    REGISTER_GLOBAL_MOCK_RETURN(tickcounter_create, FAKE_TICK_COUNTER);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(tickcounter_create, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(tickcounter_get_current_ms, 0);
+    REGISTER_GLOBAL_MOCK_RETURN(ThreadAPI_Create, THREADAPI_OK);
+
+    const MODULE_LOADER* loader = LazyLoader_Get();
+    LazyModuleLoader_Load = loader->api->Load;
+    LazyModuleLoader_Unload = loader->api->Unload;
+    LazyModuleLoader_GetModuleApi = loader->api->GetApi;
+    LazyModuleLoader_ParseEntrypointFromJson = loader->api->ParseEntrypointFromJson;
+    LazyModuleLoader_FreeEntrypoint = loader->api->FreeEntrypoint;
+    LazyModuleLoader_ParseConfigurationFromJson = loader->api->ParseConfigurationFromJson;
+    LazyModuleLoader_FreeConfiguration = loader->api->FreeConfiguration;
+    LazyModuleLoader_BuildModuleConfiguration = loader->api->BuildModuleConfiguration;
+    LazyModuleLoader_FreeModuleConfiguration = loader->api->FreeModuleConfiguration;
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    umock_c_deinit();
+
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest) != 0)
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    umock_c_reset_all_calls();
+    malloc_will_fail = false;
+    malloc_fail_count = 0;
+    malloc_count = 0;
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+//Tests_SRS_LAZY_LOADER_31_007: [ `LazyLoader_Get` shall return a non-`NULL` pointer to a `MODULE_LOADER` named `lazy`, which is not registered with the module loaders. ]
+TEST_FUNCTION(LazyLoader_Get_succeeds)
+{
+    // act
+    const MODULE_LOADER* loader = LazyLoader_Get();
+
+    // assert
+    ASSERT_IS_NOT_NULL(loader);
+    ASSERT_IS_NOT_NULL(loader->api);
+    ASSERT_ARE_EQUAL(char_ptr, LAZY_LOADER_NAME, loader->name);
+}
+
+//Tests_SRS_LAZY_LOADER_31_031: [ `LazyLoader_CreateEntrypoint` shall return `NULL` if `loader` is `NULL`. ]
+TEST_FUNCTION(LazyLoader_CreateEntrypoint_returns_NULL_when_loader_is_NULL)
+{
+    // act
+    LAZY_LOADER_ENTRYPOINT* result = LazyLoader_CreateEntrypoint(NULL, FAKE_ENTRYPOINT_JSON, 0);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+//Tests_SRS_LAZY_LOADER_31_032: [ `LazyLoader_CreateEntrypoint` shall return `NULL` if an underlying API call fails. ]
+TEST_FUNCTION(LazyLoader_CreateEntrypoint_returns_NULL_when_things_fail)
+{
+    // arrange
+    int result = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(LAZY_LOADER_ENTRYPOINT)));
+    STRICT_EXPECTED_CALL(json_value_deep_copy(FAKE_ENTRYPOINT_JSON));
+
+    umock_c_negative_tests_snapshot();
+
+    for (size_t i = 0; i < umock_c_negative_tests_call_count(); i++)
+    {
+        // arrange
+        umock_c_negative_tests_reset();
+        umock_c_negative_tests_fail_call(i);
+
+        // act
+        LAZY_LOADER_ENTRYPOINT* entrypoint = LazyLoader_CreateEntrypoint(&inner_loader, FAKE_ENTRYPOINT_JSON, 0);
+
+        // assert
+        ASSERT_IS_NULL(entrypoint);
+    }
+
+    umock_c_negative_tests_deinit();
+}
+
+//Tests_SRS_LAZY_LOADER_31_033: [ `LazyLoader_CreateEntrypoint` shall keep `loader` and `idle_timeout`, and a copy of `entrypoint` if it is not `NULL`. ]
+//Tests_SRS_LAZY_LOADER_31_006: [ `LazyModuleLoader_FreeEntrypoint` shall free the entrypoint JSON and the entrypoint. ]
+TEST_FUNCTION(LazyLoader_CreateEntrypoint_succeeds)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(LAZY_LOADER_ENTRYPOINT)));
+    STRICT_EXPECTED_CALL(json_value_deep_copy(FAKE_ENTRYPOINT_JSON));
+    STRICT_EXPECTED_CALL(json_value_free(FAKE_ENTRYPOINT_JSON));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    // act
+    LAZY_LOADER_ENTRYPOINT* result = LazyLoader_CreateEntrypoint(&inner_loader, FAKE_ENTRYPOINT_JSON, 1000);
+
+    // assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(void_ptr, &inner_loader, result->loader);
+    ASSERT_ARE_EQUAL(void_ptr, FAKE_ENTRYPOINT_JSON, result->entrypoint);
+    ASSERT_ARE_EQUAL(int, 1000, (int)result->idle_timeout);
+
+    // cleanup
+    LazyModuleLoader_FreeEntrypoint(LazyLoader_Get(), result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+//Tests_SRS_LAZY_LOADER_31_005: [ `LazyModuleLoader_FreeEntrypoint` shall do nothing if `entrypoint` is `NULL`. ]
+TEST_FUNCTION(LazyModuleLoader_FreeEntrypoint_does_nothing_with_NULL_entrypoint)
+{
+    // act
+    LazyModuleLoader_FreeEntrypoint(LazyLoader_Get(), NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+//Tests_SRS_LAZY_LOADER_31_001: [ `LazyModuleLoader_Load` shall return `NULL` if `loader` or `entrypoint` is `NULL`. ]
+TEST_FUNCTION(LazyModuleLoader_Load_returns_NULL_when_entrypoint_is_NULL)
+{
+    // act
+    MODULE_LIBRARY_HANDLE result = LazyModuleLoader_Load(LazyLoader_Get(), NULL);
+
+    // assert
+    ASSERT_IS_NULL(result);
+}
+
+//Tests_SRS_LAZY_LOADER_31_002: [ `LazyModuleLoader_Load` shall not load the module library, it shall return the stand-in module API as the library handle. ]
+//Tests_SRS_LAZY_LOADER_31_003: [ `LazyModuleLoader_GetModuleApi` shall return the stand-in module API, or `NULL` if `moduleLibraryHandle` is `NULL`. ]
+//Tests_SRS_LAZY_LOADER_31_004: [ `LazyModuleLoader_Unload` shall do nothing, the stand-in unloads the module library when it deactivates the module. ]
+TEST_FUNCTION(LazyModuleLoader_Load_does_not_load_the_module)
+{
+    // arrange
+    LAZY_LOADER_ENTRYPOINT entrypoint = { &inner_loader, FAKE_ENTRYPOINT_JSON, 0 };
+    const MODULE_LOADER* loader = LazyLoader_Get();
+
+    // act
+    MODULE_LIBRARY_HANDLE library = LazyModuleLoader_Load(loader, &entrypoint);
+    const MODULE_API* api = LazyModuleLoader_GetModuleApi(loader, library);
+    LazyModuleLoader_Unload(loader, library);
+
+    // assert
+    ASSERT_IS_NOT_NULL(library);
+    ASSERT_IS_NOT_NULL(api);
+    ASSERT_ARE_EQUAL(int, MODULE_API_VERSION_1, api->version);
+    ASSERT_IS_NULL(LazyModuleLoader_GetModuleApi(loader, NULL));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+//Tests_SRS_LAZY_LOADER_31_025: [ `LazyModuleLoader_ParseEntrypointFromJson` shall return `NULL`, lazy entrypoints are created with `LazyLoader_CreateEntrypoint`. ]
+//Tests_SRS_LAZY_LOADER_31_026: [ `LazyModuleLoader_ParseConfigurationFromJson` shall return `NULL`, the lazy loader has no configuration. ]
+TEST_FUNCTION(LazyModuleLoader_parses_nothing_from_JSON)
+{
+    // act
+    void* entrypoint = LazyModuleLoader_ParseEntrypointFromJson(LazyLoader_Get(), FAKE_ENTRYPOINT_JSON);
+    MODULE_LOADER_BASE_CONFIGURATION* configuration = LazyModuleLoader_ParseConfigurationFromJson(LazyLoader_Get(), FAKE_ENTRYPOINT_JSON);
+
+    // assert
+    ASSERT_IS_NULL(entrypoint);
+    ASSERT_IS_NULL(configuration);
+}
+
+//Tests_SRS_LAZY_LOADER_31_027: [ `LazyModuleLoader_BuildModuleConfiguration` shall return `NULL` if `entrypoint` is `NULL`. ]
+TEST_FUNCTION(LazyModuleLoader_BuildModuleConfiguration_returns_NULL_when_entrypoint_is_NULL)
+{
+    // act
+    void* result = LazyModuleLoader_BuildModuleConfiguration(LazyLoader_Get(), NULL, "{}");
+
+    // assert
+    ASSERT_IS_NULL(result);
+}
+
+//Tests_SRS_LAZY_LOADER_31_028: [ `LazyModuleLoader_BuildModuleConfiguration` shall return `NULL` if an underlying API call fails. ]
+TEST_FUNCTION(LazyModuleLoader_BuildModuleConfiguration_returns_NULL_when_malloc_fails)
+{
+    // arrange
+    LAZY_LOADER_ENTRYPOINT entrypoint = { &inner_loader, FAKE_ENTRYPOINT_JSON, 0 };
+    malloc_will_fail = true;
+    malloc_fail_count = 1;
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+
+    // act
+    void* result = LazyModuleLoader_BuildModuleConfiguration(LazyLoader_Get(), &entrypoint, "{}");
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+//Tests_SRS_LAZY_LOADER_31_029: [ `LazyModuleLoader_BuildModuleConfiguration` shall pair the entrypoint with the module JSON configuration. ]
+//Tests_SRS_LAZY_LOADER_31_030: [ `LazyModuleLoader_FreeModuleConfiguration` shall free the pair, not the configuration it refers to. ]
+TEST_FUNCTION(LazyModuleLoader_BuildModuleConfiguration_succeeds)
+{
+    // arrange
+    LAZY_LOADER_ENTRYPOINT entrypoint = { &inner_loader, FAKE_ENTRYPOINT_JSON, 0 };
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    // act
+    void* result = LazyModuleLoader_BuildModuleConfiguration(LazyLoader_Get(), &entrypoint, "{}");
+    LazyModuleLoader_FreeModuleConfiguration(LazyLoader_Get(), result);
+
+    // assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+//Tests_SRS_LAZY_LOADER_31_010: [ `LazyModule_Create` shall return `NULL` if `broker` or `configuration` is `NULL`. ]
+TEST_FUNCTION(LazyModule_Create_returns_NULL_when_configuration_is_NULL)
+{
+    // arrange
+    const MODULE_API_1* api = (const MODULE_API_1*)LazyModuleLoader_GetModuleApi(LazyLoader_Get(), (MODULE_LIBRARY_HANDLE)0x42);
+
+    // act
+    MODULE_HANDLE result = api->Module_Create(FAKE_BROKER, NULL);
+
+    // assert
+    ASSERT_IS_NULL(result);
+}
+
+//Tests_SRS_LAZY_LOADER_31_011: [ `LazyModule_Create` shall copy the module entrypoint JSON and JSON configuration, and create a tick counter and a lock, without loading the module. ]
+//Tests_SRS_LAZY_LOADER_31_022: [ `LazyModule_Destroy` shall stop the idle watcher, deactivate the module if it is active, and free all resources of the stand-in. ]
+TEST_FUNCTION(LazyModule_Create_does_not_create_the_module)
+{
+    // arrange
+    LAZY_LOADER_ENTRYPOINT entrypoint = { &inner_loader, FAKE_ENTRYPOINT_JSON, 0 };
+    const MODULE_LOADER* loader = LazyLoader_Get();
+    const MODULE_API_1* api = (const MODULE_API_1*)LazyModuleLoader_GetModuleApi(loader, LazyModuleLoader_Load(loader, &entrypoint));
+    void* configuration = LazyModuleLoader_BuildModuleConfiguration(loader, &entrypoint, "{}");
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(json_value_deep_copy(FAKE_ENTRYPOINT_JSON));
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, "{}"))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(tickcounter_create());
+    STRICT_EXPECTED_CALL(Lock_Init());
+
+    // act
+    MODULE_HANDLE result = api->Module_Create(FAKE_BROKER, configuration);
+
+    // assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    api->Module_Destroy(result);
+    LazyModuleLoader_FreeModuleConfiguration(loader, configuration);
+}
+
+//Tests_SRS_LAZY_LOADER_31_012: [ `LazyModule_Create` shall return `NULL` if an underlying API call fails. ]
+TEST_FUNCTION(LazyModule_Create_returns_NULL_when_things_fail)
+{
+    // arrange
+    LAZY_LOADER_ENTRYPOINT entrypoint = { &inner_loader, FAKE_ENTRYPOINT_JSON, 0 };
+    const MODULE_LOADER* loader = LazyLoader_Get();
+    const MODULE_API_1* api = (const MODULE_API_1*)LazyModuleLoader_GetModuleApi(loader, LazyModuleLoader_Load(loader, &entrypoint));
+    void* configuration = LazyModuleLoader_BuildModuleConfiguration(loader, &entrypoint, "{}");
+    umock_c_reset_all_calls();
+
+    int result = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1)
+        .SetFailReturn(NULL);
+    STRICT_EXPECTED_CALL(json_value_deep_copy(FAKE_ENTRYPOINT_JSON));
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, "{}"))
+        .IgnoreArgument(1)
+        .SetFailReturn(__LINE__);
+    STRICT_EXPECTED_CALL(tickcounter_create());
+    STRICT_EXPECTED_CALL(Lock_Init());
+
+    umock_c_negative_tests_snapshot();
+
+    for (size_t i = 0; i < umock_c_negative_tests_call_count(); i++)
+    {
+        // arrange
+        umock_c_negative_tests_reset();
+        umock_c_negative_tests_fail_call(i);
+
+        // act
+        MODULE_HANDLE module = api->Module_Create(FAKE_BROKER, configuration);
+
+        // assert
+        ASSERT_IS_NULL(module);
+    }
+
+    // cleanup
+    umock_c_negative_tests_deinit();
+    LazyModuleLoader_FreeModuleConfiguration(loader, configuration);
+}
+
+//Tests_SRS_LAZY_LOADER_31_013: [ If the module is not active, `LazyModule_Receive` shall activate it. The broker keeps the messages that follow queued meanwhile. ]
+//Tests_SRS_LAZY_LOADER_31_014: [ To activate the module, the stand-in shall parse the module entrypoint with the module loader, load the module library and get its `MODULE_API`. ]
+//Tests_SRS_LAZY_LOADER_31_015: [ The stand-in shall create the module from its JSON configuration the way the gateway creates modules, then free the configurations. ]
+//Tests_SRS_LAZY_LOADER_31_016: [ The stand-in shall make the module handle an alias of the stand-in on the broker, so the messages the module publishes follow the links of the stand-in. ]
+//Tests_SRS_LAZY_LOADER_31_023: [ `LazyModule_Receive` shall record the time of the message and pass it to the module. ]
+TEST_FUNCTION(LazyModule_Receive_creates_the_module_on_the_first_message)
+{
+    // arrange
+    const MODULE_API_1* api;
+    MODULE_HANDLE stand_in = create_stand_in(0, &api);
+
+    STRICT_EXPECTED_CALL(Lock(FAKE_LOCK));
+    expect_activation();
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(FAKE_TICK_COUNTER, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(Fake_Receive(FAKE_MODULE_HANDLE, FAKE_MESSAGE));
+    STRICT_EXPECTED_CALL(Unlock(FAKE_LOCK));
+
+    // act
+    api->Module_Receive(stand_in, FAKE_MESSAGE);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    api->Module_Destroy(stand_in);
+}
+
+//Tests_SRS_LAZY_LOADER_31_023: [ `LazyModule_Receive` shall record the time of the message and pass it to the module. ]
+TEST_FUNCTION(LazyModule_Receive_creates_the_module_once)
+{
+    // arrange
+    const MODULE_API_1* api;
+    MODULE_HANDLE stand_in = create_stand_in(0, &api);
+    api->Module_Receive(stand_in, FAKE_MESSAGE);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(FAKE_LOCK));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(FAKE_TICK_COUNTER, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(Fake_Receive(FAKE_MODULE_HANDLE, FAKE_MESSAGE));
+    STRICT_EXPECTED_CALL(Unlock(FAKE_LOCK));
+
+    // act
+    api->Module_Receive(stand_in, FAKE_MESSAGE);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    api->Module_Destroy(stand_in);
+}
+
+//Tests_SRS_LAZY_LOADER_31_017: [ If the stand-in was started, the stand-in shall start the module. ]
+//Tests_SRS_LAZY_LOADER_31_024: [ `LazyModule_Start` shall start the module if it is active, and the module created afterwards otherwise. ]
+TEST_FUNCTION(LazyModule_Receive_starts_the_module_when_started)
+{
+    // arrange
+    const MODULE_API_1* api;
+    MODULE_HANDLE stand_in = create_stand_in(0, &api);
+    api->Module_Start(stand_in);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(FAKE_LOCK));
+    expect_activation();
+    STRICT_EXPECTED_CALL(Fake_Start(FAKE_MODULE_HANDLE));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(FAKE_TICK_COUNTER, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(Fake_Receive(FAKE_MODULE_HANDLE, FAKE_MESSAGE));
+    STRICT_EXPECTED_CALL(Unlock(FAKE_LOCK));
+
+    // act
+    api->Module_Receive(stand_in, FAKE_MESSAGE);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    api->Module_Destroy(stand_in);
+}
+
+//Tests_SRS_LAZY_LOADER_31_018: [ If the module cannot be activated, the stand-in shall release what it acquired and drop the message. ]
+TEST_FUNCTION(LazyModule_Receive_drops_the_message_when_the_module_cannot_be_created)
+{
+    // arrange
+    const MODULE_API_1* api;
+    MODULE_HANDLE stand_in = create_stand_in(0, &api);
+
+    STRICT_EXPECTED_CALL(Lock(FAKE_LOCK));
+    STRICT_EXPECTED_CALL(Inner_ParseEntrypointFromJson(&inner_loader, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(Inner_Load(&inner_loader, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(Inner_GetApi(&inner_loader, FAKE_LIBRARY));
+    STRICT_EXPECTED_CALL(Fake_ParseConfigurationFromJson("{\"hello\":\"world\"}"));
+    STRICT_EXPECTED_CALL(Inner_BuildModuleConfiguration(&inner_loader, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(Fake_Create(FAKE_BROKER, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(Fake_FreeConfiguration(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Inner_FreeModuleConfiguration(&inner_loader, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(Inner_Unload(&inner_loader, FAKE_LIBRARY));
+    STRICT_EXPECTED_CALL(Inner_FreeEntrypoint(&inner_loader, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(Unlock(FAKE_LOCK));
+
+    // act
+    api->Module_Receive(stand_in, FAKE_MESSAGE);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    api->Module_Destroy(stand_in);
+}
+
+//Tests_SRS_LAZY_LOADER_31_019: [ If `idle_timeout` is not 0, the stand-in shall start an idle watcher thread for as long as the module is active. ]
+TEST_FUNCTION(LazyModule_Receive_starts_the_idle_watcher_with_an_idle_timeout)
+{
+    // arrange
+    const MODULE_API_1* api;
+    MODULE_HANDLE stand_in = create_stand_in(1000, &api);
+    THREAD_HANDLE thread = FAKE_THREAD;
+
+    STRICT_EXPECTED_CALL(Lock(FAKE_LOCK));
+    expect_activation();
+    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, stand_in))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .CopyOutArgumentBuffer(1, &thread, sizeof(thread));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(FAKE_TICK_COUNTER, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(Fake_Receive(FAKE_MODULE_HANDLE, FAKE_MESSAGE));
+    STRICT_EXPECTED_CALL(Unlock(FAKE_LOCK));
+
+    // act
+    api->Module_Receive(stand_in, FAKE_MESSAGE);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    api->Module_Destroy(stand_in);
+}
+
+//Tests_SRS_LAZY_LOADER_31_021: [ To deactivate the module, the stand-in shall remove the module handle alias from the broker, destroy the module, unload its library and free its entrypoint. ]
+//Tests_SRS_LAZY_LOADER_31_022: [ `LazyModule_Destroy` shall stop the idle watcher, deactivate the module if it is active, and free all resources of the stand-in. ]
+TEST_FUNCTION(LazyModule_Destroy_stops_the_watcher_and_destroys_the_module)
+{
+    // arrange
+    const MODULE_API_1* api;
+    MODULE_HANDLE stand_in = create_stand_in(1000, &api);
+    THREAD_HANDLE thread = FAKE_THREAD;
+    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments()
+        .CopyOutArgumentBuffer(1, &thread, sizeof(thread));
+    api->Module_Receive(stand_in, FAKE_MESSAGE);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(FAKE_LOCK));
+    STRICT_EXPECTED_CALL(Unlock(FAKE_LOCK));
+    STRICT_EXPECTED_CALL(ThreadAPI_Join(FAKE_THREAD, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(Broker_RemoveModuleAlias(FAKE_BROKER, FAKE_MODULE_HANDLE));
+    STRICT_EXPECTED_CALL(Fake_Destroy(FAKE_MODULE_HANDLE));
+    STRICT_EXPECTED_CALL(Inner_Unload(&inner_loader, FAKE_LIBRARY));
+    STRICT_EXPECTED_CALL(Inner_FreeEntrypoint(&inner_loader, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(Lock_Deinit(FAKE_LOCK));
+    STRICT_EXPECTED_CALL(tickcounter_destroy(FAKE_TICK_COUNTER));
+    STRICT_EXPECTED_CALL(json_value_free(FAKE_ENTRYPOINT_JSON));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_free(stand_in));
+
+    // act
+    api->Module_Destroy(stand_in);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+END_TEST_SUITE(LazyLoader_UnitTests);
@@ -71,6 +71,7 @@ MOCKABLE_FUNCTION(, JSON_Value_Type, json_value_get_type, const JSON_Value*, val
 static const size_t g_enabled_loaders[] =
 {
     1       // native loader
+    , 1     // builtin loader
 #ifdef NODE_BINDING_ENABLED
     , 1
 #endif
@@ -212,6 +213,24 @@ MOCK_FUNCTION_END(&Dynamic_Module_Loader)
 }
 #endif
 
+static MODULE_LOADER Builtin_Module_Loader =
+{
+    NATIVE,
+    "builtin",
+    NULL,
+    &Fake_Module_Loader_API
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+MOCK_FUNCTION_WITH_CODE(, const MODULE_LOADER*, BuiltinLoader_Get)
+MOCK_FUNCTION_END(&Builtin_Module_Loader)
+#ifdef __cplusplus
+}
+#endif
+
 static MODULE_LOADER Outprocess_Module_Loader =
 {
 	OUTPROCESS,
@@ -525,6 +544,7 @@ TEST_FUNCTION(ModuleLoader_Initialize_succeeds)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(VECTOR_create(sizeof(MODULE_LOADER*)));
 	STRICT_EXPECTED_CALL(DynamicLoader_Get());
+    STRICT_EXPECTED_CALL(BuiltinLoader_Get());
 #ifdef NODE_BINDING_ENABLED
     STRICT_EXPECTED_CALL(NodeLoader_Get());
 #endif
@@ -1371,12 +1391,12 @@ TEST_FUNCTION(ModuleLoader_ParseType_succeeds)
     }
 }
 
-// Tests_SRS_MODULE_LOADER_13_061: [ ModuleLoader_IsDefaultLoader shall return true if name is the name of a default module loader and false otherwise. The default module loader names are 'native', 'node', 'java' , 'dotnet' and 'dotnetcore'. ]
+// Tests_SRS_MODULE_LOADER_13_061: [ ModuleLoader_IsDefaultLoader shall return true if name is the name of a default module loader and false otherwise. The default module loader names are 'native', 'builtin', 'node', 'java' , 'dotnet' and 'dotnetcore'. ]
 TEST_FUNCTION(ModuleLoader_IsDefaultLoader_succeeds)
 {
     // arrange
-    char* inputs[] = { "native", "node", "java", "dotnet", "dotnetcore", "outprocess", "boo" };
-    bool expected[] = { true, true, true, true, true, true, false };
+    char* inputs[] = { "native", "builtin", "node", "java", "dotnet", "dotnetcore", "outprocess", "boo" };
+    bool expected[] = { true, true, true, true, true, true, true, false };
 
     for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++)
     {
@@ -450,6 +450,10 @@ expected_calls_update_entrypoint_with_launch_object (
                 .SetFailReturn(NULL);
         }
     }
+    disableNegativeTest(negative_test_index++);
+    EXPECTED_CALL(json_object_get_string(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .SetReturn(NULL)
+        .ValidateArgumentBuffer(2, "host.id", (sizeof("host.id") - 1));
 }
 
 static inline
@@ -727,6 +731,60 @@ TEST_FUNCTION(OutprocessModuleLoader_Load_succeeds)
     global_memory = false;
 }
 
+/*Tests_SRS_OUTPROCESS_LOADER_31_008: [ Launch - `OutprocessModuleLoader_Load` shall not launch the child process if the entrypoint's `host_id` names a host already launched by the loader. ]*/
+/*Tests_SRS_OUTPROCESS_LOADER_31_009: [ Launch - `OutprocessModuleLoader_Load` shall remember the entrypoint's `host_id`, if any, once the child process is launched. ]*/
+/*Tests_SRS_OUTPROCESS_LOADER_31_010: [ `OutprocessLoader_JoinChildProcesses` shall forget all launched shared host processes. ]*/
+TEST_FUNCTION(OutprocessModuleLoader_Load_launches_shared_host_once)
+{
+    // arrange
+    global_memory = true;
+    char * process_argv[] = {
+        "program.exe",
+        "control.id.1",
+        "control.id.2"
+    };
+    OUTPROCESS_LOADER_ENTRYPOINT entrypoint = {
+        OUTPROCESS_LOADER_ACTIVATION_LAUNCH,
+        (STRING_HANDLE)0x42,
+        (STRING_HANDLE)0x42,
+        sizeof(process_argv),
+        process_argv,
+        0,
+        OUTPROCESS_LOADER_TRANSPORT_IPC,
+        "shared_host"
+    };
+    MODULE_LOADER loader =
+    {
+        OUTPROCESS,
+        NULL, NULL, NULL
+    };
+
+    umock_c_reset_all_calls();
+    expected_calls_launch_child_process_from_entrypoint(true);
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    expected_calls_OutprocessLoader_SpawnChildProcesses(true);
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    MODULE_LIBRARY_HANDLE first = OutprocessModuleLoader_Load(&loader, &entrypoint);
+    ASSERT_IS_NOT_NULL(first);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    umock_c_reset_all_calls();
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+
+    // act
+    MODULE_LIBRARY_HANDLE second = OutprocessModuleLoader_Load(&loader, &entrypoint);
+
+    // assert
+    ASSERT_IS_NOT_NULL(second);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    OutprocessModuleLoader_Unload(&loader, second);
+    OutprocessModuleLoader_Unload(&loader, first);
+    OutprocessLoader_JoinChildProcesses();
+    global_memory = false;
+}
+
 TEST_FUNCTION(OutprocessModuleLoader_GetModuleApi_returns_NULL_when_moduleLibraryHandle_is_NULL)
 {
     // act
@@ -1024,17 +1082,224 @@ TEST_FUNCTION(OutprocessModuleLoader_ParseEntrypointFromJson_succeeds)
     expected_calls_update_entrypoint_with_launch_object();
 	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x43, "timeout"))
 		.SetReturn(2000);
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "message.transport"))
+		.SetReturn(NULL);
+	STRICT_EXPECTED_CALL(STRING_construct(NULL));
+
+	// act
+	void* result = OutprocessModuleLoader_ParseEntrypointFromJson(NULL, (JSON_Value*)0x42);
+
+	// assert
+	ASSERT_IS_NOT_NULL(result);
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+	OutprocessModuleLoader_FreeEntrypoint(NULL, result);
+}
+
+/*Tests_SRS_OUTPROCESS_LOADER_31_001: [ This function shall read the optional "message.transport" value, defaulting to `OUTPROCESS_LOADER_TRANSPORT_IPC`. ]*/
+TEST_FUNCTION(OutprocessModuleLoader_ParseEntrypointFromJson_reads_shm_transport)
+{
+	// arrange
+	char * activation_type = "none";
+	char * control_id = "a url";
+
+	STRICT_EXPECTED_CALL(json_value_get_type((JSON_Value*)0x42))
+		.SetReturn(JSONObject);
+	STRICT_EXPECTED_CALL(json_value_get_object((JSON_Value*)0x42))
+		.SetReturn((JSON_Object*)0x43);
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "activation.type"))
+		.SetReturn(activation_type);
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "control.id"))
+		.SetReturn(control_id);
+	STRICT_EXPECTED_CALL(json_object_get_object((JSON_Object*)0x43, "launch"));
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "message.id"))
+		.SetReturn(NULL);
+	STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(OUTPROCESS_LOADER_ENTRYPOINT)));
+	STRICT_EXPECTED_CALL(STRING_construct(control_id));
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x43, "timeout"));
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "message.transport"))
+		.SetReturn("shm");
 	STRICT_EXPECTED_CALL(STRING_construct(NULL));
 
+	// act
+	OUTPROCESS_LOADER_ENTRYPOINT* result = (OUTPROCESS_LOADER_ENTRYPOINT*)OutprocessModuleLoader_ParseEntrypointFromJson(NULL, (JSON_Value*)0x42);
+
+	// assert
+	ASSERT_IS_NOT_NULL(result);
+	ASSERT_ARE_EQUAL(int, OUTPROCESS_LOADER_TRANSPORT_SHM, result->message_transport);
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	// cleanup
+	OutprocessModuleLoader_FreeEntrypoint(NULL, result);
+}
+
+/*Tests_SRS_OUTPROCESS_LOADER_31_002: [ This function shall return NULL if "message.transport" is not "ipc", "shm" or "tcp". ]*/
+TEST_FUNCTION(OutprocessModuleLoader_ParseEntrypointFromJson_returns_NULL_when_transport_is_invalid)
+{
+	// arrange
+	char * activation_type = "none";
+	char * control_id = "a url";
+
+	STRICT_EXPECTED_CALL(json_value_get_type((JSON_Value*)0x42))
+		.SetReturn(JSONObject);
+	STRICT_EXPECTED_CALL(json_value_get_object((JSON_Value*)0x42))
+		.SetReturn((JSON_Object*)0x43);
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "activation.type"))
+		.SetReturn(activation_type);
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "control.id"))
+		.SetReturn(control_id);
+	STRICT_EXPECTED_CALL(json_object_get_object((JSON_Object*)0x43, "launch"));
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "message.id"))
+		.SetReturn(NULL);
+	STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(OUTPROCESS_LOADER_ENTRYPOINT)));
+	STRICT_EXPECTED_CALL(STRING_construct(control_id));
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x43, "timeout"));
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "message.transport"))
+		.SetReturn("carrier pigeon");
+	STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
 	// act
 	void* result = OutprocessModuleLoader_ParseEntrypointFromJson(NULL, (JSON_Value*)0x42);
 
+	// assert
+	ASSERT_IS_NULL(result);
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_OUTPROCESS_LOADER_31_012: [ If "message.transport" is "tcp", this function shall read the optional "tcp" object's "keepalive", "reconnect.max", "send.buffer" and "receive.buffer" numbers into the entrypoint's tcp_options. ]*/
+TEST_FUNCTION(OutprocessModuleLoader_ParseEntrypointFromJson_reads_tcp_transport)
+{
+	// arrange
+	char * activation_type = "none";
+	char * control_id = "127.0.0.1:5555";
+	char * message_id = "127.0.0.1:5556";
+
+	STRICT_EXPECTED_CALL(json_value_get_type((JSON_Value*)0x42))
+		.SetReturn(JSONObject);
+	STRICT_EXPECTED_CALL(json_value_get_object((JSON_Value*)0x42))
+		.SetReturn((JSON_Object*)0x43);
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "activation.type"))
+		.SetReturn(activation_type);
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "control.id"))
+		.SetReturn(control_id);
+	STRICT_EXPECTED_CALL(json_object_get_object((JSON_Object*)0x43, "launch"));
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "message.id"))
+		.SetReturn(message_id);
+	STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(OUTPROCESS_LOADER_ENTRYPOINT)));
+	STRICT_EXPECTED_CALL(STRING_construct(control_id));
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x43, "timeout"));
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "message.transport"))
+		.SetReturn("tcp");
+	STRICT_EXPECTED_CALL(json_object_get_object((JSON_Object*)0x43, "tcp"))
+		.SetReturn((JSON_Object*)0x44);
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x44, "keepalive"))
+		.SetReturn(2000);
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x44, "reconnect.max"))
+		.SetReturn(30000);
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x44, "send.buffer"))
+		.SetReturn(65536);
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x44, "receive.buffer"))
+		.SetReturn(131072);
+	STRICT_EXPECTED_CALL(STRING_construct(message_id));
+
+	// act
+	OUTPROCESS_LOADER_ENTRYPOINT* result = (OUTPROCESS_LOADER_ENTRYPOINT*)OutprocessModuleLoader_ParseEntrypointFromJson(NULL, (JSON_Value*)0x42);
+
 	// assert
 	ASSERT_IS_NOT_NULL(result);
+	ASSERT_ARE_EQUAL(int, OUTPROCESS_LOADER_TRANSPORT_TCP, result->message_transport);
+	ASSERT_ARE_EQUAL(int, 2000, (int)result->tcp_options.keepalive_interval);
+	ASSERT_ARE_EQUAL(int, 30000, result->tcp_options.reconnect_interval_max);
+	ASSERT_ARE_EQUAL(int, 65536, result->tcp_options.send_buffer_size);
+	ASSERT_ARE_EQUAL(int, 131072, result->tcp_options.receive_buffer_size);
 	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	// cleanup
 	OutprocessModuleLoader_FreeEntrypoint(NULL, result);
 }
 
+/*Tests_SRS_OUTPROCESS_LOADER_31_011: [ This function shall return NULL if "message.transport" is "tcp" and "message.id" is not present in json. ]*/
+TEST_FUNCTION(OutprocessModuleLoader_ParseEntrypointFromJson_returns_NULL_when_tcp_has_no_message_id)
+{
+	// arrange
+	char * activation_type = "none";
+	char * control_id = "127.0.0.1:5555";
+
+	STRICT_EXPECTED_CALL(json_value_get_type((JSON_Value*)0x42))
+		.SetReturn(JSONObject);
+	STRICT_EXPECTED_CALL(json_value_get_object((JSON_Value*)0x42))
+		.SetReturn((JSON_Object*)0x43);
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "activation.type"))
+		.SetReturn(activation_type);
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "control.id"))
+		.SetReturn(control_id);
+	STRICT_EXPECTED_CALL(json_object_get_object((JSON_Object*)0x43, "launch"));
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "message.id"))
+		.SetReturn(NULL);
+	STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(OUTPROCESS_LOADER_ENTRYPOINT)));
+	STRICT_EXPECTED_CALL(STRING_construct(control_id));
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x43, "timeout"));
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "message.transport"))
+		.SetReturn("tcp");
+	STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	// act
+	void* result = OutprocessModuleLoader_ParseEntrypointFromJson(NULL, (JSON_Value*)0x42);
+
+	// assert
+	ASSERT_IS_NULL(result);
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_OUTPROCESS_LOADER_31_013: [ This function shall return NULL if any of the "tcp" values is negative or larger than `INT_MAX`. ]*/
+TEST_FUNCTION(OutprocessModuleLoader_ParseEntrypointFromJson_returns_NULL_when_tcp_option_is_negative)
+{
+	// arrange
+	char * activation_type = "none";
+	char * control_id = "127.0.0.1:5555";
+	char * message_id = "127.0.0.1:5556";
+
+	STRICT_EXPECTED_CALL(json_value_get_type((JSON_Value*)0x42))
+		.SetReturn(JSONObject);
+	STRICT_EXPECTED_CALL(json_value_get_object((JSON_Value*)0x42))
+		.SetReturn((JSON_Object*)0x43);
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "activation.type"))
+		.SetReturn(activation_type);
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "control.id"))
+		.SetReturn(control_id);
+	STRICT_EXPECTED_CALL(json_object_get_object((JSON_Object*)0x43, "launch"));
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "message.id"))
+		.SetReturn(message_id);
+	STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(OUTPROCESS_LOADER_ENTRYPOINT)));
+	STRICT_EXPECTED_CALL(STRING_construct(control_id));
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x43, "timeout"));
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "message.transport"))
+		.SetReturn("tcp");
+	STRICT_EXPECTED_CALL(json_object_get_object((JSON_Object*)0x43, "tcp"))
+		.SetReturn((JSON_Object*)0x44);
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x44, "keepalive"));
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x44, "reconnect.max"));
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x44, "send.buffer"))
+		.SetReturn(-1);
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x44, "receive.buffer"));
+	STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	// act
+	void* result = OutprocessModuleLoader_ParseEntrypointFromJson(NULL, (JSON_Value*)0x42);
+
+	// assert
+	ASSERT_IS_NULL(result);
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
 /*Tests_SRS_OUTPROCESS_LOADER_17_023: [ This function shall release all resources allocated by OutprocessModuleLoader_ParseEntrypointFromJson. ]*/
 TEST_FUNCTION(OutprocessModuleLoader_FreeEntrypoint_does_nothing_when_entrypoint_is_NULL)
 {
@@ -1065,6 +1330,8 @@ TEST_FUNCTION(OutprocessModuleLoader_FreeEntrypoint_frees_resources)
 		.SetReturn(message_id);
 	STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(OUTPROCESS_LOADER_ENTRYPOINT)));
 	STRICT_EXPECTED_CALL(STRING_construct(control_id));
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "message.transport"))
+		.SetReturn(NULL);
 	STRICT_EXPECTED_CALL(STRING_construct(message_id));
 
 	void* entrypoint = OutprocessModuleLoader_ParseEntrypointFromJson(NULL, (JSON_Value*)0x42);
@@ -1174,6 +1441,92 @@ TEST_FUNCTION(OutprocessModuleLoader_BuildModuleConfiguration_success_with_msg_u
 	STRING_delete(mc);
 }
 
+/*Tests_SRS_OUTPROCESS_LOADER_31_003: [ If the entrypoint's message_transport is `OUTPROCESS_LOADER_TRANSPORT_SHM`, the message uri shall start with "shm://" instead of "ipc://". ]*/
+TEST_FUNCTION(OutprocessModuleLoader_BuildModuleConfiguration_success_with_shm_transport)
+{
+	//arrange
+	OUTPROCESS_LOADER_ENTRYPOINT ep =
+	{
+		OUTPROCESS_LOADER_ACTIVATION_NONE,
+		STRING_construct("control_id"),
+		STRING_construct("message_id"),
+		0,
+		NULL,
+		0,
+		OUTPROCESS_LOADER_TRANSPORT_SHM
+	};
+	STRING_HANDLE mc = STRING_construct("message config");
+
+	umock_c_reset_all_calls();
+
+	STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(OUTPROCESS_MODULE_CONFIG)));
+	STRICT_EXPECTED_CALL(STRING_c_str(ep.message_id));
+	STRICT_EXPECTED_CALL(STRING_c_str(ep.control_id));
+	STRICT_EXPECTED_CALL(STRING_clone(mc));
+
+	//act
+	void * result = OutprocessModuleLoader_BuildModuleConfiguration(NULL, &ep, mc);
+	OUTPROCESS_MODULE_CONFIG *omc = (OUTPROCESS_MODULE_CONFIG*)result;
+
+	//assert
+	ASSERT_IS_NOT_NULL(result);
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+	ASSERT_ARE_EQUAL(char_ptr, STRING_c_str(omc->control_uri), "ipc://control_id");
+	ASSERT_ARE_EQUAL(char_ptr, STRING_c_str(omc->message_uri), "shm://message_id");
+
+	//cleanup
+	OutprocessModuleLoader_FreeModuleConfiguration(NULL, result);
+	STRING_delete(ep.control_id);
+	STRING_delete(ep.message_id);
+	STRING_delete(mc);
+}
+
+/*Tests_SRS_OUTPROCESS_LOADER_31_014: [ If the entrypoint's message_transport is `OUTPROCESS_LOADER_TRANSPORT_TCP`, both the message uri and the control uri shall start with "tcp://" instead of "ipc://". ]*/
+/*Tests_SRS_OUTPROCESS_LOADER_31_015: [ The module configuration shall carry the entrypoint's tcp_options. ]*/
+TEST_FUNCTION(OutprocessModuleLoader_BuildModuleConfiguration_success_with_tcp_transport)
+{
+	//arrange
+	OUTPROCESS_LOADER_ENTRYPOINT ep =
+	{
+		OUTPROCESS_LOADER_ACTIVATION_NONE,
+		STRING_construct("127.0.0.1:5555"),
+		STRING_construct("127.0.0.1:5556"),
+		0,
+		NULL,
+		0,
+		OUTPROCESS_LOADER_TRANSPORT_TCP,
+		NULL,
+		{ 2000, 30000, 65536, 131072 }
+	};
+	STRING_HANDLE mc = STRING_construct("message config");
+
+	umock_c_reset_all_calls();
+
+	STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(OUTPROCESS_MODULE_CONFIG)));
+	STRICT_EXPECTED_CALL(STRING_c_str(ep.message_id));
+	STRICT_EXPECTED_CALL(STRING_c_str(ep.control_id));
+	STRICT_EXPECTED_CALL(STRING_clone(mc));
+
+	//act
+	void * result = OutprocessModuleLoader_BuildModuleConfiguration(NULL, &ep, mc);
+	OUTPROCESS_MODULE_CONFIG *omc = (OUTPROCESS_MODULE_CONFIG*)result;
+
+	//assert
+	ASSERT_IS_NOT_NULL(result);
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+	ASSERT_ARE_EQUAL(char_ptr, STRING_c_str(omc->control_uri), "tcp://127.0.0.1:5555");
+	ASSERT_ARE_EQUAL(char_ptr, STRING_c_str(omc->message_uri), "tcp://127.0.0.1:5556");
+	ASSERT_ARE_EQUAL(int, 0, (int)omc->message_ring_size);
+	ASSERT_ARE_EQUAL(int, 2000, (int)omc->tcp_options.keepalive_interval);
+	ASSERT_ARE_EQUAL(int, 131072, omc->tcp_options.receive_buffer_size);
+
+	//cleanup
+	OutprocessModuleLoader_FreeModuleConfiguration(NULL, result);
+	STRING_delete(ep.control_id);
+	STRING_delete(ep.message_id);
+	STRING_delete(mc);
+}
+
 /*Tests_SRS_OUTPROCESS_LOADER_17_029: [ If the entrypoint's message_id is NULL, then the loader shall construct an IPC url. ]*/
 /*Tests_SRS_OUTPROCESS_LOADER_17_030: [ The loader shall create a unique id, if needed for URL constrution. ]*/
 /*Tests_SRS_OUTPROCESS_LOADER_17_032: [ The message url shall be composed of "ipc://" + unique id. ]*/
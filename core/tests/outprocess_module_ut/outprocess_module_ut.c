@@ -59,6 +59,7 @@ void my_gballoc_free(void* ptr)
 #include "broker.h"
 #include "module_loader.h"
 #include "message_queue.h"
+#include "shm_ring.h"
 
 #undef ENABLE_MOCKS
 #include "control_message.h"
@@ -136,6 +137,9 @@ MOCK_FUNCTION_END(connect_result)
 MOCK_FUNCTION_WITH_CODE(, int, nn_setsockopt, int, s, int, level, int, option, const void *,optval, size_t, optvallen)
 MOCK_FUNCTION_END(1)
 
+MOCK_FUNCTION_WITH_CODE(, int, nn_shutdown, int, s, int, how)
+MOCK_FUNCTION_END(0)
+
 static bool should_nn_send_fail = false;
 static int current_nn_send_index;
 static int when_shall_nn_send_fail;
@@ -347,6 +351,9 @@ MOCK_FUNCTION_END()
 MOCK_FUNCTION_WITH_CODE(, BROKER_RESULT, Broker_Publish, BROKER_HANDLE, broker, MODULE_HANDLE, source, MESSAGE_HANDLE, message)
 MOCK_FUNCTION_END(BROKER_OK)
 
+MOCK_FUNCTION_WITH_CODE(, void, Broker_ReportAlert, BROKER_HANDLE, broker, BROKER_ALERT, alert, MODULE_HANDLE, module, size_t, value, size_t, threshold)
+MOCK_FUNCTION_END()
+
 BEGIN_TEST_SUITE(OutprocessModule_UnitTests)
 
 TEST_SUITE_INITIALIZE(TestClassInitialize)
@@ -370,8 +377,10 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
 	REGISTER_UMOCK_ALIAS_TYPE(THREAD_HANDLE, void*);
 	REGISTER_UMOCK_ALIAS_TYPE(THREAD_START_FUNC, void*);
 	REGISTER_UMOCK_ALIAS_TYPE(MODULE_API_VERSION, int);
+	REGISTER_UMOCK_ALIAS_TYPE(BROKER_ALERT, int);
 	REGISTER_UMOCK_ALIAS_TYPE(BROKER_RESULT, int);
 	REGISTER_UMOCK_ALIAS_TYPE(THREADAPI_RESULT, int);
+	REGISTER_UMOCK_ALIAS_TYPE(SHM_RING_HANDLE, void*);
 
 	// STRING
 	REGISTER_GLOBAL_MOCK_HOOK(STRING_construct, real_STRING_construct);
@@ -2196,6 +2205,56 @@ TEST_FUNCTION(Outprocess_Create_returns_null_control_connect_fails)
 
 }
 
+/*Tests_SRS_OUTPROCESS_MODULE_31_007: [ This function shall set `NN_SNDBUF`, `NN_RCVBUF` and `NN_RECONNECT_IVL_MAX` on each channel socket, before connecting it, from the non-zero `tcp_options` fields. ]*/
+/*Tests_SRS_OUTPROCESS_MODULE_17_016: [ If any step in the creation fails, this function shall deallocate all resources and return NULL. ]*/
+TEST_FUNCTION(Outprocess_Create_returns_null_control_sockopt_fails)
+{
+	// arrange
+	OUTPROCESS_MODULE_CONFIG config;
+	setup_create_config(&config);
+	config.tcp_options.reconnect_interval_max = 30000;
+	config.tcp_options.send_buffer_size = 65536;
+	config.tcp_options.receive_buffer_size = 65536;
+	const char * real_message_uri = real_STRING_c_str(config.message_uri);
+	STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Lock_Init());
+	STRICT_EXPECTED_CALL(MESSAGE_QUEUE_create())
+		.SetReturn((MESSAGE_QUEUE_HANDLE)0x40);
+	STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR));
+	STRICT_EXPECTED_CALL(nn_setsockopt(1, NN_SOL_SOCKET, NN_SNDBUF, IGNORED_PTR_ARG, sizeof(int)))
+		.IgnoreArgument(4);
+	STRICT_EXPECTED_CALL(nn_setsockopt(1, NN_SOL_SOCKET, NN_RCVBUF, IGNORED_PTR_ARG, sizeof(int)))
+		.IgnoreArgument(4);
+	STRICT_EXPECTED_CALL(nn_setsockopt(1, NN_SOL_SOCKET, NN_RECONNECT_IVL_MAX, IGNORED_PTR_ARG, sizeof(int)))
+		.IgnoreArgument(4);
+	STRICT_EXPECTED_CALL(STRING_c_str(config.message_uri));
+	// assuming the nanomsg mock starts socket at 1
+	STRICT_EXPECTED_CALL(nn_connect(1, real_message_uri));
+	STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR));
+	STRICT_EXPECTED_CALL(nn_setsockopt(2, NN_SOL_SOCKET, NN_SNDBUF, IGNORED_PTR_ARG, sizeof(int)))
+		.IgnoreArgument(4)
+		.SetReturn(-1);
+	STRICT_EXPECTED_CALL(nn_errno());
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(nn_close(1));
+	STRICT_EXPECTED_CALL(nn_close(2));
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(MESSAGE_QUEUE_destroy((MESSAGE_QUEUE_HANDLE)0x40));
+	STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+
+	// act
+	MODULE_HANDLE result = Module_Create((BROKER_HANDLE)0x42, &config);
+
+	// assert
+	ASSERT_IS_NULL(result);
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	// ablution
+	cleanup_create_config(&config);
+}
+
 /*Tests_SRS_OUTPROCESS_MODULE_17_016: [ If any step in the creation fails, this function shall deallocate all resources and return NULL. ]*/
 TEST_FUNCTION(Outprocess_Create_returns_null_control_socket_fails)
 {
@@ -2341,6 +2400,43 @@ TEST_FUNCTION(Outprocess_Create_returns_null_message_socket_fails)
 	cleanup_create_config(&config);
 }
 
+/*Tests_SRS_OUTPROCESS_MODULE_31_001: [ If `message_ring_size` is not zero, this function shall create a shared memory ring of that size named by the message uri, and connect the message socket to `SHM_RING_FALLBACK_URI_HEAD` followed by the name of the ring instead of the message uri. ]*/
+/*Tests_SRS_OUTPROCESS_MODULE_17_016: [ If any step in the creation fails, this function shall deallocate all resources and return NULL. ]*/
+TEST_FUNCTION(Outprocess_Create_returns_null_message_ring_fails)
+{
+	// arrange
+	OUTPROCESS_MODULE_CONFIG config;
+	setup_create_config(&config);
+	config.message_ring_size = 4096;
+	STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Lock_Init());
+	STRICT_EXPECTED_CALL(MESSAGE_QUEUE_create())
+		.SetReturn((MESSAGE_QUEUE_HANDLE)0x40);
+	STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(ShmRing_Create(IGNORED_PTR_ARG, 4096))
+		.IgnoreArgument(1)
+		.SetReturn(NULL);
+
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(MESSAGE_QUEUE_destroy((MESSAGE_QUEUE_HANDLE)0x40));
+	STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+
+	// act
+	MODULE_HANDLE result = Module_Create((BROKER_HANDLE)0x42, &config);
+
+	// assert
+
+	ASSERT_IS_NULL(result);
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	// ablution
+	cleanup_create_config(&config);
+}
+
 /*Tests_SRS_OUTPROCESS_MODULE_17_016: [ If any step in the creation fails, this function shall deallocate all resources and return NULL. ]*/
 TEST_FUNCTION(Outprocess_Create_returns_null_message_queue_fails)
 {
@@ -3492,6 +3588,7 @@ TEST_FUNCTION(Outprocess_control_thread_success)
 /*Tests_SRS_OUTPROCESS_MODULE_17_059 : [If a Module Reply message has been received, and the status indicates the module has failed or has been terminated, this thread shall attempt to restart communications with module host process.]*/
 /*Tests_SRS_OUTPROCESS_MODULE_17_060 : [Once the control channel has been restarted, it shall follow the same process in Outprocess_Create to send a Create Message to the module host.]*/
 /*Tests_SRS_OUTPROCESS_MODULE_24_061: [ Once the control channel has been restarted and Create Message was sent, it shall send a Start Message to the module host. ]*/
+/*Tests_SRS_OUTPROCESS_MODULE_31_011: [ When the thread first finds the module host process detached, it shall report `BROKER_ALERT_MODULE_DETACHED` for this module to the broker. ]*/
 TEST_FUNCTION(Outprocess_control_thread_restart_success)
 {
 	// arrange
@@ -3520,6 +3617,8 @@ TEST_FUNCTION(Outprocess_control_thread_restart_success)
 		.IgnoreAllArguments()
 		.SetReturn((CONTROL_MESSAGE*)&remote_died);
 	STRICT_EXPECTED_CALL(nn_freemsg(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Broker_ReportAlert((BROKER_HANDLE)0x42, BROKER_ALERT_MODULE_DETACHED, IGNORED_PTR_ARG, 0, 0))
+		.IgnoreArgument(3);
 	STRICT_EXPECTED_CALL(ControlMessage_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(ThreadAPI_Sleep(250));
 	// 2nd pass:needs_to_attach is set.
@@ -3591,6 +3690,8 @@ TEST_FUNCTION(Outprocess_control_thread_restart_fails_bad_msg_then_reconnect_fai
 		.IgnoreAllArguments()
 		.SetReturn((CONTROL_MESSAGE*)&remote_died);
 	STRICT_EXPECTED_CALL(nn_freemsg(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Broker_ReportAlert((BROKER_HANDLE)0x42, BROKER_ALERT_MODULE_DETACHED, IGNORED_PTR_ARG, 0, 0))
+		.IgnoreArgument(3);
 	STRICT_EXPECTED_CALL(ControlMessage_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(ThreadAPI_Sleep(250));
 	// 2nd pass:needs_to_attach is set, get bad message.
@@ -3735,6 +3836,69 @@ TEST_FUNCTION(Outprocess_control_thread_dies_nn_recv_unexpected_error)
 	cleanup_create_config(&config);
 }
 
+/*Tests_SRS_OUTPROCESS_MODULE_31_009: [ If `keepalive_interval` is not zero, this thread shall send a Ping Message on the control channel every `keepalive_interval` milliseconds while no control message is received. ]*/
+/*Tests_SRS_OUTPROCESS_MODULE_31_010: [ If no control message has been received for `OUTPROCESS_MODULE_KEEPALIVE_MISSED_MAX` keepalive intervals, this thread shall reconnect the control channel and the message socket, and attempt to restart communications with the module host process. ]*/
+/*Tests_SRS_OUTPROCESS_MODULE_31_011: [ When the thread first finds the module host process detached, it shall report `BROKER_ALERT_MODULE_DETACHED` for this module to the broker. ]*/
+TEST_FUNCTION(Outprocess_control_thread_keepalive_pings_then_reconnects)
+{
+	// arrange
+	global_control_msg.base.type = CONTROL_MESSAGE_TYPE_MODULE_REPLY;
+	global_control_msg.base.version = CONTROL_MESSAGE_VERSION_CURRENT;
+	((CONTROL_MESSAGE_MODULE_REPLY*)&global_control_msg)->status = 0;
+	OUTPROCESS_MODULE_CONFIG config;
+	setup_create_config(&config);
+	config.tcp_options.keepalive_interval = 100;
+
+	MODULE_HANDLE module = Module_Create((BROKER_HANDLE)0x42, &config);
+	Module_Start(module);
+	umock_c_reset_all_calls();
+	should_nn_recv_fail = true;
+
+	//1st pass: idle for one poll, ping the module host
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(nn_recv(2, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT)).IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(nn_errno()).SetReturn(EAGAIN);
+	setup_start_or_destroy_message();
+	STRICT_EXPECTED_CALL(nn_send(2, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT)).IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(ThreadAPI_Sleep(250));
+	//2nd pass: 3 keepalive intervals have passed, reconnect
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(nn_recv(2, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT)).IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(nn_errno()).SetReturn(EAGAIN);
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(nn_shutdown(1, 0));
+	STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(nn_connect(1, IGNORED_PTR_ARG)).IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(nn_shutdown(2, 0));
+	STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(nn_connect(2, IGNORED_PTR_ARG)).IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Broker_ReportAlert((BROKER_HANDLE)0x42, BROKER_ALERT_MODULE_DETACHED, IGNORED_PTR_ARG, 0, 0))
+		.IgnoreArgument(3);
+	STRICT_EXPECTED_CALL(ThreadAPI_Sleep(250));
+	//bail out
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1)
+		.SetReturn(LOCK_ERROR);
+
+	// act
+	//fourth thread created is control message thread
+	thread_func_to_call[4](thread_func_args[4]);
+
+	// assert
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	//ablution
+	should_nn_recv_fail = false;
+	Module_Destroy(module);
+	cleanup_create_config(&config);
+}
+
 TEST_FUNCTION(OutProcess_async_thread_null_input)
 {
 	// arrange
@@ -0,0 +1,55 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <cstddef>
+#include <vector>
+
+#include <parson.h>
+
+/*
+ * A log-linear histogram of latencies in microseconds, laid out as an HDR
+ * histogram with 3 significant digits: every power of two is split into 1024
+ * buckets, so a value is kept with an error below 0.1% and the percentiles
+ * are exact to that precision, however many values are recorded. Values from
+ * 0 to about 19 hours are tracked, larger ones are counted as the largest.
+ */
+class LatencyHistogram
+{
+public:
+    typedef long long value_type;
+    typedef long long count_type;
+
+    LatencyHistogram();
+
+    void add(value_type value);
+    void add(value_type value, count_type count);
+    void merge(const LatencyHistogram& other);
+
+    count_type getCount() const;
+    value_type getMin() const;
+    value_type getMax() const;
+    double getMean() const;
+    /* the value not exceeded by percentile % of the values, percentile being from 0 to 100 */
+    value_type getValueAtPercentile(double percentile) const;
+
+    /* returns an object with the count, min, max, mean, the usual percentiles and the non-empty buckets */
+    JSON_Value* toJson() const;
+    /* adds the buckets of an object returned by toJson, returns false if they cannot be read */
+    bool mergeJson(const JSON_Object* histogram);
+
+private:
+    static size_t indexOf(value_type value);
+    static value_type lowestValueAt(size_t index);
+    static value_type highestValueAt(size_t index);
+
+    std::vector<count_type> counts;
+    count_type total_count;
+    value_type min_value;
+    value_type max_value;
+    double sum;
+};
+
+#endif /*LATENCY_HISTOGRAM_H*/
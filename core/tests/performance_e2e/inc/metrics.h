@@ -4,6 +4,7 @@
 #ifndef METRICS_H
 #define METRICS_H
 
+#include <stdbool.h>
 #include "module.h"
 
 #ifdef __cplusplus
@@ -11,6 +12,13 @@ extern "C"
 {
 #endif
 
+typedef struct METRICS_MODULE_CONFIG_TAG
+{
+    char * results_file;
+    bool forward;
+} METRICS_MODULE_CONFIG;
+
+
 MODULE_EXPORT const MODULE_API* MODULE_STATIC_GETAPI(METRICS_MODULE)(MODULE_API_VERSION gateway_api_version);
 
 #ifdef __cplusplus
@@ -18,6 +18,7 @@ typedef struct SIMULATOR_MODULE_CONFIG_TAG
     size_t properties_count;
     size_t properties_size;
     size_t message_size;
+    size_t create_delay;
 } SIMULATOR_MODULE_CONFIG;
 
 
@@ -0,0 +1,686 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <parson.h>
+
+#include "gateway.h"
+#include "module_loaders/builtin_loader.h"
+#include "azure_c_shared_utility/threadapi.h"
+
+#include "simulator.h"
+#include "metrics.h"
+#include "latency_histogram.h"
+
+/*
+ * Runs a matrix of gateway configurations, each for a fixed duration, and
+ * writes the throughput and latency percentiles of every configuration to a
+ * JSON results file. Two results files can then be compared.
+ *
+ * Every configuration has "publishers" simulator modules linked to a chain of
+ * "chain.depth" - 1 metrics modules passing the messages on, whose last one is
+ * linked to "fanout" metrics modules measuring them, in this process or each
+ * in a process of its own.
+ */
+
+#define BENCHMARK_RESULTS_VERSION 1
+#define DEFAULT_DURATION_SECONDS 5
+#define DEFAULT_TOLERANCE_PERCENT 10.0
+
+#define SIMULATOR_BUILTIN_NAME "simulator"
+#define METRICS_BUILTIN_NAME "metrics"
+
+#define SINK_INPROC "inproc"
+#define SINK_OUTPROCESS "outprocess"
+
+typedef enum BENCHMARK_AXIS_TAG
+{
+    AXIS_MESSAGE_SIZE,
+    AXIS_PROPERTIES_COUNT,
+    AXIS_PROPERTIES_SIZE,
+    AXIS_FANOUT,
+    AXIS_CHAIN_DEPTH,
+    AXIS_PUBLISHERS,
+    AXIS_SINK,
+    AXIS_COUNT
+} BENCHMARK_AXIS;
+
+static const char* AXIS_NAMES[AXIS_COUNT] =
+{
+    "message.size",
+    "properties.count",
+    "properties.size",
+    "fanout",
+    "chain.depth",
+    "publishers",
+    "sink"
+};
+
+/*the value of an axis missing from the matrix, the sink being 0 for in process and 1 for out of process*/
+static const size_t AXIS_DEFAULTS[AXIS_COUNT] = { 256, 2, 16, 1, 1, 1, 0 };
+
+typedef std::vector<size_t> BenchmarkCell;
+
+typedef struct BENCHMARK_SETTINGS_TAG
+{
+    size_t duration_seconds;
+    size_t message_delay;
+    bool full;
+    std::vector<size_t> axes[AXIS_COUNT];
+} BENCHMARK_SETTINGS;
+
+static std::string axis_value_string(size_t axis, size_t value)
+{
+    std::string result;
+    if (axis == AXIS_SINK)
+    {
+        result = (value == 0) ? SINK_INPROC : SINK_OUTPROCESS;
+    }
+    else
+    {
+        result = std::to_string(value);
+    }
+    return result;
+}
+
+static std::string cell_name(const BenchmarkCell& cell)
+{
+    std::ostringstream name;
+    for (size_t axis = 0; axis < AXIS_COUNT; axis++)
+    {
+        if (axis != 0)
+        {
+            name << ",";
+        }
+        name << AXIS_NAMES[axis] << "=" << axis_value_string(axis, cell[axis]);
+    }
+    return name.str();
+}
+
+static bool read_axis(const JSON_Object* matrix, size_t axis, std::vector<size_t>& values)
+{
+    bool result = true;
+    JSON_Array* array = json_object_get_array(matrix, AXIS_NAMES[axis]);
+    if (array == NULL)
+    {
+        if (json_object_get_value(matrix, AXIS_NAMES[axis]) != NULL)
+        {
+            std::cerr << "\"" << AXIS_NAMES[axis] << "\" is not an array" << std::endl;
+            result = false;
+        }
+        else
+        {
+            values.push_back(AXIS_DEFAULTS[axis]);
+        }
+    }
+    else
+    {
+        size_t count = json_array_get_count(array);
+        for (size_t i = 0; i < count && result; i++)
+        {
+            if (axis == AXIS_SINK)
+            {
+                const char* sink = json_array_get_string(array, i);
+                if (sink != NULL && strcmp(sink, SINK_INPROC) == 0)
+                {
+                    values.push_back(0);
+                }
+                else if (sink != NULL && strcmp(sink, SINK_OUTPROCESS) == 0)
+                {
+                    values.push_back(1);
+                }
+                else
+                {
+                    std::cerr << "\"sink\" values are \"" SINK_INPROC "\" or \"" SINK_OUTPROCESS "\"" << std::endl;
+                    result = false;
+                }
+            }
+            else
+            {
+                double value = json_array_get_number(array, i);
+                if (value < 1 || value != (double)(size_t)value)
+                {
+                    std::cerr << "\"" << AXIS_NAMES[axis] << "\" values are whole numbers from 1" << std::endl;
+                    result = false;
+                }
+                else
+                {
+                    values.push_back((size_t)value);
+                }
+            }
+        }
+        if (result && values.empty())
+        {
+            std::cerr << "\"" << AXIS_NAMES[axis] << "\" has no values" << std::endl;
+            result = false;
+        }
+    }
+    return result;
+}
+
+static bool read_settings(const char* matrix_file, BENCHMARK_SETTINGS& settings)
+{
+    bool result;
+    JSON_Value* json = json_parse_file(matrix_file);
+    JSON_Object* root = json_value_get_object(json);
+    if (root == NULL)
+    {
+        std::cerr << "unable to read the matrix file " << matrix_file << std::endl;
+        result = false;
+    }
+    else
+    {
+        const char* mode = json_object_get_string(root, "mode");
+        double duration = json_object_get_number(root, "duration");
+        double delay = json_object_get_number(root, "message.delay");
+        settings.duration_seconds = (duration >= 1) ? (size_t)duration : DEFAULT_DURATION_SECONDS;
+        settings.message_delay = (delay > 0) ? (size_t)delay : 0;
+        settings.full = (mode != NULL) && (strcmp(mode, "full") == 0);
+        if (mode != NULL && !settings.full && strcmp(mode, "sweep") != 0)
+        {
+            std::cerr << "\"mode\" is \"sweep\" or \"full\"" << std::endl;
+            result = false;
+        }
+        else
+        {
+            JSON_Object* matrix = json_object_get_object(root, "matrix");
+            result = true;
+            for (size_t axis = 0; axis < AXIS_COUNT && result; axis++)
+            {
+                result = read_axis(matrix, axis, settings.axes[axis]);
+            }
+        }
+    }
+    json_value_free(json);
+    return result;
+}
+
+static std::vector<BenchmarkCell> make_cells(const BENCHMARK_SETTINGS& settings)
+{
+    std::vector<BenchmarkCell> cells;
+    BenchmarkCell baseline(AXIS_COUNT);
+    for (size_t axis = 0; axis < AXIS_COUNT; axis++)
+    {
+        baseline[axis] = settings.axes[axis][0];
+    }
+
+    if (settings.full)
+    {
+        /*every combination, the last axis changing fastest*/
+        std::vector<size_t> position(AXIS_COUNT, 0);
+        bool done = false;
+        while (!done)
+        {
+            BenchmarkCell cell(AXIS_COUNT);
+            for (size_t axis = 0; axis < AXIS_COUNT; axis++)
+            {
+                cell[axis] = settings.axes[axis][position[axis]];
+            }
+            cells.push_back(cell);
+
+            done = true;
+            for (size_t axis = AXIS_COUNT; axis-- > 0;)
+            {
+                if (++position[axis] < settings.axes[axis].size())
+                {
+                    done = false;
+                    break;
+                }
+                position[axis] = 0;
+            }
+        }
+    }
+    else
+    {
+        /*the first value of every axis is the baseline, every other value is run with the baseline of the other axes*/
+        cells.push_back(baseline);
+        for (size_t axis = 0; axis < AXIS_COUNT; axis++)
+        {
+            for (size_t i = 1; i < settings.axes[axis].size(); i++)
+            {
+                BenchmarkCell cell(baseline);
+                cell[axis] = settings.axes[axis][i];
+                cells.push_back(cell);
+            }
+        }
+    }
+    return cells;
+}
+
+static JSON_Value* builtin_loader(const char* module_name)
+{
+    std::ostringstream loader;
+    loader << "{ \"name\": \"" BUILTIN_LOADER_NAME "\", \"entrypoint\": { \"module.name\": \"" << module_name << "\" } }";
+    return json_parse_string(loader.str().c_str());
+}
+
+static JSON_Value* outprocess_loader(const std::string& control_id)
+{
+#ifdef PERFORMANCE_SINK_HOST_PATH
+    std::ostringstream loader;
+    loader
+        << "{ \"name\": \"outprocess\", \"entrypoint\": {"
+        << " \"activation.type\": \"launch\", \"control.id\": \"" << control_id << "\","
+        << " \"launch\": { \"path\": \"" PERFORMANCE_SINK_HOST_PATH "\", \"args\": [ \"" << control_id << "\" ] } } }";
+    return json_parse_string(loader.str().c_str());
+#else
+    (void)control_id;
+    return NULL;
+#endif
+}
+
+static bool add_module(JSON_Array* modules, const std::string& name, JSON_Value* loader, JSON_Value* args)
+{
+    bool result;
+    JSON_Value* module = json_value_init_object();
+    if (module == NULL || loader == NULL || args == NULL)
+    {
+        json_value_free(module);
+        json_value_free(loader);
+        json_value_free(args);
+        result = false;
+    }
+    else
+    {
+        JSON_Object* module_object = json_value_get_object(module);
+        if (json_object_set_string(module_object, "name", name.c_str()) != JSONSuccess ||
+            json_object_set_value(module_object, "loader", loader) != JSONSuccess)
+        {
+            json_value_free(loader);
+            json_value_free(args);
+            json_value_free(module);
+            result = false;
+        }
+        else if (json_object_set_value(module_object, "args", args) != JSONSuccess)
+        {
+            json_value_free(args);
+            json_value_free(module);
+            result = false;
+        }
+        else if (json_array_append_value(modules, module) != JSONSuccess)
+        {
+            json_value_free(module);
+            result = false;
+        }
+        else
+        {
+            result = true;
+        }
+    }
+    return result;
+}
+
+static bool add_link(JSON_Array* links, const std::string& source, const std::string& sink)
+{
+    std::string link = "{ \"source\": \"" + source + "\", \"sink\": \"" + sink + "\" }";
+    JSON_Value* link_value = json_parse_string(link.c_str());
+    bool result = (link_value != NULL) && (json_array_append_value(links, link_value) == JSONSuccess);
+    if (!result)
+    {
+        json_value_free(link_value);
+    }
+    return result;
+}
+
+static JSON_Value* make_gateway_json(const BENCHMARK_SETTINGS& settings, const BenchmarkCell& cell, const std::string& prefix, const std::vector<std::string>& sink_files)
+{
+    JSON_Value* result = json_parse_string("{ \"modules\": [], \"links\": [] }");
+    if (result != NULL)
+    {
+        JSON_Array* modules = json_object_get_array(json_value_get_object(result), "modules");
+        JSON_Array* links = json_object_get_array(json_value_get_object(result), "links");
+        bool ok = true;
+
+        std::vector<std::string> publishers;
+        for (size_t p = 1; p <= cell[AXIS_PUBLISHERS] && ok; p++)
+        {
+            std::ostringstream args;
+            args
+                << "{ \"deviceId\": \"device" << p << "\","
+                << " \"message.delay\": " << settings.message_delay << ","
+                << " \"message.size\": " << cell[AXIS_MESSAGE_SIZE] << ","
+                << " \"properties.count\": " << cell[AXIS_PROPERTIES_COUNT] << ","
+                << " \"properties.size\": " << cell[AXIS_PROPERTIES_SIZE] << " }";
+            publishers.push_back("publisher" + std::to_string(p));
+            ok = add_module(modules, publishers.back(), builtin_loader(SIMULATOR_BUILTIN_NAME), json_parse_string(args.str().c_str()));
+        }
+
+        /*the publishers publish to the first relay, every relay to the next one, and the last one to the sinks*/
+        std::vector<std::string> sources(publishers);
+        for (size_t r = 1; r < cell[AXIS_CHAIN_DEPTH] && ok; r++)
+        {
+            std::string relay = "relay" + std::to_string(r);
+            ok = add_module(modules, relay, builtin_loader(METRICS_BUILTIN_NAME), json_parse_string("{ \"forward\": true }"));
+            for (size_t s = 0; s < sources.size() && ok; s++)
+            {
+                ok = add_link(links, sources[s], relay);
+            }
+            sources.assign(1, relay);
+        }
+
+        for (size_t k = 0; k < sink_files.size() && ok; k++)
+        {
+            std::string sink = "sink" + std::to_string(k + 1);
+            JSON_Value* args = json_value_init_object();
+            if (args != NULL && json_object_set_string(json_value_get_object(args), "results.file", sink_files[k].c_str()) != JSONSuccess)
+            {
+                json_value_free(args);
+                args = NULL;
+            }
+            JSON_Value* loader = (cell[AXIS_SINK] == 0) ?
+                builtin_loader(METRICS_BUILTIN_NAME) :
+                outprocess_loader(prefix.substr(prefix.find_last_of("/\\") + 1) + "_" + sink);
+            ok = add_module(modules, sink, loader, args);
+            for (size_t s = 0; s < sources.size() && ok; s++)
+            {
+                ok = add_link(links, sources[s], sink);
+            }
+        }
+
+        if (!ok)
+        {
+            json_value_free(result);
+            result = NULL;
+        }
+    }
+    return result;
+}
+
+static JSON_Value* run_cell(const BENCHMARK_SETTINGS& settings, const BenchmarkCell& cell, const std::string& prefix)
+{
+    JSON_Value* result = json_value_init_object();
+    if (result != NULL)
+    {
+        JSON_Object* result_object = json_value_get_object(result);
+        JSON_Value* parameters = json_value_init_object();
+        for (size_t axis = 0; axis < AXIS_COUNT && parameters != NULL; axis++)
+        {
+            if (axis == AXIS_SINK)
+            {
+                (void)json_object_set_string(json_value_get_object(parameters), AXIS_NAMES[axis], axis_value_string(axis, cell[axis]).c_str());
+            }
+            else
+            {
+                (void)json_object_set_number(json_value_get_object(parameters), AXIS_NAMES[axis], (double)cell[axis]);
+            }
+        }
+        (void)json_object_set_string(result_object, "name", cell_name(cell).c_str());
+        if (parameters != NULL && json_object_set_value(result_object, "parameters", parameters) != JSONSuccess)
+        {
+            json_value_free(parameters);
+        }
+
+        std::vector<std::string> sink_files;
+        for (size_t k = 1; k <= cell[AXIS_FANOUT]; k++)
+        {
+            sink_files.push_back(prefix + ".sink" + std::to_string(k) + ".json");
+            (void)remove(sink_files.back().c_str());
+        }
+
+        std::string gateway_file = prefix + ".gateway.json";
+        JSON_Value* gateway_json = make_gateway_json(settings, cell, prefix, sink_files);
+        GATEWAY_HANDLE gateway;
+        if (gateway_json == NULL)
+        {
+            (void)json_object_set_string(result_object, "error", (cell[AXIS_SINK] == 0) ?
+                "unable to build the gateway configuration" :
+                "unable to build the gateway configuration, out of process sinks may not be built");
+        }
+        else if (json_serialize_to_file_pretty(gateway_json, gateway_file.c_str()) != JSONSuccess)
+        {
+            (void)json_object_set_string(result_object, "error", "unable to write the gateway configuration");
+        }
+        else if ((gateway = Gateway_CreateFromJson(gateway_file.c_str())) == NULL)
+        {
+            (void)json_object_set_string(result_object, "error", "unable to create the gateway");
+        }
+        else
+        {
+            ThreadAPI_Sleep((unsigned int)(settings.duration_seconds * 1000));
+            Gateway_Destroy(gateway);
+
+            LatencyHistogram latency;
+            double messages = 0, non_conforming = 0, out_of_sequence = 0, lost = 0, duration_sum = 0;
+            size_t reporting = 0;
+            for (size_t k = 0; k < sink_files.size(); k++)
+            {
+                JSON_Value* sink_json = json_parse_file(sink_files[k].c_str());
+                JSON_Object* sink = json_value_get_object(sink_json);
+                if (sink != NULL && latency.mergeJson(json_object_get_object(sink, "latencyMicroseconds")))
+                {
+                    messages += json_object_get_number(sink, "messages");
+                    non_conforming += json_object_get_number(sink, "nonConforming");
+                    out_of_sequence += json_object_get_number(sink, "outOfSequence");
+                    lost += json_object_get_number(sink, "lost");
+                    duration_sum += json_object_get_number(sink, "durationMicroseconds");
+                    reporting++;
+                }
+                json_value_free(sink_json);
+                (void)remove(sink_files[k].c_str());
+            }
+
+            /*the rates are those of the sinks, each sink counting the time from its start to its destruction*/
+            double messages_per_second = (duration_sum > 0) ? (messages * reporting * 1000000.0 / duration_sum) : 0;
+            (void)json_object_set_number(result_object, "sinksReporting", (double)reporting);
+            (void)json_object_set_number(result_object, "messages", messages);
+            (void)json_object_set_number(result_object, "messagesPerSecond", messages_per_second);
+            (void)json_object_set_number(result_object, "publishedPerSecond", messages_per_second / (double)cell[AXIS_FANOUT]);
+            (void)json_object_set_number(result_object, "bytesPerSecond", messages_per_second * (double)cell[AXIS_MESSAGE_SIZE]);
+            (void)json_object_set_number(result_object, "nonConforming", non_conforming);
+            (void)json_object_set_number(result_object, "outOfSequence", out_of_sequence);
+            (void)json_object_set_number(result_object, "lost", lost);
+
+            JSON_Value* latency_json = latency.toJson();
+            if (latency_json != NULL)
+            {
+                (void)json_object_remove(json_value_get_object(latency_json), "buckets");
+                if (json_object_set_value(result_object, "latencyMicroseconds", latency_json) != JSONSuccess)
+                {
+                    json_value_free(latency_json);
+                }
+            }
+            if (reporting != sink_files.size())
+            {
+                (void)json_object_set_string(result_object, "error", "some sinks did not report their results");
+            }
+        }
+        json_value_free(gateway_json);
+        (void)remove(gateway_file.c_str());
+    }
+    return result;
+}
+
+static double latency_of(const JSON_Object* cell, const char* percentile)
+{
+    /*not json_object_dotget_number, "p99.9" has a dot*/
+    return json_object_get_number(json_object_get_object(cell, "latencyMicroseconds"), percentile);
+}
+
+static int run_matrix(const char* matrix_file, const char* results_file, const char* filter)
+{
+    int result;
+    BENCHMARK_SETTINGS settings;
+    if (!read_settings(matrix_file, settings))
+    {
+        result = 1;
+    }
+    else if (BuiltinLoader_RegisterModule(SIMULATOR_BUILTIN_NAME, MODULE_STATIC_GETAPI(SIMULATOR_MODULE)) != MODULE_LOADER_SUCCESS)
+    {
+        std::cerr << "unable to register the simulator module" << std::endl;
+        result = 1;
+    }
+    else
+    {
+        if (BuiltinLoader_RegisterModule(METRICS_BUILTIN_NAME, MODULE_STATIC_GETAPI(METRICS_MODULE)) != MODULE_LOADER_SUCCESS)
+        {
+            std::cerr << "unable to register the metrics module" << std::endl;
+            result = 1;
+        }
+        else
+        {
+            JSON_Value* results = json_value_init_object();
+            JSON_Value* cell_results = json_value_init_array();
+            if (results == NULL || cell_results == NULL ||
+                json_object_set_number(json_value_get_object(results), "version", BENCHMARK_RESULTS_VERSION) != JSONSuccess ||
+                json_object_set_string(json_value_get_object(results), "matrix", matrix_file) != JSONSuccess ||
+                json_object_set_number(json_value_get_object(results), "durationSeconds", (double)settings.duration_seconds) != JSONSuccess ||
+                json_object_set_number(json_value_get_object(results), "messageDelayMilliseconds", (double)settings.message_delay) != JSONSuccess ||
+                json_object_set_value(json_value_get_object(results), "results", cell_results) != JSONSuccess)
+            {
+                std::cerr << "unable to build the results" << std::endl;
+                json_value_free(cell_results);
+                result = 1;
+            }
+            else
+            {
+                std::vector<BenchmarkCell> cells = make_cells(settings);
+                result = 0;
+                for (size_t c = 0; c < cells.size(); c++)
+                {
+                    std::string name = cell_name(cells[c]);
+                    if (filter == NULL || name.find(filter) != std::string::npos)
+                    {
+                        std::cout << "[" << (c + 1) << "/" << cells.size() << "] " << name << std::endl;
+                        JSON_Value* cell_result = run_cell(settings, cells[c], std::string(results_file) + "." + std::to_string(c + 1));
+                        if (cell_result == NULL || json_array_append_value(json_value_get_array(cell_results), cell_result) != JSONSuccess)
+                        {
+                            std::cerr << "unable to keep the results of " << name << std::endl;
+                            json_value_free(cell_result);
+                            result = 1;
+                        }
+                        else
+                        {
+                            JSON_Object* cell_object = json_value_get_object(cell_result);
+                            const char* error = json_object_get_string(cell_object, "error");
+                            if (error != NULL)
+                            {
+                                std::cerr << "    " << error << std::endl;
+                                result = 1;
+                            }
+                            std::cout
+                                << "    messages/s: " << (long long)json_object_get_number(cell_object, "messagesPerSecond")
+                                << ", p50: " << (long long)latency_of(cell_object, "p50")
+                                << " us, p99: " << (long long)latency_of(cell_object, "p99")
+                                << " us, max: " << (long long)latency_of(cell_object, "max") << " us" << std::endl;
+                        }
+                    }
+                }
+
+                if (json_serialize_to_file_pretty(results, results_file) != JSONSuccess)
+                {
+                    std::cerr << "unable to write the results to " << results_file << std::endl;
+                    result = 1;
+                }
+            }
+            json_value_free(results);
+            BuiltinLoader_UnregisterModule(METRICS_BUILTIN_NAME);
+        }
+        BuiltinLoader_UnregisterModule(SIMULATOR_BUILTIN_NAME);
+    }
+    return result;
+}
+
+static double change_percent(double baseline, double value)
+{
+    return (baseline > 0) ? ((value - baseline) * 100.0 / baseline) : 0;
+}
+
+static int compare_results(const char* baseline_file, const char* results_file, double tolerance)
+{
+    int result;
+    JSON_Value* baseline_json = json_parse_file(baseline_file);
+    JSON_Value* results_json = json_parse_file(results_file);
+    JSON_Array* baseline = json_object_get_array(json_value_get_object(baseline_json), "results");
+    JSON_Array* results = json_object_get_array(json_value_get_object(results_json), "results");
+    if (baseline == NULL || results == NULL)
+    {
+        std::cerr << "unable to read the results in " << ((baseline == NULL) ? baseline_file : results_file) << std::endl;
+        result = 1;
+    }
+    else
+    {
+        std::map<std::string, JSON_Object*> baseline_cells;
+        for (size_t i = 0; i < json_array_get_count(baseline); i++)
+        {
+            JSON_Object* cell = json_array_get_object(baseline, i);
+            const char* name = json_object_get_string(cell, "name");
+            if (name != NULL)
+            {
+                baseline_cells[name] = cell;
+            }
+        }
+
+        size_t regressions = 0;
+        for (size_t i = 0; i < json_array_get_count(results); i++)
+        {
+            JSON_Object* cell = json_array_get_object(results, i);
+            const char* name = json_object_get_string(cell, "name");
+            std::map<std::string, JSON_Object*>::iterator base = (name == NULL) ? baseline_cells.end() : baseline_cells.find(name);
+            if (base == baseline_cells.end())
+            {
+                std::cout << ((name == NULL) ? "(unnamed)" : name) << ": not in the baseline" << std::endl;
+            }
+            else
+            {
+                /*a regression is less throughput, or a higher 99th percentile latency, beyond the tolerance*/
+                double throughput = change_percent(json_object_get_number(base->second, "messagesPerSecond"), json_object_get_number(cell, "messagesPerSecond"));
+                double p50 = change_percent(latency_of(base->second, "p50"), latency_of(cell, "p50"));
+                double p99 = change_percent(latency_of(base->second, "p99"), latency_of(cell, "p99"));
+                double p999 = change_percent(latency_of(base->second, "p99.9"), latency_of(cell, "p99.9"));
+                bool regressed = (throughput < -tolerance) || (p99 > tolerance) || (json_object_get_string(cell, "error") != NULL);
+                char line[256];
+                (void)snprintf(line, sizeof(line), "    messages/s %+.1f%%, p50 %+.1f%%, p99 %+.1f%%, p99.9 %+.1f%%%s",
+                    throughput, p50, p99, p999, regressed ? "  REGRESSION" : "");
+                std::cout << name << std::endl << line << std::endl;
+                if (regressed)
+                {
+                    regressions++;
+                }
+                baseline_cells.erase(base);
+            }
+        }
+
+        for (std::map<std::string, JSON_Object*>::iterator missing = baseline_cells.begin(); missing != baseline_cells.end(); missing++)
+        {
+            std::cout << missing->first << ": not in the results" << std::endl;
+        }
+
+        std::cout << regressions << " regression(s) beyond " << tolerance << "%" << std::endl;
+        result = (regressions == 0) ? 0 : 1;
+    }
+    json_value_free(baseline_json);
+    json_value_free(results_json);
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    int result;
+    if (argc >= 4 && argc <= 5 && strcmp(argv[1], "run") == 0)
+    {
+        result = run_matrix(argv[2], argv[3], (argc == 5) ? argv[4] : NULL);
+    }
+    else if (argc >= 4 && argc <= 5 && strcmp(argv[1], "compare") == 0)
+    {
+        result = compare_results(argv[2], argv[3], (argc == 5) ? atof(argv[4]) : DEFAULT_TOLERANCE_PERCENT);
+    }
+    else
+    {
+        std::cout
+            << "usage: performance_benchmark run matrixFile resultsFile [filter]" << std::endl
+            << "       performance_benchmark compare baselineFile resultsFile [tolerance]" << std::endl
+            << "where matrixFile is the name of the file that contains the benchmark matrix" << std::endl
+            << "where filter runs only the configurations whose name contains it, as in \"sink=outprocess\"" << std::endl
+            << "where tolerance is the change in percent beyond which a result is a regression (default 10)" << std::endl;
+        result = 1;
+    }
+    return result;
+}
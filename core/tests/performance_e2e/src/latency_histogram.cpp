@@ -0,0 +1,273 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <cmath>
+
+#include "latency_histogram.h"
+
+#define SUB_BUCKET_HALF_COUNT_MAGNITUDE 10
+#define SUB_BUCKET_HALF_COUNT ((size_t)1 << SUB_BUCKET_HALF_COUNT_MAGNITUDE)
+#define SUB_BUCKET_COUNT (SUB_BUCKET_HALF_COUNT * 2)
+#define HIGHEST_TRACKABLE_MAGNITUDE 36
+#define HIGHEST_TRACKABLE_VALUE ((((LatencyHistogram::value_type)1) << HIGHEST_TRACKABLE_MAGNITUDE) - 1)
+/*one half bucket for every power of two above the first full bucket, plus the first full bucket*/
+#define COUNTS_LENGTH ((size_t)(HIGHEST_TRACKABLE_MAGNITUDE - SUB_BUCKET_HALF_COUNT_MAGNITUDE + 1) * SUB_BUCKET_HALF_COUNT)
+
+static const double REPORTED_PERCENTILES[] = { 50.0, 90.0, 99.0, 99.9, 99.99 };
+static const char* REPORTED_PERCENTILE_NAMES[] = { "p50", "p90", "p99", "p99.9", "p99.99" };
+
+LatencyHistogram::LatencyHistogram() : counts(COUNTS_LENGTH, 0), total_count(0), min_value(0), max_value(0), sum(0)
+{
+}
+
+size_t LatencyHistogram::indexOf(value_type value)
+{
+    /*the values below SUB_BUCKET_COUNT have a bucket each, above every power of two has SUB_BUCKET_HALF_COUNT buckets*/
+    unsigned int bucket = 0;
+    for (unsigned long long high_bits = ((unsigned long long)value) >> (SUB_BUCKET_HALF_COUNT_MAGNITUDE + 1); high_bits != 0; high_bits >>= 1)
+    {
+        bucket++;
+    }
+    size_t sub_bucket = (size_t)(value >> bucket);
+    return (((size_t)bucket + 1) << SUB_BUCKET_HALF_COUNT_MAGNITUDE) + sub_bucket - SUB_BUCKET_HALF_COUNT;
+}
+
+LatencyHistogram::value_type LatencyHistogram::lowestValueAt(size_t index)
+{
+    long bucket = (long)(index >> SUB_BUCKET_HALF_COUNT_MAGNITUDE) - 1;
+    size_t sub_bucket = (index & (SUB_BUCKET_HALF_COUNT - 1)) + SUB_BUCKET_HALF_COUNT;
+    if (bucket < 0)
+    {
+        sub_bucket -= SUB_BUCKET_HALF_COUNT;
+        bucket = 0;
+    }
+    return ((value_type)sub_bucket) << bucket;
+}
+
+LatencyHistogram::value_type LatencyHistogram::highestValueAt(size_t index)
+{
+    long bucket = (long)(index >> SUB_BUCKET_HALF_COUNT_MAGNITUDE) - 1;
+    if (bucket < 0)
+    {
+        bucket = 0;
+    }
+    return lowestValueAt(index) + (((value_type)1) << bucket) - 1;
+}
+
+void LatencyHistogram::add(value_type value)
+{
+    this->add(value, 1);
+}
+
+void LatencyHistogram::add(value_type value, count_type count)
+{
+    if (count > 0)
+    {
+        if (value < 0)
+        {
+            /*clocks of different threads may be a little apart*/
+            value = 0;
+        }
+        else if (value > HIGHEST_TRACKABLE_VALUE)
+        {
+            value = HIGHEST_TRACKABLE_VALUE;
+        }
+
+        this->counts[indexOf(value)] += count;
+        if (this->total_count == 0 || value < this->min_value)
+        {
+            this->min_value = value;
+        }
+        if (value > this->max_value)
+        {
+            this->max_value = value;
+        }
+        this->total_count += count;
+        this->sum += (double)value * (double)count;
+    }
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+    if (other.total_count > 0)
+    {
+        for (size_t i = 0; i < COUNTS_LENGTH; i++)
+        {
+            this->counts[i] += other.counts[i];
+        }
+        if (this->total_count == 0 || other.min_value < this->min_value)
+        {
+            this->min_value = other.min_value;
+        }
+        if (other.max_value > this->max_value)
+        {
+            this->max_value = other.max_value;
+        }
+        this->total_count += other.total_count;
+        this->sum += other.sum;
+    }
+}
+
+LatencyHistogram::count_type LatencyHistogram::getCount() const
+{
+    return this->total_count;
+}
+
+LatencyHistogram::value_type LatencyHistogram::getMin() const
+{
+    return this->min_value;
+}
+
+LatencyHistogram::value_type LatencyHistogram::getMax() const
+{
+    return this->max_value;
+}
+
+double LatencyHistogram::getMean() const
+{
+    double mean(0);
+    if (this->total_count != 0)
+    {
+        mean = this->sum / (double)this->total_count;
+    }
+    return mean;
+}
+
+LatencyHistogram::value_type LatencyHistogram::getValueAtPercentile(double percentile) const
+{
+    value_type result(0);
+    if (this->total_count != 0)
+    {
+        if (percentile > 100.0)
+        {
+            percentile = 100.0;
+        }
+        count_type wanted = (count_type)std::ceil((percentile / 100.0) * (double)this->total_count);
+        if (wanted < 1)
+        {
+            wanted = 1;
+        }
+
+        count_type seen = 0;
+        for (size_t i = 0; i < COUNTS_LENGTH; i++)
+        {
+            seen += this->counts[i];
+            if (seen >= wanted)
+            {
+                result = highestValueAt(i);
+                break;
+            }
+        }
+        if (result > this->max_value)
+        {
+            result = this->max_value;
+        }
+        else if (result < this->min_value)
+        {
+            result = this->min_value;
+        }
+    }
+    return result;
+}
+
+JSON_Value* LatencyHistogram::toJson() const
+{
+    JSON_Value* result = json_value_init_object();
+    JSON_Value* buckets = json_value_init_array();
+    if (result == NULL || buckets == NULL)
+    {
+        json_value_free(result);
+        json_value_free(buckets);
+        result = NULL;
+    }
+    else
+    {
+        JSON_Object* histogram = json_value_get_object(result);
+        bool failed = false;
+        for (size_t i = 0; i < COUNTS_LENGTH && !failed; i++)
+        {
+            if (this->counts[i] != 0)
+            {
+                /*a bucket is kept as [its lowest value, its count], adding the lowest value again finds the same bucket*/
+                JSON_Value* bucket = json_value_init_array();
+                if (bucket == NULL ||
+                    json_array_append_number(json_value_get_array(bucket), (double)lowestValueAt(i)) != JSONSuccess ||
+                    json_array_append_number(json_value_get_array(bucket), (double)this->counts[i]) != JSONSuccess ||
+                    json_array_append_value(json_value_get_array(buckets), bucket) != JSONSuccess)
+                {
+                    json_value_free(bucket);
+                    failed = true;
+                }
+            }
+        }
+
+        if (failed ||
+            json_object_set_number(histogram, "count", (double)this->total_count) != JSONSuccess ||
+            json_object_set_number(histogram, "min", (double)this->min_value) != JSONSuccess ||
+            json_object_set_number(histogram, "max", (double)this->max_value) != JSONSuccess ||
+            json_object_set_number(histogram, "mean", this->getMean()) != JSONSuccess)
+        {
+            json_value_free(buckets);
+            json_value_free(result);
+            result = NULL;
+        }
+        else
+        {
+            for (size_t p = 0; p < sizeof(REPORTED_PERCENTILES) / sizeof(REPORTED_PERCENTILES[0]); p++)
+            {
+                if (json_object_set_number(histogram, REPORTED_PERCENTILE_NAMES[p], (double)this->getValueAtPercentile(REPORTED_PERCENTILES[p])) != JSONSuccess)
+                {
+                    failed = true;
+                    break;
+                }
+            }
+
+            if (failed || json_object_set_value(histogram, "buckets", buckets) != JSONSuccess)
+            {
+                json_value_free(buckets);
+                json_value_free(result);
+                result = NULL;
+            }
+        }
+    }
+    return result;
+}
+
+bool LatencyHistogram::mergeJson(const JSON_Object* histogram)
+{
+    bool result;
+    JSON_Array* buckets = json_object_get_array(histogram, "buckets");
+    if (buckets == NULL)
+    {
+        result = false;
+    }
+    else
+    {
+        LatencyHistogram read;
+        result = true;
+        size_t bucket_count = json_array_get_count(buckets);
+        for (size_t i = 0; i < bucket_count; i++)
+        {
+            JSON_Array* bucket = json_array_get_array(buckets, i);
+            if (bucket == NULL || json_array_get_count(bucket) != 2)
+            {
+                result = false;
+                break;
+            }
+            else
+            {
+                read.add((value_type)json_array_get_number(bucket, 0), (count_type)json_array_get_number(bucket, 1));
+            }
+        }
+
+        if (result)
+        {
+            /*the buckets only know the lowest value of each bucket, the exact extremes are kept separately*/
+            read.min_value = (value_type)json_object_get_number(histogram, "min");
+            read.max_value = (value_type)json_object_get_number(histogram, "max");
+            read.sum = json_object_get_number(histogram, "mean") * (double)read.total_count;
+            this->merge(read);
+        }
+    }
+    return result;
+}
@@ -11,57 +11,20 @@
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/threadapi.h"
 #include "azure_c_shared_utility/map.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
 #include "message.h"
 #include "module.h"
+#include "broker.h"
 
 #include "simulator.h"
+#include "metrics.h"
+#include "latency_histogram.h"
 
 using HrClock = std::chrono::high_resolution_clock;
 using MicroSeconds = std::chrono::microseconds;
 using HrTime = std::chrono::time_point<HrClock, MicroSeconds>;
 using Counter = long long;
 
-template<typename ValueT>
-struct SimpleAccumulator
-{
-    typedef ValueT result_type;
-
-    ValueT accumulation;
-    ValueT max;
-    Counter accumulation_count;
-
-    SimpleAccumulator() : accumulation(0), max(0), accumulation_count(0)
-    {
-    }
-    
-    result_type getSum()
-    {
-        return this->accumulation;
-    }
-    Counter getCount()
-    {
-        return this->accumulation_count;
-    }
-    result_type getMean()
-    {
-        ValueT mean(0);
-        if (accumulation_count != 0)
-        {
-            mean = accumulation / accumulation_count;
-        }
-        return mean;
-    }
-    void add(ValueT v)
-    {
-        this->accumulation += v;
-        this->accumulation_count++;
-        if (v > max)
-        {
-            max = v;
-        }
-    }
-};
-
 struct METRICS_PER_DEVICE
 {
     Counter messages_received;
@@ -79,23 +42,60 @@ typedef struct METRICS_MODULE_HANDLE_TAG
 {
     BROKER_HANDLE broker;
     bool started;
+    bool forward;
+    char * results_file;
     HrTime start_time;
     Counter all_messages_received;
     Counter non_conforming_messages;
-    SimpleAccumulator<MicroSeconds> latency;
+    Counter forward_failures;
+    LatencyHistogram *latency;
     PerDeviceMap *per_device_metrics;
 } METRICS_MODULE_HANDLE;
 
 
 static void* MetricsModule_ParseConfigurationFromJson(const char* configuration)
 {
-    (void)configuration;
-    return NULL;
+    METRICS_MODULE_CONFIG * result;
+    JSON_Value* json = (configuration == NULL) ? NULL : json_parse_string(configuration);
+    JSON_Object* obj = json_value_get_object(json);
+    if (obj == NULL)
+    {
+        /* the module has no required settings, anything but an object keeps the defaults */
+        result = NULL;
+    }
+    else
+    {
+        result = (METRICS_MODULE_CONFIG *)malloc(sizeof(METRICS_MODULE_CONFIG));
+        if (result == NULL)
+        {
+            LogError("Could not allocate Module configuration");
+        }
+        else
+        {
+            const char * results_file_value = json_object_get_string(obj, "results.file");
+            result->results_file = NULL;
+            result->forward = (json_object_get_boolean(obj, "forward") == 1);
+            if ((results_file_value != NULL) &&
+                (mallocAndStrcpy_s(&(result->results_file), results_file_value) != 0))
+            {
+                LogError("could not allocate memory for results file string");
+                free(result);
+                result = NULL;
+            }
+        }
+    }
+    json_value_free(json);
+    return result;
 }
 
 static void MetricsModule_FreeConfiguration(void* configuration)
 {
-    (void)configuration;
+    if (configuration != NULL)
+    {
+        METRICS_MODULE_CONFIG * conf = (METRICS_MODULE_CONFIG*)configuration;
+        free(conf->results_file);
+        free(conf);
+    }
 }
 
 static MODULE_HANDLE MetricsModule_Create(BROKER_HANDLE broker, const void* configuration)
@@ -116,17 +116,30 @@ static MODULE_HANDLE MetricsModule_Create(BROKER_HANDLE broker, const void* conf
         }
         else
         {
-            HrTime init_time;
-            Counter init_count(0);
-            SimpleAccumulator<MicroSeconds> init_accumulator;
+            const METRICS_MODULE_CONFIG * conf = (const METRICS_MODULE_CONFIG *)configuration;
+            module->results_file = NULL;
+            if ((conf != NULL) && (conf->results_file != NULL) &&
+                (mallocAndStrcpy_s(&(module->results_file), conf->results_file) != 0))
+            {
+                LogError("could not allocate memory for results file string");
+                free(module);
+                module = NULL;
+            }
+            else
+            {
+                HrTime init_time;
+                Counter init_count(0);
 
-            module->broker = broker;
-            module->started = false;
-            module->start_time = init_time;
-            module->all_messages_received = init_count;
-            module->non_conforming_messages = init_count;
-            module->latency = init_accumulator;
-            module->per_device_metrics = new PerDeviceMap();
+                module->broker = broker;
+                module->started = false;
+                module->forward = (conf != NULL) && conf->forward;
+                module->start_time = init_time;
+                module->all_messages_received = init_count;
+                module->non_conforming_messages = init_count;
+                module->forward_failures = init_count;
+                module->latency = new LatencyHistogram();
+                module->per_device_metrics = new PerDeviceMap();
+            }
         }
     }
     return (MODULE_HANDLE)module;
@@ -171,7 +184,7 @@ static void MetricsModule_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE mes
                     MicroSeconds timestamp_duration(std::stoll(timestamp_property));
                     HrTime timestamp(timestamp_duration);
                     MicroSeconds current_latency = received_time - timestamp;
-                    module->latency.add(current_latency);
+                    module->latency->add(current_latency.count());
 
                     if (deviceId_property == NULL)
                     {
@@ -205,9 +218,64 @@ static void MetricsModule_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE mes
 
             ConstMap_Destroy(message_properties);
         }
+
+        if (module->forward)
+        {
+            /* a relay in a chain of metrics modules passes every message on, conforming or not */
+            if (Broker_Publish(module->broker, moduleHandle, messageHandle) != BROKER_OK)
+            {
+                module->forward_failures++;
+            }
+        }
     }
 }
 
+static void MetricsModule_write_results(METRICS_MODULE_HANDLE * module, MicroSeconds duration)
+{
+    Counter out_of_sequence_messages(0);
+    Counter messages_lost(0);
+    for (PerDeviceMap::iterator d = module->per_device_metrics->begin();
+        d != module->per_device_metrics->end();
+        d++)
+    {
+        out_of_sequence_messages += (*d).second.out_of_sequence_messages;
+        messages_lost += (*d).second.messages_lost;
+    }
+
+    JSON_Value* results = json_value_init_object();
+    JSON_Value* latency = module->latency->toJson();
+    if (results == NULL || latency == NULL)
+    {
+        LogError("unable to build the results of the metrics module");
+        json_value_free(latency);
+    }
+    else
+    {
+        JSON_Object* results_object = json_value_get_object(results);
+        if (json_object_set_number(results_object, "durationMicroseconds", (double)duration.count()) != JSONSuccess ||
+            json_object_set_number(results_object, "messages", (double)module->all_messages_received) != JSONSuccess ||
+            json_object_set_number(results_object, "nonConforming", (double)module->non_conforming_messages) != JSONSuccess ||
+            json_object_set_number(results_object, "outOfSequence", (double)out_of_sequence_messages) != JSONSuccess ||
+            json_object_set_number(results_object, "lost", (double)messages_lost) != JSONSuccess ||
+            json_object_set_number(results_object, "devices", (double)module->per_device_metrics->size()) != JSONSuccess ||
+            json_object_set_number(results_object, "forwardFailures", (double)module->forward_failures) != JSONSuccess)
+        {
+            LogError("unable to build the results of the metrics module");
+            json_value_free(latency);
+        }
+        else if (json_object_set_value(results_object, "latencyMicroseconds", latency) != JSONSuccess)
+        {
+            LogError("unable to build the results of the metrics module");
+            json_value_free(latency);
+        }
+        else if (json_serialize_to_file(results, module->results_file) != JSONSuccess)
+        {
+            LogError("unable to write the results of the metrics module to %s", module->results_file);
+        }
+    }
+    json_value_free(results);
+}
+
 static void MetricsModule_Destroy(MODULE_HANDLE moduleHandle)
 {
     if (moduleHandle == NULL)
@@ -227,8 +295,11 @@ static void MetricsModule_Destroy(MODULE_HANDLE moduleHandle)
                 << "Duration (ms): " << duration.count() / 1000 << std::endl
                 << "Messages received: " << module->all_messages_received << std::endl
                 << "Non-Conforming Messages: " << module->non_conforming_messages << std::endl
-                << "Message Latency (average microseconds): " << module->latency.getMean().count() << std::endl
-                << "Message Latency (max microseconds): " << module->latency.max.count() << std::endl
+                << "Message Latency (average microseconds): " << static_cast<long long>(module->latency->getMean()) << std::endl
+                << "Message Latency (50th percentile microseconds): " << module->latency->getValueAtPercentile(50.0) << std::endl
+                << "Message Latency (99th percentile microseconds): " << module->latency->getValueAtPercentile(99.0) << std::endl
+                << "Message Latency (99.9th percentile microseconds): " << module->latency->getValueAtPercentile(99.9) << std::endl
+                << "Message Latency (max microseconds): " << module->latency->getMax() << std::endl
                 << "Devices Discovered: " << module->per_device_metrics->size() << std::endl;
             for (PerDeviceMap::iterator d = module->per_device_metrics->begin();
                 d != module->per_device_metrics->end();
@@ -240,8 +311,15 @@ static void MetricsModule_Destroy(MODULE_HANDLE moduleHandle)
                     << "Out of Sequence Count: " << (*d).second.out_of_sequence_messages << std::endl
                     << "Messages Lost: " << (*d).second.messages_lost << std::endl;
             }
+
+            if (module->results_file != NULL)
+            {
+                MetricsModule_write_results(module, duration);
+            }
         }    
+        delete (module->latency);
         delete (module->per_device_metrics);
+        free(module->results_file);
         free(module);
     }
 }
@@ -6,10 +6,20 @@
 #include "simulator.h"
 #include "module_loader.h"
 #include "module_loaders/dynamic_loader.h"
+#include <stdio.h>
+#include <stdlib.h>
 #include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/tickcounter.h"
+#include "azure_c_shared_utility/xlogging.h"
 
 #include "testrunnerswitcher.h"
 
+#define STARTUP_MODULE_COUNT 100
+#define STARTUP_CREATE_DELAY_MS 50
+#define SCALING_LINKS_PER_MODULE 5
+#define SCALING_SLOWDOWN_FACTOR 4
+#define SCALING_MIN_US_PER_MODULE 10
+
 //=============================================================================
 //Globals
 //=============================================================================
@@ -188,5 +198,161 @@ TEST_FUNCTION(Performance_e2e_10_second_run)
 
 }
 
+TEST_FUNCTION(Performance_e2e_100_module_startup)
+{
+        ///arrange
+        GATEWAY_HANDLE e2eGatewayInstance;
+
+        /* Setup: slow to create simulators, publishing once a second */
+        SIMULATOR_MODULE_CONFIG simulator_config =
+        {
+            "device1",
+            1000,
+            2,
+            16,
+            256,
+            STARTUP_CREATE_DELAY_MS
+        };
+
+        GATEWAY_MODULES_ENTRY modules[STARTUP_MODULE_COUNT];
+        DYNAMIC_LOADER_ENTRYPOINT loader_info[STARTUP_MODULE_COUNT];
+        char module_names[STARTUP_MODULE_COUNT][16];
+
+        for (int module = 0; module < STARTUP_MODULE_COUNT; module++)
+        {
+            (void)sprintf(module_names[module], "simulator%d", module);
+            modules[module].module_name = module_names[module];
+            modules[module].module_configuration = &simulator_config;
+            modules[module].module_loader_info.loader = DynamicLoader_Get();
+            loader_info[module].moduleLibraryFileName = STRING_construct(simulator_module_path());
+            modules[module].module_loader_info.entrypoint = (void*)&(loader_info[module]);
+        }
+
+        GATEWAY_PROPERTIES performance_gw_properties;
+        VECTOR_HANDLE gatewayProps = VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY));
+        VECTOR_HANDLE gatewayLinks = VECTOR_create(sizeof(GATEWAY_LINK_ENTRY));
+
+        VECTOR_push_back(gatewayProps, &modules, STARTUP_MODULE_COUNT);
+
+        TICK_COUNTER_HANDLE tick_counter = tickcounter_create();
+        ASSERT_IS_NOT_NULL(tick_counter);
+        tickcounter_ms_t started;
+        tickcounter_ms_t running;
+
+        ///act
+        performance_gw_properties.gateway_modules = gatewayProps;
+        performance_gw_properties.gateway_links = gatewayLinks;
+        (void)tickcounter_get_current_ms(tick_counter, &started);
+        e2eGatewayInstance = Gateway_Create(&performance_gw_properties);
+        GATEWAY_START_RESULT start_result = Gateway_Start(e2eGatewayInstance);
+        (void)tickcounter_get_current_ms(tick_counter, &running);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(e2eGatewayInstance);
+        ASSERT_IS_TRUE((start_result == GATEWAY_START_SUCCESS));
+        LogInfo("Gateway of %d modules created and started in %lu ms (serial creation: %d ms)",
+            STARTUP_MODULE_COUNT, (unsigned long)(running - started), STARTUP_MODULE_COUNT * STARTUP_CREATE_DELAY_MS);
+
+        Gateway_Destroy(e2eGatewayInstance);
+
+        tickcounter_destroy(tick_counter);
+        VECTOR_destroy(gatewayProps);
+        VECTOR_destroy(gatewayLinks);
+
+        for (int loader = 0; loader < STARTUP_MODULE_COUNT; loader++)
+        {
+            STRING_delete(loader_info[loader].moduleLibraryFileName);
+        }
+}
+
+/* Creates and destroys a gateway of module_count metrics modules, each linked to the next ones, and returns the time per module in microseconds. */
+static unsigned long create_and_destroy_linked_gateway(TICK_COUNTER_HANDLE tick_counter, int module_count)
+{
+        GATEWAY_MODULES_ENTRY* modules = (GATEWAY_MODULES_ENTRY*)malloc(module_count * sizeof(GATEWAY_MODULES_ENTRY));
+        DYNAMIC_LOADER_ENTRYPOINT* loader_info = (DYNAMIC_LOADER_ENTRYPOINT*)malloc(module_count * sizeof(DYNAMIC_LOADER_ENTRYPOINT));
+        GATEWAY_LINK_ENTRY* links = (GATEWAY_LINK_ENTRY*)malloc(module_count * SCALING_LINKS_PER_MODULE * sizeof(GATEWAY_LINK_ENTRY));
+        char (*module_names)[16] = (char(*)[16])malloc(module_count * sizeof(*module_names));
+        ASSERT_IS_NOT_NULL(modules);
+        ASSERT_IS_NOT_NULL(loader_info);
+        ASSERT_IS_NOT_NULL(links);
+        ASSERT_IS_NOT_NULL(module_names);
+
+        for (int module = 0; module < module_count; module++)
+        {
+            (void)sprintf(module_names[module], "metrics%d", module);
+            modules[module].module_name = module_names[module];
+            modules[module].module_configuration = NULL;
+            modules[module].module_loader_info.loader = DynamicLoader_Get();
+            loader_info[module].moduleLibraryFileName = STRING_construct(metrics_module_path());
+            modules[module].module_loader_info.entrypoint = (void*)&(loader_info[module]);
+        }
+        for (int module = 0; module < module_count; module++)
+        {
+            for (int link = 0; link < SCALING_LINKS_PER_MODULE; link++)
+            {
+                links[module * SCALING_LINKS_PER_MODULE + link].module_source = module_names[module];
+                links[module * SCALING_LINKS_PER_MODULE + link].module_sink = module_names[(module + link + 1) % module_count];
+            }
+        }
+
+        GATEWAY_PROPERTIES performance_gw_properties;
+        VECTOR_HANDLE gatewayProps = VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY));
+        VECTOR_HANDLE gatewayLinks = VECTOR_create(sizeof(GATEWAY_LINK_ENTRY));
+        VECTOR_push_back(gatewayProps, modules, module_count);
+        VECTOR_push_back(gatewayLinks, links, module_count * SCALING_LINKS_PER_MODULE);
+        performance_gw_properties.gateway_modules = gatewayProps;
+        performance_gw_properties.gateway_links = gatewayLinks;
+
+        tickcounter_ms_t started;
+        tickcounter_ms_t created;
+        tickcounter_ms_t destroyed;
+        (void)tickcounter_get_current_ms(tick_counter, &started);
+        GATEWAY_HANDLE e2eGatewayInstance = Gateway_Create(&performance_gw_properties);
+        (void)tickcounter_get_current_ms(tick_counter, &created);
+        ASSERT_IS_NOT_NULL(e2eGatewayInstance);
+        Gateway_Destroy(e2eGatewayInstance);
+        (void)tickcounter_get_current_ms(tick_counter, &destroyed);
+
+        unsigned long us_per_module = (unsigned long)((destroyed - started) * 1000 / module_count);
+        LogInfo("Gateway of %d modules and %d links created in %lu ms, destroyed in %lu ms (%lu us per module)",
+            module_count, module_count * SCALING_LINKS_PER_MODULE, (unsigned long)(created - started), (unsigned long)(destroyed - created), us_per_module);
+
+        VECTOR_destroy(gatewayProps);
+        VECTOR_destroy(gatewayLinks);
+        for (int module = 0; module < module_count; module++)
+        {
+            STRING_delete(loader_info[module].moduleLibraryFileName);
+        }
+        free(module_names);
+        free(links);
+        free(loader_info);
+        free(modules);
+
+        return us_per_module;
+}
+
+TEST_FUNCTION(Performance_e2e_module_count_scaling)
+{
+        ///arrange
+        const int module_counts[] = { 250, 500, 1000, 2000 };
+        const int size_count = sizeof(module_counts) / sizeof(module_counts[0]);
+        unsigned long us_per_module[sizeof(module_counts) / sizeof(module_counts[0])];
+
+        TICK_COUNTER_HANDLE tick_counter = tickcounter_create();
+        ASSERT_IS_NOT_NULL(tick_counter);
+
+        ///act
+        for (int size = 0; size < size_count; size++)
+        {
+            us_per_module[size] = create_and_destroy_linked_gateway(tick_counter, module_counts[size]);
+        }
+
+        ///assert
+        /* the time per module shall not grow with the number of modules, below the tick resolution it is noise */
+        unsigned long smallest = us_per_module[0] > SCALING_MIN_US_PER_MODULE ? us_per_module[0] : SCALING_MIN_US_PER_MODULE;
+        ASSERT_IS_TRUE(us_per_module[size_count - 1] <= SCALING_SLOWDOWN_FACTOR * smallest);
+
+        tickcounter_destroy(tick_counter);
+}
 
 END_TEST_SUITE(Performance_e2e);
@@ -85,6 +85,7 @@ static void* SimulatorModule_ParseConfigurationFromJson(const char* configuratio
                             result->message_size = 256;
                             result->properties_count = 2;
                             result->properties_size = 16;
+                            result->create_delay = 0;
 
                             if (json_object_has_value_of_type(obj, "message.delay", JSONNumber))
                             {
@@ -105,6 +106,11 @@ static void* SimulatorModule_ParseConfigurationFromJson(const char* configuratio
                             {
                                 result->properties_size = static_cast<unsigned int>(properties_size_value);
                             }
+                            double create_delay_value = json_object_get_number(obj, "create.delay");
+                            if (create_delay_value > 0)
+                            {
+                                result->create_delay = static_cast<unsigned int>(create_delay_value);
+                            }
                         }
                     }
                 }
@@ -176,6 +182,12 @@ static MODULE_HANDLE SimulatorModule_Create(BROKER_HANDLE broker, const void* co
                         (module->psuedo_random_buffer)[i] = distribution(generator);
                     }
                     (module->psuedo_random_buffer)[max_buffer] = '\0';
+
+                    if (conf->create_delay > 0)
+                    {
+                        /* stands in for a module that waits on a connection before it is created */
+                        ThreadAPI_Sleep((unsigned int)conf->create_delay);
+                    }
                 }
             }
         }
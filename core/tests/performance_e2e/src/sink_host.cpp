@@ -0,0 +1,71 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <atomic>
+#include <iostream>
+
+#include "azure_c_shared_utility/threadapi.h"
+#include "module.h"
+#include "proxy_gateway.h"
+
+#include "metrics.h"
+
+/*
+ * Hosts a metrics module out of process for the performance benchmark. The
+ * benchmark launches it through the outprocess loader, and it exits once the
+ * gateway destroyed the module, so the results file is written by the time
+ * the gateway is destroyed.
+ */
+
+#define SINK_HOST_POLL_MS 100
+
+static const MODULE_API_1 * metrics_apis;
+static MODULE_API_1 sink_host_apis;
+static std::atomic<bool> sink_destroyed(false);
+
+static void SinkHost_Destroy(MODULE_HANDLE moduleHandle)
+{
+    metrics_apis->Module_Destroy(moduleHandle);
+    sink_destroyed = true;
+}
+
+int main(int argc, char** argv)
+{
+    int result;
+    if (argc != 2)
+    {
+        std::cout
+            << "usage: performance_sink_host control_channel_id" << std::endl
+            << "where control_channel_id is the control.id of the outprocess module hosting a metrics module" << std::endl;
+        result = 1;
+    }
+    else
+    {
+        metrics_apis = reinterpret_cast<const MODULE_API_1 *>(MODULE_STATIC_GETAPI(METRICS_MODULE)(MODULE_API_VERSION_1));
+        sink_host_apis = *metrics_apis;
+        sink_host_apis.Module_Destroy = SinkHost_Destroy;
+
+        REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach(reinterpret_cast<const MODULE_API *>(&sink_host_apis), argv[1]);
+        if (remote_module == NULL)
+        {
+            std::cerr << "failed to attach the metrics module on control channel " << argv[1] << std::endl;
+            result = 1;
+        }
+        else if (ProxyGateway_StartWorkerThread(remote_module) != 0)
+        {
+            std::cerr << "failed to start the worker thread for control channel " << argv[1] << std::endl;
+            ProxyGateway_Detach(remote_module);
+            result = 1;
+        }
+        else
+        {
+            while (!sink_destroyed)
+            {
+                ThreadAPI_Sleep(SINK_HOST_POLL_MS);
+            }
+            ProxyGateway_Detach(remote_module);
+            result = 0;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,409 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umock_c_negative_tests.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_bool.h"
+#include "umocktypes_stdint.h"
+
+#define ENABLE_MOCKS
+
+#define GATEWAY_EXPORT_H
+#define GATEWAY_EXPORT
+
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/vector.h"
+
+#undef ENABLE_MOCKS
+
+#include "module.h"
+#include "module_loader.h"
+#include "gateway.h"
+#include "static_gateway.h"
+
+#define ENABLE_MOCKS
+
+#define FAKE_GATEWAY ((GATEWAY_HANDLE)0x4201)
+#define FAKE_MODULES_VECTOR ((VECTOR_HANDLE)0x4202)
+#define FAKE_LINKS_VECTOR ((VECTOR_HANDLE)0x4203)
+#define FAKE_MODULE_HANDLE ((MODULE_HANDLE)0x4204)
+
+//=============================================================================
+//Globals
+//=============================================================================
+
+#ifdef WIN32
+static TEST_MUTEX_HANDLE g_dllByDll;
+#endif
+static TEST_MUTEX_HANDLE g_testByTest;
+
+/* The first module entry given to the gateway, to reach the static loader. */
+static GATEWAY_MODULES_ENTRY first_module_entry;
+static size_t module_entry_count;
+
+void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    (void)error_code;
+    ASSERT_FAIL("umock_c reported error");
+}
+
+static VECTOR_HANDLE my_VECTOR_create(size_t elementSize)
+{
+    return elementSize == sizeof(GATEWAY_MODULES_ENTRY) ? FAKE_MODULES_VECTOR : FAKE_LINKS_VECTOR;
+}
+
+static int my_VECTOR_push_back(VECTOR_HANDLE handle, const void* elements, size_t numElements)
+{
+    if (handle == FAKE_MODULES_VECTOR)
+    {
+        if (module_entry_count == 0)
+        {
+            first_module_entry = *(const GATEWAY_MODULES_ENTRY*)elements;
+        }
+        module_entry_count += numElements;
+    }
+    return 0;
+}
+
+// gateway mocks
+MOCK_FUNCTION_WITH_CODE(, GATEWAY_HANDLE, gateway_create_internal, const GATEWAY_PROPERTIES*, properties, bool, use_json)
+MOCK_FUNCTION_END(FAKE_GATEWAY)
+
+MOCK_FUNCTION_WITH_CODE(, int, Gateway_EnableLinkFusion, GATEWAY_HANDLE, gw)
+MOCK_FUNCTION_END(0)
+
+MOCK_FUNCTION_WITH_CODE(, GATEWAY_START_RESULT, Gateway_Start, GATEWAY_HANDLE, gw)
+MOCK_FUNCTION_END(GATEWAY_START_SUCCESS)
+
+MOCK_FUNCTION_WITH_CODE(, void, Gateway_Destroy, GATEWAY_HANDLE, gw)
+MOCK_FUNCTION_END()
+
+// the statically linked module
+MOCK_FUNCTION_WITH_CODE(, MODULE_HANDLE, Fake_Create, BROKER_HANDLE, broker, const void*, configuration)
+MOCK_FUNCTION_END(FAKE_MODULE_HANDLE)
+
+MOCK_FUNCTION_WITH_CODE(, void, Fake_Destroy, MODULE_HANDLE, moduleHandle)
+MOCK_FUNCTION_END()
+
+MOCK_FUNCTION_WITH_CODE(, void, Fake_Receive, MODULE_HANDLE, moduleHandle, MESSAGE_HANDLE, messageHandle)
+MOCK_FUNCTION_END()
+
+#undef ENABLE_MOCKS
+
+static const MODULE_API_1 fake_module_api =
+{
+    { MODULE_API_VERSION_1 },
+
+    NULL,
+    NULL,
+    Fake_Create,
+    Fake_Destroy,
+    Fake_Receive,
+    NULL
+};
+
+static const MODULE_API_1 fake_module_api_without_receive =
+{
+    { MODULE_API_VERSION_1 },
+
+    NULL,
+    NULL,
+    Fake_Create,
+    Fake_Destroy,
+    NULL,
+    NULL
+};
+
+static const MODULE_API* fake_get_api(MODULE_API_VERSION gateway_api_version)
+{
+    (void)gateway_api_version;
+    return (const MODULE_API*)&fake_module_api;
+}
+
+static const MODULE_API* fake_get_api_without_receive(MODULE_API_VERSION gateway_api_version)
+{
+    (void)gateway_api_version;
+    return (const MODULE_API*)&fake_module_api_without_receive;
+}
+
+static const MODULE_API* fake_get_no_api(MODULE_API_VERSION gateway_api_version)
+{
+    (void)gateway_api_version;
+    return NULL;
+}
+
+static const STATIC_GATEWAY_MODULE fake_modules[] =
+{
+    { "hello_world", fake_get_api, NULL },
+    { "logger", fake_get_api, "{\"filename\":\"log.txt\"}" }
+};
+
+static const GATEWAY_LINK_ENTRY fake_links[] =
+{
+    { "hello_world", "logger" }
+};
+
+BEGIN_TEST_SUITE(StaticGateway_UnitTests)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+    umocktypes_charptr_register_types();
+    umocktypes_stdint_register_types();
+    umocktypes_bool_register_types();
+
+    REGISTER_UMOCK_ALIAS_TYPE(VECTOR_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(GATEWAY_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(GATEWAY_START_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(MODULE_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(MESSAGE_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(BROKER_HANDLE, void*);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_create, my_VECTOR_create);
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_push_back, my_VECTOR_push_back);
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    umock_c_deinit();
+
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest) != 0)
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    umock_c_reset_all_calls();
+    memset(&first_module_entry, 0, sizeof(first_module_entry));
+    module_entry_count = 0;
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+//Tests_SRS_STATIC_GATEWAY_31_001: [ StaticGateway_Create shall return NULL if graph is NULL, if the modules or links it counts are NULL, or if a module has no name or entry point. ]
+TEST_FUNCTION(StaticGateway_Create_returns_NULL_for_an_invalid_graph)
+{
+    // arrange
+    static const STATIC_GATEWAY_MODULE module_without_entrypoint[] = { { "hello_world", NULL, NULL } };
+    STATIC_GATEWAY_GRAPH no_modules = { NULL, 1, NULL, 0, false };
+    STATIC_GATEWAY_GRAPH no_links = { fake_modules, 2, NULL, 1, false };
+    STATIC_GATEWAY_GRAPH no_entrypoint = { module_without_entrypoint, 1, NULL, 0, false };
+
+    // act
+    GATEWAY_HANDLE null_graph_result = StaticGateway_Create(NULL);
+    GATEWAY_HANDLE no_modules_result = StaticGateway_Create(&no_modules);
+    GATEWAY_HANDLE no_links_result = StaticGateway_Create(&no_links);
+    GATEWAY_HANDLE no_entrypoint_result = StaticGateway_Create(&no_entrypoint);
+
+    // assert
+    ASSERT_IS_NULL(null_graph_result);
+    ASSERT_IS_NULL(no_modules_result);
+    ASSERT_IS_NULL(no_links_result);
+    ASSERT_IS_NULL(no_entrypoint_result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+//Tests_SRS_STATIC_GATEWAY_31_002: [ StaticGateway_Create shall create the gateway properties from the modules and links of the graph, and return NULL if they cannot be created. ]
+//Tests_SRS_STATIC_GATEWAY_31_003: [ StaticGateway_Create shall create the gateway the way Gateway_CreateFromJson does, each module parsing its JSON arguments, and return NULL if it cannot be created. ]
+//Tests_SRS_STATIC_GATEWAY_31_004: [ StaticGateway_Create shall enable link fusion if the graph asks for it, then start the gateway and return it. ]
+TEST_FUNCTION(StaticGateway_Create_creates_and_starts_the_gateway)
+{
+    // arrange
+    STATIC_GATEWAY_GRAPH graph = { fake_modules, 2, fake_links, 1, true };
+
+    STRICT_EXPECTED_CALL(VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY)));
+    STRICT_EXPECTED_CALL(VECTOR_create(sizeof(GATEWAY_LINK_ENTRY)));
+    STRICT_EXPECTED_CALL(VECTOR_push_back(FAKE_MODULES_VECTOR, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(VECTOR_push_back(FAKE_MODULES_VECTOR, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(VECTOR_push_back(FAKE_LINKS_VECTOR, fake_links, 1));
+    STRICT_EXPECTED_CALL(gateway_create_internal(IGNORED_PTR_ARG, true))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Gateway_EnableLinkFusion(FAKE_GATEWAY));
+    STRICT_EXPECTED_CALL(Gateway_Start(FAKE_GATEWAY));
+    STRICT_EXPECTED_CALL(VECTOR_destroy(FAKE_MODULES_VECTOR));
+    STRICT_EXPECTED_CALL(VECTOR_destroy(FAKE_LINKS_VECTOR));
+
+    // act
+    GATEWAY_HANDLE result = StaticGateway_Create(&graph);
+
+    // assert
+    ASSERT_ARE_EQUAL(void_ptr, FAKE_GATEWAY, result);
+    ASSERT_ARE_EQUAL(size_t, 2, module_entry_count);
+    ASSERT_ARE_EQUAL(char_ptr, "hello_world", first_module_entry.module_name);
+    ASSERT_ARE_EQUAL(int, NATIVE, first_module_entry.module_loader_info.loader->type);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+//Tests_SRS_STATIC_GATEWAY_31_004: [ StaticGateway_Create shall enable link fusion if the graph asks for it, then start the gateway and return it. ]
+TEST_FUNCTION(StaticGateway_Create_does_not_fuse_links_unless_asked)
+{
+    // arrange
+    STATIC_GATEWAY_GRAPH graph = { fake_modules, 1, NULL, 0, false };
+
+    STRICT_EXPECTED_CALL(VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY)));
+    STRICT_EXPECTED_CALL(VECTOR_create(sizeof(GATEWAY_LINK_ENTRY)));
+    STRICT_EXPECTED_CALL(VECTOR_push_back(FAKE_MODULES_VECTOR, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(gateway_create_internal(IGNORED_PTR_ARG, true))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Gateway_Start(FAKE_GATEWAY));
+    STRICT_EXPECTED_CALL(VECTOR_destroy(FAKE_MODULES_VECTOR));
+    STRICT_EXPECTED_CALL(VECTOR_destroy(FAKE_LINKS_VECTOR));
+
+    // act
+    GATEWAY_HANDLE result = StaticGateway_Create(&graph);
+
+    // assert
+    ASSERT_ARE_EQUAL(void_ptr, FAKE_GATEWAY, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+//Tests_SRS_STATIC_GATEWAY_31_002: [ StaticGateway_Create shall create the gateway properties from the modules and links of the graph, and return NULL if they cannot be created. ]
+//Tests_SRS_STATIC_GATEWAY_31_003: [ StaticGateway_Create shall create the gateway the way Gateway_CreateFromJson does, each module parsing its JSON arguments, and return NULL if it cannot be created. ]
+TEST_FUNCTION(StaticGateway_Create_returns_NULL_when_an_underlying_call_fails)
+{
+    // arrange
+    STATIC_GATEWAY_GRAPH graph = { fake_modules, 1, fake_links, 1, true };
+
+    int negativeTestsInitResult = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
+
+    STRICT_EXPECTED_CALL(VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY)))
+        .SetFailReturn(NULL);
+    STRICT_EXPECTED_CALL(VECTOR_create(sizeof(GATEWAY_LINK_ENTRY)))
+        .SetFailReturn(NULL);
+    STRICT_EXPECTED_CALL(VECTOR_push_back(FAKE_MODULES_VECTOR, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(2)
+        .SetFailReturn(__LINE__);
+    STRICT_EXPECTED_CALL(VECTOR_push_back(FAKE_LINKS_VECTOR, fake_links, 1))
+        .SetFailReturn(__LINE__);
+    STRICT_EXPECTED_CALL(gateway_create_internal(IGNORED_PTR_ARG, true))
+        .IgnoreArgument(1)
+        .SetFailReturn(NULL);
+    STRICT_EXPECTED_CALL(Gateway_EnableLinkFusion(FAKE_GATEWAY))
+        .SetFailReturn(__LINE__);
+    STRICT_EXPECTED_CALL(Gateway_Start(FAKE_GATEWAY))
+        .SetFailReturn(GATEWAY_START_INVALID_ARGS);
+
+    umock_c_negative_tests_snapshot();
+
+    for (size_t i = 0; i < umock_c_negative_tests_call_count(); i++)
+    {
+        // arrange
+        umock_c_negative_tests_reset();
+        umock_c_negative_tests_fail_call(i);
+
+        // act
+        GATEWAY_HANDLE result = StaticGateway_Create(&graph);
+
+        // assert
+        ASSERT_IS_NULL(result);
+    }
+
+    umock_c_negative_tests_deinit();
+}
+
+//Tests_SRS_STATIC_GATEWAY_31_007: [ If link fusion cannot be enabled or the gateway cannot be started, StaticGateway_Create shall destroy the gateway and return NULL. ]
+TEST_FUNCTION(StaticGateway_Create_destroys_the_gateway_when_it_cannot_start)
+{
+    // arrange
+    STATIC_GATEWAY_GRAPH graph = { fake_modules, 1, NULL, 0, false };
+
+    STRICT_EXPECTED_CALL(VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY)));
+    STRICT_EXPECTED_CALL(VECTOR_create(sizeof(GATEWAY_LINK_ENTRY)));
+    STRICT_EXPECTED_CALL(VECTOR_push_back(FAKE_MODULES_VECTOR, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(gateway_create_internal(IGNORED_PTR_ARG, true))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Gateway_Start(FAKE_GATEWAY))
+        .SetReturn(GATEWAY_START_INVALID_ARGS);
+    STRICT_EXPECTED_CALL(Gateway_Destroy(FAKE_GATEWAY));
+    STRICT_EXPECTED_CALL(VECTOR_destroy(FAKE_MODULES_VECTOR));
+    STRICT_EXPECTED_CALL(VECTOR_destroy(FAKE_LINKS_VECTOR));
+
+    // act
+    GATEWAY_HANDLE result = StaticGateway_Create(&graph);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+//Tests_SRS_STATIC_GATEWAY_31_005: [ The gateway shall get the MODULE_API of each module from its MODULE_STATIC_GETAPI entry point, without loading a library. ]
+TEST_FUNCTION(static_loader_gets_the_module_api_from_its_entrypoint)
+{
+    // arrange
+    STATIC_GATEWAY_GRAPH graph = { fake_modules, 1, NULL, 0, false };
+    (void)StaticGateway_Create(&graph);
+    const MODULE_LOADER* loader = first_module_entry.module_loader_info.loader;
+    umock_c_reset_all_calls();
+
+    // act
+    MODULE_LIBRARY_HANDLE library = loader->api->Load(loader, first_module_entry.module_loader_info.entrypoint);
+    const MODULE_API* api = loader->api->GetApi(loader, library);
+    void* configuration = loader->api->BuildModuleConfiguration(loader, first_module_entry.module_loader_info.entrypoint, "{}");
+    loader->api->Unload(loader, library);
+
+    // assert
+    ASSERT_ARE_EQUAL(void_ptr, &fake_module_api, api);
+    ASSERT_ARE_EQUAL(char_ptr, "{}", (const char*)configuration);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+//Tests_SRS_STATIC_GATEWAY_31_006: [ The gateway shall fail to load a module whose MODULE_API is NULL, newer than the gateway, or lacks Module_Create, Module_Destroy or Module_Receive. ]
+TEST_FUNCTION(static_loader_fails_to_load_a_module_without_a_valid_api)
+{
+    // arrange
+    STATIC_GATEWAY_MODULE no_api = { "no_api", fake_get_no_api, NULL };
+    STATIC_GATEWAY_MODULE no_receive = { "no_receive", fake_get_api_without_receive, NULL };
+    STATIC_GATEWAY_GRAPH graph = { fake_modules, 1, NULL, 0, false };
+    (void)StaticGateway_Create(&graph);
+    const MODULE_LOADER* loader = first_module_entry.module_loader_info.loader;
+    umock_c_reset_all_calls();
+
+    // act
+    MODULE_LIBRARY_HANDLE no_api_library = loader->api->Load(loader, &no_api);
+    MODULE_LIBRARY_HANDLE no_receive_library = loader->api->Load(loader, &no_receive);
+    MODULE_LIBRARY_HANDLE no_entrypoint_library = loader->api->Load(loader, NULL);
+
+    // assert
+    ASSERT_IS_NULL(no_api_library);
+    ASSERT_IS_NULL(no_receive_library);
+    ASSERT_IS_NULL(no_entrypoint_library);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+END_TEST_SUITE(StaticGateway_UnitTests)
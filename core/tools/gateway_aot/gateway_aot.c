@@ -0,0 +1,394 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/*
+ * gateway_aot compiles a gateway JSON configuration into a C file holding a
+ * STATIC_GATEWAY_GRAPH, to create with StaticGateway_Create:
+ *
+ *     gateway_aot <config.json> <output.c> <graph name> [<module name>=<static name> ...]
+ *
+ * Each module of the configuration is mapped to the name given to
+ * MODULE_STATIC_GETAPI by its static library, for example
+ * hello_world=HELLOWORLD_MODULE. The configuration is checked here instead of
+ * when the gateway starts: an unknown or repeated module, a module that is not
+ * native or not mapped, and a link to an unknown module fail the build.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "parson.h"
+
+#define MODULES_KEY "modules"
+#define MODULE_NAME_KEY "name"
+#define LOADER_KEY "loader"
+#define LOADER_NAME_KEY "name"
+#define NATIVE_LOADER_NAME "native"
+#define ACTIVATION_KEY "activation"
+#define ACTIVATION_EAGER "eager"
+#define ARG_KEY "args"
+#define LINKS_KEY "links"
+#define SOURCE_KEY "source"
+#define SINK_KEY "sink"
+#define LINK_FUSION_KEY "link.fusion"
+#define GATEWAY_ALL "*"
+
+typedef struct AOT_MODULE_TAG
+{
+    const char* name;
+    const char* static_name;
+    char* configuration;
+} AOT_MODULE;
+
+typedef struct AOT_LINK_TAG
+{
+    const char* source;
+    const char* sink;
+} AOT_LINK;
+
+typedef struct AOT_GRAPH_TAG
+{
+    AOT_MODULE* modules;
+    size_t module_count;
+    AOT_LINK* links;
+    size_t link_count;
+    int fuse_links;
+} AOT_GRAPH;
+
+static int is_identifier(const char* name)
+{
+    int result = (name[0] != '\0' && !isdigit((unsigned char)name[0]));
+    const char* c;
+
+    for (c = name; *c != '\0' && result; c++)
+    {
+        result = (isalnum((unsigned char)*c) || *c == '_');
+    }
+
+    return result;
+}
+
+static size_t find_module(const AOT_GRAPH* graph, const char* name)
+{
+    size_t i;
+
+    for (i = 0; i < graph->module_count; i++)
+    {
+        if (strcmp(graph->modules[i].name, name) == 0)
+        {
+            break;
+        }
+    }
+
+    return i;
+}
+
+/* Finds the static name of a module among the <module name>=<static name> arguments. */
+static const char* find_static_name(const char* module_name, int mapping_count, char** mappings)
+{
+    const char* result = NULL;
+    size_t name_length = strlen(module_name);
+    int i;
+
+    for (i = 0; i < mapping_count && result == NULL; i++)
+    {
+        if (strncmp(mappings[i], module_name, name_length) == 0 && mappings[i][name_length] == '=')
+        {
+            result = mappings[i] + name_length + 1;
+        }
+    }
+
+    return result;
+}
+
+static int read_module(JSON_Object* module_json, AOT_GRAPH* graph, int mapping_count, char** mappings)
+{
+    int result;
+    AOT_MODULE* module = &graph->modules[graph->module_count];
+    JSON_Object* loader_json = json_object_get_object(module_json, LOADER_KEY);
+    const char* loader_name = (loader_json != NULL) ? json_object_get_string(loader_json, LOADER_NAME_KEY) : NULL;
+    const char* activation = json_object_get_string(module_json, ACTIVATION_KEY);
+
+    module->name = json_object_get_string(module_json, MODULE_NAME_KEY);
+    module->configuration = NULL;
+    if (module->name == NULL || strcmp(module->name, GATEWAY_ALL) == 0)
+    {
+        fprintf(stderr, "gateway_aot: module %u has no valid name\n", (unsigned int)graph->module_count);
+        result = __LINE__;
+    }
+    else if (find_module(graph, module->name) < graph->module_count)
+    {
+        fprintf(stderr, "gateway_aot: module %s is repeated\n", module->name);
+        result = __LINE__;
+    }
+    else if (loader_name != NULL && strcmp(loader_name, NATIVE_LOADER_NAME) != 0)
+    {
+        fprintf(stderr, "gateway_aot: module %s uses the %s loader, only native modules can be linked statically\n", module->name, loader_name);
+        result = __LINE__;
+    }
+    else if (activation != NULL && strcmp(activation, ACTIVATION_EAGER) != 0)
+    {
+        fprintf(stderr, "gateway_aot: module %s has activation %s, statically linked modules are created with the gateway\n", module->name, activation);
+        result = __LINE__;
+    }
+    else if ((module->static_name = find_static_name(module->name, mapping_count, mappings)) == NULL ||
+        !is_identifier(module->static_name))
+    {
+        fprintf(stderr, "gateway_aot: module %s is not mapped to the name of its MODULE_STATIC_GETAPI\n", module->name);
+        result = __LINE__;
+    }
+    else
+    {
+        JSON_Value* args = json_object_get_value(module_json, ARG_KEY);
+
+        /* Serialized the way Gateway_CreateFromJson passes the arguments to the module. */
+        if (args != NULL && (module->configuration = json_serialize_to_string(args)) == NULL)
+        {
+            fprintf(stderr, "gateway_aot: unable to serialize the arguments of module %s\n", module->name);
+            result = __LINE__;
+        }
+        else
+        {
+            graph->module_count++;
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+static int read_link(JSON_Object* link_json, AOT_GRAPH* graph)
+{
+    int result;
+    AOT_LINK* link = &graph->links[graph->link_count];
+    size_t i;
+
+    link->source = json_object_get_string(link_json, SOURCE_KEY);
+    link->sink = json_object_get_string(link_json, SINK_KEY);
+    if (link->source == NULL || link->sink == NULL)
+    {
+        fprintf(stderr, "gateway_aot: link %u has no source or sink\n", (unsigned int)graph->link_count);
+        result = __LINE__;
+    }
+    else if ((strcmp(link->source, GATEWAY_ALL) != 0 && find_module(graph, link->source) == graph->module_count) ||
+        find_module(graph, link->sink) == graph->module_count)
+    {
+        fprintf(stderr, "gateway_aot: link %s -> %s references an unknown module\n", link->source, link->sink);
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+        for (i = 0; i < graph->link_count && result == 0; i++)
+        {
+            if (strcmp(graph->links[i].source, link->source) == 0 && strcmp(graph->links[i].sink, link->sink) == 0)
+            {
+                fprintf(stderr, "gateway_aot: link %s -> %s is repeated\n", link->source, link->sink);
+                result = __LINE__;
+            }
+        }
+
+        if (result == 0)
+        {
+            graph->link_count++;
+        }
+    }
+
+    return result;
+}
+
+static int read_graph(JSON_Value* root, AOT_GRAPH* graph, int mapping_count, char** mappings)
+{
+    int result;
+    JSON_Object* root_json = json_value_get_object(root);
+    JSON_Array* modules_json = json_object_get_array(root_json, MODULES_KEY);
+    JSON_Array* links_json = json_object_get_array(root_json, LINKS_KEY);
+
+    if (modules_json == NULL || links_json == NULL)
+    {
+        fprintf(stderr, "gateway_aot: the configuration has no \"%s\" or \"%s\" array\n", MODULES_KEY, LINKS_KEY);
+        result = __LINE__;
+    }
+    else
+    {
+        size_t module_count = json_array_get_count(modules_json);
+        size_t link_count = json_array_get_count(links_json);
+        size_t i;
+
+        /* Link fusion is on unless the configuration turns it off, the graph cannot change. */
+        graph->fuse_links = (json_object_get_boolean(root_json, LINK_FUSION_KEY) != 0);
+        graph->modules = (AOT_MODULE*)calloc(module_count + 1, sizeof(AOT_MODULE));
+        graph->links = (AOT_LINK*)calloc(link_count + 1, sizeof(AOT_LINK));
+        if (graph->modules == NULL || graph->links == NULL)
+        {
+            fprintf(stderr, "gateway_aot: out of memory\n");
+            result = __LINE__;
+        }
+        else
+        {
+            result = 0;
+            for (i = 0; i < module_count && result == 0; i++)
+            {
+                result = read_module(json_array_get_object(modules_json, i), graph, mapping_count, mappings);
+            }
+            for (i = 0; i < link_count && result == 0; i++)
+            {
+                result = read_link(json_array_get_object(links_json, i), graph);
+            }
+        }
+    }
+
+    return result;
+}
+
+static void write_string(FILE* output, const char* text)
+{
+    const unsigned char* c;
+
+    if (text == NULL)
+    {
+        fputs("NULL", output);
+    }
+    else
+    {
+        fputc('"', output);
+        for (c = (const unsigned char*)text; *c != '\0'; c++)
+        {
+            if (*c == '"' || *c == '\\' || *c == '?')
+            {
+                fprintf(output, "\\%c", *c);
+            }
+            else if (*c < 0x20 || *c > 0x7e)
+            {
+                /* Octal, a hexadecimal escape would take the digits that follow. */
+                fprintf(output, "\\%03o", *c);
+            }
+            else
+            {
+                fputc(*c, output);
+            }
+        }
+        fputc('"', output);
+    }
+}
+
+static int write_graph(const AOT_GRAPH* graph, const char* config_path, const char* graph_name, FILE* output)
+{
+    size_t i;
+    size_t j;
+
+    fprintf(output, "/* Generated by gateway_aot from %s, do not edit. */\n\n", config_path);
+    fprintf(output, "#include <stddef.h>\n#include \"module.h\"\n#include \"static_gateway.h\"\n\n");
+
+    for (i = 0; i < graph->module_count; i++)
+    {
+        for (j = 0; j < i && strcmp(graph->modules[j].static_name, graph->modules[i].static_name) != 0; j++)
+        {
+        }
+        if (j == i)
+        {
+            fprintf(output, "MODULE_EXPORT const MODULE_API* MODULE_STATIC_GETAPI(%s)(MODULE_API_VERSION gateway_api_version);\n", graph->modules[i].static_name);
+        }
+    }
+
+    fprintf(output, "\nstatic const STATIC_GATEWAY_MODULE %s_modules[] =\n{\n", graph_name);
+    for (i = 0; i < graph->module_count; i++)
+    {
+        fputs("    { ", output);
+        write_string(output, graph->modules[i].name);
+        fprintf(output, ", MODULE_STATIC_GETAPI(%s), ", graph->modules[i].static_name);
+        write_string(output, graph->modules[i].configuration);
+        fprintf(output, " }%s\n", (i + 1 < graph->module_count) ? "," : "");
+    }
+    if (graph->module_count == 0)
+    {
+        fputs("    { NULL, NULL, NULL }\n", output);
+    }
+    fputs("};\n", output);
+
+    fprintf(output, "\nstatic const GATEWAY_LINK_ENTRY %s_links[] =\n{\n", graph_name);
+    for (i = 0; i < graph->link_count; i++)
+    {
+        fputs("    { ", output);
+        write_string(output, graph->links[i].source);
+        fputs(", ", output);
+        write_string(output, graph->links[i].sink);
+        fprintf(output, " }%s\n", (i + 1 < graph->link_count) ? "," : "");
+    }
+    if (graph->link_count == 0)
+    {
+        fputs("    { NULL, NULL }\n", output);
+    }
+    fputs("};\n", output);
+
+    fprintf(output, "\nconst STATIC_GATEWAY_GRAPH %s =\n{\n", graph_name);
+    fprintf(output, "    %s_modules,\n    %u,\n", graph_name, (unsigned int)graph->module_count);
+    fprintf(output, "    %s_links,\n    %u,\n", graph_name, (unsigned int)graph->link_count);
+    fprintf(output, "    %s\n};\n", graph->fuse_links ? "true" : "false");
+
+    return ferror(output) ? __LINE__ : 0;
+}
+
+int main(int argc, char** argv)
+{
+    int result;
+
+    if (argc < 4 || !is_identifier(argv[3]))
+    {
+        fprintf(stderr, "usage: gateway_aot <config.json> <output.c> <graph name> [<module name>=<static name> ...]\n");
+        result = EXIT_FAILURE;
+    }
+    else
+    {
+        JSON_Value* root = json_parse_file(argv[1]);
+        if (root == NULL)
+        {
+            fprintf(stderr, "gateway_aot: unable to parse %s\n", argv[1]);
+            result = EXIT_FAILURE;
+        }
+        else
+        {
+            AOT_GRAPH graph;
+            memset(&graph, 0, sizeof(AOT_GRAPH));
+
+            if (read_graph(root, &graph, argc - 4, argv + 4) != 0)
+            {
+                result = EXIT_FAILURE;
+            }
+            else
+            {
+                FILE* output = fopen(argv[2], "w");
+                if (output == NULL)
+                {
+                    fprintf(stderr, "gateway_aot: unable to open %s\n", argv[2]);
+                    result = EXIT_FAILURE;
+                }
+                else
+                {
+                    result = (write_graph(&graph, argv[1], argv[3], output) == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+                    if (fclose(output) != 0 || result != EXIT_SUCCESS)
+                    {
+                        fprintf(stderr, "gateway_aot: unable to write %s\n", argv[2]);
+                        (void)remove(argv[2]);
+                        result = EXIT_FAILURE;
+                    }
+                }
+            }
+
+            if (graph.modules != NULL)
+            {
+                size_t i;
+                for (i = 0; i < graph.module_count; i++)
+                {
+                    json_free_serialized_string(graph.modules[i].configuration);
+                }
+                free(graph.modules);
+            }
+            free(graph.links);
+            json_value_free(root);
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,70 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef BRIDGE_H
+#define BRIDGE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "module.h"
+
+/** @brief  Stream name subscribing to every message, including messages
+ *          without a stream property.
+ */
+#define BRIDGE_SUBSCRIBE_ALL "*"
+
+typedef struct BRIDGE_CONFIG_TAG
+{
+    /** @brief  nanomsg url of the link to the peer bridge, "tcp://" or "ipc://" */
+    char * endpoint;
+
+    /** @brief  Bind to `endpoint` when true, connect to it otherwise */
+    bool listen;
+
+    /** @brief  Message property naming the stream a message belongs to */
+    char * stream_property;
+
+    /** @brief  Streams this bridge publishes into its broker, announced to the peer */
+    char ** subscriptions;
+    size_t subscription_count;
+
+    /** @brief  Maximum number of messages sent to the peer in one frame */
+    size_t batch_size;
+
+    /** @brief  Milliseconds a partial frame may wait for more messages */
+    unsigned int batch_timeout;
+} BRIDGE_CONFIG; /*this needs to be passed to the Module_Create function*/
+
+typedef struct BRIDGE_COUNTERS_TAG
+{
+    size_t messages_sent;
+    size_t messages_filtered;
+    size_t messages_dropped;
+    size_t messages_received;
+    size_t frames_sent;
+    size_t frames_received;
+    size_t errors;
+} BRIDGE_COUNTERS;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+MODULE_EXPORT const MODULE_API* MODULE_STATIC_GETAPI(BRIDGE_MODULE)(MODULE_API_VERSION gateway_api_version);
+
+/** @brief      Reads the traffic counters of a bridge module instance.
+ *
+ *  @param      module      The bridge module instance.
+ *  @param      counters    Receives a snapshot of the counters.
+ *
+ *  @return     0 on success, non-zero otherwise.
+ */
+MODULE_EXPORT int Bridge_GetCounters(MODULE_HANDLE module, BRIDGE_COUNTERS * counters);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*BRIDGE_H*/
@@ -0,0 +1,873 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "bridge.h"
+
+#include <azure_c_shared_utility/gballoc.h>
+#include <azure_c_shared_utility/constmap.h>
+#include <azure_c_shared_utility/crt_abstractions.h>
+#include <azure_c_shared_utility/lock.h>
+#include <azure_c_shared_utility/threadapi.h>
+#include <azure_c_shared_utility/tickcounter.h>
+#include <azure_c_shared_utility/xlogging.h>
+
+#include <nanomsg/nn.h>
+#include <nanomsg/pair.h>
+
+#include <parson.h>
+
+#include "broker.h"
+#include "message.h"
+#include "messageproperties.h"
+
+/*
+ * Frames exchanged by two bridges:
+ *   [version:1][type:1][count:4, big endian][payload]
+ * SUBSCRIBE payload: `count` NUL terminated stream names.
+ * BATCH payload: `count` entries of [size:4, big endian][serialized message].
+ */
+#define BRIDGE_FRAME_VERSION            0x01
+#define BRIDGE_FRAME_SUBSCRIBE          0x01
+#define BRIDGE_FRAME_BATCH              0x02
+#define BRIDGE_FRAME_HEADER_SIZE        6
+#define BRIDGE_ENTRY_HEADER_SIZE        4
+
+#define BRIDGE_DEFAULT_BATCH_SIZE       16
+#define BRIDGE_DEFAULT_BATCH_TIMEOUT    10
+#define BRIDGE_BATCH_INITIAL_SIZE       4096
+
+/* how often the subscriptions are announced again, so a restarted peer learns them */
+#define BRIDGE_ANNOUNCE_INTERVAL_MS     1000
+
+typedef struct BRIDGE_HANDLE_DATA_TAG
+{
+    BROKER_HANDLE broker;
+    LOCK_HANDLE lock;
+    THREAD_HANDLE thread;
+    TICK_COUNTER_HANDLE clock;
+    int socket;
+    bool running;
+    char * stream_property;
+    unsigned char * announcement;
+    size_t announcement_size;
+    char * remote_streams;          /* NUL separated names of the streams the peer subscribed to */
+    size_t remote_stream_count;
+    unsigned char * batch;          /* nanomsg message being filled with serialized messages */
+    size_t batch_capacity;
+    size_t batch_used;
+    size_t batch_count;
+    size_t batch_size;
+    unsigned int batch_timeout;
+    tickcounter_ms_t batch_started;
+    tickcounter_ms_t last_announcement;
+    BRIDGE_COUNTERS counters;
+} BRIDGE_HANDLE_DATA;
+
+static void write_uint32(unsigned char * destination, uint32_t value)
+{
+    destination[0] = (unsigned char)(value >> 24);
+    destination[1] = (unsigned char)(value >> 16);
+    destination[2] = (unsigned char)(value >> 8);
+    destination[3] = (unsigned char)value;
+}
+
+static uint32_t read_uint32(const unsigned char * source)
+{
+    return ((uint32_t)source[0] << 24) | ((uint32_t)source[1] << 16) | ((uint32_t)source[2] << 8) | (uint32_t)source[3];
+}
+
+static void write_frame_header(unsigned char * frame, unsigned char type, size_t count)
+{
+    frame[0] = BRIDGE_FRAME_VERSION;
+    frame[1] = type;
+    write_uint32(frame + 2, (uint32_t)count);
+}
+
+static bool is_subscribed(const BRIDGE_HANDLE_DATA * handleData, const char * stream)
+{
+    bool result = false;
+    const char * name = handleData->remote_streams;
+    size_t i;
+
+    for (i = 0; (i < handleData->remote_stream_count) && !result; ++i)
+    {
+        result = (strcmp(name, BRIDGE_SUBSCRIBE_ALL) == 0) || ((stream != NULL) && (strcmp(name, stream) == 0));
+        name += strlen(name) + 1;
+    }
+
+    return result;
+}
+
+/* a module cannot see the gateway links, so the streams to announce come from the configuration */
+static int create_announcement(BRIDGE_HANDLE_DATA * handleData, const BRIDGE_CONFIG * config)
+{
+    int result;
+    size_t size = BRIDGE_FRAME_HEADER_SIZE;
+    size_t i;
+
+    for (i = 0; i < config->subscription_count; ++i)
+    {
+        size += strlen(config->subscriptions[i]) + 1;
+    }
+
+    if ((handleData->announcement = (unsigned char *)malloc(size)) == NULL)
+    {
+        LogError("malloc failed");
+        result = __LINE__;
+    }
+    else
+    {
+        unsigned char * cursor = handleData->announcement + BRIDGE_FRAME_HEADER_SIZE;
+        write_frame_header(handleData->announcement, BRIDGE_FRAME_SUBSCRIBE, config->subscription_count);
+        for (i = 0; i < config->subscription_count; ++i)
+        {
+            size_t length = strlen(config->subscriptions[i]) + 1;
+            (void)memcpy(cursor, config->subscriptions[i], length);
+            cursor += length;
+        }
+        handleData->announcement_size = size;
+        result = 0;
+    }
+
+    return result;
+}
+
+static void send_announcement(BRIDGE_HANDLE_DATA * handleData)
+{
+    /* the peer may not be connected yet, the announcement is repeated anyway */
+    (void)nn_send(handleData->socket, handleData->announcement, handleData->announcement_size, NN_DONTWAIT);
+}
+
+/* the batch functions below are called with the lock held */
+static int reserve_batch(BRIDGE_HANDLE_DATA * handleData, size_t size)
+{
+    int result;
+    size_t required = handleData->batch_used + size;
+
+    if (required <= handleData->batch_capacity)
+    {
+        result = 0;
+    }
+    else
+    {
+        size_t capacity = (2 * handleData->batch_capacity > required) ? (2 * handleData->batch_capacity) : required;
+        void * frame;
+
+        if (capacity < BRIDGE_BATCH_INITIAL_SIZE)
+        {
+            capacity = BRIDGE_BATCH_INITIAL_SIZE;
+        }
+
+        frame = (handleData->batch == NULL) ? nn_allocmsg(capacity, 0) : nn_reallocmsg(handleData->batch, capacity);
+        if (frame == NULL)
+        {
+            LogError("unable to grow the batch frame to %zu bytes", capacity);
+            result = __LINE__;
+        }
+        else
+        {
+            handleData->batch = (unsigned char *)frame;
+            handleData->batch_capacity = capacity;
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+static void flush_batch(BRIDGE_HANDLE_DATA * handleData)
+{
+    if (handleData->batch_count != 0)
+    {
+        void * frame;
+
+        write_frame_header(handleData->batch, BRIDGE_FRAME_BATCH, handleData->batch_count);
+
+        /* nanomsg sends the whole chunk, so trim it to its content first */
+        if ((frame = nn_reallocmsg(handleData->batch, handleData->batch_used)) == NULL)
+        {
+            LogError("unable to trim the batch frame");
+            handleData->counters.messages_dropped += handleData->batch_count;
+        }
+        else if (nn_send(handleData->socket, &frame, NN_MSG, NN_DONTWAIT) < 0)
+        {
+            /*Codes_SRS_BRIDGE_31_016: [ If the frame cannot be sent without blocking, its messages shall be dropped and counted. ]*/
+            handleData->batch = (unsigned char *)frame;
+            handleData->batch_capacity = handleData->batch_used;
+            handleData->counters.messages_dropped += handleData->batch_count;
+        }
+        else
+        {
+            /* nanomsg owns the frame now */
+            handleData->batch = NULL;
+            handleData->batch_capacity = 0;
+            handleData->counters.messages_sent += handleData->batch_count;
+            handleData->counters.frames_sent++;
+        }
+
+        handleData->batch_used = BRIDGE_FRAME_HEADER_SIZE;
+        handleData->batch_count = 0;
+    }
+}
+
+static int update_remote_streams(BRIDGE_HANDLE_DATA * handleData, const unsigned char * payload, size_t size, uint32_t count)
+{
+    int result;
+    size_t offset = 0;
+    uint32_t i;
+
+    for (i = 0; (i < count) && (offset < size); ++i)
+    {
+        const unsigned char * end = (const unsigned char *)memchr(payload + offset, '\0', size - offset);
+        if (end == NULL)
+        {
+            break;
+        }
+        offset = (size_t)(end - payload) + 1;
+    }
+
+    if (i != count)
+    {
+        LogError("malformed subscribe frame");
+        result = __LINE__;
+    }
+    else
+    {
+        char * streams = (char *)malloc(offset + 1);
+        if (streams == NULL)
+        {
+            LogError("malloc failed");
+            result = __LINE__;
+        }
+        else if (Lock(handleData->lock) != LOCK_OK)
+        {
+            LogError("unable to lock");
+            free(streams);
+            result = __LINE__;
+        }
+        else
+        {
+            /*Codes_SRS_BRIDGE_31_017: [ A SUBSCRIBE frame from the peer shall replace the set of streams forwarded to the peer. ]*/
+            (void)memcpy(streams, payload, offset);
+            streams[offset] = '\0';
+            free(handleData->remote_streams);
+            handleData->remote_streams = streams;
+            handleData->remote_stream_count = count;
+            (void)Unlock(handleData->lock);
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+static int publish_batch(BRIDGE_HANDLE_DATA * handleData, const unsigned char * payload, size_t size, uint32_t count)
+{
+    int result = 0;
+    size_t offset = 0;
+    size_t published = 0;
+    size_t errors = 0;
+    uint32_t i;
+
+    for (i = 0; (i < count) && (result == 0); ++i)
+    {
+        uint32_t entry_size;
+
+        if ((size - offset) < BRIDGE_ENTRY_HEADER_SIZE)
+        {
+            LogError("truncated batch frame");
+            result = __LINE__;
+        }
+        else if (((entry_size = read_uint32(payload + offset)) > INT32_MAX) || ((size - offset - BRIDGE_ENTRY_HEADER_SIZE) < entry_size))
+        {
+            LogError("truncated batch frame");
+            result = __LINE__;
+        }
+        else
+        {
+            /*Codes_SRS_BRIDGE_31_018: [ Each message of a BATCH frame from the peer shall be recreated with Message_CreateFromByteArray and published to the broker. ]*/
+            MESSAGE_HANDLE message = Message_CreateFromByteArray(payload + offset + BRIDGE_ENTRY_HEADER_SIZE, (int32_t)entry_size);
+            if (message == NULL)
+            {
+                LogError("unable to recreate a bridged message");
+                ++errors;
+            }
+            else
+            {
+                if (Broker_Publish(handleData->broker, (MODULE_HANDLE)handleData, message) != BROKER_OK)
+                {
+                    LogError("unable to publish a bridged message");
+                    ++errors;
+                }
+                else
+                {
+                    ++published;
+                }
+                Message_Destroy(message);
+            }
+            offset += BRIDGE_ENTRY_HEADER_SIZE + entry_size;
+        }
+    }
+
+    if (Lock(handleData->lock) != LOCK_OK)
+    {
+        LogError("unable to lock");
+    }
+    else
+    {
+        handleData->counters.frames_received++;
+        handleData->counters.messages_received += published;
+        handleData->counters.errors += errors;
+        (void)Unlock(handleData->lock);
+    }
+
+    return result;
+}
+
+static int process_frame(BRIDGE_HANDLE_DATA * handleData, const unsigned char * frame, size_t size)
+{
+    int result;
+
+    if ((size < BRIDGE_FRAME_HEADER_SIZE) || (frame[0] != BRIDGE_FRAME_VERSION))
+    {
+        LogError("malformed frame received from the peer");
+        result = __LINE__;
+    }
+    else if (frame[1] == BRIDGE_FRAME_SUBSCRIBE)
+    {
+        result = update_remote_streams(handleData, frame + BRIDGE_FRAME_HEADER_SIZE, size - BRIDGE_FRAME_HEADER_SIZE, read_uint32(frame + 2));
+    }
+    else if (frame[1] == BRIDGE_FRAME_BATCH)
+    {
+        result = publish_batch(handleData, frame + BRIDGE_FRAME_HEADER_SIZE, size - BRIDGE_FRAME_HEADER_SIZE, read_uint32(frame + 2));
+    }
+    else
+    {
+        LogError("unknown frame type %d received from the peer", (int)frame[1]);
+        result = __LINE__;
+    }
+
+    if (result != 0)
+    {
+        /*Codes_SRS_BRIDGE_31_019: [ Malformed frames shall be ignored and counted as errors. ]*/
+        if (Lock(handleData->lock) != LOCK_OK)
+        {
+            LogError("unable to lock");
+        }
+        else
+        {
+            handleData->counters.errors++;
+            (void)Unlock(handleData->lock);
+        }
+    }
+
+    return result;
+}
+
+static int bridge_worker(void * user_data)
+{
+    BRIDGE_HANDLE_DATA * handleData = (BRIDGE_HANDLE_DATA *)user_data;
+    bool running = true;
+
+    while (running)
+    {
+        void * frame = NULL;
+        tickcounter_ms_t now;
+        bool has_time;
+
+        /* returns after at most batch_timeout ms (NN_RCVTIMEO), so partial batches are not held back */
+        int received = nn_recv(handleData->socket, &frame, NN_MSG, 0);
+        if (received >= 0)
+        {
+            (void)process_frame(handleData, (const unsigned char *)frame, (size_t)received);
+            (void)nn_freemsg(frame);
+        }
+        else if ((nn_errno() != ETIMEDOUT) && (nn_errno() != EAGAIN))
+        {
+            LogError("nn_recv failed");
+            ThreadAPI_Sleep(handleData->batch_timeout);
+        }
+
+        has_time = (tickcounter_get_current_ms(handleData->clock, &now) == 0);
+        if (!has_time)
+        {
+            LogError("unable to read the clock");
+        }
+        else if ((now - handleData->last_announcement) >= BRIDGE_ANNOUNCE_INTERVAL_MS)
+        {
+            /*Codes_SRS_BRIDGE_31_021: [ The worker thread shall announce the subscriptions to the peer again every BRIDGE_ANNOUNCE_INTERVAL_MS milliseconds. ]*/
+            send_announcement(handleData);
+            handleData->last_announcement = now;
+        }
+
+        if (Lock(handleData->lock) != LOCK_OK)
+        {
+            LogError("unable to lock, stopping the bridge thread");
+            running = false;
+        }
+        else
+        {
+            /*Codes_SRS_BRIDGE_31_020: [ The worker thread shall send a partial batch once its first message waited `batch_timeout` milliseconds. ]*/
+            if (has_time && (handleData->batch_count != 0) && ((now - handleData->batch_started) >= handleData->batch_timeout))
+            {
+                flush_batch(handleData);
+            }
+            running = handleData->running;
+            (void)Unlock(handleData->lock);
+        }
+    }
+
+    return 0;
+}
+
+static void free_handle_data(BRIDGE_HANDLE_DATA * handleData)
+{
+    if (handleData->socket >= 0)
+    {
+        (void)nn_close(handleData->socket);
+    }
+    if (handleData->batch != NULL)
+    {
+        (void)nn_freemsg(handleData->batch);
+    }
+    if (handleData->clock != NULL)
+    {
+        tickcounter_destroy(handleData->clock);
+    }
+    if (handleData->lock != NULL)
+    {
+        (void)Lock_Deinit(handleData->lock);
+    }
+    free(handleData->remote_streams);
+    free(handleData->announcement);
+    free(handleData->stream_property);
+    free(handleData);
+}
+
+static MODULE_HANDLE Bridge_Create(BROKER_HANDLE broker, const void* configuration)
+{
+    BRIDGE_HANDLE_DATA * result;
+    const BRIDGE_CONFIG * config = (const BRIDGE_CONFIG *)configuration;
+
+    if ((broker == NULL) || (config == NULL))
+    {
+        /*Codes_SRS_BRIDGE_31_008: [ If `broker` or `configuration` is NULL then `Bridge_Create` shall fail and return NULL. ]*/
+        LogError("invalid arg broker=%p configuration=%p", broker, configuration);
+        result = NULL;
+    }
+    else if ((config->endpoint == NULL) || (config->stream_property == NULL) || (config->batch_size == 0))
+    {
+        /*Codes_SRS_BRIDGE_31_009: [ If `endpoint` or `stream_property` is NULL, or `batch_size` is zero, then `Bridge_Create` shall fail and return NULL. ]*/
+        LogError("invalid bridge configuration");
+        result = NULL;
+    }
+    else if ((result = (BRIDGE_HANDLE_DATA *)malloc(sizeof(BRIDGE_HANDLE_DATA))) == NULL)
+    {
+        /*Codes_SRS_BRIDGE_31_011: [ If any step fails, `Bridge_Create` shall release all resources and return NULL. ]*/
+        LogError("malloc failed");
+    }
+    else
+    {
+        int receive_timeout = (config->batch_timeout == 0) ? 1 : (int)config->batch_timeout;
+
+        (void)memset(result, 0, sizeof(BRIDGE_HANDLE_DATA));
+        result->broker = broker;
+        result->socket = -1;
+        result->batch_used = BRIDGE_FRAME_HEADER_SIZE;
+        result->batch_size = config->batch_size;
+        result->batch_timeout = config->batch_timeout;
+
+        if (mallocAndStrcpy_s(&result->stream_property, config->stream_property) != 0)
+        {
+            LogError("unable to copy the stream property name");
+            free_handle_data(result);
+            result = NULL;
+        }
+        else if (create_announcement(result, config) != 0)
+        {
+            LogError("unable to create the subscription announcement");
+            free_handle_data(result);
+            result = NULL;
+        }
+        else if ((result->lock = Lock_Init()) == NULL)
+        {
+            LogError("Lock_Init failed");
+            free_handle_data(result);
+            result = NULL;
+        }
+        else if ((result->clock = tickcounter_create()) == NULL)
+        {
+            LogError("tickcounter_create failed");
+            free_handle_data(result);
+            result = NULL;
+        }
+        /*Codes_SRS_BRIDGE_31_010: [ `Bridge_Create` shall open a `NN_PAIR` socket, bound to `endpoint` when `listen` is true and connected to it otherwise. ]*/
+        else if ((result->socket = nn_socket(AF_SP, NN_PAIR)) < 0)
+        {
+            LogError("nn_socket failed");
+            free_handle_data(result);
+            result = NULL;
+        }
+        else if (nn_setsockopt(result->socket, NN_SOL_SOCKET, NN_RCVTIMEO, &receive_timeout, sizeof(receive_timeout)) < 0)
+        {
+            LogError("nn_setsockopt failed");
+            free_handle_data(result);
+            result = NULL;
+        }
+        else if ((config->listen ? nn_bind(result->socket, config->endpoint) : nn_connect(result->socket, config->endpoint)) < 0)
+        {
+            LogError("unable to %s %s", (config->listen ? "bind to" : "connect to"), config->endpoint);
+            free_handle_data(result);
+            result = NULL;
+        }
+        else
+        {
+            /*all is fine*/
+        }
+    }
+
+    return result;
+}
+
+static void Bridge_Start(MODULE_HANDLE moduleHandle)
+{
+    if (moduleHandle == NULL)
+    {
+        LogError("Attempt to start NULL module");
+    }
+    else
+    {
+        /*Codes_SRS_BRIDGE_31_012: [ `Bridge_Start` shall announce the subscriptions to the peer and start the worker thread. ]*/
+        BRIDGE_HANDLE_DATA * handleData = (BRIDGE_HANDLE_DATA *)moduleHandle;
+
+        send_announcement(handleData);
+        if (tickcounter_get_current_ms(handleData->clock, &handleData->last_announcement) != 0)
+        {
+            LogError("unable to read the clock");
+        }
+
+        handleData->running = true;
+        if (ThreadAPI_Create(&handleData->thread, bridge_worker, handleData) != THREADAPI_OK)
+        {
+            /*Codes_SRS_BRIDGE_31_027: [ If the worker thread cannot be started, `Bridge_Start` shall close the socket and count an error, and the messages received afterwards shall be dropped and counted. ]*/
+            LogError("ThreadAPI_Create failed, closing the connection to the peer");
+            handleData->thread = NULL;
+            handleData->running = false;
+            if (Lock(handleData->lock) != LOCK_OK)
+            {
+                LogError("unable to lock");
+            }
+            else
+            {
+                (void)nn_close(handleData->socket);
+                handleData->socket = -1;
+                handleData->counters.errors++;
+                (void)Unlock(handleData->lock);
+            }
+        }
+    }
+}
+
+static void Bridge_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE messageHandle)
+{
+    /*Codes_SRS_BRIDGE_31_013: [ If `moduleHandle` or `messageHandle` is NULL then `Bridge_Receive` shall return. ]*/
+    if ((moduleHandle == NULL) || (messageHandle == NULL))
+    {
+        LogError("invalid arg moduleHandle=%p messageHandle=%p", moduleHandle, messageHandle);
+    }
+    else
+    {
+        BRIDGE_HANDLE_DATA * handleData = (BRIDGE_HANDLE_DATA *)moduleHandle;
+        CONSTMAP_HANDLE properties = Message_GetProperties(messageHandle);
+        if (properties == NULL)
+        {
+            LogError("Message_GetProperties failed");
+        }
+        else
+        {
+            const char * stream = ConstMap_GetValue(properties, handleData->stream_property);
+            if (Lock(handleData->lock) != LOCK_OK)
+            {
+                LogError("unable to lock");
+            }
+            else
+            {
+                if (handleData->socket < 0)
+                {
+                    /*Codes_SRS_BRIDGE_31_027: [ If the worker thread cannot be started, `Bridge_Start` shall close the socket and count an error, and the messages received afterwards shall be dropped and counted. ]*/
+                    handleData->counters.messages_dropped++;
+                }
+                else if (!is_subscribed(handleData, stream))
+                {
+                    /*Codes_SRS_BRIDGE_31_014: [ If the peer did not subscribe to the stream of the message, `Bridge_Receive` shall count it as filtered and not forward it. ]*/
+                    handleData->counters.messages_filtered++;
+                }
+                else
+                {
+                    /*Codes_SRS_BRIDGE_31_015: [ `Bridge_Receive` shall serialize the message into the current batch frame with Message_ToByteArray. ]*/
+                    int32_t size = Message_ToByteArray(messageHandle, NULL, 0);
+                    if ((size <= 0) ||
+                        (reserve_batch(handleData, BRIDGE_ENTRY_HEADER_SIZE + (size_t)size) != 0) ||
+                        (Message_ToByteArray(messageHandle, handleData->batch + handleData->batch_used + BRIDGE_ENTRY_HEADER_SIZE, size) < 0))
+                    {
+                        LogError("unable to serialize the message");
+                        handleData->counters.errors++;
+                    }
+                    else
+                    {
+                        write_uint32(handleData->batch + handleData->batch_used, (uint32_t)size);
+                        handleData->batch_used += BRIDGE_ENTRY_HEADER_SIZE + (size_t)size;
+                        if ((handleData->batch_count++ == 0) && (tickcounter_get_current_ms(handleData->clock, &handleData->batch_started) != 0))
+                        {
+                            LogError("unable to read the clock");
+                        }
+
+                        /*Codes_SRS_BRIDGE_31_016: [ Once the batch holds `batch_size` messages, it shall be sent to the peer without blocking. ]*/
+                        if (handleData->batch_count >= handleData->batch_size)
+                        {
+                            flush_batch(handleData);
+                        }
+                    }
+                }
+                (void)Unlock(handleData->lock);
+            }
+            ConstMap_Destroy(properties);
+        }
+    }
+}
+
+static void Bridge_Destroy(MODULE_HANDLE moduleHandle)
+{
+    /*Codes_SRS_BRIDGE_31_022: [ If `moduleHandle` is NULL then `Bridge_Destroy` shall return. ]*/
+    if (moduleHandle == NULL)
+    {
+        LogError("Attempt to destroy NULL module");
+    }
+    else
+    {
+        /*Codes_SRS_BRIDGE_31_023: [ `Bridge_Destroy` shall stop the worker thread, send the pending batch, close the socket and release all resources. ]*/
+        BRIDGE_HANDLE_DATA * handleData = (BRIDGE_HANDLE_DATA *)moduleHandle;
+
+        if (handleData->thread != NULL)
+        {
+            int thread_result;
+
+            if (Lock(handleData->lock) != LOCK_OK)
+            {
+                LogError("unable to lock, stopping the bridge thread anyway");
+                handleData->running = false;
+            }
+            else
+            {
+                handleData->running = false;
+                (void)Unlock(handleData->lock);
+            }
+
+            if (ThreadAPI_Join(handleData->thread, &thread_result) != THREADAPI_OK)
+            {
+                LogError("ThreadAPI_Join failed");
+            }
+        }
+
+        flush_batch(handleData);
+        LogInfo("bridge: %zu messages sent in %zu frames, %zu received, %zu filtered, %zu dropped, %zu errors",
+            handleData->counters.messages_sent, handleData->counters.frames_sent, handleData->counters.messages_received,
+            handleData->counters.messages_filtered, handleData->counters.messages_dropped, handleData->counters.errors);
+        free_handle_data(handleData);
+    }
+}
+
+static int parse_subscriptions(const JSON_Array * subscribe, BRIDGE_CONFIG * config)
+{
+    int result = 0;
+    size_t count = (subscribe == NULL) ? 0 : json_array_get_count(subscribe);
+
+    if (count != 0)
+    {
+        if ((config->subscriptions = (char **)malloc(count * sizeof(char *))) == NULL)
+        {
+            LogError("malloc failed");
+            result = __LINE__;
+        }
+        else
+        {
+            size_t i;
+            for (i = 0; (i < count) && (result == 0); ++i)
+            {
+                const char * stream = json_array_get_string(subscribe, i);
+                if (stream == NULL)
+                {
+                    LogError("\"subscribe\" shall only contain stream names");
+                    result = __LINE__;
+                }
+                else if (mallocAndStrcpy_s(&config->subscriptions[i], stream) != 0)
+                {
+                    LogError("unable to copy the stream name");
+                    result = __LINE__;
+                }
+                else
+                {
+                    config->subscription_count++;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+static void Bridge_FreeConfiguration(void* configuration)
+{
+    if (configuration == NULL)
+    {
+        /*Codes_SRS_BRIDGE_31_006: [ `Bridge_FreeConfiguration` shall do nothing if `configuration` is NULL. ]*/
+        LogError("configuration is NULL");
+    }
+    else
+    {
+        /*Codes_SRS_BRIDGE_31_007: [ `Bridge_FreeConfiguration` shall free all resources created by `Bridge_ParseConfigurationFromJson`. ]*/
+        BRIDGE_CONFIG * config = (BRIDGE_CONFIG *)configuration;
+        size_t i;
+
+        for (i = 0; i < config->subscription_count; ++i)
+        {
+            free(config->subscriptions[i]);
+        }
+        free(config->subscriptions);
+        free(config->stream_property);
+        free(config->endpoint);
+        free(config);
+    }
+}
+
+static void* Bridge_ParseConfigurationFromJson(const char* configuration)
+{
+    BRIDGE_CONFIG * result;
+
+    if (configuration == NULL)
+    {
+        /*Codes_SRS_BRIDGE_31_001: [ If `configuration` is NULL then `Bridge_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+        LogError("NULL parameter detected configuration=%p", configuration);
+        result = NULL;
+    }
+    else
+    {
+        /*Codes_SRS_BRIDGE_31_002: [ If `configuration` is not a JSON object, then `Bridge_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+        JSON_Value * json = json_parse_string(configuration);
+        if (json == NULL)
+        {
+            LogError("unable to json_parse_string");
+            result = NULL;
+        }
+        else
+        {
+            JSON_Object * obj = json_value_get_object(json);
+            const char * endpoint;
+
+            if (obj == NULL)
+            {
+                LogError("unable to json_value_get_object");
+                result = NULL;
+            }
+            else if ((endpoint = json_object_get_string(obj, "endpoint")) == NULL)
+            {
+                /*Codes_SRS_BRIDGE_31_003: [ If the JSON object does not contain a string named "endpoint" then `Bridge_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+                LogError("\"endpoint\" is missing from the bridge configuration");
+                result = NULL;
+            }
+            else if ((result = (BRIDGE_CONFIG *)malloc(sizeof(BRIDGE_CONFIG))) == NULL)
+            {
+                /*Codes_SRS_BRIDGE_31_005: [ If any system call fails, `Bridge_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+                LogError("malloc failed");
+            }
+            else
+            {
+                /*Codes_SRS_BRIDGE_31_004: [ `Bridge_ParseConfigurationFromJson` shall return a new `BRIDGE_CONFIG` with the values read from the JSON object, or their defaults. ]*/
+                const char * stream_property = json_object_get_string(obj, "stream.property");
+                double batch_size = json_object_get_number(obj, "batch.size");
+                double batch_timeout = json_object_get_number(obj, "batch.timeout");
+
+                (void)memset(result, 0, sizeof(BRIDGE_CONFIG));
+                result->listen = (json_object_get_boolean(obj, "listen") == 1);
+                result->batch_size = (batch_size >= 1) ? (size_t)batch_size : BRIDGE_DEFAULT_BATCH_SIZE;
+                result->batch_timeout = (batch_timeout >= 1) ? (unsigned int)batch_timeout : BRIDGE_DEFAULT_BATCH_TIMEOUT;
+
+                if ((mallocAndStrcpy_s(&result->endpoint, endpoint) != 0) ||
+                    (mallocAndStrcpy_s(&result->stream_property, (stream_property == NULL) ? GW_SOURCE_PROPERTY : stream_property) != 0) ||
+                    (parse_subscriptions(json_object_get_array(obj, "subscribe"), result) != 0))
+                {
+                    /*Codes_SRS_BRIDGE_31_005: [ If any system call fails, `Bridge_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+                    LogError("unable to read the bridge configuration");
+                    Bridge_FreeConfiguration(result);
+                    result = NULL;
+                }
+            }
+            json_value_free(json);
+        }
+    }
+
+    return result;
+}
+
+int Bridge_GetCounters(MODULE_HANDLE module, BRIDGE_COUNTERS * counters)
+{
+    int result;
+
+    if ((module == NULL) || (counters == NULL))
+    {
+        /*Codes_SRS_BRIDGE_31_024: [ If `module` or `counters` is NULL then `Bridge_GetCounters` shall return a non-zero value. ]*/
+        LogError("invalid arg module=%p counters=%p", module, counters);
+        result = __LINE__;
+    }
+    else
+    {
+        BRIDGE_HANDLE_DATA * handleData = (BRIDGE_HANDLE_DATA *)module;
+        if (Lock(handleData->lock) != LOCK_OK)
+        {
+            LogError("unable to lock");
+            result = __LINE__;
+        }
+        else
+        {
+            /*Codes_SRS_BRIDGE_31_025: [ `Bridge_GetCounters` shall copy the counters of the bridge into `counters` and return zero. ]*/
+            *counters = handleData->counters;
+            (void)Unlock(handleData->lock);
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+/*
+ *    Required for all modules:  the public API and the designated implementation functions.
+ */
+static const MODULE_API_1 Bridge_APIS_all =
+{
+    {MODULE_API_VERSION_1},
+
+    Bridge_ParseConfigurationFromJson,
+    Bridge_FreeConfiguration,
+    Bridge_Create,
+    Bridge_Destroy,
+    Bridge_Receive,
+    Bridge_Start
+};
+
+#ifdef BUILD_MODULE_TYPE_STATIC
+MODULE_EXPORT const MODULE_API* MODULE_STATIC_GETAPI(BRIDGE_MODULE)(MODULE_API_VERSION gateway_api_version)
+#else
+MODULE_EXPORT const MODULE_API* Module_GetApi(MODULE_API_VERSION gateway_api_version)
+#endif
+{
+    /*Codes_SRS_BRIDGE_31_026: [ `Module_GetApi` shall return a pointer to a `MODULE_API` structure with the required function pointers. ]*/
+    (void)gateway_api_version;
+    return (const MODULE_API *)&Bridge_APIS_all;
+}
@@ -0,0 +1,694 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstring>
+#else
+#include <stdlib.h>
+#include <string.h>
+#endif
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+#include "umocktypes_bool.h"
+
+#include <nanomsg/nn.h>
+#include <nanomsg/pair.h>
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void* my_gballoc_realloc(void* ptr, size_t size)
+{
+    return realloc(ptr, size);
+}
+
+static void my_gballoc_free(void* s)
+{
+    free(s);
+}
+
+#define GATEWAY_EXPORT_H
+#define GATEWAY_EXPORT
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/constmap.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/tickcounter.h"
+#include "broker.h"
+#include "message.h"
+#include "parson.h"
+
+MOCKABLE_FUNCTION(, JSON_Value*, json_parse_string, const char *, string);
+MOCKABLE_FUNCTION(, JSON_Object*, json_value_get_object, const JSON_Value *, value);
+MOCKABLE_FUNCTION(, const char*, json_object_get_string, const JSON_Object *, object, const char *, name);
+MOCKABLE_FUNCTION(, double, json_object_get_number, const JSON_Object *, object, const char *, name);
+MOCKABLE_FUNCTION(, int, json_object_get_boolean, const JSON_Object *, object, const char *, name);
+MOCKABLE_FUNCTION(, JSON_Array*, json_object_get_array, const JSON_Object *, object, const char *, name);
+MOCKABLE_FUNCTION(, size_t, json_array_get_count, const JSON_Array *, array);
+MOCKABLE_FUNCTION(, const char*, json_array_get_string, const JSON_Array *, array, size_t, index);
+MOCKABLE_FUNCTION(, void, json_value_free, JSON_Value *, value);
+
+#undef ENABLE_MOCKS
+
+#include "bridge.h"
+#include "module_access.h"
+
+#define MOCK_BROKER (BROKER_HANDLE)0x42
+#define MOCK_LOCK (LOCK_HANDLE)0x43
+#define MOCK_TICKCOUNTER (TICK_COUNTER_HANDLE)0x44
+#define MOCK_PROPERTIES (CONSTMAP_HANDLE)0x45
+#define MOCK_MESSAGE (MESSAGE_HANDLE)0x46
+#define MOCK_JSON_VALUE (JSON_Value *)0x47
+#define MOCK_JSON_OBJECT (JSON_Object *)0x48
+#define MOCK_JSON_ARRAY (JSON_Array *)0x49
+#define MOCK_THREAD (THREAD_HANDLE)0x4A
+
+#define MOCK_SOCKET 7
+#define MOCK_MESSAGE_SIZE 4
+
+static void * sent_frame;
+
+/* the worker thread started by Bridge_Start, run by receive_from_peer */
+static THREAD_START_FUNC worker_thread;
+static void * worker_arg;
+static bool in_worker;
+static bool stop_worker;
+static const unsigned char * peer_frame;
+static size_t peer_frame_size;
+
+MOCK_FUNCTION_WITH_CODE(, void *, nn_allocmsg, size_t, size, int, type)
+MOCK_FUNCTION_END(malloc(size))
+
+MOCK_FUNCTION_WITH_CODE(, void *, nn_reallocmsg, void *, msg, size_t, size)
+MOCK_FUNCTION_END(realloc(msg, size))
+
+MOCK_FUNCTION_WITH_CODE(, int, nn_freemsg, void *, msg)
+    free(msg);
+MOCK_FUNCTION_END(0)
+
+MOCK_FUNCTION_WITH_CODE(, int, nn_socket, int, domain, int, protocol)
+MOCK_FUNCTION_END(MOCK_SOCKET)
+
+MOCK_FUNCTION_WITH_CODE(, int, nn_setsockopt, int, s, int, level, int, option, const void *, optval, size_t, optvallen)
+MOCK_FUNCTION_END(0)
+
+MOCK_FUNCTION_WITH_CODE(, int, nn_bind, int, s, const char *, addr)
+MOCK_FUNCTION_END(1)
+
+MOCK_FUNCTION_WITH_CODE(, int, nn_connect, int, s, const char *, addr)
+MOCK_FUNCTION_END(1)
+
+MOCK_FUNCTION_WITH_CODE(, int, nn_close, int, s)
+MOCK_FUNCTION_END(0)
+
+MOCK_FUNCTION_WITH_CODE(, int, nn_send, int, s, const void *, buf, size_t, len, int, flags)
+    if (len == NN_MSG)
+    {
+        sent_frame = *(void **)buf;
+    }
+MOCK_FUNCTION_END(0)
+
+MOCK_FUNCTION_WITH_CODE(, int, nn_recv, int, s, void *, buf, size_t, len, int, flags)
+    int result = -1;
+    if (peer_frame != NULL)
+    {
+        void * frame = malloc(peer_frame_size);
+        (void)memcpy(frame, peer_frame, peer_frame_size);
+        *(void **)buf = frame;
+        result = (int)peer_frame_size;
+        peer_frame = NULL;
+    }
+MOCK_FUNCTION_END(result)
+
+MOCK_FUNCTION_WITH_CODE(, int, nn_errno)
+MOCK_FUNCTION_END(ETIMEDOUT)
+
+static int my_mallocAndStrcpy_s(char** destination, const char* source)
+{
+    *destination = (char *)malloc(strlen(source) + 1);
+    (void)strcpy(*destination, source);
+    return 0;
+}
+
+static int32_t my_Message_ToByteArray(MESSAGE_HANDLE messageHandle, unsigned char * buf, int32_t size)
+{
+    (void)messageHandle;
+    if (buf != NULL)
+    {
+        (void)memset(buf, 0xA5, size);
+    }
+    return MOCK_MESSAGE_SIZE;
+}
+
+static THREADAPI_RESULT my_ThreadAPI_Create(THREAD_HANDLE * threadHandle, THREAD_START_FUNC func, void * arg)
+{
+    *threadHandle = MOCK_THREAD;
+    worker_thread = func;
+    worker_arg = arg;
+    return THREADAPI_OK;
+}
+
+static int my_tickcounter_get_current_ms(TICK_COUNTER_HANDLE tick_counter, tickcounter_ms_t * current_ms)
+{
+    (void)tick_counter;
+    *current_ms = 0;
+    /* the worker reads the clock once the frame is processed, its next lock ends the pass */
+    stop_worker = in_worker;
+    return 0;
+}
+
+static LOCK_RESULT my_Lock(LOCK_HANDLE handle)
+{
+    LOCK_RESULT result = LOCK_OK;
+    (void)handle;
+    if (stop_worker)
+    {
+        stop_worker = false;
+        result = LOCK_ERROR;
+    }
+    return result;
+}
+
+/* runs one pass of the worker thread, in which nn_recv returns frame from the peer */
+static void receive_from_peer(const unsigned char * frame, size_t size)
+{
+    ASSERT_IS_NOT_NULL(worker_thread);
+    peer_frame = frame;
+    peer_frame_size = size;
+    in_worker = true;
+    (void)worker_thread(worker_arg);
+    in_worker = false;
+}
+
+static const unsigned char SUBSCRIBE_TELEMETRY[] = { 0x01, 0x01, 0x00, 0x00, 0x00, 0x01, 't', 'e', 'l', 'e', 'm', 'e', 't', 'r', 'y', '\0' };
+static const unsigned char BATCH_OF_ONE[] = { 0x01, 0x02, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x02, 0xA5, 0xA5 };
+static const unsigned char TRUNCATED_BATCH[] = { 0x01, 0x02, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x02, 0xA5, 0xA5 };
+
+static char * subscriptions[] = { (char *)"telemetry" };
+
+static BRIDGE_CONFIG make_config(size_t batch_size)
+{
+    BRIDGE_CONFIG config;
+    config.endpoint = (char *)"tcp://127.0.0.1:6100";
+    config.listen = false;
+    config.stream_property = (char *)"source";
+    config.subscriptions = subscriptions;
+    config.subscription_count = 1;
+    config.batch_size = batch_size;
+    config.batch_timeout = 10;
+    return config;
+}
+
+#ifdef WIN32
+static TEST_MUTEX_HANDLE g_dllByDll;
+#endif
+static TEST_MUTEX_HANDLE g_testByTest;
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+
+BEGIN_TEST_SUITE(bridge_ut)
+
+TEST_SUITE_INITIALIZE(suite_init)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+    umocktypes_charptr_register_types();
+    umocktypes_stdint_register_types();
+    umocktypes_bool_register_types();
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_realloc, my_gballoc_realloc);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+    REGISTER_GLOBAL_MOCK_HOOK(mallocAndStrcpy_s, my_mallocAndStrcpy_s);
+    REGISTER_GLOBAL_MOCK_HOOK(Message_ToByteArray, my_Message_ToByteArray);
+    REGISTER_GLOBAL_MOCK_HOOK(ThreadAPI_Create, my_ThreadAPI_Create);
+    REGISTER_GLOBAL_MOCK_HOOK(tickcounter_get_current_ms, my_tickcounter_get_current_ms);
+    REGISTER_GLOBAL_MOCK_HOOK(Lock, my_Lock);
+    REGISTER_GLOBAL_MOCK_RETURN(Lock_Init, MOCK_LOCK);
+    REGISTER_GLOBAL_MOCK_RETURN(tickcounter_create, MOCK_TICKCOUNTER);
+    REGISTER_GLOBAL_MOCK_RETURN(Message_GetProperties, MOCK_PROPERTIES);
+    REGISTER_GLOBAL_MOCK_RETURN(Message_CreateFromByteArray, MOCK_MESSAGE);
+
+    REGISTER_UMOCK_ALIAS_TYPE(BROKER_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(BROKER_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(CONSTMAP_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(MESSAGE_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(MODULE_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(THREAD_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(THREAD_HANDLE*, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(THREAD_START_FUNC, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(THREADAPI_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(TICK_COUNTER_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(tickcounter_ms_t*, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(char**, void*);
+}
+
+TEST_SUITE_CLEANUP(suite_cleanup)
+{
+    umock_c_deinit();
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(method_init)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest))
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    sent_frame = NULL;
+    worker_thread = NULL;
+    worker_arg = NULL;
+    in_worker = false;
+    stop_worker = false;
+    peer_frame = NULL;
+    umock_c_reset_all_calls();
+}
+
+TEST_FUNCTION_CLEANUP(method_cleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+/* Tests_SRS_BRIDGE_31_026: [ `Module_GetApi` shall return a pointer to a `MODULE_API` structure with the required function pointers. ] */
+TEST_FUNCTION(BRIDGE_Module_GetApi_returns_non_NULL)
+{
+    // arrange
+
+    // act
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+
+    // assert
+    ASSERT_IS_TRUE(MODULE_PARSE_CONFIGURATION_FROM_JSON(apis) != NULL);
+    ASSERT_IS_TRUE(MODULE_FREE_CONFIGURATION(apis) != NULL);
+    ASSERT_IS_TRUE(MODULE_CREATE(apis) != NULL);
+    ASSERT_IS_TRUE(MODULE_DESTROY(apis) != NULL);
+    ASSERT_IS_TRUE(MODULE_RECEIVE(apis) != NULL);
+    ASSERT_IS_TRUE(MODULE_START(apis) != NULL);
+}
+
+/* Tests_SRS_BRIDGE_31_001: [ If `configuration` is NULL then `Bridge_ParseConfigurationFromJson` shall fail and return NULL. ] */
+TEST_FUNCTION(BRIDGE_ParseConfigurationFromJson_returns_NULL_when_configuration_is_NULL)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+
+    // act
+    void* result = MODULE_PARSE_CONFIGURATION_FROM_JSON(apis)(NULL);
+
+    // assert
+    ASSERT_IS_NULL(result);
+}
+
+/* Tests_SRS_BRIDGE_31_003: [ If the JSON object does not contain a string named "endpoint" then `Bridge_ParseConfigurationFromJson` shall fail and return NULL. ] */
+TEST_FUNCTION(BRIDGE_ParseConfigurationFromJson_returns_NULL_when_endpoint_is_missing)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+
+    STRICT_EXPECTED_CALL(json_parse_string("{}"))
+        .SetReturn(MOCK_JSON_VALUE);
+    STRICT_EXPECTED_CALL(json_value_get_object(MOCK_JSON_VALUE))
+        .SetReturn(MOCK_JSON_OBJECT);
+    STRICT_EXPECTED_CALL(json_object_get_string(MOCK_JSON_OBJECT, "endpoint"))
+        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(json_value_free(MOCK_JSON_VALUE));
+
+    // act
+    void* result = MODULE_PARSE_CONFIGURATION_FROM_JSON(apis)("{}");
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_BRIDGE_31_002: [ If `configuration` is not a JSON object, then `Bridge_ParseConfigurationFromJson` shall fail and return NULL. ] */
+/* Tests_SRS_BRIDGE_31_004: [ `Bridge_ParseConfigurationFromJson` shall return a new `BRIDGE_CONFIG` with the values read from the JSON object, or their defaults. ] */
+/* Tests_SRS_BRIDGE_31_007: [ `Bridge_FreeConfiguration` shall free all resources created by `Bridge_ParseConfigurationFromJson`. ] */
+TEST_FUNCTION(BRIDGE_ParseConfigurationFromJson_success_with_defaults)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    BRIDGE_CONFIG * config;
+
+    STRICT_EXPECTED_CALL(json_parse_string("{...}"))
+        .SetReturn(MOCK_JSON_VALUE);
+    STRICT_EXPECTED_CALL(json_value_get_object(MOCK_JSON_VALUE))
+        .SetReturn(MOCK_JSON_OBJECT);
+    STRICT_EXPECTED_CALL(json_object_get_string(MOCK_JSON_OBJECT, "endpoint"))
+        .SetReturn("tcp://127.0.0.1:6100");
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(json_object_get_string(MOCK_JSON_OBJECT, "stream.property"))
+        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(json_object_get_number(MOCK_JSON_OBJECT, "batch.size"))
+        .SetReturn(0);
+    STRICT_EXPECTED_CALL(json_object_get_number(MOCK_JSON_OBJECT, "batch.timeout"))
+        .SetReturn(0);
+    STRICT_EXPECTED_CALL(json_object_get_boolean(MOCK_JSON_OBJECT, "listen"))
+        .SetReturn(-1);
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, "tcp://127.0.0.1:6100"))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, "source"))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(json_object_get_array(MOCK_JSON_OBJECT, "subscribe"))
+        .SetReturn(MOCK_JSON_ARRAY);
+    STRICT_EXPECTED_CALL(json_array_get_count(MOCK_JSON_ARRAY))
+        .SetReturn(1);
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(json_array_get_string(MOCK_JSON_ARRAY, 0))
+        .SetReturn("telemetry");
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, "telemetry"))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(json_value_free(MOCK_JSON_VALUE));
+
+    // act
+    config = (BRIDGE_CONFIG *)MODULE_PARSE_CONFIGURATION_FROM_JSON(apis)("{...}");
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NOT_NULL(config);
+    ASSERT_ARE_EQUAL(char_ptr, "tcp://127.0.0.1:6100", config->endpoint);
+    ASSERT_IS_FALSE(config->listen);
+    ASSERT_ARE_EQUAL(char_ptr, "source", config->stream_property);
+    ASSERT_ARE_EQUAL(size_t, 1, config->subscription_count);
+    ASSERT_ARE_EQUAL(char_ptr, "telemetry", config->subscriptions[0]);
+    ASSERT_ARE_EQUAL(size_t, 16, config->batch_size);
+    ASSERT_ARE_EQUAL(int, 10, (int)config->batch_timeout);
+
+    // cleanup
+    MODULE_FREE_CONFIGURATION(apis)(config);
+}
+
+/* Tests_SRS_BRIDGE_31_008: [ If `broker` or `configuration` is NULL then `Bridge_Create` shall fail and return NULL. ] */
+TEST_FUNCTION(BRIDGE_Create_returns_NULL_when_broker_is_NULL)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    BRIDGE_CONFIG config = make_config(2);
+
+    // act
+    MODULE_HANDLE result = MODULE_CREATE(apis)(NULL, &config);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_BRIDGE_31_009: [ If `endpoint` or `stream_property` is NULL, or `batch_size` is zero, then `Bridge_Create` shall fail and return NULL. ] */
+TEST_FUNCTION(BRIDGE_Create_returns_NULL_when_batch_size_is_zero)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    BRIDGE_CONFIG config = make_config(0);
+
+    // act
+    MODULE_HANDLE result = MODULE_CREATE(apis)(MOCK_BROKER, &config);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_BRIDGE_31_010: [ `Bridge_Create` shall open a `NN_PAIR` socket, bound to `endpoint` when `listen` is true and connected to it otherwise. ] */
+/* Tests_SRS_BRIDGE_31_023: [ `Bridge_Destroy` shall stop the worker thread, send the pending batch, close the socket and release all resources. ] */
+TEST_FUNCTION(BRIDGE_Create_connects_to_the_peer)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    BRIDGE_CONFIG config = make_config(2);
+    MODULE_HANDLE result;
+
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, "source"))
+        .IgnoreArgument(1);
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Lock_Init());
+    STRICT_EXPECTED_CALL(tickcounter_create());
+    STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR));
+    STRICT_EXPECTED_CALL(nn_setsockopt(MOCK_SOCKET, NN_SOL_SOCKET, NN_RCVTIMEO, IGNORED_PTR_ARG, sizeof(int)))
+        .IgnoreArgument(4);
+    STRICT_EXPECTED_CALL(nn_connect(MOCK_SOCKET, "tcp://127.0.0.1:6100"));
+
+    // act
+    result = MODULE_CREATE(apis)(MOCK_BROKER, &config);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NOT_NULL(result);
+
+    // cleanup
+    umock_c_reset_all_calls();
+    MODULE_DESTROY(apis)(result);
+    ASSERT_IS_TRUE(NULL != strstr(umock_c_get_actual_calls(), "[nn_close(7)]"));
+}
+
+/* Tests_SRS_BRIDGE_31_011: [ If any step fails, `Bridge_Create` shall release all resources and return NULL. ] */
+TEST_FUNCTION(BRIDGE_Create_returns_NULL_when_the_peer_cannot_be_reached)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    BRIDGE_CONFIG config = make_config(2);
+    MODULE_HANDLE result;
+
+    config.listen = true;
+    STRICT_EXPECTED_CALL(nn_bind(MOCK_SOCKET, "tcp://127.0.0.1:6100"))
+        .SetReturn(-1);
+
+    // act
+    result = MODULE_CREATE(apis)(MOCK_BROKER, &config);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_IS_TRUE(NULL != strstr(umock_c_get_actual_calls(), "[nn_close(7)]"));
+    ASSERT_IS_TRUE(NULL != strstr(umock_c_get_actual_calls(), "[tickcounter_destroy("));
+    ASSERT_IS_TRUE(NULL != strstr(umock_c_get_actual_calls(), "[Lock_Deinit("));
+}
+
+/* Tests_SRS_BRIDGE_31_027: [ If the worker thread cannot be started, `Bridge_Start` shall close the socket and count an error, and the messages received afterwards shall be dropped and counted. ] */
+TEST_FUNCTION(BRIDGE_Start_closes_the_socket_when_the_thread_cannot_start)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    BRIDGE_CONFIG config = make_config(2);
+    BRIDGE_COUNTERS counters;
+    MODULE_HANDLE bridge = MODULE_CREATE(apis)(MOCK_BROKER, &config);
+    ASSERT_IS_NOT_NULL(bridge);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(nn_send(MOCK_SOCKET, IGNORED_PTR_ARG, IGNORED_NUM_ARG, NN_DONTWAIT))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(MOCK_TICKCOUNTER, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments()
+        .SetReturn(THREADAPI_ERROR);
+    STRICT_EXPECTED_CALL(Lock(MOCK_LOCK));
+    STRICT_EXPECTED_CALL(nn_close(MOCK_SOCKET));
+    STRICT_EXPECTED_CALL(Unlock(MOCK_LOCK));
+
+    // act
+    MODULE_START(apis)(bridge);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    REGISTER_GLOBAL_MOCK_RETURN(ConstMap_GetValue, "telemetry");
+    MODULE_RECEIVE(apis)(bridge, MOCK_MESSAGE);
+    ASSERT_ARE_EQUAL(int, 0, Bridge_GetCounters(bridge, &counters));
+    ASSERT_ARE_EQUAL(size_t, 1, counters.errors);
+    ASSERT_ARE_EQUAL(size_t, 1, counters.messages_dropped);
+    ASSERT_ARE_EQUAL(size_t, 0, counters.messages_sent);
+
+    // cleanup
+    REGISTER_GLOBAL_MOCK_RETURN(ConstMap_GetValue, NULL);
+    umock_c_reset_all_calls();
+    MODULE_DESTROY(apis)(bridge);
+    ASSERT_IS_NULL(strstr(umock_c_get_actual_calls(), "[nn_close("));
+}
+
+/* Tests_SRS_BRIDGE_31_014: [ If the peer did not subscribe to the stream of the message, `Bridge_Receive` shall count it as filtered and not forward it. ] */
+/* Tests_SRS_BRIDGE_31_025: [ `Bridge_GetCounters` shall copy the counters of the bridge into `counters` and return zero. ] */
+TEST_FUNCTION(BRIDGE_Receive_filters_streams_without_remote_subscriber)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    BRIDGE_CONFIG config = make_config(2);
+    BRIDGE_COUNTERS counters;
+    MODULE_HANDLE bridge = MODULE_CREATE(apis)(MOCK_BROKER, &config);
+    ASSERT_IS_NOT_NULL(bridge);
+    MODULE_START(apis)(bridge);
+    receive_from_peer(SUBSCRIBE_TELEMETRY, sizeof(SUBSCRIBE_TELEMETRY));
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Message_GetProperties(MOCK_MESSAGE));
+    STRICT_EXPECTED_CALL(ConstMap_GetValue(MOCK_PROPERTIES, "source"))
+        .SetReturn("alerts");
+    STRICT_EXPECTED_CALL(Lock(MOCK_LOCK));
+    STRICT_EXPECTED_CALL(Unlock(MOCK_LOCK));
+    STRICT_EXPECTED_CALL(ConstMap_Destroy(MOCK_PROPERTIES));
+
+    // act
+    MODULE_RECEIVE(apis)(bridge, MOCK_MESSAGE);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, Bridge_GetCounters(bridge, &counters));
+    ASSERT_ARE_EQUAL(size_t, 1, counters.messages_filtered);
+    ASSERT_ARE_EQUAL(size_t, 0, counters.messages_sent);
+
+    // cleanup
+    MODULE_DESTROY(apis)(bridge);
+}
+
+/* Tests_SRS_BRIDGE_31_015: [ `Bridge_Receive` shall serialize the message into the current batch frame with Message_ToByteArray. ] */
+/* Tests_SRS_BRIDGE_31_016: [ Once the batch holds `batch_size` messages, it shall be sent to the peer without blocking. ] */
+/* Tests_SRS_BRIDGE_31_017: [ A SUBSCRIBE frame from the peer shall replace the set of streams forwarded to the peer. ] */
+TEST_FUNCTION(BRIDGE_Receive_sends_a_full_batch)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    BRIDGE_CONFIG config = make_config(2);
+    BRIDGE_COUNTERS counters;
+    unsigned char * frame;
+    MODULE_HANDLE bridge = MODULE_CREATE(apis)(MOCK_BROKER, &config);
+    ASSERT_IS_NOT_NULL(bridge);
+    MODULE_START(apis)(bridge);
+    receive_from_peer(SUBSCRIBE_TELEMETRY, sizeof(SUBSCRIBE_TELEMETRY));
+    REGISTER_GLOBAL_MOCK_RETURN(ConstMap_GetValue, "telemetry");
+    MODULE_RECEIVE(apis)(bridge, MOCK_MESSAGE);
+    ASSERT_IS_NULL(sent_frame);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Message_GetProperties(MOCK_MESSAGE));
+    STRICT_EXPECTED_CALL(ConstMap_GetValue(MOCK_PROPERTIES, "source"));
+    STRICT_EXPECTED_CALL(Lock(MOCK_LOCK));
+    STRICT_EXPECTED_CALL(Message_ToByteArray(MOCK_MESSAGE, NULL, 0));
+    STRICT_EXPECTED_CALL(Message_ToByteArray(MOCK_MESSAGE, IGNORED_PTR_ARG, MOCK_MESSAGE_SIZE))
+        .IgnoreArgument(2);
+    EXPECTED_CALL(nn_reallocmsg(IGNORED_PTR_ARG, 6 + 2 * (4 + MOCK_MESSAGE_SIZE)))
+        .ValidateArgument(2);
+    STRICT_EXPECTED_CALL(nn_send(MOCK_SOCKET, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(Unlock(MOCK_LOCK));
+    STRICT_EXPECTED_CALL(ConstMap_Destroy(MOCK_PROPERTIES));
+
+    // act
+    MODULE_RECEIVE(apis)(bridge, MOCK_MESSAGE);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NOT_NULL(sent_frame);
+    frame = (unsigned char *)sent_frame;
+    ASSERT_ARE_EQUAL(int, 0x01, frame[0]);
+    ASSERT_ARE_EQUAL(int, 0x02, frame[1]);
+    ASSERT_ARE_EQUAL(int, 2, frame[5]);
+    ASSERT_ARE_EQUAL(int, MOCK_MESSAGE_SIZE, frame[9]);
+    ASSERT_ARE_EQUAL(int, 0, Bridge_GetCounters(bridge, &counters));
+    ASSERT_ARE_EQUAL(size_t, 2, counters.messages_sent);
+    ASSERT_ARE_EQUAL(size_t, 1, counters.frames_sent);
+
+    // cleanup
+    REGISTER_GLOBAL_MOCK_RETURN(ConstMap_GetValue, NULL);
+    free(sent_frame);
+    MODULE_DESTROY(apis)(bridge);
+}
+
+/* Tests_SRS_BRIDGE_31_018: [ Each message of a BATCH frame from the peer shall be recreated with Message_CreateFromByteArray and published to the broker. ] */
+TEST_FUNCTION(BRIDGE_worker_publishes_a_batch_from_the_peer)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    BRIDGE_CONFIG config = make_config(2);
+    BRIDGE_COUNTERS counters;
+    MODULE_HANDLE bridge = MODULE_CREATE(apis)(MOCK_BROKER, &config);
+    ASSERT_IS_NOT_NULL(bridge);
+    MODULE_START(apis)(bridge);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(nn_recv(MOCK_SOCKET, IGNORED_PTR_ARG, NN_MSG, 0))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(Message_CreateFromByteArray(IGNORED_PTR_ARG, 2))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Broker_Publish(MOCK_BROKER, bridge, MOCK_MESSAGE));
+    STRICT_EXPECTED_CALL(Message_Destroy(MOCK_MESSAGE));
+    STRICT_EXPECTED_CALL(Lock(MOCK_LOCK));
+    STRICT_EXPECTED_CALL(Unlock(MOCK_LOCK));
+    STRICT_EXPECTED_CALL(nn_freemsg(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(MOCK_TICKCOUNTER, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(Lock(MOCK_LOCK));
+
+    // act
+    receive_from_peer(BATCH_OF_ONE, sizeof(BATCH_OF_ONE));
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, Bridge_GetCounters(bridge, &counters));
+    ASSERT_ARE_EQUAL(size_t, 1, counters.messages_received);
+    ASSERT_ARE_EQUAL(size_t, 1, counters.frames_received);
+
+    // cleanup
+    MODULE_DESTROY(apis)(bridge);
+}
+
+/* Tests_SRS_BRIDGE_31_019: [ Malformed frames shall be ignored and counted as errors. ] */
+TEST_FUNCTION(BRIDGE_worker_rejects_a_truncated_batch_from_the_peer)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    BRIDGE_CONFIG config = make_config(2);
+    BRIDGE_COUNTERS counters;
+    MODULE_HANDLE bridge = MODULE_CREATE(apis)(MOCK_BROKER, &config);
+    ASSERT_IS_NOT_NULL(bridge);
+    MODULE_START(apis)(bridge);
+
+    // act
+    receive_from_peer(TRUNCATED_BATCH, sizeof(TRUNCATED_BATCH));
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, Bridge_GetCounters(bridge, &counters));
+    ASSERT_ARE_EQUAL(size_t, 1, counters.messages_received);
+    ASSERT_ARE_EQUAL(size_t, 1, counters.errors);
+
+    // cleanup
+    MODULE_DESTROY(apis)(bridge);
+}
+
+/* Tests_SRS_BRIDGE_31_024: [ If `module` or `counters` is NULL then `Bridge_GetCounters` shall return a non-zero value. ] */
+TEST_FUNCTION(BRIDGE_GetCounters_returns_non_zero_when_module_is_NULL)
+{
+    // arrange
+    BRIDGE_COUNTERS counters;
+
+    // act
+    int result = Bridge_GetCounters(NULL, &counters);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+}
+
+END_TEST_SUITE(bridge_ut)
@@ -11,6 +11,7 @@
 
 #define GW_SOURCE_BLE_COMMAND               "bleCommand"
 #define GW_SOURCE_BLE_TELEMETRY             "bleTelemetry"
+#define GW_SOURCE_IDMAP_UPDATE              "mappingUpdate"
 
 #define GW_IDMAP_MODULE                     "mapping"
 #define GW_IOTHUB_MODULE                    "iothub"
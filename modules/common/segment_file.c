@@ -0,0 +1,388 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/gb_stdio.h"
+#include "azure_c_shared_utility/strings.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "segment_file.h"
+
+void SegmentFile_PutUint32(unsigned char* destination, uint32_t value)
+{
+    destination[0] = (unsigned char)(value >> 24);
+    destination[1] = (unsigned char)(value >> 16);
+    destination[2] = (unsigned char)(value >> 8);
+    destination[3] = (unsigned char)value;
+}
+
+void SegmentFile_PutUint64(unsigned char* destination, uint64_t value)
+{
+    SegmentFile_PutUint32(destination, (uint32_t)(value >> 32));
+    SegmentFile_PutUint32(destination + 4, (uint32_t)value);
+}
+
+uint32_t SegmentFile_GetUint32(const unsigned char* source)
+{
+    return ((uint32_t)source[0] << 24) | ((uint32_t)source[1] << 16) | ((uint32_t)source[2] << 8) | (uint32_t)source[3];
+}
+
+uint64_t SegmentFile_GetUint64(const unsigned char* source)
+{
+    return ((uint64_t)SegmentFile_GetUint32(source) << 32) | (uint64_t)SegmentFile_GetUint32(source + 4);
+}
+
+void SegmentFile_PutHeader(unsigned char* header, const char* magic, uint32_t size)
+{
+    memcpy(header, magic, SEGMENT_FILE_MAGIC_SIZE);
+    SegmentFile_PutUint32(header + SEGMENT_FILE_SIZE_OFFSET, size);
+}
+
+STRING_HANDLE SegmentFile_Path(STRING_HANDLE name, uint64_t number, const char* extension)
+{
+    STRING_HANDLE result = STRING_construct_sprintf("%s.%llu.%s", STRING_c_str(name), (unsigned long long)number, extension);
+    if (result == NULL)
+    {
+        LogError("unable to STRING_construct_sprintf");
+    }
+    return result;
+}
+
+STRING_HANDLE SegmentFile_ManifestPath(STRING_HANDLE name, const char* extension)
+{
+    STRING_HANDLE result = STRING_construct_sprintf("%s.%s", STRING_c_str(name), extension);
+    if (result == NULL)
+    {
+        LogError("unable to STRING_construct_sprintf");
+    }
+    return result;
+}
+
+int SegmentFile_ReadManifest(STRING_HANDLE name, const char* extension, uint64_t* numbers, size_t count)
+{
+    int result;
+    STRING_HANDLE path = SegmentFile_ManifestPath(name, extension);
+    if (path == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        FILE* manifest = fopen(STRING_c_str(path), "r");
+        if (manifest == NULL)
+        {
+            /*a new log*/
+            result = __LINE__;
+        }
+        else
+        {
+            size_t i;
+            result = 0;
+            for (i = 0; i < count; i++)
+            {
+                unsigned long long number;
+                if (fscanf(manifest, "%llu", &number) != 1)
+                {
+                    LogError("unable to read %s", STRING_c_str(path));
+                    result = __LINE__;
+                    break;
+                }
+                numbers[i] = number;
+            }
+            (void)fclose(manifest);
+        }
+        STRING_delete(path);
+    }
+    return result;
+}
+
+/*writes the bytes buffered for file through to the disk*/
+static int SegmentFile_Sync(FILE* file)
+{
+    int result;
+    if (fflush(file) != 0)
+    {
+        result = __LINE__;
+    }
+#ifdef WIN32
+    else if (_commit(_fileno(file)) != 0)
+#else
+    else if (fsync(fileno(file)) != 0)
+#endif
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+/*replaces the file at path with the file at temporary in one step, a crash leaves one or the other*/
+static int SegmentFile_Replace(const char* temporary, const char* path)
+{
+    int result;
+#ifdef WIN32
+    if (!MoveFileExA(temporary, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+#else
+    if (rename(temporary, path) != 0)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        /*the rename is only durable once the directory is synced, failing to do so does not undo it*/
+        const char* slash = strrchr(path, '/');
+        STRING_HANDLE directory = (slash == NULL)
+            ? STRING_construct(".")
+            : STRING_construct_sprintf("%.*s", (int)(slash - path + 1), path);
+        if (directory != NULL)
+        {
+            int file = open(STRING_c_str(directory), O_RDONLY);
+            if (file >= 0)
+            {
+                (void)fsync(file);
+                (void)close(file);
+            }
+            STRING_delete(directory);
+        }
+        result = 0;
+    }
+#endif
+    return result;
+}
+
+int SegmentFile_WriteManifest(STRING_HANDLE name, const char* extension, const uint64_t* numbers, size_t count)
+{
+    int result;
+    STRING_HANDLE path = SegmentFile_ManifestPath(name, extension);
+    if (path == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        /*the numbers go to name.<extension>.tmp first, so a crash while writing leaves the previous manifest whole*/
+        STRING_HANDLE temporary = STRING_construct_sprintf("%s.tmp", STRING_c_str(path));
+        if (temporary == NULL)
+        {
+            LogError("unable to STRING_construct_sprintf");
+            result = __LINE__;
+        }
+        else
+        {
+            FILE* manifest = fopen(STRING_c_str(temporary), "w");
+            if (manifest == NULL)
+            {
+                LogError("unable to open %s", STRING_c_str(temporary));
+                result = __LINE__;
+            }
+            else
+            {
+                size_t i;
+                result = 0;
+                for (i = 0; i < count; i++)
+                {
+                    if (fprintf(manifest, (i + 1 == count) ? "%llu\n" : "%llu ", (unsigned long long)numbers[i]) < 0)
+                    {
+                        LogError("unable to write %s", STRING_c_str(temporary));
+                        result = __LINE__;
+                        break;
+                    }
+                }
+
+                if (result == 0 && SegmentFile_Sync(manifest) != 0)
+                {
+                    LogError("unable to flush %s", STRING_c_str(temporary));
+                    result = __LINE__;
+                }
+
+                if (fclose(manifest) != 0 && result == 0)
+                {
+                    LogError("unable to close %s", STRING_c_str(temporary));
+                    result = __LINE__;
+                }
+
+                if (result == 0 && SegmentFile_Replace(STRING_c_str(temporary), STRING_c_str(path)) != 0)
+                {
+                    LogError("unable to replace %s", STRING_c_str(path));
+                    result = __LINE__;
+                }
+
+                if (result != 0)
+                {
+                    (void)remove(STRING_c_str(temporary));
+                }
+            }
+            STRING_delete(temporary);
+        }
+        STRING_delete(path);
+    }
+    return result;
+}
+
+int SegmentFile_GetRecord(const unsigned char* bytes, size_t size, size_t offset, const char* magic, size_t headerSize, size_t* recordSize)
+{
+    int result;
+    if (
+        (offset > size) ||
+        (size - offset < headerSize)
+        )
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        const unsigned char* header = bytes + offset;
+        size_t bodySize = SegmentFile_GetUint32(header + SEGMENT_FILE_SIZE_OFFSET);
+        if (
+            (memcmp(header, magic, SEGMENT_FILE_MAGIC_SIZE) != 0) ||
+            (bodySize > size - offset - headerSize)
+            )
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            *recordSize = bodySize;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+int SegmentFile_Map(const char* path, const unsigned char** bytes, size_t* size)
+{
+    int result;
+#ifdef WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        LARGE_INTEGER length;
+        if (
+            !GetFileSizeEx(file, &length) ||
+            ((unsigned long long)length.QuadPart > (unsigned long long)SIZE_MAX)
+            )
+        {
+            LogError("unable to find the length of %s", path);
+            result = __LINE__;
+        }
+        else if (length.QuadPart == 0)
+        {
+            *bytes = NULL;
+            *size = 0;
+            result = 0;
+        }
+        else
+        {
+            HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mapping == NULL)
+            {
+                LogError("unable to CreateFileMapping %s", path);
+                result = __LINE__;
+            }
+            else
+            {
+                const unsigned char* view = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                if (view == NULL)
+                {
+                    LogError("unable to MapViewOfFile %s", path);
+                    result = __LINE__;
+                }
+                else
+                {
+                    *bytes = view;
+                    *size = (size_t)length.QuadPart;
+                    result = 0;
+                }
+                /*the view keeps the mapping alive*/
+                (void)CloseHandle(mapping);
+            }
+        }
+        (void)CloseHandle(file);
+    }
+#else
+    int file = open(path, O_RDONLY);
+    if (file < 0)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        struct stat status;
+        if (
+            (fstat(file, &status) != 0) ||
+            ((unsigned long long)status.st_size > (unsigned long long)SIZE_MAX)
+            )
+        {
+            LogError("unable to find the length of %s", path);
+            result = __LINE__;
+        }
+        else if (status.st_size == 0)
+        {
+            *bytes = NULL;
+            *size = 0;
+            result = 0;
+        }
+        else
+        {
+            void* view = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+            if (view == MAP_FAILED)
+            {
+                LogError("unable to mmap %s", path);
+                result = __LINE__;
+            }
+            else
+            {
+                (void)posix_madvise(view, (size_t)status.st_size, POSIX_MADV_SEQUENTIAL);
+                *bytes = (const unsigned char*)view;
+                *size = (size_t)status.st_size;
+                result = 0;
+            }
+        }
+        /*the mapping outlives the descriptor*/
+        (void)close(file);
+    }
+#endif
+    return result;
+}
+
+void SegmentFile_Unmap(const unsigned char* bytes, size_t size)
+{
+    if (bytes != NULL)
+    {
+#ifdef WIN32
+        (void)size;
+        (void)UnmapViewOfFile(bytes);
+#else
+        (void)munmap((void*)bytes, size);
+#endif
+    }
+}
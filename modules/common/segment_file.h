@@ -0,0 +1,67 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef SEGMENT_FILE_H
+#define SEGMENT_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "azure_c_shared_utility/strings.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+ * The files shared by the segmented logs of the modules: a log is a manifest,
+ * name.<extension>, holding a few numbers, and segments, name.<n>.<extension>,
+ * holding records. A record is a header starting with a magic and the size of
+ * the record, followed by the bytes of the record; every number is big endian.
+ */
+#define SEGMENT_FILE_MAGIC_SIZE 4
+#define SEGMENT_FILE_SIZE_OFFSET 4
+
+void SegmentFile_PutUint32(unsigned char* destination, uint32_t value);
+void SegmentFile_PutUint64(unsigned char* destination, uint64_t value);
+uint32_t SegmentFile_GetUint32(const unsigned char* source);
+uint64_t SegmentFile_GetUint64(const unsigned char* source);
+
+/*writes the magic and the size starting the header of a record*/
+void SegmentFile_PutHeader(unsigned char* header, const char* magic, uint32_t size);
+
+/*returns name.<number>.<extension>, NULL on failure*/
+STRING_HANDLE SegmentFile_Path(STRING_HANDLE name, uint64_t number, const char* extension);
+
+/*returns name.<extension>, NULL on failure*/
+STRING_HANDLE SegmentFile_ManifestPath(STRING_HANDLE name, const char* extension);
+
+/*reads the count numbers of the manifest name.<extension>, returns 0 on success and non-zero when there is no manifest or it cannot be read*/
+int SegmentFile_ReadManifest(STRING_HANDLE name, const char* extension, uint64_t* numbers, size_t count);
+
+/*
+ * Replaces the manifest name.<extension> with count numbers, returns 0 on
+ * success. The numbers are written and synced to name.<extension>.tmp, which
+ * is then renamed over the manifest, so a crash leaves either the previous
+ * manifest or the new one.
+ */
+int SegmentFile_WriteManifest(STRING_HANDLE name, const char* extension, const uint64_t* numbers, size_t count);
+
+/*
+ * Finds the record at offset of the size bytes of a segment, returns 0 and
+ * sets *recordSize to the size of the bytes after its header of headerSize
+ * bytes when a whole record starting with magic is there. A record torn by a
+ * crash or damaged ends the segment.
+ */
+int SegmentFile_GetRecord(const unsigned char* bytes, size_t size, size_t offset, const char* magic, size_t headerSize, size_t* recordSize);
+
+/*maps the whole file at path in memory to be read in order, *bytes is NULL when it is empty, returns 0 on success*/
+int SegmentFile_Map(const char* path, const unsigned char** bytes, size_t* size);
+void SegmentFile_Unmap(const unsigned char* bytes, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*SEGMENT_FILE_H*/
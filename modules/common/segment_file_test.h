@@ -0,0 +1,93 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef SEGMENT_FILE_TEST_H
+#define SEGMENT_FILE_TEST_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * The files of the unit tests of the segmented logs built on segment_file.c.
+ * A log of the tests is named by the path its files start with, and its
+ * records hold their number in SEGMENT_FILE_TEST_RECORD_SIZE digits, so their
+ * order can be checked.
+ */
+#define SEGMENT_FILE_TEST_RECORD_SIZE 8
+#define SEGMENT_FILE_TEST_PATH_SIZE 256
+
+/*removes the manifest prefix.<manifestExtension>, its .tmp, and prefix.<n>.<extension> of the first segmentCount segments for each of the extensionCount extensions*/
+static void SegmentFileTest_DeleteFiles(const char* prefix, const char* manifestExtension, const char* const* extensions, size_t extensionCount, int segmentCount)
+{
+    char path[SEGMENT_FILE_TEST_PATH_SIZE];
+    (void)sprintf(path, "%s.%s", prefix, manifestExtension);
+    (void)remove(path);
+    (void)sprintf(path, "%s.%s.tmp", prefix, manifestExtension);
+    (void)remove(path);
+    for (int segment = 0; segment < segmentCount; segment++)
+    {
+        for (size_t i = 0; i < extensionCount; i++)
+        {
+            (void)sprintf(path, "%s.%d.%s", prefix, segment, extensions[i]);
+            (void)remove(path);
+        }
+    }
+}
+
+/*returns the size of the file prefix<suffix>, -1 when it does not exist*/
+static long SegmentFileTest_FileSize(const char* prefix, const char* suffix)
+{
+    char path[SEGMENT_FILE_TEST_PATH_SIZE];
+    long result;
+    (void)sprintf(path, "%s%s", prefix, suffix);
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        result = -1;
+    }
+    else
+    {
+        (void)fseek(file, 0, SEEK_END);
+        result = ftell(file);
+        (void)fclose(file);
+    }
+    return result;
+}
+
+/*appends the size bytes to the file prefix<suffix>, as a crash while writing would leave them, returns the bytes written*/
+static size_t SegmentFileTest_AppendBytes(const char* prefix, const char* suffix, const char* bytes, size_t size)
+{
+    char path[SEGMENT_FILE_TEST_PATH_SIZE];
+    size_t result;
+    (void)sprintf(path, "%s%s", prefix, suffix);
+    FILE* file = fopen(path, "ab");
+    if (file == NULL)
+    {
+        result = 0;
+    }
+    else
+    {
+        result = fwrite(bytes, 1, size, file);
+        (void)fclose(file);
+    }
+    return result;
+}
+
+/*writes the record holding number, record has room for SEGMENT_FILE_TEST_RECORD_SIZE + 1 chars*/
+static void SegmentFileTest_MakeRecord(char* record, int number)
+{
+    (void)sprintf(record, "%08d", number);
+}
+
+/*returns the number held by a record of SEGMENT_FILE_TEST_RECORD_SIZE bytes*/
+static int SegmentFileTest_RecordNumber(const unsigned char* record)
+{
+    char text[SEGMENT_FILE_TEST_RECORD_SIZE + 1];
+    memcpy(text, record, SEGMENT_FILE_TEST_RECORD_SIZE);
+    text[SEGMENT_FILE_TEST_RECORD_SIZE] = '\0';
+    return atoi(text);
+}
+
+#endif /*SEGMENT_FILE_TEST_H*/
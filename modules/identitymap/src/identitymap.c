@@ -4,6 +4,8 @@
 #include <stdlib.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
 #include "azure_c_shared_utility/gballoc.h"
 
 #include <stddef.h>
@@ -22,12 +24,25 @@
 
 #include <parson.h>
 
+typedef struct IDENTITY_MAP_ENTRY_TAG
+{
+    uint64_t mac; /*the MAC address packed in the low 48 bits*/
+    IDENTITY_MAP_CONFIG strings; /*the MAC address in upper case, the device id and key*/
+} IDENTITY_MAP_ENTRY;
+
+typedef struct IDENTITY_MAP_TABLE_TAG
+{
+    size_t mappingSize;
+    IDENTITY_MAP_ENTRY * entries;
+    size_t indexMask; /*the slots of each index less one, a power of two at least twice mappingSize*/
+    IDENTITY_MAP_ENTRY ** macIndex; /*open addressing by packed MAC address, NULL for an empty slot*/
+    IDENTITY_MAP_ENTRY ** deviceIdIndex; /*open addressing by device id, allocated with macIndex*/
+} IDENTITY_MAP_TABLE;
+
 typedef struct IDENTITY_MAP_DATA_TAG
 {
     BROKER_HANDLE broker;
-    size_t mappingSize;
-    IDENTITY_MAP_CONFIG * macToDevIdArray;
-    IDENTITY_MAP_CONFIG * devIdToMacArray;
+    IDENTITY_MAP_TABLE * table; /*replaced by a mapping update message*/
 } IDENTITY_MAP_DATA;
 
 #define IDENTITYMAP_RESULT_VALUES \
@@ -193,65 +208,208 @@ static void IdentityMapConfig_Free(IDENTITY_MAP_CONFIG * element)
     free((void*)element->deviceKey);
 }
 
-/*Codes_SRS_IDMAP_17_006: [If any macAddress string in configuration is not a MAC address in canonical form, this function shall fail and return NULL.]*/
-static bool IdentityMapConfig_IsCanonicalMAC(const char * macAddress)
+/*
+ * @brief    Packs a MAC address in canonical form, of either case, in the low 48 bits of *mac.
+ *            Returns false when the MAC address is not in canonical form.
+ */
+static bool IdentityMapConfig_PackMAC(const char * macAddress, uint64_t * mac)
 {
     /* Every MAC address must be in the form "XX:XX:XX:XX:XX:XX" X=[0-9,a-f,A-F] */
-    bool recognized;
     const size_t fixedSize = 17;
-    const size_t numDigits = 12;
-    const size_t numColons = 5;
-    const size_t digits[] = { 0, 1, 3, 4, 6, 7, 9, 10, 12, 13, 15, 16 };
-    const size_t colons[] = { 2, 5, 8, 11, 14 };
-    size_t macSize = strlen(macAddress);
-    if (macSize != fixedSize)
+    bool recognized = true;
+    uint64_t packed = 0;
+    size_t i;
+    /* a shorter string stops at its terminating 0, which is neither a digit nor a colon */
+    for (i = 0; i < fixedSize; i++)
     {
-        recognized = false;
-    }
-    else
-    {
-        recognized = true;
-        size_t i;
-        for (i = 0; i < numDigits; i++)
+        char c = macAddress[i];
+        if ((i % 3) == 2)
         {
-            if (!isxdigit(macAddress[digits[i]]))
+            if (c != ':')
             {
                 recognized = false;
                 break;
             }
         }
-        if (recognized == true)
+        else
         {
-            for (i = 0; i < numColons; i++)
+            unsigned int digit;
+            if ((c >= '0') && (c <= '9'))
             {
-                if (macAddress[colons[i]] != ':')
-                {
-                    recognized = false;
-                    break;
-                }
+                digit = (unsigned int)(c - '0');
+            }
+            else if ((c >= 'a') && (c <= 'f'))
+            {
+                digit = (unsigned int)(c - 'a' + 10);
+            }
+            else if ((c >= 'A') && (c <= 'F'))
+            {
+                digit = (unsigned int)(c - 'A' + 10);
+            }
+            else
+            {
+                recognized = false;
+                break;
             }
+            packed = (packed << 4) | digit;
         }
     }
+    if ((recognized == true) && (macAddress[fixedSize] != '\0'))
+    {
+        recognized = false;
+    }
+    if (recognized == true)
+    {
+        *mac = packed;
+    }
     return recognized;
 }
 
+static size_t IdentityMapTable_HashMac(uint64_t mac)
+{
+    /*Fibonacci hashing, the high half of the product depends on every bit of the MAC address*/
+    return (size_t)((mac * UINT64_C(0x9E3779B97F4A7C15)) >> 32);
+}
+
+static size_t IdentityMapTable_HashDeviceId(const char * deviceId)
+{
+    /*FNV-1a*/
+    size_t hash = (size_t)2166136261u;
+    while (*deviceId != '\0')
+    {
+        hash ^= (unsigned char)*deviceId++;
+        hash *= (size_t)16777619u;
+    }
+    return hash;
+}
+
+/*returns the slot holding the entry of mac, or the empty slot where it would be added*/
+static IDENTITY_MAP_ENTRY ** IdentityMapTable_MacSlot(const IDENTITY_MAP_TABLE * table, uint64_t mac)
+{
+    size_t i = IdentityMapTable_HashMac(mac) & table->indexMask;
+    while ((table->macIndex[i] != NULL) && (table->macIndex[i]->mac != mac))
+    {
+        i = (i + 1) & table->indexMask;
+    }
+    return &(table->macIndex[i]);
+}
+
+/*returns the slot holding the entry of deviceId, or the empty slot where it would be added*/
+static IDENTITY_MAP_ENTRY ** IdentityMapTable_DeviceIdSlot(const IDENTITY_MAP_TABLE * table, const char * deviceId)
+{
+    size_t i = IdentityMapTable_HashDeviceId(deviceId) & table->indexMask;
+    while ((table->deviceIdIndex[i] != NULL) && (strcmp(table->deviceIdIndex[i]->strings.deviceId, deviceId) != 0))
+    {
+        i = (i + 1) & table->indexMask;
+    }
+    return &(table->deviceIdIndex[i]);
+}
+
 /*
- * @brief    Comparison function by MAC address for two IDENTITY_MAP_CONFIG structures
+ * @brief    Release a mapping table and the strings of its triplets.
  */
-static int IdentityMapConfig_MacCompare(const void * a, const void * b)
+static void IdentityMapTable_Destroy(IDENTITY_MAP_TABLE * table)
 {
-    const IDENTITY_MAP_CONFIG * idA = a;
-    const IDENTITY_MAP_CONFIG * idB = b;
-    return strcmp(idA->macAddress, idB->macAddress);
+    size_t index;
+    for (index = 0; index < table->mappingSize; index++)
+    {
+        IdentityMapConfig_Free(&(table->entries[index].strings));
+    }
+    free(table->macIndex);
+    free(table->entries);
+    free(table);
 }
+
 /*
-* @brief    Comparison function by deviceId for two IDENTITY_MAP_CONFIG structures
-*/
-static int IdentityMapConfig_IdCompare(const void * a, const void * b)
+ * @brief    Copy the triplets of a validated mappingVector into a new mapping table and index them.
+ */
+static IDENTITY_MAP_TABLE * IdentityMapTable_Create(const VECTOR_HANDLE mappingVector)
 {
-    const IDENTITY_MAP_CONFIG * idA = a;
-    const IDENTITY_MAP_CONFIG * idB = b;
-    return strcmp(idA->deviceId, idB->deviceId);
+    IDENTITY_MAP_TABLE * result;
+    size_t mappingSize = VECTOR_size(mappingVector);
+    /*Codes_SRS_IDMAP_31_002: [ The mapping table shall index the triplets by their MAC address packed in 48 bits and by their device ID, in open addressing hash tables with at least twice as many slots as triplets. ]*/
+    size_t capacity = 1;
+    while (capacity < 2 * mappingSize)
+    {
+        capacity *= 2;
+    }
+
+    result = (IDENTITY_MAP_TABLE*)malloc(sizeof(IDENTITY_MAP_TABLE));
+    if (result == NULL)
+    {
+        /*Codes_SRS_IDMAP_31_004: [ If IdentityMap_Create fails to allocate the mapping table or its indexes, then this function shall fail, release all resources, and return NULL. ]*/
+        LogError("Could not allocate mapping table");
+    }
+    else if ((result->entries = (IDENTITY_MAP_ENTRY*)malloc(mappingSize * sizeof(IDENTITY_MAP_ENTRY))) == NULL)
+    {
+        /*Codes_SRS_IDMAP_31_004: [ If IdentityMap_Create fails to allocate the mapping table or its indexes, then this function shall fail, release all resources, and return NULL. ]*/
+        LogError("Could not allocate mapping table entries");
+        free(result);
+        result = NULL;
+    }
+    else if ((result->macIndex = (IDENTITY_MAP_ENTRY**)malloc(2 * capacity * sizeof(IDENTITY_MAP_ENTRY*))) == NULL)
+    {
+        /*Codes_SRS_IDMAP_31_004: [ If IdentityMap_Create fails to allocate the mapping table or its indexes, then this function shall fail, release all resources, and return NULL. ]*/
+        LogError("Could not allocate mapping table indexes");
+        free(result->entries);
+        free(result);
+        result = NULL;
+    }
+    else
+    {
+        size_t index;
+        result->indexMask = capacity - 1;
+        result->deviceIdIndex = result->macIndex + capacity;
+        for (index = 0; index < 2 * capacity; index++)
+        {
+            result->macIndex[index] = NULL;
+        }
+        result->mappingSize = 0;
+        for (index = 0; index < mappingSize; index++)
+        {
+            IDENTITY_MAP_CONFIG * element = (IDENTITY_MAP_CONFIG *)VECTOR_element(mappingVector, index);
+            IDENTITY_MAP_ENTRY * entry = &(result->entries[index]);
+            /*Codes_SRS_IDMAP_31_001: [ IdentityMap_Create shall copy the triplets of configuration into a mapping table, with the MAC addresses in upper case. ]*/
+            if (IdentityMapConfig_CopyDeep(&(entry->strings), element) != IDENTITYMAP_OK)
+            {
+                break;
+            }
+            else
+            {
+                IDENTITY_MAP_ENTRY ** slot;
+                result->mappingSize++;
+                /* validation ensures the MAC address is canonical */
+                (void)IdentityMapConfig_PackMAC(entry->strings.macAddress, &(entry->mac));
+                /*Codes_SRS_IDMAP_31_003: [ If two triplets have the same MAC address or the same device ID, the mapping table shall index the first one. ]*/
+                slot = IdentityMapTable_MacSlot(result, entry->mac);
+                if (*slot == NULL)
+                {
+                    *slot = entry;
+                }
+                else
+                {
+                    LogInfo("MAC address %s is mapped twice, the first mapping is used", entry->strings.macAddress);
+                }
+                slot = IdentityMapTable_DeviceIdSlot(result, entry->strings.deviceId);
+                if (*slot == NULL)
+                {
+                    *slot = entry;
+                }
+                else
+                {
+                    LogInfo("Device id %s is mapped twice, the first mapping is used", entry->strings.deviceId);
+                }
+            }
+        }
+        if (result->mappingSize < mappingSize)
+        {
+            /*Codes_SRS_IDMAP_31_005: [ If IdentityMap_Create fails to copy a triplet into the mapping table, then this function shall fail, release all resources, and return NULL. ]*/
+            LogError("Could not copy mapping triplets");
+            IdentityMapTable_Destroy(result);
+            result = NULL;
+        }
+    }
+    return result;
 }
 
 /*
@@ -286,7 +444,8 @@ static bool IdentityMap_ValidateConfig(const VECTOR_HANDLE mappingVector)
             }
             else
             {
-                if (IdentityMapConfig_IsCanonicalMAC(element->macAddress) == false)
+                uint64_t mac;
+                if (IdentityMapConfig_PackMAC(element->macAddress, &mac) == false)
                 {
                     /*Codes_SRS_IDMAP_17_006: [If any macAddress string in configuration is not a MAC address in canonical form, this function shall fail and return NULL.]*/
                     LogError("Non-canonical MAC Address: %s", element->macAddress);
@@ -330,77 +489,17 @@ static MODULE_HANDLE IdentityMap_Create(BROKER_HANDLE broker, const void* config
             }
             else
             {
-                size_t mappingSize = VECTOR_size(mappingVector);
-                /* validation ensures the vector is greater than zero */
-                result->macToDevIdArray = (IDENTITY_MAP_CONFIG*)malloc(mappingSize*sizeof(IDENTITY_MAP_CONFIG));
-                if (result->macToDevIdArray == NULL)
+                result->table = IdentityMapTable_Create(mappingVector);
+                if (result->table == NULL)
                 {
-                    /*Codes_SRS_IDMAP_17_011: [If IdentityMap_Create fails to create memory for the macToDeviceArray, then this function shall fail and return NULL.*/
-                    LogError("Could not allocate mac to device mapping table");
+                    LogError("Could not create mapping table");
                     free(result);
                     result = NULL;
                 }
                 else
                 {
-                    result->devIdToMacArray = (IDENTITY_MAP_CONFIG*)malloc(mappingSize*sizeof(IDENTITY_MAP_CONFIG));
-                    if (result->devIdToMacArray == NULL)
-                    {
-                        /*Codes_SRS_IDMAP_17_042: [ If IdentityMap_Create fails to create memory for the deviceToMacArray, then this function shall fail and return NULL. */
-                        LogError("Could not allocate devicee to mac mapping table");
-                        free(result->macToDevIdArray);
-                        free(result);
-                        result = NULL;
-                    }
-                    else
-                    {
-
-                        size_t index;
-                        size_t failureIndex = mappingSize;
-                        for (index = 0; index < mappingSize; index++)
-                        {
-                            IDENTITY_MAP_CONFIG * element = (IDENTITY_MAP_CONFIG *)VECTOR_element(mappingVector, index);
-                            IDENTITY_MAP_CONFIG * dest = &(result->macToDevIdArray[index]);
-                            IDENTITYMAP_RESULT copyResult;
-                            copyResult = IdentityMapConfig_CopyDeep(dest, element);
-                            if (copyResult != IDENTITYMAP_OK)
-                            {
-                                failureIndex = index;
-                                break;
-                            }
-                            dest = &(result->devIdToMacArray[index]);
-                            copyResult = IdentityMapConfig_CopyDeep(dest, element);
-                            if (copyResult != IDENTITYMAP_OK)
-                            {
-                                IdentityMapConfig_Free(&(result->macToDevIdArray[index]));
-                                failureIndex = index;
-                                break;
-                            }
-                        }
-                        if (failureIndex < mappingSize)
-                        {
-                            /*Codes_SRS_IDMAP_17_012: [If IdentityMap_Create fails to add a MAC address triplet to the macToDeviceArray, then this function shall fail, release all resources, and return NULL.]*/
-                            /*Codes_SRS_IDMAP_17_043: [ If IdentityMap_Create fails to add a MAC address triplet to the deviceToMacArray, then this function shall fail, release all resources, and return NULL. */
-                            for (index = 0; index < failureIndex; index++)
-                            {
-                                IdentityMapConfig_Free(&(result->macToDevIdArray[index]));
-                                IdentityMapConfig_Free(&(result->devIdToMacArray[index]));
-                            }
-                            free(result->macToDevIdArray);
-                            free(result->devIdToMacArray);
-                            free(result);
-                            result = NULL;
-                        }
-                        else
-                        {
-                            /*Codes_SRS_IDMAP_17_003: [Upon success, this function shall return a valid pointer to a MODULE_HANDLE.]*/
-                            qsort(result->macToDevIdArray, mappingSize, sizeof(IDENTITY_MAP_CONFIG),
-                                IdentityMapConfig_MacCompare);
-                            qsort(result->devIdToMacArray, mappingSize, sizeof(IDENTITY_MAP_CONFIG),
-                                IdentityMapConfig_IdCompare);
-                            result->mappingSize = mappingSize;
-                            result->broker = broker;
-                        }
-                    }
+                    /*Codes_SRS_IDMAP_17_003: [Upon success, this function shall return a valid pointer to a MODULE_HANDLE.]*/
+                    result->broker = broker;
                 }
             }
         }
@@ -519,13 +618,7 @@ static void IdentityMap_Destroy(MODULE_HANDLE moduleHandle)
     {
         /*Codes_SRS_IDMAP_17_015: [IdentityMap_Destroy shall release all resources allocated for the module.]*/
         IDENTITY_MAP_DATA * idModule = (IDENTITY_MAP_DATA*)moduleHandle;
-        for (size_t index = 0; index < idModule->mappingSize; index++)
-        {
-            IdentityMapConfig_Free(&(idModule->macToDevIdArray[index]));
-            IdentityMapConfig_Free(&(idModule->devIdToMacArray[index]));
-        }
-        free(idModule->macToDevIdArray);
-        free(idModule->devIdToMacArray);
+        IdentityMapTable_Destroy(idModule->table);
         free(idModule);
     }
 }
@@ -687,6 +780,67 @@ static void IdentityMap_RepublishC2D(
     }
 }
 
+/*
+ * @brief    Replace the mapping table with the one in the content of a mapping update message.
+ */
+static void IdentityMap_UpdateMapping(IDENTITY_MAP_DATA * idModule, MESSAGE_HANDLE messageHandle)
+{
+    const CONSTBUFFER * content = Message_GetContent(messageHandle);
+    if (content == NULL)
+    {
+        LogError("Could not get mapping update content");
+    }
+    else
+    {
+        /* the content is not a string, parson needs one */
+        char * json = (char*)malloc(content->size + 1);
+        if (json == NULL)
+        {
+            /*Codes_SRS_IDMAP_31_009: [ If the message content is not a valid configuration, or the new mapping table cannot be built, IdentityMap_Receive shall keep the mapping table of the module. ]*/
+            LogError("Could not allocate mapping update string");
+        }
+        else
+        {
+            VECTOR_HANDLE mappingVector;
+            if (content->size > 0)
+            {
+                memcpy(json, content->buffer, content->size);
+            }
+            json[content->size] = '\0';
+            /*Codes_SRS_IDMAP_31_007: [ If messageHandle property "source" is "mappingUpdate", IdentityMap_Receive shall parse the message content as a configuration of the same JSON form as the module arguments. ]*/
+            mappingVector = (VECTOR_HANDLE)IdentityMap_ParseConfigurationFromJson(json);
+            if (mappingVector == NULL)
+            {
+                /*Codes_SRS_IDMAP_31_009: [ If the message content is not a valid configuration, or the new mapping table cannot be built, IdentityMap_Receive shall keep the mapping table of the module. ]*/
+                LogError("Could not parse mapping update, the current mapping is kept");
+            }
+            else
+            {
+                IDENTITY_MAP_TABLE * table;
+                if (IdentityMap_ValidateConfig(mappingVector) == false)
+                {
+                    /*Codes_SRS_IDMAP_31_009: [ If the message content is not a valid configuration, or the new mapping table cannot be built, IdentityMap_Receive shall keep the mapping table of the module. ]*/
+                    LogError("unable to validate mapping update, the current mapping is kept");
+                }
+                else if ((table = IdentityMapTable_Create(mappingVector)) == NULL)
+                {
+                    /*Codes_SRS_IDMAP_31_009: [ If the message content is not a valid configuration, or the new mapping table cannot be built, IdentityMap_Receive shall keep the mapping table of the module. ]*/
+                    LogError("Could not create mapping table, the current mapping is kept");
+                }
+                else
+                {
+                    /*Codes_SRS_IDMAP_31_008: [ IdentityMap_Receive shall build a new mapping table from the parsed configuration, as IdentityMap_Create does, and replace the mapping table of the module with it, releasing the previous one. ]*/
+                    IdentityMapTable_Destroy(idModule->table);
+                    idModule->table = table;
+                    LogInfo("Identity map replaced, %lu mappings", (unsigned long)table->mappingSize);
+                }
+                IdentityMap_FreeConfiguration(mappingVector);
+            }
+            free(json);
+        }
+    }
+}
+
 /* returns true if the message should continue to be processed, sets direction */
 static bool determine_message_direction(const char * source, bool * isC2DMessage)
 {
@@ -740,7 +894,12 @@ static void IdentityMap_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE messa
 
         const char * source = ConstMap_GetValue(properties, GW_SOURCE_PROPERTY);
         bool isC2DMessage;
-        if (determine_message_direction(source, &isC2DMessage))
+        if ((source != NULL) && (strcmp(source, GW_SOURCE_IDMAP_UPDATE) == 0))
+        {
+            /*Codes_SRS_IDMAP_31_010: [ IdentityMap_Receive shall not publish a mapping update message. ]*/
+            IdentityMap_UpdateMapping(idModule, messageHandle);
+        }
+        else if (determine_message_direction(source, &isC2DMessage))
         {
             if (isC2DMessage == true)
             {
@@ -748,27 +907,21 @@ static void IdentityMap_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE messa
                 /*Codes_SRS_IDMAP_17_045: [ If messageHandle properties does not contain "deviceName" property, then the message shall not be marked as a C2D message. */
                 if (deviceName != NULL)
                 {
-                    IDENTITY_MAP_CONFIG key = { NULL,deviceName,NULL };
-
-                    IDENTITY_MAP_CONFIG * match = bsearch(&key,
-                        idModule->devIdToMacArray, idModule->mappingSize,
-                        sizeof(IDENTITY_MAP_CONFIG),
-                        IdentityMapConfig_IdCompare);
+                    IDENTITY_MAP_ENTRY * match = *IdentityMapTable_DeviceIdSlot(idModule->table, deviceName);
                     if (match == NULL)
                     {
-                        /*Codes_SRS_IDMAP_17_048: [ If the deviceName of the message is not found in deviceToMacArray, then the message shall not be marked as a C2D message. ]*/
+                        /*Codes_SRS_IDMAP_17_048: [ If the deviceName of the message is not found in the mapping table, then the message shall not be marked as a C2D message. ]*/
                         LogInfo("Did not find device Id [%s] of current message", deviceName);
                     }
                     else
                     {
-                        IdentityMap_RepublishC2D(idModule, messageHandle, match);
+                        IdentityMap_RepublishC2D(idModule, messageHandle, &(match->strings));
                     }
                 }
             }
             else
             {
-                const char * messageMac = IdentityMapConfig_ToUpperCase(
-                    ConstMap_GetValue(properties, GW_MAC_ADDRESS_PROPERTY));
+                const char * messageMac = ConstMap_GetValue(properties, GW_MAC_ADDRESS_PROPERTY);
 
                 /*Codes_SRS_IDMAP_17_021: [If messageHandle properties does not contain "macAddress" property, then the function shall return.]*/
                 if (messageMac != NULL)
@@ -777,32 +930,27 @@ static void IdentityMap_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE messa
                     if ((ConstMap_GetValue(properties, GW_DEVICENAME_PROPERTY) == NULL ||
                         ConstMap_GetValue(properties, GW_DEVICEKEY_PROPERTY) == NULL))
                     {
-                        if (IdentityMapConfig_IsCanonicalMAC(messageMac) == false)
+                        uint64_t mac;
+                        /*Codes_SRS_IDMAP_31_006: [ IdentityMap_Receive shall look up the MAC address of a message, in either case, by its 48 bit value without copying it. ]*/
+                        if (IdentityMapConfig_PackMAC(messageMac, &mac) == false)
                         {
                             /*Codes_SRS_IDMAP_17_040: [If the macAddress of the message is not in canonical form, then this function shall return.]*/
                             LogInfo("MAC address not valid: %s", messageMac);
                         }
                         else
                         {
-                            IDENTITY_MAP_CONFIG key = { messageMac,NULL,NULL };
-
-                            IDENTITY_MAP_CONFIG * match = bsearch(&key,
-                                idModule->macToDevIdArray, idModule->mappingSize,
-                                sizeof(IDENTITY_MAP_CONFIG),
-                                IdentityMapConfig_MacCompare);
+                            IDENTITY_MAP_ENTRY * match = *IdentityMapTable_MacSlot(idModule->table, mac);
                             if (match == NULL)
                             {
-                                /*Codes_SRS_IDMAP_17_025: [If the macAddress of the message is not found in the macToDeviceArray list, then this function shall return.]*/
+                                /*Codes_SRS_IDMAP_17_025: [If the macAddress of the message is not found in the mapping table, then this function shall return.]*/
                                 LogInfo("Did not find message MAC Address: %s", messageMac);
                             }
                             else
                             {
-                                IdentityMap_RepublishD2C(idModule, messageHandle, match);
+                                IdentityMap_RepublishD2C(idModule, messageHandle, &(match->strings));
                             }
                         }
                     }
-                    /*Codes_SRS_IDMAP_17_039: [IdentityMap_Receive will destroy all resources it created.]*/
-                    free((void*)messageMac);
                 }
             }
         }
@@ -3,6 +3,7 @@
 
 #include <cstdlib>
 #include <cstddef>
+#include <cstdint>
 #include "testrunnerswitcher.h"
 #include "micromock.h"
 #include "micromockcharstararenullterminatedstrings.h"
@@ -107,12 +108,25 @@ public:
     }
 };
 
+typedef struct IDENTITY_MAP_ENTRY_TAG
+{
+    uint64_t mac;
+    IDENTITY_MAP_CONFIG strings;
+} IDENTITY_MAP_ENTRY;
+
+typedef struct IDENTITY_MAP_TABLE_TAG
+{
+    size_t mappingSize;
+    IDENTITY_MAP_ENTRY * entries;
+    size_t indexMask;
+    IDENTITY_MAP_ENTRY ** macIndex;
+    IDENTITY_MAP_ENTRY ** deviceIdIndex;
+} IDENTITY_MAP_TABLE;
+
 typedef struct IDENTITY_MAP_DATA_TAG
 {
     BROKER_HANDLE broker;
-    size_t mappingSize;
-    IDENTITY_MAP_CONFIG * macToDevIdArray;
-    IDENTITY_MAP_CONFIG * devIdToMacArray;
+    IDENTITY_MAP_TABLE * table;
 } IDENTITY_MAP_DATA;
 
 #define VALID_MAP_HANDLE    0xDEAF
@@ -595,6 +609,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         currentMap_call = 0;
         whenShallMap_fail = 0;
         currentBrokerResult = BROKER_OK;
+        messageContent.buffer = NULL;
+        messageContent.size = 0;
 
         testVector1 = VECTOR_create(sizeof(IDENTITY_MAP_CONFIG));
         IDENTITY_MAP_CONFIG c1 =
@@ -1176,6 +1192,8 @@ BEGIN_TEST_SUITE(idmap_ut)
     }
 
     /*Tests_SRS_IDMAP_17_003: [Upon success, this function shall return a valid pointer to a MODULE_HANDLE.]*/
+    /*Tests_SRS_IDMAP_31_001: [ IdentityMap_Create shall copy the triplets of configuration into a mapping table, with the MAC addresses in upper case. ]*/
+    /*Tests_SRS_IDMAP_31_002: [ The mapping table shall index the triplets by their MAC address packed in 48 bits and by their device ID, in open addressing hash tables with at least twice as many slots as triplets. ]*/
     TEST_FUNCTION(IdentityMap_Create_Success_SingleEntry)
     {
         ///Arrange
@@ -1193,27 +1211,18 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the d2c internal array*/
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the c2d internal array*/
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(IDENTITY_MAP_TABLE))); /*this is for the mapping table*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(IDENTITY_MAP_ENTRY))); /*this is for the triplets*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(2 * 2 * sizeof(IDENTITY_MAP_ENTRY*))); /*this is for both indexes, 2 slots each*/
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device key*/
-            .IgnoreAllArguments();
-
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device key*/
-            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "aa:Aa:bb:bB:cc:CC")) /*this is for the mac address*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "aNiceDevice")) /*this is for the device name*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "aNiceKey")) /*this is for the device key*/
+            .IgnoreArgument(1);
 
         ///Act
         auto n = MODULE_CREATE(theAPIS)(broker, testVector1);
@@ -1221,6 +1230,10 @@ BEGIN_TEST_SUITE(idmap_ut)
         ///Assert
         ASSERT_IS_NOT_NULL(n);
         mocks.AssertActualAndExpectedCalls();
+        IDENTITY_MAP_TABLE * table = ((IDENTITY_MAP_DATA*)n)->table;
+        ASSERT_ARE_EQUAL(size_t, (size_t)1, table->mappingSize);
+        ASSERT_ARE_EQUAL(char_ptr, "AA:AA:BB:BB:CC:CC", table->entries[0].strings.macAddress);
+        ASSERT_IS_TRUE(table->entries[0].mac == 0xAAAABBBBCCCCULL);
 
         ///Ablution
         MODULE_DESTROY(theAPIS)(n);
@@ -1449,8 +1462,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         ///Ablution
     }
 
-    /*Tests_SRS_IDMAP_17_011: [If IdentityMap_Create fails to create memory for the macToDeviceArray, then this function shall fail and return NULL.]*/
-    TEST_FUNCTION(IdentityMap_Create_internal_d2c_alloc_fail)
+    /*Tests_SRS_IDMAP_31_004: [ If IdentityMap_Create fails to allocate the mapping table or its indexes, then this function shall fail, release all resources, and return NULL. ]*/
+    TEST_FUNCTION(IdentityMap_Create_table_alloc_fail)
     {
         ///Arrange
         CIdentitymapMocks mocks;
@@ -1467,10 +1480,9 @@ BEGIN_TEST_SUITE(idmap_ut)
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the mapping table*/
             .IgnoreArgument(1);
 
 
@@ -1484,8 +1496,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         ///Ablution
     }
 
-    /*Tests_SRS_IDMAP_17_042: [ If IdentityMap_Create fails to create memory for the deviceToMacArray, then this function shall fail and return NULL. */
-    TEST_FUNCTION(IdentityMap_Create_internal_c2d_alloc_fail)
+    /*Tests_SRS_IDMAP_31_004: [ If IdentityMap_Create fails to allocate the mapping table or its indexes, then this function shall fail, release all resources, and return NULL. ]*/
+    TEST_FUNCTION(IdentityMap_Create_entries_alloc_fail)
     {
         ///Arrange
         CIdentitymapMocks mocks;
@@ -1493,6 +1505,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         unsigned char fake;
         BROKER_HANDLE broker = (BROKER_HANDLE)&fake;
 
+        whenShallmalloc_fail = 3;
+
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
 
@@ -1500,15 +1514,13 @@ BEGIN_TEST_SUITE(idmap_ut)
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the mapping table*/
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the internal array*/
-            .IgnoreArgument(1)
-            .SetFailReturn((void_ptr)NULL);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the triplets*/
+            .IgnoreArgument(1);
 
 
         ///Act
@@ -1520,8 +1532,9 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         ///Ablution
     }
-    /*Tests_SRS_IDMAP_17_012: [If IdentityMap_Create fails to add a MAC address triplet to the macToDeviceArray, then this function shall fail, release all resources, and return NULL.]*/
-    TEST_FUNCTION(IdentityMap_Create_DeepCopy_fail_mac1)
+
+    /*Tests_SRS_IDMAP_31_004: [ If IdentityMap_Create fails to allocate the mapping table or its indexes, then this function shall fail, release all resources, and return NULL. ]*/
+    TEST_FUNCTION(IdentityMap_Create_index_alloc_fail)
     {
         ///Arrange
         CIdentitymapMocks mocks;
@@ -1529,11 +1542,10 @@ BEGIN_TEST_SUITE(idmap_ut)
         unsigned char fake;
         BROKER_HANDLE broker = (BROKER_HANDLE)&fake;
 
-        whenShallStrdup_fail =7;
+        whenShallmalloc_fail = 4;
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1)).IgnoreArgument(1);
 
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module struct*/
             .IgnoreArgument(1);
@@ -1541,39 +1553,60 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the D2C internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the mapping table*/
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the C2D internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the triplets*/
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the indexes*/
+            .IgnoreArgument(1);
+
+
+        ///Act
+        auto n = MODULE_CREATE(theAPIS)(broker, testVector1);
+
+        ///Assert
+        ASSERT_IS_NULL(n);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///Ablution
+    }
+
+    /*Tests_SRS_IDMAP_31_005: [ If IdentityMap_Create fails to copy a triplet into the mapping table, then this function shall fail, release all resources, and return NULL. ]*/
+    TEST_FUNCTION(IdentityMap_Create_DeepCopy_fail_mac1)
+    {
+        ///Arrange
+        CIdentitymapMocks mocks;
+        const MODULE_API* theAPIS= Module_GetApi(MODULE_API_VERSION_1);
+        unsigned char fake;
+        BROKER_HANDLE broker = (BROKER_HANDLE)&fake;
 
+        whenShallStrdup_fail = 1;
+
+        STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1)).IgnoreArgument(1);
 
-        /* 1st vector element */
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device key*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module struct*/
+            .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device key*/
-            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the mapping table*/
+            .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the triplets*/
+            .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the indexes*/
+            .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        /* 2nd vector element */
+        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
+
+        /* 1st vector element */
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
             .IgnoreAllArguments();
 
@@ -1587,8 +1620,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         ///Ablution
     }
 
-    //Tests_SRS_IDMAP_17_043: [ If IdentityMap_Create fails to add a MAC address triplet to the deviceToMacArray, then this function shall fail, release all resources, and return NULL. 
-    TEST_FUNCTION(IdentityMap_Create_DeepCopy_fail_mac2)
+    /*Tests_SRS_IDMAP_31_005: [ If IdentityMap_Create fails to copy a triplet into the mapping table, then this function shall fail, release all resources, and return NULL. ]*/
+    TEST_FUNCTION(IdentityMap_Create_DeepCopy_fail_id1)
     {
         ///Arrange
         CIdentitymapMocks mocks;
@@ -1596,7 +1629,7 @@ BEGIN_TEST_SUITE(idmap_ut)
         unsigned char fake;
         BROKER_HANDLE broker = (BROKER_HANDLE)&fake;
 
-        whenShallStrdup_fail = 10;
+        whenShallStrdup_fail = 2;
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
@@ -1608,51 +1641,24 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the D2C internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the mapping table*/
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the C2D internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the triplets*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the indexes*/
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1)).IgnoreArgument(1);
 
         /* 1st vector element */
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
             .IgnoreAllArguments();
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
             .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device key*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device key*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-
-        /* 2nd vector element */
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device key*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
 
         ///Act
         auto n = MODULE_CREATE(theAPIS)(broker, testVector2);
@@ -1664,8 +1670,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         ///Ablution
     }
 
-    /*Tests_SRS_IDMAP_17_012: [If IdentityMap_Create fails to add a MAC address triplet to the macToDeviceArray, then this function shall fail, release all resources, and return NULL.]*/
-    TEST_FUNCTION(IdentityMap_Create_DeepCopy_fail_id1)
+    /*Tests_SRS_IDMAP_31_005: [ If IdentityMap_Create fails to copy a triplet into the mapping table, then this function shall fail, release all resources, and return NULL. ]*/
+    TEST_FUNCTION(IdentityMap_Create_DeepCopy_fail_key1)
     {
         ///Arrange
         CIdentitymapMocks mocks;
@@ -1673,8 +1679,7 @@ BEGIN_TEST_SUITE(idmap_ut)
         unsigned char fake;
         BROKER_HANDLE broker = (BROKER_HANDLE)&fake;
 
-
-        whenShallStrdup_fail = 8;
+        whenShallStrdup_fail = 3;
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
@@ -1686,27 +1691,19 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the d2c internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the mapping table*/
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the c2d internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the triplets*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the indexes*/
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1)).IgnoreArgument(1);
 
-        //1st vector element
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device key*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        /* 1st vector element */
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
             .IgnoreAllArguments();
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
@@ -1715,14 +1712,6 @@ BEGIN_TEST_SUITE(idmap_ut)
             .IgnoreAllArguments();
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-
-        /* 2nd vector element */
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
 
         ///Act
         auto n = MODULE_CREATE(theAPIS)(broker, testVector2);
@@ -1734,7 +1723,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         ///Ablution
     }
 
-    TEST_FUNCTION(IdentityMap_Create_DeepCopy_fail_id2)
+    /*Tests_SRS_IDMAP_31_005: [ If IdentityMap_Create fails to copy a triplet into the mapping table, then this function shall fail, release all resources, and return NULL. ]*/
+    TEST_FUNCTION(IdentityMap_Create_DeepCopy_fail_mac2)
     {
         ///Arrange
         CIdentitymapMocks mocks;
@@ -1742,8 +1732,7 @@ BEGIN_TEST_SUITE(idmap_ut)
         unsigned char fake;
         BROKER_HANDLE broker = (BROKER_HANDLE)&fake;
 
-
-        whenShallStrdup_fail = 11;
+        whenShallStrdup_fail = 4;
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
@@ -1755,27 +1744,20 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the d2c internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the mapping table*/
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the c2d internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the triplets*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the indexes*/
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1)).IgnoreArgument(1);
 
-        //1st vector element
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device key*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        /* 1st vector element */
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
             .IgnoreAllArguments();
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
@@ -1787,19 +1769,6 @@ BEGIN_TEST_SUITE(idmap_ut)
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
         /* 2nd vector element */
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device key*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
             .IgnoreAllArguments();
 
@@ -1813,9 +1782,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         ///Ablution
     }
 
-
-    /*Tests_SRS_IDMAP_17_012: [If IdentityMap_Create fails to add a MAC address triplet to the macToDeviceArray, then this function shall fail, release all resources, and return NULL.]*/
-    TEST_FUNCTION(IdentityMap_Create_DeepCopy_fail_key1)
+    /*Tests_SRS_IDMAP_31_005: [ If IdentityMap_Create fails to copy a triplet into the mapping table, then this function shall fail, release all resources, and return NULL. ]*/
+    TEST_FUNCTION(IdentityMap_Create_DeepCopy_fail_id2)
     {
         ///Arrange
         CIdentitymapMocks mocks;
@@ -1823,7 +1791,7 @@ BEGIN_TEST_SUITE(idmap_ut)
         unsigned char fake;
         BROKER_HANDLE broker = (BROKER_HANDLE)&fake;
 
-        whenShallStrdup_fail = 9;
+        whenShallStrdup_fail = 5;
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
@@ -1835,28 +1803,20 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the D2C internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the mapping table*/
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the C2D internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the triplets*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the indexes*/
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1)).IgnoreArgument(1);
 
-        //1st vector element
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device key*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-
+        /* 1st vector element */
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
             .IgnoreAllArguments();
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
@@ -1867,18 +1827,12 @@ BEGIN_TEST_SUITE(idmap_ut)
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        // 2nd vector element
+        /* 2nd vector element */
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
             .IgnoreAllArguments();
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
             .IgnoreAllArguments();
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device key*/
-            .IgnoreAllArguments();
-
-
 
         ///Act
         auto n = MODULE_CREATE(theAPIS)(broker, testVector2);
@@ -1890,6 +1844,7 @@ BEGIN_TEST_SUITE(idmap_ut)
         ///Ablution
     }
 
+    /*Tests_SRS_IDMAP_31_005: [ If IdentityMap_Create fails to copy a triplet into the mapping table, then this function shall fail, release all resources, and return NULL. ]*/
     TEST_FUNCTION(IdentityMap_Create_DeepCopy_fail_key2)
     {
         ///Arrange
@@ -1898,7 +1853,7 @@ BEGIN_TEST_SUITE(idmap_ut)
         unsigned char fake;
         BROKER_HANDLE broker = (BROKER_HANDLE)&fake;
 
-        whenShallStrdup_fail = 12;
+        whenShallStrdup_fail = 6;
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
@@ -1910,28 +1865,20 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the D2C internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the mapping table*/
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the C2D internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the triplets*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the indexes*/
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1)).IgnoreArgument(1);
 
-        //1st vector element
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device key*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-
+        /* 1st vector element */
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
             .IgnoreAllArguments();
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
@@ -1942,7 +1889,7 @@ BEGIN_TEST_SUITE(idmap_ut)
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        // 2nd vector element
+        /* 2nd vector element */
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
             .IgnoreAllArguments();
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
@@ -1951,19 +1898,6 @@ BEGIN_TEST_SUITE(idmap_ut)
             .IgnoreAllArguments();
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device key*/
-            .IgnoreAllArguments();
-
-
 
         ///Act
         auto n = MODULE_CREATE(theAPIS)(broker, testVector2);
@@ -2007,19 +1941,14 @@ BEGIN_TEST_SUITE(idmap_ut)
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
         //2nd vector element
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        //internal struct and module data
+        //indexes, triplets, mapping table and module data
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
@@ -2113,8 +2042,6 @@ BEGIN_TEST_SUITE(idmap_ut)
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
 
 
         ///Act
@@ -2158,9 +2085,6 @@ BEGIN_TEST_SUITE(idmap_ut)
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICEKEY_PROPERTY))
@@ -2208,9 +2132,6 @@ BEGIN_TEST_SUITE(idmap_ut)
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICEKEY_PROPERTY))
@@ -2258,9 +2179,6 @@ BEGIN_TEST_SUITE(idmap_ut)
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICEKEY_PROPERTY))
@@ -2281,7 +2199,7 @@ BEGIN_TEST_SUITE(idmap_ut)
 
     }
 
-    /*Tests_SRS_IDMAP_17_025: [If the macAddress of the message is not found in the macToDeviceArray list, then this function shall return.] */
+    /*Tests_SRS_IDMAP_17_025: [If the macAddress of the message is not found in the mapping table, then this function shall return.] */
     TEST_FUNCTION(IdentityMap_Receive_D2C_mac_not_found)
     {
         ///Arrange
@@ -2308,9 +2226,6 @@ BEGIN_TEST_SUITE(idmap_ut)
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICEKEY_PROPERTY))
@@ -2356,9 +2271,6 @@ BEGIN_TEST_SUITE(idmap_ut)
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
             .IgnoreArgument(1);
 
@@ -2406,9 +2318,6 @@ BEGIN_TEST_SUITE(idmap_ut)
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
@@ -2458,9 +2367,6 @@ BEGIN_TEST_SUITE(idmap_ut)
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
@@ -2515,9 +2421,6 @@ BEGIN_TEST_SUITE(idmap_ut)
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
@@ -2572,9 +2475,6 @@ BEGIN_TEST_SUITE(idmap_ut)
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
@@ -2629,9 +2529,6 @@ BEGIN_TEST_SUITE(idmap_ut)
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
@@ -2689,9 +2586,6 @@ BEGIN_TEST_SUITE(idmap_ut)
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
@@ -2757,9 +2651,6 @@ BEGIN_TEST_SUITE(idmap_ut)
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
@@ -2847,9 +2738,6 @@ BEGIN_TEST_SUITE(idmap_ut)
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
@@ -2937,9 +2825,6 @@ BEGIN_TEST_SUITE(idmap_ut)
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
@@ -3595,7 +3480,7 @@ BEGIN_TEST_SUITE(idmap_ut)
 
     }
 
-    //Tests_SRS_IDMAP_17_048: [ If the deviceName of the message is not found in deviceToMacArray, then the message shall not be marked as a C2D message. ]
+    //Tests_SRS_IDMAP_17_048: [ If the deviceName of the message is not found in the mapping table, then the message shall not be marked as a C2D message. ]
     TEST_FUNCTION(IdentityMap_Receive_C2D_id_no_match_no_new_msg)
     {
         ///Arrange
@@ -3657,7 +3542,7 @@ BEGIN_TEST_SUITE(idmap_ut)
 
     }
 
-    //Tests_SRS_IDMAP_17_048: [ If the deviceName of the message is not found in deviceToMacArray, then the message shall not be marked as a C2D message. ]
+    //Tests_SRS_IDMAP_17_048: [ If the deviceName of the message is not found in the mapping table, then the message shall not be marked as a C2D message. ]
     //Tests_SRS_IDMAP_17_045: [ If messageHandle properties does not contain "deviceName" property, then the message shall not be marked as a C2D message. ]
     TEST_FUNCTION(IdentityMap_Receive_C2D_no_id_no_new_msg)
     {
@@ -3842,6 +3727,306 @@ BEGIN_TEST_SUITE(idmap_ut)
         VECTOR_destroy(v);
         MODULE_DESTROY(theAPIS)(n);
 
+    }
+    /*Tests_SRS_IDMAP_31_006: [ IdentityMap_Receive shall look up the MAC address of a message, in either case, by its 48 bit value without copying it. ]*/
+    TEST_FUNCTION(IdentityMap_Receive_D2C_lower_case_mac_Success)
+    {
+        ///Arrange
+        CIdentitymapMocks mocks;
+        const MODULE_API* theAPIS= Module_GetApi(MODULE_API_VERSION_1);
+
+        unsigned char fake;
+        BROKER_HANDLE broker = (BROKER_HANDLE)&fake;
+        auto n = MODULE_CREATE(theAPIS)(broker, testVector2);
+
+        MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
+        auto m = Message_Create(&cfg);
+
+        macAddressProperties = "aa:aa:bb:bb:cc:bb";
+        sourceProperties = GW_SOURCE_BLE_TELEMETRY;
+
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, ConstMap_CloneWriteable(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Map_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY, "a2ndDevice"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, GW_DEVICEKEY_PROPERTY, "a2ndKey"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY, GW_IDMAP_MODULE))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Map_Delete(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetContentHandle(m));
+        STRICT_EXPECTED_CALL(mocks, Message_CreateFromBuffer(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, CONSTBUFFER_Create(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, CONSTBUFFER_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Broker_Publish((BROKER_HANDLE)&fake, n, IGNORED_PTR_ARG))
+            .IgnoreArgument(3);
+
+
+        ///Act
+        MODULE_RECEIVE(theAPIS)(n, m);
+
+        ///Assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///Ablution
+        Message_Destroy(m);
+        MODULE_DESTROY(theAPIS)(n);
+
+    }
+
+    /*Tests_SRS_IDMAP_31_003: [ If two triplets have the same MAC address or the same device ID, the mapping table shall index the first one. ]*/
+    TEST_FUNCTION(IdentityMap_Receive_D2C_duplicate_mac_maps_first)
+    {
+        ///Arrange
+        CIdentitymapMocks mocks;
+        const MODULE_API* theAPIS= Module_GetApi(MODULE_API_VERSION_1);
+
+        unsigned char fake;
+        BROKER_HANDLE broker = (BROKER_HANDLE)&fake;
+        VECTOR_HANDLE v = VECTOR_create(sizeof(IDENTITY_MAP_CONFIG));
+
+        IDENTITY_MAP_CONFIG c1 = { "01:01:01:01:01:01", "Sensor1", "theKeyFor1" };
+        IDENTITY_MAP_CONFIG c2 = { "01:01:01:01:01:01", "Sensor2", "theKeyFor2" };
+        VECTOR_push_back(v, &c1, 1);
+        VECTOR_push_back(v, &c2, 1);
+        auto n = MODULE_CREATE(theAPIS)(broker, v);
+
+        MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
+        auto m = Message_Create(&cfg);
+
+        macAddressProperties = "01:01:01:01:01:01";
+        sourceProperties = GW_SOURCE_BLE_TELEMETRY;
+
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, ConstMap_CloneWriteable(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Map_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY, "Sensor1"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, GW_DEVICEKEY_PROPERTY, "theKeyFor1"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY, GW_IDMAP_MODULE))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Map_Delete(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetContentHandle(m));
+        STRICT_EXPECTED_CALL(mocks, Message_CreateFromBuffer(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, CONSTBUFFER_Create(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, CONSTBUFFER_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Broker_Publish((BROKER_HANDLE)&fake, n, IGNORED_PTR_ARG))
+            .IgnoreArgument(3);
+
+
+        ///Act
+        MODULE_RECEIVE(theAPIS)(n, m);
+
+        ///Assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///Ablution
+        Message_Destroy(m);
+        VECTOR_destroy(v);
+        MODULE_DESTROY(theAPIS)(n);
+
+    }
+
+    /*Tests_SRS_IDMAP_31_007: [ If messageHandle property "source" is "mappingUpdate", IdentityMap_Receive shall parse the message content as a configuration of the same JSON form as the module arguments. ]*/
+    /*Tests_SRS_IDMAP_31_008: [ IdentityMap_Receive shall build a new mapping table from the parsed configuration, as IdentityMap_Create does, and replace the mapping table of the module with it, releasing the previous one. ]*/
+    /*Tests_SRS_IDMAP_31_010: [ IdentityMap_Receive shall not publish a mapping update message. ]*/
+    TEST_FUNCTION(IdentityMap_Receive_mapping_update_replaces_table)
+    {
+        ///Arrange
+        CIdentitymapMocks mocks;
+        const MODULE_API* theAPIS= Module_GetApi(MODULE_API_VERSION_1);
+        const char* config = "pretend this is a valid JSON string";
+
+        unsigned char fake;
+        BROKER_HANDLE broker = (BROKER_HANDLE)&fake;
+        auto n = MODULE_CREATE(theAPIS)(broker, testVector1);
+        IDENTITY_MAP_TABLE * previousTable = ((IDENTITY_MAP_DATA*)n)->table;
+
+        MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
+        auto m = Message_Create(&cfg);
+
+        sourceProperties = GW_SOURCE_IDMAP_UPDATE;
+        messageContent.buffer = (const unsigned char*)config;
+        messageContent.size = strlen(config);
+
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetContent(m));
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(strlen(config) + 1)); /*this is for the configuration string*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+
+        /*parsing*/
+        STRICT_EXPECTED_CALL(mocks, json_parse_string(config));
+        STRICT_EXPECTED_CALL(mocks, json_value_get_array(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(IDENTITY_MAP_CONFIG)));
+        STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .SetReturn(1UL);
+        STRICT_EXPECTED_CALL(mocks, json_array_get_object(IGNORED_PTR_ARG, 0))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "macAddress"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "deviceId"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "deviceKey"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "00:00:00:00:00:00"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "id"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "key"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        /*validation and the new mapping table*/
+        STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the mapping table*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the triplets*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the indexes*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "00:00:00:00:00:00"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "id"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "key"))
+            .IgnoreArgument(1);
+
+        /*the previous mapping table: 3 strings, indexes, triplets and table*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(6);
+
+        /*the parsed configuration*/
+        STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(3);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///Act
+        MODULE_RECEIVE(theAPIS)(n, m);
+
+        ///Assert
+        mocks.AssertActualAndExpectedCalls();
+        IDENTITY_MAP_TABLE * table = ((IDENTITY_MAP_DATA*)n)->table;
+        ASSERT_IS_TRUE(table != previousTable);
+        ASSERT_ARE_EQUAL(size_t, (size_t)1, table->mappingSize);
+        ASSERT_ARE_EQUAL(char_ptr, "id", table->entries[0].strings.deviceId);
+
+        ///Ablution
+        Message_Destroy(m);
+        MODULE_DESTROY(theAPIS)(n);
+
+    }
+
+    /*Tests_SRS_IDMAP_31_009: [ If the message content is not a valid configuration, or the new mapping table cannot be built, IdentityMap_Receive shall keep the mapping table of the module. ]*/
+    TEST_FUNCTION(IdentityMap_Receive_mapping_update_invalid_keeps_table)
+    {
+        ///Arrange
+        CIdentitymapMocks mocks;
+        const MODULE_API* theAPIS= Module_GetApi(MODULE_API_VERSION_1);
+        const char* config = "pretend this is an empty JSON array";
+
+        unsigned char fake;
+        BROKER_HANDLE broker = (BROKER_HANDLE)&fake;
+        auto n = MODULE_CREATE(theAPIS)(broker, testVector1);
+        IDENTITY_MAP_TABLE * previousTable = ((IDENTITY_MAP_DATA*)n)->table;
+
+        MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
+        auto m = Message_Create(&cfg);
+
+        sourceProperties = GW_SOURCE_IDMAP_UPDATE;
+        messageContent.buffer = (const unsigned char*)config;
+        messageContent.size = strlen(config);
+
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetContent(m));
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(strlen(config) + 1)); /*this is for the configuration string*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, json_parse_string(config));
+        STRICT_EXPECTED_CALL(mocks, json_value_get_array(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(IDENTITY_MAP_CONFIG)));
+        STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///Act
+        MODULE_RECEIVE(theAPIS)(n, m);
+
+        ///Assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_IS_TRUE(((IDENTITY_MAP_DATA*)n)->table == previousTable);
+
+        ///Ablution
+        Message_Destroy(m);
+        MODULE_DESTROY(theAPIS)(n);
+
     }
     //
 
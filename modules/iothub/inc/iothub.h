@@ -4,6 +4,7 @@
 #ifndef IOTHUB_H
 #define IOTHUB_H
 
+#include <stdint.h>
 #include "module.h"
 #include <iothub_client_ll.h>
 
@@ -17,10 +18,72 @@ typedef struct IOTHUB_CONFIG_TAG
     const char* IoTHubName;
     const char* IoTHubSuffix;
     IOTHUB_CLIENT_TRANSPORT_PROVIDER transportProvider;
+    size_t maxPersonalities; /*the most device clients kept at once, the least recently used is destroyed beyond it; 0 for no limit*/
+    size_t batchMaxMessages; /*the most messages of a device sent together; 0 sends every message on its own*/
+    size_t batchMaxBytes; /*the most content bytes of a device sent together; 0 for no limit*/
+    unsigned int batchMaxMilliseconds; /*the longest a message waits for its batch to fill; 0 for no limit*/
+    size_t transportPoolSize; /*the shared transports the devices are spread over by name; 0 for one with HTTP and AMQP; ignored with MQTT*/
+    const char* storeDirectory; /*an existing directory where the messages of each device are kept until IoT Hub confirms them; NULL sends them from memory*/
+    size_t storeMaxBytes; /*the most bytes kept per device, the oldest messages are dropped beyond it; 0 for no limit*/
+    unsigned int storeRetentionSeconds; /*kept messages older than this are dropped; 0 keeps them*/
+    size_t storeReplayRate; /*the most kept messages sent per device and per second; 0 for no limit*/
+    size_t maxInFlight; /*the most messages of a device waiting for their confirmation, the next ones wait for a confirmation or are held back; 0 for no limit*/
+    size_t provisioningQueueSize; /*the most messages kept per device while a worker thread creates its IoTHubClient; 0 creates it in Module_Receive*/
 }IOTHUB_CONFIG; /*this needs to be passed to the Module_Create function*/
 
+typedef struct IOTHUB_BATCH_COUNTERS_TAG
+{
+    size_t batchesSent;
+    size_t messagesSent; /*messages in the batches sent*/
+    size_t largestBatch;
+    size_t flushedFull; /*batches sent because they reached batchMaxMessages*/
+    size_t flushedBytes; /*batches sent because they reached batchMaxBytes*/
+    size_t flushedTimeout; /*batches sent because they waited batchMaxMilliseconds*/
+    size_t flushedClosing; /*batches sent because their personality or the module was destroyed*/
+    size_t sendFailures; /*messages of the batches IoTHubClient did not accept*/
+}IOTHUB_BATCH_COUNTERS;
+
+/*latency[0] counts the confirmations which took less than a millisecond, latency[i] those which took from 2^(i-1) to 2^i milliseconds, the last one the slower ones as well*/
+#define IOTHUB_LATENCY_BUCKETS 16
+
+/*waited at most for a confirmation before a message of a device with maxInFlight messages in flight is dropped*/
+#define IOTHUB_IN_FLIGHT_MAX_WAIT_MILLISECONDS 30000
+
+typedef struct IOTHUB_SEND_COUNTERS_TAG
+{
+    size_t sent; /*messages given to IoTHubClient_SendEventAsync*/
+    size_t sendFailures; /*messages IoTHubClient did not accept*/
+    size_t confirmed; /*messages IoT Hub confirmed*/
+    size_t failed; /*messages confirmed with an error*/
+    size_t timedOut; /*messages whose confirmation timed out*/
+    size_t destroyed; /*messages still in flight when their IoTHubClient was destroyed*/
+    size_t inFlight; /*messages waiting for their confirmation*/
+    size_t largestInFlight;
+    size_t windowWaits; /*messages which waited for a confirmation because their device had maxInFlight messages in flight*/
+    size_t windowHolds; /*times messages were kept back in a batch or among the held messages because their device had maxInFlight messages in flight*/
+    size_t windowDrops; /*messages dropped because their device had maxInFlight messages in flight and they could neither wait nor be kept back*/
+    uint64_t latencyTotalMilliseconds; /*from IoTHubClient_SendEventAsync to the confirmation, of the confirmed messages*/
+    uint64_t latencyMaxMilliseconds;
+    size_t latency[IOTHUB_LATENCY_BUCKETS];
+}IOTHUB_SEND_COUNTERS;
+
+typedef struct IOTHUB_DEVICE_TAG
+{
+    const char* deviceName;
+    const char* deviceKey;
+}IOTHUB_DEVICE;
+
 MODULE_EXPORT const MODULE_API* MODULE_STATIC_GETAPI(IOTHUB_MODULE)(MODULE_API_VERSION gateway_api_version);
 
+/*copies the batching counters of the module into counters, returns 0 on success*/
+MODULE_EXPORT int IotHub_GetBatchCounters(MODULE_HANDLE module, IOTHUB_BATCH_COUNTERS* counters);
+
+/*copies the send and confirmation counters of the module into counters, returns 0 on success*/
+MODULE_EXPORT int IotHub_GetSendCounters(MODULE_HANDLE module, IOTHUB_SEND_COUNTERS* counters);
+
+/*creates the IoTHubClients of devices before their first message, returns 0 when every device has its personality*/
+MODULE_EXPORT int IotHub_ProvisionDevices(MODULE_HANDLE module, const IOTHUB_DEVICE* devices, size_t deviceCount);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,73 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef SEGMENT_LOG_H
+#define SEGMENT_LOG_H
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+extern "C"
+{
+#else
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+/*an append-only log of records kept in files, the segments, in a directory. Records are read in the order they were appended
+and stay on disk until they are acknowledged, dropped by size or by age. A log is not thread safe.*/
+typedef struct SEGMENT_LOG_TAG* SEGMENT_LOG_HANDLE;
+
+#define SEGMENT_LOG_DEFAULT_SEGMENT_BYTES (1024 * 1024)
+
+/*the most records read and not acknowledged at once*/
+#define SEGMENT_LOG_MAX_IN_FLIGHT 64
+
+typedef struct SEGMENT_LOG_CONFIG_TAG
+{
+    const char* directory; /*an existing directory holding the files of the log*/
+    const char* name; /*names the files of the log, characters which cannot be in a file name are escaped*/
+    size_t segmentMaxBytes; /*a segment holding this many bytes takes no more records; 0 for SEGMENT_LOG_DEFAULT_SEGMENT_BYTES*/
+    size_t maxBytes; /*beyond this many bytes the oldest segments are dropped; 0 for no limit*/
+    unsigned int retentionSeconds; /*segments whose records are all older are dropped; 0 to keep them*/
+}SEGMENT_LOG_CONFIG;
+
+typedef struct SEGMENT_LOG_COUNTERS_TAG
+{
+    uint64_t appended;
+    uint64_t acknowledged;
+    uint64_t dropped; /*records dropped by size or by age before they were acknowledged*/
+    uint64_t pending; /*records on disk not acknowledged*/
+    size_t bytes; /*bytes of the segments on disk*/
+}SEGMENT_LOG_COUNTERS;
+
+/*opens the log named config->name, the records a previous log of that name left on disk are read first*/
+MOCKABLE_FUNCTION(, SEGMENT_LOG_HANDLE, SegmentLog_Open, const SEGMENT_LOG_CONFIG*, config);
+
+/*closes the files of the log, the records not acknowledged stay on disk*/
+MOCKABLE_FUNCTION(, void, SegmentLog_Close, SEGMENT_LOG_HANDLE, log);
+
+MOCKABLE_FUNCTION(, int, SegmentLog_Append, SEGMENT_LOG_HANDLE, log, const unsigned char*, record, size_t, size);
+
+/*reads the next record; *record stays valid until the next call with log. *record is NULL when every record is read,
+or when SEGMENT_LOG_MAX_IN_FLIGHT records are read and not acknowledged*/
+MOCKABLE_FUNCTION(, int, SegmentLog_Read, SEGMENT_LOG_HANDLE, log, const unsigned char**, record, size_t*, size, uint64_t*, sequence);
+
+/*acknowledges a record read, the segments whose records are all acknowledged are deleted*/
+MOCKABLE_FUNCTION(, int, SegmentLog_Acknowledge, SEGMENT_LOG_HANDLE, log, uint64_t, sequence);
+
+/*the records read and not acknowledged are read again*/
+MOCKABLE_FUNCTION(, void, SegmentLog_Rewind, SEGMENT_LOG_HANDLE, log);
+
+/*drops the segments older than the retention*/
+MOCKABLE_FUNCTION(, void, SegmentLog_Expire, SEGMENT_LOG_HANDLE, log);
+
+MOCKABLE_FUNCTION(, int, SegmentLog_GetCounters, SEGMENT_LOG_HANDLE, log, SEGMENT_LOG_COUNTERS*, counters);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*SEGMENT_LOG_H*/
@@ -3,6 +3,7 @@
 
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 #include <ctype.h>
 #include "azure_c_shared_utility/gballoc.h"
@@ -17,8 +18,13 @@
 #include "azure_c_shared_utility/vector.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/strings.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/tickcounter.h"
 #include "messageproperties.h"
 #include "broker.h"
+#include "segment_log.h"
 
 #include <parson.h>
 
@@ -26,9 +32,27 @@ typedef struct PERSONALITY_TAG
 {
     STRING_HANDLE deviceName;
     STRING_HANDLE deviceKey;
-    IOTHUB_CLIENT_HANDLE iothubHandle;
+    IOTHUB_CLIENT_HANDLE iothubHandle; /*NULL until the provisioning worker has created it*/
     BROKER_HANDLE broker;
     MODULE_HANDLE module;
+    size_t hash; /*hash of deviceName, the key of the personality index*/
+    size_t position; /*position of the personality in the personalities vector*/
+    struct PERSONALITY_TAG* newer; /*least recently used list*/
+    struct PERSONALITY_TAG* older;
+    IOTHUB_MESSAGE_HANDLE* batch; /*room for batchMaxMessages messages, allocated with the personality*/
+    size_t batchCount;
+    size_t batchBytes;
+    tickcounter_ms_t batchStarted; /*when the first message of the batch arrived*/
+    struct PERSONALITY_TAG* nextBatch; /*personalities with a batch waiting, oldest batch first*/
+    struct PERSONALITY_TAG* previousBatch;
+    SEGMENT_LOG_HANDLE store; /*the messages of the device not yet confirmed by IoT Hub, NULL without a store*/
+    size_t storeBudget; /*records the device may still send this second, guarded by confirmationLock*/
+    bool storeConnected; /*false from a failed send until one succeeds, guarded by confirmationLock*/
+    size_t inFlight; /*messages given to the IoTHubClient and not confirmed, guarded by confirmationLock*/
+    bool windowStalled; /*true from a wait for a confirmation which timed out until a confirmation arrives, guarded by confirmationLock*/
+    IOTHUB_MESSAGE_HANDLE* held; /*room for provisioningQueueSize messages kept until the IoTHubClient is created, allocated with the personality*/
+    size_t heldCount;
+    struct PERSONALITY_TAG* nextProvision; /*personalities waiting for the provisioning worker, oldest first*/
 }PERSONALITY;
 
 typedef PERSONALITY* PERSONALITY_PTR;
@@ -39,10 +63,61 @@ typedef struct IOTHUB_HANDLE_DATA_TAG
     STRING_HANDLE IoTHubName;
     STRING_HANDLE IoTHubSuffix;
     IOTHUB_CLIENT_TRANSPORT_PROVIDER transportProvider;
-    TRANSPORT_HANDLE transportHandle;
+    TRANSPORT_HANDLE* transports; /*the shared transports, allocated with the module*/
+    size_t transportCount; /*0 when every personality has its own transport*/
     BROKER_HANDLE broker;
+    PERSONALITY_PTR* personalityIndex; /*open addressing table of the personalities, by deviceName*/
+    size_t indexCapacity;
+    size_t indexCount;
+    size_t maxPersonalities; /*0 means no limit*/
+    PERSONALITY_PTR mostRecent;
+    PERSONALITY_PTR leastRecent;
+    size_t batchMaxMessages; /*0 when batching is off*/
+    size_t batchMaxBytes;
+    unsigned int batchMaxMilliseconds;
+    TICK_COUNTER_HANDLE clock;
+    LOCK_HANDLE lock; /*only with batching, a store or provisioning, guards the personalities against the workers*/
+    THREAD_HANDLE flushWorker;
+    bool stopping;
+    PERSONALITY_PTR oldestBatch;
+    PERSONALITY_PTR newestBatch;
+    IOTHUB_BATCH_COUNTERS batchCounters;
+    STRING_HANDLE storeDirectory; /*NULL when the messages are sent from memory*/
+    size_t storeMaxBytes;
+    unsigned int storeRetentionSeconds;
+    size_t storeReplayRate; /*0 means no limit*/
+    THREAD_HANDLE replayWorker;
+    tickcounter_ms_t storeRefilled; /*when the devices were last given their budget*/
+    size_t maxInFlight; /*0 means no limit*/
+    LOCK_HANDLE confirmationLock; /*guards what the send confirmations change, taken after lock; IoTHubClient is never called with it held*/
+    COND_HANDLE windowOpened; /*posted by every confirmation, only with maxInFlight*/
+    IOTHUB_SEND_COUNTERS sendCounters;
+    size_t provisioningQueueSize; /*0 when the IoTHubClients are created in IotHub_Receive*/
+    THREAD_HANDLE provisionWorker;
+    COND_HANDLE provisionRequested; /*posted when a personality is queued for the provisioning worker, and to stop it*/
+    PERSONALITY_PTR oldestProvision;
+    PERSONALITY_PTR newestProvision;
+    PERSONALITY_PTR provisioning; /*the personality whose IoTHubClient the provisioning worker is creating*/
+    bool provisioningEvicted; /*the personality being provisioned was evicted meanwhile, the worker destroys it*/
 }IOTHUB_HANDLE_DATA;
 
+/*the context of the confirmation of a message*/
+typedef struct SEND_TAG
+{
+    PERSONALITY_PTR personality;
+    uint64_t sequence; /*the record of the store, 0 without a store*/
+    tickcounter_ms_t sent;
+    bool timed; /*false when the time it was sent is not known*/
+}SEND;
+
+typedef enum BATCH_FLUSH_REASON_TAG
+{
+    BATCH_FLUSH_FULL,
+    BATCH_FLUSH_BYTES,
+    BATCH_FLUSH_TIMEOUT,
+    BATCH_FLUSH_CLOSING
+}BATCH_FLUSH_REASON;
+
 #define SOURCE "source"
 #define MAPPING "mapping"
 #define DEVICENAME "deviceName"
@@ -50,6 +125,32 @@ typedef struct IOTHUB_HANDLE_DATA_TAG
 #define SUFFIX "IoTHubSuffix"
 #define HUBNAME "IoTHubName"
 #define TRANSPORT "Transport"
+#define MAXPERSONALITIES "MaxPersonalities"
+#define BATCHMAXMESSAGES "BatchMaxMessages"
+#define BATCHMAXBYTES "BatchMaxBytes"
+#define BATCHMAXMILLISECONDS "BatchMaxMilliseconds"
+#define TRANSPORTPOOLSIZE "TransportPoolSize"
+#define STOREDIRECTORY "StoreDirectory"
+#define STOREMAXBYTES "StoreMaxBytes"
+#define STORERETENTIONSECONDS "StoreRetentionSeconds"
+#define STOREREPLAYRATE "StoreReplayRate"
+#define MAXINFLIGHT "MaxInFlight"
+#define PROVISIONINGQUEUESIZE "ProvisioningQueueSize"
+#define OPTION_BATCHING "Batching"
+
+#define PERSONALITY_INDEX_INITIAL_CAPACITY 16
+
+#define STORE_PERIOD_MILLISECONDS 100
+#define STORE_REFILL_MILLISECONDS 1000
+/*the oldest messages are dropped a segment at a time, a store beyond storeMaxBytes loses about a quarter of it*/
+#define STORE_SEGMENTS_PER_LOG 4
+#define STORE_RECORD_COUNT_SIZE 4
+
+/*returned by SEND_message when the personality has maxInFlight messages in flight, the message is not sent*/
+#define SEND_WINDOW_CLOSED (-1)
+
+static void PERSONALITY_destroy(PERSONALITY* personality);
+static int PROVISION_worker(void* param);
 
 static int strcmp_i(const char* lhs, const char* rhs)
 {
@@ -165,10 +266,119 @@ static void* IotHub_ParseConfigurationFromJson(const char* configuration)
 
                         if (config != NULL)
                         {
-                            strcpy(name, IoTHubName);
-                            strcpy(suffix, IoTHubSuffix);
-                            config->IoTHubName = name;
-                            config->IoTHubSuffix = suffix;
+                            /*Codes_SRS_IOTHUBMODULE_31_001: [ `IotHub_ParseConfigurationFromJson` shall set `maxPersonalities` to the number named "MaxPersonalities", or to 0 if the JSON object does not contain it. ]*/
+                            double maxPersonalities = json_object_get_number(obj, MAXPERSONALITIES);
+                            /*Codes_SRS_IOTHUBMODULE_31_008: [ `IotHub_ParseConfigurationFromJson` shall set `batchMaxMessages`, `batchMaxBytes` and `batchMaxMilliseconds` to the numbers named "BatchMaxMessages", "BatchMaxBytes" and "BatchMaxMilliseconds", or to 0 for those the JSON object does not contain. ]*/
+                            double batchMaxMessages = json_object_get_number(obj, BATCHMAXMESSAGES);
+                            double batchMaxBytes = json_object_get_number(obj, BATCHMAXBYTES);
+                            double batchMaxMilliseconds = json_object_get_number(obj, BATCHMAXMILLISECONDS);
+                            /*Codes_SRS_IOTHUBMODULE_31_024: [ `IotHub_ParseConfigurationFromJson` shall set `transportPoolSize` to the number named "TransportPoolSize", or to 0 if the JSON object does not contain it. ]*/
+                            double transportPoolSize = json_object_get_number(obj, TRANSPORTPOOLSIZE);
+                            /*Codes_SRS_IOTHUBMODULE_31_029: [ `IotHub_ParseConfigurationFromJson` shall set `storeDirectory` to a copy of the string named "StoreDirectory", or to NULL if the JSON object does not contain it, and `storeMaxBytes`, `storeRetentionSeconds` and `storeReplayRate` to the numbers named "StoreMaxBytes", "StoreRetentionSeconds" and "StoreReplayRate", or to 0 for those the JSON object does not contain. ]*/
+                            const char* storeDirectory = json_object_get_string(obj, STOREDIRECTORY);
+                            double storeMaxBytes = json_object_get_number(obj, STOREMAXBYTES);
+                            double storeRetentionSeconds = json_object_get_number(obj, STORERETENTIONSECONDS);
+                            double storeReplayRate = json_object_get_number(obj, STOREREPLAYRATE);
+                            /*Codes_SRS_IOTHUBMODULE_31_042: [ `IotHub_ParseConfigurationFromJson` shall set `maxInFlight` to the number named "MaxInFlight", or to 0 if the JSON object does not contain it. ]*/
+                            double maxInFlight = json_object_get_number(obj, MAXINFLIGHT);
+                            /*Codes_SRS_IOTHUBMODULE_31_054: [ `IotHub_ParseConfigurationFromJson` shall set `provisioningQueueSize` to the number named "ProvisioningQueueSize", or to 0 if the JSON object does not contain it. ]*/
+                            double provisioningQueueSize = json_object_get_number(obj, PROVISIONINGQUEUESIZE);
+                            char* directory = NULL;
+                            if (maxPersonalities < 0)
+                            {
+                                /*Codes_SRS_IOTHUBMODULE_31_002: [ If the value of "MaxPersonalities" is negative then `IotHub_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+                                LogError("%s cannot be negative", MAXPERSONALITIES);
+                                free(name);
+                                free(suffix);
+                                free(config);
+                                config = NULL;
+                            }
+                            else if (
+                                (batchMaxMessages < 0) ||
+                                (batchMaxBytes < 0) ||
+                                (batchMaxMilliseconds < 0)
+                                )
+                            {
+                                /*Codes_SRS_IOTHUBMODULE_31_009: [ If the value of "BatchMaxMessages", "BatchMaxBytes" or "BatchMaxMilliseconds" is negative then `IotHub_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+                                LogError("%s, %s and %s cannot be negative", BATCHMAXMESSAGES, BATCHMAXBYTES, BATCHMAXMILLISECONDS);
+                                free(name);
+                                free(suffix);
+                                free(config);
+                                config = NULL;
+                            }
+                            else if (transportPoolSize < 0)
+                            {
+                                /*Codes_SRS_IOTHUBMODULE_31_025: [ If the value of "TransportPoolSize" is negative then `IotHub_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+                                LogError("%s cannot be negative", TRANSPORTPOOLSIZE);
+                                free(name);
+                                free(suffix);
+                                free(config);
+                                config = NULL;
+                            }
+                            else if (
+                                (storeMaxBytes < 0) ||
+                                (storeRetentionSeconds < 0) ||
+                                (storeReplayRate < 0)
+                                )
+                            {
+                                /*Codes_SRS_IOTHUBMODULE_31_030: [ If the value of "StoreMaxBytes", "StoreRetentionSeconds" or "StoreReplayRate" is negative then `IotHub_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+                                LogError("%s, %s and %s cannot be negative", STOREMAXBYTES, STORERETENTIONSECONDS, STOREREPLAYRATE);
+                                free(name);
+                                free(suffix);
+                                free(config);
+                                config = NULL;
+                            }
+                            else if (maxInFlight < 0)
+                            {
+                                /*Codes_SRS_IOTHUBMODULE_31_043: [ If the value of "MaxInFlight" is negative then `IotHub_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+                                LogError("%s cannot be negative", MAXINFLIGHT);
+                                free(name);
+                                free(suffix);
+                                free(config);
+                                config = NULL;
+                            }
+                            else if (provisioningQueueSize < 0)
+                            {
+                                /*Codes_SRS_IOTHUBMODULE_31_055: [ If the value of "ProvisioningQueueSize" is negative then `IotHub_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+                                LogError("%s cannot be negative", PROVISIONINGQUEUESIZE);
+                                free(name);
+                                free(suffix);
+                                free(config);
+                                config = NULL;
+                            }
+                            else if (
+                                (storeDirectory != NULL) &&
+                                ((directory = malloc(strlen(storeDirectory) + 1)) == NULL)
+                                )
+                            {
+                                LogError("Could not allocate memory for %s", STOREDIRECTORY);
+                                free(name);
+                                free(suffix);
+                                free(config);
+                                config = NULL;
+                            }
+                            else
+                            {
+                                strcpy(name, IoTHubName);
+                                strcpy(suffix, IoTHubSuffix);
+                                config->IoTHubName = name;
+                                config->IoTHubSuffix = suffix;
+                                config->maxPersonalities = (size_t)maxPersonalities;
+                                config->batchMaxMessages = (size_t)batchMaxMessages;
+                                config->batchMaxBytes = (size_t)batchMaxBytes;
+                                config->batchMaxMilliseconds = (unsigned int)batchMaxMilliseconds;
+                                config->transportPoolSize = (size_t)transportPoolSize;
+                                if (directory != NULL)
+                                {
+                                    strcpy(directory, storeDirectory);
+                                }
+                                config->storeDirectory = directory;
+                                config->storeMaxBytes = (size_t)storeMaxBytes;
+                                config->storeRetentionSeconds = (unsigned int)storeRetentionSeconds;
+                                config->storeReplayRate = (size_t)storeReplayRate;
+                                config->maxInFlight = (size_t)maxInFlight;
+                                config->provisioningQueueSize = (size_t)provisioningQueueSize;
+                            }
                         }
 
                         result = config;
@@ -191,180 +401,1399 @@ static void IotHub_FreeConfiguration(void* configuration)
         /*Codes_SRS_IOTHUBMODULE_05_015: [ `IotHub_FreeConfiguration` shall free the strings referenced by the `IoTHubName` and `IoTHubSuffix` data members, and then free the `IOTHUB_CONFIG` structure itself. ]*/
         free((void*)config->IoTHubName);
         free((void*)config->IoTHubSuffix);
+        /*Codes_SRS_IOTHUBMODULE_31_031: [ `IotHub_FreeConfiguration` shall free the string referenced by the `storeDirectory` data member, if any. ]*/
+        if (config->storeDirectory != NULL)
+        {
+            free((void*)config->storeDirectory);
+        }
         free(config);
     }
 }
 
-static MODULE_HANDLE IotHub_Create(BROKER_HANDLE broker, const void* configuration)
+static int SEND_start(IOTHUB_HANDLE_DATA* moduleHandleData)
 {
-    IOTHUB_HANDLE_DATA *result;
-    const IOTHUB_CONFIG* config = configuration;
-
-    /*Codes_SRS_IOTHUBMODULE_02_001: [ If `broker` is `NULL` then `IotHub_Create` shall fail and return `NULL`. ]*/
-    /*Codes_SRS_IOTHUBMODULE_02_002: [ If `configuration` is `NULL` then `IotHub_Create` shall fail and return `NULL`. ]*/
-    /*Codes_SRS_IOTHUBMODULE_02_003: [ If `configuration->IoTHubName` is `NULL` then `IotHub_Create` shall and return `NULL`. ]*/
-    /*Codes_SRS_IOTHUBMODULE_02_004: [ If `configuration->IoTHubSuffix` is `NULL` then `IotHub_Create` shall fail and return `NULL`. ]*/
-    if (
-        (broker == NULL) ||
-        (configuration == NULL)
-        )
+    int result;
+    /*Codes_SRS_IOTHUBMODULE_31_044: [ `IotHub_Create` shall create a tick counter and a lock for the send confirmations, and a condition if `configuration->maxInFlight` is not 0. ]*/
+    if ((moduleHandleData->clock = tickcounter_create()) == NULL)
     {
-        LogError("invalid arg broker=%p, configuration=%p", broker, configuration);
-        result = NULL;
+        LogError("unable to tickcounter_create");
+        result = __LINE__;
+    }
+    else if ((moduleHandleData->confirmationLock = Lock_Init()) == NULL)
+    {
+        LogError("unable to Lock_Init");
+        tickcounter_destroy(moduleHandleData->clock);
+        result = __LINE__;
     }
     else if (
-        (config->IoTHubName == NULL) ||
-        (config->IoTHubSuffix == NULL) ||
-        (config->transportProvider == NULL)
+        (moduleHandleData->maxInFlight != 0) &&
+        ((moduleHandleData->windowOpened = Condition_Init()) == NULL)
         )
     {
-        LogError("invalid configuration IoTHubName=%s IoTHubSuffix=%s transportProvider=%p",
-            (config != NULL) ? config->IoTHubName : "<null>",
-            (config != NULL) ? config->IoTHubSuffix : "<null>",
-            (config != NULL) ? config->transportProvider : 0);
-        result = NULL;
+        LogError("unable to Condition_Init");
+        (void)Lock_Deinit(moduleHandleData->confirmationLock);
+        tickcounter_destroy(moduleHandleData->clock);
+        result = __LINE__;
     }
     else
     {
-        result = malloc(sizeof(IOTHUB_HANDLE_DATA));
-        /*Codes_SRS_IOTHUBMODULE_02_027: [ When `IotHub_Create` encounters an internal failure it shall fail and return `NULL`. ]*/
-        if (result == NULL)
+        result = 0;
+    }
+    return result;
+}
+
+static void SEND_stop(IOTHUB_HANDLE_DATA* moduleHandleData)
+{
+    if (moduleHandleData->windowOpened != NULL)
+    {
+        Condition_Deinit(moduleHandleData->windowOpened);
+    }
+    (void)Lock_Deinit(moduleHandleData->confirmationLock);
+    tickcounter_destroy(moduleHandleData->clock);
+}
+
+/*counts a message of the personality in flight, called with confirmationLock held*/
+static void SEND_count(IOTHUB_HANDLE_DATA* moduleHandleData, PERSONALITY_PTR personality)
+{
+    IOTHUB_SEND_COUNTERS* counters = &moduleHandleData->sendCounters;
+    personality->inFlight++;
+    counters->sent++;
+    counters->inFlight++;
+    if (counters->inFlight > counters->largestInFlight)
+    {
+        counters->largestInFlight = counters->inFlight;
+    }
+}
+
+/*takes back a message IoTHubClient did not accept, called with confirmationLock held*/
+static void SEND_uncount(IOTHUB_HANDLE_DATA* moduleHandleData, PERSONALITY_PTR personality)
+{
+    personality->inFlight--;
+    moduleHandleData->sendCounters.inFlight--;
+    moduleHandleData->sendCounters.sendFailures++;
+}
+
+static void SEND_stamp(IOTHUB_HANDLE_DATA* moduleHandleData, SEND* send, PERSONALITY_PTR personality, uint64_t sequence)
+{
+    send->personality = personality;
+    send->sequence = sequence;
+    send->timed = (tickcounter_get_current_ms(moduleHandleData->clock, &send->sent) == 0);
+}
+
+/*called with confirmationLock held*/
+static bool SEND_window_closed(const IOTHUB_HANDLE_DATA* moduleHandleData, const PERSONALITY* personality)
+{
+    return (moduleHandleData->maxInFlight != 0) && (personality->inFlight >= moduleHandleData->maxInFlight);
+}
+
+/*waits until the personality has less than maxInFlight messages in flight, called without lock and without confirmationLock*/
+static void SEND_wait_for_window(IOTHUB_HANDLE_DATA* moduleHandleData, PERSONALITY_PTR personality)
+{
+    if (moduleHandleData->maxInFlight != 0)
+    {
+        if (Lock(moduleHandleData->confirmationLock) != LOCK_OK)
         {
-            LogError("malloc returned NULL");
-            /*return as is*/
+            LogError("unable to lock");
         }
         else
         {
-            /*Codes_SRS_IOTHUBMODULE_02_006: [ `IotHub_Create` shall create an empty `VECTOR` containing pointers to `PERSONALITY`s. ]*/
-            result->personalities = VECTOR_create(sizeof(PERSONALITY_PTR));
-            if (result->personalities == NULL)
-            {
-                /*Codes_SRS_IOTHUBMODULE_02_007: [ If creating the personality vector fails then `IotHub_Create` shall fail and return `NULL`. ]*/
-                free(result);
-                result = NULL;
-                LogError("VECTOR_create returned NULL");
-            }
-            else
+            /*Codes_SRS_IOTHUBMODULE_31_049: [ If `maxInFlight` is not 0, a message of a personality which has `maxInFlight` messages in flight shall wait in `IotHub_Receive` for one of them to be confirmed, but at most `IOTHUB_IN_FLIGHT_MAX_WAIT_MILLISECONDS`, and shall be dropped if none is; the next messages of the personality shall be dropped without waiting until a message of the personality is confirmed. ]*/
+            if (SEND_window_closed(moduleHandleData, personality) && !personality->windowStalled)
             {
-                result->transportProvider = config->transportProvider;
-                if (result->transportProvider == HTTP_Protocol ||
-                    result->transportProvider == AMQP_Protocol)
-                {
-                    /*Codes_SRS_IOTHUBMODULE_17_001: [ If `configuration->transportProvider` is `HTTP_Protocol` or `AMQP_Protocol`, `IotHub_Create` shall create a shared transport by calling `IoTHubTransport_Create`. ]*/
-                    result->transportHandle = IoTHubTransport_Create(config->transportProvider, config->IoTHubName, config->IoTHubSuffix);
-                    if (result->transportHandle == NULL)
-                    {
-                        /*Codes_SRS_IOTHUBMODULE_17_002: [ If creating the shared transport fails, `IotHub_Create` shall fail and return `NULL`. ]*/
-                        VECTOR_destroy(result->personalities);
-                        free(result);
-                        result = NULL;
-                        LogError("VECTOR_create returned NULL");
-                    }
-                }
-                else
-                {
-                    result->transportHandle = NULL;
-                }
-
-                if (result != NULL)
+                tickcounter_ms_t started;
+                tickcounter_ms_t now;
+                bool waiting = (tickcounter_get_current_ms(moduleHandleData->clock, &started) == 0);
+                moduleHandleData->sendCounters.windowWaits++;
+                now = started;
+                while (waiting && SEND_window_closed(moduleHandleData, personality))
                 {
-                    /*Codes_SRS_IOTHUBMODULE_02_028: [ `IotHub_Create` shall create a copy of `configuration->IoTHubName`. ]*/
-                    /*Codes_SRS_IOTHUBMODULE_02_029: [ `IotHub_Create` shall create a copy of `configuration->IoTHubSuffix`. ]*/
-                    if ((result->IoTHubName = STRING_construct(config->IoTHubName)) == NULL)
-                    {
-                        LogError("STRING_construct returned NULL");
-                        IoTHubTransport_Destroy(result->transportHandle);
-                        VECTOR_destroy(result->personalities);
-                        free(result);
-                        result = NULL;
-                    }
-                    else if ((result->IoTHubSuffix = STRING_construct(config->IoTHubSuffix)) == NULL)
+                    if ((now - started) >= IOTHUB_IN_FLIGHT_MAX_WAIT_MILLISECONDS)
                     {
-                        LogError("STRING_construct returned NULL");
-                        STRING_delete(result->IoTHubName);
-                        IoTHubTransport_Destroy(result->transportHandle);
-                        VECTOR_destroy(result->personalities);
-                        free(result);
-                        result = NULL;
+                        waiting = false;
                     }
                     else
                     {
-                        /*Codes_SRS_IOTHUBMODULE_17_004: [ `IotHub_Create` shall store the broker. ]*/
-                        result->broker = broker;
-                        /*Codes_SRS_IOTHUBMODULE_02_008: [ Otherwise, `IotHub_Create` shall return a non-`NULL` handle. ]*/
+                        (void)Condition_Wait(moduleHandleData->windowOpened, moduleHandleData->confirmationLock, (int)(IOTHUB_IN_FLIGHT_MAX_WAIT_MILLISECONDS - (now - started)));
+                        waiting = (tickcounter_get_current_ms(moduleHandleData->clock, &now) == 0);
                     }
                 }
+
+                if (SEND_window_closed(moduleHandleData, personality))
+                {
+                    LogError("the device %s still has %zu messages in flight, its messages are dropped until one is confirmed", STRING_c_str(personality->deviceName), personality->inFlight);
+                    personality->windowStalled = true;
+                }
             }
+            (void)Unlock(moduleHandleData->confirmationLock);
         }
     }
-    return result;
 }
 
-static void IotHub_Destroy(MODULE_HANDLE moduleHandle)
+/*counts the messages kept back or dropped because their personality had maxInFlight messages in flight*/
+static void SEND_count_window(IOTHUB_HANDLE_DATA* moduleHandleData, size_t held, size_t dropped)
 {
-    /*Codes_SRS_IOTHUBMODULE_02_023: [ If `moduleHandle` is `NULL` then `IotHub_Destroy` shall return. ]*/
-    if (moduleHandle == NULL)
+    if (Lock(moduleHandleData->confirmationLock) != LOCK_OK)
     {
-        LogError("moduleHandle parameter was NULL");
+        LogError("unable to lock");
     }
     else
     {
-        /*Codes_SRS_IOTHUBMODULE_02_024: [ Otherwise `IotHub_Destroy` shall free all used resources. ]*/
-        IOTHUB_HANDLE_DATA * handleData = moduleHandle;
-        size_t vectorSize = VECTOR_size(handleData->personalities);
-        for (size_t i = 0; i < vectorSize; i++)
+        moduleHandleData->sendCounters.windowHolds += held;
+        moduleHandleData->sendCounters.windowDrops += dropped;
+        (void)Unlock(moduleHandleData->confirmationLock);
+    }
+}
+
+static void SEND_record_latency(IOTHUB_SEND_COUNTERS* counters, tickcounter_ms_t latency)
+{
+    size_t bucket = 0;
+    while (
+        (bucket < IOTHUB_LATENCY_BUCKETS - 1) &&
+        (latency >= ((tickcounter_ms_t)1 << bucket))
+        )
+    {
+        bucket++;
+    }
+    counters->latency[bucket]++;
+    counters->latencyTotalMilliseconds += latency;
+    if (latency > counters->latencyMaxMilliseconds)
+    {
+        counters->latencyMaxMilliseconds = latency;
+    }
+}
+
+static size_t STORE_budget(const IOTHUB_HANDLE_DATA* moduleHandleData)
+{
+    return (moduleHandleData->storeReplayRate == 0) ? SIZE_MAX : moduleHandleData->storeReplayRate;
+}
+
+/*acknowledges or rewinds the store of the personality, called with confirmationLock held*/
+static void STORE_confirmed(PERSONALITY_PTR personality, uint64_t sequence, IOTHUB_CLIENT_CONFIRMATION_RESULT result)
+{
+    if (result == IOTHUB_CLIENT_CONFIRMATION_OK)
+    {
+        /*Codes_SRS_IOTHUBMODULE_31_037: [ When IoT Hub confirms a stored message, the record shall be acknowledged in the store, and the store deletes the segments whose records are all acknowledged. ]*/
+        if (SegmentLog_Acknowledge(personality->store, sequence) != 0)
         {
-            PERSONALITY_PTR* personality = VECTOR_element(handleData->personalities, i);
-            STRING_delete((*personality)->deviceKey);
-            STRING_delete((*personality)->deviceName);
-            IoTHubClient_Destroy((*personality)->iothubHandle);
-            free(*personality);
+            LogError("unable to acknowledge record %llu of the device %s", (unsigned long long)sequence, STRING_c_str(personality->deviceName));
         }
-        IoTHubTransport_Destroy(handleData->transportHandle);
-        VECTOR_destroy(handleData->personalities);
-        STRING_delete(handleData->IoTHubName);
-        STRING_delete(handleData->IoTHubSuffix);
-        free(handleData);
+        personality->storeConnected = true;
+    }
+    else if (result == IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY)
+    {
+        /*the record stays on disk until the personality of the device is created again*/
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBMODULE_31_038: [ When a stored message fails or times out, the device shall be taken as offline and the records not acknowledged shall be read again; while a device is offline, one record at a time shall be sent, once per second, until one is confirmed. ]*/
+        personality->storeConnected = false;
+        personality->storeBudget = 0;
+        SegmentLog_Rewind(personality->store);
     }
 }
 
-static bool lookup_DeviceName(const void* element, const void* value)
+static void SEND_confirmation(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* userContextCallback)
 {
-    return (strcmp(STRING_c_str((*(PERSONALITY_PTR*)element)->deviceName), value) == 0);
+    SEND* send = (SEND*)userContextCallback;
+    PERSONALITY_PTR personality = send->personality;
+    IOTHUB_HANDLE_DATA* moduleHandleData = (IOTHUB_HANDLE_DATA*)personality->module;
+    tickcounter_ms_t now;
+    bool timed = (result == IOTHUB_CLIENT_CONFIRMATION_OK) && send->timed && (tickcounter_get_current_ms(moduleHandleData->clock, &now) == 0);
+    if (Lock(moduleHandleData->confirmationLock) != LOCK_OK)
+    {
+        LogError("unable to lock, a confirmation is lost");
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBMODULE_31_047: [ When a message is confirmed, its personality shall have one message less in flight; a message confirmed by IoT Hub shall count its latency in the histogram of the module, the others shall be counted as failed, timed out or destroyed by their result. ]*/
+        IOTHUB_SEND_COUNTERS* counters = &moduleHandleData->sendCounters;
+        personality->inFlight--;
+        personality->windowStalled = false;
+        counters->inFlight--;
+        switch (result)
+        {
+        case IOTHUB_CLIENT_CONFIRMATION_OK:
+            counters->confirmed++;
+            if (timed)
+            {
+                SEND_record_latency(counters, now - send->sent);
+            }
+            break;
+        case IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY:
+            counters->destroyed++;
+            break;
+        case IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT:
+            counters->timedOut++;
+            break;
+        default:
+            counters->failed++;
+            break;
+        }
+
+        if (personality->store != NULL)
+        {
+            STORE_confirmed(personality, send->sequence, result);
+        }
+
+        if (moduleHandleData->windowOpened != NULL)
+        {
+            (void)Condition_Post(moduleHandleData->windowOpened);
+        }
+        (void)Unlock(moduleHandleData->confirmationLock);
+    }
+    free(send);
 }
 
-static IOTHUBMESSAGE_DISPOSITION_RESULT IotHub_ReceiveMessageCallback(IOTHUB_MESSAGE_HANDLE msg, void* userContextCallback)
+/*sends a message of the personality, unless it has maxInFlight messages in flight: then nothing is sent and SEND_WINDOW_CLOSED is returned; called without confirmationLock*/
+static int SEND_message(IOTHUB_HANDLE_DATA* moduleHandleData, PERSONALITY_PTR personality, IOTHUB_MESSAGE_HANDLE message)
 {
-    IOTHUBMESSAGE_DISPOSITION_RESULT result;
-    if (userContextCallback == NULL)
+    int result;
+    SEND* send = (SEND*)malloc(sizeof(SEND));
+    if (send == NULL)
     {
-        /*Codes_SRS_IOTHUBMODULE_17_005: [ If `userContextCallback` is `NULL`, then `IotHub_ReceiveMessageCallback` shall return `IOTHUBMESSAGE_ABANDONED`. ]*/
-        LogError("No context to associate message");
-        result = IOTHUBMESSAGE_ABANDONED;
+        LogError("unable to allocate the context of a confirmation");
+        result = __LINE__;
+    }
+    else if (Lock(moduleHandleData->confirmationLock) != LOCK_OK)
+    {
+        LogError("unable to lock");
+        free(send);
+        result = __LINE__;
+    }
+    else if (SEND_window_closed(moduleHandleData, personality))
+    {
+        (void)Unlock(moduleHandleData->confirmationLock);
+        free(send);
+        result = SEND_WINDOW_CLOSED;
     }
     else
     {
-        PERSONALITY_PTR personality = (PERSONALITY_PTR)userContextCallback;
-        IOTHUBMESSAGE_CONTENT_TYPE msgContentType = IoTHubMessage_GetContentType(msg);
-        if (msgContentType == IOTHUBMESSAGE_UNKNOWN)
+        SEND_count(moduleHandleData, personality);
+        (void)Unlock(moduleHandleData->confirmationLock);
+
+        /*Codes_SRS_IOTHUBMODULE_31_046: [ Every message shall be given to `IoTHubClient_SendEventAsync` with a confirmation callback whose context holds its personality and the time it was sent, and shall be counted in flight until it is confirmed. ]*/
+        SEND_stamp(moduleHandleData, send, personality, 0);
+        if (IoTHubClient_SendEventAsync(personality->iothubHandle, message, SEND_confirmation, send) != IOTHUB_CLIENT_OK)
         {
-            /*Codes_SRS_IOTHUBMODULE_17_006: [ If Message Content type is `IOTHUBMESSAGE_UNKNOWN`, then `IotHub_ReceiveMessageCallback` shall return `IOTHUBMESSAGE_ABANDONED`. ]*/
-            LogError("Message content type is unknown");
-            result = IOTHUBMESSAGE_ABANDONED;
+            /*Codes_SRS_IOTHUBMODULE_31_048: [ If `IoTHubClient_SendEventAsync` fails, the message shall no longer be counted in flight and shall be counted as a send failure. ]*/
+            LogError("unable to IoTHubClient_SendEventAsync");
+            if (Lock(moduleHandleData->confirmationLock) != LOCK_OK)
+            {
+                LogError("unable to lock");
+            }
+            else
+            {
+                SEND_uncount(moduleHandleData, personality);
+                (void)Unlock(moduleHandleData->confirmationLock);
+            }
+            free(send);
+            result = __LINE__;
         }
         else
         {
-            /* Handle message content */
-            MESSAGE_CONFIG newMessageConfig;
-            IOTHUB_MESSAGE_RESULT msgResult;
-            if (msgContentType == IOTHUBMESSAGE_STRING)
+            result = 0;
+        }
+    }
+    return result;
+}
+
+static void BATCH_unlink(IOTHUB_HANDLE_DATA* moduleHandleData, PERSONALITY_PTR personality)
+{
+    if (personality->previousBatch == NULL)
+    {
+        moduleHandleData->oldestBatch = personality->nextBatch;
+    }
+    else
+    {
+        personality->previousBatch->nextBatch = personality->nextBatch;
+    }
+
+    if (personality->nextBatch == NULL)
+    {
+        moduleHandleData->newestBatch = personality->previousBatch;
+    }
+    else
+    {
+        personality->nextBatch->previousBatch = personality->previousBatch;
+    }
+}
+
+static void BATCH_push(IOTHUB_HANDLE_DATA* moduleHandleData, PERSONALITY_PTR personality)
+{
+    personality->nextBatch = NULL;
+    personality->previousBatch = moduleHandleData->newestBatch;
+    if (moduleHandleData->newestBatch == NULL)
+    {
+        moduleHandleData->oldestBatch = personality;
+    }
+    else
+    {
+        moduleHandleData->newestBatch->nextBatch = personality;
+    }
+    moduleHandleData->newestBatch = personality;
+}
+
+/*packs the contents of the messages in a JSON array, the properties are those of the first message*/
+static IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromBatch(IOTHUB_MESSAGE_HANDLE* batch, size_t batchCount)
+{
+    IOTHUB_MESSAGE_HANDLE result;
+    size_t size = batchCount + 1; /*the brackets and the commas*/
+    size_t i;
+    for (i = 0; i < batchCount; i++)
+    {
+        const unsigned char* content;
+        size_t contentSize;
+        if (IoTHubMessage_GetByteArray(batch[i], &content, &contentSize) != IOTHUB_MESSAGE_OK)
+        {
+            break;
+        }
+        size += contentSize;
+    }
+
+    if (i != batchCount)
+    {
+        LogError("unable to IoTHubMessage_GetByteArray");
+        result = NULL;
+    }
+    else
+    {
+        unsigned char* buffer = (unsigned char*)malloc(size);
+        if (buffer == NULL)
+        {
+            LogError("unable to allocate %zu bytes for a batch", size);
+            result = NULL;
+        }
+        else
+        {
+            size_t used = 0;
+            buffer[used++] = '[';
+            for (i = 0; i < batchCount; i++)
             {
-                /*Codes_SRS_IOTHUBMODULE_17_014: [ If Message content type is `IOTHUBMESSAGE_STRING`, `IotHub_ReceiveMessageCallback` shall get the buffer from results of `IoTHubMessage_GetString`. ]*/
-                const char* sourceStr = IoTHubMessage_GetString(msg);
-                newMessageConfig.source = (const unsigned char*)sourceStr;
-                /*Codes_SRS_IOTHUBMODULE_17_015: [ If Message content type is `IOTHUBMESSAGE_STRING`, `IotHub_ReceiveMessageCallback` shall get the buffer size from the string length. ]*/
-                newMessageConfig.size = strlen(sourceStr);
-                msgResult = IOTHUB_MESSAGE_OK;
+                const unsigned char* content;
+                size_t contentSize;
+                (void)IoTHubMessage_GetByteArray(batch[i], &content, &contentSize);
+                if (i != 0)
+                {
+                    buffer[used++] = ',';
+                }
+                memcpy(buffer + used, content, contentSize);
+                used += contentSize;
+            }
+            buffer[used++] = ']';
+
+            result = IoTHubMessage_CreateFromByteArray(buffer, used);
+            if (result == NULL)
+            {
+                LogError("IoTHubMessage_CreateFromByteArray failed");
+            }
+            else
+            {
+                const char* const* keys;
+                const char* const* values;
+                size_t nProperties;
+                MAP_HANDLE packedProperties = IoTHubMessage_Properties(result);
+                if (Map_GetInternals(IoTHubMessage_Properties(batch[0]), &keys, &values, &nProperties) != MAP_OK)
+                {
+                    LogError("unable to get the properties of the batch");
+                    IoTHubMessage_Destroy(result);
+                    result = NULL;
+                }
+                else
+                {
+                    for (i = 0; i < nProperties; i++)
+                    {
+                        if (Map_AddOrUpdate(packedProperties, keys[i], values[i]) != MAP_OK)
+                        {
+                            LogError("unable to Map_AddOrUpdate");
+                            break;
+                        }
+                    }
+
+                    if (i != nProperties)
+                    {
+                        IoTHubMessage_Destroy(result);
+                        result = NULL;
+                    }
+                }
+            }
+            free(buffer);
+        }
+    }
+    return result;
+}
+
+/*tells whether the message would put more than batchMaxBytes content bytes in the batch*/
+static bool BATCH_overflows(const IOTHUB_HANDLE_DATA* moduleHandleData, const PERSONALITY* personality, size_t size)
+{
+    return
+        (personality->batchCount != 0) &&
+        (moduleHandleData->batchMaxBytes != 0) &&
+        (personality->batchBytes + size > moduleHandleData->batchMaxBytes);
+}
+
+/*sends the batch of the personality, called with the lock held. The messages the window of the personality has no room for stay in
+the batch until the next flush, but when the batch is flushed because the personality closes: they are dropped then*/
+static void BATCH_flush(IOTHUB_HANDLE_DATA* moduleHandleData, PERSONALITY_PTR personality, BATCH_FLUSH_REASON reason)
+{
+    IOTHUB_BATCH_COUNTERS* counters = &moduleHandleData->batchCounters;
+    size_t taken = 0; /*the messages which leave the batch, from its start*/
+    size_t dropped = 0;
+    size_t i;
+
+    if (moduleHandleData->transportProvider == MQTT_Protocol)
+    {
+        /*Codes_SRS_IOTHUBMODULE_31_017: [ With the MQTT transport, a batch shall be sent as one message whose content is a JSON array of the contents of its messages, and whose properties are those of its first message. ]*/
+        IOTHUB_MESSAGE_HANDLE packed = IoTHubMessage_CreateFromBatch(personality->batch, personality->batchCount);
+        if (packed == NULL)
+        {
+            LogError("unable to pack a batch of %zu messages", personality->batchCount);
+            counters->sendFailures += personality->batchCount;
+            taken = personality->batchCount;
+        }
+        else
+        {
+            int result = SEND_message(moduleHandleData, personality, packed);
+            if (result != SEND_WINDOW_CLOSED)
+            {
+                if (result != 0)
+                {
+                    LogError("unable to send a batch of %zu messages", personality->batchCount);
+                    counters->sendFailures += personality->batchCount;
+                }
+                taken = personality->batchCount;
+            }
+            IoTHubMessage_Destroy(packed);
+        }
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBMODULE_31_016: [ Otherwise, the messages of a batch shall be given to `IoTHubClient_SendEventAsync` one after the other, for the transport to send them together. ]*/
+        while (taken < personality->batchCount)
+        {
+            int result = SEND_message(moduleHandleData, personality, personality->batch[taken]);
+            if (result == SEND_WINDOW_CLOSED)
+            {
+                break;
+            }
+            else if (result != 0)
+            {
+                LogError("unable to send a message of a batch");
+                counters->sendFailures++;
+            }
+            taken++;
+        }
+    }
+
+    /*Codes_SRS_IOTHUBMODULE_31_067: [ If `maxInFlight` is not 0, the messages of a batch the personality has no room in flight for shall stay in the batch until the next flush, but they shall be dropped when the batch is flushed because the personality is destroyed. ]*/
+    if (taken != personality->batchCount)
+    {
+        if (reason == BATCH_FLUSH_CLOSING)
+        {
+            dropped = personality->batchCount - taken;
+            LogError("the device %s has maxInFlight messages in flight, the %zu messages left in its batch are dropped", STRING_c_str(personality->deviceName), dropped);
+            SEND_count_window(moduleHandleData, 0, dropped);
+            taken = personality->batchCount;
+        }
+        else
+        {
+            SEND_count_window(moduleHandleData, 1, 0);
+        }
+    }
+
+    if (taken != dropped)
+    {
+        counters->batchesSent++;
+        counters->messagesSent += taken - dropped;
+        if (taken - dropped > counters->largestBatch)
+        {
+            counters->largestBatch = taken - dropped;
+        }
+        switch (reason)
+        {
+        case BATCH_FLUSH_FULL:
+            counters->flushedFull++;
+            break;
+        case BATCH_FLUSH_BYTES:
+            counters->flushedBytes++;
+            break;
+        case BATCH_FLUSH_TIMEOUT:
+            counters->flushedTimeout++;
+            break;
+        default:
+            counters->flushedClosing++;
+            break;
+        }
+    }
+
+    for (i = 0; i < taken; i++)
+    {
+        IoTHubMessage_Destroy(personality->batch[i]);
+    }
+    personality->batchCount -= taken;
+    personality->batchBytes = 0;
+    if (personality->batchCount == 0)
+    {
+        BATCH_unlink(moduleHandleData, personality);
+    }
+    else
+    {
+        if (taken != 0)
+        {
+            memmove(personality->batch, personality->batch + taken, personality->batchCount * sizeof(IOTHUB_MESSAGE_HANDLE));
+        }
+        for (i = 0; i < personality->batchCount; i++)
+        {
+            const unsigned char* content;
+            size_t contentSize;
+            if (IoTHubMessage_GetByteArray(personality->batch[i], &content, &contentSize) == IOTHUB_MESSAGE_OK)
+            {
+                personality->batchBytes += contentSize;
+            }
+        }
+    }
+}
+
+static int BATCH_flush_worker(void* param)
+{
+    IOTHUB_HANDLE_DATA* moduleHandleData = (IOTHUB_HANDLE_DATA*)param;
+    /*waking up twice per time limit, no message waits much longer than it*/
+    unsigned int period = (moduleHandleData->batchMaxMilliseconds > 1) ? (moduleHandleData->batchMaxMilliseconds / 2) : 1;
+    bool stopping = false;
+    while (!stopping)
+    {
+        if (Lock(moduleHandleData->lock) != LOCK_OK)
+        {
+            LogError("unable to lock, the batch flush worker stops");
+            stopping = true;
+        }
+        else
+        {
+            tickcounter_ms_t now;
+            stopping = moduleHandleData->stopping;
+            if (!stopping && (tickcounter_get_current_ms(moduleHandleData->clock, &now) == 0))
+            {
+                /*Codes_SRS_IOTHUBMODULE_31_018: [ The flush worker shall send every batch whose first message has waited `batchMaxMilliseconds`. ]*/
+                PERSONALITY_PTR personality = moduleHandleData->oldestBatch;
+                while (
+                    (personality != NULL) &&
+                    ((now - personality->batchStarted) >= moduleHandleData->batchMaxMilliseconds)
+                    )
+                {
+                    /*a batch held back by the window of its personality stays in the list, the next ones are sent*/
+                    PERSONALITY_PTR next = personality->nextBatch;
+                    BATCH_flush(moduleHandleData, personality, BATCH_FLUSH_TIMEOUT);
+                    personality = next;
+                }
+            }
+            (void)Unlock(moduleHandleData->lock);
+
+            if (!stopping)
+            {
+                ThreadAPI_Sleep(period);
+            }
+        }
+    }
+    return 0;
+}
+
+static int BATCH_start(IOTHUB_HANDLE_DATA* moduleHandleData)
+{
+    int result;
+    /*Codes_SRS_IOTHUBMODULE_31_010: [ If `configuration->batchMaxMessages` is not 0, `IotHub_Create` shall create a lock for batching. ]*/
+    if ((moduleHandleData->lock = Lock_Init()) == NULL)
+    {
+        LogError("unable to Lock_Init");
+        result = __LINE__;
+    }
+    /*Codes_SRS_IOTHUBMODULE_31_011: [ If `configuration->batchMaxMilliseconds` is not 0 as well, `IotHub_Create` shall start a flush worker thread. ]*/
+    else if (
+        (moduleHandleData->batchMaxMilliseconds != 0) &&
+        (ThreadAPI_Create(&moduleHandleData->flushWorker, BATCH_flush_worker, moduleHandleData) != THREADAPI_OK)
+        )
+    {
+        LogError("unable to start the batch flush worker");
+        (void)Lock_Deinit(moduleHandleData->lock);
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+static void BATCH_stop(IOTHUB_HANDLE_DATA* moduleHandleData)
+{
+    if (moduleHandleData->flushWorker != NULL)
+    {
+        int notUsed;
+        if (Lock(moduleHandleData->lock) != LOCK_OK)
+        {
+            LogError("unable to lock, the batch flush worker may not stop");
+        }
+        else
+        {
+            moduleHandleData->stopping = true;
+            (void)Unlock(moduleHandleData->lock);
+        }
+        (void)ThreadAPI_Join(moduleHandleData->flushWorker, &notUsed);
+    }
+
+    while (moduleHandleData->oldestBatch != NULL)
+    {
+        BATCH_flush(moduleHandleData, moduleHandleData->oldestBatch, BATCH_FLUSH_CLOSING);
+    }
+}
+
+static bool IS_DEVICE_PROPERTY(const char* key)
+{
+    return (strcmp(key, DEVICENAME) == 0) || (strcmp(key, DEVICEKEY) == 0);
+}
+
+/*a stored message is the number of its properties, its properties as keys and values ending in '\0', then its content.
+The device name and key are not stored, the key stays off the disk*/
+static unsigned char* STORE_create_record(MESSAGE_HANDLE message, size_t* size)
+{
+    unsigned char* result;
+    const CONSTBUFFER* content = Message_GetContent(message);
+    CONSTMAP_HANDLE properties = Message_GetProperties(message);
+    const char* const* keys;
+    const char* const* values;
+    size_t nProperties;
+    if (ConstMap_GetInternals(properties, &keys, &values, &nProperties) != CONSTMAP_OK)
+    {
+        LogError("unable to get properties of the GW message");
+        result = NULL;
+    }
+    else
+    {
+        size_t needed = STORE_RECORD_COUNT_SIZE + content->size;
+        uint32_t stored = 0;
+        size_t i;
+        for (i = 0; i < nProperties; i++)
+        {
+            if (!IS_DEVICE_PROPERTY(keys[i]))
+            {
+                needed += strlen(keys[i]) + 1 + strlen(values[i]) + 1;
+                stored++;
+            }
+        }
+
+        if ((result = (unsigned char*)malloc(needed)) == NULL)
+        {
+            LogError("unable to allocate %zu bytes for a stored message", needed);
+        }
+        else
+        {
+            size_t used = STORE_RECORD_COUNT_SIZE;
+            result[0] = (unsigned char)(stored >> 24);
+            result[1] = (unsigned char)(stored >> 16);
+            result[2] = (unsigned char)(stored >> 8);
+            result[3] = (unsigned char)stored;
+            for (i = 0; i < nProperties; i++)
+            {
+                if (!IS_DEVICE_PROPERTY(keys[i]))
+                {
+                    size_t keySize = strlen(keys[i]) + 1;
+                    size_t valueSize = strlen(values[i]) + 1;
+                    memcpy(result + used, keys[i], keySize);
+                    used += keySize;
+                    memcpy(result + used, values[i], valueSize);
+                    used += valueSize;
+                }
+            }
+            memcpy(result + used, content->buffer, content->size);
+            *size = needed;
+        }
+    }
+    ConstMap_Destroy(properties);
+    return result;
+}
+
+static const unsigned char* STORE_skip_string(const unsigned char* position, const unsigned char* end)
+{
+    const unsigned char* terminator = (const unsigned char*)memchr(position, '\0', (size_t)(end - position));
+    return (terminator == NULL) ? NULL : terminator + 1;
+}
+
+static IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromRecord(const unsigned char* record, size_t size)
+{
+    IOTHUB_MESSAGE_HANDLE result;
+    const unsigned char* end = record + size;
+    const unsigned char* content = record + STORE_RECORD_COUNT_SIZE;
+    uint32_t count = 0;
+    uint32_t i;
+    if (size < STORE_RECORD_COUNT_SIZE)
+    {
+        content = NULL;
+    }
+    else
+    {
+        count = ((uint32_t)record[0] << 24) | ((uint32_t)record[1] << 16) | ((uint32_t)record[2] << 8) | (uint32_t)record[3];
+        for (i = 0; (content != NULL) && (i < 2 * count); i++)
+        {
+            content = STORE_skip_string(content, end);
+        }
+    }
+
+    if (content == NULL)
+    {
+        LogError("a stored message is damaged");
+        result = NULL;
+    }
+    else if ((result = IoTHubMessage_CreateFromByteArray(content, (size_t)(end - content))) == NULL)
+    {
+        LogError("IoTHubMessage_CreateFromByteArray failed");
+    }
+    else
+    {
+        MAP_HANDLE properties = IoTHubMessage_Properties(result);
+        const unsigned char* position = record + STORE_RECORD_COUNT_SIZE;
+        for (i = 0; i < count; i++)
+        {
+            const char* key = (const char*)position;
+            const char* value = (const char*)(position = STORE_skip_string(position, end));
+            position = STORE_skip_string(position, end);
+            if (Map_AddOrUpdate(properties, key, value) != MAP_OK)
+            {
+                LogError("unable to Map_AddOrUpdate");
+                break;
+            }
+        }
+
+        if (i != count)
+        {
+            IoTHubMessage_Destroy(result);
+            result = NULL;
+        }
+    }
+    return result;
+}
+
+/*sends the records of the store of the personality its budget allows, called with the lock held*/
+static void STORE_pump(IOTHUB_HANDLE_DATA* moduleHandleData, PERSONALITY_PTR personality)
+{
+    bool sending = true;
+    while (sending)
+    {
+        SEND* send = NULL;
+        IOTHUB_MESSAGE_HANDLE message = NULL;
+        uint64_t sequence = 0;
+        if (Lock(moduleHandleData->confirmationLock) != LOCK_OK)
+        {
+            LogError("unable to lock");
+        }
+        else
+        {
+            const unsigned char* record;
+            size_t size;
+            if (personality->iothubHandle == NULL)
+            {
+                /*the records wait for the provisioning worker to create the IoTHubClient*/
+            }
+            else if (
+                (personality->storeBudget == 0) ||
+                (!personality->storeConnected && (personality->inFlight != 0))
+                )
+            {
+                /*the budget of this second is spent, or an offline device waits for its last record*/
+            }
+            else if (
+                (moduleHandleData->maxInFlight != 0) &&
+                (personality->inFlight >= moduleHandleData->maxInFlight)
+                )
+            {
+                /*Codes_SRS_IOTHUBMODULE_31_050: [ A store shall send no record of a personality which has `maxInFlight` messages in flight, the records wait in the store instead. ]*/
+            }
+            else if (SegmentLog_Read(personality->store, &record, &size, &sequence) != 0)
+            {
+                LogError("unable to read the store of the device %s", STRING_c_str(personality->deviceName));
+            }
+            else if (record == NULL)
+            {
+                /*every record is sent, or SEGMENT_LOG_MAX_IN_FLIGHT are waiting for their confirmation*/
+            }
+            else if ((send = (SEND*)malloc(sizeof(SEND))) == NULL)
+            {
+                LogError("unable to allocate the context of a stored message");
+                SegmentLog_Rewind(personality->store);
+            }
+            else if ((message = IoTHubMessage_CreateFromRecord(record, size)) == NULL)
+            {
+                LogError("record %llu of the device %s cannot be sent, it is dropped", (unsigned long long)sequence, STRING_c_str(personality->deviceName));
+                (void)SegmentLog_Acknowledge(personality->store, sequence);
+                free(send);
+                send = NULL;
+            }
+            else
+            {
+                SEND_count(moduleHandleData, personality);
+                personality->storeBudget--;
+            }
+            (void)Unlock(moduleHandleData->confirmationLock);
+        }
+
+        if (send == NULL)
+        {
+            sending = false;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBMODULE_31_036: [ The records of a store shall be sent in order by `IoTHubClient_SendEventAsync` with a confirmation callback, at most `storeReplayRate` per second per device, and at most `SEGMENT_LOG_MAX_IN_FLIGHT` waiting for their confirmation. ]*/
+            SEND_stamp(moduleHandleData, send, personality, sequence);
+            if (IoTHubClient_SendEventAsync(personality->iothubHandle, message, SEND_confirmation, send) != IOTHUB_CLIENT_OK)
+            {
+                /*Codes_SRS_IOTHUBMODULE_31_041: [ If `IoTHubClient_SendEventAsync` fails, the record shall be read again later. ]*/
+                LogError("unable to IoTHubClient_SendEventAsync, record %llu is sent again later", (unsigned long long)sequence);
+                if (Lock(moduleHandleData->confirmationLock) != LOCK_OK)
+                {
+                    LogError("unable to lock");
+                }
+                else
+                {
+                    SEND_uncount(moduleHandleData, personality);
+                    SegmentLog_Rewind(personality->store);
+                    (void)Unlock(moduleHandleData->confirmationLock);
+                }
+                free(send);
+                sending = false;
+            }
+            IoTHubMessage_Destroy(message);
+        }
+    }
+}
+
+/*gives the personality the budget of a new second and drops its records older than the retention*/
+static void STORE_refill(IOTHUB_HANDLE_DATA* moduleHandleData, PERSONALITY_PTR personality)
+{
+    if (Lock(moduleHandleData->confirmationLock) != LOCK_OK)
+    {
+        LogError("unable to lock");
+    }
+    else
+    {
+        personality->storeBudget = STORE_budget(moduleHandleData);
+        SegmentLog_Expire(personality->store);
+        (void)Unlock(moduleHandleData->confirmationLock);
+    }
+}
+
+static int STORE_replay_worker(void* param)
+{
+    IOTHUB_HANDLE_DATA* moduleHandleData = (IOTHUB_HANDLE_DATA*)param;
+    bool stopping = false;
+    while (!stopping)
+    {
+        if (Lock(moduleHandleData->lock) != LOCK_OK)
+        {
+            LogError("unable to lock, the store replay worker stops");
+            stopping = true;
+        }
+        else
+        {
+            tickcounter_ms_t now;
+            stopping = moduleHandleData->stopping;
+            if (!stopping && (tickcounter_get_current_ms(moduleHandleData->clock, &now) == 0))
+            {
+                /*Codes_SRS_IOTHUBMODULE_31_039: [ The replay worker shall send the records of every store each 100 milliseconds and, every second, give each device a budget of `storeReplayRate` records and drop the records older than `storeRetentionSeconds`. ]*/
+                bool refill = (now - moduleHandleData->storeRefilled) >= STORE_REFILL_MILLISECONDS;
+                size_t count = VECTOR_size(moduleHandleData->personalities);
+                if (refill)
+                {
+                    moduleHandleData->storeRefilled = now;
+                }
+                for (size_t i = 0; i < count; i++)
+                {
+                    PERSONALITY_PTR personality = *(PERSONALITY_PTR*)VECTOR_element(moduleHandleData->personalities, i);
+                    if (refill)
+                    {
+                        STORE_refill(moduleHandleData, personality);
+                    }
+                    STORE_pump(moduleHandleData, personality);
+                }
+            }
+            (void)Unlock(moduleHandleData->lock);
+
+            if (!stopping)
+            {
+                ThreadAPI_Sleep(STORE_PERIOD_MILLISECONDS);
+            }
+        }
+    }
+    return 0;
+}
+
+static int STORE_start(IOTHUB_HANDLE_DATA* moduleHandleData)
+{
+    int result;
+    /*Codes_SRS_IOTHUBMODULE_31_032: [ If `configuration->storeDirectory` is not NULL, `IotHub_Create` shall create a lock and a replay worker thread, and batching shall be off. ]*/
+    if ((moduleHandleData->lock = Lock_Init()) == NULL)
+    {
+        LogError("unable to Lock_Init");
+        result = __LINE__;
+    }
+    else if (ThreadAPI_Create(&moduleHandleData->replayWorker, STORE_replay_worker, moduleHandleData) != THREADAPI_OK)
+    {
+        LogError("unable to start the store replay worker");
+        (void)Lock_Deinit(moduleHandleData->lock);
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+static void STORE_stop(IOTHUB_HANDLE_DATA* moduleHandleData)
+{
+    if (moduleHandleData->replayWorker != NULL)
+    {
+        int notUsed;
+        if (Lock(moduleHandleData->lock) != LOCK_OK)
+        {
+            LogError("unable to lock, the store replay worker may not stop");
+        }
+        else
+        {
+            moduleHandleData->stopping = true;
+            (void)Unlock(moduleHandleData->lock);
+        }
+        (void)ThreadAPI_Join(moduleHandleData->replayWorker, &notUsed);
+    }
+}
+
+static SEGMENT_LOG_HANDLE STORE_open(IOTHUB_HANDLE_DATA* moduleHandleData, const char* deviceName)
+{
+    SEGMENT_LOG_HANDLE result;
+    SEGMENT_LOG_CONFIG config;
+    config.directory = STRING_c_str(moduleHandleData->storeDirectory);
+    config.name = deviceName;
+    config.segmentMaxBytes = (
+        (moduleHandleData->storeMaxBytes != 0) &&
+        (moduleHandleData->storeMaxBytes / STORE_SEGMENTS_PER_LOG < SEGMENT_LOG_DEFAULT_SEGMENT_BYTES)
+        ) ? (moduleHandleData->storeMaxBytes / STORE_SEGMENTS_PER_LOG) : 0;
+    config.maxBytes = moduleHandleData->storeMaxBytes;
+    config.retentionSeconds = moduleHandleData->storeRetentionSeconds;
+    if ((result = SegmentLog_Open(&config)) == NULL)
+    {
+        LogError("unable to open the store of the device %s", deviceName);
+    }
+    return result;
+}
+
+static size_t TRANSPORT_POOL_size(const IOTHUB_CONFIG* config)
+{
+    size_t result;
+    if (config->transportProvider == MQTT_Protocol)
+    {
+        /*an MQTT connection carries one device, MQTT clients cannot share a transport*/
+        if (config->transportPoolSize != 0)
+        {
+            LogInfo("%s is ignored with MQTT, every device has its own connection", TRANSPORTPOOLSIZE);
+        }
+        result = 0;
+    }
+    else if (config->transportPoolSize != 0)
+    {
+        result = config->transportPoolSize;
+    }
+    else
+    {
+        result = (
+            (config->transportProvider == HTTP_Protocol) ||
+            (config->transportProvider == AMQP_Protocol)
+            ) ? 1 : 0;
+    }
+    return result;
+}
+
+static void TRANSPORT_POOL_destroy(IOTHUB_HANDLE_DATA* moduleHandleData)
+{
+    for (size_t i = 0; i < moduleHandleData->transportCount; i++)
+    {
+        IoTHubTransport_Destroy(moduleHandleData->transports[i]);
+    }
+    moduleHandleData->transportCount = 0;
+}
+
+static int TRANSPORT_POOL_create(IOTHUB_HANDLE_DATA* moduleHandleData, const IOTHUB_CONFIG* config, size_t poolSize)
+{
+    int result = 0;
+    moduleHandleData->transportCount = 0;
+    while (
+        (result == 0) &&
+        (moduleHandleData->transportCount < poolSize)
+        )
+    {
+        /*Codes_SRS_IOTHUBMODULE_17_001: [ If `configuration->transportProvider` is `HTTP_Protocol` or `AMQP_Protocol`, `IotHub_Create` shall create a shared transport by calling `IoTHubTransport_Create`. ]*/
+        /*Codes_SRS_IOTHUBMODULE_31_026: [ If `configuration->transportPoolSize` is not 0 and the transport is not `MQTT_Protocol`, `IotHub_Create` shall create `transportPoolSize` shared transports. ]*/
+        TRANSPORT_HANDLE transport = IoTHubTransport_Create(config->transportProvider, config->IoTHubName, config->IoTHubSuffix);
+        if (transport == NULL)
+        {
+            /*Codes_SRS_IOTHUBMODULE_31_027: [ If creating one of the shared transports fails, `IotHub_Create` shall destroy the ones created, fail and return `NULL`. ]*/
+            LogError("unable to create shared transport %zu of %zu", moduleHandleData->transportCount, poolSize);
+            TRANSPORT_POOL_destroy(moduleHandleData);
+            result = __LINE__;
+        }
+        else
+        {
+            moduleHandleData->transports[moduleHandleData->transportCount++] = transport;
+        }
+    }
+    return result;
+}
+
+static int PROVISION_start(IOTHUB_HANDLE_DATA* moduleHandleData)
+{
+    int result;
+    bool ownLock = (moduleHandleData->lock == NULL);
+    /*Codes_SRS_IOTHUBMODULE_31_056: [ If `configuration->provisioningQueueSize` is not 0, `IotHub_Create` shall create a lock unless batching or the store has created one, a condition and a provisioning worker thread. ]*/
+    if (ownLock && ((moduleHandleData->lock = Lock_Init()) == NULL))
+    {
+        LogError("unable to Lock_Init");
+        result = __LINE__;
+    }
+    else if ((moduleHandleData->provisionRequested = Condition_Init()) == NULL)
+    {
+        LogError("unable to Condition_Init");
+        if (ownLock)
+        {
+            (void)Lock_Deinit(moduleHandleData->lock);
+            moduleHandleData->lock = NULL;
+        }
+        result = __LINE__;
+    }
+    else if (ThreadAPI_Create(&moduleHandleData->provisionWorker, PROVISION_worker, moduleHandleData) != THREADAPI_OK)
+    {
+        LogError("unable to start the provisioning worker");
+        Condition_Deinit(moduleHandleData->provisionRequested);
+        moduleHandleData->provisionRequested = NULL;
+        moduleHandleData->provisionWorker = NULL;
+        if (ownLock)
+        {
+            (void)Lock_Deinit(moduleHandleData->lock);
+            moduleHandleData->lock = NULL;
+        }
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+static void PROVISION_stop(IOTHUB_HANDLE_DATA* moduleHandleData)
+{
+    if (moduleHandleData->provisionWorker != NULL)
+    {
+        int notUsed;
+        if (Lock(moduleHandleData->lock) != LOCK_OK)
+        {
+            LogError("unable to lock, the provisioning worker may not stop");
+        }
+        else
+        {
+            moduleHandleData->stopping = true;
+            (void)Condition_Post(moduleHandleData->provisionRequested);
+            (void)Unlock(moduleHandleData->lock);
+        }
+        (void)ThreadAPI_Join(moduleHandleData->provisionWorker, &notUsed);
+        Condition_Deinit(moduleHandleData->provisionRequested);
+    }
+}
+
+static MODULE_HANDLE IotHub_Create(BROKER_HANDLE broker, const void* configuration)
+{
+    IOTHUB_HANDLE_DATA *result;
+    const IOTHUB_CONFIG* config = configuration;
+
+    /*Codes_SRS_IOTHUBMODULE_02_001: [ If `broker` is `NULL` then `IotHub_Create` shall fail and return `NULL`. ]*/
+    /*Codes_SRS_IOTHUBMODULE_02_002: [ If `configuration` is `NULL` then `IotHub_Create` shall fail and return `NULL`. ]*/
+    /*Codes_SRS_IOTHUBMODULE_02_003: [ If `configuration->IoTHubName` is `NULL` then `IotHub_Create` shall and return `NULL`. ]*/
+    /*Codes_SRS_IOTHUBMODULE_02_004: [ If `configuration->IoTHubSuffix` is `NULL` then `IotHub_Create` shall fail and return `NULL`. ]*/
+    if (
+        (broker == NULL) ||
+        (configuration == NULL)
+        )
+    {
+        LogError("invalid arg broker=%p, configuration=%p", broker, configuration);
+        result = NULL;
+    }
+    else if (
+        (config->IoTHubName == NULL) ||
+        (config->IoTHubSuffix == NULL) ||
+        (config->transportProvider == NULL)
+        )
+    {
+        LogError("invalid configuration IoTHubName=%s IoTHubSuffix=%s transportProvider=%p",
+            (config != NULL) ? config->IoTHubName : "<null>",
+            (config != NULL) ? config->IoTHubSuffix : "<null>",
+            (config != NULL) ? config->transportProvider : 0);
+        result = NULL;
+    }
+    else
+    {
+        size_t poolSize = TRANSPORT_POOL_size(config);
+        /*the shared transports are allocated with the module*/
+        result = malloc(sizeof(IOTHUB_HANDLE_DATA) + poolSize * sizeof(TRANSPORT_HANDLE));
+        /*Codes_SRS_IOTHUBMODULE_02_027: [ When `IotHub_Create` encounters an internal failure it shall fail and return `NULL`. ]*/
+        if (result == NULL)
+        {
+            LogError("malloc returned NULL");
+            /*return as is*/
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBMODULE_02_006: [ `IotHub_Create` shall create an empty `VECTOR` containing pointers to `PERSONALITY`s. ]*/
+            result->personalities = VECTOR_create(sizeof(PERSONALITY_PTR));
+            if (result->personalities == NULL)
+            {
+                /*Codes_SRS_IOTHUBMODULE_02_007: [ If creating the personality vector fails then `IotHub_Create` shall fail and return `NULL`. ]*/
+                free(result);
+                result = NULL;
+                LogError("VECTOR_create returned NULL");
+            }
+            else
+            {
+                result->transportProvider = config->transportProvider;
+                result->transports = (TRANSPORT_HANDLE*)(result + 1);
+                if (TRANSPORT_POOL_create(result, config, poolSize) != 0)
+                {
+                    /*Codes_SRS_IOTHUBMODULE_17_002: [ If creating the shared transport fails, `IotHub_Create` shall fail and return `NULL`. ]*/
+                    VECTOR_destroy(result->personalities);
+                    free(result);
+                    result = NULL;
+                    LogError("unable to create the shared transports");
+                }
+
+                if (result != NULL)
+                {
+                    /*Codes_SRS_IOTHUBMODULE_02_028: [ `IotHub_Create` shall create a copy of `configuration->IoTHubName`. ]*/
+                    /*Codes_SRS_IOTHUBMODULE_02_029: [ `IotHub_Create` shall create a copy of `configuration->IoTHubSuffix`. ]*/
+                    if ((result->IoTHubName = STRING_construct(config->IoTHubName)) == NULL)
+                    {
+                        LogError("STRING_construct returned NULL");
+                        TRANSPORT_POOL_destroy(result);
+                        VECTOR_destroy(result->personalities);
+                        free(result);
+                        result = NULL;
+                    }
+                    else if ((result->IoTHubSuffix = STRING_construct(config->IoTHubSuffix)) == NULL)
+                    {
+                        LogError("STRING_construct returned NULL");
+                        STRING_delete(result->IoTHubName);
+                        TRANSPORT_POOL_destroy(result);
+                        VECTOR_destroy(result->personalities);
+                        free(result);
+                        result = NULL;
+                    }
+                    else
+                    {
+                        /*Codes_SRS_IOTHUBMODULE_17_004: [ `IotHub_Create` shall store the broker. ]*/
+                        result->broker = broker;
+                        /*Codes_SRS_IOTHUBMODULE_31_003: [ `IotHub_Create` shall store `configuration->maxPersonalities`, 0 meaning the number of personalities is not limited. ]*/
+                        result->maxPersonalities = config->maxPersonalities;
+                        result->personalityIndex = NULL;
+                        result->indexCapacity = 0;
+                        result->indexCount = 0;
+                        result->mostRecent = NULL;
+                        result->leastRecent = NULL;
+                        result->batchMaxMessages = config->batchMaxMessages;
+                        result->batchMaxBytes = config->batchMaxBytes;
+                        result->batchMaxMilliseconds = config->batchMaxMilliseconds;
+                        result->clock = NULL;
+                        result->lock = NULL;
+                        result->flushWorker = NULL;
+                        result->stopping = false;
+                        result->oldestBatch = NULL;
+                        result->newestBatch = NULL;
+                        memset(&result->batchCounters, 0, sizeof(result->batchCounters));
+                        result->storeDirectory = NULL;
+                        result->storeMaxBytes = config->storeMaxBytes;
+                        result->storeRetentionSeconds = config->storeRetentionSeconds;
+                        result->storeReplayRate = config->storeReplayRate;
+                        result->replayWorker = NULL;
+                        result->storeRefilled = 0;
+                        result->maxInFlight = config->maxInFlight;
+                        result->confirmationLock = NULL;
+                        result->windowOpened = NULL;
+                        memset(&result->sendCounters, 0, sizeof(result->sendCounters));
+                        result->provisioningQueueSize = config->provisioningQueueSize;
+                        result->provisionWorker = NULL;
+                        result->provisionRequested = NULL;
+                        result->oldestProvision = NULL;
+                        result->newestProvision = NULL;
+                        result->provisioning = NULL;
+                        result->provisioningEvicted = false;
+                        if (SEND_start(result) != 0)
+                        {
+                            /*Codes_SRS_IOTHUBMODULE_31_045: [ If creating the tick counter, the lock or the condition for the send confirmations fails, `IotHub_Create` shall fail and return `NULL`. ]*/
+                            STRING_delete(result->IoTHubSuffix);
+                            STRING_delete(result->IoTHubName);
+                            TRANSPORT_POOL_destroy(result);
+                            VECTOR_destroy(result->personalities);
+                            free(result);
+                            result = NULL;
+                        }
+                        else if (config->storeDirectory != NULL)
+                        {
+                            if (result->batchMaxMessages != 0)
+                            {
+                                /*a stored message is sent on its own, its confirmation acknowledges it*/
+                                LogInfo("%s is ignored with %s, the stored messages are sent one by one", BATCHMAXMESSAGES, STOREDIRECTORY);
+                                result->batchMaxMessages = 0;
+                            }
+
+                            if ((result->storeDirectory = STRING_construct(config->storeDirectory)) == NULL)
+                            {
+                                /*Codes_SRS_IOTHUBMODULE_31_033: [ If copying `configuration->storeDirectory` or creating the lock or the replay worker fails, `IotHub_Create` shall fail and return `NULL`. ]*/
+                                LogError("STRING_construct returned NULL");
+                                SEND_stop(result);
+                                STRING_delete(result->IoTHubSuffix);
+                                STRING_delete(result->IoTHubName);
+                                TRANSPORT_POOL_destroy(result);
+                                VECTOR_destroy(result->personalities);
+                                free(result);
+                                result = NULL;
+                            }
+                            else if (STORE_start(result) != 0)
+                            {
+                                STRING_delete(result->storeDirectory);
+                                SEND_stop(result);
+                                STRING_delete(result->IoTHubSuffix);
+                                STRING_delete(result->IoTHubName);
+                                TRANSPORT_POOL_destroy(result);
+                                VECTOR_destroy(result->personalities);
+                                free(result);
+                                result = NULL;
+                            }
+                        }
+                        else if (
+                            (result->batchMaxMessages != 0) &&
+                            (BATCH_start(result) != 0)
+                            )
+                        {
+                            /*Codes_SRS_IOTHUBMODULE_31_012: [ If creating the lock or the flush worker fails, `IotHub_Create` shall fail and return `NULL`. ]*/
+                            SEND_stop(result);
+                            STRING_delete(result->IoTHubSuffix);
+                            STRING_delete(result->IoTHubName);
+                            TRANSPORT_POOL_destroy(result);
+                            VECTOR_destroy(result->personalities);
+                            free(result);
+                            result = NULL;
+                        }
+
+                        if (
+                            (result != NULL) &&
+                            (result->provisioningQueueSize != 0) &&
+                            (PROVISION_start(result) != 0)
+                            )
+                        {
+                            /*Codes_SRS_IOTHUBMODULE_31_057: [ If creating the lock, the condition or the provisioning worker fails, `IotHub_Create` shall fail and return `NULL`. ]*/
+                            BATCH_stop(result);
+                            STORE_stop(result);
+                            if (result->lock != NULL)
+                            {
+                                (void)Lock_Deinit(result->lock);
+                            }
+                            if (result->storeDirectory != NULL)
+                            {
+                                STRING_delete(result->storeDirectory);
+                            }
+                            SEND_stop(result);
+                            STRING_delete(result->IoTHubSuffix);
+                            STRING_delete(result->IoTHubName);
+                            TRANSPORT_POOL_destroy(result);
+                            VECTOR_destroy(result->personalities);
+                            free(result);
+                            result = NULL;
+                        }
+                        /*Codes_SRS_IOTHUBMODULE_02_008: [ Otherwise, `IotHub_Create` shall return a non-`NULL` handle. ]*/
+                    }
+                }
+            }
+        }
+    }
+    return result;
+}
+
+static void IotHub_Destroy(MODULE_HANDLE moduleHandle)
+{
+    /*Codes_SRS_IOTHUBMODULE_02_023: [ If `moduleHandle` is `NULL` then `IotHub_Destroy` shall return. ]*/
+    if (moduleHandle == NULL)
+    {
+        LogError("moduleHandle parameter was NULL");
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBMODULE_02_024: [ Otherwise `IotHub_Destroy` shall free all used resources. ]*/
+        IOTHUB_HANDLE_DATA * handleData = moduleHandle;
+        /*Codes_SRS_IOTHUBMODULE_31_063: [ `IotHub_Destroy` shall stop the provisioning worker before the other workers; the messages held for a personality without an IoTHubClient are dropped. ]*/
+        PROVISION_stop(handleData);
+        /*Codes_SRS_IOTHUBMODULE_31_013: [ `IotHub_Destroy` shall stop the flush worker and send the batches still waiting before destroying the personalities. ]*/
+        BATCH_stop(handleData);
+        /*Codes_SRS_IOTHUBMODULE_31_040: [ `IotHub_Destroy` shall stop the replay worker; a personality shall destroy its IoTHubClient before closing its store, the records not acknowledged stay on disk and are sent once the personality of the device is created again. ]*/
+        STORE_stop(handleData);
+        size_t vectorSize = VECTOR_size(handleData->personalities);
+        for (size_t i = 0; i < vectorSize; i++)
+        {
+            PERSONALITY_PTR* personality = VECTOR_element(handleData->personalities, i);
+            PERSONALITY_destroy(*personality);
+            free(*personality);
+        }
+        TRANSPORT_POOL_destroy(handleData);
+        VECTOR_destroy(handleData->personalities);
+        free(handleData->personalityIndex);
+        if (handleData->lock != NULL)
+        {
+            (void)Lock_Deinit(handleData->lock);
+        }
+        if (handleData->storeDirectory != NULL)
+        {
+            STRING_delete(handleData->storeDirectory);
+        }
+        /*Codes_SRS_IOTHUBMODULE_31_053: [ `IotHub_Destroy` shall destroy the lock of the send confirmations after the personalities, the messages in flight are confirmed while their IoTHubClient is destroyed. ]*/
+        SEND_stop(handleData);
+        STRING_delete(handleData->IoTHubName);
+        STRING_delete(handleData->IoTHubSuffix);
+        free(handleData);
+    }
+}
+
+static IOTHUBMESSAGE_DISPOSITION_RESULT IotHub_ReceiveMessageCallback(IOTHUB_MESSAGE_HANDLE msg, void* userContextCallback)
+{
+    IOTHUBMESSAGE_DISPOSITION_RESULT result;
+    if (userContextCallback == NULL)
+    {
+        /*Codes_SRS_IOTHUBMODULE_17_005: [ If `userContextCallback` is `NULL`, then `IotHub_ReceiveMessageCallback` shall return `IOTHUBMESSAGE_ABANDONED`. ]*/
+        LogError("No context to associate message");
+        result = IOTHUBMESSAGE_ABANDONED;
+    }
+    else
+    {
+        PERSONALITY_PTR personality = (PERSONALITY_PTR)userContextCallback;
+        IOTHUBMESSAGE_CONTENT_TYPE msgContentType = IoTHubMessage_GetContentType(msg);
+        if (msgContentType == IOTHUBMESSAGE_UNKNOWN)
+        {
+            /*Codes_SRS_IOTHUBMODULE_17_006: [ If Message Content type is `IOTHUBMESSAGE_UNKNOWN`, then `IotHub_ReceiveMessageCallback` shall return `IOTHUBMESSAGE_ABANDONED`. ]*/
+            LogError("Message content type is unknown");
+            result = IOTHUBMESSAGE_ABANDONED;
+        }
+        else
+        {
+            /* Handle message content */
+            MESSAGE_CONFIG newMessageConfig;
+            IOTHUB_MESSAGE_RESULT msgResult;
+            if (msgContentType == IOTHUBMESSAGE_STRING)
+            {
+                /*Codes_SRS_IOTHUBMODULE_17_014: [ If Message content type is `IOTHUBMESSAGE_STRING`, `IotHub_ReceiveMessageCallback` shall get the buffer from results of `IoTHubMessage_GetString`. ]*/
+                const char* sourceStr = IoTHubMessage_GetString(msg);
+                newMessageConfig.source = (const unsigned char*)sourceStr;
+                /*Codes_SRS_IOTHUBMODULE_17_015: [ If Message content type is `IOTHUBMESSAGE_STRING`, `IotHub_ReceiveMessageCallback` shall get the buffer size from the string length. ]*/
+                newMessageConfig.size = strlen(sourceStr);
+                msgResult = IOTHUB_MESSAGE_OK;
             }
             else
             {
@@ -443,16 +1872,31 @@ static IOTHUBMESSAGE_DISPOSITION_RESULT IotHub_ReceiveMessageCallback(IOTHUB_MES
     return result;
 }
 
-/*returns non-null if PERSONALITY has been properly populated*/
-static PERSONALITY_PTR PERSONALITY_create(const char* deviceName, const char* deviceKey, IOTHUB_HANDLE_DATA* moduleHandleData)
+/*returns non-null if PERSONALITY has been properly populated, its IoTHubClient is created by PERSONALITY_connect*/
+static PERSONALITY_PTR PERSONALITY_create(const char* deviceName, const char* deviceKey, size_t hash, IOTHUB_HANDLE_DATA* moduleHandleData)
 {
-    PERSONALITY_PTR result = (PERSONALITY_PTR)malloc(sizeof(PERSONALITY));
+    /*the batch and the messages held until the IoTHubClient is created are allocated with the personality*/
+    size_t heldRoom = (moduleHandleData->storeDirectory == NULL) ? moduleHandleData->provisioningQueueSize : 0;
+    PERSONALITY_PTR result = (PERSONALITY_PTR)malloc(sizeof(PERSONALITY) + (moduleHandleData->batchMaxMessages + heldRoom) * sizeof(IOTHUB_MESSAGE_HANDLE));
     if (result == NULL)
     {
         LogError("unable to allocate a personality for the device %s", deviceName);
     }
     else
     {
+        result->batch = (IOTHUB_MESSAGE_HANDLE*)(result + 1);
+        result->batchCount = 0;
+        result->batchBytes = 0;
+        result->store = NULL;
+        result->storeBudget = STORE_budget(moduleHandleData);
+        result->storeConnected = true;
+        result->inFlight = 0;
+        result->windowStalled = false;
+        result->held = result->batch + moduleHandleData->batchMaxMessages;
+        result->heldCount = 0;
+        result->nextProvision = NULL;
+        result->iothubHandle = NULL;
+        result->hash = hash;
         if ((result->deviceName = STRING_construct(deviceName)) == NULL)
         {
             LogError("unable to STRING_construct");
@@ -466,98 +1910,564 @@ static PERSONALITY_PTR PERSONALITY_create(const char* deviceName, const char* de
             free(result);
             result = NULL;
         }
+        /*Codes_SRS_IOTHUBMODULE_31_034: [ If the module has a store directory, a new personality shall open the segment log named after its device in it, limited to `storeMaxBytes` and `storeRetentionSeconds`; if that fails the personality shall not be created. ]*/
+        else if (
+            (moduleHandleData->storeDirectory != NULL) &&
+            ((result->store = STORE_open(moduleHandleData, deviceName)) == NULL)
+            )
+        {
+            STRING_delete(result->deviceName);
+            STRING_delete(result->deviceKey);
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            result->broker = moduleHandleData->broker;
+            result->module = moduleHandleData;
+        }
+    }
+    return result;
+}
+
+/*creates the IoTHubClient of the personality, touches nothing the lock of the module guards so that the provisioning worker calls it without the lock*/
+static IOTHUB_CLIENT_HANDLE PERSONALITY_connect(IOTHUB_HANDLE_DATA* moduleHandleData, PERSONALITY_PTR personality, const char* deviceName, const char* deviceKey)
+{
+    IOTHUB_CLIENT_HANDLE result;
+    IOTHUB_CLIENT_CONFIG temp;
+    temp.protocol = moduleHandleData->transportProvider;
+    temp.deviceId = deviceName;
+    temp.deviceKey = deviceKey;
+    temp.deviceSasToken = NULL;
+    temp.iotHubName = STRING_c_str(moduleHandleData->IoTHubName);
+    temp.iotHubSuffix = STRING_c_str(moduleHandleData->IoTHubSuffix);
+    temp.protocolGatewayHostName = NULL;
+
+    /*Codes_SRS_IOTHUBMODULE_05_013: [ If a new personality is created and the module's transport has already been created (in `IotHub_Create`), an `IOTHUB_CLIENT_HANDLE` will be added to the personality by a call to `IoTHubClient_CreateWithTransport`. ]*/
+    /*Codes_SRS_IOTHUBMODULE_31_028: [ The transport of a new personality shall be the shared transport chosen by the hash of its device name, so that a device always uses the same connection. ]*/
+    /*Codes_SRS_IOTHUBMODULE_05_003: [ If a new personality is created and the module's transport has not already been created, an `IOTHUB_CLIENT_HANDLE` will be added to the personality by a call to `IoTHubClient_Create` with the corresponding transport provider. ]*/
+    result = (moduleHandleData->transportCount != 0)
+        ? IoTHubClient_CreateWithTransport(moduleHandleData->transports[personality->hash % moduleHandleData->transportCount], &temp)
+        : IoTHubClient_Create(&temp);
+
+    if (result == NULL)
+    {
+        LogError("unable to create IoTHubClient");
+    }
+    /*Codes_SRS_IOTHUBMODULE_17_003: [ If a new personality is created, then the associated IoTHubClient will be set to receive messages by calling `IoTHubClient_SetMessageCallback` with callback function `IotHub_ReceiveMessageCallback`, and the personality as context. ]*/
+    else if (IoTHubClient_SetMessageCallback(result, IotHub_ReceiveMessageCallback, personality) != IOTHUB_CLIENT_OK)
+    {
+        LogError("unable to IoTHubClient_SetMessageCallback");
+        IoTHubClient_Destroy(result);
+        result = NULL;
+    }
+    else if (
+        (moduleHandleData->batchMaxMessages != 0) &&
+        (moduleHandleData->transportProvider == HTTP_Protocol)
+        )
+    {
+        /*Codes_SRS_IOTHUBMODULE_31_022: [ If batching is on and the transport is HTTP, the IoTHubClient of a new personality shall be given the option "Batching" set to `true`, so that it posts the messages of a batch in one request. ]*/
+        bool batching = true;
+        if (IoTHubClient_SetOption(result, OPTION_BATCHING, &batching) != IOTHUB_CLIENT_OK)
+        {
+            LogError("unable to turn on %s, the messages of a batch are posted one by one", OPTION_BATCHING);
+        }
+    }
+    else
+    {
+        /*it is all fine*/
+    }
+    return result;
+}
+
+static void PERSONALITY_destroy(PERSONALITY* personality)
+{
+    if (personality->iothubHandle != NULL)
+    {
+        /*the confirmations of the messages in flight arrive before IoTHubClient_Destroy returns*/
+        IoTHubClient_Destroy(personality->iothubHandle);
+    }
+    if (personality->heldCount != 0)
+    {
+        LogError("%zu messages of the device %s are dropped, its IoTHubClient was not created", personality->heldCount, STRING_c_str(personality->deviceName));
+        for (size_t i = 0; i < personality->heldCount; i++)
+        {
+            IoTHubMessage_Destroy(personality->held[i]);
+        }
+    }
+    if (personality->store != NULL)
+    {
+        SegmentLog_Close(personality->store);
+    }
+    STRING_delete(personality->deviceName);
+    STRING_delete(personality->deviceKey);
+}
+
+static size_t hash_DeviceName(const char* deviceName)
+{
+    /*FNV-1a*/
+    size_t hash = (size_t)2166136261u;
+    while (*deviceName != '\0')
+    {
+        hash ^= (unsigned char)*deviceName++;
+        hash *= (size_t)16777619u;
+    }
+    return hash;
+}
+
+/*returns the slot holding the personality of deviceName, or the empty slot where it would be added*/
+static PERSONALITY_PTR* PERSONALITY_INDEX_find(IOTHUB_HANDLE_DATA* moduleHandleData, size_t hash, const char* deviceName)
+{
+    size_t mask = moduleHandleData->indexCapacity - 1;
+    size_t i = hash & mask;
+    while (
+        (moduleHandleData->personalityIndex[i] != NULL) &&
+        !((moduleHandleData->personalityIndex[i]->hash == hash) && (strcmp(STRING_c_str(moduleHandleData->personalityIndex[i]->deviceName), deviceName) == 0))
+        )
+    {
+        i = (i + 1) & mask;
+    }
+    return &moduleHandleData->personalityIndex[i];
+}
+
+static void PERSONALITY_INDEX_insert(PERSONALITY_PTR* index, size_t capacity, PERSONALITY_PTR personality)
+{
+    size_t mask = capacity - 1;
+    size_t i = personality->hash & mask;
+    while (index[i] != NULL)
+    {
+        i = (i + 1) & mask;
+    }
+    index[i] = personality;
+}
+
+/*makes room in the index for one more personality, keeping it at most half full*/
+static int PERSONALITY_INDEX_reserve(IOTHUB_HANDLE_DATA* moduleHandleData)
+{
+    int result;
+    if ((moduleHandleData->indexCount + 1) * 2 <= moduleHandleData->indexCapacity)
+    {
+        result = 0;
+    }
+    else
+    {
+        size_t newCapacity = (moduleHandleData->indexCapacity == 0) ? PERSONALITY_INDEX_INITIAL_CAPACITY : moduleHandleData->indexCapacity * 2;
+        PERSONALITY_PTR* newIndex = (PERSONALITY_PTR*)malloc(newCapacity * sizeof(PERSONALITY_PTR));
+        if (newIndex == NULL)
+        {
+            LogError("unable to grow the personality index to %zu entries", newCapacity);
+            result = __LINE__;
+        }
+        else
+        {
+            memset(newIndex, 0, newCapacity * sizeof(PERSONALITY_PTR));
+            if (moduleHandleData->personalityIndex != NULL)
+            {
+                for (size_t i = 0; i < moduleHandleData->indexCapacity; i++)
+                {
+                    if (moduleHandleData->personalityIndex[i] != NULL)
+                    {
+                        PERSONALITY_INDEX_insert(newIndex, newCapacity, moduleHandleData->personalityIndex[i]);
+                    }
+                }
+                free(moduleHandleData->personalityIndex);
+            }
+            moduleHandleData->personalityIndex = newIndex;
+            moduleHandleData->indexCapacity = newCapacity;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+static void PERSONALITY_INDEX_remove(IOTHUB_HANDLE_DATA* moduleHandleData, PERSONALITY_PTR personality)
+{
+    PERSONALITY_PTR* index = moduleHandleData->personalityIndex;
+    size_t mask = moduleHandleData->indexCapacity - 1;
+    size_t hole = personality->hash & mask;
+    while (index[hole] != personality)
+    {
+        hole = (hole + 1) & mask;
+    }
+    index[hole] = NULL;
+
+    /*shift back the personalities that probed past the hole*/
+    size_t i = hole;
+    for (;;)
+    {
+        i = (i + 1) & mask;
+        if (index[i] == NULL)
+        {
+            break;
+        }
+        size_t home = index[i]->hash & mask;
+        if ((i > hole) ? ((home <= hole) || (home > i)) : ((home <= hole) && (home > i)))
+        {
+            index[hole] = index[i];
+            index[i] = NULL;
+            hole = i;
+        }
+    }
+    moduleHandleData->indexCount--;
+}
+
+static void PERSONALITY_LRU_unlink(IOTHUB_HANDLE_DATA* moduleHandleData, PERSONALITY_PTR personality)
+{
+    if (personality->newer == NULL)
+    {
+        moduleHandleData->mostRecent = personality->older;
+    }
+    else
+    {
+        personality->newer->older = personality->older;
+    }
+
+    if (personality->older == NULL)
+    {
+        moduleHandleData->leastRecent = personality->newer;
+    }
+    else
+    {
+        personality->older->newer = personality->newer;
+    }
+}
+
+static void PERSONALITY_LRU_push(IOTHUB_HANDLE_DATA* moduleHandleData, PERSONALITY_PTR personality)
+{
+    personality->newer = NULL;
+    personality->older = moduleHandleData->mostRecent;
+    if (moduleHandleData->mostRecent == NULL)
+    {
+        moduleHandleData->leastRecent = personality;
+    }
+    else
+    {
+        moduleHandleData->mostRecent->newer = personality;
+    }
+    moduleHandleData->mostRecent = personality;
+}
+
+/*queues a personality without an IoTHubClient for the provisioning worker, called with lock held*/
+static void PROVISION_push(IOTHUB_HANDLE_DATA* moduleHandleData, PERSONALITY_PTR personality)
+{
+    personality->nextProvision = NULL;
+    if (moduleHandleData->newestProvision == NULL)
+    {
+        moduleHandleData->oldestProvision = personality;
+    }
+    else
+    {
+        moduleHandleData->newestProvision->nextProvision = personality;
+    }
+    moduleHandleData->newestProvision = personality;
+    (void)Condition_Post(moduleHandleData->provisionRequested);
+}
+
+static PERSONALITY_PTR PROVISION_pop(IOTHUB_HANDLE_DATA* moduleHandleData)
+{
+    PERSONALITY_PTR result = moduleHandleData->oldestProvision;
+    if (result != NULL)
+    {
+        moduleHandleData->oldestProvision = result->nextProvision;
+        if (moduleHandleData->oldestProvision == NULL)
+        {
+            moduleHandleData->newestProvision = NULL;
+        }
+        result->nextProvision = NULL;
+    }
+    return result;
+}
+
+/*takes a personality out of the provisioning queue, if it is in it; evicting a personality still queued is rare, the queue is walked*/
+static void PROVISION_unlink(IOTHUB_HANDLE_DATA* moduleHandleData, PERSONALITY_PTR personality)
+{
+    PERSONALITY_PTR previous = NULL;
+    PERSONALITY_PTR current = moduleHandleData->oldestProvision;
+    while ((current != NULL) && (current != personality))
+    {
+        previous = current;
+        current = current->nextProvision;
+    }
+
+    if (current != NULL)
+    {
+        if (previous == NULL)
+        {
+            moduleHandleData->oldestProvision = personality->nextProvision;
+        }
+        else
+        {
+            previous->nextProvision = personality->nextProvision;
+        }
+
+        if (moduleHandleData->newestProvision == personality)
+        {
+            moduleHandleData->newestProvision = previous;
+        }
+        personality->nextProvision = NULL;
+    }
+}
+
+static void PERSONALITY_evict(IOTHUB_HANDLE_DATA* moduleHandleData, PERSONALITY_PTR personality)
+{
+    if (personality->batchCount != 0)
+    {
+        /*Codes_SRS_IOTHUBMODULE_31_019: [ The batch of a personality shall be sent before the personality is destroyed. ]*/
+        BATCH_flush(moduleHandleData, personality, BATCH_FLUSH_CLOSING);
+    }
+    if (personality->iothubHandle == NULL)
+    {
+        PROVISION_unlink(moduleHandleData, personality);
+    }
+    PERSONALITY_INDEX_remove(moduleHandleData, personality);
+    PERSONALITY_LRU_unlink(moduleHandleData, personality);
+
+    /*the last personality of the vector takes the place of the evicted one*/
+    PERSONALITY_PTR* last = (PERSONALITY_PTR*)VECTOR_back(moduleHandleData->personalities);
+    if (*last != personality)
+    {
+        PERSONALITY_PTR* position = (PERSONALITY_PTR*)VECTOR_element(moduleHandleData->personalities, personality->position);
+        *position = *last;
+        (*position)->position = personality->position;
+    }
+    VECTOR_erase(moduleHandleData->personalities, last, 1);
+
+    if (personality == moduleHandleData->provisioning)
+    {
+        /*Codes_SRS_IOTHUBMODULE_31_062: [ A personality evicted while the provisioning worker creates its IoTHubClient shall be destroyed by the provisioning worker once `IoTHubClient_Create` returns. ]*/
+        moduleHandleData->provisioningEvicted = true;
+    }
+    else
+    {
+        PERSONALITY_destroy(personality);
+        free(personality);
+    }
+}
+
+static PERSONALITY* PERSONALITY_find_or_create(IOTHUB_HANDLE_DATA* moduleHandleData, const char* deviceName, const char* deviceKey)
+{
+    PERSONALITY* result;
+    /*Codes_SRS_IOTHUBMODULE_31_004: [ `IotHub_Receive` shall look up the personality of `deviceName` in an index of the personalities hashed by device ID. ]*/
+    size_t hash = hash_DeviceName(deviceName);
+    PERSONALITY_PTR* slot = (moduleHandleData->personalityIndex == NULL)
+        ? NULL
+        : PERSONALITY_INDEX_find(moduleHandleData, hash, deviceName);
+    if (slot != NULL && *slot != NULL)
+    {
+        /*Codes_SRS_IOTHUBMODULE_02_017: [ Otherwise `IotHub_Receive` shall not create a new personality. ]*/
+        result = *slot;
+        /*Codes_SRS_IOTHUBMODULE_31_006: [ The personality found or created shall become the most recently used personality. ]*/
+        PERSONALITY_LRU_unlink(moduleHandleData, result);
+        PERSONALITY_LRU_push(moduleHandleData, result);
+    }
+    else
+    {
+        /*a new device has arrived!*/
+        PERSONALITY_PTR personality;
+        if (
+            (moduleHandleData->maxPersonalities != 0) &&
+            (moduleHandleData->indexCount >= moduleHandleData->maxPersonalities)
+            )
+        {
+            /*Codes_SRS_IOTHUBMODULE_31_007: [ If `maxPersonalities` is not 0 and as many personalities exist, `IotHub_Receive` shall destroy the least recently used personality, and its `IOTHUB_CLIENT_HANDLE`, before creating a new one. ]*/
+            PERSONALITY_evict(moduleHandleData, moduleHandleData->leastRecent);
+        }
+
+        if (PERSONALITY_INDEX_reserve(moduleHandleData) != 0)
+        {
+            /*Codes_SRS_IOTHUBMODULE_31_005: [ If growing the personality index fails, then `IotHub_Receive` shall return. ]*/
+            LogError("unable to make room for the device %s", deviceName);
+            result = NULL;
+        }
+        else if ((personality = PERSONALITY_create(deviceName, deviceKey, hash, moduleHandleData)) == NULL)
+        {
+            LogError("unable to create a personality for the device %s", deviceName);
+            result = NULL;
+        }
+        else if (
+            (moduleHandleData->provisioningQueueSize == 0) &&
+            ((personality->iothubHandle = PERSONALITY_connect(moduleHandleData, personality, deviceName, deviceKey)) == NULL)
+            )
+        {
+            LogError("unable to create a personality for the device %s", deviceName);
+            PERSONALITY_destroy(personality);
+            free(personality);
+            result = NULL;
+        }
         else
         {
-            IOTHUB_CLIENT_CONFIG temp;
-            temp.protocol = moduleHandleData->transportProvider;
-            temp.deviceId = deviceName;
-            temp.deviceKey = deviceKey;
-            temp.deviceSasToken = NULL;
-            temp.iotHubName = STRING_c_str(moduleHandleData->IoTHubName);
-            temp.iotHubSuffix = STRING_c_str(moduleHandleData->IoTHubSuffix);
-            temp.protocolGatewayHostName = NULL;
-
-            /*Codes_SRS_IOTHUBMODULE_05_013: [ If a new personality is created and the module's transport has already been created (in `IotHub_Create`), an `IOTHUB_CLIENT_HANDLE` will be added to the personality by a call to `IoTHubClient_CreateWithTransport`. ]*/
-            /*Codes_SRS_IOTHUBMODULE_05_003: [ If a new personality is created and the module's transport has not already been created, an `IOTHUB_CLIENT_HANDLE` will be added to the personality by a call to `IoTHubClient_Create` with the corresponding transport provider. ]*/
-            result->iothubHandle = (moduleHandleData->transportHandle != NULL)
-                ? IoTHubClient_CreateWithTransport(moduleHandleData->transportHandle, &temp)
-                : IoTHubClient_Create(&temp);
-
-            if (result->iothubHandle == NULL)
-            {
-                LogError("unable to create IoTHubClient");
-                STRING_delete(result->deviceName);
-                STRING_delete(result->deviceKey);
-                free(result);
+            if ((VECTOR_push_back(moduleHandleData->personalities, &personality, 1)) != 0)
+            {
+                /*Codes_SRS_IOTHUBMODULE_02_016: [ If adding a new personality to the vector fails, then `IoTHub_Receive` shall return. ]*/
+                LogError("VECTOR_push_back failed");
+                PERSONALITY_destroy(personality);
+                free(personality);
                 result = NULL;
             }
             else
             {
-                /*Codes_SRS_IOTHUBMODULE_17_003: [ If a new personality is created, then the associated IoTHubClient will be set to receive messages by calling `IoTHubClient_SetMessageCallback` with callback function `IotHub_ReceiveMessageCallback`, and the personality as context. ]*/
-                if (IoTHubClient_SetMessageCallback(result->iothubHandle, IotHub_ReceiveMessageCallback, result) != IOTHUB_CLIENT_OK)
+                personality->position = moduleHandleData->indexCount;
+                PERSONALITY_INDEX_insert(moduleHandleData->personalityIndex, moduleHandleData->indexCapacity, personality);
+                moduleHandleData->indexCount++;
+                PERSONALITY_LRU_push(moduleHandleData, personality);
+                if (personality->iothubHandle == NULL)
                 {
-                    LogError("unable to IoTHubClient_SetMessageCallback");
-                    IoTHubClient_Destroy(result->iothubHandle);
-                    STRING_delete(result->deviceName);
-                    STRING_delete(result->deviceKey);
-                    free(result);
-                    result = NULL;
-                }
-                else
-                {
-                    /*it is all fine*/
-                    result->broker = moduleHandleData->broker;
-                    result->module = moduleHandleData;
+                    /*Codes_SRS_IOTHUBMODULE_31_058: [ If `provisioningQueueSize` is not 0, a new personality shall be created without its IoTHubClient and queued for the provisioning worker, which creates the IoTHubClients of the queued personalities one after the other without holding the lock of the module. ]*/
+                    PROVISION_push(moduleHandleData, personality);
                 }
+                result = personality;
             }
         }
     }
     return result;
 }
 
-static void PERSONALITY_destroy(PERSONALITY* personality)
+/*keeps a message of a personality whose IoTHubClient is not created yet, called with lock held; takes the message and returns false
+if it is dropped*/
+static bool PROVISION_hold(IOTHUB_HANDLE_DATA* moduleHandleData, PERSONALITY_PTR personality, IOTHUB_MESSAGE_HANDLE message)
 {
-    STRING_delete(personality->deviceName);
-    STRING_delete(personality->deviceKey);
-    IoTHubClient_Destroy(personality->iothubHandle);
+    bool result;
+    /*Codes_SRS_IOTHUBMODULE_31_059: [ Until the IoTHubClient of its personality is created, `IotHub_Receive` shall hold up to `provisioningQueueSize` messages of the device and drop the next ones; with a store the messages are appended to the store instead. ]*/
+    if (personality->heldCount >= moduleHandleData->provisioningQueueSize)
+    {
+        LogError("%zu messages of the device %s are held already, this one is dropped", personality->heldCount, STRING_c_str(personality->deviceName));
+        IoTHubMessage_Destroy(message);
+        result = false;
+    }
+    else
+    {
+        personality->held[personality->heldCount++] = message;
+        result = true;
+    }
+    return result;
 }
 
-static PERSONALITY* PERSONALITY_find_or_create(IOTHUB_HANDLE_DATA* moduleHandleData, const char* deviceName, const char* deviceKey)
+/*holds a message of a personality which has maxInFlight messages in flight, or held messages to send first; called with lock held,
+takes the message*/
+static void PROVISION_hold_back(IOTHUB_HANDLE_DATA* moduleHandleData, PERSONALITY_PTR personality, IOTHUB_MESSAGE_HANDLE message)
 {
-    /*Codes_SRS_IOTHUBMODULE_02_017: [ Otherwise `IotHub_Receive` shall not create a new personality. ]*/
-    PERSONALITY* result;
-    PERSONALITY_PTR* resultPtr = VECTOR_find_if(moduleHandleData->personalities, lookup_DeviceName, deviceName);
-    if (resultPtr == NULL)
+    /*Codes_SRS_IOTHUBMODULE_31_069: [ Once the IoTHubClient of a personality is created, a message of a personality which has `maxInFlight` messages in flight, or which has messages held still, shall be held after them, up to `provisioningQueueSize` messages, and the next ones dropped; the held messages are sent before the next message of the device. ]*/
+    if (PROVISION_hold(moduleHandleData, personality, message))
     {
-        /*a new device has arrived!*/
-        PERSONALITY_PTR personality;
-        if ((personality = PERSONALITY_create(deviceName, deviceKey, moduleHandleData)) == NULL)
+        SEND_count_window(moduleHandleData, 1, 0);
+    }
+    else
+    {
+        SEND_count_window(moduleHandleData, 0, 1);
+    }
+}
+
+/*sends the held messages of the personality while it has room in flight, the others stay held in order; called with lock held,
+returns true if messages are held still*/
+static bool PROVISION_send_held(IOTHUB_HANDLE_DATA* moduleHandleData, PERSONALITY_PTR personality)
+{
+    size_t taken = 0;
+    while (taken < personality->heldCount)
+    {
+        int result = SEND_message(moduleHandleData, personality, personality->held[taken]);
+        if (result == SEND_WINDOW_CLOSED)
         {
-            LogError("unable to create a personality for the device %s", deviceName);
-            result = NULL;
+            break;
+        }
+        else if (result != 0)
+        {
+            LogError("unable to send a message of the device %s", STRING_c_str(personality->deviceName));
+        }
+        IoTHubMessage_Destroy(personality->held[taken]);
+        taken++;
+    }
+
+    personality->heldCount -= taken;
+    if ((personality->heldCount != 0) && (taken != 0))
+    {
+        memmove(personality->held, personality->held + taken, personality->heldCount * sizeof(IOTHUB_MESSAGE_HANDLE));
+    }
+    return (personality->heldCount != 0);
+}
+
+/*sends what waited for the IoTHubClient of the personality, called with lock held*/
+static void PROVISION_release(IOTHUB_HANDLE_DATA* moduleHandleData, PERSONALITY_PTR personality)
+{
+    /*Codes_SRS_IOTHUBMODULE_31_060: [ Once the IoTHubClient of a personality is created, the provisioning worker shall send the messages held for it in the order they arrived, or the records of its store. ]*/
+    if (personality->store != NULL)
+    {
+        STORE_pump(moduleHandleData, personality);
+    }
+    else if (PROVISION_send_held(moduleHandleData, personality))
+    {
+        /*the rest waits for the next message of the device*/
+        SEND_count_window(moduleHandleData, 1, 0);
+    }
+}
+
+static int PROVISION_worker(void* param)
+{
+    IOTHUB_HANDLE_DATA* moduleHandleData = (IOTHUB_HANDLE_DATA*)param;
+    bool stopping = false;
+    while (!stopping)
+    {
+        PERSONALITY_PTR personality = NULL;
+        if (Lock(moduleHandleData->lock) != LOCK_OK)
+        {
+            LogError("unable to lock, the provisioning worker stops");
+            stopping = true;
         }
         else
         {
-            if ((VECTOR_push_back(moduleHandleData->personalities, &personality, 1)) != 0)
+            stopping = moduleHandleData->stopping;
+            if (!stopping)
             {
-                /*Codes_SRS_IOTHUBMODULE_02_016: [ If adding a new personality to the vector fails, then `IoTHub_Receive` shall return. ]*/
-                LogError("VECTOR_push_back failed");
-                PERSONALITY_destroy(personality);
-                free(personality);
-                result = NULL;
+                personality = PROVISION_pop(moduleHandleData);
+                if (personality == NULL)
+                {
+                    (void)Condition_Wait(moduleHandleData->provisionRequested, moduleHandleData->lock, 0);
+                }
+                else
+                {
+                    moduleHandleData->provisioning = personality;
+                    moduleHandleData->provisioningEvicted = false;
+                }
             }
-            else
+            (void)Unlock(moduleHandleData->lock);
+        }
+
+        if (personality != NULL)
+        {
+            /*the slow part, IotHub_Receive carries on with the other devices meanwhile*/
+            IOTHUB_CLIENT_HANDLE client = PERSONALITY_connect(moduleHandleData, personality, STRING_c_str(personality->deviceName), STRING_c_str(personality->deviceKey));
+            if (Lock(moduleHandleData->lock) != LOCK_OK)
             {
-                resultPtr = VECTOR_back(moduleHandleData->personalities);
-                result = *resultPtr;
+                LogError("unable to lock, the provisioning worker stops and the device %s gets no IoTHubClient", STRING_c_str(personality->deviceName));
+                if (client != NULL)
+                {
+                    IoTHubClient_Destroy(client);
+                }
+                stopping = true;
             }
+            else
+            {
+                moduleHandleData->provisioning = NULL;
+                personality->iothubHandle = client;
+                if (moduleHandleData->provisioningEvicted)
+                {
+                    PERSONALITY_destroy(personality);
+                    free(personality);
+                }
+                else if (client == NULL)
+                {
+                    /*Codes_SRS_IOTHUBMODULE_31_061: [ If creating the IoTHubClient fails, the provisioning worker shall destroy the personality and the messages held for it; the next message of the device creates the personality again. ]*/
+                    LogError("unable to create the IoTHubClient of the device %s, its personality is destroyed", STRING_c_str(personality->deviceName));
+                    PERSONALITY_evict(moduleHandleData, personality);
+                }
+                else
+                {
+                    PROVISION_release(moduleHandleData, personality);
+                }
+                (void)Unlock(moduleHandleData->lock);
             }
         }
-    else
-    {
-        result = *resultPtr;
     }
-    return result;
+    return 0;
 }
 
 static IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromGWMessage(MESSAGE_HANDLE message)
@@ -622,6 +2532,197 @@ static IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromGWMessage(MESSAGE_HANDLE me
     return result;
 }
 
+static void IotHub_ReceiveBatched(IOTHUB_HANDLE_DATA* moduleHandleData, const char* deviceName, const char* deviceKey, MESSAGE_HANDLE messageHandle)
+{
+    if (Lock(moduleHandleData->lock) != LOCK_OK)
+    {
+        LogError("unable to lock");
+    }
+    else
+    {
+        PERSONALITY* personality = PERSONALITY_find_or_create(moduleHandleData, deviceName, deviceKey);
+        if (personality == NULL)
+        {
+            /*Codes_SRS_IOTHUBMODULE_02_014: [ If creating the personality fails then `IotHub_Receive` shall return. ]*/
+            LogError("unable to PERSONALITY_find_or_create");
+        }
+        else
+        {
+            IOTHUB_MESSAGE_HANDLE iotHubMessage = IoTHubMessage_CreateFromGWMessage(messageHandle);
+            if (iotHubMessage == NULL)
+            {
+                LogError("unable to IoTHubMessage_CreateFromGWMessage (internal)");
+            }
+            else if (personality->iothubHandle == NULL)
+            {
+                (void)PROVISION_hold(moduleHandleData, personality, iotHubMessage);
+            }
+            else if (PROVISION_send_held(moduleHandleData, personality))
+            {
+                /*the messages held until the IoTHubClient was created go first*/
+                PROVISION_hold_back(moduleHandleData, personality, iotHubMessage);
+            }
+            else
+            {
+                size_t size = Message_GetContent(messageHandle)->size;
+                if (personality->batchCount >= moduleHandleData->batchMaxMessages)
+                {
+                    /*a batch held back by the window of its personality*/
+                    BATCH_flush(moduleHandleData, personality, BATCH_FLUSH_FULL);
+                }
+                if (BATCH_overflows(moduleHandleData, personality, size))
+                {
+                    /*Codes_SRS_IOTHUBMODULE_31_015: [ If the message would put more than `batchMaxBytes` content bytes in the batch, `IotHub_Receive` shall send the batch first. ]*/
+                    BATCH_flush(moduleHandleData, personality, BATCH_FLUSH_BYTES);
+                }
+
+                if (
+                    (personality->batchCount >= moduleHandleData->batchMaxMessages) ||
+                    BATCH_overflows(moduleHandleData, personality, size)
+                    )
+                {
+                    /*Codes_SRS_IOTHUBMODULE_31_068: [ A message which finds no room in the batch of its personality once the batch is flushed, because the personality has `maxInFlight` messages in flight, shall be dropped. ]*/
+                    LogError("the device %s has maxInFlight messages in flight and its batch is full, the message is dropped", deviceName);
+                    SEND_count_window(moduleHandleData, 0, 1);
+                    IoTHubMessage_Destroy(iotHubMessage);
+                }
+                else
+                {
+                    if (personality->batchCount == 0)
+                    {
+                        if (tickcounter_get_current_ms(moduleHandleData->clock, &personality->batchStarted) != 0)
+                        {
+                            LogError("unable to tickcounter_get_current_ms, the batch waits for the next round of the flush worker");
+                            personality->batchStarted = 0;
+                        }
+                        BATCH_push(moduleHandleData, personality);
+                    }
+
+                    /*Codes_SRS_IOTHUBMODULE_31_014: [ If `batchMaxMessages` is not 0, `IotHub_Receive` shall add the IOTHUB_MESSAGE_HANDLE to the batch of the personality instead of sending it. ]*/
+                    personality->batch[personality->batchCount++] = iotHubMessage;
+                    personality->batchBytes += size;
+
+                    /*Codes_SRS_IOTHUBMODULE_31_020: [ `IotHub_Receive` shall send the batch once it holds `batchMaxMessages` messages or `batchMaxBytes` content bytes. ]*/
+                    if (personality->batchCount >= moduleHandleData->batchMaxMessages)
+                    {
+                        BATCH_flush(moduleHandleData, personality, BATCH_FLUSH_FULL);
+                    }
+                    else if (
+                        (moduleHandleData->batchMaxBytes != 0) &&
+                        (personality->batchBytes >= moduleHandleData->batchMaxBytes)
+                        )
+                    {
+                        BATCH_flush(moduleHandleData, personality, BATCH_FLUSH_BYTES);
+                    }
+                }
+            }
+        }
+        (void)Unlock(moduleHandleData->lock);
+    }
+}
+
+static void IotHub_ReceiveStored(IOTHUB_HANDLE_DATA* moduleHandleData, const char* deviceName, const char* deviceKey, MESSAGE_HANDLE messageHandle)
+{
+    size_t size;
+    unsigned char* record = STORE_create_record(messageHandle, &size);
+    if (record == NULL)
+    {
+        LogError("unable to STORE_create_record");
+    }
+    else
+    {
+        if (Lock(moduleHandleData->lock) != LOCK_OK)
+        {
+            LogError("unable to lock");
+        }
+        else
+        {
+            PERSONALITY* personality = PERSONALITY_find_or_create(moduleHandleData, deviceName, deviceKey);
+            if (personality == NULL)
+            {
+                /*Codes_SRS_IOTHUBMODULE_02_014: [ If creating the personality fails then `IotHub_Receive` shall return. ]*/
+                LogError("unable to PERSONALITY_find_or_create");
+            }
+            else
+            {
+                int appended;
+                if (Lock(moduleHandleData->confirmationLock) != LOCK_OK)
+                {
+                    LogError("unable to lock");
+                    appended = __LINE__;
+                }
+                else
+                {
+                    /*Codes_SRS_IOTHUBMODULE_31_035: [ If the module has a store directory, `IotHub_Receive` shall append the content of the message and its properties, but `deviceName` and `deviceKey`, to the store of the personality, then send the records of the store its budget allows. ]*/
+                    appended = SegmentLog_Append(personality->store, record, size);
+                    (void)Unlock(moduleHandleData->confirmationLock);
+                }
+
+                if (appended != 0)
+                {
+                    LogError("unable to store a message of the device %s, it is lost", deviceName);
+                }
+                else
+                {
+                    STORE_pump(moduleHandleData, personality);
+                }
+            }
+            (void)Unlock(moduleHandleData->lock);
+        }
+        free(record);
+    }
+}
+
+static void IotHub_ReceiveProvisioned(IOTHUB_HANDLE_DATA* moduleHandleData, const char* deviceName, const char* deviceKey, MESSAGE_HANDLE messageHandle)
+{
+    if (Lock(moduleHandleData->lock) != LOCK_OK)
+    {
+        LogError("unable to lock");
+    }
+    else
+    {
+        PERSONALITY* personality = PERSONALITY_find_or_create(moduleHandleData, deviceName, deviceKey);
+        if (personality == NULL)
+        {
+            /*Codes_SRS_IOTHUBMODULE_02_014: [ If creating the personality fails then `IotHub_Receive` shall return. ]*/
+            LogError("unable to PERSONALITY_find_or_create");
+        }
+        else
+        {
+            IOTHUB_MESSAGE_HANDLE iotHubMessage = IoTHubMessage_CreateFromGWMessage(messageHandle);
+            if (iotHubMessage == NULL)
+            {
+                LogError("unable to IoTHubMessage_CreateFromGWMessage (internal)");
+            }
+            else if (personality->iothubHandle == NULL)
+            {
+                (void)PROVISION_hold(moduleHandleData, personality, iotHubMessage);
+            }
+            else if (PROVISION_send_held(moduleHandleData, personality))
+            {
+                PROVISION_hold_back(moduleHandleData, personality, iotHubMessage);
+            }
+            else
+            {
+                int result = SEND_message(moduleHandleData, personality, iotHubMessage);
+                if (result == SEND_WINDOW_CLOSED)
+                {
+                    PROVISION_hold_back(moduleHandleData, personality, iotHubMessage);
+                }
+                else
+                {
+                    if (result != 0)
+                    {
+                        LogError("unable to send a message of the device %s", deviceName);
+                    }
+                    IoTHubMessage_Destroy(iotHubMessage);
+                }
+            }
+        }
+        (void)Unlock(moduleHandleData->lock);
+    }
+}
+
 static void IotHub_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE messageHandle)
 {
     /*Codes_SRS_IOTHUBMODULE_02_009: [ If `moduleHandle` or `messageHandle` is `NULL` then `IotHub_Receive` shall do nothing. ]*/
@@ -665,35 +2766,59 @@ static void IotHub_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE messageHan
                 else
                 {
                     IOTHUB_HANDLE_DATA* moduleHandleData = moduleHandle;
-                    /*Codes_SRS_IOTHUBMODULE_02_013: [ If no personality exists with a device ID equal to the value of the `deviceName` property of the message, then `IotHub_Receive` shall create a new `PERSONALITY` with the ID and key values from the message. ]*/
-
-                    PERSONALITY* whereIsIt = PERSONALITY_find_or_create(moduleHandleData, deviceName, deviceKey);
-                    if (whereIsIt == NULL)
+                    if (moduleHandleData->storeDirectory != NULL)
+                    {
+                        IotHub_ReceiveStored(moduleHandleData, deviceName, deviceKey, messageHandle);
+                    }
+                    else if (moduleHandleData->batchMaxMessages != 0)
+                    {
+                        IotHub_ReceiveBatched(moduleHandleData, deviceName, deviceKey, messageHandle);
+                    }
+                    else if (moduleHandleData->provisionWorker != NULL)
                     {
-                        /*Codes_SRS_IOTHUBMODULE_02_014: [ If creating the personality fails then `IotHub_Receive` shall return. ]*/
-                        /*do nothing, device was not added to the GW*/
-                        LogError("unable to PERSONALITY_find_or_create");
+                        IotHub_ReceiveProvisioned(moduleHandleData, deviceName, deviceKey, messageHandle);
                     }
                     else
                     {
-                        IOTHUB_MESSAGE_HANDLE iotHubMessage = IoTHubMessage_CreateFromGWMessage(messageHandle);
-                        if(iotHubMessage == NULL)
+                        /*Codes_SRS_IOTHUBMODULE_02_013: [ If no personality exists with a device ID equal to the value of the `deviceName` property of the message, then `IotHub_Receive` shall create a new `PERSONALITY` with the ID and key values from the message. ]*/
+
+                        PERSONALITY* whereIsIt = PERSONALITY_find_or_create(moduleHandleData, deviceName, deviceKey);
+                        if (whereIsIt == NULL)
                         {
-                            LogError("unable to IoTHubMessage_CreateFromGWMessage (internal)");
+                            /*Codes_SRS_IOTHUBMODULE_02_014: [ If creating the personality fails then `IotHub_Receive` shall return. ]*/
+                            /*do nothing, device was not added to the GW*/
+                            LogError("unable to PERSONALITY_find_or_create");
                         }
                         else
                         {
-                            /*Codes_SRS_IOTHUBMODULE_02_020: [ `IotHub_Receive` shall call IoTHubClient_SendEventAsync passing the IOTHUB_MESSAGE_HANDLE. ]*/
-                            if (IoTHubClient_SendEventAsync(whereIsIt->iothubHandle, iotHubMessage, NULL, NULL) != IOTHUB_CLIENT_OK)
+                            IOTHUB_MESSAGE_HANDLE iotHubMessage = IoTHubMessage_CreateFromGWMessage(messageHandle);
+                            if(iotHubMessage == NULL)
                             {
-                                /*Codes_SRS_IOTHUBMODULE_02_021: [ If `IoTHubClient_SendEventAsync` fails then `IotHub_Receive` shall return. ]*/
-                                LogError("unable to IoTHubClient_SendEventAsync");
+                                LogError("unable to IoTHubMessage_CreateFromGWMessage (internal)");
                             }
                             else
                             {
-                                /*all is fine, message has been accepted for delivery*/
+                                int result;
+                                /*without the lock of the module, nothing else waits for it meanwhile*/
+                                SEND_wait_for_window(moduleHandleData, whereIsIt);
+                                /*Codes_SRS_IOTHUBMODULE_02_020: [ `IotHub_Receive` shall call IoTHubClient_SendEventAsync passing the IOTHUB_MESSAGE_HANDLE. ]*/
+                                result = SEND_message(moduleHandleData, whereIsIt, iotHubMessage);
+                                if (result == SEND_WINDOW_CLOSED)
+                                {
+                                    LogError("the device %s has maxInFlight messages in flight, the message is dropped", deviceName);
+                                    SEND_count_window(moduleHandleData, 0, 1);
+                                }
+                                else if (result != 0)
+                                {
+                                    /*Codes_SRS_IOTHUBMODULE_02_021: [ If `IoTHubClient_SendEventAsync` fails then `IotHub_Receive` shall return. ]*/
+                                    LogError("unable to send a message of the device %s", deviceName);
+                                }
+                                else
+                                {
+                                    /*all is fine, message has been accepted for delivery*/
+                                }
+                                IoTHubMessage_Destroy(iotHubMessage);
                             }
-                            IoTHubMessage_Destroy(iotHubMessage);
                         }
                     }
                 }
@@ -726,3 +2851,127 @@ MODULE_EXPORT const MODULE_API* Module_GetApi(MODULE_API_VERSION gateway_api_ver
     (void)gateway_api_version;
     return (const MODULE_API *)&moduleInterface;
 }
+
+int IotHub_GetBatchCounters(MODULE_HANDLE module, IOTHUB_BATCH_COUNTERS* counters)
+{
+    int result;
+    if (
+        (module == NULL) ||
+        (counters == NULL)
+        )
+    {
+        /*Codes_SRS_IOTHUBMODULE_31_021: [ If `module` or `counters` is `NULL` then `IotHub_GetBatchCounters` shall fail and return a non-zero value. ]*/
+        LogError("invalid arg module=%p, counters=%p", module, counters);
+        result = __LINE__;
+    }
+    else
+    {
+        IOTHUB_HANDLE_DATA* handleData = (IOTHUB_HANDLE_DATA*)module;
+        if (handleData->lock == NULL)
+        {
+            /*without batching there is nothing to count*/
+            *counters = handleData->batchCounters;
+            result = 0;
+        }
+        else if (Lock(handleData->lock) != LOCK_OK)
+        {
+            LogError("unable to lock");
+            result = __LINE__;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBMODULE_31_023: [ Otherwise `IotHub_GetBatchCounters` shall copy the batching counters of the module into `counters` and return 0. ]*/
+            *counters = handleData->batchCounters;
+            (void)Unlock(handleData->lock);
+            result = 0;
+        }
+    }
+    return result;
+}
+
+int IotHub_GetSendCounters(MODULE_HANDLE module, IOTHUB_SEND_COUNTERS* counters)
+{
+    int result;
+    if (
+        (module == NULL) ||
+        (counters == NULL)
+        )
+    {
+        /*Codes_SRS_IOTHUBMODULE_31_051: [ If `module` or `counters` is `NULL` then `IotHub_GetSendCounters` shall fail and return a non-zero value. ]*/
+        LogError("invalid arg module=%p, counters=%p", module, counters);
+        result = __LINE__;
+    }
+    else
+    {
+        IOTHUB_HANDLE_DATA* handleData = (IOTHUB_HANDLE_DATA*)module;
+        if (Lock(handleData->confirmationLock) != LOCK_OK)
+        {
+            LogError("unable to lock");
+            result = __LINE__;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBMODULE_31_052: [ Otherwise `IotHub_GetSendCounters` shall copy the send and confirmation counters of the module into `counters` and return 0. ]*/
+            *counters = handleData->sendCounters;
+            (void)Unlock(handleData->confirmationLock);
+            result = 0;
+        }
+    }
+    return result;
+}
+
+int IotHub_ProvisionDevices(MODULE_HANDLE module, const IOTHUB_DEVICE* devices, size_t deviceCount)
+{
+    int result;
+    if (
+        (module == NULL) ||
+        ((devices == NULL) && (deviceCount != 0))
+        )
+    {
+        /*Codes_SRS_IOTHUBMODULE_31_064: [ If `module` is `NULL`, or `devices` is `NULL` and `deviceCount` is not 0, then `IotHub_ProvisionDevices` shall fail and return a non-zero value. ]*/
+        LogError("invalid arg module=%p, devices=%p, deviceCount=%zu", module, devices, deviceCount);
+        result = __LINE__;
+    }
+    else
+    {
+        IOTHUB_HANDLE_DATA* handleData = (IOTHUB_HANDLE_DATA*)module;
+        if (
+            (handleData->lock != NULL) &&
+            (Lock(handleData->lock) != LOCK_OK)
+            )
+        {
+            LogError("unable to lock");
+            result = __LINE__;
+        }
+        else
+        {
+            size_t failed = 0;
+            for (size_t i = 0; i < deviceCount; i++)
+            {
+                /*Codes_SRS_IOTHUBMODULE_31_065: [ `IotHub_ProvisionDevices` shall find or create the personality of every device of `devices`, as `IotHub_Receive` does; with a provisioning worker the IoTHubClients are created by the worker. ]*/
+                if (
+                    (devices[i].deviceName == NULL) ||
+                    (devices[i].deviceKey == NULL)
+                    )
+                {
+                    LogError("the device %zu has no name or no key", i);
+                    failed++;
+                }
+                else if (PERSONALITY_find_or_create(handleData, devices[i].deviceName, devices[i].deviceKey) == NULL)
+                {
+                    LogError("unable to PERSONALITY_find_or_create the device %s", devices[i].deviceName);
+                    failed++;
+                }
+            }
+
+            if (handleData->lock != NULL)
+            {
+                (void)Unlock(handleData->lock);
+            }
+
+            /*Codes_SRS_IOTHUBMODULE_31_066: [ `IotHub_ProvisionDevices` shall return 0 if every device has its personality and a non-zero value otherwise. ]*/
+            result = (failed == 0) ? 0 : __LINE__;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,862 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/gb_stdio.h"
+#include "azure_c_shared_utility/gb_time.h"
+#include "azure_c_shared_utility/strings.h"
+#include "azure_c_shared_utility/vector.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "segment_file.h"
+#include "segment_log.h"
+
+/*a record is a header followed by the bytes appended, every number is big endian*/
+#define RECORD_MAGIC "SLOG"
+#define RECORD_SEQUENCE_OFFSET 8
+#define RECORD_TIME_OFFSET 16
+#define RECORD_HEADER_SIZE 24
+
+#define SEGMENT_EXTENSION "seg"
+#define MANIFEST_EXTENSION "log"
+
+typedef struct SEGMENT_TAG
+{
+    uint64_t number; /*names the file of the segment*/
+    uint64_t firstSequence;
+    uint64_t lastSequence; /*firstSequence - 1 while the segment is empty*/
+    size_t bytes; /*the bytes of the whole records, a record torn by a crash is past them*/
+    time_t newest; /*when the last record was appended*/
+}SEGMENT;
+
+typedef struct SEGMENT_LOG_TAG
+{
+    STRING_HANDLE prefix; /*directory and escaped name, the files of the log start with it*/
+    size_t segmentMaxBytes;
+    size_t maxBytes;
+    unsigned int retentionSeconds;
+    VECTOR_HANDLE segments; /*holds SEGMENTs, oldest first*/
+    uint64_t nextNumber;
+    FILE* writer; /*appends to the last segment, NULL once it is sealed*/
+    FILE* reader;
+    uint64_t readerNumber; /*the segment the reader has open*/
+    uint64_t readerSequence; /*the record at readerOffset*/
+    long readerOffset;
+    uint64_t nextSequence; /*of the next record appended*/
+    uint64_t readSequence; /*of the next record read*/
+    uint64_t ackedThrough; /*every record up to it is acknowledged*/
+    uint64_t ackedAbove; /*bit i set when ackedThrough + 1 + i is acknowledged*/
+    size_t totalBytes;
+    unsigned char* buffer; /*the record last read*/
+    size_t bufferSize;
+    size_t bufferUsed;
+    SEGMENT_LOG_COUNTERS counters;
+}SEGMENT_LOG;
+
+/*device names may hold characters a file name cannot, every character but letters, digits, '-' and '_' is written as %XX*/
+static STRING_HANDLE SEGMENT_LOG_create_prefix(const char* directory, const char* name)
+{
+    STRING_HANDLE result = STRING_construct(directory);
+    if (result == NULL)
+    {
+        LogError("unable to STRING_construct");
+    }
+    else if (STRING_concat(result, "/") != 0)
+    {
+        LogError("unable to STRING_concat");
+        STRING_delete(result);
+        result = NULL;
+    }
+    else
+    {
+        const char* c;
+        for (c = name; *c != '\0'; c++)
+        {
+            char escaped[4];
+            if (isalnum((unsigned char)*c) || (*c == '-') || (*c == '_'))
+            {
+                escaped[0] = *c;
+                escaped[1] = '\0';
+            }
+            else
+            {
+                (void)sprintf(escaped, "%%%02X", (unsigned int)(unsigned char)*c);
+            }
+
+            if (STRING_concat(result, escaped) != 0)
+            {
+                LogError("unable to STRING_concat");
+                break;
+            }
+        }
+
+        if (*c != '\0')
+        {
+            STRING_delete(result);
+            result = NULL;
+        }
+    }
+    return result;
+}
+
+static STRING_HANDLE SEGMENT_LOG_segment_path(SEGMENT_LOG* log, uint64_t number)
+{
+    return SegmentFile_Path(log->prefix, number, SEGMENT_EXTENSION);
+}
+
+/*
+ * The manifest names the segments on disk and how far they are acknowledged.
+ * It is written when a segment is created or deleted and when the log is
+ * closed, not on every acknowledgement, so after a crash the records
+ * acknowledged since are read again: delivery is at least once.
+ */
+static void SEGMENT_LOG_write_manifest(SEGMENT_LOG* log)
+{
+    uint64_t numbers[3];
+    numbers[0] = (VECTOR_size(log->segments) == 0)
+        ? log->nextNumber
+        : ((SEGMENT*)VECTOR_front(log->segments))->number;
+    numbers[1] = log->nextNumber;
+    numbers[2] = log->ackedThrough;
+    if (SegmentFile_WriteManifest(log->prefix, MANIFEST_EXTENSION, numbers, 3) != 0)
+    {
+        LogError("the log %s is recovered from the previous manifest", STRING_c_str(log->prefix));
+    }
+}
+
+/*finds the whole records of a segment file*/
+static int SEGMENT_LOG_scan(SEGMENT_LOG* log, SEGMENT* segment)
+{
+    int result;
+    STRING_HANDLE path = SEGMENT_LOG_segment_path(log, segment->number);
+    if (path == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        const unsigned char* bytes;
+        size_t size;
+        if (SegmentFile_Map(STRING_c_str(path), &bytes, &size) != 0)
+        {
+            LogError("segment %s is missing", STRING_c_str(path));
+            result = __LINE__;
+        }
+        else
+        {
+            size_t offset = 0;
+            size_t recordSize;
+            segment->firstSequence = 1;
+            segment->lastSequence = 0;
+            segment->newest = 0;
+            while (SegmentFile_GetRecord(bytes, size, offset, RECORD_MAGIC, RECORD_HEADER_SIZE, &recordSize) == 0)
+            {
+                const unsigned char* header = bytes + offset;
+                uint64_t sequence = SegmentFile_GetUint64(header + RECORD_SEQUENCE_OFFSET);
+                if (offset == 0)
+                {
+                    segment->firstSequence = sequence;
+                }
+                else if (sequence != segment->lastSequence + 1)
+                {
+                    break;
+                }
+                segment->lastSequence = sequence;
+                segment->newest = (time_t)SegmentFile_GetUint64(header + RECORD_TIME_OFFSET);
+                offset += RECORD_HEADER_SIZE + recordSize;
+            }
+
+            if (offset < size)
+            {
+                LogInfo("segment %s ends with a partial record, it is left out", STRING_c_str(path));
+            }
+            segment->bytes = offset;
+            SegmentFile_Unmap(bytes, size);
+            result = 0;
+        }
+        STRING_delete(path);
+    }
+    return result;
+}
+
+static int SEGMENT_LOG_recover(SEGMENT_LOG* log)
+{
+    int result = 0;
+    uint64_t numbers[3];
+    if (SegmentFile_ReadManifest(log->prefix, MANIFEST_EXTENSION, numbers, 3) != 0)
+    {
+        /*a new log, or one whose manifest is lost, starts empty*/
+    }
+    else
+    {
+        uint64_t first = numbers[0];
+        uint64_t next = numbers[1];
+
+        log->ackedThrough = numbers[2];
+        for (uint64_t number = first; (result == 0) && (number < next); number++)
+        {
+            SEGMENT segment;
+            SEGMENT* newest = (VECTOR_size(log->segments) == 0) ? NULL : (SEGMENT*)VECTOR_back(log->segments);
+            segment.number = number;
+            if (SEGMENT_LOG_scan(log, &segment) != 0)
+            {
+                /*lost, the records of the others are still read*/
+            }
+            else if (
+                (segment.lastSequence < segment.firstSequence) ||
+                ((newest != NULL) && (segment.firstSequence <= newest->lastSequence))
+                )
+            {
+                /*an empty segment, or one out of order, is left on disk for whoever looks into it*/
+                LogInfo("segment %llu of %s holds no record to read", (unsigned long long)number, STRING_c_str(log->prefix));
+            }
+            else if (VECTOR_push_back(log->segments, &segment, 1) != 0)
+            {
+                LogError("unable to VECTOR_push_back");
+                result = __LINE__;
+            }
+            else
+            {
+                log->totalBytes += segment.bytes;
+            }
+        }
+        log->nextNumber = next;
+
+        if (VECTOR_size(log->segments) == 0)
+        {
+            log->nextSequence = log->ackedThrough + 1;
+        }
+        else
+        {
+            SEGMENT* oldest = (SEGMENT*)VECTOR_front(log->segments);
+            SEGMENT* newest = (SEGMENT*)VECTOR_back(log->segments);
+            log->nextSequence = newest->lastSequence + 1;
+            if (log->ackedThrough < oldest->firstSequence - 1)
+            {
+                log->ackedThrough = oldest->firstSequence - 1;
+            }
+            else if (log->ackedThrough > newest->lastSequence)
+            {
+                log->ackedThrough = newest->lastSequence;
+            }
+        }
+        log->readSequence = log->ackedThrough + 1;
+        log->counters.pending = log->nextSequence - 1 - log->ackedThrough;
+        /*the last segment may end with a torn record, records are appended to a new one*/
+    }
+    return result;
+}
+
+SEGMENT_LOG_HANDLE SegmentLog_Open(const SEGMENT_LOG_CONFIG* config)
+{
+    SEGMENT_LOG* result;
+    if (
+        (config == NULL) ||
+        (config->directory == NULL) ||
+        (config->name == NULL)
+        )
+    {
+        /*Codes_SRS_SEGMENT_LOG_31_001: [ If `config`, `config->directory` or `config->name` is NULL then `SegmentLog_Open` shall fail and return NULL. ]*/
+        LogError("invalid arg config=%p", config);
+        result = NULL;
+    }
+    else if ((result = (SEGMENT_LOG*)malloc(sizeof(SEGMENT_LOG))) == NULL)
+    {
+        LogError("unable to malloc");
+    }
+    else
+    {
+        memset(result, 0, sizeof(SEGMENT_LOG));
+        result->segmentMaxBytes = (config->segmentMaxBytes == 0) ? SEGMENT_LOG_DEFAULT_SEGMENT_BYTES : config->segmentMaxBytes;
+        result->maxBytes = config->maxBytes;
+        result->retentionSeconds = config->retentionSeconds;
+        result->nextSequence = 1;
+        result->readSequence = 1;
+        if ((result->prefix = SEGMENT_LOG_create_prefix(config->directory, config->name)) == NULL)
+        {
+            LogError("unable to name the files of the log %s", config->name);
+            free(result);
+            result = NULL;
+        }
+        else if ((result->segments = VECTOR_create(sizeof(SEGMENT))) == NULL)
+        {
+            LogError("unable to VECTOR_create");
+            STRING_delete(result->prefix);
+            free(result);
+            result = NULL;
+        }
+        /*Codes_SRS_SEGMENT_LOG_31_002: [ `SegmentLog_Open` shall recover the records a previous log of the same name left on disk, up to the first damaged record of each segment, and append the next records to a new segment. ]*/
+        else if (SEGMENT_LOG_recover(result) != 0)
+        {
+            /*Codes_SRS_SEGMENT_LOG_31_003: [ If `SegmentLog_Open` encounters an internal failure it shall fail and return NULL. ]*/
+            LogError("unable to recover the log %s", config->name);
+            VECTOR_destroy(result->segments);
+            STRING_delete(result->prefix);
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            /*all is fine*/
+        }
+    }
+    return result;
+}
+
+/*moves ackedThrough up to through, returns how many records it passed which were not acknowledged*/
+static uint64_t SEGMENT_LOG_skip_through(SEGMENT_LOG* log, uint64_t through)
+{
+    uint64_t skipped = 0;
+    while (log->ackedThrough < through)
+    {
+        if ((log->ackedAbove & 1) == 0)
+        {
+            skipped++;
+        }
+        log->ackedAbove >>= 1;
+        log->ackedThrough++;
+    }
+
+    if (log->readSequence <= log->ackedThrough)
+    {
+        log->readSequence = log->ackedThrough + 1;
+    }
+    return skipped;
+}
+
+static void SEGMENT_LOG_delete_oldest(SEGMENT_LOG* log)
+{
+    SEGMENT* oldest = (SEGMENT*)VECTOR_front(log->segments);
+    STRING_HANDLE path = SEGMENT_LOG_segment_path(log, oldest->number);
+
+    if ((log->reader != NULL) && (log->readerNumber == oldest->number))
+    {
+        (void)fclose(log->reader);
+        log->reader = NULL;
+    }
+    if ((log->writer != NULL) && (VECTOR_size(log->segments) == 1))
+    {
+        (void)fclose(log->writer);
+        log->writer = NULL;
+    }
+
+    if (path == NULL)
+    {
+        LogError("unable to name segment %llu, its file stays on disk", (unsigned long long)oldest->number);
+    }
+    else
+    {
+        if (remove(STRING_c_str(path)) != 0)
+        {
+            LogError("unable to remove %s", STRING_c_str(path));
+        }
+        STRING_delete(path);
+    }
+
+    log->totalBytes -= oldest->bytes;
+    VECTOR_erase(log->segments, oldest, 1);
+    SEGMENT_LOG_write_manifest(log);
+}
+
+static void SEGMENT_LOG_drop_oldest(SEGMENT_LOG* log)
+{
+    SEGMENT* oldest = (SEGMENT*)VECTOR_front(log->segments);
+    uint64_t dropped = SEGMENT_LOG_skip_through(log, oldest->lastSequence);
+    if (dropped != 0)
+    {
+        LogError("%llu records of %s are dropped before they were sent", (unsigned long long)dropped, STRING_c_str(log->prefix));
+        log->counters.dropped += dropped;
+        log->counters.pending -= dropped;
+    }
+    SEGMENT_LOG_delete_oldest(log);
+}
+
+void SegmentLog_Close(SEGMENT_LOG_HANDLE log)
+{
+    if (log == NULL)
+    {
+        LogError("invalid arg log=NULL");
+    }
+    else
+    {
+        if (log->writer != NULL)
+        {
+            (void)fclose(log->writer);
+            log->writer = NULL;
+        }
+        if (log->reader != NULL)
+        {
+            (void)fclose(log->reader);
+            log->reader = NULL;
+        }
+
+        if (log->ackedThrough + 1 == log->nextSequence)
+        {
+            /*Codes_SRS_SEGMENT_LOG_31_016: [ `SegmentLog_Close` shall delete the files of a log whose records are all acknowledged. ]*/
+            STRING_HANDLE path = SegmentFile_ManifestPath(log->prefix, MANIFEST_EXTENSION);
+            while (VECTOR_size(log->segments) != 0)
+            {
+                SEGMENT_LOG_delete_oldest(log);
+            }
+            if (path != NULL)
+            {
+                (void)remove(STRING_c_str(path));
+                STRING_delete(path);
+            }
+        }
+        else
+        {
+            /*Codes_SRS_SEGMENT_LOG_31_015: [ `SegmentLog_Close` shall keep the records not acknowledged on disk, with how far the records are acknowledged. ]*/
+            SEGMENT_LOG_write_manifest(log);
+        }
+        VECTOR_destroy(log->segments);
+        STRING_delete(log->prefix);
+        free(log->buffer);
+        free(log);
+    }
+}
+
+static int SEGMENT_LOG_start_segment(SEGMENT_LOG* log)
+{
+    int result;
+    SEGMENT segment;
+    STRING_HANDLE path;
+    segment.number = log->nextNumber;
+    segment.firstSequence = log->nextSequence;
+    segment.lastSequence = log->nextSequence - 1;
+    segment.bytes = 0;
+    segment.newest = time(NULL);
+
+    if ((path = SEGMENT_LOG_segment_path(log, segment.number)) == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        if ((log->writer = fopen(STRING_c_str(path), "wb")) == NULL)
+        {
+            LogError("unable to create %s", STRING_c_str(path));
+            result = __LINE__;
+        }
+        else if (VECTOR_push_back(log->segments, &segment, 1) != 0)
+        {
+            LogError("unable to VECTOR_push_back");
+            (void)fclose(log->writer);
+            log->writer = NULL;
+            (void)remove(STRING_c_str(path));
+            result = __LINE__;
+        }
+        else
+        {
+            log->nextNumber++;
+            SEGMENT_LOG_write_manifest(log);
+            result = 0;
+        }
+        STRING_delete(path);
+    }
+    return result;
+}
+
+int SegmentLog_Append(SEGMENT_LOG_HANDLE log, const unsigned char* record, size_t size)
+{
+    int result;
+    if (
+        (log == NULL) ||
+        ((record == NULL) && (size != 0)) ||
+        (size > UINT32_MAX - RECORD_HEADER_SIZE)
+        )
+    {
+        /*Codes_SRS_SEGMENT_LOG_31_004: [ If `log` is NULL, or `record` is NULL and `size` is not 0, then `SegmentLog_Append` shall fail and return a non-zero value. ]*/
+        LogError("invalid arg log=%p, record=%p, size=%zu", log, record, size);
+        result = __LINE__;
+    }
+    else
+    {
+        size_t recordBytes = RECORD_HEADER_SIZE + size;
+        if (log->writer != NULL)
+        {
+            SEGMENT* newest = (SEGMENT*)VECTOR_back(log->segments);
+            if (
+                (newest->bytes != 0) &&
+                (newest->bytes + recordBytes > log->segmentMaxBytes)
+                )
+            {
+                /*Codes_SRS_SEGMENT_LOG_31_006: [ A segment holding `segmentMaxBytes` bytes shall take no more records, the next record shall start a new segment. ]*/
+                (void)fclose(log->writer);
+                log->writer = NULL;
+            }
+        }
+
+        if (
+            (log->writer == NULL) &&
+            (SEGMENT_LOG_start_segment(log) != 0)
+            )
+        {
+            LogError("unable to start a segment");
+            result = __LINE__;
+        }
+        else
+        {
+            SEGMENT* newest = (SEGMENT*)VECTOR_back(log->segments);
+            unsigned char header[RECORD_HEADER_SIZE];
+            time_t now = time(NULL);
+            SegmentFile_PutHeader(header, RECORD_MAGIC, (uint32_t)size);
+            SegmentFile_PutUint64(header + RECORD_SEQUENCE_OFFSET, log->nextSequence);
+            SegmentFile_PutUint64(header + RECORD_TIME_OFFSET, (uint64_t)now);
+            /*Codes_SRS_SEGMENT_LOG_31_005: [ `SegmentLog_Append` shall write the record after a header holding its size, its sequence number and the time, and flush it, before returning 0. ]*/
+            if (
+                (fwrite(header, 1, RECORD_HEADER_SIZE, log->writer) != RECORD_HEADER_SIZE) ||
+                ((size != 0) && (fwrite(record, 1, size, log->writer) != size)) ||
+                (fflush(log->writer) != 0)
+                )
+            {
+                /*what was written is past the end of the segment, it is never read, the next record goes to a new segment*/
+                LogError("unable to write a record to %s", STRING_c_str(log->prefix));
+                (void)fclose(log->writer);
+                log->writer = NULL;
+                result = __LINE__;
+            }
+            else
+            {
+                newest->lastSequence = log->nextSequence++;
+                newest->bytes += recordBytes;
+                newest->newest = now;
+                log->totalBytes += recordBytes;
+                log->counters.appended++;
+                log->counters.pending++;
+
+                /*Codes_SRS_SEGMENT_LOG_31_007: [ Beyond `maxBytes`, `SegmentLog_Append` shall delete the oldest segments, counting their records not acknowledged as dropped. ]*/
+                while (
+                    (log->maxBytes != 0) &&
+                    (log->totalBytes > log->maxBytes) &&
+                    (VECTOR_size(log->segments) > 1)
+                    )
+                {
+                    SEGMENT_LOG_drop_oldest(log);
+                }
+                result = 0;
+            }
+        }
+    }
+    return result;
+}
+
+/*opens the segment holding readSequence, at that record*/
+static int SEGMENT_LOG_position_reader(SEGMENT_LOG* log)
+{
+    int result;
+    size_t count = VECTOR_size(log->segments);
+    SEGMENT* segment = NULL;
+    for (size_t i = 0; i < count; i++)
+    {
+        SEGMENT* candidate = (SEGMENT*)VECTOR_element(log->segments, i);
+        if (
+            (candidate->firstSequence <= log->readSequence) &&
+            (log->readSequence <= candidate->lastSequence)
+            )
+        {
+            segment = candidate;
+            break;
+        }
+    }
+
+    if (segment == NULL)
+    {
+        LogError("no segment of %s holds record %llu", STRING_c_str(log->prefix), (unsigned long long)log->readSequence);
+        result = __LINE__;
+    }
+    else if (
+        (log->reader != NULL) &&
+        (log->readerNumber == segment->number) &&
+        (log->readerSequence == log->readSequence)
+        )
+    {
+        /*seeking drops what the reader buffered before the writer appended*/
+        result = (fseek(log->reader, log->readerOffset, SEEK_SET) == 0) ? 0 : __LINE__;
+    }
+    else
+    {
+        STRING_HANDLE path = SEGMENT_LOG_segment_path(log, segment->number);
+        if (log->reader != NULL)
+        {
+            (void)fclose(log->reader);
+            log->reader = NULL;
+        }
+
+        if (path == NULL)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            if ((log->reader = fopen(STRING_c_str(path), "rb")) == NULL)
+            {
+                LogError("unable to open %s", STRING_c_str(path));
+                result = __LINE__;
+            }
+            else
+            {
+                unsigned char header[RECORD_HEADER_SIZE];
+                log->readerNumber = segment->number;
+                log->readerSequence = segment->firstSequence;
+                log->readerOffset = 0;
+                result = 0;
+                while (log->readerSequence < log->readSequence)
+                {
+                    uint32_t size;
+                    if (
+                        (fread(header, 1, RECORD_HEADER_SIZE, log->reader) != RECORD_HEADER_SIZE) ||
+                        (fseek(log->reader, (long)(size = SegmentFile_GetUint32(header + SEGMENT_FILE_SIZE_OFFSET)), SEEK_CUR) != 0)
+                        )
+                    {
+                        LogError("unable to skip to record %llu in %s", (unsigned long long)log->readSequence, STRING_c_str(path));
+                        (void)fclose(log->reader);
+                        log->reader = NULL;
+                        result = __LINE__;
+                        break;
+                    }
+                    log->readerOffset += RECORD_HEADER_SIZE + (long)size;
+                    log->readerSequence++;
+                }
+            }
+            STRING_delete(path);
+        }
+    }
+    return result;
+}
+
+static int SEGMENT_LOG_read_record(SEGMENT_LOG* log)
+{
+    int result;
+    unsigned char header[RECORD_HEADER_SIZE];
+    if (
+        (fread(header, 1, RECORD_HEADER_SIZE, log->reader) != RECORD_HEADER_SIZE) ||
+        (memcmp(header, RECORD_MAGIC, SEGMENT_FILE_MAGIC_SIZE) != 0) ||
+        (SegmentFile_GetUint64(header + RECORD_SEQUENCE_OFFSET) != log->readerSequence)
+        )
+    {
+        LogError("record %llu of %s is damaged", (unsigned long long)log->readerSequence, STRING_c_str(log->prefix));
+        result = __LINE__;
+    }
+    else
+    {
+        uint32_t size = SegmentFile_GetUint32(header + SEGMENT_FILE_SIZE_OFFSET);
+        /*an empty record is read into a buffer as well, a NULL record means there is nothing to read*/
+        size_t needed = (size == 0) ? 1 : size;
+        if (needed > log->bufferSize)
+        {
+            unsigned char* buffer = (unsigned char*)realloc(log->buffer, needed);
+            if (buffer == NULL)
+            {
+                LogError("unable to realloc");
+                needed = 0;
+            }
+            else
+            {
+                log->buffer = buffer;
+                log->bufferSize = needed;
+            }
+        }
+
+        if (needed == 0)
+        {
+            result = __LINE__;
+        }
+        else if (fread(log->buffer, 1, size, log->reader) != size)
+        {
+            LogError("record %llu of %s is cut short", (unsigned long long)log->readerSequence, STRING_c_str(log->prefix));
+            result = __LINE__;
+        }
+        else
+        {
+            log->bufferUsed = size;
+            log->readerOffset += RECORD_HEADER_SIZE + (long)size;
+            log->readerSequence++;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+int SegmentLog_Read(SEGMENT_LOG_HANDLE log, const unsigned char** record, size_t* size, uint64_t* sequence)
+{
+    int result;
+    if (
+        (log == NULL) ||
+        (record == NULL) ||
+        (size == NULL) ||
+        (sequence == NULL)
+        )
+    {
+        /*Codes_SRS_SEGMENT_LOG_31_008: [ If `log`, `record`, `size` or `sequence` is NULL then `SegmentLog_Read` shall fail and return a non-zero value. ]*/
+        LogError("invalid arg log=%p, record=%p, size=%p, sequence=%p", log, record, size, sequence);
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_SEGMENT_LOG_31_009: [ `SegmentLog_Read` shall return the next record in the order they were appended, or set `*record` to NULL when every record is read or `SEGMENT_LOG_MAX_IN_FLIGHT` records are read and not acknowledged. ]*/
+        result = 0;
+        *record = NULL;
+        while (
+            (result == 0) &&
+            (*record == NULL) &&
+            (log->readSequence < log->nextSequence) &&
+            (log->readSequence - log->ackedThrough <= SEGMENT_LOG_MAX_IN_FLIGHT)
+            )
+        {
+            if (
+                (SEGMENT_LOG_position_reader(log) != 0) ||
+                (SEGMENT_LOG_read_record(log) != 0)
+                )
+            {
+                SEGMENT* oldest = (SEGMENT*)VECTOR_front(log->segments);
+                if (
+                    (oldest != NULL) &&
+                    (oldest->firstSequence <= log->readSequence) &&
+                    (log->readSequence <= oldest->lastSequence)
+                    )
+                {
+                    /*the records of an unreadable segment would never be acknowledged*/
+                    LogError("segment %llu of %s cannot be read, it is dropped", (unsigned long long)oldest->number, STRING_c_str(log->prefix));
+                    SEGMENT_LOG_drop_oldest(log);
+                }
+                result = __LINE__;
+            }
+            else
+            {
+                uint64_t read = log->readSequence++;
+                if ((log->ackedAbove & ((uint64_t)1 << (read - log->ackedThrough - 1))) != 0)
+                {
+                    /*Codes_SRS_SEGMENT_LOG_31_010: [ `SegmentLog_Read` shall skip the records acknowledged since they were last read. ]*/
+                }
+                else
+                {
+                    *record = log->buffer;
+                    *size = log->bufferUsed;
+                    *sequence = read;
+                }
+            }
+        }
+    }
+    return result;
+}
+
+int SegmentLog_Acknowledge(SEGMENT_LOG_HANDLE log, uint64_t sequence)
+{
+    int result;
+    if (log == NULL)
+    {
+        LogError("invalid arg log=NULL");
+        result = __LINE__;
+    }
+    else if (sequence <= log->ackedThrough)
+    {
+        /*acknowledged already, or dropped*/
+        result = 0;
+    }
+    else if (
+        (sequence >= log->nextSequence) ||
+        (sequence - log->ackedThrough > SEGMENT_LOG_MAX_IN_FLIGHT)
+        )
+    {
+        /*Codes_SRS_SEGMENT_LOG_31_012: [ If the record `sequence` was not read then `SegmentLog_Acknowledge` shall fail and return a non-zero value. ]*/
+        LogError("record %llu of %s was not read", (unsigned long long)sequence, STRING_c_str(log->prefix));
+        result = __LINE__;
+    }
+    else
+    {
+        uint64_t bit = (uint64_t)1 << (sequence - log->ackedThrough - 1);
+        if ((log->ackedAbove & bit) == 0)
+        {
+            log->ackedAbove |= bit;
+            log->counters.acknowledged++;
+            log->counters.pending--;
+        }
+
+        while ((log->ackedAbove & 1) != 0)
+        {
+            log->ackedAbove >>= 1;
+            log->ackedThrough++;
+        }
+
+        if (log->readSequence <= log->ackedThrough)
+        {
+            log->readSequence = log->ackedThrough + 1;
+        }
+
+        /*Codes_SRS_SEGMENT_LOG_31_011: [ `SegmentLog_Acknowledge` shall delete the segments whose records are all acknowledged, but the one records are appended to. ]*/
+        while (VECTOR_size(log->segments) != 0)
+        {
+            SEGMENT* oldest = (SEGMENT*)VECTOR_front(log->segments);
+            if (
+                (oldest->lastSequence > log->ackedThrough) ||
+                ((log->writer != NULL) && (VECTOR_size(log->segments) == 1))
+                )
+            {
+                break;
+            }
+            SEGMENT_LOG_delete_oldest(log);
+        }
+        result = 0;
+    }
+    return result;
+}
+
+void SegmentLog_Rewind(SEGMENT_LOG_HANDLE log)
+{
+    if (log == NULL)
+    {
+        LogError("invalid arg log=NULL");
+    }
+    else
+    {
+        /*Codes_SRS_SEGMENT_LOG_31_013: [ After `SegmentLog_Rewind`, `SegmentLog_Read` shall return the oldest record not acknowledged. ]*/
+        log->readSequence = log->ackedThrough + 1;
+    }
+}
+
+void SegmentLog_Expire(SEGMENT_LOG_HANDLE log)
+{
+    if (log == NULL)
+    {
+        LogError("invalid arg log=NULL");
+    }
+    else if (log->retentionSeconds != 0)
+    {
+        /*Codes_SRS_SEGMENT_LOG_31_014: [ `SegmentLog_Expire` shall delete the oldest segments whose newest record is older than `retentionSeconds`, counting their records not acknowledged as dropped. ]*/
+        time_t now = time(NULL);
+        while (
+            (VECTOR_size(log->segments) != 0) &&
+            (difftime(now, ((SEGMENT*)VECTOR_front(log->segments))->newest) > (double)log->retentionSeconds)
+            )
+        {
+            SEGMENT_LOG_drop_oldest(log);
+        }
+    }
+}
+
+int SegmentLog_GetCounters(SEGMENT_LOG_HANDLE log, SEGMENT_LOG_COUNTERS* counters)
+{
+    int result;
+    if (
+        (log == NULL) ||
+        (counters == NULL)
+        )
+    {
+        LogError("invalid arg log=%p, counters=%p", log, counters);
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_SEGMENT_LOG_31_017: [ `SegmentLog_GetCounters` shall copy the counters of the log and the bytes of its segments into `counters` and return 0. ]*/
+        *counters = log->counters;
+        counters->bytes = log->totalBytes;
+        result = 0;
+    }
+    return result;
+}
@@ -0,0 +1,307 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef WIN32
+#include <direct.h>
+#define make_directory(path) _mkdir(path)
+#define remove_directory(path) _rmdir(path)
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#define make_directory(path) mkdir(path, 0700)
+#define remove_directory(path) rmdir(path)
+#endif
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/map.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/tickcounter.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "module.h"
+#include "message.h"
+#include "broker.h"
+#include "iothub.h"
+#include "stub_protocol.h"
+
+#include "testrunnerswitcher.h"
+
+#define SCALING_SLOWDOWN_FACTOR 4
+#define SCALING_MIN_US_PER_MESSAGE 10
+#define EVICTION_MAX_PERSONALITIES 50
+#define EVICTION_DEVICE_COUNT 500
+#define POOL_SIZE 4
+#define POOL_DEVICE_COUNT 400
+/*a device name hash spreading devices evenly fills no transport past twice its share*/
+#define POOL_MAX_IMBALANCE 2
+#define DEVICE_NAME_SIZE 32
+#define STORE_DIRECTORY "iothub_benchmark_store"
+#define STORE_DEVICE_COUNT 10
+#define STORE_ROUNDS 20
+#define STORE_OUTAGE_MILLISECONDS 2000
+#define STORE_POLL_MILLISECONDS 100
+/*once the hub is back every stored message shall be delivered within this time*/
+#define STORE_RECOVERY_MAX_MILLISECONDS 30000
+
+//=============================================================================
+//Globals
+//=============================================================================
+
+#ifdef WIN32
+static TEST_MUTEX_HANDLE g_dllByDll;
+#endif
+static TEST_MUTEX_HANDLE g_testByTest;
+
+/* Creates the message the mapping module would publish for deviceName. */
+static MESSAGE_HANDLE create_mapped_message(const char* deviceName)
+{
+        static const unsigned char content[] = "{\"temperature\":21}";
+        MAP_HANDLE properties = Map_Create(NULL);
+        ASSERT_IS_NOT_NULL(properties);
+        ASSERT_ARE_EQUAL(int, MAP_OK, Map_Add(properties, "source", "mapping"));
+        ASSERT_ARE_EQUAL(int, MAP_OK, Map_Add(properties, "deviceName", deviceName));
+        ASSERT_ARE_EQUAL(int, MAP_OK, Map_Add(properties, "deviceKey", "aGVsbG8gd29ybGQ="));
+
+        MESSAGE_CONFIG config;
+        config.size = sizeof(content) - 1;
+        config.source = content;
+        config.sourceProperties = properties;
+        MESSAGE_HANDLE result = Message_Create(&config);
+        ASSERT_IS_NOT_NULL(result);
+
+        Map_Destroy(properties);
+        return result;
+}
+
+/* Sends one message per device to the module, rounds times, and returns the time per message in microseconds. */
+static unsigned long send_round_robin(TICK_COUNTER_HANDLE tick_counter, const MODULE_API_1* api, MODULE_HANDLE module, MESSAGE_HANDLE* messages, int device_count, int rounds)
+{
+        tickcounter_ms_t started;
+        tickcounter_ms_t finished;
+        (void)tickcounter_get_current_ms(tick_counter, &started);
+        for (int round = 0; round < rounds; round++)
+        {
+            for (int device = 0; device < device_count; device++)
+            {
+                api->Module_Receive(module, messages[device]);
+            }
+        }
+        (void)tickcounter_get_current_ms(tick_counter, &finished);
+        return (unsigned long)((finished - started) * 1000 / (device_count * rounds));
+}
+
+static MESSAGE_HANDLE* create_device_messages(int device_count)
+{
+        MESSAGE_HANDLE* messages = (MESSAGE_HANDLE*)malloc(device_count * sizeof(MESSAGE_HANDLE));
+        ASSERT_IS_NOT_NULL(messages);
+        for (int device = 0; device < device_count; device++)
+        {
+            char deviceName[DEVICE_NAME_SIZE];
+            (void)sprintf(deviceName, "device%d", device);
+            messages[device] = create_mapped_message(deviceName);
+        }
+        return messages;
+}
+
+static void destroy_device_messages(MESSAGE_HANDLE* messages, int device_count)
+{
+        for (int device = 0; device < device_count; device++)
+        {
+            Message_Destroy(messages[device]);
+        }
+        free(messages);
+}
+
+/* Sends two rounds of messages from device_count devices and returns the time per message of the second, when every personality exists. */
+static unsigned long measure_known_devices(TICK_COUNTER_HANDLE tick_counter, BROKER_HANDLE broker, int device_count)
+{
+        const MODULE_API_1* api = (const MODULE_API_1*)MODULE_STATIC_GETAPI(IOTHUB_MODULE)(MODULE_API_VERSION_1);
+        IOTHUB_CONFIG config = { "benchmark", "azure-devices.net", Stub_Protocol, 0 };
+        MODULE_HANDLE module = api->Module_Create(broker, &config);
+        ASSERT_IS_NOT_NULL(module);
+
+        MESSAGE_HANDLE* messages = create_device_messages(device_count);
+
+        /* the first round creates the personalities */
+        (void)send_round_robin(tick_counter, api, module, messages, device_count, 1);
+        unsigned long us_per_message = send_round_robin(tick_counter, api, module, messages, device_count, 1);
+        LogInfo("IotHub module with %d devices: %lu us per message", device_count, us_per_message);
+
+        api->Module_Destroy(module);
+        destroy_device_messages(messages, device_count);
+
+        return us_per_message;
+}
+
+BEGIN_TEST_SUITE(iothub_benchmark)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    Stub_Protocol_Deinit();
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest) != 0)
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+    Stub_Protocol_Reset();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+TEST_FUNCTION(IotHub_benchmark_device_count_scaling)
+{
+        ///arrange
+        const int device_counts[] = { 50, 100, 200, 400 };
+        const int size_count = sizeof(device_counts) / sizeof(device_counts[0]);
+        unsigned long us_per_message[sizeof(device_counts) / sizeof(device_counts[0])];
+
+        TICK_COUNTER_HANDLE tick_counter = tickcounter_create();
+        ASSERT_IS_NOT_NULL(tick_counter);
+        BROKER_HANDLE broker = Broker_Create();
+        ASSERT_IS_NOT_NULL(broker);
+
+        ///act
+        for (int size = 0; size < size_count; size++)
+        {
+            us_per_message[size] = measure_known_devices(tick_counter, broker, device_counts[size]);
+        }
+
+        ///assert
+        /* finding a device shall not slow down with the number of devices, below the tick resolution it is noise */
+        unsigned long smallest = us_per_message[0] > SCALING_MIN_US_PER_MESSAGE ? us_per_message[0] : SCALING_MIN_US_PER_MESSAGE;
+        ASSERT_IS_TRUE(us_per_message[size_count - 1] <= SCALING_SLOWDOWN_FACTOR * smallest);
+
+        Broker_Destroy(broker);
+        tickcounter_destroy(tick_counter);
+}
+
+TEST_FUNCTION(IotHub_benchmark_evicts_beyond_MaxPersonalities)
+{
+        ///arrange
+        TICK_COUNTER_HANDLE tick_counter = tickcounter_create();
+        ASSERT_IS_NOT_NULL(tick_counter);
+        BROKER_HANDLE broker = Broker_Create();
+        ASSERT_IS_NOT_NULL(broker);
+
+        const MODULE_API_1* api = (const MODULE_API_1*)MODULE_STATIC_GETAPI(IOTHUB_MODULE)(MODULE_API_VERSION_1);
+        IOTHUB_CONFIG config = { "benchmark", "azure-devices.net", Stub_Protocol, EVICTION_MAX_PERSONALITIES };
+        MODULE_HANDLE module = api->Module_Create(broker, &config);
+        ASSERT_IS_NOT_NULL(module);
+
+        MESSAGE_HANDLE* messages = create_device_messages(EVICTION_DEVICE_COUNT);
+
+        ///act
+        unsigned long us_per_message = send_round_robin(tick_counter, api, module, messages, EVICTION_DEVICE_COUNT, 2);
+        LogInfo("IotHub module with %d devices and %d personalities: %lu us per message, %lu clients at most",
+            EVICTION_DEVICE_COUNT, EVICTION_MAX_PERSONALITIES, us_per_message, (unsigned long)Stub_Protocol_GetMaxRegistered());
+
+        ///assert
+        ASSERT_IS_TRUE(Stub_Protocol_GetMaxRegistered() <= EVICTION_MAX_PERSONALITIES);
+
+        ///cleanup
+        api->Module_Destroy(module);
+        destroy_device_messages(messages, EVICTION_DEVICE_COUNT);
+        Broker_Destroy(broker);
+        tickcounter_destroy(tick_counter);
+}
+
+TEST_FUNCTION(IotHub_benchmark_spreads_devices_over_the_transport_pool)
+{
+        ///arrange
+        TICK_COUNTER_HANDLE tick_counter = tickcounter_create();
+        ASSERT_IS_NOT_NULL(tick_counter);
+        BROKER_HANDLE broker = Broker_Create();
+        ASSERT_IS_NOT_NULL(broker);
+
+        const MODULE_API_1* api = (const MODULE_API_1*)MODULE_STATIC_GETAPI(IOTHUB_MODULE)(MODULE_API_VERSION_1);
+        IOTHUB_CONFIG config = { "benchmark", "azure-devices.net", Stub_Protocol, 0 };
+        config.transportPoolSize = POOL_SIZE;
+        MODULE_HANDLE module = api->Module_Create(broker, &config);
+        ASSERT_IS_NOT_NULL(module);
+
+        MESSAGE_HANDLE* messages = create_device_messages(POOL_DEVICE_COUNT);
+
+        ///act
+        unsigned long us_per_message = send_round_robin(tick_counter, api, module, messages, POOL_DEVICE_COUNT, 2);
+        LogInfo("IotHub module with %d devices over %d transports: %lu us per message, %lu devices on the busiest transport",
+            POOL_DEVICE_COUNT, POOL_SIZE, us_per_message, (unsigned long)Stub_Protocol_GetMaxDevicesPerTransport());
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, POOL_SIZE, Stub_Protocol_GetTransportsCreated());
+        ASSERT_IS_TRUE(Stub_Protocol_GetMaxDevicesPerTransport() <= POOL_MAX_IMBALANCE * POOL_DEVICE_COUNT / POOL_SIZE);
+
+        ///cleanup
+        api->Module_Destroy(module);
+        destroy_device_messages(messages, POOL_DEVICE_COUNT);
+        Broker_Destroy(broker);
+        tickcounter_destroy(tick_counter);
+}
+
+TEST_FUNCTION(IotHub_benchmark_stores_messages_during_an_outage_and_delivers_them_after)
+{
+        ///arrange
+        TICK_COUNTER_HANDLE tick_counter = tickcounter_create();
+        ASSERT_IS_NOT_NULL(tick_counter);
+        BROKER_HANDLE broker = Broker_Create();
+        ASSERT_IS_NOT_NULL(broker);
+        (void)make_directory(STORE_DIRECTORY);
+
+        const MODULE_API_1* api = (const MODULE_API_1*)MODULE_STATIC_GETAPI(IOTHUB_MODULE)(MODULE_API_VERSION_1);
+        IOTHUB_CONFIG config = { "benchmark", "azure-devices.net", Stub_Protocol, 0 };
+        config.storeDirectory = STORE_DIRECTORY;
+        MODULE_HANDLE module = api->Module_Create(broker, &config);
+        ASSERT_IS_NOT_NULL(module);
+
+        MESSAGE_HANDLE* messages = create_device_messages(STORE_DEVICE_COUNT);
+        size_t sent = STORE_DEVICE_COUNT * STORE_ROUNDS;
+
+        ///act
+        Stub_Protocol_SetOutage(true);
+        unsigned long us_per_message = send_round_robin(tick_counter, api, module, messages, STORE_DEVICE_COUNT, STORE_ROUNDS);
+        ThreadAPI_Sleep(STORE_OUTAGE_MILLISECONDS);
+        size_t deliveredDuringOutage = Stub_Protocol_GetDelivered();
+
+        tickcounter_ms_t recovered;
+        tickcounter_ms_t now;
+        (void)tickcounter_get_current_ms(tick_counter, &recovered);
+        Stub_Protocol_SetOutage(false);
+        do
+        {
+            ThreadAPI_Sleep(STORE_POLL_MILLISECONDS);
+            (void)tickcounter_get_current_ms(tick_counter, &now);
+        } while ((Stub_Protocol_GetDelivered() < sent) && (now - recovered < STORE_RECOVERY_MAX_MILLISECONDS));
+        size_t delivered = Stub_Protocol_GetDelivered();
+        LogInfo("IotHub module storing %lu messages of %d devices: %lu us per message, all delivered %lu ms after the outage (%lu deliveries)",
+            (unsigned long)sent, STORE_DEVICE_COUNT, us_per_message, (unsigned long)(now - recovered), (unsigned long)delivered);
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, 0, deliveredDuringOutage);
+        /*a message confirmed while it was sent again is delivered twice*/
+        ASSERT_IS_TRUE(delivered >= sent);
+
+        ///cleanup
+        api->Module_Destroy(module);
+        destroy_device_messages(messages, STORE_DEVICE_COUNT);
+        /*the stores of devices whose messages are all delivered leave no file behind*/
+        (void)remove_directory(STORE_DIRECTORY);
+        Broker_Destroy(broker);
+        tickcounter_destroy(tick_counter);
+}
+
+END_TEST_SUITE(iothub_benchmark);
@@ -0,0 +1,306 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/strings.h"
+#include "azure_c_shared_utility/doublylinkedlist.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#include <iothub_transport_ll.h>
+#include <iothub_client_private.h>
+
+#include "stub_protocol.h"
+
+/*a transport carries the devices registered with it, one when it is created for a single client, many when it is shared*/
+typedef struct STUB_TRANSPORT_TAG
+{
+    STRING_HANDLE hostname;
+    DLIST_ENTRY devices;
+    size_t deviceCount;
+} STUB_TRANSPORT;
+
+typedef struct STUB_DEVICE_TAG
+{
+    DLIST_ENTRY entry; /*first, a list entry is the device*/
+    STUB_TRANSPORT* transport;
+    IOTHUB_CLIENT_LL_HANDLE client;
+    PDLIST_ENTRY waitingToSend;
+} STUB_DEVICE;
+
+/*clients register and unregister on the thread creating and destroying them, the gateway module thread*/
+static size_t registered;
+static size_t maxRegistered;
+static size_t transportsCreated;
+static size_t maxDevicesPerTransport;
+
+/*events are completed on the threads of the clients*/
+static LOCK_HANDLE completionLock;
+static bool outage;
+static size_t delivered;
+
+static TRANSPORT_LL_HANDLE StubTransport_Create(const IOTHUBTRANSPORT_CONFIG* config)
+{
+    STUB_TRANSPORT* result = (STUB_TRANSPORT*)malloc(sizeof(STUB_TRANSPORT));
+    if (result == NULL)
+    {
+        LogError("unable to allocate a stub transport");
+    }
+    else if ((result->hostname = STRING_construct_sprintf("%s.%s", config->upperConfig->iotHubName, config->upperConfig->iotHubSuffix)) == NULL)
+    {
+        LogError("unable to construct the host name");
+        free(result);
+        result = NULL;
+    }
+    else
+    {
+        DList_InitializeListHead(&result->devices);
+        result->deviceCount = 0;
+        transportsCreated++;
+    }
+    return result;
+}
+
+static void StubTransport_Destroy(TRANSPORT_LL_HANDLE handle)
+{
+    STUB_TRANSPORT* transport = (STUB_TRANSPORT*)handle;
+    /*devices left registered belong to the transport*/
+    while (!DList_IsListEmpty(&transport->devices))
+    {
+        PDLIST_ENTRY entry = DList_RemoveHeadList(&transport->devices);
+        free((STUB_DEVICE*)entry);
+        registered--;
+    }
+    STRING_delete(transport->hostname);
+    free(transport);
+}
+
+static STRING_HANDLE StubTransport_GetHostname(TRANSPORT_LL_HANDLE handle)
+{
+    return ((STUB_TRANSPORT*)handle)->hostname;
+}
+
+static IOTHUB_CLIENT_RESULT StubTransport_SetOption(TRANSPORT_LL_HANDLE handle, const char* optionName, const void* value)
+{
+    (void)handle;
+    (void)optionName;
+    (void)value;
+    return IOTHUB_CLIENT_OK;
+}
+
+static IOTHUB_DEVICE_HANDLE StubTransport_Register(TRANSPORT_LL_HANDLE handle, const IOTHUB_DEVICE_CONFIG* device, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, PDLIST_ENTRY waitingToSend)
+{
+    STUB_TRANSPORT* transport = (STUB_TRANSPORT*)handle;
+    STUB_DEVICE* result = (STUB_DEVICE*)malloc(sizeof(STUB_DEVICE));
+    (void)device;
+    if (result == NULL)
+    {
+        LogError("unable to allocate a stub device");
+    }
+    else
+    {
+        result->transport = transport;
+        result->client = iotHubClientHandle;
+        result->waitingToSend = waitingToSend;
+        DList_InsertTailList(&transport->devices, &result->entry);
+        if (++transport->deviceCount > maxDevicesPerTransport)
+        {
+            maxDevicesPerTransport = transport->deviceCount;
+        }
+        if (++registered > maxRegistered)
+        {
+            maxRegistered = registered;
+        }
+    }
+    return (IOTHUB_DEVICE_HANDLE)result;
+}
+
+static void StubTransport_Unregister(IOTHUB_DEVICE_HANDLE deviceHandle)
+{
+    STUB_DEVICE* device = (STUB_DEVICE*)deviceHandle;
+    (void)DList_RemoveEntryList(&device->entry);
+    device->transport->deviceCount--;
+    free(device);
+    registered--;
+}
+
+static int StubTransport_Subscribe(IOTHUB_DEVICE_HANDLE handle)
+{
+    (void)handle;
+    return 0;
+}
+
+static void StubTransport_Unsubscribe(IOTHUB_DEVICE_HANDLE handle)
+{
+    (void)handle;
+}
+
+static int StubTransport_DeviceMethod_Response(IOTHUB_DEVICE_HANDLE handle, METHOD_HANDLE methodId, const unsigned char* response, size_t response_size, int status_response)
+{
+    (void)handle;
+    (void)methodId;
+    (void)response;
+    (void)response_size;
+    (void)status_response;
+    return __LINE__;
+}
+
+static IOTHUB_PROCESS_ITEM_RESULT StubTransport_ProcessItem(TRANSPORT_LL_HANDLE handle, IOTHUB_IDENTITY_TYPE item_type, IOTHUB_IDENTITY_INFO* iothub_item)
+{
+    (void)handle;
+    (void)item_type;
+    (void)iothub_item;
+    return IOTHUB_PROCESS_ERROR;
+}
+
+/*a shared transport is given no client, the events of every device registered with it are completed with their own client*/
+static void StubTransport_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
+{
+    STUB_TRANSPORT* transport = (STUB_TRANSPORT*)handle;
+    PDLIST_ENTRY entry = transport->devices.Flink;
+    (void)iotHubClientHandle;
+    while (entry != &transport->devices)
+    {
+        STUB_DEVICE* device = (STUB_DEVICE*)entry;
+        if ((device->waitingToSend != NULL) && !DList_IsListEmpty(device->waitingToSend))
+        {
+            /*every waiting event is sent at once*/
+            DLIST_ENTRY sent;
+            size_t count = 0;
+            bool failing;
+            DList_InitializeListHead(&sent);
+            while (!DList_IsListEmpty(device->waitingToSend))
+            {
+                DList_InsertTailList(&sent, DList_RemoveHeadList(device->waitingToSend));
+                count++;
+            }
+
+            if (Lock(completionLock) != LOCK_OK)
+            {
+                LogError("unable to lock");
+                failing = true;
+            }
+            else
+            {
+                failing = outage;
+                if (!failing)
+                {
+                    delivered += count;
+                }
+                (void)Unlock(completionLock);
+            }
+            IoTHubClient_LL_SendComplete(device->client, &sent, failing ? IOTHUB_CLIENT_CONFIRMATION_ERROR : IOTHUB_CLIENT_CONFIRMATION_OK);
+        }
+        entry = entry->Flink;
+    }
+}
+
+static int StubTransport_SetRetryPolicy(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_RETRY_POLICY retryPolicy, size_t retryTimeoutLimitInSeconds)
+{
+    (void)handle;
+    (void)retryPolicy;
+    (void)retryTimeoutLimitInSeconds;
+    return 0;
+}
+
+static IOTHUB_CLIENT_RESULT StubTransport_GetSendStatus(IOTHUB_DEVICE_HANDLE handle, IOTHUB_CLIENT_STATUS* iotHubClientStatus)
+{
+    STUB_DEVICE* device = (STUB_DEVICE*)handle;
+    *iotHubClientStatus = ((device->waitingToSend == NULL) || DList_IsListEmpty(device->waitingToSend))
+        ? IOTHUB_CLIENT_SEND_STATUS_IDLE
+        : IOTHUB_CLIENT_SEND_STATUS_BUSY;
+    return IOTHUB_CLIENT_OK;
+}
+
+static const TRANSPORT_PROVIDER stubTransportProvider =
+{
+    .IoTHubTransport_Subscribe_DeviceMethod = StubTransport_Subscribe,
+    .IoTHubTransport_Unsubscribe_DeviceMethod = StubTransport_Unsubscribe,
+    .IoTHubTransport_DeviceMethod_Response = StubTransport_DeviceMethod_Response,
+    .IoTHubTransport_Subscribe_DeviceTwin = StubTransport_Subscribe,
+    .IoTHubTransport_Unsubscribe_DeviceTwin = StubTransport_Unsubscribe,
+    .IoTHubTransport_ProcessItem = StubTransport_ProcessItem,
+    .IoTHubTransport_GetHostname = StubTransport_GetHostname,
+    .IoTHubTransport_SetOption = StubTransport_SetOption,
+    .IoTHubTransport_Create = StubTransport_Create,
+    .IoTHubTransport_Destroy = StubTransport_Destroy,
+    .IoTHubTransport_Register = StubTransport_Register,
+    .IoTHubTransport_Unregister = StubTransport_Unregister,
+    .IoTHubTransport_Subscribe = StubTransport_Subscribe,
+    .IoTHubTransport_Unsubscribe = StubTransport_Unsubscribe,
+    .IoTHubTransport_DoWork = StubTransport_DoWork,
+    .IoTHubTransport_SetRetryPolicy = StubTransport_SetRetryPolicy,
+    .IoTHubTransport_GetSendStatus = StubTransport_GetSendStatus
+};
+
+const TRANSPORT_PROVIDER* Stub_Protocol(void)
+{
+    return &stubTransportProvider;
+}
+
+size_t Stub_Protocol_GetMaxRegistered(void)
+{
+    return maxRegistered;
+}
+
+size_t Stub_Protocol_GetTransportsCreated(void)
+{
+    return transportsCreated;
+}
+
+size_t Stub_Protocol_GetMaxDevicesPerTransport(void)
+{
+    return maxDevicesPerTransport;
+}
+
+void Stub_Protocol_SetOutage(bool failing)
+{
+    if (Lock(completionLock) != LOCK_OK)
+    {
+        LogError("unable to lock");
+    }
+    else
+    {
+        outage = failing;
+        (void)Unlock(completionLock);
+    }
+}
+
+size_t Stub_Protocol_GetDelivered(void)
+{
+    size_t result = 0;
+    if (Lock(completionLock) != LOCK_OK)
+    {
+        LogError("unable to lock");
+    }
+    else
+    {
+        result = delivered;
+        (void)Unlock(completionLock);
+    }
+    return result;
+}
+
+void Stub_Protocol_Reset(void)
+{
+    registered = 0;
+    maxRegistered = 0;
+    transportsCreated = 0;
+    maxDevicesPerTransport = 0;
+    if ((completionLock == NULL) && ((completionLock = Lock_Init()) == NULL))
+    {
+        LogError("unable to Lock_Init");
+    }
+    outage = false;
+    delivered = 0;
+}
+
+void Stub_Protocol_Deinit(void)
+{
+    if (completionLock != NULL)
+    {
+        (void)Lock_Deinit(completionLock);
+        completionLock = NULL;
+    }
+}
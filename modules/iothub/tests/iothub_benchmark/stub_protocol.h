@@ -0,0 +1,42 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef STUB_PROTOCOL_H
+#define STUB_PROTOCOL_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <iothub_transport_ll.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*a transport which completes every event it is given without a network, so the IotHub module can be measured without a hub*/
+const TRANSPORT_PROVIDER* Stub_Protocol(void);
+
+/*the most devices registered with the transport at once since the last reset*/
+size_t Stub_Protocol_GetMaxRegistered(void);
+
+/*the transports created since the last reset, one per client unless they are shared*/
+size_t Stub_Protocol_GetTransportsCreated(void);
+
+/*the most devices registered with one transport at once since the last reset*/
+size_t Stub_Protocol_GetMaxDevicesPerTransport(void);
+
+/*while there is an outage every event fails, as if the hub could not be reached*/
+void Stub_Protocol_SetOutage(bool failing);
+
+/*the events completed successfully since the last reset*/
+size_t Stub_Protocol_GetDelivered(void);
+
+void Stub_Protocol_Reset(void);
+
+void Stub_Protocol_Deinit(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // STUB_PROTOCOL_H
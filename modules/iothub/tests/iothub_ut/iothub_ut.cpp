@@ -3,6 +3,7 @@
 
 #include <cstdlib>
 #include <cstddef>
+#include <cstdio>
 #include "testrunnerswitcher.h"
 #include "micromock.h"
 #include "micromockcharstararenullterminatedstrings.h"
@@ -10,6 +11,9 @@
 #include "module.h"
 #include "module_access.h"
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/tickcounter.h"
 #include "azure_c_shared_utility/vector.h"
 #include "azure_c_shared_utility/vector_types_internal.h"
 #include "azure_c_shared_utility/strings.h"
@@ -50,6 +54,7 @@ namespace BASEIMPLEMENTATION
 #include "message.h"
 #include "azure_c_shared_utility/constmap.h"
 #include "azure_c_shared_utility/map.h"
+#include "segment_log.h"
 
 DEFINE_MICROMOCK_ENUM_TO_STRING(IOTHUBMESSAGE_DISPOSITION_RESULT, IOTHUBMESSAGE_DISPOSITION_RESULT_VALUES);
 
@@ -69,6 +74,49 @@ static size_t whenShallIoTHubMessage_CreateFromByteArray_fail;
 static size_t currentIoTHubClient_Create_call;
 static size_t whenShallIoTHubClient_Create_fail;
 
+static size_t currentLock_call;
+static size_t whenShallLock_fail;
+
+static tickcounter_ms_t currentTime;
+static THREAD_START_FUNC flushWorkerFunction;
+static void* flushWorkerArgument;
+
+/*the transport given to the last IoTHubClient_CreateWithTransport*/
+static TRANSPORT_HANDLE lastClientTransport;
+
+/*the confirmation asked for by the last IoTHubClient_SendEventAsync*/
+static IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK lastEventConfirmationCallback;
+static void* lastEventConfirmationContext;
+
+/*the confirmations IoTHubClient owes, IoTHubClient_Destroy completes those of its client as destroyed like IoTHubClient does*/
+#define MAX_PENDING_CONFIRMATIONS 256
+typedef struct PENDING_CONFIRMATION_TAG
+{
+    IOTHUB_CLIENT_HANDLE client;
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback;
+    void* context;
+}PENDING_CONFIRMATION;
+static PENDING_CONFIRMATION pendingConfirmations[MAX_PENDING_CONFIRMATIONS];
+static size_t pendingConfirmationCount;
+
+/*completes the confirmation asked for by the last IoTHubClient_SendEventAsync*/
+static void confirmLastEvent(IOTHUB_CLIENT_CONFIRMATION_RESULT result)
+{
+    pendingConfirmationCount--;
+    lastEventConfirmationCallback(result, lastEventConfirmationContext);
+}
+
+/*IoTHubClient did not take the last message, it owes no confirmation for it*/
+static void forgetLastEvent(void)
+{
+    pendingConfirmationCount--;
+}
+
+/*a record of a store holding the property "k" set to "v" and the content "x"*/
+static const unsigned char storedRecord[] = { 0, 0, 0, 1, 'k', '\0', 'v', '\0', 'x' };
+static size_t storedRecordsToRead;
+static uint64_t lastStoredSequence;
+
 static IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC IotHub_Receive_message_callback_function;
 static void * IotHub_Receive_message_userContext;
 static const char * IotHub_Receive_message_content;
@@ -81,6 +129,24 @@ typedef struct PERSONALITY_TAG
     IOTHUB_CLIENT_HANDLE iothubHandle;
     BROKER_HANDLE broker;
     MODULE_HANDLE module;
+    size_t hash;
+    size_t position;
+    struct PERSONALITY_TAG* newer;
+    struct PERSONALITY_TAG* older;
+    IOTHUB_MESSAGE_HANDLE* batch;
+    size_t batchCount;
+    size_t batchBytes;
+    tickcounter_ms_t batchStarted;
+    struct PERSONALITY_TAG* nextBatch;
+    struct PERSONALITY_TAG* previousBatch;
+    SEGMENT_LOG_HANDLE store;
+    size_t storeBudget;
+    bool storeConnected;
+    size_t inFlight;
+    bool windowStalled;
+    IOTHUB_MESSAGE_HANDLE* held;
+    size_t heldCount;
+    struct PERSONALITY_TAG* nextProvision;
 }PERSONALITY;
 
 typedef PERSONALITY* PERSONALITY_PTR;
@@ -91,8 +157,42 @@ typedef struct IOTHUB_HANDLE_DATA_TAG
     STRING_HANDLE IoTHubName;
     STRING_HANDLE IoTHubSuffix;
     IOTHUB_CLIENT_TRANSPORT_PROVIDER transportProvider;
-    TRANSPORT_HANDLE transportHandle;
+    TRANSPORT_HANDLE* transports;
+    size_t transportCount;
     BROKER_HANDLE broker;
+    PERSONALITY_PTR* personalityIndex;
+    size_t indexCapacity;
+    size_t indexCount;
+    size_t maxPersonalities;
+    PERSONALITY_PTR mostRecent;
+    PERSONALITY_PTR leastRecent;
+    size_t batchMaxMessages;
+    size_t batchMaxBytes;
+    unsigned int batchMaxMilliseconds;
+    TICK_COUNTER_HANDLE clock;
+    LOCK_HANDLE lock;
+    THREAD_HANDLE flushWorker;
+    bool stopping;
+    PERSONALITY_PTR oldestBatch;
+    PERSONALITY_PTR newestBatch;
+    IOTHUB_BATCH_COUNTERS batchCounters;
+    STRING_HANDLE storeDirectory;
+    size_t storeMaxBytes;
+    unsigned int storeRetentionSeconds;
+    size_t storeReplayRate;
+    THREAD_HANDLE replayWorker;
+    tickcounter_ms_t storeRefilled;
+    size_t maxInFlight;
+    LOCK_HANDLE confirmationLock;
+    COND_HANDLE windowOpened;
+    IOTHUB_SEND_COUNTERS sendCounters;
+    size_t provisioningQueueSize;
+    THREAD_HANDLE provisionWorker;
+    COND_HANDLE provisionRequested;
+    PERSONALITY_PTR oldestProvision;
+    PERSONALITY_PTR newestProvision;
+    PERSONALITY_PTR provisioning;
+    bool provisioningEvicted;
 }IOTHUB_HANDLE_DATA;
 
 // NOTE Each of these dummy transport provider functions have to do something a
@@ -145,6 +245,11 @@ static MAP_HANDLE MAP_HANDLE_VALID_2 = ((MAP_HANDLE)(7));
 static const char* CONSTMAP_KEYS_VALID_2[3] = { "source", "deviceName", "deviceKey"};
 static const char* CONSTMAP_VALUES_VALID_2[3] = { "mapping", "secondDevice", "red"};
 
+/*a message from the device named by deviceNameN, with the content of MESSAGE_HANDLE_VALID_2*/
+#define MESSAGE_HANDLE_VALID_N ((MESSAGE_HANDLE)(8))
+#define CONSTMAP_HANDLE_VALID_N ((CONSTMAP_HANDLE)(8))
+static char deviceNameN[32];
+
 /*these are simple cached variables*/
 static pfModule_ParseConfigurationFromJson Module_ParseConfigurationFromJson = NULL; /*gets assigned in TEST_SUITE_INITIALIZE*/
 static pfModule_FreeConfiguration Module_FreeConfiguration = NULL; /*gets assigned in TEST_SUITE_INITIALIZE*/
@@ -253,8 +358,9 @@ public:
     MOCK_STATIC_METHOD_2(, void*, VECTOR_element, VECTOR_HANDLE, handle, size_t, index)
     MOCK_METHOD_END(void*, BASEIMPLEMENTATION::VECTOR_element(handle, index))
 
-    MOCK_STATIC_METHOD_3(, void*, VECTOR_find_if, VECTOR_HANDLE, handle, PREDICATE_FUNCTION, pred, const void*, value)
-    MOCK_METHOD_END(void*, BASEIMPLEMENTATION::VECTOR_find_if(handle, pred, value))
+    MOCK_STATIC_METHOD_3(, void, VECTOR_erase, VECTOR_HANDLE, handle, void*, elements, size_t, numElements)
+        BASEIMPLEMENTATION::VECTOR_erase(handle, elements, numElements);
+    MOCK_VOID_METHOD_END()
 
     MOCK_STATIC_METHOD_1(, size_t, VECTOR_size, VECTOR_HANDLE, handle)
     MOCK_METHOD_END(size_t, BASEIMPLEMENTATION::VECTOR_size(handle))
@@ -309,6 +415,7 @@ public:
 
     MOCK_STATIC_METHOD_2(, IOTHUB_CLIENT_HANDLE, IoTHubClient_CreateWithTransport, TRANSPORT_HANDLE, transport, const IOTHUB_CLIENT_CONFIG*, config)
         IOTHUB_CLIENT_HANDLE result2;
+        lastClientTransport = transport;
         currentIoTHubClient_Create_call++;
         if (whenShallIoTHubClient_Create_fail == currentIoTHubClient_Create_call)
         {
@@ -325,6 +432,20 @@ public:
     MOCK_METHOD_END(IOTHUB_CLIENT_HANDLE, result2)
 
     MOCK_STATIC_METHOD_1(, void, IoTHubClient_Destroy, IOTHUB_CLIENT_HANDLE, iotHubClientHandle)
+        size_t kept = 0;
+        for (size_t i = 0; i < pendingConfirmationCount; i++)
+        {
+            PENDING_CONFIRMATION pending = pendingConfirmations[i];
+            if (pending.client == iotHubClientHandle)
+            {
+                pending.callback(IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, pending.context);
+            }
+            else
+            {
+                pendingConfirmations[kept++] = pending;
+            }
+        }
+        pendingConfirmationCount = kept;
         BASEIMPLEMENTATION::gballoc_free(iotHubClientHandle);
     MOCK_VOID_METHOD_END()
 
@@ -346,6 +467,10 @@ public:
         {
             result2 = CONSTMAP_HANDLE_VALID_2;
         }
+        else if (message == MESSAGE_HANDLE_VALID_N)
+        {
+            result2 = CONSTMAP_HANDLE_VALID_N;
+        }
         else
         {
             result2 = NULL;
@@ -395,6 +520,25 @@ public:
                 }
             }
         }
+        else if (handle == CONSTMAP_HANDLE_VALID_N)
+        {
+            if (strcmp(key, "source") == 0)
+            {
+                result2 = "mapping";
+            }
+            else if (strcmp(key, "deviceName") == 0)
+            {
+                result2 = deviceNameN;
+            }
+            else if (strcmp(key, "deviceKey") == 0)
+            {
+                result2 = "red";
+            }
+            else
+            {
+                result2 = NULL;
+            }
+        }
         else
         {
             result2 = NULL;
@@ -408,6 +552,16 @@ public:
     MOCK_METHOD_END(MAP_RESULT, MAP_OK)
 
     MOCK_STATIC_METHOD_4(, IOTHUB_CLIENT_RESULT, IoTHubClient_SendEventAsync, IOTHUB_CLIENT_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback)
+        lastEventConfirmationCallback = eventConfirmationCallback;
+        lastEventConfirmationContext = userContextCallback;
+        if (eventConfirmationCallback != NULL)
+        {
+            ASSERT_IS_TRUE(pendingConfirmationCount < MAX_PENDING_CONFIRMATIONS);
+            pendingConfirmations[pendingConfirmationCount].client = iotHubClientHandle;
+            pendingConfirmations[pendingConfirmationCount].callback = eventConfirmationCallback;
+            pendingConfirmations[pendingConfirmationCount].context = userContextCallback;
+            pendingConfirmationCount++;
+        }
     MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK)
 
     MOCK_STATIC_METHOD_3(, IOTHUB_CLIENT_RESULT, IoTHubClient_SetMessageCallback, IOTHUB_CLIENT_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC, messageCallback, void*, userContextCallback)
@@ -430,7 +584,10 @@ public:
         {
             result2 = CONSTBUFFER_VALID_1;
         }
-        else if (message == MESSAGE_HANDLE_VALID_2)
+        else if (
+            (message == MESSAGE_HANDLE_VALID_2) ||
+            (message == MESSAGE_HANDLE_VALID_N)
+            )
         {
             result2 = CONSTBUFFER_VALID_2;
         }
@@ -540,9 +697,129 @@ public:
         }
     MOCK_METHOD_END(const char*, result2);
 
+    MOCK_STATIC_METHOD_2(, double, json_object_get_number, const JSON_Object*, object, const char*, name)
+    MOCK_METHOD_END(double, 0);
+
     MOCK_STATIC_METHOD_1(, void, json_value_free, JSON_Value*, value)
         free(value);
     MOCK_VOID_METHOD_END();
+
+    // batching
+    MOCK_STATIC_METHOD_3(, IOTHUB_CLIENT_RESULT, IoTHubClient_SetOption, IOTHUB_CLIENT_HANDLE, iotHubClientHandle, const char*, optionName, const void*, value)
+    MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK)
+
+    MOCK_STATIC_METHOD_4(, MAP_RESULT, Map_GetInternals, MAP_HANDLE, handle, const char*const**, keys, const char*const**, values, size_t*, count)
+        if (handle == MAP_HANDLE_VALID_1)
+        {
+            *keys = CONSTMAP_KEYS_VALID_1;
+            *values = CONSTMAP_VALUES_VALID_1;
+            *count = 4;
+        }
+        else
+        {
+            *keys = NULL;
+            *values = NULL;
+            *count = 0;
+        }
+    MOCK_METHOD_END(MAP_RESULT, MAP_OK)
+
+    MOCK_STATIC_METHOD_0(, LOCK_HANDLE, Lock_Init)
+    MOCK_METHOD_END(LOCK_HANDLE, (LOCK_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1))
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Lock, LOCK_HANDLE, lock)
+        LOCK_RESULT result2;
+        ++currentLock_call;
+        if ((whenShallLock_fail > 0) &&
+            (currentLock_call == whenShallLock_fail))
+        {
+            result2 = LOCK_ERROR;
+        }
+        else
+        {
+            result2 = LOCK_OK;
+        }
+    MOCK_METHOD_END(LOCK_RESULT, result2)
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Unlock, LOCK_HANDLE, lock)
+    MOCK_METHOD_END(LOCK_RESULT, LOCK_OK)
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Lock_Deinit, LOCK_HANDLE, lock)
+        BASEIMPLEMENTATION::gballoc_free(lock);
+    MOCK_METHOD_END(LOCK_RESULT, LOCK_OK)
+
+    MOCK_STATIC_METHOD_0(, COND_HANDLE, Condition_Init)
+    MOCK_METHOD_END(COND_HANDLE, (COND_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1))
+
+    MOCK_STATIC_METHOD_1(, COND_RESULT, Condition_Post, COND_HANDLE, handle)
+    MOCK_METHOD_END(COND_RESULT, COND_OK)
+
+    /*nobody confirms a message while IotHub_Receive waits, the time goes by*/
+    MOCK_STATIC_METHOD_3(, COND_RESULT, Condition_Wait, COND_HANDLE, handle, LOCK_HANDLE, lock, int, timeout_milliseconds)
+        currentTime += timeout_milliseconds;
+    MOCK_METHOD_END(COND_RESULT, COND_TIMEOUT)
+
+    MOCK_STATIC_METHOD_1(, void, Condition_Deinit, COND_HANDLE, handle)
+        BASEIMPLEMENTATION::gballoc_free(handle);
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_3(, THREADAPI_RESULT, ThreadAPI_Create, THREAD_HANDLE*, threadHandle, THREAD_START_FUNC, func, void*, arg)
+        *threadHandle = (THREAD_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1);
+        flushWorkerFunction = func;
+        flushWorkerArgument = arg;
+    MOCK_METHOD_END(THREADAPI_RESULT, THREADAPI_OK)
+
+    MOCK_STATIC_METHOD_2(, THREADAPI_RESULT, ThreadAPI_Join, THREAD_HANDLE, threadHandle, int*, res)
+        BASEIMPLEMENTATION::gballoc_free(threadHandle);
+    MOCK_METHOD_END(THREADAPI_RESULT, THREADAPI_OK)
+
+    MOCK_STATIC_METHOD_1(, void, ThreadAPI_Sleep, unsigned int, milliseconds)
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_0(, TICK_COUNTER_HANDLE, tickcounter_create)
+    MOCK_METHOD_END(TICK_COUNTER_HANDLE, (TICK_COUNTER_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1))
+
+    MOCK_STATIC_METHOD_1(, void, tickcounter_destroy, TICK_COUNTER_HANDLE, tick_counter)
+        BASEIMPLEMENTATION::gballoc_free(tick_counter);
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_2(, int, tickcounter_get_current_ms, TICK_COUNTER_HANDLE, tick_counter, tickcounter_ms_t*, current_ms)
+        *current_ms = currentTime;
+    MOCK_METHOD_END(int, 0)
+
+    // store and forward
+    MOCK_STATIC_METHOD_1(, SEGMENT_LOG_HANDLE, SegmentLog_Open, const SEGMENT_LOG_CONFIG*, config)
+    MOCK_METHOD_END(SEGMENT_LOG_HANDLE, (SEGMENT_LOG_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1))
+
+    MOCK_STATIC_METHOD_1(, void, SegmentLog_Close, SEGMENT_LOG_HANDLE, log)
+        BASEIMPLEMENTATION::gballoc_free(log);
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_3(, int, SegmentLog_Append, SEGMENT_LOG_HANDLE, log, const unsigned char*, record, size_t, size)
+        storedRecordsToRead++;
+    MOCK_METHOD_END(int, 0)
+
+    MOCK_STATIC_METHOD_4(, int, SegmentLog_Read, SEGMENT_LOG_HANDLE, log, const unsigned char**, record, size_t*, size, uint64_t*, sequence)
+        if (storedRecordsToRead == 0)
+        {
+            *record = NULL;
+        }
+        else
+        {
+            storedRecordsToRead--;
+            *record = storedRecord;
+            *size = sizeof(storedRecord);
+            *sequence = ++lastStoredSequence;
+        }
+    MOCK_METHOD_END(int, 0)
+
+    MOCK_STATIC_METHOD_2(, int, SegmentLog_Acknowledge, SEGMENT_LOG_HANDLE, log, uint64_t, sequence)
+    MOCK_METHOD_END(int, 0)
+
+    MOCK_STATIC_METHOD_1(, void, SegmentLog_Rewind, SEGMENT_LOG_HANDLE, log)
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_1(, void, SegmentLog_Expire, SEGMENT_LOG_HANDLE, log)
+    MOCK_VOID_METHOD_END()
 };
 
 DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , void*, gballoc_malloc, size_t, size);
@@ -552,7 +829,7 @@ DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , void, ConstMap_Destroy, CONSTMAP_HAN
 DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , VECTOR_HANDLE, VECTOR_create, size_t, elementSize)
 DECLARE_GLOBAL_MOCK_METHOD_3(IotHubMocks, , int, VECTOR_push_back, VECTOR_HANDLE, handle, const void*, elements, size_t, numElements)
 DECLARE_GLOBAL_MOCK_METHOD_2(IotHubMocks, , void*, VECTOR_element, VECTOR_HANDLE, handle, size_t, index)
-DECLARE_GLOBAL_MOCK_METHOD_3(IotHubMocks, , void*, VECTOR_find_if, VECTOR_HANDLE, handle, PREDICATE_FUNCTION, pred, const void*, value)
+DECLARE_GLOBAL_MOCK_METHOD_3(IotHubMocks, , void, VECTOR_erase, VECTOR_HANDLE, handle, void*, elements, size_t, numElements)
 DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , size_t, VECTOR_size, VECTOR_HANDLE, handle)
 DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , void, VECTOR_destroy, VECTOR_HANDLE, handle)
 DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , void, STRING_delete, STRING_HANDLE, s);
@@ -587,7 +864,31 @@ DECLARE_GLOBAL_MOCK_METHOD_3(IotHubMocks, , BROKER_RESULT, Broker_Publish, BROKE
 DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , JSON_Value*, json_parse_string, const char *, filename);
 DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , JSON_Object*, json_value_get_object, const JSON_Value*, value);
 DECLARE_GLOBAL_MOCK_METHOD_2(IotHubMocks, , const char*, json_object_get_string, const JSON_Object*, object, const char*, name);
+DECLARE_GLOBAL_MOCK_METHOD_2(IotHubMocks, , double, json_object_get_number, const JSON_Object*, object, const char*, name);
 DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , void, json_value_free, JSON_Value*, value);
+DECLARE_GLOBAL_MOCK_METHOD_3(IotHubMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_SetOption, IOTHUB_CLIENT_HANDLE, iotHubClientHandle, const char*, optionName, const void*, value);
+DECLARE_GLOBAL_MOCK_METHOD_4(IotHubMocks, , MAP_RESULT, Map_GetInternals, MAP_HANDLE, handle, const char*const**, keys, const char*const**, values, size_t*, count);
+DECLARE_GLOBAL_MOCK_METHOD_0(IotHubMocks, , LOCK_HANDLE, Lock_Init);
+DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , LOCK_RESULT, Lock, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , LOCK_RESULT, Unlock, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , LOCK_RESULT, Lock_Deinit, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_0(IotHubMocks, , COND_HANDLE, Condition_Init);
+DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , COND_RESULT, Condition_Post, COND_HANDLE, handle);
+DECLARE_GLOBAL_MOCK_METHOD_3(IotHubMocks, , COND_RESULT, Condition_Wait, COND_HANDLE, handle, LOCK_HANDLE, lock, int, timeout_milliseconds);
+DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , void, Condition_Deinit, COND_HANDLE, handle);
+DECLARE_GLOBAL_MOCK_METHOD_3(IotHubMocks, , THREADAPI_RESULT, ThreadAPI_Create, THREAD_HANDLE*, threadHandle, THREAD_START_FUNC, func, void*, arg);
+DECLARE_GLOBAL_MOCK_METHOD_2(IotHubMocks, , THREADAPI_RESULT, ThreadAPI_Join, THREAD_HANDLE, threadHandle, int*, res);
+DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , void, ThreadAPI_Sleep, unsigned int, milliseconds);
+DECLARE_GLOBAL_MOCK_METHOD_0(IotHubMocks, , TICK_COUNTER_HANDLE, tickcounter_create);
+DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , void, tickcounter_destroy, TICK_COUNTER_HANDLE, tick_counter);
+DECLARE_GLOBAL_MOCK_METHOD_2(IotHubMocks, , int, tickcounter_get_current_ms, TICK_COUNTER_HANDLE, tick_counter, tickcounter_ms_t*, current_ms);
+DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , SEGMENT_LOG_HANDLE, SegmentLog_Open, const SEGMENT_LOG_CONFIG*, config);
+DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , void, SegmentLog_Close, SEGMENT_LOG_HANDLE, log);
+DECLARE_GLOBAL_MOCK_METHOD_3(IotHubMocks, , int, SegmentLog_Append, SEGMENT_LOG_HANDLE, log, const unsigned char*, record, size_t, size);
+DECLARE_GLOBAL_MOCK_METHOD_4(IotHubMocks, , int, SegmentLog_Read, SEGMENT_LOG_HANDLE, log, const unsigned char**, record, size_t*, size, uint64_t*, sequence);
+DECLARE_GLOBAL_MOCK_METHOD_2(IotHubMocks, , int, SegmentLog_Acknowledge, SEGMENT_LOG_HANDLE, log, uint64_t, sequence);
+DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , void, SegmentLog_Rewind, SEGMENT_LOG_HANDLE, log);
+DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , void, SegmentLog_Expire, SEGMENT_LOG_HANDLE, log);
 
 BEGIN_TEST_SUITE(iothub_ut)
 
@@ -630,6 +931,20 @@ BEGIN_TEST_SUITE(iothub_ut)
         currentIoTHubClient_Create_call = 0;
         whenShallIoTHubClient_Create_fail = 0;
 
+        currentLock_call = 0;
+        whenShallLock_fail = 0;
+
+        currentTime = 0;
+        flushWorkerFunction = NULL;
+        flushWorkerArgument = NULL;
+
+        lastClientTransport = NULL;
+
+        lastEventConfirmationCallback = NULL;
+        lastEventConfirmationContext = NULL;
+        pendingConfirmationCount = 0;
+        storedRecordsToRead = 0;
+        lastStoredSequence = 0;
     }
 
     TEST_FUNCTION_CLEANUP(TestMethodCleanup)
@@ -682,6 +997,28 @@ BEGIN_TEST_SUITE(iothub_ut)
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(strlen("aHubName") + 1));
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(strlen("suffix.name") + 1));
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(IOTHUB_CONFIG)));
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "MaxPersonalities"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "BatchMaxMessages"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "BatchMaxBytes"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "BatchMaxMilliseconds"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "TransportPoolSize"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "StoreDirectory"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "StoreMaxBytes"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "StoreRetentionSeconds"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "StoreReplayRate"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "MaxInFlight"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "ProvisioningQueueSize"))
+            .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
@@ -912,209 +1249,258 @@ BEGIN_TEST_SUITE(iothub_ut)
         ///cleanup
     }
 
-    /*Tests_SRS_IOTHUBMODULE_05_011: [ If the JSON object does not contain a value named "Transport" then `IotHub_ParseConfigurationFromJson` shall fail and return NULL. ]*/
-    TEST_FUNCTION(IotHub_ParseConfigurationFromJson_returns_null_when_Transport_is_missing)
+    /*Tests_SRS_IOTHUBMODULE_31_001: [ `IotHub_ParseConfigurationFromJson` shall set `maxPersonalities` to the number named "MaxPersonalities", or to 0 if the JSON object does not contain it. ]*/
+    TEST_FUNCTION(IotHub_ParseConfigurationFromJson_reads_MaxPersonalities)
     {
         ///arrange
-        IotHubMocks mocks;
-        const char * validJsonString = "calling it valid makes it so";
+        CNiceCallComparer<IotHubMocks> mocks;
 
-        STRICT_EXPECTED_CALL(mocks, json_parse_string(validJsonString));
-        STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "IoTHubName"))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "IoTHubSuffix"))
-            .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "Transport"))
             .IgnoreArgument(1)
-            .SetFailReturn((const char *)NULL);
-        STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+            .SetReturn("HTTP");
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "MaxPersonalities"))
+            .IgnoreArgument(1)
+            .SetReturn((double)500);
 
         ///act
-        auto result = Module_ParseConfigurationFromJson(validJsonString);
-        ///assert
+        auto result = (IOTHUB_CONFIG*)Module_ParseConfigurationFromJson("don't care");
 
-        ASSERT_IS_NULL(result);
+        ///assert
+        ASSERT_IS_NOT_NULL(result);
+        ASSERT_ARE_EQUAL(size_t, 500, result->maxPersonalities);
+        mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
+        Module_FreeConfiguration(result);
     }
 
-    /*Tests_SRS_IOTHUBMODULE_05_007: [ If the JSON object does not contain a value named "IoTHubSuffix" then `IotHub_ParseConfigurationFromJson` shall fail and return NULL. ]*/
-    TEST_FUNCTION(IotHub_ParseConfigurationFromJson_IoTHubSuffix_not_found_returns_null)
+    /*Tests_SRS_IOTHUBMODULE_31_001: [ `IotHub_ParseConfigurationFromJson` shall set `maxPersonalities` to the number named "MaxPersonalities", or to 0 if the JSON object does not contain it. ]*/
+    TEST_FUNCTION(IotHub_ParseConfigurationFromJson_without_MaxPersonalities_does_not_limit_personalities)
     {
         ///arrange
-        IotHubMocks mocks;
-        const char * validJsonString = "calling it valid makes it so";
+        CNiceCallComparer<IotHubMocks> mocks;
 
-        STRICT_EXPECTED_CALL(mocks, json_parse_string(validJsonString));
-        STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "IoTHubName"))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "IoTHubSuffix"))
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "Transport"))
             .IgnoreArgument(1)
-            .SetFailReturn((const char *)NULL);
-        STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+            .SetReturn("HTTP");
 
         ///act
-        auto result = Module_ParseConfigurationFromJson(validJsonString);
-        ///assert
+        auto result = (IOTHUB_CONFIG*)Module_ParseConfigurationFromJson("don't care");
 
-        ASSERT_IS_NULL(result);
+        ///assert
+        ASSERT_IS_NOT_NULL(result);
+        ASSERT_ARE_EQUAL(size_t, 0, result->maxPersonalities);
+        mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
+        Module_FreeConfiguration(result);
     }
 
-    /*Tests_SRS_IOTHUBMODULE_05_006: [ If the JSON object does not contain a value named "IoTHubName" then `IotHub_ParseConfigurationFromJson` shall fail and return NULL. ]*/
-    TEST_FUNCTION(IotHub_ParseConfigurationFromJson_IoTHubName_not_found_returns_null)
+    /*Tests_SRS_IOTHUBMODULE_31_002: [ If the value of "MaxPersonalities" is negative then `IotHub_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+    TEST_FUNCTION(IotHub_ParseConfigurationFromJson_returns_null_when_MaxPersonalities_is_negative)
     {
         ///arrange
-        IotHubMocks mocks;
-        const char * validJsonString = "calling it valid makes it so";
+        CNiceCallComparer<IotHubMocks> mocks;
 
-        STRICT_EXPECTED_CALL(mocks, json_parse_string(validJsonString));
-        STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "IoTHubName"))
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "Transport"))
             .IgnoreArgument(1)
-            .SetFailReturn((const char *)NULL);
-        STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+            .SetReturn("HTTP");
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "MaxPersonalities"))
+            .IgnoreArgument(1)
+            .SetReturn((double)-1);
 
         ///act
-        auto result = Module_ParseConfigurationFromJson(validJsonString);
-        ///assert
+        auto result = Module_ParseConfigurationFromJson("don't care");
 
+        ///assert
         ASSERT_IS_NULL(result);
+        mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
     }
 
-    /*Tests_SRS_IOTHUBMODULE_05_005: [ If parsing of `configuration` fails, `IotHub_ParseConfigurationFromJson` shall fail and return NULL. ]*/
-    TEST_FUNCTION(IotHub_ParseConfigurationFromJson_get_object_null_returns_null)
+    /*Tests_SRS_IOTHUBMODULE_31_008: [ `IotHub_ParseConfigurationFromJson` shall set `batchMaxMessages`, `batchMaxBytes` and `batchMaxMilliseconds` to the numbers named "BatchMaxMessages", "BatchMaxBytes" and "BatchMaxMilliseconds", or to 0 for those the JSON object does not contain. ]*/
+    TEST_FUNCTION(IotHub_ParseConfigurationFromJson_reads_the_batch_settings)
     {
         ///arrange
-        IotHubMocks mocks;
-        const char * validJsonString = "calling it valid makes it so";
+        CNiceCallComparer<IotHubMocks> mocks;
 
-        STRICT_EXPECTED_CALL(mocks, json_parse_string(validJsonString));
-        STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "Transport"))
             .IgnoreArgument(1)
-            .SetFailReturn((JSON_Object*)NULL);
-        STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+            .SetReturn("AMQP");
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "BatchMaxMessages"))
+            .IgnoreArgument(1)
+            .SetReturn((double)20);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "BatchMaxBytes"))
+            .IgnoreArgument(1)
+            .SetReturn((double)4096);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "BatchMaxMilliseconds"))
+            .IgnoreArgument(1)
+            .SetReturn((double)250);
 
         ///act
-        auto result = Module_ParseConfigurationFromJson(validJsonString);
+        auto result = (IOTHUB_CONFIG*)Module_ParseConfigurationFromJson("don't care");
+
         ///assert
+        ASSERT_IS_NOT_NULL(result);
+        ASSERT_ARE_EQUAL(size_t, 20, result->batchMaxMessages);
+        ASSERT_ARE_EQUAL(size_t, 4096, result->batchMaxBytes);
+        ASSERT_ARE_EQUAL(int, 250, (int)result->batchMaxMilliseconds);
+        mocks.AssertActualAndExpectedCalls();
 
-        ASSERT_IS_NULL(result);
+        ///cleanup
+        Module_FreeConfiguration(result);
     }
 
-    /*Tests_SRS_IOTHUBMODULE_05_005: [ If parsing of `configuration` fails, `IotHub_ParseConfigurationFromJson` shall fail and return NULL. ]*/
-    TEST_FUNCTION(IotHub_ParseConfigurationFromJson_parse_string_null_returns_null)
+    /*Tests_SRS_IOTHUBMODULE_31_009: [ If the value of "BatchMaxMessages", "BatchMaxBytes" or "BatchMaxMilliseconds" is negative then `IotHub_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+    TEST_FUNCTION(IotHub_ParseConfigurationFromJson_returns_null_when_BatchMaxBytes_is_negative)
     {
         ///arrange
-        IotHubMocks mocks;
-        const char * invalidJsonString = "calling it invalid has the same effect";
+        CNiceCallComparer<IotHubMocks> mocks;
 
-        STRICT_EXPECTED_CALL(mocks, json_parse_string(invalidJsonString))
-            .SetFailReturn((JSON_Value*)NULL);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "Transport"))
+            .IgnoreArgument(1)
+            .SetReturn("HTTP");
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "BatchMaxBytes"))
+            .IgnoreArgument(1)
+            .SetReturn((double)-1);
 
         ///act
-        auto result = Module_ParseConfigurationFromJson(invalidJsonString);
-        ///assert
+        auto result = Module_ParseConfigurationFromJson("don't care");
 
+        ///assert
         ASSERT_IS_NULL(result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
     }
 
-    /*Tests_SRS_IOTHUBMODULE_05_002: [ If `configuration` is NULL then `IotHub_ParseConfigurationFromJson` shall fail and return NULL. ]*/
-    TEST_FUNCTION(IotHub_ParseConfigurationFromJson_config_null_returns_null)
+    /*Tests_SRS_IOTHUBMODULE_31_024: [ `IotHub_ParseConfigurationFromJson` shall set `transportPoolSize` to the number named "TransportPoolSize", or to 0 if the JSON object does not contain it. ]*/
+    TEST_FUNCTION(IotHub_ParseConfigurationFromJson_reads_TransportPoolSize)
     {
         ///arrange
-        IotHubMocks mocks;
+        CNiceCallComparer<IotHubMocks> mocks;
+
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "Transport"))
+            .IgnoreArgument(1)
+            .SetReturn("AMQP");
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "TransportPoolSize"))
+            .IgnoreArgument(1)
+            .SetReturn((double)4);
 
         ///act
-        auto result = Module_ParseConfigurationFromJson(NULL);
+        auto result = (IOTHUB_CONFIG*)Module_ParseConfigurationFromJson("don't care");
 
         ///assert
-        ASSERT_IS_NULL(result);
+        ASSERT_IS_NOT_NULL(result);
+        ASSERT_ARE_EQUAL(size_t, 4, result->transportPoolSize);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_FreeConfiguration(result);
     }
 
-    /*Tests_SRS_IOTHUBMODULE_05_014: [ If `configuration` is NULL then `IotHub_FreeConfiguration` shall do nothing. ]*/
-    TEST_FUNCTION(IotHub_FreeConfiguration_does_nothing_if_configuration_is_NULL)
+    /*Tests_SRS_IOTHUBMODULE_31_025: [ If the value of "TransportPoolSize" is negative then `IotHub_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+    TEST_FUNCTION(IotHub_ParseConfigurationFromJson_returns_null_when_TransportPoolSize_is_negative)
     {
         ///arrange
-        IotHubMocks mocks;
+        CNiceCallComparer<IotHubMocks> mocks;
 
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "Transport"))
             .IgnoreArgument(1)
-            .NeverInvoked();
-
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .SetReturn("AMQP");
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "TransportPoolSize"))
             .IgnoreArgument(1)
-            .NeverInvoked();
+            .SetReturn((double)-2);
 
         ///act
-        Module_FreeConfiguration(NULL);
+        auto result = Module_ParseConfigurationFromJson("don't care");
 
         ///assert
+        ASSERT_IS_NULL(result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
     }
 
-    /*Tests_SRS_IOTHUBMODULE_05_015: [ `IotHub_FreeConfiguration` shall free the strings referenced by the `IoTHubName` and `IoTHubSuffix` data members, and then free the `IOTHUB_CONFIG` structure itself. ]*/
-    TEST_FUNCTION(Module_FreeConfiguration_deallocates_configuration_memory)
+    /*Tests_SRS_IOTHUBMODULE_31_029: [ `IotHub_ParseConfigurationFromJson` shall set `storeDirectory` to a copy of the string named "StoreDirectory", or to NULL if the JSON object does not contain it, and `storeMaxBytes`, `storeRetentionSeconds` and `storeReplayRate` to the numbers named "StoreMaxBytes", "StoreRetentionSeconds" and "StoreReplayRate", or to 0 for those the JSON object does not contain. ]*/
+    /*Tests_SRS_IOTHUBMODULE_31_031: [ `IotHub_FreeConfiguration` shall free the string referenced by the `storeDirectory` data member, if any. ]*/
+    TEST_FUNCTION(IotHub_ParseConfigurationFromJson_reads_the_store_settings)
     {
         ///arrange
-        IotHubMocks mocks;
-        IOTHUB_CONFIG config = CreateConfig();
-        auto configp = (IOTHUB_CONFIG*)malloc(sizeof(IOTHUB_CONFIG));
-        memcpy(configp, &config, sizeof(IOTHUB_CONFIG));
-        mocks.ResetAllCalls();
-
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        CNiceCallComparer<IotHubMocks> mocks;
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "Transport"))
+            .IgnoreArgument(1)
+            .SetReturn("HTTP");
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "StoreDirectory"))
+            .IgnoreArgument(1)
+            .SetReturn("store");
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "StoreMaxBytes"))
+            .IgnoreArgument(1)
+            .SetReturn((double)65536);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "StoreRetentionSeconds"))
+            .IgnoreArgument(1)
+            .SetReturn((double)3600);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "StoreReplayRate"))
+            .IgnoreArgument(1)
+            .SetReturn((double)50);
 
         ///act
-        Module_FreeConfiguration(configp);
+        auto result = (IOTHUB_CONFIG*)Module_ParseConfigurationFromJson("don't care");
 
         ///assert
+        ASSERT_IS_NOT_NULL(result);
+        ASSERT_ARE_EQUAL(char_ptr, "store", result->storeDirectory);
+        ASSERT_ARE_EQUAL(size_t, 65536, result->storeMaxBytes);
+        ASSERT_ARE_EQUAL(int, 3600, (int)result->storeRetentionSeconds);
+        ASSERT_ARE_EQUAL(size_t, 50, result->storeReplayRate);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_FreeConfiguration(result);
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_001: [ If `broker` is `NULL` then `IotHub_Create` shall fail and return `NULL`. ]*/
-    TEST_FUNCTION(IotHub_Create_with_NULL_BROKER_HANDLE_returns_NULL)
+    /*Tests_SRS_IOTHUBMODULE_31_029: [ `IotHub_ParseConfigurationFromJson` shall set `storeDirectory` to a copy of the string named "StoreDirectory", or to NULL if the JSON object does not contain it, and `storeMaxBytes`, `storeRetentionSeconds` and `storeReplayRate` to the numbers named "StoreMaxBytes", "StoreRetentionSeconds" and "StoreReplayRate", or to 0 for those the JSON object does not contain. ]*/
+    TEST_FUNCTION(IotHub_ParseConfigurationFromJson_without_StoreDirectory_does_not_store)
     {
         ///arrange
-        IotHubMocks mocks;
-        AutoConfig config;
-        mocks.ResetAllCalls();
+        CNiceCallComparer<IotHubMocks> mocks;
+
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "Transport"))
+            .IgnoreArgument(1)
+            .SetReturn("HTTP");
 
         ///act
-        auto result = Module_Create(NULL, config);
+        auto result = (IOTHUB_CONFIG*)Module_ParseConfigurationFromJson("don't care");
 
         ///assert
-        ASSERT_IS_NULL(result);
+        ASSERT_IS_NOT_NULL(result);
+        ASSERT_IS_NULL(result->storeDirectory);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
+        Module_FreeConfiguration(result);
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_002: [ If `configuration` is `NULL` then `IotHub_Create` shall fail and return `NULL`. ]*/
-    TEST_FUNCTION(IotHub_Create_with_NULL_config_returns_NULL)
+    /*Tests_SRS_IOTHUBMODULE_31_030: [ If the value of "StoreMaxBytes", "StoreRetentionSeconds" or "StoreReplayRate" is negative then `IotHub_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+    TEST_FUNCTION(IotHub_ParseConfigurationFromJson_returns_null_when_StoreReplayRate_is_negative)
     {
         ///arrange
-        IotHubMocks mocks;
+        CNiceCallComparer<IotHubMocks> mocks;
+
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "Transport"))
+            .IgnoreArgument(1)
+            .SetReturn("HTTP");
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "StoreDirectory"))
+            .IgnoreArgument(1)
+            .SetReturn("store");
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "StoreReplayRate"))
+            .IgnoreArgument(1)
+            .SetReturn((double)-1);
 
         ///act
-        auto result = Module_Create((BROKER_HANDLE)1, NULL);
+        auto result = Module_ParseConfigurationFromJson("don't care");
 
         ///assert
         ASSERT_IS_NULL(result);
@@ -1123,34 +1509,46 @@ BEGIN_TEST_SUITE(iothub_ut)
         ///cleanup
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_003: [ If `configuration->IoTHubName` is `NULL` then `IotHub_Create` shall and return `NULL`. ]*/
-    TEST_FUNCTION(IotHub_Create_with_NULL_IoTHubName_fails)
+    /*Tests_SRS_IOTHUBMODULE_31_042: [ `IotHub_ParseConfigurationFromJson` shall set `maxInFlight` to the number named "MaxInFlight", or to 0 if the JSON object does not contain it. ]*/
+    TEST_FUNCTION(IotHub_ParseConfigurationFromJson_reads_MaxInFlight)
     {
         ///arrange
-        IotHubMocks mocks;
-        IOTHUB_CONFIG config_with_NULL_IoTHubName = { NULL, suffix, HTTP_Protocol };
-        mocks.ResetAllCalls();
+        CNiceCallComparer<IotHubMocks> mocks;
+
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "Transport"))
+            .IgnoreArgument(1)
+            .SetReturn("HTTP");
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "MaxInFlight"))
+            .IgnoreArgument(1)
+            .SetReturn((double)8);
 
         ///act
-        auto result = Module_Create((BROKER_HANDLE)1, &config_with_NULL_IoTHubName);
+        auto result = (IOTHUB_CONFIG*)Module_ParseConfigurationFromJson("don't care");
 
         ///assert
-        ASSERT_IS_NULL(result);
+        ASSERT_IS_NOT_NULL(result);
+        ASSERT_ARE_EQUAL(size_t, 8, result->maxInFlight);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
+        Module_FreeConfiguration(result);
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_004: [ If `configuration->IoTHubSuffix` is `NULL` then `IotHub_Create` shall fail and return `NULL`. ]*/
-    TEST_FUNCTION(IotHub_Create_with_NULL_IoTHubSuffix_fails)
+    /*Tests_SRS_IOTHUBMODULE_31_043: [ If the value of "MaxInFlight" is negative then `IotHub_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+    TEST_FUNCTION(IotHub_ParseConfigurationFromJson_returns_null_when_MaxInFlight_is_negative)
     {
         ///arrange
-        IotHubMocks mocks;
-        IOTHUB_CONFIG config_with_NULL_IoTHubSuffix = { name, NULL, HTTP_Protocol };
-        mocks.ResetAllCalls();
+        CNiceCallComparer<IotHubMocks> mocks;
+
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "Transport"))
+            .IgnoreArgument(1)
+            .SetReturn("HTTP");
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "MaxInFlight"))
+            .IgnoreArgument(1)
+            .SetReturn((double)-1);
 
         ///act
-        auto result = Module_Create((BROKER_HANDLE)1, &config_with_NULL_IoTHubSuffix);
+        auto result = Module_ParseConfigurationFromJson("don't care");
 
         ///assert
         ASSERT_IS_NULL(result);
@@ -1159,1050 +1557,913 @@ BEGIN_TEST_SUITE(iothub_ut)
         ///cleanup
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_008: [ Otherwise, `IotHub_Create` shall return a non-`NULL` handle. ]*/
-    /*Tests_SRS_IOTHUBMODULE_02_006: [ `IotHub_Create` shall create an empty `VECTOR` containing pointers to `PERSONALITY`s. ]*/
-    /*Tests_SRS_IOTHUBMODULE_17_001: [ If `configuration->transportProvider` is `HTTP_Protocol` or `AMQP_Protocol`, `IotHub_Create` shall create a shared transport by calling `IoTHubTransport_Create`. ]*/
-    /*Tests_SRS_IOTHUBMODULE_02_029: [ `IotHub_Create` shall create a copy of `configuration->IoTHubSuffix`. ]*/
-    /*Tests_SRS_IOTHUBMODULE_02_028: [ `IotHub_Create` shall create a copy of `configuration->IoTHubName`. ]*/
-    /*Tests_SRS_IOTHUBMODULE_17_004: [ `IotHub_Create` shall store the broker. ]*/
-    TEST_FUNCTION(IotHub_Create_succeeds)
+    /*Tests_SRS_IOTHUBMODULE_31_054: [ `IotHub_ParseConfigurationFromJson` shall set `provisioningQueueSize` to the number named "ProvisioningQueueSize", or to 0 if the JSON object does not contain it. ]*/
+    TEST_FUNCTION(IotHub_ParseConfigurationFromJson_reads_ProvisioningQueueSize)
     {
         ///arrange
-        IotHubMocks mocks;
-        AutoConfig config;
-        mocks.ResetAllCalls();
-
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_construct(name));
-
-        STRICT_EXPECTED_CALL(mocks, STRING_construct(suffix));
+        CNiceCallComparer<IotHubMocks> mocks;
 
-        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Create(HTTP_Protocol, name, suffix));
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "Transport"))
+            .IgnoreArgument(1)
+            .SetReturn("HTTP");
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "ProvisioningQueueSize"))
+            .IgnoreArgument(1)
+            .SetReturn((double)16);
 
         ///act
-        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        auto result = (IOTHUB_CONFIG*)Module_ParseConfigurationFromJson("don't care");
 
         ///assert
-        ASSERT_IS_NOT_NULL(module);
+        ASSERT_IS_NOT_NULL(result);
+        ASSERT_ARE_EQUAL(size_t, 16, result->provisioningQueueSize);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
-        Module_Destroy(module);
+        Module_FreeConfiguration(result);
     }
 
-    TEST_FUNCTION(IotHub_Create_creates_a_transport_for_AMQP)
+    /*Tests_SRS_IOTHUBMODULE_31_055: [ If the value of "ProvisioningQueueSize" is negative then `IotHub_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+    TEST_FUNCTION(IotHub_ParseConfigurationFromJson_returns_null_when_ProvisioningQueueSize_is_negative)
     {
         ///arrange
-        IotHubMocks mocks;
-        AutoConfig config(AMQP_Protocol);
-        mocks.ResetAllCalls();
-
-        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-
-        EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG));
-
-        EXPECTED_CALL(mocks, STRING_construct(name));
-
-        EXPECTED_CALL(mocks, STRING_construct(suffix));
+        CNiceCallComparer<IotHubMocks> mocks;
 
-        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Create(AMQP_Protocol, name, suffix));
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "Transport"))
+            .IgnoreArgument(1)
+            .SetReturn("HTTP");
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "ProvisioningQueueSize"))
+            .IgnoreArgument(1)
+            .SetReturn((double)-1);
 
         ///act
-        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        auto result = Module_ParseConfigurationFromJson("don't care");
 
         ///assert
-        ASSERT_IS_NOT_NULL(module);
+        ASSERT_IS_NULL(result);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
-        Module_Destroy(module);
     }
 
-    TEST_FUNCTION(IotHub_Create_does_not_create_a_transport_for_MQTT)
+    /*Tests_SRS_IOTHUBMODULE_05_011: [ If the JSON object does not contain a value named "Transport" then `IotHub_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+    TEST_FUNCTION(IotHub_ParseConfigurationFromJson_returns_null_when_Transport_is_missing)
     {
         ///arrange
         IotHubMocks mocks;
-        AutoConfig config(MQTT_Protocol);
-        mocks.ResetAllCalls();
-
-        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-
-        EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG));
-
-        EXPECTED_CALL(mocks, STRING_construct(name));
-
-        EXPECTED_CALL(mocks, STRING_construct(suffix));
+        const char * validJsonString = "calling it valid makes it so";
 
-        EXPECTED_CALL(mocks, IoTHubTransport_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .NeverInvoked();
+        STRICT_EXPECTED_CALL(mocks, json_parse_string(validJsonString));
+        STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "IoTHubName"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "IoTHubSuffix"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "Transport"))
+            .IgnoreArgument(1)
+            .SetFailReturn((const char *)NULL);
+        STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
         ///act
-        auto module = Module_Create(BROKER_HANDLE_VALID, config);
-
+        auto result = Module_ParseConfigurationFromJson(validJsonString);
         ///assert
-        ASSERT_IS_NOT_NULL(module);
-        mocks.AssertActualAndExpectedCalls();
+
+        ASSERT_IS_NULL(result);
 
         ///cleanup
-        Module_Destroy(module);
     }
 
-    TEST_FUNCTION(IotHub_Create_does_not_create_an_unrecognized_transport)
+    /*Tests_SRS_IOTHUBMODULE_05_007: [ If the JSON object does not contain a value named "IoTHubSuffix" then `IotHub_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+    TEST_FUNCTION(IotHub_ParseConfigurationFromJson_IoTHubSuffix_not_found_returns_null)
     {
         ///arrange
         IotHubMocks mocks;
-        AutoConfig config((IOTHUB_CLIENT_TRANSPORT_PROVIDER)0x42);
-        mocks.ResetAllCalls();
-
-        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-
-        EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG));
-
-        EXPECTED_CALL(mocks, STRING_construct(name));
-
-        EXPECTED_CALL(mocks, STRING_construct(suffix));
+        const char * validJsonString = "calling it valid makes it so";
 
-        EXPECTED_CALL(mocks, IoTHubTransport_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .NeverInvoked();
+        STRICT_EXPECTED_CALL(mocks, json_parse_string(validJsonString));
+        STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "IoTHubName"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "IoTHubSuffix"))
+            .IgnoreArgument(1)
+            .SetFailReturn((const char *)NULL);
+        STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
         ///act
-        auto module = Module_Create(BROKER_HANDLE_VALID, config);
-
+        auto result = Module_ParseConfigurationFromJson(validJsonString);
         ///assert
-        ASSERT_IS_NOT_NULL(module);
-        mocks.AssertActualAndExpectedCalls();
+
+        ASSERT_IS_NULL(result);
 
         ///cleanup
-        Module_Destroy(module);
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_027: [ When `IotHub_Create` encounters an internal failure it shall fail and return `NULL`. ]*/
-    TEST_FUNCTION(IotHub_Create_fails_when_STRING_construct_fails_1)
+    /*Tests_SRS_IOTHUBMODULE_05_006: [ If the JSON object does not contain a value named "IoTHubName" then `IotHub_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+    TEST_FUNCTION(IotHub_ParseConfigurationFromJson_IoTHubName_not_found_returns_null)
     {
         ///arrange
         IotHubMocks mocks;
-        AutoConfig config;
-        mocks.ResetAllCalls();
-
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        const char * validJsonString = "calling it valid makes it so";
 
-        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Create(HTTP_Protocol, name, suffix));
-        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Destroy(IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, json_parse_string(validJsonString));
+        STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_construct(name));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "IoTHubName"))
+            .IgnoreArgument(1)
+            .SetFailReturn((const char *)NULL);
+        STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        whenShallSTRING_construct_fail = currentSTRING_construct_call + 2;
-        STRICT_EXPECTED_CALL(mocks, STRING_construct(suffix));
-
         ///act
-        auto module = Module_Create(BROKER_HANDLE_VALID, config);
-
+        auto result = Module_ParseConfigurationFromJson(validJsonString);
         ///assert
-        ASSERT_IS_NULL(module);
-        mocks.AssertActualAndExpectedCalls();
+
+        ASSERT_IS_NULL(result);
 
         ///cleanup
-        Module_Destroy(module);
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_027: [ When `IotHub_Create` encounters an internal failure it shall fail and return `NULL`. ]*/
-    TEST_FUNCTION(IotHub_Create_fails_when_STRING_construct_fails_2)
+    /*Tests_SRS_IOTHUBMODULE_05_005: [ If parsing of `configuration` fails, `IotHub_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+    TEST_FUNCTION(IotHub_ParseConfigurationFromJson_get_object_null_returns_null)
     {
         ///arrange
         IotHubMocks mocks;
-        AutoConfig config;
-        mocks.ResetAllCalls();
+        const char * validJsonString = "calling it valid makes it so";
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, json_parse_string(validJsonString));
+        STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .SetFailReturn((JSON_Object*)NULL);
+        STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        ///act
+        auto result = Module_ParseConfigurationFromJson(validJsonString);
+        ///assert
 
-        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Create(HTTP_Protocol, name, suffix))
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        ASSERT_IS_NULL(result);
+    }
 
-        whenShallSTRING_construct_fail = currentSTRING_construct_call + 1;
-        STRICT_EXPECTED_CALL(mocks, STRING_construct(name));
+    /*Tests_SRS_IOTHUBMODULE_05_005: [ If parsing of `configuration` fails, `IotHub_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+    TEST_FUNCTION(IotHub_ParseConfigurationFromJson_parse_string_null_returns_null)
+    {
+        ///arrange
+        IotHubMocks mocks;
+        const char * invalidJsonString = "calling it invalid has the same effect";
 
-        ///act
-        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        STRICT_EXPECTED_CALL(mocks, json_parse_string(invalidJsonString))
+            .SetFailReturn((JSON_Value*)NULL);
 
+        ///act
+        auto result = Module_ParseConfigurationFromJson(invalidJsonString);
         ///assert
-        ASSERT_IS_NULL(module);
-        mocks.AssertActualAndExpectedCalls();
 
-        ///cleanup
-        Module_Destroy(module);
+        ASSERT_IS_NULL(result);
     }
 
-    /*Tests_SRS_IOTHUBMODULE_17_002: [ If creating the shared transport fails, `IotHub_Create` shall fail and return `NULL`. ]*/
-    TEST_FUNCTION(IotHub_Create_fails_when_transport_create_fails)
+    /*Tests_SRS_IOTHUBMODULE_05_002: [ If `configuration` is NULL then `IotHub_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+    TEST_FUNCTION(IotHub_ParseConfigurationFromJson_config_null_returns_null)
     {
         ///arrange
         IotHubMocks mocks;
-        AutoConfig config;
-        mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        ///act
+        auto result = Module_ParseConfigurationFromJson(NULL);
 
-        STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        ///assert
+        ASSERT_IS_NULL(result);
+    }
 
-        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Create(HTTP_Protocol, name, suffix))
-            .SetFailReturn((TRANSPORT_HANDLE)NULL);
+    /*Tests_SRS_IOTHUBMODULE_05_014: [ If `configuration` is NULL then `IotHub_FreeConfiguration` shall do nothing. ]*/
+    TEST_FUNCTION(IotHub_FreeConfiguration_does_nothing_if_configuration_is_NULL)
+    {
+        ///arrange
+        IotHubMocks mocks;
+
+        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .NeverInvoked();
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .NeverInvoked();
 
         ///act
-        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_FreeConfiguration(NULL);
 
         ///assert
-        ASSERT_IS_NULL(module);
-        mocks.AssertActualAndExpectedCalls();
-
-        ///cleanup
-        Module_Destroy(module);
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_007: [ If creating the personality vector fails then `IotHub_Create` shall fail and return `NULL`. ]*/
-    TEST_FUNCTION(IotHub_Create_fails_when_VECTOR_create_fails)
+    /*Tests_SRS_IOTHUBMODULE_05_015: [ `IotHub_FreeConfiguration` shall free the strings referenced by the `IoTHubName` and `IoTHubSuffix` data members, and then free the `IOTHUB_CONFIG` structure itself. ]*/
+    TEST_FUNCTION(Module_FreeConfiguration_deallocates_configuration_memory)
     {
         ///arrange
         IotHubMocks mocks;
-        AutoConfig config;
+        IOTHUB_CONFIG config = CreateConfig();
+        auto configp = (IOTHUB_CONFIG*)malloc(sizeof(IOTHUB_CONFIG));
+        memcpy(configp, &config, sizeof(IOTHUB_CONFIG));
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
+
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
-            .IgnoreArgument(1)
-            .SetFailReturn((VECTOR_HANDLE)NULL);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
         ///act
-        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_FreeConfiguration(configp);
 
         ///assert
-        ASSERT_IS_NULL(module);
-        mocks.AssertActualAndExpectedCalls();
-
-        ///cleanup
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_027: [ When `IotHub_Create` encounters an internal failure it shall fail and return `NULL`. ]*/
-    TEST_FUNCTION(IotHub_Create_fails_when_gballoc_fails)
+    /*Tests_SRS_IOTHUBMODULE_02_001: [ If `broker` is `NULL` then `IotHub_Create` shall fail and return `NULL`. ]*/
+    TEST_FUNCTION(IotHub_Create_with_NULL_BROKER_HANDLE_returns_NULL)
     {
         ///arrange
         IotHubMocks mocks;
         AutoConfig config;
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
-            .IgnoreArgument(1)
-            .SetFailReturn((void*)NULL);
-
         ///act
-        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        auto result = Module_Create(NULL, config);
 
         ///assert
-        ASSERT_IS_NULL(module);
+        ASSERT_IS_NULL(result);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_023: [ If `moduleHandle` is `NULL` then `IotHub_Destroy` shall return. ]*/
-    TEST_FUNCTION(IotHub_Destroy_with_NULL_returns)
+    /*Tests_SRS_IOTHUBMODULE_02_002: [ If `configuration` is `NULL` then `IotHub_Create` shall fail and return `NULL`. ]*/
+    TEST_FUNCTION(IotHub_Create_with_NULL_config_returns_NULL)
     {
         ///arrange
         IotHubMocks mocks;
 
         ///act
-        Module_Destroy(NULL);
+        auto result = Module_Create((BROKER_HANDLE)1, NULL);
 
         ///assert
+        ASSERT_IS_NULL(result);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_024: [ Otherwise `IotHub_Destroy` shall free all used resources. ]*/
-    TEST_FUNCTION(IotHub_Destroy_empty_module)
+    /*Tests_SRS_IOTHUBMODULE_02_003: [ If `configuration->IoTHubName` is `NULL` then `IotHub_Create` shall and return `NULL`. ]*/
+    TEST_FUNCTION(IotHub_Create_with_NULL_IoTHubName_fails)
     {
         ///arrange
         IotHubMocks mocks;
-        AutoConfig config;
-        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        IOTHUB_CONFIG config_with_NULL_IoTHubName = { NULL, suffix, HTTP_Protocol };
         mocks.ResetAllCalls();
 
-        /* transport handle */
-        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        /*IoTHubName cache*/
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        ///act
+        auto result = Module_Create((BROKER_HANDLE)1, &config_with_NULL_IoTHubName);
 
-        /*IoTHubSuffix cache*/
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        ///assert
+        ASSERT_IS_NULL(result);
+        mocks.AssertActualAndExpectedCalls();
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        ///cleanup
+    }
 
+    /*Tests_SRS_IOTHUBMODULE_02_004: [ If `configuration->IoTHubSuffix` is `NULL` then `IotHub_Create` shall fail and return `NULL`. ]*/
+    TEST_FUNCTION(IotHub_Create_with_NULL_IoTHubSuffix_fails)
+    {
+        ///arrange
+        IotHubMocks mocks;
+        IOTHUB_CONFIG config_with_NULL_IoTHubSuffix = { name, NULL, HTTP_Protocol };
+        mocks.ResetAllCalls();
 
         ///act
-        Module_Destroy(module);
+        auto result = Module_Create((BROKER_HANDLE)1, &config_with_NULL_IoTHubSuffix);
 
         ///assert
+        ASSERT_IS_NULL(result);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_024: [ Otherwise `IotHub_Destroy` shall free all used resources. ]*/
-    TEST_FUNCTION(IotHub_Destroy_module_with_0_identity)
+    /*Tests_SRS_IOTHUBMODULE_02_008: [ Otherwise, `IotHub_Create` shall return a non-`NULL` handle. ]*/
+    /*Tests_SRS_IOTHUBMODULE_02_006: [ `IotHub_Create` shall create an empty `VECTOR` containing pointers to `PERSONALITY`s. ]*/
+    /*Tests_SRS_IOTHUBMODULE_17_001: [ If `configuration->transportProvider` is `HTTP_Protocol` or `AMQP_Protocol`, `IotHub_Create` shall create a shared transport by calling `IoTHubTransport_Create`. ]*/
+    /*Tests_SRS_IOTHUBMODULE_02_029: [ `IotHub_Create` shall create a copy of `configuration->IoTHubSuffix`. ]*/
+    /*Tests_SRS_IOTHUBMODULE_02_028: [ `IotHub_Create` shall create a copy of `configuration->IoTHubName`. ]*/
+    /*Tests_SRS_IOTHUBMODULE_17_004: [ `IotHub_Create` shall store the broker. ]*/
+    /*Tests_SRS_IOTHUBMODULE_31_044: [ `IotHub_Create` shall create a tick counter and a lock for the send confirmations, and a condition if `configuration->maxInFlight` is not 0. ]*/
+    TEST_FUNCTION(IotHub_Create_succeeds)
     {
         ///arrange
         IotHubMocks mocks;
         AutoConfig config;
-        auto module = Module_Create(BROKER_HANDLE_VALID, config);
         mocks.ResetAllCalls();
 
-        /*this is IoTHubName*/
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
             .IgnoreArgument(1);
 
-        /*this is IoTHubSuffix*/
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
             .IgnoreArgument(1);
 
-        /*this is the loop trying to dispose of all personalities*/
-        /*none for this case*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, STRING_construct(name));
 
-        /*this is VECTOR<PERSONALITY>*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, STRING_construct(suffix));
 
-        /* transport handle */
-        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, tickcounter_create());
 
-        /*this is allocated memory*/
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Lock_Init());
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Create(HTTP_Protocol, name, suffix));
 
         ///act
-        Module_Destroy(module);
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
 
         ///assert
+        ASSERT_IS_NOT_NULL(module);
         mocks.AssertActualAndExpectedCalls();
 
-        ///cleanup - nothing
+        ///cleanup
+        Module_Destroy(module);
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_024: [ Otherwise `IotHub_Destroy` shall free all used resources. ]*/
-    TEST_FUNCTION(IotHub_Destroy_module_with_1_identity)
+    /*Tests_SRS_IOTHUBMODULE_31_003: [ `IotHub_Create` shall store `configuration->maxPersonalities`, 0 meaning the number of personalities is not limited. ]*/
+    TEST_FUNCTION(IotHub_Create_stores_maxPersonalities)
     {
         ///arrange
-        IotHubMocks mocks;
+        CNiceCallComparer<IotHubMocks> mocks;
         AutoConfig config;
-        auto module = Module_Create(BROKER_HANDLE_VALID, config);
-        (void)Module_Receive(module, MESSAGE_HANDLE_VALID_1);
-        mocks.ResetAllCalls();
-
-        /*this is IoTHubName*/
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        ((IOTHUB_CONFIG*)config)->maxPersonalities = 3;
 
-        /*this is IoTHubSuffix*/
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        ///act
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
 
-        /*this is the loop trying to dispose of all personalities*/
-        /*1 for this case*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        ///assert
+        ASSERT_IS_NOT_NULL(module);
+        ASSERT_ARE_EQUAL(size_t, 3, ((IOTHUB_HANDLE_DATA*)module)->maxPersonalities);
+        ASSERT_ARE_EQUAL(size_t, 0, ((IOTHUB_HANDLE_DATA*)module)->indexCount);
+        mocks.AssertActualAndExpectedCalls();
 
-        /* transport handle */
-        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        ///cleanup
+        Module_Destroy(module);
+    }
 
-        /*this is VECTOR<PERSONALITY>*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+    /*Tests_SRS_IOTHUBMODULE_31_010: [ If `configuration->batchMaxMessages` is not 0, `IotHub_Create` shall create a lock for batching. ]*/
+    /*Tests_SRS_IOTHUBMODULE_31_011: [ If `configuration->batchMaxMilliseconds` is not 0 as well, `IotHub_Create` shall start a flush worker thread. ]*/
+    TEST_FUNCTION(IotHub_Create_with_batching_starts_the_flush_worker)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->batchMaxMessages = 10;
+        ((IOTHUB_CONFIG*)config)->batchMaxMilliseconds = 100;
 
-        /*this is allocated memory*/
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Lock_Init())
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
 
         ///act
-        Module_Destroy(module);
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
 
         ///assert
+        ASSERT_IS_NOT_NULL(module);
+        ASSERT_ARE_EQUAL(void_ptr, (void*)module, flushWorkerArgument);
         mocks.AssertActualAndExpectedCalls();
 
-        ///cleanup - nothing
+        ///cleanup
+        Module_Destroy(module);
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_024: [ Otherwise `IotHub_Destroy` shall free all used resources. ]*/
-    TEST_FUNCTION(IotHub_Destroy_module_with_2_identity)
+    /*Tests_SRS_IOTHUBMODULE_31_011: [ If `configuration->batchMaxMilliseconds` is not 0 as well, `IotHub_Create` shall start a flush worker thread. ]*/
+    TEST_FUNCTION(IotHub_Create_with_batching_without_a_time_limit_does_not_start_a_flush_worker)
     {
         ///arrange
-        IotHubMocks mocks;
+        CNiceCallComparer<IotHubMocks> mocks;
         AutoConfig config;
-        auto module = Module_Create(BROKER_HANDLE_VALID, config);
-        (void)Module_Receive(module, MESSAGE_HANDLE_VALID_1);
-        (void)Module_Receive(module, MESSAGE_HANDLE_VALID_2);
-        mocks.ResetAllCalls();
+        ((IOTHUB_CONFIG*)config)->batchMaxMessages = 10;
 
-        /*this is IoTHubName*/
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Lock_Init())
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .NeverInvoked();
 
-        /*this is IoTHubSuffix*/
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        ///act
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
 
-        /*this is the loop trying to dispose of all personalities*/
-        /*1 for this case*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        /*first element*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        ///assert
+        ASSERT_IS_NOT_NULL(module);
+        mocks.AssertActualAndExpectedCalls();
 
-        /*second element*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        ///cleanup
+        Module_Destroy(module);
+    }
 
-        /* transport handle */
-        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+    /*Tests_SRS_IOTHUBMODULE_31_012: [ If creating the lock or the flush worker fails, `IotHub_Create` shall fail and return `NULL`. ]*/
+    TEST_FUNCTION(IotHub_Create_with_batching_fails_when_the_flush_worker_fails)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->batchMaxMessages = 10;
+        ((IOTHUB_CONFIG*)config)->batchMaxMilliseconds = 100;
 
-        /*this is VECTOR<PERSONALITY>*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .SetReturn(THREADAPI_ERROR);
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
-
-        /*this is allocated memory*/
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
         ///act
-        Module_Destroy(module);
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
 
         ///assert
+        ASSERT_IS_NULL(module);
         mocks.AssertActualAndExpectedCalls();
 
-        ///cleanup - nothing
+        ///cleanup
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_009: [ If `moduleHandle` or `messageHandle` is `NULL` then `IotHub_Receive` shall do nothing. ]*/
-    TEST_FUNCTION(IotHub_Receive_with_NULL_moduleHandle_returns)
+    /*Tests_SRS_IOTHUBMODULE_31_044: [ `IotHub_Create` shall create a tick counter and a lock for the send confirmations, and a condition if `configuration->maxInFlight` is not 0. ]*/
+    TEST_FUNCTION(IotHub_Create_with_maxInFlight_creates_a_condition)
     {
         ///arrange
-        IotHubMocks mocks;
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->maxInFlight = 4;
+
+        STRICT_EXPECTED_CALL(mocks, Condition_Init());
 
         ///act
-        Module_Receive(NULL, MESSAGE_HANDLE_VALID);
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
 
         ///assert
+        ASSERT_IS_NOT_NULL(module);
+        ASSERT_ARE_EQUAL(size_t, 4, ((IOTHUB_HANDLE_DATA*)module)->maxInFlight);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
+        Module_Destroy(module);
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_009: [ If `moduleHandle` or `messageHandle` is `NULL` then `IotHub_Receive` shall do nothing. ]*/
-    TEST_FUNCTION(IotHub_Receive_with_NULL_messageHandle_returns)
+    /*Tests_SRS_IOTHUBMODULE_31_045: [ If creating the tick counter, the lock or the condition for the send confirmations fails, `IotHub_Create` shall fail and return `NULL`. ]*/
+    TEST_FUNCTION(IotHub_Create_fails_when_tickcounter_create_fails)
     {
         ///arrange
-        IotHubMocks mocks;
+        CNiceCallComparer<IotHubMocks> mocks;
         AutoConfig config;
-        auto module = Module_Create(BROKER_HANDLE_VALID, config);
-        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, tickcounter_create())
+            .SetFailReturn((TICK_COUNTER_HANDLE)NULL);
+        STRICT_EXPECTED_CALL(mocks, Lock_Init())
+            .NeverInvoked();
+        STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
         ///act
-        Module_Receive(module, NULL);
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
 
         ///assert
+        ASSERT_IS_NULL(module);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
-        Module_Destroy(module);
-
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_013: [ If no personality exists with a device ID equal to the value of the `deviceName` property of the message, then `IotHub_Receive` shall create a new `PERSONALITY` with the ID and key values from the message. ]*/
-    /*Tests_SRS_IOTHUBMODULE_05_013: [ If a new personality is created and the module's transport has already been created (in `IotHub_Create`), an `IOTHUB_CLIENT_HANDLE` will be added to the personality by a call to `IoTHubClient_CreateWithTransport`. ]*/
-    /*Tests_SRS_IOTHUBMODULE_17_003: [ If a new personality is created, then the associated IoTHubClient will be set to receive messages by calling `IoTHubClient_SetMessageCallback` with callback function `IotHub_ReceiveMessageCallback`, and the personality as context. ]*/
-    /*Tests_SRS_IOTHUBMODULE_02_018: [ `IotHub_Receive` shall create a new IOTHUB_MESSAGE_HANDLE having the same content as `messageHandle`, and the same properties with the exception of `deviceName` and `deviceKey`. ]*/
-    /*Tests_SRS_IOTHUBMODULE_02_020: [ `IotHub_Receive` shall call IoTHubClient_SendEventAsync passing the IOTHUB_MESSAGE_HANDLE. ]*/
-    /*Tests_SRS_IOTHUBMODULE_02_022: [ If `IoTHubClient_SendEventAsync` succeeds then `IotHub_Receive` shall return. ]*/
-    TEST_FUNCTION(IotHub_Receive_succeeds)
+    /*Tests_SRS_IOTHUBMODULE_31_045: [ If creating the tick counter, the lock or the condition for the send confirmations fails, `IotHub_Create` shall fail and return `NULL`. ]*/
+    TEST_FUNCTION(IotHub_Create_fails_when_Condition_Init_fails)
     {
         ///arrange
-        IotHubMocks mocks;
+        CNiceCallComparer<IotHubMocks> mocks;
         AutoConfig config;
-        auto module = Module_Create(BROKER_HANDLE_VALID, config);
-        mocks.ResetAllCalls();
+        ((IOTHUB_CONFIG*)config)->maxInFlight = 4;
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, Condition_Init())
+            .SetFailReturn((COND_HANDLE)NULL);
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+        ///act
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+        ///assert
+        ASSERT_IS_NULL(module);
+        mocks.AssertActualAndExpectedCalls();
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+        ///cleanup
+    }
 
-        /*VECTOR_find_if incurs a STRING_c_str until it find the deviceName. None in this test*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
+    TEST_FUNCTION(IotHub_Create_creates_a_transport_for_AMQP)
+    {
+        ///arrange
+        IotHubMocks mocks;
+        AutoConfig config(AMQP_Protocol);
+        mocks.ResetAllCalls();
 
-        /*because the deviceName is brand new, it will be added as a new personality*/
-        {/*separate scope for personality building*/
-            /* create a new PERSONALITY */
-            STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
-                .IgnoreArgument(1);
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
 
-            /*making a copy of the deviceName*/
-            STRICT_EXPECTED_CALL(mocks, STRING_construct("firstDevice"));
-            /*making a copy of the deviceKey*/
-            STRICT_EXPECTED_CALL(mocks, STRING_construct("cheiaDeLaPoartaVerde"));
+        EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG));
 
-            /*getting the stored IoTHubName*/
-            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
-            /*getting the stored IoTHubSuffix*/
-            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+        EXPECTED_CALL(mocks, STRING_construct(name));
 
-            /*creating the IOTHUB_CLIENT_HANDLE associated with the device*/
-            STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-                .IgnoreArgument(1)
-                .IgnoreArgument(2);
+        EXPECTED_CALL(mocks, STRING_construct(suffix));
 
-            STRICT_EXPECTED_CALL(mocks, IoTHubClient_SetMessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-                .IgnoreArgument(1)
-                .IgnoreArgument(2)
-                .IgnoreArgument(3);
-        }
+        EXPECTED_CALL(mocks, tickcounter_create());
 
-        /*adding the personality to the VECTOR or personalities*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
+        EXPECTED_CALL(mocks, Lock_Init());
 
-        /*getting the location of the personality in the VECTOR*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Create(AMQP_Protocol, name, suffix));
 
-        { /*scope for creating the IOTHUBMESSAGE from GWMESSAGE*/
+        ///act
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
 
-            /*gettng the GW message content*/
-            STRICT_EXPECTED_CALL(mocks, Message_GetContent(MESSAGE_HANDLE_VALID_1));
+        ///assert
+        ASSERT_IS_NOT_NULL(module);
+        mocks.AssertActualAndExpectedCalls();
 
-            /*creating a new IOTHUB_MESSAGE*/
-            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, 1))
-                .ValidateArgumentBuffer(1, CONSTBUFFER_VALID_CONTENT1.buffer, 1);
+        ///cleanup
+        Module_Destroy(module);
+    }
 
-            /*every creation has its destruction - this one actually happens AFTER SendEventAsync*/
-            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+    TEST_FUNCTION(IotHub_Create_does_not_create_a_transport_for_MQTT)
+    {
+        ///arrange
+        IotHubMocks mocks;
+        AutoConfig config(MQTT_Protocol);
+        mocks.ResetAllCalls();
 
-            /*getting the IOTHUBMESSAGE properties*/
-            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
 
-            /*getting the GW message properties*/
-            STRICT_EXPECTED_CALL(mocks, Message_GetProperties(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
-            STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+        EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG));
 
-            /*getting the GW keys and values*/
-            STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(CONSTMAP_HANDLE_VALID_1, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-                .IgnoreArgument(2)
-                .IgnoreArgument(3)
-                .IgnoreArgument(4);
+        EXPECTED_CALL(mocks, STRING_construct(name));
 
-            /*add "source"*/
-            STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, "source", "mapping"))
-                .IgnoreArgument(1);
+        EXPECTED_CALL(mocks, STRING_construct(suffix));
 
-            /*add "somethingExtra"*/
-            STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, "somethingExtra", "blue"))
-                .IgnoreArgument(1);
-        }
+        EXPECTED_CALL(mocks, tickcounter_create());
 
-        /*finally, send the message*/
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, NULL, NULL))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
+        EXPECTED_CALL(mocks, Lock_Init());
+
+        EXPECTED_CALL(mocks, IoTHubTransport_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .NeverInvoked();
 
         ///act
-        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
 
         ///assert
+        ASSERT_IS_NOT_NULL(module);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
         Module_Destroy(module);
-
     }
 
-    /*Tests_SRS_IOTHUBMODULE_05_013: [ If a new personality is created and the module's transport has already been created (in `IotHub_Create`), an `IOTHUB_CLIENT_HANDLE` will be added to the personality by a call to `IoTHubClient_CreateWithTransport`. ]*/
-    TEST_FUNCTION(IotHub_Receive_creates_a_client_with_an_existing_AMQP_transport)
+    /*Tests_SRS_IOTHUBMODULE_31_026: [ If `configuration->transportPoolSize` is not 0 and the transport is not `MQTT_Protocol`, `IotHub_Create` shall create `transportPoolSize` shared transports. ]*/
+    TEST_FUNCTION(IotHub_Create_creates_transportPoolSize_shared_transports)
     {
         ///arrange
         CNiceCallComparer<IotHubMocks> mocks;
-        IOTHUB_CLIENT_TRANSPORT_PROVIDER transport = AMQP_Protocol;
-        AutoConfig config(transport);
-
-        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Create(transport, name, suffix));
-        EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .ValidateArgumentBuffer(2, &transport, sizeof(IOTHUB_CLIENT_TRANSPORT_PROVIDER));
+        AutoConfig config(AMQP_Protocol);
+        ((IOTHUB_CONFIG*)config)->transportPoolSize = 3;
+        mocks.ResetAllCalls();
 
-        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Create(AMQP_Protocol, name, suffix))
+            .ExpectedTimesExactly(3);
 
         ///act
-        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
 
         ///assert
+        ASSERT_IS_NOT_NULL(module);
+        ASSERT_ARE_EQUAL(size_t, 3, ((IOTHUB_HANDLE_DATA*)module)->transportCount);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
         Module_Destroy(module);
     }
 
-    /*Tests_SRS_IOTHUBMODULE_05_003: [ If a new personality is created and the module's transport has not already been created, an `IOTHUB_CLIENT_HANDLE` will be added to the personality by a call to `IoTHubClient_Create` with the corresponding transport provider. ]*/
-    TEST_FUNCTION(IotHub_Receive_creates_a_client_with_MQTT_transport)
+    /*Tests_SRS_IOTHUBMODULE_31_026: [ If `configuration->transportPoolSize` is not 0 and the transport is not `MQTT_Protocol`, `IotHub_Create` shall create `transportPoolSize` shared transports. ]*/
+    TEST_FUNCTION(IotHub_Create_ignores_transportPoolSize_for_MQTT)
     {
         ///arrange
         CNiceCallComparer<IotHubMocks> mocks;
-        IOTHUB_CLIENT_TRANSPORT_PROVIDER transport = MQTT_Protocol;
-        AutoConfig config(transport);
-
-        EXPECTED_CALL(mocks, IoTHubClient_Create(IGNORED_PTR_ARG))
-            .ValidateArgumentBuffer(1, &transport, sizeof(IOTHUB_CLIENT_TRANSPORT_PROVIDER), 0);
+        AutoConfig config(MQTT_Protocol);
+        ((IOTHUB_CONFIG*)config)->transportPoolSize = 3;
+        mocks.ResetAllCalls();
 
-        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        EXPECTED_CALL(mocks, IoTHubTransport_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .NeverInvoked();
 
         ///act
-        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
 
         ///assert
+        ASSERT_IS_NOT_NULL(module);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
         Module_Destroy(module);
     }
 
-    /*Tests_SRS_IOTHUBMODULE_05_003: [ If a new personality is created and the module's transport has not already been created, an `IOTHUB_CLIENT_HANDLE` will be added to the personality by a call to `IoTHubClient_Create` with the corresponding transport provider. ]*/
-    TEST_FUNCTION(IotHub_Receive_creates_a_client_with_custom_transport)
+    /*Tests_SRS_IOTHUBMODULE_31_027: [ If creating one of the shared transports fails, `IotHub_Create` shall destroy the ones created, fail and return `NULL`. ]*/
+    TEST_FUNCTION(IotHub_Create_fails_when_a_pooled_transport_fails)
     {
         ///arrange
         CNiceCallComparer<IotHubMocks> mocks;
-        IOTHUB_CLIENT_TRANSPORT_PROVIDER transport = ABCD_Protocol;
-        AutoConfig config(transport);
-
-        EXPECTED_CALL(mocks, IoTHubClient_Create(IGNORED_PTR_ARG))
-            .ValidateArgumentBuffer(1, &transport, sizeof(IOTHUB_CLIENT_TRANSPORT_PROVIDER));
+        AutoConfig config(HTTP_Protocol);
+        ((IOTHUB_CONFIG*)config)->transportPoolSize = 2;
+        mocks.ResetAllCalls();
 
-        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Create(HTTP_Protocol, name, suffix));
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Create(HTTP_Protocol, name, suffix))
+            .SetReturn((TRANSPORT_HANDLE)NULL);
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
         ///act
-        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
 
         ///assert
+        ASSERT_IS_NULL(module);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
-        Module_Destroy(module);
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_017: [ Otherwise `IotHub_Receive` shall not create a new personality. ]*/
-    /*Tests_SRS_IOTHUBMODULE_02_020: [ `IotHub_Receive` shall call IoTHubClient_SendEventAsync passing the IOTHUB_MESSAGE_HANDLE. ]*/
-    /*Tests_SRS_IOTHUBMODULE_02_022: [ If `IoTHubClient_SendEventAsync` succeeds then `IotHub_Receive` shall return. ]*/
-    TEST_FUNCTION(IotHub_Receive_after_receive_succeeds)
+    TEST_FUNCTION(IotHub_Create_does_not_create_an_unrecognized_transport)
     {
         ///arrange
         IotHubMocks mocks;
-        AutoConfig config;
-        auto module = Module_Create(BROKER_HANDLE_VALID, config);
-        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        AutoConfig config((IOTHUB_CLIENT_TRANSPORT_PROVIDER)0x42);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+        EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+        EXPECTED_CALL(mocks, STRING_construct(name));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+        EXPECTED_CALL(mocks, STRING_construct(suffix));
 
-        /*VECTOR_find_if incurs a STRING_c_str until it find the deviceName. One in this test*/
-        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        EXPECTED_CALL(mocks, tickcounter_create());
 
-        STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
+        EXPECTED_CALL(mocks, Lock_Init());
 
-        { /*scope for creating the IOTHUBMESSAGE from GWMESSAGE*/
+        EXPECTED_CALL(mocks, IoTHubTransport_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .NeverInvoked();
 
-          /*gettng the GW message content*/
-            STRICT_EXPECTED_CALL(mocks, Message_GetContent(MESSAGE_HANDLE_VALID_1));
+        ///act
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
 
-            /*creating a new IOTHUB_MESSAGE*/
-            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, 1))
-                .ValidateArgumentBuffer(1, CONSTBUFFER_VALID_CONTENT1.buffer, 1);
+        ///assert
+        ASSERT_IS_NOT_NULL(module);
+        mocks.AssertActualAndExpectedCalls();
 
-            /*every creation has its destruction - this one actually happens AFTER SendEventAsync*/
-            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+        ///cleanup
+        Module_Destroy(module);
+    }
 
-            /*getting the IOTHUBMESSAGE properties*/
-            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+    /*Tests_SRS_IOTHUBMODULE_02_027: [ When `IotHub_Create` encounters an internal failure it shall fail and return `NULL`. ]*/
+    TEST_FUNCTION(IotHub_Create_fails_when_STRING_construct_fails_1)
+    {
+        ///arrange
+        IotHubMocks mocks;
+        AutoConfig config;
+        mocks.ResetAllCalls();
 
-            /*getting the GW message properties*/
-            STRICT_EXPECTED_CALL(mocks, Message_GetProperties(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
-            STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
-            /*getting the GW keys and values*/
-            STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(CONSTMAP_HANDLE_VALID_1, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-                .IgnoreArgument(2)
-                .IgnoreArgument(3)
-                .IgnoreArgument(4);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
-            /*add "source"*/
-            STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, "source", "mapping"))
-                .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Create(HTTP_Protocol, name, suffix));
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
-            /*add "somethingExtra"*/
-            STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, "somethingExtra", "blue"))
-                .IgnoreArgument(1);
-        }
+        STRICT_EXPECTED_CALL(mocks, STRING_construct(name));
+        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
-        /*finally, send the message*/
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, NULL, NULL))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
+        whenShallSTRING_construct_fail = currentSTRING_construct_call + 2;
+        STRICT_EXPECTED_CALL(mocks, STRING_construct(suffix));
 
         ///act
-        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
 
         ///assert
+        ASSERT_IS_NULL(module);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
         Module_Destroy(module);
-
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_013: [ If no personality exists with a device ID equal to the value of the `deviceName` property of the message, then `IotHub_Receive` shall create a new `PERSONALITY` with the ID and key values from the message. ]*/
-    /*Tests_SRS_IOTHUBMODULE_02_018: [ `IotHub_Receive` shall create a new IOTHUB_MESSAGE_HANDLE having the same content as `messageHandle`, and the same properties with the exception of `deviceName` and `deviceKey`. ]*/
-    /*Tests_SRS_IOTHUBMODULE_02_020: [ `IotHub_Receive` shall call IoTHubClient_SendEventAsync passing the IOTHUB_MESSAGE_HANDLE. ]*/
-    /*Tests_SRS_IOTHUBMODULE_02_022: [ If `IoTHubClient_SendEventAsync` succeeds then `IotHub_Receive` shall return. ]*/
-    TEST_FUNCTION(IotHub_Receive_after_Receive_a_new_device_succeeds)
+    /*Tests_SRS_IOTHUBMODULE_02_027: [ When `IotHub_Create` encounters an internal failure it shall fail and return `NULL`. ]*/
+    TEST_FUNCTION(IotHub_Create_fails_when_STRING_construct_fails_2)
     {
         ///arrange
         IotHubMocks mocks;
         AutoConfig config;
-        auto module = Module_Create(BROKER_HANDLE_VALID, config);
-        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_2));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_2, "source"));
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_2, "deviceName"));
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_2, "deviceKey"));
-
-        /*VECTOR_find_if incurs a STRING_c_str until it find the deviceName. One in this test*/
-        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Create(HTTP_Protocol, name, suffix))
             .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
-        /*because the deviceName is brand new, it will be added as a new personality*/
-        {/*separate scope for personality building*/
-         /* create a new PERSONALITY */
-            STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
-                .IgnoreArgument(1);
-
-         /*making a copy of the deviceName*/
-            STRICT_EXPECTED_CALL(mocks, STRING_construct("secondDevice"));
-            /*making a copy of the deviceKey*/
-            STRICT_EXPECTED_CALL(mocks, STRING_construct("red"));
+        whenShallSTRING_construct_fail = currentSTRING_construct_call + 1;
+        STRICT_EXPECTED_CALL(mocks, STRING_construct(name));
 
-            /*getting the stored IoTHubName*/
-            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
-            /*getting the stored IoTHubSuffix*/
-            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+        ///act
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
 
-            /*creating the IOTHUB_CLIENT_HANDLE associated with the device*/
-            STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-                .IgnoreArgument(1)
-                .IgnoreArgument(2);
+        ///assert
+        ASSERT_IS_NULL(module);
+        mocks.AssertActualAndExpectedCalls();
 
-            STRICT_EXPECTED_CALL(mocks, IoTHubClient_SetMessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-                .IgnoreArgument(1)
-                .IgnoreArgument(2)
-                .IgnoreArgument(3);
-        }
+        ///cleanup
+        Module_Destroy(module);
+    }
 
-        /*adding the personality to the VECTOR or personalities*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
+    /*Tests_SRS_IOTHUBMODULE_17_002: [ If creating the shared transport fails, `IotHub_Create` shall fail and return `NULL`. ]*/
+    TEST_FUNCTION(IotHub_Create_fails_when_transport_create_fails)
+    {
+        ///arrange
+        IotHubMocks mocks;
+        AutoConfig config;
+        mocks.ResetAllCalls();
 
-        /*getting the location of the personality in the VECTOR*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        { /*scope for creating the IOTHUBMESSAGE from GWMESSAGE*/
-
-          /*gettng the GW message content*/
-            STRICT_EXPECTED_CALL(mocks, Message_GetContent(MESSAGE_HANDLE_VALID_2));
+        STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
-            /*creating a new IOTHUB_MESSAGE*/
-            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, 0))
-                ;
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Create(HTTP_Protocol, name, suffix))
+            .SetFailReturn((TRANSPORT_HANDLE)NULL);
 
-            /*every creation has its destruction - this one actually happens AFTER SendEventAsync*/
-            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+        ///act
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
 
-            /*getting the IOTHUBMESSAGE properties*/
-            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+        ///assert
+        ASSERT_IS_NULL(module);
+        mocks.AssertActualAndExpectedCalls();
 
-            /*getting the GW message properties*/
-            STRICT_EXPECTED_CALL(mocks, Message_GetProperties(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
-            STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+        ///cleanup
+        Module_Destroy(module);
+    }
 
-            /*getting the GW keys and values*/
-            STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(CONSTMAP_HANDLE_VALID_2, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-                .IgnoreArgument(2)
-                .IgnoreArgument(3)
-                .IgnoreArgument(4);
+    /*Tests_SRS_IOTHUBMODULE_02_007: [ If creating the personality vector fails then `IotHub_Create` shall fail and return `NULL`. ]*/
+    TEST_FUNCTION(IotHub_Create_fails_when_VECTOR_create_fails)
+    {
+        ///arrange
+        IotHubMocks mocks;
+        AutoConfig config;
+        mocks.ResetAllCalls();
 
-            /*add "source"*/
-            STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, "source", "mapping"))
-                .IgnoreArgument(1);
-        }
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
-        /*finally, send the message*/
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, NULL, NULL))
+        STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
             .IgnoreArgument(1)
-            .IgnoreArgument(2);
+            .SetFailReturn((VECTOR_HANDLE)NULL);
 
         ///act
-        Module_Receive(module, MESSAGE_HANDLE_VALID_2);
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
 
         ///assert
+        ASSERT_IS_NULL(module);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
-        Module_Destroy(module);
-
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_021: [ If `IoTHubClient_SendEventAsync` fails then `IotHub_Receive` shall return. ]*/
-    TEST_FUNCTION(IotHub_Receive_when_IoTHubClient_SendEventAsync_fails_it_still_returns)
+    /*Tests_SRS_IOTHUBMODULE_02_027: [ When `IotHub_Create` encounters an internal failure it shall fail and return `NULL`. ]*/
+    TEST_FUNCTION(IotHub_Create_fails_when_gballoc_fails)
     {
         ///arrange
         IotHubMocks mocks;
         AutoConfig config;
-        auto module = Module_Create(BROKER_HANDLE_VALID, config);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1)
+            .SetFailReturn((void*)NULL);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+        ///act
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+        ///assert
+        ASSERT_IS_NULL(module);
+        mocks.AssertActualAndExpectedCalls();
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+        ///cleanup
+    }
 
-        /*VECTOR_find_if incurs a STRING_c_str until it find the deviceName. None in this test*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
+    /*Tests_SRS_IOTHUBMODULE_02_023: [ If `moduleHandle` is `NULL` then `IotHub_Destroy` shall return. ]*/
+    TEST_FUNCTION(IotHub_Destroy_with_NULL_returns)
+    {
+        ///arrange
+        IotHubMocks mocks;
 
-        /*because the deviceName is brand new, it will be added as a new personality*/
-        {/*separate scope for personality building*/
+        ///act
+        Module_Destroy(NULL);
 
-         /* create a new PERSONALITY */
-            STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
-                .IgnoreArgument(1);
-         /*making a copy of the deviceName*/
-            STRICT_EXPECTED_CALL(mocks, STRING_construct("firstDevice"));
-            /*making a copy of the deviceKey*/
-            STRICT_EXPECTED_CALL(mocks, STRING_construct("cheiaDeLaPoartaVerde"));
-
-            /*getting the stored IoTHubName*/
-            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
-            /*getting the stored IoTHubSuffix*/
-            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
-
-            /*creating the IOTHUB_CLIENT_HANDLE associated with the device*/
-            STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-                .IgnoreArgument(1)
-                .IgnoreArgument(2);
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
 
-            STRICT_EXPECTED_CALL(mocks, IoTHubClient_SetMessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-                .IgnoreArgument(1)
-                .IgnoreArgument(2)
-                .IgnoreArgument(3);
-        }
+        ///cleanup
+    }
 
-        /*adding the personality to the VECTOR or personalities*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
+    /*Tests_SRS_IOTHUBMODULE_02_024: [ Otherwise `IotHub_Destroy` shall free all used resources. ]*/
+    TEST_FUNCTION(IotHub_Destroy_empty_module)
+    {
+        ///arrange
+        IotHubMocks mocks;
+        AutoConfig config;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        mocks.ResetAllCalls();
 
-        /*getting the location of the personality in the VECTOR*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
+        /* transport handle */
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Destroy(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        { /*scope for creating the IOTHUBMESSAGE from GWMESSAGE*/
-
-          /*gettng the GW message content*/
-            STRICT_EXPECTED_CALL(mocks, Message_GetContent(MESSAGE_HANDLE_VALID_1));
-
-            /*creating a new IOTHUB_MESSAGE*/
-            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, 1))
-                .ValidateArgumentBuffer(1, CONSTBUFFER_VALID_CONTENT1.buffer, 1);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
-            /*every creation has its destruction - this one actually happens AFTER SendEventAsync*/
-            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
-            /*getting the IOTHUBMESSAGE properties*/
-            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+        /*this is the personality index*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
-            /*getting the GW message properties*/
-            STRICT_EXPECTED_CALL(mocks, Message_GetProperties(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
-            STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+        /*IoTHubName cache*/
+        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
-            /*getting the GW keys and values*/
-            STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(CONSTMAP_HANDLE_VALID_1, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-                .IgnoreArgument(2)
-                .IgnoreArgument(3)
-                .IgnoreArgument(4);
+        /*IoTHubSuffix cache*/
+        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
-            /*add "source"*/
-            STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, "source", "mapping"))
-                .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
-            /*add "somethingExtra"*/
-            STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, "somethingExtra", "blue"))
-                .IgnoreArgument(1);
-        }
 
-        /*finally, send the message*/
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, NULL, NULL))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2)
-            .SetReturn(IOTHUB_CLIENT_ERROR);
+        /*this is the lock of the send confirmations and its clock*/
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
         ///act
-        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        Module_Destroy(module);
 
         ///assert
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
-        Module_Destroy(module);
-
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_019: [ If creating the IOTHUB_MESSAGE_HANDLE fails, then `IotHub_Receive` shall return. ]*/
-    TEST_FUNCTION(IotHub_Receive_when_creating_IOTHUB_MESSAGE_HANDLE_fails_1)
+    /*Tests_SRS_IOTHUBMODULE_02_024: [ Otherwise `IotHub_Destroy` shall free all used resources. ]*/
+    TEST_FUNCTION(IotHub_Destroy_module_with_0_identity)
     {
         ///arrange
         IotHubMocks mocks;
@@ -2210,140 +2471,284 @@ BEGIN_TEST_SUITE(iothub_ut)
         auto module = Module_Create(BROKER_HANDLE_VALID, config);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+        /*this is IoTHubName*/
+        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+        /*this is IoTHubSuffix*/
+        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+        /*this is the loop trying to dispose of all personalities*/
+        /*none for this case*/
+        STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+        /*this is VECTOR<PERSONALITY>*/
+        STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
-        /*VECTOR_find_if incurs a STRING_c_str until it find the deviceName. None in this test*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
+        /* transport handle */
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
-        /*because the deviceName is brand new, it will be added as a new personality*/
-        {/*separate scope for personality building*/
+        /*this is the personality index*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
-         /* create a new PERSONALITY */
-            STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
-                .IgnoreArgument(1);
+        /*this is allocated memory*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
-         /*making a copy of the deviceName*/
-            STRICT_EXPECTED_CALL(mocks, STRING_construct("firstDevice"));
-            /*making a copy of the deviceKey*/
-            STRICT_EXPECTED_CALL(mocks, STRING_construct("cheiaDeLaPoartaVerde"));
+        /*this is the lock of the send confirmations and its clock*/
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
-            /*getting the stored IoTHubName*/
-            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
-            /*getting the stored IoTHubSuffix*/
-            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+        ///act
+        Module_Destroy(module);
 
-            /*creating the IOTHUB_CLIENT_HANDLE associated with the device*/
-            STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-                .IgnoreArgument(1)
-                .IgnoreArgument(2);
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
 
-            STRICT_EXPECTED_CALL(mocks, IoTHubClient_SetMessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-                .IgnoreArgument(1)
-                .IgnoreArgument(2)
-                .IgnoreArgument(3);
-        }
+        ///cleanup - nothing
+    }
 
-        /*adding the personality to the VECTOR or personalities*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
+    /*Tests_SRS_IOTHUBMODULE_02_024: [ Otherwise `IotHub_Destroy` shall free all used resources. ]*/
+    TEST_FUNCTION(IotHub_Destroy_module_with_1_identity)
+    {
+        ///arrange
+        IotHubMocks mocks;
+        AutoConfig config;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        (void)Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        mocks.ResetAllCalls();
 
-        /*getting the location of the personality in the VECTOR*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
+        /*this is IoTHubName*/
+        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        { /*scope for creating the IOTHUBMESSAGE from GWMESSAGE*/
-
-          /*gettng the GW message content*/
-            STRICT_EXPECTED_CALL(mocks, Message_GetContent(MESSAGE_HANDLE_VALID_1));
-
-            /*creating a new IOTHUB_MESSAGE*/
-            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, 1))
-                .ValidateArgumentBuffer(1, CONSTBUFFER_VALID_CONTENT1.buffer, 1);
+        /*this is IoTHubSuffix*/
+        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
-            /*every creation has its destruction - this one actually happens AFTER SendEventAsync*/
-            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+        /*this is the loop trying to dispose of all personalities*/
+        /*1 for this case*/
+        STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        /*its message in flight is confirmed as destroyed*/
+        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
-            /*getting the IOTHUBMESSAGE properties*/
-            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+        /* transport handle */
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
-            /*getting the GW message properties*/
-            STRICT_EXPECTED_CALL(mocks, Message_GetProperties(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
-            STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+        /*this is VECTOR<PERSONALITY>*/
+        STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
-            /*getting the GW keys and values*/
-            STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(CONSTMAP_HANDLE_VALID_1, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-                .IgnoreArgument(2)
-                .IgnoreArgument(3)
-                .IgnoreArgument(4);
+        /*this is the personality index*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
-            /*add "source"*/
-            STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, "source", "mapping"))
-                .IgnoreArgument(1);
+        /*this is allocated memory*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
-            /*add "somethingExtra"*/
-            STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, "somethingExtra", "blue"))
-                .IgnoreArgument(1)
-                .SetReturn(MAP_ERROR);
-        }
+        /*this is the lock of the send confirmations and its clock*/
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
         ///act
-        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        Module_Destroy(module);
 
         ///assert
         mocks.AssertActualAndExpectedCalls();
 
-        ///cleanup
-        Module_Destroy(module);
-
+        ///cleanup - nothing
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_019: [ If creating the IOTHUB_MESSAGE_HANDLE fails, then `IotHub_Receive` shall return. ]*/
-    TEST_FUNCTION(IotHub_Receive_when_creating_IOTHUB_MESSAGE_HANDLE_fails_2)
+    /*Tests_SRS_IOTHUBMODULE_02_024: [ Otherwise `IotHub_Destroy` shall free all used resources. ]*/
+    TEST_FUNCTION(IotHub_Destroy_module_with_2_identity)
     {
         ///arrange
         IotHubMocks mocks;
         AutoConfig config;
         auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        (void)Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        (void)Module_Receive(module, MESSAGE_HANDLE_VALID_2);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+        /*this is IoTHubName*/
+        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+        /*this is IoTHubSuffix*/
+        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        /*this is the loop trying to dispose of all personalities*/
+        /*1 for this case*/
+        STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        /*first element*/
+        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        /*its message in flight is confirmed as destroyed*/
+        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        /*second element*/
+        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        /*its message in flight is confirmed as destroyed*/
+        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        /* transport handle */
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        /*this is VECTOR<PERSONALITY>*/
+        STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        /*this is the personality index*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        /*this is allocated memory*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        /*this is the lock of the send confirmations and its clock*/
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        Module_Destroy(module);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup - nothing
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_02_009: [ If `moduleHandle` or `messageHandle` is `NULL` then `IotHub_Receive` shall do nothing. ]*/
+    TEST_FUNCTION(IotHub_Receive_with_NULL_moduleHandle_returns)
+    {
+        ///arrange
+        IotHubMocks mocks;
+
+        ///act
+        Module_Receive(NULL, MESSAGE_HANDLE_VALID);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_02_009: [ If `moduleHandle` or `messageHandle` is `NULL` then `IotHub_Receive` shall do nothing. ]*/
+    TEST_FUNCTION(IotHub_Receive_with_NULL_messageHandle_returns)
+    {
+        ///arrange
+        IotHubMocks mocks;
+        AutoConfig config;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        mocks.ResetAllCalls();
+
+        ///act
+        Module_Receive(module, NULL);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_02_013: [ If no personality exists with a device ID equal to the value of the `deviceName` property of the message, then `IotHub_Receive` shall create a new `PERSONALITY` with the ID and key values from the message. ]*/
+    /*Tests_SRS_IOTHUBMODULE_05_013: [ If a new personality is created and the module's transport has already been created (in `IotHub_Create`), an `IOTHUB_CLIENT_HANDLE` will be added to the personality by a call to `IoTHubClient_CreateWithTransport`. ]*/
+    /*Tests_SRS_IOTHUBMODULE_17_003: [ If a new personality is created, then the associated IoTHubClient will be set to receive messages by calling `IoTHubClient_SetMessageCallback` with callback function `IotHub_ReceiveMessageCallback`, and the personality as context. ]*/
+    /*Tests_SRS_IOTHUBMODULE_02_018: [ `IotHub_Receive` shall create a new IOTHUB_MESSAGE_HANDLE having the same content as `messageHandle`, and the same properties with the exception of `deviceName` and `deviceKey`. ]*/
+    /*Tests_SRS_IOTHUBMODULE_02_020: [ `IotHub_Receive` shall call IoTHubClient_SendEventAsync passing the IOTHUB_MESSAGE_HANDLE. ]*/
+    /*Tests_SRS_IOTHUBMODULE_02_022: [ If `IoTHubClient_SendEventAsync` succeeds then `IotHub_Receive` shall return. ]*/
+    /*Tests_SRS_IOTHUBMODULE_31_046: [ Every message shall be given to `IoTHubClient_SendEventAsync` with a confirmation callback whose context holds its personality and the time it was sent, and shall be counted in flight until it is confirmed. ]*/
+    TEST_FUNCTION(IotHub_Receive_succeeds)
+    {
+        ///arrange
+        IotHubMocks mocks;
+        AutoConfig config;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
 
         STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
 
-        /*VECTOR_find_if incurs a STRING_c_str until it find the deviceName. None in this test*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
+        /*the personality index is allocated for the first device*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
 
         /*because the deviceName is brand new, it will be added as a new personality*/
         {/*separate scope for personality building*/
-
-         /* create a new PERSONALITY */
+            /* create a new PERSONALITY */
             STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
                 .IgnoreArgument(1);
 
-         /*making a copy of the deviceName*/
+            /*making a copy of the deviceName*/
             STRICT_EXPECTED_CALL(mocks, STRING_construct("firstDevice"));
             /*making a copy of the deviceKey*/
             STRICT_EXPECTED_CALL(mocks, STRING_construct("cheiaDeLaPoartaVerde"));
@@ -2371,13 +2776,9 @@ BEGIN_TEST_SUITE(iothub_ut)
             .IgnoreArgument(1)
             .IgnoreArgument(2);
 
-        /*getting the location of the personality in the VECTOR*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
         { /*scope for creating the IOTHUBMESSAGE from GWMESSAGE*/
 
-          /*gettng the GW message content*/
+            /*gettng the GW message content*/
             STRICT_EXPECTED_CALL(mocks, Message_GetContent(MESSAGE_HANDLE_VALID_1));
 
             /*creating a new IOTHUB_MESSAGE*/
@@ -2404,556 +2805,2618 @@ BEGIN_TEST_SUITE(iothub_ut)
                 .IgnoreArgument(3)
                 .IgnoreArgument(4);
 
-            /*add "source"*/
-            STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, "source", "mapping"))
-                .IgnoreArgument(1)
-                .SetReturn(MAP_ERROR);
-        }
+            /*add "source"*/
+            STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, "source", "mapping"))
+                .IgnoreArgument(1);
+
+            /*add "somethingExtra"*/
+            STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, "somethingExtra", "blue"))
+                .IgnoreArgument(1);
+        }
+
+        /*the context of the confirmation, counted in flight and stamped*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+
+        /*finally, send the message*/
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_IS_NOT_NULL((void*)lastEventConfirmationCallback);
+        ASSERT_ARE_EQUAL(size_t, 1, ((IOTHUB_HANDLE_DATA*)module)->mostRecent->inFlight);
+        ASSERT_ARE_EQUAL(size_t, 1, ((IOTHUB_HANDLE_DATA*)module)->sendCounters.inFlight);
+
+        ///cleanup
+        Module_Destroy(module);
+
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_05_013: [ If a new personality is created and the module's transport has already been created (in `IotHub_Create`), an `IOTHUB_CLIENT_HANDLE` will be added to the personality by a call to `IoTHubClient_CreateWithTransport`. ]*/
+    TEST_FUNCTION(IotHub_Receive_creates_a_client_with_an_existing_AMQP_transport)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        IOTHUB_CLIENT_TRANSPORT_PROVIDER transport = AMQP_Protocol;
+        AutoConfig config(transport);
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Create(transport, name, suffix));
+        EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .ValidateArgumentBuffer(2, &transport, sizeof(IOTHUB_CLIENT_TRANSPORT_PROVIDER));
+
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_31_028: [ The transport of a new personality shall be the shared transport chosen by the hash of its device name, so that a device always uses the same connection. ]*/
+    TEST_FUNCTION(IotHub_Receive_creates_the_client_on_the_transport_chosen_by_the_device_name)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config(AMQP_Protocol);
+        ((IOTHUB_CONFIG*)config)->transportPoolSize = 3;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        IOTHUB_HANDLE_DATA* handleData = (IOTHUB_HANDLE_DATA*)module;
+        mocks.ResetAllCalls();
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        TRANSPORT_HANDLE firstTransport = lastClientTransport;
+        size_t firstHash = handleData->mostRecent->hash;
+        Module_Receive(module, MESSAGE_HANDLE_VALID_2);
+
+        ///assert
+        ASSERT_IS_TRUE(firstTransport == handleData->transports[firstHash % 3]);
+        ASSERT_IS_TRUE(lastClientTransport == handleData->transports[handleData->mostRecent->hash % 3]);
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_05_003: [ If a new personality is created and the module's transport has not already been created, an `IOTHUB_CLIENT_HANDLE` will be added to the personality by a call to `IoTHubClient_Create` with the corresponding transport provider. ]*/
+    TEST_FUNCTION(IotHub_Receive_creates_a_client_with_MQTT_transport)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        IOTHUB_CLIENT_TRANSPORT_PROVIDER transport = MQTT_Protocol;
+        AutoConfig config(transport);
+
+        EXPECTED_CALL(mocks, IoTHubClient_Create(IGNORED_PTR_ARG))
+            .ValidateArgumentBuffer(1, &transport, sizeof(IOTHUB_CLIENT_TRANSPORT_PROVIDER), 0);
+
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_05_003: [ If a new personality is created and the module's transport has not already been created, an `IOTHUB_CLIENT_HANDLE` will be added to the personality by a call to `IoTHubClient_Create` with the corresponding transport provider. ]*/
+    TEST_FUNCTION(IotHub_Receive_creates_a_client_with_custom_transport)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        IOTHUB_CLIENT_TRANSPORT_PROVIDER transport = ABCD_Protocol;
+        AutoConfig config(transport);
+
+        EXPECTED_CALL(mocks, IoTHubClient_Create(IGNORED_PTR_ARG))
+            .ValidateArgumentBuffer(1, &transport, sizeof(IOTHUB_CLIENT_TRANSPORT_PROVIDER));
+
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_02_017: [ Otherwise `IotHub_Receive` shall not create a new personality. ]*/
+    /*Tests_SRS_IOTHUBMODULE_02_020: [ `IotHub_Receive` shall call IoTHubClient_SendEventAsync passing the IOTHUB_MESSAGE_HANDLE. ]*/
+    /*Tests_SRS_IOTHUBMODULE_02_022: [ If `IoTHubClient_SendEventAsync` succeeds then `IotHub_Receive` shall return. ]*/
+    TEST_FUNCTION(IotHub_Receive_after_receive_succeeds)
+    {
+        ///arrange
+        IotHubMocks mocks;
+        AutoConfig config;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+
+        /*the index compares the deviceName of the personality it finds*/
+        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        { /*scope for creating the IOTHUBMESSAGE from GWMESSAGE*/
+
+          /*gettng the GW message content*/
+            STRICT_EXPECTED_CALL(mocks, Message_GetContent(MESSAGE_HANDLE_VALID_1));
+
+            /*creating a new IOTHUB_MESSAGE*/
+            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, 1))
+                .ValidateArgumentBuffer(1, CONSTBUFFER_VALID_CONTENT1.buffer, 1);
+
+            /*every creation has its destruction - this one actually happens AFTER SendEventAsync*/
+            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*getting the IOTHUBMESSAGE properties*/
+            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*getting the GW message properties*/
+            STRICT_EXPECTED_CALL(mocks, Message_GetProperties(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+            STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*getting the GW keys and values*/
+            STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(CONSTMAP_HANDLE_VALID_1, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+                .IgnoreArgument(2)
+                .IgnoreArgument(3)
+                .IgnoreArgument(4);
+
+            /*add "source"*/
+            STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, "source", "mapping"))
+                .IgnoreArgument(1);
+
+            /*add "somethingExtra"*/
+            STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, "somethingExtra", "blue"))
+                .IgnoreArgument(1);
+        }
+
+        /*the context of the confirmation, counted in flight and stamped*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+
+        /*finally, send the message*/
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_02_013: [ If no personality exists with a device ID equal to the value of the `deviceName` property of the message, then `IotHub_Receive` shall create a new `PERSONALITY` with the ID and key values from the message. ]*/
+    /*Tests_SRS_IOTHUBMODULE_02_018: [ `IotHub_Receive` shall create a new IOTHUB_MESSAGE_HANDLE having the same content as `messageHandle`, and the same properties with the exception of `deviceName` and `deviceKey`. ]*/
+    /*Tests_SRS_IOTHUBMODULE_02_020: [ `IotHub_Receive` shall call IoTHubClient_SendEventAsync passing the IOTHUB_MESSAGE_HANDLE. ]*/
+    /*Tests_SRS_IOTHUBMODULE_02_022: [ If `IoTHubClient_SendEventAsync` succeeds then `IotHub_Receive` shall return. ]*/
+    TEST_FUNCTION(IotHub_Receive_after_Receive_a_new_device_succeeds)
+    {
+        ///arrange
+        IotHubMocks mocks;
+        AutoConfig config;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_2));
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_2, "source"));
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_2, "deviceName"));
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_2, "deviceKey"));
+
+        /*the deviceName hashes differently than the known device, so it is not compared*/
+
+        /*because the deviceName is brand new, it will be added as a new personality*/
+        {/*separate scope for personality building*/
+         /* create a new PERSONALITY */
+            STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+                .IgnoreArgument(1);
+
+         /*making a copy of the deviceName*/
+            STRICT_EXPECTED_CALL(mocks, STRING_construct("secondDevice"));
+            /*making a copy of the deviceKey*/
+            STRICT_EXPECTED_CALL(mocks, STRING_construct("red"));
+
+            /*getting the stored IoTHubName*/
+            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+            /*getting the stored IoTHubSuffix*/
+            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*creating the IOTHUB_CLIENT_HANDLE associated with the device*/
+            STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+                .IgnoreArgument(1)
+                .IgnoreArgument(2);
+
+            STRICT_EXPECTED_CALL(mocks, IoTHubClient_SetMessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+                .IgnoreArgument(1)
+                .IgnoreArgument(2)
+                .IgnoreArgument(3);
+        }
+
+        /*adding the personality to the VECTOR or personalities*/
+        STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+
+        { /*scope for creating the IOTHUBMESSAGE from GWMESSAGE*/
+
+          /*gettng the GW message content*/
+            STRICT_EXPECTED_CALL(mocks, Message_GetContent(MESSAGE_HANDLE_VALID_2));
+
+            /*creating a new IOTHUB_MESSAGE*/
+            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, 0))
+                ;
+
+            /*every creation has its destruction - this one actually happens AFTER SendEventAsync*/
+            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*getting the IOTHUBMESSAGE properties*/
+            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*getting the GW message properties*/
+            STRICT_EXPECTED_CALL(mocks, Message_GetProperties(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+            STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*getting the GW keys and values*/
+            STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(CONSTMAP_HANDLE_VALID_2, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+                .IgnoreArgument(2)
+                .IgnoreArgument(3)
+                .IgnoreArgument(4);
+
+            /*add "source"*/
+            STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, "source", "mapping"))
+                .IgnoreArgument(1);
+        }
+
+        /*the context of the confirmation, counted in flight and stamped*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+
+        /*finally, send the message*/
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_2);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_02_021: [ If `IoTHubClient_SendEventAsync` fails then `IotHub_Receive` shall return. ]*/
+    /*Tests_SRS_IOTHUBMODULE_31_048: [ If `IoTHubClient_SendEventAsync` fails, the message shall no longer be counted in flight and shall be counted as a send failure. ]*/
+    TEST_FUNCTION(IotHub_Receive_when_IoTHubClient_SendEventAsync_fails_it_still_returns)
+    {
+        ///arrange
+        IotHubMocks mocks;
+        AutoConfig config;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+
+        /*the personality index is allocated for the first device*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        /*because the deviceName is brand new, it will be added as a new personality*/
+        {/*separate scope for personality building*/
+
+         /* create a new PERSONALITY */
+            STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+                .IgnoreArgument(1);
+         /*making a copy of the deviceName*/
+            STRICT_EXPECTED_CALL(mocks, STRING_construct("firstDevice"));
+            /*making a copy of the deviceKey*/
+            STRICT_EXPECTED_CALL(mocks, STRING_construct("cheiaDeLaPoartaVerde"));
+
+            /*getting the stored IoTHubName*/
+            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+            /*getting the stored IoTHubSuffix*/
+            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*creating the IOTHUB_CLIENT_HANDLE associated with the device*/
+            STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+                .IgnoreArgument(1)
+                .IgnoreArgument(2);
+
+            STRICT_EXPECTED_CALL(mocks, IoTHubClient_SetMessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+                .IgnoreArgument(1)
+                .IgnoreArgument(2)
+                .IgnoreArgument(3);
+        }
+
+        /*adding the personality to the VECTOR or personalities*/
+        STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+
+        { /*scope for creating the IOTHUBMESSAGE from GWMESSAGE*/
+
+          /*gettng the GW message content*/
+            STRICT_EXPECTED_CALL(mocks, Message_GetContent(MESSAGE_HANDLE_VALID_1));
+
+            /*creating a new IOTHUB_MESSAGE*/
+            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, 1))
+                .ValidateArgumentBuffer(1, CONSTBUFFER_VALID_CONTENT1.buffer, 1);
+
+            /*every creation has its destruction - this one actually happens AFTER SendEventAsync*/
+            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*getting the IOTHUBMESSAGE properties*/
+            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*getting the GW message properties*/
+            STRICT_EXPECTED_CALL(mocks, Message_GetProperties(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+            STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*getting the GW keys and values*/
+            STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(CONSTMAP_HANDLE_VALID_1, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+                .IgnoreArgument(2)
+                .IgnoreArgument(3)
+                .IgnoreArgument(4);
+
+            /*add "source"*/
+            STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, "source", "mapping"))
+                .IgnoreArgument(1);
+
+            /*add "somethingExtra"*/
+            STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, "somethingExtra", "blue"))
+                .IgnoreArgument(1);
+        }
+
+        /*the context of the confirmation, counted in flight and stamped*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+
+        /*finally, send the message*/
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .SetReturn(IOTHUB_CLIENT_ERROR);
+
+        /*the message is no longer in flight, and its context is freed*/
+        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        forgetLastEvent();
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 0, ((IOTHUB_HANDLE_DATA*)module)->mostRecent->inFlight);
+        ASSERT_ARE_EQUAL(size_t, 1, ((IOTHUB_HANDLE_DATA*)module)->sendCounters.sent);
+        ASSERT_ARE_EQUAL(size_t, 1, ((IOTHUB_HANDLE_DATA*)module)->sendCounters.sendFailures);
+        ASSERT_ARE_EQUAL(size_t, 0, ((IOTHUB_HANDLE_DATA*)module)->sendCounters.inFlight);
+
+        ///cleanup
+        Module_Destroy(module);
+
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_02_019: [ If creating the IOTHUB_MESSAGE_HANDLE fails, then `IotHub_Receive` shall return. ]*/
+    TEST_FUNCTION(IotHub_Receive_when_creating_IOTHUB_MESSAGE_HANDLE_fails_1)
+    {
+        ///arrange
+        IotHubMocks mocks;
+        AutoConfig config;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+
+        /*the personality index is allocated for the first device*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        /*because the deviceName is brand new, it will be added as a new personality*/
+        {/*separate scope for personality building*/
+
+         /* create a new PERSONALITY */
+            STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+                .IgnoreArgument(1);
+
+         /*making a copy of the deviceName*/
+            STRICT_EXPECTED_CALL(mocks, STRING_construct("firstDevice"));
+            /*making a copy of the deviceKey*/
+            STRICT_EXPECTED_CALL(mocks, STRING_construct("cheiaDeLaPoartaVerde"));
+
+            /*getting the stored IoTHubName*/
+            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+            /*getting the stored IoTHubSuffix*/
+            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*creating the IOTHUB_CLIENT_HANDLE associated with the device*/
+            STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+                .IgnoreArgument(1)
+                .IgnoreArgument(2);
+
+            STRICT_EXPECTED_CALL(mocks, IoTHubClient_SetMessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+                .IgnoreArgument(1)
+                .IgnoreArgument(2)
+                .IgnoreArgument(3);
+        }
+
+        /*adding the personality to the VECTOR or personalities*/
+        STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+
+        { /*scope for creating the IOTHUBMESSAGE from GWMESSAGE*/
+
+          /*gettng the GW message content*/
+            STRICT_EXPECTED_CALL(mocks, Message_GetContent(MESSAGE_HANDLE_VALID_1));
+
+            /*creating a new IOTHUB_MESSAGE*/
+            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, 1))
+                .ValidateArgumentBuffer(1, CONSTBUFFER_VALID_CONTENT1.buffer, 1);
+
+            /*every creation has its destruction - this one actually happens AFTER SendEventAsync*/
+            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*getting the IOTHUBMESSAGE properties*/
+            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*getting the GW message properties*/
+            STRICT_EXPECTED_CALL(mocks, Message_GetProperties(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+            STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*getting the GW keys and values*/
+            STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(CONSTMAP_HANDLE_VALID_1, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+                .IgnoreArgument(2)
+                .IgnoreArgument(3)
+                .IgnoreArgument(4);
+
+            /*add "source"*/
+            STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, "source", "mapping"))
+                .IgnoreArgument(1);
+
+            /*add "somethingExtra"*/
+            STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, "somethingExtra", "blue"))
+                .IgnoreArgument(1)
+                .SetReturn(MAP_ERROR);
+        }
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_02_019: [ If creating the IOTHUB_MESSAGE_HANDLE fails, then `IotHub_Receive` shall return. ]*/
+    TEST_FUNCTION(IotHub_Receive_when_creating_IOTHUB_MESSAGE_HANDLE_fails_2)
+    {
+        ///arrange
+        IotHubMocks mocks;
+        AutoConfig config;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+
+        /*the personality index is allocated for the first device*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        /*because the deviceName is brand new, it will be added as a new personality*/
+        {/*separate scope for personality building*/
+
+         /* create a new PERSONALITY */
+            STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+                .IgnoreArgument(1);
+
+         /*making a copy of the deviceName*/
+            STRICT_EXPECTED_CALL(mocks, STRING_construct("firstDevice"));
+            /*making a copy of the deviceKey*/
+            STRICT_EXPECTED_CALL(mocks, STRING_construct("cheiaDeLaPoartaVerde"));
+
+            /*getting the stored IoTHubName*/
+            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+            /*getting the stored IoTHubSuffix*/
+            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*creating the IOTHUB_CLIENT_HANDLE associated with the device*/
+            STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+                .IgnoreArgument(1)
+                .IgnoreArgument(2);
+
+            STRICT_EXPECTED_CALL(mocks, IoTHubClient_SetMessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+                .IgnoreArgument(1)
+                .IgnoreArgument(2)
+                .IgnoreArgument(3);
+        }
+
+        /*adding the personality to the VECTOR or personalities*/
+        STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+
+        { /*scope for creating the IOTHUBMESSAGE from GWMESSAGE*/
+
+          /*gettng the GW message content*/
+            STRICT_EXPECTED_CALL(mocks, Message_GetContent(MESSAGE_HANDLE_VALID_1));
+
+            /*creating a new IOTHUB_MESSAGE*/
+            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, 1))
+                .ValidateArgumentBuffer(1, CONSTBUFFER_VALID_CONTENT1.buffer, 1);
+
+            /*every creation has its destruction - this one actually happens AFTER SendEventAsync*/
+            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*getting the IOTHUBMESSAGE properties*/
+            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*getting the GW message properties*/
+            STRICT_EXPECTED_CALL(mocks, Message_GetProperties(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+            STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*getting the GW keys and values*/
+            STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(CONSTMAP_HANDLE_VALID_1, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+                .IgnoreArgument(2)
+                .IgnoreArgument(3)
+                .IgnoreArgument(4);
+
+            /*add "source"*/
+            STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, "source", "mapping"))
+                .IgnoreArgument(1)
+                .SetReturn(MAP_ERROR);
+        }
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_02_019: [ If creating the IOTHUB_MESSAGE_HANDLE fails, then `IotHub_Receive` shall return. ]*/
+    TEST_FUNCTION(IotHub_Receive_when_creating_IOTHUB_MESSAGE_HANDLE_fails_3)
+    {
+        ///arrange
+        IotHubMocks mocks;
+        AutoConfig config;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+
+        /*the personality index is allocated for the first device*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        /*because the deviceName is brand new, it will be added as a new personality*/
+        {/*separate scope for personality building*/
+         /* create a new PERSONALITY */
+            STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+                .IgnoreArgument(1);
+         /*making a copy of the deviceName*/
+            STRICT_EXPECTED_CALL(mocks, STRING_construct("firstDevice"));
+            /*making a copy of the deviceKey*/
+            STRICT_EXPECTED_CALL(mocks, STRING_construct("cheiaDeLaPoartaVerde"));
+
+            /*getting the stored IoTHubName*/
+            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+            /*getting the stored IoTHubSuffix*/
+            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*creating the IOTHUB_CLIENT_HANDLE associated with the device*/
+            STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+                .IgnoreArgument(1)
+                .IgnoreArgument(2);
+
+            STRICT_EXPECTED_CALL(mocks, IoTHubClient_SetMessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+                .IgnoreArgument(1)
+                .IgnoreArgument(2)
+                .IgnoreArgument(3);
+        }
+
+        /*adding the personality to the VECTOR or personalities*/
+        STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+
+        { /*scope for creating the IOTHUBMESSAGE from GWMESSAGE*/
+
+          /*gettng the GW message content*/
+            STRICT_EXPECTED_CALL(mocks, Message_GetContent(MESSAGE_HANDLE_VALID_1));
+
+            /*creating a new IOTHUB_MESSAGE*/
+            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, 1))
+                .ValidateArgumentBuffer(1, CONSTBUFFER_VALID_CONTENT1.buffer, 1);
+
+            /*every creation has its destruction - this one actually happens AFTER SendEventAsync*/
+            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*getting the IOTHUBMESSAGE properties*/
+            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*getting the GW message properties*/
+            STRICT_EXPECTED_CALL(mocks, Message_GetProperties(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+            STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*getting the GW keys and values*/
+            STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(CONSTMAP_HANDLE_VALID_1, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+                .IgnoreArgument(2)
+                .IgnoreArgument(3)
+                .IgnoreArgument(4)
+                .SetReturn(CONSTMAP_ERROR);
+        }
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_02_019: [ If creating the IOTHUB_MESSAGE_HANDLE fails, then `IotHub_Receive` shall return. ]*/
+    TEST_FUNCTION(IotHub_Receive_when_creating_IOTHUB_MESSAGE_HANDLE_fails_4)
+    {
+        ///arrange
+        IotHubMocks mocks;
+        AutoConfig config;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+
+        /*the personality index is allocated for the first device*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        /*because the deviceName is brand new, it will be added as a new personality*/
+        {/*separate scope for personality building*/
+         /* create a new PERSONALITY */
+            STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+                .IgnoreArgument(1);
+         /*making a copy of the deviceName*/
+            STRICT_EXPECTED_CALL(mocks, STRING_construct("firstDevice"));
+            /*making a copy of the deviceKey*/
+            STRICT_EXPECTED_CALL(mocks, STRING_construct("cheiaDeLaPoartaVerde"));
+
+            /*getting the stored IoTHubName*/
+            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+            /*getting the stored IoTHubSuffix*/
+            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*creating the IOTHUB_CLIENT_HANDLE associated with the device*/
+            STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+                .IgnoreArgument(1)
+                .IgnoreArgument(2);
+
+            STRICT_EXPECTED_CALL(mocks, IoTHubClient_SetMessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+                .IgnoreArgument(1)
+                .IgnoreArgument(2)
+                .IgnoreArgument(3);
+        }
+
+        /*adding the personality to the VECTOR or personalities*/
+        STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+
+        { /*scope for creating the IOTHUBMESSAGE from GWMESSAGE*/
+
+          /*gettng the GW message content*/
+            STRICT_EXPECTED_CALL(mocks, Message_GetContent(MESSAGE_HANDLE_VALID_1));
+
+            /*creating a new IOTHUB_MESSAGE*/
+            whenShallIoTHubMessage_CreateFromByteArray_fail = currentIoTHubMessage_CreateFromByteArray_call + 1;
+            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, 1))
+                .ValidateArgumentBuffer(1, CONSTBUFFER_VALID_CONTENT1.buffer, 1)
+                ;
+        }
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_02_016: [ If adding a new personality to the vector fails, then `IoTHub_Receive` shall return. ]*/
+    TEST_FUNCTION(IotHub_Receive_when_adding_the_personality_fails_it_fails)
+    {
+        ///arrange
+        IotHubMocks mocks;
+        AutoConfig config;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+
+        /*the personality index is allocated for the first device*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        /*because the deviceName is brand new, it will be added as a new personality*/
+        {/*separate scope for personality building*/
+         /* create a new PERSONALITY */
+            STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+                .IgnoreArgument(1);
+            STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*making a copy of the deviceName*/
+            STRICT_EXPECTED_CALL(mocks, STRING_construct("firstDevice"));
+            STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*making a copy of the deviceKey*/
+            STRICT_EXPECTED_CALL(mocks, STRING_construct("cheiaDeLaPoartaVerde"));
+            STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG)) /*this is deviceName*/
+                .IgnoreArgument(1);
+
+            /*getting the stored IoTHubName*/
+            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+            /*getting the stored IoTHubSuffix*/
+            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*creating the IOTHUB_CLIENT_HANDLE associated with the device*/
+            STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+                .IgnoreArgument(1)
+                .IgnoreArgument(2);
+            STRICT_EXPECTED_CALL(mocks, IoTHubClient_Destroy(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            STRICT_EXPECTED_CALL(mocks, IoTHubClient_SetMessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+                .IgnoreArgument(1)
+                .IgnoreArgument(2)
+                .IgnoreArgument(3);
+        }
+
+        /*adding the personality to the VECTOR or personalities*/
+        whenShallVECTOR_push_back_fail = currentVECTOR_push_back_call + 1;
+        STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_02_014: [ If creating the personality fails then `IotHub_Receive` shall return. ]*/
+    TEST_FUNCTION(IotHub_Receive_when_creating_the_personality_fails_it_fails_1a)
+    {
+        ///arrange
+        IotHubMocks mocks;
+        AutoConfig config;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+
+        /*the personality index is allocated for the first device*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        /*because the deviceName is brand new, it will be added as a new personality*/
+        {/*separate scope for personality building*/
+         /* create a new PERSONALITY */
+            STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+                .IgnoreArgument(1);
+            STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*making a copy of the deviceName*/
+            STRICT_EXPECTED_CALL(mocks, STRING_construct("firstDevice"))
+                .SetFailReturn((STRING_HANDLE)NULL);
+
+        }
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_02_014: [ If creating the personality fails then `IotHub_Receive` shall return. ]*/
+    TEST_FUNCTION(IotHub_Receive_when_creating_the_personality_fails_it_fails_1b)
+    {
+        ///arrange
+        IotHubMocks mocks;
+        AutoConfig config;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+
+        /*the personality index is allocated for the first device*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        /*because the deviceName is brand new, it will be added as a new personality*/
+        {/*separate scope for personality building*/
+         /* create a new PERSONALITY */
+            STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+                .IgnoreArgument(1);
+            STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+         /*making a copy of the deviceName*/
+            STRICT_EXPECTED_CALL(mocks, STRING_construct("firstDevice"));
+            STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*making a copy of the deviceKey*/
+            STRICT_EXPECTED_CALL(mocks, STRING_construct("cheiaDeLaPoartaVerde"));
+            STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG)) /*this is deviceName*/
+                .IgnoreArgument(1);
+
+            /*getting the stored IoTHubName*/
+            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+            /*getting the stored IoTHubSuffix*/
+            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*creating the IOTHUB_CLIENT_HANDLE associated with the device*/
+            whenShallIoTHubClient_Create_fail = currentIoTHubClient_Create_call + 1;
+            STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+                .IgnoreArgument(1)
+                .IgnoreArgument(2);
+
+        }
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_02_014: [ If creating the personality fails then `IotHub_Receive` shall return. ]*/
+    TEST_FUNCTION(IotHub_Receive_when_creating_the_personality_fails_it_fails_1c)
+    {
+        ///arrange
+        IotHubMocks mocks;
+        AutoConfig config;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+
+        /*the personality index is allocated for the first device*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        /*because the deviceName is brand new, it will be added as a new personality*/
+        {/*separate scope for personality building*/
+         /* create a new PERSONALITY */
+            STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+                .IgnoreArgument(1);
+            STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*making a copy of the deviceName*/
+            STRICT_EXPECTED_CALL(mocks, STRING_construct("firstDevice"));
+            STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*making a copy of the deviceKey*/
+            STRICT_EXPECTED_CALL(mocks, STRING_construct("cheiaDeLaPoartaVerde"));
+            STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG)) /*this is deviceName*/
+                .IgnoreArgument(1);
+
+            /*getting the stored IoTHubName*/
+            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+            /*getting the stored IoTHubSuffix*/
+            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*creating the IOTHUB_CLIENT_HANDLE associated with the device*/
+            STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+                .IgnoreArgument(1)
+                .IgnoreArgument(2);
+            STRICT_EXPECTED_CALL(mocks, IoTHubClient_Destroy(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            STRICT_EXPECTED_CALL(mocks, IoTHubClient_SetMessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+                .IgnoreArgument(1)
+                .IgnoreArgument(2)
+                .IgnoreArgument(3)
+                .SetFailReturn(IOTHUB_CLIENT_ERROR);
+        }
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_02_014: [ If creating the personality fails then `IotHub_Receive` shall return. ]*/
+    TEST_FUNCTION(IotHub_Receive_when_creating_the_personality_fails_it_fails_2)
+    {
+        ///arrange
+        IotHubMocks mocks;
+        AutoConfig config;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+
+        /*the personality index is allocated for the first device*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        /*because the deviceName is brand new, it will be added as a new personality*/
+        {/*separate scope for personality building*/
+         /* create a new PERSONALITY */
+            STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+                .IgnoreArgument(1);
+            STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+         /*making a copy of the deviceName*/
+            STRICT_EXPECTED_CALL(mocks, STRING_construct("firstDevice"));
+            STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+                .IgnoreArgument(1);
+
+            /*making a copy of the deviceKey*/
+            whenShallSTRING_construct_fail = currentSTRING_construct_call + 2;
+            STRICT_EXPECTED_CALL(mocks, STRING_construct("cheiaDeLaPoartaVerde"));
+        }
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_02_014: [ If creating the personality fails then `IotHub_Receive` shall return. ]*/
+    TEST_FUNCTION(IotHub_Receive_when_creating_the_personality_fails_it_fails_3)
+    {
+        ///arrange
+        IotHubMocks mocks;
+        AutoConfig config;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+
+        /*the personality index is allocated for the first device*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        /*because the deviceName is brand new, it will be added as a new personality*/
+        {/*separate scope for personality building*/
+         /* create a new PERSONALITY */
+            STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+                .IgnoreArgument(1)
+                .SetFailReturn((void*)NULL);
+        }
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_31_005: [ If growing the personality index fails, then `IotHub_Receive` shall return. ]*/
+    TEST_FUNCTION(IotHub_Receive_when_growing_the_personality_index_fails_it_fails)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        mocks.ResetAllCalls();
+
+        /*the personality index is allocated for the first device*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1)
+            .SetFailReturn((void*)NULL);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .NeverInvoked();
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .NeverInvoked();
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_31_004: [ `IotHub_Receive` shall look up the personality of `deviceName` in an index of the personalities hashed by device ID. ]*/
+    /*Tests_SRS_IOTHUBMODULE_02_017: [ Otherwise `IotHub_Receive` shall not create a new personality. ]*/
+    TEST_FUNCTION(IotHub_Receive_finds_the_personalities_of_many_devices)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        mocks.ResetAllCalls();
+
+        /*enough devices to grow the index a few times*/
+        const int deviceCount = 100;
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .ExpectedTimesExactly(deviceCount);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .ExpectedTimesExactly(2 * deviceCount);
+
+        ///act
+        for (int round = 0; round < 2; round++)
+        {
+            for (int device = 0; device < deviceCount; device++)
+            {
+                (void)sprintf(deviceNameN, "device%d", device);
+                Module_Receive(module, MESSAGE_HANDLE_VALID_N);
+            }
+        }
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, (size_t)deviceCount, ((IOTHUB_HANDLE_DATA*)module)->indexCount);
+        ASSERT_IS_TRUE(((IOTHUB_HANDLE_DATA*)module)->indexCapacity >= (size_t)(2 * deviceCount));
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_31_007: [ If `maxPersonalities` is not 0 and as many personalities exist, `IotHub_Receive` shall destroy the least recently used personality, and its `IOTHUB_CLIENT_HANDLE`, before creating a new one. ]*/
+    /*Tests_SRS_IOTHUBMODULE_02_013: [ If no personality exists with a device ID equal to the value of the `deviceName` property of the message, then `IotHub_Receive` shall create a new `PERSONALITY` with the ID and key values from the message. ]*/
+    TEST_FUNCTION(IotHub_Receive_evicts_a_personality_beyond_maxPersonalities)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->maxPersonalities = 2;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_2);
+        mocks.ResetAllCalls();
+
+        /*the third device evicts firstDevice, which is then created again in place of secondDevice*/
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .ExpectedTimesExactly(2);
+
+        ///act
+        (void)strcpy(deviceNameN, "thirdDevice");
+        Module_Receive(module, MESSAGE_HANDLE_VALID_N);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        IOTHUB_HANDLE_DATA* handleData = (IOTHUB_HANDLE_DATA*)module;
+        ASSERT_ARE_EQUAL(size_t, 2, handleData->indexCount);
+        ASSERT_ARE_EQUAL(size_t, 2, BASEIMPLEMENTATION::VECTOR_size(handleData->personalities));
+        for (size_t i = 0; i < 2; i++)
+        {
+            PERSONALITY_PTR personality = *(PERSONALITY_PTR*)BASEIMPLEMENTATION::VECTOR_element(handleData->personalities, i);
+            ASSERT_ARE_EQUAL(size_t, i, personality->position);
+        }
+        ASSERT_ARE_EQUAL(char_ptr, "firstDevice", BASEIMPLEMENTATION::STRING_c_str(handleData->mostRecent->deviceName));
+        ASSERT_ARE_EQUAL(char_ptr, "thirdDevice", BASEIMPLEMENTATION::STRING_c_str(handleData->leastRecent->deviceName));
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_31_006: [ The personality found or created shall become the most recently used personality. ]*/
+    TEST_FUNCTION(IotHub_Receive_evicts_the_least_recently_used_personality)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->maxPersonalities = 2;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_2);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        mocks.ResetAllCalls();
+
+        /*secondDevice is evicted, firstDevice is kept*/
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(1);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .ExpectedTimesExactly(1);
+
+        ///act
+        (void)strcpy(deviceNameN, "thirdDevice");
+        Module_Receive(module, MESSAGE_HANDLE_VALID_N);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        IOTHUB_HANDLE_DATA* handleData = (IOTHUB_HANDLE_DATA*)module;
+        ASSERT_ARE_EQUAL(char_ptr, "firstDevice", BASEIMPLEMENTATION::STRING_c_str(handleData->mostRecent->deviceName));
+        ASSERT_ARE_EQUAL(char_ptr, "thirdDevice", BASEIMPLEMENTATION::STRING_c_str(handleData->leastRecent->deviceName));
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_31_014: [ If `batchMaxMessages` is not 0, `IotHub_Receive` shall add the IOTHUB_MESSAGE_HANDLE to the batch of the personality instead of sending it. ]*/
+    TEST_FUNCTION(IotHub_Receive_with_batching_does_not_send_the_message)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->batchMaxMessages = 3;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, 1))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .NeverInvoked();
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        IOTHUB_HANDLE_DATA* handleData = (IOTHUB_HANDLE_DATA*)module;
+        ASSERT_ARE_EQUAL(size_t, 1, handleData->mostRecent->batchCount);
+        ASSERT_ARE_EQUAL(size_t, 1, handleData->mostRecent->batchBytes);
+        ASSERT_IS_TRUE(handleData->oldestBatch == handleData->mostRecent);
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_31_022: [ If batching is on and the transport is HTTP, the IoTHubClient of a new personality shall be given the option "Batching" set to `true`, so that it posts the messages of a batch in one request. ]*/
+    TEST_FUNCTION(IotHub_Receive_with_batching_turns_on_HTTP_batching)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->batchMaxMessages = 3;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SetOption(IGNORED_PTR_ARG, "Batching", IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .IgnoreArgument(3);
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_31_020: [ `IotHub_Receive` shall send the batch once it holds `batchMaxMessages` messages or `batchMaxBytes` content bytes. ]*/
+    /*Tests_SRS_IOTHUBMODULE_31_016: [ Otherwise, the messages of a batch shall be given to `IoTHubClient_SendEventAsync` one after the other, for the transport to send them together. ]*/
+    /*Tests_SRS_IOTHUBMODULE_31_023: [ Otherwise `IotHub_GetBatchCounters` shall copy the batching counters of the module into `counters` and return 0. ]*/
+    TEST_FUNCTION(IotHub_Receive_sends_the_batch_when_it_holds_batchMaxMessages)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->batchMaxMessages = 2;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(2);
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        IOTHUB_BATCH_COUNTERS counters;
+        ASSERT_ARE_EQUAL(int, 0, IotHub_GetBatchCounters(module, &counters));
+        ASSERT_ARE_EQUAL(size_t, 1, counters.batchesSent);
+        ASSERT_ARE_EQUAL(size_t, 2, counters.messagesSent);
+        ASSERT_ARE_EQUAL(size_t, 2, counters.largestBatch);
+        ASSERT_ARE_EQUAL(size_t, 1, counters.flushedFull);
+        ASSERT_ARE_EQUAL(size_t, 0, counters.sendFailures);
+        ASSERT_IS_NULL(((IOTHUB_HANDLE_DATA*)module)->oldestBatch);
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_31_020: [ `IotHub_Receive` shall send the batch once it holds `batchMaxMessages` messages or `batchMaxBytes` content bytes. ]*/
+    TEST_FUNCTION(IotHub_Receive_sends_the_batch_when_it_holds_batchMaxBytes)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->batchMaxMessages = 10;
+        ((IOTHUB_CONFIG*)config)->batchMaxBytes = 2;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .ExpectedTimesExactly(2);
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        IOTHUB_BATCH_COUNTERS counters;
+        ASSERT_ARE_EQUAL(int, 0, IotHub_GetBatchCounters(module, &counters));
+        ASSERT_ARE_EQUAL(size_t, 1, counters.flushedBytes);
+        ASSERT_ARE_EQUAL(size_t, 0, counters.flushedFull);
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_31_017: [ With the MQTT transport, a batch shall be sent as one message whose content is a JSON array of the contents of its messages, and whose properties are those of its first message. ]*/
+    TEST_FUNCTION(IotHub_Receive_packs_the_batch_in_a_JSON_array_for_MQTT)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config(MQTT_Protocol);
+        ((IOTHUB_CONFIG*)config)->batchMaxMessages = 2;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        mocks.ResetAllCalls();
+
+        IotHub_Receive_message_content = "{}";
+        IotHub_Receive_message_size = 2;
+
+        /*the second message*/
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, 1))
+            .IgnoreArgument(1);
+        /*the batch*/
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, 7))
+            .ValidateArgumentBuffer(1, "[{},{}]", 7);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .ExpectedTimesExactly(1);
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(3);
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        IOTHUB_BATCH_COUNTERS counters;
+        ASSERT_ARE_EQUAL(int, 0, IotHub_GetBatchCounters(module, &counters));
+        ASSERT_ARE_EQUAL(size_t, 2, counters.messagesSent);
+        ASSERT_ARE_EQUAL(size_t, 0, counters.sendFailures);
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_31_018: [ The flush worker shall send every batch whose first message has waited `batchMaxMilliseconds`. ]*/
+    TEST_FUNCTION(IotHub_flush_worker_sends_the_batches_which_waited_batchMaxMilliseconds)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->batchMaxMessages = 10;
+        ((IOTHUB_CONFIG*)config)->batchMaxMilliseconds = 100;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        currentTime = 50;
+        Module_Receive(module, MESSAGE_HANDLE_VALID_2);
+        currentTime = 100;
+        mocks.ResetAllCalls();
+
+        /*the worker stops when it cannot lock the second time*/
+        whenShallLock_fail = currentLock_call + 2;
+
+        /*only the batch of firstDevice is old enough*/
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .ExpectedTimesExactly(1);
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(50))
+            .ExpectedTimesExactly(1);
+
+        ///act
+        int result = flushWorkerFunction(flushWorkerArgument);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        mocks.AssertActualAndExpectedCalls();
+        IOTHUB_HANDLE_DATA* handleData = (IOTHUB_HANDLE_DATA*)module;
+        ASSERT_ARE_EQUAL(size_t, 1, handleData->batchCounters.flushedTimeout);
+        ASSERT_ARE_EQUAL(char_ptr, "secondDevice", BASEIMPLEMENTATION::STRING_c_str(handleData->oldestBatch->deviceName));
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_31_019: [ The batch of a personality shall be sent before the personality is destroyed. ]*/
+    TEST_FUNCTION(IotHub_Receive_sends_the_batch_of_an_evicted_personality)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->maxPersonalities = 1;
+        ((IOTHUB_CONFIG*)config)->batchMaxMessages = 10;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .ExpectedTimesExactly(1);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(1);
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_2);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        IOTHUB_BATCH_COUNTERS counters;
+        ASSERT_ARE_EQUAL(int, 0, IotHub_GetBatchCounters(module, &counters));
+        ASSERT_ARE_EQUAL(size_t, 1, counters.flushedClosing);
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_31_013: [ `IotHub_Destroy` shall stop the flush worker and send the batches still waiting before destroying the personalities. ]*/
+    TEST_FUNCTION(IotHub_Destroy_stops_the_flush_worker_and_sends_the_batches)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->batchMaxMessages = 10;
+        ((IOTHUB_CONFIG*)config)->batchMaxMilliseconds = 100;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .ExpectedTimesExactly(1);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        Module_Destroy(module);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_31_021: [ If `module` or `counters` is `NULL` then `IotHub_GetBatchCounters` shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(IotHub_GetBatchCounters_with_NULL_arguments_fails)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        IOTHUB_BATCH_COUNTERS counters;
+
+        ///act
+        int result1 = IotHub_GetBatchCounters(NULL, &counters);
+        int result2 = IotHub_GetBatchCounters(module, NULL);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result1);
+        ASSERT_ARE_NOT_EQUAL(int, 0, result2);
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_31_047: [ When a message is confirmed, its personality shall have one message less in flight; a message confirmed by IoT Hub shall count its latency in the histogram of the module, the others shall be counted as failed, timed out or destroyed by their result. ]*/
+    /*Tests_SRS_IOTHUBMODULE_31_052: [ Otherwise `IotHub_GetSendCounters` shall copy the send and confirmation counters of the module into `counters` and return 0. ]*/
+    TEST_FUNCTION(IotHub_confirmation_counts_the_latency_of_the_message)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        IOTHUB_SEND_COUNTERS counters;
+        currentTime = 1000;
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        currentTime = 1100;
+
+        ///act
+        confirmLastEvent(IOTHUB_CLIENT_CONFIRMATION_OK);
+        int result = IotHub_GetSendCounters(module, &counters);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(size_t, 1, counters.sent);
+        ASSERT_ARE_EQUAL(size_t, 1, counters.confirmed);
+        ASSERT_ARE_EQUAL(size_t, 0, counters.inFlight);
+        ASSERT_ARE_EQUAL(size_t, 1, counters.largestInFlight);
+        ASSERT_ARE_EQUAL(size_t, 100, (size_t)counters.latencyTotalMilliseconds);
+        ASSERT_ARE_EQUAL(size_t, 100, (size_t)counters.latencyMaxMilliseconds);
+        ASSERT_ARE_EQUAL(size_t, 1, counters.latency[7]);
+        ASSERT_ARE_EQUAL(size_t, 0, ((IOTHUB_HANDLE_DATA*)module)->mostRecent->inFlight);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_31_047: [ When a message is confirmed, its personality shall have one message less in flight; a message confirmed by IoT Hub shall count its latency in the histogram of the module, the others shall be counted as failed, timed out or destroyed by their result. ]*/
+    TEST_FUNCTION(IotHub_confirmation_counts_the_messages_which_failed_or_timed_out)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        IOTHUB_SEND_COUNTERS counters;
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        confirmLastEvent(IOTHUB_CLIENT_CONFIRMATION_ERROR);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///act
+        confirmLastEvent(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT);
+        (void)IotHub_GetSendCounters(module, &counters);
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, 2, counters.sent);
+        ASSERT_ARE_EQUAL(size_t, 0, counters.confirmed);
+        ASSERT_ARE_EQUAL(size_t, 1, counters.failed);
+        ASSERT_ARE_EQUAL(size_t, 1, counters.timedOut);
+        ASSERT_ARE_EQUAL(size_t, 0, counters.inFlight);
+        ASSERT_ARE_EQUAL(size_t, 0, (size_t)counters.latencyTotalMilliseconds);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_31_049: [ If `maxInFlight` is not 0, a message of a personality which has `maxInFlight` messages in flight shall wait in `IotHub_Receive` for one of them to be confirmed, but at most `IOTHUB_IN_FLIGHT_MAX_WAIT_MILLISECONDS`, and shall be dropped if none is; the next messages of the personality shall be dropped without waiting until a message of the personality is confirmed. ]*/
+    TEST_FUNCTION(IotHub_Receive_with_maxInFlight_waits_for_a_confirmation_then_drops_the_message)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->maxInFlight = 1;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Condition_Wait(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IOTHUB_IN_FLIGHT_MAX_WAIT_MILLISECONDS))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .NeverInvoked();
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 1, ((IOTHUB_HANDLE_DATA*)module)->mostRecent->inFlight);
+        ASSERT_IS_TRUE(((IOTHUB_HANDLE_DATA*)module)->mostRecent->windowStalled);
+        ASSERT_ARE_EQUAL(size_t, 1, ((IOTHUB_HANDLE_DATA*)module)->sendCounters.windowWaits);
+        ASSERT_ARE_EQUAL(size_t, 1, ((IOTHUB_HANDLE_DATA*)module)->sendCounters.windowDrops);
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_31_049: [ If `maxInFlight` is not 0, a message of a personality which has `maxInFlight` messages in flight shall wait in `IotHub_Receive` for one of them to be confirmed, but at most `IOTHUB_IN_FLIGHT_MAX_WAIT_MILLISECONDS`, and shall be dropped if none is; the next messages of the personality shall be dropped without waiting until a message of the personality is confirmed. ]*/
+    TEST_FUNCTION(IotHub_Receive_with_maxInFlight_drops_without_waiting_until_a_confirmation)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->maxInFlight = 1;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Condition_Wait(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+            .IgnoreAllArguments()
+            .NeverInvoked();
+        STRICT_EXPECTED_CALL(mocks, Condition_Post(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .NeverInvoked();
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        confirmLastEvent(IOTHUB_CLIENT_CONFIRMATION_OK);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 0, ((IOTHUB_HANDLE_DATA*)module)->mostRecent->inFlight);
+        ASSERT_IS_FALSE(((IOTHUB_HANDLE_DATA*)module)->mostRecent->windowStalled);
+        ASSERT_ARE_EQUAL(size_t, 1, ((IOTHUB_HANDLE_DATA*)module)->sendCounters.windowWaits);
+        ASSERT_ARE_EQUAL(size_t, 2, ((IOTHUB_HANDLE_DATA*)module)->sendCounters.windowDrops);
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_31_067: [ If `maxInFlight` is not 0, the messages of a batch the personality has no room in flight for shall stay in the batch until the next flush, but they shall be dropped when the batch is flushed because the personality is destroyed. ]*/
+    TEST_FUNCTION(IotHub_Receive_with_maxInFlight_keeps_the_rest_of_the_batch_without_waiting)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->batchMaxMessages = 3;
+        ((IOTHUB_CONFIG*)config)->maxInFlight = 1;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Condition_Wait(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+            .IgnoreAllArguments()
+            .NeverInvoked();
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .ExpectedTimesExactly(1);
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        PERSONALITY* personality = ((IOTHUB_HANDLE_DATA*)module)->mostRecent;
+        ASSERT_ARE_EQUAL(size_t, 1, personality->inFlight);
+        ASSERT_ARE_EQUAL(size_t, 2, personality->batchCount);
+        ASSERT_IS_TRUE(((IOTHUB_HANDLE_DATA*)module)->oldestBatch == personality);
+        ASSERT_ARE_EQUAL(size_t, 1, ((IOTHUB_HANDLE_DATA*)module)->sendCounters.windowHolds);
+        ASSERT_ARE_EQUAL(size_t, 0, ((IOTHUB_HANDLE_DATA*)module)->sendCounters.windowDrops);
+        ASSERT_ARE_EQUAL(size_t, 1, ((IOTHUB_HANDLE_DATA*)module)->batchCounters.messagesSent);
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_31_067: [ If `maxInFlight` is not 0, the messages of a batch the personality has no room in flight for shall stay in the batch until the next flush, but they shall be dropped when the batch is flushed because the personality is destroyed. ]*/
+    TEST_FUNCTION(IotHub_Receive_with_maxInFlight_sends_the_rest_of_the_batch_after_a_confirmation)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->batchMaxMessages = 2;
+        ((IOTHUB_CONFIG*)config)->maxInFlight = 1;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        confirmLastEvent(IOTHUB_CLIENT_CONFIRMATION_OK);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .ExpectedTimesExactly(1);
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        PERSONALITY* personality = ((IOTHUB_HANDLE_DATA*)module)->mostRecent;
+        ASSERT_ARE_EQUAL(size_t, 1, personality->inFlight);
+        ASSERT_ARE_EQUAL(size_t, 1, personality->batchCount);
+        ASSERT_ARE_EQUAL(size_t, 0, ((IOTHUB_HANDLE_DATA*)module)->sendCounters.windowDrops);
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_31_068: [ A message which finds no room in the batch of its personality once the batch is flushed, because the personality has `maxInFlight` messages in flight, shall be dropped. ]*/
+    TEST_FUNCTION(IotHub_Receive_with_maxInFlight_drops_the_message_when_the_batch_is_full)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->batchMaxMessages = 2;
+        ((IOTHUB_CONFIG*)config)->maxInFlight = 1;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .NeverInvoked();
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 2, ((IOTHUB_HANDLE_DATA*)module)->mostRecent->batchCount);
+        ASSERT_ARE_EQUAL(size_t, 1, ((IOTHUB_HANDLE_DATA*)module)->sendCounters.windowDrops);
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_31_067: [ If `maxInFlight` is not 0, the messages of a batch the personality has no room in flight for shall stay in the batch until the next flush, but they shall be dropped when the batch is flushed because the personality is destroyed. ]*/
+    TEST_FUNCTION(IotHub_Destroy_with_maxInFlight_drops_the_rest_of_the_batches)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->batchMaxMessages = 2;
+        ((IOTHUB_CONFIG*)config)->maxInFlight = 1;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .NeverInvoked();
+
+        ///act
+        Module_Destroy(module);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_31_053: [ `IotHub_Destroy` shall destroy the lock of the send confirmations after the personalities, the messages in flight are confirmed while their IoTHubClient is destroyed. ]*/
+    TEST_FUNCTION(IotHub_Destroy_confirms_the_messages_in_flight_before_destroying_the_lock)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->maxInFlight = 4;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Condition_Post(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Condition_Deinit(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        Module_Destroy(module);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 0, pendingConfirmationCount);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_31_051: [ If `module` or `counters` is `NULL` then `IotHub_GetSendCounters` shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(IotHub_GetSendCounters_with_NULL_arguments_fails)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        IOTHUB_SEND_COUNTERS counters;
+
+        ///act
+        int result1 = IotHub_GetSendCounters(NULL, &counters);
+        int result2 = IotHub_GetSendCounters(module, NULL);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result1);
+        ASSERT_ARE_NOT_EQUAL(int, 0, result2);
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_31_032: [ If `configuration->storeDirectory` is not NULL, `IotHub_Create` shall create a lock and a replay worker thread, and batching shall be off. ]*/
+    TEST_FUNCTION(IotHub_Create_with_a_store_starts_the_replay_worker)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->storeDirectory = "store";
+        ((IOTHUB_CONFIG*)config)->batchMaxMessages = 10;
+
+        STRICT_EXPECTED_CALL(mocks, STRING_construct("store"));
+        STRICT_EXPECTED_CALL(mocks, Lock_Init())
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+
+        ///act
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(module);
+        ASSERT_ARE_EQUAL(void_ptr, (void*)module, flushWorkerArgument);
+        ASSERT_ARE_EQUAL(size_t, 0, ((IOTHUB_HANDLE_DATA*)module)->batchMaxMessages);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_31_033: [ If copying `configuration->storeDirectory` or creating the lock or the replay worker fails, `IotHub_Create` shall fail and return `NULL`. ]*/
+    TEST_FUNCTION(IotHub_Create_with_a_store_fails_when_the_replay_worker_fails)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->storeDirectory = "store";
+
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .SetReturn(THREADAPI_ERROR);
+        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(3);
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+
+        ///assert
+        ASSERT_IS_NULL(module);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_31_033: [ If copying `configuration->storeDirectory` or creating the lock or the replay worker fails, `IotHub_Create` shall fail and return `NULL`. ]*/
+    TEST_FUNCTION(IotHub_Create_with_a_store_fails_when_copying_the_directory_fails)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->storeDirectory = "store";
+
+        STRICT_EXPECTED_CALL(mocks, STRING_construct("store"))
+            .SetFailReturn((STRING_HANDLE)NULL);
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .NeverInvoked();
+        STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+
+        ///assert
+        ASSERT_IS_NULL(module);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_31_035: [ If the module has a store directory, `IotHub_Receive` shall append the content of the message and its properties, but `deviceName` and `deviceKey`, to the store of the personality, then send the records of the store its budget allows. ]*/
+    /*Tests_SRS_IOTHUBMODULE_31_036: [ The records of a store shall be sent in order by `IoTHubClient_SendEventAsync` with a confirmation callback, at most `storeReplayRate` per second per device, and at most `SEGMENT_LOG_MAX_IN_FLIGHT` waiting for their confirmation. ]*/
+    TEST_FUNCTION(IotHub_Receive_with_a_store_appends_the_message_and_sends_the_record)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->storeDirectory = "store";
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, SegmentLog_Open(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, SegmentLog_Append(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, SegmentLog_Read(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, 1))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, "k", "v"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, "deviceKey", IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .NeverInvoked();
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
         ///act
         Module_Receive(module, MESSAGE_HANDLE_VALID_1);
 
         ///assert
         mocks.AssertActualAndExpectedCalls();
+        ASSERT_IS_NOT_NULL((void*)lastEventConfirmationCallback);
+        ASSERT_ARE_EQUAL(size_t, 1, ((IOTHUB_HANDLE_DATA*)module)->mostRecent->inFlight);
 
         ///cleanup
         Module_Destroy(module);
-
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_019: [ If creating the IOTHUB_MESSAGE_HANDLE fails, then `IotHub_Receive` shall return. ]*/
-    TEST_FUNCTION(IotHub_Receive_when_creating_IOTHUB_MESSAGE_HANDLE_fails_3)
+    /*Tests_SRS_IOTHUBMODULE_31_037: [ When IoT Hub confirms a stored message, the record shall be acknowledged in the store, and the store deletes the segments whose records are all acknowledged. ]*/
+    TEST_FUNCTION(IotHub_confirmation_of_a_stored_message_acknowledges_the_record)
     {
         ///arrange
-        IotHubMocks mocks;
+        CNiceCallComparer<IotHubMocks> mocks;
         AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->storeDirectory = "store";
         auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, SegmentLog_Acknowledge(IGNORED_PTR_ARG, 1))
             .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
-
-        /*VECTOR_find_if incurs a STRING_c_str until it find the deviceName. None in this test*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-
-        /*because the deviceName is brand new, it will be added as a new personality*/
-        {/*separate scope for personality building*/
-         /* create a new PERSONALITY */
-            STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
-                .IgnoreArgument(1);
-         /*making a copy of the deviceName*/
-            STRICT_EXPECTED_CALL(mocks, STRING_construct("firstDevice"));
-            /*making a copy of the deviceKey*/
-            STRICT_EXPECTED_CALL(mocks, STRING_construct("cheiaDeLaPoartaVerde"));
-
-            /*getting the stored IoTHubName*/
-            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
-            /*getting the stored IoTHubSuffix*/
-            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
-
-            /*creating the IOTHUB_CLIENT_HANDLE associated with the device*/
-            STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-                .IgnoreArgument(1)
-                .IgnoreArgument(2);
-
-            STRICT_EXPECTED_CALL(mocks, IoTHubClient_SetMessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-                .IgnoreArgument(1)
-                .IgnoreArgument(2)
-                .IgnoreArgument(3);
-        }
-
-        /*adding the personality to the VECTOR or personalities*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+        STRICT_EXPECTED_CALL(mocks, SegmentLog_Rewind(IGNORED_PTR_ARG))
             .IgnoreArgument(1)
-            .IgnoreArgument(2);
-
-        /*getting the location of the personality in the VECTOR*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        { /*scope for creating the IOTHUBMESSAGE from GWMESSAGE*/
-
-          /*gettng the GW message content*/
-            STRICT_EXPECTED_CALL(mocks, Message_GetContent(MESSAGE_HANDLE_VALID_1));
+            .NeverInvoked();
 
-            /*creating a new IOTHUB_MESSAGE*/
-            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, 1))
-                .ValidateArgumentBuffer(1, CONSTBUFFER_VALID_CONTENT1.buffer, 1);
+        ///act
+        confirmLastEvent(IOTHUB_CLIENT_CONFIRMATION_OK);
 
-            /*every creation has its destruction - this one actually happens AFTER SendEventAsync*/
-            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 0, ((IOTHUB_HANDLE_DATA*)module)->mostRecent->inFlight);
+        ASSERT_IS_TRUE(((IOTHUB_HANDLE_DATA*)module)->mostRecent->storeConnected);
 
-            /*getting the IOTHUBMESSAGE properties*/
-            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+        ///cleanup
+        Module_Destroy(module);
+    }
 
-            /*getting the GW message properties*/
-            STRICT_EXPECTED_CALL(mocks, Message_GetProperties(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
-            STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+    /*Tests_SRS_IOTHUBMODULE_31_038: [ When a stored message fails or times out, the device shall be taken as offline and the records not acknowledged shall be read again; while a device is offline, one record at a time shall be sent, once per second, until one is confirmed. ]*/
+    TEST_FUNCTION(IotHub_failure_of_a_stored_message_rewinds_the_store_and_stops_sending)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->storeDirectory = "store";
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        mocks.ResetAllCalls();
 
-            /*getting the GW keys and values*/
-            STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(CONSTMAP_HANDLE_VALID_1, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-                .IgnoreArgument(2)
-                .IgnoreArgument(3)
-                .IgnoreArgument(4)
-                .SetReturn(CONSTMAP_ERROR);
-        }
+        STRICT_EXPECTED_CALL(mocks, SegmentLog_Rewind(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, SegmentLog_Acknowledge(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+            .IgnoreAllArguments()
+            .NeverInvoked();
+        STRICT_EXPECTED_CALL(mocks, SegmentLog_Append(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .NeverInvoked();
 
         ///act
+        confirmLastEvent(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT);
         Module_Receive(module, MESSAGE_HANDLE_VALID_1);
 
         ///assert
         mocks.AssertActualAndExpectedCalls();
+        ASSERT_IS_FALSE(((IOTHUB_HANDLE_DATA*)module)->mostRecent->storeConnected);
+        ASSERT_ARE_EQUAL(size_t, 0, ((IOTHUB_HANDLE_DATA*)module)->mostRecent->inFlight);
 
         ///cleanup
         Module_Destroy(module);
-
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_019: [ If creating the IOTHUB_MESSAGE_HANDLE fails, then `IotHub_Receive` shall return. ]*/
-    TEST_FUNCTION(IotHub_Receive_when_creating_IOTHUB_MESSAGE_HANDLE_fails_4)
+    /*Tests_SRS_IOTHUBMODULE_31_041: [ If `IoTHubClient_SendEventAsync` fails, the record shall be read again later. ]*/
+    TEST_FUNCTION(IotHub_Receive_with_a_store_rewinds_when_IoTHubClient_SendEventAsync_fails)
     {
         ///arrange
-        IotHubMocks mocks;
+        CNiceCallComparer<IotHubMocks> mocks;
         AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->storeDirectory = "store";
         auto module = Module_Create(BROKER_HANDLE_VALID, config);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .SetReturn(IOTHUB_CLIENT_ERROR);
+        STRICT_EXPECTED_CALL(mocks, SegmentLog_Rewind(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        forgetLastEvent();
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 0, ((IOTHUB_HANDLE_DATA*)module)->mostRecent->inFlight);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_31_050: [ A store shall send no record of a personality which has `maxInFlight` messages in flight, the records wait in the store instead. ]*/
+    TEST_FUNCTION(IotHub_Receive_with_a_store_keeps_the_record_when_maxInFlight_are_in_flight)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->storeDirectory = "store";
+        ((IOTHUB_CONFIG*)config)->maxInFlight = 1;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        mocks.ResetAllCalls();
 
-        /*VECTOR_find_if incurs a STRING_c_str until it find the deviceName. None in this test*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, SegmentLog_Append(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
             .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .NeverInvoked();
+        STRICT_EXPECTED_CALL(mocks, Condition_Wait(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+            .IgnoreAllArguments()
+            .NeverInvoked();
 
-        /*because the deviceName is brand new, it will be added as a new personality*/
-        {/*separate scope for personality building*/
-         /* create a new PERSONALITY */
-            STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
-                .IgnoreArgument(1);
-         /*making a copy of the deviceName*/
-            STRICT_EXPECTED_CALL(mocks, STRING_construct("firstDevice"));
-            /*making a copy of the deviceKey*/
-            STRICT_EXPECTED_CALL(mocks, STRING_construct("cheiaDeLaPoartaVerde"));
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
 
-            /*getting the stored IoTHubName*/
-            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
-            /*getting the stored IoTHubSuffix*/
-            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 1, ((IOTHUB_HANDLE_DATA*)module)->mostRecent->inFlight);
 
-            /*creating the IOTHUB_CLIENT_HANDLE associated with the device*/
-            STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-                .IgnoreArgument(1)
-                .IgnoreArgument(2);
+        ///cleanup
+        Module_Destroy(module);
+    }
 
-            STRICT_EXPECTED_CALL(mocks, IoTHubClient_SetMessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-                .IgnoreArgument(1)
-                .IgnoreArgument(2)
-                .IgnoreArgument(3);
-        }
+    /*Tests_SRS_IOTHUBMODULE_31_034: [ If the module has a store directory, a new personality shall open the segment log named after its device in it, limited to `storeMaxBytes` and `storeRetentionSeconds`; if that fails the personality shall not be created. ]*/
+    TEST_FUNCTION(IotHub_Receive_with_a_store_fails_when_SegmentLog_Open_fails)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->storeDirectory = "store";
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        mocks.ResetAllCalls();
 
-        /*adding the personality to the VECTOR or personalities*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+        STRICT_EXPECTED_CALL(mocks, SegmentLog_Open(IGNORED_PTR_ARG))
             .IgnoreArgument(1)
-            .IgnoreArgument(2);
-
-        /*getting the location of the personality in the VECTOR*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        { /*scope for creating the IOTHUBMESSAGE from GWMESSAGE*/
-
-          /*gettng the GW message content*/
-            STRICT_EXPECTED_CALL(mocks, Message_GetContent(MESSAGE_HANDLE_VALID_1));
-
-            /*creating a new IOTHUB_MESSAGE*/
-            whenShallIoTHubMessage_CreateFromByteArray_fail = currentIoTHubMessage_CreateFromByteArray_call + 1;
-            STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, 1))
-                .ValidateArgumentBuffer(1, CONSTBUFFER_VALID_CONTENT1.buffer, 1)
-                ;
-        }
+            .SetFailReturn((SEGMENT_LOG_HANDLE)NULL);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .NeverInvoked();
+        STRICT_EXPECTED_CALL(mocks, SegmentLog_Append(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+            .IgnoreAllArguments()
+            .NeverInvoked();
 
         ///act
         Module_Receive(module, MESSAGE_HANDLE_VALID_1);
 
         ///assert
         mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 0, VECTOR_size(((IOTHUB_HANDLE_DATA*)module)->personalities));
 
         ///cleanup
         Module_Destroy(module);
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_016: [ If adding a new personality to the vector fails, then `IoTHub_Receive` shall return. ]*/
-    TEST_FUNCTION(IotHub_Receive_when_adding_the_personality_fails_it_fails)
+    /*Tests_SRS_IOTHUBMODULE_31_040: [ `IotHub_Destroy` shall stop the replay worker; a personality shall destroy its IoTHubClient before closing its store, the records not acknowledged stay on disk and are sent once the personality of the device is created again. ]*/
+    TEST_FUNCTION(IotHub_Destroy_with_a_store_stops_the_replay_worker_and_closes_the_stores)
     {
         ///arrange
-        IotHubMocks mocks;
+        CNiceCallComparer<IotHubMocks> mocks;
         AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->storeDirectory = "store";
         auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        confirmLastEvent(IOTHUB_CLIENT_CONFIRMATION_OK);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, SegmentLog_Close(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(2);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+        ///act
+        Module_Destroy(module);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+    }
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+    /*Tests_SRS_IOTHUBMODULE_31_056: [ If `configuration->provisioningQueueSize` is not 0, `IotHub_Create` shall create a lock unless batching or the store has created one, a condition and a provisioning worker thread. ]*/
+    TEST_FUNCTION(IotHub_Create_with_provisioningQueueSize_starts_the_provisioning_worker)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->provisioningQueueSize = 4;
 
-        /*VECTOR_find_if incurs a STRING_c_str until it find the deviceName. None in this test*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, Lock_Init())
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, Condition_Init());
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
             .IgnoreAllArguments();
 
-        /*because the deviceName is brand new, it will be added as a new personality*/
-        {/*separate scope for personality building*/
-         /* create a new PERSONALITY */
-            STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
-                .IgnoreArgument(1);
-            STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
-
-            /*making a copy of the deviceName*/
-            STRICT_EXPECTED_CALL(mocks, STRING_construct("firstDevice"));
-            STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
-
-            /*making a copy of the deviceKey*/
-            STRICT_EXPECTED_CALL(mocks, STRING_construct("cheiaDeLaPoartaVerde"));
-            STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG)) /*this is deviceName*/
-                .IgnoreArgument(1);
-
-            /*getting the stored IoTHubName*/
-            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
-            /*getting the stored IoTHubSuffix*/
-            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+        ///act
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
 
-            /*creating the IOTHUB_CLIENT_HANDLE associated with the device*/
-            STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-                .IgnoreArgument(1)
-                .IgnoreArgument(2);
-            STRICT_EXPECTED_CALL(mocks, IoTHubClient_Destroy(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+        ///assert
+        ASSERT_IS_NOT_NULL(module);
+        ASSERT_ARE_EQUAL(void_ptr, (void*)module, flushWorkerArgument);
+        ASSERT_IS_NOT_NULL(((IOTHUB_HANDLE_DATA*)module)->provisionWorker);
+        mocks.AssertActualAndExpectedCalls();
 
-            STRICT_EXPECTED_CALL(mocks, IoTHubClient_SetMessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-                .IgnoreArgument(1)
-                .IgnoreArgument(2)
-                .IgnoreArgument(3);
-        }
+        ///cleanup
+        Module_Destroy(module);
+    }
 
-        /*adding the personality to the VECTOR or personalities*/
-        whenShallVECTOR_push_back_fail = currentVECTOR_push_back_call + 1;
-        STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+    /*Tests_SRS_IOTHUBMODULE_31_057: [ If creating the lock, the condition or the provisioning worker fails, `IotHub_Create` shall fail and return `NULL`. ]*/
+    TEST_FUNCTION(IotHub_Create_fails_when_the_provisioning_worker_fails)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->provisioningQueueSize = 4;
+
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .SetFailReturn(THREADAPI_ERROR);
+        STRICT_EXPECTED_CALL(mocks, Condition_Deinit(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
             .IgnoreArgument(1)
-            .IgnoreArgument(2);
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
         ///act
-        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
 
         ///assert
+        ASSERT_IS_NULL(module);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
-        Module_Destroy(module);
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_014: [ If creating the personality fails then `IotHub_Receive` shall return. ]*/
-    TEST_FUNCTION(IotHub_Receive_when_creating_the_personality_fails_it_fails_1a)
+    /*Tests_SRS_IOTHUBMODULE_31_058: [ If `provisioningQueueSize` is not 0, a new personality shall be created without its IoTHubClient and queued for the provisioning worker, which creates the IoTHubClients of the queued personalities one after the other without holding the lock of the module. ]*/
+    /*Tests_SRS_IOTHUBMODULE_31_059: [ Until the IoTHubClient of its personality is created, `IotHub_Receive` shall hold up to `provisioningQueueSize` messages of the device and drop the next ones; with a store the messages are appended to the store instead. ]*/
+    TEST_FUNCTION(IotHub_Receive_with_provisioningQueueSize_holds_the_message_until_the_IoTHubClient_is_created)
     {
         ///arrange
-        IotHubMocks mocks;
+        CNiceCallComparer<IotHubMocks> mocks;
         AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->provisioningQueueSize = 4;
         auto module = Module_Create(BROKER_HANDLE_VALID, config);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .NeverInvoked();
+        STRICT_EXPECTED_CALL(mocks, Condition_Post(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .NeverInvoked();
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .NeverInvoked();
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
 
-        /*VECTOR_find_if incurs a STRING_c_str until it find the deviceName. None in this test*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        IOTHUB_HANDLE_DATA* handleData = (IOTHUB_HANDLE_DATA*)module;
+        ASSERT_IS_NULL(handleData->mostRecent->iothubHandle);
+        ASSERT_ARE_EQUAL(size_t, 1, handleData->mostRecent->heldCount);
+        ASSERT_ARE_EQUAL(void_ptr, (void*)handleData->mostRecent, (void*)handleData->oldestProvision);
 
-        /*because the deviceName is brand new, it will be added as a new personality*/
-        {/*separate scope for personality building*/
-         /* create a new PERSONALITY */
-            STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
-                .IgnoreArgument(1);
-            STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+        ///cleanup
+        Module_Destroy(module);
+    }
 
-            /*making a copy of the deviceName*/
-            STRICT_EXPECTED_CALL(mocks, STRING_construct("firstDevice"))
-                .SetFailReturn((STRING_HANDLE)NULL);
+    /*Tests_SRS_IOTHUBMODULE_31_059: [ Until the IoTHubClient of its personality is created, `IotHub_Receive` shall hold up to `provisioningQueueSize` messages of the device and drop the next ones; with a store the messages are appended to the store instead. ]*/
+    TEST_FUNCTION(IotHub_Receive_with_provisioningQueueSize_drops_the_messages_beyond_the_queue)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->provisioningQueueSize = 1;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        mocks.ResetAllCalls();
 
-        }
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(1);
 
         ///act
         Module_Receive(module, MESSAGE_HANDLE_VALID_1);
 
         ///assert
         mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 1, ((IOTHUB_HANDLE_DATA*)module)->mostRecent->heldCount);
 
         ///cleanup
         Module_Destroy(module);
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_014: [ If creating the personality fails then `IotHub_Receive` shall return. ]*/
-    TEST_FUNCTION(IotHub_Receive_when_creating_the_personality_fails_it_fails_1b)
+    /*Tests_SRS_IOTHUBMODULE_31_060: [ Once the IoTHubClient of a personality is created, the provisioning worker shall send the messages held for it in the order they arrived, or the records of its store. ]*/
+    TEST_FUNCTION(IotHub_provisioning_worker_creates_the_IoTHubClient_and_sends_the_held_messages)
     {
         ///arrange
-        IotHubMocks mocks;
+        CNiceCallComparer<IotHubMocks> mocks;
         AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->provisioningQueueSize = 4;
         auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+        /*the worker locks to pick the personality and to hand it its IoTHubClient, each send locks once, the next round fails*/
+        whenShallLock_fail = currentLock_call + 5;
 
-        /*VECTOR_find_if incurs a STRING_c_str until it find the deviceName. None in this test*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
             .IgnoreAllArguments();
-
-        /*because the deviceName is brand new, it will be added as a new personality*/
-        {/*separate scope for personality building*/
-         /* create a new PERSONALITY */
-            STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
-                .IgnoreArgument(1);
-            STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
-
-         /*making a copy of the deviceName*/
-            STRICT_EXPECTED_CALL(mocks, STRING_construct("firstDevice"));
-            STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
-
-            /*making a copy of the deviceKey*/
-            STRICT_EXPECTED_CALL(mocks, STRING_construct("cheiaDeLaPoartaVerde"));
-            STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG)) /*this is deviceName*/
-                .IgnoreArgument(1);
-
-            /*getting the stored IoTHubName*/
-            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
-            /*getting the stored IoTHubSuffix*/
-            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
-
-            /*creating the IOTHUB_CLIENT_HANDLE associated with the device*/
-            whenShallIoTHubClient_Create_fail = currentIoTHubClient_Create_call + 1;
-            STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-                .IgnoreArgument(1)
-                .IgnoreArgument(2);
-
-        }
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SetMessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(2);
 
         ///act
-        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        int result = flushWorkerFunction(flushWorkerArgument);
 
         ///assert
+        ASSERT_ARE_EQUAL(int, 0, result);
         mocks.AssertActualAndExpectedCalls();
+        IOTHUB_HANDLE_DATA* handleData = (IOTHUB_HANDLE_DATA*)module;
+        ASSERT_IS_NOT_NULL(handleData->mostRecent->iothubHandle);
+        ASSERT_ARE_EQUAL(size_t, 0, handleData->mostRecent->heldCount);
+        ASSERT_IS_NULL(handleData->oldestProvision);
+        ASSERT_IS_NULL(handleData->provisioning);
 
         ///cleanup
         Module_Destroy(module);
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_014: [ If creating the personality fails then `IotHub_Receive` shall return. ]*/
-    TEST_FUNCTION(IotHub_Receive_when_creating_the_personality_fails_it_fails_1c)
+    /*Tests_SRS_IOTHUBMODULE_31_069: [ Once the IoTHubClient of a personality is created, a message of a personality which has `maxInFlight` messages in flight, or which has messages held still, shall be held after them, up to `provisioningQueueSize` messages, and the next ones dropped; the held messages are sent before the next message of the device. ]*/
+    TEST_FUNCTION(IotHub_provisioning_worker_with_maxInFlight_keeps_the_held_messages_without_waiting)
     {
         ///arrange
-        IotHubMocks mocks;
+        CNiceCallComparer<IotHubMocks> mocks;
         AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->provisioningQueueSize = 4;
+        ((IOTHUB_CONFIG*)config)->maxInFlight = 1;
         auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+        /*the worker locks twice, the two sends and the count of the held message lock once each, the next round fails*/
+        whenShallLock_fail = currentLock_call + 6;
 
-        /*VECTOR_find_if incurs a STRING_c_str until it find the deviceName. None in this test*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, Condition_Wait(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+            .IgnoreAllArguments()
+            .NeverInvoked();
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .ExpectedTimesExactly(1);
 
-        /*because the deviceName is brand new, it will be added as a new personality*/
-        {/*separate scope for personality building*/
-         /* create a new PERSONALITY */
-            STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
-                .IgnoreArgument(1);
-            STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+        ///act
+        int result = flushWorkerFunction(flushWorkerArgument);
 
-            /*making a copy of the deviceName*/
-            STRICT_EXPECTED_CALL(mocks, STRING_construct("firstDevice"));
-            STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+        ///assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        mocks.AssertActualAndExpectedCalls();
+        IOTHUB_HANDLE_DATA* handleData = (IOTHUB_HANDLE_DATA*)module;
+        ASSERT_ARE_EQUAL(size_t, 1, handleData->mostRecent->inFlight);
+        ASSERT_ARE_EQUAL(size_t, 1, handleData->mostRecent->heldCount);
+        ASSERT_ARE_EQUAL(size_t, 1, handleData->sendCounters.windowHolds);
 
-            /*making a copy of the deviceKey*/
-            STRICT_EXPECTED_CALL(mocks, STRING_construct("cheiaDeLaPoartaVerde"));
-            STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG)) /*this is deviceName*/
-                .IgnoreArgument(1);
+        ///cleanup
+        Module_Destroy(module);
+    }
 
-            /*getting the stored IoTHubName*/
-            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
-            /*getting the stored IoTHubSuffix*/
-            STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+    /*Tests_SRS_IOTHUBMODULE_31_061: [ If creating the IoTHubClient fails, the provisioning worker shall destroy the personality and the messages held for it; the next message of the device creates the personality again. ]*/
+    TEST_FUNCTION(IotHub_provisioning_worker_destroys_the_personality_when_the_IoTHubClient_fails)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->provisioningQueueSize = 4;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        mocks.ResetAllCalls();
 
-            /*creating the IOTHUB_CLIENT_HANDLE associated with the device*/
-            STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-                .IgnoreArgument(1)
-                .IgnoreArgument(2);
-            STRICT_EXPECTED_CALL(mocks, IoTHubClient_Destroy(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+        whenShallLock_fail = currentLock_call + 3;
 
-            STRICT_EXPECTED_CALL(mocks, IoTHubClient_SetMessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-                .IgnoreArgument(1)
-                .IgnoreArgument(2)
-                .IgnoreArgument(3)
-                .SetFailReturn(IOTHUB_CLIENT_ERROR);
-        }
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .SetFailReturn((IOTHUB_CLIENT_HANDLE)NULL);
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(1);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .NeverInvoked();
 
         ///act
-        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        int result = flushWorkerFunction(flushWorkerArgument);
 
         ///assert
+        ASSERT_ARE_EQUAL(int, 0, result);
         mocks.AssertActualAndExpectedCalls();
+        IOTHUB_HANDLE_DATA* handleData = (IOTHUB_HANDLE_DATA*)module;
+        ASSERT_ARE_EQUAL(size_t, 0, VECTOR_size(handleData->personalities));
+        ASSERT_IS_NULL(handleData->mostRecent);
 
         ///cleanup
         Module_Destroy(module);
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_014: [ If creating the personality fails then `IotHub_Receive` shall return. ]*/
-    TEST_FUNCTION(IotHub_Receive_when_creating_the_personality_fails_it_fails_2)
+    /*Tests_SRS_IOTHUBMODULE_31_063: [ `IotHub_Destroy` shall stop the provisioning worker before the other workers; the messages held for a personality without an IoTHubClient are dropped. ]*/
+    TEST_FUNCTION(IotHub_Destroy_stops_the_provisioning_worker_and_drops_the_held_messages)
     {
         ///arrange
-        IotHubMocks mocks;
+        CNiceCallComparer<IotHubMocks> mocks;
         AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->provisioningQueueSize = 4;
         auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, Condition_Post(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
-
-        /*VECTOR_find_if incurs a STRING_c_str until it find the deviceName. None in this test*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
             .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, Condition_Deinit(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .NeverInvoked();
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(2);
 
-        /*because the deviceName is brand new, it will be added as a new personality*/
-        {/*separate scope for personality building*/
-         /* create a new PERSONALITY */
-            STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
-                .IgnoreArgument(1);
-            STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+        ///act
+        Module_Destroy(module);
 
-         /*making a copy of the deviceName*/
-            STRICT_EXPECTED_CALL(mocks, STRING_construct("firstDevice"));
-            STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-                .IgnoreArgument(1);
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+    }
 
-            /*making a copy of the deviceKey*/
-            whenShallSTRING_construct_fail = currentSTRING_construct_call + 2;
-            STRICT_EXPECTED_CALL(mocks, STRING_construct("cheiaDeLaPoartaVerde"));
-        }
+    /*Tests_SRS_IOTHUBMODULE_31_064: [ If `module` is `NULL`, or `devices` is `NULL` and `deviceCount` is not 0, then `IotHub_ProvisionDevices` shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(IotHub_ProvisionDevices_with_NULL_arguments_fails)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        IOTHUB_DEVICE devices[1] = { { "firstDevice", "cheiaDeLaPoartaVerde" } };
 
         ///act
-        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        int result1 = IotHub_ProvisionDevices(NULL, devices, 1);
+        int result2 = IotHub_ProvisionDevices(module, NULL, 1);
 
         ///assert
-        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_NOT_EQUAL(int, 0, result1);
+        ASSERT_ARE_NOT_EQUAL(int, 0, result2);
+        ASSERT_ARE_EQUAL(size_t, 0, VECTOR_size(((IOTHUB_HANDLE_DATA*)module)->personalities));
 
         ///cleanup
         Module_Destroy(module);
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_014: [ If creating the personality fails then `IotHub_Receive` shall return. ]*/
-    TEST_FUNCTION(IotHub_Receive_when_creating_the_personality_fails_it_fails_3)
+    /*Tests_SRS_IOTHUBMODULE_31_065: [ `IotHub_ProvisionDevices` shall find or create the personality of every device of `devices`, as `IotHub_Receive` does; with a provisioning worker the IoTHubClients are created by the worker. ]*/
+    /*Tests_SRS_IOTHUBMODULE_31_066: [ `IotHub_ProvisionDevices` shall return 0 if every device has its personality and a non-zero value otherwise. ]*/
+    TEST_FUNCTION(IotHub_ProvisionDevices_creates_the_personalities)
     {
         ///arrange
-        IotHubMocks mocks;
+        CNiceCallComparer<IotHubMocks> mocks;
         AutoConfig config;
         auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        IOTHUB_DEVICE devices[2] = { { "firstDevice", "cheiaDeLaPoartaVerde" }, { "secondDevice", "red" } };
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .ExpectedTimesExactly(2);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+        ///act
+        int result = IotHub_ProvisionDevices(module, devices, 2);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+        ///assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 2, VECTOR_size(((IOTHUB_HANDLE_DATA*)module)->personalities));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+        ///cleanup
+        Module_Destroy(module);
+    }
 
-        /*VECTOR_find_if incurs a STRING_c_str until it find the deviceName. None in this test*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
+    /*Tests_SRS_IOTHUBMODULE_31_066: [ `IotHub_ProvisionDevices` shall return 0 if every device has its personality and a non-zero value otherwise. ]*/
+    TEST_FUNCTION(IotHub_ProvisionDevices_fails_when_a_device_has_no_key)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        IOTHUB_DEVICE devices[2] = { { "firstDevice", NULL }, { "secondDevice", "red" } };
+        mocks.ResetAllCalls();
 
-        /*because the deviceName is brand new, it will be added as a new personality*/
-        {/*separate scope for personality building*/
-         /* create a new PERSONALITY */
-            STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
-                .IgnoreArgument(1)
-                .SetFailReturn((void*)NULL);
-        }
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .ExpectedTimesExactly(1);
 
         ///act
-        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        int result = IotHub_ProvisionDevices(module, devices, 2);
 
         ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
         mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 1, VECTOR_size(((IOTHUB_HANDLE_DATA*)module)->personalities));
 
         ///cleanup
         Module_Destroy(module);
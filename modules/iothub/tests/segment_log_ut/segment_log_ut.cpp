@@ -0,0 +1,729 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <cstdlib>
+#include <cstddef>
+#include <cstdio>
+#include <cstdarg>
+#include <ctime>
+#include "testrunnerswitcher.h"
+#include "micromock.h"
+#include "micromockcharstararenullterminatedstrings.h"
+
+#ifdef WIN32
+#include <direct.h>
+#define make_directory(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define make_directory(path) mkdir(path, 0700)
+#endif
+
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/vector.h"
+#include "azure_c_shared_utility/vector_types_internal.h"
+#include "azure_c_shared_utility/strings.h"
+
+#ifndef GB_TIME_INTERCEPT
+#error these unit tests require the symbol GB_TIME_INTERCEPT to be defined
+#else
+extern "C"
+{
+    extern time_t gb_time(time_t *timer);
+}
+#endif
+
+#define GBALLOC_H
+extern "C" int gballoc_init(void);
+extern "C" void gballoc_deinit(void);
+extern "C" void* gballoc_malloc(size_t size);
+extern "C" void* gballoc_calloc(size_t nmemb, size_t size);
+extern "C" void* gballoc_realloc(void* ptr, size_t size);
+extern "C" void gballoc_free(void* ptr);
+
+namespace BASEIMPLEMENTATION
+{
+#define Lock(x) (LOCK_OK + gballocState - gballocState) /*compiler warning about constant in if condition*/
+#define Unlock(x) (LOCK_OK + gballocState - gballocState)
+#define Lock_Init() (LOCK_HANDLE)0x42
+#define Lock_Deinit(x) (LOCK_OK + gballocState - gballocState)
+#include "gballoc.c"
+#undef Lock
+#undef Unlock
+#undef Lock_Init
+#undef Lock_Deinit
+
+#include "vector.c"
+#include "strings.c"
+};
+
+#include "segment_log.h"
+#include "segment_file_test.h"
+
+/*the segments of the tests are real files in this directory*/
+#define TEST_DIRECTORY "segment_log_ut_files"
+#define TEST_NAME "device"
+#define TEST_PREFIX TEST_DIRECTORY "/" TEST_NAME
+#define TEST_SEGMENT_COUNT 64
+#define TEST_RECORD_SIZE SEGMENT_FILE_TEST_RECORD_SIZE
+#define TEST_RECORD_HEADER_SIZE 24
+
+static MICROMOCK_MUTEX_HANDLE g_testByTest;
+static MICROMOCK_GLOBAL_SEMAPHORE_HANDLE g_dllByDll;
+
+static time_t currentTime;
+
+/*poor man mock, STRING_construct_sprintf takes ...*/
+extern "C" STRING_HANDLE STRING_construct_sprintf(const char* format, ...)
+{
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    (void)vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    return BASEIMPLEMENTATION::STRING_construct(buffer);
+}
+
+TYPED_MOCK_CLASS(SegmentLogMocks, CGlobalMock)
+{
+public:
+
+    // memory
+    MOCK_STATIC_METHOD_1(, void*, gballoc_malloc, size_t, size)
+        void* result2 = BASEIMPLEMENTATION::gballoc_malloc(size);
+    MOCK_METHOD_END(void*, result2);
+
+    MOCK_STATIC_METHOD_2(, void*, gballoc_realloc, void*, ptr, size_t, size)
+        void* result2 = BASEIMPLEMENTATION::gballoc_realloc(ptr, size);
+    MOCK_METHOD_END(void*, result2);
+
+    MOCK_STATIC_METHOD_1(, void, gballoc_free, void*, ptr)
+        BASEIMPLEMENTATION::gballoc_free(ptr);
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_1(, VECTOR_HANDLE, VECTOR_create, size_t, elementSize)
+        VECTOR_HANDLE result2 = BASEIMPLEMENTATION::VECTOR_create(elementSize);
+    MOCK_METHOD_END(VECTOR_HANDLE, result2)
+
+    MOCK_STATIC_METHOD_1(, void, VECTOR_destroy, VECTOR_HANDLE, handle)
+        BASEIMPLEMENTATION::VECTOR_destroy(handle);
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_3(, int, VECTOR_push_back, VECTOR_HANDLE, handle, const void*, elements, size_t, numElements)
+    MOCK_METHOD_END(int, BASEIMPLEMENTATION::VECTOR_push_back(handle, elements, numElements))
+
+    MOCK_STATIC_METHOD_2(, void*, VECTOR_element, VECTOR_HANDLE, handle, size_t, index)
+    MOCK_METHOD_END(void*, BASEIMPLEMENTATION::VECTOR_element(handle, index))
+
+    MOCK_STATIC_METHOD_3(, void, VECTOR_erase, VECTOR_HANDLE, handle, void*, elements, size_t, numElements)
+        BASEIMPLEMENTATION::VECTOR_erase(handle, elements, numElements);
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_1(, size_t, VECTOR_size, VECTOR_HANDLE, handle)
+    MOCK_METHOD_END(size_t, BASEIMPLEMENTATION::VECTOR_size(handle))
+
+    MOCK_STATIC_METHOD_1(, void*, VECTOR_front, VECTOR_HANDLE, handle)
+    MOCK_METHOD_END(void*, BASEIMPLEMENTATION::VECTOR_front(handle))
+
+    MOCK_STATIC_METHOD_1(, void*, VECTOR_back, VECTOR_HANDLE, handle)
+    MOCK_METHOD_END(void*, BASEIMPLEMENTATION::VECTOR_back(handle))
+
+    MOCK_STATIC_METHOD_1(, STRING_HANDLE, STRING_construct, const char*, source)
+    MOCK_METHOD_END(STRING_HANDLE, BASEIMPLEMENTATION::STRING_construct(source))
+
+    MOCK_STATIC_METHOD_2(, int, STRING_concat, STRING_HANDLE, s1, const char*, s2)
+    MOCK_METHOD_END(int, BASEIMPLEMENTATION::STRING_concat(s1, s2));
+
+    MOCK_STATIC_METHOD_1(, const char*, STRING_c_str, STRING_HANDLE, s)
+    MOCK_METHOD_END(const char*, BASEIMPLEMENTATION::STRING_c_str(s))
+
+    MOCK_STATIC_METHOD_1(, void, STRING_delete, STRING_HANDLE, s)
+        BASEIMPLEMENTATION::STRING_delete(s);
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_1(, time_t, gb_time, time_t*, timer)
+    MOCK_METHOD_END(time_t, currentTime)
+};
+
+DECLARE_GLOBAL_MOCK_METHOD_1(SegmentLogMocks, , void*, gballoc_malloc, size_t, size);
+DECLARE_GLOBAL_MOCK_METHOD_2(SegmentLogMocks, , void*, gballoc_realloc, void*, ptr, size_t, size);
+DECLARE_GLOBAL_MOCK_METHOD_1(SegmentLogMocks, , void, gballoc_free, void*, ptr);
+DECLARE_GLOBAL_MOCK_METHOD_1(SegmentLogMocks, , VECTOR_HANDLE, VECTOR_create, size_t, elementSize);
+DECLARE_GLOBAL_MOCK_METHOD_1(SegmentLogMocks, , void, VECTOR_destroy, VECTOR_HANDLE, handle);
+DECLARE_GLOBAL_MOCK_METHOD_3(SegmentLogMocks, , int, VECTOR_push_back, VECTOR_HANDLE, handle, const void*, elements, size_t, numElements);
+DECLARE_GLOBAL_MOCK_METHOD_2(SegmentLogMocks, , void*, VECTOR_element, VECTOR_HANDLE, handle, size_t, index);
+DECLARE_GLOBAL_MOCK_METHOD_3(SegmentLogMocks, , void, VECTOR_erase, VECTOR_HANDLE, handle, void*, elements, size_t, numElements);
+DECLARE_GLOBAL_MOCK_METHOD_1(SegmentLogMocks, , size_t, VECTOR_size, VECTOR_HANDLE, handle);
+DECLARE_GLOBAL_MOCK_METHOD_1(SegmentLogMocks, , void*, VECTOR_front, VECTOR_HANDLE, handle);
+DECLARE_GLOBAL_MOCK_METHOD_1(SegmentLogMocks, , void*, VECTOR_back, VECTOR_HANDLE, handle);
+DECLARE_GLOBAL_MOCK_METHOD_1(SegmentLogMocks, , STRING_HANDLE, STRING_construct, const char*, source);
+DECLARE_GLOBAL_MOCK_METHOD_2(SegmentLogMocks, , int, STRING_concat, STRING_HANDLE, s1, const char*, s2);
+DECLARE_GLOBAL_MOCK_METHOD_1(SegmentLogMocks, , const char*, STRING_c_str, STRING_HANDLE, s);
+DECLARE_GLOBAL_MOCK_METHOD_1(SegmentLogMocks, , void, STRING_delete, STRING_HANDLE, s);
+DECLARE_GLOBAL_MOCK_METHOD_1(SegmentLogMocks, , time_t, gb_time, time_t*, timer);
+
+static SEGMENT_LOG_CONFIG makeConfig(const char* name, size_t segmentMaxBytes, size_t maxBytes, unsigned int retentionSeconds)
+{
+    SEGMENT_LOG_CONFIG config;
+    config.directory = TEST_DIRECTORY;
+    config.name = name;
+    config.segmentMaxBytes = segmentMaxBytes;
+    config.maxBytes = maxBytes;
+    config.retentionSeconds = retentionSeconds;
+    return config;
+}
+
+/*prefix is the directory and the file name of a log*/
+static void deleteFiles(const char* prefix)
+{
+    static const char* const extensions[] = { "seg" };
+    SegmentFileTest_DeleteFiles(prefix, "log", extensions, sizeof(extensions) / sizeof(extensions[0]), TEST_SEGMENT_COUNT);
+}
+
+/*records hold their number, so their order can be checked*/
+static void appendRecords(SEGMENT_LOG_HANDLE log, int first, int count)
+{
+    for (int i = first; i < first + count; i++)
+    {
+        char record[TEST_RECORD_SIZE + 1];
+        SegmentFileTest_MakeRecord(record, i);
+        ASSERT_ARE_EQUAL(int, 0, SegmentLog_Append(log, (const unsigned char*)record, TEST_RECORD_SIZE));
+    }
+}
+
+/*returns the number held by the next record, -1 when there is none*/
+static int readRecord(SEGMENT_LOG_HANDLE log, uint64_t* sequence)
+{
+    const unsigned char* record;
+    size_t size;
+    ASSERT_ARE_EQUAL(int, 0, SegmentLog_Read(log, &record, &size, sequence));
+    int result;
+    if (record == NULL)
+    {
+        result = -1;
+    }
+    else
+    {
+        ASSERT_ARE_EQUAL(size_t, TEST_RECORD_SIZE, size);
+        result = SegmentFileTest_RecordNumber(record);
+    }
+    return result;
+}
+
+BEGIN_TEST_SUITE(segment_log_ut)
+
+    TEST_SUITE_INITIALIZE(TestClassInitialize)
+    {
+        TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+        g_testByTest = MicroMockCreateMutex();
+        ASSERT_IS_NOT_NULL(g_testByTest);
+        (void)make_directory(TEST_DIRECTORY);
+    }
+
+    TEST_SUITE_CLEANUP(TestClassCleanup)
+    {
+        MicroMockDestroyMutex(g_testByTest);
+        TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    }
+
+    TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+    {
+        if (!MicroMockAcquireMutex(g_testByTest))
+        {
+            ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+        }
+        currentTime = 1000;
+        deleteFiles(TEST_PREFIX);
+    }
+
+    TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+    {
+        deleteFiles(TEST_PREFIX);
+        if (!MicroMockReleaseMutex(g_testByTest))
+        {
+            ASSERT_FAIL("failure in test framework at ReleaseMutex");
+        }
+    }
+
+    /*Tests_SRS_SEGMENT_LOG_31_001: [ If `config`, `config->directory` or `config->name` is NULL then `SegmentLog_Open` shall fail and return NULL. ]*/
+    TEST_FUNCTION(SegmentLog_Open_with_NULL_config_fails)
+    {
+        ///arrange
+        SegmentLogMocks mocks;
+
+        ///act
+        SEGMENT_LOG_HANDLE result = SegmentLog_Open(NULL);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_IS_NULL(result);
+    }
+
+    /*Tests_SRS_SEGMENT_LOG_31_001: [ If `config`, `config->directory` or `config->name` is NULL then `SegmentLog_Open` shall fail and return NULL. ]*/
+    TEST_FUNCTION(SegmentLog_Open_with_NULL_directory_fails)
+    {
+        ///arrange
+        SegmentLogMocks mocks;
+        SEGMENT_LOG_CONFIG config = makeConfig(TEST_NAME, 0, 0, 0);
+        config.directory = NULL;
+
+        ///act
+        SEGMENT_LOG_HANDLE result = SegmentLog_Open(&config);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_IS_NULL(result);
+    }
+
+    /*Tests_SRS_SEGMENT_LOG_31_001: [ If `config`, `config->directory` or `config->name` is NULL then `SegmentLog_Open` shall fail and return NULL. ]*/
+    TEST_FUNCTION(SegmentLog_Open_with_NULL_name_fails)
+    {
+        ///arrange
+        SegmentLogMocks mocks;
+        SEGMENT_LOG_CONFIG config = makeConfig(NULL, 0, 0, 0);
+
+        ///act
+        SEGMENT_LOG_HANDLE result = SegmentLog_Open(&config);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_IS_NULL(result);
+    }
+
+    /*Tests_SRS_SEGMENT_LOG_31_003: [ If `SegmentLog_Open` encounters an internal failure it shall fail and return NULL. ]*/
+    TEST_FUNCTION(SegmentLog_Open_fails_when_malloc_fails)
+    {
+        ///arrange
+        SegmentLogMocks mocks;
+        SEGMENT_LOG_CONFIG config = makeConfig(TEST_NAME, 0, 0, 0);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1)
+            .SetFailReturn((void*)NULL);
+
+        ///act
+        SEGMENT_LOG_HANDLE result = SegmentLog_Open(&config);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_IS_NULL(result);
+    }
+
+    /*Tests_SRS_SEGMENT_LOG_31_003: [ If `SegmentLog_Open` encounters an internal failure it shall fail and return NULL. ]*/
+    TEST_FUNCTION(SegmentLog_Open_fails_when_VECTOR_create_fails)
+    {
+        ///arrange
+        CNiceCallComparer<SegmentLogMocks> mocks;
+        SEGMENT_LOG_CONFIG config = makeConfig(TEST_NAME, 0, 0, 0);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
+            .IgnoreArgument(1)
+            .SetFailReturn((VECTOR_HANDLE)NULL);
+
+        ///act
+        SEGMENT_LOG_HANDLE result = SegmentLog_Open(&config);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+    }
+
+    /*Tests_SRS_SEGMENT_LOG_31_004: [ If `log` is NULL, or `record` is NULL and `size` is not 0, then `SegmentLog_Append` shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(SegmentLog_Append_with_NULL_log_fails)
+    {
+        ///arrange
+        SegmentLogMocks mocks;
+        const unsigned char record[] = { 1 };
+
+        ///act
+        int result = SegmentLog_Append(NULL, record, sizeof(record));
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    }
+
+    /*Tests_SRS_SEGMENT_LOG_31_004: [ If `log` is NULL, or `record` is NULL and `size` is not 0, then `SegmentLog_Append` shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(SegmentLog_Append_with_NULL_record_fails)
+    {
+        ///arrange
+        CNiceCallComparer<SegmentLogMocks> mocks;
+        SEGMENT_LOG_CONFIG config = makeConfig(TEST_NAME, 0, 0, 0);
+        SEGMENT_LOG_HANDLE log = SegmentLog_Open(&config);
+        ASSERT_IS_NOT_NULL(log);
+
+        ///act
+        int result = SegmentLog_Append(log, NULL, 1);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+
+        ///cleanup
+        SegmentLog_Close(log);
+    }
+
+    /*Tests_SRS_SEGMENT_LOG_31_005: [ `SegmentLog_Append` shall write the record after a header holding its size, its sequence number and the time, and flush it, before returning 0. ]*/
+    /*Tests_SRS_SEGMENT_LOG_31_009: [ `SegmentLog_Read` shall return the next record in the order they were appended, or set `*record` to NULL when every record is read or `SEGMENT_LOG_MAX_IN_FLIGHT` records are read and not acknowledged. ]*/
+    TEST_FUNCTION(SegmentLog_Read_returns_the_records_in_order)
+    {
+        ///arrange
+        CNiceCallComparer<SegmentLogMocks> mocks;
+        SEGMENT_LOG_CONFIG config = makeConfig(TEST_NAME, 0, 0, 0);
+        SEGMENT_LOG_HANDLE log = SegmentLog_Open(&config);
+        ASSERT_IS_NOT_NULL(log);
+        appendRecords(log, 0, 10);
+
+        ///act
+        uint64_t sequence;
+        for (int i = 0; i < 10; i++)
+        {
+            ///assert
+            ASSERT_ARE_EQUAL(int, i, readRecord(log, &sequence));
+            ASSERT_ARE_EQUAL(size_t, (size_t)(i + 1), (size_t)sequence);
+        }
+        ASSERT_ARE_EQUAL(int, -1, readRecord(log, &sequence));
+
+        ///cleanup
+        SegmentLog_Close(log);
+    }
+
+    /*Tests_SRS_SEGMENT_LOG_31_008: [ If `log`, `record`, `size` or `sequence` is NULL then `SegmentLog_Read` shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(SegmentLog_Read_with_NULL_log_fails)
+    {
+        ///arrange
+        SegmentLogMocks mocks;
+        const unsigned char* record;
+        size_t size;
+        uint64_t sequence;
+
+        ///act
+        int result = SegmentLog_Read(NULL, &record, &size, &sequence);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    }
+
+    /*Tests_SRS_SEGMENT_LOG_31_009: [ `SegmentLog_Read` shall return the next record in the order they were appended, or set `*record` to NULL when every record is read or `SEGMENT_LOG_MAX_IN_FLIGHT` records are read and not acknowledged. ]*/
+    TEST_FUNCTION(SegmentLog_Read_stops_at_SEGMENT_LOG_MAX_IN_FLIGHT_records_not_acknowledged)
+    {
+        ///arrange
+        CNiceCallComparer<SegmentLogMocks> mocks;
+        SEGMENT_LOG_CONFIG config = makeConfig(TEST_NAME, 0, 0, 0);
+        SEGMENT_LOG_HANDLE log = SegmentLog_Open(&config);
+        ASSERT_IS_NOT_NULL(log);
+        appendRecords(log, 0, SEGMENT_LOG_MAX_IN_FLIGHT + 10);
+        uint64_t sequence;
+        int read = 0;
+        while (readRecord(log, &sequence) != -1)
+        {
+            read++;
+        }
+        ASSERT_ARE_EQUAL(int, SEGMENT_LOG_MAX_IN_FLIGHT, read);
+
+        ///act
+        ASSERT_ARE_EQUAL(int, 0, SegmentLog_Acknowledge(log, 1));
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, SEGMENT_LOG_MAX_IN_FLIGHT, readRecord(log, &sequence));
+        ASSERT_ARE_EQUAL(int, -1, readRecord(log, &sequence));
+
+        ///cleanup
+        SegmentLog_Close(log);
+    }
+
+    /*Tests_SRS_SEGMENT_LOG_31_012: [ If the record `sequence` was not read then `SegmentLog_Acknowledge` shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(SegmentLog_Acknowledge_of_a_record_not_appended_fails)
+    {
+        ///arrange
+        CNiceCallComparer<SegmentLogMocks> mocks;
+        SEGMENT_LOG_CONFIG config = makeConfig(TEST_NAME, 0, 0, 0);
+        SEGMENT_LOG_HANDLE log = SegmentLog_Open(&config);
+        ASSERT_IS_NOT_NULL(log);
+        appendRecords(log, 0, 1);
+
+        ///act
+        int result = SegmentLog_Acknowledge(log, 2);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+
+        ///cleanup
+        SegmentLog_Close(log);
+    }
+
+    /*Tests_SRS_SEGMENT_LOG_31_010: [ `SegmentLog_Read` shall skip the records acknowledged since they were last read. ]*/
+    /*Tests_SRS_SEGMENT_LOG_31_013: [ After `SegmentLog_Rewind`, `SegmentLog_Read` shall return the oldest record not acknowledged. ]*/
+    TEST_FUNCTION(SegmentLog_Rewind_reads_again_the_records_not_acknowledged)
+    {
+        ///arrange
+        CNiceCallComparer<SegmentLogMocks> mocks;
+        SEGMENT_LOG_CONFIG config = makeConfig(TEST_NAME, 0, 0, 0);
+        SEGMENT_LOG_HANDLE log = SegmentLog_Open(&config);
+        ASSERT_IS_NOT_NULL(log);
+        appendRecords(log, 0, 5);
+        uint64_t sequence;
+        while (readRecord(log, &sequence) != -1)
+        {
+        }
+        ASSERT_ARE_EQUAL(int, 0, SegmentLog_Acknowledge(log, 1));
+        ASSERT_ARE_EQUAL(int, 0, SegmentLog_Acknowledge(log, 3));
+
+        ///act
+        SegmentLog_Rewind(log);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, 1, readRecord(log, &sequence));
+        ASSERT_ARE_EQUAL(int, 3, readRecord(log, &sequence));
+        ASSERT_ARE_EQUAL(int, 4, readRecord(log, &sequence));
+        ASSERT_ARE_EQUAL(int, -1, readRecord(log, &sequence));
+
+        ///cleanup
+        SegmentLog_Close(log);
+    }
+
+    /*Tests_SRS_SEGMENT_LOG_31_002: [ `SegmentLog_Open` shall recover the records a previous log of the same name left on disk, up to the first damaged record of each segment, and append the next records to a new segment. ]*/
+    /*Tests_SRS_SEGMENT_LOG_31_015: [ `SegmentLog_Close` shall keep the records not acknowledged on disk, with how far the records are acknowledged. ]*/
+    TEST_FUNCTION(SegmentLog_Open_recovers_the_records_not_acknowledged)
+    {
+        ///arrange
+        CNiceCallComparer<SegmentLogMocks> mocks;
+        SEGMENT_LOG_CONFIG config = makeConfig(TEST_NAME, 0, 0, 0);
+        SEGMENT_LOG_HANDLE log = SegmentLog_Open(&config);
+        ASSERT_IS_NOT_NULL(log);
+        appendRecords(log, 0, 5);
+        uint64_t sequence;
+        ASSERT_ARE_EQUAL(int, 0, readRecord(log, &sequence));
+        ASSERT_ARE_EQUAL(int, 0, SegmentLog_Acknowledge(log, sequence));
+        SegmentLog_Close(log);
+
+        ///act
+        log = SegmentLog_Open(&config);
+        ASSERT_IS_NOT_NULL(log);
+        appendRecords(log, 5, 1);
+
+        ///assert
+        SEGMENT_LOG_COUNTERS counters;
+        ASSERT_ARE_EQUAL(int, 0, SegmentLog_GetCounters(log, &counters));
+        ASSERT_ARE_EQUAL(size_t, (size_t)5, (size_t)counters.pending);
+        for (int i = 1; i < 6; i++)
+        {
+            ASSERT_ARE_EQUAL(int, i, readRecord(log, &sequence));
+            ASSERT_ARE_EQUAL(size_t, (size_t)(i + 1), (size_t)sequence);
+        }
+        ASSERT_IS_TRUE(SegmentFileTest_FileSize(TEST_PREFIX, ".1.seg") >= 0);
+
+        ///cleanup
+        SegmentLog_Close(log);
+    }
+
+    /*Tests_SRS_SEGMENT_LOG_31_015: [ `SegmentLog_Close` shall keep the records not acknowledged on disk, with how far the records are acknowledged. ]*/
+    TEST_FUNCTION(SegmentLog_Close_replaces_the_manifest_without_leaving_the_temporary_file)
+    {
+        ///arrange
+        CNiceCallComparer<SegmentLogMocks> mocks;
+        SEGMENT_LOG_CONFIG config = makeConfig(TEST_NAME, 0, 0, 0);
+        SEGMENT_LOG_HANDLE log = SegmentLog_Open(&config);
+        ASSERT_IS_NOT_NULL(log);
+        appendRecords(log, 0, 2);
+
+        ///act
+        SegmentLog_Close(log);
+
+        ///assert
+        ASSERT_IS_TRUE(SegmentFileTest_FileSize(TEST_PREFIX, ".log") >= 0);
+        ASSERT_ARE_EQUAL(long, -1, SegmentFileTest_FileSize(TEST_PREFIX, ".log.tmp"));
+    }
+
+    /*Tests_SRS_SEGMENT_LOG_31_002: [ `SegmentLog_Open` shall recover the records a previous log of the same name left on disk, up to the first damaged record of each segment, and append the next records to a new segment. ]*/
+    TEST_FUNCTION(SegmentLog_Open_leaves_out_a_record_cut_short)
+    {
+        ///arrange
+        CNiceCallComparer<SegmentLogMocks> mocks;
+        SEGMENT_LOG_CONFIG config = makeConfig(TEST_NAME, 0, 0, 0);
+        SEGMENT_LOG_HANDLE log = SegmentLog_Open(&config);
+        ASSERT_IS_NOT_NULL(log);
+        appendRecords(log, 0, 2);
+        SegmentLog_Close(log);
+
+        /*a crash while the last record was written*/
+        const char torn[] = "SLOG";
+        ASSERT_ARE_EQUAL(size_t, sizeof(torn) - 1, SegmentFileTest_AppendBytes(TEST_PREFIX, ".0.seg", torn, sizeof(torn) - 1));
+
+        ///act
+        log = SegmentLog_Open(&config);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(log);
+        uint64_t sequence;
+        ASSERT_ARE_EQUAL(int, 0, readRecord(log, &sequence));
+        ASSERT_ARE_EQUAL(int, 1, readRecord(log, &sequence));
+        ASSERT_ARE_EQUAL(int, -1, readRecord(log, &sequence));
+
+        ///cleanup
+        SegmentLog_Close(log);
+    }
+
+    /*Tests_SRS_SEGMENT_LOG_31_006: [ A segment holding `segmentMaxBytes` bytes shall take no more records, the next record shall start a new segment. ]*/
+    TEST_FUNCTION(SegmentLog_Append_starts_a_new_segment_when_one_is_full)
+    {
+        ///arrange
+        CNiceCallComparer<SegmentLogMocks> mocks;
+        SEGMENT_LOG_CONFIG config = makeConfig(TEST_NAME, 2 * (TEST_RECORD_HEADER_SIZE + TEST_RECORD_SIZE), 0, 0);
+        SEGMENT_LOG_HANDLE log = SegmentLog_Open(&config);
+        ASSERT_IS_NOT_NULL(log);
+
+        ///act
+        appendRecords(log, 0, 5);
+
+        ///assert
+        ASSERT_IS_TRUE(SegmentFileTest_FileSize(TEST_PREFIX, ".0.seg") >= 0);
+        ASSERT_IS_TRUE(SegmentFileTest_FileSize(TEST_PREFIX, ".1.seg") >= 0);
+        ASSERT_IS_TRUE(SegmentFileTest_FileSize(TEST_PREFIX, ".2.seg") >= 0);
+        ASSERT_ARE_EQUAL(long, -1, SegmentFileTest_FileSize(TEST_PREFIX, ".3.seg"));
+
+        ///cleanup
+        SegmentLog_Close(log);
+    }
+
+    /*Tests_SRS_SEGMENT_LOG_31_011: [ `SegmentLog_Acknowledge` shall delete the segments whose records are all acknowledged, but the one records are appended to. ]*/
+    TEST_FUNCTION(SegmentLog_Acknowledge_deletes_the_segments_acknowledged)
+    {
+        ///arrange
+        CNiceCallComparer<SegmentLogMocks> mocks;
+        SEGMENT_LOG_CONFIG config = makeConfig(TEST_NAME, 2 * (TEST_RECORD_HEADER_SIZE + TEST_RECORD_SIZE), 0, 0);
+        SEGMENT_LOG_HANDLE log = SegmentLog_Open(&config);
+        ASSERT_IS_NOT_NULL(log);
+        appendRecords(log, 0, 5);
+        uint64_t sequence;
+
+        ///act
+        while (readRecord(log, &sequence) != -1)
+        {
+            ASSERT_ARE_EQUAL(int, 0, SegmentLog_Acknowledge(log, sequence));
+        }
+
+        ///assert
+        ASSERT_ARE_EQUAL(long, -1, SegmentFileTest_FileSize(TEST_PREFIX, ".0.seg"));
+        ASSERT_ARE_EQUAL(long, -1, SegmentFileTest_FileSize(TEST_PREFIX, ".1.seg"));
+        ASSERT_IS_TRUE(SegmentFileTest_FileSize(TEST_PREFIX, ".2.seg") >= 0);
+        SEGMENT_LOG_COUNTERS counters;
+        ASSERT_ARE_EQUAL(int, 0, SegmentLog_GetCounters(log, &counters));
+        ASSERT_ARE_EQUAL(size_t, (size_t)5, (size_t)counters.acknowledged);
+        ASSERT_ARE_EQUAL(size_t, (size_t)0, (size_t)counters.pending);
+
+        ///cleanup
+        SegmentLog_Close(log);
+    }
+
+    /*Tests_SRS_SEGMENT_LOG_31_016: [ `SegmentLog_Close` shall delete the files of a log whose records are all acknowledged. ]*/
+    TEST_FUNCTION(SegmentLog_Close_deletes_the_files_when_every_record_is_acknowledged)
+    {
+        ///arrange
+        CNiceCallComparer<SegmentLogMocks> mocks;
+        SEGMENT_LOG_CONFIG config = makeConfig(TEST_NAME, 0, 0, 0);
+        SEGMENT_LOG_HANDLE log = SegmentLog_Open(&config);
+        ASSERT_IS_NOT_NULL(log);
+        appendRecords(log, 0, 3);
+        uint64_t sequence;
+        while (readRecord(log, &sequence) != -1)
+        {
+            ASSERT_ARE_EQUAL(int, 0, SegmentLog_Acknowledge(log, sequence));
+        }
+
+        ///act
+        SegmentLog_Close(log);
+
+        ///assert
+        ASSERT_ARE_EQUAL(long, -1, SegmentFileTest_FileSize(TEST_PREFIX, ".log"));
+        ASSERT_ARE_EQUAL(long, -1, SegmentFileTest_FileSize(TEST_PREFIX, ".0.seg"));
+    }
+
+    /*Tests_SRS_SEGMENT_LOG_31_007: [ Beyond `maxBytes`, `SegmentLog_Append` shall delete the oldest segments, counting their records not acknowledged as dropped. ]*/
+    TEST_FUNCTION(SegmentLog_Append_drops_the_oldest_segments_beyond_maxBytes)
+    {
+        ///arrange
+        CNiceCallComparer<SegmentLogMocks> mocks;
+        SEGMENT_LOG_CONFIG config = makeConfig(TEST_NAME, 2 * (TEST_RECORD_HEADER_SIZE + TEST_RECORD_SIZE), 4 * (TEST_RECORD_HEADER_SIZE + TEST_RECORD_SIZE), 0);
+        SEGMENT_LOG_HANDLE log = SegmentLog_Open(&config);
+        ASSERT_IS_NOT_NULL(log);
+
+        ///act
+        appendRecords(log, 0, 10);
+
+        ///assert
+        SEGMENT_LOG_COUNTERS counters;
+        ASSERT_ARE_EQUAL(int, 0, SegmentLog_GetCounters(log, &counters));
+        ASSERT_ARE_EQUAL(size_t, (size_t)6, (size_t)counters.dropped);
+        ASSERT_ARE_EQUAL(size_t, (size_t)4, (size_t)counters.pending);
+        ASSERT_ARE_EQUAL(size_t, (size_t)(4 * (TEST_RECORD_HEADER_SIZE + TEST_RECORD_SIZE)), counters.bytes);
+        uint64_t sequence;
+        ASSERT_ARE_EQUAL(int, 6, readRecord(log, &sequence));
+
+        ///cleanup
+        SegmentLog_Close(log);
+    }
+
+    /*Tests_SRS_SEGMENT_LOG_31_014: [ `SegmentLog_Expire` shall delete the oldest segments whose newest record is older than `retentionSeconds`, counting their records not acknowledged as dropped. ]*/
+    TEST_FUNCTION(SegmentLog_Expire_drops_the_segments_older_than_the_retention)
+    {
+        ///arrange
+        CNiceCallComparer<SegmentLogMocks> mocks;
+        SEGMENT_LOG_CONFIG config = makeConfig(TEST_NAME, 2 * (TEST_RECORD_HEADER_SIZE + TEST_RECORD_SIZE), 0, 60);
+        SEGMENT_LOG_HANDLE log = SegmentLog_Open(&config);
+        ASSERT_IS_NOT_NULL(log);
+        appendRecords(log, 0, 2);
+        currentTime += 30;
+        appendRecords(log, 2, 2);
+        currentTime += 45;
+
+        ///act
+        SegmentLog_Expire(log);
+
+        ///assert
+        SEGMENT_LOG_COUNTERS counters;
+        ASSERT_ARE_EQUAL(int, 0, SegmentLog_GetCounters(log, &counters));
+        ASSERT_ARE_EQUAL(size_t, (size_t)2, (size_t)counters.dropped);
+        uint64_t sequence;
+        ASSERT_ARE_EQUAL(int, 2, readRecord(log, &sequence));
+
+        ///cleanup
+        SegmentLog_Close(log);
+    }
+
+    /*Tests_SRS_SEGMENT_LOG_31_017: [ `SegmentLog_GetCounters` shall copy the counters of the log and the bytes of its segments into `counters` and return 0. ]*/
+    TEST_FUNCTION(SegmentLog_GetCounters_with_NULL_counters_fails)
+    {
+        ///arrange
+        CNiceCallComparer<SegmentLogMocks> mocks;
+        SEGMENT_LOG_CONFIG config = makeConfig(TEST_NAME, 0, 0, 0);
+        SEGMENT_LOG_HANDLE log = SegmentLog_Open(&config);
+        ASSERT_IS_NOT_NULL(log);
+
+        ///act
+        int result = SegmentLog_GetCounters(log, NULL);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+
+        ///cleanup
+        SegmentLog_Close(log);
+    }
+
+    TEST_FUNCTION(SegmentLog_Open_escapes_the_characters_a_file_name_cannot_hold)
+    {
+        ///arrange
+        CNiceCallComparer<SegmentLogMocks> mocks;
+        deleteFiles(TEST_DIRECTORY "/a%2Fb");
+        SEGMENT_LOG_CONFIG config = makeConfig("a/b", 0, 0, 0);
+        SEGMENT_LOG_HANDLE log = SegmentLog_Open(&config);
+        ASSERT_IS_NOT_NULL(log);
+
+        ///act
+        appendRecords(log, 0, 1);
+
+        ///assert
+        ASSERT_IS_TRUE(SegmentFileTest_FileSize(TEST_DIRECTORY "/a%2Fb", ".0.seg") >= 0);
+
+        ///cleanup
+        SegmentLog_Close(log);
+        deleteFiles(TEST_DIRECTORY "/a%2Fb");
+    }
+
+END_TEST_SUITE(segment_log_ut)
@@ -8,9 +8,17 @@
 
 typedef enum LOGGER_TYPE_TAG
 {
-    LOGGING_TO_FILE
+    LOGGING_TO_FILE,
+    LOGGING_TO_RECORD_LOG /*binary records in segments, see record_log.h*/
 } LOGGER_TYPE;
 
+typedef enum LOGGER_FLUSH_TAG
+{
+    LOGGER_FLUSH_NONE, /*the C runtime writes the file out when its buffer is full*/
+    LOGGER_FLUSH_BATCH, /*fflush after every write*/
+    LOGGER_FLUSH_SYNC /*fflush and commit the file to the disk after every write*/
+} LOGGER_FLUSH;
+
 typedef struct LOGGER_CONFIG_TAG
 {
     LOGGER_TYPE selector;
@@ -19,10 +27,31 @@ typedef struct LOGGER_CONFIG_TAG
         struct LOGGER_CONFIG_FILE_TAG
         {
             const char * name;
+            size_t queueMaxBytes; /*the most bytes of records waiting for the writer thread, the next records are dropped beyond it; 0 writes every record in Module_Receive*/
+            size_t batchMaxBytes; /*the writer thread waits for this many bytes of records before writing them; 0 writes the records as soon as they come*/
+            unsigned int flushMilliseconds; /*the longest the writer thread waits for batchMaxBytes; 0 does not wait*/
+            LOGGER_FLUSH flush;
         } loggerConfigFile;
+        struct LOGGER_CONFIG_RECORD_LOG_TAG
+        {
+            const char * name; /*the path of the log without extension*/
+            size_t segmentMaxBytes; /*a segment holding this many bytes takes no more records; 0 for RECORD_LOG_DEFAULT_SEGMENT_BYTES*/
+            unsigned int segmentMaxSeconds; /*a segment whose first record is this old takes no more records; 0 for no limit*/
+            size_t indexIntervalBytes; /*the index of a segment points to a record every this many bytes; 0 for RECORD_LOG_DEFAULT_INDEX_BYTES*/
+            LOGGER_FLUSH flush;
+        } loggerConfigRecordLog;
     } selectee;
 } LOGGER_CONFIG; /*this needs to be passed to the Module_Create function*/
 
+typedef struct LOGGER_COUNTERS_TAG
+{
+    size_t written; /*records written to the file*/
+    size_t writeFailures; /*records which could not be written to the file*/
+    size_t dropped; /*records dropped because queueMaxBytes bytes of records were waiting for the writer thread*/
+    size_t batches; /*writes of the writer thread*/
+    size_t largestBatch; /*the most records the writer thread wrote at once*/
+} LOGGER_COUNTERS;
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -30,6 +59,9 @@ extern "C"
 
 MODULE_EXPORT const MODULE_API* MODULE_STATIC_GETAPI(LOGGER_MODULE)(MODULE_API_VERSION gateway_api_version);
 
+/*copies the counters of the module into counters, returns 0 on success*/
+MODULE_EXPORT int Logger_GetCounters(MODULE_HANDLE module, LOGGER_COUNTERS* counters);
+
 #ifdef __cplusplus
 }
 #endif
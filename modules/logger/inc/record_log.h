@@ -0,0 +1,52 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef RECORD_LOG_H
+#define RECORD_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct RECORD_LOG_TAG* RECORD_LOG_HANDLE;
+typedef struct RECORD_LOG_READER_TAG* RECORD_LOG_READER_HANDLE;
+
+#define RECORD_LOG_DEFAULT_SEGMENT_BYTES (16 * 1024 * 1024)
+#define RECORD_LOG_DEFAULT_INDEX_BYTES (64 * 1024)
+
+typedef struct RECORD_LOG_CONFIG_TAG
+{
+    const char* name; /*the path of the log without extension, its files are name.rlog, name.<n>.rlog and name.<n>.ridx*/
+    size_t segmentMaxBytes; /*a segment holding this many bytes takes no more records; 0 for RECORD_LOG_DEFAULT_SEGMENT_BYTES*/
+    unsigned int segmentMaxSeconds; /*a segment whose first record is this old takes no more records; 0 for no limit*/
+    size_t indexIntervalBytes; /*the index of a segment points to a record every this many bytes; 0 for RECORD_LOG_DEFAULT_INDEX_BYTES*/
+}RECORD_LOG_CONFIG;
+
+RECORD_LOG_HANDLE RecordLog_Open(const RECORD_LOG_CONFIG* config);
+void RecordLog_Close(RECORD_LOG_HANDLE log);
+
+/*appends a record stamped with the milliseconds since 1970, returns 0 on success*/
+int RecordLog_Append(RECORD_LOG_HANDLE log, const unsigned char* record, size_t size);
+
+/*writes the records appended to the file, and to the disk when commit is true, returns 0 on success*/
+int RecordLog_Flush(RECORD_LOG_HANDLE log, bool commit);
+
+RECORD_LOG_READER_HANDLE RecordLog_OpenReader(const char* name);
+void RecordLog_CloseReader(RECORD_LOG_READER_HANDLE reader);
+
+/*moves the reader to the first record appended at or after time, in milliseconds since 1970, returns 0 on success*/
+int RecordLog_Seek(RECORD_LOG_READER_HANDLE reader, uint64_t time);
+
+/*reads the next record, *record stays valid until the next call with reader and is NULL once every record is read*/
+int RecordLog_Next(RECORD_LOG_READER_HANDLE reader, const unsigned char** record, size_t* size, uint64_t* time);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*RECORD_LOG_H*/
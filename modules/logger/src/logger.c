@@ -5,25 +5,68 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include <errno.h>
+#include <string.h>
+
+#ifdef WIN32
+#include <io.h>
+#define LOGGER_COMMIT(file) _commit(_fileno(file))
+#else
+#include <unistd.h>
+#define LOGGER_COMMIT(file) fsync(fileno(file))
+#endif
 
 #include "logger.h"
+#include "record_log.h"
 
 #include <azure_c_shared_utility/gballoc.h>
 #include <azure_c_shared_utility/gb_stdio.h>
 #include <azure_c_shared_utility/gb_time.h>
-#include <azure_c_shared_utility/strings.h>
 #include <azure_c_shared_utility/xlogging.h>
 #include <azure_c_shared_utility/crt_abstractions.h>
-#include <azure_c_shared_utility/base64.h>
-#include <azure_c_shared_utility/map.h>
 #include <azure_c_shared_utility/constmap.h>
-#include <azure_c_shared_utility/strings.h>
+#include <azure_c_shared_utility/lock.h>
+#include <azure_c_shared_utility/condition.h>
+#include <azure_c_shared_utility/threadapi.h>
 
 #include <parson.h>
 
+#define FILENAME "filename"
+#define QUEUEMAXBYTES "queueMaxBytes"
+#define BATCHMAXBYTES "batchMaxBytes"
+#define FLUSHMILLISECONDS "flushMilliseconds"
+#define FLUSH "flush"
+#define FORMAT "format"
+#define SEGMENTMAXBYTES "segmentMaxBytes"
+#define SEGMENTMAXSECONDS "segmentMaxSeconds"
+#define INDEXINTERVALBYTES "indexIntervalBytes"
+
+typedef struct LOGGER_BUFFER_TAG
+{
+    char* text;
+    size_t size; /*characters in text*/
+    size_t capacity;
+}LOGGER_BUFFER;
+
 typedef struct LOGGER_HANDLE_DATA_TAG
 {
-    FILE* fout;
+    FILE* fout; /*NULL when the records go to recordLog*/
+    RECORD_LOG_HANDLE recordLog;
+    LOGGER_FLUSH flush;
+    LOGGER_BUFFER record; /*the record Logger_Receive renders, kept from one message to the next*/
+    time_t recordTime; /*the time printed in recordTimeText*/
+    char recordTimeText[80];
+    size_t queueMaxBytes;
+    size_t batchMaxBytes;
+    unsigned int flushMilliseconds;
+    LOCK_HANDLE lock; /*the next fields are used when queueMaxBytes is not 0, guarded by lock*/
+    COND_HANDLE recordsQueued;
+    THREAD_HANDLE writer;
+    bool stopping;
+    LOGGER_BUFFER queued; /*records waiting for the writer thread*/
+    size_t queuedRecords;
+    bool dropping; /*the last record was dropped, the next ones are dropped without a word*/
+    LOGGER_BUFFER writing; /*the records the writer thread writes, owned by it*/
+    LOGGER_COUNTERS counters;
 }LOGGER_HANDLE_DATA;
 
 /*this function adds a JSON object to the output*/
@@ -126,6 +169,429 @@ static int append_logStartStop(FILE* fout, bool appendStart, bool isAbsoluteStar
     return result;
 }
 
+static int LOGGER_write(LOGGER_HANDLE_DATA* handleData, const char* records)
+{
+    int result;
+    if (addJSONString(handleData->fout, records) != 0)
+    {
+        LogError("internal error in addJSONString");
+        result = __LINE__;
+    }
+    else if ((handleData->flush != LOGGER_FLUSH_NONE) && (fflush(handleData->fout) != 0))
+    {
+        LogError("unable to fflush");
+        result = __LINE__;
+    }
+    else if ((handleData->flush == LOGGER_FLUSH_SYNC) && (LOGGER_COMMIT(handleData->fout) != 0))
+    {
+        LogError("unable to commit the file to the disk");
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+/*the characters of a literal, without the '\0'*/
+#define LITERAL_LENGTH(literal) (sizeof(literal) - 1)
+
+#define RECORD_TIME ",{\"time\":\""
+#define RECORD_PROPERTIES "\",\"properties\":{"
+#define RECORD_CONTENT "},\"content\":\""
+#define RECORD_END "\"}"
+/*the closing ] of the array and the '\0' which follow the record when it is written on its own*/
+#define RECORD_CLOSING 2
+
+static char* RECORD_append_escaped(char* destination, const char* source)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+    for (; *source != '\0'; source++)
+    {
+        unsigned char c = (unsigned char)*source;
+        switch (c)
+        {
+            case '"': *destination++ = '\\'; *destination++ = '"'; break;
+            case '\\': *destination++ = '\\'; *destination++ = '\\'; break;
+            case '\b': *destination++ = '\\'; *destination++ = 'b'; break;
+            case '\f': *destination++ = '\\'; *destination++ = 'f'; break;
+            case '\n': *destination++ = '\\'; *destination++ = 'n'; break;
+            case '\r': *destination++ = '\\'; *destination++ = 'r'; break;
+            case '\t': *destination++ = '\\'; *destination++ = 't'; break;
+            default:
+            {
+                if (c < 0x20)
+                {
+                    *destination++ = '\\';
+                    *destination++ = 'u';
+                    *destination++ = '0';
+                    *destination++ = '0';
+                    *destination++ = hexDigits[c >> 4];
+                    *destination++ = hexDigits[c & 0x0F];
+                }
+                else
+                {
+                    *destination++ = (char)c;
+                }
+                break;
+            }
+        }
+    }
+    return destination;
+}
+
+static char* RECORD_append_base64(char* destination, const unsigned char* source, size_t size)
+{
+    static const char base64Digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t i;
+    for (i = 0; i + 2 < size; i += 3)
+    {
+        *destination++ = base64Digits[source[i] >> 2];
+        *destination++ = base64Digits[((source[i] & 0x03) << 4) | (source[i + 1] >> 4)];
+        *destination++ = base64Digits[((source[i + 1] & 0x0F) << 2) | (source[i + 2] >> 6)];
+        *destination++ = base64Digits[source[i + 2] & 0x3F];
+    }
+    if (i + 1 == size)
+    {
+        *destination++ = base64Digits[source[i] >> 2];
+        *destination++ = base64Digits[(source[i] & 0x03) << 4];
+        *destination++ = '=';
+        *destination++ = '=';
+    }
+    else if (i + 2 == size)
+    {
+        *destination++ = base64Digits[source[i] >> 2];
+        *destination++ = base64Digits[((source[i] & 0x03) << 4) | (source[i + 1] >> 4)];
+        *destination++ = base64Digits[(source[i + 1] & 0x0F) << 2];
+        *destination++ = '=';
+    }
+    return destination;
+}
+
+/*renders ,{"time":"...","properties":{...},"content":"..."} in handleData->record, with room left for RECORD_CLOSING*/
+static int RECORD_render(LOGGER_HANDLE_DATA* handleData, const char* const* keys, const char* const* values, size_t count, const CONSTBUFFER* content)
+{
+    int result;
+    size_t timeLength = strlen(handleData->recordTimeText);
+    size_t i;
+    /*every character of a key or a value takes at most 6 once escaped (\u00XX), and a property adds "":"", */
+    size_t needed = LITERAL_LENGTH(RECORD_TIME) + timeLength + LITERAL_LENGTH(RECORD_PROPERTIES) + LITERAL_LENGTH(RECORD_CONTENT) + LITERAL_LENGTH(RECORD_END) + RECORD_CLOSING;
+    for (i = 0; i < count; i++)
+    {
+        needed += 6 * (strlen(keys[i]) + strlen(values[i])) + 6;
+    }
+    needed += 4 * ((content->size + 2) / 3);
+
+    if (needed > handleData->record.capacity)
+    {
+        char* newText = (char*)realloc(handleData->record.text, needed);
+        if (newText == NULL)
+        {
+            LogError("unable to grow the record to %lu bytes", (unsigned long)needed);
+            result = __LINE__;
+        }
+        else
+        {
+            handleData->record.text = newText;
+            handleData->record.capacity = needed;
+            result = 0;
+        }
+    }
+    else
+    {
+        result = 0;
+    }
+
+    if (result == 0)
+    {
+        char* destination = handleData->record.text;
+        memcpy(destination, RECORD_TIME, LITERAL_LENGTH(RECORD_TIME));
+        destination += LITERAL_LENGTH(RECORD_TIME);
+        memcpy(destination, handleData->recordTimeText, timeLength);
+        destination += timeLength;
+        memcpy(destination, RECORD_PROPERTIES, LITERAL_LENGTH(RECORD_PROPERTIES));
+        destination += LITERAL_LENGTH(RECORD_PROPERTIES);
+        for (i = 0; i < count; i++)
+        {
+            if (i != 0)
+            {
+                *destination++ = ',';
+            }
+            *destination++ = '"';
+            destination = RECORD_append_escaped(destination, keys[i]);
+            *destination++ = '"';
+            *destination++ = ':';
+            *destination++ = '"';
+            destination = RECORD_append_escaped(destination, values[i]);
+            *destination++ = '"';
+        }
+        memcpy(destination, RECORD_CONTENT, LITERAL_LENGTH(RECORD_CONTENT));
+        destination += LITERAL_LENGTH(RECORD_CONTENT);
+        if (content->buffer != NULL)
+        {
+            destination = RECORD_append_base64(destination, content->buffer, content->size);
+        }
+        memcpy(destination, RECORD_END, LITERAL_LENGTH(RECORD_END));
+        destination += LITERAL_LENGTH(RECORD_END);
+        handleData->record.size = destination - handleData->record.text;
+    }
+    return result;
+}
+
+/*prints now in recordTimeText, unless it is already there*/
+static int RECORD_print_time(LOGGER_HANDLE_DATA* handleData, time_t now)
+{
+    int result;
+    /*Codes_SRS_LOGGER_31_006: [ `Logger_Receive` shall print the time with `strftime` only when it differs from the time of the previous message. ]*/
+    if (now == handleData->recordTime)
+    {
+        result = 0;
+    }
+    else
+    {
+        struct tm* t = localtime(&now);
+        if (t == NULL)
+        {
+            LogError("localtime failed");
+            result = __LINE__;
+        }
+        else
+        {
+            char timetemp[80] = { 0 };
+            if (strftime(timetemp, sizeof(timetemp) / sizeof(timetemp[0]), "%C", t) == 0)
+            {
+                LogError("unable to strftime");
+                result = __LINE__;
+            }
+            else
+            {
+                (void)memcpy(handleData->recordTimeText, timetemp, sizeof(timetemp));
+                handleData->recordTime = now;
+                result = 0;
+            }
+        }
+    }
+    return result;
+}
+
+static void WRITER_queue(LOGGER_HANDLE_DATA* handleData)
+{
+    if (Lock(handleData->lock) != LOCK_OK)
+    {
+        LogError("unable to lock, the record is dropped");
+    }
+    else
+    {
+        size_t size = handleData->record.size;
+        if (size > handleData->queueMaxBytes - handleData->queued.size)
+        {
+            /*Codes_SRS_LOGGER_31_010: [ If the record does not fit in `queueMaxBytes` bytes with the records waiting, `Logger_Receive` shall drop it and count it as dropped. ]*/
+            if (!handleData->dropping)
+            {
+                LogError("%lu bytes of records are waiting for the writer thread, the records are dropped until it writes them", (unsigned long)handleData->queued.size);
+                handleData->dropping = true;
+            }
+            handleData->counters.dropped++;
+        }
+        else
+        {
+            /*Codes_SRS_LOGGER_31_009: [ Otherwise `Logger_Receive` shall append the record to the records waiting for the writer thread, and wake the writer thread up when there were none or when they reach `batchMaxBytes` bytes. ]*/
+            bool wakeUp =
+                (handleData->queued.size == 0) ||
+                ((handleData->queued.size < handleData->batchMaxBytes) && (handleData->queued.size + size >= handleData->batchMaxBytes));
+            (void)memcpy(handleData->queued.text + handleData->queued.size, handleData->record.text, size);
+            handleData->queued.size += size;
+            handleData->queuedRecords++;
+            handleData->dropping = false;
+            if (wakeUp)
+            {
+                (void)Condition_Post(handleData->recordsQueued);
+            }
+        }
+        (void)Unlock(handleData->lock);
+    }
+}
+
+static int WRITER_thread(void* param)
+{
+    LOGGER_HANDLE_DATA* handleData = (LOGGER_HANDLE_DATA*)param;
+    bool stopping = false;
+    while (!stopping)
+    {
+        size_t records = 0;
+        if (Lock(handleData->lock) != LOCK_OK)
+        {
+            LogError("unable to lock, the writer thread stops");
+            stopping = true;
+        }
+        else
+        {
+            LOGGER_BUFFER batch;
+            /*Codes_SRS_LOGGER_31_011: [ The writer thread shall wait for records, then, when `batchMaxBytes` and `flushMilliseconds` are not 0, at most `flushMilliseconds` for `batchMaxBytes` bytes of records. ]*/
+            if (!handleData->stopping && (handleData->queued.size == 0))
+            {
+                (void)Condition_Wait(handleData->recordsQueued, handleData->lock, 0);
+            }
+            if (
+                !handleData->stopping &&
+                (handleData->batchMaxBytes != 0) &&
+                (handleData->flushMilliseconds != 0) &&
+                (handleData->queued.size < handleData->batchMaxBytes)
+                )
+            {
+                (void)Condition_Wait(handleData->recordsQueued, handleData->lock, (int)handleData->flushMilliseconds);
+            }
+
+            /*Logger_Receive carries on in the other buffer while this one is written*/
+            batch = handleData->queued;
+            handleData->queued = handleData->writing;
+            handleData->queued.size = 0;
+            handleData->writing = batch;
+            records = handleData->queuedRecords;
+            handleData->queuedRecords = 0;
+            stopping = handleData->stopping;
+            (void)Unlock(handleData->lock);
+        }
+
+        if (records != 0)
+        {
+            /*Codes_SRS_LOGGER_31_012: [ The writer thread shall write all the records waiting at once, and flush the file as `flush` tells. ]*/
+            int written;
+            handleData->writing.text[handleData->writing.size] = ']';
+            handleData->writing.text[handleData->writing.size + 1] = '\0';
+            written = LOGGER_write(handleData, handleData->writing.text);
+            if (written != 0)
+            {
+                LogError("unable to write %lu records", (unsigned long)records);
+            }
+
+            if (Lock(handleData->lock) != LOCK_OK)
+            {
+                LogError("unable to lock, the counters miss %lu records", (unsigned long)records);
+            }
+            else
+            {
+                if (written != 0)
+                {
+                    handleData->counters.writeFailures += records;
+                }
+                else
+                {
+                    handleData->counters.written += records;
+                }
+                handleData->counters.batches++;
+                if (records > handleData->counters.largestBatch)
+                {
+                    handleData->counters.largestBatch = records;
+                }
+                (void)Unlock(handleData->lock);
+            }
+        }
+    }
+    return 0;
+}
+
+static int WRITER_start(LOGGER_HANDLE_DATA* handleData)
+{
+    int result;
+    /*Codes_SRS_LOGGER_31_005: [ If `queueMaxBytes` is not 0, `Logger_Create` shall allocate two buffers of `queueMaxBytes` bytes, create a lock and a condition, and start a writer thread. ]*/
+    if ((handleData->queued.text = (char*)malloc(handleData->queueMaxBytes + RECORD_CLOSING)) == NULL)
+    {
+        LogError("unable to allocate the queue of %lu bytes", (unsigned long)handleData->queueMaxBytes);
+        result = __LINE__;
+    }
+    else if ((handleData->writing.text = (char*)malloc(handleData->queueMaxBytes + RECORD_CLOSING)) == NULL)
+    {
+        LogError("unable to allocate the batch of %lu bytes", (unsigned long)handleData->queueMaxBytes);
+        free(handleData->queued.text);
+        result = __LINE__;
+    }
+    else if ((handleData->lock = Lock_Init()) == NULL)
+    {
+        LogError("unable to Lock_Init");
+        free(handleData->writing.text);
+        free(handleData->queued.text);
+        result = __LINE__;
+    }
+    else if ((handleData->recordsQueued = Condition_Init()) == NULL)
+    {
+        LogError("unable to Condition_Init");
+        (void)Lock_Deinit(handleData->lock);
+        free(handleData->writing.text);
+        free(handleData->queued.text);
+        result = __LINE__;
+    }
+    else if (ThreadAPI_Create(&handleData->writer, WRITER_thread, handleData) != THREADAPI_OK)
+    {
+        LogError("unable to start the writer thread");
+        Condition_Deinit(handleData->recordsQueued);
+        (void)Lock_Deinit(handleData->lock);
+        free(handleData->writing.text);
+        free(handleData->queued.text);
+        handleData->writer = NULL;
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+static void WRITER_stop(LOGGER_HANDLE_DATA* handleData)
+{
+    int notUsed;
+    /*Codes_SRS_LOGGER_31_013: [ `Logger_Destroy` shall stop the writer thread once it has written the records waiting, before adding the end of log JSON object. ]*/
+    if (Lock(handleData->lock) != LOCK_OK)
+    {
+        LogError("unable to lock, the writer thread may not stop");
+    }
+    else
+    {
+        handleData->stopping = true;
+        (void)Condition_Post(handleData->recordsQueued);
+        (void)Unlock(handleData->lock);
+    }
+    (void)ThreadAPI_Join(handleData->writer, &notUsed);
+    Condition_Deinit(handleData->recordsQueued);
+    (void)Lock_Deinit(handleData->lock);
+    free(handleData->writing.text);
+    free(handleData->queued.text);
+}
+
+static LOGGER_HANDLE_DATA* LOGGER_create_record_log(const struct LOGGER_CONFIG_RECORD_LOG_TAG* config)
+{
+    LOGGER_HANDLE_DATA* result = (LOGGER_HANDLE_DATA*)malloc(sizeof(LOGGER_HANDLE_DATA));
+    if (result == NULL)
+    {
+        /*Codes_SRS_LOGGER_02_007: [If Logger_Create encounters any errors while creating the LOGGER_HANDLE_DATA then it shall fail and return NULL.]*/
+        LogError("malloc failed");
+    }
+    else
+    {
+        RECORD_LOG_CONFIG recordLogConfig;
+        recordLogConfig.name = config->name;
+        recordLogConfig.segmentMaxBytes = config->segmentMaxBytes;
+        recordLogConfig.segmentMaxSeconds = config->segmentMaxSeconds;
+        recordLogConfig.indexIntervalBytes = config->indexIntervalBytes;
+
+        /*every field not used by a record log is 0 or NULL*/
+        (void)memset(result, 0, sizeof(LOGGER_HANDLE_DATA));
+        result->flush = config->flush;
+        result->recordTime = (time_t)-1;
+
+        /*Codes_SRS_LOGGER_31_018: [ If `configuration->selector` is `LOGGING_TO_RECORD_LOG`, `Logger_Create` shall open a record log with the settings of `configuration->selectee.loggerConfigRecordLog` instead of a file, and fail and return NULL if it cannot. ]*/
+        if ((result->recordLog = RecordLog_Open(&recordLogConfig)) == NULL)
+        {
+            LogError("unable to open the record log %s", (config->name == NULL) ? "NULL" : config->name);
+            free(result);
+            result = NULL;
+        }
+    }
+    return result;
+}
+
 static MODULE_HANDLE Logger_Create(BROKER_HANDLE broker, const void* configuration)
 {
     LOGGER_HANDLE_DATA* result;
@@ -142,12 +608,19 @@ static MODULE_HANDLE Logger_Create(BROKER_HANDLE broker, const void* configurati
     else
     {
         const LOGGER_CONFIG* config = configuration;
-        /*Codes_SRS_LOGGER_02_003: [If configuration->selector has a value different than LOGGING_TO_FILE then Logger_Create shall fail and return NULL.]*/
-        if (config->selector != LOGGING_TO_FILE)
+        /*Codes_SRS_LOGGER_02_003: [If configuration->selector has a value different than LOGGING_TO_FILE and LOGGING_TO_RECORD_LOG then Logger_Create shall fail and return NULL.]*/
+        if (
+            (config->selector != LOGGING_TO_FILE) &&
+            (config->selector != LOGGING_TO_RECORD_LOG)
+            )
         {
             LogError("invalid arg config->selector=%d", config->selector);
             result = NULL;
         }
+        else if (config->selector == LOGGING_TO_RECORD_LOG)
+        {
+            result = LOGGER_create_record_log(&config->selectee.loggerConfigRecordLog);
+        }
         else
         {
             /*Codes_SRS_LOGGER_02_004: [If configuration->selectee.loggerConfigFile.name is NULL then Logger_Create shall fail and return NULL.]*/
@@ -168,6 +641,28 @@ static MODULE_HANDLE Logger_Create(BROKER_HANDLE broker, const void* configurati
                 }
                 else
                 {
+                    result->recordLog = NULL;
+                    result->flush = config->selectee.loggerConfigFile.flush;
+                    result->record.text = NULL;
+                    result->record.size = 0;
+                    result->record.capacity = 0;
+                    result->recordTime = (time_t)-1;
+                    result->recordTimeText[0] = '\0';
+                    result->queueMaxBytes = config->selectee.loggerConfigFile.queueMaxBytes;
+                    result->batchMaxBytes = config->selectee.loggerConfigFile.batchMaxBytes;
+                    result->flushMilliseconds = config->selectee.loggerConfigFile.flushMilliseconds;
+                    result->lock = NULL;
+                    result->recordsQueued = NULL;
+                    result->writer = NULL;
+                    result->stopping = false;
+                    result->queued.text = NULL;
+                    result->queued.size = 0;
+                    result->queued.capacity = 0;
+                    result->queuedRecords = 0;
+                    result->dropping = false;
+                    result->writing = result->queued;
+                    (void)memset(&result->counters, 0, sizeof(result->counters));
+
                     /*Codes_SRS_LOGGER_02_006: [Logger_Create shall open the file configuration the filename selectee.loggerConfigFile.name in update (reading and writing) mode and assign the result of fopen to fout field. ]*/
                     result->fout = fopen(config->selectee.loggerConfigFile.name, "r+b"); /*open binary file for update (reading and writing)*/
                     if (result->fout == NULL)
@@ -262,6 +757,21 @@ static MODULE_HANDLE Logger_Create(BROKER_HANDLE broker, const void* configurati
                             }
                         }
                     }
+
+                    if (
+                        (result != NULL) &&
+                        (result->queueMaxBytes != 0) &&
+                        (WRITER_start(result) != 0)
+                        )
+                    {
+                        /*Codes_SRS_LOGGER_02_007: [If Logger_Create encounters any errors while creating the LOGGER_HANDLE_DATA then it shall fail and return NULL.]*/
+                        if (fclose(result->fout) != 0)
+                        {
+                            LogError("unable to close file %s", config->selectee.loggerConfigFile.name);
+                        }
+                        free(result);
+                        result = NULL;
+                    }
                 }
             }
         }
@@ -298,7 +808,7 @@ static void* Logger_ParseConfigurationFromJson(const char* configuration)
             else
             {
                 /*Codes_SRS_LOGGER_05_012: [ If the JSON object does not contain a value named "filename" then Logger_CreateFromJson shall fail and return NULL. ]*/
-                const char* fileNameValue = json_object_get_string(obj, "filename");
+                const char* fileNameValue = json_object_get_string(obj, FILENAME);
                 if (fileNameValue == NULL)
                 {
                     /*Codes_SRS_LOGGER_17_003: [ If any system call fails, Logger_ParseConfigurationFromJson shall fail and return NULL. ]*/
@@ -309,34 +819,135 @@ static void* Logger_ParseConfigurationFromJson(const char* configuration)
                 {
                     /*fileNameValue is believed at this moment to be a string that might point to a filename on the system*/
 
-                    /*Codes_SRS_LOGGER_17_001: [ Logger_ParseConfigurationFromJson shall allocate a new LOGGER_CONFIG structure. ]*/
-                    result = (LOGGER_CONFIG*)malloc(sizeof(LOGGER_CONFIG));
-                    if (result == NULL)
+                    /*Codes_SRS_LOGGER_31_001: [ `Logger_ParseConfigurationFromJson` shall set `queueMaxBytes`, `batchMaxBytes` and `flushMilliseconds` to the numbers named "queueMaxBytes", "batchMaxBytes" and "flushMilliseconds", or to 0 for those the JSON object does not contain. ]*/
+                    double queueMaxBytes = json_object_get_number(obj, QUEUEMAXBYTES);
+                    double batchMaxBytes = json_object_get_number(obj, BATCHMAXBYTES);
+                    double flushMilliseconds = json_object_get_number(obj, FLUSHMILLISECONDS);
+                    /*Codes_SRS_LOGGER_31_003: [ `Logger_ParseConfigurationFromJson` shall set `flush` to `LOGGER_FLUSH_NONE`, `LOGGER_FLUSH_BATCH` or `LOGGER_FLUSH_SYNC` when the string named "flush" is "none", "batch" or "sync", and to `LOGGER_FLUSH_NONE` if the JSON object does not contain it. ]*/
+                    const char* flushValue = json_object_get_string(obj, FLUSH);
+                    LOGGER_FLUSH flush = LOGGER_FLUSH_NONE;
+                    bool validFlush = true;
+                    if ((flushValue == NULL) || (strcmp(flushValue, "none") == 0))
+                    {
+                        flush = LOGGER_FLUSH_NONE;
+                    }
+                    else if (strcmp(flushValue, "batch") == 0)
                     {
-                        /*Codes_SRS_LOGGER_17_003: [ If any system call fails, Logger_ParseConfigurationFromJson shall fail and return NULL. ]*/
-                        LogError("malloc failed");
+                        flush = LOGGER_FLUSH_BATCH;
+                    }
+                    else if (strcmp(flushValue, "sync") == 0)
+                    {
+                        flush = LOGGER_FLUSH_SYNC;
                     }
                     else
                     {
-                        /*Codes_SRS_LOGGER_17_002: [ Logger_ParseConfigurationFromJson shall duplicate the filename string into the LOGGER_CONFIG structure. ]*/
-                        /*Codes_SRS_LOGGER_17_007: [ Logger_ParseConfigurationFromJson shall set the selector in LOGGER_CONFIG to LOGGING_TO_FILE. ]*/
-                        result->selector = LOGGING_TO_FILE;
-                        char * logfileName;
-                        int copy_result = mallocAndStrcpy_s(&logfileName, fileNameValue);
-                        if (copy_result != 0)
+                        validFlush = false;
+                    }
+
+                    /*Codes_SRS_LOGGER_31_016: [ If the string named "format" is "binary", `Logger_ParseConfigurationFromJson` shall set the selector to `LOGGING_TO_RECORD_LOG`, the name of the record log to "filename", `flush` as it does for a file, and `segmentMaxBytes`, `segmentMaxSeconds` and `indexIntervalBytes` to the numbers of the same names, or to 0 for those the JSON object does not contain. ]*/
+                    const char* formatValue = json_object_get_string(obj, FORMAT);
+                    bool binary = (formatValue != NULL) && (strcmp(formatValue, "binary") == 0);
+                    double segmentMaxBytes = 0;
+                    double segmentMaxSeconds = 0;
+                    double indexIntervalBytes = 0;
+                    if (binary)
+                    {
+                        segmentMaxBytes = json_object_get_number(obj, SEGMENTMAXBYTES);
+                        segmentMaxSeconds = json_object_get_number(obj, SEGMENTMAXSECONDS);
+                        indexIntervalBytes = json_object_get_number(obj, INDEXINTERVALBYTES);
+                    }
+
+                    if (
+                        (queueMaxBytes < 0) ||
+                        (batchMaxBytes < 0) ||
+                        (flushMilliseconds < 0)
+                        )
+                    {
+                        /*Codes_SRS_LOGGER_31_002: [ If the value of "queueMaxBytes", "batchMaxBytes" or "flushMilliseconds" is negative then `Logger_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+                        LogError("%s, %s and %s cannot be negative", QUEUEMAXBYTES, BATCHMAXBYTES, FLUSHMILLISECONDS);
+                        result = NULL;
+                    }
+                    else if (!validFlush)
+                    {
+                        /*Codes_SRS_LOGGER_31_004: [ If the string named "flush" has another value then `Logger_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+                        LogError("%s cannot be %s, it is none, batch or sync", FLUSH, flushValue);
+                        result = NULL;
+                    }
+                    else if (
+                        (formatValue != NULL) &&
+                        !binary &&
+                        (strcmp(formatValue, "json") != 0)
+                        )
+                    {
+                        /*Codes_SRS_LOGGER_31_017: [ If the string named "format" is not "json" or "binary", if it is "binary" and "segmentMaxBytes", "segmentMaxSeconds" or "indexIntervalBytes" is negative, or if it is "binary" and "queueMaxBytes", "batchMaxBytes" or "flushMilliseconds" is not 0, then `Logger_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+                        LogError("%s cannot be %s, it is json or binary", FORMAT, formatValue);
+                        result = NULL;
+                    }
+                    else if (
+                        (segmentMaxBytes < 0) ||
+                        (segmentMaxSeconds < 0) ||
+                        (indexIntervalBytes < 0)
+                        )
+                    {
+                        /*Codes_SRS_LOGGER_31_017: [ If the string named "format" is not "json" or "binary", if it is "binary" and "segmentMaxBytes", "segmentMaxSeconds" or "indexIntervalBytes" is negative, or if it is "binary" and "queueMaxBytes", "batchMaxBytes" or "flushMilliseconds" is not 0, then `Logger_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+                        LogError("%s, %s and %s cannot be negative", SEGMENTMAXBYTES, SEGMENTMAXSECONDS, INDEXINTERVALBYTES);
+                        result = NULL;
+                    }
+                    else if (
+                        binary &&
+                        ((queueMaxBytes != 0) || (batchMaxBytes != 0) || (flushMilliseconds != 0))
+                        )
+                    {
+                        /*Codes_SRS_LOGGER_31_017: [ If the string named "format" is not "json" or "binary", if it is "binary" and "segmentMaxBytes", "segmentMaxSeconds" or "indexIntervalBytes" is negative, or if it is "binary" and "queueMaxBytes", "batchMaxBytes" or "flushMilliseconds" is not 0, then `Logger_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+                        LogError("the binary format writes every record in Module_Receive, %s, %s and %s cannot be set", QUEUEMAXBYTES, BATCHMAXBYTES, FLUSHMILLISECONDS);
+                        result = NULL;
+                    }
+                    else
+                    {
+                        /*Codes_SRS_LOGGER_17_001: [ Logger_ParseConfigurationFromJson shall allocate a new LOGGER_CONFIG structure. ]*/
+                        result = (LOGGER_CONFIG*)malloc(sizeof(LOGGER_CONFIG));
+                        if (result == NULL)
                         {
                             /*Codes_SRS_LOGGER_17_003: [ If any system call fails, Logger_ParseConfigurationFromJson shall fail and return NULL. ]*/
-                            LogError("Copying the filename failed, error= %d", copy_result);
-                            free(result);
-                            result = NULL;
+                            LogError("malloc failed");
                         }
                         else
                         {
-                            /*Codes_SRS_LOGGER_17_006: [ Logger_ParseConfigurationFromJson shall return a pointer to the created LOGGER_CONFIG structure. ]*/
-                            /**
-                             * Everything's good.
-                             */
-                             result->selectee.loggerConfigFile.name = (const char *)logfileName;
+                            /*Codes_SRS_LOGGER_17_002: [ Logger_ParseConfigurationFromJson shall duplicate the filename string into the LOGGER_CONFIG structure. ]*/
+                            /*Codes_SRS_LOGGER_17_007: [ Logger_ParseConfigurationFromJson shall set the selector in LOGGER_CONFIG to LOGGING_TO_FILE, unless "format" is "binary". ]*/
+                            result->selector = binary ? LOGGING_TO_RECORD_LOG : LOGGING_TO_FILE;
+                            char * logfileName;
+                            int copy_result = mallocAndStrcpy_s(&logfileName, fileNameValue);
+                            if (copy_result != 0)
+                            {
+                                /*Codes_SRS_LOGGER_17_003: [ If any system call fails, Logger_ParseConfigurationFromJson shall fail and return NULL. ]*/
+                                LogError("Copying the filename failed, error= %d", copy_result);
+                                free(result);
+                                result = NULL;
+                            }
+                            else
+                            {
+                                /*Codes_SRS_LOGGER_17_006: [ Logger_ParseConfigurationFromJson shall return a pointer to the created LOGGER_CONFIG structure. ]*/
+                                /**
+                                 * Everything's good.
+                                 */
+                                if (binary)
+                                {
+                                    result->selectee.loggerConfigRecordLog.name = (const char *)logfileName;
+                                    result->selectee.loggerConfigRecordLog.segmentMaxBytes = (size_t)segmentMaxBytes;
+                                    result->selectee.loggerConfigRecordLog.segmentMaxSeconds = (unsigned int)segmentMaxSeconds;
+                                    result->selectee.loggerConfigRecordLog.indexIntervalBytes = (size_t)indexIntervalBytes;
+                                    result->selectee.loggerConfigRecordLog.flush = flush;
+                                }
+                                else
+                                {
+                                    result->selectee.loggerConfigFile.name = (const char *)logfileName;
+                                    result->selectee.loggerConfigFile.queueMaxBytes = (size_t)queueMaxBytes;
+                                    result->selectee.loggerConfigFile.batchMaxBytes = (size_t)batchMaxBytes;
+                                    result->selectee.loggerConfigFile.flushMilliseconds = (unsigned int)flushMilliseconds;
+                                    result->selectee.loggerConfigFile.flush = flush;
+                                }
+                            }
                         }
                     }
                 }
@@ -359,7 +970,14 @@ static void Logger_FreeConfiguration(void* configuration)
     {
         /*Codes_SRS_LOGGER_17_005: [ Logger_FreeConfiguration shall free all resources created by Logger_ParseConfigurationFromJson. ]*/
         LOGGER_CONFIG* config = (LOGGER_CONFIG*)configuration;
-        free((char*)config->selectee.loggerConfigFile.name);
+        if (config->selector == LOGGING_TO_RECORD_LOG)
+        {
+            free((char*)config->selectee.loggerConfigRecordLog.name);
+        }
+        else
+        {
+            free((char*)config->selectee.loggerConfigFile.name);
+        }
         free(config);
     }
 }
@@ -369,24 +987,90 @@ static void Logger_Destroy(MODULE_HANDLE module)
     /*Codes_SRS_LOGGER_02_014: [If moduleHandle is NULL then Logger_Destroy shall return.]*/
     if (module != NULL)
     {
-        /*Codes_SRS_LOGGER_02_019: [Logger_Destroy shall add to the log file the following end of log JSON object:]*/
         LOGGER_HANDLE_DATA* moduleHandleData = (LOGGER_HANDLE_DATA *)module;
-        if (append_logStartStop(moduleHandleData->fout, false, false) != 0)
+        if (moduleHandleData->recordLog != NULL)
         {
-            LogError("unable to append log ending time");
+            /*Codes_SRS_LOGGER_31_020: [ `Logger_Destroy` shall close the record log, without adding the end of log JSON object. ]*/
+            RecordLog_Close(moduleHandleData->recordLog);
         }
-
-        /*Codes_SRS_LOGGER_02_015: [Otherwise Logger_Destroy shall unuse all used resources.]*/
-        if (fclose(moduleHandleData->fout) != 0)
+        else
         {
-            LogError("unable to fclose");
+            if (moduleHandleData->writer != NULL)
+            {
+                WRITER_stop(moduleHandleData);
+            }
+
+            /*Codes_SRS_LOGGER_02_019: [Logger_Destroy shall add to the log file the following end of log JSON object:]*/
+            if (append_logStartStop(moduleHandleData->fout, false, false) != 0)
+            {
+                LogError("unable to append log ending time");
+            }
+
+            /*Codes_SRS_LOGGER_02_015: [Otherwise Logger_Destroy shall unuse all used resources.]*/
+            if (fclose(moduleHandleData->fout) != 0)
+            {
+                LogError("unable to fclose");
+            }
         }
 
+        if (moduleHandleData->record.text != NULL)
+        {
+            free(moduleHandleData->record.text);
+        }
         free(moduleHandleData);
 
     }
 }
 
+/*appends the message in the gateway wire format to the record log*/
+static void RECORD_append_message(LOGGER_HANDLE_DATA* handleData, MESSAGE_HANDLE messageHandle)
+{
+    /*Codes_SRS_LOGGER_31_019: [ With a record log, `Logger_Receive` shall serialize the message with `Message_ToByteArray` in a buffer kept from one message to the next, append it to the record log and flush the record log as `flush` tells. ]*/
+    int32_t size = Message_ToByteArray(messageHandle, NULL, 0);
+    if (size < 0)
+    {
+        LogError("unable to find the size of the message");
+    }
+    else
+    {
+        if ((size_t)size > handleData->record.capacity)
+        {
+            char* newText = (char*)realloc(handleData->record.text, (size_t)size);
+            if (newText == NULL)
+            {
+                LogError("unable to grow the record to %lu bytes", (unsigned long)size);
+                size = -1;
+            }
+            else
+            {
+                handleData->record.text = newText;
+                handleData->record.capacity = (size_t)size;
+            }
+        }
+
+        if (size < 0)
+        {
+            /*Codes_SRS_LOGGER_02_012: [If producing the JSON format or writing it to the file fails, then Logger_Receive shall fail and return.]*/
+        }
+        else if (Message_ToByteArray(messageHandle, (unsigned char*)handleData->record.text, size) != size)
+        {
+            LogError("unable to Message_ToByteArray");
+        }
+        else if (
+            (RecordLog_Append(handleData->recordLog, (const unsigned char*)handleData->record.text, (size_t)size) != 0) ||
+            ((handleData->flush != LOGGER_FLUSH_NONE) && (RecordLog_Flush(handleData->recordLog, handleData->flush == LOGGER_FLUSH_SYNC) != 0))
+            )
+        {
+            LogError("unable to append the message to the record log");
+            handleData->counters.writeFailures++;
+        }
+        else
+        {
+            handleData->counters.written++;
+        }
+    }
+}
+
 static void Logger_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE messageHandle)
 {
     /*Codes_SRS_LOGGER_02_009: [If moduleHandle is NULL then Logger_Receive shall fail and return.]*/
@@ -412,123 +1096,109 @@ static void Logger_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE messageHan
             "content":"base64 encode of the message content"
         },
         */
-
-        /*the function will gather first all the values then will dump them into a STRING_HANDLE that is JSON*/
+        LOGGER_HANDLE_DATA *handleData = (LOGGER_HANDLE_DATA *)moduleHandle;
 
         /*getting the time*/
-        time_t temp = time(NULL);
-        if (temp == (time_t)-1)
+        time_t temp;
+        if (handleData->recordLog != NULL)
+        {
+            RECORD_append_message(handleData, messageHandle);
+        }
+        else if ((temp = time(NULL)) == (time_t)-1)
         {
             LogError("time function failed");
         }
+        else if (RECORD_print_time(handleData, temp) != 0)
+        {
+            /*Codes_SRS_LOGGER_02_012: [If producing the JSON format or writing it to the file fails, then Logger_Receive shall fail and return.]*/
+            LogError("unable to print the time");
+        }
         else
         {
-            struct tm* t = localtime(&temp);
-            if (t == NULL)
+            /*getting the properties*/
+            CONSTMAP_HANDLE originalProperties = Message_GetProperties(messageHandle); /*by contract this is never NULL*/
+            const char* const* keys;
+            const char* const* values;
+            size_t count;
+            if (ConstMap_GetInternals(originalProperties, &keys, &values, &count) != CONSTMAP_OK)
             {
-                LogError("localtime failed");
+                LogError("unable to ConstMap_GetInternals");
             }
             else
             {
-                char timetemp[80] = { 0 };
-                if (strftime(timetemp, sizeof(timetemp) / sizeof(timetemp[0]), "%C", t) == 0)
+                const CONSTBUFFER * content = Message_GetContent(messageHandle); /*by contract, this is never NULL*/
+                if (content == NULL)
+                {
+                    LogError("unable to Message_GetContent");
+                }
+                /*Codes_SRS_LOGGER_31_007: [ `Logger_Receive` shall render the record in a buffer kept from one message to the next, escaping the property keys and values and encoding the content in base64. ]*/
+                else if (RECORD_render(handleData, keys, values, count, content) != 0)
                 {
-                    LogError("unable to strftime");
                     /*Codes_SRS_LOGGER_02_012: [If producing the JSON format or writing it to the file fails, then Logger_Receive shall fail and return.]*/
-                    /*just return*/
+                    LogError("unable to render the record");
+                }
+                else if (handleData->writer != NULL)
+                {
+                    WRITER_queue(handleData);
                 }
                 else
                 {
-                    /*getting the properties*/
-                    /*getting the constmap*/
-                    CONSTMAP_HANDLE originalProperties = Message_GetProperties(messageHandle); /*by contract this is never NULL*/
-                    MAP_HANDLE propertiesAsMap = ConstMap_CloneWriteable(originalProperties); /*sigh, if only there'd be a constmap_tojson*/
-                    if (propertiesAsMap == NULL)
+                    /*Codes_SRS_LOGGER_31_008: [ If `queueMaxBytes` is 0, `Logger_Receive` shall write the record to the file and flush the file as `flush` tells. ]*/
+                    handleData->record.text[handleData->record.size] = ']';
+                    handleData->record.text[handleData->record.size + 1] = '\0';
+                    if (LOGGER_write(handleData, handleData->record.text) != 0)
                     {
-                        LogError("ConstMap_CloneWriteable failed");
+                        LogError("failed top add a json string to the output file");
+                        handleData->counters.writeFailures++;
                     }
                     else
                     {
-                        STRING_HANDLE jsonProperties = Map_ToJSON(propertiesAsMap);
-                        if (jsonProperties == NULL)
-                        {
-                            LogError("unable to Map_ToJSON");
-                        }
-                        else
-                        {
-                            /*getting the base64 encode of the message*/
-                            const CONSTBUFFER * content = Message_GetContent(messageHandle); /*by contract, this is never NULL*/
-							STRING_HANDLE contentAsJSON;
-							if (content == NULL)
-							{
-								contentAsJSON = NULL;
-							}
-							else
-							{
-								if (content->buffer == NULL)
-								{
-									contentAsJSON = STRING_construct_n("", 0);
-								}
-								else
-								{
-									contentAsJSON = Base64_Encode_Bytes(content->buffer, content->size);
-								}
-							}
-
-							/* NULL value here will be an error.*/
-                            if (contentAsJSON == NULL)
-                            {
-                                LogError("unable to Base64_Encode_Bytes");
-                            }
-                            else
-                            {
-                                STRING_HANDLE jsonToBeAppended = STRING_construct(",{\"time\":\"");
-                                if (jsonToBeAppended == NULL)
-                                {
-                                    LogError("unable to STRING_construct");
-                                }
-                                else
-                                {
-
-                                    if (!(
-                                        (STRING_concat(jsonToBeAppended, timetemp) == 0) &&
-                                        (STRING_concat(jsonToBeAppended, "\",\"properties\":") == 0) &&
-                                        (STRING_concat_with_STRING(jsonToBeAppended, jsonProperties) == 0) &&
-                                        (STRING_concat(jsonToBeAppended, ",\"content\":\"") == 0) &&
-                                        (STRING_concat_with_STRING(jsonToBeAppended, contentAsJSON) == 0) &&
-                                        (STRING_concat(jsonToBeAppended, "\"}]") == 0)
-                                        ))
-                                    {
-                                        LogError("STRING concatenation error");
-                                    }
-                                    else
-                                    {
-                                        LOGGER_HANDLE_DATA *handleData = (LOGGER_HANDLE_DATA *)moduleHandle;
-                                        if (addJSONString(handleData->fout, STRING_c_str(jsonToBeAppended)) != 0)
-                                        {
-                                            LogError("failed top add a json string to the output file");
-                                        }
-                                        else
-                                        {
-                                            /*all seems fine*/
-                                        }
-                                    }
-                                    STRING_delete(jsonToBeAppended);
-                                }
-                                STRING_delete(contentAsJSON);
-                            }
-                            STRING_delete(jsonProperties);
-                        }
-                        Map_Destroy(propertiesAsMap);
+                        handleData->counters.written++;
                     }
-                    ConstMap_Destroy(originalProperties);
                 }
             }
+            ConstMap_Destroy(originalProperties);
         }
     }
     /*Codes_SRS_LOGGER_02_013: [Logger_Receive shall return.]*/
 }
 
+int Logger_GetCounters(MODULE_HANDLE module, LOGGER_COUNTERS* counters)
+{
+    int result;
+    /*Codes_SRS_LOGGER_31_014: [ If `module` or `counters` is NULL then `Logger_GetCounters` shall fail and return a non-zero value. ]*/
+    if (
+        (module == NULL) ||
+        (counters == NULL)
+        )
+    {
+        LogError("invalid arg module=%p counters=%p", module, counters);
+        result = __LINE__;
+    }
+    else
+    {
+        LOGGER_HANDLE_DATA* handleData = (LOGGER_HANDLE_DATA*)module;
+        if (handleData->writer == NULL)
+        {
+            /*Codes_SRS_LOGGER_31_015: [ `Logger_GetCounters` shall copy the counters of the module into `counters` and return 0. ]*/
+            *counters = handleData->counters;
+            result = 0;
+        }
+        else if (Lock(handleData->lock) != LOCK_OK)
+        {
+            LogError("unable to lock");
+            result = __LINE__;
+        }
+        else
+        {
+            *counters = handleData->counters;
+            (void)Unlock(handleData->lock);
+            result = 0;
+        }
+    }
+    return result;
+}
+
 /*
  *    Required for all modules:  the public API and the designated implementation functions.
  */
@@ -0,0 +1,633 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef WIN32
+#include <io.h>
+#define RECORD_LOG_COMMIT(file) _commit(_fileno(file))
+#else
+#include <unistd.h>
+#define RECORD_LOG_COMMIT(file) fsync(fileno(file))
+#endif
+
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/gb_stdio.h"
+#include "azure_c_shared_utility/gb_time.h"
+#include "azure_c_shared_utility/strings.h"
+#include "azure_c_shared_utility/tickcounter.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "segment_file.h"
+#include "record_log.h"
+
+/*a record is a header followed by the bytes appended, every number is big endian*/
+#define RECORD_MAGIC "RLOG"
+#define RECORD_TIME_OFFSET 8
+#define RECORD_HEADER_SIZE 16
+
+/*an index entry is the time of a record followed by its offset in the segment*/
+#define INDEX_TIME_OFFSET 0
+#define INDEX_RECORD_OFFSET 8
+#define INDEX_ENTRY_SIZE 16
+
+#define RECORD_LOG_EXTENSION "rlog"
+#define INDEX_EXTENSION "ridx"
+
+typedef struct RECORD_LOG_TAG
+{
+    STRING_HANDLE name;
+    size_t segmentMaxBytes;
+    uint64_t segmentMaxMilliseconds;
+    size_t indexIntervalBytes;
+    TICK_COUNTER_HANDLE clock;
+    uint64_t openedTime; /*milliseconds since 1970 when the log was opened*/
+    tickcounter_ms_t openedTicks;
+    uint64_t lastTime; /*of the record last appended, the times of the records never go back*/
+    uint64_t firstNumber; /*of the oldest segment of the log*/
+    uint64_t nextNumber; /*of the next segment started*/
+    FILE* segment; /*the segment records are appended to, NULL once it is sealed*/
+    FILE* index;
+    size_t segmentBytes;
+    uint64_t segmentStarted; /*the time of the first record of the segment*/
+    size_t indexedBytes; /*segmentBytes when the last index entry was written*/
+}RECORD_LOG;
+
+typedef struct RECORD_LOG_READER_TAG
+{
+    STRING_HANDLE name;
+    uint64_t firstNumber;
+    uint64_t endNumber; /*one past the newest segment*/
+    uint64_t number; /*of the next segment mapped*/
+    bool mapped;
+    const unsigned char* bytes; /*the segment mapped, NULL when it is empty*/
+    size_t size;
+    size_t offset; /*of the next record in the segment mapped*/
+    size_t startOffset; /*where the reading of the next segment mapped starts*/
+    uint64_t from; /*the records appended before are skipped*/
+}RECORD_LOG_READER;
+
+static bool RECORD_LOG_segment_exists(STRING_HANDLE name, uint64_t number)
+{
+    bool result = false;
+    STRING_HANDLE path = SegmentFile_Path(name, number, RECORD_LOG_EXTENSION);
+    if (path != NULL)
+    {
+        FILE* file = fopen(STRING_c_str(path), "rb");
+        if (file != NULL)
+        {
+            (void)fclose(file);
+            result = true;
+        }
+        STRING_delete(path);
+    }
+    return result;
+}
+
+/*the manifest holds the numbers of the oldest segment and of the next one, a log without a manifest has none*/
+static int RECORD_LOG_read_manifest(STRING_HANDLE name, uint64_t* first, uint64_t* next)
+{
+    int result;
+    uint64_t numbers[2];
+    if (SegmentFile_ReadManifest(name, RECORD_LOG_EXTENSION, numbers, 2) != 0)
+    {
+        result = __LINE__;
+    }
+    else if (numbers[0] > numbers[1])
+    {
+        LogError("the manifest of %s is damaged", STRING_c_str(name));
+        result = __LINE__;
+    }
+    else
+    {
+        *first = numbers[0];
+        *next = numbers[1];
+        result = 0;
+    }
+    return result;
+}
+
+static int RECORD_LOG_write_manifest(RECORD_LOG* log)
+{
+    uint64_t numbers[2];
+    numbers[0] = log->firstNumber;
+    numbers[1] = log->nextNumber;
+    return SegmentFile_WriteManifest(log->name, RECORD_LOG_EXTENSION, numbers, 2);
+}
+
+RECORD_LOG_HANDLE RecordLog_Open(const RECORD_LOG_CONFIG* config)
+{
+    RECORD_LOG* result;
+    if (
+        (config == NULL) ||
+        (config->name == NULL)
+        )
+    {
+        /*Codes_SRS_RECORD_LOG_31_001: [ If `config` or `config->name` is NULL then `RecordLog_Open` shall fail and return NULL. ]*/
+        LogError("invalid arg config=%p", config);
+        result = NULL;
+    }
+    else if ((result = (RECORD_LOG*)malloc(sizeof(RECORD_LOG))) == NULL)
+    {
+        /*Codes_SRS_RECORD_LOG_31_003: [ If `RecordLog_Open` encounters an internal failure it shall fail and return NULL. ]*/
+        LogError("unable to malloc");
+    }
+    else
+    {
+        time_t now;
+        memset(result, 0, sizeof(RECORD_LOG));
+        result->segmentMaxBytes = (config->segmentMaxBytes == 0) ? RECORD_LOG_DEFAULT_SEGMENT_BYTES : config->segmentMaxBytes;
+        result->segmentMaxMilliseconds = (uint64_t)config->segmentMaxSeconds * 1000;
+        result->indexIntervalBytes = (config->indexIntervalBytes == 0) ? RECORD_LOG_DEFAULT_INDEX_BYTES : config->indexIntervalBytes;
+        if ((result->name = STRING_construct(config->name)) == NULL)
+        {
+            LogError("unable to STRING_construct");
+            free(result);
+            result = NULL;
+        }
+        else if ((result->clock = tickcounter_create()) == NULL)
+        {
+            LogError("unable to tickcounter_create");
+            STRING_delete(result->name);
+            free(result);
+            result = NULL;
+        }
+        else if (
+            ((now = time(NULL)) == (time_t)-1) ||
+            (tickcounter_get_current_ms(result->clock, &result->openedTicks) != 0)
+            )
+        {
+            LogError("unable to read the clock");
+            tickcounter_destroy(result->clock);
+            STRING_delete(result->name);
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            result->openedTime = (uint64_t)now * 1000;
+            /*Codes_SRS_RECORD_LOG_31_002: [ `RecordLog_Open` shall keep the segments a previous log of the same name left on disk, and append the next records to a new segment. ]*/
+            if (RECORD_LOG_read_manifest(result->name, &result->firstNumber, &result->nextNumber) != 0)
+            {
+                /*a new log*/
+                result->firstNumber = 1;
+                result->nextNumber = 1;
+            }
+
+            /*a segment left behind by a log whose manifest was lost is not overwritten*/
+            while (RECORD_LOG_segment_exists(result->name, result->nextNumber))
+            {
+                result->nextNumber++;
+            }
+        }
+    }
+    return result;
+}
+
+static uint64_t RECORD_LOG_now(RECORD_LOG* log)
+{
+    tickcounter_ms_t ticks;
+    uint64_t result;
+    if (tickcounter_get_current_ms(log->clock, &ticks) != 0)
+    {
+        LogError("unable to tickcounter_get_current_ms, the record takes the time of the previous one");
+        result = log->lastTime;
+    }
+    else if (ticks < log->openedTicks)
+    {
+        result = log->lastTime;
+    }
+    else
+    {
+        result = log->openedTime + (uint64_t)(ticks - log->openedTicks);
+        if (result < log->lastTime)
+        {
+            result = log->lastTime;
+        }
+    }
+    return result;
+}
+
+static void RECORD_LOG_seal(RECORD_LOG* log)
+{
+    if (fclose(log->segment) != 0)
+    {
+        LogError("unable to close segment %llu", (unsigned long long)(log->nextNumber - 1));
+    }
+    if (fclose(log->index) != 0)
+    {
+        LogError("unable to close the index of segment %llu", (unsigned long long)(log->nextNumber - 1));
+    }
+    log->segment = NULL;
+    log->index = NULL;
+}
+
+static int RECORD_LOG_start_segment(RECORD_LOG* log, uint64_t time)
+{
+    int result;
+    STRING_HANDLE segmentPath = SegmentFile_Path(log->name, log->nextNumber, RECORD_LOG_EXTENSION);
+    STRING_HANDLE indexPath = SegmentFile_Path(log->name, log->nextNumber, INDEX_EXTENSION);
+    if (
+        (segmentPath == NULL) ||
+        (indexPath == NULL)
+        )
+    {
+        result = __LINE__;
+    }
+    else if ((log->segment = fopen(STRING_c_str(segmentPath), "wb")) == NULL)
+    {
+        LogError("unable to create %s", STRING_c_str(segmentPath));
+        result = __LINE__;
+    }
+    else if ((log->index = fopen(STRING_c_str(indexPath), "wb")) == NULL)
+    {
+        LogError("unable to create %s", STRING_c_str(indexPath));
+        (void)fclose(log->segment);
+        log->segment = NULL;
+        (void)remove(STRING_c_str(segmentPath));
+        result = __LINE__;
+    }
+    else
+    {
+        log->nextNumber++;
+        log->segmentBytes = 0;
+        log->segmentStarted = time;
+        if (RECORD_LOG_write_manifest(log) != 0)
+        {
+            /*the segment is found by the next log all the same*/
+            LogError("unable to record segment %llu in the manifest", (unsigned long long)(log->nextNumber - 1));
+        }
+        result = 0;
+    }
+    STRING_delete(indexPath);
+    STRING_delete(segmentPath);
+    return result;
+}
+
+int RecordLog_Append(RECORD_LOG_HANDLE log, const unsigned char* record, size_t size)
+{
+    int result;
+    if (
+        (log == NULL) ||
+        ((record == NULL) && (size != 0)) ||
+        (size > UINT32_MAX)
+        )
+    {
+        /*Codes_SRS_RECORD_LOG_31_004: [ If `log` is NULL, or `record` is NULL and `size` is not 0, then `RecordLog_Append` shall fail and return a non-zero value. ]*/
+        LogError("invalid arg log=%p record=%p size=%lu", log, record, (unsigned long)size);
+        result = __LINE__;
+    }
+    else
+    {
+        uint64_t now = RECORD_LOG_now(log);
+        /*Codes_SRS_RECORD_LOG_31_006: [ A segment holding `segmentMaxBytes` bytes, or whose first record was appended `segmentMaxSeconds` seconds ago, shall take no more records, the next record shall start a new segment. ]*/
+        if (
+            (log->segment != NULL) &&
+            (
+                ((log->segmentBytes != 0) && (log->segmentBytes + RECORD_HEADER_SIZE + size > log->segmentMaxBytes)) ||
+                ((log->segmentMaxMilliseconds != 0) && (now - log->segmentStarted >= log->segmentMaxMilliseconds))
+            )
+            )
+        {
+            RECORD_LOG_seal(log);
+        }
+
+        if (
+            (log->segment == NULL) &&
+            (RECORD_LOG_start_segment(log, now) != 0)
+            )
+        {
+            LogError("unable to start a segment, the record is lost");
+            result = __LINE__;
+        }
+        else
+        {
+            unsigned char header[RECORD_HEADER_SIZE];
+            bool written = true;
+
+            /*Codes_SRS_RECORD_LOG_31_007: [ `RecordLog_Append` shall write the time and the offset of the record to the index of the segment when it is the first record of the segment or `indexIntervalBytes` bytes were appended since the last one indexed. ]*/
+            if (
+                (log->segmentBytes == 0) ||
+                (log->segmentBytes - log->indexedBytes >= log->indexIntervalBytes)
+                )
+            {
+                unsigned char entry[INDEX_ENTRY_SIZE];
+                SegmentFile_PutUint64(entry + INDEX_TIME_OFFSET, now);
+                SegmentFile_PutUint64(entry + INDEX_RECORD_OFFSET, (uint64_t)log->segmentBytes);
+                written = (fwrite(entry, 1, INDEX_ENTRY_SIZE, log->index) == INDEX_ENTRY_SIZE);
+                log->indexedBytes = log->segmentBytes;
+            }
+
+            /*Codes_SRS_RECORD_LOG_31_005: [ `RecordLog_Append` shall write the record after a header holding the magic "RLOG", its size and the milliseconds since 1970, never less than those of the previous record, and return 0. ]*/
+            SegmentFile_PutHeader(header, RECORD_MAGIC, (uint32_t)size);
+            SegmentFile_PutUint64(header + RECORD_TIME_OFFSET, now);
+            if (
+                !written ||
+                (fwrite(header, 1, RECORD_HEADER_SIZE, log->segment) != RECORD_HEADER_SIZE) ||
+                ((size != 0) && (fwrite(record, 1, size, log->segment) != size))
+                )
+            {
+                /*Codes_SRS_RECORD_LOG_31_008: [ If writing the record fails then `RecordLog_Append` shall seal its segment, so that a torn record ends it, and return a non-zero value. ]*/
+                LogError("unable to write the record to segment %llu", (unsigned long long)(log->nextNumber - 1));
+                RECORD_LOG_seal(log);
+                result = __LINE__;
+            }
+            else
+            {
+                log->segmentBytes += RECORD_HEADER_SIZE + size;
+                log->lastTime = now;
+                result = 0;
+            }
+        }
+    }
+    return result;
+}
+
+int RecordLog_Flush(RECORD_LOG_HANDLE log, bool commit)
+{
+    int result;
+    if (log == NULL)
+    {
+        /*Codes_SRS_RECORD_LOG_31_009: [ If `log` is NULL then `RecordLog_Flush` shall fail and return a non-zero value. ]*/
+        LogError("invalid arg log=NULL");
+        result = __LINE__;
+    }
+    else if (log->segment == NULL)
+    {
+        /*a sealed segment is already written out*/
+        result = 0;
+    }
+    /*Codes_SRS_RECORD_LOG_31_010: [ `RecordLog_Flush` shall flush the segment records are appended to and its index, commit them to the disk when `commit` is true, and return 0. ]*/
+    else if (
+        (fflush(log->segment) != 0) ||
+        (fflush(log->index) != 0)
+        )
+    {
+        LogError("unable to fflush");
+        result = __LINE__;
+    }
+    else if (
+        commit &&
+        ((RECORD_LOG_COMMIT(log->segment) != 0) || (RECORD_LOG_COMMIT(log->index) != 0))
+        )
+    {
+        LogError("unable to commit the segment to the disk");
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+void RecordLog_Close(RECORD_LOG_HANDLE log)
+{
+    /*Codes_SRS_RECORD_LOG_31_011: [ `RecordLog_Close` shall close the files of the log; it shall do nothing when `log` is NULL. ]*/
+    if (log != NULL)
+    {
+        if (log->segment != NULL)
+        {
+            RECORD_LOG_seal(log);
+        }
+        tickcounter_destroy(log->clock);
+        STRING_delete(log->name);
+        free(log);
+    }
+}
+
+static void RECORD_LOG_READER_unmap(RECORD_LOG_READER* reader)
+{
+    if (reader->mapped)
+    {
+        SegmentFile_Unmap(reader->bytes, reader->size);
+        reader->mapped = false;
+        reader->bytes = NULL;
+        reader->size = 0;
+    }
+}
+
+RECORD_LOG_READER_HANDLE RecordLog_OpenReader(const char* name)
+{
+    RECORD_LOG_READER* result;
+    if (name == NULL)
+    {
+        /*Codes_SRS_RECORD_LOG_31_012: [ If `name` is NULL, or there is no log named `name`, then `RecordLog_OpenReader` shall fail and return NULL. ]*/
+        LogError("invalid arg name=NULL");
+        result = NULL;
+    }
+    else if ((result = (RECORD_LOG_READER*)malloc(sizeof(RECORD_LOG_READER))) == NULL)
+    {
+        /*Codes_SRS_RECORD_LOG_31_013: [ If `RecordLog_OpenReader` encounters an internal failure it shall fail and return NULL. ]*/
+        LogError("unable to malloc");
+    }
+    else
+    {
+        memset(result, 0, sizeof(RECORD_LOG_READER));
+        if ((result->name = STRING_construct(name)) == NULL)
+        {
+            LogError("unable to STRING_construct");
+            free(result);
+            result = NULL;
+        }
+        else if (RECORD_LOG_read_manifest(result->name, &result->firstNumber, &result->endNumber) != 0)
+        {
+            LogError("there is no log named %s", name);
+            STRING_delete(result->name);
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            /*the segment a log is appending to is read as far as it is written when it is mapped*/
+            result->number = result->firstNumber;
+        }
+    }
+    return result;
+}
+
+void RecordLog_CloseReader(RECORD_LOG_READER_HANDLE reader)
+{
+    /*Codes_SRS_RECORD_LOG_31_018: [ `RecordLog_CloseReader` shall unmap the segment being read; it shall do nothing when `reader` is NULL. ]*/
+    if (reader != NULL)
+    {
+        RECORD_LOG_READER_unmap(reader);
+        STRING_delete(reader->name);
+        free(reader);
+    }
+}
+
+int RecordLog_Next(RECORD_LOG_READER_HANDLE reader, const unsigned char** record, size_t* size, uint64_t* time)
+{
+    int result;
+    if (
+        (reader == NULL) ||
+        (record == NULL) ||
+        (size == NULL) ||
+        (time == NULL)
+        )
+    {
+        /*Codes_SRS_RECORD_LOG_31_014: [ If `reader`, `record`, `size` or `time` is NULL then `RecordLog_Next` shall fail and return a non-zero value. ]*/
+        LogError("invalid arg reader=%p record=%p size=%p time=%p", reader, record, size, time);
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_RECORD_LOG_31_015: [ `RecordLog_Next` shall return the records in the order they were appended, mapping the segments one at a time, leaving out a segment from its first damaged record on, and set `*record` to NULL once every record is read. ]*/
+        *record = NULL;
+        result = 0;
+        while (*record == NULL)
+        {
+            if (!reader->mapped)
+            {
+                STRING_HANDLE path;
+                if (reader->number >= reader->endNumber)
+                {
+                    /*every record is read*/
+                    break;
+                }
+                else if ((path = SegmentFile_Path(reader->name, reader->number, RECORD_LOG_EXTENSION)) == NULL)
+                {
+                    result = __LINE__;
+                    break;
+                }
+                else
+                {
+                    if (SegmentFile_Map(STRING_c_str(path), &reader->bytes, &reader->size) != 0)
+                    {
+                        LogInfo("segment %s cannot be read, it is left out", STRING_c_str(path));
+                    }
+                    else
+                    {
+                        reader->mapped = true;
+                        /*an index pointing past its segment is not trusted*/
+                        reader->offset = (reader->startOffset <= reader->size) ? reader->startOffset : 0;
+                    }
+                    reader->startOffset = 0;
+                    reader->number++;
+                    STRING_delete(path);
+                }
+            }
+            else
+            {
+                size_t recordSize;
+                if (SegmentFile_GetRecord(reader->bytes, reader->size, reader->offset, RECORD_MAGIC, RECORD_HEADER_SIZE, &recordSize) != 0)
+                {
+                    if (reader->offset != reader->size)
+                    {
+                        LogInfo("segment %llu is torn or damaged at offset %lu, the rest of it is left out", (unsigned long long)(reader->number - 1), (unsigned long)reader->offset);
+                    }
+                    RECORD_LOG_READER_unmap(reader);
+                }
+                else
+                {
+                    const unsigned char* header = reader->bytes + reader->offset;
+                    uint64_t recordTime = SegmentFile_GetUint64(header + RECORD_TIME_OFFSET);
+                    reader->offset += RECORD_HEADER_SIZE + recordSize;
+                    if (recordTime >= reader->from)
+                    {
+                        *record = header + RECORD_HEADER_SIZE;
+                        *size = recordSize;
+                        *time = recordTime;
+                    }
+                }
+            }
+        }
+    }
+    return result;
+}
+
+/*reads the first entry of the index of a segment, which points to its first record*/
+static int RECORD_LOG_READER_first_time(RECORD_LOG_READER* reader, uint64_t number, uint64_t* time)
+{
+    int result;
+    STRING_HANDLE path = SegmentFile_Path(reader->name, number, INDEX_EXTENSION);
+    if (path == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        FILE* index = fopen(STRING_c_str(path), "rb");
+        if (index == NULL)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            unsigned char entry[INDEX_ENTRY_SIZE];
+            if (fread(entry, 1, INDEX_ENTRY_SIZE, index) != INDEX_ENTRY_SIZE)
+            {
+                result = __LINE__;
+            }
+            else
+            {
+                *time = SegmentFile_GetUint64(entry + INDEX_TIME_OFFSET);
+                result = 0;
+            }
+            (void)fclose(index);
+        }
+        STRING_delete(path);
+    }
+    return result;
+}
+
+/*finds the offset of the last record indexed in the segment before time, 0 when there is none*/
+static size_t RECORD_LOG_READER_find_offset(RECORD_LOG_READER* reader, uint64_t number, uint64_t time)
+{
+    size_t result = 0;
+    STRING_HANDLE path = SegmentFile_Path(reader->name, number, INDEX_EXTENSION);
+    if (path != NULL)
+    {
+        FILE* index = fopen(STRING_c_str(path), "rb");
+        if (index != NULL)
+        {
+            unsigned char entry[INDEX_ENTRY_SIZE];
+            while (
+                (fread(entry, 1, INDEX_ENTRY_SIZE, index) == INDEX_ENTRY_SIZE) &&
+                (SegmentFile_GetUint64(entry + INDEX_TIME_OFFSET) < time)
+                )
+            {
+                result = (size_t)SegmentFile_GetUint64(entry + INDEX_RECORD_OFFSET);
+            }
+            (void)fclose(index);
+        }
+        STRING_delete(path);
+    }
+    return result;
+}
+
+int RecordLog_Seek(RECORD_LOG_READER_HANDLE reader, uint64_t time)
+{
+    int result;
+    if (reader == NULL)
+    {
+        /*Codes_SRS_RECORD_LOG_31_016: [ If `reader` is NULL then `RecordLog_Seek` shall fail and return a non-zero value. ]*/
+        LogError("invalid arg reader=NULL");
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_RECORD_LOG_31_017: [ `RecordLog_Seek` shall skip the segments whose next segment starts at or before `time`, start reading at the last record indexed before `time`, and make `RecordLog_Next` leave out the records appended before `time`. ]*/
+        uint64_t number = reader->firstNumber;
+        uint64_t nextFirst;
+        while (
+            (number + 1 < reader->endNumber) &&
+            (RECORD_LOG_READER_first_time(reader, number + 1, &nextFirst) == 0) &&
+            (nextFirst <= time)
+            )
+        {
+            number++;
+        }
+
+        RECORD_LOG_READER_unmap(reader);
+        reader->number = number;
+        reader->startOffset = RECORD_LOG_READER_find_offset(reader, number, time);
+        reader->from = time;
+        result = 0;
+    }
+    return result;
+}
@@ -22,14 +22,14 @@ gb_fprintf                        \
 FOR_EACH_1(DEFINE_FAIL_VARIABLES, LIST_OF_COUNTED_APIS)
 
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/threadapi.h"
 #include "module.h"
 #include "module_access.h"
-#include "azure_c_shared_utility/strings.h"
 #include "azure_c_shared_utility/constmap.h"
-#include "azure_c_shared_utility/map.h"
 #include "message.h"
-#include "azure_c_shared_utility/base64.h"
 #include "logger.h"
+#include "record_log.h"
 
 #include <parson.h>
 
@@ -130,11 +130,6 @@ namespace BASEIMPLEMENTATION
 
 };
 
-typedef struct LOGGER_HANDLE_DATA_TAG
-{
-    FILE* fout;
-}LOGGER_HANDLE_DATA;
-
 static MICROMOCK_MUTEX_HANDLE g_testByTest;
 static MICROMOCK_GLOBAL_SEMAPHORE_HANDLE g_dllByDll;
 
@@ -172,6 +167,39 @@ static MESSAGE_HANDLE validMessageHandle = (MESSAGE_HANDLE)0x032;
 static unsigned char buffer[3] = { 1,2,3 };
 static CONSTBUFFER validBuffer = { buffer, sizeof(buffer)/sizeof(buffer[0]) };
 
+static const char* const propertyKeys[] = { "key1", "key\"2" };
+static const char* const propertyValues[] = { "value1", "line\nbreak" };
+
+/*the record of validMessageHandle, its properties escaped and its content in base64*/
+#define RENDERED_RECORD ",{\"time\":\"" TIME_IN_STRFTIME "\",\"properties\":{\"key1\":\"value1\",\"key\\\"2\":\"line\\nbreak\"},\"content\":\"AQID\"}"
+
+/*room for 2 records*/
+static LOGGER_CONFIG writerConfig =
+{
+    LOGGING_TO_FILE,
+    { { "a.txt", 2 * (sizeof(RENDERED_RECORD) - 1), 0, 0, LOGGER_FLUSH_NONE } }
+};
+
+/*the size of validMessageHandle in the gateway wire format*/
+#define SERIALIZED_SIZE 42
+#define TEST_RECORD_LOG (RECORD_LOG_HANDLE)0x4242
+
+static LOGGER_CONFIG makeRecordLogConfig(void)
+{
+    LOGGER_CONFIG config;
+    config.selector = LOGGING_TO_RECORD_LOG;
+    config.selectee.loggerConfigRecordLog.name = "log";
+    config.selectee.loggerConfigRecordLog.segmentMaxBytes = 0;
+    config.selectee.loggerConfigRecordLog.segmentMaxSeconds = 0;
+    config.selectee.loggerConfigRecordLog.indexIntervalBytes = 0;
+    config.selectee.loggerConfigRecordLog.flush = LOGGER_FLUSH_BATCH;
+    return config;
+}
+
+/*the writer thread runs when Logger_Destroy joins it*/
+static THREAD_START_FUNC writerFunction;
+static void* writerArgument;
+
 
 TYPED_MOCK_CLASS(CLoggerMocks, CGlobalMock)
 {
@@ -196,6 +224,9 @@ public:
     MOCK_STATIC_METHOD_2(, const char*, json_object_get_string, const JSON_Object*, object, const char*, name)
     MOCK_METHOD_END(const char*, (strcmp(name, "filename") == 0) ? "log.txt" : NULL);
 
+    MOCK_STATIC_METHOD_2(, double, json_object_get_number, const JSON_Object*, object, const char*, name)
+    MOCK_METHOD_END(double, 0);
+
     MOCK_STATIC_METHOD_1(, void, json_value_free, JSON_Value*, value)
         free(value);
     MOCK_VOID_METHOD_END();
@@ -205,6 +236,10 @@ public:
         void* result2 = BASEIMPLEMENTATION::gballoc_malloc(size);
     MOCK_METHOD_END(void*, result2);
 
+    MOCK_STATIC_METHOD_2(, void*, gballoc_realloc, void*, ptr, size_t, size)
+        void* result2 = BASEIMPLEMENTATION::gballoc_realloc(ptr, size);
+    MOCK_METHOD_END(void*, result2);
+
     MOCK_STATIC_METHOD_1(, void, gballoc_free, void*, ptr)
         BASEIMPLEMENTATION::gballoc_free(ptr);
     MOCK_VOID_METHOD_END()
@@ -225,40 +260,6 @@ public:
 	}
 	MOCK_METHOD_END(int, r)
 
-    //string
-    MOCK_STATIC_METHOD_1(, STRING_HANDLE, STRING_construct, const char*, source)
-        STRING_HANDLE result2 = (STRING_HANDLE)malloc(4);
-    MOCK_METHOD_END(STRING_HANDLE, result2)
-
-	MOCK_STATIC_METHOD_2(, STRING_HANDLE, STRING_construct_n, const char*, psz, size_t, n)
-		STRING_HANDLE result3 = (STRING_HANDLE)malloc(n+1);
-	MOCK_METHOD_END(STRING_HANDLE, result3)
-
-    MOCK_STATIC_METHOD_1(, void, STRING_delete, STRING_HANDLE, s)
-        free(s);
-    MOCK_VOID_METHOD_END()
-
-    MOCK_STATIC_METHOD_2(, int, STRING_concat, STRING_HANDLE, s1, const char*, s2)
-    MOCK_METHOD_END(int, 0);
-
-    MOCK_STATIC_METHOD_2(, int, STRING_concat_with_STRING, STRING_HANDLE, s1, STRING_HANDLE, s2)
-    MOCK_METHOD_END(int, 0);
-
-    MOCK_STATIC_METHOD_1(, const char*, STRING_c_str, STRING_HANDLE, s)
-    MOCK_METHOD_END(const char*, "thisIsRandomContent")
-
-    MOCK_STATIC_METHOD_1(, MAP_HANDLE, ConstMap_CloneWriteable, CONSTMAP_HANDLE, handle)
-        MAP_HANDLE result2 = (MAP_HANDLE)malloc(5);
-    MOCK_METHOD_END(MAP_HANDLE, result2)
-
-    MOCK_STATIC_METHOD_1(, void, Map_Destroy, MAP_HANDLE, ptr)
-       free(ptr);
-    MOCK_VOID_METHOD_END()
-
-    MOCK_STATIC_METHOD_1(, STRING_HANDLE, Map_ToJSON, MAP_HANDLE, handle)
-        STRING_HANDLE result2 = (STRING_HANDLE)malloc(6);
-    MOCK_METHOD_END(STRING_HANDLE, result2)
-
     MOCK_STATIC_METHOD_1(, CONSTMAP_HANDLE, Message_GetProperties, MESSAGE_HANDLE, message)
         CONSTMAP_HANDLE result2 = (CONSTMAP_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1);
     MOCK_METHOD_END(CONSTMAP_HANDLE, result2)
@@ -267,13 +268,35 @@ public:
         free(handle);
     MOCK_VOID_METHOD_END()
 
+    MOCK_STATIC_METHOD_4(, CONSTMAP_RESULT, ConstMap_GetInternals, CONSTMAP_HANDLE, handle, const char*const**, keys, const char*const**, values, size_t*, count)
+        *keys = propertyKeys;
+        *values = propertyValues;
+        *count = sizeof(propertyKeys) / sizeof(propertyKeys[0]);
+    MOCK_METHOD_END(CONSTMAP_RESULT, CONSTMAP_OK)
+
     MOCK_STATIC_METHOD_1(, const CONSTBUFFER *, Message_GetContent, MESSAGE_HANDLE, message)
         const CONSTBUFFER * result2 = &validBuffer;
     MOCK_METHOD_END(const CONSTBUFFER *, result2)
 
-    MOCK_STATIC_METHOD_2(, STRING_HANDLE, Base64_Encode_Bytes, const unsigned char*, source, size_t, size);
-        STRING_HANDLE result2 = (STRING_HANDLE)malloc(7);
-    MOCK_METHOD_END(STRING_HANDLE, result2);
+    MOCK_STATIC_METHOD_3(, int32_t, Message_ToByteArray, MESSAGE_HANDLE, messageHandle, unsigned char*, buf, int32_t, size)
+        if (buf != NULL)
+        {
+            memset(buf, 'A', size);
+        }
+    MOCK_METHOD_END(int32_t, SERIALIZED_SIZE)
+
+    // record_log.h
+    MOCK_STATIC_METHOD_1(, RECORD_LOG_HANDLE, RecordLog_Open, const RECORD_LOG_CONFIG*, config)
+    MOCK_METHOD_END(RECORD_LOG_HANDLE, TEST_RECORD_LOG)
+
+    MOCK_STATIC_METHOD_1(, void, RecordLog_Close, RECORD_LOG_HANDLE, log)
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_3(, int, RecordLog_Append, RECORD_LOG_HANDLE, log, const unsigned char*, record, size_t, size)
+    MOCK_METHOD_END(int, 0)
+
+    MOCK_STATIC_METHOD_2(, int, RecordLog_Flush, RECORD_LOG_HANDLE, log, bool, commit)
+    MOCK_METHOD_END(int, 0)
 
     MOCK_STATIC_METHOD_2(, FILE*, gb_fopen, const char*, filename, const char*, mode)
         FILE* result2 = (FILE*)malloc(8);
@@ -310,34 +333,71 @@ public:
             strcpy(s, TIME_IN_STRFTIME);
         }
     MOCK_METHOD_END(size_t, maxsize);
+
+    MOCK_STATIC_METHOD_0(, LOCK_HANDLE, Lock_Init)
+    MOCK_METHOD_END(LOCK_HANDLE, (LOCK_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1))
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Lock, LOCK_HANDLE, lock)
+    MOCK_METHOD_END(LOCK_RESULT, LOCK_OK)
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Unlock, LOCK_HANDLE, lock)
+    MOCK_METHOD_END(LOCK_RESULT, LOCK_OK)
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Lock_Deinit, LOCK_HANDLE, lock)
+        BASEIMPLEMENTATION::gballoc_free(lock);
+    MOCK_METHOD_END(LOCK_RESULT, LOCK_OK)
+
+    MOCK_STATIC_METHOD_0(, COND_HANDLE, Condition_Init)
+    MOCK_METHOD_END(COND_HANDLE, (COND_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1))
+
+    MOCK_STATIC_METHOD_1(, COND_RESULT, Condition_Post, COND_HANDLE, handle)
+    MOCK_METHOD_END(COND_RESULT, COND_OK)
+
+    MOCK_STATIC_METHOD_3(, COND_RESULT, Condition_Wait, COND_HANDLE, handle, LOCK_HANDLE, lock, int, timeout_milliseconds)
+    MOCK_METHOD_END(COND_RESULT, COND_TIMEOUT)
+
+    MOCK_STATIC_METHOD_1(, void, Condition_Deinit, COND_HANDLE, handle)
+        BASEIMPLEMENTATION::gballoc_free(handle);
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_3(, THREADAPI_RESULT, ThreadAPI_Create, THREAD_HANDLE*, threadHandle, THREAD_START_FUNC, func, void*, arg)
+        *threadHandle = (THREAD_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1);
+        writerFunction = func;
+        writerArgument = arg;
+    MOCK_METHOD_END(THREADAPI_RESULT, THREADAPI_OK)
+
+    /*Logger_Destroy has asked the writer thread to stop, it writes the records waiting and returns*/
+    MOCK_STATIC_METHOD_2(, THREADAPI_RESULT, ThreadAPI_Join, THREAD_HANDLE, threadHandle, int*, res)
+        if (writerFunction != NULL)
+        {
+            *res = writerFunction(writerArgument);
+            writerFunction = NULL;
+        }
+        BASEIMPLEMENTATION::gballoc_free(threadHandle);
+    MOCK_METHOD_END(THREADAPI_RESULT, THREADAPI_OK)
 };
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , JSON_Value*, json_parse_string, const char *, filename);
 DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , JSON_Object*, json_value_get_object, const JSON_Value*, value);
 DECLARE_GLOBAL_MOCK_METHOD_2(CLoggerMocks, , const char*, json_object_get_string, const JSON_Object*, object, const char*, name);
+DECLARE_GLOBAL_MOCK_METHOD_2(CLoggerMocks, , double, json_object_get_number, const JSON_Object*, object, const char*, name);
 DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , void, json_value_free, JSON_Value*, value);
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , void*, gballoc_malloc, size_t, size);
+DECLARE_GLOBAL_MOCK_METHOD_2(CLoggerMocks, , void*, gballoc_realloc, void*, ptr, size_t, size);
 DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , void, gballoc_free, void*, ptr);
 DECLARE_GLOBAL_MOCK_METHOD_2(CLoggerMocks, , int, mallocAndStrcpy_s, char**, destination, const char*, source);
 
-DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , STRING_HANDLE, STRING_construct, const char*, s);
-DECLARE_GLOBAL_MOCK_METHOD_2(CLoggerMocks, , STRING_HANDLE, STRING_construct_n, const char*, psz, size_t, n);
-
-DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , void, STRING_delete, STRING_HANDLE, s);
-DECLARE_GLOBAL_MOCK_METHOD_2(CLoggerMocks, , int, STRING_concat, STRING_HANDLE, s1, const char*, s2);
-DECLARE_GLOBAL_MOCK_METHOD_2(CLoggerMocks, , int, STRING_concat_with_STRING, STRING_HANDLE, s1, STRING_HANDLE, s2);
-DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , const char*, STRING_c_str, STRING_HANDLE, s);
-
-DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , MAP_HANDLE, ConstMap_CloneWriteable, CONSTMAP_HANDLE, handle);
-DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , STRING_HANDLE, Map_ToJSON, MAP_HANDLE, handle);
-DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , void, Map_Destroy, MAP_HANDLE, ptr);
-
 DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , CONSTMAP_HANDLE, Message_GetProperties, MESSAGE_HANDLE, message);
 DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , void,  ConstMap_Destroy, CONSTMAP_HANDLE, handle);
+DECLARE_GLOBAL_MOCK_METHOD_4(CLoggerMocks, , CONSTMAP_RESULT, ConstMap_GetInternals, CONSTMAP_HANDLE, handle, const char*const**, keys, const char*const**, values, size_t*, count);
 DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , const CONSTBUFFER *, Message_GetContent, MESSAGE_HANDLE, message);
+DECLARE_GLOBAL_MOCK_METHOD_3(CLoggerMocks, , int32_t, Message_ToByteArray, MESSAGE_HANDLE, messageHandle, unsigned char*, buf, int32_t, size);
 
-DECLARE_GLOBAL_MOCK_METHOD_2(CLoggerMocks, , STRING_HANDLE, Base64_Encode_Bytes, const unsigned char*, source, size_t, size);
+DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , RECORD_LOG_HANDLE, RecordLog_Open, const RECORD_LOG_CONFIG*, config);
+DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , void, RecordLog_Close, RECORD_LOG_HANDLE, log);
+DECLARE_GLOBAL_MOCK_METHOD_3(CLoggerMocks, , int, RecordLog_Append, RECORD_LOG_HANDLE, log, const unsigned char*, record, size_t, size);
+DECLARE_GLOBAL_MOCK_METHOD_2(CLoggerMocks, , int, RecordLog_Flush, RECORD_LOG_HANDLE, log, bool, commit);
 
 DECLARE_GLOBAL_MOCK_METHOD_2(CLoggerMocks, , FILE*, gb_fopen, const char*, filename, const char*, mode);
 DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , int, gb_fclose, FILE*, stream);
@@ -348,6 +408,17 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , time_t, gb_time, time_t*, timer);
 DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , struct tm*, gb_localtime, const time_t*, timer);
 DECLARE_GLOBAL_MOCK_METHOD_4(CLoggerMocks, , size_t, gb_strftime, char*, s, size_t, maxsize, const char *, format, const struct tm *, timeptr);
 
+DECLARE_GLOBAL_MOCK_METHOD_0(CLoggerMocks, , LOCK_HANDLE, Lock_Init);
+DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , LOCK_RESULT, Lock, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , LOCK_RESULT, Unlock, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , LOCK_RESULT, Lock_Deinit, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_0(CLoggerMocks, , COND_HANDLE, Condition_Init);
+DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , COND_RESULT, Condition_Post, COND_HANDLE, handle);
+DECLARE_GLOBAL_MOCK_METHOD_3(CLoggerMocks, , COND_RESULT, Condition_Wait, COND_HANDLE, handle, LOCK_HANDLE, lock, int, timeout_milliseconds);
+DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , void, Condition_Deinit, COND_HANDLE, handle);
+DECLARE_GLOBAL_MOCK_METHOD_3(CLoggerMocks, , THREADAPI_RESULT, ThreadAPI_Create, THREAD_HANDLE*, threadHandle, THREAD_START_FUNC, func, void*, arg);
+DECLARE_GLOBAL_MOCK_METHOD_2(CLoggerMocks, , THREADAPI_RESULT, ThreadAPI_Join, THREAD_HANDLE, threadHandle, int*, res);
+
 
 static void mocks_ResetAllCounters(void)
 {
@@ -384,6 +455,8 @@ BEGIN_TEST_SUITE(logger_ut)
         }
 
         mocks_ResetAllCounters();
+        writerFunction = NULL;
+        writerArgument = NULL;
 
     }
 
@@ -415,7 +488,7 @@ BEGIN_TEST_SUITE(logger_ut)
     /*Tests_SRS_LOGGER_17_001: [ Logger_ParseConfigurationFromJson shall allocate a new LOGGER_CONFIG structure. ]*/
     /*Tests_SRS_LOGGER_17_002: [ Logger_ParseConfigurationFromJson shall duplicate the filename string into the LOGGER_CONFIG structure. ]*/
     /*Tests_SRS_LOGGER_17_006: [ Logger_ParseConfigurationFromJson shall return a pointer to the created LOGGER_CONFIG structure. ]*/
-    /*Tests_SRS_LOGGER_17_007: [ Logger_ParseConfigurationFromJson shall set the selector in LOGGER_CONFIG to LOGGING_TO_FILE. ]*/
+    /*Tests_SRS_LOGGER_17_007: [ Logger_ParseConfigurationFromJson shall set the selector in LOGGER_CONFIG to LOGGING_TO_FILE, unless "format" is "binary". ]*/
     TEST_FUNCTION(Logger_ParseConfigurationFromJson_happy_path_succeeds)
     {
         ///arrange
@@ -428,6 +501,16 @@ BEGIN_TEST_SUITE(logger_ut)
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "filename")) /*this is getting a json string that is what follows "filename": in the json*/
             .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "queueMaxBytes"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "batchMaxBytes"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "flushMilliseconds"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "flush")) /*no flush, LOGGER_FLUSH_NONE*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "format")) /*no format, a JSON file*/
+            .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(LOGGER_CONFIG)));
 		STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 			.IgnoreArgument(1)
@@ -445,6 +528,257 @@ BEGIN_TEST_SUITE(logger_ut)
         Logger_FreeConfiguration(result);
     }
 
+    /*Tests_SRS_LOGGER_31_001: [ `Logger_ParseConfigurationFromJson` shall set `queueMaxBytes`, `batchMaxBytes` and `flushMilliseconds` to the numbers named "queueMaxBytes", "batchMaxBytes" and "flushMilliseconds", or to 0 for those the JSON object does not contain. ]*/
+    /*Tests_SRS_LOGGER_31_003: [ `Logger_ParseConfigurationFromJson` shall set `flush` to `LOGGER_FLUSH_NONE`, `LOGGER_FLUSH_BATCH` or `LOGGER_FLUSH_SYNC` when the string named "flush" is "none", "batch" or "sync", and to `LOGGER_FLUSH_NONE` if the JSON object does not contain it. ]*/
+    TEST_FUNCTION(Logger_ParseConfigurationFromJson_sets_the_writer_settings)
+    {
+        ///arrange
+        CLoggerMocks mocks;
+
+        STRICT_EXPECTED_CALL(mocks, json_parse_string(VALID_CONFIG_STRING));
+        STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "filename"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "queueMaxBytes"))
+            .IgnoreArgument(1)
+            .SetReturn(1048576);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "batchMaxBytes"))
+            .IgnoreArgument(1)
+            .SetReturn(65536);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "flushMilliseconds"))
+            .IgnoreArgument(1)
+            .SetReturn(1000);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "flush"))
+            .IgnoreArgument(1)
+            .SetReturn("sync");
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "format")) /*no format, a JSON file*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(LOGGER_CONFIG)));
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+
+        ///act
+        auto result = Logger_ParseConfigurationFromJson(VALID_CONFIG_STRING);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(result);
+        ASSERT_ARE_EQUAL(size_t, 1048576, ((LOGGER_CONFIG*)result)->selectee.loggerConfigFile.queueMaxBytes);
+        ASSERT_ARE_EQUAL(size_t, 65536, ((LOGGER_CONFIG*)result)->selectee.loggerConfigFile.batchMaxBytes);
+        ASSERT_ARE_EQUAL(int, 1000, (int)((LOGGER_CONFIG*)result)->selectee.loggerConfigFile.flushMilliseconds);
+        ASSERT_ARE_EQUAL(int, (int)LOGGER_FLUSH_SYNC, (int)((LOGGER_CONFIG*)result)->selectee.loggerConfigFile.flush);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Logger_FreeConfiguration(result);
+    }
+
+    /*Tests_SRS_LOGGER_31_002: [ If the value of "queueMaxBytes", "batchMaxBytes" or "flushMilliseconds" is negative then `Logger_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+    TEST_FUNCTION(Logger_ParseConfigurationFromJson_fails_when_queueMaxBytes_is_negative)
+    {
+        ///arrange
+        CLoggerMocks mocks;
+
+        STRICT_EXPECTED_CALL(mocks, json_parse_string(VALID_CONFIG_STRING));
+        STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "filename"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "queueMaxBytes"))
+            .IgnoreArgument(1)
+            .SetReturn(-1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "batchMaxBytes"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "flushMilliseconds"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "flush"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "format")) /*no format, a JSON file*/
+            .IgnoreArgument(1);
+
+        ///act
+        auto result = Logger_ParseConfigurationFromJson(VALID_CONFIG_STRING);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+    }
+
+    /*Tests_SRS_LOGGER_31_004: [ If the string named "flush" has another value then `Logger_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+    TEST_FUNCTION(Logger_ParseConfigurationFromJson_fails_when_flush_is_unknown)
+    {
+        ///arrange
+        CLoggerMocks mocks;
+
+        STRICT_EXPECTED_CALL(mocks, json_parse_string(VALID_CONFIG_STRING));
+        STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "filename"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "queueMaxBytes"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "batchMaxBytes"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "flushMilliseconds"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "flush"))
+            .IgnoreArgument(1)
+            .SetReturn("always");
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "format")) /*no format, a JSON file*/
+            .IgnoreArgument(1);
+
+        ///act
+        auto result = Logger_ParseConfigurationFromJson(VALID_CONFIG_STRING);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+    }
+
+    /*Tests_SRS_LOGGER_31_016: [ If the string named "format" is "binary", `Logger_ParseConfigurationFromJson` shall set the selector to `LOGGING_TO_RECORD_LOG`, the name of the record log to "filename", `flush` as it does for a file, and `segmentMaxBytes`, `segmentMaxSeconds` and `indexIntervalBytes` to the numbers of the same names, or to 0 for those the JSON object does not contain. ]*/
+    TEST_FUNCTION(Logger_ParseConfigurationFromJson_sets_the_record_log_settings)
+    {
+        ///arrange
+        CLoggerMocks mocks;
+
+        STRICT_EXPECTED_CALL(mocks, json_parse_string(VALID_CONFIG_STRING));
+        STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "filename"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "queueMaxBytes"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "batchMaxBytes"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "flushMilliseconds"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "flush"))
+            .IgnoreArgument(1)
+            .SetReturn("batch");
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "format"))
+            .IgnoreArgument(1)
+            .SetReturn("binary");
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "segmentMaxBytes"))
+            .IgnoreArgument(1)
+            .SetReturn(1048576);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "segmentMaxSeconds"))
+            .IgnoreArgument(1)
+            .SetReturn(3600);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "indexIntervalBytes"))
+            .IgnoreArgument(1)
+            .SetReturn(4096);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(LOGGER_CONFIG)));
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+
+        ///act
+        auto result = Logger_ParseConfigurationFromJson(VALID_CONFIG_STRING);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(result);
+        ASSERT_ARE_EQUAL(int, (int)LOGGING_TO_RECORD_LOG, (int)((LOGGER_CONFIG*)result)->selector);
+        ASSERT_ARE_EQUAL(char_ptr, "log.txt", ((LOGGER_CONFIG*)result)->selectee.loggerConfigRecordLog.name);
+        ASSERT_ARE_EQUAL(size_t, 1048576, ((LOGGER_CONFIG*)result)->selectee.loggerConfigRecordLog.segmentMaxBytes);
+        ASSERT_ARE_EQUAL(int, 3600, (int)((LOGGER_CONFIG*)result)->selectee.loggerConfigRecordLog.segmentMaxSeconds);
+        ASSERT_ARE_EQUAL(size_t, 4096, ((LOGGER_CONFIG*)result)->selectee.loggerConfigRecordLog.indexIntervalBytes);
+        ASSERT_ARE_EQUAL(int, (int)LOGGER_FLUSH_BATCH, (int)((LOGGER_CONFIG*)result)->selectee.loggerConfigRecordLog.flush);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Logger_FreeConfiguration(result);
+    }
+
+    /*Tests_SRS_LOGGER_31_017: [ If the string named "format" is not "json" or "binary", if it is "binary" and "segmentMaxBytes", "segmentMaxSeconds" or "indexIntervalBytes" is negative, or if it is "binary" and "queueMaxBytes", "batchMaxBytes" or "flushMilliseconds" is not 0, then `Logger_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+    TEST_FUNCTION(Logger_ParseConfigurationFromJson_fails_when_format_is_unknown)
+    {
+        ///arrange
+        CLoggerMocks mocks;
+
+        STRICT_EXPECTED_CALL(mocks, json_parse_string(VALID_CONFIG_STRING));
+        STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "filename"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "queueMaxBytes"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "batchMaxBytes"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "flushMilliseconds"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "flush"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "format"))
+            .IgnoreArgument(1)
+            .SetReturn("xml");
+
+        ///act
+        auto result = Logger_ParseConfigurationFromJson(VALID_CONFIG_STRING);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+    }
+
+    /*Tests_SRS_LOGGER_31_017: [ If the string named "format" is not "json" or "binary", if it is "binary" and "segmentMaxBytes", "segmentMaxSeconds" or "indexIntervalBytes" is negative, or if it is "binary" and "queueMaxBytes", "batchMaxBytes" or "flushMilliseconds" is not 0, then `Logger_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+    TEST_FUNCTION(Logger_ParseConfigurationFromJson_fails_when_binary_has_a_queue)
+    {
+        ///arrange
+        CLoggerMocks mocks;
+
+        STRICT_EXPECTED_CALL(mocks, json_parse_string(VALID_CONFIG_STRING));
+        STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "filename"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "queueMaxBytes"))
+            .IgnoreArgument(1)
+            .SetReturn(65536);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "batchMaxBytes"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "flushMilliseconds"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "flush"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "format"))
+            .IgnoreArgument(1)
+            .SetReturn("binary");
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "segmentMaxBytes"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "segmentMaxSeconds"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "indexIntervalBytes"))
+            .IgnoreArgument(1);
+
+        ///act
+        auto result = Logger_ParseConfigurationFromJson(VALID_CONFIG_STRING);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+    }
+
     /*Tests_SRS_LOGGER_17_003: [ If any system call fails, Logger_ParseConfigurationFromJson shall fail and return NULL. ]*/
 	TEST_FUNCTION(Logger_ParseConfigurationFromJson_string_copy_fails)
 	{
@@ -458,6 +792,16 @@ BEGIN_TEST_SUITE(logger_ut)
 			.IgnoreArgument(1);
 		STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "filename")) /*this is getting a json string that is what follows "filename": in the json*/
 			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "queueMaxBytes"))
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "batchMaxBytes"))
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "flushMilliseconds"))
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "flush")) /*no flush, LOGGER_FLUSH_NONE*/
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "format")) /*no format, a JSON file*/
+			.IgnoreArgument(1);
 		STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(LOGGER_CONFIG)));
 		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
 			.IgnoreArgument(1);
@@ -489,6 +833,16 @@ BEGIN_TEST_SUITE(logger_ut)
 			.IgnoreArgument(1);
 		STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "filename")) /*this is getting a json string that is what follows "filename": in the json*/
 			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "queueMaxBytes"))
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "batchMaxBytes"))
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "flushMilliseconds"))
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "flush")) /*no flush, LOGGER_FLUSH_NONE*/
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "format")) /*no format, a JSON file*/
+			.IgnoreArgument(1);
 		STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(LOGGER_CONFIG)))
 			.SetFailReturn(nullptr);
 
@@ -585,6 +939,16 @@ BEGIN_TEST_SUITE(logger_ut)
 			.IgnoreArgument(1);
 		STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "filename")) /*this is getting a json string that is what follows "filename": in the json*/
 			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "queueMaxBytes"))
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "batchMaxBytes"))
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "flushMilliseconds"))
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "flush")) /*no flush, LOGGER_FLUSH_NONE*/
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "format")) /*no format, a JSON file*/
+			.IgnoreArgument(1);
 		STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(LOGGER_CONFIG)));
 		STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 			.IgnoreArgument(1)
@@ -652,7 +1016,7 @@ BEGIN_TEST_SUITE(logger_ut)
         ///cleanup
     }
 
-    /*Tests_SRS_LOGGER_02_003: [If configuration->selector has a value different than LOGGING_TO_FILE then Logger_Create shall fail and return NULL.]*/
+    /*Tests_SRS_LOGGER_02_003: [If configuration->selector has a value different than LOGGING_TO_FILE and LOGGING_TO_RECORD_LOG then Logger_Create shall fail and return NULL.]*/
     TEST_FUNCTION(Logger_Create_with_invalid_selector_fails)
     {
         ///arrange
@@ -1239,433 +1603,210 @@ BEGIN_TEST_SUITE(logger_ut)
 
     }
 
-    /*Tests_SRS_LOGGER_02_009: [If moduleHandle is NULL then Logger_Receive shall fail and return.]*/
-    TEST_FUNCTION(Logger_Receive_with_NULL_modulehandle_fails)
+    /*Tests_SRS_LOGGER_31_005: [ If `queueMaxBytes` is not 0, `Logger_Create` shall allocate two buffers of `queueMaxBytes` bytes, create a lock and a condition, and start a writer thread. ]*/
+    TEST_FUNCTION(Logger_Create_with_writer_starts_the_writer_thread)
     {
         ///arrange
         CLoggerMocks mocks;
 
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is the handle*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gb_fopen(writerConfig.selectee.loggerConfigFile.name, "r+b")); /*this is opening the file*/
+
+        STRICT_EXPECTED_CALL(mocks, gb_fseek(IGNORED_PTR_ARG, 0, SEEK_END)) /*this is going to the end of the file*/
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, gb_ftell(IGNORED_PTR_ARG)) /*this is getting the file size*/
+            .IgnoreArgument(1)
+            .SetReturn(2); /*non-zero filesize*/
+
+        STRICT_EXPECTED_CALL(mocks, gb_time(NULL)); /*this is getting the time*/
+
+        STRICT_EXPECTED_CALL(mocks, gb_localtime(IGNORED_PTR_ARG)) /*this is transforming the time from time_t to struct tm* */
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, gb_strftime(IGNORED_PTR_ARG, IGNORED_NUM_ARG, ",{\"time\":\"%C\",\"content\":\"Log started\"}]", IGNORED_PTR_ARG)) /*this is building a JSON object in timetemp*/
+            .IgnoreArgument(1)
+            .IgnoreArgument(2)
+            .IgnoreArgument(4);
+
+        STRICT_EXPECTED_CALL(mocks, gb_fseek(IGNORED_PTR_ARG, -1, SEEK_END)) /*this eats the "]" at the end*/
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(writerConfig.selectee.loggerConfigFile.queueMaxBytes + 2)) /*these are the records waiting and the records written, each with room for "]"*/
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, Lock_Init());
+        STRICT_EXPECTED_CALL(mocks, Condition_Init());
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+
         ///act
-        Logger_Receive(NULL, validMessageHandle);
+        auto handle = Logger_Create(validBrokerHandle, &writerConfig);
 
         ///assert
+        ASSERT_IS_NOT_NULL(handle);
+        ASSERT_IS_NOT_NULL(writerFunction);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
+        Logger_Destroy(handle);
 
     }
 
-    /*Tests_SRS_LOGGER_02_010: [If messageHandle is NULL then Logger_Receive shall fail and return.]*/
-    TEST_FUNCTION(Logger_Receive_with_NULL_messageHandle_fails)
+    /*Tests_SRS_LOGGER_02_007: [If Logger_Create encounters any errors while creating the LOGGER_HANDLE_DATA then it shall fail and return NULL.]*/
+    TEST_FUNCTION(Logger_Create_with_writer_fails_when_ThreadAPI_Create_fails)
     {
         ///arrange
         CLoggerMocks mocks;
-        auto moduleHandle = Logger_Create(validBrokerHandle, &validConfig);
-        mocks.ResetAllCalls();
-
-        ///act
-        Logger_Receive(moduleHandle, NULL);
-
-        ///assert
-        mocks.AssertActualAndExpectedCalls();
 
-        ///cleanup
-        Logger_Destroy(moduleHandle);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is the handle*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gb_fopen(writerConfig.selectee.loggerConfigFile.name, "r+b")); /*this is opening the file*/
 
-    }
+        STRICT_EXPECTED_CALL(mocks, gb_fseek(IGNORED_PTR_ARG, 0, SEEK_END)) /*this is going to the end of the file*/
+            .IgnoreArgument(1);
 
-    /*Tests_SRS_LOGGER_02_011: [Logger_Receive shall write in the fout FILE the following information in JSON format:]*/
-    /*Tests_SRS_LOGGER_02_013: [Logger_Receive shall return.]*/
-    TEST_FUNCTION(Logger_Receive_happy_path)
-    {
-        ///arrange
-        CLoggerMocks mocks;
-        auto moduleHandle = Logger_Create(validBrokerHandle, &validConfig);
-        mocks.ResetAllCalls();
-        mocks_ResetAllCounters();
+        STRICT_EXPECTED_CALL(mocks, gb_ftell(IGNORED_PTR_ARG)) /*this is getting the file size*/
+            .IgnoreArgument(1)
+            .SetReturn(2); /*non-zero filesize*/
 
         STRICT_EXPECTED_CALL(mocks, gb_time(NULL)); /*this is getting the time*/
 
         STRICT_EXPECTED_CALL(mocks, gb_localtime(IGNORED_PTR_ARG)) /*this is transforming the time from time_t to struct tm* */
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gb_strftime(IGNORED_PTR_ARG, IGNORED_NUM_ARG, "%C", IGNORED_PTR_ARG)) /*this is building a JSON object in timetemp*/
+        STRICT_EXPECTED_CALL(mocks, gb_strftime(IGNORED_PTR_ARG, IGNORED_NUM_ARG, ",{\"time\":\"%C\",\"content\":\"Log started\"}]", IGNORED_PTR_ARG)) /*this is building a JSON object in timetemp*/
             .IgnoreArgument(1)
             .IgnoreArgument(2)
             .IgnoreArgument(4);
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(validMessageHandle)); /*this is getting the properties from the message*/
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, gb_fseek(IGNORED_PTR_ARG, -1, SEEK_END)) /*this eats the "]" at the end*/
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_CloneWriteable(IGNORED_PTR_ARG)) /*this is getting the properties in a writeable map, because ConstMap doesn't have ToJSON*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, Map_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(writerConfig.selectee.loggerConfigFile.queueMaxBytes + 2)) /*these are the records waiting and the records written, each with room for "]"*/
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, Lock_Init());
+        STRICT_EXPECTED_CALL(mocks, Condition_Init());
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .SetFailReturn(THREADAPI_ERROR);
 
-        STRICT_EXPECTED_CALL(mocks, Map_ToJSON(IGNORED_PTR_ARG)) /*this is getting a STRING_HANDLE that is the MAP as JSON*/
+        STRICT_EXPECTED_CALL(mocks, Condition_Deinit(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, Message_GetContent(validMessageHandle)); /*this is getting the content*/
-
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer, sizeof(buffer) / sizeof(buffer[0]))); /*this is getting a STRING_HANDLE that is the base64 encode of the bytes*/
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_construct(",{\"time\":\"")); /*this is the actual JSON object building*/
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding the real time to the json*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\",\"properties\":")) /*this is adding the "properties":" string*/
-            .IgnoreArgument(1); 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding the result of MapToJSON*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"content\":\"")) /*this is adding the ,"content":"*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding the result of base64_encode*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*the 2 buffers and the handle*/
             .IgnoreArgument(1)
-            .IgnoreArgument(2);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"}]")) /*this closes the JSON*/
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*this is harvesting the const char* of the json string*/
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, gb_fseek(IGNORED_PTR_ARG, -1, SEEK_END)) /*this is rewinding the file by 1 character*/
+            .ExpectedTimesExactly(3);
+        STRICT_EXPECTED_CALL(mocks, gb_fclose(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        /*here a call to fprintf happens({
-        "time":"timeAsPrinted by ctime",
-        "content": "Log started"
-        },"
-        it is captured by a weak verification in ASSERT*/
-
         ///act
-        Logger_Receive(moduleHandle, validMessageHandle);
+        auto handle = Logger_Create(validBrokerHandle, &writerConfig);
 
         ///assert
+        ASSERT_IS_NULL(handle);
         mocks.AssertActualAndExpectedCalls();
-        ASSERT_ARE_EQUAL(size_t, 1, CURRENT_API_CALL(gb_fprintf));
 
         ///cleanup
-        Logger_Destroy(moduleHandle);
 
     }
-	/*Tests_SRS_LOGGER_02_011: [Logger_Receive shall write in the fout FILE the following information in JSON format:]*/
-	/*Tests_SRS_LOGGER_02_013: [Logger_Receive shall return.]*/
-	TEST_FUNCTION(Logger_Receive_happy_path_empty_content)
-	{
-		///arrange
-		CLoggerMocks mocks;
-		auto moduleHandle = Logger_Create(validBrokerHandle, &validConfig);
-		mocks.ResetAllCalls();
-		mocks_ResetAllCounters();
-		const CONSTBUFFER empty_content = {
-			NULL,
-			0
-		};
 
-		STRICT_EXPECTED_CALL(mocks, gb_time(NULL)); /*this is getting the time*/
-
-		STRICT_EXPECTED_CALL(mocks, gb_localtime(IGNORED_PTR_ARG)) /*this is transforming the time from time_t to struct tm* */
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, gb_strftime(IGNORED_PTR_ARG, IGNORED_NUM_ARG, "%C", IGNORED_PTR_ARG)) /*this is building a JSON object in timetemp*/
-			.IgnoreArgument(1)
-			.IgnoreArgument(2)
-			.IgnoreArgument(4);
-
-		STRICT_EXPECTED_CALL(mocks, Message_GetProperties(validMessageHandle)); /*this is getting the properties from the message*/
-		STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, ConstMap_CloneWriteable(IGNORED_PTR_ARG)) /*this is getting the properties in a writeable map, because ConstMap doesn't have ToJSON*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, Map_Destroy(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, Map_ToJSON(IGNORED_PTR_ARG)) /*this is getting a STRING_HANDLE that is the MAP as JSON*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, Message_GetContent(validMessageHandle)).SetReturn(&empty_content); /*this is getting the content*/
-
-		STRICT_EXPECTED_CALL(mocks, STRING_construct_n("", 0));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_construct(",{\"time\":\"")); /*this is the actual JSON object building*/
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding the real time to the json*/
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\",\"properties\":")) /*this is adding the "properties":" string*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding the result of MapToJSON*/
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"content\":\"")) /*this is adding the ,"content":"*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding the result of base64_encode*/
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"}]")) /*this closes the JSON*/
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*this is harvesting the const char* of the json string*/
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, gb_fseek(IGNORED_PTR_ARG, -1, SEEK_END)) /*this is rewinding the file by 1 character*/
-			.IgnoreArgument(1);
-
-		/*here a call to fprintf happens({
-		"time":"timeAsPrinted by ctime",
-		"content": "Log started"
-		},"
-		it is captured by a weak verification in ASSERT*/
-
-		///act
-		Logger_Receive(moduleHandle, validMessageHandle);
-
-		///assert
-		mocks.AssertActualAndExpectedCalls();
-		ASSERT_ARE_EQUAL(size_t, 1, CURRENT_API_CALL(gb_fprintf));
-
-		///cleanup
-		Logger_Destroy(moduleHandle);
-
-	}
-
-    /*Tests_SRS_LOGGER_02_012: [If producing the JSON format or writing it to the file fails, then Logger_Receive shall fail and return.]*/
-    TEST_FUNCTION(Logger_Receive_fails_when_fprintf_fails)
+    /*Tests_SRS_LOGGER_31_018: [ If `configuration->selector` is `LOGGING_TO_RECORD_LOG`, `Logger_Create` shall open a record log with the settings of `configuration->selectee.loggerConfigRecordLog` instead of a file, and fail and return NULL if it cannot. ]*/
+    TEST_FUNCTION(Logger_Create_with_record_log_opens_it)
     {
         ///arrange
         CLoggerMocks mocks;
-        auto moduleHandle = Logger_Create(validBrokerHandle, &validConfig);
-        mocks.ResetAllCalls();
-        mocks_ResetAllCounters();
-
-        STRICT_EXPECTED_CALL(mocks, gb_time(NULL)); /*this is getting the time*/
-
-        STRICT_EXPECTED_CALL(mocks, gb_localtime(IGNORED_PTR_ARG)) /*this is transforming the time from time_t to struct tm* */
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, gb_strftime(IGNORED_PTR_ARG, IGNORED_NUM_ARG, "%C", IGNORED_PTR_ARG)) /*this is building a JSON object in timetemp*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(2)
-            .IgnoreArgument(4);
-
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(validMessageHandle)); /*this is getting the properties from the message*/
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        LOGGER_CONFIG recordLogConfig = makeRecordLogConfig();
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_CloneWriteable(IGNORED_PTR_ARG)) /*this is getting the properties in a writeable map, because ConstMap doesn't have ToJSON*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is the handle*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, Map_Destroy(IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, RecordLog_Open(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, Map_ToJSON(IGNORED_PTR_ARG)) /*this is getting a STRING_HANDLE that is the MAP as JSON*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        ///act
+        auto handle = Logger_Create(validBrokerHandle, &recordLogConfig);
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetContent(validMessageHandle)); /*this is getting the content*/
+        ///assert
+        ASSERT_IS_NOT_NULL(handle);
+        mocks.AssertActualAndExpectedCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer, sizeof(buffer) / sizeof(buffer[0]))); /*this is getting a STRING_HANDLE that is the base64 encode of the bytes*/
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        ///cleanup
+        Logger_Destroy(handle);
+    }
 
-        STRICT_EXPECTED_CALL(mocks, STRING_construct(",{\"time\":\"")); /*this is the actual JSON object building*/
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+    /*Tests_SRS_LOGGER_31_018: [ If `configuration->selector` is `LOGGING_TO_RECORD_LOG`, `Logger_Create` shall open a record log with the settings of `configuration->selectee.loggerConfigRecordLog` instead of a file, and fail and return NULL if it cannot. ]*/
+    TEST_FUNCTION(Logger_Create_with_record_log_fails_when_RecordLog_Open_fails)
+    {
+        ///arrange
+        CLoggerMocks mocks;
+        LOGGER_CONFIG recordLogConfig = makeRecordLogConfig();
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding the real time to the json*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\",\"properties\":")) /*this is adding the "properties":" string*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding the result of MapToJSON*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"content\":\"")) /*this is adding the ,"content":"*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is the handle*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding the result of base64_encode*/
+        STRICT_EXPECTED_CALL(mocks, RecordLog_Open(IGNORED_PTR_ARG))
             .IgnoreArgument(1)
-            .IgnoreArgument(2);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"}]")) /*this closes the JSON*/
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*this is harvesting the const char* of the json string*/
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, gb_fseek(IGNORED_PTR_ARG, -1, SEEK_END)) /*this is rewinding the file by 1 character*/
+            .SetFailReturn((RECORD_LOG_HANDLE)NULL);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        MAKE_FAIL(gb_fprintf, 1);
-        /*here a call to fprintf happens({
-        "time":"timeAsPrinted by ctime",
-        "content": "Log started"
-        },"
-        it is captured by a weak verification in ASSERT*/
-
         ///act
-        Logger_Receive(moduleHandle, validMessageHandle);
+        auto handle = Logger_Create(validBrokerHandle, &recordLogConfig);
 
         ///assert
+        ASSERT_IS_NULL(handle);
         mocks.AssertActualAndExpectedCalls();
-        ASSERT_ARE_EQUAL(size_t, 1, CURRENT_API_CALL(gb_fprintf));
 
         ///cleanup
-        Logger_Destroy(moduleHandle);
-
     }
 
-    /*Tests_SRS_LOGGER_02_012: [If producing the JSON format or writing it to the file fails, then Logger_Receive shall fail and return.]*/
-    TEST_FUNCTION(Logger_Receive_fails_when_fseek_fails)
+    /*Tests_SRS_LOGGER_31_019: [ With a record log, `Logger_Receive` shall serialize the message with `Message_ToByteArray` in a buffer kept from one message to the next, append it to the record log and flush the record log as `flush` tells. ]*/
+    TEST_FUNCTION(Logger_Receive_with_record_log_appends_the_message)
     {
         ///arrange
         CLoggerMocks mocks;
-        auto moduleHandle = Logger_Create(validBrokerHandle, &validConfig);
+        LOGGER_CONFIG recordLogConfig = makeRecordLogConfig();
+        LOGGER_COUNTERS counters;
+        auto moduleHandle = Logger_Create(validBrokerHandle, &recordLogConfig);
         mocks.ResetAllCalls();
-        mocks_ResetAllCounters();
-
-        STRICT_EXPECTED_CALL(mocks, gb_time(NULL)); /*this is getting the time*/
-
-        STRICT_EXPECTED_CALL(mocks, gb_localtime(IGNORED_PTR_ARG)) /*this is transforming the time from time_t to struct tm* */
-            .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gb_strftime(IGNORED_PTR_ARG, IGNORED_NUM_ARG, "%C", IGNORED_PTR_ARG)) /*this is building a JSON object in timetemp*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(2)
-            .IgnoreArgument(4);
-
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(validMessageHandle)); /*this is getting the properties from the message*/
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_CloneWriteable(IGNORED_PTR_ARG)) /*this is getting the properties in a writeable map, because ConstMap doesn't have ToJSON*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, Map_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, Map_ToJSON(IGNORED_PTR_ARG)) /*this is getting a STRING_HANDLE that is the MAP as JSON*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, Message_GetContent(validMessageHandle)); /*this is getting the content*/
-
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer, sizeof(buffer) / sizeof(buffer[0]))); /*this is getting a STRING_HANDLE that is the base64 encode of the bytes*/
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_construct(",{\"time\":\"")); /*this is the actual JSON object building*/
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding the real time to the json*/
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(validMessageHandle, NULL, 0)); /*this is getting the size*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_realloc(NULL, SERIALIZED_SIZE)); /*this is the record buffer, allocated by the first message*/
+        STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(validMessageHandle, IGNORED_PTR_ARG, SERIALIZED_SIZE))
             .IgnoreArgument(2);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\",\"properties\":")) /*this is adding the "properties":" string*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding the result of MapToJSON*/
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, RecordLog_Append(TEST_RECORD_LOG, IGNORED_PTR_ARG, SERIALIZED_SIZE))
             .IgnoreArgument(2);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"content\":\"")) /*this is adding the ,"content":"*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding the result of base64_encode*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"}]")) /*this closes the JSON*/
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*this is harvesting the const char* of the json string*/
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, gb_fseek(IGNORED_PTR_ARG, -1, SEEK_END)) /*this is rewinding the file by 1 character*/
-            .IgnoreArgument(1)
-            .SetReturn(__LINE__);
+        STRICT_EXPECTED_CALL(mocks, RecordLog_Flush(TEST_RECORD_LOG, false)); /*batch flushes without committing*/
 
         ///act
         Logger_Receive(moduleHandle, validMessageHandle);
 
         ///assert
         mocks.AssertActualAndExpectedCalls();
-        ASSERT_ARE_EQUAL(size_t, 0, CURRENT_API_CALL(gb_fprintf));
+        ASSERT_ARE_EQUAL(int, 0, Logger_GetCounters(moduleHandle, &counters));
+        ASSERT_ARE_EQUAL(size_t, 1, counters.written);
+        ASSERT_ARE_EQUAL(size_t, 0, counters.writeFailures);
 
         ///cleanup
         Logger_Destroy(moduleHandle);
-
     }
 
-    /*Tests_SRS_LOGGER_02_012: [If producing the JSON format or writing it to the file fails, then Logger_Receive shall fail and return.]*/
-    TEST_FUNCTION(Logger_Receive_fails_when_STRING_concat_fails_1)
+    /*Tests_SRS_LOGGER_31_019: [ With a record log, `Logger_Receive` shall serialize the message with `Message_ToByteArray` in a buffer kept from one message to the next, append it to the record log and flush the record log as `flush` tells. ]*/
+    TEST_FUNCTION(Logger_Receive_with_record_log_counts_a_failed_append)
     {
         ///arrange
         CLoggerMocks mocks;
-        auto moduleHandle = Logger_Create(validBrokerHandle, &validConfig);
+        LOGGER_CONFIG recordLogConfig = makeRecordLogConfig();
+        LOGGER_COUNTERS counters;
+        auto moduleHandle = Logger_Create(validBrokerHandle, &recordLogConfig);
         mocks.ResetAllCalls();
-        mocks_ResetAllCounters();
-
-        STRICT_EXPECTED_CALL(mocks, gb_time(NULL)); /*this is getting the time*/
-
-        STRICT_EXPECTED_CALL(mocks, gb_localtime(IGNORED_PTR_ARG)) /*this is transforming the time from time_t to struct tm* */
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, gb_strftime(IGNORED_PTR_ARG, IGNORED_NUM_ARG, "%C", IGNORED_PTR_ARG)) /*this is building a JSON object in timetemp*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(2)
-            .IgnoreArgument(4);
-
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(validMessageHandle)); /*this is getting the properties from the message*/
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_CloneWriteable(IGNORED_PTR_ARG)) /*this is getting the properties in a writeable map, because ConstMap doesn't have ToJSON*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, Map_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, Map_ToJSON(IGNORED_PTR_ARG)) /*this is getting a STRING_HANDLE that is the MAP as JSON*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, Message_GetContent(validMessageHandle)); /*this is getting the content*/
-
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer, sizeof(buffer) / sizeof(buffer[0]))); /*this is getting a STRING_HANDLE that is the base64 encode of the bytes*/
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, STRING_construct(",{\"time\":\"")); /*this is the actual JSON object building*/
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding the real time to the json*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\",\"properties\":")) /*this is adding the "properties":" string*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding the result of MapToJSON*/
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(validMessageHandle, NULL, 0)); /*this is getting the size*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_realloc(NULL, SERIALIZED_SIZE)); /*this is the record buffer, allocated by the first message*/
+        STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(validMessageHandle, IGNORED_PTR_ARG, SERIALIZED_SIZE))
             .IgnoreArgument(2);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"content\":\"")) /*this is adding the ,"content":"*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding the result of base64_encode*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"}]")) /*this closes the JSON*/
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, RecordLog_Append(TEST_RECORD_LOG, IGNORED_PTR_ARG, SERIALIZED_SIZE))
+            .IgnoreArgument(2)
             .SetFailReturn(__LINE__);
 
         ///act
@@ -1673,86 +1814,54 @@ BEGIN_TEST_SUITE(logger_ut)
 
         ///assert
         mocks.AssertActualAndExpectedCalls();
-        ASSERT_ARE_EQUAL(size_t, 0, CURRENT_API_CALL(gb_fprintf));
+        ASSERT_ARE_EQUAL(int, 0, Logger_GetCounters(moduleHandle, &counters));
+        ASSERT_ARE_EQUAL(size_t, 0, counters.written);
+        ASSERT_ARE_EQUAL(size_t, 1, counters.writeFailures);
 
         ///cleanup
         Logger_Destroy(moduleHandle);
-
     }
 
-    /*Tests_SRS_LOGGER_02_012: [If producing the JSON format or writing it to the file fails, then Logger_Receive shall fail and return.]*/
-    TEST_FUNCTION(Logger_Receive_fails_when_STRING_concat_with_STRING_fails_1)
+    /*Tests_SRS_LOGGER_02_009: [If moduleHandle is NULL then Logger_Receive shall fail and return.]*/
+    TEST_FUNCTION(Logger_Receive_with_NULL_modulehandle_fails)
     {
         ///arrange
         CLoggerMocks mocks;
-        auto moduleHandle = Logger_Create(validBrokerHandle, &validConfig);
-        mocks.ResetAllCalls();
-        mocks_ResetAllCounters();
-
-        STRICT_EXPECTED_CALL(mocks, gb_time(NULL)); /*this is getting the time*/
-
-        STRICT_EXPECTED_CALL(mocks, gb_localtime(IGNORED_PTR_ARG)) /*this is transforming the time from time_t to struct tm* */
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, gb_strftime(IGNORED_PTR_ARG, IGNORED_NUM_ARG, "%C", IGNORED_PTR_ARG)) /*this is building a JSON object in timetemp*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(2)
-            .IgnoreArgument(4);
-
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(validMessageHandle)); /*this is getting the properties from the message*/
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_CloneWriteable(IGNORED_PTR_ARG)) /*this is getting the properties in a writeable map, because ConstMap doesn't have ToJSON*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, Map_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, Map_ToJSON(IGNORED_PTR_ARG)) /*this is getting a STRING_HANDLE that is the MAP as JSON*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetContent(validMessageHandle)); /*this is getting the content*/
+        ///act
+        Logger_Receive(NULL, validMessageHandle);
 
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer, sizeof(buffer) / sizeof(buffer[0]))); /*this is getting a STRING_HANDLE that is the base64 encode of the bytes*/
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
 
-        STRICT_EXPECTED_CALL(mocks, STRING_construct(",{\"time\":\"")); /*this is the actual JSON object building*/
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        ///cleanup
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding the real time to the json*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\",\"properties\":")) /*this is adding the "properties":" string*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding the result of MapToJSON*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"content\":\"")) /*this is adding the ,"content":"*/
-            .IgnoreArgument(1);
+    }
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding the result of base64_encode*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(2)
-            .SetFailReturn(__LINE__);
+    /*Tests_SRS_LOGGER_02_010: [If messageHandle is NULL then Logger_Receive shall fail and return.]*/
+    TEST_FUNCTION(Logger_Receive_with_NULL_messageHandle_fails)
+    {
+        ///arrange
+        CLoggerMocks mocks;
+        auto moduleHandle = Logger_Create(validBrokerHandle, &validConfig);
+        mocks.ResetAllCalls();
 
         ///act
-        Logger_Receive(moduleHandle, validMessageHandle);
+        Logger_Receive(moduleHandle, NULL);
 
         ///assert
         mocks.AssertActualAndExpectedCalls();
-        ASSERT_ARE_EQUAL(size_t, 0, CURRENT_API_CALL(gb_fprintf));
 
         ///cleanup
         Logger_Destroy(moduleHandle);
 
     }
 
-    /*Tests_SRS_LOGGER_02_012: [If producing the JSON format or writing it to the file fails, then Logger_Receive shall fail and return.]*/
-    TEST_FUNCTION(Logger_Receive_fails_when_STRING_concat_fails_2)
+    /*Tests_SRS_LOGGER_02_011: [Logger_Receive shall write in the fout FILE the following information in JSON format:]*/
+    /*Tests_SRS_LOGGER_02_013: [Logger_Receive shall return.]*/
+    /*Tests_SRS_LOGGER_31_007: [ `Logger_Receive` shall render the record in a buffer kept from one message to the next, escaping the property keys and values and encoding the content in base64. ]*/
+    /*Tests_SRS_LOGGER_31_008: [ If `queueMaxBytes` is 0, `Logger_Receive` shall write the record to the file and flush the file as `flush` tells. ]*/
+    TEST_FUNCTION(Logger_Receive_happy_path)
     {
         ///arrange
         CLoggerMocks mocks;
@@ -1765,7 +1874,7 @@ BEGIN_TEST_SUITE(logger_ut)
         STRICT_EXPECTED_CALL(mocks, gb_localtime(IGNORED_PTR_ARG)) /*this is transforming the time from time_t to struct tm* */
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gb_strftime(IGNORED_PTR_ARG, IGNORED_NUM_ARG, "%C", IGNORED_PTR_ARG)) /*this is building a JSON object in timetemp*/
+        STRICT_EXPECTED_CALL(mocks, gb_strftime(IGNORED_PTR_ARG, IGNORED_NUM_ARG, "%C", IGNORED_PTR_ARG)) /*this is printing the time*/
             .IgnoreArgument(1)
             .IgnoreArgument(2)
             .IgnoreArgument(4);
@@ -1774,174 +1883,116 @@ BEGIN_TEST_SUITE(logger_ut)
         STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_CloneWriteable(IGNORED_PTR_ARG)) /*this is getting the properties in a writeable map, because ConstMap doesn't have ToJSON*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, Map_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, Map_ToJSON(IGNORED_PTR_ARG)) /*this is getting a STRING_HANDLE that is the MAP as JSON*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is getting the keys and values of the properties*/
+            .IgnoreAllArguments();
 
         STRICT_EXPECTED_CALL(mocks, Message_GetContent(validMessageHandle)); /*this is getting the content*/
 
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer, sizeof(buffer) / sizeof(buffer[0]))); /*this is getting a STRING_HANDLE that is the base64 encode of the bytes*/
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_construct(",{\"time\":\"")); /*this is the actual JSON object building*/
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding the real time to the json*/
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, gballoc_realloc(NULL, IGNORED_NUM_ARG)) /*this is the record buffer, allocated by the first message*/
             .IgnoreArgument(2);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\",\"properties\":")) /*this is adding the "properties":" string*/
+
+        STRICT_EXPECTED_CALL(mocks, gb_fseek(IGNORED_PTR_ARG, -1, SEEK_END)) /*this is rewinding the file by 1 character*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding the result of MapToJSON*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"content\":\"")) /*this is adding the ,"content":"*/
-            .IgnoreArgument(1)
-            .SetFailReturn(__LINE__);
+        /*here a call to fprintf happens, it is captured by a weak verification in ASSERT*/
 
         ///act
         Logger_Receive(moduleHandle, validMessageHandle);
 
         ///assert
         mocks.AssertActualAndExpectedCalls();
-        ASSERT_ARE_EQUAL(size_t, 0, CURRENT_API_CALL(gb_fprintf));
+        ASSERT_ARE_EQUAL(size_t, 1, CURRENT_API_CALL(gb_fprintf));
+        ASSERT_ARE_EQUAL(char_ptr, RENDERED_RECORD "]", all_fprintfs[0]);
 
         ///cleanup
         Logger_Destroy(moduleHandle);
 
     }
 
-    /*Tests_SRS_LOGGER_02_012: [If producing the JSON format or writing it to the file fails, then Logger_Receive shall fail and return.]*/
-    TEST_FUNCTION(Logger_Receive_fails_when_STRING_concat_with_STRING_fails_2)
-    {
-        ///arrange
-        CLoggerMocks mocks;
-        auto moduleHandle = Logger_Create(validBrokerHandle, &validConfig);
-        mocks.ResetAllCalls();
-        mocks_ResetAllCounters();
-
-        STRICT_EXPECTED_CALL(mocks, gb_time(NULL)); /*this is getting the time*/
-
-        STRICT_EXPECTED_CALL(mocks, gb_localtime(IGNORED_PTR_ARG)) /*this is transforming the time from time_t to struct tm* */
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, gb_strftime(IGNORED_PTR_ARG, IGNORED_NUM_ARG, "%C", IGNORED_PTR_ARG)) /*this is building a JSON object in timetemp*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(2)
-            .IgnoreArgument(4);
+	/*Tests_SRS_LOGGER_02_011: [Logger_Receive shall write in the fout FILE the following information in JSON format:]*/
+	/*Tests_SRS_LOGGER_02_013: [Logger_Receive shall return.]*/
+	TEST_FUNCTION(Logger_Receive_happy_path_empty_content)
+	{
+		///arrange
+		CLoggerMocks mocks;
+		auto moduleHandle = Logger_Create(validBrokerHandle, &validConfig);
+		mocks.ResetAllCalls();
+		mocks_ResetAllCounters();
+		const CONSTBUFFER empty_content = {
+			NULL,
+			0
+		};
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(validMessageHandle)); /*this is getting the properties from the message*/
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, gb_time(NULL)); /*this is getting the time*/
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_CloneWriteable(IGNORED_PTR_ARG)) /*this is getting the properties in a writeable map, because ConstMap doesn't have ToJSON*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, Map_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, gb_localtime(IGNORED_PTR_ARG)) /*this is transforming the time from time_t to struct tm* */
+			.IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, Map_ToJSON(IGNORED_PTR_ARG)) /*this is getting a STRING_HANDLE that is the MAP as JSON*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, gb_strftime(IGNORED_PTR_ARG, IGNORED_NUM_ARG, "%C", IGNORED_PTR_ARG)) /*this is printing the time*/
+			.IgnoreArgument(1)
+			.IgnoreArgument(2)
+			.IgnoreArgument(4);
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetContent(validMessageHandle)); /*this is getting the content*/
+		STRICT_EXPECTED_CALL(mocks, Message_GetProperties(validMessageHandle)); /*this is getting the properties from the message*/
+		STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+			.IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer, sizeof(buffer) / sizeof(buffer[0]))); /*this is getting a STRING_HANDLE that is the base64 encode of the bytes*/
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is getting the keys and values of the properties*/
+			.IgnoreAllArguments();
 
-        STRICT_EXPECTED_CALL(mocks, STRING_construct(",{\"time\":\"")); /*this is the actual JSON object building*/
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, Message_GetContent(validMessageHandle)).SetReturn(&empty_content); /*this is getting the content*/
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding the real time to the json*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\",\"properties\":")) /*this is adding the "properties":" string*/
-            .IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, gballoc_realloc(NULL, IGNORED_NUM_ARG)) /*this is the record buffer, allocated by the first message*/
+			.IgnoreArgument(2);
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding the result of MapToJSON*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(2)
-            .SetFailReturn(__LINE__);
+		STRICT_EXPECTED_CALL(mocks, gb_fseek(IGNORED_PTR_ARG, -1, SEEK_END)) /*this is rewinding the file by 1 character*/
+			.IgnoreArgument(1);
 
-        ///act
-        Logger_Receive(moduleHandle, validMessageHandle);
+		///act
+		Logger_Receive(moduleHandle, validMessageHandle);
 
-        ///assert
-        mocks.AssertActualAndExpectedCalls();
-        ASSERT_ARE_EQUAL(size_t, 0, CURRENT_API_CALL(gb_fprintf));
+		///assert
+		mocks.AssertActualAndExpectedCalls();
+		ASSERT_ARE_EQUAL(size_t, 1, CURRENT_API_CALL(gb_fprintf));
+		ASSERT_ARE_EQUAL(char_ptr, ",{\"time\":\"" TIME_IN_STRFTIME "\",\"properties\":{\"key1\":\"value1\",\"key\\\"2\":\"line\\nbreak\"},\"content\":\"\"}]", all_fprintfs[0]);
 
-        ///cleanup
-        Logger_Destroy(moduleHandle);
+		///cleanup
+		Logger_Destroy(moduleHandle);
 
-    }
+	}
 
-    /*Tests_SRS_LOGGER_02_012: [If producing the JSON format or writing it to the file fails, then Logger_Receive shall fail and return.]*/
-    TEST_FUNCTION(Logger_Receive_fails_when_STRING_concat_fails_3)
+    /*Tests_SRS_LOGGER_31_006: [ `Logger_Receive` shall print the time with `strftime` only when it differs from the time of the previous message. ]*/
+    /*Tests_SRS_LOGGER_31_007: [ `Logger_Receive` shall render the record in a buffer kept from one message to the next, escaping the property keys and values and encoding the content in base64. ]*/
+    TEST_FUNCTION(Logger_Receive_second_message_reuses_the_time_and_the_record_buffer)
     {
         ///arrange
         CLoggerMocks mocks;
         auto moduleHandle = Logger_Create(validBrokerHandle, &validConfig);
+        Logger_Receive(moduleHandle, validMessageHandle);
         mocks.ResetAllCalls();
         mocks_ResetAllCounters();
 
-        STRICT_EXPECTED_CALL(mocks, gb_time(NULL)); /*this is getting the time*/
-
-        STRICT_EXPECTED_CALL(mocks, gb_localtime(IGNORED_PTR_ARG)) /*this is transforming the time from time_t to struct tm* */
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, gb_strftime(IGNORED_PTR_ARG, IGNORED_NUM_ARG, "%C", IGNORED_PTR_ARG)) /*this is building a JSON object in timetemp*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(2)
-            .IgnoreArgument(4);
+        STRICT_EXPECTED_CALL(mocks, gb_time(NULL)); /*the same second as the first message*/
 
         STRICT_EXPECTED_CALL(mocks, Message_GetProperties(validMessageHandle)); /*this is getting the properties from the message*/
         STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_CloneWriteable(IGNORED_PTR_ARG)) /*this is getting the properties in a writeable map, because ConstMap doesn't have ToJSON*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, Map_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, Map_ToJSON(IGNORED_PTR_ARG)) /*this is getting a STRING_HANDLE that is the MAP as JSON*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is getting the keys and values of the properties*/
+            .IgnoreAllArguments();
 
         STRICT_EXPECTED_CALL(mocks, Message_GetContent(validMessageHandle)); /*this is getting the content*/
 
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer, sizeof(buffer) / sizeof(buffer[0]))); /*this is getting a STRING_HANDLE that is the base64 encode of the bytes*/
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_construct(",{\"time\":\"")); /*this is the actual JSON object building*/
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, gb_fseek(IGNORED_PTR_ARG, -1, SEEK_END)) /*this is rewinding the file by 1 character*/
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding the real time to the json*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\",\"properties\":")) /*this is adding the "properties":" string*/
-            .IgnoreArgument(1)
-            .SetFailReturn(__LINE__);
-
         ///act
         Logger_Receive(moduleHandle, validMessageHandle);
 
         ///assert
         mocks.AssertActualAndExpectedCalls();
-        ASSERT_ARE_EQUAL(size_t, 0, CURRENT_API_CALL(gb_fprintf));
+        ASSERT_ARE_EQUAL(size_t, 1, CURRENT_API_CALL(gb_fprintf));
+        ASSERT_ARE_EQUAL(char_ptr, RENDERED_RECORD "]", all_fprintfs[0]);
 
         ///cleanup
         Logger_Destroy(moduleHandle);
@@ -1949,7 +2000,7 @@ BEGIN_TEST_SUITE(logger_ut)
     }
 
     /*Tests_SRS_LOGGER_02_012: [If producing the JSON format or writing it to the file fails, then Logger_Receive shall fail and return.]*/
-    TEST_FUNCTION(Logger_Receive_fails_when_STRING_concat_fails_4)
+    TEST_FUNCTION(Logger_Receive_fails_when_fprintf_fails)
     {
         ///arrange
         CLoggerMocks mocks;
@@ -1962,7 +2013,7 @@ BEGIN_TEST_SUITE(logger_ut)
         STRICT_EXPECTED_CALL(mocks, gb_localtime(IGNORED_PTR_ARG)) /*this is transforming the time from time_t to struct tm* */
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gb_strftime(IGNORED_PTR_ARG, IGNORED_NUM_ARG, "%C", IGNORED_PTR_ARG)) /*this is building a JSON object in timetemp*/
+        STRICT_EXPECTED_CALL(mocks, gb_strftime(IGNORED_PTR_ARG, IGNORED_NUM_ARG, "%C", IGNORED_PTR_ARG)) /*this is printing the time*/
             .IgnoreArgument(1)
             .IgnoreArgument(2)
             .IgnoreArgument(4);
@@ -1971,37 +2022,25 @@ BEGIN_TEST_SUITE(logger_ut)
         STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_CloneWriteable(IGNORED_PTR_ARG)) /*this is getting the properties in a writeable map, because ConstMap doesn't have ToJSON*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, Map_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, Map_ToJSON(IGNORED_PTR_ARG)) /*this is getting a STRING_HANDLE that is the MAP as JSON*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is getting the keys and values of the properties*/
+            .IgnoreAllArguments();
 
         STRICT_EXPECTED_CALL(mocks, Message_GetContent(validMessageHandle)); /*this is getting the content*/
 
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer, sizeof(buffer) / sizeof(buffer[0]))); /*this is getting a STRING_HANDLE that is the base64 encode of the bytes*/
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_realloc(NULL, IGNORED_NUM_ARG)) /*this is the record buffer, allocated by the first message*/
+            .IgnoreArgument(2);
 
-        STRICT_EXPECTED_CALL(mocks, STRING_construct(",{\"time\":\"")); /*this is the actual JSON object building*/
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, gb_fseek(IGNORED_PTR_ARG, -1, SEEK_END)) /*this is rewinding the file by 1 character*/
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding the real time to the json*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(2)
-            .SetFailReturn(__LINE__);
+        MAKE_FAIL(gb_fprintf, 1);
 
         ///act
         Logger_Receive(moduleHandle, validMessageHandle);
 
         ///assert
         mocks.AssertActualAndExpectedCalls();
-        ASSERT_ARE_EQUAL(size_t, 0, CURRENT_API_CALL(gb_fprintf));
+        ASSERT_ARE_EQUAL(size_t, 1, CURRENT_API_CALL(gb_fprintf));
 
         ///cleanup
         Logger_Destroy(moduleHandle);
@@ -2009,7 +2048,7 @@ BEGIN_TEST_SUITE(logger_ut)
     }
 
     /*Tests_SRS_LOGGER_02_012: [If producing the JSON format or writing it to the file fails, then Logger_Receive shall fail and return.]*/
-    TEST_FUNCTION(Logger_Receive_fails_when_STRING_construct_fails)
+    TEST_FUNCTION(Logger_Receive_fails_when_fseek_fails)
     {
         ///arrange
         CLoggerMocks mocks;
@@ -2022,7 +2061,7 @@ BEGIN_TEST_SUITE(logger_ut)
         STRICT_EXPECTED_CALL(mocks, gb_localtime(IGNORED_PTR_ARG)) /*this is transforming the time from time_t to struct tm* */
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gb_strftime(IGNORED_PTR_ARG, IGNORED_NUM_ARG, "%C", IGNORED_PTR_ARG)) /*this is building a JSON object in timetemp*/
+        STRICT_EXPECTED_CALL(mocks, gb_strftime(IGNORED_PTR_ARG, IGNORED_NUM_ARG, "%C", IGNORED_PTR_ARG)) /*this is printing the time*/
             .IgnoreArgument(1)
             .IgnoreArgument(2)
             .IgnoreArgument(4);
@@ -2031,25 +2070,18 @@ BEGIN_TEST_SUITE(logger_ut)
         STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_CloneWriteable(IGNORED_PTR_ARG)) /*this is getting the properties in a writeable map, because ConstMap doesn't have ToJSON*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, Map_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, Map_ToJSON(IGNORED_PTR_ARG)) /*this is getting a STRING_HANDLE that is the MAP as JSON*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is getting the keys and values of the properties*/
+            .IgnoreAllArguments();
 
         STRICT_EXPECTED_CALL(mocks, Message_GetContent(validMessageHandle)); /*this is getting the content*/
 
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer, sizeof(buffer) / sizeof(buffer[0]))); /*this is getting a STRING_HANDLE that is the base64 encode of the bytes*/
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_realloc(NULL, IGNORED_NUM_ARG)) /*this is the record buffer, allocated by the first message*/
+            .IgnoreArgument(2);
+
+        STRICT_EXPECTED_CALL(mocks, gb_fseek(IGNORED_PTR_ARG, -1, SEEK_END)) /*this is rewinding the file by 1 character*/
+            .IgnoreArgument(1)
+            .SetFailReturn(1);
 
-        STRICT_EXPECTED_CALL(mocks, STRING_construct(",{\"time\":\"")) /*this is the actual JSON object building*/
-            .SetFailReturn((STRING_HANDLE)NULL);
-        
         ///act
         Logger_Receive(moduleHandle, validMessageHandle);
 
@@ -2063,7 +2095,7 @@ BEGIN_TEST_SUITE(logger_ut)
     }
 
     /*Tests_SRS_LOGGER_02_012: [If producing the JSON format or writing it to the file fails, then Logger_Receive shall fail and return.]*/
-    TEST_FUNCTION(Logger_Receive_fails_when_Base64_Encode_Bytes_fails)
+    TEST_FUNCTION(Logger_Receive_fails_when_the_record_buffer_cannot_grow)
     {
         ///arrange
         CLoggerMocks mocks;
@@ -2076,7 +2108,7 @@ BEGIN_TEST_SUITE(logger_ut)
         STRICT_EXPECTED_CALL(mocks, gb_localtime(IGNORED_PTR_ARG)) /*this is transforming the time from time_t to struct tm* */
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gb_strftime(IGNORED_PTR_ARG, IGNORED_NUM_ARG, "%C", IGNORED_PTR_ARG)) /*this is building a JSON object in timetemp*/
+        STRICT_EXPECTED_CALL(mocks, gb_strftime(IGNORED_PTR_ARG, IGNORED_NUM_ARG, "%C", IGNORED_PTR_ARG)) /*this is printing the time*/
             .IgnoreArgument(1)
             .IgnoreArgument(2)
             .IgnoreArgument(4);
@@ -2085,21 +2117,15 @@ BEGIN_TEST_SUITE(logger_ut)
         STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_CloneWriteable(IGNORED_PTR_ARG)) /*this is getting the properties in a writeable map, because ConstMap doesn't have ToJSON*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, Map_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, Map_ToJSON(IGNORED_PTR_ARG)) /*this is getting a STRING_HANDLE that is the MAP as JSON*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is getting the keys and values of the properties*/
+            .IgnoreAllArguments();
 
         STRICT_EXPECTED_CALL(mocks, Message_GetContent(validMessageHandle)); /*this is getting the content*/
 
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer, sizeof(buffer) / sizeof(buffer[0]))) /*this is getting a STRING_HANDLE that is the base64 encode of the bytes*/
-            .SetFailReturn((STRING_HANDLE)NULL);
-                                                                        
+        STRICT_EXPECTED_CALL(mocks, gballoc_realloc(NULL, IGNORED_NUM_ARG)) /*this is the record buffer, allocated by the first message*/
+            .IgnoreArgument(2)
+            .SetFailReturn((void*)NULL);
+
         ///act
         Logger_Receive(moduleHandle, validMessageHandle);
 
@@ -2112,7 +2138,7 @@ BEGIN_TEST_SUITE(logger_ut)
 
     }
 
-	/*Tests_SRS_LOGGER_02_012: [If producing the JSON format or writing it to the file fails, then Logger_Receive shall fail and return.]*/
+    /*Tests_SRS_LOGGER_02_012: [If producing the JSON format or writing it to the file fails, then Logger_Receive shall fail and return.]*/
 	TEST_FUNCTION(Logger_Receive_fails_when_content_is_null)
 	{
 		///arrange
@@ -2126,7 +2152,7 @@ BEGIN_TEST_SUITE(logger_ut)
 		STRICT_EXPECTED_CALL(mocks, gb_localtime(IGNORED_PTR_ARG)) /*this is transforming the time from time_t to struct tm* */
 			.IgnoreArgument(1);
 
-		STRICT_EXPECTED_CALL(mocks, gb_strftime(IGNORED_PTR_ARG, IGNORED_NUM_ARG, "%C", IGNORED_PTR_ARG)) /*this is building a JSON object in timetemp*/
+		STRICT_EXPECTED_CALL(mocks, gb_strftime(IGNORED_PTR_ARG, IGNORED_NUM_ARG, "%C", IGNORED_PTR_ARG)) /*this is printing the time*/
 			.IgnoreArgument(1)
 			.IgnoreArgument(2)
 			.IgnoreArgument(4);
@@ -2135,17 +2161,11 @@ BEGIN_TEST_SUITE(logger_ut)
 		STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
 			.IgnoreArgument(1);
 
-		STRICT_EXPECTED_CALL(mocks, ConstMap_CloneWriteable(IGNORED_PTR_ARG)) /*this is getting the properties in a writeable map, because ConstMap doesn't have ToJSON*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, Map_Destroy(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, Map_ToJSON(IGNORED_PTR_ARG)) /*this is getting a STRING_HANDLE that is the MAP as JSON*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is getting the keys and values of the properties*/
+			.IgnoreAllArguments();
 
-		STRICT_EXPECTED_CALL(mocks, Message_GetContent(validMessageHandle)).SetFailReturn((const CONSTBUFFER *)NULL); /*this is getting the content*/
+		STRICT_EXPECTED_CALL(mocks, Message_GetContent(validMessageHandle)) /*this is getting the content*/
+			.SetFailReturn((const CONSTBUFFER *)NULL);
 
 		///act
 		Logger_Receive(moduleHandle, validMessageHandle);
@@ -2160,7 +2180,7 @@ BEGIN_TEST_SUITE(logger_ut)
 	}
 
     /*Tests_SRS_LOGGER_02_012: [If producing the JSON format or writing it to the file fails, then Logger_Receive shall fail and return.]*/
-    TEST_FUNCTION(Logger_Receive_fails_when_Map_ToJSON_fails)
+    TEST_FUNCTION(Logger_Receive_fails_when_ConstMap_GetInternals_fails)
     {
         ///arrange
         CLoggerMocks mocks;
@@ -2173,7 +2193,7 @@ BEGIN_TEST_SUITE(logger_ut)
         STRICT_EXPECTED_CALL(mocks, gb_localtime(IGNORED_PTR_ARG)) /*this is transforming the time from time_t to struct tm* */
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gb_strftime(IGNORED_PTR_ARG, IGNORED_NUM_ARG, "%C", IGNORED_PTR_ARG)) /*this is building a JSON object in timetemp*/
+        STRICT_EXPECTED_CALL(mocks, gb_strftime(IGNORED_PTR_ARG, IGNORED_NUM_ARG, "%C", IGNORED_PTR_ARG)) /*this is printing the time*/
             .IgnoreArgument(1)
             .IgnoreArgument(2)
             .IgnoreArgument(4);
@@ -2182,15 +2202,10 @@ BEGIN_TEST_SUITE(logger_ut)
         STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_CloneWriteable(IGNORED_PTR_ARG)) /*this is getting the properties in a writeable map, because ConstMap doesn't have ToJSON*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, Map_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is getting the keys and values of the properties*/
+            .IgnoreAllArguments()
+            .SetFailReturn(CONSTMAP_ERROR);
 
-        STRICT_EXPECTED_CALL(mocks, Map_ToJSON(IGNORED_PTR_ARG)) /*this is getting a STRING_HANDLE that is the MAP as JSON*/
-            .IgnoreArgument(1)
-            .SetFailReturn((STRING_HANDLE)NULL);
-        
         ///act
         Logger_Receive(moduleHandle, validMessageHandle);
 
@@ -2203,12 +2218,12 @@ BEGIN_TEST_SUITE(logger_ut)
 
     }
 
-    /*Tests_SRS_LOGGER_02_012: [If producing the JSON format or writing it to the file fails, then Logger_Receive shall fail and return.]*/
-    TEST_FUNCTION(Logger_Receive_fails_when_ConstMap_CloneWriteable_fails)
+    /*Tests_SRS_LOGGER_31_009: [ Otherwise `Logger_Receive` shall append the record to the records waiting for the writer thread, and wake the writer thread up when there were none or when they reach `batchMaxBytes` bytes. ]*/
+    TEST_FUNCTION(Logger_Receive_with_writer_queues_the_record)
     {
         ///arrange
         CLoggerMocks mocks;
-        auto moduleHandle = Logger_Create(validBrokerHandle, &validConfig);
+        auto moduleHandle = Logger_Create(validBrokerHandle, &writerConfig);
         mocks.ResetAllCalls();
         mocks_ResetAllCounters();
 
@@ -2217,7 +2232,7 @@ BEGIN_TEST_SUITE(logger_ut)
         STRICT_EXPECTED_CALL(mocks, gb_localtime(IGNORED_PTR_ARG)) /*this is transforming the time from time_t to struct tm* */
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gb_strftime(IGNORED_PTR_ARG, IGNORED_NUM_ARG, "%C", IGNORED_PTR_ARG)) /*this is building a JSON object in timetemp*/
+        STRICT_EXPECTED_CALL(mocks, gb_strftime(IGNORED_PTR_ARG, IGNORED_NUM_ARG, "%C", IGNORED_PTR_ARG)) /*this is printing the time*/
             .IgnoreArgument(1)
             .IgnoreArgument(2)
             .IgnoreArgument(4);
@@ -2226,16 +2241,69 @@ BEGIN_TEST_SUITE(logger_ut)
         STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_CloneWriteable(IGNORED_PTR_ARG)) /*this is getting the properties in a writeable map, because ConstMap doesn't have ToJSON*/
-            .IgnoreArgument(1)
-            .SetFailReturn((MAP_HANDLE)NULL);
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is getting the keys and values of the properties*/
+            .IgnoreAllArguments();
+
+        STRICT_EXPECTED_CALL(mocks, Message_GetContent(validMessageHandle)); /*this is getting the content*/
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_realloc(NULL, IGNORED_NUM_ARG)) /*this is the record buffer, allocated by the first message*/
+            .IgnoreArgument(2);
+
+        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Condition_Post(IGNORED_PTR_ARG)) /*the writer thread waits for this first record*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
         ///act
         Logger_Receive(moduleHandle, validMessageHandle);
 
         ///assert
         mocks.AssertActualAndExpectedCalls();
-        ASSERT_ARE_EQUAL(size_t, 0, CURRENT_API_CALL(gb_fprintf));
+        ASSERT_ARE_EQUAL(size_t, 0, CURRENT_API_CALL(gb_fprintf)); /*Logger_Receive does not touch the file*/
+
+        ///cleanup
+        Logger_Destroy(moduleHandle);
+
+    }
+
+    /*Tests_SRS_LOGGER_31_010: [ If the record does not fit in `queueMaxBytes` bytes with the records waiting, `Logger_Receive` shall drop it and count it as dropped. ]*/
+    TEST_FUNCTION(Logger_Receive_with_writer_drops_the_record_when_the_queue_is_full)
+    {
+        ///arrange
+        CLoggerMocks mocks;
+        LOGGER_COUNTERS counters;
+        auto moduleHandle = Logger_Create(validBrokerHandle, &writerConfig);
+        Logger_Receive(moduleHandle, validMessageHandle);
+        Logger_Receive(moduleHandle, validMessageHandle); /*the queue is full*/
+        mocks.ResetAllCalls();
+        mocks_ResetAllCounters();
+
+        STRICT_EXPECTED_CALL(mocks, gb_time(NULL)); /*the same second as the first messages*/
+
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(validMessageHandle)); /*this is getting the properties from the message*/
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is getting the keys and values of the properties*/
+            .IgnoreAllArguments();
+
+        STRICT_EXPECTED_CALL(mocks, Message_GetContent(validMessageHandle)); /*this is getting the content*/
+
+        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        Logger_Receive(moduleHandle, validMessageHandle);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(int, 0, Logger_GetCounters(moduleHandle, &counters));
+        ASSERT_ARE_EQUAL(size_t, 1, counters.dropped);
+        ASSERT_ARE_EQUAL(size_t, 0, counters.written);
 
         ///cleanup
         Logger_Destroy(moduleHandle);
@@ -2385,6 +2453,154 @@ BEGIN_TEST_SUITE(logger_ut)
         ///cleanup
     }
 
+    /*Tests_SRS_LOGGER_31_020: [ `Logger_Destroy` shall close the record log, without adding the end of log JSON object. ]*/
+    TEST_FUNCTION(Logger_Destroy_with_record_log_closes_it)
+    {
+        ///arrange
+        CLoggerMocks mocks;
+        LOGGER_CONFIG recordLogConfig = makeRecordLogConfig();
+        auto moduleHandle = Logger_Create(validBrokerHandle, &recordLogConfig);
+        Logger_Receive(moduleHandle, validMessageHandle);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, RecordLog_Close(TEST_RECORD_LOG));
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*the record buffer and the handle*/
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(2);
+
+        ///act
+        Logger_Destroy(moduleHandle);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+    }
+
+    /*Tests_SRS_LOGGER_31_012: [ The writer thread shall write all the records waiting at once, and flush the file as `flush` tells. ]*/
+    /*Tests_SRS_LOGGER_31_013: [ `Logger_Destroy` shall stop the writer thread once it has written the records waiting, before adding the end of log JSON object. ]*/
+    TEST_FUNCTION(Logger_Destroy_with_writer_writes_the_records_waiting)
+    {
+        ///arrange
+        CLoggerMocks mocks;
+        auto moduleHandle = Logger_Create(validBrokerHandle, &writerConfig);
+        Logger_Receive(moduleHandle, validMessageHandle);
+        Logger_Receive(moduleHandle, validMessageHandle);
+        mocks.ResetAllCalls();
+        mocks_ResetAllCounters();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG)) /*stopping, taking the records, counting them*/
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(3);
+        STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(3);
+        STRICT_EXPECTED_CALL(mocks, Condition_Post(IGNORED_PTR_ARG)) /*waking up the writer thread to stop*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+
+        STRICT_EXPECTED_CALL(mocks, gb_fseek(IGNORED_PTR_ARG, -1, SEEK_END)) /*the writer thread eats the "]" at the end, once for both records*/
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, Condition_Deinit(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, gb_time(NULL)); /*this is getting the time*/
+
+        STRICT_EXPECTED_CALL(mocks, gb_localtime(IGNORED_PTR_ARG)) /*this is transforming the time from time_t to struct tm* */
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, gb_strftime(IGNORED_PTR_ARG, IGNORED_NUM_ARG, ",{\"time\":\"%C\",\"content\":\"Log stopped\"}]", IGNORED_PTR_ARG)) /*this is building a JSON object in timetemp*/
+            .IgnoreArgument(1)
+            .IgnoreArgument(2)
+            .IgnoreArgument(4);
+
+        STRICT_EXPECTED_CALL(mocks, gb_fseek(IGNORED_PTR_ARG, -1, SEEK_END)) /*the end of log eats the "]" at the end*/
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, gb_fclose(IGNORED_PTR_ARG)) /*this closes the file opened in _create*/
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*the 2 buffers of the writer thread, the record buffer and the handle*/
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(4);
+
+        ///act
+        Logger_Destroy(moduleHandle);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 2, CURRENT_API_CALL(gb_fprintf));
+        ASSERT_ARE_EQUAL(char_ptr, RENDERED_RECORD RENDERED_RECORD "]", all_fprintfs[0]);
+        ASSERT_ARE_EQUAL(char_ptr, TIME_IN_STRFTIME, all_fprintfs[1]);
+
+        ///cleanup
+    }
+
+    /*Tests_SRS_LOGGER_31_014: [ If `module` or `counters` is NULL then `Logger_GetCounters` shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(Logger_GetCounters_with_NULL_module_fails)
+    {
+        ///arrange
+        CLoggerMocks mocks;
+        LOGGER_COUNTERS counters;
+
+        ///act
+        int result = Logger_GetCounters(NULL, &counters);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+    }
+
+    /*Tests_SRS_LOGGER_31_014: [ If `module` or `counters` is NULL then `Logger_GetCounters` shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(Logger_GetCounters_with_NULL_counters_fails)
+    {
+        ///arrange
+        CLoggerMocks mocks;
+        auto moduleHandle = Logger_Create(validBrokerHandle, &validConfig);
+        mocks.ResetAllCalls();
+
+        ///act
+        int result = Logger_GetCounters(moduleHandle, NULL);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Logger_Destroy(moduleHandle);
+    }
+
+    /*Tests_SRS_LOGGER_31_015: [ `Logger_GetCounters` shall copy the counters of the module into `counters` and return 0. ]*/
+    TEST_FUNCTION(Logger_GetCounters_counts_the_records_written)
+    {
+        ///arrange
+        CLoggerMocks mocks;
+        LOGGER_COUNTERS counters;
+        auto moduleHandle = Logger_Create(validBrokerHandle, &validConfig);
+        Logger_Receive(moduleHandle, validMessageHandle);
+        Logger_Receive(moduleHandle, validMessageHandle);
+        mocks.ResetAllCalls();
+
+        ///act
+        int result = Logger_GetCounters(moduleHandle, &counters);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(size_t, 2, counters.written);
+        ASSERT_ARE_EQUAL(size_t, 0, counters.writeFailures);
+        ASSERT_ARE_EQUAL(size_t, 0, counters.dropped);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Logger_Destroy(moduleHandle);
+    }
+
     /*Tests_SRS_LOGGER_26_001: [ `Module_GetApi` shall return a pointer to a  `MODULE_API` structure with the required function pointers. ]*/
     TEST_FUNCTION(Module_GetApi_returns_non_NULL_and_non_NULL_fields)
     {
@@ -0,0 +1,701 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <cstdlib>
+#include <cstddef>
+#include <cstdio>
+#include <cstdarg>
+#include <ctime>
+#include "testrunnerswitcher.h"
+#include "micromock.h"
+#include "micromockcharstararenullterminatedstrings.h"
+
+#ifdef WIN32
+#include <direct.h>
+#define make_directory(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define make_directory(path) mkdir(path, 0700)
+#endif
+
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/strings.h"
+#include "azure_c_shared_utility/tickcounter.h"
+
+#ifndef GB_TIME_INTERCEPT
+#error these unit tests require the symbol GB_TIME_INTERCEPT to be defined
+#else
+extern "C"
+{
+    extern time_t gb_time(time_t *timer);
+}
+#endif
+
+#define GBALLOC_H
+extern "C" int gballoc_init(void);
+extern "C" void gballoc_deinit(void);
+extern "C" void* gballoc_malloc(size_t size);
+extern "C" void* gballoc_calloc(size_t nmemb, size_t size);
+extern "C" void* gballoc_realloc(void* ptr, size_t size);
+extern "C" void gballoc_free(void* ptr);
+
+namespace BASEIMPLEMENTATION
+{
+#define Lock(x) (LOCK_OK + gballocState - gballocState) /*compiler warning about constant in if condition*/
+#define Unlock(x) (LOCK_OK + gballocState - gballocState)
+#define Lock_Init() (LOCK_HANDLE)0x42
+#define Lock_Deinit(x) (LOCK_OK + gballocState - gballocState)
+#include "gballoc.c"
+#undef Lock
+#undef Unlock
+#undef Lock_Init
+#undef Lock_Deinit
+
+#include "strings.c"
+};
+
+#include "record_log.h"
+#include "segment_file_test.h"
+
+/*the segments of the tests are real files in this directory*/
+#define TEST_DIRECTORY "record_log_ut_files"
+#define TEST_NAME TEST_DIRECTORY "/log"
+#define TEST_SEGMENT_COUNT 16
+#define TEST_RECORD_SIZE SEGMENT_FILE_TEST_RECORD_SIZE
+#define TEST_RECORD_HEADER_SIZE 16
+#define TEST_RECORD_BYTES (TEST_RECORD_HEADER_SIZE + TEST_RECORD_SIZE)
+#define TEST_INDEX_ENTRY_SIZE 16
+#define TEST_TICK_COUNTER (TICK_COUNTER_HANDLE)0x4242
+
+static MICROMOCK_MUTEX_HANDLE g_testByTest;
+static MICROMOCK_GLOBAL_SEMAPHORE_HANDLE g_dllByDll;
+
+static time_t currentTime;
+static tickcounter_ms_t currentTicks;
+
+/*the milliseconds since 1970 of the records appended while currentTicks is ticks, for a log opened at START_TICKS*/
+#define START_TICKS 5000
+#define RECORD_TIME(ticks) ((uint64_t)currentTime * 1000 + (ticks) - START_TICKS)
+
+/*poor man mock, STRING_construct_sprintf takes ...*/
+extern "C" STRING_HANDLE STRING_construct_sprintf(const char* format, ...)
+{
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    (void)vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    return BASEIMPLEMENTATION::STRING_construct(buffer);
+}
+
+TYPED_MOCK_CLASS(RecordLogMocks, CGlobalMock)
+{
+public:
+
+    // memory
+    MOCK_STATIC_METHOD_1(, void*, gballoc_malloc, size_t, size)
+        void* result2 = BASEIMPLEMENTATION::gballoc_malloc(size);
+    MOCK_METHOD_END(void*, result2);
+
+    MOCK_STATIC_METHOD_1(, void, gballoc_free, void*, ptr)
+        BASEIMPLEMENTATION::gballoc_free(ptr);
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_1(, STRING_HANDLE, STRING_construct, const char*, source)
+    MOCK_METHOD_END(STRING_HANDLE, BASEIMPLEMENTATION::STRING_construct(source))
+
+    MOCK_STATIC_METHOD_1(, const char*, STRING_c_str, STRING_HANDLE, s)
+    MOCK_METHOD_END(const char*, BASEIMPLEMENTATION::STRING_c_str(s))
+
+    MOCK_STATIC_METHOD_1(, void, STRING_delete, STRING_HANDLE, s)
+        BASEIMPLEMENTATION::STRING_delete(s);
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_1(, time_t, gb_time, time_t*, timer)
+    MOCK_METHOD_END(time_t, currentTime)
+
+    MOCK_STATIC_METHOD_0(, TICK_COUNTER_HANDLE, tickcounter_create)
+    MOCK_METHOD_END(TICK_COUNTER_HANDLE, TEST_TICK_COUNTER)
+
+    MOCK_STATIC_METHOD_1(, void, tickcounter_destroy, TICK_COUNTER_HANDLE, tick_counter)
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_2(, int, tickcounter_get_current_ms, TICK_COUNTER_HANDLE, tick_counter, tickcounter_ms_t*, current_ms)
+        *current_ms = currentTicks;
+    MOCK_METHOD_END(int, 0)
+};
+
+DECLARE_GLOBAL_MOCK_METHOD_1(RecordLogMocks, , void*, gballoc_malloc, size_t, size);
+DECLARE_GLOBAL_MOCK_METHOD_1(RecordLogMocks, , void, gballoc_free, void*, ptr);
+DECLARE_GLOBAL_MOCK_METHOD_1(RecordLogMocks, , STRING_HANDLE, STRING_construct, const char*, source);
+DECLARE_GLOBAL_MOCK_METHOD_1(RecordLogMocks, , const char*, STRING_c_str, STRING_HANDLE, s);
+DECLARE_GLOBAL_MOCK_METHOD_1(RecordLogMocks, , void, STRING_delete, STRING_HANDLE, s);
+DECLARE_GLOBAL_MOCK_METHOD_1(RecordLogMocks, , time_t, gb_time, time_t*, timer);
+DECLARE_GLOBAL_MOCK_METHOD_0(RecordLogMocks, , TICK_COUNTER_HANDLE, tickcounter_create);
+DECLARE_GLOBAL_MOCK_METHOD_1(RecordLogMocks, , void, tickcounter_destroy, TICK_COUNTER_HANDLE, tick_counter);
+DECLARE_GLOBAL_MOCK_METHOD_2(RecordLogMocks, , int, tickcounter_get_current_ms, TICK_COUNTER_HANDLE, tick_counter, tickcounter_ms_t*, current_ms);
+
+static RECORD_LOG_CONFIG makeConfig(size_t segmentMaxBytes, unsigned int segmentMaxSeconds, size_t indexIntervalBytes)
+{
+    RECORD_LOG_CONFIG config;
+    config.name = TEST_NAME;
+    config.segmentMaxBytes = segmentMaxBytes;
+    config.segmentMaxSeconds = segmentMaxSeconds;
+    config.indexIntervalBytes = indexIntervalBytes;
+    return config;
+}
+
+static void deleteFiles(void)
+{
+    static const char* const extensions[] = { "rlog", "ridx" };
+    SegmentFileTest_DeleteFiles(TEST_NAME, "rlog", extensions, sizeof(extensions) / sizeof(extensions[0]), TEST_SEGMENT_COUNT);
+}
+
+/*records hold their number, so their order can be checked, and are appended 100 milliseconds apart*/
+static void appendRecords(RECORD_LOG_HANDLE log, int first, int count)
+{
+    for (int i = first; i < first + count; i++)
+    {
+        char record[TEST_RECORD_SIZE + 1];
+        SegmentFileTest_MakeRecord(record, i);
+        ASSERT_ARE_EQUAL(int, 0, RecordLog_Append(log, (const unsigned char*)record, TEST_RECORD_SIZE));
+        currentTicks += 100;
+    }
+}
+
+static void writeLog(const RECORD_LOG_CONFIG* config, int first, int count)
+{
+    RECORD_LOG_HANDLE log = RecordLog_Open(config);
+    ASSERT_IS_NOT_NULL(log);
+    appendRecords(log, first, count);
+    RecordLog_Close(log);
+}
+
+/*returns the number held by the next record, -1 when there is none*/
+static int readRecord(RECORD_LOG_READER_HANDLE reader, uint64_t* time)
+{
+    const unsigned char* record;
+    size_t size;
+    ASSERT_ARE_EQUAL(int, 0, RecordLog_Next(reader, &record, &size, time));
+    int result;
+    if (record == NULL)
+    {
+        result = -1;
+    }
+    else
+    {
+        ASSERT_ARE_EQUAL(size_t, TEST_RECORD_SIZE, size);
+        result = SegmentFileTest_RecordNumber(record);
+    }
+    return result;
+}
+
+BEGIN_TEST_SUITE(record_log_ut)
+
+    TEST_SUITE_INITIALIZE(TestClassInitialize)
+    {
+        TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+        g_testByTest = MicroMockCreateMutex();
+        ASSERT_IS_NOT_NULL(g_testByTest);
+        (void)make_directory(TEST_DIRECTORY);
+    }
+
+    TEST_SUITE_CLEANUP(TestClassCleanup)
+    {
+        MicroMockDestroyMutex(g_testByTest);
+        TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    }
+
+    TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+    {
+        if (!MicroMockAcquireMutex(g_testByTest))
+        {
+            ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+        }
+        currentTime = 1000;
+        currentTicks = START_TICKS;
+        deleteFiles();
+    }
+
+    TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+    {
+        deleteFiles();
+        if (!MicroMockReleaseMutex(g_testByTest))
+        {
+            ASSERT_FAIL("failure in test framework at ReleaseMutex");
+        }
+    }
+
+    /*Tests_SRS_RECORD_LOG_31_001: [ If `config` or `config->name` is NULL then `RecordLog_Open` shall fail and return NULL. ]*/
+    TEST_FUNCTION(RecordLog_Open_with_NULL_config_fails)
+    {
+        ///arrange
+        RecordLogMocks mocks;
+
+        ///act
+        RECORD_LOG_HANDLE result = RecordLog_Open(NULL);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_IS_NULL(result);
+    }
+
+    /*Tests_SRS_RECORD_LOG_31_001: [ If `config` or `config->name` is NULL then `RecordLog_Open` shall fail and return NULL. ]*/
+    TEST_FUNCTION(RecordLog_Open_with_NULL_name_fails)
+    {
+        ///arrange
+        RecordLogMocks mocks;
+        RECORD_LOG_CONFIG config = makeConfig(0, 0, 0);
+        config.name = NULL;
+
+        ///act
+        RECORD_LOG_HANDLE result = RecordLog_Open(&config);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_IS_NULL(result);
+    }
+
+    /*Tests_SRS_RECORD_LOG_31_003: [ If `RecordLog_Open` encounters an internal failure it shall fail and return NULL. ]*/
+    TEST_FUNCTION(RecordLog_Open_fails_when_malloc_fails)
+    {
+        ///arrange
+        RecordLogMocks mocks;
+        RECORD_LOG_CONFIG config = makeConfig(0, 0, 0);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1)
+            .SetFailReturn((void*)NULL);
+
+        ///act
+        RECORD_LOG_HANDLE result = RecordLog_Open(&config);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_IS_NULL(result);
+    }
+
+    /*Tests_SRS_RECORD_LOG_31_003: [ If `RecordLog_Open` encounters an internal failure it shall fail and return NULL. ]*/
+    TEST_FUNCTION(RecordLog_Open_fails_when_tickcounter_create_fails)
+    {
+        ///arrange
+        CNiceCallComparer<RecordLogMocks> mocks;
+        RECORD_LOG_CONFIG config = makeConfig(0, 0, 0);
+        STRICT_EXPECTED_CALL(mocks, tickcounter_create())
+            .SetFailReturn((TICK_COUNTER_HANDLE)NULL);
+
+        ///act
+        RECORD_LOG_HANDLE result = RecordLog_Open(&config);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+    }
+
+    /*Tests_SRS_RECORD_LOG_31_004: [ If `log` is NULL, or `record` is NULL and `size` is not 0, then `RecordLog_Append` shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(RecordLog_Append_with_NULL_log_fails)
+    {
+        ///arrange
+        RecordLogMocks mocks;
+        const unsigned char record[] = { 1 };
+
+        ///act
+        int result = RecordLog_Append(NULL, record, sizeof(record));
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    }
+
+    /*Tests_SRS_RECORD_LOG_31_004: [ If `log` is NULL, or `record` is NULL and `size` is not 0, then `RecordLog_Append` shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(RecordLog_Append_with_NULL_record_fails)
+    {
+        ///arrange
+        CNiceCallComparer<RecordLogMocks> mocks;
+        RECORD_LOG_CONFIG config = makeConfig(0, 0, 0);
+        RECORD_LOG_HANDLE log = RecordLog_Open(&config);
+        ASSERT_IS_NOT_NULL(log);
+
+        ///act
+        int result = RecordLog_Append(log, NULL, 1);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(long, -1, SegmentFileTest_FileSize(TEST_NAME, ".1.rlog"));
+
+        ///cleanup
+        RecordLog_Close(log);
+    }
+
+    /*Tests_SRS_RECORD_LOG_31_005: [ `RecordLog_Append` shall write the record after a header holding the magic "RLOG", its size and the milliseconds since 1970, never less than those of the previous record, and return 0. ]*/
+    /*Tests_SRS_RECORD_LOG_31_015: [ `RecordLog_Next` shall return the records in the order they were appended, mapping the segments one at a time, leaving out a segment from its first damaged record on, and set `*record` to NULL once every record is read. ]*/
+    TEST_FUNCTION(RecordLog_Next_returns_the_records_in_order)
+    {
+        ///arrange
+        CNiceCallComparer<RecordLogMocks> mocks;
+        RECORD_LOG_CONFIG config = makeConfig(0, 0, 0);
+        writeLog(&config, 0, 10);
+        RECORD_LOG_READER_HANDLE reader = RecordLog_OpenReader(TEST_NAME);
+        ASSERT_IS_NOT_NULL(reader);
+
+        ///act
+        uint64_t time;
+        for (int i = 0; i < 10; i++)
+        {
+            ///assert
+            ASSERT_ARE_EQUAL(int, i, readRecord(reader, &time));
+            ASSERT_IS_TRUE(RECORD_TIME(START_TICKS + 100 * i) == time);
+        }
+        ASSERT_ARE_EQUAL(int, -1, readRecord(reader, &time));
+        ASSERT_ARE_EQUAL(long, (long)(10 * TEST_RECORD_BYTES), SegmentFileTest_FileSize(TEST_NAME, ".1.rlog"));
+
+        ///cleanup
+        RecordLog_CloseReader(reader);
+    }
+
+    /*Tests_SRS_RECORD_LOG_31_005: [ `RecordLog_Append` shall write the record after a header holding the magic "RLOG", its size and the milliseconds since 1970, never less than those of the previous record, and return 0. ]*/
+    TEST_FUNCTION(RecordLog_Append_never_stamps_a_record_before_the_previous_one)
+    {
+        ///arrange
+        CNiceCallComparer<RecordLogMocks> mocks;
+        RECORD_LOG_CONFIG config = makeConfig(0, 0, 0);
+        RECORD_LOG_HANDLE log = RecordLog_Open(&config);
+        ASSERT_IS_NOT_NULL(log);
+        currentTicks = START_TICKS + 500;
+        appendRecords(log, 0, 1);
+
+        ///act
+        currentTicks = START_TICKS + 200;
+        appendRecords(log, 1, 1);
+        RecordLog_Close(log);
+
+        ///assert
+        RECORD_LOG_READER_HANDLE reader = RecordLog_OpenReader(TEST_NAME);
+        ASSERT_IS_NOT_NULL(reader);
+        uint64_t time;
+        ASSERT_ARE_EQUAL(int, 0, readRecord(reader, &time));
+        ASSERT_ARE_EQUAL(int, 1, readRecord(reader, &time));
+        ASSERT_IS_TRUE(RECORD_TIME(START_TICKS + 500) == time);
+
+        ///cleanup
+        RecordLog_CloseReader(reader);
+    }
+
+    /*Tests_SRS_RECORD_LOG_31_006: [ A segment holding `segmentMaxBytes` bytes, or whose first record was appended `segmentMaxSeconds` seconds ago, shall take no more records, the next record shall start a new segment. ]*/
+    TEST_FUNCTION(RecordLog_Append_starts_a_new_segment_when_one_is_full)
+    {
+        ///arrange
+        CNiceCallComparer<RecordLogMocks> mocks;
+        RECORD_LOG_CONFIG config = makeConfig(2 * TEST_RECORD_BYTES, 0, 0);
+
+        ///act
+        writeLog(&config, 0, 5);
+
+        ///assert
+        ASSERT_ARE_EQUAL(long, (long)(2 * TEST_RECORD_BYTES), SegmentFileTest_FileSize(TEST_NAME, ".1.rlog"));
+        ASSERT_ARE_EQUAL(long, (long)(2 * TEST_RECORD_BYTES), SegmentFileTest_FileSize(TEST_NAME, ".2.rlog"));
+        ASSERT_ARE_EQUAL(long, (long)TEST_RECORD_BYTES, SegmentFileTest_FileSize(TEST_NAME, ".3.rlog"));
+        ASSERT_ARE_EQUAL(long, -1, SegmentFileTest_FileSize(TEST_NAME, ".4.rlog"));
+    }
+
+    /*Tests_SRS_RECORD_LOG_31_006: [ A segment holding `segmentMaxBytes` bytes, or whose first record was appended `segmentMaxSeconds` seconds ago, shall take no more records, the next record shall start a new segment. ]*/
+    TEST_FUNCTION(RecordLog_Append_starts_a_new_segment_when_one_is_old)
+    {
+        ///arrange
+        CNiceCallComparer<RecordLogMocks> mocks;
+        RECORD_LOG_CONFIG config = makeConfig(0, 1, 0);
+        RECORD_LOG_HANDLE log = RecordLog_Open(&config);
+        ASSERT_IS_NOT_NULL(log);
+
+        ///act
+        for (int i = 0; i < 4; i++)
+        {
+            appendRecords(log, i, 1);
+            currentTicks += 500;
+        }
+        RecordLog_Close(log);
+
+        ///assert
+        ASSERT_ARE_EQUAL(long, (long)(2 * TEST_RECORD_BYTES), SegmentFileTest_FileSize(TEST_NAME, ".1.rlog"));
+        ASSERT_ARE_EQUAL(long, (long)(2 * TEST_RECORD_BYTES), SegmentFileTest_FileSize(TEST_NAME, ".2.rlog"));
+        ASSERT_ARE_EQUAL(long, -1, SegmentFileTest_FileSize(TEST_NAME, ".3.rlog"));
+    }
+
+    /*Tests_SRS_RECORD_LOG_31_002: [ `RecordLog_Open` shall keep the segments a previous log of the same name left on disk, and append the next records to a new segment. ]*/
+    TEST_FUNCTION(RecordLog_Open_appends_to_a_new_segment_after_those_of_the_previous_log)
+    {
+        ///arrange
+        CNiceCallComparer<RecordLogMocks> mocks;
+        RECORD_LOG_CONFIG config = makeConfig(0, 0, 0);
+        writeLog(&config, 0, 2);
+
+        ///act
+        writeLog(&config, 2, 2);
+
+        ///assert
+        ASSERT_ARE_EQUAL(long, (long)(2 * TEST_RECORD_BYTES), SegmentFileTest_FileSize(TEST_NAME, ".1.rlog"));
+        ASSERT_ARE_EQUAL(long, (long)(2 * TEST_RECORD_BYTES), SegmentFileTest_FileSize(TEST_NAME, ".2.rlog"));
+        RECORD_LOG_READER_HANDLE reader = RecordLog_OpenReader(TEST_NAME);
+        ASSERT_IS_NOT_NULL(reader);
+        uint64_t time;
+        for (int i = 0; i < 4; i++)
+        {
+            ASSERT_ARE_EQUAL(int, i, readRecord(reader, &time));
+        }
+        ASSERT_ARE_EQUAL(int, -1, readRecord(reader, &time));
+
+        ///cleanup
+        RecordLog_CloseReader(reader);
+    }
+
+    /*Tests_SRS_RECORD_LOG_31_007: [ `RecordLog_Append` shall write the time and the offset of the record to the index of the segment when it is the first record of the segment or `indexIntervalBytes` bytes were appended since the last one indexed. ]*/
+    TEST_FUNCTION(RecordLog_Append_indexes_a_record_every_indexIntervalBytes)
+    {
+        ///arrange
+        CNiceCallComparer<RecordLogMocks> mocks;
+        RECORD_LOG_CONFIG config = makeConfig(4 * TEST_RECORD_BYTES, 0, 2 * TEST_RECORD_BYTES);
+
+        ///act
+        writeLog(&config, 0, 7);
+
+        ///assert
+        ASSERT_ARE_EQUAL(long, (long)(2 * TEST_INDEX_ENTRY_SIZE), SegmentFileTest_FileSize(TEST_NAME, ".1.ridx"));
+        ASSERT_ARE_EQUAL(long, (long)(2 * TEST_INDEX_ENTRY_SIZE), SegmentFileTest_FileSize(TEST_NAME, ".2.ridx"));
+    }
+
+    /*Tests_SRS_RECORD_LOG_31_009: [ If `log` is NULL then `RecordLog_Flush` shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(RecordLog_Flush_with_NULL_log_fails)
+    {
+        ///arrange
+        RecordLogMocks mocks;
+
+        ///act
+        int result = RecordLog_Flush(NULL, false);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    }
+
+    /*Tests_SRS_RECORD_LOG_31_010: [ `RecordLog_Flush` shall flush the segment records are appended to and its index, commit them to the disk when `commit` is true, and return 0. ]*/
+    TEST_FUNCTION(RecordLog_Flush_writes_the_records_to_the_file)
+    {
+        ///arrange
+        CNiceCallComparer<RecordLogMocks> mocks;
+        RECORD_LOG_CONFIG config = makeConfig(0, 0, 0);
+        RECORD_LOG_HANDLE log = RecordLog_Open(&config);
+        ASSERT_IS_NOT_NULL(log);
+        appendRecords(log, 0, 3);
+
+        ///act
+        int result = RecordLog_Flush(log, true);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(long, (long)(3 * TEST_RECORD_BYTES), SegmentFileTest_FileSize(TEST_NAME, ".1.rlog"));
+        ASSERT_ARE_EQUAL(long, (long)TEST_INDEX_ENTRY_SIZE, SegmentFileTest_FileSize(TEST_NAME, ".1.ridx"));
+
+        ///cleanup
+        RecordLog_Close(log);
+    }
+
+    /*Tests_SRS_RECORD_LOG_31_011: [ `RecordLog_Close` shall close the files of the log; it shall do nothing when `log` is NULL. ]*/
+    TEST_FUNCTION(RecordLog_Close_with_NULL_log_does_nothing)
+    {
+        ///arrange
+        RecordLogMocks mocks;
+
+        ///act
+        RecordLog_Close(NULL);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_RECORD_LOG_31_012: [ If `name` is NULL, or there is no log named `name`, then `RecordLog_OpenReader` shall fail and return NULL. ]*/
+    TEST_FUNCTION(RecordLog_OpenReader_with_NULL_name_fails)
+    {
+        ///arrange
+        RecordLogMocks mocks;
+
+        ///act
+        RECORD_LOG_READER_HANDLE result = RecordLog_OpenReader(NULL);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_IS_NULL(result);
+    }
+
+    /*Tests_SRS_RECORD_LOG_31_012: [ If `name` is NULL, or there is no log named `name`, then `RecordLog_OpenReader` shall fail and return NULL. ]*/
+    TEST_FUNCTION(RecordLog_OpenReader_of_a_log_which_does_not_exist_fails)
+    {
+        ///arrange
+        CNiceCallComparer<RecordLogMocks> mocks;
+
+        ///act
+        RECORD_LOG_READER_HANDLE result = RecordLog_OpenReader(TEST_NAME);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+    }
+
+    /*Tests_SRS_RECORD_LOG_31_013: [ If `RecordLog_OpenReader` encounters an internal failure it shall fail and return NULL. ]*/
+    TEST_FUNCTION(RecordLog_OpenReader_fails_when_malloc_fails)
+    {
+        ///arrange
+        RecordLogMocks mocks;
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1)
+            .SetFailReturn((void*)NULL);
+
+        ///act
+        RECORD_LOG_READER_HANDLE result = RecordLog_OpenReader(TEST_NAME);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_IS_NULL(result);
+    }
+
+    /*Tests_SRS_RECORD_LOG_31_014: [ If `reader`, `record`, `size` or `time` is NULL then `RecordLog_Next` shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(RecordLog_Next_with_NULL_reader_fails)
+    {
+        ///arrange
+        RecordLogMocks mocks;
+        const unsigned char* record;
+        size_t size;
+        uint64_t time;
+
+        ///act
+        int result = RecordLog_Next(NULL, &record, &size, &time);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    }
+
+    /*Tests_SRS_RECORD_LOG_31_014: [ If `reader`, `record`, `size` or `time` is NULL then `RecordLog_Next` shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(RecordLog_Next_with_NULL_record_fails)
+    {
+        ///arrange
+        CNiceCallComparer<RecordLogMocks> mocks;
+        RECORD_LOG_CONFIG config = makeConfig(0, 0, 0);
+        writeLog(&config, 0, 1);
+        RECORD_LOG_READER_HANDLE reader = RecordLog_OpenReader(TEST_NAME);
+        ASSERT_IS_NOT_NULL(reader);
+        size_t size;
+        uint64_t time;
+
+        ///act
+        int result = RecordLog_Next(reader, NULL, &size, &time);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+
+        ///cleanup
+        RecordLog_CloseReader(reader);
+    }
+
+    /*Tests_SRS_RECORD_LOG_31_015: [ `RecordLog_Next` shall return the records in the order they were appended, mapping the segments one at a time, leaving out a segment from its first damaged record on, and set `*record` to NULL once every record is read. ]*/
+    TEST_FUNCTION(RecordLog_Next_leaves_out_a_record_cut_short)
+    {
+        ///arrange
+        CNiceCallComparer<RecordLogMocks> mocks;
+        RECORD_LOG_CONFIG config = makeConfig(0, 0, 0);
+        writeLog(&config, 0, 3);
+        const char torn[] = "RLOG\0\0\0\x08\0\0\0\0\0\0\0\0" "0000";
+        ASSERT_ARE_EQUAL(size_t, sizeof(torn) - 1, SegmentFileTest_AppendBytes(TEST_NAME, ".1.rlog", torn, sizeof(torn) - 1));
+        writeLog(&config, 3, 1);
+        RECORD_LOG_READER_HANDLE reader = RecordLog_OpenReader(TEST_NAME);
+        ASSERT_IS_NOT_NULL(reader);
+
+        ///act
+        uint64_t time;
+        for (int i = 0; i < 4; i++)
+        {
+            ///assert
+            ASSERT_ARE_EQUAL(int, i, readRecord(reader, &time));
+        }
+        ASSERT_ARE_EQUAL(int, -1, readRecord(reader, &time));
+
+        ///cleanup
+        RecordLog_CloseReader(reader);
+    }
+
+    /*Tests_SRS_RECORD_LOG_31_015: [ `RecordLog_Next` shall return the records in the order they were appended, mapping the segments one at a time, leaving out a segment from its first damaged record on, and set `*record` to NULL once every record is read. ]*/
+    TEST_FUNCTION(RecordLog_Next_leaves_out_a_segment_deleted)
+    {
+        ///arrange
+        CNiceCallComparer<RecordLogMocks> mocks;
+        RECORD_LOG_CONFIG config = makeConfig(2 * TEST_RECORD_BYTES, 0, 0);
+        writeLog(&config, 0, 6);
+        char path[256];
+        (void)sprintf(path, "%s.2.rlog", TEST_NAME);
+        ASSERT_ARE_EQUAL(int, 0, remove(path));
+        RECORD_LOG_READER_HANDLE reader = RecordLog_OpenReader(TEST_NAME);
+        ASSERT_IS_NOT_NULL(reader);
+
+        ///act
+        uint64_t time;
+        ASSERT_ARE_EQUAL(int, 0, readRecord(reader, &time));
+        ASSERT_ARE_EQUAL(int, 1, readRecord(reader, &time));
+        ASSERT_ARE_EQUAL(int, 4, readRecord(reader, &time));
+        ASSERT_ARE_EQUAL(int, 5, readRecord(reader, &time));
+        ASSERT_ARE_EQUAL(int, -1, readRecord(reader, &time));
+
+        ///cleanup
+        RecordLog_CloseReader(reader);
+    }
+
+    /*Tests_SRS_RECORD_LOG_31_016: [ If `reader` is NULL then `RecordLog_Seek` shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(RecordLog_Seek_with_NULL_reader_fails)
+    {
+        ///arrange
+        RecordLogMocks mocks;
+
+        ///act
+        int result = RecordLog_Seek(NULL, 0);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    }
+
+    /*Tests_SRS_RECORD_LOG_31_017: [ `RecordLog_Seek` shall skip the segments whose next segment starts at or before `time`, start reading at the last record indexed before `time`, and make `RecordLog_Next` leave out the records appended before `time`. ]*/
+    TEST_FUNCTION(RecordLog_Seek_starts_at_the_first_record_appended_at_or_after_time)
+    {
+        ///arrange
+        CNiceCallComparer<RecordLogMocks> mocks;
+        RECORD_LOG_CONFIG config = makeConfig(4 * TEST_RECORD_BYTES, 0, 2 * TEST_RECORD_BYTES);
+        writeLog(&config, 0, 12);
+        RECORD_LOG_READER_HANDLE reader = RecordLog_OpenReader(TEST_NAME);
+        ASSERT_IS_NOT_NULL(reader);
+        uint64_t time;
+
+        ///act
+        int result = RecordLog_Seek(reader, RECORD_TIME(START_TICKS + 100 * 7) - 50);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(int, 7, readRecord(reader, &time));
+        ASSERT_IS_TRUE(RECORD_TIME(START_TICKS + 100 * 7) == time);
+        ASSERT_ARE_EQUAL(int, 0, RecordLog_Seek(reader, RECORD_TIME(START_TICKS + 100 * 8)));
+        ASSERT_ARE_EQUAL(int, 8, readRecord(reader, &time));
+        ASSERT_ARE_EQUAL(int, 0, RecordLog_Seek(reader, 0));
+        ASSERT_ARE_EQUAL(int, 0, readRecord(reader, &time));
+
+        ///cleanup
+        RecordLog_CloseReader(reader);
+    }
+
+    /*Tests_SRS_RECORD_LOG_31_018: [ `RecordLog_CloseReader` shall unmap the segment being read; it shall do nothing when `reader` is NULL. ]*/
+    TEST_FUNCTION(RecordLog_CloseReader_with_NULL_reader_does_nothing)
+    {
+        ///arrange
+        RecordLogMocks mocks;
+
+        ///act
+        RecordLog_CloseReader(NULL);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+END_TEST_SUITE(record_log_ut)
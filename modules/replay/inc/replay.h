@@ -0,0 +1,48 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "module.h"
+
+typedef enum REPLAY_PACE_TAG
+{
+    REPLAY_PACE_ORIGINAL, /*the messages are published as far apart as they were logged*/
+    REPLAY_PACE_FAST /*the messages are published as fast as the broker takes them*/
+} REPLAY_PACE;
+
+typedef struct REPLAY_CONFIG_TAG
+{
+    const char* name; /*the record log written by the logger module with "format" set to "binary"*/
+    REPLAY_PACE pace;
+    uint64_t from; /*the milliseconds since 1970 of the first message to publish; 0 for the start of the log*/
+} REPLAY_CONFIG; /*this needs to be passed to the Module_Create function*/
+
+typedef struct REPLAY_COUNTERS_TAG
+{
+    size_t published; /*messages published to the broker*/
+    size_t publishFailures; /*messages which could not be published*/
+    size_t invalid; /*records which are not messages*/
+    uint64_t behindMaxMilliseconds; /*with REPLAY_PACE_ORIGINAL, the most a message was published after its time*/
+    bool finished; /*true once every record is read, or the log cannot be read*/
+} REPLAY_COUNTERS;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+MODULE_EXPORT const MODULE_API* MODULE_STATIC_GETAPI(REPLAY_MODULE)(MODULE_API_VERSION gateway_api_version);
+
+/*copies the counters of the module into counters, returns 0 on success*/
+MODULE_EXPORT int Replay_GetCounters(MODULE_HANDLE module, REPLAY_COUNTERS* counters);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*REPLAY_H*/
@@ -0,0 +1,483 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include "replay.h"
+#include "record_log.h"
+#include <azure_c_shared_utility/gballoc.h>
+#include <azure_c_shared_utility/xlogging.h>
+#include <azure_c_shared_utility/crt_abstractions.h>
+#include <azure_c_shared_utility/lock.h>
+#include <azure_c_shared_utility/condition.h>
+#include <azure_c_shared_utility/threadapi.h>
+#include <azure_c_shared_utility/tickcounter.h>
+#include <parson.h>
+#include "message.h"
+#include "broker.h"
+
+#define FILENAME "filename"
+#define PACE "pace"
+#define FROM "from"
+
+typedef struct REPLAY_HANDLE_DATA_TAG
+{
+    BROKER_HANDLE broker;
+    char* name;
+    REPLAY_PACE pace;
+    uint64_t from;
+    TICK_COUNTER_HANDLE clock;
+    LOCK_HANDLE lock; /*guards running and counters*/
+    COND_HANDLE stopping; /*posted by Replay_Destroy to end a wait for the time of a message*/
+    THREAD_HANDLE thread;
+    bool running;
+    REPLAY_COUNTERS counters;
+} REPLAY_HANDLE_DATA;
+
+/*with REPLAY_PACE_ORIGINAL, waits until delay milliseconds have passed since started, returns false when the module is being destroyed*/
+static bool REPLAY_wait(REPLAY_HANDLE_DATA* handleData, tickcounter_ms_t started, uint64_t delay)
+{
+    bool result;
+    if (Lock(handleData->lock) != LOCK_OK)
+    {
+        LogError("unable to lock");
+        result = false;
+    }
+    else
+    {
+        tickcounter_ms_t now;
+        bool waiting = (tickcounter_get_current_ms(handleData->clock, &now) == 0);
+        while (waiting && handleData->running && ((uint64_t)(now - started) < delay))
+        {
+            uint64_t left = delay - (uint64_t)(now - started);
+            (void)Condition_Wait(handleData->stopping, handleData->lock, (left > INT32_MAX) ? INT32_MAX : (int)left);
+            waiting = (tickcounter_get_current_ms(handleData->clock, &now) == 0);
+        }
+
+        if (waiting && ((uint64_t)(now - started) > delay + handleData->counters.behindMaxMilliseconds))
+        {
+            handleData->counters.behindMaxMilliseconds = (uint64_t)(now - started) - delay;
+        }
+        result = handleData->running;
+        (void)Unlock(handleData->lock);
+    }
+    return result;
+}
+
+/*publishes one record, returns false when the module is being destroyed*/
+static bool REPLAY_publish(REPLAY_HANDLE_DATA* handleData, const unsigned char* record, size_t size)
+{
+    bool result;
+    MESSAGE_HANDLE message;
+    BROKER_RESULT published;
+
+    /*Codes_SRS_REPLAY_31_011: [ The thread shall create a message from every record with `Message_CreateFromByteArray`, publish it to the broker and destroy it, counting the records which are not messages and the messages which cannot be published. ]*/
+    if (size > INT32_MAX)
+    {
+        LogError("a record of %lu bytes is not a message", (unsigned long)size);
+        message = NULL;
+    }
+    else if ((message = Message_CreateFromByteArray(record, (int32_t)size)) == NULL)
+    {
+        LogError("a record of %lu bytes is not a message", (unsigned long)size);
+    }
+
+    published = (message == NULL) ? BROKER_ERROR : Broker_Publish(handleData->broker, (MODULE_HANDLE)handleData, message);
+    if ((message != NULL) && (published != BROKER_OK))
+    {
+        LogError("unable to Broker_Publish");
+    }
+
+    if (Lock(handleData->lock) != LOCK_OK)
+    {
+        LogError("unable to lock");
+        result = false;
+    }
+    else
+    {
+        if (message == NULL)
+        {
+            handleData->counters.invalid++;
+        }
+        else if (published != BROKER_OK)
+        {
+            handleData->counters.publishFailures++;
+        }
+        else
+        {
+            handleData->counters.published++;
+        }
+        result = handleData->running;
+        (void)Unlock(handleData->lock);
+    }
+
+    if (message != NULL)
+    {
+        Message_Destroy(message);
+    }
+    return result;
+}
+
+/*returns false once the module is being destroyed*/
+static bool REPLAY_is_running(REPLAY_HANDLE_DATA* handleData)
+{
+    bool result;
+    if (Lock(handleData->lock) != LOCK_OK)
+    {
+        LogError("unable to lock");
+        result = false;
+    }
+    else
+    {
+        result = handleData->running;
+        (void)Unlock(handleData->lock);
+    }
+    return result;
+}
+
+static int REPLAY_thread(void* userData)
+{
+    REPLAY_HANDLE_DATA* handleData = (REPLAY_HANDLE_DATA*)userData;
+
+    /*Codes_SRS_REPLAY_31_009: [ The thread shall open a reader of the record log named `name` and, when `from` is not 0, seek it to `from`. ]*/
+    RECORD_LOG_READER_HANDLE reader = RecordLog_OpenReader(handleData->name);
+    if (reader == NULL)
+    {
+        LogError("unable to open the record log %s", handleData->name);
+    }
+    else
+    {
+        if ((handleData->from != 0) && (RecordLog_Seek(reader, handleData->from) != 0))
+        {
+            LogError("unable to seek the record log %s", handleData->name);
+        }
+        else
+        {
+            /*the next checks come with the waits and the publishes*/
+            bool running = REPLAY_is_running(handleData);
+            bool first = true;
+            uint64_t firstTime = 0;
+            tickcounter_ms_t started = 0;
+            while (running)
+            {
+                const unsigned char* record;
+                size_t size;
+                uint64_t time;
+                if (RecordLog_Next(reader, &record, &size, &time) != 0)
+                {
+                    LogError("unable to read the record log %s", handleData->name);
+                    running = false;
+                }
+                else if (record == NULL)
+                {
+                    /*every record is read*/
+                    running = false;
+                }
+                else
+                {
+                    if (handleData->pace == REPLAY_PACE_ORIGINAL)
+                    {
+                        /*Codes_SRS_REPLAY_31_010: [ With `REPLAY_PACE_ORIGINAL` the thread shall publish every message as long after the first one as it was logged after it, and keep the most it was late in `behindMaxMilliseconds`; with `REPLAY_PACE_FAST` it shall not wait. ]*/
+                        if (first)
+                        {
+                            if (tickcounter_get_current_ms(handleData->clock, &started) != 0)
+                            {
+                                LogError("unable to tickcounter_get_current_ms, the messages are published without waiting");
+                                handleData->pace = REPLAY_PACE_FAST;
+                            }
+                            firstTime = time;
+                            first = false;
+                        }
+                        else
+                        {
+                            /*the records of a log never go back in time*/
+                            running = REPLAY_wait(handleData, started, (time > firstTime) ? (time - firstTime) : 0);
+                        }
+                    }
+
+                    if (running)
+                    {
+                        running = REPLAY_publish(handleData, record, size);
+                    }
+                }
+            }
+        }
+        RecordLog_CloseReader(reader);
+    }
+
+    /*Codes_SRS_REPLAY_31_012: [ The thread shall close the reader and set `finished` once every record is read, the log cannot be read, or the module is being destroyed. ]*/
+    if (Lock(handleData->lock) != LOCK_OK)
+    {
+        LogError("unable to lock");
+    }
+    else
+    {
+        handleData->counters.finished = true;
+        (void)Unlock(handleData->lock);
+    }
+    return 0;
+}
+
+static void* Replay_ParseConfigurationFromJson(const char* configuration)
+{
+    REPLAY_CONFIG* result;
+    /*Codes_SRS_REPLAY_31_001: [ If `configuration` is NULL then `Replay_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+    if (configuration == NULL)
+    {
+        LogError("invalid arg configuration=%p", configuration);
+        result = NULL;
+    }
+    else
+    {
+        JSON_Value* json = json_parse_string(configuration);
+        if (json == NULL)
+        {
+            /*Codes_SRS_REPLAY_31_002: [ If `configuration` is not a JSON object holding the string "filename" then `Replay_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+            LogError("unable to json_parse_string");
+            result = NULL;
+        }
+        else
+        {
+            JSON_Object* obj = json_value_get_object(json);
+            const char* fileName;
+            if (
+                (obj == NULL) ||
+                ((fileName = json_object_get_string(obj, FILENAME)) == NULL)
+                )
+            {
+                LogError("the configuration is not a JSON object holding the string \"" FILENAME "\"");
+                result = NULL;
+            }
+            else
+            {
+                /*Codes_SRS_REPLAY_31_003: [ `Replay_ParseConfigurationFromJson` shall set `pace` to `REPLAY_PACE_FAST` when the string "pace" is "fast", and to `REPLAY_PACE_ORIGINAL` when it is "original" or missing, and `from` to the number "from", or 0 when it is missing. ]*/
+                const char* pace = json_object_get_string(obj, PACE);
+                double from = json_object_get_number(obj, FROM);
+                if (
+                    ((pace != NULL) && (strcmp(pace, "original") != 0) && (strcmp(pace, "fast") != 0)) ||
+                    (from < 0)
+                    )
+                {
+                    /*Codes_SRS_REPLAY_31_004: [ If "pace" is not "original" or "fast", or "from" is negative, then `Replay_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+                    LogError("\"" PACE "\" is not \"original\" or \"fast\", or \"" FROM "\" is negative");
+                    result = NULL;
+                }
+                else if ((result = (REPLAY_CONFIG*)malloc(sizeof(REPLAY_CONFIG))) == NULL)
+                {
+                    /*Codes_SRS_REPLAY_31_005: [ If `Replay_ParseConfigurationFromJson` encounters an internal failure it shall fail and return NULL. ]*/
+                    LogError("unable to malloc");
+                }
+                else
+                {
+                    char* name;
+                    if (mallocAndStrcpy_s(&name, fileName) != 0)
+                    {
+                        LogError("unable to mallocAndStrcpy_s");
+                        free(result);
+                        result = NULL;
+                    }
+                    else
+                    {
+                        result->name = name;
+                        result->pace = ((pace != NULL) && (strcmp(pace, "fast") == 0)) ? REPLAY_PACE_FAST : REPLAY_PACE_ORIGINAL;
+                        result->from = (uint64_t)from;
+                    }
+                }
+            }
+            json_value_free(json);
+        }
+    }
+    return result;
+}
+
+static void Replay_FreeConfiguration(void* configuration)
+{
+    if (configuration != NULL)
+    {
+        REPLAY_CONFIG* config = (REPLAY_CONFIG*)configuration;
+        free((char*)config->name);
+        free(config);
+    }
+}
+
+static MODULE_HANDLE Replay_Create(BROKER_HANDLE broker, const void* configuration)
+{
+    REPLAY_HANDLE_DATA* result;
+    const REPLAY_CONFIG* config = (const REPLAY_CONFIG*)configuration;
+    /*Codes_SRS_REPLAY_31_006: [ If `broker`, `configuration` or `configuration->name` is NULL then `Replay_Create` shall fail and return NULL. ]*/
+    if (
+        (broker == NULL) ||
+        (config == NULL) ||
+        (config->name == NULL)
+        )
+    {
+        LogError("invalid arg broker=%p configuration=%p", broker, configuration);
+        result = NULL;
+    }
+    else if ((result = (REPLAY_HANDLE_DATA*)malloc(sizeof(REPLAY_HANDLE_DATA))) == NULL)
+    {
+        /*Codes_SRS_REPLAY_31_007: [ If `Replay_Create` encounters an internal failure it shall fail and return NULL. ]*/
+        LogError("unable to malloc");
+    }
+    else
+    {
+        (void)memset(result, 0, sizeof(REPLAY_HANDLE_DATA));
+        result->broker = broker;
+        result->pace = config->pace;
+        result->from = config->from;
+        result->running = true;
+        if (mallocAndStrcpy_s(&result->name, config->name) != 0)
+        {
+            LogError("unable to mallocAndStrcpy_s");
+            free(result);
+            result = NULL;
+        }
+        else if ((result->clock = tickcounter_create()) == NULL)
+        {
+            LogError("unable to tickcounter_create");
+            free(result->name);
+            free(result);
+            result = NULL;
+        }
+        else if ((result->lock = Lock_Init()) == NULL)
+        {
+            LogError("unable to Lock_Init");
+            tickcounter_destroy(result->clock);
+            free(result->name);
+            free(result);
+            result = NULL;
+        }
+        else if ((result->stopping = Condition_Init()) == NULL)
+        {
+            LogError("unable to Condition_Init");
+            (void)Lock_Deinit(result->lock);
+            tickcounter_destroy(result->clock);
+            free(result->name);
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            /*Codes_SRS_REPLAY_31_008: [ `Replay_Create` shall keep the settings of `configuration` and return a non-NULL handle; the messages are published once the module is started. ]*/
+        }
+    }
+    return result;
+}
+
+static void Replay_Start(MODULE_HANDLE module)
+{
+    if (module == NULL)
+    {
+        LogError("invalid arg module=%p", module);
+    }
+    else
+    {
+        REPLAY_HANDLE_DATA* handleData = (REPLAY_HANDLE_DATA*)module;
+        /*Codes_SRS_REPLAY_31_013: [ `Replay_Start` shall start a thread publishing the messages of the record log. ]*/
+        if (ThreadAPI_Create(&handleData->thread, REPLAY_thread, handleData) != THREADAPI_OK)
+        {
+            LogError("unable to ThreadAPI_Create");
+            handleData->thread = NULL;
+        }
+    }
+}
+
+static void Replay_Receive(MODULE_HANDLE module, MESSAGE_HANDLE message)
+{
+    /*Codes_SRS_REPLAY_31_014: [ `Replay_Receive` shall ignore the messages it receives. ]*/
+    (void)module;
+    (void)message;
+}
+
+static void Replay_Destroy(MODULE_HANDLE module)
+{
+    if (module != NULL)
+    {
+        REPLAY_HANDLE_DATA* handleData = (REPLAY_HANDLE_DATA*)module;
+
+        /*Codes_SRS_REPLAY_31_015: [ `Replay_Destroy` shall stop the thread, without publishing the messages not yet published, and free the resources of the module. ]*/
+        if (Lock(handleData->lock) != LOCK_OK)
+        {
+            LogError("unable to lock");
+        }
+        else
+        {
+            handleData->running = false;
+            (void)Condition_Post(handleData->stopping);
+            (void)Unlock(handleData->lock);
+        }
+
+        if (handleData->thread != NULL)
+        {
+            int threadResult;
+            if (ThreadAPI_Join(handleData->thread, &threadResult) != THREADAPI_OK)
+            {
+                LogError("unable to ThreadAPI_Join");
+            }
+        }
+
+        Condition_Deinit(handleData->stopping);
+        (void)Lock_Deinit(handleData->lock);
+        tickcounter_destroy(handleData->clock);
+        free(handleData->name);
+        free(handleData);
+    }
+}
+
+int Replay_GetCounters(MODULE_HANDLE module, REPLAY_COUNTERS* counters)
+{
+    int result;
+    /*Codes_SRS_REPLAY_31_016: [ If `module` or `counters` is NULL then `Replay_GetCounters` shall fail and return a non-zero value. ]*/
+    if (
+        (module == NULL) ||
+        (counters == NULL)
+        )
+    {
+        LogError("invalid arg module=%p counters=%p", module, counters);
+        result = __LINE__;
+    }
+    else
+    {
+        REPLAY_HANDLE_DATA* handleData = (REPLAY_HANDLE_DATA*)module;
+        if (Lock(handleData->lock) != LOCK_OK)
+        {
+            LogError("unable to lock");
+            result = __LINE__;
+        }
+        else
+        {
+            /*Codes_SRS_REPLAY_31_017: [ `Replay_GetCounters` shall copy the counters of the module into `counters` and return 0. ]*/
+            *counters = handleData->counters;
+            (void)Unlock(handleData->lock);
+            result = 0;
+        }
+    }
+    return result;
+}
+
+/*
+ *    Required for all modules:  the public API and the designated implementation functions.
+ */
+static const MODULE_API_1 Replay_APIS_all =
+{
+    {MODULE_API_VERSION_1},
+
+    Replay_ParseConfigurationFromJson,
+    Replay_FreeConfiguration,
+    Replay_Create,
+    Replay_Destroy,
+    Replay_Receive,
+    Replay_Start
+};
+
+#ifdef BUILD_MODULE_TYPE_STATIC
+MODULE_EXPORT const MODULE_API* MODULE_STATIC_GETAPI(REPLAY_MODULE)(MODULE_API_VERSION gateway_api_version)
+#else
+MODULE_EXPORT const MODULE_API* Module_GetApi(MODULE_API_VERSION gateway_api_version)
+#endif
+{
+    (void)gateway_api_version;
+    return (const MODULE_API *)&Replay_APIS_all;
+}
@@ -0,0 +1,837 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include "testrunnerswitcher.h"
+#include "micromock.h"
+#include "micromockcharstararenullterminatedstrings.h"
+
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/tickcounter.h"
+#include "module.h"
+#include "module_access.h"
+#include "message.h"
+#include "broker.h"
+#include "replay.h"
+#include "record_log.h"
+
+#include <parson.h>
+
+extern "C" int mallocAndStrcpy_s(char** destination, const char*source);
+
+#define GBALLOC_H
+extern "C" int gballoc_init(void);
+extern "C" void gballoc_deinit(void);
+extern "C" void* gballoc_malloc(size_t size);
+extern "C" void* gballoc_calloc(size_t nmemb, size_t size);
+extern "C" void* gballoc_realloc(void* ptr, size_t size);
+extern "C" void gballoc_free(void* ptr);
+
+namespace BASEIMPLEMENTATION
+{
+
+#define Lock(x) (LOCK_OK + gballocState - gballocState) /*compiler warning about constant in if condition*/
+#define Unlock(x) (LOCK_OK + gballocState - gballocState)
+#define Lock_Init() (LOCK_HANDLE)0x42
+#define Lock_Deinit(x) (LOCK_OK + gballocState - gballocState)
+#include "gballoc.c"
+#undef Lock
+#undef Unlock
+#undef Lock_Init
+#undef Lock_Deinit
+
+};
+
+static MICROMOCK_MUTEX_HANDLE g_testByTest;
+static MICROMOCK_GLOBAL_SEMAPHORE_HANDLE g_dllByDll;
+
+/*these are simple cached variables*/
+static pfModule_ParseConfigurationFromJson Replay_ParseConfigurationFromJson = NULL; /*gets assigned in TEST_SUITE_INITIALIZE*/
+static pfModule_FreeConfiguration Replay_FreeConfiguration = NULL; /*gets assigned in TEST_SUITE_INITIALIZE*/
+static pfModule_Create Replay_Create = NULL; /*gets assigned in TEST_SUITE_INITIALIZE*/
+static pfModule_Destroy Replay_Destroy = NULL; /*gets assigned in TEST_SUITE_INITIALIZE*/
+static pfModule_Receive Replay_Receive = NULL; /*gets assigned in TEST_SUITE_INITIALIZE*/
+static pfModule_Start Replay_Start = NULL; /*gets assigned in TEST_SUITE_INITIALIZE*/
+
+#define VALID_CONFIG_STRING "{\"filename\":\"capture\"}"
+#define TEST_READER (RECORD_LOG_READER_HANDLE)0x4242
+#define TEST_FROM 1250
+
+static BROKER_HANDLE validBrokerHandle = (BROKER_HANDLE)0x1;
+static MESSAGE_HANDLE validMessageHandle = (MESSAGE_HANDLE)0x032;
+
+static REPLAY_CONFIG validConfig = { "capture", REPLAY_PACE_FAST, 0 };
+static REPLAY_CONFIG originalConfig = { "capture", REPLAY_PACE_ORIGINAL, 0 };
+
+/*the records of the log read by RecordLog_Next, a record holding 0 is not a message*/
+typedef struct TEST_RECORD_TAG
+{
+    unsigned char content;
+    uint64_t time;
+} TEST_RECORD;
+
+static const TEST_RECORD testRecords[] =
+{
+    { 1, 1000 },
+    { 2, 1250 },
+    { 3, 1600 }
+};
+static const TEST_RECORD* records;
+static size_t recordCount;
+static size_t recordsRead;
+
+/*what the thread published, in order*/
+static unsigned char published[10];
+static size_t publishedCount;
+
+/*the milliseconds each Broker_Publish takes*/
+static tickcounter_ms_t publishTicks;
+static tickcounter_ms_t currentTicks;
+
+/*the timeouts of the waits for the time of a message*/
+static int waits[10];
+static size_t waitCount;
+
+/*Replay_Start starts the thread, the tests run it*/
+static THREAD_START_FUNC threadFunction;
+static void* threadArgument;
+
+TYPED_MOCK_CLASS(CReplayMocks, CGlobalMock)
+{
+public:
+    //parson
+    MOCK_STATIC_METHOD_1(, JSON_Value*, json_parse_string, const char *, string)
+        JSON_Value* value = NULL;
+        if (string != NULL)
+        {
+            value = (JSON_Value*)BASEIMPLEMENTATION::gballoc_malloc(1);
+        }
+    MOCK_METHOD_END(JSON_Value*, value);
+
+    MOCK_STATIC_METHOD_1(, JSON_Object*, json_value_get_object, const JSON_Value*, value)
+        JSON_Object* object = NULL;
+        if (value != NULL)
+        {
+            object = (JSON_Object*)0x42;
+        }
+    MOCK_METHOD_END(JSON_Object*, object);
+
+    MOCK_STATIC_METHOD_2(, const char*, json_object_get_string, const JSON_Object*, object, const char*, name)
+    MOCK_METHOD_END(const char*, (strcmp(name, "filename") == 0) ? "capture" : NULL);
+
+    MOCK_STATIC_METHOD_2(, double, json_object_get_number, const JSON_Object*, object, const char*, name)
+    MOCK_METHOD_END(double, 0);
+
+    MOCK_STATIC_METHOD_1(, void, json_value_free, JSON_Value*, value)
+        BASEIMPLEMENTATION::gballoc_free(value);
+    MOCK_VOID_METHOD_END();
+
+    //memory
+    MOCK_STATIC_METHOD_1(, void*, gballoc_malloc, size_t, size)
+        void* result2 = BASEIMPLEMENTATION::gballoc_malloc(size);
+    MOCK_METHOD_END(void*, result2);
+
+    MOCK_STATIC_METHOD_1(, void, gballoc_free, void*, ptr)
+        BASEIMPLEMENTATION::gballoc_free(ptr);
+    MOCK_VOID_METHOD_END()
+
+    // crt_abstractions.h
+    MOCK_STATIC_METHOD_2(, int, mallocAndStrcpy_s, char**, destination, const char*, source)
+        int r;
+        if (source == NULL)
+        {
+            *destination = NULL;
+            r = 1;
+        }
+        else
+        {
+            *destination = (char*)BASEIMPLEMENTATION::gballoc_malloc(strlen(source) + 1);
+            strcpy(*destination, source);
+            r = 0;
+        }
+    MOCK_METHOD_END(int, r)
+
+    // tickcounter.h
+    MOCK_STATIC_METHOD_0(, TICK_COUNTER_HANDLE, tickcounter_create)
+    MOCK_METHOD_END(TICK_COUNTER_HANDLE, (TICK_COUNTER_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1))
+
+    MOCK_STATIC_METHOD_1(, void, tickcounter_destroy, TICK_COUNTER_HANDLE, tick_counter)
+        BASEIMPLEMENTATION::gballoc_free(tick_counter);
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_2(, int, tickcounter_get_current_ms, TICK_COUNTER_HANDLE, tick_counter, tickcounter_ms_t*, current_ms)
+        *current_ms = currentTicks;
+    MOCK_METHOD_END(int, 0)
+
+    // lock.h, condition.h, threadapi.h
+    MOCK_STATIC_METHOD_0(, LOCK_HANDLE, Lock_Init)
+    MOCK_METHOD_END(LOCK_HANDLE, (LOCK_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1))
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Lock, LOCK_HANDLE, lock)
+    MOCK_METHOD_END(LOCK_RESULT, LOCK_OK)
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Unlock, LOCK_HANDLE, lock)
+    MOCK_METHOD_END(LOCK_RESULT, LOCK_OK)
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Lock_Deinit, LOCK_HANDLE, lock)
+        BASEIMPLEMENTATION::gballoc_free(lock);
+    MOCK_METHOD_END(LOCK_RESULT, LOCK_OK)
+
+    MOCK_STATIC_METHOD_0(, COND_HANDLE, Condition_Init)
+    MOCK_METHOD_END(COND_HANDLE, (COND_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1))
+
+    MOCK_STATIC_METHOD_1(, COND_RESULT, Condition_Post, COND_HANDLE, handle)
+    MOCK_METHOD_END(COND_RESULT, COND_OK)
+
+    /*nobody posts the condition during the tests, every wait times out*/
+    MOCK_STATIC_METHOD_3(, COND_RESULT, Condition_Wait, COND_HANDLE, handle, LOCK_HANDLE, lock, int, timeout_milliseconds)
+        if (waitCount < sizeof(waits) / sizeof(waits[0]))
+        {
+            waits[waitCount++] = timeout_milliseconds;
+        }
+        currentTicks += timeout_milliseconds;
+    MOCK_METHOD_END(COND_RESULT, COND_TIMEOUT)
+
+    MOCK_STATIC_METHOD_1(, void, Condition_Deinit, COND_HANDLE, handle)
+        BASEIMPLEMENTATION::gballoc_free(handle);
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_3(, THREADAPI_RESULT, ThreadAPI_Create, THREAD_HANDLE*, threadHandle, THREAD_START_FUNC, func, void*, arg)
+        *threadHandle = (THREAD_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1);
+        threadFunction = func;
+        threadArgument = arg;
+    MOCK_METHOD_END(THREADAPI_RESULT, THREADAPI_OK)
+
+    /*Replay_Destroy has asked the thread to stop, a thread not run yet runs now*/
+    MOCK_STATIC_METHOD_2(, THREADAPI_RESULT, ThreadAPI_Join, THREAD_HANDLE, threadHandle, int*, res)
+        if (threadFunction != NULL)
+        {
+            *res = threadFunction(threadArgument);
+            threadFunction = NULL;
+        }
+        BASEIMPLEMENTATION::gballoc_free(threadHandle);
+    MOCK_METHOD_END(THREADAPI_RESULT, THREADAPI_OK)
+
+    // record_log.h
+    MOCK_STATIC_METHOD_1(, RECORD_LOG_READER_HANDLE, RecordLog_OpenReader, const char*, name)
+        recordsRead = 0;
+    MOCK_METHOD_END(RECORD_LOG_READER_HANDLE, TEST_READER)
+
+    MOCK_STATIC_METHOD_1(, void, RecordLog_CloseReader, RECORD_LOG_READER_HANDLE, reader)
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_2(, int, RecordLog_Seek, RECORD_LOG_READER_HANDLE, reader, uint64_t, time)
+        while ((recordsRead < recordCount) && (records[recordsRead].time < time))
+        {
+            recordsRead++;
+        }
+    MOCK_METHOD_END(int, 0)
+
+    MOCK_STATIC_METHOD_4(, int, RecordLog_Next, RECORD_LOG_READER_HANDLE, reader, const unsigned char**, record, size_t*, size, uint64_t*, time)
+        if (recordsRead == recordCount)
+        {
+            *record = NULL;
+        }
+        else
+        {
+            *record = &records[recordsRead].content;
+            *size = sizeof(records[recordsRead].content);
+            *time = records[recordsRead].time;
+            recordsRead++;
+        }
+    MOCK_METHOD_END(int, 0)
+
+    // message.h, broker.h
+    MOCK_STATIC_METHOD_2(, MESSAGE_HANDLE, Message_CreateFromByteArray, const unsigned char*, source, int32_t, size)
+        MESSAGE_HANDLE result2 = NULL;
+        if ((size == 1) && (source[0] != 0))
+        {
+            result2 = (MESSAGE_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1);
+            *(unsigned char*)result2 = source[0];
+        }
+    MOCK_METHOD_END(MESSAGE_HANDLE, result2)
+
+    MOCK_STATIC_METHOD_1(, void, Message_Destroy, MESSAGE_HANDLE, message)
+        BASEIMPLEMENTATION::gballoc_free(message);
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_3(, BROKER_RESULT, Broker_Publish, BROKER_HANDLE, broker, MODULE_HANDLE, source, MESSAGE_HANDLE, message)
+        if (publishedCount < sizeof(published) / sizeof(published[0]))
+        {
+            published[publishedCount++] = *(unsigned char*)message;
+        }
+        currentTicks += publishTicks;
+    MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
+};
+
+DECLARE_GLOBAL_MOCK_METHOD_1(CReplayMocks, , JSON_Value*, json_parse_string, const char *, string);
+DECLARE_GLOBAL_MOCK_METHOD_1(CReplayMocks, , JSON_Object*, json_value_get_object, const JSON_Value*, value);
+DECLARE_GLOBAL_MOCK_METHOD_2(CReplayMocks, , const char*, json_object_get_string, const JSON_Object*, object, const char*, name);
+DECLARE_GLOBAL_MOCK_METHOD_2(CReplayMocks, , double, json_object_get_number, const JSON_Object*, object, const char*, name);
+DECLARE_GLOBAL_MOCK_METHOD_1(CReplayMocks, , void, json_value_free, JSON_Value*, value);
+
+DECLARE_GLOBAL_MOCK_METHOD_1(CReplayMocks, , void*, gballoc_malloc, size_t, size);
+DECLARE_GLOBAL_MOCK_METHOD_1(CReplayMocks, , void, gballoc_free, void*, ptr);
+DECLARE_GLOBAL_MOCK_METHOD_2(CReplayMocks, , int, mallocAndStrcpy_s, char**, destination, const char*, source);
+
+DECLARE_GLOBAL_MOCK_METHOD_0(CReplayMocks, , TICK_COUNTER_HANDLE, tickcounter_create);
+DECLARE_GLOBAL_MOCK_METHOD_1(CReplayMocks, , void, tickcounter_destroy, TICK_COUNTER_HANDLE, tick_counter);
+DECLARE_GLOBAL_MOCK_METHOD_2(CReplayMocks, , int, tickcounter_get_current_ms, TICK_COUNTER_HANDLE, tick_counter, tickcounter_ms_t*, current_ms);
+
+DECLARE_GLOBAL_MOCK_METHOD_0(CReplayMocks, , LOCK_HANDLE, Lock_Init);
+DECLARE_GLOBAL_MOCK_METHOD_1(CReplayMocks, , LOCK_RESULT, Lock, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_1(CReplayMocks, , LOCK_RESULT, Unlock, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_1(CReplayMocks, , LOCK_RESULT, Lock_Deinit, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_0(CReplayMocks, , COND_HANDLE, Condition_Init);
+DECLARE_GLOBAL_MOCK_METHOD_1(CReplayMocks, , COND_RESULT, Condition_Post, COND_HANDLE, handle);
+DECLARE_GLOBAL_MOCK_METHOD_3(CReplayMocks, , COND_RESULT, Condition_Wait, COND_HANDLE, handle, LOCK_HANDLE, lock, int, timeout_milliseconds);
+DECLARE_GLOBAL_MOCK_METHOD_1(CReplayMocks, , void, Condition_Deinit, COND_HANDLE, handle);
+DECLARE_GLOBAL_MOCK_METHOD_3(CReplayMocks, , THREADAPI_RESULT, ThreadAPI_Create, THREAD_HANDLE*, threadHandle, THREAD_START_FUNC, func, void*, arg);
+DECLARE_GLOBAL_MOCK_METHOD_2(CReplayMocks, , THREADAPI_RESULT, ThreadAPI_Join, THREAD_HANDLE, threadHandle, int*, res);
+
+DECLARE_GLOBAL_MOCK_METHOD_1(CReplayMocks, , RECORD_LOG_READER_HANDLE, RecordLog_OpenReader, const char*, name);
+DECLARE_GLOBAL_MOCK_METHOD_1(CReplayMocks, , void, RecordLog_CloseReader, RECORD_LOG_READER_HANDLE, reader);
+DECLARE_GLOBAL_MOCK_METHOD_2(CReplayMocks, , int, RecordLog_Seek, RECORD_LOG_READER_HANDLE, reader, uint64_t, time);
+DECLARE_GLOBAL_MOCK_METHOD_4(CReplayMocks, , int, RecordLog_Next, RECORD_LOG_READER_HANDLE, reader, const unsigned char**, record, size_t*, size, uint64_t*, time);
+
+DECLARE_GLOBAL_MOCK_METHOD_2(CReplayMocks, , MESSAGE_HANDLE, Message_CreateFromByteArray, const unsigned char*, source, int32_t, size);
+DECLARE_GLOBAL_MOCK_METHOD_1(CReplayMocks, , void, Message_Destroy, MESSAGE_HANDLE, message);
+DECLARE_GLOBAL_MOCK_METHOD_3(CReplayMocks, , BROKER_RESULT, Broker_Publish, BROKER_HANDLE, broker, MODULE_HANDLE, source, MESSAGE_HANDLE, message);
+
+/*starts a module with config and runs its thread to the end of the log*/
+static MODULE_HANDLE runReplay(const REPLAY_CONFIG* config)
+{
+    MODULE_HANDLE result = Replay_Create(validBrokerHandle, config);
+    ASSERT_IS_NOT_NULL(result);
+    Replay_Start(result);
+    ASSERT_IS_NOT_NULL((void*)threadFunction);
+    (void)threadFunction(threadArgument);
+    threadFunction = NULL;
+    return result;
+}
+
+BEGIN_TEST_SUITE(replay_ut)
+
+    TEST_SUITE_INITIALIZE(TestClassInitialize)
+    {
+        TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+        g_testByTest = MicroMockCreateMutex();
+        ASSERT_IS_NOT_NULL(g_testByTest);
+
+        const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+        Replay_ParseConfigurationFromJson = MODULE_PARSE_CONFIGURATION_FROM_JSON(apis);
+        Replay_FreeConfiguration = MODULE_FREE_CONFIGURATION(apis);
+        Replay_Create = MODULE_CREATE(apis);
+        Replay_Destroy = MODULE_DESTROY(apis);
+        Replay_Receive = MODULE_RECEIVE(apis);
+        Replay_Start = MODULE_START(apis);
+    }
+
+    TEST_SUITE_CLEANUP(TestClassCleanup)
+    {
+        MicroMockDestroyMutex(g_testByTest);
+        TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    }
+
+    TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+    {
+        if (!MicroMockAcquireMutex(g_testByTest))
+        {
+            ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+        }
+
+        records = testRecords;
+        recordCount = sizeof(testRecords) / sizeof(testRecords[0]);
+        recordsRead = 0;
+        publishedCount = 0;
+        publishTicks = 0;
+        currentTicks = 5000;
+        waitCount = 0;
+        threadFunction = NULL;
+        threadArgument = NULL;
+    }
+
+    TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+    {
+        if (!MicroMockReleaseMutex(g_testByTest))
+        {
+            ASSERT_FAIL("failure in test framework at ReleaseMutex");
+        }
+    }
+
+    /*Tests_SRS_REPLAY_31_001: [ If `configuration` is NULL then `Replay_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+    TEST_FUNCTION(Replay_ParseConfigurationFromJson_with_NULL_configuration_fails)
+    {
+        ///arrange
+        CReplayMocks mocks;
+
+        ///act
+        auto result = Replay_ParseConfigurationFromJson(NULL);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_REPLAY_31_002: [ If `configuration` is not a JSON object holding the string "filename" then `Replay_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+    TEST_FUNCTION(Replay_ParseConfigurationFromJson_fails_without_filename)
+    {
+        ///arrange
+        CReplayMocks mocks;
+
+        STRICT_EXPECTED_CALL(mocks, json_parse_string(VALID_CONFIG_STRING));
+        STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "filename"))
+            .IgnoreArgument(1)
+            .SetReturn((const char*)NULL);
+        STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        auto result = Replay_ParseConfigurationFromJson(VALID_CONFIG_STRING);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_REPLAY_31_003: [ `Replay_ParseConfigurationFromJson` shall set `pace` to `REPLAY_PACE_FAST` when the string "pace" is "fast", and to `REPLAY_PACE_ORIGINAL` when it is "original" or missing, and `from` to the number "from", or 0 when it is missing. ]*/
+    TEST_FUNCTION(Replay_ParseConfigurationFromJson_happy_path_defaults)
+    {
+        ///arrange
+        CReplayMocks mocks;
+
+        STRICT_EXPECTED_CALL(mocks, json_parse_string(VALID_CONFIG_STRING));
+        STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "filename"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "pace"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "from"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(REPLAY_CONFIG)));
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "capture"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        auto result = Replay_ParseConfigurationFromJson(VALID_CONFIG_STRING);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(result);
+        ASSERT_ARE_EQUAL(char_ptr, "capture", ((REPLAY_CONFIG*)result)->name);
+        ASSERT_ARE_EQUAL(int, (int)REPLAY_PACE_ORIGINAL, (int)((REPLAY_CONFIG*)result)->pace);
+        ASSERT_IS_TRUE(((REPLAY_CONFIG*)result)->from == 0);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Replay_FreeConfiguration(result);
+    }
+
+    /*Tests_SRS_REPLAY_31_003: [ `Replay_ParseConfigurationFromJson` shall set `pace` to `REPLAY_PACE_FAST` when the string "pace" is "fast", and to `REPLAY_PACE_ORIGINAL` when it is "original" or missing, and `from` to the number "from", or 0 when it is missing. ]*/
+    TEST_FUNCTION(Replay_ParseConfigurationFromJson_sets_pace_and_from)
+    {
+        ///arrange
+        CNiceCallComparer<CReplayMocks> mocks;
+
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "pace"))
+            .IgnoreArgument(1)
+            .SetReturn("fast");
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "from"))
+            .IgnoreArgument(1)
+            .SetReturn(1479859200000.0);
+
+        ///act
+        auto result = Replay_ParseConfigurationFromJson(VALID_CONFIG_STRING);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(result);
+        ASSERT_ARE_EQUAL(int, (int)REPLAY_PACE_FAST, (int)((REPLAY_CONFIG*)result)->pace);
+        ASSERT_IS_TRUE(((REPLAY_CONFIG*)result)->from == 1479859200000ULL);
+
+        ///cleanup
+        Replay_FreeConfiguration(result);
+    }
+
+    /*Tests_SRS_REPLAY_31_004: [ If "pace" is not "original" or "fast", or "from" is negative, then `Replay_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+    TEST_FUNCTION(Replay_ParseConfigurationFromJson_fails_when_pace_is_unknown)
+    {
+        ///arrange
+        CNiceCallComparer<CReplayMocks> mocks;
+
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "pace"))
+            .IgnoreArgument(1)
+            .SetReturn("slow");
+
+        ///act
+        auto result = Replay_ParseConfigurationFromJson(VALID_CONFIG_STRING);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+    }
+
+    /*Tests_SRS_REPLAY_31_005: [ If `Replay_ParseConfigurationFromJson` encounters an internal failure it shall fail and return NULL. ]*/
+    TEST_FUNCTION(Replay_ParseConfigurationFromJson_fails_when_mallocAndStrcpy_s_fails)
+    {
+        ///arrange
+        CNiceCallComparer<CReplayMocks> mocks;
+
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .SetFailReturn(__LINE__);
+
+        ///act
+        auto result = Replay_ParseConfigurationFromJson(VALID_CONFIG_STRING);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+    }
+
+    /*Tests_SRS_REPLAY_31_006: [ If `broker`, `configuration` or `configuration->name` is NULL then `Replay_Create` shall fail and return NULL. ]*/
+    TEST_FUNCTION(Replay_Create_with_NULL_broker_fails)
+    {
+        ///arrange
+        CReplayMocks mocks;
+
+        ///act
+        auto result = Replay_Create(NULL, &validConfig);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_REPLAY_31_006: [ If `broker`, `configuration` or `configuration->name` is NULL then `Replay_Create` shall fail and return NULL. ]*/
+    TEST_FUNCTION(Replay_Create_with_NULL_name_fails)
+    {
+        ///arrange
+        CReplayMocks mocks;
+        REPLAY_CONFIG config = { NULL, REPLAY_PACE_FAST, 0 };
+
+        ///act
+        auto result = Replay_Create(validBrokerHandle, &config);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_REPLAY_31_008: [ `Replay_Create` shall keep the settings of `configuration` and return a non-NULL handle; the messages are published once the module is started. ]*/
+    TEST_FUNCTION(Replay_Create_happy_path)
+    {
+        ///arrange
+        CReplayMocks mocks;
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is the handle*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "capture"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, tickcounter_create());
+        STRICT_EXPECTED_CALL(mocks, Lock_Init());
+        STRICT_EXPECTED_CALL(mocks, Condition_Init());
+
+        ///act
+        auto result = Replay_Create(validBrokerHandle, &validConfig);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Replay_Destroy(result);
+    }
+
+    /*Tests_SRS_REPLAY_31_007: [ If `Replay_Create` encounters an internal failure it shall fail and return NULL. ]*/
+    TEST_FUNCTION(Replay_Create_fails_when_Condition_Init_fails)
+    {
+        ///arrange
+        CReplayMocks mocks;
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is the handle*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "capture"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, tickcounter_create());
+        STRICT_EXPECTED_CALL(mocks, Lock_Init());
+        STRICT_EXPECTED_CALL(mocks, Condition_Init())
+            .SetFailReturn((COND_HANDLE)NULL);
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*the name and the handle*/
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(2);
+
+        ///act
+        auto result = Replay_Create(validBrokerHandle, &validConfig);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_REPLAY_31_013: [ `Replay_Start` shall start a thread publishing the messages of the record log. ]*/
+    TEST_FUNCTION(Replay_Start_starts_the_thread)
+    {
+        ///arrange
+        CReplayMocks mocks;
+        auto module = Replay_Create(validBrokerHandle, &validConfig);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, module))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+
+        ///act
+        Replay_Start(module);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_IS_NOT_NULL((void*)threadFunction);
+
+        ///cleanup
+        threadFunction = NULL;
+        Replay_Destroy(module);
+    }
+
+    /*Tests_SRS_REPLAY_31_009: [ The thread shall open a reader of the record log named `name` and, when `from` is not 0, seek it to `from`. ]*/
+    /*Tests_SRS_REPLAY_31_011: [ The thread shall create a message from every record with `Message_CreateFromByteArray`, publish it to the broker and destroy it, counting the records which are not messages and the messages which cannot be published. ]*/
+    /*Tests_SRS_REPLAY_31_012: [ The thread shall close the reader and set `finished` once every record is read, the log cannot be read, or the module is being destroyed. ]*/
+    TEST_FUNCTION(Replay_thread_publishes_every_record_in_order)
+    {
+        ///arrange
+        CNiceCallComparer<CReplayMocks> mocks;
+        REPLAY_COUNTERS counters;
+
+        STRICT_EXPECTED_CALL(mocks, RecordLog_OpenReader("capture"));
+        STRICT_EXPECTED_CALL(mocks, RecordLog_CloseReader(TEST_READER));
+
+        ///act
+        auto module = runReplay(&validConfig);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 3, publishedCount);
+        ASSERT_ARE_EQUAL(int, 1, published[0]);
+        ASSERT_ARE_EQUAL(int, 2, published[1]);
+        ASSERT_ARE_EQUAL(int, 3, published[2]);
+        ASSERT_ARE_EQUAL(size_t, 0, waitCount);
+        ASSERT_ARE_EQUAL(int, 0, Replay_GetCounters(module, &counters));
+        ASSERT_ARE_EQUAL(size_t, 3, counters.published);
+        ASSERT_IS_TRUE(counters.finished);
+
+        ///cleanup
+        Replay_Destroy(module);
+    }
+
+    /*Tests_SRS_REPLAY_31_009: [ The thread shall open a reader of the record log named `name` and, when `from` is not 0, seek it to `from`. ]*/
+    TEST_FUNCTION(Replay_thread_seeks_to_from)
+    {
+        ///arrange
+        CNiceCallComparer<CReplayMocks> mocks;
+        REPLAY_CONFIG config = { "capture", REPLAY_PACE_FAST, TEST_FROM };
+
+        STRICT_EXPECTED_CALL(mocks, RecordLog_Seek(TEST_READER, TEST_FROM));
+
+        ///act
+        auto module = runReplay(&config);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 2, publishedCount);
+        ASSERT_ARE_EQUAL(int, 2, published[0]);
+
+        ///cleanup
+        Replay_Destroy(module);
+    }
+
+    /*Tests_SRS_REPLAY_31_010: [ With `REPLAY_PACE_ORIGINAL` the thread shall publish every message as long after the first one as it was logged after it, and keep the most it was late in `behindMaxMilliseconds`; with `REPLAY_PACE_FAST` it shall not wait. ]*/
+    TEST_FUNCTION(Replay_thread_with_original_pace_waits_for_the_time_of_every_message)
+    {
+        ///arrange
+        CNiceCallComparer<CReplayMocks> mocks;
+        REPLAY_COUNTERS counters;
+
+        ///act
+        auto module = runReplay(&originalConfig);
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, 3, publishedCount);
+        ASSERT_ARE_EQUAL(size_t, 2, waitCount);
+        ASSERT_ARE_EQUAL(int, 250, waits[0]);
+        ASSERT_ARE_EQUAL(int, 350, waits[1]);
+        ASSERT_ARE_EQUAL(int, 0, Replay_GetCounters(module, &counters));
+        ASSERT_IS_TRUE(counters.behindMaxMilliseconds == 0);
+
+        ///cleanup
+        Replay_Destroy(module);
+    }
+
+    /*Tests_SRS_REPLAY_31_010: [ With `REPLAY_PACE_ORIGINAL` the thread shall publish every message as long after the first one as it was logged after it, and keep the most it was late in `behindMaxMilliseconds`; with `REPLAY_PACE_FAST` it shall not wait. ]*/
+    TEST_FUNCTION(Replay_thread_with_original_pace_counts_how_late_the_messages_are)
+    {
+        ///arrange
+        CNiceCallComparer<CReplayMocks> mocks;
+        REPLAY_COUNTERS counters;
+        publishTicks = 400; /*the second message is due 250ms after the first, the third 600ms after*/
+
+        ///act
+        auto module = runReplay(&originalConfig);
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, 3, publishedCount);
+        ASSERT_ARE_EQUAL(size_t, 0, waitCount);
+        ASSERT_ARE_EQUAL(int, 0, Replay_GetCounters(module, &counters));
+        ASSERT_IS_TRUE(counters.behindMaxMilliseconds == 200);
+
+        ///cleanup
+        Replay_Destroy(module);
+    }
+
+    /*Tests_SRS_REPLAY_31_011: [ The thread shall create a message from every record with `Message_CreateFromByteArray`, publish it to the broker and destroy it, counting the records which are not messages and the messages which cannot be published. ]*/
+    TEST_FUNCTION(Replay_thread_counts_invalid_records_and_failed_publishes)
+    {
+        ///arrange
+        CNiceCallComparer<CReplayMocks> mocks;
+        REPLAY_COUNTERS counters;
+        static const TEST_RECORD damagedRecords[] = { { 1, 1000 }, { 0, 1100 }, { 3, 1200 } };
+        records = damagedRecords;
+        recordCount = sizeof(damagedRecords) / sizeof(damagedRecords[0]);
+
+        STRICT_EXPECTED_CALL(mocks, Broker_Publish(validBrokerHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreArgument(2)
+            .IgnoreArgument(3)
+            .SetFailReturn(BROKER_ERROR);
+        STRICT_EXPECTED_CALL(mocks, Broker_Publish(validBrokerHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreArgument(2)
+            .IgnoreArgument(3);
+
+        ///act
+        auto module = runReplay(&validConfig);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(int, 0, Replay_GetCounters(module, &counters));
+        ASSERT_ARE_EQUAL(size_t, 1, counters.published);
+        ASSERT_ARE_EQUAL(size_t, 1, counters.publishFailures);
+        ASSERT_ARE_EQUAL(size_t, 1, counters.invalid);
+
+        ///cleanup
+        Replay_Destroy(module);
+    }
+
+    /*Tests_SRS_REPLAY_31_012: [ The thread shall close the reader and set `finished` once every record is read, the log cannot be read, or the module is being destroyed. ]*/
+    TEST_FUNCTION(Replay_thread_finishes_when_the_log_cannot_be_read)
+    {
+        ///arrange
+        CNiceCallComparer<CReplayMocks> mocks;
+        REPLAY_COUNTERS counters;
+
+        STRICT_EXPECTED_CALL(mocks, RecordLog_OpenReader("capture"))
+            .SetFailReturn((RECORD_LOG_READER_HANDLE)NULL);
+
+        ///act
+        auto module = runReplay(&validConfig);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 0, publishedCount);
+        ASSERT_ARE_EQUAL(int, 0, Replay_GetCounters(module, &counters));
+        ASSERT_IS_TRUE(counters.finished);
+
+        ///cleanup
+        Replay_Destroy(module);
+    }
+
+    /*Tests_SRS_REPLAY_31_014: [ `Replay_Receive` shall ignore the messages it receives. ]*/
+    TEST_FUNCTION(Replay_Receive_ignores_the_message)
+    {
+        ///arrange
+        CReplayMocks mocks;
+        auto module = Replay_Create(validBrokerHandle, &validConfig);
+        mocks.ResetAllCalls();
+
+        ///act
+        Replay_Receive(module, validMessageHandle);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Replay_Destroy(module);
+    }
+
+    /*Tests_SRS_REPLAY_31_015: [ `Replay_Destroy` shall stop the thread, without publishing the messages not yet published, and free the resources of the module. ]*/
+    TEST_FUNCTION(Replay_Destroy_stops_the_thread_before_it_publishes)
+    {
+        ///arrange
+        CNiceCallComparer<CReplayMocks> mocks;
+        auto module = Replay_Create(validBrokerHandle, &originalConfig);
+        Replay_Start(module);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Condition_Post(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*the thread runs here, after it is asked to stop*/
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, RecordLog_CloseReader(TEST_READER));
+
+        ///act
+        Replay_Destroy(module);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 0, publishedCount);
+    }
+
+    /*Tests_SRS_REPLAY_31_016: [ If `module` or `counters` is NULL then `Replay_GetCounters` shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(Replay_GetCounters_with_NULL_module_fails)
+    {
+        ///arrange
+        CReplayMocks mocks;
+        REPLAY_COUNTERS counters;
+
+        ///act
+        int result = Replay_GetCounters(NULL, &counters);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_REPLAY_31_017: [ `Replay_GetCounters` shall copy the counters of the module into `counters` and return 0. ]*/
+    TEST_FUNCTION(Replay_GetCounters_before_Start_returns_zeroes)
+    {
+        ///arrange
+        CReplayMocks mocks;
+        REPLAY_COUNTERS counters;
+        auto module = Replay_Create(validBrokerHandle, &validConfig);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        int result = Replay_GetCounters(module, &counters);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(size_t, 0, counters.published);
+        ASSERT_IS_FALSE(counters.finished);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Replay_Destroy(module);
+    }
+
+END_TEST_SUITE(replay_ut)
@@ -2,6 +2,14 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
 
 #include "simulated_device.h"
 #include "azure_c_shared_utility/threadapi.h"
@@ -14,6 +22,14 @@
 
 #include <parson.h>
 
+/*one of the devices a module simulates in load mode*/
+typedef struct SIMULATEDDEVICE_VIRTUAL_TAG
+{
+    char                macAddress[18];
+    MAP_HANDLE          properties; /*the properties of its messages, the timestamps and the sequence number are updated for every message*/
+    uint64_t            sequenceNumber;
+} SIMULATEDDEVICE_VIRTUAL;
+
 typedef struct SIMULATEDDEVICE_DATA_TAG
 {
     BROKER_HANDLE       broker;
@@ -21,14 +37,44 @@ typedef struct SIMULATEDDEVICE_DATA_TAG
     const char *        fakeMacAddress;
     unsigned int        messagePeriod;
     unsigned int        simulatedDeviceRunning : 1;
+    /*load mode, devices is NULL without it*/
+    SIMULATEDDEVICE_VIRTUAL * devices;
+    size_t              deviceCount;
+    double              messagesPerSecond;
+    size_t              burstSize;
+    unsigned int        activeMilliseconds;
+    unsigned int        idleMilliseconds;
+    unsigned char *     payload;
+    size_t              payloadSize;
 } SIMULATEDDEVICE_DATA;
 
+/*the "load" object of the configuration*/
+typedef struct SIMULATEDDEVICE_LOAD_CONFIG_TAG
+{
+    size_t              devices; /*the devices simulated, their MAC addresses follow macAddress*/
+    double              messagesPerSecond; /*the messages of all the devices together*/
+    size_t              burstSize; /*the messages published back to back, the bursts are spaced to keep messagesPerSecond*/
+    unsigned int        activeMilliseconds; /*the messages are published for this long, then none for idleMilliseconds; 0 publishes all the time*/
+    unsigned int        idleMilliseconds;
+    size_t              payloadSize;
+    size_t              propertyCount;
+    char **             propertyNames;
+    char **             propertyTemplates; /*{mac} and {device} are replaced by the MAC address and the index of the device*/
+} SIMULATEDDEVICE_LOAD_CONFIG;
+
 typedef struct SIMULATEDDEVICE_CONFIG_TAG
 {
     char *              macAddress;
     unsigned int        messagePeriod;
+    SIMULATEDDEVICE_LOAD_CONFIG * load; /*NULL for one device sending a temperature every messagePeriod*/
 } SIMULATEDDEVICE_CONFIG;
 
+#define LOAD_DEFAULT_PAYLOAD_SIZE 256
+#define LOAD_SEQUENCE_NUMBER_PROPERTY "sequence number"
+#define LOAD_SENT_TIMESTAMP_PROPERTY "sent timestamp"
+/*the longest the load worker sleeps before it checks whether the module is being destroyed*/
+#define LOAD_MAX_SLEEP_MILLISECONDS 100
+
 static void SimulatedDevice_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE messageHandle)
 {
     // Print the properties & content of the received message
@@ -88,8 +134,20 @@ static void SimulatedDevice_Destroy(MODULE_HANDLE moduleHandle)
         /* Tell thread to stop */
         module_data->simulatedDeviceRunning = 0;
         /* join the thread */
-        ThreadAPI_Join(module_data->simulatedDeviceThread, &result);
+        if (module_data->simulatedDeviceThread != NULL)
+        {
+            ThreadAPI_Join(module_data->simulatedDeviceThread, &result);
+        }
         /* free module data */
+        if (module_data->devices != NULL)
+        {
+            for (size_t i = 0; i < module_data->deviceCount; i++)
+            {
+                Map_Destroy(module_data->devices[i].properties);
+            }
+            free(module_data->devices);
+        }
+        free(module_data->payload);
         free((void*)module_data->fakeMacAddress);
         free(module_data);
     }
@@ -173,6 +231,118 @@ static int simulated_device_worker(void * user_data)
     return 0;
 }
 
+/*microseconds since 1970, the clock of the timestamps the messages carry*/
+static uint64_t load_now_microseconds(void)
+{
+#ifdef WIN32
+    FILETIME now;
+    ULARGE_INTEGER ticks;
+    GetSystemTimeAsFileTime(&now);
+    ticks.LowPart = now.dwLowDateTime;
+    ticks.HighPart = now.dwHighDateTime;
+    /*100 nanoseconds since 1601*/
+    return (ticks.QuadPart - 116444736000000000ULL) / 10;
+#else
+    struct timeval now;
+    (void)gettimeofday(&now, NULL);
+    return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_usec;
+#endif
+}
+
+/*the microseconds after the start at which message k is due, which does not depend on when the messages before it were published*/
+static uint64_t load_schedule(const SIMULATEDDEVICE_DATA* module_data, uint64_t k)
+{
+    double offset = (double)((k / module_data->burstSize) * module_data->burstSize) * 1000000.0 / module_data->messagesPerSecond;
+    if (module_data->activeMilliseconds != 0)
+    {
+        /*the active time is spread over cycles of active then idle time*/
+        double active = module_data->activeMilliseconds * 1000.0;
+        uint64_t cycles = (uint64_t)(offset / active);
+        offset = (double)cycles * (module_data->activeMilliseconds + module_data->idleMilliseconds) * 1000.0 + (offset - (double)cycles * active);
+    }
+    return (uint64_t)offset;
+}
+
+/*publishes the messages of all the devices on a fixed schedule: a message late because the broker was slow does not push back the ones after
+it, and it carries the time it was due, so the latencies measured downstream include the time it waited for its turn*/
+static int simulated_device_load_worker(void * user_data)
+{
+    SIMULATEDDEVICE_DATA* module_data = (SIMULATEDDEVICE_DATA*)user_data;
+    uint64_t started = load_now_microseconds();
+    uint64_t k = 0;
+    uint64_t published = 0;
+    uint64_t failures = 0;
+    uint64_t behindMax = 0;
+
+    while (module_data->simulatedDeviceRunning)
+    {
+        uint64_t due = started + load_schedule(module_data, k);
+        uint64_t now = load_now_microseconds();
+        if (now < due)
+        {
+            uint64_t ahead = (due - now + 999) / 1000;
+            ThreadAPI_Sleep((unsigned int)((ahead > LOAD_MAX_SLEEP_MILLISECONDS) ? LOAD_MAX_SLEEP_MILLISECONDS : ahead));
+        }
+        else
+        {
+            SIMULATEDDEVICE_VIRTUAL* device = &module_data->devices[k % module_data->deviceCount];
+            char dueText[24];
+            char nowText[24];
+            char sequenceText[24];
+            MESSAGE_CONFIG newMessageCfg;
+
+            if (now - due > behindMax)
+            {
+                behindMax = now - due;
+            }
+
+            device->sequenceNumber++;
+            (void)sprintf_s(dueText, sizeof(dueText), "%llu", (unsigned long long)due);
+            (void)sprintf_s(nowText, sizeof(nowText), "%llu", (unsigned long long)now);
+            (void)sprintf_s(sequenceText, sizeof(sequenceText), "%llu", (unsigned long long)device->sequenceNumber);
+            if (
+                (Map_AddOrUpdate(device->properties, GW_TIMESTAMP_PROPERTY, dueText) != MAP_OK) ||
+                (Map_AddOrUpdate(device->properties, LOAD_SENT_TIMESTAMP_PROPERTY, nowText) != MAP_OK) ||
+                (Map_AddOrUpdate(device->properties, LOAD_SEQUENCE_NUMBER_PROPERTY, sequenceText) != MAP_OK)
+                )
+            {
+                LogError("Failed to set the timestamps of the message");
+                failures++;
+            }
+            else
+            {
+                MESSAGE_HANDLE newMessage;
+                newMessageCfg.sourceProperties = device->properties;
+                newMessageCfg.size = module_data->payloadSize;
+                newMessageCfg.source = module_data->payload;
+                if ((newMessage = Message_Create(&newMessageCfg)) == NULL)
+                {
+                    LogError("Failed to create new message");
+                    failures++;
+                }
+                else
+                {
+                    if (Broker_Publish(module_data->broker, (MODULE_HANDLE)module_data, newMessage) != BROKER_OK)
+                    {
+                        LogError("Failed to publish new message");
+                        failures++;
+                    }
+                    else
+                    {
+                        published++;
+                    }
+                    Message_Destroy(newMessage);
+                }
+            }
+            k++;
+        }
+    }
+
+    LogInfo("load of %lu devices: %llu messages published, %llu failed, at most %llu microseconds behind the schedule",
+        (unsigned long)module_data->deviceCount, (unsigned long long)published, (unsigned long long)failures, (unsigned long long)behindMax);
+    return 0;
+}
+
 static void SimulatedDevice_Start(MODULE_HANDLE moduleHandle)
 {
     if (moduleHandle == NULL)
@@ -186,7 +356,7 @@ static void SimulatedDevice_Start(MODULE_HANDLE moduleHandle)
         /* Create a fake data thread.  */
         if (ThreadAPI_Create(
             &(module_data->simulatedDeviceThread),
-            simulated_device_worker,
+            (module_data->devices != NULL) ? simulated_device_load_worker : simulated_device_worker,
             (void*)module_data) != THREADAPI_OK)
         {
             LogError("ThreadAPI_Create failed");
@@ -199,6 +369,164 @@ static void SimulatedDevice_Start(MODULE_HANDLE moduleHandle)
     }
 }
 
+/*the MAC address of virtual device index: the one of the module, read as a 48 bit number, plus index*/
+static int load_device_mac_address(char* destination, const char* macAddress, size_t index)
+{
+    int result;
+    unsigned int bytes[6];
+    if (sscanf(macAddress, "%2x:%2x:%2x:%2x:%2x:%2x", &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5]) != 6)
+    {
+        LogError("macAddress %s is not in canonical form", macAddress);
+        result = __LINE__;
+    }
+    else
+    {
+        uint64_t address = 0;
+        for (size_t i = 0; i < 6; i++)
+        {
+            address = (address << 8) | (bytes[i] & 0xFF);
+        }
+        address += index;
+        (void)sprintf_s(destination, 18, "%02X:%02X:%02X:%02X:%02X:%02X",
+            (unsigned int)((address >> 40) & 0xFF), (unsigned int)((address >> 32) & 0xFF), (unsigned int)((address >> 24) & 0xFF),
+            (unsigned int)((address >> 16) & 0xFF), (unsigned int)((address >> 8) & 0xFF), (unsigned int)(address & 0xFF));
+        result = 0;
+    }
+    return result;
+}
+
+/*copies template to destination with {mac} and {device} replaced, and returns the characters it has, or would have when destination is NULL*/
+static size_t load_expand(char* destination, const char* template, const char* macAddress, const char* indexText)
+{
+    size_t result = 0;
+    while (*template != '\0')
+    {
+        const char* replacement;
+        size_t replacementLength;
+        if (strncmp(template, "{mac}", 5) == 0)
+        {
+            replacement = macAddress;
+            replacementLength = strlen(macAddress);
+            template += 5;
+        }
+        else if (strncmp(template, "{device}", 8) == 0)
+        {
+            replacement = indexText;
+            replacementLength = strlen(indexText);
+            template += 8;
+        }
+        else
+        {
+            replacement = template;
+            replacementLength = 1;
+            template++;
+        }
+
+        if (destination != NULL)
+        {
+            (void)memcpy(destination + result, replacement, replacementLength);
+        }
+        result += replacementLength;
+    }
+    return result;
+}
+
+/*adds the property name to properties, with {mac} and {device} of template replaced*/
+static int load_add_property(MAP_HANDLE properties, const char* name, const char* template, const char* macAddress, size_t index)
+{
+    int result;
+    char indexText[24];
+    char* value;
+
+    (void)sprintf_s(indexText, sizeof(indexText), "%lu", (unsigned long)index);
+    if ((value = (char*)malloc(load_expand(NULL, template, macAddress, indexText) + 1)) == NULL)
+    {
+        LogError("unable to malloc");
+        result = __LINE__;
+    }
+    else
+    {
+        value[load_expand(value, template, macAddress, indexText)] = '\0';
+        if (Map_AddOrUpdate(properties, name, value) != MAP_OK)
+        {
+            LogError("unable to add property %s", name);
+            result = __LINE__;
+        }
+        else
+        {
+            result = 0;
+        }
+        free(value);
+    }
+    return result;
+}
+
+/*creates the virtual devices and the payload of load mode*/
+static int load_create(SIMULATEDDEVICE_DATA* module_data, const SIMULATEDDEVICE_LOAD_CONFIG* load)
+{
+    int result;
+    module_data->messagesPerSecond = load->messagesPerSecond;
+    module_data->burstSize = (load->burstSize == 0) ? 1 : load->burstSize;
+    module_data->activeMilliseconds = load->activeMilliseconds;
+    module_data->idleMilliseconds = load->idleMilliseconds;
+    module_data->payloadSize = load->payloadSize;
+
+    if ((module_data->payload = (unsigned char*)malloc((load->payloadSize == 0) ? 1 : load->payloadSize)) == NULL)
+    {
+        LogError("unable to malloc the payload");
+        result = __LINE__;
+    }
+    else if ((module_data->devices = (SIMULATEDDEVICE_VIRTUAL*)calloc(load->devices, sizeof(SIMULATEDDEVICE_VIRTUAL))) == NULL)
+    {
+        LogError("unable to allocate %lu devices", (unsigned long)load->devices);
+        result = __LINE__;
+    }
+    else
+    {
+        size_t i;
+        /*printable, so that modules logging the content can*/
+        for (i = 0; i < load->payloadSize; i++)
+        {
+            module_data->payload[i] = (unsigned char)('a' + (i % 26));
+        }
+
+        result = 0;
+        for (i = 0; (result == 0) && (i < load->devices); i++)
+        {
+            SIMULATEDDEVICE_VIRTUAL* device = &module_data->devices[i];
+            if (load_device_mac_address(device->macAddress, module_data->fakeMacAddress, i) != 0)
+            {
+                result = __LINE__;
+            }
+            else if ((device->properties = Map_Create(NULL)) == NULL)
+            {
+                LogError("Failed to create message properties");
+                result = __LINE__;
+            }
+            else
+            {
+                module_data->deviceCount = i + 1;
+                if (
+                    (Map_Add(device->properties, GW_SOURCE_PROPERTY, GW_SOURCE_BLE_TELEMETRY) != MAP_OK) ||
+                    (Map_Add(device->properties, GW_MAC_ADDRESS_PROPERTY, device->macAddress) != MAP_OK)
+                    )
+                {
+                    LogError("Failed to set source property");
+                    result = __LINE__;
+                }
+                else
+                {
+                    for (size_t p = 0; (result == 0) && (p < load->propertyCount); p++)
+                    {
+                        result = load_add_property(device->properties, load->propertyNames[p], load->propertyTemplates[p], device->macAddress, i);
+                    }
+                }
+            }
+        }
+    }
+    return result;
+}
+
 static MODULE_HANDLE SimulatedDevice_Create(BROKER_HANDLE broker, const void* configuration)
 {
     SIMULATEDDEVICE_DATA * result;
@@ -211,7 +539,7 @@ static MODULE_HANDLE SimulatedDevice_Create(BROKER_HANDLE broker, const void* co
     else
     {
         /* allocate module data struct */
-        result = (SIMULATEDDEVICE_DATA*)malloc(sizeof(SIMULATEDDEVICE_DATA));
+        result = (SIMULATEDDEVICE_DATA*)calloc(1, sizeof(SIMULATEDDEVICE_DATA));
         if (result == NULL)
         {
             LogError("couldn't allocate memory for BLE Module");
@@ -229,6 +557,8 @@ static MODULE_HANDLE SimulatedDevice_Create(BROKER_HANDLE broker, const void* co
             if (status != 0)
             {
                 LogError("MacAddress did not copy");
+                free(result);
+                result = NULL;
             }
             else
             {
@@ -236,6 +566,12 @@ static MODULE_HANDLE SimulatedDevice_Create(BROKER_HANDLE broker, const void* co
                 result -> messagePeriod = config -> messagePeriod;
                 result->simulatedDeviceThread = NULL;
 
+                if ((config->load != NULL) && (load_create(result, config->load) != 0))
+                {
+                    LogError("unable to create the devices of the load");
+                    SimulatedDevice_Destroy(result);
+                    result = NULL;
+                }
             }
 
         }
@@ -243,6 +579,99 @@ static MODULE_HANDLE SimulatedDevice_Create(BROKER_HANDLE broker, const void* co
     return result;
 }
 
+static void load_free(SIMULATEDDEVICE_LOAD_CONFIG* load)
+{
+    if (load != NULL)
+    {
+        for (size_t i = 0; i < load->propertyCount; i++)
+        {
+            free(load->propertyNames[i]);
+            free(load->propertyTemplates[i]);
+        }
+        free(load->propertyNames);
+        free(load->propertyTemplates);
+        free(load);
+    }
+}
+
+/*reads the "load" object of the configuration*/
+static SIMULATEDDEVICE_LOAD_CONFIG* load_parse(const JSON_Object* load)
+{
+    SIMULATEDDEVICE_LOAD_CONFIG* result;
+    double devices = json_object_get_number(load, "devices");
+    double messagesPerSecond = json_object_get_number(load, "messagesPerSecond");
+    double burstSize = json_object_get_number(load, "burstSize");
+    double activeMilliseconds = json_object_get_number(load, "activeMilliseconds");
+    double idleMilliseconds = json_object_get_number(load, "idleMilliseconds");
+    JSON_Value* payloadSize = json_object_get_value(load, "payloadSize");
+    JSON_Object* properties = json_object_get_object(load, "properties");
+
+    if (
+        (devices < 0) ||
+        (messagesPerSecond <= 0) ||
+        (burstSize < 0) ||
+        (activeMilliseconds < 0) ||
+        (idleMilliseconds < 0) ||
+        ((payloadSize != NULL) && (json_object_get_number(load, "payloadSize") < 0))
+        )
+    {
+        LogError("\"messagesPerSecond\" shall be more than 0, and \"devices\", \"burstSize\", \"activeMilliseconds\", \"idleMilliseconds\" and \"payloadSize\" not negative");
+        result = NULL;
+    }
+    else if ((result = (SIMULATEDDEVICE_LOAD_CONFIG*)calloc(1, sizeof(SIMULATEDDEVICE_LOAD_CONFIG))) == NULL)
+    {
+        LogError("allocation of load configuration failed");
+    }
+    else
+    {
+        size_t count = (properties == NULL) ? 0 : json_object_get_count(properties);
+        result->devices = (devices < 1) ? 1 : (size_t)devices;
+        result->messagesPerSecond = messagesPerSecond;
+        result->burstSize = (size_t)burstSize;
+        result->activeMilliseconds = (unsigned int)activeMilliseconds;
+        result->idleMilliseconds = (unsigned int)idleMilliseconds;
+        result->payloadSize = (payloadSize == NULL) ? LOAD_DEFAULT_PAYLOAD_SIZE : (size_t)json_object_get_number(load, "payloadSize");
+
+        if (
+            (count != 0) &&
+            (
+                ((result->propertyNames = (char**)calloc(count, sizeof(char*))) == NULL) ||
+                ((result->propertyTemplates = (char**)calloc(count, sizeof(char*))) == NULL)
+            )
+            )
+        {
+            LogError("allocation of load properties failed");
+            load_free(result);
+            result = NULL;
+        }
+        else
+        {
+            for (size_t i = 0; (result != NULL) && (i < count); i++)
+            {
+                const char* name = json_object_get_name(properties, i);
+                const char* template = json_object_get_string(properties, name);
+                result->propertyCount = i + 1;
+                if (template == NULL)
+                {
+                    LogError("load property %s is not a string", name);
+                    load_free(result);
+                    result = NULL;
+                }
+                else if (
+                    (mallocAndStrcpy_s(&result->propertyNames[i], name) != 0) ||
+                    (mallocAndStrcpy_s(&result->propertyTemplates[i], template) != 0)
+                    )
+                {
+                    LogError("allocation of load property %s failed", name);
+                    load_free(result);
+                    result = NULL;
+                }
+            }
+        }
+    }
+    return result;
+}
+
 static void * SimulatedDevice_ParseConfigurationFromJson(const char* configuration)
 {
 	SIMULATEDDEVICE_CONFIG * result;
@@ -279,15 +708,23 @@ static void * SimulatedDevice_ParseConfigurationFromJson(const char* configurati
                 else
                 {
                     int period = (int)json_object_get_number(root, "messagePeriod");
-                    if (period <= 0)
+                    JSON_Object* load = json_object_get_object(root, "load");
+                    config.load = NULL;
+                    if ((load == NULL) && (period <= 0))
                     {
                         LogError("Invalid period time specified");
                         result = NULL;
                     }
+                    else if ((load != NULL) && ((config.load = load_parse(load)) == NULL))
+                    {
+                        LogError("Invalid load specified");
+                        result = NULL;
+                    }
                     else
                     {
                         if (mallocAndStrcpy_s(&(config.macAddress), macAddress) != 0)
                         {
+                            load_free(config.load);
                             result = NULL;
                         }
                         else
@@ -296,6 +733,7 @@ static void * SimulatedDevice_ParseConfigurationFromJson(const char* configurati
                             result = malloc(sizeof(SIMULATEDDEVICE_CONFIG));
                             if (result == NULL) {
                                 free(config.macAddress);
+                                load_free(config.load);
                                 LogError("allocation of configuration failed");
                             }
                             else
@@ -318,6 +756,7 @@ void SimulatedDevice_FreeConfiguration(void * configuration)
 	{
         SIMULATEDDEVICE_CONFIG * config = (SIMULATEDDEVICE_CONFIG *)configuration;
         free(config->macAddress);
+        load_free(config->load);
         free(config);
 	}
 }
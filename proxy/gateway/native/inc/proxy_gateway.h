@@ -8,6 +8,7 @@
 
 #include "gateway_export.h"
 #include "module.h"
+#include "broker.h"
 
 #ifdef __cplusplus
   extern "C" {
@@ -15,6 +16,48 @@
 
 typedef struct REMOTE_MODULE_TAG * REMOTE_MODULE_HANDLE;
 
+#define PROXY_GATEWAY_QUEUE_FULL_POLICY_VALUES \
+    PROXY_GATEWAY_QUEUE_FULL_REJECT, \
+    PROXY_GATEWAY_QUEUE_FULL_DROP_OLDEST
+
+/*!
+ * \brief What `Broker_Publish` does when the asynchronous publish queue is full
+ *
+ * `PROXY_GATEWAY_QUEUE_FULL_REJECT` fails the new message with `BROKER_ERROR`.
+ * `PROXY_GATEWAY_QUEUE_FULL_DROP_OLDEST` discards the oldest queued message to
+ * make room for the new one.
+ */
+DEFINE_ENUM(PROXY_GATEWAY_QUEUE_FULL_POLICY, PROXY_GATEWAY_QUEUE_FULL_POLICY_VALUES);
+
+/*!
+ * \brief Completion callback for messages published asynchronously
+ *
+ * Called once for every message accepted by `Broker_Publish`, with `BROKER_OK`
+ * once the message has been handed to the gateway channel, or `BROKER_ERROR` if
+ * it was dropped or could not be sent. The callback may run on the publishing
+ * thread or on the thread servicing the remote module, and must not block.
+ */
+typedef void (*PROXY_GATEWAY_PUBLISH_CALLBACK)(void * context, BROKER_RESULT result);
+
+/*!
+ * \brief Connection tuning for a remote module attached over tcp
+ *
+ * A zero field keeps the nanomsg default or disables the feature.
+ */
+typedef struct PROXY_GATEWAY_TCP_OPTIONS_TAG {
+    /*!
+     * \brief Milliseconds without any control message after which the gateway
+     *        is considered gone: the module is destroyed and the control channel
+     *        re-bound, ready for the gateway to reconnect. It should be a few times
+     *        the gateway's keepalive interval.
+     */
+    unsigned int keepalive_timeout;
+    /*! \brief Send buffer size in bytes (NN_SNDBUF) of the gateway channels */
+    int send_buffer_size;
+    /*! \brief Receive buffer size in bytes (NN_RCVBUF) of the gateway channels */
+    int receive_buffer_size;
+} PROXY_GATEWAY_TCP_OPTIONS;
+
 #include "azure_c_shared_utility/umock_c_prod.h"
 
 /*!
@@ -32,7 +75,9 @@ typedef struct REMOTE_MODULE_TAG * REMOTE_MODULE_HANDLE;
  *                         Only Module_Create, Module_Destroy and Module_Receive
  *                         are mandatory.
  * \param connection_id [in] The unique identifier specified in the Azure IoT
- *                           Gateway JSON configuration
+ *                           Gateway JSON configuration, or a "tcp://" address
+ *                           (e.g. "tcp://0.0.0.0:5555") to accept a gateway
+ *                           running on another node
  *
  * \return A handle to a remote module
  */
@@ -49,6 +94,43 @@ MOCKABLE_FUNCTION(, GATEWAY_EXPORT REMOTE_MODULE_HANDLE, ProxyGateway_Attach, co
  */
 MOCKABLE_FUNCTION(, GATEWAY_EXPORT void, ProxyGateway_Detach, REMOTE_MODULE_HANDLE, remote_module);
 
+/*!
+ * \brief Make `Broker_Publish` asynchronous for a given remote module
+ *
+ * By default `Broker_Publish` serializes and sends each message on the caller's
+ * thread, so a slow gateway stalls the module. Once `ProxyGateway_EnableAsyncPublish`
+ * has been called, `Broker_Publish` only ever attempts a non-blocking send. When the
+ * gateway channel is busy (or not yet connected), the serialized message is stored in
+ * a bounded queue which is drained by `ProxyGateway_DoWork` or the worker thread.
+ *
+ * \param remote_module [in] The handle of the remote module.
+ * \param queue_size [in] The maximum number of messages waiting to be sent.
+ * \param full_policy [in] What to do with a new message when the queue is full.
+ * \param callback [in] Optional function called as each message completes.
+ * \param callback_context [in] Value passed to `callback`.
+ *
+ * \return A result value. 0 indicating success or failure otherwise
+ *
+ * \note Asynchronous publishing cannot be disabled again. Messages still queued when
+ *       `ProxyGateway_Detach` is called are completed with `BROKER_ERROR`.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT int, ProxyGateway_EnableAsyncPublish, REMOTE_MODULE_HANDLE, remote_module, size_t, queue_size, PROXY_GATEWAY_QUEUE_FULL_POLICY, full_policy, PROXY_GATEWAY_PUBLISH_CALLBACK, callback, void *, callback_context);
+
+/*!
+ * \brief Tune the gateway channels of a remote module attached over tcp
+ *
+ * The buffer sizes apply to the control socket right away, and to the message
+ * socket when the gateway next sends a create message. Once `keepalive_timeout`
+ * is set, the ProxyGateway library expects the gateway's keepalive pings and
+ * drops the connection when they stop.
+ *
+ * \param remote_module [in] The handle of the remote module.
+ * \param options [in] The options to apply.
+ *
+ * \return A result value. 0 indicating success or failure otherwise
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT int, ProxyGateway_SetTcpOptions, REMOTE_MODULE_HANDLE, remote_module, const PROXY_GATEWAY_TCP_OPTIONS *, options);
+
 /*!
  * \brief Process transactions for a given remote module.
  *
@@ -91,7 +173,8 @@ MOCKABLE_FUNCTION(, GATEWAY_EXPORT int, ProxyGateway_HaltWorkerThread, REMOTE_MO
  * `ProxyGateway_StartWorkerThread` is a convenience method which gives control of calling
  * `ProxyGateway_DoWork` over to the ProxyGateway library. If `ProxyGateway_StartWorkerThread`
  * has been invoked, then the ProxyGateway library will create a thread to service and deliver
- * messages from the Azure IoT Gateway to the remote module.
+ * messages from the Azure IoT Gateway to the remote module. The thread blocks while no
+ * message is pending, and services every pending message each time it wakes up.
  *
  * \param remote_module [in] The handle of the remote module you wish to detach from
  *                           the Azure IoT Gateway.
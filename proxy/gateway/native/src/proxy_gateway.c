@@ -5,6 +5,7 @@
 #include "broker.h"
 
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -14,11 +15,32 @@
 #include <azure_c_shared_utility/gballoc.h>
 #include <azure_c_shared_utility/lock.h>
 #include <azure_c_shared_utility/threadapi.h>
+#include <azure_c_shared_utility/tickcounter.h>
 #include <azure_c_shared_utility/xlogging.h>
 
 #include "control_message.h"
 #include "gateway.h"
 #include "message.h"
+#include "shm_ring.h"
+
+/* how long Broker_Publish waits for room in a full message ring */
+#define PROXY_GATEWAY_RING_WRITE_TIMEOUT_MS 1000
+
+/* how long the worker thread waits for a message when it has to check the keepalive, or the control channel next to a message ring */
+#define PROXY_GATEWAY_WORKER_WAIT_MS 100
+
+/* nn_poll waits for a message or the halt signal, without timeout */
+#define PROXY_GATEWAY_WAIT_FOREVER -1
+
+/* how long the worker thread waits before retrying a queued publish on a full message ring */
+#define PROXY_GATEWAY_PUBLISH_RETRY_MS 10
+
+/* how many passes of process_pending_messages the worker thread makes before checking for a halt signal again */
+#define PROXY_GATEWAY_WORKER_DRAIN_PASSES 64
+
+#define IPC_URI_HEAD "ipc://"
+#define TCP_URI_HEAD "tcp://"
+#define WAKEUP_URI_FORMAT "inproc://proxy_gateway_wakeup_%p"
 
 typedef enum REMOTE_MODULE_RESULT_TAG {
     REMOTE_MODULE_DETACH = -1,
@@ -46,35 +68,91 @@ invoke_add_module_procedure (
     const char * json_config
 );
 
+int
+flush_publish_queue (
+    REMOTE_MODULE_HANDLE remote_module
+);
+
 int
 process_module_create_message (
     REMOTE_MODULE_HANDLE remote_module,
     const CONTROL_MESSAGE_MODULE_CREATE * message
 );
 
+int
+process_pending_messages (
+    REMOTE_MODULE_HANDLE remote_module
+);
+
 int
 send_control_reply (
     REMOTE_MODULE_HANDLE remote_module,
     uint8_t response
 );
 
+void
+wait_for_messages (
+    REMOTE_MODULE_HANDLE remote_module
+);
+
 int
 worker_thread(
     void * thread_arg
 );
 
+static
+int
+send_control_message (
+    REMOTE_MODULE_HANDLE remote_module,
+    CONTROL_MESSAGE * message
+);
+
 typedef struct MESSAGE_THREAD_TAG {
     bool halt;
     LOCK_HANDLE mutex;
     THREAD_HANDLE thread;
+    // An inproc pair, the halt signal is sent on wakeup_signal and wakes the thread polling wakeup_socket
+    int wakeup_socket;
+    int wakeup_signal;
+    // The message ring the thread is waiting on, to be woken by the halt signal
+    SHM_RING_HANDLE waiting_ring;
 } MESSAGE_THREAD;
 
+typedef struct PUBLISH_QUEUE_ENTRY_TAG {
+    void * buffer;
+    int32_t size;
+} PUBLISH_QUEUE_ENTRY;
+
+typedef struct PUBLISH_QUEUE_TAG {
+    LOCK_HANDLE mutex;
+    PUBLISH_QUEUE_ENTRY * entries;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    PROXY_GATEWAY_QUEUE_FULL_POLICY full_policy;
+    PROXY_GATEWAY_PUBLISH_CALLBACK callback;
+    void * callback_context;
+} PUBLISH_QUEUE;
+
+typedef enum PUBLISH_SEND_RESULT_TAG {
+    PUBLISH_SEND_OK,
+    PUBLISH_SEND_WOULD_BLOCK,
+    PUBLISH_SEND_ERROR
+} PUBLISH_SEND_RESULT;
+
 typedef struct REMOTE_MODULE_TAG {
 	int control_endpoint;
 	int control_socket;
     int message_endpoint;
     int message_socket;
+    SHM_RING_HANDLE message_ring;
+    int32_t message_ring_record_max;
     MESSAGE_THREAD_HANDLE message_thread;
+    PUBLISH_QUEUE * publish_queue;
+    PROXY_GATEWAY_TCP_OPTIONS tcp_options;
+    TICK_COUNTER_HANDLE keepalive_clock;
+    tickcounter_ms_t last_control_message;
+    char control_uri[GATEWAY_CONNECTION_ID_MAX + sizeof(IPC_URI_HEAD)];
     MODULE module;
 } REMOTE_MODULE;
 
@@ -87,6 +165,377 @@ static size_t strnlen_(const char* s, size_t max)
     return i;
 }
 
+static int set_buffer_sizes(int socket, const PROXY_GATEWAY_TCP_OPTIONS * options)
+{
+    int result;
+
+    if ((0 != options->send_buffer_size) && (0 > nn_setsockopt(socket, NN_SOL_SOCKET, NN_SNDBUF, &options->send_buffer_size, sizeof(options->send_buffer_size)))) {
+        LogError("%s: Unable to set the send buffer size!", __FUNCTION__);
+        result = __LINE__;
+    } else if ((0 != options->receive_buffer_size) && (0 > nn_setsockopt(socket, NN_SOL_SOCKET, NN_RCVBUF, &options->receive_buffer_size, sizeof(options->receive_buffer_size)))) {
+        LogError("%s: Unable to set the receive buffer size!", __FUNCTION__);
+        result = __LINE__;
+    } else {
+        result = 0;
+    }
+
+    return result;
+}
+
+static void refresh_keepalive(REMOTE_MODULE_HANDLE remote_module)
+{
+    if (0 != tickcounter_get_current_ms(remote_module->keepalive_clock, &remote_module->last_control_message)) {
+        LogError("%s: Unable to read the keepalive clock!", __FUNCTION__);
+    }
+}
+
+static void check_keepalive(REMOTE_MODULE_HANDLE remote_module)
+{
+    tickcounter_ms_t now;
+
+    if (0 != tickcounter_get_current_ms(remote_module->keepalive_clock, &now)) {
+        LogError("%s: Unable to read the keepalive clock!", __FUNCTION__);
+    } else if ((now - remote_module->last_control_message) >= remote_module->tcp_options.keepalive_timeout) {
+        LogInfo("%s: No control message from the gateway for %u ms, waiting for it to reconnect", __FUNCTION__, (unsigned int)(now - remote_module->last_control_message));
+        remote_module->last_control_message = now;
+
+        if (NULL != remote_module->module.module_handle) {
+            ((MODULE_API_1 *)remote_module->module.module_apis)->Module_Destroy(remote_module->module.module_handle);
+            remote_module->module.module_handle = NULL;
+            disconnect_from_message_channel(remote_module);
+        }
+
+        // A gateway which vanished without closing its connection keeps the pair socket attached, so listen afresh
+        (void)nn_shutdown(remote_module->control_socket, remote_module->control_endpoint);
+        if (0 > (remote_module->control_endpoint = nn_bind(remote_module->control_socket, remote_module->control_uri))) {
+            LogError("%s: Unable to re-bind the gateway control channel!", __FUNCTION__);
+        }
+    }
+}
+
+static int open_wakeup_channel(MESSAGE_THREAD_HANDLE message_thread)
+{
+    int result;
+    char wakeup_uri[64];
+
+    (void)snprintf(wakeup_uri, sizeof(wakeup_uri), WAKEUP_URI_FORMAT, (void *)message_thread);
+    message_thread->wakeup_signal = -1;
+    if (-1 == (message_thread->wakeup_socket = nn_socket(AF_SP, NN_PAIR))) {
+        LogError("%s: Unable to create the wakeup socket!", __FUNCTION__);
+        result = __LINE__;
+    } else if (0 > nn_bind(message_thread->wakeup_socket, wakeup_uri)) {
+        LogError("%s: Unable to bind the wakeup socket!", __FUNCTION__);
+        (void)nn_close(message_thread->wakeup_socket);
+        result = __LINE__;
+    } else if (-1 == (message_thread->wakeup_signal = nn_socket(AF_SP, NN_PAIR))) {
+        LogError("%s: Unable to create the wakeup socket!", __FUNCTION__);
+        (void)nn_close(message_thread->wakeup_socket);
+        result = __LINE__;
+    } else if (0 > nn_connect(message_thread->wakeup_signal, wakeup_uri)) {
+        LogError("%s: Unable to connect the wakeup socket!", __FUNCTION__);
+        (void)nn_close(message_thread->wakeup_signal);
+        (void)nn_close(message_thread->wakeup_socket);
+        result = __LINE__;
+    } else {
+        result = 0;
+    }
+
+    return result;
+}
+
+static void close_wakeup_channel(MESSAGE_THREAD_HANDLE message_thread)
+{
+    (void)nn_close(message_thread->wakeup_signal);
+    (void)nn_close(message_thread->wakeup_socket);
+}
+
+// Publishes the ring the worker thread is about to wait on, unless it was told to halt
+static bool begin_ring_wait(REMOTE_MODULE_HANDLE remote_module)
+{
+    bool result;
+
+    if (NULL == remote_module->message_thread) {
+        result = true;
+    } else if (LOCK_OK != Lock(remote_module->message_thread->mutex)) {
+        LogError("%s: Unable to acquire mutex!", __FUNCTION__);
+        result = false;
+    } else {
+        result = !remote_module->message_thread->halt;
+        if (result) {
+            remote_module->message_thread->waiting_ring = remote_module->message_ring;
+        }
+        (void)Unlock(remote_module->message_thread->mutex);
+    }
+
+    return result;
+}
+
+static void end_ring_wait(REMOTE_MODULE_HANDLE remote_module)
+{
+    if (NULL == remote_module->message_thread) {
+        // not waiting on behalf of the worker thread
+    } else if (LOCK_OK != Lock(remote_module->message_thread->mutex)) {
+        LogError("%s: Unable to acquire mutex!", __FUNCTION__);
+    } else {
+        remote_module->message_thread->waiting_ring = NULL;
+        (void)Unlock(remote_module->message_thread->mutex);
+    }
+}
+
+static void complete_publish(PUBLISH_QUEUE * queue, BROKER_RESULT result)
+{
+    if (NULL != queue->callback) {
+        queue->callback(queue->callback_context, result);
+    }
+}
+
+// Whether a serialized message of size bytes goes through the message ring;
+// the messages too large for it go through the message socket.
+static bool fits_message_ring(REMOTE_MODULE_HANDLE remote_module, int32_t size)
+{
+    return (NULL != remote_module->message_ring && size <= remote_module->message_ring_record_max);
+}
+
+// Serializes a message straight into a record of the message ring, waiting at
+// most timeout_ms for room in the ring.
+static PUBLISH_SEND_RESULT write_message_to_ring(REMOTE_MODULE_HANDLE remote_module, MESSAGE_HANDLE message, int32_t size, unsigned int timeout_ms)
+{
+    PUBLISH_SEND_RESULT result;
+    unsigned char * record;
+
+    if (NULL == (record = ShmRing_BeginWrite(remote_module->message_ring, size, timeout_ms))) {
+        result = PUBLISH_SEND_WOULD_BLOCK;
+    } else if (size != Message_ToByteArray(message, record, size)) {
+        LogError("%s: Unable to serialize a message [%p]", __FUNCTION__, message);
+        ShmRing_CancelWrite(remote_module->message_ring);
+        result = PUBLISH_SEND_ERROR;
+    } else if (0 != ShmRing_EndWrite(remote_module->message_ring)) {
+        LogError("%s: Unable to publish a message to the message ring!", __FUNCTION__);
+        result = PUBLISH_SEND_ERROR;
+    } else {
+        result = PUBLISH_SEND_OK;
+    }
+
+    return result;
+}
+
+// Writes a message to the message ring without blocking, unless messages are
+// queued ahead of it.
+static PUBLISH_SEND_RESULT publish_to_idle_ring(REMOTE_MODULE_HANDLE remote_module, MESSAGE_HANDLE message, int32_t size)
+{
+    PUBLISH_SEND_RESULT result;
+    PUBLISH_QUEUE * queue = remote_module->publish_queue;
+
+    if (LOCK_ERROR == Lock(queue->mutex)) {
+        LogError("%s: Failed to obtain mutex!", __FUNCTION__);
+        result = PUBLISH_SEND_ERROR;
+    } else {
+        if (0 == queue->count) {
+            result = write_message_to_ring(remote_module, message, size, 0);
+        } else {
+            result = PUBLISH_SEND_WOULD_BLOCK;
+        }
+        (void)Unlock(queue->mutex);
+    }
+
+    return result;
+}
+
+// Attempts to send a serialized message without blocking. Unless the channel
+// would block, the nanomsg buffer is consumed whatever the outcome.
+static PUBLISH_SEND_RESULT send_serialized_message(REMOTE_MODULE_HANDLE remote_module, void * buffer, int32_t size)
+{
+    PUBLISH_SEND_RESULT result;
+
+    if (fits_message_ring(remote_module, size)) {
+        unsigned char * record;
+        if (NULL == (record = ShmRing_BeginWrite(remote_module->message_ring, size, 0))) {
+            result = PUBLISH_SEND_WOULD_BLOCK;
+        } else {
+            (void)memcpy(record, buffer, size);
+            if (0 != ShmRing_EndWrite(remote_module->message_ring)) {
+                LogError("%s: Unable to publish a message to the message ring!", __FUNCTION__);
+                result = PUBLISH_SEND_ERROR;
+            } else {
+                result = PUBLISH_SEND_OK;
+            }
+            (void)nn_freemsg(buffer);
+        }
+    } else if (0 > remote_module->message_socket) {
+        // not connected to message channel yet, keep the message until it is
+        result = PUBLISH_SEND_WOULD_BLOCK;
+    } else if (size == nn_send(remote_module->message_socket, &buffer, NN_MSG, NN_DONTWAIT)) {
+        result = PUBLISH_SEND_OK;
+    } else if (EAGAIN == nn_errno()) {
+        result = PUBLISH_SEND_WOULD_BLOCK;
+    } else {
+        LogError("%s: Unable to send a message to the message channel!", __FUNCTION__);
+        (void)nn_freemsg(buffer);
+        result = PUBLISH_SEND_ERROR;
+    }
+
+    return result;
+}
+
+// Sends a message too large for the message ring on the message socket,
+// blocking like the socket channel does.
+static BROKER_RESULT send_message_to_socket(REMOTE_MODULE_HANDLE remote_module, MESSAGE_HANDLE message, int32_t size)
+{
+    BROKER_RESULT result;
+    void * nn_msg;
+
+    if (NULL == (nn_msg = nn_allocmsg(size, 0))) {
+        LogError("%s: Unable to allocate a message [%p]", __FUNCTION__, message);
+        result = BROKER_ERROR;
+    } else if (size != Message_ToByteArray(message, (unsigned char *)nn_msg, size)) {
+        LogError("%s: Unable to serialize a message [%p]", __FUNCTION__, message);
+        (void)nn_freemsg(nn_msg);
+        result = BROKER_ERROR;
+    } else if (size != nn_send(remote_module->message_socket, &nn_msg, NN_MSG, 0)) {
+        LogError("%s: Unable to send a message [%p]", __FUNCTION__, message);
+        (void)nn_freemsg(nn_msg);
+        result = BROKER_ERROR;
+    } else {
+        result = BROKER_OK;
+    }
+
+    return result;
+}
+
+static BROKER_RESULT publish_async(REMOTE_MODULE_HANDLE remote_module, MESSAGE_HANDLE message)
+{
+    BROKER_RESULT result;
+    PUBLISH_QUEUE * queue = remote_module->publish_queue;
+    int32_t msg_size;
+    void * nn_msg;
+    PUBLISH_SEND_RESULT send_result;
+
+    if (0 > (msg_size = Message_ToByteArray(message, NULL, 0))) {
+        LogError("%s: Unable to serialize a message [%p]", __FUNCTION__, message);
+        result = BROKER_ERROR;
+    /* Codes_SRS_PROXY_GATEWAY_31_040: [ If the message channel is a shared memory ring and no message is queued, `Broker_Publish` shall serialize the message directly into a record reserved with `ShmRing_BeginWrite` without waiting, and queue it only if the ring is full. ] */
+    /* Codes_SRS_PROXY_GATEWAY_31_045: [ If the message channel is a shared memory ring, `Broker_Publish` shall send a message larger than `ShmRing_GetMaxRecordSize` on the message socket instead. ] */
+    } else if (fits_message_ring(remote_module, msg_size) && PUBLISH_SEND_WOULD_BLOCK != (send_result = publish_to_idle_ring(remote_module, message, msg_size))) {
+        if (PUBLISH_SEND_OK == send_result) {
+            complete_publish(queue, BROKER_OK);
+            result = BROKER_OK;
+        } else {
+            result = BROKER_ERROR;
+        }
+    /* Codes_SRS_PROXY_GATEWAY_31_015: [ If asynchronous publishing is enabled, `Broker_Publish` shall serialize the message into a buffer allocated with `nn_allocmsg`. ] */
+    } else if (NULL == (nn_msg = nn_allocmsg(msg_size, 0))) {
+        LogError("%s: Unable to allocate a message [%p]", __FUNCTION__, message);
+        result = BROKER_ERROR;
+    } else if (msg_size != Message_ToByteArray(message, (unsigned char *)nn_msg, msg_size)) {
+        LogError("%s: Unable to serialize a message [%p]", __FUNCTION__, message);
+        (void)nn_freemsg(nn_msg);
+        result = BROKER_ERROR;
+    } else if (LOCK_ERROR == Lock(queue->mutex)) {
+        LogError("%s: Failed to obtain mutex!", __FUNCTION__);
+        (void)nn_freemsg(nn_msg);
+        result = BROKER_ERROR;
+    } else {
+        bool dropped_oldest = false;
+
+        /* Codes_SRS_PROXY_GATEWAY_31_016: [ If no message is queued, `Broker_Publish` shall attempt to send the message without blocking. ] */
+        if (0 == queue->count) {
+            send_result = send_serialized_message(remote_module, nn_msg, msg_size);
+        } else {
+            send_result = PUBLISH_SEND_WOULD_BLOCK;
+        }
+
+        if (PUBLISH_SEND_OK == send_result) {
+            result = BROKER_OK;
+        } else if (PUBLISH_SEND_ERROR == send_result) {
+            result = BROKER_ERROR;
+        } else if (queue->count == queue->capacity && PROXY_GATEWAY_QUEUE_FULL_REJECT == queue->full_policy) {
+            /* Codes_SRS_PROXY_GATEWAY_31_018: [ If the queue is full and the policy is `PROXY_GATEWAY_QUEUE_FULL_REJECT`, `Broker_Publish` shall free the message and return `BROKER_ERROR`. ] */
+            LogError("%s: Publish queue is full, message [%p] rejected", __FUNCTION__, message);
+            (void)nn_freemsg(nn_msg);
+            result = BROKER_ERROR;
+        } else {
+            if (queue->count == queue->capacity) {
+                /* Codes_SRS_PROXY_GATEWAY_31_019: [ If the queue is full and the policy is `PROXY_GATEWAY_QUEUE_FULL_DROP_OLDEST`, `Broker_Publish` shall free the oldest queued message and complete it with `BROKER_ERROR`. ] */
+                (void)nn_freemsg(queue->entries[queue->head].buffer);
+                queue->head = (queue->head + 1) % queue->capacity;
+                --queue->count;
+                dropped_oldest = true;
+            }
+            /* Codes_SRS_PROXY_GATEWAY_31_017: [ If the message cannot be sent without blocking, `Broker_Publish` shall append it to the publish queue and return `BROKER_OK`. ] */
+            queue->entries[(queue->head + queue->count) % queue->capacity].buffer = nn_msg;
+            queue->entries[(queue->head + queue->count) % queue->capacity].size = msg_size;
+            ++queue->count;
+            result = BROKER_OK;
+        }
+        (void)Unlock(queue->mutex);
+
+        // Callbacks are made outside the lock, so they may publish
+        if (dropped_oldest) {
+            complete_publish(queue, BROKER_ERROR);
+        }
+        /* Codes_SRS_PROXY_GATEWAY_31_020: [ `Broker_Publish` shall invoke the completion callback with `BROKER_OK` for a message sent immediately, and not invoke it for a message it failed. ] */
+        if (PUBLISH_SEND_OK == send_result) {
+            complete_publish(queue, BROKER_OK);
+        }
+    }
+
+    return result;
+}
+
+static bool publish_queue_is_pending(REMOTE_MODULE_HANDLE remote_module)
+{
+    bool result;
+
+    if (NULL == remote_module->publish_queue) {
+        result = false;
+    } else if (LOCK_ERROR == Lock(remote_module->publish_queue->mutex)) {
+        result = false;
+    } else {
+        result = (0 < remote_module->publish_queue->count);
+        (void)Unlock(remote_module->publish_queue->mutex);
+    }
+
+    return result;
+}
+
+static void fail_publish_queue(REMOTE_MODULE_HANDLE remote_module)
+{
+    PUBLISH_QUEUE * queue = remote_module->publish_queue;
+    size_t messages_failed = 0;
+
+    if (NULL == queue) {
+        // Nothing is queued when publishing is synchronous
+    } else if (LOCK_ERROR == Lock(queue->mutex)) {
+        LogError("%s: Failed to obtain mutex!", __FUNCTION__);
+    } else {
+        for (; 0 < queue->count; --queue->count) {
+            (void)nn_freemsg(queue->entries[queue->head].buffer);
+            queue->head = (queue->head + 1) % queue->capacity;
+            ++messages_failed;
+        }
+        queue->head = 0;
+        (void)Unlock(queue->mutex);
+
+        // Callbacks are made outside the lock, so they may publish
+        for (; 0 < messages_failed; --messages_failed) {
+            complete_publish(queue, BROKER_ERROR);
+        }
+    }
+}
+
+static void destroy_publish_queue(REMOTE_MODULE_HANDLE remote_module)
+{
+    PUBLISH_QUEUE * queue = remote_module->publish_queue;
+
+    // Last chance to deliver what is still queued
+    (void)flush_publish_queue(remote_module);
+    fail_publish_queue(remote_module);
+    (void)Lock_Deinit(queue->mutex);
+    free(queue->entries);
+    free(queue);
+    remote_module->publish_queue = NULL;
+}
+
 REMOTE_MODULE_HANDLE
 ProxyGateway_Attach (
     const MODULE_API * module_apis,
@@ -126,9 +575,9 @@ ProxyGateway_Attach (
         /* Codes_SRS_PROXY_GATEWAY_027_008: [If memory allocation fails for the instance data, then `ProxyGateway_Attach` shall return `NULL`] */
         LogError("%s: Unable to allocate memory!", __FUNCTION__);
     } else {
-        static const size_t ENDPOINT_DECORATION_SIZE = sizeof("ipc://") - 1;
-
-        const size_t control_channel_uri_size = strlen(connection_id) + ENDPOINT_DECORATION_SIZE + 1;
+        /* Codes_SRS_PROXY_GATEWAY_31_026: [If `connection_id` starts with "tcp://", then `ProxyGateway_Attach` shall use it unchanged as the connection string, otherwise it shall prefix it with "ipc://"] */
+        const char * endpoint_decoration = ((0 == strncmp(connection_id, TCP_URI_HEAD, sizeof(TCP_URI_HEAD) - 1)) ? "" : IPC_URI_HEAD);
+        const size_t control_channel_uri_size = strlen(connection_id) + strlen(endpoint_decoration) + 1;
         char * control_channel_uri;
 
         // Transform the connection id into a nanomsg URI
@@ -138,7 +587,7 @@ ProxyGateway_Attach (
             LogError("%s: Unable to allocate memory!", __FUNCTION__);
             free(remote_module);
             remote_module = NULL;
-        } else if (NULL == strcpy(control_channel_uri, "ipc://")) {
+        } else if (NULL == strcpy(control_channel_uri, endpoint_decoration)) {
             LogError("%s: Unable to compose channel uri prefix!", __FUNCTION__);
             free(remote_module);
             remote_module = NULL;
@@ -164,9 +613,13 @@ ProxyGateway_Attach (
                 // Save the module API
                 remote_module->module.module_apis = module_apis;
 
+                // Keep the connection string to listen afresh after a keepalive timeout
+                (void)strcpy(remote_module->control_uri, control_channel_uri);
+
                 // Initialize remaining fields
                 remote_module->message_socket = -1;
                 remote_module->message_endpoint = -1;
+                remote_module->message_ring = NULL;
             }
         }
         /* Codes_SRS_PROXY_GATEWAY_027_015: [`ProxyGateway_Attach` shall release the memory required to formulate the connection string] */
@@ -193,11 +646,17 @@ ProxyGateway_Detach (
             if (NULL != remote_module->message_thread) {
                 /* Codes_SRS_PROXY_GATEWAY_027_060: [If unable to halt the worker thread, `ProxyGateway_Detach` shall forcibly free the memory allocated to the worker thread] */
                 LogError("%s: Unable to gracefully halt worker thread!", __FUNCTION__);
+                close_wakeup_channel(remote_module->message_thread);
                 free(remote_module->message_thread);
                 remote_module->message_thread = NULL;
             }
         }
 
+        if (NULL != remote_module->publish_queue) {
+            /* Codes_SRS_PROXY_GATEWAY_31_023: [If asynchronous publishing is enabled, then `ProxyGateway_Detach` shall attempt to send the queued messages once, complete any message left with `BROKER_ERROR` and free the publish queue] */
+            destroy_publish_queue(remote_module);
+        }
+
         /* Codes_SRS_PROXY_GATEWAY_027_061: [`ProxyGateway_Detach` shall attempt to notify the Azure IoT Gateway of the detachment] */
         (void)send_control_reply(remote_module, (uint8_t)REMOTE_MODULE_DETACH);
 		ThreadAPI_Sleep(1000);
@@ -210,6 +669,10 @@ ProxyGateway_Detach (
         /* Codes_SRS_PROXY_GATEWAY_027_064: [`ProxyGateway_Detach` shall close the Azure IoT Gateway control socket by calling `int nn_close(int s)`] */
         (void)nn_close(remote_module->control_socket);
         remote_module->control_socket = 0;
+        if (NULL != remote_module->keepalive_clock) {
+            /* Codes_SRS_PROXY_GATEWAY_31_034: [`ProxyGateway_Detach` shall destroy the keepalive clock, if any, by calling `void tickcounter_destroy(TICK_COUNTER_HANDLE tick_counter)`] */
+            tickcounter_destroy(remote_module->keepalive_clock);
+        }
         /* Codes_SRS_PROXY_GATEWAY_027_065: [`ProxyGateway_Detach` shall free the remaining memory dedicated to its instance data] */
         free(remote_module);
         remote_module = NULL;
@@ -219,6 +682,97 @@ ProxyGateway_Detach (
 }
 
 
+int
+ProxyGateway_EnableAsyncPublish (
+    REMOTE_MODULE_HANDLE remote_module,
+    size_t queue_size,
+    PROXY_GATEWAY_QUEUE_FULL_POLICY full_policy,
+    PROXY_GATEWAY_PUBLISH_CALLBACK callback,
+    void * callback_context
+) {
+    int result;
+
+    if (NULL == remote_module) {
+        /* Codes_SRS_PROXY_GATEWAY_31_009: [*Prerequisite Check* - If the `remote_module` parameter is `NULL`, then `ProxyGateway_EnableAsyncPublish` shall return a non-zero value] */
+        LogError("%s: NULL parameter - remote_module!", __FUNCTION__);
+        result = __LINE__;
+    } else if (0 == queue_size) {
+        /* Codes_SRS_PROXY_GATEWAY_31_010: [*Prerequisite Check* - If `queue_size` is zero, then `ProxyGateway_EnableAsyncPublish` shall return a non-zero value] */
+        LogError("%s: queue_size must be greater than zero!", __FUNCTION__);
+        result = __LINE__;
+    } else if (NULL != remote_module->publish_queue) {
+        /* Codes_SRS_PROXY_GATEWAY_31_011: [*Prerequisite Check* - If asynchronous publishing is already enabled, then `ProxyGateway_EnableAsyncPublish` shall return a non-zero value] */
+        LogError("%s: Asynchronous publishing is already enabled!", __FUNCTION__);
+        result = __LINE__;
+    /* Codes_SRS_PROXY_GATEWAY_31_012: [`ProxyGateway_EnableAsyncPublish` shall allocate the publish queue and `queue_size` queue entries] */
+    } else if (NULL == (remote_module->publish_queue = (PUBLISH_QUEUE *)calloc(1, sizeof(PUBLISH_QUEUE)))) {
+        /* Codes_SRS_PROXY_GATEWAY_31_013: [If any allocation fails, then `ProxyGateway_EnableAsyncPublish` shall free any previously allocated memory and return a non-zero value] */
+        LogError("%s: Unable to allocate memory!", __FUNCTION__);
+        result = __LINE__;
+    } else if (NULL == (remote_module->publish_queue->entries = (PUBLISH_QUEUE_ENTRY *)malloc(queue_size * sizeof(PUBLISH_QUEUE_ENTRY)))) {
+        LogError("%s: Unable to allocate memory!", __FUNCTION__);
+        free(remote_module->publish_queue);
+        remote_module->publish_queue = NULL;
+        result = __LINE__;
+    /* Codes_SRS_PROXY_GATEWAY_31_014: [`ProxyGateway_EnableAsyncPublish` shall create the queue mutex by calling `LOCK_HANDLE Lock_Init(void)`] */
+    } else if (NULL == (remote_module->publish_queue->mutex = Lock_Init())) {
+        LogError("%s: Unable to create mutex!", __FUNCTION__);
+        free(remote_module->publish_queue->entries);
+        free(remote_module->publish_queue);
+        remote_module->publish_queue = NULL;
+        result = __LINE__;
+    } else {
+        remote_module->publish_queue->capacity = queue_size;
+        remote_module->publish_queue->full_policy = full_policy;
+        remote_module->publish_queue->callback = callback;
+        remote_module->publish_queue->callback_context = callback_context;
+        result = 0;
+    }
+
+    return result;
+}
+
+
+int
+ProxyGateway_SetTcpOptions (
+    REMOTE_MODULE_HANDLE remote_module,
+    const PROXY_GATEWAY_TCP_OPTIONS * options
+) {
+    int result;
+
+    if (NULL == remote_module) {
+        /* Codes_SRS_PROXY_GATEWAY_31_027: [*Prerequisite Check* - If the `remote_module` parameter is `NULL`, then `ProxyGateway_SetTcpOptions` shall return a non-zero value] */
+        LogError("%s: NULL parameter - remote_module!", __FUNCTION__);
+        result = __LINE__;
+    } else if (NULL == options) {
+        /* Codes_SRS_PROXY_GATEWAY_31_028: [*Prerequisite Check* - If the `options` parameter is `NULL`, then `ProxyGateway_SetTcpOptions` shall return a non-zero value] */
+        LogError("%s: NULL parameter - options!", __FUNCTION__);
+        result = __LINE__;
+    /* Codes_SRS_PROXY_GATEWAY_31_029: [`ProxyGateway_SetTcpOptions` shall apply each non-zero buffer size to the control socket by calling `int nn_setsockopt(int s, int level, int option, const void * optval, size_t optvallen)` with `NN_SNDBUF` or `NN_RCVBUF` as `option`] */
+    } else if (0 != set_buffer_sizes(remote_module->control_socket, options)) {
+        /* Codes_SRS_PROXY_GATEWAY_31_030: [If a call to `nn_setsockopt` fails, then `ProxyGateway_SetTcpOptions` shall return a non-zero value] */
+        result = __LINE__;
+    /* Codes_SRS_PROXY_GATEWAY_31_031: [If `keepalive_timeout` is not zero, `ProxyGateway_SetTcpOptions` shall create the keepalive clock, if not created yet, by calling `TICK_COUNTER_HANDLE tickcounter_create(void)`, and start the keepalive period] */
+    } else if ((0 != options->keepalive_timeout) && (NULL == remote_module->keepalive_clock) && (NULL == (remote_module->keepalive_clock = tickcounter_create()))) {
+        /* Codes_SRS_PROXY_GATEWAY_31_032: [If unable to create the keepalive clock, then `ProxyGateway_SetTcpOptions` shall return a non-zero value] */
+        LogError("%s: Unable to create the keepalive clock!", __FUNCTION__);
+        result = __LINE__;
+    } else {
+        if (0 != options->keepalive_timeout) {
+            refresh_keepalive(remote_module);
+        } else if (NULL != remote_module->keepalive_clock) {
+            /* Codes_SRS_PROXY_GATEWAY_31_033: [If `keepalive_timeout` is zero, `ProxyGateway_SetTcpOptions` shall destroy the keepalive clock, if any, by calling `void tickcounter_destroy(TICK_COUNTER_HANDLE tick_counter)`] */
+            tickcounter_destroy(remote_module->keepalive_clock);
+            remote_module->keepalive_clock = NULL;
+        }
+        remote_module->tcp_options = *options;
+        result = 0;
+    }
+
+    return result;
+}
+
+
 void
 ProxyGateway_DoWork (
     REMOTE_MODULE_HANDLE remote_module
@@ -227,91 +781,150 @@ ProxyGateway_DoWork (
         /* Codes_SRS_PROXY_GATEWAY_027_026: [Prerequisite Check - If the `remote_module` parameter is `NULL`, then `ProxyGateway_DoWork` shall do nothing] */
         LogError("%s: NULL parameter - remote_module!", __FUNCTION__);
     } else {
-        int32_t bytes_received;
-        void * control_message = NULL;
+        (void)process_pending_messages(remote_module);
+    }
 
-        /* Codes_SRS_PROXY_GATEWAY_027_027: [Control Channel - `ProxyGateway_DoWork` shall poll the gateway control channel by calling `int nn_recv(int s, void * buf, size_t len, int flags)` with the control socket for `s`, `NULL` for `buf`, `NN_MSG` for `len` and NN_DONTWAIT for `flags`] */
-        if (0 > (bytes_received = nn_recv(remote_module->control_socket, &control_message, NN_MSG, NN_DONTWAIT))) {
-            if (EAGAIN == nn_errno()) {
-                /* Codes_SRS_PROXY_GATEWAY_027_028: [Control Channel - If no message is available, then `ProxyGateway_DoWork` shall abandon the control channel request] */
-            } else {
-                /* Codes_SRS_PROXY_GATEWAY_027_066: [Control Channel - If an error occurred when polling the gateway, then `ProxyGateway_DoWork` shall signal the gateway abandon the control channel request] */
-                LogError("%s: Unexpected error received from the control channel!", __FUNCTION__);
-                (void)send_control_reply(remote_module, (uint8_t)REMOTE_MODULE_GATEWAY_CONNECTION_ERROR);
+    return;
+}
+
+
+int
+process_pending_messages (
+    REMOTE_MODULE_HANDLE remote_module
+) {
+    int messages_received = 0;
+    int32_t bytes_received;
+    void * control_message = NULL;
+
+    /* Codes_SRS_PROXY_GATEWAY_027_027: [Control Channel - `ProxyGateway_DoWork` shall poll the gateway control channel by calling `int nn_recv(int s, void * buf, size_t len, int flags)` with the control socket for `s`, `NULL` for `buf`, `NN_MSG` for `len` and NN_DONTWAIT for `flags`] */
+    if (0 > (bytes_received = nn_recv(remote_module->control_socket, &control_message, NN_MSG, NN_DONTWAIT))) {
+        if (EAGAIN == nn_errno()) {
+            /* Codes_SRS_PROXY_GATEWAY_027_028: [Control Channel - If no message is available, then `ProxyGateway_DoWork` shall abandon the control channel request] */
+            if (NULL != remote_module->keepalive_clock) {
+                /* Codes_SRS_PROXY_GATEWAY_31_035: [Control Channel - If no control message has been received for `keepalive_timeout` milliseconds, then `ProxyGateway_DoWork` shall destroy the module, disconnect from the message channel, and shutdown and re-bind the control channel] */
+                check_keepalive(remote_module);
             }
         } else {
-            CONTROL_MESSAGE * structured_control_message;
+            /* Codes_SRS_PROXY_GATEWAY_027_066: [Control Channel - If an error occurred when polling the gateway, then `ProxyGateway_DoWork` shall signal the gateway abandon the control channel request] */
+            LogError("%s: Unexpected error received from the control channel!", __FUNCTION__);
+            (void)send_control_reply(remote_module, (uint8_t)REMOTE_MODULE_GATEWAY_CONNECTION_ERROR);
+        }
+    } else {
+        CONTROL_MESSAGE * structured_control_message;
+        ++messages_received;
 
-            /* Codes_SRS_PROXY_GATEWAY_027_029: [Control Channel - If a control message was received, then `ProxyGateway_DoWork` will parse that message by calling `CONTROL_MESSAGE * ControlMessage_CreateFromByteArray(const unsigned char * source, size_t size)` with the buffer received from `nn_recv` as `source` and return value from `nn_recv` as `size`] */
-            if (NULL == (structured_control_message = ControlMessage_CreateFromByteArray((const unsigned char *)control_message, bytes_received))) {
-                /* Codes_SRS_PROXY_GATEWAY_027_030: [Control Channel - If unable to parse the control message, then `ProxyGateway_DoWork` shall signal the gateway, free any previously allocated memory and abandon the control channel request] */
-                LogError("%s: Unable to parse control message!", __FUNCTION__);
-                (void)send_control_reply(remote_module, (uint8_t)REMOTE_MODULE_GATEWAY_CONNECTION_ERROR);
-            } else {
-                // Route control channel messages to appropriate functions
-                switch (structured_control_message->type) {
-                  case CONTROL_MESSAGE_TYPE_MODULE_CREATE:
-                    /* Codes_SRS_PROXY_GATEWAY_027_031: [Control Channel - If the message type is CONTROL_MESSAGE_TYPE_MODULE_CREATE, then `ProxyGateway_DoWork` shall process the create message] */
-                    if (0 != process_module_create_message(remote_module, (const CONTROL_MESSAGE_MODULE_CREATE *)structured_control_message)) {
-                        LogError("%s: Unable to process create message!", __FUNCTION__);
-                    }
-                    break;
-                  case CONTROL_MESSAGE_TYPE_MODULE_START:
-                    /* Codes_SRS_PROXY_GATEWAY_027_032: [Control Channel - If the message type is CONTROL_MESSAGE_TYPE_MODULE_START and `Module_Start` was provided, then `ProxyGateway_DoWork` shall call `void Module_Start(MODULE_HANDLE moduleHandle)`] */
-                    if (((MODULE_API_1 *)remote_module->module.module_apis)->Module_Start) {
-                        ((MODULE_API_1 *)remote_module->module.module_apis)->Module_Start(remote_module->module.module_handle);
-                    }
-                    break;
-                  case CONTROL_MESSAGE_TYPE_MODULE_DESTROY:
-                    /* Codes_SRS_PROXY_GATEWAY_027_033: [Control Channel - If the message type is CONTROL_MESSAGE_TYPE_MODULE_DESTROY, then `ProxyGateway_DoWork` shall call `void Module_Destroy(MODULE_HANDLE moduleHandle)`] */
-                    ((MODULE_API_1 *)remote_module->module.module_apis)->Module_Destroy(remote_module->module.module_handle);
-                    remote_module->module.module_handle = NULL;
-                    /* Codes_SRS_PROXY_GATEWAY_027_034: [Control Channel - If the message type is CONTROL_MESSAGE_TYPE_MODULE_DESTROY, then `ProxyGateway_DoWork` shall disconnect from the message channel] */
-                    disconnect_from_message_channel(remote_module);
-                    break;
-                  default: LogError("ERROR: REMOTE_MODULE - Received unsupported message type! [%d]\n", structured_control_message->type); break;
-                }
-                /* Codes_SRS_PROXY_GATEWAY_027_035: [Control Channel - `ProxyGateway_DoWork` shall free the resources held by the parsed control message by calling `void ControlMessage_Destroy(CONTROL_MESSAGE * message)` using the parsed control message as `message`] */
-                ControlMessage_Destroy(structured_control_message);
-            }
-            /* Codes_SRS_PROXY_GATEWAY_027_036: [Control Channel - `ProxyGateway_DoWork` shall free the resources held by the gateway message by calling `int nn_freemsg(void * msg)` with the resulting buffer from the previous call to `nn_recv`] */
-            (void)nn_freemsg(control_message);
+        if (NULL != remote_module->keepalive_clock) {
+            /* Codes_SRS_PROXY_GATEWAY_31_036: [Control Channel - If the keepalive clock exists, then `ProxyGateway_DoWork` shall restart the keepalive period on every control message by calling `int tickcounter_get_current_ms(TICK_COUNTER_HANDLE tick_counter, tickcounter_ms_t * current_ms)`] */
+            refresh_keepalive(remote_module);
         }
 
-        /* Codes_SRS_PROXY_GATEWAY_027_037: [Message Channel - `ProxyGateway_DoWork` shall not check for messages, if the message socket is not available] */
-        if ( 0 > remote_module->message_socket ) {
-            // not connected to message channel
+        /* Codes_SRS_PROXY_GATEWAY_027_029: [Control Channel - If a control message was received, then `ProxyGateway_DoWork` will parse that message by calling `CONTROL_MESSAGE * ControlMessage_CreateFromByteArray(const unsigned char * source, size_t size)` with the buffer received from `nn_recv` as `source` and return value from `nn_recv` as `size`] */
+        if (NULL == (structured_control_message = ControlMessage_CreateFromByteArray((const unsigned char *)control_message, bytes_received))) {
+            /* Codes_SRS_PROXY_GATEWAY_027_030: [Control Channel - If unable to parse the control message, then `ProxyGateway_DoWork` shall signal the gateway, free any previously allocated memory and abandon the control channel request] */
+            LogError("%s: Unable to parse control message!", __FUNCTION__);
+            (void)send_control_reply(remote_module, (uint8_t)REMOTE_MODULE_GATEWAY_CONNECTION_ERROR);
         } else {
-            void * module_message = NULL;
-
-            /* Codes_SRS_PROXY_GATEWAY_027_038: [Message Channel - `ProxyGateway_DoWork` shall poll the gateway message channel by calling `int nn_recv(int s, void * buf, size_t len, int flags)` with each message socket for `s`, `NULL` for `buf`, `NN_MSG` for `len` and NN_DONTWAIT for `flags`] */
-            if (0 > (bytes_received = nn_recv(remote_module->message_socket, &module_message, NN_MSG, NN_DONTWAIT))) {
-                /* Codes_SRS_PROXY_GATEWAY_027_039: [Message Channel - If no message is available or an error occurred, then `ProxyGateway_DoWork` shall abandon the message channel request] */
-                if (EAGAIN == nn_errno()) {
-                    // no messages available at this time
-                } else {
-                    LogError("%s: Unexpected error received from the message channel!", __FUNCTION__);
+            // Route control channel messages to appropriate functions
+            switch (structured_control_message->type) {
+              case CONTROL_MESSAGE_TYPE_MODULE_CREATE:
+                /* Codes_SRS_PROXY_GATEWAY_027_031: [Control Channel - If the message type is CONTROL_MESSAGE_TYPE_MODULE_CREATE, then `ProxyGateway_DoWork` shall process the create message] */
+                if (0 != process_module_create_message(remote_module, (const CONTROL_MESSAGE_MODULE_CREATE *)structured_control_message)) {
+                    LogError("%s: Unable to process create message!", __FUNCTION__);
                 }
-            } else {
-                MESSAGE_HANDLE structured_module_message;
-
-                /* Codes_SRS_PROXY_GATEWAY_027_040: [Message Channel - If a module message was received, then `ProxyGateway_DoWork` will parse that message by calling `MESSAGE_HANDLE Message_CreateFromByteArray(const unsigned char * source, int32_t size)` with the buffer received from `nn_recv` as `source` and return value from `nn_recv` as `size`] */
-                if (NULL == (structured_module_message = Message_CreateFromByteArray((const unsigned char *)module_message, bytes_received))) {
-                    /* Codes_SRS_PROXY_GATEWAY_027_041: [Message Channel - If unable to parse the module message, then `ProxyGateway_DoWork` shall free any previously allocated memory and abandon the message channel request] */
-                    LogError("%s: Unable to parse control message!", __FUNCTION__);
-                } else {
-                    /* Codes_SRS_PROXY_GATEWAY_027_042: [Message Channel - `ProxyGateway_DoWork` shall pass the structured message to the module by calling `void Module_Receive(MODULE_HANDLE moduleHandle)` using the parsed message as `moduleHandle`] */
-                    ((MODULE_API_1 *)remote_module->module.module_apis)->Module_Receive(remote_module->module.module_handle, structured_module_message);
-                    /* Codes_SRS_PROXY_GATEWAY_027_043: [Message Channel - `ProxyGateway_DoWork` shall free the resources held by the parsed module message by calling `void Message_Destroy(MESSAGE_HANDLE * message)` using the parsed module message as `message`] */
+                break;
+              case CONTROL_MESSAGE_TYPE_MODULE_START:
+                /* Codes_SRS_PROXY_GATEWAY_027_032: [Control Channel - If the message type is CONTROL_MESSAGE_TYPE_MODULE_START and `Module_Start` was provided, then `ProxyGateway_DoWork` shall call `void Module_Start(MODULE_HANDLE moduleHandle)`] */
+                if (((MODULE_API_1 *)remote_module->module.module_apis)->Module_Start) {
+                    ((MODULE_API_1 *)remote_module->module.module_apis)->Module_Start(remote_module->module.module_handle);
+                }
+                break;
+              case CONTROL_MESSAGE_TYPE_MODULE_DESTROY:
+                /* Codes_SRS_PROXY_GATEWAY_027_033: [Control Channel - If the message type is CONTROL_MESSAGE_TYPE_MODULE_DESTROY, then `ProxyGateway_DoWork` shall call `void Module_Destroy(MODULE_HANDLE moduleHandle)`] */
+                ((MODULE_API_1 *)remote_module->module.module_apis)->Module_Destroy(remote_module->module.module_handle);
+                remote_module->module.module_handle = NULL;
+                /* Codes_SRS_PROXY_GATEWAY_027_034: [Control Channel - If the message type is CONTROL_MESSAGE_TYPE_MODULE_DESTROY, then `ProxyGateway_DoWork` shall disconnect from the message channel] */
+                disconnect_from_message_channel(remote_module);
+                break;
+              case CONTROL_MESSAGE_TYPE_MODULE_PING:
+                /* Codes_SRS_PROXY_GATEWAY_31_037: [Control Channel - If the message type is CONTROL_MESSAGE_TYPE_MODULE_PING, then `ProxyGateway_DoWork` shall send the message back to the gateway] */
+                (void)send_control_message(remote_module, structured_control_message);
+                break;
+              default: LogError("ERROR: REMOTE_MODULE - Received unsupported message type! [%d]\n", structured_control_message->type); break;
+            }
+            /* Codes_SRS_PROXY_GATEWAY_027_035: [Control Channel - `ProxyGateway_DoWork` shall free the resources held by the parsed control message by calling `void ControlMessage_Destroy(CONTROL_MESSAGE * message)` using the parsed control message as `message`] */
+            ControlMessage_Destroy(structured_control_message);
+        }
+        /* Codes_SRS_PROXY_GATEWAY_027_036: [Control Channel - `ProxyGateway_DoWork` shall free the resources held by the gateway message by calling `int nn_freemsg(void * msg)` with the resulting buffer from the previous call to `nn_recv`] */
+        (void)nn_freemsg(control_message);
+    }
+
+    if (NULL != remote_module->message_ring) {
+        const unsigned char * record = NULL;
+
+        /* Codes_SRS_PROXY_GATEWAY_31_001: [Message Channel - If the message channel is a shared memory ring, then `ProxyGateway_DoWork` shall poll the ring by calling `int32_t ShmRing_BeginRead(SHM_RING_HANDLE ring, const unsigned char ** data, unsigned int timeout_ms)` with a zero `timeout_ms`] */
+        if (0 < (bytes_received = ShmRing_BeginRead(remote_module->message_ring, &record, 0))) {
+            MESSAGE_HANDLE structured_module_message;
+            ++messages_received;
+
+            /* Codes_SRS_PROXY_GATEWAY_31_002: [Message Channel - `ProxyGateway_DoWork` shall copy the record out of the ring by parsing it with `MESSAGE_HANDLE Message_CreateFromByteArray(const unsigned char * source, int32_t size)`, release it by calling `int ShmRing_EndRead(SHM_RING_HANDLE ring)`, and pass the structured message to the module unless the release failed] */
+            structured_module_message = Message_CreateFromByteArray(record, bytes_received);
+            if (0 != ShmRing_EndRead(remote_module->message_ring)) {
+                // another module host attached to the ring and takes the record
+                LogError("%s: The message ring was taken over, dropping the record!", __FUNCTION__);
+                if (NULL != structured_module_message) {
                     Message_Destroy(structured_module_message);
                 }
-                /* Codes_SRS_PROXY_GATEWAY_027_044: [Message Channel - `ProxyGateway_DoWork` shall free the resources held by the gateway message by calling `int nn_freemsg(void * msg)` with the resulting buffer from the previous call to `nn_recv`] */
-                (void)nn_freemsg(module_message);
+            } else if (NULL == structured_module_message) {
+                LogError("%s: Unable to parse module message!", __FUNCTION__);
+            } else {
+                ((MODULE_API_1 *)remote_module->module.module_apis)->Module_Receive(remote_module->module.module_handle, structured_module_message);
+                Message_Destroy(structured_module_message);
             }
+        } else if (0 > bytes_received) {
+            LogError("%s: Unexpected error received from the message ring!", __FUNCTION__);
         }
     }
 
-    return;
+    /* Codes_SRS_PROXY_GATEWAY_027_037: [Message Channel - `ProxyGateway_DoWork` shall not check for messages, if the message socket is not available] */
+    /* Codes_SRS_PROXY_GATEWAY_31_046: [Message Channel - If the message channel is a shared memory ring, then `ProxyGateway_DoWork` shall also poll the message socket, which carries the messages too large for the ring] */
+    if ( 0 > remote_module->message_socket ) {
+        // not connected to message channel
+    } else {
+        void * module_message = NULL;
+
+        /* Codes_SRS_PROXY_GATEWAY_027_038: [Message Channel - `ProxyGateway_DoWork` shall poll the gateway message channel by calling `int nn_recv(int s, void * buf, size_t len, int flags)` with each message socket for `s`, `NULL` for `buf`, `NN_MSG` for `len` and NN_DONTWAIT for `flags`] */
+        if (0 > (bytes_received = nn_recv(remote_module->message_socket, &module_message, NN_MSG, NN_DONTWAIT))) {
+            /* Codes_SRS_PROXY_GATEWAY_027_039: [Message Channel - If no message is available or an error occurred, then `ProxyGateway_DoWork` shall abandon the message channel request] */
+            if (EAGAIN == nn_errno()) {
+                // no messages available at this time
+            } else {
+                LogError("%s: Unexpected error received from the message channel!", __FUNCTION__);
+            }
+        } else {
+            MESSAGE_HANDLE structured_module_message;
+            ++messages_received;
+
+            /* Codes_SRS_PROXY_GATEWAY_027_040: [Message Channel - If a module message was received, then `ProxyGateway_DoWork` will parse that message by calling `MESSAGE_HANDLE Message_CreateFromByteArray(const unsigned char * source, int32_t size)` with the buffer received from `nn_recv` as `source` and return value from `nn_recv` as `size`] */
+            if (NULL == (structured_module_message = Message_CreateFromByteArray((const unsigned char *)module_message, bytes_received))) {
+                /* Codes_SRS_PROXY_GATEWAY_027_041: [Message Channel - If unable to parse the module message, then `ProxyGateway_DoWork` shall free any previously allocated memory and abandon the message channel request] */
+                LogError("%s: Unable to parse control message!", __FUNCTION__);
+            } else {
+                /* Codes_SRS_PROXY_GATEWAY_027_042: [Message Channel - `ProxyGateway_DoWork` shall pass the structured message to the module by calling `void Module_Receive(MODULE_HANDLE moduleHandle)` using the parsed message as `moduleHandle`] */
+                ((MODULE_API_1 *)remote_module->module.module_apis)->Module_Receive(remote_module->module.module_handle, structured_module_message);
+                /* Codes_SRS_PROXY_GATEWAY_027_043: [Message Channel - `ProxyGateway_DoWork` shall free the resources held by the parsed module message by calling `void Message_Destroy(MESSAGE_HANDLE * message)` using the parsed module message as `message`] */
+                Message_Destroy(structured_module_message);
+            }
+            /* Codes_SRS_PROXY_GATEWAY_027_044: [Message Channel - `ProxyGateway_DoWork` shall free the resources held by the gateway message by calling `int nn_freemsg(void * msg)` with the resulting buffer from the previous call to `nn_recv`] */
+            (void)nn_freemsg(module_message);
+        }
+    }
+
+    /* Codes_SRS_PROXY_GATEWAY_31_024: [`ProxyGateway_DoWork` shall send the messages queued by an asynchronous `Broker_Publish` by calling `int flush_publish_queue(REMOTE_MODULE_HANDLE remote_module)`] */
+    if (NULL != remote_module->publish_queue) {
+        messages_received += flush_publish_queue(remote_module);
+    }
+
+    return messages_received;
 }
 
 
@@ -339,7 +952,14 @@ ProxyGateway_HaltWorkerThread (
         int thread_exit_result = -1;
         // Signal the message thread
         remote_module->message_thread->halt = true;
-        
+        /* Codes_SRS_PROXY_GATEWAY_31_041: [`ProxyGateway_HaltWorkerThread` shall wake the worker thread by sending a message on its wakeup socket with `int nn_send(int s, const void * buf, size_t len, int flags)`, and by calling `void ShmRing_Wake(SHM_RING_HANDLE ring)` on the message ring it waits on, if any] */
+        if (0 > nn_send(remote_module->message_thread->wakeup_signal, "", 1, NN_DONTWAIT)) {
+            LogError("%s: Unable to wake the message thread!", __FUNCTION__);
+        }
+        if (NULL != remote_module->message_thread->waiting_ring) {
+            ShmRing_Wake(remote_module->message_thread->waiting_ring);
+        }
+
         /* Codes_SRS_PROXY_GATEWAY_027_049: [`ProxyGateway_HaltWorkerThread` shall release the thread mutex upon signalling by calling `LOCK_RESULT Unlock(LOCK_HANDLE handle)`] */
         if (LOCK_OK != Unlock(remote_module->message_thread->mutex)) {
             /* Codes_SRS_PROXY_GATEWAY_027_050: [If unable to release the mutex, then `ProxyGateway_HaltWorkerThread` shall return a non-zero value] */
@@ -354,6 +974,8 @@ ProxyGateway_HaltWorkerThread (
             /* Codes_SRS_PROXY_GATEWAY_027_053: [`ProxyGateway_HaltWorkerThread` shall free the thread mutex by calling `LOCK_RESULT Lock_Deinit(LOCK_HANDLE handle)`] */
             /* Codes_SRS_PROXY_GATEWAY_027_054: [If unable to free the thread mutex, then `ProxyGateway_HaltWorkerThread` shall ignore the result and continue processing] */
             (void)Lock_Deinit(remote_module->message_thread->mutex);
+            /* Codes_SRS_PROXY_GATEWAY_31_042: [`ProxyGateway_HaltWorkerThread` shall close the wakeup sockets by calling `int nn_close(int s)`] */
+            close_wakeup_channel(remote_module->message_thread);
             /* Codes_SRS_PROXY_GATEWAY_027_055: [`ProxyGateway_HaltWorkerThread` shall free the memory allocated to the thread details] */
             free(remote_module->message_thread);
             remote_module->message_thread = NULL;
@@ -398,11 +1020,19 @@ ProxyGateway_StartWorkerThread (
         result = __LINE__;
         free(remote_module->message_thread);
         remote_module->message_thread = (MESSAGE_THREAD_HANDLE)NULL;
+    /* Codes_SRS_PROXY_GATEWAY_31_043: [`ProxyGateway_StartWorkerThread` shall create the wakeup sockets of the worker thread, an inproc pair, by calling `int nn_socket(int domain, int protocol)` twice with `AF_SP` and `NN_PAIR`, `int nn_bind(int s, const char * addr)` and `int nn_connect(int s, const char * addr)`] */
+    } else if (0 != open_wakeup_channel(remote_module->message_thread)) {
+        /* Codes_SRS_PROXY_GATEWAY_31_044: [If unable to create the wakeup sockets, then `ProxyGateway_StartWorkerThread` shall free any previously allocated memory and return a non-zero value] */
+        result = __LINE__;
+        (void)Lock_Deinit(remote_module->message_thread->mutex);
+        free(remote_module->message_thread);
+        remote_module->message_thread = (MESSAGE_THREAD_HANDLE)NULL;
     /* Codes_SRS_PROXY_GATEWAY_027_023: [`ProxyGateway_StartWorkerThread` shall start a worker thread by calling `THREADAPI_RESULT ThreadAPI_Create(&THREAD_HANDLE threadHandle, THREAD_START_FUNC func, void * arg)` with an empty thread handle for `threadHandle`, a function that loops polling the messages for `func`, and `remote_module` for `arg`] */
     } else if (THREADAPI_OK != ThreadAPI_Create(&remote_module->message_thread->thread, worker_thread, remote_module)) {
         /* Codes_SRS_PROXY_GATEWAY_027_024: [If the worker thread failed to start, then `ProxyGateway_StartWorkerThread` shall free any previously allocated memory and return a non-zero value] */
         LogError("%s: Unable to create worker thread!", __FUNCTION__);
         result = __LINE__;
+        close_wakeup_channel(remote_module->message_thread);
         (void)Lock_Deinit(remote_module->message_thread->mutex);
         free(remote_module->message_thread);
         remote_module->message_thread = (MESSAGE_THREAD_HANDLE)NULL;
@@ -434,6 +1064,35 @@ Broker_Publish (
         result = BROKER_INVALIDARG;
         LogError("Broker handle and/or message handle is NULL");
     }
+    else if (remote_module->publish_queue != NULL)
+    {
+        result = publish_async(remote_module, message);
+    }
+    else if (remote_module->message_ring != NULL)
+    {
+        /* Codes_SRS_PROXY_GATEWAY_31_003: [ If the message channel is a shared memory ring, `Broker_Publish` shall serialize the message directly into a record reserved with `ShmRing_BeginWrite` and publish it with `ShmRing_EndWrite`, without cloning the message. ] */
+        int32_t msg_size = Message_ToByteArray(message, NULL, 0);
+        PUBLISH_SEND_RESULT send_result;
+        if (msg_size < 0)
+        {
+            LogError("unable to serialize a message [%p]", message);
+            result = BROKER_ERROR;
+        }
+        else if (!fits_message_ring(remote_module, msg_size))
+        {
+            /* Codes_SRS_PROXY_GATEWAY_31_045: [ If the message channel is a shared memory ring, `Broker_Publish` shall send a message larger than `ShmRing_GetMaxRecordSize` on the message socket instead. ] */
+            result = send_message_to_socket(remote_module, message, msg_size);
+        }
+        else if (PUBLISH_SEND_WOULD_BLOCK == (send_result = write_message_to_ring(remote_module, message, msg_size, PROXY_GATEWAY_RING_WRITE_TIMEOUT_MS)))
+        {
+            LogError("unable to reserve a message [%p] in the message ring", message);
+            result = BROKER_ERROR;
+        }
+        else
+        {
+            result = (PUBLISH_SEND_OK == send_result) ? BROKER_OK : BROKER_ERROR;
+        }
+    }
     else
     {
         // Send message_ to nanomsg
@@ -494,20 +1153,26 @@ Broker_Publish (
 }
 
 
-int
-connect_to_message_channel (
+static int
+bind_message_socket (
     REMOTE_MODULE_HANDLE remote_module,
-    const MESSAGE_URI * channel_uri
+    int protocol,
+    const char * uri
 ) {
     int result;
 
     /* SRS_PROXY_GATEWAY_027_0xx: [`connect_to_message_channel` shall create a socket for the Azure IoT Gateway message channel by calling `int nn_socket(int domain, int protocol)` with `AF_SP` as `domain` and `MESSAGE_URI::uri_type` as `protocol`] */
-    if (-1 == (remote_module->message_socket = nn_socket(AF_SP, channel_uri->uri_type))) {
+    if (-1 == (remote_module->message_socket = nn_socket(AF_SP, protocol))) {
         /* SRS_PROXY_GATEWAY_027_0xx: [If a call to `nn_socket` returns -1, then `connect_to_message_channel` shall free any previously allocated memory, abandon the control message and prepare for the next create message] */
         LogError("%s: Unable to create the gateway socket!", __FUNCTION__);
         result = __LINE__;
+    /* SRS_PROXY_GATEWAY_31_038: [`connect_to_message_channel` shall apply the non-zero buffer sizes given to `ProxyGateway_SetTcpOptions` by calling `int nn_setsockopt(int s, int level, int option, const void * optval, size_t optvallen)`] */
+    } else if (0 != set_buffer_sizes(remote_module->message_socket, &remote_module->tcp_options)) {
+        result = __LINE__;
+        (void)nn_close(remote_module->message_socket);
+        remote_module->message_socket = -1;
     /* SRS_PROXY_GATEWAY_027_0xx: [`connect_to_message_channel` shall bind to the Azure IoT Gateway message channel by calling `int nn_bind(int s, const char * addr)` with the newly created socket as `s` and `MESSAGE_URI::uri` as `addr`] */
-    } else if (0 > (remote_module->message_endpoint = nn_bind(remote_module->message_socket, channel_uri->uri))) {
+    } else if (0 > (remote_module->message_endpoint = nn_bind(remote_module->message_socket, uri))) {
         /* SRS_PROXY_GATEWAY_027_0xx: [If a call to `nn_connect` returns a negative value, then `connect_to_message_channel` shall free any previously allocated memory, abandon the control message and prepare for the next create message] */
         LogError("%s: Unable to connect to the gateway message channel!", __FUNCTION__);
         result = __LINE__;
@@ -522,10 +1187,50 @@ connect_to_message_channel (
 }
 
 
+int
+connect_to_message_channel (
+    REMOTE_MODULE_HANDLE remote_module,
+    const MESSAGE_URI * channel_uri
+) {
+    int result;
+
+    if (MESSAGE_URI_TYPE_SHM_RING == channel_uri->uri_type) {
+        char fallback_uri[SHM_RING_FALLBACK_URI_SIZE];
+
+        /* SRS_PROXY_GATEWAY_31_004: [If `MESSAGE_URI::uri_type` is `MESSAGE_URI_TYPE_SHM_RING`, then `connect_to_message_channel` shall attach to the shared memory ring named by `MESSAGE_URI::uri`, and bind an `NN_PAIR` message socket at `SHM_RING_FALLBACK_URI_HEAD` followed by the name of the ring for the messages too large for the ring] */
+        if (NULL == (remote_module->message_ring = ShmRing_Attach(channel_uri->uri))) {
+            LogError("%s: Unable to attach to the gateway message ring!", __FUNCTION__);
+            result = __LINE__;
+        } else if (sizeof(fallback_uri) <= (size_t)snprintf(fallback_uri, sizeof(fallback_uri), "%s%s", SHM_RING_FALLBACK_URI_HEAD, (channel_uri->uri + SHM_RING_URI_HEAD_SIZE))
+            || 0 != bind_message_socket(remote_module, NN_PAIR, fallback_uri)) {
+            LogError("%s: Unable to connect to the gateway message socket of the ring!", __FUNCTION__);
+            ShmRing_Destroy(remote_module->message_ring);
+            remote_module->message_ring = NULL;
+            result = __LINE__;
+        } else {
+            remote_module->message_ring_record_max = ShmRing_GetMaxRecordSize(remote_module->message_ring);
+            result = 0;
+        }
+    } else {
+        result = bind_message_socket(remote_module, channel_uri->uri_type, channel_uri->uri);
+    }
+
+    return result;
+}
+
+
 void
 disconnect_from_message_channel (
     REMOTE_MODULE_HANDLE remote_module
 ) {
+    /* Codes_SRS_PROXY_GATEWAY_31_039: [`disconnect_from_message_channel` shall free every message left in the publish queue, if any, complete each with `BROKER_ERROR` and empty the queue] */
+    fail_publish_queue(remote_module);
+
+    if (NULL != remote_module->message_ring) {
+        /* SRS_PROXY_GATEWAY_31_005: [`disconnect_from_message_channel` shall detach from the shared memory ring, if any, by calling `void ShmRing_Destroy(SHM_RING_HANDLE ring)`] */
+        ShmRing_Destroy(remote_module->message_ring);
+        remote_module->message_ring = NULL;
+    }
     /* SRS_PROXY_GATEWAY_027_0xx: [`disconnect_from_message_channel` shall shutdown the Azure IoT Gateway message channel by calling `int nn_shutdown(int s, int how)`] */
     (void)nn_shutdown(remote_module->message_socket, remote_module->message_endpoint);
     remote_module->message_endpoint = -1;
@@ -537,6 +1242,45 @@ disconnect_from_message_channel (
 }
 
 
+/* Codes_SRS_PROXY_GATEWAY_31_021: [`flush_publish_queue` shall send queued messages in order, without blocking, until the queue is empty or the channel would block, completing each message with `BROKER_OK` once sent or `BROKER_ERROR` if the send failed] */
+/* Codes_SRS_PROXY_GATEWAY_31_022: [`flush_publish_queue` shall return the number of messages taken off the queue] */
+int
+flush_publish_queue (
+    REMOTE_MODULE_HANDLE remote_module
+) {
+    PUBLISH_QUEUE * queue = remote_module->publish_queue;
+    int messages_flushed = 0;
+    bool flushing = (NULL != queue);
+
+    while (flushing) {
+        PUBLISH_SEND_RESULT send_result = PUBLISH_SEND_WOULD_BLOCK;
+
+        // Send under the lock, so a concurrent Broker_Publish cannot overtake queued messages
+        if (LOCK_ERROR == Lock(queue->mutex)) {
+            LogError("%s: Failed to obtain mutex!", __FUNCTION__);
+        } else {
+            if (0 < queue->count) {
+                send_result = send_serialized_message(remote_module, queue->entries[queue->head].buffer, queue->entries[queue->head].size);
+                if (PUBLISH_SEND_WOULD_BLOCK != send_result) {
+                    queue->head = (queue->head + 1) % queue->capacity;
+                    --queue->count;
+                }
+            }
+            (void)Unlock(queue->mutex);
+        }
+
+        if (PUBLISH_SEND_WOULD_BLOCK == send_result) {
+            flushing = false;
+        } else {
+            ++messages_flushed;
+            complete_publish(queue, ((PUBLISH_SEND_OK == send_result) ? BROKER_OK : BROKER_ERROR));
+        }
+    }
+
+    return messages_flushed;
+}
+
+
 int
 invoke_add_module_procedure (
     REMOTE_MODULE_HANDLE remote_module,
@@ -626,7 +1370,6 @@ send_control_reply (
     REMOTE_MODULE_HANDLE remote_module,
     uint8_t response
 ) {
-    int result;
     CONTROL_MESSAGE_MODULE_REPLY reply = {
         .base = {
             .type = CONTROL_MESSAGE_TYPE_MODULE_REPLY,
@@ -634,11 +1377,23 @@ send_control_reply (
         },
         .status = response,
     };
+
+    return send_control_message(remote_module, (CONTROL_MESSAGE *)&reply);
+}
+
+
+static
+int
+send_control_message (
+    REMOTE_MODULE_HANDLE remote_module,
+    CONTROL_MESSAGE * message
+) {
+    int result;
     unsigned char * message_buffer = NULL;
     int32_t message_size;
 
     /* SRS_PROXY_GATEWAY_027_0xx: [`send_control_reply` shall calculate the serialized message size by calling `size_t ControlMessage_ToByteArray(CONTROL MESSAGE * message, unsigned char * buf, size_t size)`] */
-    if (0 > (message_size = ControlMessage_ToByteArray((CONTROL_MESSAGE *)&reply, message_buffer, 0))) {
+    if (0 > (message_size = ControlMessage_ToByteArray(message, message_buffer, 0))) {
         /* SRS_PROXY_GATEWAY_027_0xx: [If unable to calculate the serialized message size, `send_control_reply` shall return a non-zero value] */
         LogError("%s: Unable to calculate serialized message size!", __FUNCTION__);
         result = __LINE__;
@@ -649,7 +1404,7 @@ send_control_reply (
             LogError("%s: Unable to allocate message!", __FUNCTION__);
             result = __LINE__;
         /* SRS_PROXY_GATEWAY_027_0xx: [`send_control_reply` shall serialize a creation reply indicating the creation status by calling `size_t ControlMessage_ToByteArray(CONTROL MESSAGE * message, unsigned char * buf, size_t size)`] */
-        } else if (0 > ControlMessage_ToByteArray((CONTROL_MESSAGE *)&reply, message_buffer, message_size)) {
+        } else if (0 > ControlMessage_ToByteArray(message, message_buffer, message_size)) {
             /* SRS_PROXY_GATEWAY_027_0xx: [If unable to serialize the creation message reply, `send_control_reply` shall return a non-zero value] */
             LogError("%s: Unable to serialize message!", __FUNCTION__);
             result = __LINE__;
@@ -669,12 +1424,65 @@ send_control_reply (
 }
 
 
+/* Codes_SRS_PROXY_GATEWAY_31_006: [`wait_for_messages` shall wait on the control socket, the wakeup socket of the worker thread and, if connected, the message socket by calling `int nn_poll(struct nn_pollfd * fds, int nfds, int timeout)` with `NN_POLLIN` for `events`, and `PROXY_GATEWAY_WORKER_WAIT_MS` for `timeout` if the keepalive is checked or no timeout otherwise] */
+/* Codes_SRS_PROXY_GATEWAY_31_007: [If the message channel is a shared memory ring, then `wait_for_messages` shall check the control socket and the message socket without waiting and, if no message is pending on either, wait on the ring by calling `ShmRing_BeginRead` with `PROXY_GATEWAY_WORKER_WAIT_MS` for `timeout_ms`, leaving the record in the ring, unless the worker thread was told to halt; the ring is published under the thread mutex while the thread waits on it] */
+/* Codes_SRS_PROXY_GATEWAY_31_008: [If `nn_poll` fails, then `wait_for_messages` shall sleep for `PROXY_GATEWAY_WORKER_WAIT_MS` milliseconds] */
+/* Codes_SRS_PROXY_GATEWAY_31_025: [If messages are waiting in the publish queue, then `wait_for_messages` shall also wait for the message socket to become writable with `NN_POLLOUT`, or wait on the shared memory ring for `PROXY_GATEWAY_PUBLISH_RETRY_MS` only] */
+void
+wait_for_messages (
+    REMOTE_MODULE_HANDLE remote_module
+) {
+    struct nn_pollfd channels[3];
+    int channel_count = 0;
+    int poll_result;
+
+    channels[channel_count].fd = remote_module->control_socket;
+    channels[channel_count].events = NN_POLLIN;
+    channels[channel_count].revents = 0;
+    ++channel_count;
+
+    if (NULL != remote_module->message_ring) {
+        // The messages too large for the ring arrive on the message socket
+        channels[channel_count].fd = remote_module->message_socket;
+        channels[channel_count].events = NN_POLLIN;
+        channels[channel_count].revents = 0;
+        ++channel_count;
+        // The ring is signalled with a futex, so it cannot be polled along with the sockets; the halt signal wakes it instead
+        if (0 == (poll_result = nn_poll(channels, channel_count, 0)) && begin_ring_wait(remote_module)) {
+            const unsigned char * record;
+            (void)ShmRing_BeginRead(remote_module->message_ring, &record, (publish_queue_is_pending(remote_module) ? PROXY_GATEWAY_PUBLISH_RETRY_MS : PROXY_GATEWAY_WORKER_WAIT_MS));
+            end_ring_wait(remote_module);
+        }
+    } else {
+        if (NULL != remote_module->message_thread) {
+            channels[channel_count].fd = remote_module->message_thread->wakeup_socket;
+            channels[channel_count].events = NN_POLLIN;
+            channels[channel_count].revents = 0;
+            ++channel_count;
+        }
+        if (0 <= remote_module->message_socket) {
+            channels[channel_count].fd = remote_module->message_socket;
+            channels[channel_count].events = (publish_queue_is_pending(remote_module) ? (NN_POLLIN | NN_POLLOUT) : NN_POLLIN);
+            channels[channel_count].revents = 0;
+            ++channel_count;
+        }
+        // Only the keepalive needs a timeout, a message, room for a queued publish or the halt signal ends the wait
+        poll_result = nn_poll(channels, channel_count, ((NULL != remote_module->keepalive_clock) ? PROXY_GATEWAY_WORKER_WAIT_MS : PROXY_GATEWAY_WAIT_FOREVER));
+    }
+
+    if (0 > poll_result) {
+        LogError("%s: Unable to poll the gateway channels!", __FUNCTION__);
+        ThreadAPI_Sleep(PROXY_GATEWAY_WORKER_WAIT_MS);
+    }
+}
+
+
 /* SRS_PROXY_GATEWAY_027_0xx: [`worker_thread` shall obtain the thread mutex in order to initialize the thread by calling `LOCK_RESULT Lock(LOCK_HANDLE handle)`] */
 /* SRS_PROXY_GATEWAY_027_0xx: [If unable to obtain the mutex, then `worker_thread` shall return a non-zero value] */
 /* SRS_PROXY_GATEWAY_027_0xx: [`worker_thread` shall release the thread mutex upon entering the loop by calling `LOCK_RESULT Unlock(LOCK_HANDLE handle)`] */
 /* SRS_PROXY_GATEWAY_027_0xx: [If unable to release the mutex, then `worker_thread` shall exit the thread and return a non-zero value] */
-/* SRS_PROXY_GATEWAY_027_0xx: [`worker_thread` shall invoke asynchronous processing by calling `void ProxyGateway_DoWork(REMOTE_MODULE_HANDLE remote_module)`] */
-/* SRS_PROXY_GATEWAY_027_0xx: [`worker_thread` shall yield its remaining quantum by calling `void THREADAPI_Sleep(unsigned int milliseconds)`] */
+/* SRS_PROXY_GATEWAY_31_0xx: [`worker_thread` shall wait for a message on the gateway channels by calling `void wait_for_messages(REMOTE_MODULE_HANDLE remote_module)`] */
+/* SRS_PROXY_GATEWAY_31_0xx: [`worker_thread` shall process messages until none are pending, but at most `PROXY_GATEWAY_WORKER_DRAIN_PASSES` times before checking for a halt signal, by calling `int process_pending_messages(REMOTE_MODULE_HANDLE remote_module)`] */
 /* SRS_PROXY_GATEWAY_027_0xx: [`worker_thread` shall obtain the thread mutex in order to check for a halt signal by calling `LOCK_RESULT Lock(LOCK_HANDLE handle)`] */
 /* SRS_PROXY_GATEWAY_027_0xx: [If unable to obtain the mutex, then `worker_thread` shall exit the thread return a non-zero value] */
 /* SRS_PROXY_GATEWAY_027_0xx: [If unable to obtain the mutex, then `worker_thread` shall exit the thread return a non-zero value] */
@@ -703,8 +1511,11 @@ worker_thread (
                 break;
             }
             else {
-                ProxyGateway_DoWork(remote_module);
-                ThreadAPI_Sleep(0);  // Release the CPU
+                int passes;
+                wait_for_messages(remote_module);
+                // drain what arrived while waiting; a peer which keeps sending must not keep the halt signal from being seen
+                for (passes = 0; passes < PROXY_GATEWAY_WORKER_DRAIN_PASSES && 0 < process_pending_messages(remote_module); ++passes) {
+                }
                 if (LOCK_ERROR == Lock(remote_module->message_thread->mutex)) {
                     LogError("%s: Failed to obtain mutex!", __FUNCTION__);
                     result = __LINE__;
@@ -72,9 +72,11 @@ non_mocked_free(
   #include "azure_c_shared_utility/gballoc.h"
   #include "azure_c_shared_utility/lock.h"
   #include "azure_c_shared_utility/threadapi.h"
+  #include "azure_c_shared_utility/tickcounter.h"
   #include "control_message.h"
   #include "message.h"
   #include "module.h"
+  #include "shm_ring.h"
 #undef ENABLE_MOCKS
 
 // Under test #includes
@@ -86,6 +88,7 @@ non_mocked_free(
 #define MOCK_LOCK (LOCK_HANDLE)0x17091979
 #define MOCK_MODULE (MODULE_HANDLE)0x09171979
 #define MOCK_REMOTE_MODULE (REMOTE_MODULE_HANDLE)0x19790917
+#define MOCK_TICKCOUNTER (TICK_COUNTER_HANDLE)0x19791709
 
 #ifdef __cplusplus
 extern "C"
@@ -105,6 +108,12 @@ disconnect_from_message_channel (
     REMOTE_MODULE_HANDLE remote_module
 );
 
+extern
+int
+flush_publish_queue (
+    REMOTE_MODULE_HANDLE remote_module
+);
+
 extern
 int
 invoke_add_module_procedure (
@@ -119,6 +128,12 @@ process_module_create_message (
     const CONTROL_MESSAGE_MODULE_CREATE * message
 );
 
+extern
+int
+process_pending_messages (
+    REMOTE_MODULE_HANDLE remote_module
+);
+
 extern
 int
 send_control_reply (
@@ -126,6 +141,12 @@ send_control_reply (
     uint8_t response
 );
 
+extern
+void
+wait_for_messages (
+    REMOTE_MODULE_HANDLE remote_module
+);
+
 extern
 int
 worker_thread (
@@ -205,6 +226,17 @@ umockvalue_stringify_CONTROL_MESSAGE (
                 (uint8_t)(*value_)->version
             );
 
+            result = (char *)non_mocked_malloc(len + 1);
+            strcpy(result, buffer);
+            break;
+          case CONTROL_MESSAGE_TYPE_MODULE_PING:
+            len = sprintf(
+                buffer,
+                "CONTROL_MESSAGE_MODULE_PING {\n\t.type: %u\n\t.version: %u\n}\n",
+                (uint8_t)(*value_)->type,
+                (uint8_t)(*value_)->version
+            );
+
             result = (char *)non_mocked_malloc(len + 1);
             strcpy(result, buffer);
             break;
@@ -397,18 +429,28 @@ MOCK_FUNCTION_END(0)
 MOCK_FUNCTION_WITH_CODE(, int, nn_close, int, s)
 MOCK_FUNCTION_END(0)
 
+MOCK_FUNCTION_WITH_CODE(, int, nn_connect, int, s, const char *, addr)
+MOCK_FUNCTION_END(0)
+
 MOCK_FUNCTION_WITH_CODE(, int, nn_errno)
 MOCK_FUNCTION_END(0)
 
 MOCK_FUNCTION_WITH_CODE(, int, nn_freemsg, void *, msg)
 MOCK_FUNCTION_END(0)
 
+typedef struct nn_pollfd * NN_POLLFD_PTR;
+MOCK_FUNCTION_WITH_CODE(, int, nn_poll, NN_POLLFD_PTR, fds, int, nfds, int, timeout)
+MOCK_FUNCTION_END(0)
+
 MOCK_FUNCTION_WITH_CODE(, int, nn_recv, int, s, void *, buf, size_t, len, int, flags)
 MOCK_FUNCTION_END(0)
 
 MOCK_FUNCTION_WITH_CODE(, int, nn_send, int, s, const void *, buf, size_t, len, int, flags)
 MOCK_FUNCTION_END(0)
 
+MOCK_FUNCTION_WITH_CODE(, int, nn_setsockopt, int, s, int, level, int, option, const void *, optval, size_t, optvallen)
+MOCK_FUNCTION_END(0)
+
 MOCK_FUNCTION_WITH_CODE(, int, nn_shutdown, int, s, int, how)
 MOCK_FUNCTION_END(0)
 
@@ -446,6 +488,20 @@ static const MODULE_API_1 MOCK_MODULE_APIS = {
 
 DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
 
+static int publish_callback_count;
+static BROKER_RESULT publish_callback_result;
+
+static
+void
+publish_callback (
+    void * context,
+    BROKER_RESULT result
+) {
+    (void)context;
+    ++publish_callback_count;
+    publish_callback_result = result;
+}
+
 static
 void
 expected_calls_connect_to_message_channel (
@@ -569,10 +625,13 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_UMOCK_ALIAS_TYPE(LOCK_RESULT, int);
     REGISTER_UMOCK_ALIAS_TYPE(MESSAGE_HANDLE, void *);
     REGISTER_UMOCK_ALIAS_TYPE(MODULE_HANDLE, void *);
+    REGISTER_UMOCK_ALIAS_TYPE(NN_POLLFD_PTR, void *);
     REGISTER_UMOCK_ALIAS_TYPE(REMOTE_MODULE_HANDLE, void *);
+    REGISTER_UMOCK_ALIAS_TYPE(SHM_RING_HANDLE, void *);
     REGISTER_UMOCK_ALIAS_TYPE(THREAD_HANDLE, void *);
     REGISTER_UMOCK_ALIAS_TYPE(THREAD_START_FUNC, void *);
     REGISTER_UMOCK_ALIAS_TYPE(THREADAPI_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(TICK_COUNTER_HANDLE, void *);
 
     //REGISTER_UMOCKC_PAIRED_CREATE_DESTROY_CALLS(ControlMessage_Create, ControlMessage_Destroy);
     //REGISTER_UMOCKC_PAIRED_CREATE_DESTROY_CALLS(Message_Create, Message_Destroy);
@@ -584,6 +643,7 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_GLOBAL_MOCK_HOOK(gballoc_calloc, non_mocked_calloc);
     REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, non_mocked_free);
     REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, non_mocked_malloc);
+    REGISTER_GLOBAL_MOCK_RETURN(ShmRing_GetMaxRecordSize, (SHM_RING_DEFAULT_CAPACITY / 2) - 8);
 }
 
 TEST_SUITE_CLEANUP(suite_cleanup)
@@ -921,6 +981,10 @@ TEST_FUNCTION(startWorkerThread_SCENARIO_threadAlreadyStarted)
     EXPECTED_CALL(gballoc_calloc(IGNORED_NUM_ARG, IGNORED_NUM_ARG));
     EXPECTED_CALL(Lock_Init())
         .SetReturn(MOCK_LOCK);
+    STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR));
+    EXPECTED_CALL(nn_bind(IGNORED_NUM_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR));
+    EXPECTED_CALL(nn_connect(IGNORED_NUM_ARG, IGNORED_PTR_ARG));
     EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .SetReturn(THREADAPI_OK);
 
@@ -943,6 +1007,7 @@ TEST_FUNCTION(startWorkerThread_SCENARIO_threadAlreadyStarted)
 /* Tests_SRS_PROXY_GATEWAY_027_021: [`ProxyGateway_StartWorkerThread` shall create a mutex by calling `LOCK_HANDLE Lock_Init(void)`] */
 /* Tests_SRS_PROXY_GATEWAY_027_023: [`ProxyGateway_StartWorkerThread` shall start a worker thread by calling `THREADAPI_RESULT ThreadAPI_Create(&THREAD_HANDLE threadHandle, THREAD_START_FUNC func, void * arg)` with an empty thread handle for `threadHandle`, a function that loops polling the messages for `func`, and `remote_module` for `arg`] */
 /* Tests_SRS_PROXY_GATEWAY_027_025: [If no errors are encountered, then `ProxyGateway_StartWorkerThread` shall return zero] */
+/* Tests_SRS_PROXY_GATEWAY_31_043: [`ProxyGateway_StartWorkerThread` shall create the wakeup sockets of the worker thread, an inproc pair, by calling `int nn_socket(int domain, int protocol)` twice with `AF_SP` and `NN_PAIR`, `int nn_bind(int s, const char * addr)` and `int nn_connect(int s, const char * addr)`] */
 TEST_FUNCTION(startWorkerThread_SCENARIO_success)
 {
     // Arrange
@@ -955,6 +1020,10 @@ TEST_FUNCTION(startWorkerThread_SCENARIO_success)
     EXPECTED_CALL(gballoc_calloc(IGNORED_NUM_ARG, IGNORED_NUM_ARG));
     EXPECTED_CALL(Lock_Init())
         .SetReturn(MOCK_LOCK);
+    STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR));
+    EXPECTED_CALL(nn_bind(IGNORED_NUM_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR));
+    EXPECTED_CALL(nn_connect(IGNORED_NUM_ARG, IGNORED_PTR_ARG));
     EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .SetReturn(THREADAPI_OK);
 
@@ -973,6 +1042,7 @@ TEST_FUNCTION(startWorkerThread_SCENARIO_success)
 /* Tests_SRS_PROXY_GATEWAY_027_020: [If memory allocation fails for the worker thread data, then `ProxyGateway_StartWorkerThread` shall return a non-zero value] */
 /* Tests_SRS_PROXY_GATEWAY_027_022: [If a mutex is unable to be created, then `ProxyGateway_StartWorkerThread` shall free any previously allocated memory and return a non-zero value] */
 /* Tests_SRS_PROXY_GATEWAY_027_024: [If the worker thread failed to start, then `ProxyGateway_StartWorkerThread` shall free any previously allocated memory and return a non-zero value] */
+/* Tests_SRS_PROXY_GATEWAY_31_044: [If unable to create the wakeup sockets, then `ProxyGateway_StartWorkerThread` shall free any previously allocated memory and return a non-zero value] */
 TEST_FUNCTION(startWorkerThread_SCENARIO_negative_tests)
 {
     // Arrange
@@ -993,6 +1063,18 @@ TEST_FUNCTION(startWorkerThread_SCENARIO_negative_tests)
         .SetFailReturn(NULL)
         .SetReturn(MOCK_LOCK);
     enableNegativeTest(negative_test_index++);
+    STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR))
+        .SetFailReturn(-1);
+    enableNegativeTest(negative_test_index++);
+    EXPECTED_CALL(nn_bind(IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+        .SetFailReturn(-1);
+    enableNegativeTest(negative_test_index++);
+    STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR))
+        .SetFailReturn(-1);
+    enableNegativeTest(negative_test_index++);
+    EXPECTED_CALL(nn_connect(IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+        .SetFailReturn(-1);
+    enableNegativeTest(negative_test_index++);
     EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .SetFailReturn(THREADAPI_ERROR)
         .SetReturn(THREADAPI_OK);
@@ -1482,6 +1564,149 @@ TEST_FUNCTION(doWork_SCENARIO_gateway_message_bad_parse)
     ProxyGateway_Detach(remote_module);
 }
 
+/* Tests_SRS_PROXY_GATEWAY_027_028: [Control Channel - If no message is available, then `ProxyGateway_DoWork` shall abandon the control channel request] */
+TEST_FUNCTION(process_pending_messages_SCENARIO_nothing_pending)
+{
+    // Arrange
+    int result;
+
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetReturn(-1);
+    STRICT_EXPECTED_CALL(nn_errno())
+        .SetReturn(EAGAIN);
+
+    // Act
+    result = process_pending_messages(remote_module);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
+/* Tests_SRS_PROXY_GATEWAY_31_006: [`wait_for_messages` shall wait on the control socket, the wakeup socket of the worker thread and, if connected, the message socket by calling `int nn_poll(struct nn_pollfd * fds, int nfds, int timeout)` with `NN_POLLIN` for `events`, and `PROXY_GATEWAY_WORKER_WAIT_MS` for `timeout` if the keepalive is checked or no timeout otherwise] */
+TEST_FUNCTION(wait_for_messages_SCENARIO_control_channel_only)
+{
+    // Arrange
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(nn_poll(IGNORED_PTR_ARG, 1, -1))
+        .IgnoreArgument(1)
+        .SetReturn(1);
+
+    // Act
+    wait_for_messages(remote_module);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
+/* Tests_SRS_PROXY_GATEWAY_31_006: [`wait_for_messages` shall wait on the control socket, the wakeup socket of the worker thread and, if connected, the message socket by calling `int nn_poll(struct nn_pollfd * fds, int nfds, int timeout)` with `NN_POLLIN` for `events`, and `PROXY_GATEWAY_WORKER_WAIT_MS` for `timeout` if the keepalive is checked or no timeout otherwise] */
+TEST_FUNCTION(wait_for_messages_SCENARIO_message_channel_connected)
+{
+    // Arrange
+    static const MESSAGE_URI MESSAGE = {
+        sizeof("ipc://message_channel"),
+        NN_PAIR,
+        "ipc://message_channel"
+    };
+
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+    ASSERT_ARE_EQUAL(int, 0, connect_to_message_channel(remote_module, &MESSAGE));
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(nn_poll(IGNORED_PTR_ARG, 2, -1))
+        .IgnoreArgument(1)
+        .SetReturn(0);
+
+    // Act
+    wait_for_messages(remote_module);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
+/* Tests_SRS_PROXY_GATEWAY_31_007: [If the message channel is a shared memory ring, then `wait_for_messages` shall check the control socket and the message socket without waiting and, if no message is pending on either, wait on the ring by calling `ShmRing_BeginRead` with `PROXY_GATEWAY_WORKER_WAIT_MS` for `timeout_ms`, leaving the record in the ring, unless the worker thread was told to halt; the ring is published under the thread mutex while the thread waits on it] */
+TEST_FUNCTION(wait_for_messages_SCENARIO_shm_ring)
+{
+    // Arrange
+    static const MESSAGE_URI MESSAGE = {
+        sizeof("shm://proxy_gateway_ut"),
+        MESSAGE_URI_TYPE_SHM_RING,
+        "shm://proxy_gateway_ut"
+    };
+
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(ShmRing_Attach(MESSAGE.uri))
+        .SetReturn((SHM_RING_HANDLE)0x31);
+    ASSERT_ARE_EQUAL(int, 0, connect_to_message_channel(remote_module, &MESSAGE));
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(nn_poll(IGNORED_PTR_ARG, 2, 0))
+        .IgnoreArgument(1)
+        .SetReturn(0);
+    STRICT_EXPECTED_CALL(ShmRing_BeginRead((SHM_RING_HANDLE)0x31, IGNORED_PTR_ARG, 100))
+        .IgnoreArgument(2)
+        .SetReturn(0);
+
+    // Act
+    wait_for_messages(remote_module);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
+/* Tests_SRS_PROXY_GATEWAY_31_008: [If `nn_poll` fails, then `wait_for_messages` shall sleep for `PROXY_GATEWAY_WORKER_WAIT_MS` milliseconds] */
+TEST_FUNCTION(wait_for_messages_SCENARIO_poll_fails)
+{
+    // Arrange
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(nn_poll(IGNORED_PTR_ARG, 1, -1))
+        .IgnoreArgument(1)
+        .SetReturn(-1);
+    STRICT_EXPECTED_CALL(ThreadAPI_Sleep(100));
+
+    // Act
+    wait_for_messages(remote_module);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
 /* Tests_SRS_PROXY_GATEWAY_027_045: [Prerequisite Check - If the `remote_module` parameter is `NULL`, then `ProxyGateway_HaltWorkerThread` shall return a non-zero value] */
 TEST_FUNCTION(haltWorkerThread_SCENARIO_NULL_handle)
 {
@@ -1530,6 +1755,8 @@ TEST_FUNCTION(haltWorkerThread_SCENARIO_no_worker_thread)
 /* Tests_SRS_PROXY_GATEWAY_027_053: [`ProxyGateway_HaltWorkerThread` shall free the thread mutex by calling `LOCK_RESULT Lock_Deinit(LOCK_HANDLE handle)`] */
 /* Tests_SRS_PROXY_GATEWAY_027_055: [`ProxyGateway_HaltWorkerThread` shall free the memory allocated to the thread details] */
 /* Tests_SRS_PROXY_GATEWAY_027_057: [If no errors are encountered, then `ProxyGateway_HaltWorkerThread` shall return zero] */
+/* Tests_SRS_PROXY_GATEWAY_31_041: [`ProxyGateway_HaltWorkerThread` shall wake the worker thread by sending a message on its wakeup socket with `int nn_send(int s, const void * buf, size_t len, int flags)`, and by calling `void ShmRing_Wake(SHM_RING_HANDLE ring)` on the message ring it waits on, if any] */
+/* Tests_SRS_PROXY_GATEWAY_31_042: [`ProxyGateway_HaltWorkerThread` shall close the wakeup sockets by calling `int nn_close(int s)`] */
 TEST_FUNCTION(haltWorkerThread_SCENARIO_success)
 {
     // Arrange
@@ -1544,12 +1771,19 @@ TEST_FUNCTION(haltWorkerThread_SCENARIO_success)
     EXPECTED_CALL(gballoc_calloc(IGNORED_NUM_ARG, IGNORED_NUM_ARG));
     EXPECTED_CALL(Lock_Init())
         .SetReturn(MOCK_LOCK);
+    STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR));
+    EXPECTED_CALL(nn_bind(IGNORED_NUM_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR));
+    EXPECTED_CALL(nn_connect(IGNORED_NUM_ARG, IGNORED_PTR_ARG));
     EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .SetReturn(THREADAPI_OK);
 
     STRICT_EXPECTED_CALL(Lock(MOCK_LOCK))
         .SetFailReturn(LOCK_ERROR)
         .SetReturn(LOCK_OK);
+    STRICT_EXPECTED_CALL(nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, 1, NN_DONTWAIT))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(Unlock(MOCK_LOCK))
         .SetFailReturn(LOCK_ERROR)
         .SetReturn(LOCK_OK);
@@ -1562,6 +1796,8 @@ TEST_FUNCTION(haltWorkerThread_SCENARIO_success)
     STRICT_EXPECTED_CALL(Lock_Deinit(MOCK_LOCK))
         .SetFailReturn(LOCK_ERROR)
         .SetReturn(LOCK_OK);
+    EXPECTED_CALL(nn_close(IGNORED_NUM_ARG));
+    EXPECTED_CALL(nn_close(IGNORED_NUM_ARG));
     EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
 
     // Act
@@ -1592,12 +1828,19 @@ TEST_FUNCTION(haltWorkerThread_SCENARIO_thread_error)
     EXPECTED_CALL(gballoc_calloc(IGNORED_NUM_ARG, IGNORED_NUM_ARG));
     EXPECTED_CALL(Lock_Init())
         .SetReturn(MOCK_LOCK);
+    STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR));
+    EXPECTED_CALL(nn_bind(IGNORED_NUM_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR));
+    EXPECTED_CALL(nn_connect(IGNORED_NUM_ARG, IGNORED_PTR_ARG));
     EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .SetReturn(THREADAPI_OK);
 
     STRICT_EXPECTED_CALL(Lock(MOCK_LOCK))
         .SetFailReturn(LOCK_ERROR)
         .SetReturn(LOCK_OK);
+    STRICT_EXPECTED_CALL(nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, 1, NN_DONTWAIT))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(Unlock(MOCK_LOCK))
         .SetFailReturn(LOCK_ERROR)
         .SetReturn(LOCK_OK);
@@ -1610,6 +1853,8 @@ TEST_FUNCTION(haltWorkerThread_SCENARIO_thread_error)
     STRICT_EXPECTED_CALL(Lock_Deinit(MOCK_LOCK))
         .SetFailReturn(LOCK_ERROR)
         .SetReturn(LOCK_OK);
+    EXPECTED_CALL(nn_close(IGNORED_NUM_ARG));
+    EXPECTED_CALL(nn_close(IGNORED_NUM_ARG));
     EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
 
     // Act
@@ -1639,6 +1884,10 @@ TEST_FUNCTION(haltWorkerThread_SCENARIO_can_not_obtain_mutex)
     EXPECTED_CALL(gballoc_calloc(IGNORED_NUM_ARG, IGNORED_NUM_ARG));
     EXPECTED_CALL(Lock_Init())
         .SetReturn(MOCK_LOCK);
+    STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR));
+    EXPECTED_CALL(nn_bind(IGNORED_NUM_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR));
+    EXPECTED_CALL(nn_connect(IGNORED_NUM_ARG, IGNORED_PTR_ARG));
     EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .SetReturn(THREADAPI_OK);
 
@@ -1672,11 +1921,18 @@ TEST_FUNCTION(haltWorkerThread_SCENARIO_can_not_release_mutex)
     EXPECTED_CALL(gballoc_calloc(IGNORED_NUM_ARG, IGNORED_NUM_ARG));
     EXPECTED_CALL(Lock_Init())
         .SetReturn(MOCK_LOCK);
+    STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR));
+    EXPECTED_CALL(nn_bind(IGNORED_NUM_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR));
+    EXPECTED_CALL(nn_connect(IGNORED_NUM_ARG, IGNORED_PTR_ARG));
     EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .SetReturn(THREADAPI_OK);
 
     STRICT_EXPECTED_CALL(Lock(MOCK_LOCK))
         .SetReturn(LOCK_OK);
+    STRICT_EXPECTED_CALL(nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, 1, NN_DONTWAIT))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(Unlock(MOCK_LOCK))
         .SetReturn(LOCK_ERROR);
 
@@ -1708,12 +1964,19 @@ TEST_FUNCTION(haltWorkerThread_SCENARIO_can_not_join_thread)
     EXPECTED_CALL(gballoc_calloc(IGNORED_NUM_ARG, IGNORED_NUM_ARG));
     EXPECTED_CALL(Lock_Init())
         .SetReturn(MOCK_LOCK);
+    STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR));
+    EXPECTED_CALL(nn_bind(IGNORED_NUM_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR));
+    EXPECTED_CALL(nn_connect(IGNORED_NUM_ARG, IGNORED_PTR_ARG));
     EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .SetReturn(THREADAPI_OK);
 
     STRICT_EXPECTED_CALL(Lock(MOCK_LOCK))
         .SetFailReturn(LOCK_ERROR)
         .SetReturn(LOCK_OK);
+    STRICT_EXPECTED_CALL(nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, 1, NN_DONTWAIT))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(Unlock(MOCK_LOCK))
         .SetFailReturn(LOCK_ERROR)
         .SetReturn(LOCK_OK);
@@ -1751,12 +2014,19 @@ TEST_FUNCTION(haltWorkerThread_SCENARIO_can_not_free_mutex)
     EXPECTED_CALL(gballoc_calloc(IGNORED_NUM_ARG, IGNORED_NUM_ARG));
     EXPECTED_CALL(Lock_Init())
         .SetReturn(MOCK_LOCK);
+    STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR));
+    EXPECTED_CALL(nn_bind(IGNORED_NUM_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR));
+    EXPECTED_CALL(nn_connect(IGNORED_NUM_ARG, IGNORED_PTR_ARG));
     EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .SetReturn(THREADAPI_OK);
 
     STRICT_EXPECTED_CALL(Lock(MOCK_LOCK))
         .SetFailReturn(LOCK_ERROR)
         .SetReturn(LOCK_OK);
+    STRICT_EXPECTED_CALL(nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, 1, NN_DONTWAIT))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(Unlock(MOCK_LOCK))
         .SetFailReturn(LOCK_ERROR)
         .SetReturn(LOCK_OK);
@@ -1769,6 +2039,8 @@ TEST_FUNCTION(haltWorkerThread_SCENARIO_can_not_free_mutex)
     STRICT_EXPECTED_CALL(Lock_Deinit(MOCK_LOCK))
         .SetFailReturn(LOCK_ERROR)
         .SetReturn(LOCK_OK);
+    EXPECTED_CALL(nn_close(IGNORED_NUM_ARG));
+    EXPECTED_CALL(nn_close(IGNORED_NUM_ARG));
     EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
 
     // Act
@@ -1824,12 +2096,19 @@ TEST_FUNCTION(detach_SCENARIO_halt_not_called)
     EXPECTED_CALL(gballoc_calloc(IGNORED_NUM_ARG, IGNORED_NUM_ARG));
     EXPECTED_CALL(Lock_Init())
         .SetReturn(MOCK_LOCK);
+    STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR));
+    EXPECTED_CALL(nn_bind(IGNORED_NUM_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR));
+    EXPECTED_CALL(nn_connect(IGNORED_NUM_ARG, IGNORED_PTR_ARG));
     EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .SetReturn(THREADAPI_OK);
 
     STRICT_EXPECTED_CALL(Lock(MOCK_LOCK))
         .SetFailReturn(LOCK_ERROR)
         .SetReturn(LOCK_OK);
+    STRICT_EXPECTED_CALL(nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, 1, NN_DONTWAIT))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(Unlock(MOCK_LOCK))
         .SetFailReturn(LOCK_ERROR)
         .SetReturn(LOCK_OK);
@@ -1841,6 +2120,8 @@ TEST_FUNCTION(detach_SCENARIO_halt_not_called)
         .SetReturn(THREADAPI_OK);
     STRICT_EXPECTED_CALL(Lock_Deinit(MOCK_LOCK))
         .SetReturn(LOCK_ERROR);
+    EXPECTED_CALL(nn_close(IGNORED_NUM_ARG));
+    EXPECTED_CALL(nn_close(IGNORED_NUM_ARG));
     EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
 
     expected_calls_send_control_reply((CONTROL_MESSAGE_MODULE_REPLY *)&REPLY);
@@ -1920,14 +2201,23 @@ TEST_FUNCTION(detach_SCENARIO_unable_to_halt_thread)
     EXPECTED_CALL(gballoc_calloc(IGNORED_NUM_ARG, IGNORED_NUM_ARG));
     EXPECTED_CALL(Lock_Init())
         .SetReturn(MOCK_LOCK);
+    STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR));
+    EXPECTED_CALL(nn_bind(IGNORED_NUM_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR));
+    EXPECTED_CALL(nn_connect(IGNORED_NUM_ARG, IGNORED_PTR_ARG));
     EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .SetReturn(THREADAPI_OK);
 
     STRICT_EXPECTED_CALL(Lock(MOCK_LOCK))
         .SetFailReturn(LOCK_ERROR)
         .SetReturn(LOCK_OK);
+    STRICT_EXPECTED_CALL(nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, 1, NN_DONTWAIT))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(Unlock(MOCK_LOCK))
         .SetReturn(LOCK_ERROR);
+    EXPECTED_CALL(nn_close(IGNORED_NUM_ARG));
+    EXPECTED_CALL(nn_close(IGNORED_NUM_ARG));
     EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
 
     expected_calls_send_control_reply((CONTROL_MESSAGE_MODULE_REPLY *)&REPLY);
@@ -1985,6 +2275,81 @@ TEST_FUNCTION(connect_to_message_channel_SCENARIO_success)
     ProxyGateway_Detach(remote_module);
 }
 
+/* SRS_PROXY_GATEWAY_31_004: [If `MESSAGE_URI::uri_type` is `MESSAGE_URI_TYPE_SHM_RING`, then `connect_to_message_channel` shall attach to the shared memory ring named by `MESSAGE_URI::uri`, and bind an `NN_PAIR` message socket at `SHM_RING_FALLBACK_URI_HEAD` followed by the name of the ring for the messages too large for the ring] */
+/* SRS_PROXY_GATEWAY_31_005: [`disconnect_from_message_channel` shall detach from the shared memory ring, if any, by calling `void ShmRing_Destroy(SHM_RING_HANDLE ring)`] */
+TEST_FUNCTION(connect_to_message_channel_SCENARIO_shm_ring_success)
+{
+    // Arrange
+    static const MESSAGE_URI MESSAGE = {
+        sizeof("shm://proxy_gateway_ut"),
+        MESSAGE_URI_TYPE_SHM_RING,
+        "shm://proxy_gateway_ut"
+    };
+
+    int result;
+
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(ShmRing_Attach(MESSAGE.uri))
+        .SetReturn((SHM_RING_HANDLE)0x31);
+    STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR))
+        .SetReturn(1979);
+    STRICT_EXPECTED_CALL(nn_bind(1979, "ipc://proxy_gateway_ut"))
+        .SetReturn(917);
+    STRICT_EXPECTED_CALL(ShmRing_GetMaxRecordSize((SHM_RING_HANDLE)0x31));
+    STRICT_EXPECTED_CALL(ShmRing_Destroy((SHM_RING_HANDLE)0x31));
+    STRICT_EXPECTED_CALL(nn_shutdown(1979, 917));
+    STRICT_EXPECTED_CALL(nn_close(1979));
+
+    // Act
+    result = connect_to_message_channel(remote_module, &MESSAGE);
+    disconnect_from_message_channel(remote_module);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
+/* SRS_PROXY_GATEWAY_31_004: [If `MESSAGE_URI::uri_type` is `MESSAGE_URI_TYPE_SHM_RING`, then `connect_to_message_channel` shall attach to the shared memory ring named by `MESSAGE_URI::uri`, and bind an `NN_PAIR` message socket at `SHM_RING_FALLBACK_URI_HEAD` followed by the name of the ring for the messages too large for the ring] */
+TEST_FUNCTION(connect_to_message_channel_SCENARIO_shm_ring_socket_fails)
+{
+    // Arrange
+    static const MESSAGE_URI MESSAGE = {
+        sizeof("shm://proxy_gateway_ut"),
+        MESSAGE_URI_TYPE_SHM_RING,
+        "shm://proxy_gateway_ut"
+    };
+
+    int result;
+
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(ShmRing_Attach(MESSAGE.uri))
+        .SetReturn((SHM_RING_HANDLE)0x31);
+    STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR))
+        .SetReturn(-1);
+    STRICT_EXPECTED_CALL(ShmRing_Destroy((SHM_RING_HANDLE)0x31));
+
+    // Act
+    result = connect_to_message_channel(remote_module, &MESSAGE);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
 /* SRS_PROXY_GATEWAY_027_0xx: [If a call to `nn_socket` returns -1, then `connect_to_message_channel` shall free any previously allocated memory, abandon the control message and prepare for the next create message] */
 /* SRS_PROXY_GATEWAY_027_0xx: [If a call to `nn_connect` returns a negative value, then `connect_to_message_channel` shall free any previously allocated memory, abandon the control message and prepare for the next create message] */
 TEST_FUNCTION(connect_to_message_channel_SCENARIO_negative_tests)
@@ -2053,6 +2418,48 @@ TEST_FUNCTION(disconnect_from_message_channel_SCENARIO_success)
     ProxyGateway_Detach(remote_module);
 }
 
+/* Tests_SRS_PROXY_GATEWAY_31_039: [`disconnect_from_message_channel` shall free every message left in the publish queue, if any, complete each with `BROKER_ERROR` and empty the queue] */
+TEST_FUNCTION(disconnect_from_message_channel_SCENARIO_publish_queue_not_empty)
+{
+    // Arrange
+    static const MESSAGE_HANDLE MESSAGE = (MESSAGE_HANDLE)0x19790917;
+    static void * NN_MESSAGE_BUFFER = (void *)0xEBADF00D;
+    static const int32_t NN_MESSAGE_SIZE = 1979;
+
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+    EXPECTED_CALL(Lock_Init())
+        .SetReturn(MOCK_LOCK);
+    ASSERT_ARE_EQUAL(int, 0, ProxyGateway_EnableAsyncPublish(remote_module, 4, PROXY_GATEWAY_QUEUE_FULL_REJECT, publish_callback, NULL));
+    EXPECTED_CALL(Message_ToByteArray(MESSAGE, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .SetReturn(NN_MESSAGE_SIZE);
+    EXPECTED_CALL(nn_allocmsg(IGNORED_NUM_ARG, IGNORED_NUM_ARG))
+        .SetReturn(NN_MESSAGE_BUFFER);
+    EXPECTED_CALL(Message_ToByteArray(MESSAGE, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .SetReturn(NN_MESSAGE_SIZE);
+    ASSERT_ARE_EQUAL(int, BROKER_OK, Broker_Publish((BROKER_HANDLE)remote_module, MOCK_MODULE, MESSAGE));
+    publish_callback_count = 0;
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(Lock(MOCK_LOCK));
+    STRICT_EXPECTED_CALL(nn_freemsg(NN_MESSAGE_BUFFER));
+    STRICT_EXPECTED_CALL(Unlock(MOCK_LOCK));
+    expected_calls_disconnect_from_message_channel();
+
+    // Act
+    disconnect_from_message_channel(remote_module);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 1, publish_callback_count);
+    ASSERT_ARE_EQUAL(int, BROKER_ERROR, publish_callback_result);
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+    ASSERT_ARE_EQUAL(int, 1, publish_callback_count);
+}
+
 /* SRS_PROXY_GATEWAY_027_0xx: [Special Handling - If `Module_ParseConfigurationFromJson` was provided, `invoke_add_module_procedure` shall parse the configuration by calling `void * Module_ParseConfigurationFromJson(const char * configuration)` using the `CONTROL_MESSAGE_MODULE_CREATE::args` as `configuration`] */
 TEST_FUNCTION(invoke_add_module_procedure_SCENARIO_NULL_Module_ParseConfigurationFromJson)
 {
@@ -2570,6 +2977,763 @@ TEST_FUNCTION(publish_SCENARIO_create_message_success)
     ProxyGateway_Detach(remote_module);
 }
 
+/* Tests_SRS_PROXY_GATEWAY_31_009: [*Prerequisite Check* - If the `remote_module` parameter is `NULL`, then `ProxyGateway_EnableAsyncPublish` shall return a non-zero value] */
+TEST_FUNCTION(enableAsyncPublish_SCENARIO_NULL_handle)
+{
+    // Arrange
+    int result;
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+
+    // Act
+    result = ProxyGateway_EnableAsyncPublish(NULL, 16, PROXY_GATEWAY_QUEUE_FULL_REJECT, NULL, NULL);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+
+    // Cleanup
+}
+
+/* Tests_SRS_PROXY_GATEWAY_31_010: [*Prerequisite Check* - If `queue_size` is zero, then `ProxyGateway_EnableAsyncPublish` shall return a non-zero value] */
+TEST_FUNCTION(enableAsyncPublish_SCENARIO_zero_queue_size)
+{
+    // Arrange
+    int result;
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+
+    // Act
+    result = ProxyGateway_EnableAsyncPublish(remote_module, 0, PROXY_GATEWAY_QUEUE_FULL_REJECT, NULL, NULL);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
+/* Tests_SRS_PROXY_GATEWAY_31_011: [*Prerequisite Check* - If asynchronous publishing is already enabled, then `ProxyGateway_EnableAsyncPublish` shall return a non-zero value] */
+/* Tests_SRS_PROXY_GATEWAY_31_012: [`ProxyGateway_EnableAsyncPublish` shall allocate the publish queue and `queue_size` queue entries] */
+/* Tests_SRS_PROXY_GATEWAY_31_014: [`ProxyGateway_EnableAsyncPublish` shall create the queue mutex by calling `LOCK_HANDLE Lock_Init(void)`] */
+TEST_FUNCTION(enableAsyncPublish_SCENARIO_success)
+{
+    // Arrange
+    int result;
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    EXPECTED_CALL(gballoc_calloc(1, IGNORED_NUM_ARG));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(Lock_Init())
+        .SetReturn(MOCK_LOCK);
+
+    // Act
+    result = ProxyGateway_EnableAsyncPublish(remote_module, 16, PROXY_GATEWAY_QUEUE_FULL_REJECT, publish_callback, NULL);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_NOT_EQUAL(int, 0, ProxyGateway_EnableAsyncPublish(remote_module, 16, PROXY_GATEWAY_QUEUE_FULL_REJECT, publish_callback, NULL));
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
+/* Tests_SRS_PROXY_GATEWAY_31_013: [If any allocation fails, then `ProxyGateway_EnableAsyncPublish` shall free any previously allocated memory and return a non-zero value] */
+TEST_FUNCTION(enableAsyncPublish_SCENARIO_negative_tests)
+{
+    // Arrange
+    int negativeTestsInitResult = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
+
+    int result;
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    enableNegativeTest(negative_test_index++);
+    EXPECTED_CALL(gballoc_calloc(1, IGNORED_NUM_ARG))
+        .SetFailReturn(NULL);
+    enableNegativeTest(negative_test_index++);
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .SetFailReturn(NULL);
+    enableNegativeTest(negative_test_index++);
+    EXPECTED_CALL(Lock_Init())
+        .SetFailReturn(NULL)
+        .SetReturn(MOCK_LOCK);
+    umock_c_negative_tests_snapshot();
+
+    ASSERT_ARE_EQUAL(int, negative_test_index, umock_c_negative_tests_call_count());
+    for (size_t i = 0; i < umock_c_negative_tests_call_count(); ++i) {
+        if (skipNegativeTest(i)) {
+            printf("%s: Skipping negative tests: %zx\n", __FUNCTION__, i);
+            continue;
+        }
+        printf("%s: Running negative tests: %zx\n", __FUNCTION__, i);
+        umock_c_negative_tests_reset();
+        umock_c_negative_tests_fail_call(i);
+
+        // Act
+        result = ProxyGateway_EnableAsyncPublish(remote_module, 16, PROXY_GATEWAY_QUEUE_FULL_REJECT, NULL, NULL);
+
+        // Assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    }
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+    umock_c_negative_tests_deinit();
+}
+
+/* Tests_SRS_PROXY_GATEWAY_31_015: [ If asynchronous publishing is enabled, `Broker_Publish` shall serialize the message into a buffer allocated with `nn_allocmsg`. ] */
+/* Tests_SRS_PROXY_GATEWAY_31_016: [ If no message is queued, `Broker_Publish` shall attempt to send the message without blocking. ] */
+/* Tests_SRS_PROXY_GATEWAY_31_020: [ `Broker_Publish` shall invoke the completion callback with `BROKER_OK` for a message sent immediately, and not invoke it for a message it failed. ] */
+TEST_FUNCTION(publish_SCENARIO_async_sent_immediately)
+{
+    // Arrange
+    static const MESSAGE_URI MESSAGE_CHANNEL = {
+        sizeof("ipc://message_channel"),
+        NN_PAIR,
+        "ipc://message_channel"
+    };
+    static const MESSAGE_HANDLE MESSAGE = (MESSAGE_HANDLE)0x19790917;
+    static void * NN_MESSAGE_BUFFER = (void *)0xEBADF00D;
+    static const int32_t NN_MESSAGE_SIZE = 1979;
+    BROKER_RESULT result;
+
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+    expected_calls_connect_to_message_channel(&MESSAGE_CHANNEL);
+    ASSERT_ARE_EQUAL(int, 0, connect_to_message_channel(remote_module, &MESSAGE_CHANNEL));
+    EXPECTED_CALL(Lock_Init())
+        .SetReturn(MOCK_LOCK);
+    ASSERT_ARE_EQUAL(int, 0, ProxyGateway_EnableAsyncPublish(remote_module, 16, PROXY_GATEWAY_QUEUE_FULL_REJECT, publish_callback, NULL));
+    publish_callback_count = 0;
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(Message_ToByteArray(MESSAGE, NULL, 0))
+        .SetReturn(NN_MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(nn_allocmsg(NN_MESSAGE_SIZE, 0))
+        .SetReturn(NN_MESSAGE_BUFFER);
+    STRICT_EXPECTED_CALL(Message_ToByteArray(MESSAGE, (unsigned char *)NN_MESSAGE_BUFFER, NN_MESSAGE_SIZE))
+        .SetReturn(NN_MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(Lock(MOCK_LOCK));
+    STRICT_EXPECTED_CALL(nn_send(1979, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT))
+        .IgnoreArgument(2)
+        .SetReturn(NN_MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(Unlock(MOCK_LOCK));
+
+    // Act
+    result = Broker_Publish((BROKER_HANDLE)remote_module, MOCK_MODULE, MESSAGE);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, BROKER_OK, result);
+    ASSERT_ARE_EQUAL(int, 1, publish_callback_count);
+    ASSERT_ARE_EQUAL(int, BROKER_OK, publish_callback_result);
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
+/* Tests_SRS_PROXY_GATEWAY_31_003: [ If the message channel is a shared memory ring, `Broker_Publish` shall serialize the message directly into a record reserved with `ShmRing_BeginWrite` and publish it with `ShmRing_EndWrite`, without cloning the message. ] */
+TEST_FUNCTION(publish_SCENARIO_shm_ring_success)
+{
+    // Arrange
+    static const MESSAGE_URI MESSAGE_CHANNEL = {
+        sizeof("shm://proxy_gateway_ut"),
+        MESSAGE_URI_TYPE_SHM_RING,
+        "shm://proxy_gateway_ut"
+    };
+    static const MESSAGE_HANDLE MESSAGE = (MESSAGE_HANDLE)0x19790917;
+    static unsigned char RECORD[1979];
+    static const int32_t RECORD_SIZE = 1979;
+    BROKER_RESULT result;
+
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+    STRICT_EXPECTED_CALL(ShmRing_Attach(MESSAGE_CHANNEL.uri))
+        .SetReturn((SHM_RING_HANDLE)0x31);
+    ASSERT_ARE_EQUAL(int, 0, connect_to_message_channel(remote_module, &MESSAGE_CHANNEL));
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(Message_ToByteArray(MESSAGE, NULL, 0))
+        .SetReturn(RECORD_SIZE);
+    STRICT_EXPECTED_CALL(ShmRing_BeginWrite((SHM_RING_HANDLE)0x31, RECORD_SIZE, 1000))
+        .SetReturn(RECORD);
+    STRICT_EXPECTED_CALL(Message_ToByteArray(MESSAGE, RECORD, RECORD_SIZE))
+        .SetReturn(RECORD_SIZE);
+    STRICT_EXPECTED_CALL(ShmRing_EndWrite((SHM_RING_HANDLE)0x31))
+        .SetReturn(0);
+
+    // Act
+    result = Broker_Publish((BROKER_HANDLE)remote_module, MOCK_MODULE, MESSAGE);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, BROKER_OK, result);
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
+/* Tests_SRS_PROXY_GATEWAY_31_045: [ If the message channel is a shared memory ring, `Broker_Publish` shall send a message larger than `ShmRing_GetMaxRecordSize` on the message socket instead. ] */
+TEST_FUNCTION(publish_SCENARIO_shm_ring_sends_a_message_too_large_for_the_ring_on_the_socket)
+{
+    // Arrange
+    static const MESSAGE_URI MESSAGE_CHANNEL = {
+        sizeof("shm://proxy_gateway_ut"),
+        MESSAGE_URI_TYPE_SHM_RING,
+        "shm://proxy_gateway_ut"
+    };
+    static const MESSAGE_HANDLE MESSAGE = (MESSAGE_HANDLE)0x19790917;
+    static void * NN_MESSAGE_BUFFER = (void *)0xEBADF00D;
+    static const int32_t RECORD_SIZE = 1979;
+    BROKER_RESULT result;
+
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+    STRICT_EXPECTED_CALL(ShmRing_Attach(MESSAGE_CHANNEL.uri))
+        .SetReturn((SHM_RING_HANDLE)0x31);
+    STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR))
+        .SetReturn(1979);
+    STRICT_EXPECTED_CALL(ShmRing_GetMaxRecordSize((SHM_RING_HANDLE)0x31))
+        .SetReturn(RECORD_SIZE - 1);
+    ASSERT_ARE_EQUAL(int, 0, connect_to_message_channel(remote_module, &MESSAGE_CHANNEL));
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(Message_ToByteArray(MESSAGE, NULL, 0))
+        .SetReturn(RECORD_SIZE);
+    STRICT_EXPECTED_CALL(nn_allocmsg(RECORD_SIZE, 0))
+        .SetReturn(NN_MESSAGE_BUFFER);
+    STRICT_EXPECTED_CALL(Message_ToByteArray(MESSAGE, (unsigned char *)NN_MESSAGE_BUFFER, RECORD_SIZE))
+        .SetReturn(RECORD_SIZE);
+    STRICT_EXPECTED_CALL(nn_send(1979, IGNORED_PTR_ARG, NN_MSG, 0))
+        .IgnoreArgument(2)
+        .SetReturn(RECORD_SIZE);
+
+    // Act
+    result = Broker_Publish((BROKER_HANDLE)remote_module, MOCK_MODULE, MESSAGE);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, BROKER_OK, result);
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
+/* Tests_SRS_PROXY_GATEWAY_31_040: [ If the message channel is a shared memory ring and no message is queued, `Broker_Publish` shall serialize the message directly into a record reserved with `ShmRing_BeginWrite` without waiting, and queue it only if the ring is full. ] */
+/* Tests_SRS_PROXY_GATEWAY_31_020: [ `Broker_Publish` shall invoke the completion callback with `BROKER_OK` for a message sent immediately, and not invoke it for a message it failed. ] */
+TEST_FUNCTION(publish_SCENARIO_async_shm_ring_written_directly)
+{
+    // Arrange
+    static const MESSAGE_URI MESSAGE_CHANNEL = {
+        sizeof("shm://proxy_gateway_ut"),
+        MESSAGE_URI_TYPE_SHM_RING,
+        "shm://proxy_gateway_ut"
+    };
+    static const MESSAGE_HANDLE MESSAGE = (MESSAGE_HANDLE)0x19790917;
+    static unsigned char RECORD[1979];
+    static const int32_t RECORD_SIZE = 1979;
+    BROKER_RESULT result;
+
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+    STRICT_EXPECTED_CALL(ShmRing_Attach(MESSAGE_CHANNEL.uri))
+        .SetReturn((SHM_RING_HANDLE)0x31);
+    ASSERT_ARE_EQUAL(int, 0, connect_to_message_channel(remote_module, &MESSAGE_CHANNEL));
+    EXPECTED_CALL(Lock_Init())
+        .SetReturn(MOCK_LOCK);
+    ASSERT_ARE_EQUAL(int, 0, ProxyGateway_EnableAsyncPublish(remote_module, 16, PROXY_GATEWAY_QUEUE_FULL_REJECT, publish_callback, NULL));
+    publish_callback_count = 0;
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(Message_ToByteArray(MESSAGE, NULL, 0))
+        .SetReturn(RECORD_SIZE);
+    STRICT_EXPECTED_CALL(Lock(MOCK_LOCK));
+    STRICT_EXPECTED_CALL(ShmRing_BeginWrite((SHM_RING_HANDLE)0x31, RECORD_SIZE, 0))
+        .SetReturn(RECORD);
+    STRICT_EXPECTED_CALL(Message_ToByteArray(MESSAGE, RECORD, RECORD_SIZE))
+        .SetReturn(RECORD_SIZE);
+    STRICT_EXPECTED_CALL(ShmRing_EndWrite((SHM_RING_HANDLE)0x31))
+        .SetReturn(0);
+    STRICT_EXPECTED_CALL(Unlock(MOCK_LOCK));
+
+    // Act
+    result = Broker_Publish((BROKER_HANDLE)remote_module, MOCK_MODULE, MESSAGE);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, BROKER_OK, result);
+    ASSERT_ARE_EQUAL(int, 1, publish_callback_count);
+    ASSERT_ARE_EQUAL(int, BROKER_OK, publish_callback_result);
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
+/* Tests_SRS_PROXY_GATEWAY_31_017: [ If the message cannot be sent without blocking, `Broker_Publish` shall append it to the publish queue and return `BROKER_OK`. ] */
+/* Tests_SRS_PROXY_GATEWAY_31_018: [ If the queue is full and the policy is `PROXY_GATEWAY_QUEUE_FULL_REJECT`, `Broker_Publish` shall free the message and return `BROKER_ERROR`. ] */
+TEST_FUNCTION(publish_SCENARIO_async_queue_full_rejects)
+{
+    // Arrange
+    static const MESSAGE_HANDLE MESSAGE = (MESSAGE_HANDLE)0x19790917;
+    static void * NN_MESSAGE_BUFFER = (void *)0xEBADF00D;
+    static const int32_t NN_MESSAGE_SIZE = 1979;
+    BROKER_RESULT result;
+
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+    EXPECTED_CALL(Lock_Init())
+        .SetReturn(MOCK_LOCK);
+    ASSERT_ARE_EQUAL(int, 0, ProxyGateway_EnableAsyncPublish(remote_module, 1, PROXY_GATEWAY_QUEUE_FULL_REJECT, publish_callback, NULL));
+    publish_callback_count = 0;
+
+    // Not connected to the message channel yet, so the first message is queued
+    EXPECTED_CALL(Message_ToByteArray(MESSAGE, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .SetReturn(NN_MESSAGE_SIZE);
+    EXPECTED_CALL(nn_allocmsg(IGNORED_NUM_ARG, IGNORED_NUM_ARG))
+        .SetReturn(NN_MESSAGE_BUFFER);
+    EXPECTED_CALL(Message_ToByteArray(MESSAGE, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .SetReturn(NN_MESSAGE_SIZE);
+    ASSERT_ARE_EQUAL(int, BROKER_OK, Broker_Publish((BROKER_HANDLE)remote_module, MOCK_MODULE, MESSAGE));
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(Message_ToByteArray(MESSAGE, NULL, 0))
+        .SetReturn(NN_MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(nn_allocmsg(NN_MESSAGE_SIZE, 0))
+        .SetReturn(NN_MESSAGE_BUFFER);
+    STRICT_EXPECTED_CALL(Message_ToByteArray(MESSAGE, (unsigned char *)NN_MESSAGE_BUFFER, NN_MESSAGE_SIZE))
+        .SetReturn(NN_MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(Lock(MOCK_LOCK));
+    STRICT_EXPECTED_CALL(nn_freemsg(NN_MESSAGE_BUFFER));
+    STRICT_EXPECTED_CALL(Unlock(MOCK_LOCK));
+
+    // Act
+    result = Broker_Publish((BROKER_HANDLE)remote_module, MOCK_MODULE, MESSAGE);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, BROKER_ERROR, result);
+    ASSERT_ARE_EQUAL(int, 0, publish_callback_count);
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
+/* Tests_SRS_PROXY_GATEWAY_31_019: [ If the queue is full and the policy is `PROXY_GATEWAY_QUEUE_FULL_DROP_OLDEST`, `Broker_Publish` shall free the oldest queued message and complete it with `BROKER_ERROR`. ] */
+TEST_FUNCTION(publish_SCENARIO_async_queue_full_drops_oldest)
+{
+    // Arrange
+    static const MESSAGE_HANDLE MESSAGE = (MESSAGE_HANDLE)0x19790917;
+    static void * OLDEST_BUFFER = (void *)0xEBADF00D;
+    static void * NEWEST_BUFFER = (void *)0xDEADBEEF;
+    static const int32_t NN_MESSAGE_SIZE = 1979;
+    BROKER_RESULT result;
+
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+    EXPECTED_CALL(Lock_Init())
+        .SetReturn(MOCK_LOCK);
+    ASSERT_ARE_EQUAL(int, 0, ProxyGateway_EnableAsyncPublish(remote_module, 1, PROXY_GATEWAY_QUEUE_FULL_DROP_OLDEST, publish_callback, NULL));
+    publish_callback_count = 0;
+
+    EXPECTED_CALL(Message_ToByteArray(MESSAGE, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .SetReturn(NN_MESSAGE_SIZE);
+    EXPECTED_CALL(nn_allocmsg(IGNORED_NUM_ARG, IGNORED_NUM_ARG))
+        .SetReturn(OLDEST_BUFFER);
+    EXPECTED_CALL(Message_ToByteArray(MESSAGE, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .SetReturn(NN_MESSAGE_SIZE);
+    ASSERT_ARE_EQUAL(int, BROKER_OK, Broker_Publish((BROKER_HANDLE)remote_module, MOCK_MODULE, MESSAGE));
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(Message_ToByteArray(MESSAGE, NULL, 0))
+        .SetReturn(NN_MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(nn_allocmsg(NN_MESSAGE_SIZE, 0))
+        .SetReturn(NEWEST_BUFFER);
+    STRICT_EXPECTED_CALL(Message_ToByteArray(MESSAGE, (unsigned char *)NEWEST_BUFFER, NN_MESSAGE_SIZE))
+        .SetReturn(NN_MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(Lock(MOCK_LOCK));
+    STRICT_EXPECTED_CALL(nn_freemsg(OLDEST_BUFFER));
+    STRICT_EXPECTED_CALL(Unlock(MOCK_LOCK));
+
+    // Act
+    result = Broker_Publish((BROKER_HANDLE)remote_module, MOCK_MODULE, MESSAGE);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, BROKER_OK, result);
+    ASSERT_ARE_EQUAL(int, 1, publish_callback_count);
+    ASSERT_ARE_EQUAL(int, BROKER_ERROR, publish_callback_result);
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
+/* Tests_SRS_PROXY_GATEWAY_31_021: [`flush_publish_queue` shall send queued messages in order, without blocking, until the queue is empty or the channel would block, completing each message with `BROKER_OK` once sent or `BROKER_ERROR` if the send failed] */
+/* Tests_SRS_PROXY_GATEWAY_31_022: [`flush_publish_queue` shall return the number of messages taken off the queue] */
+TEST_FUNCTION(flush_publish_queue_SCENARIO_sends_queued_message)
+{
+    // Arrange
+    static const MESSAGE_URI MESSAGE_CHANNEL = {
+        sizeof("ipc://message_channel"),
+        NN_PAIR,
+        "ipc://message_channel"
+    };
+    static const MESSAGE_HANDLE MESSAGE = (MESSAGE_HANDLE)0x19790917;
+    static void * NN_MESSAGE_BUFFER = (void *)0xEBADF00D;
+    static const int32_t NN_MESSAGE_SIZE = 1979;
+    int result;
+
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+    EXPECTED_CALL(Lock_Init())
+        .SetReturn(MOCK_LOCK);
+    ASSERT_ARE_EQUAL(int, 0, ProxyGateway_EnableAsyncPublish(remote_module, 4, PROXY_GATEWAY_QUEUE_FULL_REJECT, publish_callback, NULL));
+    EXPECTED_CALL(Message_ToByteArray(MESSAGE, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .SetReturn(NN_MESSAGE_SIZE);
+    EXPECTED_CALL(nn_allocmsg(IGNORED_NUM_ARG, IGNORED_NUM_ARG))
+        .SetReturn(NN_MESSAGE_BUFFER);
+    EXPECTED_CALL(Message_ToByteArray(MESSAGE, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .SetReturn(NN_MESSAGE_SIZE);
+    ASSERT_ARE_EQUAL(int, BROKER_OK, Broker_Publish((BROKER_HANDLE)remote_module, MOCK_MODULE, MESSAGE));
+    expected_calls_connect_to_message_channel(&MESSAGE_CHANNEL);
+    ASSERT_ARE_EQUAL(int, 0, connect_to_message_channel(remote_module, &MESSAGE_CHANNEL));
+    publish_callback_count = 0;
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(Lock(MOCK_LOCK));
+    STRICT_EXPECTED_CALL(nn_send(1979, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT))
+        .IgnoreArgument(2)
+        .SetReturn(NN_MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(Unlock(MOCK_LOCK));
+    STRICT_EXPECTED_CALL(Lock(MOCK_LOCK));
+    STRICT_EXPECTED_CALL(Unlock(MOCK_LOCK));
+
+    // Act
+    result = flush_publish_queue(remote_module);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 1, result);
+    ASSERT_ARE_EQUAL(int, 1, publish_callback_count);
+    ASSERT_ARE_EQUAL(int, BROKER_OK, publish_callback_result);
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
+/* Tests_SRS_PROXY_GATEWAY_31_023: [If asynchronous publishing is enabled, then `ProxyGateway_Detach` shall attempt to send the queued messages once, complete any message left with `BROKER_ERROR` and free the publish queue] */
+TEST_FUNCTION(detach_SCENARIO_async_publish_queue_not_empty)
+{
+    // Arrange
+    static const MESSAGE_HANDLE MESSAGE = (MESSAGE_HANDLE)0x19790917;
+    static void * NN_MESSAGE_BUFFER = (void *)0xEBADF00D;
+    static const int32_t NN_MESSAGE_SIZE = 1979;
+
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+    EXPECTED_CALL(Lock_Init())
+        .SetReturn(MOCK_LOCK);
+    ASSERT_ARE_EQUAL(int, 0, ProxyGateway_EnableAsyncPublish(remote_module, 4, PROXY_GATEWAY_QUEUE_FULL_REJECT, publish_callback, NULL));
+    EXPECTED_CALL(Message_ToByteArray(MESSAGE, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .SetReturn(NN_MESSAGE_SIZE);
+    EXPECTED_CALL(nn_allocmsg(IGNORED_NUM_ARG, IGNORED_NUM_ARG))
+        .SetReturn(NN_MESSAGE_BUFFER);
+    EXPECTED_CALL(Message_ToByteArray(MESSAGE, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .SetReturn(NN_MESSAGE_SIZE);
+    ASSERT_ARE_EQUAL(int, BROKER_OK, Broker_Publish((BROKER_HANDLE)remote_module, MOCK_MODULE, MESSAGE));
+    publish_callback_count = 0;
+
+    // Act
+    ProxyGateway_Detach(remote_module);
+
+    // Assert
+    ASSERT_ARE_EQUAL(int, 1, publish_callback_count);
+    ASSERT_ARE_EQUAL(int, BROKER_ERROR, publish_callback_result);
+
+    // Cleanup
+}
+
+/* Tests_SRS_PROXY_GATEWAY_31_026: [If `connection_id` starts with "tcp://", then `ProxyGateway_Attach` shall use it unchanged as the connection string, otherwise it shall prefix it with "ipc://"] */
+TEST_FUNCTION(attach_SCENARIO_tcp_connection_id)
+{
+    // Arrange
+    static const int COMMAND_ENDPOINT = 917;
+    static const int COMMAND_SOCKET = 1979;
+    static const char CONTROL_CHANNEL_URI[] = "tcp://127.0.0.1:5555";
+
+    REMOTE_MODULE_HANDLE remote_module;
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    EXPECTED_CALL(gballoc_calloc(IGNORED_NUM_ARG, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(CONTROL_CHANNEL_URI)));
+    STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR))
+        .SetReturn(COMMAND_SOCKET);
+    STRICT_EXPECTED_CALL(nn_bind(COMMAND_SOCKET, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .SetReturn(COMMAND_ENDPOINT)
+        .ValidateArgumentBuffer(2, CONTROL_CHANNEL_URI, sizeof(CONTROL_CHANNEL_URI));
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // Act
+    remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, CONTROL_CHANNEL_URI);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NOT_NULL(remote_module);
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
+/* Tests_SRS_PROXY_GATEWAY_31_027: [*Prerequisite Check* - If the `remote_module` parameter is `NULL`, then `ProxyGateway_SetTcpOptions` shall return a non-zero value] */
+TEST_FUNCTION(setTcpOptions_SCENARIO_NULL_handle)
+{
+    // Arrange
+    static const PROXY_GATEWAY_TCP_OPTIONS OPTIONS = { 5000, 65536, 131072 };
+    int result;
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+
+    // Act
+    result = ProxyGateway_SetTcpOptions(NULL, &OPTIONS);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+
+    // Cleanup
+}
+
+/* Tests_SRS_PROXY_GATEWAY_31_028: [*Prerequisite Check* - If the `options` parameter is `NULL`, then `ProxyGateway_SetTcpOptions` shall return a non-zero value] */
+TEST_FUNCTION(setTcpOptions_SCENARIO_NULL_options)
+{
+    // Arrange
+    int result;
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "tcp://127.0.0.1:5555");
+    ASSERT_IS_NOT_NULL(remote_module);
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+
+    // Act
+    result = ProxyGateway_SetTcpOptions(remote_module, NULL);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
+/* Tests_SRS_PROXY_GATEWAY_31_029: [`ProxyGateway_SetTcpOptions` shall apply each non-zero buffer size to the control socket by calling `int nn_setsockopt(int s, int level, int option, const void * optval, size_t optvallen)` with `NN_SNDBUF` or `NN_RCVBUF` as `option`] */
+/* Tests_SRS_PROXY_GATEWAY_31_031: [If `keepalive_timeout` is not zero, `ProxyGateway_SetTcpOptions` shall create the keepalive clock, if not created yet, by calling `TICK_COUNTER_HANDLE tickcounter_create(void)`, and start the keepalive period] */
+/* Tests_SRS_PROXY_GATEWAY_31_034: [`ProxyGateway_Detach` shall destroy the keepalive clock, if any, by calling `void tickcounter_destroy(TICK_COUNTER_HANDLE tick_counter)`] */
+TEST_FUNCTION(setTcpOptions_SCENARIO_success)
+{
+    // Arrange
+    static const PROXY_GATEWAY_TCP_OPTIONS OPTIONS = { 5000, 65536, 131072 };
+    int result;
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "tcp://127.0.0.1:5555");
+    ASSERT_IS_NOT_NULL(remote_module);
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(nn_setsockopt(IGNORED_NUM_ARG, NN_SOL_SOCKET, NN_SNDBUF, IGNORED_PTR_ARG, sizeof(int)))
+        .IgnoreArgument(1)
+        .IgnoreArgument(4);
+    STRICT_EXPECTED_CALL(nn_setsockopt(IGNORED_NUM_ARG, NN_SOL_SOCKET, NN_RCVBUF, IGNORED_PTR_ARG, sizeof(int)))
+        .IgnoreArgument(1)
+        .IgnoreArgument(4);
+    EXPECTED_CALL(tickcounter_create())
+        .SetReturn(MOCK_TICKCOUNTER);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(MOCK_TICKCOUNTER, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+
+    // Act
+    result = ProxyGateway_SetTcpOptions(remote_module, &OPTIONS);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    // Cleanup
+    umock_c_reset_all_calls();
+    ProxyGateway_Detach(remote_module);
+    ASSERT_IS_TRUE(NULL != strstr(umock_c_get_actual_calls(), "[tickcounter_destroy("));
+}
+
+/* Tests_SRS_PROXY_GATEWAY_31_030: [If a call to `nn_setsockopt` fails, then `ProxyGateway_SetTcpOptions` shall return a non-zero value] */
+/* Tests_SRS_PROXY_GATEWAY_31_032: [If unable to create the keepalive clock, then `ProxyGateway_SetTcpOptions` shall return a non-zero value] */
+TEST_FUNCTION(setTcpOptions_SCENARIO_negative_tests)
+{
+    // Arrange
+    int negativeTestsInitResult = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
+
+    static const PROXY_GATEWAY_TCP_OPTIONS OPTIONS = { 5000, 65536, 131072 };
+    int result;
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "tcp://127.0.0.1:5555");
+    ASSERT_IS_NOT_NULL(remote_module);
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    enableNegativeTest(negative_test_index++);
+    EXPECTED_CALL(nn_setsockopt(IGNORED_NUM_ARG, NN_SOL_SOCKET, NN_SNDBUF, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .SetFailReturn(-1);
+    enableNegativeTest(negative_test_index++);
+    EXPECTED_CALL(nn_setsockopt(IGNORED_NUM_ARG, NN_SOL_SOCKET, NN_RCVBUF, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .SetFailReturn(-1);
+    enableNegativeTest(negative_test_index++);
+    EXPECTED_CALL(tickcounter_create())
+        .SetFailReturn(NULL)
+        .SetReturn(MOCK_TICKCOUNTER);
+    umock_c_negative_tests_snapshot();
+
+    ASSERT_ARE_EQUAL(int, negative_test_index, umock_c_negative_tests_call_count());
+    for (size_t i = 0; i < umock_c_negative_tests_call_count(); ++i) {
+        if (skipNegativeTest(i)) {
+            printf("%s: Skipping negative tests: %zx\n", __FUNCTION__, i);
+            continue;
+        }
+        printf("%s: Running negative tests: %zx\n", __FUNCTION__, i);
+        umock_c_negative_tests_reset();
+        umock_c_negative_tests_fail_call(i);
+
+        // Act
+        result = ProxyGateway_SetTcpOptions(remote_module, &OPTIONS);
+
+        // Assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    }
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+    umock_c_negative_tests_deinit();
+}
+
+/* Tests_SRS_PROXY_GATEWAY_31_036: [Control Channel - If the keepalive clock exists, then `ProxyGateway_DoWork` shall restart the keepalive period on every control message by calling `int tickcounter_get_current_ms(TICK_COUNTER_HANDLE tick_counter, tickcounter_ms_t * current_ms)`] */
+/* Tests_SRS_PROXY_GATEWAY_31_037: [Control Channel - If the message type is CONTROL_MESSAGE_TYPE_MODULE_PING, then `ProxyGateway_DoWork` shall send the message back to the gateway] */
+TEST_FUNCTION(doWork_SCENARIO_ping_message_echoed)
+{
+    // Arrange
+    static const PROXY_GATEWAY_TCP_OPTIONS OPTIONS = { 5000, 0, 0 };
+    static const CONTROL_MESSAGE PING_MESSAGE = {
+        CONTROL_MESSAGE_VERSION_CURRENT,
+        CONTROL_MESSAGE_TYPE_MODULE_PING
+    };
+    static const void * NN_MESSAGE_BUFFER = (void *)0xEBADF00D;
+    static const int32_t NN_MESSAGE_SIZE = 1979;
+
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "tcp://127.0.0.1:5555");
+    ASSERT_IS_NOT_NULL(remote_module);
+    EXPECTED_CALL(tickcounter_create())
+        .SetReturn(MOCK_TICKCOUNTER);
+    ASSERT_ARE_EQUAL(int, 0, ProxyGateway_SetTcpOptions(remote_module, &OPTIONS));
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT))
+        .CopyOutArgumentBuffer(2, &NN_MESSAGE_BUFFER, sizeof(void *))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetReturn(NN_MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(MOCK_TICKCOUNTER, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(ControlMessage_CreateFromByteArray((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG))
+        .IgnoreArgument(2)
+        .SetReturn((CONTROL_MESSAGE *)&PING_MESSAGE);
+    expected_calls_send_control_reply((const CONTROL_MESSAGE_MODULE_REPLY *)&PING_MESSAGE);
+    STRICT_EXPECTED_CALL(ControlMessage_Destroy((CONTROL_MESSAGE *)&PING_MESSAGE));
+    STRICT_EXPECTED_CALL(nn_freemsg((void *)NN_MESSAGE_BUFFER));
+
+    // Act
+    ProxyGateway_DoWork(remote_module);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
+/* Tests_SRS_PROXY_GATEWAY_31_035: [Control Channel - If no control message has been received for `keepalive_timeout` milliseconds, then `ProxyGateway_DoWork` shall destroy the module, disconnect from the message channel, and shutdown and re-bind the control channel] */
+TEST_FUNCTION(doWork_SCENARIO_keepalive_expired)
+{
+    // Arrange
+    static const PROXY_GATEWAY_TCP_OPTIONS OPTIONS = { 5000, 0, 0 };
+    static const char CONTROL_CHANNEL_URI[] = "tcp://127.0.0.1:5555";
+    static const int COMMAND_ENDPOINT = 917;
+    static const int COMMAND_SOCKET = 1979;
+    tickcounter_ms_t start_ms = 1000;
+    tickcounter_ms_t before_timeout_ms = 5999;
+    tickcounter_ms_t timeout_ms = 6000;
+
+    STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR))
+        .SetReturn(COMMAND_SOCKET);
+    STRICT_EXPECTED_CALL(nn_bind(COMMAND_SOCKET, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .SetReturn(COMMAND_ENDPOINT);
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, CONTROL_CHANNEL_URI);
+    ASSERT_IS_NOT_NULL(remote_module);
+    EXPECTED_CALL(tickcounter_create())
+        .SetReturn(MOCK_TICKCOUNTER);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(MOCK_TICKCOUNTER, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &start_ms, sizeof(tickcounter_ms_t));
+    ASSERT_ARE_EQUAL(int, 0, ProxyGateway_SetTcpOptions(remote_module, &OPTIONS));
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(nn_recv(COMMAND_SOCKET, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT))
+        .IgnoreArgument(2)
+        .SetReturn(-1);
+    STRICT_EXPECTED_CALL(nn_errno())
+        .SetReturn(EAGAIN);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(MOCK_TICKCOUNTER, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &before_timeout_ms, sizeof(tickcounter_ms_t));
+    STRICT_EXPECTED_CALL(nn_recv(COMMAND_SOCKET, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT))
+        .IgnoreArgument(2)
+        .SetReturn(-1);
+    STRICT_EXPECTED_CALL(nn_errno())
+        .SetReturn(EAGAIN);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(MOCK_TICKCOUNTER, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &timeout_ms, sizeof(tickcounter_ms_t));
+    STRICT_EXPECTED_CALL(nn_shutdown(COMMAND_SOCKET, COMMAND_ENDPOINT));
+    STRICT_EXPECTED_CALL(nn_bind(COMMAND_SOCKET, CONTROL_CHANNEL_URI))
+        .SetReturn(COMMAND_ENDPOINT);
+
+    // Act
+    ProxyGateway_DoWork(remote_module);
+    ProxyGateway_DoWork(remote_module);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
 
 /* SRS_PROXY_GATEWAY_027_0xx: [`worker_thread` shall obtain the thread mutex in order to initialize the thread by calling `LOCK_RESULT Lock(LOCK_HANDLE handle)`] */
 /* SRS_PROXY_GATEWAY_027_0xx: [If unable to obtain the mutex, then `worker_thread` shall return a non-zero value] */
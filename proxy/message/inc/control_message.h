@@ -25,12 +25,18 @@ extern "C"
 #define CONTROL_MESSAGE_VERSION_1           0x01
 #define CONTROL_MESSAGE_VERSION_CURRENT     CONTROL_MESSAGE_VERSION_1
 
+/** @brief    `MESSAGE_URI::uri_type` value selecting the shared memory message
+ *            channel (see shm_ring.h). Any other value is a nanomsg protocol.
+ */
+#define MESSAGE_URI_TYPE_SHM_RING           0xFE
+
 #define CONTROL_MESSAGE_TYPE_VALUES      \
     CONTROL_MESSAGE_TYPE_ERROR,          \
     CONTROL_MESSAGE_TYPE_MODULE_CREATE,  \
     CONTROL_MESSAGE_TYPE_MODULE_REPLY, \
     CONTROL_MESSAGE_TYPE_MODULE_START,   \
-    CONTROL_MESSAGE_TYPE_MODULE_DESTROY
+    CONTROL_MESSAGE_TYPE_MODULE_DESTROY, \
+    CONTROL_MESSAGE_TYPE_MODULE_PING
 
 /** @brief    Enumeration specifying the various types of control messages that
  *            can be sent from a gateway process to a module host process.
@@ -61,7 +67,8 @@ typedef struct MESSAGE_URI_TAG
      */
     uint32_t  uri_size;
 
-    /** @brief  Type of URL.
+    /** @brief  Type of URL. A nanomsg protocol (e.g. NN_PAIR), or
+     *          MESSAGE_URI_TYPE_SHM_RING for the shared memory channel.
      */
     uint8_t  uri_type;
 
@@ -0,0 +1,162 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file       shm_ring.h
+ *  @brief      Shared memory transport for the out of process message channel.
+ *
+ *  @details    A shared memory segment holds two single producer, single
+ *              consumer byte rings, one per direction. The side that creates
+ *              the segment (the gateway) writes to the first ring and reads
+ *              from the second; the side that attaches (the module host) does
+ *              the opposite. The writer serializes a gateway message straight
+ *              into its record, and the reader deserializes it, which copies
+ *              it out, before releasing the record; no other buffer is
+ *              allocated. Waiting readers and writers are woken with futexes
+ *              on the ring indexes.
+ *
+ *              A record takes at most half of the ring, see
+ *              #ShmRing_GetMaxRecordSize; larger messages go over a nanomsg
+ *              pair socket named by #SHM_RING_FALLBACK_URI_HEAD and the name
+ *              of the segment, which both sides open along with the ring.
+ *
+ *              Attaching again, e.g. after the module host restarted,
+ *              supersedes the handles attached before, so two module hosts
+ *              never take the same record.
+ *
+ *              The transport is only available on Linux. On other platforms
+ *              every function fails and the out of process modules fall back
+ *              to nanomsg.
+ */
+
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#ifdef __cplusplus
+#include <cstdint>
+#include <cstddef>
+extern "C"
+{
+#else
+#include <stdint.h>
+#include <stddef.h>
+#endif
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#include "gateway_export.h"
+
+/** @brief  URI scheme which selects the shared memory message channel. */
+#define SHM_RING_URI_HEAD "shm://"
+#define SHM_RING_URI_HEAD_SIZE 6
+
+/** @brief  URI scheme of the socket carrying the messages too large for the
+ *          ring; the name of the segment follows it. */
+#define SHM_RING_FALLBACK_URI_HEAD "ipc://"
+
+/** @brief  Size of a buffer large enough for any fallback socket URI. */
+#define SHM_RING_FALLBACK_URI_SIZE (sizeof(SHM_RING_FALLBACK_URI_HEAD) + 255)
+
+/** @brief  Default size in bytes of each direction of the ring. */
+#define SHM_RING_DEFAULT_CAPACITY (1024 * 1024)
+
+typedef struct SHM_RING_TAG* SHM_RING_HANDLE;
+
+/** @brief      Creates a new shared memory segment for the message channel.
+ *
+ *  @param      uri         A "shm://<name>" URI naming the segment.
+ *  @param      capacity    Size in bytes of each direction. Rounded up to a
+ *                          power of two.
+ *
+ *  @return     A valid #SHM_RING_HANDLE, or NULL upon failure.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT SHM_RING_HANDLE, ShmRing_Create, const char*, uri, uint32_t, capacity);
+
+/** @brief      Attaches to a segment previously created with #ShmRing_Create.
+ *
+ *  @details    Every handle attached to the segment before fails from then
+ *              on, leaving both rings to the new handle.
+ *
+ *  @param      uri         The "shm://<name>" URI given to #ShmRing_Create.
+ *
+ *  @return     A valid #SHM_RING_HANDLE, or NULL upon failure.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT SHM_RING_HANDLE, ShmRing_Attach, const char*, uri);
+
+/** @brief      Unmaps the segment. The creator also removes the segment name.
+ *
+ *  @param      ring        The ring to destroy.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT void, ShmRing_Destroy, SHM_RING_HANDLE, ring);
+
+/** @brief      Reserves space for one record in the outgoing ring.
+ *
+ *  @details    Blocks until enough space is free or the timeout expires. On
+ *              success the caller owns the writer side of the ring until it
+ *              calls #ShmRing_EndWrite or #ShmRing_CancelWrite.
+ *
+ *  @param      ring        The ring to write to.
+ *  @param      size        The size of the record.
+ *  @param      timeout_ms  How long to wait for free space; zero does not wait.
+ *
+ *  @return     A pointer to `size` writable bytes, or NULL upon failure or
+ *              timeout. A record larger than #ShmRing_GetMaxRecordSize
+ *              always fails.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT unsigned char*, ShmRing_BeginWrite, SHM_RING_HANDLE, ring, int32_t, size, unsigned int, timeout_ms);
+
+/** @brief      Publishes the record reserved by #ShmRing_BeginWrite and wakes
+ *              the reader.
+ *
+ *  @return     Zero on success, non-zero otherwise.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT int, ShmRing_EndWrite, SHM_RING_HANDLE, ring);
+
+/** @brief      Releases the reservation made by #ShmRing_BeginWrite without
+ *              publishing it.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT void, ShmRing_CancelWrite, SHM_RING_HANDLE, ring);
+
+/** @brief      Gets the next record from the incoming ring.
+ *
+ *  @details    The record stays in the ring, and `data` stays valid, until
+ *              the caller calls #ShmRing_EndRead. A corrupt record header
+ *              drops every record published so far, so the reader carries on
+ *              with the next record written.
+ *
+ *  @param      ring        The ring to read from.
+ *  @param      data        Receives a pointer to the record.
+ *  @param      timeout_ms  How long to wait for a record; zero does not wait.
+ *
+ *  @return     The size of the record, zero if the timeout expired, or a
+ *              negative value upon failure.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT int32_t, ShmRing_BeginRead, SHM_RING_HANDLE, ring, const unsigned char**, data, unsigned int, timeout_ms);
+
+/** @brief      Releases the record returned by #ShmRing_BeginRead and wakes
+ *              the writer.
+ *
+ *  @return     Zero on success. Non-zero if the segment was attached again
+ *              since, or another reader released the record first; the
+ *              caller must then drop the record, which is not its to deliver.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT int, ShmRing_EndRead, SHM_RING_HANDLE, ring);
+
+/** @brief      Gets the size of the largest record #ShmRing_BeginWrite
+ *              accepts, half of the ring less the record header.
+ *
+ *  @return     The size, or a negative value upon failure.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT int32_t, ShmRing_GetMaxRecordSize, SHM_RING_HANDLE, ring);
+
+/** @brief      Wakes a thread of this process waiting in #ShmRing_BeginRead.
+ *
+ *  @details    The wait ends at once with no record. If no thread is waiting,
+ *              the next wait on `ring` ends at once instead.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT void, ShmRing_Wake, SHM_RING_HANDLE, ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*SHM_RING_H*/
@@ -281,10 +281,12 @@ CONTROL_MESSAGE * ControlMessage_CreateFromByteArray(const unsigned char* source
                 }
                 else if (
                         (messageType == CONTROL_MESSAGE_TYPE_MODULE_START) || 
-                        (messageType == CONTROL_MESSAGE_TYPE_MODULE_DESTROY)
+                        (messageType == CONTROL_MESSAGE_TYPE_MODULE_DESTROY) ||
+                        (messageType == CONTROL_MESSAGE_TYPE_MODULE_PING)
                         )
                 {
 					/*Codes_SRS_CONTROL_MESSAGE_17_023: [ This function shall allocate a CONTROL_MESSAGE structure. ]*/
+					/*Codes_SRS_CONTROL_MESSAGE_31_001: [ A `CONTROL_MESSAGE_TYPE_MODULE_PING` message has no body and shall be parsed as a `CONTROL_MESSAGE` structure. ]*/
                     result = (CONTROL_MESSAGE *)malloc(sizeof(CONTROL_MESSAGE));
                     if (result != NULL)
                     {
@@ -415,7 +417,8 @@ int32_t ControlMessage_ToByteArray(CONTROL_MESSAGE * message, unsigned char* buf
         }
         else if (
                  (message->type == CONTROL_MESSAGE_TYPE_MODULE_START) || 
-                 (message->type == CONTROL_MESSAGE_TYPE_MODULE_DESTROY)
+                 (message->type == CONTROL_MESSAGE_TYPE_MODULE_DESTROY) ||
+                 (message->type == CONTROL_MESSAGE_TYPE_MODULE_PING)
                 )
         {
             /* no additional fields */
@@ -0,0 +1,685 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "shm_ring.h"
+
+#if defined(__linux__)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define SHM_RING_MAGIC 0x474E5252
+#define SHM_RING_MIN_CAPACITY 4096
+#define SHM_RING_MAX_CAPACITY 0x40000000
+#define SHM_RING_RECORD_HEADER_SIZE 8
+#define SHM_RING_WRAP_MARKER 0xFFFFFFFF
+
+#define SHM_RING_ALIGN(size) (((size) + (SHM_RING_RECORD_HEADER_SIZE - 1)) & ~(uint32_t)(SHM_RING_RECORD_HEADER_SIZE - 1))
+
+/* One direction. head and tail are free running byte counters; the writer
+ * only moves head and the reader only moves tail. */
+typedef struct SHM_RING_CONTROL_TAG
+{
+    uint32_t head;
+    uint32_t reader_waiting;
+    /* the reader sleeps on it, the writer and ShmRing_Wake bump it to wake the reader */
+    uint32_t reader_doorbell;
+    uint8_t head_padding[52];
+    uint32_t tail;
+    uint32_t writer_waiting;
+    uint8_t tail_padding[56];
+} SHM_RING_CONTROL;
+
+/* Layout of the shared segment, followed by 2 * capacity bytes of data. */
+typedef struct SHM_RING_SEGMENT_TAG
+{
+    uint32_t magic;
+    uint32_t capacity;
+    /* bumped by every attach; a handle attached earlier is superseded */
+    uint32_t generation;
+    uint8_t padding[52];
+    SHM_RING_CONTROL control[2];
+} SHM_RING_SEGMENT;
+
+typedef struct SHM_RING_TAG
+{
+    SHM_RING_SEGMENT* segment;
+    size_t segment_size;
+    char* name;
+    bool is_owner;
+    uint32_t capacity;
+    uint32_t generation;
+
+    SHM_RING_CONTROL* tx;
+    unsigned char* tx_data;
+    SHM_RING_CONTROL* rx;
+    unsigned char* rx_data;
+
+    LOCK_HANDLE write_lock;
+    uint32_t pending_write_head;
+    uint32_t pending_write_offset;
+    uint32_t pending_write_size;
+    uint32_t pending_read_start;
+    uint32_t pending_read_tail;
+    uint32_t woken;
+} SHM_RING;
+
+static uint64_t shm_ring_now_ms(void)
+{
+    struct timespec now;
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000) + ((uint64_t)now.tv_nsec / 1000000);
+}
+
+/* Blocks while *word == value, at most timeout_ms. The waiting flag lets the
+ * peer skip the wake system call when nobody is asleep. */
+static void shm_ring_wait(uint32_t* word, uint32_t value, uint32_t* waiting, unsigned int timeout_ms)
+{
+    __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(word, __ATOMIC_SEQ_CST) == value)
+    {
+        struct timespec timeout;
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_nsec = (long)(timeout_ms % 1000) * 1000000L;
+        (void)syscall(SYS_futex, word, FUTEX_WAIT, value, &timeout, NULL, 0);
+    }
+    __atomic_store_n(waiting, 0, __ATOMIC_SEQ_CST);
+}
+
+/* Moves the tail of the incoming ring from start to value and wakes a waiting
+ * writer. The move fails if another reader moved the tail first, so a record
+ * is never released, and handed over, twice. */
+static bool shm_ring_release(SHM_RING_HANDLE ring, uint32_t start, uint32_t value)
+{
+    bool result = __atomic_compare_exchange_n(&ring->rx->tail, &start, value, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    if (result && __atomic_load_n(&ring->rx->writer_waiting, __ATOMIC_SEQ_CST) != 0)
+    {
+        (void)syscall(SYS_futex, &ring->rx->tail, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    }
+    return result;
+}
+
+/* True once the module host attached again, e.g. after a restart: the rings
+ * then belong to the new handle and this one must stop using them. */
+static bool shm_ring_is_superseded(SHM_RING_HANDLE ring)
+{
+    return !ring->is_owner && __atomic_load_n(&ring->segment->generation, __ATOMIC_ACQUIRE) != ring->generation;
+}
+
+static void shm_ring_ring_doorbell(SHM_RING_CONTROL* control)
+{
+    (void)__atomic_add_fetch(&control->reader_doorbell, 1, __ATOMIC_SEQ_CST);
+    (void)syscall(SYS_futex, &control->reader_doorbell, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/* Blocks while the incoming ring holds no record past head and the ring was
+ * not woken, at most timeout_ms. The reader sleeps on the doorbell rather than
+ * on head, so both the writer and ShmRing_Wake can wake it: the doorbell is
+ * read before the checks, a bump after them makes the futex return at once. */
+static void shm_ring_wait_reader(SHM_RING_HANDLE ring, uint32_t head, unsigned int timeout_ms)
+{
+    uint32_t doorbell = __atomic_load_n(&ring->rx->reader_doorbell, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&ring->rx->reader_waiting, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->rx->head, __ATOMIC_SEQ_CST) == head &&
+        __atomic_load_n(&ring->woken, __ATOMIC_SEQ_CST) == 0)
+    {
+        struct timespec timeout;
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_nsec = (long)(timeout_ms % 1000) * 1000000L;
+        (void)syscall(SYS_futex, &ring->rx->reader_doorbell, FUTEX_WAIT, doorbell, &timeout, NULL, 0);
+    }
+    __atomic_store_n(&ring->rx->reader_waiting, 0, __ATOMIC_SEQ_CST);
+}
+
+static char* shm_ring_name_from_uri(const char* uri)
+{
+    char* result;
+    if (uri == NULL || strncmp(uri, SHM_RING_URI_HEAD, SHM_RING_URI_HEAD_SIZE) != 0)
+    {
+        LogError("not a shared memory uri: %s", uri == NULL ? "NULL" : uri);
+        result = NULL;
+    }
+    else
+    {
+        const char* id = uri + SHM_RING_URI_HEAD_SIZE;
+        size_t id_length = strlen(id);
+        /* shm_open wants a single path component with a leading slash */
+        if (id_length == 0 || id_length >= NAME_MAX || strchr(id, '/') != NULL)
+        {
+            LogError("invalid shared memory name: %s", id);
+            result = NULL;
+        }
+        else if ((result = (char*)malloc(id_length + 2)) == NULL)
+        {
+            LogError("unable to allocate shared memory name");
+        }
+        else
+        {
+            result[0] = '/';
+            (void)memcpy(result + 1, id, id_length + 1);
+        }
+    }
+    return result;
+}
+
+static SHM_RING_HANDLE shm_ring_map(char* name, int fd, size_t segment_size, bool is_owner)
+{
+    SHM_RING_HANDLE result = (SHM_RING_HANDLE)calloc(1, sizeof(SHM_RING));
+    if (result == NULL)
+    {
+        LogError("unable to allocate shared memory ring");
+    }
+    else if ((result->write_lock = Lock_Init()) == NULL)
+    {
+        LogError("unable to create shared memory ring lock");
+        free(result);
+        result = NULL;
+    }
+    else
+    {
+        void* segment = mmap(NULL, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (segment == MAP_FAILED)
+        {
+            LogError("unable to map shared memory segment %s, errno = %d", name, errno);
+            (void)Lock_Deinit(result->write_lock);
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            result->segment = (SHM_RING_SEGMENT*)segment;
+            result->segment_size = segment_size;
+            result->name = name;
+            result->is_owner = is_owner;
+        }
+    }
+    return result;
+}
+
+static void shm_ring_assign_directions(SHM_RING_HANDLE ring, uint32_t capacity)
+{
+    unsigned char* data = (unsigned char*)ring->segment + sizeof(SHM_RING_SEGMENT);
+    int tx_index = ring->is_owner ? 0 : 1;
+
+    ring->capacity = capacity;
+    ring->tx = &ring->segment->control[tx_index];
+    ring->tx_data = data + ((size_t)tx_index * capacity);
+    ring->rx = &ring->segment->control[1 - tx_index];
+    ring->rx_data = data + ((size_t)(1 - tx_index) * capacity);
+}
+
+SHM_RING_HANDLE ShmRing_Create(const char* uri, uint32_t capacity)
+{
+    SHM_RING_HANDLE result;
+    char* name;
+
+    /*Codes_SRS_SHM_RING_31_001: [ If `uri` is NULL or does not start with "shm://", this function shall return NULL. ]*/
+    if ((name = shm_ring_name_from_uri(uri)) == NULL)
+    {
+        result = NULL;
+    }
+    else
+    {
+        /*Codes_SRS_SHM_RING_31_002: [ This function shall round `capacity` up to a power of two no smaller than 4096 bytes. ]*/
+        uint32_t rounded = SHM_RING_MIN_CAPACITY;
+        while (rounded < capacity && rounded < SHM_RING_MAX_CAPACITY)
+        {
+            rounded <<= 1;
+        }
+
+        /*Codes_SRS_SHM_RING_31_003: [ This function shall create a shared memory object named after the uri, replacing a stale object of the same name. ]*/
+        int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+        if (fd < 0 && errno == EEXIST)
+        {
+            (void)shm_unlink(name);
+            fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+        }
+
+        if (fd < 0)
+        {
+            /*Codes_SRS_SHM_RING_31_004: [ If any step fails, this function shall release all resources and return NULL. ]*/
+            LogError("unable to create shared memory object %s, errno = %d", name, errno);
+            free(name);
+            result = NULL;
+        }
+        else
+        {
+            size_t segment_size = sizeof(SHM_RING_SEGMENT) + (2 * (size_t)rounded);
+            if (ftruncate(fd, (off_t)segment_size) != 0)
+            {
+                /*Codes_SRS_SHM_RING_31_004: [ If any step fails, this function shall release all resources and return NULL. ]*/
+                LogError("unable to size shared memory object %s, errno = %d", name, errno);
+                (void)shm_unlink(name);
+                free(name);
+                result = NULL;
+            }
+            else if ((result = shm_ring_map(name, fd, segment_size, true)) == NULL)
+            {
+                /*Codes_SRS_SHM_RING_31_004: [ If any step fails, this function shall release all resources and return NULL. ]*/
+                (void)shm_unlink(name);
+                free(name);
+            }
+            else
+            {
+                /*Codes_SRS_SHM_RING_31_005: [ This function shall initialize both rings empty and publish the segment header last. ]*/
+                (void)memset(result->segment->control, 0, sizeof(result->segment->control));
+                result->segment->capacity = rounded;
+                result->segment->generation = 0;
+                __atomic_store_n(&result->segment->magic, SHM_RING_MAGIC, __ATOMIC_RELEASE);
+                shm_ring_assign_directions(result, rounded);
+            }
+            (void)close(fd);
+        }
+    }
+
+    return result;
+}
+
+SHM_RING_HANDLE ShmRing_Attach(const char* uri)
+{
+    SHM_RING_HANDLE result;
+    char* name;
+
+    /*Codes_SRS_SHM_RING_31_006: [ If `uri` is NULL or does not start with "shm://", this function shall return NULL. ]*/
+    if ((name = shm_ring_name_from_uri(uri)) == NULL)
+    {
+        result = NULL;
+    }
+    else
+    {
+        struct stat segment_stat;
+        int fd = shm_open(name, O_RDWR, 0);
+        if (fd < 0)
+        {
+            /*Codes_SRS_SHM_RING_31_007: [ If the segment does not exist or cannot be mapped, this function shall return NULL. ]*/
+            LogError("unable to open shared memory object %s, errno = %d", name, errno);
+            free(name);
+            result = NULL;
+        }
+        else
+        {
+            if (fstat(fd, &segment_stat) != 0 || (size_t)segment_stat.st_size < sizeof(SHM_RING_SEGMENT))
+            {
+                /*Codes_SRS_SHM_RING_31_007: [ If the segment does not exist or cannot be mapped, this function shall return NULL. ]*/
+                LogError("shared memory object %s is too small", name);
+                free(name);
+                result = NULL;
+            }
+            else if ((result = shm_ring_map(name, fd, (size_t)segment_stat.st_size, false)) == NULL)
+            {
+                free(name);
+            }
+            else
+            {
+                uint32_t capacity = result->segment->capacity;
+                /*Codes_SRS_SHM_RING_31_008: [ This function shall validate the segment header against the size of the segment. ]*/
+                if (__atomic_load_n(&result->segment->magic, __ATOMIC_ACQUIRE) != SHM_RING_MAGIC ||
+                    capacity < SHM_RING_MIN_CAPACITY ||
+                    (capacity & (capacity - 1)) != 0 ||
+                    sizeof(SHM_RING_SEGMENT) + (2 * (size_t)capacity) != result->segment_size)
+                {
+                    LogError("shared memory object %s has an invalid header", name);
+                    ShmRing_Destroy(result);
+                    result = NULL;
+                }
+                else
+                {
+                    /*Codes_SRS_SHM_RING_31_027: [ This function shall supersede the handles attached to the segment before. ]*/
+                    result->generation = __atomic_add_fetch(&result->segment->generation, 1, __ATOMIC_SEQ_CST);
+                    shm_ring_assign_directions(result, capacity);
+                }
+            }
+            (void)close(fd);
+        }
+    }
+
+    return result;
+}
+
+void ShmRing_Destroy(SHM_RING_HANDLE ring)
+{
+    /*Codes_SRS_SHM_RING_31_009: [ If `ring` is NULL, this function shall do nothing. ]*/
+    if (ring != NULL)
+    {
+        /*Codes_SRS_SHM_RING_31_010: [ This function shall unmap the segment, and the creator shall also unlink the shared memory object. ]*/
+        (void)munmap(ring->segment, ring->segment_size);
+        if (ring->is_owner)
+        {
+            (void)shm_unlink(ring->name);
+        }
+        (void)Lock_Deinit(ring->write_lock);
+        free(ring->name);
+        free(ring);
+    }
+}
+
+unsigned char* ShmRing_BeginWrite(SHM_RING_HANDLE ring, int32_t size, unsigned int timeout_ms)
+{
+    unsigned char* result;
+
+    if (ring == NULL || size < 0)
+    {
+        /*Codes_SRS_SHM_RING_31_011: [ If `ring` is NULL or `size` is negative, this function shall return NULL. ]*/
+        LogError("invalid arguments ring = %p, size = %d", ring, (int)size);
+        result = NULL;
+    }
+    else if (SHM_RING_ALIGN((uint32_t)size + SHM_RING_RECORD_HEADER_SIZE) > ring->capacity / 2)
+    {
+        /*Codes_SRS_SHM_RING_31_012: [ If the record would take more than half of the ring, this function shall return NULL. ]*/
+        LogError("record of %d bytes does not fit a ring of %u bytes", (int)size, ring->capacity);
+        result = NULL;
+    }
+    else if (shm_ring_is_superseded(ring))
+    {
+        /*Codes_SRS_SHM_RING_31_028: [ If the segment was attached again after `ring`, this function shall return NULL. ]*/
+        LogError("shared memory ring %s was attached again", ring->name);
+        result = NULL;
+    }
+    else if (Lock(ring->write_lock) != LOCK_OK)
+    {
+        LogError("unable to lock the ring writer");
+        result = NULL;
+    }
+    else
+    {
+        uint32_t record_size = SHM_RING_ALIGN((uint32_t)size + SHM_RING_RECORD_HEADER_SIZE);
+        uint32_t head = __atomic_load_n(&ring->tx->head, __ATOMIC_RELAXED);
+        uint32_t offset = head & (ring->capacity - 1);
+        uint32_t contiguous = ring->capacity - offset;
+        /* a record never straddles the end; the remainder is skipped instead */
+        uint32_t needed = (record_size > contiguous) ? (record_size + contiguous) : record_size;
+        uint64_t deadline = shm_ring_now_ms() + timeout_ms;
+
+        result = NULL;
+        for (;;)
+        {
+            uint32_t tail = __atomic_load_n(&ring->tx->tail, __ATOMIC_ACQUIRE);
+            if (ring->capacity - (head - tail) >= needed)
+            {
+                if (record_size > contiguous)
+                {
+                    *(uint32_t*)(ring->tx_data + offset) = SHM_RING_WRAP_MARKER;
+                    head += contiguous;
+                    offset = 0;
+                }
+                ring->pending_write_offset = offset;
+                ring->pending_write_head = head + record_size;
+                ring->pending_write_size = (uint32_t)size;
+                /*Codes_SRS_SHM_RING_31_013: [ This function shall return a pointer to `size` bytes inside the outgoing ring and keep the writer locked. ]*/
+                result = ring->tx_data + offset + SHM_RING_RECORD_HEADER_SIZE;
+                break;
+            }
+            else
+            {
+                uint64_t now = shm_ring_now_ms();
+                if (now >= deadline)
+                {
+                    break;
+                }
+                /*Codes_SRS_SHM_RING_31_014: [ If the ring is full, this function shall wait up to `timeout_ms` for the reader to release space. ]*/
+                shm_ring_wait(&ring->tx->tail, tail, &ring->tx->writer_waiting, (unsigned int)(deadline - now));
+            }
+        }
+
+        if (result == NULL)
+        {
+            /*Codes_SRS_SHM_RING_31_015: [ If no space was released before the timeout, this function shall unlock the writer and return NULL. ]*/
+            (void)Unlock(ring->write_lock);
+        }
+    }
+
+    return result;
+}
+
+int ShmRing_EndWrite(SHM_RING_HANDLE ring)
+{
+    int result;
+    if (ring == NULL)
+    {
+        /*Codes_SRS_SHM_RING_31_016: [ If `ring` is NULL, this function shall return a non-zero value. ]*/
+        LogError("ring is NULL");
+        result = __LINE__;
+    }
+    else if (shm_ring_is_superseded(ring))
+    {
+        /*Codes_SRS_SHM_RING_31_029: [ If the segment was attached again after `ring`, this function shall unlock the writer without publishing the record and return a non-zero value. ]*/
+        LogError("shared memory ring %s was attached again", ring->name);
+        (void)Unlock(ring->write_lock);
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_SHM_RING_31_017: [ This function shall store the record size, publish the new head and wake a waiting reader. ]*/
+        *(uint32_t*)(ring->tx_data + ring->pending_write_offset) = ring->pending_write_size;
+        __atomic_store_n(&ring->tx->head, ring->pending_write_head, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&ring->tx->reader_waiting, __ATOMIC_SEQ_CST) != 0)
+        {
+            shm_ring_ring_doorbell(ring->tx);
+        }
+        (void)Unlock(ring->write_lock);
+        result = 0;
+    }
+    return result;
+}
+
+void ShmRing_CancelWrite(SHM_RING_HANDLE ring)
+{
+    if (ring != NULL)
+    {
+        /*Codes_SRS_SHM_RING_31_018: [ This function shall unlock the writer without publishing the reserved record. ]*/
+        (void)Unlock(ring->write_lock);
+    }
+}
+
+int32_t ShmRing_BeginRead(SHM_RING_HANDLE ring, const unsigned char** data, unsigned int timeout_ms)
+{
+    int32_t result;
+
+    if (ring == NULL || data == NULL)
+    {
+        /*Codes_SRS_SHM_RING_31_019: [ If `ring` or `data` is NULL, this function shall return a negative value. ]*/
+        LogError("invalid arguments ring = %p, data = %p", ring, data);
+        result = -1;
+    }
+    else if (shm_ring_is_superseded(ring))
+    {
+        /*Codes_SRS_SHM_RING_31_030: [ If the segment was attached again after `ring`, this function shall return a negative value. ]*/
+        LogError("shared memory ring %s was attached again", ring->name);
+        result = -1;
+    }
+    else
+    {
+        uint32_t tail = __atomic_load_n(&ring->rx->tail, __ATOMIC_RELAXED);
+        uint32_t head = __atomic_load_n(&ring->rx->head, __ATOMIC_ACQUIRE);
+        uint64_t deadline = shm_ring_now_ms() + timeout_ms;
+
+        while (head == tail && __atomic_load_n(&ring->woken, __ATOMIC_SEQ_CST) == 0)
+        {
+            uint64_t now = shm_ring_now_ms();
+            if (now >= deadline)
+            {
+                break;
+            }
+            /*Codes_SRS_SHM_RING_31_020: [ If the ring is empty, this function shall wait up to `timeout_ms` for the writer to publish a record or for `ShmRing_Wake`. ]*/
+            shm_ring_wait_reader(ring, head, (unsigned int)(deadline - now));
+            head = __atomic_load_n(&ring->rx->head, __ATOMIC_ACQUIRE);
+        }
+
+        if (head == tail)
+        {
+            /*Codes_SRS_SHM_RING_31_021: [ If no record was published before the timeout or the wake, this function shall return zero. ]*/
+            /*Codes_SRS_SHM_RING_31_026: [ A wake shall end a single wait of `ShmRing_BeginRead`. ]*/
+            __atomic_store_n(&ring->woken, 0, __ATOMIC_SEQ_CST);
+            result = 0;
+        }
+        else
+        {
+            uint32_t start = tail;
+            uint32_t offset = tail & (ring->capacity - 1);
+            uint32_t size = *(const uint32_t*)(ring->rx_data + offset);
+            if (size == SHM_RING_WRAP_MARKER)
+            {
+                tail += ring->capacity - offset;
+                offset = 0;
+                size = *(const uint32_t*)(ring->rx_data);
+            }
+
+            if (size > ring->capacity / 2 ||
+                head - tail > ring->capacity ||
+                SHM_RING_ALIGN(size + SHM_RING_RECORD_HEADER_SIZE) > head - tail)
+            {
+                /*Codes_SRS_SHM_RING_31_022: [ If the record header is corrupt, this function shall drop every record published so far, wake a waiting writer and return zero. ]*/
+                LogError("corrupt record of %u bytes in shared memory ring %s, dropping %u bytes", size, ring->name, head - start);
+                (void)shm_ring_release(ring, start, head);
+                result = 0;
+            }
+            else
+            {
+                /*Codes_SRS_SHM_RING_31_023: [ This function shall point `data` at the oldest record and return its size. ]*/
+                ring->pending_read_start = start;
+                ring->pending_read_tail = tail + SHM_RING_ALIGN(size + SHM_RING_RECORD_HEADER_SIZE);
+                *data = ring->rx_data + offset + SHM_RING_RECORD_HEADER_SIZE;
+                result = (int32_t)size;
+            }
+        }
+    }
+
+    return result;
+}
+
+int ShmRing_EndRead(SHM_RING_HANDLE ring)
+{
+    int result;
+    if (ring == NULL)
+    {
+        /*Codes_SRS_SHM_RING_31_031: [ If `ring` is NULL, this function shall return a non-zero value. ]*/
+        LogError("ring is NULL");
+        result = __LINE__;
+    }
+    else if (shm_ring_is_superseded(ring))
+    {
+        /*Codes_SRS_SHM_RING_31_032: [ If the segment was attached again after `ring`, this function shall leave the record to the new handle and return a non-zero value. ]*/
+        LogError("shared memory ring %s was attached again, the record is left to the new reader", ring->name);
+        result = __LINE__;
+    }
+    /*Codes_SRS_SHM_RING_31_024: [ This function shall release the record returned by `ShmRing_BeginRead`, wake a waiting writer and return zero. ]*/
+    else if (!shm_ring_release(ring, ring->pending_read_start, ring->pending_read_tail))
+    {
+        /*Codes_SRS_SHM_RING_31_033: [ If another reader released the record first, this function shall return a non-zero value. ]*/
+        LogError("record of shared memory ring %s was released by another reader", ring->name);
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+int32_t ShmRing_GetMaxRecordSize(SHM_RING_HANDLE ring)
+{
+    int32_t result;
+    if (ring == NULL)
+    {
+        /*Codes_SRS_SHM_RING_31_034: [ If `ring` is NULL, this function shall return a negative value. ]*/
+        LogError("ring is NULL");
+        result = -1;
+    }
+    else
+    {
+        /*Codes_SRS_SHM_RING_31_035: [ This function shall return the size of the largest record `ShmRing_BeginWrite` accepts, half of the ring less the record header. ]*/
+        result = (int32_t)((ring->capacity / 2) - SHM_RING_RECORD_HEADER_SIZE);
+    }
+    return result;
+}
+
+void ShmRing_Wake(SHM_RING_HANDLE ring)
+{
+    if (ring != NULL)
+    {
+        /*Codes_SRS_SHM_RING_31_025: [ This function shall make the current or the next wait of `ShmRing_BeginRead` on `ring` return zero at once, unless a record is there. ]*/
+        __atomic_store_n(&ring->woken, 1, __ATOMIC_SEQ_CST);
+        shm_ring_ring_doorbell(ring->rx);
+    }
+}
+
+#else /* !__linux__ */
+
+SHM_RING_HANDLE ShmRing_Create(const char* uri, uint32_t capacity)
+{
+    (void)capacity;
+    LogError("shared memory transport is not supported on this platform: %s", uri == NULL ? "NULL" : uri);
+    return NULL;
+}
+
+SHM_RING_HANDLE ShmRing_Attach(const char* uri)
+{
+    LogError("shared memory transport is not supported on this platform: %s", uri == NULL ? "NULL" : uri);
+    return NULL;
+}
+
+void ShmRing_Destroy(SHM_RING_HANDLE ring)
+{
+    (void)ring;
+}
+
+unsigned char* ShmRing_BeginWrite(SHM_RING_HANDLE ring, int32_t size, unsigned int timeout_ms)
+{
+    (void)ring;
+    (void)size;
+    (void)timeout_ms;
+    return NULL;
+}
+
+int ShmRing_EndWrite(SHM_RING_HANDLE ring)
+{
+    (void)ring;
+    return __LINE__;
+}
+
+void ShmRing_CancelWrite(SHM_RING_HANDLE ring)
+{
+    (void)ring;
+}
+
+int32_t ShmRing_BeginRead(SHM_RING_HANDLE ring, const unsigned char** data, unsigned int timeout_ms)
+{
+    (void)ring;
+    (void)data;
+    (void)timeout_ms;
+    return -1;
+}
+
+int ShmRing_EndRead(SHM_RING_HANDLE ring)
+{
+    (void)ring;
+    return __LINE__;
+}
+
+int32_t ShmRing_GetMaxRecordSize(SHM_RING_HANDLE ring)
+{
+    (void)ring;
+    return -1;
+}
+
+void ShmRing_Wake(SHM_RING_HANDLE ring)
+{
+    (void)ring;
+}
+
+#endif /* __linux__ */
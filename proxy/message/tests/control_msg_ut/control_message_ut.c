@@ -567,6 +567,34 @@ TEST_FUNCTION(ControlMessage_CreateFromByteArray_start_struct_malloc_fail)
 	///cleanup
 }
 
+/*Tests_SRS_CONTROL_MESSAGE_31_001: [ A `CONTROL_MESSAGE_TYPE_MODULE_PING` message has no body and shall be parsed as a `CONTROL_MESSAGE` structure. ]*/
+TEST_FUNCTION(ControlMessage_CreateFromByteArray_ping_roundabout_success)
+{
+	///arrange
+	CONTROL_MESSAGE m1 =
+	{
+		CONTROL_MESSAGE_VERSION_CURRENT,
+		CONTROL_MESSAGE_TYPE_MODULE_PING
+	};
+	unsigned char buf[8];
+	int32_t c1 = ControlMessage_ToByteArray(&m1, buf, sizeof(buf));
+	ASSERT_ARE_EQUAL(int32_t, 8, c1);
+	umock_c_reset_all_calls();
+
+	STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(CONTROL_MESSAGE)));
+
+	///act
+	CONTROL_MESSAGE * r1 = ControlMessage_CreateFromByteArray(buf, c1);
+
+	///assert
+	ASSERT_IS_NOT_NULL(r1);
+	ASSERT_ARE_EQUAL(int, CONTROL_MESSAGE_TYPE_MODULE_PING, r1->type);
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	///cleanup
+	ControlMessage_Destroy(r1);
+}
+
 /*Tests_SRS_CONTROL_MESSAGE_17_007: [ This function shall return NULL if the type is not a valid enum value of CONTROL_MESSAGE_TYPE or CONTROL_MESSAGE_TYPE_ERROR. ]*/
 TEST_FUNCTION(ControlMessage_CreateFromByteArray_bad_msg_type_fails)
 {
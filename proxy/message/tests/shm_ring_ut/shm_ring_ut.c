@@ -0,0 +1,464 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+
+#include "shm_ring.h"
+
+#ifdef WIN32
+static TEST_MUTEX_HANDLE g_dllByDll;
+#endif
+static TEST_MUTEX_HANDLE g_testByTest;
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void* my_gballoc_calloc(size_t nmemb, size_t size)
+{
+    return calloc(nmemb, size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/lock.h"
+#undef ENABLE_MOCKS
+
+/* the tests drive both ends of the ring from one thread, so the writer lock only has to count */
+static int lock_depth;
+
+static LOCK_HANDLE my_Lock_Init(void)
+{
+    return (LOCK_HANDLE)malloc(1);
+}
+
+static LOCK_RESULT my_Lock(LOCK_HANDLE handle)
+{
+    (void)handle;
+    lock_depth++;
+    return LOCK_OK;
+}
+
+static LOCK_RESULT my_Unlock(LOCK_HANDLE handle)
+{
+    (void)handle;
+    lock_depth--;
+    return LOCK_OK;
+}
+
+static LOCK_RESULT my_Lock_Deinit(LOCK_HANDLE handle)
+{
+    free(handle);
+    return LOCK_OK;
+}
+
+#ifdef _MSC_VER
+#pragma warning(disable:4505)
+#endif
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    (void)error_code;
+    ASSERT_FAIL("umock_c reported error");
+}
+
+static char test_uri[64];
+
+static int write_record(SHM_RING_HANDLE ring, const char* text)
+{
+    int32_t size = (int32_t)strlen(text);
+    unsigned char* record = ShmRing_BeginWrite(ring, size, 0);
+    int result;
+    if (record == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        (void)memcpy(record, text, size);
+        result = ShmRing_EndWrite(ring);
+    }
+    return result;
+}
+
+BEGIN_TEST_SUITE(shm_ring_ut)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+
+    int result = umocktypes_charptr_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_RESULT, int);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_calloc, my_gballoc_calloc);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+    REGISTER_GLOBAL_MOCK_HOOK(Lock_Init, my_Lock_Init);
+    REGISTER_GLOBAL_MOCK_HOOK(Lock, my_Lock);
+    REGISTER_GLOBAL_MOCK_HOOK(Unlock, my_Unlock);
+    REGISTER_GLOBAL_MOCK_HOOK(Lock_Deinit, my_Lock_Deinit);
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    TEST_MUTEX_DESTROY(g_testByTest);
+    umock_c_deinit();
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest) != 0)
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    umock_c_reset_all_calls();
+    lock_depth = 0;
+    (void)snprintf(test_uri, sizeof(test_uri), "shm://shm_ring_ut_%d", (int)getpid());
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+/*Tests_SRS_SHM_RING_31_001: [ If `uri` is NULL or does not start with "shm://", this function shall return NULL. ]*/
+TEST_FUNCTION(ShmRing_Create_returns_NULL_for_a_non_shm_uri)
+{
+    ///act
+    SHM_RING_HANDLE null_uri = ShmRing_Create(NULL, 4096);
+    SHM_RING_HANDLE ipc_uri = ShmRing_Create("ipc://shm_ring_ut", 4096);
+    SHM_RING_HANDLE nested_uri = ShmRing_Create("shm://shm/ring_ut", 4096);
+
+    ///assert
+    ASSERT_IS_NULL(null_uri);
+    ASSERT_IS_NULL(ipc_uri);
+    ASSERT_IS_NULL(nested_uri);
+}
+
+TEST_FUNCTION(ShmRing_Attach_returns_NULL_when_the_segment_does_not_exist)
+{
+    ///act
+    SHM_RING_HANDLE ring = ShmRing_Attach(test_uri);
+
+    ///assert
+    ASSERT_IS_NULL(ring);
+}
+
+/*Tests_SRS_SHM_RING_31_013: [ This function shall return a pointer to `size` bytes inside the outgoing ring and keep the writer locked. ]*/
+/*Tests_SRS_SHM_RING_31_017: [ This function shall store the record size, publish the new head and wake a waiting reader. ]*/
+/*Tests_SRS_SHM_RING_31_023: [ This function shall point `data` at the oldest record and return its size. ]*/
+TEST_FUNCTION(ShmRing_records_cross_in_both_directions)
+{
+    ///arrange
+    SHM_RING_HANDLE gateway = ShmRing_Create(test_uri, 4096);
+    ASSERT_IS_NOT_NULL(gateway);
+    SHM_RING_HANDLE host = ShmRing_Attach(test_uri);
+    ASSERT_IS_NOT_NULL(host);
+    const unsigned char* data = NULL;
+
+    ///act
+    int to_host = write_record(gateway, "to host");
+    int to_gateway = write_record(host, "to gateway");
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, to_host);
+    ASSERT_ARE_EQUAL(int, 0, to_gateway);
+    ASSERT_ARE_EQUAL(int, 0, lock_depth);
+
+    ASSERT_ARE_EQUAL(int32_t, (int32_t)strlen("to host"), ShmRing_BeginRead(host, &data, 0));
+    ASSERT_ARE_EQUAL(int, 0, memcmp(data, "to host", strlen("to host")));
+    ASSERT_ARE_EQUAL(int, 0, ShmRing_EndRead(host));
+
+    ASSERT_ARE_EQUAL(int32_t, (int32_t)strlen("to gateway"), ShmRing_BeginRead(gateway, &data, 0));
+    ASSERT_ARE_EQUAL(int, 0, memcmp(data, "to gateway", strlen("to gateway")));
+    ASSERT_ARE_EQUAL(int, 0, ShmRing_EndRead(gateway));
+
+    ///cleanup
+    ShmRing_Destroy(host);
+    ShmRing_Destroy(gateway);
+}
+
+/*Tests_SRS_SHM_RING_31_021: [ If no record was published before the timeout, this function shall return zero. ]*/
+TEST_FUNCTION(ShmRing_BeginRead_returns_zero_when_empty)
+{
+    ///arrange
+    SHM_RING_HANDLE gateway = ShmRing_Create(test_uri, 4096);
+    ASSERT_IS_NOT_NULL(gateway);
+    const unsigned char* data = NULL;
+
+    ///act
+    int32_t no_wait = ShmRing_BeginRead(gateway, &data, 0);
+    int32_t short_wait = ShmRing_BeginRead(gateway, &data, 10);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int32_t, 0, no_wait);
+    ASSERT_ARE_EQUAL(int32_t, 0, short_wait);
+
+    ///cleanup
+    ShmRing_Destroy(gateway);
+}
+
+/*Tests_SRS_SHM_RING_31_025: [ This function shall make the current or the next wait of `ShmRing_BeginRead` on `ring` return zero at once, unless a record is there. ]*/
+/*Tests_SRS_SHM_RING_31_026: [ A wake shall end a single wait of `ShmRing_BeginRead`. ]*/
+TEST_FUNCTION(ShmRing_Wake_ends_the_next_wait_once)
+{
+    ///arrange
+    SHM_RING_HANDLE gateway = ShmRing_Create(test_uri, 4096);
+    ASSERT_IS_NOT_NULL(gateway);
+    const unsigned char* data = NULL;
+
+    ///act
+    ShmRing_Wake(gateway);
+    int32_t woken = ShmRing_BeginRead(gateway, &data, 60000);
+    int32_t short_wait = ShmRing_BeginRead(gateway, &data, 10);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int32_t, 0, woken);
+    ASSERT_ARE_EQUAL(int32_t, 0, short_wait);
+
+    ///cleanup
+    ShmRing_Destroy(gateway);
+}
+
+/*Tests_SRS_SHM_RING_31_012: [ If the record would take more than half of the ring, this function shall return NULL. ]*/
+TEST_FUNCTION(ShmRing_BeginWrite_rejects_records_larger_than_half_the_ring)
+{
+    ///arrange
+    SHM_RING_HANDLE gateway = ShmRing_Create(test_uri, 4096);
+    ASSERT_IS_NOT_NULL(gateway);
+
+    ///act
+    unsigned char* record = ShmRing_BeginWrite(gateway, 4096, 0);
+
+    ///assert
+    ASSERT_IS_NULL(record);
+    ASSERT_ARE_EQUAL(int, 0, lock_depth);
+
+    ///cleanup
+    ShmRing_Destroy(gateway);
+}
+
+/*Tests_SRS_SHM_RING_31_015: [ If no space was released before the timeout, this function shall unlock the writer and return NULL. ]*/
+/*Tests_SRS_SHM_RING_31_024: [ This function shall release the record returned by `ShmRing_BeginRead`, wake a waiting writer and return zero. ]*/
+TEST_FUNCTION(ShmRing_BeginWrite_times_out_when_full_and_resumes_after_read)
+{
+    ///arrange
+    SHM_RING_HANDLE gateway = ShmRing_Create(test_uri, 4096);
+    ASSERT_IS_NOT_NULL(gateway);
+    SHM_RING_HANDLE host = ShmRing_Attach(test_uri);
+    ASSERT_IS_NOT_NULL(host);
+    const unsigned char* data = NULL;
+    unsigned char* record;
+
+    /* two records of just under half the ring fill it */
+    record = ShmRing_BeginWrite(gateway, 2000, 0);
+    ASSERT_IS_NOT_NULL(record);
+    ASSERT_ARE_EQUAL(int, 0, ShmRing_EndWrite(gateway));
+    record = ShmRing_BeginWrite(gateway, 2000, 0);
+    ASSERT_IS_NOT_NULL(record);
+    ASSERT_ARE_EQUAL(int, 0, ShmRing_EndWrite(gateway));
+
+    ///act
+    unsigned char* full = ShmRing_BeginWrite(gateway, 2000, 10);
+    ASSERT_ARE_EQUAL(int32_t, 2000, ShmRing_BeginRead(host, &data, 0));
+    ASSERT_ARE_EQUAL(int, 0, ShmRing_EndRead(host));
+    unsigned char* freed = ShmRing_BeginWrite(gateway, 2000, 0);
+
+    ///assert
+    ASSERT_IS_NULL(full);
+    ASSERT_IS_NOT_NULL(freed);
+    ASSERT_ARE_EQUAL(int, 0, ShmRing_EndWrite(gateway));
+    ASSERT_ARE_EQUAL(int, 0, lock_depth);
+
+    ///cleanup
+    ShmRing_Destroy(host);
+    ShmRing_Destroy(gateway);
+}
+
+TEST_FUNCTION(ShmRing_records_wrap_around_the_end_of_the_ring)
+{
+    ///arrange
+    SHM_RING_HANDLE gateway = ShmRing_Create(test_uri, 4096);
+    ASSERT_IS_NOT_NULL(gateway);
+    SHM_RING_HANDLE host = ShmRing_Attach(test_uri);
+    ASSERT_IS_NOT_NULL(host);
+    const unsigned char* data = NULL;
+    int i;
+
+    ///act
+    for (i = 0; i < 64; i++)
+    {
+        char text[2000];
+        (void)memset(text, 'a' + (i % 26), 1500);
+        text[1500] = '\0';
+        ASSERT_ARE_EQUAL(int, 0, write_record(gateway, text));
+
+        ///assert
+        ASSERT_ARE_EQUAL(int32_t, 1500, ShmRing_BeginRead(host, &data, 0));
+        ASSERT_ARE_EQUAL(int, 'a' + (i % 26), data[0]);
+        ASSERT_ARE_EQUAL(int, 'a' + (i % 26), data[1499]);
+        ASSERT_ARE_EQUAL(int, 0, ShmRing_EndRead(host));
+    }
+
+    ///cleanup
+    ShmRing_Destroy(host);
+    ShmRing_Destroy(gateway);
+}
+
+/*Tests_SRS_SHM_RING_31_018: [ This function shall unlock the writer without publishing the reserved record. ]*/
+TEST_FUNCTION(ShmRing_CancelWrite_does_not_publish)
+{
+    ///arrange
+    SHM_RING_HANDLE gateway = ShmRing_Create(test_uri, 4096);
+    ASSERT_IS_NOT_NULL(gateway);
+    SHM_RING_HANDLE host = ShmRing_Attach(test_uri);
+    ASSERT_IS_NOT_NULL(host);
+    const unsigned char* data = NULL;
+
+    ///act
+    unsigned char* record = ShmRing_BeginWrite(gateway, 16, 0);
+    ASSERT_IS_NOT_NULL(record);
+    ShmRing_CancelWrite(gateway);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, lock_depth);
+    ASSERT_ARE_EQUAL(int32_t, 0, ShmRing_BeginRead(host, &data, 0));
+
+    ///cleanup
+    ShmRing_Destroy(host);
+    ShmRing_Destroy(gateway);
+}
+
+/*Tests_SRS_SHM_RING_31_035: [ This function shall return the size of the largest record `ShmRing_BeginWrite` accepts, half of the ring less the record header. ]*/
+TEST_FUNCTION(ShmRing_GetMaxRecordSize_is_the_largest_record_written)
+{
+    ///arrange
+    SHM_RING_HANDLE gateway = ShmRing_Create(test_uri, 4096);
+    ASSERT_IS_NOT_NULL(gateway);
+
+    ///act
+    int32_t max_record_size = ShmRing_GetMaxRecordSize(gateway);
+    unsigned char* too_large = ShmRing_BeginWrite(gateway, max_record_size + 1, 0);
+    unsigned char* largest = ShmRing_BeginWrite(gateway, max_record_size, 0);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int32_t, 2040, max_record_size);
+    ASSERT_IS_NULL(too_large);
+    ASSERT_IS_NOT_NULL(largest);
+    ShmRing_CancelWrite(gateway);
+    ASSERT_ARE_EQUAL(int32_t, -1, ShmRing_GetMaxRecordSize(NULL));
+
+    ///cleanup
+    ShmRing_Destroy(gateway);
+}
+
+/*Tests_SRS_SHM_RING_31_022: [ If the record header is corrupt, this function shall drop every record published so far, wake a waiting writer and return zero. ]*/
+TEST_FUNCTION(ShmRing_BeginRead_skips_a_corrupt_record)
+{
+    ///arrange
+    SHM_RING_HANDLE gateway = ShmRing_Create(test_uri, 4096);
+    ASSERT_IS_NOT_NULL(gateway);
+    SHM_RING_HANDLE host = ShmRing_Attach(test_uri);
+    ASSERT_IS_NOT_NULL(host);
+    const unsigned char* data = NULL;
+    unsigned char* record = ShmRing_BeginWrite(gateway, 16, 0);
+    ASSERT_IS_NOT_NULL(record);
+    ASSERT_ARE_EQUAL(int, 0, ShmRing_EndWrite(gateway));
+    ASSERT_ARE_EQUAL(int, 0, write_record(gateway, "dropped"));
+    /* the size in the header of the first record */
+    *(uint32_t*)(record - 8) = 0x7FFFFFFF;
+
+    ///act
+    int32_t corrupt = ShmRing_BeginRead(host, &data, 0);
+    int32_t empty = ShmRing_BeginRead(host, &data, 0);
+    ASSERT_ARE_EQUAL(int, 0, write_record(gateway, "next"));
+    int32_t next = ShmRing_BeginRead(host, &data, 0);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int32_t, 0, corrupt);
+    ASSERT_ARE_EQUAL(int32_t, 0, empty);
+    ASSERT_ARE_EQUAL(int32_t, (int32_t)strlen("next"), next);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(data, "next", strlen("next")));
+    ASSERT_ARE_EQUAL(int, 0, ShmRing_EndRead(host));
+
+    ///cleanup
+    ShmRing_Destroy(host);
+    ShmRing_Destroy(gateway);
+}
+
+/*Tests_SRS_SHM_RING_31_027: [ This function shall supersede the handles attached to the segment before. ]*/
+/*Tests_SRS_SHM_RING_31_028: [ If the segment was attached again after `ring`, this function shall return NULL. ]*/
+/*Tests_SRS_SHM_RING_31_030: [ If the segment was attached again after `ring`, this function shall return a negative value. ]*/
+/*Tests_SRS_SHM_RING_31_032: [ If the segment was attached again after `ring`, this function shall leave the record to the new handle and return a non-zero value. ]*/
+TEST_FUNCTION(ShmRing_Attach_again_hands_the_record_being_read_to_the_new_host_only)
+{
+    ///arrange
+    SHM_RING_HANDLE gateway = ShmRing_Create(test_uri, 4096);
+    ASSERT_IS_NOT_NULL(gateway);
+    SHM_RING_HANDLE previous_host = ShmRing_Attach(test_uri);
+    ASSERT_IS_NOT_NULL(previous_host);
+    const unsigned char* data = NULL;
+    ASSERT_ARE_EQUAL(int, 0, write_record(gateway, "once"));
+    ASSERT_ARE_EQUAL(int32_t, (int32_t)strlen("once"), ShmRing_BeginRead(previous_host, &data, 0));
+
+    ///act
+    SHM_RING_HANDLE host = ShmRing_Attach(test_uri);
+    ASSERT_IS_NOT_NULL(host);
+    int previous_release = ShmRing_EndRead(previous_host);
+    int32_t previous_read = ShmRing_BeginRead(previous_host, &data, 0);
+    unsigned char* previous_write = ShmRing_BeginWrite(previous_host, 16, 0);
+    int32_t read = ShmRing_BeginRead(host, &data, 0);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, previous_release);
+    ASSERT_IS_TRUE(previous_read < 0);
+    ASSERT_IS_NULL(previous_write);
+    ASSERT_ARE_EQUAL(int, 0, lock_depth);
+    ASSERT_ARE_EQUAL(int32_t, (int32_t)strlen("once"), read);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(data, "once", strlen("once")));
+    ASSERT_ARE_EQUAL(int, 0, ShmRing_EndRead(host));
+    ASSERT_ARE_EQUAL(int32_t, 0, ShmRing_BeginRead(host, &data, 0));
+
+    ///cleanup
+    ShmRing_Destroy(previous_host);
+    ShmRing_Destroy(host);
+    ShmRing_Destroy(gateway);
+}
+
+TEST_FUNCTION(ShmRing_Destroy_of_the_creator_removes_the_segment)
+{
+    ///arrange
+    SHM_RING_HANDLE gateway = ShmRing_Create(test_uri, 4096);
+    ASSERT_IS_NOT_NULL(gateway);
+
+    ///act
+    ShmRing_Destroy(gateway);
+    SHM_RING_HANDLE host = ShmRing_Attach(test_uri);
+
+    ///assert
+    ASSERT_IS_NULL(host);
+}
+
+END_TEST_SUITE(shm_ring_ut)
@@ -5,6 +5,7 @@
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/macro_utils.h"
+#include "azure_c_shared_utility/lock.h"
 
 #include "gateway.h"
 #include "broker.h"
@@ -30,6 +31,19 @@ typedef struct MODULE_HOST_TAG
     BROKER_HANDLE module_host_broker;
 } MODULE_HOST;
 
+/*
+ * Several module hosts may live in one process (one per control channel), and
+ * they all share the process wide module loader. The loader is initialized by
+ * the first host created and destroyed with the last one. Every control
+ * channel has a worker thread of its own which creates and destroys its host,
+ * so the count, and the loader initialization and destruction it decides, are
+ * guarded by module_host_lock. The lock is created by the first Module_GetApi,
+ * which a process calls before it attaches any host, and lives as long as the
+ * process.
+ */
+static LOCK_HANDLE module_host_lock = NULL;
+static size_t module_host_count = 0;
+
 static void* NativeModuleHost_ParseConfigurationFromJson(const char* configuration)
 {
     char* config_str;
@@ -192,10 +206,18 @@ static MODULE_HANDLE NativeModuleHost_Create(BROKER_HANDLE broker, const void* c
         LogError("broker [%p] or configuration [%p] is NULL, both are required", broker, configuration);
         result = NULL;
     }
+    /*Codes_SRS_NATIVEMODULEHOST_31_005: [ NativeModuleHost_Create shall hold the module host lock from before it initializes the Module_Loader until the module host is created or the Module_Loader is destroyed on failure. ]*/
+    else if ((module_host_lock == NULL) || (Lock(module_host_lock) != LOCK_OK))
+    {
+        /*Codes_SRS_NATIVEMODULEHOST_31_006: [ If the module host lock cannot be acquired, NativeModuleHost_Create shall return NULL. ]*/
+        LogError("unable to lock the module hosts of the process");
+        result = NULL;
+    }
     else
     {
         /*Codes_SRS_NATIVEMODULEHOST_17_010: [ NativeModuleHost_Create shall intialize the Module_Loader. ]*/
-        if (ModuleLoader_Initialize() != MODULE_LOADER_SUCCESS)
+        /*Codes_SRS_NATIVEMODULEHOST_31_001: [ NativeModuleHost_Create shall only initialize the Module_Loader if no other module host exists in the process. ]*/
+        if ((module_host_count == 0) && (ModuleLoader_Initialize() != MODULE_LOADER_SUCCESS))
         {
             /*Codes_SRS_NATIVEMODULEHOST_17_026: [ If any step above fails, then NativeModuleHost_Create shall free all resources allocated and return NULL. ]*/
             LogError("ModuleLoader_Initialize failed");
@@ -280,46 +302,75 @@ static MODULE_HANDLE NativeModuleHost_Create(BROKER_HANDLE broker, const void* c
             {
                 // failed to create a module, give up entirely.
                 /*Codes_SRS_NATIVEMODULEHOST_17_026: [ If any step above fails, then NativeModuleHost_Create shall free all resources allocated and return NULL. ]*/
-                ModuleLoader_Destroy();
+                /*Codes_SRS_NATIVEMODULEHOST_31_002: [ On failure, NativeModuleHost_Create shall not destroy the Module_Loader if other module hosts exist in the process. ]*/
+                if (module_host_count == 0)
+                {
+                    ModuleLoader_Destroy();
+                }
+            }
+            else
+            {
+                module_host_count++;
             }
         }
+        (void)Unlock(module_host_lock);
     }
     return result;
 }
 
 static void NativeModuleHost_Destroy(MODULE_HANDLE moduleHandle)
 {
-    if (moduleHandle != NULL)
+    /*Codes_SRS_NATIVEMODULEHOST_31_007: [ NativeModuleHost_Destroy shall hold the module host lock while it destroys the module host and, if it is the last one, the module loader. ]*/
+    if ((module_host_lock == NULL) || (Lock(module_host_lock) != LOCK_OK))
     {
-        MODULE_HOST* module_host = (MODULE_HOST*)moduleHandle;
-        if (module_host->module != NULL)
+        /*Codes_SRS_NATIVEMODULEHOST_31_008: [ If the module host lock cannot be acquired, NativeModuleHost_Destroy shall do nothing. ]*/
+        LogError("unable to lock the module hosts of the process");
+    }
+    else
+    {
+        if (moduleHandle != NULL)
         {
-            const MODULE_LOADER* module_loader = module_host->module_loader;
-            MODULE_LIBRARY_HANDLE module_library = module_host->module_library_handle;
-
-            if (module_loader != NULL)
+            MODULE_HOST* module_host = (MODULE_HOST*)moduleHandle;
+            if (module_host->module != NULL)
             {
-                MODULE_LOADER_API * loader_api = module_loader->api;
-                if ((module_library != NULL) && (loader_api != NULL))
+                const MODULE_LOADER* module_loader = module_host->module_loader;
+                MODULE_LIBRARY_HANDLE module_library = module_host->module_library_handle;
+
+                if (module_loader != NULL)
                 {
-                    const MODULE_API* module_apis = loader_api->GetApi(module_loader, module_library);
-                    if (MODULE_DESTROY(module_apis) != NULL)
+                    MODULE_LOADER_API * loader_api = module_loader->api;
+                    if ((module_library != NULL) && (loader_api != NULL))
                     {
-                        /*Codes_SRS_NATIVEMODULEHOST_17_028: [ NativeModuleHost_Destroy shall free all remaining allocated resources if moduleHandle is not NULL. ]*/
-                        MODULE_DESTROY(module_apis)(module_host->module);
-                    }
+                        const MODULE_API* module_apis = loader_api->GetApi(module_loader, module_library);
+                        if (MODULE_DESTROY(module_apis) != NULL)
+                        {
+                            /*Codes_SRS_NATIVEMODULEHOST_17_028: [ NativeModuleHost_Destroy shall free all remaining allocated resources if moduleHandle is not NULL. ]*/
+                            MODULE_DESTROY(module_apis)(module_host->module);
+                        }
 
-                    loader_api->Unload(module_loader, module_library);
+                        loader_api->Unload(module_loader, module_library);
+                    }
                 }
+                module_host->module = NULL;
+                module_host->module_library_handle = NULL;
+                module_host->module_host_broker = NULL;
+                free(module_host);
+            }
+
+            if (module_host_count > 0)
+            {
+                module_host_count--;
             }
-            module_host->module = NULL;
-            module_host->module_library_handle = NULL;
-            module_host->module_host_broker = NULL;
-            free(module_host);
         }
+
+        /*Codes_SRS_NATIVEMODULEHOST_17_027: [ NativeModuleHost_Destroy shall always destroy the module loader. ]*/
+        /*Codes_SRS_NATIVEMODULEHOST_31_003: [ NativeModuleHost_Destroy shall only destroy the module loader when no other module host exists in the process. ]*/
+        if (module_host_count == 0)
+        {
+            ModuleLoader_Destroy();
+        }
+        (void)Unlock(module_host_lock);
     }
-    /*Codes_SRS_NATIVEMODULEHOST_17_027: [ NativeModuleHost_Destroy shall always destroy the module loader. ]*/
-    ModuleLoader_Destroy();
 }
 
 static void NativeModuleHost_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE messageHandle)
@@ -405,5 +456,14 @@ MODULE_EXPORT const MODULE_API* Module_GetApi(MODULE_API_VERSION gateway_api_ver
     /*Codes_SRS_NATIVEMODULEHOST_17_001: [ Module_GetApi shall return a valid pointer to a MODULE_API structure. ]*/
     /*Codes_SRS_NATIVEMODULEHOST_17_002: [ The MODULE_API structure returned shall have valid pointers for all pointers in the strcuture. ]*/
     (void)gateway_api_version;
+    /*Codes_SRS_NATIVEMODULEHOST_31_004: [ Module_GetApi shall create the module host lock of the process if it does not exist yet. ]*/
+    if (module_host_lock == NULL)
+    {
+        module_host_lock = Lock_Init();
+        if (module_host_lock == NULL)
+        {
+            LogError("unable to create the module host lock");
+        }
+    }
     return (const MODULE_API *)&NATIVEMODULEHOST_APIS_all;
 }
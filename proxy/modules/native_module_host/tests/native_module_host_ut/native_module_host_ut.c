@@ -84,6 +84,7 @@ int my_mallocAndStrcpy_s( char** destination, const char* source)
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/lock.h"
 #include "parson.h"
 
 MOCKABLE_FUNCTION(, JSON_Value *, json_object_get_value, const JSON_Object *, object, const char *, name);
@@ -291,6 +292,16 @@ TEST_SUITE_INITIALIZE(suite_init)
 	REGISTER_UMOCK_ALIAS_TYPE(BROKER_RESULT, int);
 	REGISTER_UMOCK_ALIAS_TYPE(MODULE_LIBRARY_HANDLE, void*);
 	REGISTER_UMOCK_ALIAS_TYPE(MODULE_LOADER_RESULT, int);
+	REGISTER_UMOCK_ALIAS_TYPE(LOCK_HANDLE, void*);
+	REGISTER_UMOCK_ALIAS_TYPE(LOCK_RESULT, int);
+
+	REGISTER_GLOBAL_MOCK_RETURN(Lock_Init, (LOCK_HANDLE)0x4C);
+	REGISTER_GLOBAL_MOCK_RETURN(Lock, LOCK_OK);
+	REGISTER_GLOBAL_MOCK_FAIL_RETURN(Lock, LOCK_ERROR);
+	REGISTER_GLOBAL_MOCK_RETURN(Unlock, LOCK_OK);
+
+	/*the module host lock lives as long as the process, it is created by the first Module_GetApi*/
+	(void)Module_GetApi(MODULE_API_VERSION_1);
 
 
 }
@@ -448,6 +459,7 @@ TEST_FUNCTION(NativeModuleHost_Create_returns_null_on_null_input)
 	///ablution
 }
 
+/*Tests_SRS_NATIVEMODULEHOST_31_005: [ NativeModuleHost_Create shall hold the module host lock from before it initializes the Module_Loader until the module host is created or the Module_Loader is destroyed on failure. ]*/
 /*Tests_SRS_NATIVEMODULEHOST_17_010: [ NativeModuleHost_Create shall intialize the Module_Loader. ]*/
 /*Tests_SRS_NATIVEMODULEHOST_17_011: [ NativeModuleHost_Create shall parse the configuration JSON. ]*/
 /*Tests_SRS_NATIVEMODULEHOST_17_012: [ NativeModuleHost_Create shall get the "outprocess.loader" object from the configuration JSON. ]*/
@@ -471,6 +483,7 @@ TEST_FUNCTION(NativeModuleHost_Create_success)
 	const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 	BROKER_HANDLE b = (BROKER_HANDLE)0x42;
 	char * config = "Assume this is a valid config";
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
 	STRICT_EXPECTED_CALL(ModuleLoader_Initialize());
 	STRICT_EXPECTED_CALL(json_parse_string(config))
 		.SetReturn((JSON_Value*)0x43);
@@ -517,6 +530,7 @@ TEST_FUNCTION(NativeModuleHost_Create_success)
 	STRICT_EXPECTED_CALL(mock_ModuleLoader_FreeEntrypoint(&dummyModuleLoader, IGNORED_PTR_ARG))
 		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(json_value_free((JSON_Value*)0x43));
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 	///act
 	MODULE_HANDLE m = MODULE_CREATE(apis)(b, config);
 
@@ -537,6 +551,7 @@ TEST_FUNCTION(NativeModuleHost_Create_fails_module_create_fails)
 	const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 	BROKER_HANDLE b = (BROKER_HANDLE)0x42;
 	char * config = "Assume this is a valid config";
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
 	STRICT_EXPECTED_CALL(ModuleLoader_Initialize());
 	STRICT_EXPECTED_CALL(json_parse_string(config))
 		.SetReturn((JSON_Value*)0x43);
@@ -588,6 +603,7 @@ TEST_FUNCTION(NativeModuleHost_Create_fails_module_create_fails)
 		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(json_value_free((JSON_Value*)0x43));
 	STRICT_EXPECTED_CALL(ModuleLoader_Destroy());
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 
 	///act
 	MODULE_HANDLE m = MODULE_CREATE(apis)(b, config);
@@ -605,6 +621,7 @@ TEST_FUNCTION(NativeModuleHost_Create_fails_GetModuleApi_fails)
 	const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 	BROKER_HANDLE b = (BROKER_HANDLE)0x42;
 	char * config = "Assume this is a valid config";
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
 	STRICT_EXPECTED_CALL(ModuleLoader_Initialize());
 	STRICT_EXPECTED_CALL(json_parse_string(config))
 		.SetReturn((JSON_Value*)0x43);
@@ -644,6 +661,7 @@ TEST_FUNCTION(NativeModuleHost_Create_fails_GetModuleApi_fails)
 		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(json_value_free((JSON_Value*)0x43));
 	STRICT_EXPECTED_CALL(ModuleLoader_Destroy());
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 	///act
 	MODULE_HANDLE m = MODULE_CREATE(apis)(b, config);
 
@@ -660,6 +678,7 @@ TEST_FUNCTION(NativeModuleHost_Create_fails_Load_fails)
 	const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 	BROKER_HANDLE b = (BROKER_HANDLE)0x42;
 	char * config = "Assume this is a valid config";
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
 	STRICT_EXPECTED_CALL(ModuleLoader_Initialize());
 	STRICT_EXPECTED_CALL(json_parse_string(config))
 		.SetReturn((JSON_Value*)0x43);
@@ -697,6 +716,7 @@ TEST_FUNCTION(NativeModuleHost_Create_fails_Load_fails)
 		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(json_value_free((JSON_Value*)0x43));
 	STRICT_EXPECTED_CALL(ModuleLoader_Destroy());
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 	///act
 	MODULE_HANDLE m = MODULE_CREATE(apis)(b, config);
 
@@ -713,6 +733,7 @@ TEST_FUNCTION(NativeModuleHost_Create_fails_json_mod_arg_fails)
 	const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 	BROKER_HANDLE b = (BROKER_HANDLE)0x42;
 	char * config = "Assume this is a valid config";
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
 	STRICT_EXPECTED_CALL(ModuleLoader_Initialize());
 	STRICT_EXPECTED_CALL(json_parse_string(config))
 		.SetReturn((JSON_Value*)0x43);
@@ -746,6 +767,7 @@ TEST_FUNCTION(NativeModuleHost_Create_fails_json_mod_arg_fails)
 		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(json_value_free((JSON_Value*)0x43));
 	STRICT_EXPECTED_CALL(ModuleLoader_Destroy());
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 	///act
 	MODULE_HANDLE m = MODULE_CREATE(apis)(b, config);
 
@@ -762,6 +784,7 @@ TEST_FUNCTION(NativeModuleHost_Create_fails_module_alloc_fails)
 	const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 	BROKER_HANDLE b = (BROKER_HANDLE)0x42;
 	char * config = "Assume this is a valid config";
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
 	STRICT_EXPECTED_CALL(ModuleLoader_Initialize());
 	STRICT_EXPECTED_CALL(json_parse_string(config))
 		.SetReturn((JSON_Value*)0x43);
@@ -791,6 +814,7 @@ TEST_FUNCTION(NativeModuleHost_Create_fails_module_alloc_fails)
 		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(json_value_free((JSON_Value*)0x43));
 	STRICT_EXPECTED_CALL(ModuleLoader_Destroy());
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 	///act
 	MODULE_HANDLE m = MODULE_CREATE(apis)(b, config);
 
@@ -806,6 +830,7 @@ TEST_FUNCTION(NativeModuleHost_Create_fails_parseEntrypoint_fails)
 	const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 	BROKER_HANDLE b = (BROKER_HANDLE)0x42;
 	char * config = "Assume this is a valid config";
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
 	STRICT_EXPECTED_CALL(ModuleLoader_Initialize());
 	STRICT_EXPECTED_CALL(json_parse_string(config))
 		.SetReturn((JSON_Value*)0x43);
@@ -831,6 +856,7 @@ TEST_FUNCTION(NativeModuleHost_Create_fails_parseEntrypoint_fails)
 
 	STRICT_EXPECTED_CALL(json_value_free((JSON_Value*)0x43));
 	STRICT_EXPECTED_CALL(ModuleLoader_Destroy());
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 	///act
 	MODULE_HANDLE m = MODULE_CREATE(apis)(b, config);
 
@@ -847,6 +873,7 @@ TEST_FUNCTION(NativeModuleHost_Create_fails_json_get_entrypoint_fails)
 	const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 	BROKER_HANDLE b = (BROKER_HANDLE)0x42;
 	char * config = "Assume this is a valid config";
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
 	STRICT_EXPECTED_CALL(ModuleLoader_Initialize());
 	STRICT_EXPECTED_CALL(json_parse_string(config))
 		.SetReturn((JSON_Value*)0x43);
@@ -869,6 +896,7 @@ TEST_FUNCTION(NativeModuleHost_Create_fails_json_get_entrypoint_fails)
 
 	STRICT_EXPECTED_CALL(json_value_free((JSON_Value*)0x43));
 	STRICT_EXPECTED_CALL(ModuleLoader_Destroy());
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 	///act
 	MODULE_HANDLE m = MODULE_CREATE(apis)(b, config);
 
@@ -885,6 +913,7 @@ TEST_FUNCTION(NativeModuleHost_Create_fails_loader_not_found_fails)
 	const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 	BROKER_HANDLE b = (BROKER_HANDLE)0x42;
 	char * config = "Assume this is a valid config";
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
 	STRICT_EXPECTED_CALL(ModuleLoader_Initialize());
 	STRICT_EXPECTED_CALL(json_parse_string(config))
 		.SetReturn((JSON_Value*)0x43);
@@ -905,6 +934,7 @@ TEST_FUNCTION(NativeModuleHost_Create_fails_loader_not_found_fails)
 
 	STRICT_EXPECTED_CALL(json_value_free((JSON_Value*)0x43));
 	STRICT_EXPECTED_CALL(ModuleLoader_Destroy());
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 	///act
 	MODULE_HANDLE m = MODULE_CREATE(apis)(b, config);
 
@@ -921,6 +951,7 @@ TEST_FUNCTION(NativeModuleHost_Create_fails_loader_key_not_found_fails)
 	const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 	BROKER_HANDLE b = (BROKER_HANDLE)0x42;
 	char * config = "Assume this is a valid config";
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
 	STRICT_EXPECTED_CALL(ModuleLoader_Initialize());
 	STRICT_EXPECTED_CALL(json_parse_string(config))
 		.SetReturn((JSON_Value*)0x43);
@@ -936,6 +967,7 @@ TEST_FUNCTION(NativeModuleHost_Create_fails_loader_key_not_found_fails)
 
 	STRICT_EXPECTED_CALL(json_value_free((JSON_Value*)0x43));
 	STRICT_EXPECTED_CALL(ModuleLoader_Destroy());
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 	///act
 	MODULE_HANDLE m = MODULE_CREATE(apis)(b, config);
 
@@ -951,6 +983,7 @@ TEST_FUNCTION(NativeModuleHost_Create_fails_init_loaders_from_json_fails)
 	const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 	BROKER_HANDLE b = (BROKER_HANDLE)0x42;
 	char * config = "Assume this is a valid config";
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
 	STRICT_EXPECTED_CALL(ModuleLoader_Initialize());
 	STRICT_EXPECTED_CALL(json_parse_string(config))
 		.SetReturn((JSON_Value*)0x43);
@@ -963,6 +996,7 @@ TEST_FUNCTION(NativeModuleHost_Create_fails_init_loaders_from_json_fails)
 
 	STRICT_EXPECTED_CALL(json_value_free((JSON_Value*)0x43));
 	STRICT_EXPECTED_CALL(ModuleLoader_Destroy());
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 	///act
 	MODULE_HANDLE m = MODULE_CREATE(apis)(b, config);
 
@@ -979,6 +1013,7 @@ TEST_FUNCTION(NativeModuleHost_Create_fails_json_root_obj_not_found_fails)
 	const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 	BROKER_HANDLE b = (BROKER_HANDLE)0x42;
 	char * config = "Assume this is a valid config";
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
 	STRICT_EXPECTED_CALL(ModuleLoader_Initialize());
 	STRICT_EXPECTED_CALL(json_parse_string(config))
 		.SetReturn((JSON_Value*)0x43);
@@ -987,6 +1022,7 @@ TEST_FUNCTION(NativeModuleHost_Create_fails_json_root_obj_not_found_fails)
 
 	STRICT_EXPECTED_CALL(json_value_free((JSON_Value*)0x43));
 	STRICT_EXPECTED_CALL(ModuleLoader_Destroy());
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 	///act
 	MODULE_HANDLE m = MODULE_CREATE(apis)(b, config);
 
@@ -1003,11 +1039,13 @@ TEST_FUNCTION(NativeModuleHost_Create_fails_json_parse_fails)
 	const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 	BROKER_HANDLE b = (BROKER_HANDLE)0x42;
 	char * config = "Assume this is a valid config";
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
 	STRICT_EXPECTED_CALL(ModuleLoader_Initialize());
 	STRICT_EXPECTED_CALL(json_parse_string(config))
 		.SetReturn(NULL);
 
 	STRICT_EXPECTED_CALL(ModuleLoader_Destroy());
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 	///act
 	MODULE_HANDLE m = MODULE_CREATE(apis)(b, config);
 
@@ -1024,8 +1062,29 @@ TEST_FUNCTION(NativeModuleHost_Create_fails_moduleloader_init_fails)
 	const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 	BROKER_HANDLE b = (BROKER_HANDLE)0x42;
 	char * config = "Assume this is a valid config";
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
 	STRICT_EXPECTED_CALL(ModuleLoader_Initialize())
 		.SetReturn(MODULE_LOADER_ERROR);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+
+	///act
+	MODULE_HANDLE m = MODULE_CREATE(apis)(b, config);
+
+	///assert
+	ASSERT_IS_NULL(m);
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+	///ablution
+}
+
+/*Tests_SRS_NATIVEMODULEHOST_31_006: [ If the module host lock cannot be acquired, NativeModuleHost_Create shall return NULL. ]*/
+TEST_FUNCTION(NativeModuleHost_Create_fails_lock_fails)
+{
+	///arrange
+	const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+	BROKER_HANDLE b = (BROKER_HANDLE)0x42;
+	char * config = "Assume this is a valid config";
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
+		.SetReturn(LOCK_ERROR);
 
 	///act
 	MODULE_HANDLE m = MODULE_CREATE(apis)(b, config);
@@ -1042,7 +1101,9 @@ TEST_FUNCTION(NativeModuleHost_Destroy_destroys_loader_with_nothing)
 	///arrange
 	const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
 	STRICT_EXPECTED_CALL(ModuleLoader_Destroy());
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 
 	///act
 	MODULE_DESTROY(apis)(NULL);
@@ -1056,6 +1117,7 @@ static MODULE_HANDLE create_a_module(const MODULE_API* apis)
 {
 	BROKER_HANDLE b = (BROKER_HANDLE)0x42;
 	char * config = "Assume this is a valid config";
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
 	STRICT_EXPECTED_CALL(ModuleLoader_Initialize());
 	STRICT_EXPECTED_CALL(json_parse_string(config))
 		.SetReturn((JSON_Value*)0x43);
@@ -1100,6 +1162,7 @@ static MODULE_HANDLE create_a_module(const MODULE_API* apis)
 	STRICT_EXPECTED_CALL(mock_ModuleLoader_FreeEntrypoint(&dummyModuleLoader, IGNORED_PTR_ARG))
 		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(json_value_free((JSON_Value*)0x43));
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 
 	///act
 	MODULE_HANDLE m = MODULE_CREATE(apis)(b, config);
@@ -1109,6 +1172,7 @@ static MODULE_HANDLE create_a_module(const MODULE_API* apis)
 }
 
 /*Tests_SRS_NATIVEMODULEHOST_17_028: [ NativeModuleHost_Destroy shall free all remaining allocated resources if moduleHandle is not NULL. ]*/
+/*Tests_SRS_NATIVEMODULEHOST_31_007: [ NativeModuleHost_Destroy shall hold the module host lock while it destroys the module host and, if it is the last one, the module loader. ]*/
 TEST_FUNCTION(NativeModuleHost_Destroy_success)
 {
 	///arrange
@@ -1116,6 +1180,7 @@ TEST_FUNCTION(NativeModuleHost_Destroy_success)
 
 	MODULE_HANDLE m = create_a_module(apis);
 
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
 	STRICT_EXPECTED_CALL(mock_ModuleLoader_GetApi(&dummyModuleLoader, IGNORED_PTR_ARG))
 		.IgnoreArgument(2).SetReturn((const MODULE_API*)&dummyAPIs);
 	STRICT_EXPECTED_CALL(mock_Module_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
@@ -1124,13 +1189,68 @@ TEST_FUNCTION(NativeModuleHost_Destroy_success)
 	STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(ModuleLoader_Destroy());
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+
+	///act
+	MODULE_DESTROY(apis)(m);
+
+	///assert
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+	///ablution
+}
+
+/*Tests_SRS_NATIVEMODULEHOST_31_008: [ If the module host lock cannot be acquired, NativeModuleHost_Destroy shall do nothing. ]*/
+TEST_FUNCTION(NativeModuleHost_Destroy_does_nothing_when_lock_fails)
+{
+	///arrange
+	const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+
+	MODULE_HANDLE m = create_a_module(apis);
+
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
+		.SetReturn(LOCK_ERROR);
 
 	///act
 	MODULE_DESTROY(apis)(m);
 
 	///assert
 	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	///ablution
+	umock_c_reset_all_calls();
+	EXPECTED_CALL(mock_ModuleLoader_GetApi(&dummyModuleLoader, IGNORED_PTR_ARG))
+		.IgnoreArgument(2).SetReturn((const MODULE_API*)&dummyAPIs);
+	MODULE_DESTROY(apis)(m);
+}
+
+/*Tests_SRS_NATIVEMODULEHOST_31_001: [ NativeModuleHost_Create shall only initialize the Module_Loader if no other module host exists in the process. ]*/
+/*Tests_SRS_NATIVEMODULEHOST_31_003: [ NativeModuleHost_Destroy shall only destroy the module loader when no other module host exists in the process. ]*/
+TEST_FUNCTION(NativeModuleHost_Destroy_keeps_loader_for_other_hosts)
+{
+	///arrange
+	const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+
+	MODULE_HANDLE m1 = create_a_module(apis);
+	MODULE_HANDLE m2 = create_a_module(apis);
+
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mock_ModuleLoader_GetApi(&dummyModuleLoader, IGNORED_PTR_ARG))
+		.IgnoreArgument(2).SetReturn((const MODULE_API*)&dummyAPIs);
+	STRICT_EXPECTED_CALL(mock_Module_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mock_ModuleLoader_Unload(&dummyModuleLoader, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+
+	///act
+	MODULE_DESTROY(apis)(m1);
+
+	///assert
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
 	///ablution
+	MODULE_DESTROY(apis)(m2);
 }
 
 /*Tests_SRS_NATIVEMODULEHOST_17_029: [ NativeModuleHost_Receive shall do nothing if moduleHandle is NULL. ]*/
@@ -16,6 +16,7 @@
 
 #include "module.h"
 #include "module_loader.h"
+#include "module_loaders/outprocess_module.h"
 #include "gateway_export.h"
 
 #ifdef __cplusplus
@@ -35,6 +36,17 @@ extern "C"
  */
 DEFINE_ENUM(OUTPROCESS_LOADER_ACTIVATION_TYPE, OUTPROCESS_LOADER_ACTIVATION_TYPE_VALUES);
 
+#define OUTPROCESS_LOADER_TRANSPORT_VALUES \
+    OUTPROCESS_LOADER_TRANSPORT_IPC, \
+    OUTPROCESS_LOADER_TRANSPORT_SHM, \
+    OUTPROCESS_LOADER_TRANSPORT_TCP, \
+    OUTPROCESS_LOADER_TRANSPORT_INVALID \
+
+/**
+ * @brief Enumeration listing the transports available for the message channel
+ */
+DEFINE_ENUM(OUTPROCESS_LOADER_TRANSPORT, OUTPROCESS_LOADER_TRANSPORT_VALUES);
+
 /** @brief Structure to load an out of process proxy module */
 typedef struct OUTPROCESS_LOADER_ENTRYPOINT_TAG
 {
@@ -53,6 +65,20 @@ typedef struct OUTPROCESS_LOADER_ENTRYPOINT_TAG
     char ** process_argv;
     /** @brief controls timeout for ipc retries. */
 	unsigned int remote_message_wait;
+    /** @brief The transport used by the message channel. */
+    OUTPROCESS_LOADER_TRANSPORT message_transport;
+    /**
+     * @brief Optional id of a module host process shared by several modules.
+     * Modules launched with the same host id are hosted by a single process,
+     * which is only launched for the first of them. Each module keeps its
+     * own control and message channels to the shared process.
+     */
+    char * host_id;
+    /**
+     * @brief Connection tuning for the `OUTPROCESS_LOADER_TRANSPORT_TCP`
+     * transport, all zero otherwise.
+     */
+    OUTPROCESS_MODULE_TCP_OPTIONS tcp_options;
 } OUTPROCESS_LOADER_ENTRYPOINT;
 
 /** @brief      The API for the out of process proxy module loader. */
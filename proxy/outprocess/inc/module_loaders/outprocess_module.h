@@ -23,6 +23,25 @@ extern "C"
 
 DEFINE_ENUM(OUTPROCESS_MODULE_LIFECYCLE, OUTPROCESS_MODULE_LIFECYCLE_VALUES);
 
+/** @brief Connection tuning for control and message channels carried over tcp.
+ *         A zero field keeps the nanomsg default or disables the feature. */
+typedef struct OUTPROCESS_MODULE_TCP_OPTIONS_TAG
+{
+	/** @brief Interval in ms between keepalive pings on an idle control
+	 *         channel. The channels are reconnected once
+	 *         `OUTPROCESS_MODULE_KEEPALIVE_MISSED_MAX` intervals pass with no
+	 *         control message from the module host. */
+	unsigned int keepalive_interval;
+	/** @brief Upper bound in ms of the reconnect back-off (NN_RECONNECT_IVL_MAX). */
+	int reconnect_interval_max;
+	/** @brief Send buffer size in bytes (NN_SNDBUF). */
+	int send_buffer_size;
+	/** @brief Receive buffer size in bytes (NN_RCVBUF). */
+	int receive_buffer_size;
+} OUTPROCESS_MODULE_TCP_OPTIONS;
+
+#define OUTPROCESS_MODULE_KEEPALIVE_MISSED_MAX 3
+
 /** @brief Structure to configure an out of process proxy module */
 typedef struct OUTPROCESS_MODULE_CONFIG_DATA
 {
@@ -35,6 +54,11 @@ typedef struct OUTPROCESS_MODULE_CONFIG_DATA
     STRING_HANDLE outprocess_module_args;
 	/** @brief controls timeout for ipc retries. */
 	unsigned int remote_message_wait;
+	/** @brief Size in bytes of each direction of the shared memory message
+	 *         ring. Zero selects a nanomsg socket for the message channel. */
+	uint32_t message_ring_size;
+	/** @brief Options applied to both channel sockets. */
+	OUTPROCESS_MODULE_TCP_OPTIONS tcp_options;
 } OUTPROCESS_MODULE_CONFIG;
 
 /** @brief the API fr this module */
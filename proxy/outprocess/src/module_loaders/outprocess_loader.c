@@ -3,6 +3,7 @@
 
 #include "module_loaders/outprocess_loader.h"
 
+#include <limits.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <uv.h>
@@ -19,12 +20,14 @@
 #include "module.h"
 #include "module_loader.h"
 #include "module_loaders/outprocess_module.h"
+#include "shm_ring.h"
 
 DEFINE_ENUM_STRINGS(OUTPROCESS_LOADER_ACTIVATION_TYPE, OUTPROCESS_LOADER_ACTIVATION_TYPE_VALUES);
 
 #define LOADER_GUID_SIZE 37
 #define IPC_URI_HEAD "ipc://"
 #define IPC_URI_HEAD_SIZE 6
+#define TCP_URI_HEAD "tcp://"
 #define MESSAGE_URI_SIZE (INPROC_URI_HEAD_SIZE + LOADER_GUID_SIZE +1)
 
 #define GRACE_PERIOD_MS_DEFAULT 3000
@@ -41,6 +44,62 @@ static VECTOR_HANDLE uv_processes = NULL;
 static THREAD_HANDLE uv_thread = NULL;
 static tickcounter_ms_t uv_process_grace_period_ms = 0;
 
+typedef struct LAUNCHED_HOST_TAG
+{
+    struct LAUNCHED_HOST_TAG * next;
+    char host_id[1];
+} LAUNCHED_HOST;
+
+// Host ids of the shared module host processes launched so far
+static LAUNCHED_HOST * launched_hosts = NULL;
+
+static bool host_is_launched(const char * host_id)
+{
+    bool result = false;
+
+    if (host_id != NULL)
+    {
+        for (LAUNCHED_HOST * host = launched_hosts; host != NULL; host = host->next)
+        {
+            if (0 == strcmp(host->host_id, host_id))
+            {
+                result = true;
+                break;
+            }
+        }
+    }
+
+    return result;
+}
+
+static int record_launched_host(const char * host_id)
+{
+    int result;
+
+    if (host_id == NULL)
+    {
+        result = 0;
+    }
+    else
+    {
+        LAUNCHED_HOST * host = (LAUNCHED_HOST *)malloc(sizeof(LAUNCHED_HOST) + strlen(host_id));
+        if (host == NULL)
+        {
+            LogError("Unable to record launched host [%s]", host_id);
+            result = __LINE__;
+        }
+        else
+        {
+            (void)strcpy(host->host_id, host_id);
+            host->next = launched_hosts;
+            launched_hosts = host;
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
 int launch_child_process_from_entrypoint (OUTPROCESS_LOADER_ENTRYPOINT * outprocess_entry)
 {
     int result;
@@ -122,6 +181,7 @@ int update_entrypoint_with_launch_object(OUTPROCESS_LOADER_ENTRYPOINT * outproce
     JSON_Array * launch_args = json_object_get_array(launch_object, "args");
 
     /* Codes_SRS_OUTPROCESS_LOADER_27_084: [ `update_entrypoint_with_launch_object` shall determine the size of the JSON arguments array, by calling `size_t json_array_get_count(const JSON_Array * array)`. ] */
+    outprocess_entry->host_id = NULL;
     outprocess_entry->process_argc = (json_array_get_count(launch_args) + 1);  // Add 1 to make room for launch path
     /* Codes_SRS_OUTPROCESS_LOADER_27_085: [ `update_entrypoint_with_launch_object` shall allocate the argument array, by calling `void * malloc(size _Size)` passing the result of `json_array_get_count` plus two, one for passing the file path as the first argument and the second for the NULL terminating pointer required by libUV. ] */
     if (NULL == (outprocess_entry->process_argv = (char **)malloc(sizeof(char *) * (outprocess_entry->process_argc + 1)))) // Add 1 to make room for NULL terminator
@@ -173,6 +233,30 @@ int update_entrypoint_with_launch_object(OUTPROCESS_LOADER_ENTRYPOINT * outproce
             }
         }
         outprocess_entry->process_argv[i] = NULL;  // NULL terminate the array
+
+        if (0 == result)
+        {
+            // A shared host only shares the process: each of its modules keeps its own control and message channels
+            /* Codes_SRS_OUTPROCESS_LOADER_31_005: [ `update_entrypoint_with_launch_object` shall retrieve the optional host id, by calling `const char * json_object_get_string(const JSON_Object * object, const char * name)` passing `host.id` as `name`. ] */
+            const char * host_id = json_object_get_string(launch_object, "host.id");
+            if (NULL == host_id)
+            {
+                // not a shared host
+            }
+            /* Codes_SRS_OUTPROCESS_LOADER_31_006: [ `update_entrypoint_with_launch_object` shall allocate the space necessary to copy the host id, by calling `void * malloc(size _Size)`. ] */
+            else if (NULL == (outprocess_entry->host_id = (char *)malloc(strlen(host_id) + 1)))
+            {
+                /* Codes_SRS_OUTPROCESS_LOADER_31_007: [ If unable to allocate space for the host id, then `update_entrypoint_with_launch_object` shall free the argument array and return a non - zero value. ] */
+                LogError("Unable to allocate host id string.");
+                for (i = 0; i < (int)outprocess_entry->process_argc; ++i) { free(outprocess_entry->process_argv[i]); }
+                free(outprocess_entry->process_argv);
+                result = __LINE__;
+            }
+            else
+            {
+                (void)strcpy(outprocess_entry->host_id, host_id);
+            }
+        }
     }
 
     return result;
@@ -340,6 +424,14 @@ void OutprocessLoader_JoinChildProcesses(void) {
         VECTOR_destroy(uv_processes);
         uv_processes = NULL;
     }
+
+    /* Codes_SRS_OUTPROCESS_LOADER_31_010: [ `OutprocessLoader_JoinChildProcesses` shall forget all launched shared host processes. ] */
+    while (NULL != launched_hosts)
+    {
+        LAUNCHED_HOST * host = launched_hosts;
+        launched_hosts = host->next;
+        free(host);
+    }
 }
 
 static MODULE_LIBRARY_HANDLE OutprocessModuleLoader_Load(const MODULE_LOADER* loader, const void* entrypoint)
@@ -372,7 +464,11 @@ static MODULE_LIBRARY_HANDLE OutprocessModuleLoader_Load(const MODULE_LOADER* lo
         LogError("Invalid arguments activation type");
     }
     /*Codes_SRS_OUTPROCESS_LOADER_27_005: [ Launch - `OutprocessModuleLoader_Load` shall launch the child process identified by the entrypoint. ]*/
-    else if ((OUTPROCESS_LOADER_ACTIVATION_LAUNCH == outprocess_entry->activation_type) && launch_child_process_from_entrypoint(outprocess_entry))
+    /*Codes_SRS_OUTPROCESS_LOADER_31_008: [ Launch - `OutprocessModuleLoader_Load` shall not launch the child process if the entrypoint's `host_id` names a host already launched by the loader. ]*/
+    /*Codes_SRS_OUTPROCESS_LOADER_31_009: [ Launch - `OutprocessModuleLoader_Load` shall remember the entrypoint's `host_id`, if any, once the child process is launched. ]*/
+    else if ((OUTPROCESS_LOADER_ACTIVATION_LAUNCH == outprocess_entry->activation_type) &&
+             !host_is_launched(outprocess_entry->host_id) &&
+             (launch_child_process_from_entrypoint(outprocess_entry) || record_launched_host(outprocess_entry->host_id)))
     {
         /*Codes_SRS_OUTPROCESS_LOADER_17_008: [ If any call in this function fails, this function shall return NULL. ] */
         result = NULL;
@@ -451,9 +547,70 @@ static void OutprocessModuleLoader_Unload(const struct MODULE_LOADER_TAG* loader
     }
 }
 
+static OUTPROCESS_LOADER_TRANSPORT parse_message_transport(const char* transport)
+{
+    OUTPROCESS_LOADER_TRANSPORT result;
+    if (transport == NULL || !strncmp("ipc", transport, sizeof("ipc")))
+    {
+        result = OUTPROCESS_LOADER_TRANSPORT_IPC;
+    }
+    else if (!strncmp("shm", transport, sizeof("shm")))
+    {
+        result = OUTPROCESS_LOADER_TRANSPORT_SHM;
+    }
+    else if (!strncmp("tcp", transport, sizeof("tcp")))
+    {
+        result = OUTPROCESS_LOADER_TRANSPORT_TCP;
+    }
+    else
+    {
+        result = OUTPROCESS_LOADER_TRANSPORT_INVALID;
+    }
+    return result;
+}
+
+static bool is_valid_tcp_option(double value)
+{
+    return ((value >= 0) && (value <= INT_MAX));
+}
+
+static int parse_tcp_options(const JSON_Object* tcp, OUTPROCESS_MODULE_TCP_OPTIONS* options)
+{
+    int result;
+    if (tcp == NULL)
+    {
+        // keep the nanomsg defaults
+        result = 0;
+    }
+    else
+    {
+        double keepalive = json_object_get_number(tcp, "keepalive");
+        double reconnect_max = json_object_get_number(tcp, "reconnect.max");
+        double send_buffer = json_object_get_number(tcp, "send.buffer");
+        double receive_buffer = json_object_get_number(tcp, "receive.buffer");
+
+        if (!is_valid_tcp_option(keepalive) || !is_valid_tcp_option(reconnect_max) ||
+            !is_valid_tcp_option(send_buffer) || !is_valid_tcp_option(receive_buffer))
+        {
+            LogError("Invalid tcp options specified!");
+            result = __LINE__;
+        }
+        else
+        {
+            options->keepalive_interval = (unsigned int)keepalive;
+            options->reconnect_interval_max = (int)reconnect_max;
+            options->send_buffer_size = (int)send_buffer;
+            options->receive_buffer_size = (int)receive_buffer;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+static void OutprocessModuleLoader_FreeEntrypoint(const struct MODULE_LOADER_TAG* loader, void* entrypoint);
+
 static void* OutprocessModuleLoader_ParseEntrypointFromJson(const struct MODULE_LOADER_TAG* loader, const JSON_Value* json)
 {
-    (void)loader;
 
     OUTPROCESS_LOADER_ENTRYPOINT * config;
     JSON_Object* entrypoint;
@@ -531,6 +688,8 @@ static void* OutprocessModuleLoader_ParseEntrypointFromJson(const struct MODULE_
             // Initialize variables to ensure proper clean-up behavior
             config->process_argc = 0;
             config->process_argv = NULL;
+            config->host_id = NULL;
+            memset(&config->tcp_options, 0, sizeof(config->tcp_options));
 
             /*Codes_SRS_OUTPROCESS_LOADER_17_018: [ This function shall assign the entrypoint control_id to the string value of "control.id" in json, NULL if not present. ] */
             if (NULL == (config->control_id = STRING_construct(controlId)))
@@ -565,8 +724,37 @@ static void* OutprocessModuleLoader_ParseEntrypointFromJson(const struct MODULE_
                 /*Codes_SRS_OUTPROCESS_LOADER_17_017: [ This function shall assign the entrypoint activation_type to the decoded value. ] */
                 config->activation_type = activationType;
 
-                /*Codes_SRS_OUTPROCESS_LOADER_17_019: [ This function shall assign the entrypoint message_id to the string value of "message.id" in json, NULL if not present. ] */
-                config->message_id = STRING_construct(messageId);
+                /*Codes_SRS_OUTPROCESS_LOADER_31_001: [ This function shall read the optional "message.transport" value, defaulting to `OUTPROCESS_LOADER_TRANSPORT_IPC`. ]*/
+                config->message_transport = parse_message_transport(json_object_get_string(entrypoint, "message.transport"));
+                if (config->message_transport == OUTPROCESS_LOADER_TRANSPORT_INVALID)
+                {
+                    /*Codes_SRS_OUTPROCESS_LOADER_31_002: [ This function shall return NULL if "message.transport" is not "ipc", "shm" or "tcp". ]*/
+                    LogError("Invalid message transport specified!");
+                    config->message_id = NULL;
+                    OutprocessModuleLoader_FreeEntrypoint(loader, config);
+                    config = NULL;
+                }
+                else if ((config->message_transport == OUTPROCESS_LOADER_TRANSPORT_TCP) && (messageId == NULL))
+                {
+                    /*Codes_SRS_OUTPROCESS_LOADER_31_011: [ This function shall return NULL if "message.transport" is "tcp" and "message.id" is not present in json. ]*/
+                    LogError("The tcp message transport needs a message.id address!");
+                    config->message_id = NULL;
+                    OutprocessModuleLoader_FreeEntrypoint(loader, config);
+                    config = NULL;
+                }
+                /*Codes_SRS_OUTPROCESS_LOADER_31_012: [ If "message.transport" is "tcp", this function shall read the optional "tcp" object's "keepalive", "reconnect.max", "send.buffer" and "receive.buffer" numbers into the entrypoint's tcp_options. ]*/
+                else if ((config->message_transport == OUTPROCESS_LOADER_TRANSPORT_TCP) && (0 != parse_tcp_options(json_object_get_object(entrypoint, "tcp"), &config->tcp_options)))
+                {
+                    /*Codes_SRS_OUTPROCESS_LOADER_31_013: [ This function shall return NULL if any of the "tcp" values is negative or larger than `INT_MAX`. ]*/
+                    config->message_id = NULL;
+                    OutprocessModuleLoader_FreeEntrypoint(loader, config);
+                    config = NULL;
+                }
+                else
+                {
+                    /*Codes_SRS_OUTPROCESS_LOADER_17_019: [ This function shall assign the entrypoint message_id to the string value of "message.id" in json, NULL if not present. ] */
+                    config->message_id = STRING_construct(messageId);
+                }
 
                 /*Codes_SRS_OUTPROCESS_LOADER_17_022: [ This function shall return a valid pointer to an OUTPROCESS_LOADER_ENTRYPOINT on success. ]*/
             }
@@ -593,6 +781,8 @@ static void OutprocessModuleLoader_FreeEntrypoint(const struct MODULE_LOADER_TAG
             }
             free(ep->process_argv);
         }
+        if (ep->host_id != NULL)
+            free(ep->host_id);
 
         free(ep);
     }
@@ -643,6 +833,10 @@ static void* OutprocessModuleLoader_BuildModuleConfiguration(
         OUTPROCESS_LOADER_ENTRYPOINT* ep = (OUTPROCESS_LOADER_ENTRYPOINT*)entrypoint;
         char uuid[LOADER_GUID_SIZE];
         UNIQUEID_RESULT uuid_result = UNIQUEID_OK;
+        /*Codes_SRS_OUTPROCESS_LOADER_31_003: [ If the entrypoint's message_transport is `OUTPROCESS_LOADER_TRANSPORT_SHM`, the message uri shall start with "shm://" instead of "ipc://". ]*/
+        /*Codes_SRS_OUTPROCESS_LOADER_31_014: [ If the entrypoint's message_transport is `OUTPROCESS_LOADER_TRANSPORT_TCP`, both the message uri and the control uri shall start with "tcp://" instead of "ipc://". ]*/
+        const char* control_uri_head = (ep->message_transport == OUTPROCESS_LOADER_TRANSPORT_TCP) ? TCP_URI_HEAD : IPC_URI_HEAD;
+        const char* message_uri_head = (ep->message_transport == OUTPROCESS_LOADER_TRANSPORT_SHM) ? SHM_RING_URI_HEAD : control_uri_head;
 
         if (ep->message_id == NULL)
         {
@@ -658,13 +852,13 @@ static void* OutprocessModuleLoader_BuildModuleConfiguration(
             else
             {
                 /*Codes_SRS_OUTPROCESS_LOADER_17_032: [ The message uri shall be composed of "ipc://" + unique id . ]*/
-                fullModuleConfiguration->message_uri = STRING_construct_sprintf("%s%s", IPC_URI_HEAD, uuid);
+                fullModuleConfiguration->message_uri = STRING_construct_sprintf("%s%s", message_uri_head, uuid);
             }
         }
         else
         {
             /*Codes_SRS_OUTPROCESS_LOADER_17_033: [ This function shall allocate and copy each string in OUTPROCESS_LOADER_ENTRYPOINT and assign them to the corresponding fields in OUTPROCESS_MODULE_CONFIG. ]*/
-            fullModuleConfiguration->message_uri = STRING_construct_sprintf("%s%s", IPC_URI_HEAD, STRING_c_str(ep->message_id));
+            fullModuleConfiguration->message_uri = STRING_construct_sprintf("%s%s", message_uri_head, STRING_c_str(ep->message_id));
         }
 
         if (fullModuleConfiguration->message_uri == NULL)
@@ -675,7 +869,7 @@ static void* OutprocessModuleLoader_BuildModuleConfiguration(
             fullModuleConfiguration = NULL;
         }
         /*Codes_SRS_OUTPROCESS_LOADER_17_033: [ This function shall allocate and copy each string in OUTPROCESS_LOADER_ENTRYPOINT and assign them to the corresponding fields in OUTPROCESS_MODULE_CONFIG. ]*/
-        else if (NULL == (fullModuleConfiguration->control_uri = STRING_construct_sprintf("%s%s", IPC_URI_HEAD, STRING_c_str(ep->control_id))))
+        else if (NULL == (fullModuleConfiguration->control_uri = STRING_construct_sprintf("%s%s", control_uri_head, STRING_c_str(ep->control_id))))
         {
             /*Codes_SRS_OUTPROCESS_LOADER_17_026: [ This function shall return NULL if entrypoint, control_id, or module_configuration is NULL. ] */
             /*Codes_SRS_OUTPROCESS_LOADER_17_036: [ If any call fails, this function shall return NULL. ]*/
@@ -700,6 +894,10 @@ static void* OutprocessModuleLoader_BuildModuleConfiguration(
             /*Codes_SRS_OUTPROCESS_LOADER_17_035: [ Upon success, this function shall return a valid pointer to an OUTPROCESS_MODULE_CONFIG structure. ]*/
             fullModuleConfiguration->remote_message_wait = ep->remote_message_wait;
             fullModuleConfiguration->lifecycle_model = OUTPROCESS_LIFECYCLE_SYNC;
+            /*Codes_SRS_OUTPROCESS_LOADER_31_004: [ If the entrypoint's message_transport is `OUTPROCESS_LOADER_TRANSPORT_SHM`, the module configuration shall request a shared memory ring of `SHM_RING_DEFAULT_CAPACITY` bytes, otherwise no ring. ]*/
+            fullModuleConfiguration->message_ring_size = (ep->message_transport == OUTPROCESS_LOADER_TRANSPORT_SHM) ? SHM_RING_DEFAULT_CAPACITY : 0;
+            /*Codes_SRS_OUTPROCESS_LOADER_31_015: [ The module configuration shall carry the entrypoint's tcp_options. ]*/
+            fullModuleConfiguration->tcp_options = ep->tcp_options;
         }
     }
 
@@ -2,6 +2,7 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <errno.h>
 #include <nanomsg/nn.h>
 #include <nanomsg/pair.h>
@@ -11,6 +12,7 @@
 #include "message.h"
 #include "message_queue.h"
 #include "control_message.h"
+#include "shm_ring.h"
 #include "module_loaders/outprocess_module.h"
 #include "azure_c_shared_utility/strings.h"
 #include "azure_c_shared_utility/xlogging.h"
@@ -27,11 +29,23 @@ typedef struct THREAD_CONTROL_TAG
 
 #define THREAD_FLAG_STOP 1
 
+/* how long the shared memory threads block before checking for a stop request */
+#define SHM_RING_POLL_TIMEOUT_MS 100
+
+/* how often the control thread checks the control channel */
+#define CONTROL_THREAD_POLL_MS 250
+
 typedef struct OUTPROCESS_HANDLE_DATA_TAG
 {
 	LOCK_HANDLE handle_lock;
 	int message_socket;
+	int message_endpoint;
+	SHM_RING_HANDLE message_ring;
+	int32_t message_ring_record_max;
+	char message_fallback_uri[SHM_RING_FALLBACK_URI_SIZE];
 	int control_socket;
+	int control_endpoint;
+	OUTPROCESS_MODULE_TCP_OPTIONS tcp_options;
 	MESSAGE_QUEUE_HANDLE outgoing_messages;
 	STRING_HANDLE control_uri;
 	STRING_HANDLE message_uri;
@@ -49,6 +63,8 @@ typedef struct OUTPROCESS_HANDLE_DATA_TAG
 // forward definitions
 static void* construct_create_message(OUTPROCESS_HANDLE_DATA* handleData, int32_t * creationMessageSize);
 static void send_start_message(OUTPROCESS_HANDLE_DATA* handleData);
+static void send_ping_message(OUTPROCESS_HANDLE_DATA* handleData);
+static void reconnect_channels(OUTPROCESS_HANDLE_DATA* handleData);
 
 
 int outprocessIncomingMessageThread(void *param)
@@ -73,6 +89,7 @@ int outprocessIncomingMessageThread(void *param)
 				break;
 			}
 			int nn_fd = handleData->message_socket;
+			SHM_RING_HANDLE message_ring = handleData->message_ring;
 			if (Unlock(handleData->handle_lock) != LOCK_OK)
 			{
 				should_continue = 0;
@@ -98,15 +115,36 @@ int outprocessIncomingMessageThread(void *param)
 				break;
 			}
 
+			int receive_flags = 0;
+			if (message_ring != NULL)
+			{
+				const unsigned char* record = NULL;
+				/*Codes_SRS_OUTPROCESS_MODULE_31_004: [ If the message channel is a shared memory ring, this function shall wait for the next record in the ring, then check the message socket, which carries the messages too large for the ring, without waiting. ]*/
+				/* a corrupt record is skipped by the ring itself, so a failed read does not end the thread */
+				int32_t record_size = ShmRing_BeginRead(message_ring, &record, SHM_RING_POLL_TIMEOUT_MS);
+				if (record_size > 0)
+				{
+					/*Codes_SRS_OUTPROCESS_MODULE_31_005: [ This function shall deserialize the message, which copies it out of the ring, release the record, and publish the message to the broker. ]*/
+					MESSAGE_HANDLE msg = Message_CreateFromByteArray(record, record_size);
+					(void)ShmRing_EndRead(message_ring);
+					if (msg != NULL)
+					{
+						Broker_Publish(handleData->broker, (MODULE_HANDLE)handleData, msg);
+						Message_Destroy(msg);
+					}
+				}
+				receive_flags = NN_DONTWAIT;
+			}
+
 			int nbytes;
 			unsigned char *buf = NULL;
 			errno = 0;
 			/*Codes_SRS_OUTPROCESS_MODULE_17_038: [ This function shall read from the message channel for gateway messages from the module host. ]*/
-			nbytes = nn_recv(nn_fd, (void *)&buf, NN_MSG, 0);
+			nbytes = nn_recv(nn_fd, (void *)&buf, NN_MSG, receive_flags);
 			if (nbytes < 0)
 			{
 				int receive_error = nn_errno();
-				if (receive_error != ETIMEDOUT)
+				if (receive_error != ETIMEDOUT && receive_error != EAGAIN)
 					should_continue = 0;
 			}
 			else
@@ -122,7 +160,10 @@ int outprocessIncomingMessageThread(void *param)
 				}
 				nn_freemsg(buf);
 			}
-			ThreadAPI_Sleep(1);
+			if (message_ring == NULL)
+			{
+				ThreadAPI_Sleep(1);
+			}
 		}
 	}
 	return 0;
@@ -199,6 +240,25 @@ static int outprocessOutgoingMessagesThread(void * param)
 				{
 					LogError("unable to serialize outgoing message [%p]", messageHandle);
 				}
+				/*Codes_SRS_OUTPROCESS_MODULE_31_012: [ If the message channel is a shared memory ring, this function shall send a message larger than `ShmRing_GetMaxRecordSize` on the message socket instead. ]*/
+				else if (handleData->message_ring != NULL && msg_size <= handleData->message_ring_record_max)
+				{
+					/*Codes_SRS_OUTPROCESS_MODULE_31_006: [ If the message channel is a shared memory ring, this function shall serialize the message directly into space reserved in the ring. ]*/
+					unsigned char* record = ShmRing_BeginWrite(handleData->message_ring, msg_size, handleData->remote_message_wait);
+					if (record == NULL)
+					{
+						LogError("unable to reserve ring space for message [%p]", messageHandle);
+					}
+					else if (Message_ToByteArray(messageHandle, record, msg_size) != msg_size)
+					{
+						LogError("unable to serialize outgoing message [%p]", messageHandle);
+						ShmRing_CancelWrite(handleData->message_ring);
+					}
+					else
+					{
+						(void)ShmRing_EndWrite(handleData->message_ring);
+					}
+				}
 				else
 				{
 					void* result = nn_allocmsg(msg_size, 0);
@@ -321,7 +381,12 @@ static int outprocessCreate(void *param)
 								}
 								else
 								{
-									if (msg->type != CONTROL_MESSAGE_TYPE_MODULE_REPLY)
+									if (msg->type == CONTROL_MESSAGE_TYPE_MODULE_PING)
+									{
+										/*Codes_SRS_OUTPROCESS_MODULE_31_008: [ This function shall ignore keepalive pings echoed by the module host while waiting for the Create Response. ]*/
+										should_continue = 1;
+									}
+									else if (msg->type != CONTROL_MESSAGE_TYPE_MODULE_REPLY)
 									{
 										thread_return = -1;
 									}
@@ -351,6 +416,15 @@ static int outprocessCreate(void *param)
 	return thread_return;
 }
 
+static void report_detached(OUTPROCESS_HANDLE_DATA * handleData, int needs_to_attach)
+{
+	/*Codes_SRS_OUTPROCESS_MODULE_31_011: [ When the thread first finds the module host process detached, it shall report `BROKER_ALERT_MODULE_DETACHED` for this module to the broker. ]*/
+	if (needs_to_attach == 0)
+	{
+		Broker_ReportAlert(handleData->broker, BROKER_ALERT_MODULE_DETACHED, (MODULE_HANDLE)handleData, 0, 0);
+	}
+}
+
 int outprocessControlThread(void *param)
 {
 	OUTPROCESS_HANDLE_DATA * handleData = (OUTPROCESS_HANDLE_DATA*)param;
@@ -362,6 +436,7 @@ int outprocessControlThread(void *param)
 	{
 		int should_continue = 1;
 		int needs_to_attach = 0;
+		unsigned int idle_time = 0;
 
 		while (should_continue)
 		{
@@ -429,6 +504,7 @@ int outprocessControlThread(void *param)
 			}
 			else
 			{
+				idle_time = 0;
 				CONTROL_MESSAGE * msg = ControlMessage_CreateFromByteArray((const unsigned char*)buf, nbytes);
 				nn_freemsg(buf);
 				if (msg != NULL)
@@ -440,13 +516,33 @@ int outprocessControlThread(void *param)
 						if (resp_msg->status != 0)
 						{
 							/*Codes_SRS_OUTPROCESS_MODULE_17_059: [ If a Module Reply message has been received, and the status indicates the module has failed or has been terminated, this thread shall attempt to restart communications with module host process. ]*/
+							report_detached(handleData, needs_to_attach);
 							needs_to_attach = 1;
 						}
 					}
 					ControlMessage_Destroy(msg);
 				}
 			}
-			ThreadAPI_Sleep(250);
+
+			if ((nbytes < 0) && (should_continue == 1) && (handleData->tcp_options.keepalive_interval != 0))
+			{
+				idle_time += CONTROL_THREAD_POLL_MS;
+				if (idle_time >= handleData->tcp_options.keepalive_interval * OUTPROCESS_MODULE_KEEPALIVE_MISSED_MAX)
+				{
+					/*Codes_SRS_OUTPROCESS_MODULE_31_010: [ If no control message has been received for `OUTPROCESS_MODULE_KEEPALIVE_MISSED_MAX` keepalive intervals, this thread shall reconnect the control channel and the message socket, and attempt to restart communications with the module host process. ]*/
+					LogError("module host silent for %u ms, reconnecting", idle_time);
+					reconnect_channels(handleData);
+					report_detached(handleData, needs_to_attach);
+					needs_to_attach = 1;
+					idle_time = 0;
+				}
+				else if ((idle_time % handleData->tcp_options.keepalive_interval) < CONTROL_THREAD_POLL_MS)
+				{
+					/*Codes_SRS_OUTPROCESS_MODULE_31_009: [ If `keepalive_interval` is not zero, this thread shall send a Ping Message on the control channel every `keepalive_interval` milliseconds while no control message is received. ]*/
+					send_ping_message(handleData);
+				}
+			}
+			ThreadAPI_Sleep(CONTROL_THREAD_POLL_MS);
 		}
 	}
 	return 0;
@@ -455,54 +551,130 @@ int outprocessControlThread(void *param)
 /* Connection related functions
 */
 
+static int apply_socket_options(int socket, const OUTPROCESS_MODULE_TCP_OPTIONS * options)
+{
+	int result;
+	/*Codes_SRS_OUTPROCESS_MODULE_31_007: [ This function shall set `NN_SNDBUF`, `NN_RCVBUF` and `NN_RECONNECT_IVL_MAX` on each channel socket, before connecting it, from the non-zero `tcp_options` fields. ]*/
+	if ((options->send_buffer_size != 0) &&
+		(nn_setsockopt(socket, NN_SOL_SOCKET, NN_SNDBUF, &options->send_buffer_size, sizeof(options->send_buffer_size)) < 0))
+	{
+		result = -1;
+		LogError("unable to set the send buffer size, errno = %d", nn_errno());
+	}
+	else if ((options->receive_buffer_size != 0) &&
+		(nn_setsockopt(socket, NN_SOL_SOCKET, NN_RCVBUF, &options->receive_buffer_size, sizeof(options->receive_buffer_size)) < 0))
+	{
+		result = -1;
+		LogError("unable to set the receive buffer size, errno = %d", nn_errno());
+	}
+	else if ((options->reconnect_interval_max != 0) &&
+		(nn_setsockopt(socket, NN_SOL_SOCKET, NN_RECONNECT_IVL_MAX, &options->reconnect_interval_max, sizeof(options->reconnect_interval_max)) < 0))
+	{
+		result = -1;
+		LogError("unable to set the reconnect interval, errno = %d", nn_errno());
+	}
+	else
+	{
+		result = 0;
+	}
+	return result;
+}
+
 static int connection_setup(OUTPROCESS_HANDLE_DATA* handleData, OUTPROCESS_MODULE_CONFIG * config)
 {
 	int result;
 	handleData->control_socket = -1;
+	handleData->control_endpoint = -1;
+	handleData->message_socket = -1;
+	handleData->message_endpoint = -1;
+	handleData->message_ring = NULL;
 	/*
 	* Start with messaging socket.
 	*/
-	/*Codes_SRS_OUTPROCESS_MODULE_17_008: [ This function shall create a pair socket for sending gateway messages to the module host. ]*/
-	handleData->message_socket = nn_socket(AF_SP, NN_PAIR);
-	if (handleData->message_socket < 0)
+	if (config->message_ring_size > 0)
 	{
-		result = handleData->message_socket;
-		LogError("message socket failed to create, result = %d, errno = %d", result, nn_errno());
+		/*Codes_SRS_OUTPROCESS_MODULE_31_001: [ If `message_ring_size` is not zero, this function shall create a shared memory ring of that size named by the message uri, and connect the message socket to `SHM_RING_FALLBACK_URI_HEAD` followed by the name of the ring instead of the message uri. ]*/
+		handleData->message_ring = ShmRing_Create(STRING_c_str(config->message_uri), config->message_ring_size);
+		if (handleData->message_ring == NULL)
+		{
+			result = -1;
+			LogError("unable to create shared memory message channel");
+		}
+		else if (snprintf(handleData->message_fallback_uri, sizeof(handleData->message_fallback_uri), "%s%s", SHM_RING_FALLBACK_URI_HEAD, STRING_c_str(config->message_uri) + SHM_RING_URI_HEAD_SIZE) >= (int)sizeof(handleData->message_fallback_uri))
+		{
+			result = -1;
+			LogError("shared memory message channel name is too long");
+		}
+		else
+		{
+			handleData->message_ring_record_max = ShmRing_GetMaxRecordSize(handleData->message_ring);
+			result = 0;
+		}
 	}
 	else
 	{
-		/*Codes_SRS_OUTPROCESS_MODULE_17_009: [ This function shall bind and connect the pair socket to the message_uri. ]*/
-		int message_bind_id = nn_connect(handleData->message_socket, STRING_c_str(config->message_uri));
-		if (message_bind_id < 0)
+		result = 0;
+	}
+
+	if (result == 0)
+	{
+		/*Codes_SRS_OUTPROCESS_MODULE_17_008: [ This function shall create a pair socket for sending gateway messages to the module host. ]*/
+		handleData->message_socket = nn_socket(AF_SP, NN_PAIR);
+		if (handleData->message_socket < 0)
+		{
+			result = handleData->message_socket;
+			LogError("message socket failed to create, result = %d, errno = %d", result, nn_errno());
+		}
+		else if (apply_socket_options(handleData->message_socket, &config->tcp_options) != 0)
+		{
+			result = -1;
+		}
+		else
+		{
+			/*Codes_SRS_OUTPROCESS_MODULE_17_009: [ This function shall bind and connect the pair socket to the message_uri. ]*/
+			int message_bind_id = nn_connect(handleData->message_socket, (handleData->message_ring != NULL) ? handleData->message_fallback_uri : STRING_c_str(config->message_uri));
+			handleData->message_endpoint = message_bind_id;
+			if (message_bind_id < 0)
+			{
+				result = message_bind_id;
+				LogError("remote socket failed to bind to message URL, result = %d, errno = %d", result, nn_errno());
+			}
+			else
+			{
+				result = 0;
+			}
+		}
+	}
+
+	if (result == 0)
+	{
+		/*
+		* Now, the control socket.
+		*/
+		/*Codes_SRS_OUTPROCESS_MODULE_17_010: [ This function shall create a request/reply socket for sending control messages to the module host. ]*/
+		handleData->control_socket = nn_socket(AF_SP, NN_PAIR);
+		if (handleData->control_socket < 0)
 		{
-			result = message_bind_id;
-			LogError("remote socket failed to bind to message URL, result = %d, errno = %d", result, nn_errno());
+			result = handleData->control_socket;
+			LogError("remote socket failed to connect to control URL, result = %d, errno = %d", result, nn_errno());
+		}
+		else if (apply_socket_options(handleData->control_socket, &config->tcp_options) != 0)
+		{
+			result = -1;
 		}
 		else
 		{
-			/*
-			* Now, the control socket.
-			*/
-			/*Codes_SRS_OUTPROCESS_MODULE_17_010: [ This function shall create a request/reply socket for sending control messages to the module host. ]*/
-			handleData->control_socket = nn_socket(AF_SP, NN_PAIR);
-			if (handleData->control_socket < 0)
+			/*Codes_SRS_OUTPROCESS_MODULE_17_011: [ This function shall connect the request/reply socket to the control_id. ]*/
+			int control_connect_id = nn_connect(handleData->control_socket, STRING_c_str(config->control_uri));
+			handleData->control_endpoint = control_connect_id;
+			if (control_connect_id < 0)
 			{
-				result = handleData->control_socket;
+				result = control_connect_id;
 				LogError("remote socket failed to connect to control URL, result = %d, errno = %d", result, nn_errno());
 			}
 			else
 			{
-				/*Codes_SRS_OUTPROCESS_MODULE_17_011: [ This function shall connect the request/reply socket to the control_id. ]*/
-				int control_connect_id = nn_connect(handleData->control_socket, STRING_c_str(config->control_uri));
-				if (control_connect_id < 0)
-				{
-					result = control_connect_id;
-					LogError("remote socket failed to connect to control URL, result = %d, errno = %d", result, nn_errno());
-				}
-				else
-				{
-					result = 0;
-				}
+				result = 0;
 			}
 		}
 	}
@@ -523,6 +695,42 @@ static void connection_teardown(OUTPROCESS_HANDLE_DATA* handleData)
 }
 
 
+static void reconnect_channels(OUTPROCESS_HANDLE_DATA* handleData)
+{
+	if (Lock(handleData->handle_lock) != LOCK_OK)
+	{
+		LogError("unable to Lock handle data");
+	}
+	else
+	{
+		/* a peer which vanished without closing its connection keeps the pair sockets attached, so the endpoints are dropped and connected again */
+		(void)nn_shutdown(handleData->message_socket, handleData->message_endpoint);
+		handleData->message_endpoint = nn_connect(handleData->message_socket, (handleData->message_ring != NULL) ? handleData->message_fallback_uri : STRING_c_str(handleData->message_uri));
+		if (handleData->message_endpoint < 0)
+		{
+			LogError("unable to reconnect the message channel, errno = %d", nn_errno());
+		}
+		(void)nn_shutdown(handleData->control_socket, handleData->control_endpoint);
+		handleData->control_endpoint = nn_connect(handleData->control_socket, STRING_c_str(handleData->control_uri));
+		if (handleData->control_endpoint < 0)
+		{
+			LogError("unable to reconnect the control channel, errno = %d", nn_errno());
+		}
+		(void)Unlock(handleData->handle_lock);
+	}
+}
+
+
+static void message_ring_teardown(OUTPROCESS_HANDLE_DATA* handleData)
+{
+	/* the ring is unmapped only once no thread can touch it */
+	if (handleData->message_ring != NULL)
+	{
+		ShmRing_Destroy(handleData->message_ring);
+		handleData->message_ring = NULL;
+	}
+}
+
 
 /**/
 
@@ -580,7 +788,8 @@ static void* construct_create_message(OUTPROCESS_HANDLE_DATA* handleData, int32_
 			GATEWAY_MESSAGE_VERSION_CURRENT,		/*gateway_message_version*/
 			{
 				uri_length + 1,						/*uri_size (+1 for null)*/
-				(uint8_t)NN_PAIR,					/*uri_type*/
+				/*Codes_SRS_OUTPROCESS_MODULE_31_002: [ The Create Message uri type shall be `MESSAGE_URI_TYPE_SHM_RING` for a shared memory message channel, `NN_PAIR` otherwise. ]*/
+				(handleData->message_ring != NULL) ? (uint8_t)MESSAGE_URI_TYPE_SHM_RING : (uint8_t)NN_PAIR,	/*uri_type*/
 				uri_string							/*uri*/
 			},
 			args_length + 1,	/*args_size;(+1 for null)*/
@@ -633,6 +842,26 @@ static void send_start_message(OUTPROCESS_HANDLE_DATA* handleData)
     }
 }
 
+static void send_ping_message(OUTPROCESS_HANDLE_DATA* handleData)
+{
+	int32_t pingMessageSize = 0;
+	CONTROL_MESSAGE ping_msg =
+	{
+		CONTROL_MESSAGE_VERSION_CURRENT,	/*version*/
+		CONTROL_MESSAGE_TYPE_MODULE_PING	/*type*/
+	};
+	void * pingMessage = serialize_control_message(&ping_msg, &pingMessageSize);
+	if (pingMessage != NULL)
+	{
+		/* a ping which cannot be sent simply counts as missed */
+		int nBytes = nn_send(handleData->control_socket, &pingMessage, NN_MSG, NN_DONTWAIT);
+		if (nBytes != pingMessageSize)
+		{
+			nn_freemsg(pingMessage);
+		}
+	}
+}
+
 /*Codes_SRS_OUTPROCESS_MODULE_17_001: [ This function shall return NULL if configuration is NULL ]*/
 /*Codes_SRS_OUTPROCESS_MODULE_17_002: [ This function shall construct a STRING_HANDLE from the given configuration and return the result. ]*/
 static void* Outprocess_ParseConfigurationFromJson(const char* configuration)
@@ -746,6 +975,7 @@ static MODULE_HANDLE Outprocess_Create(BROKER_HANDLE broker, const void* configu
 						/*Codes_SRS_OUTPROCESS_MODULE_17_016: [ If any step in the creation fails, this function shall deallocate all resources and return NULL. ]*/
 						LogError("unable to set up connections");
 						connection_teardown(module);
+						message_ring_teardown(module);
 						MESSAGE_QUEUE_destroy(module->outgoing_messages);
 						Lock_Deinit(module->handle_lock);
 						free(module);
@@ -761,6 +991,7 @@ static MODULE_HANDLE Outprocess_Create(BROKER_HANDLE broker, const void* configu
 						};
 						module->broker = broker;
 						module->remote_message_wait = config->remote_message_wait;
+						module->tcp_options = config->tcp_options;
 						module->message_receive_thread = default_thread;
 						module->message_send_thread = default_thread;
 						module->control_thread = default_thread;
@@ -771,6 +1002,7 @@ static MODULE_HANDLE Outprocess_Create(BROKER_HANDLE broker, const void* configu
 						if ((module->message_receive_thread.thread_lock = Lock_Init()) == NULL)
 						{
 							connection_teardown(module);
+							message_ring_teardown(module);
 							MESSAGE_QUEUE_destroy(module->outgoing_messages);
 							Lock_Deinit(module->handle_lock);
 							free(module);
@@ -779,6 +1011,7 @@ static MODULE_HANDLE Outprocess_Create(BROKER_HANDLE broker, const void* configu
 						else if ((module->control_thread.thread_lock = Lock_Init()) == NULL)
 						{
 							connection_teardown(module);
+							message_ring_teardown(module);
 							MESSAGE_QUEUE_destroy(module->outgoing_messages);
 							Lock_Deinit(module->message_receive_thread.thread_lock);
 							Lock_Deinit(module->handle_lock);
@@ -788,6 +1021,7 @@ static MODULE_HANDLE Outprocess_Create(BROKER_HANDLE broker, const void* configu
 						else if ((module->async_create_thread.thread_lock = Lock_Init()) == NULL)
 						{
 							connection_teardown(module);
+							message_ring_teardown(module);
 							MESSAGE_QUEUE_destroy(module->outgoing_messages);
 							Lock_Deinit(module->control_thread.thread_lock);
 							Lock_Deinit(module->message_receive_thread.thread_lock);
@@ -798,6 +1032,7 @@ static MODULE_HANDLE Outprocess_Create(BROKER_HANDLE broker, const void* configu
 						else if ((module->message_send_thread.thread_lock = Lock_Init()) == NULL)
 						{
 							connection_teardown(module);
+							message_ring_teardown(module);
 							MESSAGE_QUEUE_destroy(module->outgoing_messages);
 							Lock_Deinit(module->async_create_thread.thread_lock);
 							Lock_Deinit(module->control_thread.thread_lock);
@@ -809,6 +1044,7 @@ static MODULE_HANDLE Outprocess_Create(BROKER_HANDLE broker, const void* configu
 						else if (save_strings(module, config) != 0)
 						{
 							connection_teardown(module);
+							message_ring_teardown(module);
 							MESSAGE_QUEUE_destroy(module->outgoing_messages);
 							Lock_Deinit(module->async_create_thread.thread_lock);
 							Lock_Deinit(module->control_thread.thread_lock);
@@ -828,6 +1064,7 @@ static MODULE_HANDLE Outprocess_Create(BROKER_HANDLE broker, const void* configu
 								LogError("failed to spawn a thread");
 								module->async_create_thread.thread_handle = NULL;
 								connection_teardown(module);
+								message_ring_teardown(module);
 								delete_strings(module);
 								MESSAGE_QUEUE_destroy(module->outgoing_messages);
 								Lock_Deinit(module->async_create_thread.thread_lock);
@@ -864,6 +1101,7 @@ static MODULE_HANDLE Outprocess_Create(BROKER_HANDLE broker, const void* configu
 								{
 									/*Codes_SRS_OUTPROCESS_MODULE_17_016: [ If any step in the creation fails, this function shall deallocate all resources and return NULL. ]*/
 									connection_teardown(module);
+									message_ring_teardown(module);
 									delete_strings(module);
 									MESSAGE_QUEUE_destroy(module->outgoing_messages);
 									Lock_Deinit(module->async_create_thread.thread_lock);
@@ -974,6 +1212,9 @@ static void Outprocess_Destroy(MODULE_HANDLE moduleHandle)
 		shutdown_a_thread(&(handleData->control_thread));
 		shutdown_a_thread(&(handleData->async_create_thread));
 
+		/*Codes_SRS_OUTPROCESS_MODULE_31_003: [ This function shall destroy the shared memory ring, if any, once the messaging threads have stopped. ]*/
+		message_ring_teardown(handleData);
+
 		/* Free remaining resources */
 		/*Codes_SRS_OUTPROCESS_MODULE_17_034: [ This function shall release all resources created by this module. ]*/
 		delete_strings(handleData);
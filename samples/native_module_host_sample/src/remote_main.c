@@ -2,34 +2,53 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include <stdio.h>
+#include <stdlib.h>
 #include "proxy_gateway.h"
 #include "native_module_host.h"
 
 int main(int argc, char** argv)
 {
-    REMOTE_MODULE_HANDLE remote_module;
-    if (argc != 2)
+    REMOTE_MODULE_HANDLE * remote_modules;
+    if (argc < 2)
     {
-        printf("usage: native_host_sample control_channel_id\n");
-        printf("where control_channel_id is the name of the control channel (used in URI).\n");
+        printf("usage: native_host_sample control_channel_id [control_channel_id ...]\n");
+        printf("where control_channel_id is the name of a control channel (used in URI).\n");
+        printf("One module is hosted for each control channel given.\n");
+    }
+    else if ((remote_modules = (REMOTE_MODULE_HANDLE *)calloc(argc - 1, sizeof(REMOTE_MODULE_HANDLE))) == NULL)
+    {
+        printf("failed to allocate the remote module list\n");
     }
     else
     {
-        if ((remote_module = ProxyGateway_Attach(Module_GetApi(MODULE_API_VERSION_1), argv[1])) == NULL)
+        int attached;
+        for (attached = 0; attached < (argc - 1); attached++)
         {
-            printf("failed to attach remote module from JSON\n");
+            if ((remote_modules[attached] = ProxyGateway_Attach(Module_GetApi(MODULE_API_VERSION_1), argv[attached + 1])) == NULL)
+            {
+                printf("failed to attach remote module on control channel %s\n", argv[attached + 1]);
+                break;
+            }
+            else if (0 != ProxyGateway_StartWorkerThread(remote_modules[attached]))
+            {
+                printf("failed to start the worker thread for control channel %s\n", argv[attached + 1]);
+                ProxyGateway_Detach(remote_modules[attached]);
+                break;
+            }
         }
-        else if (0 != ProxyGateway_StartWorkerThread(remote_module))
+
+        if (attached == (argc - 1))
         {
-            printf("failed to start the worker thread\n");
+            printf("%d remote module(s) successfully created\n", attached);
+            printf("remote modules shall run until ENTER is pressed\n");
+            (void)getchar();
         }
-        else
+
+        while (attached > 0)
         {
-            printf("remote module successfully created\n");
-            printf("remote module shall run until ENTER is pressed\n");
-            (void)getchar();
-			ProxyGateway_Detach(remote_module);
+            ProxyGateway_Detach(remote_modules[--attached]);
         }
+        free(remote_modules);
     }
     return 0;
 }
@@ -0,0 +1,27 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdio.h>
+
+#include "gateway.h"
+#include "static_gateway.h"
+
+/* Generated from static_gateway.json at build time. */
+extern const STATIC_GATEWAY_GRAPH static_gateway_graph;
+
+int main(void)
+{
+    GATEWAY_HANDLE gateway;
+    if ((gateway = StaticGateway_Create(&static_gateway_graph)) == NULL)
+    {
+        printf("failed to create the gateway from its compiled graph\n");
+    }
+    else
+    {
+        printf("gateway successfully created from its compiled graph\n");
+        printf("gateway shall run until ENTER is pressed\n");
+        (void)getchar();
+        Gateway_Destroy(gateway);
+    }
+    return 0;
+}